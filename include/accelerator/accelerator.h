@@ -24,7 +24,11 @@
 #include "geometry/intersect_data.h"
 #include "color/color.h"
 #include "common/memory.h"
+#include "common/memory_arena.h"
+#include "common/memory_stats.h"
+#include "accelerator/accelerator_stats.h"
 #include <vector>
+#include <memory>
 
 BEGIN_YAFARAY
 
@@ -33,11 +37,14 @@ class Bound;
 class ParamMap;
 class Ray;
 class Primitive;
+class Matrix4;
 
 struct AcceleratorIntersectData : IntersectData
 {
 	float t_max_ = std::numeric_limits<float>::infinity();
 	const Primitive *hit_primitive_ = nullptr;
+	const Matrix4 *obj_to_world_ = nullptr; //!< instance matrix of the hit primitive, when it was hit in object space by a two-level accelerator
+	std::shared_ptr<const void> hit_geometry_; //!< owner of the hit primitive when its geometry can be unloaded, keeping it alive while the hit is shaded
 };
 
 struct AcceleratorTsIntersectData : AcceleratorIntersectData
@@ -52,8 +59,28 @@ class Accelerator
 		virtual ~Accelerator() = default;
 		virtual AcceleratorIntersectData intersect(const Ray &ray, float t_max) const = 0;
 		virtual AcceleratorIntersectData intersectS(const Ray &ray, float t_max, float shadow_bias) const = 0;
-		virtual AcceleratorTsIntersectData intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float dist, float shadow_bias) const = 0;
+		virtual AcceleratorTsIntersectData intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float dist, float shadow_bias, const Matrix4 *obj_to_world = nullptr) const = 0;
 		virtual Bound getBound() const = 0;
+		/*! Ray stream versions, intersecting each ray with its own t_max. Accelerators can override them to traverse
+		 * coherent rays (for example camera rays in a tile or shadow rays towards the same light) together.
+		 * The default implementations intersect the rays one by one */
+		virtual std::vector<AcceleratorIntersectData> intersectStream(const std::vector<Ray> &rays, const std::vector<float> &t_max) const;
+		virtual std::vector<AcceleratorIntersectData> intersectStreamS(const std::vector<Ray> &rays, const std::vector<float> &t_max, float shadow_bias) const;
+		/*! Updates the accelerator after the transformation matrices of the instances it references changed,
+		 * keeping the tree structure and recalculating only the bounds.
+		 * Returns false when not supported, so the accelerator must be rebuilt */
+		virtual bool refit() { return false; }
+		/*! Build parameters and counters, for the accelerators supporting them. The traversal counters are shared by all the accelerators, so they are filled by the scene */
+		virtual AcceleratorStats getStats() const { return {}; }
+		size_t getMemory() const { return memory_tracker_.get(); } //!< bytes of its own nodes and primitive references
+
+	protected:
+		/*! Multiplies the transparent shadow throughput by the transparency of the material hit, evaluated in place while traversing the tree.
+		 * The material data of all the hits of the ray reuses the arena space from material_data_marker, as it is only needed to get each transparency.
+		 * Returns true once the throughput falls below min_transparency_, so the shadow ray can be stopped as blocked */
+		static bool accumulateTransparency(AcceleratorTsIntersectData &accelerator_intersect_data, RenderData &render_data, const MemoryArena::Marker &material_data_marker, const Primitive *primitive, const Ray &ray, const Matrix4 *obj_to_world);
+		static constexpr float min_transparency_ = 1e-3f; //!< transparent shadow throughput below which the remaining hits are not evaluated
+		MemoryTracker memory_tracker_ {MemoryStats::Accelerators}; //!< nodes and primitive references, set by each accelerator once built
 };
 
 END_YAFARAY
@@ -0,0 +1,251 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_ACCELERATOR_BVH_H
+#define YAFARAY_ACCELERATOR_BVH_H
+
+#include "accelerator/accelerator.h"
+#include "geometry/bound.h"
+#include "common/task_pool.h"
+#include "common/memory.h"
+#include "common/sysinfo.h"
+#include <array>
+
+BEGIN_YAFARAY
+
+// ============================================================
+/*! Bounding Volume Hierarchy built with binned SAH (Surface Area Heuristic).
+	Compared to the kd-trees, each primitive is referenced exactly once, so
+	the number of nodes is bounded by 2 * num_primitives - 1 and the build
+	does not need the edge sorting nor the polygon clipping.
+	The top levels of the tree are built in parallel with a work-stealing task pool.
+	Optionally, spatial splits are also evaluated as in the SBVH (Stich et al. 2009), so
+	long or diagonal primitives overlapping many nodes can be split between the children
+	within a budget of duplicated references. In that case each primitive can be referenced
+	by more than one leaf, like in the kd-trees.
+	When there are primitives moving during the frame, each node also keeps its bounds at the start and at
+	the end of the frame, interpolated at the ray time during the single ray traversals. The node bound
+	covering the whole frame is still used by the ray packets, whose rays can have different times.
+*/
+class AcceleratorBvh final : public Accelerator
+{
+	public:
+		static std::unique_ptr<Accelerator> factory(const std::vector<const Primitive *> &primitives, ParamMap &params);
+
+	private:
+		struct Parameters;
+		struct Stats;
+		struct BuildPrimitive;
+		struct BuildNode;
+		struct Bin;
+		struct SpatialBin;
+		struct SpatialSplit;
+		class Node;
+		struct RayPacket;
+		struct TriangleBlock;
+		struct TriangleRay;
+		struct TriangleBlockHits;
+		AcceleratorBvh(const std::vector<const Primitive *> &primitives, const Parameters &parameters);
+		virtual ~AcceleratorBvh() override;
+		virtual AcceleratorIntersectData intersect(const Ray &ray, float t_max) const override;
+		virtual AcceleratorIntersectData intersectS(const Ray &ray, float t_max, float shadow_bias) const override;
+		virtual AcceleratorTsIntersectData intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *obj_to_world = nullptr) const override;
+		virtual Bound getBound() const override { return tree_bound_; }
+		virtual AcceleratorStats getStats() const override { return stats_; }
+		virtual std::vector<AcceleratorIntersectData> intersectStream(const std::vector<Ray> &rays, const std::vector<float> &t_max) const override;
+		virtual std::vector<AcceleratorIntersectData> intersectStreamS(const std::vector<Ray> &rays, const std::vector<float> &t_max, float shadow_bias) const override;
+
+		std::unique_ptr<BuildNode> buildTree(std::vector<BuildPrimitive> &build_primitives, uint32_t begin, uint32_t end, int depth, const Parameters &parameters, Stats &stats) const;
+		void buildTreeWorker(std::vector<BuildPrimitive> &build_primitives, uint32_t begin, uint32_t end, int depth, const Parameters &parameters, Stats &stats, std::unique_ptr<BuildNode> &result) const;
+		SpatialSplit findSpatialSplit(const std::vector<BuildPrimitive> &build_primitives, uint32_t begin, uint32_t end, const Bound &node_bound, const Parameters &parameters) const;
+		static void splitReference(const BuildPrimitive &build_primitive, int axis, float position, BuildPrimitive &left, BuildPrimitive &right, bool &left_valid, bool &right_valid);
+		static bool clipReference(const BuildPrimitive &build_primitive, const Bound &clip_bound, Bound &result);
+		uint32_t flattenTree(const BuildNode &build_node, const std::vector<const Primitive *> &primitives, bool align_leaves);
+		void buildTriangleBlocks();
+		void buildRayMasks();
+		void buildMotionBounds(); //!< node bounds at the start and at the end of the frame, calculated from the leaves up
+		Bound nodeBound(uint32_t node_id, float time) const;
+		static float surfaceArea(const Bound &bound);
+		static bool crossesNode(const Bound &bound, const Point3 &from, const Vec3 &inv_dir, float t_max);
+		static uint32_t crossesNode(const Bound &bound, const RayPacket &packet, uint32_t active_mask);
+		static uint32_t crossesNodeSse42(const Bound &bound, const RayPacket &packet, uint32_t active_mask);
+		static uint32_t crossesNodeAvx2(const Bound &bound, const RayPacket &packet, uint32_t active_mask);
+		void intersectPacket(const std::vector<Ray> &rays, const std::vector<float> &t_max, size_t first_ray, std::vector<AcceleratorIntersectData> &results) const;
+		void intersectPacketS(const std::vector<Ray> &rays, const std::vector<float> &t_max, size_t first_ray, std::vector<AcceleratorIntersectData> &results) const;
+		static uint32_t intersectBlock(const TriangleBlock &block, const TriangleRay &triangle_ray, TriangleBlockHits &hits);
+		static uint32_t intersectBlockSse42(const TriangleBlock &block, const TriangleRay &triangle_ray, TriangleBlockHits &hits);
+		static uint32_t intersectBlockAvx2(const TriangleBlock &block, const TriangleRay &triangle_ray, TriangleBlockHits &hits);
+		void selectSimdKernels();
+		template <typename HitFunc> bool intersectLeaf(const Node &node, const Ray &ray, const TriangleRay &triangle_ray, uint8_t ray_type, const HitFunc &hit_func) const;
+
+		Bound tree_bound_;
+		LargeVector<Node> nodes_;
+		std::vector<const Primitive *> primitives_; //!< primitives sorted so each leaf references a contiguous range
+		std::vector<uint8_t> ray_masks_; //!< RayTypeMask of each entry of primitives_, from the object and material visibility
+		std::vector<std::array<Bound, 2>> motion_bounds_; //!< if not empty, bounds of each node at the start and at the end of the frame
+		LargeVector<TriangleBlock> triangle_blocks_; //!< if not empty, one block for each block_size_ entries of primitives_
+		//! SIMD kernels compiled for the instruction set chosen at run time, all of them giving exactly the same results
+		uint32_t (*crosses_node_packet_)(const Bound &bound, const RayPacket &packet, uint32_t active_mask) = crossesNode;
+		uint32_t (*intersect_block_)(const TriangleBlock &block, const TriangleRay &triangle_ray, TriangleBlockHits &hits) = intersectBlock;
+		SysInfo::SimdLevel simd_level_ = SysInfo::SimdLevel::Generic; //!< instruction set of the kernels in use
+		AcceleratorStats stats_;
+		std::unique_ptr<TaskPool> task_pool_; //!< only during the build, shared by all the subtree builds
+		float spatial_split_min_overlap_ = 0.f; //!< spatial splits are only evaluated when the children of the object split overlap more than this area
+		mutable std::atomic<int64_t> spatial_split_references_left_ {0}; //!< remaining budget of duplicated references, shared by all the build threads
+		bool has_duplicated_references_ = false; //!< the spatial splits referenced some primitives in several leaves, so their transparent shadow hits must be filtered
+		static constexpr int max_stack_ = 64;
+		static constexpr uint32_t packet_size_ = 8; //!< rays per packet in the ray stream traversal, less than 32 so the packet masks fit in 32 bits
+		static constexpr uint32_t block_size_ = 4; //!< triangles per precomputed triangle block, matching the default leaf size
+};
+
+struct AcceleratorBvh::Parameters
+{
+	int max_leaf_size_ = 4; //!< leaves are forced to split above this size
+	int num_bins_ = 16; //!< number of SAH bins evaluated per axis and per node
+	float cost_ratio_ = 0.125f; //!< node traversal cost divided by primitive intersection cost
+	int num_threads_ = 1;
+	int min_indices_to_spawn_threads_ = 10000; //!< only spawn threads for subtrees with more primitives than this, to avoid the overhead in small subtrees
+	bool triangle_blocks_ = true; //!< store the leaf triangles precomputed in SoA blocks, tested with the watertight ray-triangle test
+	bool spatial_splits_ = false; //!< also evaluate spatial splits (SBVH), duplicating the references of the primitives crossing the split plane
+	float spatial_split_budget_ = 0.3f; //!< maximum number of duplicated references created by the spatial splits, relative to the number of primitives
+	HugePages::Mode huge_pages_mode_ = HugePages::Mode::None; //!< of the scene, for the nodes and triangle blocks
+};
+
+struct AcceleratorBvh::Stats
+{
+	void outputLog(uint32_t num_primitives, uint32_t num_nodes) const;
+	Stats &operator += (const Stats &stats);
+	int interior_nodes_ = 0;
+	int leaves_ = 0;
+	int max_leaf_primitives_ = 0;
+	int forced_splits_ = 0;
+	int max_depth_ = 0;
+	int spatial_splits_ = 0;
+	int duplicated_references_ = 0;
+};
+
+/*! Reference to a primitive during the build. With spatial splits a primitive can have several
+	references, each one with the bound of the part of the primitive inside its node */
+struct AcceleratorBvh::BuildPrimitive
+{
+	Bound bound_;
+	Point3 centroid_;
+	uint32_t primitive_index_;
+	const Primitive *primitive_;
+};
+
+struct AcceleratorBvh::BuildNode
+{
+	Bound bound_;
+	std::array<std::unique_ptr<BuildNode>, 2> children_;
+	std::vector<uint32_t> primitive_indices_; //!< leaf primitives
+	int axis_ = 0;
+	bool isLeaf() const { return !children_[0]; }
+};
+
+struct AcceleratorBvh::Bin
+{
+	Bound bound_;
+	uint32_t count_ = 0;
+};
+
+/*! Spatial split bins also count the references entering and leaving each bin, as the references crossing the bins are clipped and counted in all of them */
+struct AcceleratorBvh::SpatialBin
+{
+	Bound bound_;
+	bool empty_ = true;
+	uint32_t entries_ = 0;
+	uint32_t exits_ = 0;
+};
+
+struct AcceleratorBvh::SpatialSplit
+{
+	float cost_ = std::numeric_limits<float>::infinity();
+	int axis_ = -1;
+	float position_ = 0.f;
+	uint32_t num_left_ = 0;
+	uint32_t num_right_ = 0;
+};
+
+/*! Rays of a packet in SoA layout, so the node tests of all the rays in the packet can be vectorized by the compiler */
+struct AcceleratorBvh::RayPacket
+{
+	RayPacket(const std::vector<Ray> &rays, const std::vector<float> &t_max, size_t first_ray);
+	std::array<std::array<float, packet_size_>, 3> from_;
+	std::array<std::array<float, packet_size_>, 3> inv_dir_;
+	std::array<float, packet_size_> t_max_;
+	uint32_t num_rays_;
+	uint32_t active_mask_; //!< one bit per ray in the packet
+};
+
+/*! Vertices of block_size_ triangles in SoA layout, so a ray can be tested against all the triangles of the
+	block at the same time. Lanes with primitives that are not triangles, or padding lanes, have their bit cleared
+	in the triangle mask and the primitives are intersected with their own intersect function instead
+*/
+struct AcceleratorBvh::TriangleBlock
+{
+	std::array<std::array<float, block_size_>, 3> vertex_0_; //!< [axis][lane]
+	std::array<std::array<float, block_size_>, 3> vertex_1_;
+	std::array<std::array<float, block_size_>, 3> vertex_2_;
+	std::array<float, block_size_> epsilon_; //!< minimum hit distance, the same used in the triangle primitive intersect
+	uint32_t triangle_mask_ = 0; //!< one bit per lane containing a triangle
+};
+
+/*! Per ray precomputed data for the watertight ray-triangle test: the ray is transformed so it goes along
+	the +Z axis, permuting the axes so the largest direction component is Z and shearing X and Y
+*/
+struct AcceleratorBvh::TriangleRay
+{
+	TriangleRay() = default;
+	explicit TriangleRay(const Ray &ray);
+	std::array<float, 3> from_;
+	int axis_x_, axis_y_, axis_z_;
+	float shear_x_, shear_y_, shear_z_;
+};
+
+struct AcceleratorBvh::TriangleBlockHits
+{
+	std::array<float, block_size_> t_;
+	std::array<float, block_size_> barycentric_u_;
+	std::array<float, block_size_> barycentric_v_;
+	std::array<float, block_size_> barycentric_w_;
+};
+
+// ============================================================
+/*! BVH nodes stored in depth-first order, so the first child of an interior node
+	is always the next node. 32 bytes per node.
+*/
+class AcceleratorBvh::Node
+{
+	public:
+		void createLeaf(uint32_t primitives_offset, uint32_t num_primitives) { offset_ = primitives_offset; flags_ = (num_primitives << 2) | 3; }
+		void createInterior(int axis) { flags_ = static_cast<uint32_t>(axis); }
+		void setSecondChild(uint32_t node_id) { offset_ = node_id; }
+		bool isLeaf() const { return (flags_ & 3) == 3; }
+		uint32_t getPrimitivesOffset() const { return offset_; }
+		uint32_t getSecondChild() const { return offset_; }
+		uint32_t getNumPrimitives() const { return flags_ >> 2; }
+		int getSplitAxis() const { return flags_ & 3; }
+		Bound bound_;
+		uint32_t offset_; //!< leaf: offset into the primitives array. Interior: index of the second child
+		uint32_t flags_; //!< 2bits: isLeaf, axis; 30bits: nprims (leaf)
+};
+
+END_YAFARAY
+#endif    //YAFARAY_ACCELERATOR_BVH_H
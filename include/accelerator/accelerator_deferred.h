@@ -0,0 +1,97 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_ACCELERATOR_DEFERRED_H
+#define YAFARAY_ACCELERATOR_DEFERRED_H
+
+#include "accelerator/accelerator.h"
+#include "common/param.h"
+#include <atomic>
+#include <mutex>
+
+BEGIN_YAFARAY
+
+class DeferredObject;
+class MeshObject;
+class Material;
+
+// ============================================================
+/*! Bottom level accelerator of a DeferredObject, placed in the two-level accelerator with the bound declared by the object.
+	The first ray entering the bound loads the mesh and builds its accelerator, the other threads reaching it meanwhile wait for them.
+	The loaded geometries share a cache with a memory budget, evicting the least recently hit ones when a new geometry exceeds it.
+	An evicted geometry stays alive while any thread is traversing it, and the camera and bounce hits hold it in their surface point,
+	so the hit primitives stay valid while they are shaded even if they were evicted meanwhile
+*/
+class AcceleratorDeferred final : public Accelerator
+{
+	public:
+		class Cache;
+		AcceleratorDeferred(const DeferredObject &object, const ParamMap &params, std::shared_ptr<Cache> cache);
+		virtual ~AcceleratorDeferred() override;
+
+	private:
+		struct Geometry
+		{
+			std::unique_ptr<MeshObject> mesh_;
+			std::unique_ptr<Accelerator> accelerator_;
+			const Material *material_; //!< of the object when it was loaded, the geometry is reloaded after a material update
+			size_t bytes_;
+		};
+		virtual AcceleratorIntersectData intersect(const Ray &ray, float t_max) const override;
+		virtual AcceleratorIntersectData intersectS(const Ray &ray, float t_max, float shadow_bias) const override;
+		virtual AcceleratorTsIntersectData intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *obj_to_world = nullptr) const override;
+		virtual Bound getBound() const override;
+		virtual AcceleratorStats getStats() const override;
+		std::shared_ptr<const Geometry> acquire() const; //!< the loaded geometry, loading it if needed. nullptr when it could not be loaded
+		std::shared_ptr<const Geometry> load() const;
+		void evict() const;
+
+		const DeferredObject &object_;
+		ParamMap params_; //!< to build the accelerator of the loaded mesh
+		std::shared_ptr<Cache> cache_;
+		mutable std::shared_ptr<const Geometry> geometry_; //!< read and written with the atomic shared_ptr functions, nullptr while not loaded
+		mutable std::mutex load_mutex_;
+		mutable std::atomic<bool> load_failed_ {false}; //!< the file is not read again after an error
+		mutable std::atomic<uint64_t> last_used_ {0}; //!< cache tick of the last hit, for the eviction order
+		mutable std::atomic<uint32_t> num_loads_ {0};
+};
+
+// ============================================================
+/*! Loaded geometries of the deferred accelerators sharing a memory budget. The tick advances with each load, so the hits only
+	write their accelerator last used tick when it changed
+*/
+class AcceleratorDeferred::Cache final
+{
+	public:
+		explicit Cache(size_t budget) : budget_(budget) { }
+		uint64_t tick() const { return tick_.load(std::memory_order_relaxed); }
+		/*! accounts a new loaded geometry, evicting the least recently used geometries of the other accelerators until the budget is met */
+		void insert(const AcceleratorDeferred *accelerator, size_t bytes);
+		void remove(const AcceleratorDeferred *accelerator);
+
+	private:
+		std::mutex mutex_;
+		std::vector<std::pair<const AcceleratorDeferred *, size_t>> loaded_; //!< accelerators with a loaded geometry and its size
+		size_t used_ = 0;
+		size_t budget_; //!< bytes, 0 for no limit
+		std::atomic<uint64_t> tick_ {1};
+};
+
+END_YAFARAY
+#endif    //YAFARAY_ACCELERATOR_DEFERRED_H
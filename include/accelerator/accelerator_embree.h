@@ -0,0 +1,95 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_ACCELERATOR_EMBREE_H
+#define YAFARAY_ACCELERATOR_EMBREE_H
+
+#ifdef HAVE_EMBREE
+
+#include "accelerator/accelerator.h"
+#include "geometry/bound.h"
+
+struct RTCDeviceTy;
+struct RTCSceneTy;
+struct RTCFilterFunctionNArguments;
+struct RTCIntersectFunctionNArguments;
+struct RTCOccludedFunctionNArguments;
+struct RTCBoundsFunctionArguments;
+
+BEGIN_YAFARAY
+
+class Object;
+class Matrix4;
+
+// ============================================================
+/*! Accelerator using the Embree ray tracing kernels for the tree build and traversal.
+	The static triangles of each mesh are given to Embree as triangle geometries with the mesh vertices and face indices,
+	the other primitives (and the moving ones) as user geometries intersected by their own intersect functions.
+	The instances of the base objects are Embree instances of a scene built once per base object.
+	The object and material visibility and the transparent shadows are handled in the Embree filter callbacks
+*/
+class AcceleratorEmbree final : public Accelerator
+{
+	public:
+		static std::unique_ptr<Accelerator> factory(const std::vector<const Primitive *> &primitives, ParamMap &params);
+		/*! with the instances, falling back to the two-level accelerator (with Embree accelerators for each base object) when there are deferred objects, not supported by Embree */
+		static std::unique_ptr<Accelerator> factory(const std::vector<const Primitive *> &primitives, const std::vector<const Object *> &instances, ParamMap &params);
+		virtual ~AcceleratorEmbree() override;
+
+	private:
+		struct Geometry;
+		struct IntersectContext;
+		explicit AcceleratorEmbree(int num_threads);
+		virtual AcceleratorIntersectData intersect(const Ray &ray, float t_max) const override;
+		virtual AcceleratorIntersectData intersectS(const Ray &ray, float t_max, float shadow_bias) const override;
+		virtual AcceleratorTsIntersectData intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *obj_to_world = nullptr) const override;
+		virtual Bound getBound() const override { return bound_; }
+		virtual bool refit() override;
+		virtual AcceleratorStats getStats() const override;
+
+		RTCSceneTy *newScene() const;
+		void addGeometries(RTCSceneTy *scene, const std::vector<const Primitive *> &primitives); //!< adds the geometries of the primitives to a scene, and its entry to scene_geometries_
+		void addInstance(size_t object_scene_index, const Matrix4 *obj_to_world); //!< object_scene_index is the index in scene_geometries_ of the instanced scene
+		void commit();
+		void setInstanceTransform(unsigned int geometry_id) const;
+		const Geometry *getHitGeometry(unsigned int instance_id, unsigned int geometry_id) const;
+		/*! applies the ray visibility and the transparent shadows to a hit found by Embree, returns false if the hit must be ignored */
+		static bool acceptHit(IntersectContext &context, const Geometry &geometry, unsigned int primitive_id, const Ray &ray, const IntersectData &intersect_data);
+		static void filterHits(const RTCFilterFunctionNArguments *args);
+		static void intersectUserPrimitive(const RTCIntersectFunctionNArguments *args);
+		static void occludedUserPrimitive(const RTCOccludedFunctionNArguments *args);
+		static void userPrimitiveBounds(const RTCBoundsFunctionArguments *args);
+
+		RTCDeviceTy *device_ = nullptr;
+		RTCSceneTy *scene_ = nullptr;
+		std::vector<RTCSceneTy *> object_scenes_; //!< scenes of the base objects, referenced by the instances
+		std::vector<std::unique_ptr<Geometry>> geometries_;
+		std::vector<std::vector<const Geometry *>> scene_geometries_; //!< for the main scene (first) and each object scene, its geometries by Embree geometry id, nullptr for the instances
+		std::vector<const Matrix4 *> instance_matrices_; //!< by geometry id in the main scene, nullptr for the geometries not being instances
+		std::vector<size_t> instance_object_scenes_; //!< by geometry id in the main scene, the index in scene_geometries_ of the instanced scene
+		Bound bound_;
+		size_t num_primitives_ = 0;
+		size_t num_instances_ = 0;
+};
+
+END_YAFARAY
+
+#endif // HAVE_EMBREE
+
+#endif    //YAFARAY_ACCELERATOR_EMBREE_H
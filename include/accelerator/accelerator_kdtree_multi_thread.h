@@ -24,7 +24,7 @@
 #include "geometry/bound.h"
 #include "geometry/primitive.h"
 #include "scene/yafaray/object_yafaray.h"
-#include "common/thread.h"
+#include "common/task_pool.h"
 #include <array>
 
 BEGIN_YAFARAY
@@ -56,21 +56,31 @@ class AcceleratorKdTreeMultiThread final : public Accelerator
 		virtual ~AcceleratorKdTreeMultiThread() override;
 		virtual AcceleratorIntersectData intersect(const Ray &ray, float t_max) const override;
 		virtual AcceleratorIntersectData intersectS(const Ray &ray, float t_max, float shadow_bias) const override;
-		virtual AcceleratorTsIntersectData intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias) const override;
+		virtual AcceleratorTsIntersectData intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *obj_to_world = nullptr) const override;
 		virtual Bound getBound() const override { return tree_bound_; }
+		virtual AcceleratorStats getStats() const override { return stats_; }
 
 		Result buildTree(const std::vector<const Primitive *> &primitives, const Bound &node_bound, const std::vector<uint32_t> &indices, int depth, uint32_t next_node_id, int bad_refines, const std::vector<Bound> &bounds, const Parameters &parameters, const ClipPlane &clip_plane, const std::vector<PolyDouble> &polygons, const std::vector<uint32_t> &primitive_indices) const;
 		void buildTreeWorker(const std::vector<const Primitive *> &primitives, const Bound &node_bound, const std::vector<uint32_t> &indices, int depth, uint32_t next_node_id, int bad_refines, const std::vector<Bound> &bounds, const Parameters &parameters, const ClipPlane &clip_plane, const std::vector<PolyDouble> &polygons, const std::vector<uint32_t> &primitive_indices, Result &result) const;
-		static SplitCost pigeonMinCost(float e_bonus, float cost_ratio, const std::vector<Bound> &bounds, const Bound &node_bound, const std::vector<uint32_t> &prim_indices);
+		static SplitCost pigeonMinCost(float e_bonus, float cost_ratio, const std::vector<Bound> &bounds, const Bound &node_bound, const std::vector<uint32_t> &prim_indices, TaskPool *task_pool); //!< with a task pool the three axes are binned in parallel
+		static SplitCost pigeonMinCostAxis(int axis, float e_bonus, float cost_ratio, const std::vector<Bound> &bounds, const Bound &node_bound, const std::vector<uint32_t> &prim_indices);
 		static SplitCost minimalCost(float e_bonus, float cost_ratio, const Bound &node_bound, const std::vector<uint32_t> &indices, const std::vector<Bound> &bounds);
-		static AcceleratorIntersectData intersect(const Ray &ray, float t_max, const std::vector<Node> &nodes, const Bound &tree_bound);
-		static AcceleratorIntersectData intersectS(const Ray &ray, float t_max, float shadow_bias, const std::vector<Node> &nodes, const Bound &tree_bound);
-		static AcceleratorTsIntersectData intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const std::vector<Node> &nodes, const Bound &tree_bound);
+		static void appendResult(Result &result, const Result &sub_result);
+		static uint64_t cacheHash(const std::vector<const Primitive *> &primitives, const Parameters &parameters);
+		bool loadCache(const std::string &path, uint64_t hash, const std::vector<const Primitive *> &primitives);
+		bool saveCache(const std::string &path, uint64_t hash, const std::vector<const Primitive *> &primitives) const;
+		AcceleratorStats makeStats(const Parameters &parameters, const Stats &build_stats, float build_seconds, bool loaded_from_cache) const;
+		static AcceleratorIntersectData intersect(const Ray &ray, float t_max, const Node *nodes, const std::vector<const Primitive *> &primitives, const Bound &tree_bound);
+		static AcceleratorIntersectData intersectS(const Ray &ray, float t_max, float shadow_bias, const Node *nodes, const std::vector<const Primitive *> &primitives, const Bound &tree_bound);
+		static AcceleratorTsIntersectData intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *obj_to_world, const Node *nodes, const std::vector<const Primitive *> &primitives, const Bound &tree_bound);
 
 		Bound tree_bound_; 	//!< overall space the tree encloses
-		std::vector<Node> nodes_;
-		mutable std::atomic<int> num_current_threads_ { 0 };
+		LargeVector<Node> nodes_; //!< aligned to cache lines, so nodes close in the tree share the same cache line, and backed by huge pages if enabled
+		std::vector<const Primitive *> primitives_; //!< primitives of all the leaves, each leaf references a contiguous range
+		AcceleratorStats stats_;
+		std::unique_ptr<TaskPool> task_pool_; //!< only during the build, shared by all the subtree builds
 		static constexpr int kd_max_stack_ = 64;
+		static constexpr const char *cache_header_ = "YAF_KDTREE_MTv1"; //!< header of the tree cache files, to be changed if the node layout changes
 };
 
 struct AcceleratorKdTreeMultiThread::Parameters
@@ -81,6 +91,8 @@ struct AcceleratorKdTreeMultiThread::Parameters
 	float empty_bonus_ = 0.33;
 	int num_threads_ = 1;
 	int min_indices_to_spawn_threads_ = 10000; //Only spawn threaded subtree building when the number of indices in the subtree is higher than this value to prevent slowdown due to very small subtree left indices
+	std::string cache_dir_; //!< if not empty, the built trees are saved to and loaded from this directory, keyed by a hash of the primitives
+	HugePages::Mode huge_pages_mode_ = HugePages::Mode::None; //!< of the scene, for the nodes
 };
 
 struct AcceleratorKdTreeMultiThread::Stats
@@ -100,24 +112,30 @@ struct AcceleratorKdTreeMultiThread::Stats
 };
 
 // ============================================================
-/*! kd-tree nodes, kept as small as possible
-    double precision float and/or 64 bit system: 12bytes
-    else 8 bytes */
+/*! kd-tree nodes, kept as small as possible: 8 bytes.
+    Leaves do not own their primitives, they reference a range of the shared primitives array */
 
 class AcceleratorKdTreeMultiThread::Node
 {
 	public:
-		Stats createLeaf(const std::vector<uint32_t> &prim_indices, const std::vector<const Primitive *> &primitives);
+		Stats createLeaf(const std::vector<uint32_t> &prim_indices, const std::vector<const Primitive *> &primitives, std::vector<const Primitive *> &leaf_primitives);
 		Stats createInterior(Axis axis, float d);
 		float splitPos() const { return division_; }
 		int splitAxis() const { return flags_ & 3; }
-		int nPrimitives() const { return primitives_.size(); /*flags_ >> 2; */ }
+		uint32_t nPrimitives() const { return flags_ >> 2; }
+		uint32_t getPrimitivesOffset() const { return primitives_offset_; }
+		void setPrimitivesOffset(uint32_t offset) { primitives_offset_ = offset; }
 		bool isLeaf() const { return (flags_ & 3) == 3; }
 		uint32_t getRightChild() const { return (flags_ >> 2); }
 		void setRightChild(uint32_t i) { flags_ = (flags_ & 3) | (i << 2); }
-		float division_; //!< interior: division plane position
-		std::vector<const Primitive *> primitives_; //!< leaf: list of primitives
-		uint32_t flags_; //!< 2bits: isLeaf, axis; 30bits: nprims (leaf) or index of right child
+
+	private:
+		union
+		{
+			float division_; //!< interior: division plane position
+			uint32_t primitives_offset_; //!< leaf: offset of the first primitive in the shared primitives array
+		};
+		uint32_t flags_ = 0; //!< 2bits: isLeaf, axis; 30bits: nprims (leaf) or index of right child
 };
 
 /*! Stack elements for the custom stack of the recursive traversal */
@@ -173,20 +191,19 @@ struct AcceleratorKdTreeMultiThread::Result
 {
 	Stats stats_;
 	std::vector<Node> nodes_;
+	std::vector<const Primitive *> primitives_; //!< leaf primitives, the leaf offsets are relative to this subtree result
 };
 
 
-inline AcceleratorKdTreeMultiThread::Stats AcceleratorKdTreeMultiThread::Node::createLeaf(const std::vector<uint32_t> &prim_indices, const std::vector<const Primitive *> &primitives)
+inline AcceleratorKdTreeMultiThread::Stats AcceleratorKdTreeMultiThread::Node::createLeaf(const std::vector<uint32_t> &prim_indices, const std::vector<const Primitive *> &primitives, std::vector<const Primitive *> &leaf_primitives)
 {
 	const uint32_t num_prim_indices = prim_indices.size();
 	AcceleratorKdTreeMultiThread::Stats kd_stats;
-	primitives_.clear();
-	//flags_ = num_prim_indices << 2;
-	flags_ |= 3;
+	primitives_offset_ = static_cast<uint32_t>(leaf_primitives.size());
+	flags_ = (num_prim_indices << 2) | 3;
 	if(num_prim_indices >= 1)
 	{
-		primitives_.reserve(num_prim_indices);
-		for(const auto &prim_id : prim_indices) primitives_.emplace_back(primitives[prim_id]);
+		for(const auto &prim_id : prim_indices) leaf_primitives.emplace_back(primitives[prim_id]);
 		kd_stats.kd_prims_ += num_prim_indices; //stat
 	}
 	else kd_stats.empty_kd_leaves_++; //stat
@@ -198,7 +215,7 @@ inline AcceleratorKdTreeMultiThread::Stats AcceleratorKdTreeMultiThread::Node::c
 {
 	AcceleratorKdTreeMultiThread::Stats kd_stats;
 	division_ = d;
-	flags_ = (flags_ & ~3) | axis.get();
+	flags_ = axis.get();
 	kd_stats.kd_inodes_++;
 	return kd_stats;
 }
@@ -0,0 +1,90 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_ACCELERATOR_STATS_H
+#define YAFARAY_ACCELERATOR_STATS_H
+
+#include "constants.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+BEGIN_YAFARAY
+
+/*! Traversal counters. Each thread accumulates its counters in its own storage, so the
+	traversal does not need any synchronization, and the totals are obtained adding the
+	counters of all the threads. The counters are shared by all the accelerators of the scene
+*/
+struct AcceleratorTraversalStats
+{
+	AcceleratorTraversalStats &operator += (const AcceleratorTraversalStats &stats);
+	static AcceleratorTraversalStats &threadStats(); //!< counters of the calling thread
+	static AcceleratorTraversalStats total(); //!< sum of the counters of all the threads, not to be called while rendering
+	static void reset(); //!< not to be called while rendering
+	uint64_t rays_ = 0; //!< closest hit rays, counted by the scene for any accelerator
+	uint64_t shadow_rays_ = 0; //!< shadow and transparent shadow rays, counted by the scene for any accelerator
+	//! the counters below are only counted with the RENDER_STATS build option, as they are incremented in the traversal loops
+	uint64_t nodes_visited_ = 0; //!< interior and leaf nodes
+	uint64_t leaves_visited_ = 0;
+	uint64_t primitive_tests_ = 0;
+	uint64_t shadow_early_outs_ = 0; //!< shadow rays ending the traversal at an occluding primitive
+};
+
+/*! Traversal counters of a single ray, kept locally during the traversal and added to the thread counters
+	when going out of scope, so the thread storage is only accessed once per ray. Without the RENDER_STATS
+	build option the node counting functions are empty */
+class AcceleratorRayStats
+{
+	public:
+#ifdef RENDER_STATS
+		~AcceleratorRayStats();
+		void addNode() { ++nodes_visited_; }
+		void addLeaf(uint32_t num_primitives) { ++nodes_visited_; ++leaves_visited_; primitive_tests_ += num_primitives; }
+		void setEarlyOut() { early_out_ = true; }
+#else
+		void addNode() { }
+		void addLeaf(uint32_t num_primitives) { }
+		void setEarlyOut() { }
+#endif
+
+#ifdef RENDER_STATS
+	private:
+		bool early_out_ = false;
+		uint32_t nodes_visited_ = 0;
+		uint32_t leaves_visited_ = 0;
+		uint32_t primitive_tests_ = 0;
+#endif
+};
+
+/*! Build counters of an accelerator, for example to compare SAH parameters in a given scene, and
+	the scene traversal counters */
+struct AcceleratorStats
+{
+	/*! the nested accelerators are written without the traversal counters, as they are shared. The non finite values and the
+		traversal counters not counted without RENDER_STATS are written as null */
+	std::string toJson(bool with_traversal = true) const;
+	std::string accelerator_; //!< accelerator type
+	std::vector<std::pair<std::string, double>> build_; //!< accelerator specific build parameters and counters
+	std::vector<AcceleratorStats> children_; //!< stats of the nested accelerators, like the per object accelerators of the two-level accelerator
+	AcceleratorTraversalStats traversal_;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_ACCELERATOR_STATS_H
@@ -0,0 +1,97 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_ACCELERATOR_TWO_LEVEL_H
+#define YAFARAY_ACCELERATOR_TWO_LEVEL_H
+
+#include "accelerator/accelerator.h"
+#include "geometry/bound.h"
+#include "geometry/matrix4.h"
+
+BEGIN_YAFARAY
+
+class Object;
+
+// ============================================================
+/*! Two-level accelerator for instanced geometry.
+	One bottom-level accelerator is built in object space for each base object, and
+	shared between all its instances. The top level is a small BVH over the instance
+	world bounds: rays are transformed into object space when they reach an instance,
+	so memory scales with the unique geometry instead of with the number of instances.
+	Non-instanced primitives are kept in their own world space accelerator.
+*/
+class AcceleratorTwoLevel final : public Accelerator
+{
+	public:
+		static std::unique_ptr<Accelerator> factory(const std::vector<const Primitive *> &primitives, const std::vector<const Object *> &instances, ParamMap &params);
+
+	private:
+		struct Instance;
+		class Node;
+		AcceleratorTwoLevel(std::unique_ptr<Accelerator> primitives_accelerator, std::vector<std::unique_ptr<Accelerator>> object_accelerators, std::vector<Instance> instances);
+		virtual AcceleratorIntersectData intersect(const Ray &ray, float t_max) const override;
+		virtual AcceleratorIntersectData intersectS(const Ray &ray, float t_max, float shadow_bias) const override;
+		virtual AcceleratorTsIntersectData intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *obj_to_world = nullptr) const override;
+		virtual Bound getBound() const override { return tree_bound_; }
+		virtual bool refit() override;
+		virtual AcceleratorStats getStats() const override;
+
+		uint32_t buildTree(uint32_t begin, uint32_t end, int depth);
+		template <typename InstanceFunc> void traverse(const Ray &ray, const float &t_max, const InstanceFunc &instance_func) const;
+		static Ray objectRay(const Instance &instance, const Ray &ray);
+		static Bound instanceBound(const Bound &object_bound, const Matrix4 &obj_to_world);
+
+		Bound tree_bound_;
+		std::unique_ptr<Accelerator> primitives_accelerator_; //!< non-instanced primitives, in world space
+		std::vector<std::unique_ptr<Accelerator>> object_accelerators_; //!< one accelerator per base object, in object space
+		std::vector<Instance> instances_; //!< sorted so each top level leaf references a contiguous range
+		std::vector<Node> nodes_;
+		static constexpr int max_stack_ = 64;
+		static constexpr uint32_t max_leaf_size_ = 2;
+};
+
+struct AcceleratorTwoLevel::Instance
+{
+	const Accelerator *accelerator_;
+	const Matrix4 *obj_to_world_;
+	Matrix4 world_to_obj_;
+	Bound bound_; //!< world space bound
+};
+
+// ============================================================
+/*! Top level nodes stored in depth-first order, using the same layout as the BVH nodes.
+*/
+class AcceleratorTwoLevel::Node
+{
+	public:
+		void createLeaf(uint32_t instances_offset, uint32_t num_instances) { offset_ = instances_offset; flags_ = (num_instances << 2) | 3; }
+		void createInterior(int axis) { flags_ = static_cast<uint32_t>(axis); }
+		void setSecondChild(uint32_t node_id) { offset_ = node_id; }
+		bool isLeaf() const { return (flags_ & 3) == 3; }
+		uint32_t getInstancesOffset() const { return offset_; }
+		uint32_t getSecondChild() const { return offset_; }
+		uint32_t getNumInstances() const { return flags_ >> 2; }
+		int getSplitAxis() const { return flags_ & 3; }
+		Bound bound_;
+		uint32_t offset_; //!< leaf: offset into the instances array. Interior: index of the second child
+		uint32_t flags_; //!< 2bits: isLeaf, axis; 30bits: ninstances (leaf)
+};
+
+END_YAFARAY
+#endif    //YAFARAY_ACCELERATOR_TWO_LEVEL_H
@@ -21,6 +21,7 @@
 #define YAFARAY_BACKGROUND_H
 
 #include <memory>
+#include <cstdint>
 #include "constants.h"
 
 BEGIN_YAFARAY
@@ -31,6 +32,7 @@ class RenderData;
 class Light;
 class Rgb;
 class Ray;
+class Vec3;
 
 class Background
 {
@@ -40,6 +42,14 @@ class Background
 		//! get the background color for a given ray
 		virtual Rgb operator()(const Ray &ray, RenderData &render_data, bool from_postprocessed = false) const = 0;
 		virtual Rgb eval(const Ray &ray, bool from_postprocessed = false) const = 0;
+		//! background color averaged over a cone of about the given angle, used to build the background light distribution
+		virtual Rgb evalFiltered(const Ray &ray, float angle) const;
+		//! identifies the background light distribution to reuse it in the next renders of the session, 0 if it cannot be reused
+		virtual uint64_t getDistributionKey() const { return 0; }
+		//! precomputations needing the loaded textures, done in the scene setup before rendering
+		virtual void init(Scene &scene) { }
+		//! irradiance from the whole background divided by pi, without occlusion, for the diffuse look-ups ending the paths. Returns false if not available
+		virtual bool evalIrradiance(const Vec3 &normal, Rgb &irradiance) const { return false; }
 		/*! get the light source representing background lighting.
 			\return the light source that reproduces background lighting, or nullptr if background
 					shall only be sampled from BSDFs
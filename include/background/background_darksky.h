@@ -28,6 +28,7 @@
 
 #include <memory>
 #include "background.h"
+#include "background/sky_table.h"
 #include "geometry/vector.h"
 #include "color/color_conversion.h"
 
@@ -47,6 +48,7 @@ class DarkSkyBackground final : public Background
 		virtual Rgb eval(const Ray &ray, bool from_postprocessed = false) const override;
 		Rgb getAttenuatedSunColor();
 		Rgb getSkyCol(const Ray &ray) const;
+		Rgb computeSkyCol(const Vec3 &dir) const;
 		double perezFunction(const double *lam, double cos_theta, double gamma, double cos_gamma, double lvz) const;
 		double prePerez(const double *perez);
 		Rgb getSunColorFromSunRad();
@@ -63,6 +65,7 @@ class DarkSkyBackground final : public Background
 		ColorConv color_conv_;
 		float alt_;
 		bool night_sky_;
+		SkyTable sky_table_;
 };
 
 END_YAFARAY
@@ -23,6 +23,7 @@
 #define YAFARAY_BACKGROUND_SUNSKY_H
 
 #include "background.h"
+#include "background/sky_table.h"
 #include "color/color.h"
 #include "geometry/vector.h"
 
@@ -47,6 +48,7 @@ class SunSkyBackground final : public Background
 		virtual Rgb operator()(const Ray &ray, RenderData &render_data, bool from_postprocessed = false) const override;
 		virtual Rgb eval(const Ray &ray, bool from_postprocessed = false) const override;
 		Rgb getSkyCol(const Ray &ray) const;
+		Rgb computeSkyCol(const Vec3 &dir) const;
 
 		Vec3 sun_dir_;
 		float turbidity_;
@@ -57,6 +59,7 @@ class SunSkyBackground final : public Background
 		double angleBetween(double thetav, double phiv) const;
 		double perezFunction(const double *lam, double theta, double gamma, double lvz) const;
 		float power_;
+		SkyTable sky_table_;
 };
 
 END_YAFARAY
@@ -31,6 +31,8 @@ BEGIN_YAFARAY
 class Scene;
 class ParamMap;
 class Texture;
+class MipMapParams;
+class PrefilteredEnvironment;
 
 class TextureBackground final : public Background
 {
@@ -39,16 +41,28 @@ class TextureBackground final : public Background
 
 	private:
 		enum Projection { Spherical = 0, Angular };
-		TextureBackground(const Texture *texture, Projection proj, float bpower, float rot, bool ibl, float ibl_blur, bool with_caustic);
+		TextureBackground(const Texture *texture, Projection proj, float bpower, float rot, bool ibl, float ibl_blur, bool with_caustic, int prefilter_resolution, int prefilter_levels);
 		virtual Rgb operator()(const Ray &ray, RenderData &render_data, bool use_ibl_blur = false) const override;
 		virtual Rgb eval(const Ray &ray, bool use_ibl_blur = false) const override;
+		//! uses the mipmap level of the texture with texels of about the given angle, when the texture has mipmaps
+		virtual Rgb evalFiltered(const Ray &ray, float angle) const override;
+		//! the images key of the texture with the projection settings and a few texels, so the adjustments of the texture are also taken into account
+		virtual uint64_t getDistributionKey() const override;
+		//! prefilters the texture for the IBL blur and projects its irradiance, reusing them from the previous renders when the texture did not change
+		virtual void init(Scene &scene) override;
+		virtual bool evalIrradiance(const Vec3 &normal, Rgb &irradiance) const override;
+		Rgb evalTexture(const Ray &ray, const MipMapParams *mipmap_params) const;
 
 		const Texture *tex_;
 		Projection project_;
 		float power_;
 		float rotation_;
 		float sin_r_, cos_r_;
-		float ibl_blur_mipmap_level_; //Calculated based on the IBL_Blur parameter. As mipmap levels have half size each, this parameter is not linear
+		float ibl_blur_;
+		float ibl_blur_mipmap_level_; //Calculated based on the IBL_Blur parameter. As mipmap levels have half size each, this parameter is not linear. Only used if the texture is not prefiltered
+		int prefilter_resolution_; //!< rows of the first prefiltered level, 0 to blur with the texture mipmaps instead
+		int prefilter_levels_;
+		std::shared_ptr<const PrefilteredEnvironment> prefiltered_;
 };
 
 END_YAFARAY
@@ -0,0 +1,53 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_PREFILTERED_ENVIRONMENT_H
+#define YAFARAY_PREFILTERED_ENVIRONMENT_H
+
+#include "background/sky_table.h"
+#include <array>
+
+BEGIN_YAFARAY
+
+/*! Environment radiance convolved with GGX lobes of increasing roughness, each roughness level baked in a lat-long table with half the resolution of the previous one,
+ * and the irradiance of the environment projected on the 9 spherical harmonics up to order 2 (Ramamoorthi and Hanrahan 2001).
+ * The few samples of each lobe read the environment averaged over their solid angle (filtered importance sampling), so the tables are built quickly and without noise */
+class PrefilteredEnvironment final
+{
+	public:
+		//! radiance of the environment averaged over a cone of about the given angle, as given by Background::evalFiltered
+		using RadianceFunction = std::function<Rgb(const Vec3 &dir, float angle)>;
+		//! with 0 levels only the irradiance is computed. The radiance function must be thread safe, as the tables are built in parallel
+		PrefilteredEnvironment(const RadianceFunction &radiance, int resolution, int num_levels, int num_threads);
+		bool hasRadiance() const { return !levels_.empty(); }
+		float getMinRoughness() const { return 1.f / levels_.size(); } //!< roughness of the first level, the lower ones are interpolated with the environment itself by the caller
+		Rgb getRadiance(const Vec3 &dir, float roughness) const; //!< interpolated between the two levels around the roughness, clamped to the first and last levels
+		Rgb getIrradiance(const Vec3 &normal) const; //!< divided by pi, so it is the radiance reflected by a white lambertian surface without occlusion
+
+	private:
+		static Rgb convolveGgx(const RadianceFunction &radiance, const Vec3 &dir, float roughness, float min_angle);
+		void projectIrradiance(const RadianceFunction &radiance, TaskPool &task_pool);
+
+		std::vector<SkyTable> levels_; //!< level i has the roughness (i + 1) / levels_.size()
+		std::array<Rgb, 9> irradiance_sh_; //!< spherical harmonics coefficients of the irradiance, already convolved with the clamped cosine and divided by pi
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_PREFILTERED_ENVIRONMENT_H
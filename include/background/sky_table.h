@@ -0,0 +1,55 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_SKY_TABLE_H
+#define YAFARAY_SKY_TABLE_H
+
+#include "constants.h"
+#include "color/color.h"
+#include "geometry/vector.h"
+#include <functional>
+#include <vector>
+
+BEGIN_YAFARAY
+
+class TaskPool;
+
+/*! Colors of an analytic sky model baked once in a lat-long table with the spherical mapping of the background light,
+ * so each look-up is a bilinear interpolation of four texels instead of the evaluation of the model exponentials and
+ * trigonometric functions. The table is sampled at the texel centers, wrapping around the azimuth and clamping at the poles */
+class SkyTable final
+{
+	public:
+		/*! Evaluates the function at the texel centers of a table with the given number of rows along the polar angle and twice as many columns along the azimuth.
+		 * A resolution of 0 disables the table, so the model is evaluated in each look-up as before */
+		void bake(int resolution, const std::function<Rgb(const Vec3 &dir)> &function, TaskPool *task_pool = nullptr); //!< with a task pool the rows are baked in parallel, so the function must be thread safe
+		int getHeight() const { return height_; }
+		bool isEnabled() const { return !colors_.empty(); }
+		//! the direction must not be zero, it does not need to be normalized
+		Rgb getColor(const Vec3 &dir) const;
+
+	private:
+		static constexpr int max_resolution_ = 4096;
+		int width_ = 0, height_ = 0;
+		std::vector<Rgb> colors_; //!< indexed by y * width_ + x, with the v coordinate of the spherical mapping along y
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_SKY_TABLE_H
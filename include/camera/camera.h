@@ -36,6 +36,14 @@ class Scene;
 
 class Vec3;
 class Point3;
+class DiffRay;
+
+//! Pixel coordinates and lens sample of a camera ray, for the rays shot in batches
+struct CameraRaySample
+{
+	float px_, py_;
+	float lens_u_, lens_v_;
+};
 
 //! Camera base class.
 /*!
@@ -51,6 +59,9 @@ class Camera
 		virtual void setAxis(const Vec3 &vx, const Vec3 &vy, const Vec3 &vz) = 0; //!< Set camera axis
 		/*! Shoot a new ray from the camera gived image pixel coordinates px,py and lense dof effect */
 		virtual Ray shootRay(float px, float py, float u, float v, float &wt) const = 0; //!< Shoot a new ray from the camera.
+		/*! Shoots the rays of num_samples pixel samples, with their differentials towards the next pixel in x and y if differentials is true.
+			The base implementation shoots each differential as another ray, the cameras with a linear projection derive them from the ray setup */
+		virtual void shootRays(const CameraRaySample *samples, size_t num_samples, DiffRay *rays, float *weights, bool differentials) const;
 		virtual Point3 screenproject(const Point3 &p) const = 0; //!< Get projection of point p into camera plane
 		virtual bool sampleLense() const { return false; } //!< Indicate whether the lense need to be sampled
 		virtual bool project(const Ray &wo, float lu, float lv, float &u, float &v, float &pdf) const { return false; }
@@ -44,6 +44,7 @@ class PerspectiveCamera : public Camera
 						  float const near_clip_distance = 0.0f, float const far_clip_distance = 1e6f);
 		virtual void setAxis(const Vec3 &vx, const Vec3 &vy, const Vec3 &vz) override;
 		virtual Ray shootRay(float px, float py, float lu, float lv, float &wt) const override;
+		virtual void shootRays(const CameraRaySample *samples, size_t num_samples, DiffRay *rays, float *weights, bool differentials) const override;
 		virtual bool sampleLense() const override;
 		virtual Point3 screenproject(const Point3 &p) const override;
 		virtual bool project(const Ray &wo, float lu, float lv, float &u, float &v, float &pdf) const override;
@@ -26,6 +26,7 @@
 
 #include "constants.h"
 #include "math/math.h"
+#include "math/simd.h"
 #include <iostream>
 
 BEGIN_YAFARAY
@@ -59,7 +60,7 @@ class Rgb
 		// Using ITU/Photometric values Y = 0.2126 R + 0.7152 G + 0.0722 B
 		float col2Bri() const { return (0.2126f * r_ + 0.7152f * g_ + 0.0722f * b_); }
 		float abscol2Bri() const { return (0.2126f * std::abs(r_) + 0.7152f * std::abs(g_) + 0.0722f * std::abs(b_)); }
-		void gammaAdjust(float g) { r_ = math::pow(r_, g); g_ = math::pow(g_, g); b_ = math::pow(b_, g); }
+		void gammaAdjust(float g);
 		void expgamAdjust(float e, float g, bool clamp_rgb);
 		float getR() const { return r_; }
 		float getG() const { return g_; }
@@ -138,7 +139,7 @@ class Rgb
 		float b_ = 0.f;
 };
 
-class Rgba final : public Rgb
+class YAFARAY_SIMD_ALIGN Rgba final : public Rgb
 {
 	public:
 		Rgba() = default;
@@ -148,6 +149,10 @@ class Rgba final : public Rgb
 		Rgba(float g): Rgb(g), a_(g) { }
 		Rgba(float g, float a): Rgb(g), a_(a) { }
 		Rgba(float af[4]): Rgb(af), a_(af[3]) { }
+#ifdef SIMD_TYPES
+		explicit Rgba(const Float4 &f) { f.store(&r_); } //the 3 floats of Rgb are followed by a_, as checked after the class
+		Float4 getFloat4() const { return Float4::load(&r_); }
+#endif
 
 		void set(float r, float g, float b, float a = 1.f) { Rgb::set(r, g, b); a_ = a; }
 
@@ -194,6 +199,10 @@ class Rgba final : public Rgb
 		float a_ = 1.f;
 };
 
+#ifdef SIMD_TYPES
+static_assert(sizeof(Rgba) == 4 * sizeof(float), "The Rgba SIMD operators need the 4 components stored as contiguous floats");
+#endif
+
 class Rgbe final
 {
 	public:
@@ -217,6 +226,14 @@ class Rgbe final
 		unsigned char rgbe_[4];
 };
 
+inline void Rgb::gammaAdjust(float g)
+{
+	//The components are padded to 4 lanes so the batched pow is evaluated with a single vector
+	float values[4] = { r_, g_, b_, 1.f };
+	math::pow(values, g, values, 4);
+	set(values[0], values[1], values[2]);
+}
+
 inline void Rgb::expgamAdjust(float e, float g, bool clamp_rgb)
 {
 	if((e == 0.f) && (g == 1.f))
@@ -228,17 +245,15 @@ inline void Rgb::expgamAdjust(float e, float g, bool clamp_rgb)
 	{
 		// exposure adjust
 		clampRgb0();
-		r_ = 1.f - math::exp(r_ * e);
-		g_ = 1.f - math::exp(g_ * e);
-		b_ = 1.f - math::exp(b_ * e);
+		float values[4] = { r_ * e, g_ * e, b_ * e, 0.f };
+		math::exp(values, values, 4);
+		set(1.f - values[0], 1.f - values[1], 1.f - values[2]);
 	}
 	if(g != 1.f)
 	{
 		// gamma adjust
 		clampRgb0();
-		r_ = math::pow(r_, g);
-		g_ = math::pow(g_, g);
-		b_ = math::pow(b_, g);
+		gammaAdjust(g);
 	}
 }
 
@@ -298,39 +313,70 @@ inline Rgb &Rgb::operator -=(const Rgb &c)
 
 inline Rgba operator * (const Rgba &a, const Rgba &b)
 {
+#ifdef SIMD_TYPES
+	return Rgba(a.getFloat4() * b.getFloat4());
+#else
 	return Rgba(a.r_ * b.r_, a.g_ * b.g_, a.b_ * b.b_, a.a_ * b.a_);
+#endif
 }
 
 inline Rgba operator * (const float f, const Rgba &b)
 {
+#ifdef SIMD_TYPES
+	return Rgba(b.getFloat4() * Float4::broadcast(f));
+#else
 	return Rgba(f * b.r_, f * b.g_, f * b.b_, f * b.a_);
+#endif
 }
 
 inline Rgba operator * (const Rgba &b, const float f)
 {
+#ifdef SIMD_TYPES
+	return Rgba(b.getFloat4() * Float4::broadcast(f));
+#else
 	return Rgba(f * b.r_, f * b.g_, f * b.b_, f * b.a_);
+#endif
 }
 
 inline Rgba operator / (const Rgba &b, float f)
 {
 	if(f != 0) f = 1.f / f;
+#ifdef SIMD_TYPES
+	return Rgba(b.getFloat4() * Float4::broadcast(f));
+#else
 	return Rgba(b.r_ * f, b.g_ * f, b.b_ * f, b.a_ * f);
+#endif
 }
 
 inline Rgba operator + (const Rgba &a, const Rgba &b)
 {
+#ifdef SIMD_TYPES
+	return Rgba(a.getFloat4() + b.getFloat4());
+#else
 	return Rgba(a.r_ + b.r_, a.g_ + b.g_, a.b_ + b.b_, a.a_ + b.a_);
+#endif
 }
 
 inline Rgba operator - (const Rgba &a, const Rgba &b)
 {
+#ifdef SIMD_TYPES
+	return Rgba(a.getFloat4() - b.getFloat4());
+#else
 	return Rgba(a.r_ - b.r_, a.g_ - b.g_, a.b_ - b.b_, a.a_ - b.a_);
+#endif
 }
 
+#ifdef SIMD_TYPES
+inline Rgba &Rgba::operator +=(const Rgba &c) { (getFloat4() + c.getFloat4()).store(&r_); return *this; }
+inline Rgba &Rgba::operator *=(const Rgba &c) { (getFloat4() * c.getFloat4()).store(&r_); return *this; }
+inline Rgba &Rgba::operator *=(float f) { (getFloat4() * Float4::broadcast(f)).store(&r_); return *this; }
+inline Rgba &Rgba::operator -=(const Rgba &c) { (getFloat4() - c.getFloat4()).store(&r_); return *this; }
+#else
 inline Rgba &Rgba::operator +=(const Rgba &c) { r_ += c.r_; g_ += c.g_; b_ += c.b_; a_ += c.a_;  return *this; }
 inline Rgba &Rgba::operator *=(const Rgba &c) { r_ *= c.r_; g_ *= c.g_; b_ *= c.b_; a_ *= c.a_;  return *this; }
 inline Rgba &Rgba::operator *=(float f) { r_ *= f; g_ *= f; b_ *= f; a_ *= f;  return *this; }
 inline Rgba &Rgba::operator -=(const Rgba &c) { r_ -= c.r_; g_ -= c.g_; b_ -= c.b_; a_ -= c.a_;  return *this; }
+#endif
 
 inline float maxAbsDiff_global(const Rgb &a, const Rgb &b)
 {
@@ -372,9 +418,12 @@ inline void Rgb::linearRgbFromColorSpace(ColorSpace color_space, float gamma)
 	//NOTE: Alpha value is not converted from linear to color space and vice versa. Should it be converted?
 	if(color_space == Srgb)
 	{
-		r_ = linearRgbFromSRgb(r_);
-		g_ = linearRgbFromSRgb(g_);
-		b_ = linearRgbFromSRgb(b_);
+		//Same as linearRgbFromSRgb, with the pow of the 3 components batched and the linear segment selected afterwards
+		float values[4] = { (r_ + 0.055f) / 1.055f, (g_ + 0.055f) / 1.055f, (b_ + 0.055f) / 1.055f, 1.f };
+		math::pow(values, 2.4f, values, 4);
+		r_ = (r_ <= 0.04045f) ? (r_ / 12.92f) : values[0];
+		g_ = (g_ <= 0.04045f) ? (g_ / 12.92f) : values[1];
+		b_ = (b_ <= 0.04045f) ? (b_ / 12.92f) : values[2];
 	}
 	else if(color_space == XyzD65)
 	{
@@ -394,9 +443,12 @@ inline void Rgb::colorSpaceFromLinearRgb(ColorSpace color_space, float gamma)
 	//NOTE: Alpha value is not converted from linear to color space and vice versa. Should it be converted?
 	if(color_space == Srgb)
 	{
-		r_ = sRgbFromLinearRgb(r_);
-		g_ = sRgbFromLinearRgb(g_);
-		b_ = sRgbFromLinearRgb(b_);
+		//Same as sRgbFromLinearRgb, with the pow of the 3 components batched and the linear segment selected afterwards
+		float values[4] = { r_, g_, b_, 1.f };
+		math::pow(values, 0.416667f, values, 4); //0,416667f = 1/2.4
+		r_ = (r_ <= 0.0031308f) ? (r_ * 12.92f) : ((1.055f * values[0]) - 0.055f);
+		g_ = (g_ <= 0.0031308f) ? (g_ * 12.92f) : ((1.055f * values[1]) - 0.055f);
+		b_ = (b_ <= 0.0031308f) ? (b_ * 12.92f) : ((1.055f * values[2]) - 0.055f);
 	}
 	else if(color_space == XyzD65)
 	{
@@ -114,11 +114,14 @@ inline Rgb ColorConv::fromXyz(float x, float y, float z, bool force_gamma) const
 
 	if(encode_gamma_ || force_gamma)
 	{
-		ret.set(
-		    sGammaEnc((mat_[0] * x) + (mat_[1] * y) + (mat_[2] * z)),
-		    sGammaEnc((mat_[3] * x) + (mat_[4] * y) + (mat_[5] * z)),
-		    sGammaEnc((mat_[6] * x) + (mat_[7] * y) + (mat_[8] * z))
-		);
+		float values[4] = {
+		    (mat_[0] * x) + (mat_[1] * y) + (mat_[2] * z),
+		    (mat_[3] * x) + (mat_[4] * y) + (mat_[5] * z),
+		    (mat_[6] * x) + (mat_[7] * y) + (mat_[8] * z),
+		    1.f
+		};
+		math::pow(values, simple_g_enc_, values, 4); //same as sGammaEnc, batched for the 3 components
+		ret.set(values[0], values[1], values[2]);
 	}
 	else
 	{
@@ -35,13 +35,23 @@ struct ColorLayer final
 	Layer::Type layer_type_;
 };
 
-class ColorLayers final : public Collection<Layer::Type, ColorLayer>  //Actual buffer of colors in the rendering process, one entry for each enabled layer.
+/*! Colors of one layer in a rectangular area of the image, stored row by row */
+struct ColorLayerTile final
+{
+	ColorLayerTile(const Layer::Type &layer_type, const Rgba *colors, int row_stride) : layer_type_(layer_type), colors_(colors), row_stride_(row_stride) { }
+	Layer::Type layer_type_;
+	const Rgba *colors_; //!< color of the top-left pixel of the area
+	int row_stride_; //!< number of colors from the start of one row to the start of the next one
+};
+
+class ColorLayers final : public LayerCollection<ColorLayer>  //Actual buffer of colors in the rendering process, one entry for each enabled layer.
 {
 	public:
 		ColorLayers(const Layers &layers);
 		void setDefaultColors();
 		void setLayer(const Layer::Type key, const ColorLayer &layer) { flags_ |= Layer::getFlags(key); set(key, layer); };
 		bool isDefinedAny(const std::vector<Layer::Type> &types) const;
+		bool isCombinedOnly() const { return size() == 1 && find(Layer::Combined); }
 		MaskParams getMaskParams() const { return mask_params_; }
 		Layer::Flags getFlags() const { return flags_; }
 
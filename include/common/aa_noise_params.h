@@ -23,6 +23,7 @@
 struct AaNoiseParams
 {
 	enum class DarkDetectionType : int { None, Linear, Curve };
+	enum class SamplerType : int { Halton, Sobol };
 
 	int samples_ = 1;
 	int passes_ = 1;
@@ -39,6 +40,11 @@ struct AaNoiseParams
 	int variance_pixels_ = 0;
 	float clamp_samples_ = 0.f;
 	float clamp_indirect_ = 0.f;
+	SamplerType sampler_type_ = SamplerType::Halton; //!< low discrepancy sequence of the pixel samples
+	float time_budget_ = 0.f; //!< seconds, excluding the preprocessing, after which no more passes are started and the samples of the last one are reduced to fit. 0 for no limit
+	float noise_target_ = 0.f; //!< % of the total pixels above the AA threshold below which no more passes are rendered. 0 for no target
+	bool variance_sampling_ = false; //!< the pixels resampled and their number of samples are chosen from the estimated error of their mean instead of the differences with their neighbours
+	int preview_levels_ = 0; //!< coarse previews shown before the first pass, from 1/2^levels to 1/2 of the resolution. 0 for no preview
 };
 
 #endif //YAFARAY_AA_NOISE_PARAMS_H
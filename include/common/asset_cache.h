@@ -0,0 +1,50 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_ASSET_CACHE_H
+#define YAFARAY_ASSET_CACHE_H
+
+#include "constants.h"
+#include <string>
+#include <cstdint>
+
+BEGIN_YAFARAY
+
+/*! Local cache of the asset files (images, geometry files) addressed by their contents, so the render nodes read each asset from the shared storage only once.
+ * The copies are stored in the cache directory as "<content hash>-<size>.<extension>". Small index files map the path, size and modification time of the original files
+ * to their content hash, so the cached assets are found in the next jobs without reading the originals again.
+ * The cache directory can also be filled in advance with the assets from another node (for example by the node sending the scene), as the content hashes do not depend on the original paths. */
+class AssetCache final
+{
+	public:
+		/*! path of the local copy of the asset in the cache directory, copying it the first time. If the content key (as returned by getContentKey()) is known,
+		 * an existing copy is used without checking the original file, which does not need to exist then.
+		 * Returns the original path if the cache directory is empty or the asset could not be cached */
+		static std::string getLocalPath(const std::string &cache_dir, const std::string &file_path, const std::string &content_key = "");
+		static std::string getContentKey(const char *data, uint64_t size); //!< 64bit FNV-1a hash of the contents in hexadecimal, followed by the size
+
+	private:
+		static std::string getCachedPath(const std::string &cache_dir, const std::string &content_key, const std::string &extension);
+		static std::string getIndexedContentKey(const std::string &index_path, const std::string &index_key);
+		static std::string copyToCache(const std::string &cache_dir, const std::string &file_path, const std::string &extension);
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_ASSET_CACHE_H
@@ -24,6 +24,7 @@
 
 #include "constants.h"
 #include <map>
+#include <cstddef>
 
 BEGIN_YAFARAY
 
@@ -27,6 +27,8 @@
 #include "constants.h"
 #include <string>
 #include <vector>
+#include <type_traits>
+#include <cstdint>
 
 BEGIN_YAFARAY
 
@@ -63,6 +65,7 @@ class File final
 		static std::FILE *open(const Path &path, const std::string &access_mode);
 		static int close(std::FILE *fp);
 		static bool exists(const std::string &path, bool files_only);
+		static bool getInfo(const std::string &path, uint64_t &size, int64_t &modification_time); //!< size in bytes and last modification time in seconds of a regular file, returns false if it does not exist
 		static bool remove(const std::string &path, bool files_only);
 		static bool rename(const std::string &path_old, const std::string &path_new, bool overwrite, bool files_only);
 		static std::vector<std::string> listFiles(const std::string &directory);
@@ -70,8 +73,12 @@ class File final
 		int close();
 		bool read(std::string &str) const;
 		template <typename T> bool read(T &value) const;
+		template <typename T, typename Alloc> bool read(std::vector<T, Alloc> &values) const; //!< reads values.size() elements, the vector must be resized before
 		bool append(const std::string &str);
 		template <typename T> bool append(const T &value);
+		template <typename T, typename Alloc> bool append(const std::vector<T, Alloc> &values);
+		template <typename T> bool append(const T *values, size_t num_values);
+		bool seek(uint64_t position); //!< moves the read/write position to an absolute position from the file start, with 64bit positions also in the platforms with 32bit long
 
 	private:
 		bool save(const char *buffer, size_t size, bool with_temp);
@@ -81,18 +88,56 @@ class File final
 		std::FILE *fp_ = nullptr;
 };
 
+/*! Read only memory mapping of a whole file, so its contents are loaded by the OS on demand and shared between the processes mapping the same file */
+class MappedFile final
+{
+	public:
+		MappedFile(const std::string &path);
+		~MappedFile();
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+		bool isOpen() const { return data_ != nullptr; }
+		const char *data() const { return data_; }
+		uint64_t size() const { return size_; }
+
+	private:
+		const char *data_ = nullptr;
+		uint64_t size_ = 0;
+#if defined(_WIN32)
+		void *file_handle_ = nullptr;
+		void *mapping_handle_ = nullptr;
+#endif //defined(_WIN32)
+};
+
 template <typename T> bool File::read(T &value) const
 {
 	static_assert(std::is_pod<T>::value, "T must be a plain old data (POD) type like char, int32_t, float, etc");
 	return File::read((char *)&value, sizeof(T));
 }
 
+template <typename T, typename Alloc> bool File::read(std::vector<T, Alloc> &values) const
+{
+	static_assert(std::is_trivially_copyable<T>::value, "T must be a trivially copyable type");
+	return File::read((char *)values.data(), values.size() * sizeof(T));
+}
+
 template <typename T> bool File::append(const T &value)
 {
 	static_assert(std::is_pod<T>::value, "T must be a plain old data (POD) type like char, int32_t, float, etc");
 	return File::append((const char *)&value, sizeof(T));
 }
 
+template <typename T, typename Alloc> bool File::append(const std::vector<T, Alloc> &values)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "T must be a trivially copyable type");
+	return File::append((const char *)values.data(), values.size() * sizeof(T));
+}
+template <typename T> bool File::append(const T *values, size_t num_values)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "T must be a trivially copyable type");
+	return File::append((const char *)values, num_values * sizeof(T));
+}
+
 
 END_YAFARAY
 
@@ -30,6 +30,7 @@
 #include <string>
 #include <vector>
 #include <array>
+#include <cstdint>
 
 BEGIN_YAFARAY
 
@@ -113,7 +114,9 @@ class LIBYAFARAY_EXPORT Layer final
 			DebugDudxDvdx,
 			DebugDudyDvdy,
 			DebugDudxyDvdxy,
+			DebugRenderTime, //!< microseconds spent integrating the camera samples of each pixel, averaged over its samples
 		};
+		static constexpr int num_types_ = DebugRenderTime + 1; //!< to be kept after the last type
 		Layer() = default;
 		Layer(const Type &type, const Image::Type &image_type = Image::Type::None, const Image::Type &exported_image_type = Image::Type::None, const std::string &exported_image_name = "");
 		Layer(const std::string &type_name, const std::string &image_type_name = "", const std::string &exported_image_type_name = "", const std::string &exported_image_name = "");
@@ -147,6 +150,8 @@ class LIBYAFARAY_EXPORT Layer final
 		static Rgba getDefaultColor(const Type &type);
 		static Image::Type getDefaultImageType(const Type &type);
 		static Flags getFlags(const Type &type);
+		static bool allowsHalfFloat(const Type &type); //!< layers with a limited range that can be accumulated in half floats, not the beauty nor the absolute values
+		static bool isPointSampled(const Type &type); //!< layers with a value constant over each sample, written once per pixel by the first sample that hits something instead of filtered
 		static const std::map<Type, std::string> &getMapTypeTypeName() { return map_type_typename_; }
 
 	private:
@@ -185,7 +190,51 @@ struct EdgeToonParams //Options for Edge detection and Toon Render Layers
 	float face_smoothness_ = 0.5f; //!Smoothness (blur) of the edges used in the Faces Edge Render Layers
 };
 
-class Layers final : public Collection<Layer::Type, Layer>
+/*! Items of the enabled layers, found by their type with an array lookup instead of a tree search as they are looked up
+	for each sample. The items are kept in a compact vector sorted by layer type, so they are iterated in the same order as a map */
+template <typename T>
+class LayerCollection
+{
+	public:
+		using iterator = typename std::vector<std::pair<Layer::Type, T>>::iterator;
+		using const_iterator = typename std::vector<std::pair<Layer::Type, T>>::const_iterator;
+		LayerCollection() { indices_.fill(-1); }
+		size_t size() const { return items_.size(); }
+		void set(const Layer::Type &key, const T &item);
+		void clear() { items_.clear(); indices_.fill(-1); }
+		iterator begin() { return items_.begin(); }
+		iterator end() { return items_.end(); }
+		const_iterator begin() const { return items_.begin(); }
+		const_iterator end() const { return items_.end(); }
+		//! throws std::out_of_range for the layers not in the collection, as the map based collections
+		T &operator()(const Layer::Type &key) { return items_.at(index(key)).second; }
+		const T &operator()(const Layer::Type &key) const { return items_.at(index(key)).second; }
+		T *find(const Layer::Type &key) { const size_t i = index(key); return i < items_.size() ? &items_[i].second : nullptr; }
+		const T *find(const Layer::Type &key) const { const size_t i = index(key); return i < items_.size() ? &items_[i].second : nullptr; }
+
+	protected:
+		size_t index(const Layer::Type &key) const { return (key >= 0 && key < Layer::num_types_ && indices_[key] >= 0) ? static_cast<size_t>(indices_[key]) : items_.size(); }
+		std::vector<std::pair<Layer::Type, T>> items_;
+		std::array<int8_t, Layer::num_types_> indices_; //!< position of each layer type in items_, -1 when not in the collection
+};
+
+template <typename T>
+inline void LayerCollection<T>::set(const Layer::Type &key, const T &item)
+{
+	if(T *existing_item = find(key))
+	{
+		*existing_item = item;
+		return;
+	}
+	if(key < 0 || key >= Layer::num_types_) return;
+	auto position = items_.begin();
+	while(position != items_.end() && position->first < key) ++position;
+	items_.insert(position, {key, item});
+	indices_.fill(-1);
+	for(size_t i = 0; i < items_.size(); ++i) indices_[items_[i].first] = static_cast<int8_t>(i);
+}
+
+class Layers final : public LayerCollection<Layer>
 {
 	public:
 		void setLayer(const Layer::Type key, const Layer &layer) { flags_ |= Layer::getFlags(key); set(key, layer); };
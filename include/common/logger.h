@@ -33,6 +33,7 @@
 #include <sstream>
 #include <unordered_map>
 #include <vector>
+#include <memory>
 #include "render/render_control.h"
 
 //for Y_DEBUG printing of variable name + value. For example:  Y_DEBUG PRTEXT(Integration1) PR(color) PR(ray.dir) PREND;
@@ -61,11 +62,48 @@ class LogEntry
 		std::string description_;
 };
 
+class Logger;
+
+/*! Message being written by a thread, each thread has its own one so the threads do not share any state
+	while composing their messages. The message is complete when a std::endl (YENDL) is written into it */
+class LIBYAFARAY_EXPORT LogStream final
+{
+		friend class Logger;
+
+	public:
+		template <typename T> LogStream &operator << (const T &obj);
+		LogStream &operator << (std::ostream & (obj)(std::ostream &));
+
+	private:
+		void start(Logger *logger, int verbosity_level, bool enabled);
+		void finish(std::string &&text);
+		Logger *logger_ = nullptr;
+		int verbosity_level_ = 0;
+		bool enabled_ = false;
+		std::time_t date_time_ = 0;
+		std::ostringstream stream_;
+};
+
 class LIBYAFARAY_EXPORT Logger
 {
+		friend class LogStream;
+
 	public:
 		enum LogLevel : int { VlMute = 0, VlError, VlWarning, VlParams, VlInfo, VlVerbose, VlDebug, };
-		Logger() = default;
+		/*! While it exists the messages are queued in per-thread lock free buffers and written by a background thread,
+			so the render threads never wait for the console or for each other when logging. The repeated messages are
+			only written once per second with their number of repetitions, and the messages of each thread are rate limited */
+		class AsyncScope final
+		{
+			public:
+				explicit AsyncScope(Logger &logger) : logger_(logger) { logger_.startAsync(); }
+				~AsyncScope() { logger_.stopAsync(); }
+
+			private:
+				Logger &logger_;
+		};
+		Logger();
+		~Logger();
 		Logger(const Logger &) = delete; //deleting copy constructor so we can use a std::mutex as a class member (not copiable)
 
 		LogLevel getMaxLogLevel() const;
@@ -73,6 +111,7 @@ class LIBYAFARAY_EXPORT Logger
 		void enablePrintDateTime(bool value) { print_datetime_ = value; }
 		void setConsoleMasterVerbosity(const std::string &str_v_level);
 		void setLogMasterVerbosity(const std::string &str_v_level);
+		void setAsyncRateLimit(int max_messages_per_second) { async_rate_limit_ = max_messages_per_second; } //!< per thread, 0 for no limit
 
 		void setImagePath(const std::string &path) { image_path_ = path; }
 		void setConsoleLogColorsEnabled(bool console_log_colors_enabled) { console_log_colors_enabled_ = console_log_colors_enabled; }
@@ -84,7 +123,9 @@ class LIBYAFARAY_EXPORT Logger
 		void saveHtmlLog(const std::string &name, const Badge &badge, const RenderControl &render_control);
 		void clearMemoryLog();
 		void clearAll();
-		Logger &out(int verbosity_level);
+		LogStream &out(int verbosity_level); //!< starts a new message of the calling thread
+		void startAsync(); //!< can be nested, the background writing stops when the outermost stopAsync() is called
+		void stopAsync(); //!< writes all the queued messages before returning
 
 		void statsClear() { diagnostics_stats_.clear(); }
 		void statsPrint(bool sorted = false) const;
@@ -106,13 +147,13 @@ class LIBYAFARAY_EXPORT Logger
 		static std::string printDate(const std::time_t &datetime);
 		static int vlevelFromString(std::string str_v_level);
 
-		template <typename T> Logger &operator << (const T &obj);
-		Logger &operator << (std::ostream & (obj)(std::ostream &));
-
 		std::mutex mutx_;  //To try to avoid garbled output when there are several threads trying to output data to the log
 
 	protected:
-		int verbosity_level_ = VlInfo;
+		struct AsyncState;
+		void addMessage(int verbosity_level, std::time_t date_time, std::string &&text); //!< called with the complete messages
+		void writeMessage(int verbosity_level, std::time_t date_time, const std::string &text); //!< to the console and the memory log, lock mutx_ when calling!
+		void drainAsync(); //!< only called by the background thread and by stopAsync() after joining it
 		int console_master_verbosity_level_ = VlInfo;
 		int log_master_verbosity_level_ = VlVerbose;
 		bool print_datetime_ = true;
@@ -122,36 +163,16 @@ class LIBYAFARAY_EXPORT Logger
 		std::time_t previous_console_event_date_time_ = 0;
 		std::time_t previous_log_event_date_time_ = 0;
 		std::unordered_map <std::string, double> diagnostics_stats_;
+		int async_rate_limit_ = 100;
+		std::unique_ptr<AsyncState> async_;
 };
 
 template<typename T>
-inline Logger &Logger::operator<<(const T &obj) {
-	std::ostringstream tmp_stream;
-	tmp_stream << obj;
-
-	if(verbosity_level_ <= console_master_verbosity_level_) std::cout << tmp_stream.str();
-	if(verbosity_level_ <= log_master_verbosity_level_ && !memory_log_.empty())
-	{
-		std::lock_guard<std::mutex> lock_guard(mutx_);
-		memory_log_.back().description_ += tmp_stream.str();
-	}
+inline LogStream &LogStream::operator<<(const T &obj) {
+	if(enabled_) stream_ << obj;
 	return *this;
 }
 
-inline Logger &Logger::operator<<(std::ostream &(*obj)(std::ostream &)) {
-	std::ostringstream tmp_stream;
-	tmp_stream << obj;
-
-	if(verbosity_level_ <= console_master_verbosity_level_) std::cout << tmp_stream.str();
-	if(verbosity_level_ <= log_master_verbosity_level_ && !memory_log_.empty())
-	{
-		std::lock_guard<std::mutex> lock_guard(mutx_);
-		memory_log_.back().description_ += tmp_stream.str();
-	}
-	return *this;
-}
-
-
 extern LIBYAFARAY_EXPORT Logger logger_global;
 
 #define Y_DEBUG logger_global.out(yafaray4::Logger::VlDebug)
@@ -22,6 +22,9 @@
 
 #include "constants.h"
 #include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
 
 BEGIN_YAFARAY
 
@@ -39,6 +42,77 @@ struct LIBYAFARAY_EXPORT CustomDeleter
 
 template <typename T, typename Base = T> using UniquePtr_t = std::unique_ptr<T, CustomDeleter<Base>>; //!< Customized std::unique_ptr with optional custom deleter. If no custom deleter specified, it becomes a regular std::unique_ptr
 
+/*! Minimal allocator returning memory aligned to "alignment" bytes, for example to keep std::vector storage aligned to cache lines.
+ * The original pointer returned by operator new is stored just before the aligned block. */
+template <typename T, size_t alignment>
+class AlignedAllocator
+{
+	static_assert((alignment & (alignment - 1)) == 0 && alignment >= sizeof(void *), "AlignedAllocator: alignment must be a power of two, not smaller than a pointer");
+	public:
+		using value_type = T;
+		template <typename U> struct rebind { using other = AlignedAllocator<U, alignment>; };
+		AlignedAllocator() = default;
+		template <typename U> AlignedAllocator(const AlignedAllocator<U, alignment> &) { }
+		T *allocate(size_t n)
+		{
+			void *original = ::operator new(n * sizeof(T) + alignment + sizeof(void *));
+			const uintptr_t aligned = (reinterpret_cast<uintptr_t>(original) + sizeof(void *) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+			reinterpret_cast<void **>(aligned)[-1] = original;
+			return reinterpret_cast<T *>(aligned);
+		}
+		void deallocate(T *p, size_t) { ::operator delete(reinterpret_cast<void **>(p)[-1]); }
+		template <typename U> bool operator==(const AlignedAllocator<U, alignment> &) const { return true; }
+		template <typename U> bool operator!=(const AlignedAllocator<U, alignment> &) const { return false; }
+};
+
+/*! Huge page backed allocations for the large read-mostly render data (textures, meshes, accelerator trees, film), to reduce the TLB misses when accessing them randomly.
+ * The mode is a setting of each scene, given to the containers of its data with their LargeBufferAllocator.
+ * Only the blocks of at least minAllocationSize() bytes are mapped, the smaller ones are left to the regular allocator (allocate() returns nullptr for them).
+ *   - Mode::Transparent: 2MB aligned anonymous mappings with the transparent huge pages hint (madvise)
+ *   - Mode::Explicit: mappings from the reserved huge pages pool (1GB pages for blocks of at least 1GB if available, 2MB pages otherwise), falling back to Mode::Transparent if there are not enough reserved pages
+ * Only implemented in Linux, in the other platforms allocate() always returns nullptr. */
+class LIBYAFARAY_EXPORT HugePages final
+{
+	public:
+		enum class Mode : int { None, Transparent, Explicit };
+		static Mode modeFromName(const std::string &mode_name); //!< "none", "transparent" or "explicit"
+		static std::string modeName(Mode mode);
+		static constexpr size_t minAllocationSize() { return 4 * 1024 * 1024; }
+		static void *allocate(size_t bytes, Mode mode); //!< nullptr if the block could not be mapped to huge pages
+		static bool deallocate(void *p, size_t bytes); //!< false if the block was not allocated by allocate()
+};
+
+/*! Allocator for the large render data containers, using HugePages with the mode of the scene owning the data for the big blocks and AlignedAllocator for the rest.
+ * Any allocator releases the blocks of any other, so they all compare equal and the containers with different modes can still be moved and swapped */
+template <typename T, size_t alignment = 64>
+class LargeBufferAllocator
+{
+	public:
+		using value_type = T;
+		template <typename U> struct rebind { using other = LargeBufferAllocator<U, alignment>; };
+		LargeBufferAllocator() = default;
+		explicit LargeBufferAllocator(HugePages::Mode huge_pages_mode) : huge_pages_mode_(huge_pages_mode) { }
+		template <typename U> LargeBufferAllocator(const LargeBufferAllocator<U, alignment> &allocator) : huge_pages_mode_(allocator.getHugePagesMode()) { }
+		HugePages::Mode getHugePagesMode() const { return huge_pages_mode_; }
+		T *allocate(size_t n)
+		{
+			void *huge_pages = HugePages::allocate(n * sizeof(T), huge_pages_mode_);
+			if(huge_pages) return static_cast<T *>(huge_pages);
+			return AlignedAllocator<T, alignment>().allocate(n);
+		}
+		void deallocate(T *p, size_t n)
+		{
+			if(!HugePages::deallocate(p, n * sizeof(T))) AlignedAllocator<T, alignment>().deallocate(p, n);
+		}
+		template <typename U> bool operator==(const LargeBufferAllocator<U, alignment> &) const { return true; }
+		template <typename U> bool operator!=(const LargeBufferAllocator<U, alignment> &) const { return false; }
+
+	private:
+		HugePages::Mode huge_pages_mode_ = HugePages::Mode::None;
+};
+
+template <typename T> using LargeVector = std::vector<T, LargeBufferAllocator<T>>; //!< std::vector for the large render data, see HugePages. Constructed with LargeBufferAllocator<T>(huge_pages_mode) to use huge pages
+
 END_YAFARAY
 
 #endif //YAFARAY_MEMORY_H
@@ -24,6 +24,8 @@
 #include <vector>
 #include <algorithm>
 #include <cstdint>
+#include <cstdlib>
+#include <iterator>
 
 BEGIN_YAFARAY
 
@@ -35,42 +37,88 @@ class MemoryArena
 		{
 			block_size_ = block_size;
 			cur_block_pos_ = 0;
-			current_block_ = (char *) malloc(block_size_);
+			current_block_ = { (char *) malloc(block_size_), block_size_ };
 		}
 		~MemoryArena()
 		{
-			free(current_block_);
+			free(current_block_.data_);
 			for(uint32_t i = 0; i < used_blocks_.size(); ++i)
-				free(used_blocks_[i]);
+				free(used_blocks_[i].data_);
 			for(uint32_t i = 0; i < available_blocks_.size(); ++i)
-				free(available_blocks_[i]);
+				free(available_blocks_[i].data_);
 		}
 		void *alloc(uint32_t sz)
 		{
 			// Round up _sz_ to minimum machine alignment
 			sz = ((sz + 7) & (~7));
-			if(cur_block_pos_ + sz > block_size_)
-			{
-				// Get new block of memory for _MemoryArena_
-				used_blocks_.push_back(current_block_);
-				if(available_blocks_.size() && sz <= block_size_)
-				{
-					current_block_ = available_blocks_.back();
-					available_blocks_.pop_back();
-				}
-				else
-					current_block_ = (char *) malloc((std::max(sz, block_size_)));
-				cur_block_pos_ = 0;
-			}
-			void *ret = current_block_ + cur_block_pos_;
+			if(cur_block_pos_ + sz > current_block_.size_) nextBlock(sz);
+			void *ret = current_block_.data_ + cur_block_pos_;
 			cur_block_pos_ += sz;
 			return ret;
 		}
+		/*! Allocates sz bytes aligned to "alignment" bytes, which must be a power of two not bigger than the malloc alignment */
+		void *alloc(size_t sz, size_t alignment)
+		{
+			uint32_t pos = (cur_block_pos_ + static_cast<uint32_t>(alignment) - 1) & ~(static_cast<uint32_t>(alignment) - 1);
+			if(pos + sz > current_block_.size_)
+			{
+				nextBlock(static_cast<uint32_t>(sz));
+				pos = 0;
+			}
+			cur_block_pos_ = pos + static_cast<uint32_t>(sz);
+			return current_block_.data_ + pos;
+		}
+		/*! Typed allocation of num uninitialized elements, for trivially destructible types as the arena never calls destructors */
+		template <typename T> T *alloc(size_t num)
+		{
+			return static_cast<T *>(alloc(num * sizeof(T), alignof(T)));
+		}
+		struct Marker
+		{
+			size_t num_used_blocks_;
+			uint32_t block_pos_;
+		};
+		Marker getMarker() const { return { used_blocks_.size(), cur_block_pos_ }; }
+		/*! Frees everything allocated after the marker was taken, keeping the blocks for the next allocations */
+		void rewind(const Marker &marker)
+		{
+			while(used_blocks_.size() > marker.num_used_blocks_)
+			{
+				available_blocks_.push_back(current_block_);
+				current_block_ = used_blocks_.back();
+				used_blocks_.pop_back();
+			}
+			cur_block_pos_ = marker.block_pos_;
+		}
+		void reset() { rewind({ 0, 0 }); } //!< frees everything at once, keeping the blocks
 	private:
+		struct Block
+		{
+			char *data_;
+			uint32_t size_;
+		};
+		void nextBlock(uint32_t sz)
+		{
+			// Get new block of memory for _MemoryArena_
+			used_blocks_.push_back(current_block_);
+			//The blocks bigger than block_size_, for the big scratch buffers, are kept and reused as the others
+			const auto available_block = std::find_if(available_blocks_.rbegin(), available_blocks_.rend(), [sz](const Block &block) { return block.size_ >= sz; });
+			if(available_block != available_blocks_.rend())
+			{
+				current_block_ = *available_block;
+				available_blocks_.erase(std::next(available_block).base());
+			}
+			else
+			{
+				const uint32_t size = std::max(sz, block_size_);
+				current_block_ = { (char *) malloc(size), size };
+			}
+			cur_block_pos_ = 0;
+		}
 		// MemoryArena Private Data
 		uint32_t cur_block_pos_, block_size_;
-		char *current_block_;
-		std::vector<char *> used_blocks_, available_blocks_;
+		Block current_block_;
+		std::vector<Block> used_blocks_, available_blocks_;
 };
 
 END_YAFARAY
@@ -0,0 +1,93 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_MEMORY_STATS_H
+#define YAFARAY_MEMORY_STATS_H
+
+#include "constants.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+BEGIN_YAFARAY
+
+/*! Memory used by the big buffers of each subsystem, to know which one is to blame when a render runs out of memory
+	and to predict the memory of a render. Only the buffers growing with the scene size are tracked, through the
+	MemoryTracker of their owners, so the totals are a lower bound of the process memory.
+	The counters are atomic, as some buffers are allocated by the render threads */
+class LIBYAFARAY_EXPORT MemoryStats final
+{
+	public:
+		enum Category : int { Meshes, Accelerators, Textures, TextureTiles, Photons, ImageFilm, Volumes, NumCategories };
+		struct Usage
+		{
+			int64_t current_ = 0; //!< bytes
+			int64_t peak_ = 0; //!< bytes, since the start or the last resetPeaks()
+			int64_t count_ = 0; //!< number of owners with tracked memory, for example meshes or photon maps
+		};
+		static void add(Category category, int64_t bytes, int64_t count);
+		static Usage getUsage(Category category);
+		static Usage getTotal(); //!< the total peak is the peak of the sum, not the sum of the peaks
+		static std::string getCategoryName(Category category);
+		static void resetPeaks(); //!< sets the peaks to the current values, for example at the start of each render
+		static std::string toJson();
+		static std::string toString(); //!< one line summary in MiB for the log
+};
+
+/*! Tracked memory of an owner, added to its MemoryStats category while the owner exists. The owner sets the size of
+	its buffers with set() whenever it changes significantly, usually after building them. The copies of an owner
+	track the same size, as they copy its buffers */
+class MemoryTracker final
+{
+	public:
+		explicit MemoryTracker(MemoryStats::Category category) : category_(category) { }
+		MemoryTracker(const MemoryTracker &tracker) : category_(tracker.category_) { set(tracker.bytes_); }
+		MemoryTracker &operator=(const MemoryTracker &tracker);
+		~MemoryTracker() { set(0); }
+		void set(size_t bytes);
+		size_t get() const { return bytes_; }
+
+	private:
+		MemoryStats::Category category_;
+		size_t bytes_ = 0;
+};
+
+inline MemoryTracker &MemoryTracker::operator=(const MemoryTracker &tracker)
+{
+	if(this == &tracker) return *this;
+	set(0);
+	category_ = tracker.category_;
+	set(tracker.bytes_);
+	return *this;
+}
+
+inline void MemoryTracker::set(size_t bytes)
+{
+	if(bytes == bytes_) return;
+	MemoryStats::add(category_, static_cast<int64_t>(bytes) - static_cast<int64_t>(bytes_), (bytes > 0 ? 1 : 0) - (bytes_ > 0 ? 1 : 0));
+	bytes_ = bytes;
+}
+
+//! memory reserved by a vector, not only the used part
+template <typename T, typename Allocator>
+inline size_t vectorMemory_global(const std::vector<T, Allocator> &vector) { return vector.capacity() * sizeof(T); }
+
+END_YAFARAY
+
+#endif //YAFARAY_MEMORY_STATS_H
@@ -21,7 +21,6 @@
 #define YAFARAY_PARAM_H
 
 #include "constants.h"
-#include <map>
 #include <vector>
 #include <string>
 
@@ -86,28 +85,33 @@ class LIBYAFARAY_EXPORT Parameter
 		std::vector<float> vval_;
 };
 
+/*! Parameters sorted by name in a flat vector: the maps are small, built once and looked up a few times by
+ * each factory, so the binary search over contiguous entries is faster than the tree nodes of a std::map */
 class LIBYAFARAY_EXPORT ParamMap
 {
 	public:
+		using Container = std::vector<std::pair<std::string, Parameter>>;
 		ParamMap() = default;
 		//! template function to get a value, available types are those of parameter_t::getVal()
 		template <class T>
-		bool getParam(const std::string &name, T &val) const
+		bool getParam(const char *name, T &val) const
 		{
-			auto i = dicc_.find(name);
-			if(i != dicc_.end()) return i->second.getVal(val);
-			return false;
+			const Parameter *param = find(name);
+			return param && param->getVal(val);
 		}
+		template <class T>
+		bool getParam(const std::string &name, T &val) const { return getParam(name.c_str(), val); }
+		const Parameter *find(const char *name) const; //!< nullptr if there is no parameter with the name. The names given as literals are compared without building a string
 		Parameter &operator [](const std::string &key);
 		std::string print() const;
 		void printDebug() const;
 
 		void clear();
-		std::map<std::string, Parameter>::const_iterator begin() const;
-		std::map<std::string, Parameter>::const_iterator end() const;
+		Container::const_iterator begin() const;
+		Container::const_iterator end() const;
 
 	private:
-		std::map<std::string, Parameter> dicc_;
+		Container dicc_;
 };
 
 END_YAFARAY
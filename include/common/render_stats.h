@@ -0,0 +1,91 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_RENDER_STATS_H
+#define YAFARAY_RENDER_STATS_H
+
+#include "constants.h"
+#include <string>
+#include <cstdint>
+
+BEGIN_YAFARAY
+
+/*! Counters and histograms of the render hot paths, only compiled in with the RENDER_STATS build option.
+	They are registered at compile time in the Counter and Histogram enums, so counting is just an increment
+	in the cache line aligned slots of the calling thread, without any name look up nor lock. The slots of all
+	the threads are added together at the end of each pass. Without RENDER_STATS the counting functions are
+	empty and nothing is stored
+*/
+class RenderStats final
+{
+	public:
+		enum Counter : int { CameraSamples, Rays, ShadowRays, ShadowCacheHits, BsdfSamples, TextureLookups, NumCounters };
+		enum Histogram : int { PathBounces, NumHistograms };
+		static constexpr int num_buckets_ = 16; //!< the last bucket also counts all the bigger values
+		static constexpr bool enabled()
+		{
+#ifdef RENDER_STATS
+			return true;
+#else
+			return false;
+#endif
+		}
+		static void add(Counter counter, uint64_t amount = 1);
+		static void addToHistogram(Histogram histogram, int value);
+		static RenderStats collectPass(); //!< counters of all the threads since the previous pass, added to the render totals, to be called between passes
+		static RenderStats renderTotal(); //!< sum of the collected passes, not to be called while rendering
+		static void reset(); //!< not to be called while rendering
+		RenderStats &operator += (const RenderStats &stats);
+		std::string toJson() const;
+		uint64_t counters_[NumCounters] = { };
+		uint64_t histograms_[NumHistograms][num_buckets_] = { };
+
+	private:
+		static RenderStats *registerThread(); //!< slow path, only taken in the first count of each thread
+};
+
+#ifdef RENDER_STATS
+
+extern thread_local RenderStats *render_stats_thread_slots_global;
+
+inline void RenderStats::add(Counter counter, uint64_t amount)
+{
+	RenderStats *slots = render_stats_thread_slots_global;
+	if(!slots) slots = registerThread();
+	slots->counters_[counter] += amount;
+}
+
+inline void RenderStats::addToHistogram(Histogram histogram, int value)
+{
+	RenderStats *slots = render_stats_thread_slots_global;
+	if(!slots) slots = registerThread();
+	const int bucket = value < 0 ? 0 : (value < num_buckets_ ? value : num_buckets_ - 1);
+	++slots->histograms_[histogram][bucket];
+}
+
+#else
+
+inline void RenderStats::add(Counter, uint64_t) { }
+inline void RenderStats::addToHistogram(Histogram, int) { }
+
+#endif //RENDER_STATS
+
+END_YAFARAY
+
+#endif //YAFARAY_RENDER_STATS_H
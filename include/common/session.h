@@ -25,11 +25,19 @@
 
 #include "constants.h"
 #include "thread.h"
+#include <map>
+#include <memory>
+#include <vector>
 
 BEGIN_YAFARAY
 
 class PhotonMap;
+struct PhotonMapsState;
+struct BackgroundDistribution;
+class PrefilteredEnvironment;
 
+/*! Render state of one scene kept between its renders: photon maps and cached light and volume data.
+	Each Scene owns its own session, so several scenes can be rendered at the same time in one process */
 class LIBYAFARAY_EXPORT Session
 {
 	public:
@@ -44,9 +52,13 @@ class LIBYAFARAY_EXPORT Session
 		bool getDifferentialRaysEnabled() const { return ray_differentials_enabled_; }
 		bool isPreview() const { return false; } //FIXME!
 
-		bool isInteractive();
+		bool isInteractive() const { return interactive_; }
 
 		std::unique_ptr<PhotonMap> caustic_map_, diffuse_map_, radiance_map_;
+		std::unique_ptr<PhotonMapsState> photon_maps_state_; //!< what the photon maps were shot from, to update them incrementally
+		std::map<uint64_t, std::shared_ptr<const std::vector<float>>> attenuation_grids_; //!< single scatter light attenuation grids from the last render, keyed by the signature of the volumes and light they were computed for
+		std::map<uint64_t, std::shared_ptr<const BackgroundDistribution>> background_distributions_; //!< background light distributions of the last renders, keyed by Background::getDistributionKey
+		std::map<uint64_t, std::shared_ptr<const PrefilteredEnvironment>> prefiltered_environments_; //!< prefiltered backgrounds of the last renders, keyed by Background::getDistributionKey and the prefiltering settings
 		std::mutex mutx_;
 
 	protected:
@@ -54,8 +66,6 @@ class LIBYAFARAY_EXPORT Session
 		bool interactive_ = false;
 };
 
-extern LIBYAFARAY_EXPORT Session session_global;
-
 END_YAFARAY
 
 #endif
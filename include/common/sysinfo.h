@@ -23,13 +23,25 @@
 #define YAFARAY_SYSINFO_H
 
 #include "constants.h"
+#include <string>
+#include <vector>
+
+//The SIMD kernels are compiled for each instruction set with the GCC/Clang target attributes and selected at run time
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define YAFARAY_SIMD_DISPATCH 1
+#endif
 
 BEGIN_YAFARAY
 
 class SysInfo
 {
 	public:
+		enum class SimdLevel : int { Generic, Sse42, Avx2, Avx512 }; //!< in increasing order, each level includes the previous ones
+		SimdLevel getSimdLevel() const; //!< Highest SIMD instruction set supported by the CPU and the OS, detected once with CPUID. Generic if the SIMD kernels are not compiled for several instruction sets in this build
+		static std::string getSimdLevelName(SimdLevel simd_level);
 		int getNumSystemThreads() const;
+		std::vector<int> getNumaCpuOrder() const; //!< CPU ids taking one CPU of each NUMA node in turn, so threads pinned in this order are spread evenly between the nodes. Only detected in Linux, elsewhere the CPUs are in consecutive order
+		bool pinCurrentThread(int cpu_id) const; //!< Restricts the calling thread to the given CPU. Returns false if it's not supported in this system or it failed
 };
 
 END_YAFARAY
@@ -0,0 +1,117 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_TASK_POOL_H
+#define YAFARAY_TASK_POOL_H
+
+#include "constants.h"
+#include "common/thread.h"
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+
+BEGIN_YAFARAY
+
+/*! Work-stealing pool for fork-join parallelism, like the recursive tree builds.
+	Each thread has its own task queue: new tasks are added to the queue of the thread
+	creating them and taken back from the same end (depth-first, good data locality),
+	while the idle threads steal from the other end of the other queues, where the
+	oldest and usually largest tasks are. The threads waiting for a group of tasks
+	run pending tasks meanwhile, so no thread stays blocked while there is work left.
+	The thread creating the pool works as one of its threads when it waits for a group
+*/
+class TaskPool final
+{
+	public:
+		class Group;
+		explicit TaskPool(int num_threads, const std::vector<int> &worker_cpus = {}); //!< if worker_cpus is not empty, each worker thread is pinned to the next CPU in it
+		TaskPool(const TaskPool &task_pool) = delete;
+		~TaskPool();
+		int getNumThreads() const { return static_cast<int>(workers_.size()) + 1; }
+		int getCurrentThreadId() const { return static_cast<int>(currentQueueId()); } //!< 0 for the thread creating the pool and the threads not belonging to it, from 1 for the worker threads
+
+	private:
+		struct Task
+		{
+			std::function<void()> function_;
+			Group *group_;
+		};
+		struct Queue
+		{
+			std::mutex mutex_;
+			std::deque<Task> tasks_;
+		};
+		void push(Task task);
+		bool runPendingTask(); //!< runs one task of the calling thread queue or stolen from another queue, returns false if there were no pending tasks
+		void workerLoop(size_t queue_id, int cpu_id);
+		size_t currentQueueId() const; //!< queue of the calling thread, the threads not belonging to the pool share the first queue
+
+		std::vector<std::unique_ptr<Queue>> queues_;
+		std::vector<std::thread> workers_;
+		std::mutex sleep_mutex_;
+		std::condition_variable sleep_condition_;
+		std::atomic<int> num_queued_tasks_ {0};
+		std::atomic<bool> finish_ {false};
+};
+
+/*! Set of tasks to be waited for together. The Group must outlive its tasks, the destructor waits for them */
+class TaskPool::Group final
+{
+	public:
+		explicit Group(TaskPool &task_pool) : task_pool_(task_pool) { }
+		Group(const Group &group) = delete;
+		~Group() { wait(); }
+		void run(std::function<void()> function); //!< runs the function immediately if the pool has no other threads
+		void wait();
+
+	private:
+		friend class TaskPool;
+		TaskPool &task_pool_;
+		std::atomic<int> num_unfinished_tasks_ {0};
+};
+
+/*! Tasks with dependencies between them, each one run by the task pool as soon as the tasks it depends on finished.
+	The dependencies are given by the ids returned when adding the tasks, so they always refer to earlier tasks and the graph has no cycles */
+class TaskGraph final
+{
+	public:
+		explicit TaskGraph(TaskPool &task_pool) : task_pool_(task_pool) { }
+		TaskGraph(const TaskGraph &task_graph) = delete;
+		size_t add(std::function<void()> function, const std::vector<size_t> &dependencies = {}); //!< returns the id of the task
+		void run(); //!< runs all the tasks and waits for them
+
+	private:
+		struct Node
+		{
+			std::function<void()> function_;
+			std::vector<size_t> dependents_;
+			std::atomic<int> num_pending_dependencies_ {0};
+		};
+		void runNode(TaskPool::Group &task_group, size_t node_id);
+		TaskPool &task_pool_;
+		std::vector<std::unique_ptr<Node>> nodes_;
+};
+
+//! Calls function(begin, end) for consecutive chunks of [0, size), run in parallel by the task pool threads when there is enough work for more than one chunk
+void parallelFor_global(TaskPool *task_pool, size_t size, const std::function<void(size_t begin, size_t end)> &function, size_t min_chunk_size = 4096);
+
+END_YAFARAY
+
+#endif //YAFARAY_TASK_POOL_H
@@ -59,9 +59,6 @@ class Timer
 		std::map<std::string, Tdata> events_;
 };
 
-// global timer object, defined in timer.cc
-extern Timer g_timer_global;
-
 END_YAFARAY
 
 #endif
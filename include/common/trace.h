@@ -0,0 +1,69 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_TRACE_H
+#define YAFARAY_TRACE_H
+
+#include "constants.h"
+#include <string>
+#include <cstdint>
+#include <atomic>
+
+BEGIN_YAFARAY
+
+/*! Timeline of the render phases, saved as a Chrome trace JSON file to be opened with chrome://tracing or Perfetto,
+	showing the idle threads, the serial phases and the tile imbalance of a render. The spans are only recorded
+	while a trace file is set with the "trace_file" scene parameter, otherwise they just check a flag */
+class Trace final
+{
+	public:
+		static void setFile(const std::string &file_path); //!< enables the recording if the path is not empty
+		static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+		static int64_t now(); //!< microseconds since the recording was enabled
+		static void addSpan(const char *category, const char *name, std::string &&args, int64_t begin, int64_t end);
+		static bool save(); //!< writes all the spans recorded so far to the trace file
+
+	private:
+		static std::atomic<bool> enabled_;
+};
+
+/*! Span of the timeline from its construction to its destruction, in the calling thread. The names are literals,
+	and the arguments are only formatted while the recording is enabled */
+class TraceSpan final
+{
+	public:
+		TraceSpan(const char *category, const char *name) : category_(category), name_(name), enabled_(Trace::isEnabled()) { if(enabled_) begin_ = Trace::now(); }
+		~TraceSpan() { if(enabled_) Trace::addSpan(category_, name_, std::move(args_), begin_, Trace::now()); }
+		TraceSpan(const TraceSpan &) = delete;
+		TraceSpan &operator=(const TraceSpan &) = delete;
+		void addArg(const char *name, int64_t value) { if(enabled_) addArgName(name) += std::to_string(value); }
+		void addArg(const char *name, const std::string &value);
+
+	private:
+		std::string &addArgName(const char *name);
+		const char *category_;
+		const char *name_;
+		bool enabled_;
+		int64_t begin_ = 0;
+		std::string args_; //!< JSON members of the "args" object of the span
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_TRACE_H
@@ -22,6 +22,7 @@
 
 #include "constants.h"
 #include <string>
+#include <cstdint>
 
 BEGIN_YAFARAY
 
@@ -36,6 +37,18 @@ inline Visibility visibilityFromString_global(const std::string &str)
 	else return Visibility::NormalVisible;
 }
 
+/*! Ray types seeing a primitive, stored compactly by the accelerators with the primitives so the ones not seen by a ray are skipped before intersecting them.
+	The radiance rays are the camera rays and their bounces */
+enum RayTypeMask : uint8_t { RayTypeNone = 0, RayTypeRadiance = 1, RayTypeShadow = 1 << 1 };
+
+inline uint8_t rayTypeMaskFromVisibility_global(const Visibility &visibility)
+{
+	if(visibility == Visibility::NormalVisible) return RayTypeRadiance | RayTypeShadow;
+	else if(visibility == Visibility::VisibleNoShadows) return RayTypeRadiance;
+	else if(visibility == Visibility::InvisibleShadowsOnly) return RayTypeShadow;
+	else return RayTypeNone;
+}
+
 inline std::string stringFromVisibility_global(const Visibility &visibility)
 {
 	if(visibility == Visibility::NormalVisible) return "normal";
@@ -24,6 +24,8 @@
 #include <map>
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <memory>
 
 BEGIN_YAFARAY
 
@@ -39,17 +41,28 @@ class LIBYAFARAY_EXPORT XmlExport: public Interface
 		virtual unsigned int getNextFreeId() override;
 		virtual bool endObject() override;
 		virtual bool addInstance(const char *base_object_name, const Matrix4 &obj_to_world) override;
+		virtual bool addInstances(const char *base_object_name, const float *obj_to_world, unsigned int num_instances) override;
+		virtual bool updateInstance(const char *base_object_name, unsigned int instance_number, const Matrix4 &obj_to_world) override;
+		virtual bool addObjectLod(const char *base_object_name, const char *lod_object_name, float max_screen_size) override;
+		virtual Camera *updateCamera(const char *name) override;
+		virtual Material *updateMaterial(const char *name) override;
+		virtual Light *updateLight(const char *name) override;
 		virtual int  addVertex(double x, double y, double z) override; //!< add vertex to mesh; returns index to be used for addTriangle
 		virtual int  addVertex(double x, double y, double z, double ox, double oy, double oz) override; //!< add vertex with Orco to mesh; returns index to be used for addTriangle
 		virtual void addNormal(double nx, double ny, double nz) override; //!< add vertex normal to mesh; the vertex that will be attached to is the last one inserted by addVertex method
 		virtual bool addFace(int a, int b, int c) override;
 		virtual bool addFace(int a, int b, int c, int uv_a, int uv_b, int uv_c) override;
 		virtual int  addUv(float u, float v) override;
+		virtual int  addVertices(const float *vertices, unsigned int num_vertices, const float *orco = nullptr) override;
+		virtual void addNormals(const float *normals, unsigned int num_normals) override;
+		virtual bool addFaces(const int *vert_indices, unsigned int num_faces, const int *uv_indices = nullptr) override;
+		virtual int  addUvs(const float *uvs, unsigned int num_uvs) override;
 		virtual bool smoothMesh(const char *name, double angle) override;
 		virtual void setCurrentMaterial(const char *name) override;
 		virtual Object *createObject(const char *name) override;
 		virtual Light *createLight(const char *name) override;
 		virtual Texture *createTexture(const char *name) override;
+		virtual bool addImageBuffer(const char *name, const void *data, int width, int height, int num_channels, bool float_data, long long row_stride, bool reference_host_memory = false) override;
 		virtual Material *createMaterial(const char *name) override;
 		virtual Camera *createCamera(const char *name) override;
 		virtual Background *createBackground(const char *name) override;
@@ -61,10 +74,22 @@ class LIBYAFARAY_EXPORT XmlExport: public Interface
 		virtual void clearOutputs() override { }
 		virtual void render(ProgressBar *pb = nullptr, bool auto_delete_progress_bar = false) override; //!< render the scene...
 		void setXmlColorSpace(std::string color_space_string, float gamma_val);
+		/*! Writes the vertices, normals, faces and uvs to a binary geometry file next to the XML file, referenced by the XML file by offset.
+		 * Must be set before createScene. The XML file keeps the scene description and the parameters */
+		void setBinaryGeometry(bool binary_geometry) { binary_geometry_ = binary_geometry; }
+		static constexpr char geometry_file_header_[16] = "YAFARAY_GEOM_V1"; //!< at the start of the binary geometry files, followed by the arrays in the native byte order
 
 	protected:
+		enum class GeometryBlock : int { None, Vertices, VerticesOrco, Normals, Faces, FacesUv, Uvs };
+		void startGeometryBlock(GeometryBlock block); //!< flushes the geometry buffered by the single element calls when the block type changes
+		void flushGeometryBlock();
+		uint64_t writeGeometryData(const void *data, size_t size); //!< returns the offset of the data in the geometry file
+		void writeVerticesBlock(const float *vertices, size_t num_vertices, const float *orco);
+		void writeFacesBlock(const int *vert_indices, size_t num_faces, const int *uv_indices);
 		void writeParamMap(const ParamMap &param_map, int indent = 1);
 		void writeParamList(int indent);
+		static constexpr size_t file_buffer_size_ = 1 << 20;
+		std::unique_ptr<char[]> file_buffer_; //!< large stream buffer of the XML file, declared before the stream to outlive it
 		std::ofstream xml_file_;
 		std::string xml_name_;
 		std::string current_material_;
@@ -73,6 +98,12 @@ class LIBYAFARAY_EXPORT XmlExport: public Interface
 		unsigned int next_obj_ = 0;
 		float xml_gamma_ = 1.f;
 		ColorSpace xml_color_space_ = RawManualGamma;
+		bool binary_geometry_ = false;
+		std::ofstream geometry_file_;
+		uint64_t geometry_offset_ = 0;
+		GeometryBlock geometry_block_ = GeometryBlock::None;
+		std::vector<float> block_values_, block_orco_; //!< geometry of the single element calls, written as a single block
+		std::vector<int> block_indices_, block_uv_indices_;
 };
 
 typedef XmlExport *XmlExportConstructor_t();
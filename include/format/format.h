@@ -27,6 +27,8 @@
 #include "constants.h"
 #include "image/image.h"
 #include "common/memory.h"
+#include "color/color.h"
+#include <array>
 #include <limits>
 
 BEGIN_YAFARAY
@@ -34,7 +36,29 @@ BEGIN_YAFARAY
 class ImageLayers;
 class ParamMap;
 class Scene;
-enum ColorSpace : int;
+class TaskPool;
+
+/*! Converts the decoded 8 bit channel values to linear RGB. The color spaces converting each channel separately use a table
+ * of the 256 channel values, as computing the color space curve for each texel is much slower than looking it up */
+class LinearTable8Bit final
+{
+	public:
+		LinearTable8Bit(const ColorSpace &color_space, float gamma);
+		Rgba getColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a) const
+		{
+			if(by_channel_) return Rgba(table_[r], table_[g], table_[b], a * inv_max_8_bit_);
+			Rgba color(r * inv_max_8_bit_, g * inv_max_8_bit_, b * inv_max_8_bit_, a * inv_max_8_bit_);
+			color.linearRgbFromColorSpace(color_space_, gamma_);
+			return color;
+		}
+
+	private:
+		static constexpr float inv_max_8_bit_ = 1.f / static_cast<float>(std::numeric_limits<uint8_t>::max());
+		ColorSpace color_space_;
+		float gamma_;
+		bool by_channel_; //!< false for the color spaces mixing the channels, converted texel by texel
+		std::array<float, 256> table_;
+};
 
 class LIBYAFARAY_EXPORT Format
 {
@@ -51,8 +75,12 @@ class LIBYAFARAY_EXPORT Format
 		virtual bool supportsAlpha() const { return true; }
 		virtual std::string getFormatName() const { return ""; }
 		void setGrayScaleSetting(bool grayscale) { grayscale_ = grayscale; }
+		void setTaskPool(TaskPool *task_pool) { task_pool_ = task_pool; } //!< threads to decode and convert the images, when the format supports it
+		void setHugePagesMode(HugePages::Mode huge_pages_mode) { huge_pages_mode_ = huge_pages_mode; } //!< of the scene the images are loaded for
 
 	protected:
+		TaskPool *task_pool_ = nullptr;
+		HugePages::Mode huge_pages_mode_ = HugePages::Mode::None;
 		bool grayscale_ = false; //!< Converts the information loaded from the texture RGB to grayscale to reduce memory usage for bump or mask textures, for example. Alpha is ignored in this case.
 
 		static constexpr double inv_31_ = 1.0 / 31.0;
@@ -25,6 +25,7 @@
 #define YAFARAY_FORMAT_EXR_H
 
 #include "format/format.h"
+#include <vector>
 
 BEGIN_YAFARAY
 
@@ -42,6 +43,28 @@ class ExrFormat final : public Format
 		virtual bool supportsMultiLayer() const override { return true; }
 };
 
+//! Tiled multi-layer EXR file, with tiles that can be written in any order so the render areas can be saved as soon as they are finished
+class ExrTiledWriter final
+{
+	public:
+		ExrTiledWriter(const std::string &name, int width, int height, int tile_size, const std::vector<std::string> &layer_names);
+		~ExrTiledWriter();
+		bool isOpen() const { return static_cast<bool>(file_data_); }
+		int getTileSize() const { return tile_size_; }
+		int getNumTilesX() const { return (width_ + tile_size_ - 1) / tile_size_; }
+		int getNumTilesY() const { return (height_ + tile_size_ - 1) / tile_size_; }
+		//! Each layer has tile_size x tile_size colors by rows, the pixels outside the image in the tiles of the right and bottom borders are ignored
+		bool writeTile(int tile_x, int tile_y, const std::vector<const Rgba *> &layers_colors);
+
+	private:
+		struct FileData; //!< OpenEXR file and stream, kept out of the header
+		std::unique_ptr<FileData> file_data_;
+		std::vector<std::string> layer_names_;
+		int width_ = 0;
+		int height_ = 0;
+		int tile_size_ = 64;
+};
+
 END_YAFARAY
 
 #endif // YAFARAY_FORMAT_EXR_H
\ No newline at end of file
@@ -55,7 +55,7 @@ class LIBYAFARAY_EXPORT Matrix4
 
 	private:
 		float matrix_[4][4];
-		int invalid_;
+		int invalid_ = 0;
 };
 
 inline Matrix4 operator * (const Matrix4 &a, const Matrix4 &b)
@@ -48,12 +48,15 @@ class Object
 		/*! To check if we can use the MeshObject interface or not for a certain object. It's a "hack" but
 		 * the only way to handle MeshObjects without cluttering the basic Object interface */
 		virtual bool isMesh() const { return false; }
+		/*! the geometry of the object is only loaded when a ray reaches its bound, see DeferredObject */
+		virtual bool isDeferred() const { return false; }
 		/*! the number of primitives the object holds. Primitive is an element
 			that by definition can perform ray-triangle intersection */
 		virtual int numPrimitives() const = 0;
-		/*! write the primitive pointers to the given array
-			\return number of written primitives */
 		virtual const std::vector<const Primitive *> getPrimitives() const = 0;
+		/*! write the primitive pointers to the given array, with room for numPrimitives() pointers, without allocating a vector for them
+			\return number of written primitives */
+		virtual int writePrimitives(const Primitive **primitives) const;
 		/*! sample object surface */
 		//virtual void sample(float s_1, float s_2, Point3 &p, Vec3 &n)  const = 0;
 		/*! Sets the object visibility to the renderer (is added or not to the kdtree) */
@@ -75,8 +78,18 @@ class Object
 		virtual const Light *getLight() const = 0;
 		/*! set a light source to be associated with this object */
 		virtual void setLight(const Light *light) = 0;
+		/*! Light linking: bit mask of the light link groups illuminating the object, all of them by default */
+		virtual unsigned int getLightLinkMask() const = 0;
+		virtual void setLightLinkMask(unsigned int light_link_mask) = 0;
 		virtual bool calculateObject(const Material *material = nullptr) = 0;
+		//! makes its primitives using the old material use the new one, for the material updates
+		virtual void replaceMaterial(const Material *old_material, const Material *new_material) { }
 		virtual const Matrix4 *getObjToWorldMatrix() const { return nullptr; }
+		/*! Number of transformations of the instances this object stands for, more than one for the instance arrays */
+		virtual size_t numInstances() const { return getObjToWorldMatrix() ? 1 : 0; }
+		virtual const Matrix4 *getInstanceObjToWorldMatrix(size_t instance_number) const { return getObjToWorldMatrix(); }
+		/*! Returns the base object if this object is an instance, nullptr otherwise */
+		virtual const Object *getBaseObject() const { return nullptr; }
 };
 
 END_YAFARAY
@@ -30,8 +30,9 @@ class ObjectInstance : public Object
 {
 	public:
 		ObjectInstance(const Object &base_object, const Matrix4 &obj_to_world);
-		virtual int numPrimitives() const override { return primitive_instances_.size(); }
+		virtual int numPrimitives() const override { return base_object_.numPrimitives(); }
 		virtual const std::vector<const Primitive *> getPrimitives() const override;
+		virtual int writePrimitives(const Primitive **primitives) const override;
 		virtual std::string getName() const override { return base_object_.getName(); }
 		virtual void setName(const std::string &name) override { }
 		virtual bool isMesh() const override { return base_object_.isMesh(); }
@@ -56,13 +57,23 @@ class ObjectInstance : public Object
 		virtual const Light *getLight() const override { return base_object_.getLight(); }
 		/*! set a light source to be associated with this object */
 		virtual void setLight(const Light *light) override { }
+		virtual unsigned int getLightLinkMask() const override { return base_object_.getLightLinkMask(); }
+		virtual void setLightLinkMask(unsigned int light_link_mask) override { }
 		virtual const Matrix4 *getObjToWorldMatrix() const override { return obj_to_world_.get(); }
+		/*! Changes the transformation in place, so the accelerators referencing the matrix can be refitted instead of rebuilt */
+		void setObjToWorldMatrix(const Matrix4 &obj_to_world);
+		/*! Inverse of the transformation, cached for transforming the rays to object space. nullptr if the transformation is not invertible */
+		const Matrix4 *getWorldToObjMatrix() const;
+		virtual const Object *getBaseObject() const override { return &base_object_; }
 		virtual bool calculateObject(const Material *material = nullptr) override { return true; }
 
 	protected:
+		explicit ObjectInstance(const Object &base_object) : base_object_(base_object) { }
+		void createPrimitiveInstances() const;
 		const Object &base_object_;
-		std::unique_ptr<const Matrix4> obj_to_world_;
-		std::vector<std::unique_ptr<const Primitive>> primitive_instances_;
+		std::unique_ptr<Matrix4> obj_to_world_;
+		std::unique_ptr<Matrix4> world_to_obj_;
+		mutable std::vector<std::unique_ptr<const Primitive>> primitive_instances_; //!< only created on demand, two-level accelerators intersect the base object primitives directly
 };
 
 END_YAFARAY
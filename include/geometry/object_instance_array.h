@@ -0,0 +1,65 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_OBJECT_INSTANCE_ARRAY_H
+#define YAFARAY_OBJECT_INSTANCE_ARRAY_H
+
+#include "geometry/object_instance.h"
+#include "geometry/matrix4.h"
+
+BEGIN_YAFARAY
+
+/*! Many instances of the same base object added in a single call, only keeping their transformations.
+	It has no primitive instances, the instance arrays are always intersected by the two-level (or Embree) accelerators */
+class ObjectInstanceArray final : public ObjectInstance
+{
+	public:
+		/*! obj_to_world has the 3 first rows of the matrix of each instance (12 floats per instance, row-major), the last row being (0, 0, 0, 1) */
+		ObjectInstanceArray(const Object &base_object, const float *obj_to_world, size_t num_instances);
+		virtual int numPrimitives() const override { return 0; }
+		virtual const std::vector<const Primitive *> getPrimitives() const override { return {}; }
+		virtual int writePrimitives(const Primitive **primitives) const override { return 0; }
+		virtual const Matrix4 *getObjToWorldMatrix() const override { return obj_to_world_matrices_.empty() ? nullptr : obj_to_world_matrices_.data(); }
+		virtual size_t numInstances() const override { return obj_to_world_matrices_.size(); }
+		virtual const Matrix4 *getInstanceObjToWorldMatrix(size_t instance_number) const override { return &obj_to_world_matrices_[instance_number]; }
+
+	private:
+		std::vector<Matrix4> obj_to_world_matrices_;
+};
+
+/*! Instances using a level of detail of their base object, made by the scene from the instances of the base object whose projected size selects that level.
+	It references the transformations of the original instances, so their updates still refit the accelerator */
+class ObjectInstanceLod final : public ObjectInstance
+{
+	public:
+		ObjectInstanceLod(const Object &lod_object, std::vector<const Matrix4 *> obj_to_world) : ObjectInstance(lod_object), obj_to_world_matrices_(std::move(obj_to_world)) { }
+		virtual int numPrimitives() const override { return 0; }
+		virtual const std::vector<const Primitive *> getPrimitives() const override { return {}; }
+		virtual int writePrimitives(const Primitive **primitives) const override { return 0; }
+		virtual const Matrix4 *getObjToWorldMatrix() const override { return obj_to_world_matrices_.empty() ? nullptr : obj_to_world_matrices_.front(); }
+		virtual size_t numInstances() const override { return obj_to_world_matrices_.size(); }
+		virtual const Matrix4 *getInstanceObjToWorldMatrix(size_t instance_number) const override { return obj_to_world_matrices_[instance_number]; }
+
+	private:
+		std::vector<const Matrix4 *> obj_to_world_matrices_;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_OBJECT_INSTANCE_ARRAY_H
@@ -48,6 +48,9 @@ class Primitive
 		virtual ~Primitive() = default;
 		/*! return the object bound in global ("world") coordinates */
 		virtual Bound getBound(const Matrix4 *obj_to_world = nullptr) const = 0;
+		/*! For primitives moving during the frame: bounds at the start and at the end of the frame time, such that the bounds linearly interpolated at any ray time contain the primitive at that time
+			\return false for static primitives, which only have the getBound() bound */
+		virtual bool getMotionBounds(Bound &bound_start, Bound &bound_end, const Matrix4 *obj_to_world = nullptr) const { return false; }
 		/*! a possibly more precise check to find out if the primitve really
 			intersects the bound of interest, given that the primitive's bound does.
 			used e.g. for optimized kd-tree construction */
@@ -60,10 +63,16 @@ class Primitive
 			\return false if ray misses primitive, true otherwise
 			\param t set this to raydepth where hit occurs */
 		virtual IntersectData intersect(const Ray &ray, const Matrix4 *obj_to_world = nullptr) const;
+		/*! get the vertices if the primitive is a flat triangle, so accelerators can store them precomputed
+			\return false if the primitive is not a triangle */
+		virtual bool getTriangleVertices(std::array<Point3, 3> &vertices, const Matrix4 *obj_to_world = nullptr) const { return false; }
 		/* fill in surfacePoint_t */
 		virtual SurfacePoint getSurface(const Point3 &hit, const IntersectData &data, const Matrix4 *obj_to_world = nullptr) const;
+		/* original coordinates (orco) of a surface point of this primitive, only computed when a texture asks for them. By default the world position and geometric normal */
+		virtual void getOrco(const SurfacePoint &sp, Point3 &orco_p, Vec3 &orco_ng) const;
 		/* return the material */
 		virtual const Material *getMaterial() const { return nullptr; }
+		virtual void setMaterial(const Material *material) { }
 		/* calculate surface area */
 		virtual float surfaceArea(const Matrix4 *obj_to_world = nullptr) const = 0;
 		/* obtains the geometric normal in the surface parametric u,v coordinates */
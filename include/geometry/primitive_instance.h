@@ -40,13 +40,16 @@ class PrimitiveInstance : public Primitive
 {
 	public:
 		//static PrimitiveInstance *factory(ParamMap &params, const Scene &scene);
-		PrimitiveInstance(const Primitive *base_primitive, const Object &object_yafaray_instance) : Primitive(object_yafaray_instance), base_primitive_(base_primitive) { }
+		PrimitiveInstance(const Primitive *base_primitive, const ObjectInstance &object_instance);
 		virtual Bound getBound(const Matrix4 *) const override;
+		virtual bool getMotionBounds(Bound &bound_start, Bound &bound_end, const Matrix4 *) const override;
 		virtual bool intersectsBound(const ExBound &b, const Matrix4 *) const override;
 		virtual bool clippingSupport() const override { return base_primitive_->clippingSupport(); }
 		virtual PolyDouble::ClipResultWithBound clipToBound(const std::array<Vec3Double, 2> &bound, const ClipPlane &clip_plane, const PolyDouble &poly, const Matrix4 *obj_to_world) const override;
 		virtual IntersectData intersect(const Ray &ray, const Matrix4 *) const override;
+		virtual bool getTriangleVertices(std::array<Point3, 3> &vertices, const Matrix4 *) const override;
 		virtual SurfacePoint getSurface(const Point3 &hit_point, const IntersectData &intersect_data, const Matrix4 *) const override;
+		virtual void getOrco(const SurfacePoint &sp, Point3 &orco_p, Vec3 &orco_ng) const override { base_primitive_->getOrco(sp, orco_p, orco_ng); }
 		virtual const Material *getMaterial() const override { return base_primitive_->getMaterial(); }
 		virtual float surfaceArea(const Matrix4 *) const override;
 		virtual Vec3 getGeometricNormal(const Matrix4 *, float u, float v) const override;
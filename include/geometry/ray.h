@@ -45,11 +45,31 @@ class DiffRay: public Ray
 		DiffRay(const Ray &r): Ray(r), has_differentials_(false) {}
 		DiffRay(const Point3 &f, const Vec3 &d, float start = 0.0, float end = -1.f, float ftime = 0.f):
 				Ray(f, d, start, end, ftime), has_differentials_(false) {}
+		float getConeWidth(float distance) const; //!< width of the ray footprint at a distance from its origin, from its differentials or from its cone
+		float getConeSpread() const; //!< increase of the footprint width per unit distance
+		void setCone(float width, float spread) { has_differentials_ = false; cone_width_ = width; cone_spread_ = spread; }
+		bool hasCone() const { return cone_width_ > 0.f || cone_spread_ > 0.f; }
 		bool has_differentials_;
 		Point3 xfrom_, yfrom_;
 		Vec3 xdir_, ydir_;
+		/*! The camera rays keep their differentials, the secondary rays only a cone (ray cone tracking):
+			its footprint width at the ray origin and its spread, much cheaper to propagate on each bounce */
+		float cone_width_ = 0.f;
+		float cone_spread_ = 0.f;
 };
 
+inline float DiffRay::getConeWidth(float distance) const
+{
+	if(has_differentials_) return 0.5f * ((xfrom_ - from_).length() + (yfrom_ - from_).length()) + distance * getConeSpread();
+	return cone_width_ + distance * cone_spread_;
+}
+
+inline float DiffRay::getConeSpread() const
+{
+	if(has_differentials_) return 0.5f * ((xdir_ - dir_).length() + (ydir_ - dir_).length());
+	return cone_spread_;
+}
+
 END_YAFARAY
 
 #endif //YAFARAY_RAY_H
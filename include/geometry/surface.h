@@ -27,6 +27,7 @@
 #include "geometry/vector.h"
 #include "geometry/intersect_data.h"
 #include "color/color.h"
+#include <memory>
 
 BEGIN_YAFARAY
 class Material;
@@ -40,34 +41,33 @@ struct IntersectData;
 /*! This holds a sampled surface point's data
 	When a ray intersects an object, a surfacePoint_t is computed.
 	It contains data about normal, position, assigned material and other
-	things.
+	things. The data only needed by some textures, as the original coordinates (orco)
+	and the ray differentials, are computed when asked for, from the hit primitive and the ray.
  */
 class SurfacePoint
 {
 	public:
 		static Vec3 normalFaceForward(const Vec3 &normal_geometry, const Vec3 &normal, const Vec3 &incoming_vector);
 		static SurfacePoint blendSurfacePoints(SurfacePoint const &sp_0, SurfacePoint const &sp_1, float alpha);
+		void blend(const SurfacePoint &sp, float alpha); //!< blends in place the shading space of this point with the one of sp, as blendSurfacePoints
+		void getOrco(Point3 &orco_p, Vec3 &orco_ng) const; //!< untransformed position and geometric normal, computed by the hit primitive
 		float getDistToNearestEdge() const;
 
 		//int object; //!< the object owner of the point.
-		const Material *material_; //!< the surface material
-		const Light *light_; //!< light source if surface point is on a light
-		const Object *object_; //!< object the prim belongs to
+		const Material *material_ = nullptr; //!< the surface material
+		const Light *light_ = nullptr; //!< light source if surface point is on a light
+		const Object *object_ = nullptr; //!< object the prim belongs to
 		//	point2d_t screenpos; // only used with 'win' texture coord. mode
-		const Primitive *hit_primitive_;
+		const Primitive *hit_primitive_ = nullptr;
+		std::shared_ptr<const void> hit_geometry_; //!< owner of the hit primitive when its geometry can be unloaded, see AcceleratorIntersectData
 		IntersectData intersect_data_;
 
 		// Geometry related
 		Vec3 n_; //!< the shading normal.
 		Vec3 ng_; //!< the geometric normal.
-		Vec3 orco_ng_; //!< the untransformed geometric normal.
 		Point3 p_; //!< the (world) position.
-		Point3 orco_p_;
 		//	Rgb vertex_col;
 		bool has_uv_;
-		bool has_orco_;
-		bool available_;
-		int prim_num_;
 
 		float u_; //!< the u texture coord.
 		float v_; //!< the v texture coord.
@@ -110,10 +110,10 @@ class SpDifferentials
 {
 	public:
 		SpDifferentials(const SurfacePoint &spoint, const DiffRay &ray);
-		//! compute differentials for a scattered ray
-		void reflectedRay(const DiffRay &in, DiffRay &out) const;
-		//! compute differentials for a refracted ray
-		void refractedRay(const DiffRay &in, DiffRay &out, float ior) const;
+		//! compute the ray cone for a reflected ray
+		static void reflectedRay(const SurfacePoint &sp, const DiffRay &in, DiffRay &out);
+		//! compute the ray cone for a refracted ray
+		static void refractedRay(const SurfacePoint &sp, const DiffRay &in, DiffRay &out, float ior);
 		float projectedPixelArea();
 		void getUVdifferentials(float &du_dx, float &dv_dx, float &du_dy, float &dv_dy) const;
 		Vec3 dp_dx_;
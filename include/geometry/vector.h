@@ -25,7 +25,7 @@
 
 #include "constants.h"
 #include "math/math.h"
-#include "math/random.h"
+#include "math/simd.h"
 #include <iostream>
 
 BEGIN_YAFARAY
@@ -40,7 +40,7 @@ class Point3;
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
 #endif
-class Vec3
+class YAFARAY_SIMD_ALIGN Vec3
 {
 	public:
 		Vec3() = default;
@@ -48,6 +48,10 @@ class Vec3
 		Vec3(float ix, float iy, float iz = 0): x_(ix), y_(iy), z_(iz) { }
 		Vec3(const Vec3 &s): x_(s.x_), y_(s.y_), z_(s.z_) { }
 		explicit Vec3(const Point3 &p);
+#ifdef SIMD_TYPES
+		explicit Vec3(const Float4 &f) { f.store(&x_); }
+		Float4 getFloat4() const { return Float4::load(&x_); }
+#endif
 
 		void set(float ix, float iy, float iz = 0) { x_ = ix; y_ = iy; z_ = iz; }
 		Vec3 &normalize();
@@ -60,10 +64,17 @@ class Vec3
 		float sinFromVectors(const Vec3 &v) const;
 
 		Vec3 &operator = (const Vec3 &s) { x_ = s.x_; y_ = s.y_; z_ = s.z_;  return *this;}
+#ifdef SIMD_TYPES
+		Vec3 &operator +=(const Vec3 &s) { (getFloat4() + s.getFloat4()).store(&x_); return *this; }
+		Vec3 &operator -=(const Vec3 &s) { (getFloat4() - s.getFloat4()).store(&x_); return *this; }
+		Vec3 &operator /=(float s) { (getFloat4() / Float4::broadcast(s)).store(&x_); return *this; }
+		Vec3 &operator *=(float s) { (getFloat4() * Float4::broadcast(s)).store(&x_); return *this; }
+#else
 		Vec3 &operator +=(const Vec3 &s) { x_ += s.x_; y_ += s.y_; z_ += s.z_;  return *this;}
 		Vec3 &operator -=(const Vec3 &s) { x_ -= s.x_; y_ -= s.y_; z_ -= s.z_;  return *this;}
 		Vec3 &operator /=(float s) { x_ /= s; y_ /= s; z_ /= s;  return *this;}
 		Vec3 &operator *=(float s) { x_ *= s; y_ *= s; z_ *= s;  return *this;}
+#endif
 		float operator[](int i) const { return (&x_)[i]; } //Lynx
 		float &operator[](int i) { return (&x_)[i]; } //Lynx
 
@@ -73,12 +84,14 @@ class Vec3
 		static void fastFresnel(const Vec3 &i, const Vec3 &n, float iorf, float &kr, float &kt);
 		static void createCs(const Vec3 &n, Vec3 &u, Vec3 &v);
 		static void shirleyDisk(float r_1, float r_2, float &u, float &v);
-		static Vec3 randomSpherical();
 		static Vec3 randomVectorCone(const Vec3 &d, const Vec3 &u, const Vec3 &v, float cosang, float z_1, float z_2);
 		static Vec3 randomVectorCone(const Vec3 &dir, float cosangle, float r_1, float r_2);
 		static Vec3 discreteVectorCone(const Vec3 &dir, float cangle, int sample, int square);
 
 		float x_, y_, z_;
+#ifdef SIMD_TYPES
+		float w_ = 0.f; //!< 4th lane of the 16 bytes layout, not used by the vector operations
+#endif
 };
 
 class Point3 final : public Vec3
@@ -88,6 +101,9 @@ class Point3 final : public Vec3
 		Point3(float ix, float iy, float iz = 0) : Vec3(ix, iy, iz) { }
 		Point3(const Point3 &s) : Vec3(s.x_, s.y_, s.z_) { }
 		Point3(const Vec3 &v): Vec3(v) { }
+#ifdef SIMD_TYPES
+		explicit Point3(const Float4 &f) : Vec3(f) { }
+#endif
 };
 
 #if defined(__GNUC__) && !defined(__clang__)
@@ -106,37 +122,65 @@ inline float operator * (const Vec3 &a, const Vec3 &b)
 
 inline Vec3 operator * (float f, const Vec3 &b)
 {
+#ifdef SIMD_TYPES
+	return Vec3(b.getFloat4() * Float4::broadcast(f));
+#else
 	return Vec3(f * b.x_, f * b.y_, f * b.z_);
+#endif
 }
 
 inline Vec3 operator * (const Vec3 &b, float f)
 {
+#ifdef SIMD_TYPES
+	return Vec3(b.getFloat4() * Float4::broadcast(f));
+#else
 	return Vec3(f * b.x_, f * b.y_, f * b.z_);
+#endif
 }
 
 inline Point3 operator * (float f, const Point3 &b)
 {
+#ifdef SIMD_TYPES
+	return Point3(b.getFloat4() * Float4::broadcast(f));
+#else
 	return Point3(f * b.x_, f * b.y_, f * b.z_);
+#endif
 }
 
 inline Vec3 operator / (const Vec3 &b, float f)
 {
+#ifdef SIMD_TYPES
+	return Vec3(b.getFloat4() / Float4::broadcast(f));
+#else
 	return Vec3(b.x_ / f, b.y_ / f, b.z_ / f);
+#endif
 }
 
 inline Point3 operator / (const Point3 &b, float f)
 {
+#ifdef SIMD_TYPES
+	return Point3(b.getFloat4() / Float4::broadcast(f));
+#else
 	return Point3(b.x_ / f, b.y_ / f, b.z_ / f);
+#endif
 }
 
 inline Point3 operator * (const Point3 &b, float f)
 {
+#ifdef SIMD_TYPES
+	return Point3(b.getFloat4() * Float4::broadcast(f));
+#else
 	return Point3(b.x_ * f, b.y_ * f, b.z_ * f);
+#endif
 }
 
 inline Vec3 operator / (float f, const Vec3 &b)
 {
+#ifdef SIMD_TYPES
+	return Vec3(b.getFloat4() / Float4::broadcast(f));
+#else
 	return Vec3(b.x_ / f, b.y_ / f, b.z_ / f);
+#endif
 }
 
 inline Vec3 operator ^ (const Vec3 &a, const Vec3 &b)
@@ -146,37 +190,65 @@ inline Vec3 operator ^ (const Vec3 &a, const Vec3 &b)
 
 inline Vec3  operator - (const Vec3 &a, const Vec3 &b)
 {
+#ifdef SIMD_TYPES
+	return Vec3(a.getFloat4() - b.getFloat4());
+#else
 	return Vec3(a.x_ - b.x_, a.y_ - b.y_, a.z_ - b.z_);
+#endif
 }
 
 inline Vec3  operator - (const Point3 &a, const Point3 &b)
 {
+#ifdef SIMD_TYPES
+	return Vec3(a.getFloat4() - b.getFloat4());
+#else
 	return Vec3(a.x_ - b.x_, a.y_ - b.y_, a.z_ - b.z_);
+#endif
 }
 
 inline Point3  operator - (const Point3 &a, const Vec3 &b)
 {
+#ifdef SIMD_TYPES
+	return Point3(a.getFloat4() - b.getFloat4());
+#else
 	return Point3(a.x_ - b.x_, a.y_ - b.y_, a.z_ - b.z_);
+#endif
 }
 
 inline Vec3  operator - (const Vec3 &b)
 {
+#ifdef SIMD_TYPES
+	return Vec3(Float4::broadcast(-0.f) - b.getFloat4());
+#else
 	return Vec3(-b.x_, -b.y_, -b.z_);
+#endif
 }
 
 inline Vec3  operator + (const Vec3 &a, const Vec3 &b)
 {
+#ifdef SIMD_TYPES
+	return Vec3(a.getFloat4() + b.getFloat4());
+#else
 	return Vec3(a.x_ + b.x_, a.y_ + b.y_, a.z_ + b.z_);
+#endif
 }
 
 inline Point3  operator + (const Point3 &a, const Point3 &b)
 {
+#ifdef SIMD_TYPES
+	return Point3(a.getFloat4() + b.getFloat4());
+#else
 	return Point3(a.x_ + b.x_, a.y_ + b.y_, a.z_ + b.z_);
+#endif
 }
 
 inline Point3  operator + (const Point3 &a, const Vec3 &b)
 {
+#ifdef SIMD_TYPES
+	return Point3(a.getFloat4() + b.getFloat4());
+#else
 	return Point3(a.x_ + b.x_, a.y_ + b.y_, a.z_ + b.z_);
+#endif
 }
 
 inline bool  operator == (const Point3 &a, const Point3 &b)
@@ -189,7 +261,11 @@ bool  operator != (const Vec3 &a, const Vec3 &b);
 
 inline Point3 mult_global(const Point3 &a, const Vec3 &b)
 {
+#ifdef SIMD_TYPES
+	return Point3(a.getFloat4() * b.getFloat4());
+#else
 	return Point3(a.x_ * b.x_, a.y_ * b.y_, a.z_ * b.z_);
+#endif
 }
 
 inline Vec3 &Vec3::normalize()
@@ -277,20 +353,6 @@ inline void Vec3::createCs(const Vec3 &n, Vec3 &u, Vec3 &v)
 	}
 }
 
-inline Vec3 Vec3::randomSpherical()
-{
-	Vec3 v(0.0, 0.0, FastRandom::getNextFloatNormalized());
-	float r = 1.0 - v.z_ * v.z_;
-	if(r > 0.0)
-	{
-		const float a = math::mult_pi_by_2 * FastRandom::getNextFloatNormalized();
-		r = math::sqrt(r);
-		v.x_ = r * math::cos(a); v.y_ = r * math::sin(a);
-	}
-	else v.z_ = 1.0;
-	return v;
-}
-
 END_YAFARAY
 
 #endif // YAFARAY_VECTOR_H
@@ -43,20 +43,24 @@ class LIBYAFARAY_EXPORT Image
 {
 	public:
 		enum class Type : int { None, Gray, GrayAlpha, GrayWeight, GrayAlphaWeight, Color, ColorAlpha, ColorAlphaWeight };
-		enum class Optimization : int { None, Optimized, Compressed };
+		enum class Optimization : int { None, Optimized, Compressed, BlockCompressed, HalfFloat };
 		enum class Position : int { None, Top, Bottom, Left, Right, Overlay };
-		static std::unique_ptr<Image> factory(int width, int height, const Type &type, const Optimization &optimization);
+		//! The block compressed images are created with ImageBlockCompressed::compress from complete images, the factory creates the uncompressed images they are compressed from
+		static std::unique_ptr<Image> factory(int width, int height, const Type &type, const Optimization &optimization, HugePages::Mode huge_pages_mode = HugePages::Mode::None);
 		virtual ~Image() = default;
 
 		virtual Type getType() const = 0;
 		virtual Optimization getOptimization() const = 0;
 		virtual Rgba getColor(int x, int y) const = 0;
+		//! Colors of num consecutive pixels of the column x from the row y, with a single virtual call. The image buffers store their columns contiguously, so this is the fastest way to read several pixels
+		virtual void getColumnColors(int x, int y, int num, Rgba *colors) const;
 		virtual float getFloat(int x, int y) const = 0;
 		virtual float getWeight(int x, int y) const { return 0.f; }
 		virtual void setColor(int x, int y, const Rgba &col) = 0;
 		virtual void setFloat(int x, int y, float val) = 0;
 		virtual void setWeight(int x, int y, float val) { }
 		virtual void clear() = 0;
+		virtual size_t getMemorySize() const; //!< memory used by the pixels
 
 		int getWidth() const { return width_; }
 		int getHeight() const { return height_; }
@@ -75,6 +79,7 @@ class LIBYAFARAY_EXPORT Image
 		static bool hasAlpha(const Type &image_type);
 		static bool isGrayscale(const Type &image_type);
 		static Type getTypeFromSettings(bool has_alpha, bool grayscale, bool has_weight = false);
+		static size_t getPixelSize(const Type &type, const Optimization &optimization); //!< memory used by each pixel of the images created by the factory
 		static std::unique_ptr<Image> getDenoisedLdrImage(const Image *image, const DenoiseParams &denoise_params); //!< Provides a denoised buffer, but only works with LDR images (that can be represented in 8-bit 0..255 values). If attempted with HDR images they would lose the HDR range and become unusable!
 		static std::unique_ptr<Image> getComposedImage(const Image *image_1, const Image *image_2, const Position &position_image_2, int overlay_x = 0, int overlay_y = 0);
 
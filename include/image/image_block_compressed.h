@@ -0,0 +1,69 @@
+#pragma once
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef YAFARAY_IMAGE_BLOCK_COMPRESSED_H
+#define YAFARAY_IMAGE_BLOCK_COMPRESSED_H
+
+#include "image/image.h"
+#include <vector>
+
+BEGIN_YAFARAY
+
+class TaskPool;
+
+/*! Read only image [LOSSY!] stored in blocks of 4x4 texels, each one encoded by two endpoints and the position of each texel between them,
+ * similar to the GPU block compression formats. The texels are decoded individually when read, so the interpolations can use it as any other image.
+ * - LDR color: like BC1, two RGB565 endpoints (encoded with gamma 2 to keep more precision in the darks) and 4 levels (4 bit/texel)
+ * - HDR color and gray: like BC6H, two RGB endpoints of 10 bit quasi logarithmic codes (the most significant bits of half floats) and 16 levels (8 bit/texel)
+ * - LDR gray and alpha: like BC4, two 8 bit endpoints and 8 levels (4 bit/texel) */
+class LIBYAFARAY_EXPORT ImageBlockCompressed final : public Image
+{
+	public:
+		/*! Returns the block compressed copy of a complete image, as each block is encoded from all its texels. The float images are encoded as HDR,
+		 * the optimized ones as LDR. Returns nullptr for the weighted image types, which are not used by textures */
+		static std::unique_ptr<Image> compress(const Image &image, TaskPool *task_pool);
+
+	private:
+		ImageBlockCompressed(int width, int height, const Type &type, bool hdr);
+		virtual Type getType() const override { return type_; }
+		virtual Optimization getOptimization() const override { return Optimization::BlockCompressed; }
+		virtual Rgba getColor(int x, int y) const override;
+		virtual float getFloat(int x, int y) const override;
+		virtual void setColor(int x, int y, const Rgba &col) override { } //read only, the blocks are encoded from all their texels by compress()
+		virtual void setFloat(int x, int y, float val) override { }
+		virtual void clear() override { }
+		virtual size_t getMemorySize() const override { return (blocks_.capacity() + alpha_blocks_.capacity()) * sizeof(uint64_t); }
+		void encodeBlock(const Image &image, int block_x, int block_y);
+		size_t getBlockIndex(int x, int y) const { return static_cast<size_t>(y / block_size_) * num_blocks_x_ + x / block_size_; }
+		static int getTexelIndex(int x, int y) { return (y % block_size_) * block_size_ + x % block_size_; }
+
+		static constexpr int block_size_ = 4;
+		Type type_;
+		bool hdr_;
+		int num_blocks_x_;
+		int words_per_block_; //!< 64 bit words of each color or gray block, 2 for the HDR color blocks and 1 otherwise
+		std::vector<uint64_t> blocks_;
+		std::vector<uint64_t> alpha_blocks_; //!< empty for the image types without alpha
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_IMAGE_BLOCK_COMPRESSED_H
@@ -27,6 +27,7 @@
 
 #include "color/color.h"
 #include "math/buffer.h"
+#include <cstring>
 
 BEGIN_YAFARAY
 
@@ -295,15 +296,124 @@ class Rgba1010108 final
 		uint8_t a_ = 0;
 };
 
+//! Conversion between floats and IEEE 754 half floats (1 sign, 5 exponent and 10 mantissa bits), rounding to the nearest even. Values above the half range become infinite
+class HalfFloat final
+{
+	public:
+		static uint16_t fromFloat(float value)
+		{
+			constexpr uint32_t float_infinity = 255 << 23;
+			constexpr uint32_t half_overflow = (127 + 16) << 23; //!< 65536, the values from 65520 are rounded to infinity below
+			constexpr uint32_t denormal_magic = ((127 - 15) + (23 - 10) + 1) << 23;
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			const uint32_t sign = bits & 0x80000000u;
+			bits ^= sign;
+			uint16_t half;
+			if(bits >= half_overflow) half = (bits > float_infinity) ? 0x7E00 : 0x7C00; //NaN or infinity
+			else if(bits < (113u << 23)) //half subnormals and zero, rounded by the float addition
+			{
+				float magic;
+				std::memcpy(&magic, &denormal_magic, sizeof(magic));
+				float sum;
+				std::memcpy(&sum, &bits, sizeof(sum));
+				sum += magic;
+				uint32_t sum_bits;
+				std::memcpy(&sum_bits, &sum, sizeof(sum_bits));
+				half = static_cast<uint16_t>(sum_bits - denormal_magic);
+			}
+			else
+			{
+				const uint32_t mantissa_odd = (bits >> 13) & 1;
+				bits += ((15u - 127u) << 23) + 0xFFF + mantissa_odd;
+				half = static_cast<uint16_t>(bits >> 13);
+			}
+			return half | static_cast<uint16_t>(sign >> 16);
+		}
+		static float toFloat(uint16_t half)
+		{
+			constexpr uint32_t shifted_exponent = 0x7C00 << 13;
+			uint32_t bits = static_cast<uint32_t>(half & 0x7FFF) << 13;
+			const uint32_t exponent = shifted_exponent & bits;
+			bits += (127u - 15u) << 23;
+			float value;
+			if(exponent == shifted_exponent) bits += (128u - 16u) << 23; //infinity or NaN
+			else if(exponent == 0) //zero or subnormal, renormalized by a float subtraction
+			{
+				bits += 1u << 23;
+				constexpr uint32_t magic_bits = 113u << 23;
+				float magic;
+				std::memcpy(&magic, &magic_bits, sizeof(magic));
+				std::memcpy(&value, &bits, sizeof(value));
+				value -= magic;
+				std::memcpy(&bits, &value, sizeof(bits));
+			}
+			bits |= static_cast<uint32_t>(half & 0x8000) << 16;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+};
+
+//! Rgba half float format (64 bit/pixel), keeps the HDR range with 11 bits of precision
+class RgbaHalf final
+{
+	public:
+		void setColor(const Rgba &col) { r_ = HalfFloat::fromFloat(col.r_); g_ = HalfFloat::fromFloat(col.g_); b_ = HalfFloat::fromFloat(col.b_); a_ = HalfFloat::fromFloat(col.a_); }
+		Rgba getColor() const { return Rgba(HalfFloat::toFloat(r_), HalfFloat::toFloat(g_), HalfFloat::toFloat(b_), HalfFloat::toFloat(a_)); }
+
+	private:
+		uint16_t r_ = 0;
+		uint16_t g_ = 0;
+		uint16_t b_ = 0;
+		uint16_t a_ = 0;
+};
+
+//! Rgb half float format (48 bit/pixel)
+class RgbHalf final
+{
+	public:
+		void setColor(const Rgba &col) { r_ = HalfFloat::fromFloat(col.r_); g_ = HalfFloat::fromFloat(col.g_); b_ = HalfFloat::fromFloat(col.b_); }
+		Rgba getColor() const { return Rgba(HalfFloat::toFloat(r_), HalfFloat::toFloat(g_), HalfFloat::toFloat(b_), 1.f); }
+
+	private:
+		uint16_t r_ = 0;
+		uint16_t g_ = 0;
+		uint16_t b_ = 0;
+};
+
+//! Gray and alpha half float format (32 bit/pixel)
+class GrayAlphaHalf final
+{
+	public:
+		void setColor(const Rgba &col) { value_ = HalfFloat::fromFloat((col.r_ + col.g_ + col.b_) / 3.f); alpha_ = HalfFloat::fromFloat(col.a_); }
+		Rgba getColor() const { return { HalfFloat::toFloat(value_), HalfFloat::toFloat(alpha_) }; }
+
+	private:
+		uint16_t value_ = 0;
+		uint16_t alpha_ = 0;
+};
+
+//! Gray half float format (16 bit/pixel)
+class GrayHalf final
+{
+	public:
+		void setColor(const Rgba &col) { value_ = HalfFloat::fromFloat((col.r_ + col.g_ + col.b_) / 3.f); }
+		Rgba getColor() const { return { HalfFloat::toFloat(value_), 1.f }; }
+
+	private:
+		uint16_t value_ = 0;
+};
+
 template <class T>
 class ImageBuffer2D final : public Buffer<T, 2>
 {
 	public:
-		ImageBuffer2D(int weight, int height) : Buffer<T, 2>{{ static_cast<size_t>(weight), static_cast<size_t>(height) }} { }
+		ImageBuffer2D(int weight, int height, HugePages::Mode huge_pages_mode = HugePages::Mode::None) : Buffer<T, 2>{{ static_cast<size_t>(weight), static_cast<size_t>(height) }, huge_pages_mode} { }
 		void set(int x, int y, const T &val) { Buffer<T, 2>::set({ static_cast<size_t>(x), static_cast<size_t>(y) }, val); }
 		T get(int x, int y) const { return Buffer<T, 2>::get({ static_cast<size_t>(x), static_cast<size_t>(y) }); }
 		T &operator()(int x, int y) { return Buffer<T, 2>::operator()({ static_cast<size_t>(x), static_cast<size_t>(y) }); }
 		const T &operator()(int x, int y) const { return Buffer<T, 2>::operator()({ static_cast<size_t>(x), static_cast<size_t>(y) }); }
+		const T *getColumnData(int x, int y) const { return &(*this)(x, y); } //!< the pixels of each column are stored contiguously, from the row y to the last one
 		void clear() { Buffer<T, 2>::zero(); }
 		int getWidth() const { return static_cast<int>(Buffer<T, 2>::getDimensions().at(0)); }
 		int getHeight() const { return static_cast<int>(Buffer<T, 2>::getDimensions().at(1)); }
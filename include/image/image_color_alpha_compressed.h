@@ -31,12 +31,13 @@ BEGIN_YAFARAY
 class LIBYAFARAY_EXPORT ImageColorAlphaCompressed final : public Image
 {
 	public:
-		ImageColorAlphaCompressed(int width, int height) : Image(width, height), buffer_{width, height} { }
+		ImageColorAlphaCompressed(int width, int height, HugePages::Mode huge_pages_mode = HugePages::Mode::None) : Image(width, height), buffer_{width, height, huge_pages_mode} { }
 
 	private:
 		virtual Type getType() const override { return Type::ColorAlpha; }
 		virtual Image::Optimization getOptimization() const override { return Image::Optimization::Compressed; }
 		virtual Rgba getColor(int x, int y) const override { return buffer_(x, y).getColor(); }
+		virtual void getColumnColors(int x, int y, int num, Rgba *colors) const override { const auto *column = buffer_.getColumnData(x, y); for(int texel = 0; texel < num; ++texel) colors[texel] = column[texel].getColor(); }
 		virtual float getFloat(int x, int y) const override { return getColor(x, y).r_; }
 		virtual void setColor(int x, int y, const Rgba &col) override { buffer_(x, y).setColor(col); }
 		virtual void setFloat(int x, int y, float val) override { setColor(x, y, val); }
@@ -0,0 +1,51 @@
+#pragma once
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef YAFARAY_IMAGE_COLOR_ALPHA_HALF_H
+#define YAFARAY_IMAGE_COLOR_ALPHA_HALF_H
+
+#include "image/image.h"
+#include "image/image_buffers.h"
+
+BEGIN_YAFARAY
+
+//!< Rgba half float image buffer (64 bit/pixel)
+class LIBYAFARAY_EXPORT ImageColorAlphaHalf final : public Image
+{
+	public:
+		ImageColorAlphaHalf(int width, int height, HugePages::Mode huge_pages_mode = HugePages::Mode::None) : Image(width, height), buffer_{width, height, huge_pages_mode} { }
+
+	private:
+		virtual Type getType() const override { return Type::ColorAlpha; }
+		virtual Image::Optimization getOptimization() const override { return Image::Optimization::HalfFloat; }
+		virtual Rgba getColor(int x, int y) const override { return buffer_(x, y).getColor(); }
+		virtual void getColumnColors(int x, int y, int num, Rgba *colors) const override { const auto *column = buffer_.getColumnData(x, y); for(int texel = 0; texel < num; ++texel) colors[texel] = column[texel].getColor(); }
+		virtual float getFloat(int x, int y) const override { return getColor(x, y).r_; }
+		virtual void setColor(int x, int y, const Rgba &col) override { buffer_(x, y).setColor(col); }
+		virtual void setFloat(int x, int y, float val) override { setColor(x, y, val); }
+		virtual void clear() override { buffer_.clear(); }
+
+		ImageBuffer2D<RgbaHalf> buffer_;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_IMAGE_COLOR_ALPHA_HALF_H
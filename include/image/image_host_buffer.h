@@ -0,0 +1,80 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_IMAGE_HOST_BUFFER_H
+#define YAFARAY_IMAGE_HOST_BUFFER_H
+
+#include "image/image.h"
+#include "format/format.h"
+#include <vector>
+#include <memory>
+
+BEGIN_YAFARAY
+
+/*! Raw pixels given by the host application, 8 bit or float with 1 (gray), 2 (gray and alpha), 3 (RGB) or 4 (RGBA) channels per pixel.
+ * The rows start from the top one and are row_stride bytes apart, a negative row stride with data pointing to the last row in memory gives the bottom-up buffers.
+ * The pixels are either copied or, when referencing the host memory, read from it directly, the host application keeping them valid and unchanged while the scene uses them */
+class LIBYAFARAY_EXPORT HostPixelBuffer final
+{
+	public:
+		HostPixelBuffer(const void *data, int width, int height, int num_channels, bool float_data, int64_t row_stride, bool reference_host_memory);
+		int getWidth() const { return width_; }
+		int getHeight() const { return height_; }
+		int getNumChannels() const { return num_channels_; }
+		bool isFloat() const { return float_data_; }
+		bool referencesHostMemory() const { return owned_data_.empty(); }
+		const uint8_t *getPixel(int x, int y) const { return data_ + y * row_stride_ + x * pixel_size_; }
+		size_t getMemorySize() const { return owned_data_.size(); } //!< the referenced host memory is not counted
+
+	private:
+		std::vector<uint8_t> owned_data_;
+		const uint8_t *data_ = nullptr;
+		int width_ = 0;
+		int height_ = 0;
+		int num_channels_ = 0;
+		bool float_data_ = false;
+		int64_t row_stride_ = 0;
+		int64_t pixel_size_ = 0;
+};
+
+/*! Read only image over a HostPixelBuffer, converting the pixels to linear RGB when they are read, so the texture uses the pixels of the host application without copying them */
+class LIBYAFARAY_EXPORT ImageHostBuffer final : public Image
+{
+	public:
+		ImageHostBuffer(std::shared_ptr<const HostPixelBuffer> buffer, const ColorSpace &color_space, float gamma);
+
+	private:
+		virtual Type getType() const override;
+		virtual Image::Optimization getOptimization() const override { return Image::Optimization::None; }
+		virtual Rgba getColor(int x, int y) const override;
+		virtual float getFloat(int x, int y) const override { return getColor(x, y).r_; }
+		virtual void setColor(int x, int y, const Rgba &col) override { }
+		virtual void setFloat(int x, int y, float val) override { }
+		virtual void clear() override { }
+		virtual size_t getMemorySize() const override { return 0; } //!< the pixels belong to the scene or to the host application
+
+		std::shared_ptr<const HostPixelBuffer> buffer_;
+		ColorSpace color_space_;
+		float gamma_;
+		LinearTable8Bit linear_table_;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_IMAGE_HOST_BUFFER_H
@@ -42,7 +42,7 @@ class ImageLayer
 		Layer layer_;
 };
 
-class ImageLayers final : public Collection<Layer::Type, ImageLayer>  //Actual buffer of images in the rendering process, one entry for each enabled layer.
+class ImageLayers final : public LayerCollection<ImageLayer>  //Actual buffer of images in the rendering process, one entry for each enabled layer.
 {
 	public:
 		void setColor(int x, int y, const ColorLayer &color_layer);
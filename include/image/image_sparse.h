@@ -0,0 +1,70 @@
+#pragma once
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *
+ */
+
+#ifndef YAFARAY_IMAGE_SPARSE_H
+#define YAFARAY_IMAGE_SPARSE_H
+
+#include "image/image.h"
+#include "common/thread.h"
+#include <atomic>
+
+BEGIN_YAFARAY
+
+/*! Image stored in tiles allocated on the first write of a non-zero pixel, for the render layers written only in a part of the image.
+ * The pixels of the tiles not allocated are zero. Each tile is an image of the same type and optimization created by Image::factory.
+ * Different pixels can be written concurrently, the tile allocations are serialized by a mutex */
+class LIBYAFARAY_EXPORT ImageSparse final : public Image
+{
+	public:
+		ImageSparse(int width, int height, const Type &type, const Optimization &optimization);
+		virtual ~ImageSparse() override;
+
+	private:
+		virtual Type getType() const override { return type_; }
+		virtual Optimization getOptimization() const override { return optimization_; }
+		virtual Rgba getColor(int x, int y) const override;
+		virtual float getFloat(int x, int y) const override;
+		virtual float getWeight(int x, int y) const override;
+		virtual void setColor(int x, int y, const Rgba &col) override;
+		virtual void setFloat(int x, int y, float val) override;
+		virtual void setWeight(int x, int y, float val) override;
+		virtual void clear() override; //!< also frees the tiles
+		virtual size_t getMemorySize() const override;
+		const Image *getTile(int x, int y) const { return tiles_[getTileIndex(x, y)].load(std::memory_order_acquire); }
+		Image *getOrCreateTile(int x, int y);
+		size_t getTileIndex(int x, int y) const { return static_cast<size_t>(y >> tile_shift_) * num_tiles_x_ + (x >> tile_shift_); }
+
+		static constexpr int tile_shift_ = 6;
+		static constexpr int tile_size_ = 1 << tile_shift_;
+		static constexpr int tile_mask_ = tile_size_ - 1;
+		Type type_;
+		Optimization optimization_;
+		int num_tiles_x_;
+		int num_tiles_;
+		std::unique_ptr<std::atomic<Image *>[]> tiles_; //!< owned, null for the tiles not allocated yet
+		std::atomic<int> num_allocated_tiles_ {0};
+		std::mutex mutex_;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_IMAGE_SPARSE_H
@@ -0,0 +1,77 @@
+#pragma once
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef YAFARAY_IMAGE_TILED_H
+#define YAFARAY_IMAGE_TILED_H
+
+#include "image/image.h"
+#include <vector>
+
+BEGIN_YAFARAY
+
+class MappedFile;
+
+/*! Read only image stored in a tile file, loading its tiles on demand into the global tile cache.
+ * The tile file keeps all the mipmap levels of a texture, so the texture memory is limited by the
+ * tile cache budget instead of being the sum of the sizes of all the textures.
+ * Each tile is decoded into a small image of the same type and optimization as the original image,
+ * so the texels are the same as when the whole image is loaded */
+class LIBYAFARAY_EXPORT ImageTiled final : public Image
+{
+	public:
+		/*! Writes the images (normally the mipmap levels of a texture) to a tile file. The signature identifies the source image and load settings,
+		 * so the tile file can be reused while they do not change */
+		static bool saveTileFile(const std::string &path, uint64_t signature, const std::vector<std::unique_ptr<Image>> &images);
+		/*! Returns the tiled images of a tile file, or none if it does not exist or its signature is different */
+		static std::vector<std::unique_ptr<Image>> loadTileFile(const std::string &path, uint64_t signature);
+		/*! Returns the images of a tile file fully loaded in memory, only the first one if the mipmaps are not needed */
+		static std::vector<std::unique_ptr<Image>> readTileFile(const std::string &path, uint64_t signature, bool mipmaps, HugePages::Mode huge_pages_mode = HugePages::Mode::None);
+		virtual ~ImageTiled() override;
+
+	private:
+		ImageTiled(std::shared_ptr<const MappedFile> file, uint64_t data_offset, int width, int height, const Type &type, const Optimization &optimization);
+		virtual Type getType() const override { return type_; }
+		virtual Optimization getOptimization() const override { return optimization_; }
+		virtual Rgba getColor(int x, int y) const override;
+		virtual void getColumnColors(int x, int y, int num, Rgba *colors) const override;
+		virtual float getFloat(int x, int y) const override;
+		virtual void setColor(int x, int y, const Rgba &col) override { } //read only, the tiles are loaded from the tile file
+		virtual void setFloat(int x, int y, float val) override { }
+		virtual void clear() override { }
+		virtual size_t getMemorySize() const override { return 0; } //!< the resident tiles are accounted by the tile cache
+		const Image *getTile(int x, int y) const;
+		std::shared_ptr<const Image> loadTile(int tile_x, int tile_y) const;
+		static size_t getChannelSize(const Optimization &optimization) { return optimization == Optimization::None ? sizeof(float) : sizeof(uint16_t); }
+
+		static constexpr int tile_size_ = 64;
+		static constexpr int max_channels_ = 4; //!< channels of the texels of the tileable image types, the tile files with more are rejected
+		static const std::string tile_file_header_;
+		std::shared_ptr<const MappedFile> file_; //!< shared by all the levels stored in the same tile file
+		uint64_t data_offset_; //!< position in the tile file of the tiles, stored in rows of tiles and each tile in rows of texels
+		Type type_;
+		Optimization optimization_;
+		int num_tiles_x_;
+		uint32_t id_; //!< unique for each tiled image, to build the tile cache keys
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_IMAGE_TILED_H
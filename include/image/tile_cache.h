@@ -0,0 +1,78 @@
+#pragma once
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef YAFARAY_TILE_CACHE_H
+#define YAFARAY_TILE_CACHE_H
+
+#include "constants.h"
+#include <array>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+BEGIN_YAFARAY
+
+class Image;
+
+/*! Resident tiles of the tiled images, shared by all of them within a global memory budget.
+ * The tiles are split in shards with their own lock and least recently used list, so the render threads loading
+ * or finding tiles of different shards do not wait for each other. Each shard evicts its least recently used
+ * tiles when it exceeds its share of the budget. The tiles still used by a thread when evicted are kept alive
+ * by their shared pointers until that thread releases them */
+class TileCache final
+{
+	public:
+		void setBudget(size_t budget) { budget_ = budget; } //!< in bytes
+		size_t getBudget() const { return budget_; }
+		size_t getUsed() const;
+		/*! Keys are unique for each tile of each image, see ImageTiled::tileKey */
+		std::shared_ptr<const Image> findTile(uint64_t key);
+		/*! Returns the tile already inserted by another thread if it loaded the same tile meanwhile */
+		std::shared_ptr<const Image> insertTile(uint64_t key, std::shared_ptr<const Image> tile, size_t size);
+		void removeImage(uint32_t image_id); //!< removes all the tiles of an image when it is destroyed
+
+	private:
+		struct Entry
+		{
+			std::shared_ptr<const Image> tile_;
+			size_t size_;
+			std::list<uint64_t>::iterator lru_position_;
+		};
+		struct Shard
+		{
+			mutable std::mutex mutex_;
+			std::unordered_map<uint64_t, Entry> tiles_;
+			std::list<uint64_t> lru_; //!< most recently used tile keys first
+			size_t used_ = 0;
+		};
+		static constexpr int num_shards_ = 64;
+		Shard &getShard(uint64_t key) { return shards_[(key ^ (key >> 32)) % num_shards_]; }
+		std::array<Shard, num_shards_> shards_;
+		std::atomic<size_t> budget_ {static_cast<size_t>(2048) * 1024 * 1024};
+};
+
+extern LIBYAFARAY_EXPORT TileCache tile_cache_global;
+
+END_YAFARAY
+
+#endif //YAFARAY_TILE_CACHE_H
@@ -23,18 +23,24 @@
 #include "constants.h"
 #include "common/param.h"
 #include <list>
+#include <map>
 #include <vector>
 #include <string>
 #include <memory>
 
 BEGIN_YAFARAY
 
-class Scene;
 class Scene;
 class XmlParser;
+class MappedFile;
 enum ColorSpace : int;
 
 LIBYAFARAY_EXPORT std::unique_ptr<Scene> parseXmlFile_global(const char *filename, ParamMap &render, const std::string &color_space_string, float input_gamma);
+/*! Applies the XML file to a scene parsed before, for the next frame of an animation. The cameras, materials, lights and outputs
+ * of the file replace the existing ones with the same names, the instances update the transforms of the existing instances of
+ * their base objects in the same order, and the objects, textures and other items that already exist are kept, so the file can be
+ * a complete frame or only the changes from the previous frame. The render parameters are added to the render parameter map */
+LIBYAFARAY_EXPORT bool parseXmlUpdateFile_global(const char *filename, std::unique_ptr<Scene> &scene, ParamMap &render, const std::string &color_space_string, float input_gamma);
 
 typedef void (*StartElementCb_t)(XmlParser &p, const char *element, const char **attrs);
 typedef void (*EndElementCb_t)(XmlParser &p, const char *element);
@@ -51,6 +57,19 @@ struct ParserState
 	std::string last_element_attrs_; //! to show last element attributes previous to a XML Parser error
 };
 
+//! Consecutive points, normals, faces or uvs of an object, parsed before the XML parser reaches them
+struct XmlGeometryRun
+{
+	enum Type : int { Vertices, VerticesOrco, Normals, Faces, Uvs };
+	Type type_;
+	size_t num_ = 0; //!< number of points, normals, faces or uvs
+	std::vector<float> values_; //!< 3 per point or normal, 2 per uv
+	std::vector<float> orco_;
+	std::vector<int> indices_; //!< 3 vertex indices per face
+	std::vector<int> uv_indices_; //!< 3 per face, empty if no face of the run has uvs
+};
+using XmlGeometryBlock = std::vector<XmlGeometryRun>; //!< geometry elements between two other elements of an object
+
 class XmlParser
 {
 	public:
@@ -72,12 +91,23 @@ class XmlParser
 		std::string getLastElementName() const { return current_->last_element_; }
 		std::string getLastElementNameAttrs() const { return current_->last_element_attrs_; }
 		std::unique_ptr<Scene> getScene() { return std::move(scene_); }
+		bool openGeometryFile(const std::string &file_name); //!< the binary geometry file written by XmlExport next to the XML file
+		//! address of the num_values elements of type T at the offset of the geometry file, or nullptr if they are not in the file
+		template <typename T> const T *getGeometryData(const char *offset, size_t num_values) const;
+		//! passes to the scene the geometry block pre-parsed for the placeholder element of the object
+		bool addParsedGeometry(size_t object_index, size_t block_index);
 
 		std::unique_ptr<Scene> scene_;
 		ParamMap params_, &render_;
 		std::list<ParamMap> eparams_; //! for materials that need to define a whole shader tree etc.
 		ParamMap *cparams_ = nullptr; //! just a pointer to the current paramMap, either params or a eparams element
+		std::string xml_directory_; //!< the relative geometry file names are relative to it
+		std::vector<std::vector<XmlGeometryBlock>> parsed_geometry_; //!< geometry blocks of each object parsed by the worker threads, indexed by object and block
+		bool updating_ = false; //!< the file updates the scene of the previous frame instead of creating a new one
+		bool skipping_object_ = false; //!< the current object already exists in the updated scene
+		std::map<std::string, size_t> instance_numbers_; //!< next instance of each base object to update
 	protected:
+		std::unique_ptr<const MappedFile> geometry_file_;
 		std::vector<ParserState> state_stack_;
 		ParserState *current_ = nullptr;
 		int level_ = 0;
@@ -68,10 +68,10 @@ class Integrator
 		virtual Type getType() const = 0;
 		std::string getRenderInfo() const { return render_info_; }
 		std::string getAaNoiseInfo() const { return aa_noise_info_; }
-		static constexpr unsigned int getUserDataSize() { return user_data_size_; } //Total number of bytes used for the "arena"-style "userdata" memory
+		static constexpr unsigned int getUserDataSize() { return user_data_size_; } //Number of bytes of material data stored inline where a fixed block is kept per path vertex, the rest of the material data is allocated from RenderData::arena_
 
 	protected:
-		static constexpr unsigned int user_data_size_ = 1024; //Total number of bytes used for the "arena"-style "userdata" memory
+		static constexpr unsigned int user_data_size_ = 1024; //Number of bytes of material data stored inline where a fixed block is kept per path vertex
 		std::string render_info_;
 		std::string aa_noise_info_;
 		const Scene *scene_ = nullptr;
@@ -82,6 +82,10 @@ class SurfaceIntegrator: public Integrator
 {
 	public:
 		virtual Rgba integrate(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers, const RenderView *render_view) const = 0;
+		/*! Tells the integrator that the view independent data of its last preprocess (the photon maps) is also valid for the next render view,
+		 * which has the same lights, so its preprocess can reuse it instead of computing it again */
+		virtual void shareViewPreprocess(bool share) { }
+		virtual uint64_t getNumCameraSamples() const { return 0; } //!< camera samples integrated by the last render
 
 	protected:
 		SurfaceIntegrator() = default;
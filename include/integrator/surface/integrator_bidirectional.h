@@ -41,6 +41,7 @@ class BidirectionalIntegrator final : public TiledIntegrator
 		static std::unique_ptr<Integrator> factory(ParamMap &params, const Scene &scene);
 
 	private:
+		enum class RussianRouletteType { Bsdf, Throughput };
 		BidirectionalIntegrator(bool transp_shad = false, int shadow_depth = 4);
 		virtual std::string getShortName() const override { return "BdPT"; }
 		virtual std::string getName() const override { return "BidirectionalPathTracer"; }
@@ -49,7 +50,7 @@ class BidirectionalIntegrator final : public TiledIntegrator
 		virtual Rgba integrate(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers, const RenderView *render_view) const override;
 		Rgb sampleAmbientOcclusionLayer(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const;
 		Rgb sampleAmbientOcclusionClayLayer(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const;
-		int createPath(RenderData &render_data, const Ray &start, std::vector<PathVertex> &path, int max_len) const;
+		int createPath(RenderData &render_data, const Ray &start, PathVertex *path, int max_len) const;
 		Rgb evalPath(RenderData &render_data, int s, int t, PathData &pd) const;
 		Rgb evalLPath(RenderData &render_data, int t, PathData &pd, Ray &l_ray, const Rgb &lcol) const;
 		Rgb evalPathE(RenderData &render_data, int s, PathData &pd) const;
@@ -67,9 +68,10 @@ class BidirectionalIntegrator final : public TiledIntegrator
 		//mutable pathData_t pathData;
 		mutable std::vector<PathData> thread_data_;
 		std::vector<const Light *> lights_; //! An array containing all the scene lights
-		std::unique_ptr<Pdf1D> light_power_d_;
+		const Pdf1D *light_power_d_ = nullptr; //!< owned by the render view, shared with the other integrators
 		float f_num_lights_;
 		std::map <const Light *, float> inv_light_power_d_;
+		RussianRouletteType russian_roulette_type_ = RussianRouletteType::Bsdf; //!< Bsdf: the subpaths survive with the albedo of each sampled BSDF direction, Throughput: with their accumulated weight
 
 		bool use_ambient_occlusion_; //! Use ambient occlusion
 		int ao_samples_; //! Ambient occlusion samples
@@ -35,6 +35,9 @@ class DirectLightIntegrator final : public MonteCarloIntegrator
 		virtual std::string getName() const override { return "DirectLight"; }
 		virtual bool preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *image_film) override;
 		virtual Rgba integrate(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers, const RenderView *render_view) const override;
+		template <bool photon_caustics, bool ambient_occlusion> Rgba integrateKernel(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers) const;
+
+		Rgba (DirectLightIntegrator::*integrate_kernel_)(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers) const = &DirectLightIntegrator::integrateKernel<false, false>; //!< selected in preprocess for the caustics and ambient occlusion settings
 };
 
 END_YAFARAY
@@ -24,14 +24,20 @@
 
 #include "integrator_tiled.h"
 #include "color/color.h"
+#include "light/light.h"
 
 
 BEGIN_YAFARAY
 
 class Background;
 class Photon;
+class PhotonShootingProgress;
 class Vec3;
 class Light;
+class LightTree;
+class Object;
+class DiffusionProfile;
+class SssPointCloud;
 struct BsdfFlags;
 
 enum PhotonMapProcessing
@@ -39,32 +45,54 @@ enum PhotonMapProcessing
 	PhotonsGenerateOnly,
 	PhotonsGenerateAndSave,
 	PhotonsLoad,
-	PhotonsReuse
+	PhotonsReuse,
+	PhotonsUpdate //!< reuse the photon maps from memory, shooting again only the paths affected by the changes in the scene
 };
 
 class MonteCarloIntegrator: public TiledIntegrator
 {
 	public:
+		enum class LightSampling : int { Uniform, Power, LightTree };
 		MonteCarloIntegrator();
+		virtual void shareViewPreprocess(bool share) override;
 
 	protected:
 		virtual ~MonteCarloIntegrator() override;
 		/*! Estimates direct light from all sources in a mc fashion and completing MIS (Multiple Importance Sampling) for a given surface point */
 		Rgb estimateAllDirectLight(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, ColorLayers *color_layers = nullptr) const;
 		/*! Like previous but for only one random light source for a given surface point */
-		Rgb estimateOneDirectLight(RenderData &render_data, const SurfacePoint &sp, Vec3 wo, int n) const;
+		Rgb estimateOneDirectLight(RenderData &render_data, const SurfacePoint &sp, Vec3 wo, int n, bool skip_background_lights = false) const; //!< skipping the background lights keeps the selection probabilities, so the estimate of the other lights is unchanged
+		/*! Prepares the selection of the lights in estimateOneDirectLight, must be called after setting lights_ from the render view */
+		void setupLightSampling(const RenderView *render_view);
 		/*! Does the actual light estimation on a specific light for the given surface point */
 		Rgb doLightEstimation(RenderData &render_data, const Light *light, const SurfacePoint &sp, const Vec3 &wo, const unsigned int &loffs, ColorLayers *color_layers = nullptr) const;
+		/*! Number of samples of an area light, with the adaptive light samples the ones allocated to it in the area rendered */
+		int lightSamples(const RenderData &render_data, const Light *light, unsigned int loffs) const;
+		/*! Adds the luminance sums of the samples of an estimation of a light, reallocating the samples of the lights every few estimations */
+		void addLightSampleStats(RenderData &render_data, unsigned int loffs, int num_samples, double sum, double sum_2) const;
 		/*! Does recursive mc raytracing with MIS (Multiple Importance Sampling) for a given surface point */
 		void recursiveRaytrace(RenderData &render_data, const DiffRay &ray, const BsdfFlags &bsdfs, SurfacePoint &sp, const Vec3 &wo, Rgb &col, float &alpha, int additional_depth, ColorLayers *color_layers = nullptr) const;
 		/*! Creates and prepares the caustic photon map */
 		bool createCausticMap(const RenderView *render_view, const RenderControl &render_control);
+		/*! with the render checkpoints, the photon maps are saved next to the checkpoint when the render starts and loaded from there when it resumes */
+		void setupCheckpointPhotonMaps(const RenderView *render_view);
+		std::string getPhotonMapPath(const std::string &map_name) const; //!< file of a saved photon map, next to the checkpoints or to the film file
+		/*! Collects the bounding spheres of the objects with specular, glossy or dispersive materials, the only ones that can start a caustic path */
+		void createCausticTargets();
+		//! fraction of the light emission shot towards the caustic targets, 1 without targets
+		float causticEmissionFraction(const Light &light) const { return caustic_targets_.empty() ? 1.f : light.projectionFraction(caustic_targets_); }
 		/*! Estimates caustic photons for a given surface point */
 		Rgb estimateCausticPhotons(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const;
 		/*! Samples ambient occlusion for a given surface point */
 		Rgb sampleAmbientOcclusion(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const;
 		Rgb sampleAmbientOcclusionLayer(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const;
 		Rgb sampleAmbientOcclusionClayLayer(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const;
+		/*! Sum of the colors of the ambient occlusion rays that hit nothing, traced together as a ray stream without evaluating the materials hit */
+		Rgb unoccludedColor(const RenderData &render_data, const std::vector<Ray> &occlusion_rays, const std::vector<Rgb> &occlusion_colors) const;
+		/*! Creates the irradiance point clouds of the objects with a diffusion profile inside their material, must be called after setting lights_ */
+		void createSubsurfaceClouds();
+		/*! Light diffused under the surface of the objects with an irradiance point cloud, leaving it towards wo */
+		Rgb estimateSubsurfaceDiffusion(const SurfacePoint &sp, const Vec3 &wo) const;
 
 		int r_depth_; //! Ray depth
 		bool tr_shad_; //! Use transparent shadows
@@ -75,6 +103,8 @@ class MonteCarloIntegrator: public TiledIntegrator
 		int n_caus_search_; //! Amount of caustic photons to be gathered in estimation
 		float caus_radius_; //! Caustic search radius for estimation
 		int caus_depth_; //! Caustic photons max path depth
+		bool caustic_projection_ = true; //! Shoot the caustic photons only towards the objects that can generate caustics (projection map)
+		std::vector<ProjectionTarget> caustic_targets_; //! Bounding spheres of the objects that can generate caustics, empty to shoot the caustic photons over the whole light emission
 		std::unique_ptr<Pdf1D> light_power_d_;
 
 		bool use_ambient_occlusion_; //! Use ambient occlusion
@@ -83,13 +113,30 @@ class MonteCarloIntegrator: public TiledIntegrator
 		Rgb ao_col_; //! Ambient occlusion color
 
 		PhotonMapProcessing photon_map_processing_ = PhotonsGenerateOnly;
+		PhotonMapProcessing view_photon_map_processing_ = PhotonsGenerateOnly; //!< the configured processing, while the render views share the photon maps of the first one
+		bool sharing_view_preprocess_ = false;
 
 		int n_paths_; //! Number of samples for mc raytracing
 		int max_bounces_; //! Max. path depth for mc raytracing
 		std::vector<const Light *> lights_; //! An array containing all the scene lights
+		LightSampling light_sampling_ = LightSampling::Uniform; //! How estimateOneDirectLight selects the light
+		bool adaptive_light_samples_ = false; //! The area lights share the samples of their estimations in proportion to the standard deviation of their samples in each area rendered
+		static constexpr int light_samples_update_interval_ = 64; //! Area light estimations between the reallocations of the light samples
+		std::unique_ptr<LightTree> light_tree_; //! Light hierarchy to select the lights by their estimated contribution, only with LightSampling::LightTree
+		const Pdf1D *light_power_pdf_ = nullptr; //! Render view distribution to select the lights by their emitted energy, only with LightSampling::Power
+		int sss_max_points_ = 50000; //! Maximum number of points of each subsurface scattering irradiance point cloud
+		float sss_max_error_ = 0.3f; //! Largest size to distance ratio of the point clusters evaluated as a whole
+		struct SubsurfaceCloud
+		{
+			const DiffusionProfile *profile_;
+			std::unique_ptr<const SssPointCloud> cloud_;
+		};
+		std::map<const Object *, SubsurfaceCloud> subsurface_clouds_; //! Irradiance point clouds of the objects with subsurface scattering
+		/*! Irradiance point cloud of the object at sp when the surface is seen from outside, the light refracted into it is accounted by the cloud instead of being traced */
+		const SubsurfaceCloud *findSubsurfaceCloud(const SurfacePoint &sp, const Vec3 &wo) const;
 		bool transp_background_; //! Render background as transparent
 		bool transp_refracted_background_; //! Render refractions of background as transparent
-		void causticWorker(PhotonMap *caustic_map, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_caus_photons, Pdf1D *light_power_d, int num_lights, const std::vector<const Light *> &caus_lights, int caus_depth, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot);
+		void causticWorker(std::vector<Photon> &caustic_photons, unsigned int &photons_shot, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_caus_photons, Pdf1D *light_power_d, int num_lights, const std::vector<const Light *> &caus_lights, int caus_depth, PhotonShootingProgress &progress, int pb_step, const std::vector<unsigned int> *paths, std::vector<unsigned int> *photon_paths, uint64_t *path_objects);
 };
 
 END_YAFARAY
@@ -22,6 +22,11 @@
 
 #include "render/render_view.h"
 #include "integrator_montecarlo.h"
+#include "geometry/surface.h"
+#include "geometry/ray.h"
+#include "material/material.h"
+#include "sampler/sd_tree.h"
+#include <array>
 
 BEGIN_YAFARAY
 
@@ -35,14 +40,105 @@ class PathIntegrator final : public MonteCarloIntegrator
 		virtual std::string getShortName() const override { return "PT"; }
 		virtual std::string getName() const override { return "PathTracer"; }
 		virtual bool preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *image_film) override;
+		virtual void prePass(int samples, int offset, bool adaptive, const RenderControl &render_control, const RenderView *render_view) override;
 		virtual Rgba integrate(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers, const RenderView *render_view) const override;
 		enum class CausticType { None, Path, Photon, Both };
+		enum class RussianRouletteType { Throughput, WeightWindow };
+		struct PathState;
+		struct WavefrontData;
+		struct GuidingVertex;
+		struct HeroWavelengths;
+		/*! Continues a path from the start hit, whose BSDF is already initialized in the render data arena, until it is terminated. Returns the contribution of the path vertices after the start hit, including its split copies.
+			The hero wavelengths are only set for the chromatic paths in the hero wavelength mode. Without the extended features (splitting, weight window roulette, hero wavelengths, guiding and IBL irradiance) their checks are compiled out */
+		template <bool extended_features> Rgb tracePathBounces(RenderData &render_data, const SurfacePoint &start_hit, const Vec3 &start_wo, const BsdfFlags &start_bsdfs, Rgb throughput, int first_depth, unsigned int offs, float dc_1, float dc_2, bool split_allowed, HeroWavelengths *hero, ColorLayers *color_layers) const;
+		/*! Weights the other hero wavelengths at a dispersive vertex, whose direction wi was sampled with the hero wavelength, and applies the change of the spectral factor to the throughput */
+		void heroWavelengthVertex(RenderData &render_data, const SurfacePoint &sp, const Material *material, const Vec3 &wo, const Vec3 &wi, HeroWavelengths &hero, Rgb &throughput) const;
+		float survivalProbability(const Rgb &throughput, int depth, int thread_id) const; //!< russian roulette probability of continuing a path with this throughput at this depth
+		int pathSplits(const Rgb &throughput, int depth, int thread_id) const; //!< number of copies the path is split into at this depth, 1 if it must not be split
+		float bounceCostFactor(int depth, int thread_id) const; //!< square root of the cost of the first bounce relative to the cost of this bounce, as measured by the render thread
+		void addBounceCost(int depth, int thread_id, float cost) const;
+		/*! Samples the next direction of the path with the material, or with the guiding tree combined with the material sampling by one-sample MIS at the diffuse vertices. Returns the sampled BSDF * |cos| / pdf, and the solid angle pdf of the combined sampling in guiding_pdf so the vertex can be recorded, or 0 if it cannot be guided */
+		Rgb sampleBsdf(RenderData &render_data, const SurfacePoint &sp, const Material *material, const BsdfFlags &bsdfs, const BsdfFlags &sample_flags, const Vec3 &wo, Vec3 &wi, Sample &s, float &guiding_pdf) const;
+		void recordGuidingVertex(RenderData &render_data, const GuidingVertex &vertex, const Rgb &contribution) const; //!< records the incident radiance estimated from the contribution of the path after the vertex into the guiding tree
+		static bool isGuidable(const BsdfFlags &bsdfs) { return bsdfs.hasAny(BsdfFlags::Diffuse) && !bsdfs.hasAny(BsdfFlags::Specular | BsdfFlags::Glossy | BsdfFlags::Filter); }
+		/*! True if the path ends at this vertex with the background irradiance (beyond the IBL irradiance depth, at the diffuse vertices), giving the reflected irradiance without occlusion in irradiance_col.
+			The direct lighting of the vertex must then skip the background lights, whose light is already in the irradiance */
+		bool endsWithIrradiance(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const BsdfFlags &bsdfs, int depth, Rgb &irradiance_col) const;
+		/*! Traces the n_samples paths starting at the surface point sp together, bounce by bounce: each bounce is run as a sequence of phases over all the active paths (material sampling, ray stream intersection, shading grouped by material, direct lighting). Returns the sum of the paths contributions */
+		Rgb tracePathsWavefront(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Material *material, int n_samples, bool was_chromatic, BsdfFlags path_flags, ColorLayers *color_layers) const;
 
 		bool trace_caustics_; //!< use path tracing for caustics (determined by causticType)
 		bool no_recursive_;
 		float inv_n_paths_;
 		CausticType caustic_type_;
 		int russian_roulette_min_bounces_;  //!< minimum number of bounces where russian roulette is not applied. Afterwards russian roulette will be used until the maximum selected bounces. If min_bounces >= max_bounces, then no russian roulette takes place
+		bool wavefront_ = false; //!< trace the paths of each hit point together, bounce by bounce, instead of one path after another
+		bool hero_wavelength_ = false; //!< each chromatic path carries 4 wavelengths instead of one, weighted at the dispersive vertices
+		Rgb (PathIntegrator::*trace_path_bounces_)(RenderData &render_data, const SurfacePoint &start_hit, const Vec3 &start_wo, const BsdfFlags &start_bsdfs, Rgb throughput, int first_depth, unsigned int offs, float dc_1, float dc_2, bool split_allowed, HeroWavelengths *hero, ColorLayers *color_layers) const = &PathIntegrator::tracePathBounces<true>; //!< selected in preprocess for the features in use
+		mutable std::vector<WavefrontData> wavefront_thread_data_; //!< path queues reused between the integrate calls of each render thread
+		RussianRouletteType russian_roulette_type_ = RussianRouletteType::Throughput;
+		float russian_roulette_weight_low_ = 0.1f; //!< with the weight window roulette, paths with a cost weighted throughput below this are terminated with probability proportional to their weight
+		int path_splitting_max_ = 1; //!< maximum number of copies a path can be split into at a bounce, 1 to disable the splitting
+		float path_splitting_weight_ = 0.5f; //!< paths with a cost weighted throughput above this are split so each copy has at most this weight
+		mutable std::vector<std::vector<float>> bounce_costs_; //!< [thread][depth] running average of the time of each bounce, in seconds
+		static constexpr float bounce_cost_smoothing_ = 1.f / 256.f;
+		bool path_guiding_ = false; //!< guide the paths with the incident radiance learnt in the first passes
+		int path_guiding_training_passes_ = 4; //!< number of AA passes recording the incident radiance, the guiding tree is not updated afterwards
+		float path_guiding_fraction_ = 0.5f; //!< probability of sampling the guiding tree instead of the material at the guided vertices
+		SdTree::Parameters path_guiding_parameters_;
+		std::unique_ptr<SdTree> sd_tree_;
+		bool path_guiding_recording_ = false; //!< only changed between passes
+		int path_guiding_pass_ = 0;
+		int ibl_irradiance_depth_ = 0; //!< depth from which the diffuse vertices end the paths with the prefiltered background irradiance instead of bouncing further, 0 to disable
+};
+
+/*! State of one of the paths traced together in the wavefront mode, between the phases of each bounce */
+struct PathIntegrator::PathState
+{
+	Rgb throughput_;
+	Vec3 pwo_;
+	Ray ray_;
+	SurfacePoint hit_;
+	const Material *material_ = nullptr;
+	void *material_data_ = nullptr; //!< data of the material of the current hit, allocated from the thread arena
+	BsdfFlags bsdfs_;
+	unsigned int offs_; //!< sample index of the path in the pixel
+	float wavelength_;
+	bool chromatic_;
+	bool caustic_;
+};
+
+struct PathIntegrator::WavefrontData
+{
+	std::vector<PathState> paths_;
+	std::vector<int> active_paths_; //!< indices of the paths still being traced
+	std::vector<Ray> rays_; //!< ray stream of the active paths, in the same order as active_paths_
+	std::vector<SurfacePoint> hits_;
+};
+
+/*! Vertex of a path where the sampled direction can be recorded into the guiding tree once the contribution of the rest of the path is known */
+struct PathIntegrator::GuidingVertex
+{
+	Point3 p_;
+	Vec3 wi_;
+	Rgb throughput_; //!< path throughput including the BSDF sampled at the vertex
+	Rgb path_col_; //!< path contribution before the vertex, the contribution after it being the difference with the final one
+	float pdf_;
+};
+
+/*! Wavelengths carried together by a chromatic path in the hero wavelength mode (Wilkie et al., "Hero Wavelength Spectral Sampling", 2014).
+ * The hero wavelength selects the directions at the dispersive vertices, and the other ones, rotated a fraction of the range each,
+ * are weighted with the balance heuristic over all the wavelengths. At the specular dispersive vertices only the hero wavelength
+ * can follow the path. Until the first dispersive vertex the path is not spectral and its throughput is the RGB one */
+struct PathIntegrator::HeroWavelengths
+{
+	static constexpr int num_wavelengths_ = 4;
+	explicit HeroWavelengths(float hero_wavelength);
+	Rgb spectralFactor() const; //!< sum of the wavelength colors weighted by their BSDF ratios, divided by the sum of their pdf ratios
+	std::array<float, num_wavelengths_> wavelengths_; //!< the hero wavelength first
+	std::array<Rgb, num_wavelengths_> bsdf_ratios_; //!< product of the BSDF of each wavelength relative to the hero one at the dispersive vertices
+	std::array<float, num_wavelengths_> pdf_ratios_; //!< product of the pdf of each wavelength relative to the hero one at the dispersive vertices
+	Rgb factor_ {1.f}; //!< spectral factor already applied to the throughput
 };
 
 END_YAFARAY
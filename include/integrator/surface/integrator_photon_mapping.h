@@ -23,20 +23,23 @@
 #include "integrator_montecarlo.h"
 #include "photon/photon.h"
 #include <vector>
+#include <atomic>
 #include "render/render_view.h"
+#include "photon/irradiance_cache.h"
 
 BEGIN_YAFARAY
 
 struct PreGatherData final
 {
-	PreGatherData(PhotonMap *dm): diffuse_map_(dm), fetched_(0) {}
+	PreGatherData(PhotonMap *dm): diffuse_map_(dm) {}
 	PhotonMap *diffuse_map_;
 
-	std::vector<RadData> rad_points_;
+	std::vector<RadData> rad_points_; //!< sorted along a Morton curve before the pre-gathering, so each chunk of consecutive points is a small region of the scene
 	std::vector<Photon> radiance_vec_;
 	std::shared_ptr<ProgressBar> pbar_;
-	volatile int fetched_;
-	std::mutex mutx_;
+	std::atomic<unsigned int> fetched_ {0}; //!< first radiance point not taken by any worker yet
+	std::atomic<unsigned int> progress_steps_ {0}; //!< points pre-gathered and not reported to the progress bar yet
+	std::mutex progress_mutx_; //!< the progress bar is updated by the worker getting this mutex, the others do not wait for it
 };
 
 class PhotonIntegrator final : public MonteCarloIntegrator
@@ -51,9 +54,17 @@ class PhotonIntegrator final : public MonteCarloIntegrator
 		virtual bool preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *image_film) override;
 		virtual Rgba integrate(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers, const RenderView *render_view) const override;
 		void preGatherWorker(PreGatherData *gdata, float ds_rad, int n_search);
-		void diffuseWorker(PhotonMap *diffuse_map, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_diffuse_photons, const Pdf1D *light_power_d, int num_d_lights, const std::vector<const Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, bool final_gather, PreGatherData &pgdat);
+		void diffuseWorker(std::vector<Photon> &diffuse_photons, std::vector<RadData> &rad_points, unsigned int &photons_shot, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_diffuse_photons, const Pdf1D *light_power_d, int num_d_lights, const std::vector<const Light *> &tmplights, PhotonShootingProgress &progress, int pb_step, int max_bounces, bool final_gather, const std::vector<unsigned int> *paths, std::vector<unsigned int> *photon_paths, std::vector<unsigned int> *rad_point_paths, uint64_t *path_objects);
 		void photonMapKdTreeWorker(PhotonMap *photon_map);
+		/*! Compares the scene with the one the photon maps in the session were shot from, finding the paths to shoot again. Returns
+			false when the maps cannot be updated incrementally and all the paths must be shot again */
+		bool findChangedPaths(std::vector<unsigned int> &diffuse_paths, std::vector<unsigned int> &caustic_paths) const;
 		Rgb finalGathering(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const;
+		/*! radiance arriving along the final gather ray, optionally returning the distance to its first hit (unchanged if it hits the background) */
+		Rgb traceGatherPath(RenderData &render_data, Ray &p_ray, unsigned int offs, float *first_hit_distance = nullptr) const;
+		/*! final gathering interpolated from the irradiance cache, adding a record when none is accurate enough at the point */
+		Rgb cachedFinalGathering(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const;
+		Rgb addIrradianceRecord(RenderData &render_data, const SurfacePoint &sp, const Vec3 &n) const;
 		void enableCaustics(const bool caustics) { use_photon_caustics_ = caustics; }
 		void enableDiffuse(const bool diffuse) { use_photon_diffuse_ = diffuse; }
 
@@ -66,6 +77,11 @@ class PhotonIntegrator final : public MonteCarloIntegrator
 		float ds_radius_; //!< diffuse search radius
 		float lookup_rad_; //!< square radius to lookup radiance photons, as infinity is no such good idea ;)
 		float gather_dist_; //!< minimum distance to terminate path tracing (unless gatherBounces is reached)
+		bool use_irradiance_cache_ = false;
+		float irradiance_cache_accuracy_ = 0.25f; //!< maximum estimated error of the interpolated records
+		int irradiance_cache_samples_ = 256; //!< final gather rays per record
+		float irradiance_cache_min_radius_, irradiance_cache_max_radius_;
+		std::unique_ptr<IrradianceCache> irradiance_cache_;
 };
 
 END_YAFARAY
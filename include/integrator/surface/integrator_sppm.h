@@ -22,29 +22,56 @@
 
 #include "integrator_montecarlo.h"
 #include "photon/hashgrid.h"
+#include "photon/visible_point_grid.h"
+#include "photon/photon_guide.h"
 #include "sampler/halton.h"
 #include "photon/photon.h"
+#include "image/image_buffers.h"
 
 BEGIN_YAFARAY
 
 class Random;
+class RenderCheckpoint;
 
-struct HitPoint final // actually are per-pixel variable, use to record the sppm's shared statistics
+/*! Per-pixel statistics shared by the SPPM passes, in structure of arrays so the refinements of each pass only stream the arrays they update.
+	The accumulated flux can be kept in half floats, halving its memory traffic in big renders */
+class HitPoints final
 {
-	float radius_2_; // square search-radius, shrink during the passes
-	int64_t acc_photon_count_; // record the total photon this pixel gathered
-	Rgba acc_photon_flux_; // accumulated flux
-	Rgba constant_randiance_; // record the direct light for this pixel
+	public:
+		void resize(size_t size, float radius_2, bool half_flux);
+		size_t size() const { return radius_2_.size(); }
+		Rgba getFlux(size_t index) const { return half_flux_ ? acc_photon_flux_half_[index].getColor() : acc_photon_flux_[index]; }
+		void setFlux(size_t index, const Rgba &flux);
+		/*! progressive refinement of the radius and flux of a hit point with the photons of a pass */
+		void refine(size_t index, const Rgba &photon_flux, float photon_count);
+		void save(RenderCheckpoint &checkpoint) const;
+		bool load(const RenderCheckpoint &checkpoint); //!< into hit points resized as the saved ones, returns false without changing them if they do not match
+
+		std::vector<float> radius_2_; // square search-radius, shrink during the passes
+		std::vector<int64_t> acc_photon_count_; // record the total photon this pixel gathered
+		std::vector<Rgba> constant_randiance_; // record the direct light for this pixel
+		std::vector<unsigned char> radius_setted_; // used by IRE to direct whether the initial radius is set or not.
 
-	bool radius_setted_; // used by IRE to direct whether the initial radius is set or not.
+	private:
+		bool half_flux_ = false;
+		std::vector<Rgba> acc_photon_flux_; // accumulated flux
+		std::vector<RgbaHalf> acc_photon_flux_half_; // accumulated flux when kept in half floats
 };
 
+inline void HitPoints::setFlux(size_t index, const Rgba &flux)
+{
+	if(half_flux_) acc_photon_flux_half_[index].setColor(flux);
+	else acc_photon_flux_[index] = flux;
+}
+
 //used for gather ray to collect photon information
 struct GatherInfo final
 {
 	int64_t photon_count_;  // the number of photons that the gather ray collected
 	Rgba photon_flux_;   // the unnormalized flux of photons that the gather ray collected
 	Rgba constant_randiance_; // the radiance from when the gather ray hit the lightsource
+	std::vector<VisiblePoint> *visible_points_ = nullptr; // when splatting the photons, the visible points recorded by the gather ray
+	size_t visible_points_begin_ = 0, visible_points_end_ = 0; // they are contiguous, as the gather rays are traced depth first
 
 	GatherInfo(): photon_count_(0), photon_flux_(0.f), constant_randiance_(0.f) {}
 
@@ -53,8 +80,37 @@ struct GatherInfo final
 		photon_count_ += g.photon_count_;
 		photon_flux_ += g.photon_flux_;
 		constant_randiance_ += g.constant_randiance_;
+		mergeVisiblePoints(g);
 		return (*this);
 	}
+	//! scales the photon flux, and the weight of the visible points that will receive it
+	void scaleFlux(const Rgb &factor)
+	{
+		photon_flux_ *= factor;
+		if(visible_points_) for(size_t i = visible_points_begin_; i < visible_points_end_; ++i) (*visible_points_)[i].weight_ *= factor;
+	}
+	//! adds the photons of g, scaling their flux and count
+	void addPhotons(const GatherInfo &g, const Rgb &flux_factor, float count_factor = 1.f)
+	{
+		photon_flux_ += g.photon_flux_ * Rgba(flux_factor, 1.f);
+		photon_count_ += g.photon_count_ * count_factor;
+		if(g.visible_points_)
+		{
+			for(size_t i = g.visible_points_begin_; i < g.visible_points_end_; ++i)
+			{
+				(*g.visible_points_)[i].weight_ *= flux_factor;
+				(*g.visible_points_)[i].count_weight_ *= count_factor;
+			}
+		}
+		mergeVisiblePoints(g);
+	}
+	void mergeVisiblePoints(const GatherInfo &g)
+	{
+		if(g.visible_points_begin_ == g.visible_points_end_) return;
+		if(visible_points_begin_ == visible_points_end_) visible_points_begin_ = g.visible_points_begin_;
+		visible_points_end_ = g.visible_points_end_;
+		visible_points_ = g.visible_points_;
+	}
 };
 
 
@@ -74,12 +130,18 @@ class SppmIntegrator final : public MonteCarloIntegrator
 		virtual bool preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *image_film) override; //not used for now
 		// not used now
 		virtual void prePass(int samples, int offset, bool adaptive, const RenderControl &render_control, const RenderView *render_view) override;
+		virtual void saveIntegratorCheckpoint(RenderCheckpoint &checkpoint) const override;
+		virtual bool loadIntegratorCheckpoint(const RenderCheckpoint &checkpoint) override;
 		/*! not used now, use traceGatherRay instead*/
 		/*! initializing the things that PPM uses such as initial radius */
 		void initializePpm(const RenderView *render_view);
+		/*! progressive refinement of the hit point radius and flux with the photons of a pass */
+		void refineHitPoint(size_t hit_point, const Rgba &photon_flux, float photon_count);
+		/*! refines the hit points with the photons splatted into the visible points of the previous eye pass */
+		void refineVisiblePoints();
 		/*! based on integrate method to do the gatering trace, need double-check deadly. */
-		GatherInfo traceGatherRay(RenderData &render_data, DiffRay &ray, HitPoint &hp, ColorLayers *color_layers = nullptr);
-		void photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_photons, const Pdf1D *light_power_d, int num_d_lights, const std::vector<const Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, Random &prng);
+		GatherInfo traceGatherRay(RenderData &render_data, DiffRay &ray, size_t hit_point, ColorLayers *color_layers = nullptr);
+		void photonWorker(std::vector<Photon> &diffuse_photons, std::vector<Photon> &caustic_photons, unsigned int &photons_shot, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_photons, unsigned int first_photon, unsigned int last_photon, const Pdf1D *light_power_d, int num_d_lights, const std::vector<const Light *> &tmplights, PhotonShootingProgress &progress, int pb_step, int max_bounces);
 
 		HashGrid  photon_grid_; // the hashgrid for holding photons
 		PhotonMap diffuse_map_, caustic_map_; // photonmap
@@ -91,10 +153,16 @@ class SppmIntegrator final : public MonteCarloIntegrator
 		uint64_t totaln_photons_; // amount of total photons that have been emited, used to normalize photon energy
 		bool pm_ire_; // flag to  say if using PM for initial radius estimate
 		bool b_hashgrid_; // flag to choose using hashgrid or not.
-		Halton hal_1_{2, 0}, hal_2_{3, 0}, hal_3_{5, 0}, hal_4_{7, 0}; // halton sequence to do
-		std::vector<HitPoint>hit_points_; // per-pixel refine data
-		unsigned int n_refined_; // Debug info: Refined pixel per pass
-		std::mutex mutex_;
+		unsigned int photon_index_base_ = 0; // index in the halton sequences of the first photon of the pass, the photons of the pass follow it
+		HitPoints hit_points_; // per-pixel refine data
+		bool half_flux_ = false; // keep the accumulated flux of the hit points in half floats
+		bool photon_splatting_ = false; // splat the photons into the visible points while tracing them, instead of storing them in photon maps
+		bool record_visible_points_only_ = false; // the first eye pass only records the visible points, without output
+		std::vector<std::vector<VisiblePoint>> visible_points_; // recorded by each render thread during an eye pass
+		VisiblePointGrid visible_point_grid_; // the visible points of the previous eye pass, receiving the photons
+		bool photon_guiding_ = false; // guide the photon emission towards the photons deposited near the gather points of the previous passes
+		PhotonGuide photon_guide_;
+		std::atomic<unsigned int> n_refined_ {0}; // Debug info: Refined pixel per pass
 };
 
 END_YAFARAY
@@ -22,25 +22,42 @@
 
 #include "integrator/integrator.h"
 #include "common/thread.h"
+#include "common/task_pool.h"
 #include "common/aa_noise_params.h"
+#include "sampler/sampler.h"
+#include "geometry/ray.h"
 #include <vector>
+#include <map>
+#include <algorithm>
 
 BEGIN_YAFARAY
 
 class SurfacePoint;
+class Material;
+class ColorLayers;
 class PhotonMap;
 class Pdf1D;
 class RenderArea;
+class Primitive;
+class RenderCheckpoint;
 enum class DarkDetectionType : int;
 
+//! Render time of a tile, to find the tiles blowing the render time budget
+struct TileCost
+{
+	int x_, y_, w_, h_;
+	float seconds_;
+};
+
 class ThreadControl final
 {
 	public:
 		ThreadControl() : finished_threads_(0) {}
 		std::mutex m_;
 		std::condition_variable c_; //!< condition variable to signal main thread
-		std::vector<RenderArea> areas_; //!< area to be output to e.g. blender, if any
-		volatile int finished_threads_; //!< number of finished threads, lock countCV when increasing/reading!
+		std::vector<RenderArea> areas_; //!< areas to be output to e.g. blender, if any. Swapped out by the main thread before the output, so the queue is only locked briefly
+		int finished_threads_; //!< number of finished threads, lock m_ when increasing/reading!
+		std::vector<TileCost> tile_costs_; //!< render time of the tiles finished in the pass, lock m_ when adding!
 };
 
 class TiledIntegrator : public SurfaceIntegrator
@@ -55,13 +72,43 @@ class TiledIntegrator : public SurfaceIntegrator
 		virtual bool renderPass(const RenderView *render_view, int samples, int offset, bool adaptive, int aa_pass_number, RenderControl &render_control);
 		/*! render a tile; only required by default implementation of render() */
 		virtual bool renderTile(RenderArea &a, const RenderView *render_view, const RenderControl &render_control, int n_samples, int offset, bool adaptive, int thread_id, int aa_pass_number = 0);
-		virtual void renderWorker(TiledIntegrator *integrator, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, ThreadControl *control, int thread_id, int samples, int offset = 0, bool adaptive = false, int aa_pass = 0);
+		virtual void renderWorker(TiledIntegrator *integrator, const Scene *scene, const RenderView *render_view, RenderControl &render_control, ThreadControl *control, int thread_id, int samples, int offset = 0, bool adaptive = false, int aa_pass = 0);
 
 		//		virtual void recursiveRaytrace(renderState_t &state, diffRay_t &ray, int rDepth, BSDF_t bsdfs, surfacePoint_t &sp, vector3d_t &wo, Rgb &col, float &alpha) const;
 		virtual void precalcDepths(const RenderView *render_view);
+		/*! renders coarse images with one sample per block of pixels and shows them upscaled in the non-image outputs, so there is feedback before the first pass */
+		void renderPreview(const RenderView *render_view, const RenderControl &render_control);
 		void generateCommonLayers(RenderData &render_data, const SurfacePoint &sp, const DiffRay &ray, ColorLayers *color_layers = nullptr) const; //!< Generates render passes common to all integrators
+		const std::vector<TileCost> &getLastPassTileCosts() const { return last_pass_tile_costs_; } //!< in the order the tiles were finished
+		virtual uint64_t getNumCameraSamples() const override { return num_camera_samples_; }
 
 	protected:
+		struct CameraSample;
+		/*! integrate a camera sample and add its color layers to the film */
+		void renderCameraSample(RenderData &render_data, const CameraSample &camera_sample, RenderArea &a, ColorLayers &color_layers, const RenderView *render_view, int aa_pass_number, float inv_aa_max_possible_samples) const;
+		/*! specialized without the per layer work for the common renders with only the combined layer */
+		template <bool combined_only> void renderCameraSampleLayers(RenderData &render_data, const CameraSample &camera_sample, RenderArea &a, ColorLayers &color_layers, const RenderView *render_view, int aa_pass_number, float inv_aa_max_possible_samples) const;
+		/*! integrate the camera samples grouped by the material of their first hit, so the same material code and data are used consecutively */
+		void renderCameraSamplesSorted(RenderData &render_data, const std::vector<CameraSample> &camera_samples, RenderArea &a, ColorLayers &color_layers, const RenderView *render_view, int aa_pass_number, float inv_aa_max_possible_samples) const;
+		/*! stable reorder of the ids so the ones with the same material are consecutive, the groups sorted by first appearance so the order does not depend on the material addresses */
+		template <typename MaterialFunc> static void groupByMaterial(std::vector<int> &ids, const MaterialFunc &material_func);
+		/*! spectral wavelength of the sample index of a pixel, the Halton sampling keeps its Sobol radical inverse */
+		float sampleWavelength(unsigned int index, unsigned int seed) const;
+		/*! saves the film and the integrator state in the render checkpoint of the view after next_pass passes, when the checkpoints are enabled and
+			the passes are a multiple of the checkpoints interval. The passes loop state is the one render() needs to continue from next_pass */
+		void saveCheckpoint(const RenderView *render_view, const RenderControl &render_control, int next_pass, int acum_aa_samples, int resampled_pixels, bool aa_threshold_changed) const;
+		/*! restores the film and the integrator state from the render checkpoint of the view after the film init(), if there is one saved by this integrator.
+			Returns false if the render has to start from the first pass */
+		bool loadCheckpoint(const RenderView *render_view, RenderControl &render_control, int num_passes, int &next_pass, int &acum_aa_samples, int &resampled_pixels, bool &aa_threshold_changed);
+		void removeCheckpoint(const RenderView *render_view, const RenderControl &render_control) const; //!< once the render is finished, so the next renders start from the beginning
+		/*! state of the derived integrators kept in the render checkpoints, loadIntegratorCheckpoint must not change anything if it fails */
+		virtual void saveIntegratorCheckpoint(RenderCheckpoint &checkpoint) const { }
+		virtual bool loadIntegratorCheckpoint(const RenderCheckpoint &checkpoint) { return true; }
+		/*! clears the primary hit cache and allocates it for the film when enabled, only for cameras without depth of field so the rays of each pixel stratum are coherent */
+		void setupPrimaryHitCache(const RenderView *render_view);
+		/*! slot of the primary hit cache for a sample of a film pixel, nullptr when the cache is not used */
+		const Primitive **primaryHitSlot(int film_pixel, float dx, float dy) const;
+
 		float i_aa_passes_; //!< Inverse of AA_passes used for depth map
 		AaNoiseParams aa_noise_params_;
 		float aa_sample_multiplier_ = 1.f;
@@ -70,9 +117,53 @@ class TiledIntegrator : public SurfaceIntegrator
 		float max_depth_; //!< Inverse of max depth from camera within the scene boundaries
 		float min_depth_; //!< Distance between camera and the closest object on the scene
 		bool diff_rays_enabled_;	//!< Differential rays enabled/disabled - for future motion blur / interference features
-		static std::vector<int> correlative_sample_number_;  //!< Used to sample lights more uniformly when using estimateOneDirectLight
+		mutable std::vector<int> correlative_sample_number_;  //!< Used to sample lights more uniformly when using estimateOneDirectLight
+		std::unique_ptr<const Sampler> sampler_ {Sampler::factory(AaNoiseParams::SamplerType::Halton)}; //!< low discrepancy samples of the integrators, selected by the AA_sampler parameter
+		std::unique_ptr<TaskPool> render_thread_pool_; //!< render threads kept for all the passes, only recreated when the number of threads or the pinning changes
+		bool render_threads_pinned_ = false;
+		std::vector<TileCost> last_pass_tile_costs_;
+		std::atomic<uint64_t> num_camera_samples_ {0}; //!< added once per tile by the render threads
+		static constexpr size_t max_sorted_camera_samples_ = 4096; //!< camera samples of a tile sorted together by material, to bound the memory used by big tiles or many samples
+		mutable std::vector<const Primitive *> primary_hit_cache_; //!< primitive hit by the last camera ray of each stratum of the film pixels, each pixel only written by the thread rendering its area
+		static constexpr int primary_hit_strata_ = 4; //!< 2x2 strata per pixel
 };
 
+/*! Generated camera ray of a pixel sample, with the state needed to integrate it later */
+struct TiledIntegrator::CameraSample
+{
+	DiffRay ray_;
+	float wt_ = 0.f;
+	float dx_, dy_;
+	float time_;
+	int x_, y_;
+	int sample_;
+	int pixel_sample_;
+	int pixel_number_;
+	unsigned int sampling_offs_;
+};
+
+inline const Primitive **TiledIntegrator::primaryHitSlot(int film_pixel, float dx, float dy) const
+{
+	if(primary_hit_cache_.empty()) return nullptr;
+	const int stratum = (dx < 0.5f ? 0 : 1) + (dy < 0.5f ? 0 : 2);
+	return &primary_hit_cache_[static_cast<size_t>(film_pixel) * primary_hit_strata_ + stratum];
+}
+
+template <typename MaterialFunc>
+void TiledIntegrator::groupByMaterial(std::vector<int> &ids, const MaterialFunc &material_func)
+{
+	std::map<const Material *, int> material_groups;
+	std::vector<std::pair<int, int>> grouped_ids; //!< group, id
+	grouped_ids.reserve(ids.size());
+	for(const int id : ids)
+	{
+		const auto group = material_groups.emplace(material_func(id), static_cast<int>(material_groups.size())).first;
+		grouped_ids.emplace_back(group->second, id);
+	}
+	std::stable_sort(grouped_ids.begin(), grouped_ids.end(), [](const std::pair<int, int> &a, const std::pair<int, int> &b) { return a.first < b.first; });
+	for(size_t i = 0; i < ids.size(); ++i) ids[i] = grouped_ids[i].second;
+}
+
 END_YAFARAY
 
 #endif // YAFARAY_INTEGRATOR_TILED_H
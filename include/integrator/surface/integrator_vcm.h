@@ -0,0 +1,123 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_INTEGRATOR_VCM_H
+#define YAFARAY_INTEGRATOR_VCM_H
+
+#include "integrator_tiled.h"
+#include "geometry/surface.h"
+#include "color/color.h"
+#include <vector>
+#include <memory>
+
+BEGIN_YAFARAY
+
+class Camera;
+class Light;
+class Random;
+class ImageFilm;
+
+/*! Vertex connection and merging (Georgiev et al. 2012, Hachisuka et al. 2012 "unified path sampling").
+	Each pass traces a set of light subpaths first, splats their vertices to the camera and keeps them in a light vertex cache.
+	The eye subpaths of the pass then connect to light sources and to random cached light vertices (bidirectional path tracing),
+	and merge with the cached light vertices around them (progressive photon mapping), all the strategies weighted with the balance heuristic.
+	The light subpaths only start on the lights with bounded emission, the sun, directional and background lights are only sampled from the eye subpaths */
+class VcmIntegrator final : public TiledIntegrator
+{
+	public:
+		static std::unique_ptr<Integrator> factory(ParamMap &params, const Scene &scene);
+
+	private:
+		enum class Mode { Vcm, Bpt, Ppm };
+		//! vertex of a light subpath, kept for the connections and merging of the eye subpaths of the pass
+		struct LightVertex
+		{
+			SurfacePoint sp_;
+			void *material_data_; //!< in the arena of the light subpath thread, valid until the next pass
+			Rgb throughput_;
+			Vec3 wi_; //!< direction towards the previous vertex of the subpath
+			float d_vcm_, d_vc_, d_vm_; //!< partial MIS quantities of the subpath, evaluated recursively
+			int path_length_; //!< segments from the light source
+		};
+		//! state of a light or eye subpath while it is traced
+		struct SubpathState
+		{
+			Rgb throughput_ {1.f};
+			float d_vcm_ = 0.f, d_vc_ = 0.f, d_vm_ = 0.f;
+			int path_length_ = 1;
+			bool specular_path_ = true; //!< all the vertices so far were specular
+		};
+		VcmIntegrator(Mode mode, int max_path_length, int num_light_paths, float radius_factor, float radius_alpha, int num_connections);
+		virtual std::string getShortName() const override { return "VCM"; }
+		virtual std::string getName() const override { return "VertexConnectionMerging"; }
+		virtual bool preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *image_film) override;
+		virtual void prePass(int samples, int offset, bool adaptive, const RenderControl &render_control, const RenderView *render_view) override;
+		virtual void cleanup() override;
+		virtual void saveIntegratorCheckpoint(RenderCheckpoint &checkpoint) const override;
+		virtual bool loadIntegratorCheckpoint(const RenderCheckpoint &checkpoint) override;
+		virtual Rgba integrate(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers, const RenderView *render_view) const override;
+		void lightPathWorker(std::vector<LightVertex> &light_vertices, int thread_id, int num_paths, const Camera *camera) const;
+		Rgb traceEyePath(RenderData &render_data, const Ray &ray, SurfacePoint sp, const Camera *camera) const;
+		bool sampleScattering(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, SubpathState &state, Ray &ray) const;
+		void connectToCamera(RenderData &render_data, const LightVertex &vertex, const Camera *camera) const;
+		Rgb connectToLight(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const SubpathState &state) const;
+		Rgb connectToLightVertices(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const SubpathState &state) const;
+		Rgb mergeLightVertices(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const SubpathState &state) const;
+		void buildLightVertexGrid(); //!< sorts the light vertices by the cells of the merging hash grid
+		unsigned int gridCell(int ix, int iy, int iz) const { return ((static_cast<unsigned int>(ix) * 73856093u) ^ (static_cast<unsigned int>(iy) * 19349663u) ^ (static_cast<unsigned int>(iz) * 83492791u)) % grid_size_; }
+
+		bool use_vc_ = true; //!< vertex connections: light sampling, connections to the light vertices and light tracing to the camera
+		bool use_vm_ = true; //!< vertex merging
+		bool light_tracing_ = true; //!< the light vertices are splatted to the camera, not possible with depth of field
+		int max_path_length_;
+		int num_light_paths_; //!< light subpaths traced in each pass
+		int num_connections_; //!< light vertices connected to each eye vertex, 0 for the mean number of vertices of the light subpaths
+		float radius_factor_; //!< initial merging radius relative to the radius of the scene bounding sphere
+		float radius_alpha_; //!< the merging radius shrinks with the pass number to the power of (alpha - 1) / 2
+		bool transp_background_ = false; //! Render background as transparent
+		bool transp_refracted_background_ = false; //! Render refractions of background as transparent
+		bool background_light_ = false; //!< the background is sampled as a light, so it is only added when the eye subpaths escape after specular vertices
+
+		std::vector<const Light *> lights_;
+		const Pdf1D *light_power_d_ = nullptr; //!< owned by the render view, shared with the other integrators
+		std::vector<float> light_pick_pdfs_; //!< probability of sampling each light from the eye subpaths
+		std::vector<int> emitting_lights_; //!< lights with bounded emission, where the light subpaths start
+		std::unique_ptr<Pdf1D> emitting_power_d_;
+		std::vector<float> emit_pick_pdfs_; //!< probability of starting a light subpath on each light, 0 for the lights without bounded emission
+		std::vector<std::unique_ptr<Random>> light_prngs_;
+		std::vector<std::unique_ptr<RenderData>> light_render_data_; //!< of each light subpath thread, their arenas keep the material data of the light vertices
+
+		int pass_ = 0;
+		int pass_light_paths_ = 0; //!< light subpaths traced in the current pass
+		int total_light_paths_ = 0; //!< light subpaths traced in all the passes, normalizing the light tracing image
+		float base_radius_ = 0.f, radius_ = 0.f;
+		float mis_vm_weight_factor_ = 0.f, mis_vc_weight_factor_ = 0.f;
+		float vm_normalization_ = 0.f;
+		int pass_connections_ = 1;
+		float connection_factor_ = 1.f; //!< the connections to random light vertices estimate the connections to all the vertices of one light subpath
+		float light_tracing_factor_ = 0.f;
+		std::vector<LightVertex> light_vertices_; //!< sorted by merging grid cell
+		std::vector<unsigned int> grid_cell_starts_; //!< index of the first light vertex of each cell, with the number of light vertices at the end
+		unsigned int grid_size_ = 1;
+		float grid_inv_cell_size_ = 1.f;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_INTEGRATOR_VCM_H
@@ -21,6 +21,7 @@
 #define YAFARAY_INTEGRATOR_EMISSION_H
 
 #include "integrator/integrator.h"
+#include "volume/volume_region_tree.h"
 
 BEGIN_YAFARAY
 
@@ -32,10 +33,13 @@ class EmissionIntegrator final : public VolumeIntegrator
 	private:
 		virtual std::string getShortName() const override { return "Em"; }
 		virtual std::string getName() const override { return "Emission"; }
+		virtual bool preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *image_film) override;
 		// optical thickness, absorption, attenuation, extinction
 		virtual Rgba transmittance(RenderData &render_data, const Ray &ray) const override;
 		// emission part
 		virtual Rgba integrate(RenderData &render_data, const Ray &ray, int additional_depth = 0) const override;
+
+		VolumeRegionTree volume_tree_;
 };
 
 END_YAFARAY
@@ -22,6 +22,7 @@
 
 
 #include "integrator/integrator.h"
+#include "volume/volume_region_tree.h"
 #include <vector>
 #include "render/render_view.h"
 
@@ -37,7 +38,7 @@ class SingleScatterIntegrator final : public VolumeIntegrator
 		static std::unique_ptr<Integrator> factory(ParamMap &params, const Scene &scene);
 
 	private:
-		SingleScatterIntegrator(float s_size, bool adapt, bool opt);
+		SingleScatterIntegrator(float s_size, bool adapt, bool opt, bool tracking);
 		virtual std::string getShortName() const override { return "SSc"; }
 		virtual std::string getName() const override { return "SingleScatter"; }
 		virtual bool preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *image_film) override;
@@ -46,11 +47,19 @@ class SingleScatterIntegrator final : public VolumeIntegrator
 		// emission and in-scattering
 		virtual Rgba integrate(RenderData &render_data, const Ray &ray, int additional_depth = 0) const override;
 		Rgb getInScatter(RenderData &render_data, Ray &step_ray, float current_step) const;
+		//! fills the attenuation grid points of the slice z, so the slices can be computed in parallel
+		void computeAttenuationSlice(const VolumeRegion &vr, const Light &light, int z, float *attenuation_grid) const;
+		//! transmittance along a light ray through all the volume regions, ray marched or ratio tracked
+		float lightTransmittance(RenderData &render_data, const Ray &light_ray, float step) const;
+		//! single scattering estimate from one delta tracked collision, instead of ray marching between t_0 and t_1 through the regions crossed by the ray
+		Rgba integrateDeltaTracking(RenderData &render_data, const Ray &ray, const std::vector<VolumeRegionTree::Hit> &hits, float t_0, float t_1) const;
 
 		bool adaptive_;
 		bool optimize_;
+		bool tracking_; //!< use delta/ratio tracking against the region majorants instead of fixed step ray marching
 		float adaptive_step_size_;
 		std::vector<const Light *> lights_;
+		VolumeRegionTree volume_tree_;
 		unsigned int vr_size_;
 		float i_vr_size_;
 		float step_size_;
@@ -21,6 +21,8 @@
 #define YAFARAY_INTEGRATOR_SKY_H
 
 #include "integrator/integrator.h"
+#include "background/sky_table.h"
+#include <vector>
 
 BEGIN_YAFARAY
 
@@ -32,7 +34,7 @@ class SkyIntegrator : public VolumeIntegrator
 		static std::unique_ptr<Integrator> factory(ParamMap &params, const Scene &scene);
 
 	private:
-		SkyIntegrator(float s_size, float a, float ss, float t);
+		SkyIntegrator(float a, float ss, float t, int table_resolution);
 		virtual std::string getShortName() const override { return "Sky"; }
 		virtual std::string getName() const override { return "Sky"; }
 		virtual bool preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *image_film) override;
@@ -42,8 +44,8 @@ class SkyIntegrator : public VolumeIntegrator
 		virtual Rgba integrate(RenderData &render_data, const Ray &ray, int additional_depth = 0) const override;
 		Rgba skyTau(const Ray &ray) const;
 		Rgba skyTau(const Ray &ray, float beta, float alpha) const;
+		void inScatteredSources(const Vec3 &dir, Rgb &s_0_r, Rgb &s_0_m) const; //!< background light scattered into the direction over the hemisphere, per unit of Rayleigh and Mie density
 
-		float step_size_;
 		float alpha_; // steepness of the exponential density
 		float sigma_t_; // beta in the paper, more or less the thickness coefficient
 		float turbidity_;
@@ -52,6 +54,9 @@ class SkyIntegrator : public VolumeIntegrator
 		float alpha_r_; // rayleigh, molecules
 		float alpha_m_; // mie, haze
 		float scale_;
+		int table_resolution_; //!< rows of the in-scattering tables along the polar angle, 0 to sum the hemisphere radiance in each ray instead
+		std::vector<std::pair<Vec3, Rgb>> hemisphere_radiance_; //!< background radiance of the directions gathered by the in-scattering, evaluated once per render
+		SkyTable rayleigh_source_table_, mie_source_table_; //!< in-scattered sources by view direction, baked once per render for the current background and sun
 };
 
 END_YAFARAY
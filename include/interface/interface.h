@@ -45,6 +45,7 @@ class Format;
 class ProgressBar;
 class Matrix4;
 class Object;
+class RenderJob;
 
 class LIBYAFARAY_EXPORT Interface
 {
@@ -62,8 +63,15 @@ class LIBYAFARAY_EXPORT Interface
 		virtual bool addFace(int a, int b, int c); //!< add a triangle given vertex indices and material pointer
 		virtual bool addFace(int a, int b, int c, int uv_a, int uv_b, int uv_c); //!< add a triangle given vertex and uv indices and material pointer
 		virtual int  addUv(float u, float v); //!< add a UV coordinate pair; returns index to be used for addTriangle
+		virtual int  addVertices(const float *vertices, unsigned int num_vertices, const float *orco = nullptr); //!< add num_vertices vertices (and optionally their Orco) from contiguous x, y, z buffers; returns the index of the first one
+		virtual void addNormals(const float *normals, unsigned int num_normals); //!< add num_normals vertex normals from a contiguous x, y, z buffer
+		virtual bool addFaces(const int *vert_indices, unsigned int num_faces, const int *uv_indices = nullptr); //!< add num_faces triangles from contiguous buffers of 3 vertex (and optionally 3 uv) indices per triangle
+		virtual int  addUvs(const float *uvs, unsigned int num_uvs); //!< add num_uvs UV coordinate pairs from a contiguous u, v buffer; returns the index of the first one
 		virtual bool smoothMesh(const char *name, double angle); //!< smooth vertex normals of mesh with given ID and angle (in degrees)
 		virtual bool addInstance(const char *base_object_name, const Matrix4 &obj_to_world);
+		virtual bool addInstances(const char *base_object_name, const float *obj_to_world, unsigned int num_instances); //!< add num_instances instances of the base object from a contiguous buffer with the 3 first rows of the matrix of each instance (12 floats per instance, row-major)
+		virtual bool updateInstance(const char *base_object_name, unsigned int instance_number, const Matrix4 &obj_to_world); //!< transform-only update of the instance_number-th instance added for the base object, refitting the accelerator instead of rebuilding it when possible
+		virtual bool addObjectLod(const char *base_object_name, const char *lod_object_name, float max_screen_size); //!< the instances of the base object projecting on at most max_screen_size pixels in the camera use the lod object instead
 		// functions to build paramMaps instead of passing them from Blender
 		// (decouling implementation details of STL containers, paraMap_t etc. as much as possible)
 		virtual void paramsSetVector(const char *name, double x, double y, double z);
@@ -85,18 +93,27 @@ class LIBYAFARAY_EXPORT Interface
 		virtual Object *createObject(const char *name);
 		virtual Light *createLight(const char *name);
 		virtual Texture *createTexture(const char *name);
+		/*! add the pixels of an image for the image textures with the "image_buffer" parameter, without encoding them to an image file: 8 bit (float_data false) or float values with num_channels (1 to 4) per pixel,
+		 * rows from the top one and row_stride bytes apart (negative for the bottom-up buffers). With reference_host_memory the pixels are not copied, and must be kept valid and unchanged until the scene is cleared */
+		virtual bool addImageBuffer(const char *name, const void *data, int width, int height, int num_channels, bool float_data, long long row_stride, bool reference_host_memory = false);
 		virtual Material *createMaterial(const char *name);
 		virtual Camera *createCamera(const char *name);
 		virtual Background *createBackground(const char *name);
 		virtual Integrator *createIntegrator(const char *name);
 		virtual VolumeRegion *createVolumeRegion(const char *name);
 		virtual RenderView *createRenderView(const char *name);
+		/*! Replace the camera, material or light with the current parameters for an interactive re-render, which keeps the accelerator and the
+		 * caches that do not depend on the replaced item. The item is created if it does not exist */
+		virtual Camera *updateCamera(const char *name);
+		virtual Material *updateMaterial(const char *name);
+		virtual Light *updateLight(const char *name);
 		virtual ColorOutput *createOutput(const char *name, bool auto_delete = true); //!< ColorOutput creation, usually for internally-owned outputs that are destroyed when the scene is deleted or when libYafaRay instance is closed. If the client wants to keep ownership, it can set the "auto_delete" to false.
 		virtual ColorOutput *createOutput(const char *name, ColorOutput *output, bool auto_delete = false); //!< ColorOutput creation, usually for externally client-owned and client-supplied outputs that are *NOT* destroyed when the scene is deleted or when libYafaRay instance is closed. If the client wants to transfer ownership to libYafaRay, it can set the "auto_delete" to true.
 		bool removeOutput(const char *name);
 		virtual void clearOutputs();
 		virtual void clearAll();
 		virtual void render(ProgressBar *pb = nullptr, bool auto_delete_progress_bar = false); //!< render the scene...
+		RenderJob *renderAsync(ProgressBar *pb = nullptr, bool auto_delete_progress_bar = false); //!< starts the render in its own thread and returns at once. The caller owns the returned job, deleting it waits for the render to end
 		virtual void defineLayer(const std::string &layer_type_name, const std::string &exported_image_type_name, const std::string &exported_image_name, const std::string &image_type_name = "");
 		virtual bool setupLayersParameters();
 		virtual void abort();
@@ -107,6 +124,9 @@ class LIBYAFARAY_EXPORT Interface
 		void setConsoleVerbosityLevel(const std::string &str_v_level);
 		void setLogVerbosityLevel(const std::string &str_v_level);
 		std::string getVersion() const; //!< Get version to check against the exporters
+		std::string getAcceleratorStatsJson() const; //!< accelerator build and traversal counters of the last render, in JSON format
+		std::string getMemoryStatsJson() const; //!< current and peak memory of each subsystem since the start of the last render, in JSON format
+		std::string getRenderProgressStatsJson() const; //!< rays per second, samples, estimated time left, render threads utilization and current memory of the render in progress, in JSON format. Thread safe, can be polled while rendering
 
 		/*! Console Printing wrappers to report in color with yafaray's own console coloring */
 		void printDebug(const std::string &msg) const;
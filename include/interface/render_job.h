@@ -0,0 +1,103 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_RENDER_JOB_H
+#define YAFARAY_RENDER_JOB_H
+
+#include "constants.h"
+#include "render/render_control.h"
+#include <atomic>
+#include <future>
+#include <list>
+#include <memory>
+#include <thread>
+
+BEGIN_YAFARAY
+
+class Interface;
+class ProgressBar;
+
+/*! Bounded queue of the finished render areas, pushed by the render threads and popped by the host without locks
+ * (the bounded multiple producer queue of D. Vyukov, each cell has a sequence number telling if it is free or full) */
+class LIBYAFARAY_EXPORT RenderAreaQueue final
+{
+	public:
+		struct Area { int x_0_, y_0_, x_1_, y_1_; };
+		explicit RenderAreaQueue(size_t capacity); //!< rounded up to a power of two
+		bool push(const Area &area); //!< returns false if the queue is full
+		bool pop(Area &area); //!< returns false if the queue is empty
+
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence_;
+			Area area_;
+		};
+		std::unique_ptr<Cell[]> cells_;
+		size_t mask_;
+		std::atomic<size_t> push_position_ {0};
+		std::atomic<size_t> pop_position_ {0};
+};
+
+/*! Render running in its own thread, started by Interface::renderAsync, so the host keeps its thread responsive and polls the
+ * progress instead of waiting in Interface::render. The scene must not be modified until the render ends.
+ * Deleting the job waits for the render to end */
+class LIBYAFARAY_EXPORT RenderJob final : public RenderListener
+{
+	public:
+		//! the render control receives the progress of the render, if there is one
+		RenderJob(Interface &interface, RenderControl *render_control, ProgressBar *pb, bool auto_delete_progress_bar);
+		virtual ~RenderJob() override;
+		void wait(); //!< blocks until the render ends
+		bool finished() const { return finished_; }
+		void cancel(); //!< aborts the render, it ends after the areas being rendered
+		int completedPasses() const { return completed_passes_; }
+		/*! Future set to true when the pass (starting at 1) is completed, or to false if the render ends or it is cancelled before */
+		std::shared_future<bool> passFuture(int pass);
+		bool waitPass(int pass) { return passFuture(pass).get(); } //!< blocking version of passFuture, for the bindings
+		/*! Gets the next area finished by the render threads without blocking, returns false when there are none left. If the host does
+		 * not poll them fast enough the queue drops the new areas, then areasDropped returns true once and the whole image should be updated */
+		bool pollArea(int &x_0, int &y_0, int &x_1, int &y_1);
+		bool areasDropped() { return areas_dropped_.exchange(false); }
+
+	private:
+		struct PassWaiter
+		{
+			int pass_;
+			std::promise<bool> promise_;
+			std::shared_future<bool> future_;
+		};
+		virtual void areaFinished(int x_0, int y_0, int x_1, int y_1) override;
+		virtual void passesCompleted(int num_passes) override;
+
+		static constexpr size_t area_queue_capacity_ = 4096;
+		Interface &interface_;
+		RenderControl *render_control_;
+		RenderAreaQueue areas_ {area_queue_capacity_};
+		std::atomic<bool> areas_dropped_ {false};
+		std::atomic<bool> finished_ {false};
+		std::atomic<int> completed_passes_ {0};
+		std::mutex waiters_mutex_;
+		std::list<PassWaiter> waiters_; //!< futures of the passes not completed yet
+		std::thread thread_;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_RENDER_JOB_H
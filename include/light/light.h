@@ -24,7 +24,9 @@
 #include "common/flags.h"
 #include "color/color.h"
 #include "common/memory.h"
+#include "geometry/vector.h"
 #include <sstream>
+#include <vector>
 
 BEGIN_YAFARAY
 
@@ -32,11 +34,20 @@ class ParamMap;
 class Scene;
 class SurfacePoint;
 class Background;
+class Bound;
 class Ray;
 class Scene;
 class Vec3;
 class Point3;
 struct LSample;
+struct LightBounds;
+
+//! Bounding sphere of an object the photons are shot towards, such as the objects generating caustics (projection map)
+struct ProjectionTarget
+{
+	Point3 center_;
+	float radius_;
+};
 
 class Light
 {
@@ -53,6 +64,10 @@ class Light
 		virtual ~Light() = default;
 		//! allow for preprocessing when scene loading has finished
 		virtual void init(Scene &scene) {}
+		//! true if init() uses or changes the scene objects (the lights attached to an object), so it is called before building the scene accelerator. The other lights are initialized meanwhile
+		virtual bool initUsesObjects() const { return false; }
+		//! called after init() once the scene accelerator is built, for the lights depending on the scene bound
+		virtual void initSceneBound(const Bound &scene_bound) {}
 		//! total energy emmitted during whole frame
 		virtual Rgb totalEnergy() const = 0;
 		//! emit a photon
@@ -60,6 +75,10 @@ class Light
 		//! create a sample of light emission, similar to emitPhoton, just more suited for bidirectional methods
 		/*! fill in s.dirPdf, s.areaPdf, s.col and s.flags, and s.sp if not nullptr */
 		virtual Rgb emitSample(Vec3 &wo, LSample &s) const {return Rgb(0.f);};
+		//! fraction of the emitted power that can reach the projection targets, 1 for the lights that do not restrict their photons to them
+		virtual float projectionFraction(const std::vector<ProjectionTarget> &targets) const { return 1.f; }
+		//! emit a photon towards the projection targets, same as emitPhoton for the lights that do not restrict their photons to them
+		virtual Rgb emitPhotonTowards(const std::vector<ProjectionTarget> &targets, float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const { return emitPhoton(s_1, s_2, s_3, s_4, ray, ipdf); }
 		//! indicate whether the light has a dirac delta distribution or not
 		virtual bool diracLight() const = 0;
 		//! illuminate a given surface point, generating sample s, fill in s.sp if not nullptr; Set ray to test visibility by integrator
@@ -78,8 +97,12 @@ class Light
 		//! get the pdf values for sampling point sp on the light and outgoing direction wo when emitting energy (emitSample, NOT illumSample)
 		/*! sp should've been generated from illumSample or emitSample, and may only be complete enough to call light functions! */
 		virtual void emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const { area_pdf = 0.f; dir_pdf = 0.f; }
+		//! spatial and directional bounds of the emission, used by the light tree. False for the lights without bounds (sun, directional, background...)
+		virtual bool getBounds(LightBounds &bounds) const { return false; }
 		//! (preferred) number of samples for direct lighting
 		virtual int nSamples() const { return 8; }
+		//! true for the lights emitting the light of the background (the background light and the portals)
+		virtual bool illuminatesFromBackground() const { return false; }
 		//! This method must be called right after the factory is called on a background light or the light will fail
 		virtual void setBackground(std::shared_ptr<Background> bg) { background_ = std::move(bg); }
 		//! Enable/disable entire light source
@@ -94,6 +117,9 @@ class Light
 		//! sets clampIntersect value to reduce noise at the expense of realism and inexact overall lighting
 		void setClampIntersect(float clamp) { clamp_intersect_ = clamp; }
 		Flags getFlags() const { return flags_; }
+		//! light linking group of the light as a bit mask, the light only illuminates the objects with this bit in their light link mask
+		unsigned int getLinkMask() const { return link_mask_; }
+		void setLinkGroup(int link_group) { link_mask_ = 1u << link_group; }
 
 	protected:
 		Flags flags_;
@@ -104,6 +130,7 @@ class Light
 		bool shoot_diffuse_; //!<enable/disable if the light can shoot diffuse photons (photonmap integrator)
 		bool photon_only_; //!<enable/disable if the light is a photon-only light (only shoots photons, not illuminating)
 		float clamp_intersect_ = 0.f;	//!<trick to reduce light sampling noise at the expense of realism and inexact overall light. 0.f disables clamping
+		unsigned int link_mask_ = 1; //!< light linking group bit, group 0 by default
 
 };
 
@@ -37,6 +37,7 @@ class AreaLight final : public Light
 		AreaLight(const Point3 &c, const Vec3 &v_1, const Vec3 &v_2,
 				  const Rgb &col, float inte, int nsam, bool light_enabled = true, bool cast_shadows = true);
 		virtual void init(Scene &scene) override;
+		virtual bool initUsesObjects() const override { return true; }
 		virtual Rgb totalEnergy() const override;
 		virtual Rgb emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const override;
 		virtual Rgb emitSample(Vec3 &wo, LSample &s) const override;
@@ -47,6 +48,7 @@ class AreaLight final : public Light
 		virtual bool intersect(const Ray &ray, float &t, Rgb &col, float &ipdf) const override;
 		virtual float illumPdf(const SurfacePoint &sp, const SurfacePoint &sp_light) const override;
 		virtual void emitPdf(const SurfacePoint &sp, const Vec3 &wi, float &area_pdf, float &dir_pdf, float &cos_wo) const override;
+		virtual bool getBounds(LightBounds &bounds) const override;
 		virtual int nSamples() const override { return samples_; }
 
 		Point3 corner_, c_2_, c_3_, c_4_;
@@ -24,14 +24,22 @@
 
 #include "light/light.h"
 #include "geometry/vector.h"
+#include "sampler/sample_pdf1d.h"
+#include <vector>
 
 BEGIN_YAFARAY
 
 class Background;
-class Pdf1D;
 class Scene;
 class ParamMap;
 
+//! marginal and conditional distributions of the background light directions, shared with the session to reuse them in the next renders
+struct BackgroundDistribution final
+{
+	std::vector<Pdf1D> u_dist_; //!< one for each row of the spherical mapping
+	Pdf1D v_dist_;
+};
+
 class BackgroundLight final : public Light
 {
 	public:
@@ -40,10 +48,12 @@ class BackgroundLight final : public Light
 	private:
 		BackgroundLight(int sampl, bool invert_intersect = false, bool light_enabled = true, bool cast_shadows = true);
 		virtual void init(Scene &scene) override;
+		virtual void initSceneBound(const Bound &scene_bound) override;
 		virtual Rgb totalEnergy() const override;
 		virtual Rgb emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const override;
 		virtual Rgb emitSample(Vec3 &wo, LSample &s) const override;
 		virtual bool diracLight() const override { return false; }
+		virtual bool illuminatesFromBackground() const override { return true; }
 		virtual bool illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const override;
 		virtual bool illuminate(const SurfacePoint &sp, Rgb &col, Ray &wi) const override { return false; }
 		virtual float illumPdf(const SurfacePoint &sp, const SurfacePoint &sp_light) const override;
@@ -55,9 +65,9 @@ class BackgroundLight final : public Light
 		float dirPdf(const Vec3 dir) const;
 		float calcFromSample(float s_1, float s_2, float &u, float &v, bool inv = false) const;
 		float calcFromDir(const Vec3 &dir, float &u, float &v, bool inv = false) const;
+		std::shared_ptr<const BackgroundDistribution> buildDistribution(int num_threads) const;
 
-		std::unique_ptr<std::unique_ptr<Pdf1D>[]> u_dist_;
-		std::unique_ptr<Pdf1D> v_dist_;
+		std::shared_ptr<const BackgroundDistribution> distribution_;
 		int samples_;
 		Point3 world_center_;
 		float world_radius_;
@@ -25,6 +25,7 @@
 #include "light/light.h"
 #include "geometry/vector.h"
 #include <vector>
+#include <array>
 
 BEGIN_YAFARAY
 
@@ -44,10 +45,13 @@ class BackgroundPortalLight final : public Light
 	private:
 		BackgroundPortalLight(const std::string &object_name, int sampl, float pow, bool light_enabled = true, bool cast_shadows = true);
 		virtual void init(Scene &scene) override;
+		virtual bool initUsesObjects() const override { return true; }
+		virtual void initSceneBound(const Bound &scene_bound) override;
 		virtual Rgb totalEnergy() const override;
 		virtual Rgb emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const override;
 		virtual Rgb emitSample(Vec3 &wo, LSample &s) const override;
 		virtual bool diracLight() const override { return false; }
+		virtual bool illuminatesFromBackground() const override { return true; }
 		//virtual bool illumSample(const surfacePoint_t &sp, float s1, float s2, Rgb &col, float &ipdf, ray_t &wi) const override;
 		virtual bool illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const override;
 		virtual bool illuminate(const SurfacePoint &sp, Rgb &col, Ray &wi) const override { return false; }
@@ -58,6 +62,19 @@ class BackgroundPortalLight final : public Light
 		virtual void emitPdf(const SurfacePoint &sp, const Vec3 &wi, float &area_pdf, float &dir_pdf, float &cos_wo) const override;
 		void initIs();
 		void sampleSurface(Point3 &p, Vec3 &n, float s_1, float s_2) const;
+		static constexpr int max_weighted_faces_ = 32;
+		struct FaceWeights
+		{
+			std::array<float, max_weighted_faces_> probability_; //!< of sampling each face from the point
+			std::array<float, max_weighted_faces_> solid_angle_;
+		};
+		/*! Probabilities of sampling each portal face from the point, proportional to its solid angle and to the background luminance through it.
+		 * Returns false if no face is facing the point */
+		bool faceWeights(const Point3 &p, FaceWeights &weights) const;
+		//! sampling pdf of the direction from the point to the face (in the same units as the area sampling pdf), with the face weights of the point
+		float faceDirPdf(const FaceWeights &weights, int face_num, float dist_sqr, float cos_angle) const;
+		bool illumSampleSolidAngle(const SurfacePoint &sp, LSample &s, Ray &wi) const;
+		float dirPdfSolidAngle(const Point3 &p, const Primitive *face, float dist_sqr, float cos_angle) const;
 
 		std::string object_name_;
 		std::unique_ptr<Pdf1D> area_dist_;
@@ -66,6 +83,7 @@ class BackgroundPortalLight final : public Light
 		int num_primitives_; //!< gives the array size of uDist
 		float area_, inv_area_;
 		float power_;
+		bool solid_angle_sampling_ = true; //!< faces sampled by solid angle and background luminance instead of by area, only in portals with up to max_weighted_faces_ faces
 		MeshObject *mesh_object_ = nullptr;
 		std::unique_ptr<Accelerator> accelerator_;
 		Background *bg_ = nullptr;
@@ -37,9 +37,11 @@ class DirectionalLight final : public Light
 
 	private:
 		DirectionalLight(const Point3 &pos, Vec3 dir, const Rgb &col, float inte, bool inf, float rad, bool b_light_enabled = true, bool b_cast_shadows = true);
-		virtual void init(Scene &scene) override;
+		virtual void initSceneBound(const Bound &scene_bound) override;
 		virtual Rgb totalEnergy() const override { return color_ * radius_ * radius_ * M_PI; }
 		virtual Rgb emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const override;
+		virtual float projectionFraction(const std::vector<ProjectionTarget> &targets) const override;
+		virtual Rgb emitPhotonTowards(const std::vector<ProjectionTarget> &targets, float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const override;
 		virtual Rgb emitSample(Vec3 &wo, LSample &s) const override;
 		virtual bool diracLight() const override { return true; }
 		virtual bool illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const override;
@@ -24,6 +24,8 @@
 
 #include "light/light.h"
 #include "geometry/vector.h"
+#include "sampler/sample_pdf1d.h"
+#include <vector>
 
 BEGIN_YAFARAY
 
@@ -48,8 +50,14 @@ class IesLight final : public Light
 		virtual Rgb emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const override;
 		virtual Rgb emitSample(Vec3 &wo, LSample &s) const override;
 		virtual void emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const override;
+		virtual bool getBounds(LightBounds &bounds) const override;
 		bool isIesOk() { return ies_ok_; };
 		void getAngles(float &u, float &v, const Vec3 &dir, const float &costheta) const;
+		/*! Tabulates the IES intensity on a regular grid of angles to the light axis and around it, and builds the 2D distribution sampling it */
+		void buildEmitDistribution();
+		/*! Samples an emission direction following the IES distribution, returning its pdf with respect to the solid angle */
+		Vec3 sampleEmitDir(float s_1, float s_2, float &pdf) const;
+		float emitDirPdf(const Vec3 &dir) const; //!< solid angle pdf of sampleEmitDir
 
 		Point3 position_;
 		Vec3 dir_; //!< orientation of the spot cone
@@ -62,6 +70,10 @@ class IesLight final : public Light
 		float tot_energy_;
 		std::unique_ptr<IesData> ies_data_;
 		bool ies_ok_;
+		float theta_end_; //!< angle of the cone edge to the light axis
+		float cone_solid_angle_;
+		std::vector<Pdf1D> phi_dist_; //!< one for each row of angles to the light axis
+		Pdf1D theta_dist_;
 };
 
 END_YAFARAY
@@ -33,6 +33,7 @@ class MeshObject;
 class Primitive;
 class Accelerator;
 class Pdf1D;
+class LightTree;
 class ParamMap;
 class Scene;
 
@@ -44,6 +45,7 @@ class MeshLight final : public Light
 	private:
 		MeshLight(const std::string &object_name, const Rgb &col, int sampl, bool dbl_s = false, bool light_enabled = true, bool cast_shadows = true);
 		virtual void init(Scene &scene) override;
+		virtual bool initUsesObjects() const override { return true; }
 		virtual Rgb totalEnergy() const override;
 		virtual Rgb emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const override;
 		virtual Rgb emitSample(Vec3 &wo, LSample &s) const override;
@@ -55,14 +57,19 @@ class MeshLight final : public Light
 		virtual bool intersect(const Ray &ray, float &t, Rgb &col, float &ipdf) const override;
 		virtual float illumPdf(const SurfacePoint &sp, const SurfacePoint &sp_light) const override;
 		virtual void emitPdf(const SurfacePoint &sp, const Vec3 &wi, float &area_pdf, float &dir_pdf, float &cos_wo) const override;
+		virtual bool getBounds(LightBounds &bounds) const override;
 		void initIs();
-		void sampleSurface(Point3 &p, Vec3 &n, float s_1, float s_2) const;
+		int sampleSurface(Point3 &p, Vec3 &n, float s_1, float s_2) const; //!< samples the surface by area, returns the number of the sampled primitive
+		int sampleSurface(const Point3 &from, Point3 &p, Vec3 &n, float s_1, float s_2, float &area_pdf) const; //!< samples the surface favouring the triangles facing the point from, returns the number of the sampled primitive or -1
+		float surfacePdf(const Point3 &from, const Primitive *primitive) const; //!< area pdf of the sampleSurface() illuminating the point from
 
 		std::string object_name_;
 		bool double_sided_;
 		Rgb color_;
 		std::unique_ptr<Pdf1D> area_dist_;
+		std::unique_ptr<LightTree> primitives_tree_; //!< bounds of the primitives, to choose the primitives facing the illuminated points
 		std::vector<const Primitive *> primitives_;
+		std::vector<float> primitives_areas_;
 		int samples_;
 		int num_primitives_; //!< gives the array size of uDist
 		float area_, inv_area_;
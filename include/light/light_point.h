@@ -39,11 +39,14 @@ class PointLight final : public Light
 		PointLight(const Point3 &pos, const Rgb &col, float inte, bool b_light_enabled = true, bool b_cast_shadows = true);
 		virtual Rgb totalEnergy() const override { return color_ * 4.0f * M_PI; }
 		virtual Rgb emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const override;
+		virtual float projectionFraction(const std::vector<ProjectionTarget> &targets) const override;
+		virtual Rgb emitPhotonTowards(const std::vector<ProjectionTarget> &targets, float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const override;
 		virtual Rgb emitSample(Vec3 &wo, LSample &s) const override;
 		virtual bool diracLight() const override { return true; }
 		virtual bool illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const override;
 		virtual bool illuminate(const SurfacePoint &sp, Rgb &col, Ray &wi) const override;
 		virtual void emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const override;
+		virtual bool getBounds(LightBounds &bounds) const override;
 
 		Point3 position_;
 		Rgb color_;
@@ -27,8 +27,6 @@
 
 BEGIN_YAFARAY
 
-class Pdf1D;
-
 class SpotLight final : public Light
 {
 	public:
@@ -43,6 +41,7 @@ class SpotLight final : public Light
 		virtual bool illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const override;
 		virtual bool illuminate(const SurfacePoint &sp, Rgb &col, Ray &wi) const override;
 		virtual void emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const override;
+		virtual bool getBounds(LightBounds &bounds) const override;
 		virtual bool canIntersect() const override { return soft_shadows_; }
 		virtual bool intersect(const Ray &ray, float &t, Rgb &col, float &ipdf) const override;
 		virtual int nSamples() const override { return samples_; };
@@ -55,7 +54,6 @@ class SpotLight final : public Light
 		float icos_diff_; //<! 1.0/(cosStart-cosEnd);
 		Rgb color_; //<! color, premulitplied by light intensity
 		float intensity_;
-		std::unique_ptr<Pdf1D> pdf_;
 		float interv_1_, interv_2_;
 
 		bool soft_shadows_;
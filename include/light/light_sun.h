@@ -37,21 +37,26 @@ class SunLight final : public Light
 
 	private:
 		SunLight(Vec3 dir, const Rgb &col, float inte, float angle, int n_samples, bool b_light_enabled = true, bool b_cast_shadows = true);
-		virtual void init(Scene &scene);
+		virtual void initSceneBound(const Bound &scene_bound);
 		virtual Rgb totalEnergy() const { return color_ * e_pdf_; }
 		virtual Rgb emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const;
+		virtual float projectionFraction(const std::vector<ProjectionTarget> &targets) const;
+		virtual Rgb emitPhotonTowards(const std::vector<ProjectionTarget> &targets, float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const;
 		virtual bool diracLight() const { return false; }
 		virtual bool illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const;
 		virtual bool illuminate(const SurfacePoint &sp, Rgb &col, Ray &wi) const { return false; }
 		virtual bool canIntersect() const { return true; }
 		virtual bool intersect(const Ray &ray, float &t, Rgb &col, float &ipdf) const;
 		virtual int nSamples() const { return samples_; }
+		//! disk of the target on the plane through the scene center perpendicular to the sun direction, widened so it is crossed by all the photons of the sun cone hitting the target
+		void targetDisk(const ProjectionTarget &target, Point3 &center, float &radius) const;
 
 		Point3 world_center_;
 		Rgb color_, col_pdf_;
 		Vec3 direction_, du_, dv_;
 		float pdf_, invpdf_;
 		double cos_angle_;
+		float tan_angle_;
 		int samples_;
 		float world_radius_;
 		float e_pdf_;
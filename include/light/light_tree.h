@@ -0,0 +1,89 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_LIGHT_TREE_H
+#define YAFARAY_LIGHT_TREE_H
+
+#include "constants.h"
+#include "geometry/bound.h"
+#include <vector>
+
+BEGIN_YAFARAY
+
+class Light;
+
+/*! Spatial and directional bounds of the emission of a light or a group of lights.
+	The emitting normals are inside the cone of half angle theta_o around the axis, and
+	the light is emitted up to theta_e around each normal (as in Conty Estevez and Kulla 2018) */
+struct LightBounds
+{
+	float importance(const Point3 &p, const Vec3 &n) const; //!< conservative estimation of the contribution to the point p with normal n, 0 only if the lights cannot illuminate it
+	static LightBounds merge(const LightBounds &a, const LightBounds &b);
+	Bound bound_;
+	Vec3 axis_ {0.f, 0.f, 1.f};
+	float cos_theta_o_ = -1.f;
+	float cos_theta_e_ = 0.f;
+	float intensity_ = 0.f; //!< emitted intensity, so intensity_ / distance^2 estimates the irradiance from the lights
+	bool two_sided_ = false;
+};
+
+/*! Binary tree over the lights with bounded emission, to sample the lights proportionally to
+	their estimated contribution at the shading point. The lights without bounds (sun, directional,
+	background...) cannot be estimated this way, and each one is sampled with the same probability
+	as the whole tree. It can also be built directly over the bounds of the parts of a single light,
+	such as the triangles of a mesh light.
+*/
+class LightTree final
+{
+	public:
+		explicit LightTree(const std::vector<const Light *> &lights);
+		explicit LightTree(const std::vector<LightBounds> &emitters_bounds); //!< tree over emitters all with bounds, the bounds with no intensity are never sampled
+		/*! Samples one of the lights for the point p with normal n, returns its index in the lights vector or -1 if no light can illuminate the point. The pmf is the probability of sampling it.
+			If s_remapped is not null, it receives the sample rescaled to [0,1) within the choice of the light, to reuse it for sampling that light */
+		int sample(const Point3 &p, const Vec3 &n, float s, float &pmf, float *s_remapped = nullptr) const;
+		float pmf(const Point3 &p, const Vec3 &n, int index) const; //!< probability of sampling the light with that index for the point p with normal n
+		int numBoundedLights() const { return static_cast<int>(bounded_lights_.size()); }
+
+	private:
+		struct Node
+		{
+			LightBounds bounds_;
+			int index_ = 0; //!< leaf: index in the lights vector. Interior: index of the second child, the first child is always the next node
+			int parent_ = -1;
+			bool is_leaf_ = false;
+		};
+		struct BuildLight
+		{
+			LightBounds bounds_;
+			int light_index_;
+		};
+		void build(std::vector<BuildLight> &build_lights, int num_lights);
+		int buildTree(std::vector<BuildLight> &build_lights, int begin, int end);
+		static float orientationCost(const LightBounds &bounds, const Bound &node_bound, int axis);
+
+		std::vector<Node> nodes_;
+		std::vector<int> bounded_lights_;
+		std::vector<int> infinite_lights_;
+		std::vector<int> leaf_nodes_; //!< node of each light in the lights vector, -1 for the lights not in the tree
+		static constexpr int num_bins_ = 12;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_LIGHT_TREE_H
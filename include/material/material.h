@@ -27,6 +27,9 @@
 #include "common/memory.h"
 #include "geometry/vector.h"
 #include <list>
+#include <array>
+#include <atomic>
+#include <mutex>
 
 BEGIN_YAFARAY
 
@@ -92,6 +95,9 @@ class Material
 		/*! evaluate the BSDF for the given components.
 				@param types the types of BSDFs to be evaluated (e.g. diffuse only, or diffuse and glossy) */
 		virtual Rgb eval(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wl, const BsdfFlags &types, bool force_eval = false) const = 0;
+		/*! evaluate the BSDF for several light directions at the same surface point, like the samples of an area light, with the same results as eval() for each direction.
+				The built-in materials evaluate their textures once for all the directions and the direction dependent terms in lanes. By default each direction is evaluated with eval() */
+		virtual void evalBatch(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 *wl, int num_directions, const BsdfFlags &types, Rgb *cols) const;
 
 		/*! take a sample from the BSDF, given a 2-dimensional sample value and the BSDF types to be sampled from
 			\param s s1, s2 and flags members give necessary information for creating the sample, pdf and sampledFlags need to be returned
@@ -120,7 +126,8 @@ class Material
 			Typical use: recursive raytracing of integrators. */
 		virtual Specular getSpecular(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const { return {}; }
 
-		/*! get the overall reflectivity of the material (used to compute radiance map for example) */
+		/*! get the overall reflectivity of the material (used to compute radiance map for example).
+			Estimated with 16 samples of the BSDF, only once for the materials with a constant reflectivity */
 		virtual Rgb getReflectivity(const RenderData &render_data, const SurfacePoint &sp, BsdfFlags flags) const;
 
 		/*!	allow light emitting materials, for realizing correctly visible area lights.
@@ -187,6 +194,9 @@ class Material
 		/* small function to apply bump mapping to a surface point
 			you need to determine the partial derivatives for NU and NV first, e.g. from a shader node */
 		void applyBump(SurfacePoint &sp, float df_dnu, float df_dnv) const;
+		/*! true if the BSDF is the same in all the surface points (no textures, bump or wireframe), so getReflectivity is estimated once and cached */
+		virtual bool isReflectivityConstant() const { return false; }
+		Rgb estimateReflectivity(const RenderData &render_data, const SurfacePoint &sp, BsdfFlags flags) const;
 
 		BsdfFlags bsdf_flags_ = BsdfFlags::None;
 
@@ -212,6 +222,14 @@ class Material
 
 		bool flat_material_ = false;		//!< Flat Material is a special non-photorealistic material that does not multiply the surface color by the cosine of the angle with the light, as happens in real life. Also, if receive_shadows is disabled, this flat material does no longer self-shadow. For special applications only.
 
+		struct CachedReflectivity
+		{
+			std::atomic<unsigned int> flags_ {BsdfFlags::None}; //!< None while the entry is free, set after reflectivity_
+			Rgb reflectivity_;
+		};
+		mutable std::array<CachedReflectivity, 4> reflectivity_cache_; //!< for the different flags requested, usually only the reflected and the transmitted parts
+		mutable std::mutex reflectivity_cache_mutex_;
+
 		static float highest_sampling_factor_;	//!< Class shared variable containing the highest material sampling factor. This is used to calculate the max. possible samples for the Sampling pass.
 		static unsigned int material_index_auto_;	//!< Material Index automatically generated for the material-index-auto render pass
 		static unsigned int material_index_highest_;	//!< Class shared variable containing the highest material index used for the Normalized Material Index pass.
@@ -29,6 +29,9 @@ BEGIN_YAFARAY
 	components, recursive raytracing will not work properly!
 	Sampling will still work, but possibly be inefficient
 	Outdated info... DarkTide
+	In the stochastic mode only one of the materials is initialized and evaluated at each surface point, picked with
+	the blend value as probability, so the cost of nested blend materials grows linearly with their depth instead of
+	exponentially. The expected result is the same blend, with some more noise
 */
 
 class BlendMaterial final : public NodeMaterial
@@ -52,7 +55,16 @@ class BlendMaterial final : public NodeMaterial
 		virtual float getAlpha(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const override;
 		virtual bool scatterPhoton(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wi, Vec3 &wo, PSample &s) const override;
 		virtual const VolumeHandler *getVolumeHandler(bool inside) const override;
+		virtual bool isReflectivityConstant() const override { return false; } //!< depends on the picked or blended materials
 		float getBlendVal(const RenderData &render_data, const SurfacePoint &sp) const;
+		enum class Branch : unsigned char { Both, Material1, Material2 }; //!< materials initialized at the surface point
+		struct BlendData //!< prepared by initBsdf and stored in the own data of the blend material after the node stack
+		{
+			float blend_val_;
+			Branch branch_;
+		};
+		BlendData &getBlendData(const RenderData &render_data) const;
+		const Material *getPickedMaterial(const RenderData &render_data) const; //!< material picked by initBsdf in the stochastic mode, moving the material data to its data, or nullptr if both materials are blended
 
 		const Material *mat_1_ = nullptr, *mat_2_ = nullptr;
 		ShaderNode *blend_shader_ = nullptr; //!< the shader node used for blending the materials
@@ -60,8 +72,10 @@ class BlendMaterial final : public NodeMaterial
 		float blend_val_;
 		float min_thres_;
 		float max_thres_;
-		size_t mmem_1_;
+		size_t mmem_0_ = 0; //!< size of the own data of the blend material, followed by the data of mat_1_ and then by the data of mat_2_
+		size_t mmem_1_; //!< size of the data of mat_1_, aligned
 		bool recalc_blend_;
+		bool stochastic_ = false;
 		float blended_ior_;
 		mutable BsdfFlags mat_1_flags_, mat_2_flags_;
 };
@@ -26,6 +26,8 @@
 
 BEGIN_YAFARAY
 
+class BlinnAlbedoTable;
+
 /*! Coated Glossy Material.
 	A Material with Phong/Anisotropic Phong microfacet base layer and a layer of
 	(dielectric) perfectly specular coating. This is to simulate surfaces like
@@ -55,6 +57,7 @@ class CoatedGlossyMaterial final : public NodeMaterial
 
 		void initOrenNayar(double sigma);
 		float orenNayar(const Vec3 &wi, const Vec3 &wo, const Vec3 &n, bool use_texture_sigma, double texture_sigma) const;
+		float energyCompensation(const NodeStack &stack, float reflectance, float wo_n, float wi_n) const; //!< multiple scattering lobe added to the glossy lobe, 0 without energy compensation
 
 		ShaderNode *diffuse_shader_ = nullptr;
 		ShaderNode *glossy_shader_ = nullptr;
@@ -74,6 +77,7 @@ class CoatedGlossyMaterial final : public NodeMaterial
 		float reflectivity_;
 		float diffuse_;
 		bool as_diffuse_, with_diffuse_ = false, anisotropic_ = false;
+		const BlinnAlbedoTable *albedo_table_ = nullptr; //!< only set with energy compensation
 		BsdfFlags spec_flags_;
 		BsdfFlags c_flags_[3];
 		int n_bsdf_;
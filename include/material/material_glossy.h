@@ -26,6 +26,8 @@
 
 BEGIN_YAFARAY
 
+class BlinnAlbedoTable;
+
 class GlossyMaterial final : public NodeMaterial
 {
 	public:
@@ -35,6 +37,7 @@ class GlossyMaterial final : public NodeMaterial
 		GlossyMaterial(const Rgb &col, const Rgb &dcol, float reflect, float diff, float expo, bool as_diffuse, Visibility e_visibility = Visibility::NormalVisible);
 		virtual void initBsdf(const RenderData &render_data, SurfacePoint &sp, BsdfFlags &bsdf_types) const override;
 		virtual Rgb eval(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, const BsdfFlags &bsdfs, bool force_eval = false) const override;
+		virtual void evalBatch(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 *wl, int num_directions, const BsdfFlags &bsdfs, Rgb *cols) const override;
 		virtual Rgb sample(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, Vec3 &wi, Sample &s, float &w) const override;
 		virtual float pdf(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, const BsdfFlags &bsdfs) const override;
 
@@ -50,6 +53,7 @@ class GlossyMaterial final : public NodeMaterial
 		virtual Rgb getGlossyColor(const RenderData &render_data) const override;
 
 		float orenNayar(const Vec3 &wi, const Vec3 &wo, const Vec3 &n, bool use_texture_sigma, double texture_sigma) const;
+		float energyCompensation(const NodeStack &stack, float reflectance, float wo_n, float wi_n) const; //!< multiple scattering lobe added to the glossy lobe, 0 without energy compensation
 
 		ShaderNode *diffuse_shader_ = nullptr;
 		ShaderNode *glossy_shader_ = nullptr;
@@ -64,6 +68,7 @@ class GlossyMaterial final : public NodeMaterial
 		float reflectivity_;
 		float diffuse_;
 		bool as_diffuse_, with_diffuse_ = false, anisotropic_ = false;
+		const BlinnAlbedoTable *albedo_table_ = nullptr; //!< only set with energy compensation
 		bool oren_nayar_;
 		float oren_a_, oren_b_;
 };
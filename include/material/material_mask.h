@@ -43,11 +43,13 @@ class MaskMaterial final : public NodeMaterial
 		virtual Specular getSpecular(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const override;
 		virtual Rgb emit(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const override;
 		virtual float getAlpha(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const override;
+		virtual bool isReflectivityConstant() const override { return false; } //!< depends on the material picked by the mask
 
 		const Material *mat_1_ = nullptr;
 		const Material *mat_2_ = nullptr;
 		ShaderNode *mask_ = nullptr;
 		float threshold_;
+		bool shadow_alpha_mask_ = true; //!< the transparent shadows pick the material from the alpha mask of the mask texture, see getTransparency
 };
 
 END_YAFARAY
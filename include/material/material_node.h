@@ -21,6 +21,7 @@
 #define YAFARAY_MATERIAL_NODE_H
 
 #include "material/material.h"
+#include "shader/shader_node.h"
 #include "common/memory.h"
 #include <map>
 #include <vector>
@@ -45,12 +46,19 @@ class NodeMaterial: public Material
 		/* put nodes in evaluation order in "allSorted" given all root nodes;
 		   sets reqNodeMem to the amount of memory the node stack requires for evaluation of all nodes */
 		void solveNodesOrder(const std::vector<ShaderNode *> &roots);
-		void getNodeList(const ShaderNode *root, std::vector<ShaderNode *> &nodes);
+		/*! eval_nodes_list is for the lists evaluated by evalNodes, which leave out the constant nodes and add the nodes whose results are copied to their equivalent nodes in the list.
+			The lists evaluated with ShaderNode::evalDerivative need all the nodes */
+		void getNodeList(const ShaderNode *root, std::vector<ShaderNode *> &nodes, bool eval_nodes_list = true);
 		void evalNodes(const RenderData &render_data, const SurfacePoint &sp, const std::vector<ShaderNode *> &nodes, NodeStack &stack) const;
+		void foldConstantNodes(const std::vector<ShaderNode *> &roots); //!< evaluates the nodes with constant results once, called by solveNodesOrder
 		void evalBump(NodeStack &stack, const RenderData &render_data, SurfacePoint &sp, const ShaderNode *bump_shader_node) const;
+		virtual bool isReflectivityConstant() const override { return color_nodes_.empty() && bump_nodes_.empty() && wireframe_amount_ <= 0.f; } //!< all the nodes are constant or there are none
 
 		std::vector<ShaderNode *> color_nodes_, color_nodes_sorted_, bump_nodes_;
 		std::map<std::string, std::unique_ptr<ShaderNode>> shaders_table_;
+		std::vector<char> constant_nodes_; //!< for each node id, if its results are constant, so evalNodes copies them instead of evaluating the node
+		std::vector<std::pair<unsigned int, NodeResult>> constant_results_; //!< the constant results read by the material or by other nodes, with the ids of their nodes
+		std::vector<const ShaderNode *> equivalent_nodes_; //!< for each node id, the first node in evaluation order equivalent to it, so its results are copied instead of evaluated again, or nullptr
 		size_t req_node_mem_ = 0;
 };
 
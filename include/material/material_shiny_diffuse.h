@@ -46,8 +46,10 @@ class ShinyDiffuseMaterial final : public NodeMaterial
 		ShinyDiffuseMaterial(const Rgb &diffuse_color, const Rgb &mirror_color, float diffuse_strength, float transparency_strength = 0.0, float translucency_strength = 0.0, float mirror_strength = 0.0, float emit_strength = 0.0, float transmit_filter_strength = 1.0, Visibility visibility = Visibility::NormalVisible);
 		virtual void initBsdf(const RenderData &render_data, SurfacePoint &sp, BsdfFlags &bsdf_types) const override;
 		virtual Rgb eval(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wl, const BsdfFlags &bsdfs, bool force_eval = false) const override;
+		virtual void evalBatch(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 *wl, int num_directions, const BsdfFlags &bsdfs, Rgb *cols) const override;
 		virtual Rgb sample(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, Vec3 &wi, Sample &s, float &w) const override;
 		virtual float pdf(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, const BsdfFlags &bsdfs) const override;
+		virtual Rgb getReflectivity(const RenderData &render_data, const SurfacePoint &sp, BsdfFlags flags) const override;
 		virtual bool isTransparent() const override { return is_transparent_; }
 		virtual Rgb getTransparency(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const override;
 		virtual Rgb emit(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const override; // { return emitCol; }
@@ -77,6 +79,7 @@ class ShinyDiffuseMaterial final : public NodeMaterial
 		bool is_mirror_ = false;                       //!< Boolean value which is true if you have specular reflection component
 		bool is_diffuse_ = false;                      //!< Boolean value which is true if you have diffuse component
 
+		bool shadow_alpha_mask_ = false;                //!< the transparent shadows read the transparency from the alpha mask of the transparency texture, see getTransparency
 		bool has_fresnel_effect_ = false;               //!< Boolean value which is true if you have Fresnel specular effect
 		float ior_ = 1.f;                              //!< IOR
 		float ior_squared_ = 1.f;                     //!< Squared IOR
@@ -0,0 +1,53 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_MICROFACET_ALBEDO_H
+#define YAFARAY_MICROFACET_ALBEDO_H
+
+#include "constants.h"
+#include <array>
+
+BEGIN_YAFARAY
+
+/*! Directional albedo of the Blinn glossy lobe of the glossy materials with unit reflectance, tabulated against the
+	cosine of the view direction and the exponent and integrated once, the first time it is needed. The single
+	scattering lobe loses energy at high roughness and grazing angles, which is added back by a multiple scattering
+	lobe computed from the table (Kulla and Conty, "Revisiting Physically Based Shading at Imageworks", 2017) */
+class BlinnAlbedoTable final
+{
+	public:
+		static const BlinnAlbedoTable &get(); //!< thread safe, the table is built by the first call
+		float albedo(float cos_theta, float exponent) const;
+		float averageAlbedo(float exponent) const; //!< cosine weighted average of the albedo over the hemisphere
+		//! value of the multiple scattering lobe with Schlick Fresnel of normal reflectance "reflectance", to be added to the single scattering lobe
+		float multipleScattering(float cos_wo, float cos_wi, float exponent, float reflectance) const;
+
+	private:
+		BlinnAlbedoTable();
+		static float exponentCoordinate(float exponent); //!< in [0, 1], 0 for the maximum exponent and 1 for exponent 0, logarithmic so the rough lobes get more table entries
+		static constexpr int cos_size_ = 32;
+		static constexpr int exponent_size_ = 32;
+		static constexpr float max_exponent_ = 10000.f;
+		std::array<float, cos_size_ * exponent_size_> albedo_;
+		std::array<float, exponent_size_> average_albedo_;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_MICROFACET_ALBEDO_H
@@ -21,6 +21,7 @@
 #define YAFARAY_BUFFER_H
 
 #include "constants.h"
+#include "common/memory.h"
 #include <vector>
 #include <array>
 
@@ -31,7 +32,7 @@ class Buffer //! Generic n-dimensional buffer. Unrolled starting from the highes
 {
 	public:
 		Buffer() = default;
-		Buffer(const std::array<size_t, n> &dimensions) { resize(dimensions); }
+		Buffer(const std::array<size_t, n> &dimensions, HugePages::Mode huge_pages_mode = HugePages::Mode::None) : data_(LargeBufferAllocator<T>(huge_pages_mode)) { resize(dimensions); }
 		void zero() { data_.clear(); resize(dimensions_); }
 		void resize(const std::array<size_t, n> &dimensions);
 		void fill(const T &val) { for(size_t i = 0; i < data_.size(); ++i) data_[i] = val; }
@@ -45,7 +46,7 @@ class Buffer //! Generic n-dimensional buffer. Unrolled starting from the highes
 		size_t calculateDataPosition(const std::array<size_t, n> &coordinates) const;
 
 		std::array<size_t, n> dimensions_;
-		std::vector<T> data_;
+		LargeVector<T> data_; //!< textures and film layers can be big, see HugePages
 };
 
 template<class T, unsigned char n>
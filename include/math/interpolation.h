@@ -79,6 +79,17 @@ inline Y cubicInterpolate(const Y &y_0, const Y &y_1, const Y &y_2, const Y &y_3
 	return (a_0 * x_cubed + a_1 * x_squared + a_2 * x + a_3);
 }
 
+//! derivative with respect to x of cubicInterpolate
+template<class Y, typename X>
+inline Y cubicInterpolateDerivative(const Y &y_0, const Y &y_1, const Y &y_2, const Y &y_3, const X &x)
+{
+	const Y a_0 = y_3 - y_2 - y_0 + y_1;
+	const Y a_1 = y_0 - y_1 - a_0;
+	const Y a_2 = y_2 - y_0;
+
+	return (a_0 * (static_cast<X>(3) * x * x) + a_1 * (static_cast<X>(2) * x) + a_2);
+}
+
 } // namespace math
 
 END_YAFARAY
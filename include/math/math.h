@@ -37,6 +37,7 @@
 
 #include <cmath>
 #include <algorithm>
+#include <limits>
 
 BEGIN_YAFARAY
 
@@ -110,35 +111,6 @@ inline float log2(float x)
 	return (polylog_global(m.f_) * (m.f_ - one.f_) + e.f_);
 }
 
-#ifdef FAST_MATH
-inline float sqrt_asm(float n)
-{
-#if defined (__APPLE__)
-	float r = n;
-	asm(
-		"flds %0;"
-		"fsqrt;"
-		"fstps %0"
-		:"=m"(r)
-		:"m"(r)
-	);
-	return r;
-#elif defined(__GNUC__) && defined(__i386__)
-	float r = n;
-	asm(
-		"fld %0;"
-		"fsqrt;"
-		"fstp %0"
-		:"=m"(r)
-		:"m"(r)
-	);
-	return r;
-#else
-	return std::sqrt(n);
-#endif
-}
-#endif // FAST_MATH
-
 inline float pow(float a, float b)
 {
 #ifdef FAST_MATH
@@ -166,13 +138,27 @@ inline float exp(float a)
 #endif
 }
 
+/*! Batched pow, exp and log of n values, with the same results as the single value functions. Their loops
+ * have no branches, so the compilers vectorize them in 4 or 8 lanes when optimizing. The results can be
+ * stored in place of the parameters */
+inline void pow(const float *a, float b, float *result, int n)
+{
+	for(int i = 0; i < n; ++i) result[i] = math::pow(a[i], b);
+}
+
+inline void exp(const float *a, float *result, int n)
+{
+	for(int i = 0; i < n; ++i) result[i] = math::exp(a[i]);
+}
+
+inline void log(const float *a, float *result, int n)
+{
+	for(int i = 0; i < n; ++i) result[i] = math::log(a[i]);
+}
+
 inline float sqrt(float a)
 {
-#ifdef FAST_MATH
-	return math::sqrt_asm(a);
-#else
-	return std::sqrt(a);
-#endif
+	return std::sqrt(a); //compiled to the SSE square root instruction, faster than the x87 fsqrt even with FAST_MATH
 }
 
 inline float ldexp(float x, int a)
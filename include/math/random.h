@@ -24,24 +24,28 @@
 
 #include "constants.h"
 #include "math/math.h"
+#include <cstdint>
 
 BEGIN_YAFARAY
 
-class FastRandom final
+/*! Counter based generator: each number is a hash of its key, counter and dimension (for example the pixel, the sample
+ * and the dimension of the sample), so it does not keep any state. The numbers are reproducible regardless of the
+ * order in which the threads draw them and there is no shared seed to contend for. The hash is the PCG output
+ * permutation applied to each of the three inputs, as in Jarzynski and Olano, "Hash Functions for GPU Rendering" (2020) */
+class CounterRandom final
 {
 	public:
-		static int getNextInt();
-		static int getNextInt(int &seed);
-		static float getNextFloatNormalized();
-		static float getNextFloatNormalized(int &seed);
+		static uint32_t getInt(uint32_t key, uint32_t counter, uint32_t dimension) { return pcgHash(dimension + pcgHash(counter + pcgHash(key))); }
+		//! float in [0, 1), with the 24 upper bits of the hash
+		static float getFloat(uint32_t key, uint32_t counter, uint32_t dimension) { return static_cast<float>(getInt(key, counter, dimension) >> 8) * 5.9604644775390625e-8f; }
 
 	private:
-		static int myseed_; //FIXME: Should this be std::atomic<int> for thread safety? Performance??
-		static constexpr int a_ = 0x000041A7;
-		static constexpr int m_ = 0x7FFFFFFF;
-		static constexpr int q_ = 0x0001F31D; // m/a
-		static constexpr int r_ = 0x00000B14; // m%a;
-
+		static uint32_t pcgHash(uint32_t value)
+		{
+			const uint32_t state = value * 747796405u + 2891336453u;
+			const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+			return (word >> 22u) ^ word;
+		}
 };
 
 /* multiply-with-carry generator x(n) = a*x(n-1) + carry mod 2^32.
@@ -68,32 +72,6 @@ class Random final
 };
 
 
-inline int FastRandom::getNextInt()
-{
-	myseed_ = a_ * (myseed_ % q_) - r_ * (myseed_ / q_);
-	if(myseed_ < 0)
-		myseed_ += m_;
-	return myseed_;
-}
-
-inline float FastRandom::getNextFloatNormalized()
-{
-	return static_cast<float>(getNextInt()) / static_cast<float>(m_);
-}
-
-inline int FastRandom::getNextInt(int &seed)
-{
-	seed = a_ * (seed % q_) - r_ * (seed / q_);
-	if(myseed_ < 0)
-		myseed_ += m_;
-	return seed;
-}
-
-inline float FastRandom::getNextFloatNormalized(int &seed)
-{
-	return static_cast<float>(getNextInt(seed)) / static_cast<float>(m_);
-}
-
 inline double Random::operator()()
 {
 	const unsigned int xh = x_ >> 16, xl = x_ & 65535;
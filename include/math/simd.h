@@ -0,0 +1,115 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_SIMD_H
+#define YAFARAY_SIMD_H
+
+#include "constants.h"
+
+#ifdef SIMD_TYPES
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define YAFARAY_SIMD_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define YAFARAY_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+#define YAFARAY_SIMD_ALIGN alignas(16)
+#else
+#define YAFARAY_SIMD_ALIGN
+#endif //SIMD_TYPES
+
+BEGIN_YAFARAY
+
+/*! Four floats operated at the same time with SSE or NEON, used by the SIMD_TYPES build option to implement the
+ * vector and color operators on their 4 lanes layout. Without SSE nor NEON the lanes are operated one by one.
+ * The loads and stores are unaligned, as the C++11 containers do not guarantee the 16 bytes alignment in all
+ * the platforms, but they are as fast as the aligned ones when the data is aligned.
+ * All the operations are the IEEE ones, so the results are exactly the same as with the scalar operators */
+class Float4 final
+{
+	public:
+		Float4() = default;
+		static Float4 load(const float *values);
+		static Float4 broadcast(float value);
+		void store(float *values) const;
+		Float4 operator + (const Float4 &f) const;
+		Float4 operator - (const Float4 &f) const;
+		Float4 operator * (const Float4 &f) const;
+		Float4 operator / (const Float4 &f) const;
+
+	private:
+#if defined(YAFARAY_SIMD_SSE)
+		explicit Float4(__m128 v) : v_(v) { }
+		__m128 v_;
+#elif defined(YAFARAY_SIMD_NEON)
+		explicit Float4(float32x4_t v) : v_(v) { }
+		float32x4_t v_;
+#else
+		float v_[4];
+#endif
+};
+
+#if defined(YAFARAY_SIMD_SSE)
+
+inline Float4 Float4::load(const float *values) { return Float4(_mm_loadu_ps(values)); }
+inline Float4 Float4::broadcast(float value) { return Float4(_mm_set1_ps(value)); }
+inline void Float4::store(float *values) const { _mm_storeu_ps(values, v_); }
+inline Float4 Float4::operator + (const Float4 &f) const { return Float4(_mm_add_ps(v_, f.v_)); }
+inline Float4 Float4::operator - (const Float4 &f) const { return Float4(_mm_sub_ps(v_, f.v_)); }
+inline Float4 Float4::operator * (const Float4 &f) const { return Float4(_mm_mul_ps(v_, f.v_)); }
+inline Float4 Float4::operator / (const Float4 &f) const { return Float4(_mm_div_ps(v_, f.v_)); }
+
+#elif defined(YAFARAY_SIMD_NEON)
+
+inline Float4 Float4::load(const float *values) { return Float4(vld1q_f32(values)); }
+inline Float4 Float4::broadcast(float value) { return Float4(vdupq_n_f32(value)); }
+inline void Float4::store(float *values) const { vst1q_f32(values, v_); }
+inline Float4 Float4::operator + (const Float4 &f) const { return Float4(vaddq_f32(v_, f.v_)); }
+inline Float4 Float4::operator - (const Float4 &f) const { return Float4(vsubq_f32(v_, f.v_)); }
+inline Float4 Float4::operator * (const Float4 &f) const { return Float4(vmulq_f32(v_, f.v_)); }
+#if defined(__aarch64__)
+inline Float4 Float4::operator / (const Float4 &f) const { return Float4(vdivq_f32(v_, f.v_)); }
+#else
+inline Float4 Float4::operator / (const Float4 &f) const
+{
+	//The 32 bits NEON only has a reciprocal estimate, not exact enough, so the lanes are divided one by one
+	float a[4], b[4];
+	store(a);
+	f.store(b);
+	for(int i = 0; i < 4; ++i) a[i] /= b[i];
+	return load(a);
+}
+#endif
+
+#else
+
+inline Float4 Float4::load(const float *values) { Float4 f; for(int i = 0; i < 4; ++i) f.v_[i] = values[i]; return f; }
+inline Float4 Float4::broadcast(float value) { Float4 f; for(int i = 0; i < 4; ++i) f.v_[i] = value; return f; }
+inline void Float4::store(float *values) const { for(int i = 0; i < 4; ++i) values[i] = v_[i]; }
+inline Float4 Float4::operator + (const Float4 &f) const { Float4 r; for(int i = 0; i < 4; ++i) r.v_[i] = v_[i] + f.v_[i]; return r; }
+inline Float4 Float4::operator - (const Float4 &f) const { Float4 r; for(int i = 0; i < 4; ++i) r.v_[i] = v_[i] - f.v_[i]; return r; }
+inline Float4 Float4::operator * (const Float4 &f) const { Float4 r; for(int i = 0; i < 4; ++i) r.v_[i] = v_[i] * f.v_[i]; return r; }
+inline Float4 Float4::operator / (const Float4 &f) const { Float4 r; for(int i = 0; i < 4; ++i) r.v_[i] = v_[i] / f.v_[i]; return r; }
+
+#endif
+
+END_YAFARAY
+
+#endif //YAFARAY_SIMD_H
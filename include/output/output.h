@@ -39,6 +39,7 @@ class Image;
 class Scene;
 class Layers;
 struct ColorLayer;
+struct ColorLayerTile;
 class ColorLayers;
 class ParamMap;
 class RenderView;
@@ -53,13 +54,16 @@ class LIBYAFARAY_EXPORT ColorOutput
 		void setLoggingParams(const ParamMap &params);
 		void setBadgeParams(const ParamMap &params);
 		virtual bool putPixel(int x, int y, const ColorLayer &color_layer) = 0;
+		virtual bool putTile(int x_0, int y_0, int width, int height, const ColorLayerTile &color_layer_tile); //!< by default calls putPixel for each pixel, outputs can override it to copy the whole area at once
 		virtual void flush(const RenderControl &render_control) = 0;
 		virtual void flushArea(int x_0, int y_0, int x_1, int y_1) { }
 		virtual void highlightArea(int x_0, int y_0, int x_1, int y_1) { }
+		virtual void setFinalAreas(bool final_areas) { } //!< tells if the tiles being put are final, their pixels will not be rendered again
 		virtual bool isImageOutput() const { return false; }
 		virtual bool isPreview() const { return false; }
 		virtual void init(int width, int height, const Layers *layers, const std::map<std::string, std::unique_ptr<RenderView>> *render_views);
 		bool putPixel(int x, int y, const ColorLayers &color_layers);
+		bool putTile(int x_0, int y_0, int width, int height, const std::vector<ColorLayerTile> &color_layers_tiles);
 		void setRenderView(const RenderView *render_view) { current_render_view_ = render_view; }
 		bool isAutoDeleted() const { return auto_delete_; }
 		int getWidth() const { return width_; }
@@ -90,6 +94,7 @@ class LIBYAFARAY_EXPORT ColorOutput
 		const RenderView *current_render_view_ = nullptr;
 		const std::map<std::string, std::unique_ptr<RenderView>> *render_views_ = nullptr;
 		const Layers *layers_ = nullptr;
+		std::vector<Rgba> preprocessed_tile_colors_; //!< color space converted colors of the tile being output
 };
 
 END_YAFARAY
@@ -0,0 +1,75 @@
+#pragma once
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef YAFARAY_OUTPUT_EXR_STREAM_H
+#define YAFARAY_OUTPUT_EXR_STREAM_H
+
+#include "output/output.h"
+#include "common/layers.h"
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+class ExrTiledWriter;
+
+/*! Output writing the exported layers to a tiled multi-layer EXR file while rendering.
+ * The colors of the areas are kept only for the EXR tiles not complete yet: each tile is written as soon as all its pixels have been put in final areas
+ * (the areas of the last pass of the render), and then freed. The tiles not complete when the render finishes are written on flush.
+ * In single pass renders the image is never held complete by the output, with multiple passes the tiles are written in the last one */
+class ExrStreamOutput final : public ColorOutput
+{
+	public:
+		static UniquePtr_t<ColorOutput> factory(const ParamMap &params, const Scene &scene);
+		ExrStreamOutput(const std::string &image_path, int tile_size, const std::string &name = "out", const ColorSpace color_space = ColorSpace::LinearRgb, float gamma = 1.f, bool with_alpha = true, bool alpha_premultiply = false);
+		virtual ~ExrStreamOutput() override;
+
+	private:
+		struct PendingTile
+		{
+			std::vector<Rgba> colors_; //!< tile_size x tile_size colors of each layer, by rows
+			std::vector<bool> final_pixels_; //!< pixels of each layer put in final areas
+			size_t num_final_pixels_ = 0;
+		};
+		virtual bool putPixel(int x, int y, const ColorLayer &color_layer) override;
+		virtual bool putTile(int x_0, int y_0, int width, int height, const ColorLayerTile &color_layer_tile) override;
+		virtual void flush(const RenderControl &render_control) override;
+		virtual void setFinalAreas(bool final_areas) override { final_areas_ = final_areas; }
+		virtual void init(int width, int height, const Layers *layers, const std::map<std::string, std::unique_ptr<RenderView>> *render_views) override;
+		bool openFile();
+		void closeFile();
+		PendingTile &getPendingTile(int tile_index);
+		bool writeTile(int tile_index, const PendingTile *pending_tile);
+		int getTileWidth(int tile_x) const { return std::min(tile_size_, width_ - tile_x * tile_size_); }
+		int getTileHeight(int tile_y) const { return std::min(tile_size_, height_ - tile_y * tile_size_); }
+
+		std::string image_path_;
+		int tile_size_ = 64;
+		std::vector<Layer::Type> layer_types_; //!< exported layers, in the order of their colors in the pending tiles
+		std::unique_ptr<ExrTiledWriter> writer_;
+		const RenderView *file_render_view_ = nullptr; //!< render view of the file being written
+		std::map<int, PendingTile> pending_tiles_;
+		std::vector<bool> written_tiles_;
+		bool final_areas_ = false;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_OUTPUT_EXR_STREAM_H
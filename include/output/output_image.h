@@ -41,13 +41,14 @@ class ImageOutput final : public ColorOutput
 
 	private:
 		virtual bool putPixel(int x, int y, const ColorLayer &color_layer) override;
+		virtual bool putTile(int x_0, int y_0, int width, int height, const ColorLayerTile &color_layer_tile) override;
 		virtual void flush(const RenderControl &render_control) override;
 		virtual void flushArea(int x_0, int y_0, int x_1, int y_1) override {} // not used by images... yet
 		virtual bool isImageOutput() const override { return true; }
 		virtual std::string printDenoiseParams() const override;
 		virtual void init(int width, int height, const Layers *layers, const std::map<std::string, std::unique_ptr<RenderView>> *render_views) override;
-		void saveImageFile(const std::string &filename, const Layer::Type &layer_type, Format *format, const RenderControl &render_control);
-		void saveImageFileMultiChannel(const std::string &filename, Format *format, const RenderControl &render_control);
+		void saveImageFile(const std::string &filename, const Layer::Type &layer_type, Format *format, const RenderControl &render_control, const Image *badge_image);
+		void saveImageFileMultiChannel(const std::string &filename, Format *format, const RenderControl &render_control, const Image *badge_image);
 		void clearImageLayers();
 		bool denoiseEnabled() const { return denoise_params_.enabled_; }
 		DenoiseParams getDenoiseParams() const { return denoise_params_; }
@@ -34,6 +34,7 @@ class MemoryInputOutput final : public ColorOutput
 
 	private:
 		virtual bool putPixel(int x, int y, const ColorLayer &color_layer) override;
+		virtual bool putTile(int x_0, int y_0, int width, int height, const ColorLayerTile &color_layer_tile) override;
 		void flush(const RenderControl &render_control) override;
 
 		float *image_mem_;
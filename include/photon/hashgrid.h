@@ -22,7 +22,7 @@
 
 #include "constants.h"
 #include "geometry/bound.h"
-#include <list>
+#include "common/memory_stats.h"
 #include <vector>
 
 BEGIN_YAFARAY
@@ -33,14 +33,16 @@ class Bound;
 class Point3;
 
 
+/*! Compact hash grid: the photons are sorted by hash cell with a parallel counting sort, so the photons of each cell are
+	contiguous in the photons vector and the cells only store the offset of their first photon */
 class HashGrid final
 {
 	public:
-		HashGrid() { hash_grid_ = nullptr;}
+		HashGrid() = default;
 		HashGrid(double cell_size, unsigned int grid_size, Bound b_box);
 		void setParm(double cell_size, unsigned int grid_size, Bound b_box);
 		void clear(); //remove all the photons in the grid;
-		void updateGrid(); //build the hashgrid
+		void updateGrid(int num_threads = 1); //build the hashgrid
 		void pushPhoton(Photon &p);
 		unsigned int gather(const Point3 &p, FoundPhoton *found, unsigned int k, float sq_radius);
 
@@ -49,15 +51,18 @@ class HashGrid final
 		{
 			return static_cast<unsigned int>((ix * 73856093) ^ (iy * 19349663) ^ (iz * 83492791)) % grid_size_;
 		}
+		unsigned int cellIndex(const Point3 &p);
 
 	public:
 		double cell_size_, inv_cell_size_;
 		unsigned int grid_size_;
 		Bound bounding_box_;
-		std::vector<Photon>photons_;
-		std::unique_ptr<std::unique_ptr<std::list<const Photon *>>[]> hash_grid_;
-};
+		std::vector<Photon>photons_; //!< sorted by hash cell by updateGrid()
+		std::vector<unsigned int> cell_starts_; //!< index in photons_ of the first photon of each cell, with the number of photons at the end
 
+	private:
+		MemoryTracker memory_tracker_ {MemoryStats::Photons};
+};
 
 END_YAFARAY
 #endif
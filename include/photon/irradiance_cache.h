@@ -0,0 +1,83 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_IRRADIANCE_CACHE_H
+#define YAFARAY_IRRADIANCE_CACHE_H
+
+#include "constants.h"
+#include "geometry/bound.h"
+#include "color/color.h"
+#include <array>
+#include <atomic>
+
+BEGIN_YAFARAY
+
+/*! Irradiance cache (Ward et al. 1988) with irradiance gradients (Ward and Heckbert 1992). The records are stored in an
+	octree whose nodes and record lists are only ever appended to with atomic operations, so all the render threads can
+	look it up and add records at the same time without locking */
+class IrradianceCache final
+{
+	public:
+		struct Record
+		{
+			Point3 p_;
+			Vec3 n_;
+			Rgb irradiance_;
+			float radius_; //!< harmonic mean distance to the surfaces seen from the record
+			std::array<Rgb, 3> rotational_gradient_; //!< per axis
+			std::array<Rgb, 3> translational_gradient_; //!< per axis
+		};
+		IrradianceCache(const Bound &bound, float accuracy);
+		~IrradianceCache();
+		/*! Interpolates the irradiance from the records whose estimated error at the point is below the accuracy, returns false if there are none */
+		bool interpolate(const Point3 &p, const Vec3 &n, Rgb &irradiance) const;
+		void add(const Record &record);
+		int getNumRecords() const { return num_records_.load(std::memory_order_relaxed); }
+
+	private:
+		struct Entry
+		{
+			const Record *record_;
+			Entry *next_;
+		};
+		struct Node
+		{
+			Node() { for(auto &child : children_) child.store(nullptr, std::memory_order_relaxed); }
+			~Node();
+			std::array<std::atomic<Node *>, 8> children_;
+			std::atomic<Entry *> entries_ {nullptr};
+		};
+		struct OwnedRecord
+		{
+			Record record_;
+			OwnedRecord *next_;
+		};
+		void add(Node *node, const Bound &node_bound, const Record *record, const Bound &record_bound, float record_diagonal_2, int depth);
+		static Bound childBound(const Bound &bound, int child);
+
+		Node root_;
+		Bound bound_;
+		float accuracy_;
+		std::atomic<OwnedRecord *> records_ {nullptr}; //!< all the records, to delete them
+		std::atomic<int> num_records_ {0};
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_IRRADIANCE_CACHE_H
@@ -24,6 +24,11 @@
 
 #include "pkdtree.h"
 #include "color/color.h"
+#include "render/monitor.h"
+#include "common/file.h"
+#include "common/memory_stats.h"
+#include <atomic>
+#include <cstdint>
 
 BEGIN_YAFARAY
 
@@ -117,41 +122,97 @@ class PhotonMap final
 		void setNumPaths(int n) { paths_ = n; }
 		void setName(const std::string &mapname) { name_ = mapname; }
 		void setNumThreadsPkDtree(int threads) { threads_pkd_tree_ = threads; }
+		void setHugePagesMode(HugePages::Mode huge_pages_mode) { huge_pages_mode_ = huge_pages_mode; }
 		int nPaths() const { return paths_; }
 		int nPhotons() const { return photons_.size(); }
-		void pushPhoton(Photon &p) { photons_.push_back(p); updated_ = false; }
-		void swapVector(std::vector<Photon> &vec) { photons_.swap(vec); updated_ = false; }
-		void appendVector(std::vector<Photon> &vec, unsigned int curr) { photons_.insert(std::end(photons_), std::begin(vec), std::end(vec)); updated_ = false; paths_ += curr;}
+		void pushPhoton(Photon &p) { photons_.push_back(p); photon_paths_.clear(); updated_ = false; }
+		void swapVector(std::vector<Photon> &vec) { photons_.swap(vec); photon_paths_.clear(); updated_ = false; }
+		void appendVector(std::vector<Photon> &vec, unsigned int curr) { photons_.insert(std::end(photons_), std::begin(vec), std::end(vec)); photon_paths_.clear(); updated_ = false; paths_ += curr;}
+		/*! Appends the photons stored by each thread in its own chunk: the chunk offsets are computed with a prefix sum of their sizes and the chunks are copied in parallel, so no locking is needed.
+			The optional path chunks hold the index of the path that stored each photon */
+		void appendChunks(const std::vector<std::vector<Photon>> &chunks, unsigned int paths, const std::vector<std::vector<unsigned int>> *path_chunks = nullptr);
 		void reserveMemory(size_t num_photons) { photons_.reserve(num_photons); }
 		void updateTree();
-		void clear() { photons_.clear(); tree_ = nullptr; updated_ = false; }
+		void clear();
+		bool hasPathTags() const { return photon_paths_.size() == photons_.size(); } //!< whether the path of every photon is known, to update the map incrementally
+		std::vector<uint64_t> &getPathObjects() { return path_objects_; } //!< mask of the objects hit by each path, see PhotonMapsState::objectBit()
+		/*! Removes the photons stored by the paths flagged as removed, indexed by path */
+		void removePaths(const std::vector<bool> &removed);
 		bool ready() const { return updated_; }
 		//	void gather(const point3d_t &P, std::vector< foundPhoton_t > &found, unsigned int K, float &sqRadius) const;
+		/*! The k nearest photons within the square radius, which is reduced to the farthest of them when k are found.
+			A first estimate of the radius from the photon counts of the tree nodes bounds the search, falling back to the full radius if it holds less than k photons */
 		int gather(const Point3 &p, FoundPhoton *found, unsigned int k, float &sq_radius) const;
 		const Photon *findNearest(const Point3 &p, const Vec3 &n, float dist) const;
+		/*! Loads both file versions. The version 2 files are memory mapped and their kd-tree is used from the mapping without building it again */
 		bool load(const std::string &filename);
-		bool save(const std::string &filename) const;
+		bool save(const std::string &filename) const; //!< saves in the version 2 format, with the kd-tree and quantized photons
+
 		std::mutex mutx_;
 
 	protected:
+		bool loadMapped(std::unique_ptr<MappedFile> mapped_file, const std::string &filename);
+		int boundedGather(const Point3 &p, FoundPhoton *found, unsigned int k, float &sq_radius) const;
+		void updateMemoryTracker();
 		std::vector<Photon> photons_;
+		std::vector<unsigned int> photon_paths_; //!< index of the path that stored each photon, empty when unknown
+		std::vector<uint64_t> path_objects_;
 		int paths_ = 0; //!< amount of photon paths that have been traced for generating the map
 		bool updated_ = false;
 		float search_radius_ = 1.f;
 		std::unique_ptr<kdtree::PointKdTree<Photon>> tree_;
+		std::unique_ptr<MappedFile> mapped_file_; //!< file the tree nodes and leaf positions are used from, if loaded from a version 2 file
 		std::string name_;
 		int threads_pkd_tree_ = 1;
+		HugePages::Mode huge_pages_mode_ = HugePages::Mode::None; //!< of the scene, for the kd-tree
+		MemoryTracker memory_tracker_ {MemoryStats::Photons};
+};
+
+/*! Progress of the photon shooting threads: the steps are counted atomically and the thread that
+	can take the progress bar lock without waiting flushes them to the bar, so no thread blocks */
+class PhotonShootingProgress final
+{
+	public:
+		PhotonShootingProgress(ProgressBar *pb) : pb_(pb) { }
+		void addStep()
+		{
+			pending_steps_.fetch_add(1, std::memory_order_relaxed);
+			if(pb_->mutx_.try_lock())
+			{
+				flushSteps();
+				pb_->mutx_.unlock();
+			}
+		}
+		void flush() //!< to be called when the threads have finished, for the steps not flushed yet
+		{
+			std::lock_guard<std::mutex> lock_guard(pb_->mutx_);
+			flushSteps();
+		}
+
+	private:
+		void flushSteps()
+		{
+			const int steps = pending_steps_.exchange(0, std::memory_order_relaxed);
+			if(steps > 0) pb_->update(steps);
+		}
+		ProgressBar *pb_;
+		std::atomic<int> pending_steps_ {0};
 };
 
 // photon "processes" for lookup
 
+/*! Collects the photons unordered in a buffer larger than the lookup. Only when the buffer is full the n_lookup_ nearest
+	photons are selected and the search radius shrinks to the farthest of them, so no heap is maintained for every photon */
 struct PhotonGather
 {
-	PhotonGather(uint32_t mp, const Point3 &p);
+	PhotonGather(uint32_t mp, const Point3 &p, FoundPhoton *photons, uint32_t capacity);
 	void operator()(const Photon *photon, float dist_2, float &max_dist_squared) const;
+	//! Selects the n_lookup_ nearest photons at the end of the lookup, reducing the radius if there are enough of them
+	void finish(float &max_dist_squared) const;
 	const Point3 &p_;
 	FoundPhoton *photons_;
 	uint32_t n_lookup_;
+	uint32_t capacity_; //!< size of photons_, larger than n_lookup_
 	mutable uint32_t found_photons_;
 };
 
@@ -178,7 +239,7 @@ struct EliminatePhoton
 	const Vec3 n_;
 };
 
-#ifdef SMALL_PHOTONS
+/*! Direction quantized in 8 bit spherical angles, theta 255 for the null direction */
 class DirConverter
 {
 	public:
@@ -204,7 +265,6 @@ class DirConverter
 };
 
 extern DirConverter dirconverter_global;
-#endif // SMALL_PHOTONS
 
 END_YAFARAY
 
@@ -0,0 +1,94 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_PHOTON_GUIDE_H
+#define YAFARAY_PHOTON_GUIDE_H
+
+#include "constants.h"
+#include "sampler/sample_pdf1d.h"
+#include <vector>
+#include <array>
+#include <atomic>
+#include <memory>
+
+BEGIN_YAFARAY
+
+class Point3;
+
+/*! Visibility driven sampling of the photons emitted in the progressive photon passes.
+	The gather points of each eye pass mark the cells of a coarse hash grid, and the photons depositing into a marked cell are the useful ones.
+	The useful photons of each light are accumulated in histograms of its two pairs of emission samples, and the next photon pass selects the
+	lights by their useful power and warps their emission samples with these histograms. The histograms are mixed with the uniform sampling,
+	so every photon path can still be sampled, and the photon colors are divided by the pdfs, so the photon density is only moved to where it is seen */
+class PhotonGuide final
+{
+	public:
+		struct Sample
+		{
+			float inv_pdf_ = 1.f; //!< inverse pdf of the warped emission samples
+			std::array<int, 2> cells_ {{0, 0}}; //!< histogram cells of the two pairs of emission samples
+		};
+		void init(int num_lights, int num_threads, float cell_size, unsigned int hash_size);
+		void markVisible(const Point3 &p, float radius); //!< marks the cells overlapping the gather sphere, can be called by several threads at once
+		bool isVisible(const Point3 &p) const;
+		bool ready() const { return ready_; } //!< there are useful photons from a previous pass to guide the emission
+		float getLightFactor(int light) const { return ready_ ? light_factors_[light] : 1.f; } //!< factor of the power of the light when selecting the lights
+		/*! warps the uniform emission samples of the light, they are unchanged until there are useful photons */
+		Sample sampleEmission(int light, float &s_1, float &s_2, float &s_3, float &s_4) const;
+		void addPhoton(int thread_id, int light, const Sample &sample, bool useful);
+		/*! accumulates the photons of the pass into the histograms used by the next pass */
+		void update();
+
+	private:
+		static constexpr int resolution_ = 8; //!< histogram cells along each emission sample
+		static constexpr int num_cells_ = resolution_ * resolution_;
+		struct Histogram
+		{
+			std::array<float, num_cells_> useful_ {}; //!< useful photons of each cell, weighted with the inverse pdf of their samples
+			void clear() { useful_.fill(0.f); }
+		};
+		struct Statistics
+		{
+			std::vector<std::array<Histogram, 2>> histograms_; //!< per light
+			std::vector<double> emitted_; //!< photons emitted by each light
+		};
+		//! 2D distribution of a pair of emission samples, as the marginal pdf of the first sample and the conditional pdfs of the second
+		struct Distribution
+		{
+			void build(const Histogram &histogram);
+			float sample(float &s_a, float &s_b, int &cell) const;
+			std::unique_ptr<Pdf1D> marginal_;
+			std::array<std::unique_ptr<Pdf1D>, resolution_> conditional_;
+		};
+		unsigned int hash(int ix, int iy, int iz) const { return ((static_cast<unsigned int>(ix) * 73856093u) ^ (static_cast<unsigned int>(iy) * 19349663u) ^ (static_cast<unsigned int>(iz) * 83492791u)) % hash_size_; }
+
+		int num_lights_ = 0;
+		bool ready_ = false;
+		float inv_cell_size_ = 1.f;
+		unsigned int hash_size_ = 1;
+		std::unique_ptr<std::atomic<unsigned char>[]> visible_cells_;
+		std::vector<Statistics> thread_statistics_; //!< of the photons of the current pass, per photon thread so they are not locked
+		Statistics accumulated_; //!< of all the passes
+		std::vector<std::array<Distribution, 2>> distributions_; //!< per light
+		std::vector<float> light_factors_;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_PHOTON_GUIDE_H
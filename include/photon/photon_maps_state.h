@@ -0,0 +1,57 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_PHOTON_MAPS_STATE_H
+#define YAFARAY_PHOTON_MAPS_STATE_H
+
+#include "constants.h"
+#include "photon/photon.h"
+#include <map>
+#include <functional>
+#include <string>
+
+BEGIN_YAFARAY
+
+class Light;
+class Scene;
+
+/*! What the photon maps in the session were shot from, kept between renders so the maps can be updated incrementally: only the
+	paths from the lights that changed, or that hit objects that changed, are shot again. The changes are detected comparing
+	signatures, so it also works when the scene is created again from scratch for each frame */
+struct PhotonMapsState final
+{
+	/*! Bit of the object in the path masks: the objects are identified by name, so all the instances of an object share the bit, as
+		well as the objects whose names hash to the same bit, which only means that some valid paths are shot again */
+	static uint64_t objectBit(const std::string &name) { return uint64_t(1) << (std::hash<std::string>{}(name) % 64); }
+	static uint64_t lightSignature(const Light &light); //!< hash of a few photons emitted by the light, changes when it is moved or resized
+	static std::map<std::string, uint64_t> objectSignatures(const Scene &scene); //!< hash of the primitive bounds of each object, by name
+	static uint64_t hashCombine(uint64_t hash, uint64_t value);
+	static uint64_t hashCombine(uint64_t hash, float value);
+
+	bool valid_ = false;
+	uint64_t settings_ = 0; //!< hash of the integrator settings and light energies, any change needs all the paths to be shot again
+	std::vector<uint64_t> diffuse_lights_, caustic_lights_;
+	std::map<std::string, uint64_t> objects_;
+	std::vector<RadData> rad_points_; //!< FG radiance points before removing the ones too close to each other
+	std::vector<unsigned int> rad_point_paths_; //!< index of the diffuse path that stored each radiance point
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_PHOTON_MAPS_STATE_H
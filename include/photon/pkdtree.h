@@ -23,9 +23,13 @@
 #include "constants.h"
 #include "common/logger.h"
 #include "common/thread.h"
+#include "common/task_pool.h"
+#include "common/memory.h"
 #include "geometry/bound.h"
 #include <vector>
-#include <cstdlib>
+#include <array>
+#include <memory>
+#include <limits>
 
 BEGIN_YAFARAY
 
@@ -36,13 +40,13 @@ namespace kdtree
 
 #define NON_REC_LOOKUP 1
 
-template <class T>
+/*! The leaves store a bucket of up to PointKdTree::max_leaf_elements_ elements, contiguous in the leaf arrays of the tree */
 struct KdNode
 {
-	void createLeaf(const T *d)
+	void createLeaf(uint32_t first_element, uint32_t num_elements)
 	{
-		flags_ = 3;
-		data_ = d;
+		flags_ = 3 | (num_elements << 2);
+		first_element_ = first_element;
 	}
 	void createInterior(int axis, float d)
 	{
@@ -51,14 +55,15 @@ struct KdNode
 	}
 	float 	splitPos() const { return division_; }
 	int 	splitAxis() const { return flags_ & 3; }
-	int 	nPrimitives() const { return flags_ >> 2; }
+	uint32_t	nElements() const { return flags_ >> 2; }
+	uint32_t	firstElement() const { return first_element_; }
 	bool 	isLeaf() const { return (flags_ & 3) == 3; }
 	uint32_t	getRightChild() const { return (flags_ >> 2); }
 	void 	setRightChild(uint32_t i) { flags_ = (flags_ & 3) | (i << 2); }
 	union
 	{
 		float division_;
-		const T *data_;
+		uint32_t first_element_;
 	};
 	uint32_t	flags_;
 };
@@ -73,34 +78,58 @@ template<class NodeData> struct CompareNode
 	}
 };
 
+/*! Kd-tree over the positions of the elements, with the nodes in depth first order and buckets of elements in the
+	leaves. The positions of the elements are copied to the leaf arrays (in SoA form and in the order of the leaves),
+	so the lookups test the elements of a leaf together without touching the elements themselves.
+	A built tree can also be used from external storage, such as a memory mapped file, with the elements in leaf order */
 template <class T>
 class PointKdTree
 {
 	public:
 		PointKdTree() {};
-		PointKdTree(const std::vector<T> &dat, const std::string &map_name, int num_threads = 1);
-		~PointKdTree() { if(nodes_) free(nodes_); }
+		PointKdTree(const std::vector<T> &dat, const std::string &map_name, int num_threads = 1, HugePages::Mode huge_pages_mode = HugePages::Mode::None);
+		/*! Tree over elements already in leaf order, with the nodes and leaf positions saved from a built tree, not copied */
+		PointKdTree(const std::vector<T> &dat, const KdNode *nodes, uint32_t num_nodes, const std::array<const float *, 3> &leaf_positions, const Bound &bound);
 		template<class LookupProc> void lookup(const Point3 &p, const LookupProc &proc, float &max_dist_squared) const;
+		/*! Squared radius expected to hold about k elements around p, from the number of elements and the bound of the smallest node containing p with at least k elements.
+			The elements are assumed to lie on surfaces, spread over the two largest extents of the node. The maximum float if the tree has too few elements */
+		float estimateSqRadius(const Point3 &p, uint32_t k) const;
+		uint32_t getNumNodes() const { return next_free_node_; }
+		const KdNode *getNodes() const { return nodes_; }
+		const float *getLeafPositions(int axis) const { return leaf_positions_[axis]; }
+		uint32_t getLeafElement(uint32_t i) const { return leaf_elements_.empty() ? i : leaf_elements_[i]; } //!< index of the i-th element in leaf order
+		const Bound &getBound() const { return tree_bound_; }
+		size_t getMemorySize() const { return owned_nodes_.capacity() * sizeof(KdNode) + (leaf_elements_.capacity() + node_elements_.capacity()) * sizeof(uint32_t) + 3 * owned_leaf_positions_[0].capacity() * sizeof(float); } //!< without the nodes and leaf positions used from a mapped file
 	protected:
 		template<class LookupProc> void recursiveLookup(const Point3 &p, const LookupProc &proc, float &max_dist_squared, int node_num) const;
+		template<class LookupProc> void lookupLeaf(const Point3 &p, const LookupProc &proc, float &max_dist_squared, const KdNode &node) const;
 		struct KdStack
 		{
-			const KdNode<T> *node_; //!< pointer to far child
+			const KdNode *node_; //!< pointer to far child
 			float s_; 		//!< the split val of parent node
 			int axis_; 		//!< the split axis of parent node
 		};
-		void buildTree(uint32_t start, uint32_t end, Bound &node_bound, const T **prims);
-		void buildTreeWorker(uint32_t start, uint32_t end, Bound &node_bound, const T **prims, int level, uint32_t &local_next_free_node, KdNode<T> *local_nodes);
-		KdNode<T> *nodes_;
-		uint32_t n_elements_, next_free_node_;
+		static uint32_t numSubtreeNodes(uint32_t num_elements);
+		void countNodeElements();
+		void buildTree(uint32_t start, uint32_t end, Bound &node_bound, const T **prims, TaskPool *task_pool);
+		void buildTreeWorker(uint32_t start, uint32_t end, Bound &node_bound, const T **prims, int level, uint32_t &local_next_free_node, KdNode *local_nodes, TaskPool *task_pool);
+		LargeVector<KdNode> owned_nodes_;
+		const KdNode *nodes_ = nullptr;
+		const T *elements_ = nullptr;
+		std::vector<uint32_t> leaf_elements_; //!< index of the elements of each leaf bucket, empty when the elements are in leaf order
+		std::array<LargeVector<float>, 3> owned_leaf_positions_;
+		std::array<const float *, 3> leaf_positions_ {{nullptr, nullptr, nullptr}}; //!< x, y and z of the elements of each leaf bucket
+		std::vector<uint32_t> node_elements_; //!< number of elements of the subtree of each node, for estimating the density of the elements
+		uint32_t n_elements_ = 0, next_free_node_ = 0;
 		Bound tree_bound_;
-		int max_level_threads_ = 0;  //max level where we will launch threads. We will try to launch at least as many threads as scene threads parameter
 		static constexpr unsigned int kd_max_stack_ = 64;
+		static constexpr uint32_t max_leaf_elements_ = 8;
+		static constexpr uint32_t min_elements_to_spawn_tasks_ = 4096; //!< smaller subtrees are built in the thread building their parent, as the task overhead would be higher than the gain
 		std::mutex mutx_;
 };
 
 template<class T>
-PointKdTree<T>::PointKdTree(const std::vector<T> &dat, const std::string &map_name, int num_threads)
+PointKdTree<T>::PointKdTree(const std::vector<T> &dat, const std::string &map_name, int num_threads, HugePages::Mode huge_pages_mode) : owned_nodes_(LargeBufferAllocator<KdNode>(huge_pages_mode)), owned_leaf_positions_ {{LargeVector<float>(LargeBufferAllocator<float>(huge_pages_mode)), LargeVector<float>(LargeBufferAllocator<float>(huge_pages_mode)), LargeVector<float>(LargeBufferAllocator<float>(huge_pages_mode))}}
 {
 	next_free_node_ = 0;
 	n_elements_ = dat.size();
@@ -111,7 +140,9 @@ PointKdTree<T>::PointKdTree(const std::vector<T> &dat, const std::string &map_na
 		return;
 	}
 
-	nodes_ = (KdNode<T> *) malloc(4 * n_elements_ * sizeof(KdNode<T>)); //actually we could allocate one less...2n-1
+	owned_nodes_.resize(numSubtreeNodes(n_elements_));
+	nodes_ = owned_nodes_.data();
+	elements_ = dat.data();
 
 	auto elements = std::unique_ptr<const T*[]>(new const T*[n_elements_]);
 
@@ -121,29 +152,96 @@ PointKdTree<T>::PointKdTree(const std::vector<T> &dat, const std::string &map_na
 
 	for(uint32_t i = 1; i < n_elements_; ++i) tree_bound_.include(dat[i].pos_);
 
-	max_level_threads_ = (int) std::ceil(math::log2((float) num_threads)); //in how many pkdtree levels we will spawn threads, so we create at least as many threads as scene threads parameter (or more)
-	int real_threads = static_cast<int>(math::pow(2.f, max_level_threads_)); //real amount of threads we will create during pkdtree creation depending on the maximum level where we will generate threads
+	Y_INFO << "pointKdTree: Starting " << map_name << " recusive tree build for " << n_elements_ << " elements [using " << num_threads << " threads]" << YENDL;
 
-	Y_INFO << "pointKdTree: Starting " << map_name << " recusive tree build for " << n_elements_ << " elements [using " << real_threads << " threads]" << YENDL;
+	if(num_threads > 1)
+	{
+		TaskPool task_pool(num_threads);
+		buildTree(0, n_elements_, tree_bound_, elements.get(), &task_pool);
+	}
+	else buildTree(0, n_elements_, tree_bound_, elements.get(), nullptr);
 
-	buildTree(0, n_elements_, tree_bound_, elements.get());
+	//The leaves reference contiguous ranges of the sorted elements, so the leaf arrays follow their order
+	leaf_elements_.resize(n_elements_);
+	for(auto &positions : owned_leaf_positions_) positions.resize(n_elements_);
+	for(uint32_t i = 0; i < n_elements_; ++i)
+	{
+		leaf_elements_[i] = static_cast<uint32_t>(elements[i] - elements_);
+		for(int axis = 0; axis < 3; ++axis) owned_leaf_positions_[axis][i] = elements[i]->pos_[axis];
+	}
+	for(int axis = 0; axis < 3; ++axis) leaf_positions_[axis] = owned_leaf_positions_[axis].data();
+	countNodeElements();
 
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "pointKdTree: " << map_name << " tree built." << YENDL;
 }
 
 template<class T>
-void PointKdTree<T>::buildTree(uint32_t start, uint32_t end, Bound &node_bound, const T **prims)
+PointKdTree<T>::PointKdTree(const std::vector<T> &dat, const KdNode *nodes, uint32_t num_nodes, const std::array<const float *, 3> &leaf_positions, const Bound &bound) : nodes_(nodes), elements_(dat.data()), leaf_positions_(leaf_positions), n_elements_(dat.size()), next_free_node_(num_nodes), tree_bound_(bound)
+{
+	countNodeElements();
+}
+
+//! The children of each node come after it in the depth first order, so the nodes are counted backwards
+template<class T>
+void PointKdTree<T>::countNodeElements()
+{
+	node_elements_.resize(next_free_node_);
+	for(uint32_t node_num = next_free_node_; node_num-- > 0;)
+	{
+		const KdNode &node = nodes_[node_num];
+		node_elements_[node_num] = node.isLeaf() ? node.nElements() : node_elements_[node_num + 1] + node_elements_[node.getRightChild()];
+	}
+}
+
+template<class T>
+float PointKdTree<T>::estimateSqRadius(const Point3 &p, uint32_t k) const
+{
+	if(node_elements_.empty() || node_elements_[0] <= k) return std::numeric_limits<float>::max();
+	uint32_t node_num = 0;
+	Bound bound = tree_bound_;
+	while(!nodes_[node_num].isLeaf())
+	{
+		const KdNode &node = nodes_[node_num];
+		const int axis = node.splitAxis();
+		const bool below = p[axis] <= node.splitPos();
+		const uint32_t child = below ? node_num + 1 : node.getRightChild();
+		if(node_elements_[child] < k) break;
+		if(below) bound.g_[axis] = node.splitPos();
+		else bound.a_[axis] = node.splitPos();
+		node_num = child;
+	}
+	std::array<float, 3> extents {{ bound.longX(), bound.longY(), bound.longZ() }};
+	std::sort(extents.begin(), extents.end());
+	const float area = extents[1] * extents[2];
+	if(area <= 0.f) return std::numeric_limits<float>::max();
+	return static_cast<float>(k) * area / (static_cast<float>(M_PI) * static_cast<float>(node_elements_[node_num]));
+}
+
+/*! Each node with more than max_leaf_elements_ elements is split in halves, so the sizes of the nodes of each level
+	only differ by one and the number of leaves can be computed from the first level whose smaller nodes are leaves */
+template<class T>
+uint32_t PointKdTree<T>::numSubtreeNodes(uint32_t num_elements)
 {
-	buildTreeWorker(start, end, node_bound, prims, 0, next_free_node_, nodes_);
+	uint32_t num_leaves = 1;
+	while(num_elements / num_leaves > max_leaf_elements_) num_leaves *= 2;
+	//The larger nodes of that level are split once more if they are still too large
+	if(num_elements / num_leaves == max_leaf_elements_) num_leaves += num_elements % num_leaves;
+	return 2 * num_leaves - 1;
 }
 
 template<class T>
-void PointKdTree<T>::buildTreeWorker(uint32_t start, uint32_t end, Bound &node_bound, const T **prims, int level, uint32_t &local_next_free_node, KdNode<T> *local_nodes)
+void PointKdTree<T>::buildTree(uint32_t start, uint32_t end, Bound &node_bound, const T **prims, TaskPool *task_pool)
+{
+	buildTreeWorker(start, end, node_bound, prims, 0, next_free_node_, owned_nodes_.data(), task_pool);
+}
+
+template<class T>
+void PointKdTree<T>::buildTreeWorker(uint32_t start, uint32_t end, Bound &node_bound, const T **prims, int level, uint32_t &local_next_free_node, KdNode *local_nodes, TaskPool *task_pool)
 {
 	++level;
-	if(end - start == 1)
+	if(end - start <= max_leaf_elements_)
 	{
-		local_nodes[local_next_free_node].createLeaf(prims[start]);
+		local_nodes[local_next_free_node].createLeaf(start, end - start);
 		local_next_free_node++;
 		--level;
 		return;
@@ -164,59 +262,27 @@ void PointKdTree<T>::buildTreeWorker(uint32_t start, uint32_t end, Bound &node_b
 		case 2: bound_l.setMaxZ(split_pos); bound_r.setMinZ(split_pos); break;
 	}
 
-	if(level <= max_level_threads_)   //launch threads for the first "x" levels to try to match (at least) the scene threads parameter
+	//The number of nodes of the below subtree only depends on its number of elements, so the position of the above child is known in advance and both subtrees can be built in place concurrently
+	const uint32_t above_node = cur_node + 1 + numSubtreeNodes(split_el - start);
+	local_nodes[cur_node].setRightChild(above_node);
+	if(task_pool && split_el - start >= min_elements_to_spawn_tasks_)
 	{
-		//<< recurse below child >>
-		uint32_t next_free_node_1 = 0;
-		auto *nodes_1 = (KdNode<T> *) malloc(4 * (split_el - start) * sizeof(KdNode<T>));
-		auto below_worker = std::thread( &PointKdTree<T>::buildTreeWorker, this, start, split_el, std::ref(bound_l), prims, level, std::ref(next_free_node_1), nodes_1 );
-
-		//<< recurse above child >>
-		uint32_t next_free_node_2 = 0;
-		auto *nodes_2 = (KdNode<T> *) malloc(4 * (end - split_el) * sizeof(KdNode<T>));
-		auto above_worker = std::thread( &PointKdTree<T>::buildTreeWorker, this, split_el, end, std::ref(bound_r), prims, level, std::ref(next_free_node_2), nodes_2 );
-
-		below_worker.join();
-		above_worker.join();
-
-		if(nodes_1)
-		{
-			for(uint32_t i = 0; i < next_free_node_1; ++i)
-			{
-				local_nodes[i + local_next_free_node] = nodes_1[i];
-				if(!local_nodes[i + local_next_free_node].isLeaf())
-				{
-					uint32_t right_child = local_nodes[i + local_next_free_node].getRightChild();
-					local_nodes[i + local_next_free_node].setRightChild(right_child + local_next_free_node);
-				}
-			}
-			free(nodes_1);
-		}
-
-		if(nodes_2)
+		TaskPool::Group task_group(*task_pool);
+		task_group.run([&]()
 		{
-			for(uint32_t i = 0; i < next_free_node_2; ++i)
-			{
-				local_nodes[i + local_next_free_node + next_free_node_1] = nodes_2[i];
-				if(!local_nodes[i + local_next_free_node + next_free_node_1].isLeaf())
-				{
-					uint32_t right_child = local_nodes[i + local_next_free_node + next_free_node_1].getRightChild();
-					local_nodes[i + local_next_free_node + next_free_node_1].setRightChild(right_child + local_next_free_node + next_free_node_1);
-				}
-			}
-			free(nodes_2);
-		}
-
-		local_nodes[cur_node].setRightChild(local_next_free_node + next_free_node_1);
-		local_next_free_node = local_next_free_node + next_free_node_1 + next_free_node_2;
+			uint32_t below_next_free_node = cur_node + 1;
+			buildTreeWorker(start, split_el, bound_l, prims, level, below_next_free_node, local_nodes, task_pool);
+		});
+		local_next_free_node = above_node;
+		buildTreeWorker(split_el, end, bound_r, prims, level, local_next_free_node, local_nodes, task_pool);
+		task_group.wait();
 	}
-	else  //for the rest of the levels in the tree, don't launch more threads, do normal "sequential" operation
+	else
 	{
 		//<< recurse below child >>
-		buildTreeWorker(start, split_el, bound_l, prims, level, local_next_free_node, local_nodes);
+		buildTreeWorker(start, split_el, bound_l, prims, level, local_next_free_node, local_nodes, task_pool);
 		//<< recurse above child >>
-		local_nodes[cur_node].setRightChild(local_next_free_node);
-		buildTreeWorker(split_el, end, bound_r, prims, level, local_next_free_node, local_nodes);
+		buildTreeWorker(split_el, end, bound_r, prims, level, local_next_free_node, local_nodes, task_pool);
 	}
 	--level;
 }
@@ -227,7 +293,7 @@ void PointKdTree<T>::lookup(const Point3 &p, const LookupProc &proc, float &max_
 {
 #if NON_REC_LOOKUP > 0
 	KdStack stack[kd_max_stack_];
-	const KdNode<T> *far_child, *curr_node = nodes_;
+	const KdNode *far_child, *curr_node = nodes_;
 
 	int stack_ptr = 1;
 	stack[stack_ptr].node_ = nullptr; // "nowhere", termination flag
@@ -256,18 +322,12 @@ void PointKdTree<T>::lookup(const Point3 &p, const LookupProc &proc, float &max_
 		}
 
 		// Hand leaf-data kd-tree to processing function
-		Vec3 v = curr_node->data_->pos_ - p;
-		float dist_2 = v.lengthSqr();
-
-		if(dist_2 < max_dist_squared)
-		{
-			proc(curr_node->data_, dist_2, max_dist_squared);
-		}
+		lookupLeaf(p, proc, max_dist_squared, *curr_node);
 
 		if(!stack[stack_ptr].node_) return; // stack empty, done.
 		//radius probably lowered so we may pop additional elements:
 		int axis = stack[stack_ptr].axis_;
-		dist_2 = p[axis] - stack[stack_ptr].s_;
+		float dist_2 = p[axis] - stack[stack_ptr].s_;
 		dist_2 *= dist_2;
 
 		while(dist_2 > max_dist_squared)
@@ -294,15 +354,10 @@ void PointKdTree<T>::lookup(const Point3 &p, const LookupProc &proc, float &max_
 template<class T> template<class LookupProc>
 void PointKdTree<T>::recursiveLookup(const Point3 &p, const LookupProc &proc, float &max_dist_squared, int node_num) const
 {
-	const KdNode<T> *curr_node = &nodes_[node_num];
+	const KdNode *curr_node = &nodes_[node_num];
 	if(curr_node->isLeaf())
 	{
-		Vec3 v = curr_node->data_->pos_ - p;
-		float dist_2 = v.lengthSqr();
-		if(dist_2 < max_dist_squared)
-		{
-			proc(curr_node->data_, dist_2, max_dist_squared);
-		}
+		lookupLeaf(p, proc, max_dist_squared, *curr_node);
 		return;
 	}
 	int axis = curr_node->splitAxis();
@@ -322,6 +377,28 @@ void PointKdTree<T>::recursiveLookup(const Point3 &p, const LookupProc &proc, fl
 	}
 }
 
+template<class T> template<class LookupProc>
+inline void PointKdTree<T>::lookupLeaf(const Point3 &p, const LookupProc &proc, float &max_dist_squared, const KdNode &node) const
+{
+	//The distances to all the elements of the bucket are computed first in a loop over the SoA arrays the compiler can vectorize
+	const uint32_t first = node.firstElement();
+	const uint32_t num_elements = node.nElements();
+	const float *pos_x = &leaf_positions_[0][first], *pos_y = &leaf_positions_[1][first], *pos_z = &leaf_positions_[2][first];
+	float dist_2[max_leaf_elements_];
+	for(uint32_t i = 0; i < num_elements; ++i)
+	{
+		const float d_x = pos_x[i] - p.x_;
+		const float d_y = pos_y[i] - p.y_;
+		const float d_z = pos_z[i] - p.z_;
+		dist_2[i] = d_x * d_x + d_y * d_y + d_z * d_z;
+	}
+	const T *elements = leaf_elements_.empty() ? &elements_[first] : nullptr;
+	for(uint32_t i = 0; i < num_elements; ++i)
+	{
+		if(dist_2[i] < max_dist_squared) proc(elements ? &elements[i] : &elements_[leaf_elements_[first + i]], dist_2[i], max_dist_squared);
+	}
+}
+
 } // namespace::kdtree
 
 END_YAFARAY
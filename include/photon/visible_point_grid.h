@@ -0,0 +1,81 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_VISIBLE_POINT_GRID_H
+#define YAFARAY_VISIBLE_POINT_GRID_H
+
+#include "constants.h"
+#include "geometry/bound.h"
+#include "color/color.h"
+#include <vector>
+#include <array>
+#include <atomic>
+#include <memory>
+
+BEGIN_YAFARAY
+
+//! Hit point of a gather ray, recorded to receive the photons while they are traced instead of gathering them from a photon map
+struct VisiblePoint final
+{
+	Point3 p_;
+	Vec3 n_; //!< shading normal, on the side of the gather ray
+	Rgb reflect_col_; //!< diffuse response to the photons arriving on the side of the normal
+	Rgb transmit_col_; //!< diffuse response to the photons arriving from the other side
+	Rgb weight_ {1.f}; //!< throughput of the gather path from the camera, applied to the received flux
+	float count_weight_ = 1.f; //!< applied to the number of received photons
+	float radius_2_; //!< square search radius of the pixel
+	unsigned int hit_point_; //!< index of the pixel hit point
+	bool caustics_; //!< whether it receives the caustic photons, only on the surfaces with a diffuse component
+};
+
+/*! Uniform grid over the visible points of an eye pass, with cells the size of the largest search radius. The points are
+	sorted by cell with a counting sort and the photons are splatted into the points of the cells around them, atomically
+	so all the photon threads can splat at the same time */
+class VisiblePointGrid final
+{
+	public:
+		void build(std::vector<std::vector<VisiblePoint>> &visible_points); //!< moves the points of all the threads into the grid, leaving their vectors empty
+		void clear();
+		bool empty() const { return points_.empty(); }
+		size_t size() const { return points_.size(); }
+		const VisiblePoint &operator[](size_t index) const { return points_[index]; }
+		void splat(const Point3 &p, const Vec3 &dir, const Rgb &col, bool caustic); //!< dir points to where the photon comes from
+		/*! Flux received by the point, weighted with its gather path throughput, and weighted number of received photons */
+		void getPhotons(size_t index, Rgba &flux, float &count) const;
+
+	private:
+		struct PhotonSums
+		{
+			PhotonSums() { for(auto &sum : sums_) sum.store(0.f, std::memory_order_relaxed); }
+			std::array<std::atomic<float>, 6> sums_; //!< reflected and transmitted photon colors
+			std::atomic<unsigned int> count_ {0};
+		};
+		static void atomicAdd(std::atomic<float> &value, float addend);
+
+		std::vector<VisiblePoint> points_; //!< sorted by cell
+		std::unique_ptr<PhotonSums[]> photon_sums_;
+		std::vector<unsigned int> cell_starts_; //!< index in points_ of the first point of each cell, with the number of points at the end
+		Bound bound_;
+		float inv_cell_size_ = 1.f;
+		std::array<int, 3> num_cells_ {{0, 0, 0}};
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_VISIBLE_POINT_GRID_H
@@ -0,0 +1,67 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_FILM_DENOISER_H
+#define YAFARAY_FILM_DENOISER_H
+
+#include "constants.h"
+#include "color/color.h"
+#include "geometry/vector.h"
+#include <vector>
+
+BEGIN_YAFARAY
+
+/*! Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) for the HDR float colors of the film, before they are sent to the outputs.
+	The edges are kept with the differences of color and of the auxiliary features rendered with the image: normals, diffuse color and depth.
+	Each iteration doubles the spacing of the 5x5 filter taps and is computed in bands of rows by the threads of a task pool */
+class FilmDenoiser final
+{
+	public:
+		struct Params
+		{
+			bool enabled_ = false;
+			bool intermediate_ = false; //!< also denoise the images of the intermediate passes, not only the final one
+			int iterations_ = 5; //!< the filter covers 4 * 2^iterations + 1 pixels
+			float sigma_color_ = 2.f; //!< difference tolerance of the colors compressed to 0..1, halved on each iteration as the noise decreases
+			float sigma_normal_ = 0.1f; //!< tolerance of 1 - cosine of the angle between the normals
+			float sigma_albedo_ = 0.1f; //!< diffuse color difference tolerance
+			float sigma_depth_ = 0.05f; //!< depth difference tolerance, relative to the depth of the pixel
+		};
+		//! Auxiliary features of the pixels, empty vectors for the features not rendered
+		struct Features
+		{
+			std::vector<Vec3> normals_;
+			std::vector<Rgb> albedo_;
+			std::vector<float> depth_;
+		};
+		FilmDenoiser(const Params &params, int num_threads) : params_(params), num_threads_(num_threads) { }
+		//! Denoises the colors of the width x height image in place, in row order
+		void denoise(std::vector<Rgb> &colors, const Features &features, int width, int height, int band_height) const;
+		const Params &getParams() const { return params_; }
+
+	private:
+		void iteration(const std::vector<Rgb> &colors_in, std::vector<Rgb> &colors_out, const std::vector<Rgb> &compressed, const Features &features, int width, int height, int y_0, int y_1, int step, float inv_sigma_color_2) const;
+
+		Params params_;
+		int num_threads_ = 1;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_FILM_DENOISER_H
@@ -0,0 +1,62 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_FILM_FILE_HEADER_H
+#define YAFARAY_FILM_FILE_HEADER_H
+
+#include "constants.h"
+#include <string>
+#include <vector>
+
+BEGIN_YAFARAY
+
+class File;
+
+/*! Header of the film files and layout of their chunks, shared by the ImageFilm and the film merging tool.
+	In the chunked formats the film is split in chunks of chunk_size_global x chunk_size_global pixels stored in row order,
+	each one with its weights followed by the pixels of each layer, so the chunks are at known file positions */
+struct FilmFileHeader final
+{
+	enum class Format : int { Legacy, Chunked, ChunkedLayers };
+	static constexpr int chunk_size_global = 64;
+
+	bool read(const File &file); //!< returns false if the file is not a film file
+	bool write(File &file) const; //!< always written in the ChunkedLayers format
+	bool isChunked() const { return format_ != Format::Legacy; }
+	int getChunksX() const { return (width_ + chunk_size_global - 1) / chunk_size_global; }
+	int getChunksY() const { return (height_ + chunk_size_global - 1) / chunk_size_global; }
+	size_t getPixelSize() const { return 1 + 4 * static_cast<size_t>(num_layers_); } //!< number of floats of each pixel: its weight and the color of each layer
+	uint64_t getSize() const; //!< bytes of the header in the file
+	uint64_t getChunkFilePosition(int chunk_x, int chunk_y) const;
+	uint64_t getFileSize() const { return getSize() + static_cast<uint64_t>(width_) * height_ * getPixelSize() * sizeof(float); }
+	void getChunkArea(int chunk_x, int chunk_y, int &x_0, int &y_0, int &x_1, int &y_1) const;
+
+	Format format_ = Format::ChunkedLayers;
+	unsigned int computer_node_ = 0;
+	unsigned int base_sampling_offset_ = 0;
+	unsigned int sampling_offset_ = 0;
+	int width_ = 0, height_ = 0, cx_0_ = 0, cx_1_ = 0, cy_0_ = 0, cy_1_ = 0;
+	int num_layers_ = 0;
+	int chunk_size_ = chunk_size_global;
+	std::vector<int> layer_types_; //!< Layer::Type of each layer, empty if they are not known
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_FILM_FILE_HEADER_H
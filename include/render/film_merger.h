@@ -0,0 +1,46 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_FILM_MERGER_H
+#define YAFARAY_FILM_MERGER_H
+
+#include "constants.h"
+#include <string>
+#include <vector>
+
+BEGIN_YAFARAY
+
+/*! Merges the film files saved by the computer nodes of a multi-computer render into a single film file, without the scene.
+	The input films are memory mapped and merged chunk row by chunk row by the threads of a task pool, each thread writing
+	its rows directly at their position in the output file, so the memory used is one chunk row per thread whatever the number of films */
+class LIBYAFARAY_EXPORT FilmMerger final
+{
+	public:
+		explicit FilmMerger(int num_threads) : num_threads_(num_threads) { }
+		/*! Returns false if no film could be merged. The films not matching the first one, and the repeated films of a
+		 * computer node with the same sampling offsets, are skipped with a warning */
+		bool merge(const std::vector<std::string> &input_paths, const std::string &output_path) const;
+
+	private:
+		int num_threads_ = 1;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_FILM_MERGER_H
@@ -30,8 +30,12 @@
 #include "common/aa_noise_params.h"
 #include "common/layers.h"
 #include "common/memory.h"
+#include "common/memory_stats.h"
 #include "image/image_buffers.h"
 #include "image/image_layers.h"
+#include "render/film_denoiser.h"
+#include <chrono>
+#include <atomic>
 
 
 BEGIN_YAFARAY
@@ -48,7 +52,11 @@ class Rgb;
 class ColorLayers;
 class ParamMap;
 class RenderControl;
+class Session;
 class RenderView;
+class File;
+class RenderCheckpoint;
+struct FilmFileHeader;
 
 class LIBYAFARAY_EXPORT ImageFilm final
 {
@@ -71,12 +79,26 @@ class LIBYAFARAY_EXPORT ImageFilm final
 			std::string path_ = "./";
 			AutoSaveParams auto_save_;
 		};
+		//! Render checkpoints saved between the passes, see RenderCheckpoint
+		struct CheckpointParams
+		{
+			std::string path_; //!< checkpoints disabled when empty
+			int interval_passes_ = 1;
+		};
+		//! Error of the Combined layer against the convergence reference image at the end of a pass
+		struct ConvergencePass
+		{
+			int pass_ = 0;
+			double seconds_ = 0.0; //!< since the film initialization, without the time of the error calculations
+			double rmse_ = 0.0;
+			double rel_mse_ = 0.0; //!< mean of (pixel - reference)^2 / (reference^2 + 0.01), less dominated by the bright pixels than the RMSE
+		};
 
 		static std::unique_ptr<ImageFilm> factory(const ParamMap &params, Scene *scene);
 		/*! imageFilm_t Constructor */
 		ImageFilm(int width, int height, int xstart, int ystart, int num_threads, RenderControl &render_control, const Layers &layers, const std::map<std::string, UniquePtr_t<ColorOutput>> &outputs, float filter_size = 1.0, FilterType filt = FilterType::Box,
 				  bool show_sam_mask = false, int t_size = 32,
-				  ImageSplitter::TilesOrderType tiles_order_type = ImageSplitter::Linear);
+				  ImageSplitter::TilesOrderType tiles_order_type = ImageSplitter::Linear, bool half_float_layers = false, HugePages::Mode huge_pages_mode = HugePages::Mode::None);
 		/*! Initialize imageFilm for new rendering, i.e. set pixels black etc */
 		void init(RenderControl &render_control, int num_passes = 0);
 		/*! Prepare for next pass, i.e. reset area_cnt, check if pixels need resample...
@@ -85,8 +107,9 @@ class LIBYAFARAY_EXPORT ImageFilm final
 		int nextPass(const RenderView *render_view, RenderControl &render_control, bool adaptive_aa, std::string integrator_name, bool skip_nrender_layer = false);
 		/*! Return the next area to be rendered
 			CAUTION! This method MUST be threadsafe!
+			\param thread_id render thread asking for the area, so with the curve tiles orders it is given the areas of its own range
 			\return false if no area is left to be handed out, true otherwise */
-		bool nextArea(RenderArea &a);
+		bool nextArea(RenderArea &a, int thread_id = -1);
 		/*! Indicate that all pixels inside the area have been sampled for this pass */
 		void finishArea(const RenderView *render_view, RenderControl &render_control, RenderArea &a);
 		/*! Output all pixels to the color output */
@@ -98,25 +121,29 @@ class LIBYAFARAY_EXPORT ImageFilm final
 		bool doMoreSamples(int x, int y) const;
 		/*!	Add image sample; dx and dy describe the position in the pixel (x,y).
 			IMPORTANT: when a is given, all samples within a are assumed to come from the same thread!
+			In that case they are accumulated without locking into the area buffer, merged into the film in finishArea.
 			use a=0 for contributions outside the area associated with current thread!
 		*/
-		void addSample(int x, int y, float dx, float dy, const RenderArea *a = nullptr, int num_sample = 0, int aa_pass_number = 0, float inv_aa_max_possible_samples = 0.1f, ColorLayers *color_layers = nullptr);
+		void addSample(int x, int y, float dx, float dy, RenderArea *a = nullptr, int num_sample = 0, int aa_pass_number = 0, float inv_aa_max_possible_samples = 0.1f, ColorLayers *color_layers = nullptr);
 		/*!	Add light density sample; dx and dy describe the position in the pixel (x,y).
-			IMPORTANT: when a is given, all samples within a are assumed to come from the same thread!
-			use a=0 for contributions outside the area associated with current thread!
+			The samples are added with atomic operations, so any thread can add them to any pixel without locking
 		*/
 		void addDensitySample(const Rgb &c, int x, int y, float dx, float dy, const RenderArea *a = nullptr);
 		//! Enables/Disables a light density estimation image
 		void setDensityEstimation(bool enable);
 		//! set number of samples for correct density estimation (if enabled)
-		void setNumDensitySamples(int n) { num_density_samples_ = n; }
+		void setNumDensitySamples(int n) { num_density_samples_.store(n, std::memory_order_relaxed); }
 		/*! Sets the adaptative AA sampling threshold */
 		void setAaThreshold(float thresh) { aa_noise_params_.threshold_ = thresh; }
+		float getAaThreshold() const { return aa_noise_params_.threshold_; }
 		/*! Sets a custom progress bar in the image film */
 		void setProgressBar(std::shared_ptr<ProgressBar> pb);
 		/*! The following methods set the strings used for the parameters badge rendering */
 		int getTotalPixels() const { return width_ * height_; };
+		int getPassPixels() const { return pass_pixels_; } //!< number of pixels to be rendered in the current pass
 		void setAaNoiseParams(const AaNoiseParams &aa_noise_params) { aa_noise_params_ = aa_noise_params; };
+		void setSession(const Session *session) { session_ = session; } //!< session of the scene rendered, for its preview and interactive flags
+		void setDenoiseParams(const FilmDenoiser::Params &denoise_params) { denoise_params_ = denoise_params; }
 		/*! Methods for rendering the parameters badge; Note that FreeType lib is needed to render text */
 		float darkThresholdCurveInterpolate(float pixel_brightness);
 		int getWidth() const { return width_; }
@@ -125,12 +152,15 @@ class LIBYAFARAY_EXPORT ImageFilm final
 		int getCy0() const { return cy_0_; }
 		int getTileSize() const { return tile_size_; }
 		float getWeight(int x, int y) const { return weights_(x, y).getFloat(); }
+		//! relative number of samples of the pixel in the pass, with the variance sampling
+		float getVarianceSampleFactor(int x, int y) const { return variance_sample_factors_.empty() ? 1.f : variance_sample_factors_[static_cast<size_t>(y) * width_ + x]; }
 		bool getBackgroundResampling() const { return background_resampling_; }
 		void setBackgroundResampling(bool background_resampling) { background_resampling_ = background_resampling; }
 		unsigned int getComputerNode() const { return computer_node_; }
 		unsigned int getBaseSamplingOffset() const { return base_sampling_offset_ + computer_node_ * 100000; } //We give to each computer node a "reserved space" of 100,000 samples
 		unsigned int getSamplingOffset() const { return sampling_offset_; }
 		void setComputerNode(unsigned int computer_node) { computer_node_ = computer_node; }
+		void setNumComputerNodes(unsigned int num_computer_nodes) { num_computer_nodes_ = num_computer_nodes; }
 		void setBaseSamplingOffset(unsigned int offset) { base_sampling_offset_ = offset; }
 		void setSamplingOffset(unsigned int offset) { sampling_offset_ = offset; }
 
@@ -144,12 +174,49 @@ class LIBYAFARAY_EXPORT ImageFilm final
 		std::string getFilmSavePath() const { return film_load_save_.path_; }
 		void resetImagesAutoSaveTimer() { images_auto_save_params_.timer_ = 0.0; }
 		void resetFilmAutoSaveTimer() { film_load_save_.auto_save_.timer_ = 0.0; }
+		void setCheckpointParams(const CheckpointParams &checkpoint_params) { checkpoint_params_ = checkpoint_params; }
+		const CheckpointParams &getCheckpointParams() const { return checkpoint_params_; }
+		bool checkpointsEnabled() const { return !checkpoint_params_.path_.empty() && !isPreview(); }
+		std::string getCheckpointPath(const std::string &view_name) const; //!< of the checkpoints of a render view, for this computer node
+		/*! adds the film pixels, the adaptive AA flags and statistics and the pass counters to a render checkpoint */
+		void saveCheckpoint(RenderCheckpoint &checkpoint) const;
+		/*! replaces the film contents with the ones of a render checkpoint, after init(). Returns false, keeping the film cleared, if it was saved for a different film */
+		bool loadCheckpoint(const RenderCheckpoint &checkpoint);
 
 		void generateDebugFacesEdges(int xstart, int width, int ystart, int height, bool drawborder);
 		void generateToonAndDebugObjectEdges(int xstart, int width, int ystart, int height, bool drawborder);
 		const ImageLayers *getImageLayers() const { return &image_layers_; }
+		bool setConvergenceReference(const std::string &file_path); //!< image with the converged render, to measure the error of each pass
+		/*! Measures the error of the passes rendered so far against the convergence reference, if any. Called by nextPass for
+		 * the previous pass and by the scene after the last pass, a pass is only measured once */
+		void measureConvergence();
+		const std::vector<ConvergencePass> &getConvergence() const { return convergence_; }
 
 	private:
+		bool isComputerNodeArea(const RenderArea &a) const; //!< if the area is rendered by this computer node
+		/*! flags the pixels whose mean has an estimated standard error above the AA threshold, and spreads the samples of the pass between
+			them in proportion to their error */
+		void flagPixelsByVariance(const Image *sampling_factor_image_pass);
+		int passAreasLeft() const; //!< non-empty pass areas not handed out yet. Must be called with splitter_mutex_ locked
+		int nextThreadArea(int thread_id); //!< next area of the thread range, or stolen from another range, -1 if there are none left. Must be called with splitter_mutex_ locked
+		int setupPassAreas(bool all_pixels); //!< sets the part of each splitter area to be rendered in the pass, returns the number of pixels to be rendered
+		void initAreaAccumulation(RenderArea &a) const;
+		void mergeAreaAccumulation(RenderArea &a);
+		/*! Computes the colors of all the layers in the area with pixel_color(layer_type, image, x, y) and sends them as a tile to the outputs */
+		/*! Film file chunks: the chunks are stored in row order, each one with its weights followed by the pixels of each layer */
+		FilmFileHeader getFilmFileHeader() const;
+		void getFilmChunkArea(int chunk_x, int chunk_y, int &x_0, int &y_0, int &x_1, int &y_1) const;
+		bool saveFilmChunk(File &file, int chunk_x, int chunk_y, std::vector<float> &chunk_data) const;
+		bool addFilmChunk(File &file, int chunk_x, int chunk_y, std::vector<float> &chunk_data);
+		void markFilmChunksModified(int x_0, int y_0, int x_1, int y_1); //!< film area including x_1, y_1. Must be called with image_mutex_ locked
+		void updateMemoryTracker();
+		void clearDensityImage(); //!< allocates the density image if needed
+		Rgb getDensityColor(int x, int y) const { const size_t index = 3 * (static_cast<size_t>(y) * width_ + x); return Rgb(density_image_[index].load(std::memory_order_relaxed), density_image_[index + 1].load(std::memory_order_relaxed), density_image_[index + 2].load(std::memory_order_relaxed)); }
+		bool isPreview() const;
+		bool isInteractive() const;
+		std::vector<Rgb> getDenoisedCombined() const; //!< HDR colors of the Combined layer after the film denoiser, in row order
+		template <typename PixelColorFunc> bool putOutputsTile(int x_0, int y_0, int width, int height, const Layers &layers, bool include_image_outputs, const PixelColorFunc &pixel_color);
+
 		int width_, height_, cx_0_, cx_1_, cy_0_, cy_1_;
 		int badge_height_; //!< height of the rendering parameters badge;
 		bool show_mask_;
@@ -158,9 +225,16 @@ class LIBYAFARAY_EXPORT ImageFilm final
 		int num_threads_ = 1;
 		int n_passes_;
 		unsigned int computer_node_ = 0;	//Computer node in multi-computer render environments/render farms
+		unsigned int num_computer_nodes_ = 1;	//If more than 1, the tiles of the frame are distributed between the computer nodes and each node only renders its own tiles
 		int n_pass_;
 		volatile int next_area_;
 		int area_cnt_, completed_cnt_;
+		int pass_pixels_ = 0;
+		std::vector<ImageSplitter::Region> dynamic_split_areas_; //!< halves of the areas split at the end of the pass, handed out before the next splitter areas. Protected by splitter_mutex_
+		std::atomic<int> num_dynamic_split_areas_ {0}; //!< areas added in this pass by the dynamic splits, to know when all the areas are finished
+		std::vector<ImageSplitter::Region> pass_areas_; //!< for each splitter area, the part rendered in this pass: the bounding box of its pixels flagged for more samples, empty (w_ = 0) if the area is skipped
+		std::vector<int> pass_areas_left_; //!< number of non-empty pass areas from each splitter area index to the end
+		std::vector<std::pair<int, int>> thread_areas_; //!< with the curve tiles orders, for each render thread the next and end splitter area indices of its range. Protected by splitter_mutex_
 		bool split_ = true;
 		bool abort_ = false;
 		bool background_resampling_ = true;   //If false, the background will not be resampled in subsequent adaptative AA passes
@@ -168,27 +242,43 @@ class LIBYAFARAY_EXPORT ImageFilm final
 		unsigned int base_sampling_offset_ = 0;	//Base sampling offset, in case of multi-computer rendering each should have a different offset so they don't "repeat" the same samples (user configurable)
 		unsigned int sampling_offset_ = 0;	//To ensure sampling after loading the image film continues and does not repeat already done samples
 		bool estimate_density_ = false;
-		int num_density_samples_ = 0;
+		std::atomic<int> num_density_samples_ {0};
 		AaNoiseParams aa_noise_params_;
+		FilmDenoiser::Params denoise_params_;
 		const Layers &layers_;
 		const std::map<std::string, UniquePtr_t<ColorOutput>> &outputs_;
 		std::unique_ptr<ImageSplitter> splitter_;
 		std::shared_ptr<ProgressBar> progress_bar_;
 		//const Scene *scene_ = nullptr;
+		const Session *session_ = nullptr;
 		//const RenderControl *render_control_;
 
 		AutoSaveParams images_auto_save_params_;
 		FilmLoadSave film_load_save_;
+		CheckpointParams checkpoint_params_;
 
 		float filterw_, table_scale_;
 		std::unique_ptr<float[]> filter_table_;
+		std::unique_ptr<float[]> filter_table_1d_; //!< only for separable filters
 		// Thread mutes for shared access
-		std::mutex image_mutex_, splitter_mutex_, out_mutex_, density_image_mutex_;
+		std::mutex image_mutex_, splitter_mutex_, out_mutex_;
 
 		ImageBuffer2D<bool> flags_; //!< flags for adaptive AA sampling;
 		ImageBuffer2D<Gray> weights_;
+		std::vector<std::array<float, 2>> luminance_moments_; //!< with the variance sampling, sums of the filter weighted squared luminances of the combined samples and of the squared filter weights of each pixel
+		std::vector<float> variance_sample_factors_; //!< with the variance sampling, relative number of samples of each pixel in the pass
 		ImageLayers image_layers_;
-		std::unique_ptr<ImageBuffer2D<Rgb>> density_image_; //!< storage for z-buffer channel
+		std::vector<bool> point_sampled_layers_; //!< Layer::isPointSampled for each image layer, in the image layers order
+		std::unique_ptr<std::atomic<float>[]> density_image_; //!< rgb of each pixel of the light density image, added to with atomic operations
+		int film_chunks_x_, film_chunks_y_;
+		std::vector<bool> film_chunks_modified_; //!< chunks modified since the last film save, protected by image_mutex_
+		bool film_file_saved_ = false; //!< the whole film file has been written by this film, so the next saves only need to rewrite the modified chunks
+		std::vector<Rgba> output_tile_colors_; //!< colors of the tile being sent to the outputs, protected by out_mutex_
+		std::unique_ptr<Image> convergence_reference_;
+		std::vector<ConvergencePass> convergence_;
+		std::chrono::steady_clock::time_point convergence_start_;
+		double convergence_measure_seconds_ = 0.0; //!< time of the error calculations, excluded from the pass times
+		MemoryTracker memory_tracker_ {MemoryStats::ImageFilm}; //!< layer images, weights, flags and density image
 };
 
 END_YAFARAY
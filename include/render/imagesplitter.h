@@ -21,8 +21,11 @@
 #define YAFARAY_IMAGESPLITTER_H
 
 #include "constants.h"
+#include "color/color.h"
 
 #include <vector>
+#include <array>
+#include <cstdint>
 #include <cmath>
 
 BEGIN_YAFARAY
@@ -62,6 +65,17 @@ struct RenderArea
 	//	std::vector<Rgba> image;
 	//	std::vector<float> depth;
 	std::vector<bool> resample_;
+	uint64_t num_camera_samples_ = 0; //!< camera samples integrated in the area by the last renderTile
+	/*! Thread-private accumulation of the samples added to the area, including a border of the filter size,
+		so the rendering thread does not need to lock the image film. Merged into the film in ImageFilm::finishArea */
+	struct Accumulation
+	{
+		int x_0_ = 0, y_0_ = 0, w_ = 0, h_ = 0;
+		bool modified_ = false; //!< any sample added, otherwise there is nothing to merge
+		std::vector<float> weights_;
+		std::vector<Rgba> colors_; //!< for each pixel, the colors of all the image layers contiguous in memory, so all of them are updated in the same loop
+		std::vector<std::array<float, 2>> moments_; //!< with the variance sampling, see ImageFilm::luminance_moments_
+	} accumulation_;
 };
 
 /*!	Splits the image to be rendered into pieces, e.g. "buckets" for
@@ -71,20 +85,22 @@ struct RenderArea
 class ImageSplitter final
 {
 	public:
-		enum TilesOrderType { Linear, Random, CentreRandom };
+		enum TilesOrderType { Linear, Random, CentreRandom, Hilbert, Morton };
 		struct Region
 		{
 			int x_, y_, w_, h_;
 			//			int rx,ry,rw,rh;
 		};
 		ImageSplitter() {};
-		ImageSplitter(int w, int h, int x_0, int y_0, int bsize, TilesOrderType torder, int nthreads);
+		ImageSplitter(int w, int h, int x_0, int y_0, int bsize, TilesOrderType torder);
 		/* return the n-th area to be rendered.
 			\return false if n is out of range, true otherwise
 		*/
 		bool getArea(int n, RenderArea &area);
 
 		bool empty() const {return regions_.empty();};
+		/*! with the space filling curve orders, any range of consecutive areas covers a compact part of the image */
+		bool isCurveOrder() const { return tilesorder_ == Hilbert || tilesorder_ == Morton; }
 		int size() const {return static_cast<int>(regions_.size());};
 
 	private:
@@ -0,0 +1,97 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_RENDER_CHECKPOINT_H
+#define YAFARAY_RENDER_CHECKPOINT_H
+
+#include "constants.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+BEGIN_YAFARAY
+
+class MappedFile;
+
+/*! State of a render saved between its passes (film, adaptive AA flags, pass counters and integrator state), so a render interrupted,
+	for example preempted in a render farm, can resume from its last checkpoint. The state is kept in named sections of plain arrays,
+	each one aligned in the file so it can be used in place from the memory mapped file. The file is only valid in platforms with the same byte order */
+class RenderCheckpoint final
+{
+	public:
+		RenderCheckpoint();
+		~RenderCheckpoint();
+		template <typename T> void add(const std::string &name, const T *values, size_t num_values);
+		template <typename T, typename Alloc> void add(const std::string &name, const std::vector<T, Alloc> &values) { add(name, values.data(), values.size()); }
+		template <typename T> void addValue(const std::string &name, const T &value) { add(name, &value, 1); }
+		/*! writes the sections to a temporary file renamed over the previous checkpoint, so an interruption while saving keeps the previous checkpoint */
+		bool save(const std::string &path) const;
+		/*! maps the file, the sections loaded are valid until the checkpoint is loaded again or destroyed */
+		bool load(const std::string &path);
+		/*! values of a loaded section, nullptr if it does not exist or it does not have num_values elements */
+		template <typename T> const T *get(const std::string &name, size_t num_values) const;
+		template <typename T, typename Alloc> bool get(const std::string &name, std::vector<T, Alloc> &values) const; //!< copies a loaded section with values.size() elements
+		template <typename T> bool getValue(const std::string &name, T &value) const;
+		size_t getSectionSize(const std::string &name) const; //!< bytes of a loaded section, 0 if it does not exist
+
+	private:
+		const char *getSectionData(const std::string &name, size_t size) const;
+
+		std::vector<std::pair<std::string, std::vector<char>>> sections_; //!< to be saved, in the order they were added
+		std::unique_ptr<MappedFile> mapped_file_;
+		std::map<std::string, std::pair<uint64_t, uint64_t>> loaded_sections_; //!< offset and size in the mapped file of each section
+};
+
+template <typename T> void RenderCheckpoint::add(const std::string &name, const T *values, size_t num_values)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "T must be a trivially copyable type");
+	std::vector<char> data(num_values * sizeof(T));
+	if(num_values > 0) std::memcpy(data.data(), values, data.size());
+	sections_.emplace_back(name, std::move(data));
+}
+
+template <typename T> const T *RenderCheckpoint::get(const std::string &name, size_t num_values) const
+{
+	static_assert(std::is_trivially_copyable<T>::value, "T must be a trivially copyable type");
+	return reinterpret_cast<const T *>(getSectionData(name, num_values * sizeof(T)));
+}
+
+template <typename T, typename Alloc> bool RenderCheckpoint::get(const std::string &name, std::vector<T, Alloc> &values) const
+{
+	const T *data = get<T>(name, values.size());
+	if(!data) return false;
+	std::copy(data, data + values.size(), values.begin());
+	return true;
+}
+
+template <typename T> bool RenderCheckpoint::getValue(const std::string &name, T &value) const
+{
+	const T *data = get<T>(name, 1);
+	if(!data) return false;
+	std::memcpy(&value, data, sizeof(T));
+	return true;
+}
+
+END_YAFARAY
+
+#endif // YAFARAY_RENDER_CHECKPOINT_H
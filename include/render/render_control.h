@@ -22,12 +22,47 @@
 
 #include "constants.h"
 #include "common/thread.h"
+#include "common/timer.h"
+#include <chrono>
+#include <vector>
 
 BEGIN_YAFARAY
 
+//! Receives the render progress from the render threads, for the renders started with Interface::renderAsync
+class RenderListener
+{
+	public:
+		virtual ~RenderListener() = default;
+		virtual void areaFinished(int x_0, int y_0, int x_1, int y_1) = 0;
+		virtual void passesCompleted(int num_passes) = 0; //!< number of passes of the current render view completed so far
+};
+
+/*! Snapshot of the progress of the render in progress, for example for a render farm scheduler polling it to decide
+	preemptions and rebalancing. The rates are averages since the start of the render */
+struct LIBYAFARAY_EXPORT RenderProgressStats
+{
+	std::string toJson() const;
+	double elapsed_seconds_ = 0.0; //!< since the start of the render
+	uint64_t rays_ = 0; //!< closest hit rays of the finished tiles
+	uint64_t shadow_rays_ = 0; //!< shadow and transparent shadow rays of the finished tiles
+	uint64_t camera_samples_ = 0; //!< of the finished tiles
+	double rays_per_second_ = 0.0;
+	double shadow_rays_per_second_ = 0.0;
+	double camera_samples_per_second_ = 0.0;
+	int current_pass_ = 0;
+	int total_passes_ = 0;
+	float current_pass_percent_ = 0.f;
+	double pass_eta_seconds_ = -1.0; //!< estimated time left of the current pass from the measured cost per pixel of its finished tiles, -1 if not known yet
+	double eta_seconds_ = -1.0; //!< estimated time left of the render, assuming the passes left render as many pixels as the current one, so it is an upper bound with adaptive AA. -1 if not known yet
+	std::vector<double> thread_busy_ratios_; //!< fraction of the elapsed time each render thread spent rendering tiles, the rest is idle waiting for tiles, passes or the preprocesses
+	int64_t memory_bytes_ = 0; //!< current tracked memory, see MemoryStats
+};
+
 class LIBYAFARAY_EXPORT RenderControl final
 {
 	public:
+		void setListener(RenderListener *listener) { listener_ = listener; } //!< set before the render starts and removed after it ends
+		void notifyAreaFinished(int x_0, int y_0, int x_1, int y_1) const { if(listener_) listener_->areaFinished(x_0, y_0, x_1, y_1); }
 		void setStarted();
 		void setResumed();
 		void setFinished();
@@ -37,6 +72,9 @@ class LIBYAFARAY_EXPORT RenderControl final
 		void setCurrentPassPercent(float current_pass_percent);
 		void setRenderInfo(const std::string &render_settings);
 		void setAaNoiseInfo(const std::string &aa_noise_settings);
+		void setPassPixels(int pass_pixels, int num_threads); //!< number of pixels to be rendered in the pass starting and number of render threads rendering them
+		void addTileStats(int thread_id, int pixels, float seconds, uint64_t rays, uint64_t shadow_rays, uint64_t camera_samples); //!< called by the render threads after each finished tile
+		RenderProgressStats getProgressStats() const; //!< thread safe, can be polled while rendering
 
 		bool inProgress() const;
 		bool resumed() const;
@@ -47,6 +85,7 @@ class LIBYAFARAY_EXPORT RenderControl final
 		float currentPassPercent() const;
 		std::string getRenderInfo() const { return render_info_; }
 		std::string getAaNoiseInfo() const { return aa_noise_info_; }
+		Timer &getTimer() const { return timer_; } //!< render and preprocess times of the scene renders, also measured from the const render stages
 
 	private:
 		bool render_in_progress_ = false;
@@ -58,8 +97,21 @@ class LIBYAFARAY_EXPORT RenderControl final
 		float current_pass_percent_ = 0.f;
 		std::string render_info_;
 		std::string aa_noise_info_;
+		RenderListener *listener_ = nullptr;
+
+		std::chrono::steady_clock::time_point render_start_;
+		uint64_t rays_ = 0;
+		uint64_t shadow_rays_ = 0;
+		uint64_t camera_samples_ = 0;
+		int pass_pixels_ = 0;
+		int pass_pixels_done_ = 0;
+		double pass_tile_seconds_ = 0.0; //!< sum of the render times of the finished tiles of the current pass
+		int64_t total_pixels_done_ = 0;
+		double total_tile_seconds_ = 0.0;
+		std::vector<double> thread_busy_seconds_;
+		mutable Timer timer_;
 
-		std::mutex mutx_;
+		mutable std::mutex mutx_;
 };
 
 END_YAFARAY
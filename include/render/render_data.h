@@ -21,11 +21,14 @@
 #define YAFARAY_RENDER_DATA_H
 
 #include "constants.h"
+#include "common/memory_arena.h"
+#include <vector>
 
 BEGIN_YAFARAY
 
 class Random;
 class Camera;
+class Primitive;
 
 class RenderData final
 {
@@ -58,7 +61,28 @@ class RenderData final
 		float time_ = 0.f; //!< the current (normalized) frame time
 		const Camera *cam_ = nullptr;
 		Random *const prng_ = nullptr; //!< a pseudorandom number generator
-		mutable void *arena_ = nullptr; //!< a fixed amount of memory where materials may keep data to avoid recalculations...really need better memory management :(
+		mutable MemoryArena arena_ {arena_block_size_}; //!< bump allocator of this render thread for the material data and the scratch buffers of the photon gathers, reset by the integrators for each sample
+		mutable void *material_data_ = nullptr; //!< data of the material being evaluated, where materials keep surface point specific data to avoid recalculations
+		mutable std::vector<const Primitive *> light_occluders_; //!< last primitive found blocking the shadow rays of each light in this thread, tested first by the next shadow rays of the light
+		const Primitive **primary_hit_ = nullptr; //!< slot of the primary hit cache of the camera sample being integrated, only used by its first intersection
+		const Primitive **takePrimaryHit() { const Primitive **primary_hit = primary_hit_; primary_hit_ = nullptr; return primary_hit; } //!< so the next rays of the sample are not bounded by the camera ray hit
+		//! statistics of the samples of a light in the area rendered, for the adaptive light samples
+		struct LightSampleStats
+		{
+			double sum_ = 0.0, sum_2_ = 0.0; //!< of the luminance of the light samples
+			int num_samples_ = 0;
+			int allocated_samples_ = 0; //!< samples of the next estimations of the light, 0 to use its own number of samples
+		};
+		mutable std::vector<LightSampleStats> light_sample_stats_; //!< of each light, the render data being created for each area rendered
+		mutable int light_estimations_ = 0; //!< area light estimations since the last allocation of the light samples
+
+		static constexpr size_t material_data_alignment_ = 16; //!< alignment of the material data blocks, enough for any material data type
+		static constexpr size_t alignMaterialDataSize(size_t size) { return (size + material_data_alignment_ - 1) & ~(material_data_alignment_ - 1); }
+		/*! Allocates the data of a material with the given required memory (see Material::getReqMem()) */
+		void *allocMaterialData(size_t size) const { return arena_.alloc(size, material_data_alignment_); }
+
+	private:
+		static constexpr uint32_t arena_block_size_ = 16384;
 };
 
 END_YAFARAY
@@ -25,6 +25,7 @@
 #include "constants.h"
 #include "common/collection.h"
 #include "common/memory.h"
+#include "sampler/sample_pdf1d.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -43,10 +44,13 @@ class RenderView final
 		bool init(const Scene &scene);
 		std::string getName() const { return name_; }
 		const Camera *getCamera() const { return camera_; }
+		std::string getCameraName() const { return camera_name_; } //!< the camera is only found by init, this is for the scene setup before it
 		const std::map<std::string, Light *> getLights() const { return lights_; }
 		bool isSpectral() const { return wavelength_ != 0.f; }
 		float getWaveLength() const { return wavelength_; }
 		const std::vector<const Light *> getLightsVisible() const;
+		/*! Distribution to select the visible lights proportionally to their total emitted energy, in the same order as getLightsVisible(). Shared by the integrators, nullptr if there are no visible lights or all of them have zero energy */
+		const Pdf1D *getLightsVisiblePowerPdf() const { return lights_visible_power_pdf_.get(); }
 		const std::vector<const Light *> getLightsEmittingCausticPhotons() const;
 		const std::vector<const Light *> getLightsEmittingDiffusePhotons() const;
 
@@ -58,6 +62,7 @@ class RenderView final
 		float wavelength_ = 0.f;
 		const Camera *camera_ = nullptr;
 		std::map<std::string, Light *> lights_;
+		std::unique_ptr<Pdf1D> lights_visible_power_pdf_;
 };
 
 END_YAFARAY
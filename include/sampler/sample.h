@@ -85,6 +85,63 @@ Vec3 inline cone(const Vec3 &d, const Vec3 &u, const Vec3 &v, float max_cos_ang,
 	return (u * math::cos(t_1) + v * math::sin(t_1)) * sin_ang + d * cos_ang;
 }
 
+//! solid angle of the spherical triangle with the given normalized vertices (Van Oosterom and Strackee)
+
+float inline sphericalTriangleArea(const Vec3 &a, const Vec3 &b, const Vec3 &c)
+{
+	const float det = std::abs(a * (b ^ c));
+	return 2.f * std::atan2(det, 1.f + a * b + b * c + c * a);
+}
+
+//! Uniformly sample the solid angle of the spherical triangle with the given normalized vertices ("Stratified sampling of spherical triangles", Arvo 1995). Using doubles because the triangles seen from far away are very small...
+
+Vec3 inline sphericalTriangle(const Vec3 &a, const Vec3 &b, const Vec3 &c, float s_1, float s_2)
+{
+	const double a_x = a.x_, a_y = a.y_, a_z = a.z_;
+	const double b_x = b.x_, b_y = b.y_, b_z = b.z_;
+	const double c_x = c.x_, c_y = c.y_, c_z = c.z_;
+	//normals of the planes of the triangle sides, the vertex angles are the angles between them
+	auto cross = [](double u_x, double u_y, double u_z, double v_x, double v_y, double v_z, double *n)
+	{
+		n[0] = u_y * v_z - u_z * v_y;
+		n[1] = u_z * v_x - u_x * v_z;
+		n[2] = u_x * v_y - u_y * v_x;
+		const double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if(len > 0.0) for(int i = 0; i < 3; ++i) n[i] /= len;
+	};
+	auto angle = [](const double *u, const double *v) { return std::acos(std::max(-1.0, std::min(1.0, -(u[0] * v[0] + u[1] * v[1] + u[2] * v[2])))); };
+	double n_ab[3], n_bc[3], n_ca[3];
+	cross(a_x, a_y, a_z, b_x, b_y, b_z, n_ab);
+	cross(b_x, b_y, b_z, c_x, c_y, c_z, n_bc);
+	cross(c_x, c_y, c_z, a_x, a_y, a_z, n_ca);
+	const double alpha = angle(n_ab, n_ca);
+	const double beta = angle(n_bc, n_ab);
+	const double gamma = angle(n_ca, n_bc);
+	//the first sample selects the sub-triangle with a fraction of the area, which sets the new vertex c_p along the side ac
+	const double area_sub = s_1 * (alpha + beta + gamma - M_PI);
+	const double sin_alpha = std::sin(alpha), cos_alpha = std::cos(alpha);
+	const double s = std::sin(area_sub - alpha), t = std::cos(area_sub - alpha);
+	const double cos_c = a_x * b_x + a_y * b_y + a_z * b_z;
+	const double u = t - cos_alpha;
+	const double v = s + sin_alpha * cos_c;
+	const double den = (v * s + u * t) * sin_alpha;
+	const double q = (den != 0.0) ? std::max(-1.0, std::min(1.0, ((v * t - u * s) * cos_alpha - v) / den)) : 1.0;
+	const double cos_b = a_x * c_x + a_y * c_y + a_z * c_z;
+	double ca_x = c_x - cos_b * a_x, ca_y = c_y - cos_b * a_y, ca_z = c_z - cos_b * a_z;
+	const double ca_len = std::sqrt(ca_x * ca_x + ca_y * ca_y + ca_z * ca_z);
+	if(ca_len > 0.0) { ca_x /= ca_len; ca_y /= ca_len; ca_z /= ca_len; }
+	const double sin_q = std::sqrt(std::max(0.0, 1.0 - q * q));
+	const double cp_x = q * a_x + sin_q * ca_x, cp_y = q * a_y + sin_q * ca_y, cp_z = q * a_z + sin_q * ca_z;
+	//the second sample sets the point along the arc from b to c_p
+	const double cos_cp_b = cp_x * b_x + cp_y * b_y + cp_z * b_z;
+	const double z = 1.0 - s_2 * (1.0 - cos_cp_b);
+	double cpb_x = cp_x - cos_cp_b * b_x, cpb_y = cp_y - cos_cp_b * b_y, cpb_z = cp_z - cos_cp_b * b_z;
+	const double cpb_len = std::sqrt(cpb_x * cpb_x + cpb_y * cpb_y + cpb_z * cpb_z);
+	if(cpb_len > 0.0) { cpb_x /= cpb_len; cpb_y /= cpb_len; cpb_z /= cpb_len; }
+	const double sin_z = std::sqrt(std::max(0.0, 1.0 - z * z));
+	return Vec3(static_cast<float>(z * b_x + sin_z * cpb_x), static_cast<float>(z * b_y + sin_z * cpb_y), static_cast<float>(z * b_z + sin_z * cpb_z));
+}
+
 // rotate the coord-system D, U, V with minimum rotation so that D gets
 // mapped to D2, i.e. rotate around D^D2.
 // V is assumed to be D^U, accordingly V2 is D2^U2; all input vectors must be normalized!
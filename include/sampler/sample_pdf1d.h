@@ -24,27 +24,39 @@
 #include "sampler/sample.h"
 #include "common/logger.h"
 #include <cstring>
+#include <vector>
+#include <algorithm>
 
 BEGIN_YAFARAY
 
 /*! class that holds a 1D probability distribution function (pdf) and is also able to
 	take samples from it. In order to do this the cumulative distribution function (cdf)
-	is also calculated on construction.
+	is also calculated on construction, together with an alias table (Vose's method) to
+	take the samples in constant time instead of the binary search over the cdf.
 */
 
 class Pdf1D final
 {
 	public:
 		static void inline cumulateStep1DDf(const float *f, int n_steps, float *integral, float *cdf);
+		void buildAliasTable();
 		Pdf1D() = default;
 		Pdf1D(float *f, int n);
 		float sample(float u, float *pdf) const;
 		// take a discrete sample.
 		// determines an index in the array from which the CDF was taked from, rather than a sample in [0;1]
 		int dSample(float u, float *pdf) const;
+		/*! discrete sample with the alias table, in constant time. The sampled index keeps the pdf of dSample but not its cdf order,
+			so the nearby values of u do not always give nearby indices. The u_remapped (if not null) is a new uniform value in [0, 1)
+			taken from the remaining bits of u, to sample inside the selected step */
+		int dSampleAlias(float u, float *pdf, float *u_remapped) const;
+		//! continuous sample with the alias table, the offset along the selected step is the remapped u
+		float sampleAlias(float u, float *pdf) const;
 		// Distribution1D Data
 
 		std::unique_ptr<float[]> func_, cdf_;
+		std::unique_ptr<float[]> alias_prob_; //!< probability of keeping each step instead of jumping to its alias
+		std::unique_ptr<int[]> alias_;
 		float integral_, inv_integral_, inv_count_;
 		int count_;
 };
@@ -58,6 +70,39 @@ inline Pdf1D::Pdf1D(float *f, int n)
 	cumulateStep1DDf(func_.get(), n, &integral_, cdf_.get());
 	inv_integral_ = 1.f / integral_;
 	inv_count_ = 1.f / count_;
+	buildAliasTable();
+}
+
+inline void Pdf1D::buildAliasTable()
+{
+	alias_prob_ = std::unique_ptr<float[]>(new float[count_]);
+	alias_ = std::unique_ptr<int[]>(new int[count_]);
+	//Probabilities scaled by the number of steps, so the average step has 1
+	std::vector<double> scaled(count_);
+	std::vector<int> small, large;
+	for(int i = 0; i < count_; ++i)
+	{
+		scaled[i] = integral_ > 0.f ? static_cast<double>(func_[i]) * static_cast<double>(inv_integral_) : 1.0;
+		alias_[i] = i;
+		if(scaled[i] < 1.0) small.push_back(i);
+		else large.push_back(i);
+	}
+	while(!small.empty() && !large.empty())
+	{
+		const int s = small.back(), l = large.back();
+		small.pop_back();
+		alias_prob_[s] = static_cast<float>(scaled[s]);
+		alias_[s] = l;
+		scaled[l] -= 1.0 - scaled[s];
+		if(scaled[l] < 1.0)
+		{
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	//What remains in any list only differs from 1 by the rounding errors
+	for(const int l : large) alias_prob_[l] = 1.f;
+	for(const int s : small) alias_prob_[s] = 1.f;
 }
 
 inline void Pdf1D::cumulateStep1DDf(const float *f, int n_steps, float *integral, float *cdf)
@@ -109,6 +154,31 @@ inline int Pdf1D::dSample(float u, float *pdf) const
 	return index;
 }
 
+inline int Pdf1D::dSampleAlias(float u, float *pdf, float *u_remapped) const
+{
+	const float scaled = u * count_;
+	int index = std::min(static_cast<int>(scaled), count_ - 1);
+	//Below 1 even when u is 1 or u * count_ rounds up, so the entries kept with probability 1 never divide 0 by 0
+	float frac = std::min(scaled - index, 0.99999994f);
+	const float prob = alias_prob_[index];
+	if(frac < prob) frac /= prob;
+	else
+	{
+		frac = (frac - prob) / (1.f - prob);
+		index = alias_[index];
+	}
+	if(pdf) *pdf = func_[index] * inv_integral_;
+	if(u_remapped) *u_remapped = std::min(frac, 0.99999994f);
+	return index;
+}
+
+inline float Pdf1D::sampleAlias(float u, float *pdf) const
+{
+	float delta;
+	const int index = dSampleAlias(u, pdf, &delta);
+	return index + delta;
+}
+
 END_YAFARAY
 
 #endif //YAFARAY_SAMPLE_PDF1D_H
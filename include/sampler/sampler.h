@@ -0,0 +1,68 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_SAMPLER_H
+#define YAFARAY_SAMPLER_H
+
+#include "constants.h"
+#include "common/aa_noise_params.h"
+#include <memory>
+#include <array>
+
+BEGIN_YAFARAY
+
+/*! Low discrepancy samples used by the integrators. Each sample is selected by its dimension and by its index
+ * within the pixel, while the seed (the sampling offset of the pixel) decorrelates the samples of the different pixels */
+class Sampler
+{
+	public:
+		static std::unique_ptr<Sampler> factory(AaNoiseParams::SamplerType type);
+		virtual ~Sampler() = default;
+		virtual float sample(int dimension, unsigned int index, unsigned int seed) const = 0;
+};
+
+/*! Faure scrambled Halton sequence, the seed is added to the index as in the classic sampling offsets. The dimension 1 is the base 2 */
+class SamplerHalton final : public Sampler
+{
+	public:
+		virtual float sample(int dimension, unsigned int index, unsigned int seed) const override;
+};
+
+/*! Owen scrambled Sobol sequence with the hash based nested uniform scrambling of Burley, "Practical Hash-based
+ * Owen Scrambling" (2020). The index is shuffled and the points are scrambled with seeds derived from the pixel seed,
+ * so each pixel gets an independent randomization of the same well stratified sequence. The dimensions are padded
+ * in groups of 4 Sobol dimensions, each group with its own seed */
+class SamplerSobol final : public Sampler
+{
+	public:
+		SamplerSobol();
+		virtual float sample(int dimension, unsigned int index, unsigned int seed) const override;
+
+	private:
+		static constexpr int num_dimensions_ = 4;
+		static uint32_t reverseBits(uint32_t x);
+		static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed);
+		static uint32_t hashCombine(uint32_t seed, uint32_t value) { return seed ^ (value + (seed << 6) + (seed >> 2)); }
+		uint32_t sobol(uint32_t index, int dimension) const;
+		std::array<std::array<uint32_t, 32>, num_dimensions_> directions_; //!< generator matrices of the first Sobol dimensions, one column per bit of the index
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_SAMPLER_H
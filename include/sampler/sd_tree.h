@@ -0,0 +1,123 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_SD_TREE_H
+#define YAFARAY_SD_TREE_H
+
+#include "constants.h"
+#include "geometry/bound.h"
+#include <vector>
+#include <array>
+#include <atomic>
+
+BEGIN_YAFARAY
+
+/*! Quadtree over the directions, mapped to the unit square with the cylindrical equal-area mapping (cos theta, phi),
+	storing the incident radiance recorded in each cell. The cells receiving more energy are subdivided more, so
+	the directions can be sampled approximately proportionally to the incident radiance. The recorded values are
+	atomic, so all the render threads can record into the same tree while its structure is not modified */
+class DirectionalQuadtree final
+{
+	public:
+		DirectionalQuadtree();
+		DirectionalQuadtree(const DirectionalQuadtree &tree);
+		DirectionalQuadtree &operator=(const DirectionalQuadtree &tree);
+		void record(const Vec3 &dir, float value); //!< adds the value to the leaf cell containing the direction
+		void build(); //!< propagates the recorded values from the leaves to the root, so the tree can be sampled
+		/*! Resets the recorded values, subdividing the cells with more than the threshold fraction of the energy of the reference tree and merging the ones with less */
+		void refine(const DirectionalQuadtree &reference, float subdivision_threshold, int max_depth);
+		Vec3 sample(float s_1, float s_2) const;
+		float pdf(const Vec3 &dir) const; //!< solid angle pdf of sampling the direction, 0 if the tree has no energy
+		float getTotal() const { return total_; }
+		void addSample() { num_samples_.fetch_add(1, std::memory_order_relaxed); }
+		int getNumSamples() const { return num_samples_.load(std::memory_order_relaxed); }
+		void setNumSamples(int num_samples) { num_samples_.store(num_samples, std::memory_order_relaxed); }
+		int getNumNodes() const { return static_cast<int>(nodes_.size()); }
+
+	private:
+		struct Node;
+		static std::array<float, 2> dirToSquare(const Vec3 &dir);
+		static Vec3 squareToDir(float u, float v);
+		static int childIndex(std::array<float, 2> &p); //!< child containing the point, which is remapped to the child cell
+		static void atomicAdd(std::atomic<float> &value, float addend);
+		float buildNode(size_t node_id);
+
+		std::vector<Node> nodes_;
+		float total_ = 0.f; //!< energy of the whole tree, only valid after build()
+		std::atomic<int> num_samples_ {0};
+};
+
+/*! The children are numbered x + 2 * y, x and y being 0 for the lower half of the cell and 1 for the upper half */
+struct DirectionalQuadtree::Node
+{
+	Node() { for(auto &sum : sums_) sum.store(0.f, std::memory_order_relaxed); }
+	Node(const Node &node) : children_(node.children_) { for(int i = 0; i < 4; ++i) sums_[i].store(node.sums_[i].load(std::memory_order_relaxed), std::memory_order_relaxed); }
+	Node &operator=(const Node &node) { children_ = node.children_; for(int i = 0; i < 4; ++i) sums_[i].store(node.sums_[i].load(std::memory_order_relaxed), std::memory_order_relaxed); return *this; }
+	float sum() const { return sums_[0].load(std::memory_order_relaxed) + sums_[1].load(std::memory_order_relaxed) + sums_[2].load(std::memory_order_relaxed) + sums_[3].load(std::memory_order_relaxed); }
+	std::array<std::atomic<float>, 4> sums_;
+	std::array<uint32_t, 4> children_ {{0, 0, 0, 0}}; //!< 0 if the child is a leaf cell, as the root can never be a child
+};
+
+/*! Spatial-directional tree for path guiding (as in Mueller et al. 2017 "Practical Path Guiding"): a binary tree
+	over the scene bound, splitting the cells alternately along the three axes, with a sampling and a recording
+	directional quadtree in each leaf. The sampling quadtrees learnt in a pass are used to guide the paths of the
+	next pass while the recording ones gather their incident radiance, then update() refines both trees */
+class SdTree final
+{
+	public:
+		struct Parameters
+		{
+			int spatial_threshold_ = 12000; //!< spatial leaves with more recorded samples than this are split
+			float directional_threshold_ = 0.01f; //!< directional cells with more than this fraction of the energy are subdivided
+			int max_spatial_depth_ = 48;
+			int max_directional_depth_ = 20;
+		};
+		SdTree(const Bound &bound, const Parameters &parameters);
+		const DirectionalQuadtree *getSamplingTree(const Point3 &p) const; //!< sampling quadtree at the point, nullptr if it has no energy yet
+		void record(const Point3 &p, const Vec3 &dir, float value, const std::array<float, 3> &jitter); //!< the jitter, in [0, 1), is used to filter the record position
+		/*! Called between passes, when no thread is recording: the recorded quadtrees become the sampling ones, the spatial leaves with many samples are split and the recording quadtrees are refined from the new sampling ones */
+		void update();
+		int getNumLeaves() const { return static_cast<int>(leaves_.size()); }
+		int getNumDirectionalNodes() const;
+
+	private:
+		struct Node
+		{
+			int axis_ = 0;
+			std::array<uint32_t, 2> children_ {{0, 0}};
+			int leaf_ = -1; //!< index in leaves_, -1 for the interior nodes
+		};
+		struct Leaf
+		{
+			DirectionalQuadtree sampling_;
+			DirectionalQuadtree recording_;
+		};
+		int findLeaf(const Point3 &p, Vec3 *leaf_size = nullptr) const; //!< optionally returns the size of the leaf cell
+		void splitLeaf(uint32_t node_id, int depth);
+
+		Bound bound_;
+		Vec3 inv_size_;
+		Parameters parameters_;
+		std::vector<Node> nodes_;
+		std::vector<Leaf> leaves_;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_SD_TREE_H
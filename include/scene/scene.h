@@ -29,9 +29,12 @@
 #include "common/aa_noise_params.h"
 #include "geometry/bound.h"
 #include "common/memory.h"
+#include "common/param.h"
+#include "common/session.h"
 #include <vector>
 #include <map>
 #include <list>
+#include <set>
 
 BEGIN_YAFARAY
 
@@ -40,6 +43,7 @@ class Material;
 class VolumeHandler;
 class VolumeRegion;
 class Texture;
+class HostPixelBuffer;
 class Camera;
 class Background;
 class ShaderNode;
@@ -57,6 +61,8 @@ class SurfacePoint;
 class Matrix4;
 class Rgb;
 class RenderData;
+class Primitive;
+struct AcceleratorStats;
 enum class DarkDetectionType : int;
 
 typedef unsigned int ObjId_t;
@@ -74,6 +80,15 @@ typedef unsigned int ObjId_t;
 class LIBYAFARAY_EXPORT Scene
 {
 	public:
+		//! wall clock seconds spent in each phase of the last render, the view phases added for all the render views
+		struct RenderTimes
+		{
+			double textures_ = 0.0;
+			double accelerator_build_ = 0.0;
+			double preprocess_ = 0.0;
+			double render_ = 0.0;
+			double output_ = 0.0;
+		};
 		static std::unique_ptr<Scene> factory(ParamMap &params);
 		Scene();
 		Scene(const Scene &s) = delete;
@@ -83,33 +98,65 @@ class LIBYAFARAY_EXPORT Scene
 		virtual void addNormal(const Vec3 &n) = 0;
 		virtual bool addFace(const std::vector<int> &vert_indices, const std::vector<int> &uv_indices = {}) = 0;
 		virtual int addUv(float u, float v) = 0;
+		/*! Bulk versions of the functions above, taking contiguous buffers: x, y, z per vertex/normal, u, v per uv and 3 vertex/uv indices per triangle.
+		 *  addVertices and addUvs return the index of the first element added, or -1 on error */
+		virtual int addVertices(const float *vertices, size_t num_vertices, const float *orco = nullptr) = 0;
+		virtual bool addNormals(const float *normals, size_t num_normals) = 0;
+		virtual bool addFaces(const int *vert_indices, size_t num_faces, const int *uv_indices = nullptr) = 0;
+		virtual int addUvs(const float *uvs, size_t num_uvs) = 0;
 		virtual bool smoothNormals(const std::string &name, float angle) = 0;
 		virtual Object *createObject(const std::string &name, ParamMap &params) = 0;
 		virtual bool endObject() = 0;
 		virtual bool addInstance(const std::string &base_object_name, const Matrix4 &obj_to_world) = 0;
+		/*! Adds num_instances instances of the base object at once, keeping only their transformations (no per-instance objects nor primitives).
+		 *  obj_to_world has the 3 first rows of the matrix of each instance, 12 floats per instance in row-major order */
+		virtual bool addInstances(const std::string &base_object_name, const float *obj_to_world, size_t num_instances) = 0;
+		/*! Transform-only update of an existing instance, instance_number being the order in which the instances of the base object were added.
+		 *  If there are no other geometry changes, the accelerator is refitted instead of rebuilt when possible */
+		virtual bool updateInstance(const std::string &base_object_name, size_t instance_number, const Matrix4 &obj_to_world) = 0;
+		virtual size_t getNumInstances(const std::string &base_object_name) const = 0; //!< number of instances added for the base object
+		/*! Registers the lod object as a level of detail of the base object, used by the instances of the base object whose bound projects
+		 *  on at most max_screen_size pixels (diameter) in the camera of the first render view, see "lod_hysteresis". The lod object becomes
+		 *  a base object itself, so it is not rendered on its own. Only the levels chosen for some instance get an accelerator */
+		virtual bool addObjectLod(const std::string &base_object_name, const std::string &lod_object_name, float max_screen_size) = 0;
+		virtual bool hasObjectLods() const { return false; } //!< the accelerator depends on the camera, so the camera updates rebuild it
 		virtual bool updateObjects() = 0;
-		virtual bool intersect(const Ray &ray, SurfacePoint &sp) const = 0;
-		virtual bool intersect(const DiffRay &ray, SurfacePoint &sp) const = 0;
-		virtual bool isShadowed(const RenderData &render_data, const Ray &ray, float &obj_index, float &mat_index) const = 0;
+		/*! If primary_hit is not null, the primitive it points to is intersected first and only closer hits are searched in the accelerator, as it is often
+		 *  hit again by the camera rays of the same pixel in the next passes, and it is updated with the primitive hit */
+		virtual bool intersect(const Ray &ray, SurfacePoint &sp, const Primitive **primary_hit = nullptr) const = 0;
+		virtual bool intersect(const DiffRay &ray, SurfacePoint &sp, const Primitive **primary_hit = nullptr) const = 0;
+		/*! If last_occluder is not null, the primitive it points to is tested first, as it often blocks the next shadow rays towards the same light, and it is updated with the blocking primitive found */
+		virtual bool isShadowed(const RenderData &render_data, const Ray &ray, float &obj_index, float &mat_index, const Primitive **last_occluder = nullptr) const = 0;
 		virtual bool isShadowed(RenderData &render_data, const Ray &ray, int max_depth, Rgb &filt, float &obj_index, float &mat_index) const = 0;
+		/*! Ray stream versions for coherent rays, faster than intersecting the rays one by one with some accelerators */
+		virtual std::vector<bool> intersect(const std::vector<Ray> &rays, std::vector<SurfacePoint> &sp) const = 0;
+		virtual std::vector<bool> isShadowed(const RenderData &render_data, const std::vector<Ray> &rays, const Primitive **last_occluder = nullptr) const = 0;
 		virtual Object *getObject(const std::string &name) const = 0;
+		virtual std::vector<const Object *> getObjects() const = 0; //!< all the objects and instances in the scene
+		virtual AcceleratorStats getAcceleratorStats() const = 0; //!< build counters of the scene accelerator and traversal counters since the start of the last render
 
 		ObjId_t getNextFreeId();
 		bool startObjects();
-		bool endObjects();
+		virtual bool endObjects();
 		void setBackground(std::shared_ptr<Background> bg);
 		void setSurfIntegrator(SurfaceIntegrator *s);
 		SurfaceIntegrator *getSurfIntegrator() const { return surf_integrator_; }
+		const RenderTimes &getRenderTimes() const { return render_times_; }
+		uint64_t getNumCameraSamples() const { return num_camera_samples_; } //!< camera samples integrated by the last render, in all the render views
 		void setVolIntegrator(VolumeIntegrator *v);
 		void setAntialiasing(const AaNoiseParams &aa_noise_params) { aa_noise_params_ = aa_noise_params; };
 		void setNumThreads(int threads);
 		void setNumThreadsPhotons(int threads_photons);
+		void setThreadsPinning(bool threads_pinning) { threads_pinning_ = threads_pinning; }
+		void setShadingSortByMaterial(bool shading_sort_by_material) { shading_sort_by_material_ = shading_sort_by_material; }
+		void setPrimaryHitCache(bool primary_hit_cache) { primary_hit_cache_ = primary_hit_cache; }
 		void setCurrentMaterial(const Material *material);
 		const Material *getCurrentMaterial() const { return creation_state_.current_material_; }
 		void createDefaultMaterial();
 		void clearNonObjects();
 		void clearAll();
 		bool render();
+		void completePendingTextures(); //!< completes the deferred loading of the textures created since the last call, in parallel. Called before creating the scene items using textures, and before rendering
 
 		Background *getBackground() const;
 		const ImageFilm *getImageFilm() const { return image_film_.get(); }
@@ -117,11 +164,20 @@ class LIBYAFARAY_EXPORT Scene
 		Bound getSceneBound() const;
 		int getNumThreads() const { return nthreads_; }
 		int getNumThreadsPhotons() const { return nthreads_photons_; }
+		bool getThreadsPinning() const { return threads_pinning_; }
+		bool getShadingSortByMaterial() const { return shading_sort_by_material_; }
+		bool getPrimaryHitCache() const { return primary_hit_cache_; }
 		AaNoiseParams getAaParameters() const { return aa_noise_params_; }
 		const RenderControl &getRenderControl() const { return render_control_; }
 		RenderControl &getRenderControl() { return render_control_; }
+		Session &getSession() const { return session_; } //!< updated by the const render stages, as the photon maps shot by the integrators preprocess
+		const std::string &getAssetCacheDir() const { return asset_cache_dir_; }
+		HugePages::Mode getHugePagesMode() const { return huge_pages_mode_; }
 		Material *getMaterial(const std::string &name) const;
+		Material *getMaterial(const std::string &name); //!< also creates the material if its creation was deferred, see lazy_creation_
 		Texture *getTexture(const std::string &name) const;
+		bool addImageBuffer(const std::string &name, std::shared_ptr<const HostPixelBuffer> pixel_buffer); //!< replaces the buffer with the same name, the textures created before keep using the previous one
+		std::shared_ptr<const HostPixelBuffer> getImageBuffer(const std::string &name) const;
 		ShaderNode *getShaderNode(const std::string &name) const;
 		Camera *getCamera(const std::string &name) const;
 		Light *getLight(const std::string &name) const;
@@ -145,6 +201,12 @@ class LIBYAFARAY_EXPORT Scene
 		RenderView *createRenderView(const std::string &name, ParamMap &params);
 		ColorOutput *createOutput(const std::string &name, ParamMap &params, bool auto_delete = true);
 		ColorOutput *createOutput(const std::string &name, UniquePtr_t<ColorOutput> output, bool auto_delete = true);
+		/*! Replace an existing camera, material or light with a new one made from the parameters (or create it if there is none yet), for the
+		 * interactive re-renders. The next render only updates what depends on the replaced item: the accelerator is kept, and the lights are
+		 * not initialized again for a camera or material change */
+		Camera *updateCamera(const std::string &name, ParamMap &params);
+		Material *updateMaterial(const std::string &name, ParamMap &params, std::list<ParamMap> &eparams);
+		Light *updateLight(const std::string &name, ParamMap &params);
 		bool removeOutput(const std::string &name);
 		void clearOutputs();
 		std::map<std::string, UniquePtr_t<ColorOutput>> &getOutputs() { return outputs_; }
@@ -168,7 +230,7 @@ class LIBYAFARAY_EXPORT Scene
 		struct CreationState
 		{
 			enum State { Ready, Geometry, Object };
-			enum Flags { CNone = 0, CGeom = 1, CLight = 1 << 1, COther = 1 << 2, CAll = CGeom | CLight | COther };
+			enum Flags { CNone = 0, CGeom = 1, CLight = 1 << 1, COther = 1 << 2, CTransform = 1 << 3, CCamera = 1 << 4, CMaterial = 1 << 5, CAll = CGeom | CLight | COther | CTransform | CCamera | CMaterial };
 			std::list<State> stack_;
 			unsigned int changes_;
 			ObjId_t next_free_id_;
@@ -176,10 +238,37 @@ class LIBYAFARAY_EXPORT Scene
 		} creation_state_;
 		Bound scene_bound_; //!< bounding box of all (finite) scene geometry
 		std::string scene_accelerator_;
+		bool scene_accelerator_two_level_ = true; //!< intersect instances in object space using one accelerator per base object, instead of flattening all the instanced primitives
+		std::string scene_accelerator_cache_dir_; //!< if not empty, directory where the accelerators supporting it save their built trees, to load them instead of rebuilding when the geometry did not change
+		bool scene_accelerator_spatial_splits_ = false; //!< BVH spatial splits, for scenes with long thin primitives
+		float scene_accelerator_spatial_split_budget_ = 0.3f; //!< maximum duplicated references of the spatial splits, relative to the number of primitives
 		std::map<std::string, std::unique_ptr<Light>> lights_;
 		std::map<std::string, std::unique_ptr<Material>> materials_;
+		//! materials and lights replaced by the updates, kept until the scene is cleared so the pointers still held by the previous render stay valid and are never reused by new items
+		std::vector<std::unique_ptr<Material>> retired_materials_;
+		std::vector<std::unique_ptr<Light>> retired_lights_;
+		/*! With the "lazy_creation" scene parameter the materials are created the first time an object or another material uses them,
+		 * and only the textures used by the created materials, shader nodes, backgrounds and volumes are loaded, so the unused
+		 * items of library scenes cost neither their creation time nor their memory. Interface::createMaterial returns nullptr for them */
+		bool lazy_creation_ = false;
+		bool dedup_meshes_ = false; //!< with the "dedup_meshes" scene parameter, the meshes identical to another one up to a rigid transform become instances of it
+		float lod_hysteresis_ = 0.1f; //!< relative margin of projected size beyond the range of the level of detail chosen by the previous render before an instance changes its level, so the levels do not flicker between frames
+		int deferred_geometry_budget_ = 0; //!< MB of loaded geometry of the deferred objects before evicting the least recently hit ones, 0 for no limit
+		std::string asset_cache_dir_; //!< if not empty, local directory where the image and geometry files are copied the first time and read from afterwards, see AssetCache
+		HugePages::Mode huge_pages_mode_ = HugePages::Mode::None; //!< with the "huge_pages" scene parameter, the large data of the scene is allocated in huge pages, see HugePages
+		mutable Session session_;
+		void instantiateReferencedMaterials(const ParamMap &params); //!< creates the deferred materials named by the string parameters
 
 	private:
+		struct DeferredMaterial
+		{
+			ParamMap params_;
+			std::list<ParamMap> eparams_;
+		};
+		Material *instantiateMaterial(const std::string &name, ParamMap &params, std::list<ParamMap> &eparams);
+		void requestTextures(const ParamMap &params); //!< marks the textures named by the string parameters to be loaded by completePendingTextures
+		void requestTextures(const ParamMap &params, const std::list<ParamMap> &eparams);
+		virtual void replaceMaterial(const Material *old_material, const Material *new_material) = 0; //!< makes the primitives using the old material use the new one
 		const Layers getLayersWithImages() const;
 		const Layers getLayersWithExportedImages() const;
 		template <typename T> static T *findMapItem(const std::string &name, const std::map<std::string, std::unique_ptr<T>> &map);
@@ -198,10 +287,20 @@ class LIBYAFARAY_EXPORT Scene
 		AaNoiseParams aa_noise_params_;
 		int nthreads_ = 1;
 		int nthreads_photons_ = 1;
+		bool threads_pinning_ = false; //!< pin the render threads to CPUs, spread between the NUMA nodes
+		bool shading_sort_by_material_ = false; //!< shade the camera samples of each tile grouped by the material of their first hit
+		bool primary_hit_cache_ = false; //!< keep the first primitive hit in each stratum of the pixels, tested first by the camera rays of the next passes
 		std::unique_ptr<ImageFilm> image_film_;
 		std::shared_ptr<Background> background_;
 		SurfaceIntegrator *surf_integrator_ = nullptr;
 		std::map<std::string, std::unique_ptr<Texture>> textures_;
+		std::map<std::string, std::shared_ptr<const HostPixelBuffer>> image_buffers_; //!< pixels given by the host application, used by the image textures with the "image_buffer" parameter
+		std::vector<Texture *> pending_textures_; //!< textures with their deferred loading not completed yet, see Texture::completeLoading
+		std::map<std::string, Texture *> images_textures_; //!< first texture created for each images key, whose images are shared by the next textures with the same key, see Texture::getImagesKey
+		std::map<std::string, DeferredMaterial> deferred_materials_; //!< materials not created yet, see lazy_creation_
+		RenderTimes render_times_;
+		uint64_t num_camera_samples_ = 0;
+		std::set<const Texture *> requested_textures_; //!< pending textures used by the created items, loaded by completePendingTextures with the lazy creation
 		std::map<std::string, std::unique_ptr<Camera>> cameras_;
 		std::map<std::string, std::shared_ptr<Background>> backgrounds_;
 		std::map<std::string, std::unique_ptr<Integrator>> integrators_;
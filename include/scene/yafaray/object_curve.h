@@ -21,6 +21,7 @@
 #define YAFARAY_OBJECT_CURVE_H
 
 #include "scene/yafaray/object_mesh.h"
+#include "scene/yafaray/primitive_curve_segment.h"
 
 BEGIN_YAFARAY
 
@@ -32,13 +33,24 @@ class CurveObject final : public MeshObject
 {
 	public:
 		static std::unique_ptr<Object> factory(ParamMap &params, const Scene &scene);
-		CurveObject(int num_vertices, float strand_start, float strand_end, float strand_shape, bool has_uv = false, bool has_orco = false);
+		CurveObject(int num_vertices, float strand_start, float strand_end, float strand_shape, bool ribbons = false, bool has_uv = false, bool has_orco = false, HugePages::Mode huge_pages_mode = HugePages::Mode::None);
+		virtual int numPrimitives() const override { return ribbons_ ? segments_.size() : faces_.size(); }
+		virtual const std::vector<const Primitive *> getPrimitives() const override;
+		virtual int writePrimitives(const Primitive **primitives) const override;
 		virtual bool calculateObject(const Material *material) override;
+		float getRadius(int index) const { return radii_[index]; }
+		const Material *getMaterial() const { return material_; }
 
 	private:
+		float calculateRadius(int index) const;
+
 		float strand_start_ = 0.01f;
 		float strand_end_ = 0.01f;
 		float strand_shape_ = 0.f;
+		bool ribbons_ = false; //!< render the strand with ray facing ribbon segments instead of extruding it into triangles
+		std::vector<CurveSegmentPrimitive> segments_;
+		std::vector<float> radii_; //!< strand radius at each point, only for the ribbon segments
+		const Material *material_ = nullptr;
 };
 
 END_YAFARAY
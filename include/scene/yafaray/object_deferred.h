@@ -0,0 +1,66 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_OBJECT_DEFERRED_H
+#define YAFARAY_OBJECT_DEFERRED_H
+
+#include "scene/yafaray/object_yafaray.h"
+#include "geometry/bound.h"
+#include "geometry/matrix4.h"
+#include "common/memory.h"
+#include <string>
+
+BEGIN_YAFARAY
+
+class MeshObject;
+
+/*! Object declaring only a bound and the path of an external binary mesh, so scenes with many assets do not keep in memory the
+	geometry never reached by the rays. The mesh is loaded and its accelerator built the first time a ray enters the bound, see
+	AcceleratorDeferred. It is placed in the scene as an instance of itself with the identity matrix, so the mesh is in world space.
+	The mesh file starts with the "YAFMESH1" magic and the uint32 number of vertices, number of triangles and flags (bit 0: per vertex
+	normals, bit 1: per vertex uvs), followed by the float x, y, z points, the normals, the int32 vertex indices of the triangles and the float u, v values */
+class DeferredObject final : public ObjectYafaRay
+{
+	public:
+		static std::unique_ptr<Object> factory(ParamMap &params, const Scene &scene);
+		DeferredObject(const std::string &path, const Bound &bound, const Material *material, bool compact_attributes);
+		virtual bool isDeferred() const override { return true; }
+		virtual int numPrimitives() const override { return 0; }
+		virtual const std::vector<const Primitive *> getPrimitives() const override { return {}; }
+		virtual bool calculateObject(const Material *) override { return true; }
+		virtual void replaceMaterial(const Material *old_material, const Material *new_material) override { if(material_ == old_material) material_ = new_material; }
+		virtual const Matrix4 *getObjToWorldMatrix() const override { return &obj_to_world_; }
+		const Bound &getBound() const { return bound_; }
+		const Material *getMaterial() const { return material_; }
+		/*! reads the mesh file into a calculated mesh with the properties of this object, nullptr when the file cannot be read.
+			Called from the render threads */
+		std::unique_ptr<MeshObject> loadMesh() const;
+
+	private:
+		std::string path_;
+		Bound bound_; //!< declared bound, the loaded geometry is expected to be inside it
+		const Material *material_ = nullptr;
+		bool compact_attributes_ = false;
+		HugePages::Mode huge_pages_mode_ = HugePages::Mode::None; //!< of the scene, for the loaded mesh
+		Matrix4 obj_to_world_ {1.f};
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_OBJECT_DEFERRED_H
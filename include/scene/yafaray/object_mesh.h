@@ -21,60 +21,97 @@
 #define YAFARAY_OBJECT_MESH_H
 
 #include "object_yafaray.h"
+#include "scene/yafaray/primitive_triangle.h"
 #include "geometry/vector.h"
 #include "geometry/uv.h"
 #include "common/memory.h"
+#include "common/memory_stats.h"
 #include <vector>
+#include <cstdint>
+#include <array>
 
 BEGIN_YAFARAY
 
 struct Uv;
 class FacePrimitive;
 class Material;
+class TaskPool;
+class Matrix4;
 
 class MeshObject : public ObjectYafaRay
 {
 	public:
 		static std::unique_ptr<Object> factory(ParamMap &params, const Scene &scene);
-		MeshObject(int num_vertices, int num_faces, bool has_uv = false, bool has_orco = false);
+		MeshObject(int num_vertices, int num_faces, bool has_uv = false, bool has_orco = false, HugePages::Mode huge_pages_mode = HugePages::Mode::None);
 		virtual ~MeshObject() override;
 		virtual bool isMesh() const override { return true; }
 		/*! the number of primitives the object holds. Primitive is an element
 			that by definition can perform ray-triangle intersection */
 		virtual int numPrimitives() const override { return faces_.size(); }
 		virtual const std::vector<const Primitive *> getPrimitives() const override;
+		virtual int writePrimitives(const Primitive **primitives) const override;
 		int lastVertexId() const { return points_.size() - 1; }
-		Vec3 getVertexNormal(int index) const { return normals_[index]; }
+		Vec3 getVertexNormal(int index) const;
 		Point3 getVertex(int index) const { return points_[index]; }
 		Point3 getOrcoVertex(int index) const { return orco_points_[index]; }
 		int numVertices() const { return points_.size(); }
-		int numNormals() const { return normals_.size(); }
-		void addFace(std::unique_ptr<FacePrimitive> face);
+		int numNormals() const { return packed_normals_.empty() ? normals_.size() : packed_normals_.size(); }
 		void addFace(const std::vector<int> &vertices, const std::vector<int> &vertices_uv, const Material *mat);
-		void calculateNormals();
-		const std::vector<Point3> &getPoints() const { return points_; }
-		const std::vector<Uv> &getUvValues() const { return uv_values_; }
+		void addFaces(const int *vertices, size_t num_faces, const int *vertices_uv, const Material *mat); //!< triangles from a contiguous buffer of 3 vertex indices per face, vertices_uv (3 uv indices per face) can be nullptr
+		void calculateNormals(TaskPool *task_pool = nullptr); //!< the faces are split between the task pool threads, if any
+		const LargeVector<Point3> &getPoints() const { return points_; }
+		Uv getUvValue(int index) const;
+		int getFaceVertexIndex(uint32_t index) const { return face_vertices_[index]; }
+		int getFaceNormalIndex(uint32_t index) const { return face_normals_[index]; }
+		int getFaceUvIndex(uint32_t index) const { return face_uvs_[index]; }
+		void setFaceNormalsIndices(const FacePrimitive &face, const FacePrimitive::VertexArray<int> &normals_indices);
 		bool hasOrco() const { return !orco_points_.empty(); }
-		bool hasUv() const { return !uv_values_.empty(); }
+		bool hasUv() const { return !uv_values_.empty() || !packed_uv_values_.empty(); }
 		bool isSmooth() const { return is_smooth_; }
-		bool hasNormalsExported() const { return !normals_.empty(); }
+		bool hasNormalsExported() const { return !normals_.empty() || !packed_normals_.empty(); }
+		void setCompactAttributes(bool compact_attributes) { compact_attributes_ = compact_attributes; }
 		void addPoint(const Point3 &p) { points_.push_back(p); }
 		void addOrcoPoint(const Point3 &p) { orco_points_.push_back(p); }
+		void addPoints(const float *points, size_t num_points); //!< from a contiguous x, y, z buffer
+		void addOrcoPoints(const float *points, size_t num_points); //!< from a contiguous x, y, z buffer
 		void addNormal(const Vec3 &n);
+		void addNormals(const float *normals, size_t num_normals); //!< from a contiguous x, y, z buffer
 		int addUvValue(const Uv &uv) { uv_values_.push_back(uv); return static_cast<int>(uv_values_.size()) - 1; }
+		int addUvValues(const float *uvs, size_t num_uvs); //!< from a contiguous u, v buffer, returns the index of the first uv added
 		void setSmooth(bool smooth) { is_smooth_ = smooth; }
-		bool smoothNormals(float angle);
+		bool smoothNormals(float angle, TaskPool *task_pool = nullptr); //!< the faces and vertices are split between the task pool threads, if any
 		//int convertToBezierControlPoints();
 		virtual bool calculateObject(const Material *material) override;
+		virtual void replaceMaterial(const Material *old_material, const Material *new_material) override;
 		static MeshObject *getMeshFromObject(Object *object);
+		size_t getMemory() const { return memory_tracker_.get(); } //!< bytes of the calculated mesh
+		/*! hash of the topology, face materials, uvs, orco points and settings of the mesh before it is calculated, without its vertex positions
+			and normals, so it is the same for the copies of a mesh placed anywhere with a rigid transform */
+		uint64_t contentHash() const;
+		/*! finds the rigid transform moving the vertices and exported normals of base onto this mesh, both not calculated yet.
+			Returns false when the meshes have different contents or are not related by a rigid transform */
+		bool findRigidTransformFrom(const MeshObject &base, Matrix4 &base_to_this) const;
 
 	protected:
-		std::vector<std::unique_ptr<FacePrimitive>> faces_;
-		std::vector<Point3> points_;
+		void packNormals();
+		void unpackNormals();
+		void packUvValues();
+
+		std::vector<TrianglePrimitive> faces_; //!< contiguous, the faces are light views into the index buffers, without allocations of their own
+		LargeVector<Point3> points_; //!< with the index buffers, the biggest mesh data randomly accessed when rendering, see HugePages
 		std::vector<Point3> orco_points_;
 		std::vector<Vec3> normals_;
 		std::vector<Uv> uv_values_;
+		LargeVector<int> face_vertices_; //!< index buffers with the point, normal (or -1) and uv (or -1) indices of all the face vertices, each face points to its first vertex in them
+		LargeVector<int> face_normals_;
+		LargeVector<int> face_uvs_;
+		bool compact_attributes_ = false; //!< after calculating the object, the normals are stored octahedral encoded in 32 bits and the uvs quantized to 16 bits per component
+		std::vector<uint32_t> packed_normals_;
+		std::vector<std::array<uint16_t, 2>> packed_uv_values_;
+		Uv packed_uv_min_ {0.f, 0.f};
+		Uv packed_uv_scale_ {0.f, 0.f};
 		bool is_smooth_ = false;
+		MemoryTracker memory_tracker_ {MemoryStats::Meshes};
 };
 
 END_YAFARAY
@@ -21,6 +21,7 @@
 #define YAFARAY_OBJECT_PRIMITIVE_H
 
 #include "scene/yafaray/object_yafaray.h"
+#include "geometry/primitive.h"
 
 BEGIN_YAFARAY
 
@@ -29,13 +30,15 @@ BEGIN_YAFARAY
 class PrimitiveObject : public ObjectYafaRay
 {
 	public:
-		void setPrimitive(const Primitive *primitive) { primitive_ = primitive; }
+		void setPrimitive(Primitive *primitive) { primitive_ = primitive; }
 		virtual int numPrimitives() const override { return 1; }
 		virtual const std::vector<const Primitive *> getPrimitives() const override { return {primitive_}; }
+		virtual int writePrimitives(const Primitive **primitives) const override { primitives[0] = primitive_; return 1; }
 		virtual bool calculateObject(const Material *material) override { return true; }
+		virtual void replaceMaterial(const Material *old_material, const Material *new_material) override { if(primitive_ && primitive_->getMaterial() == old_material) primitive_->setMaterial(new_material); }
 
 	private:
-		const Primitive *primitive_ = nullptr;
+		Primitive *primitive_ = nullptr;
 };
 
 END_YAFARAY
@@ -51,6 +51,8 @@ class ObjectYafaRay : public Object
 		virtual const Light *getLight() const override { return light_; }
 		/*! set a light source to be associated with this object */
 		virtual void setLight(const Light *light) override { light_ = light; }
+		virtual unsigned int getLightLinkMask() const override { return light_link_mask_; }
+		virtual void setLightLinkMask(unsigned int light_link_mask) override { light_link_mask_ = light_link_mask; }
 
 	protected:
 		ObjectYafaRay();
@@ -59,6 +61,7 @@ class ObjectYafaRay : public Object
 		Visibility visibility_ = Visibility::NormalVisible;
 		bool is_base_object_ = false;
 		unsigned int object_index_ = 0;	//!< Object Index for the object-index render pass
+		unsigned int light_link_mask_ = 0xFFFFFFFF; //!< light link groups illuminating the object
 		Rgb object_index_auto_color_ = 0.f;	//!< Object Index color automatically generated for the object-index-auto color render pass
 		static unsigned int object_index_auto_;	//!< Object Index automatically generated for the object-index-auto render pass
 		static unsigned int highest_object_index_;	//!< Class shared variable containing the highest object index used for the Normalized Object Index pass.
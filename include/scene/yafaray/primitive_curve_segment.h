@@ -0,0 +1,55 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_PRIMITIVE_CURVE_SEGMENT_H
+#define YAFARAY_PRIMITIVE_CURVE_SEGMENT_H
+
+#include "geometry/primitive.h"
+#include "geometry/vector.h"
+
+BEGIN_YAFARAY
+
+class CurveObject;
+
+/*! Strand segment between two consecutive points of a CurveObject, rendered as a ribbon facing the ray with the
+ *  width interpolated between the radii of both points. It only stores the index of its first point, the points and
+ *  radii are kept in the curve object, so instances of the curve share them like the mesh faces with their mesh */
+class CurveSegmentPrimitive final : public Primitive
+{
+	public:
+		CurveSegmentPrimitive(int point_index, const CurveObject &curve_object);
+		virtual Bound getBound(const Matrix4 *obj_to_world) const override;
+		virtual IntersectData intersect(const Ray &ray, const Matrix4 *obj_to_world) const override;
+		virtual SurfacePoint getSurface(const Point3 &hit, const IntersectData &intersect_data, const Matrix4 *obj_to_world) const override;
+		virtual const Material *getMaterial() const override;
+		virtual float surfaceArea(const Matrix4 *obj_to_world) const override;
+		virtual Vec3 getGeometricNormal(const Matrix4 *obj_to_world, float u, float v) const override;
+		virtual void sample(float s_1, float s_2, Point3 &p, Vec3 &n, const Matrix4 *obj_to_world) const override;
+
+	private:
+		const CurveObject &getCurveObject() const;
+		Point3 getPoint(int point_number, const Matrix4 *obj_to_world) const; //!< 0 for the start and 1 for the end point of the segment
+		float getRadius(int point_number) const;
+
+		int point_index_;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_PRIMITIVE_CURVE_SEGMENT_H
@@ -23,6 +23,8 @@
 #include "geometry/primitive.h"
 #include "geometry/vector.h"
 #include <vector>
+#include <array>
+#include <cstdint>
 
 BEGIN_YAFARAY
 
@@ -32,37 +34,42 @@ class Uv;
 class FacePrimitive: public Primitive
 {
 	public:
-		FacePrimitive(const std::vector<int> &vertices_indices, const std::vector<int> &vertices_uv_indices, const MeshObject &mesh_object);
+		static constexpr size_t max_vertices_ = 4; //!< triangles and quads
+		template <typename T> using VertexArray = std::array<T, max_vertices_>; //!< fixed size, returned by value without allocations: only the first numVertices() elements are valid
+
+		FacePrimitive(uint32_t first_index, uint32_t num_vertices, const MeshObject &mesh_object);
 		//In the following functions "vertex_number" is the vertex number in the face: 0, 1, 2 in triangles, 0, 1, 2, 3 in quads, etc
 		virtual Vec3 getGeometricNormal(const Matrix4 *obj_to_world = nullptr, float u = 0.f, float v = 0.f) const override;
 		virtual const Material *getMaterial() const override { return material_; }
 		virtual Bound getBound(const Matrix4 *obj_to_world) const override;
+		virtual void getOrco(const SurfacePoint &sp, Point3 &orco_p, Vec3 &orco_ng) const override;
 		virtual void calculateGeometricNormal() = 0;
 		Point3 getVertex(size_t vertex_number, const Matrix4 *obj_to_world) const; //!< Get face vertex
 		Point3 getOrcoVertex(size_t vertex_number) const; //!< Get face original coordinates (orco) vertex in instance objects
 		Vec3 getVertexNormal(size_t vertex_number, const Vec3 &surface_normal_world, const Matrix4 *obj_to_world) const; //!< Get face vertex normal
 		Uv getVertexUv(size_t vertex_number) const; //!< Get face vertex Uv
-		void setNormalsIndices(const std::vector<int> &normals_indices) { vertex_normals_ = normals_indices; }
-		void setUvIndices(const std::vector<int> &uv_indices) { vertex_uvs_ = uv_indices; }
-		const std::vector<int> getVerticesIndices() const { return vertices_; }
-		const std::vector<int> getNormalsIndices() const { return vertex_normals_; }
-		const std::vector<int> getUvIndices() const { return vertex_uvs_; }
-		std::vector<Point3> getVertices(const Matrix4 *obj_to_world = nullptr) const;
-		std::vector<Point3> getOrcoVertices() const;
-		std::vector<Vec3> getVerticesNormals(const Vec3 &surface_normal, const Matrix4 *obj_to_world = nullptr) const;
-		std::vector<Uv> getVerticesUvs() const;
-		void setMaterial(const Material *material) { material_ = material; }
-		size_t getSelfIndex() const { return self_index_; }
-		void setSelfIndex(size_t index) { self_index_ = index; }
-		static Bound getBound(const std::vector<Point3> &vertices);
+		size_t numVertices() const { return num_vertices_; }
+		uint32_t getFirstIndex() const { return first_index_; } //!< position of the first face vertex in the mesh index buffers
+		VertexArray<int> getVerticesIndices() const;
+		VertexArray<int> getNormalsIndices() const;
+		VertexArray<int> getUvIndices() const;
+		VertexArray<Point3> getVertices(const Matrix4 *obj_to_world = nullptr) const;
+		VertexArray<Point3> getOrcoVertices() const;
+		VertexArray<Vec3> getVerticesNormals(const Vec3 &surface_normal, const Matrix4 *obj_to_world = nullptr) const;
+		VertexArray<Uv> getVerticesUvs() const;
+		virtual void setMaterial(const Material *material) override { material_ = material; }
+		uint32_t getSelfIndex() const { return self_index_; }
+		void setSelfIndex(uint32_t index) { self_index_ = index; }
+		static Bound getBound(const Point3 *vertices, size_t num_vertices);
 
 	protected:
-		size_t self_index_ = 0;
+		const MeshObject &getMeshObject() const;
+
 		Vec3 normal_geometric_;
+		uint32_t self_index_ = 0;
 		const Material *material_ = nullptr;
-		std::vector<int> vertices_; //!< indices in point array, referenced in mesh.
-		std::vector<int> vertex_normals_; //!< indices in normal array, if mesh is smoothed.
-		std::vector<int> vertex_uvs_; //!< indices in uv array, if mesh has explicit uv.
+		uint32_t first_index_; //!< the point, normal and uv indices of the face vertices are packed in the mesh index buffers, starting at this position
+		uint32_t num_vertices_;
 };
 
 std::ostream &operator<<(std::ostream &out, const FacePrimitive &face);
@@ -44,7 +44,9 @@ class SpherePrimitive final : public Primitive
 		virtual bool intersectsBound(const ExBound &b, const Matrix4 *obj_to_world) const override { return true; };
 		virtual IntersectData intersect(const Ray &ray, const Matrix4 *obj_to_world) const override;
 		virtual SurfacePoint getSurface(const Point3 &hit, const IntersectData &intersect_data, const Matrix4 *obj_to_world) const override;
+		virtual void getOrco(const SurfacePoint &sp, Point3 &orco_p, Vec3 &orco_ng) const override;
 		virtual const Material *getMaterial() const override { return material_; }
+		virtual void setMaterial(const Material *material) override { material_ = material; }
 		virtual float surfaceArea(const Matrix4 *obj_to_world) const override;
 		virtual Vec3 getGeometricNormal(const Matrix4 *obj_to_world, float u, float v) const override;
 		virtual void sample(float s_1, float s_2, Point3 &p, Vec3 &n, const Matrix4 *obj_to_world) const override;
@@ -31,8 +31,9 @@ class MeshObject;
 class TrianglePrimitive: public FacePrimitive
 {
 	public:
-		TrianglePrimitive(const std::vector<int> &vertices_indices, const std::vector<int> &vertices_uv_indices, const MeshObject &mesh_object);
+		TrianglePrimitive(uint32_t first_index, const MeshObject &mesh_object);
 		virtual IntersectData intersect(const Ray &ray, const Matrix4 *obj_to_world) const override;
+		virtual bool getTriangleVertices(std::array<Point3, 3> &vertices, const Matrix4 *obj_to_world) const override;
 		virtual bool intersectsBound(const ExBound &eb, const Matrix4 *obj_to_world) const override;
 		virtual bool clippingSupport() const override { return true; }
 		// return: false:=doesn't overlap bound; true:=valid clip exists
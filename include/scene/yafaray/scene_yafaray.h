@@ -26,6 +26,9 @@ BEGIN_YAFARAY
 
 class Accelerator;
 class Primitive;
+class ObjectInstance;
+class MeshObject;
+class TaskPool;
 
 class YafaRayScene final : public Scene
 {
@@ -41,21 +44,58 @@ class YafaRayScene final : public Scene
 		virtual void addNormal(const Vec3 &n) override;
 		virtual bool addFace(const std::vector<int> &vert_indices, const std::vector<int> &uv_indices = {}) override;
 		virtual int  addUv(float u, float v) override;
+		virtual int  addVertices(const float *vertices, size_t num_vertices, const float *orco = nullptr) override;
+		virtual bool addNormals(const float *normals, size_t num_normals) override;
+		virtual bool addFaces(const int *vert_indices, size_t num_faces, const int *uv_indices = nullptr) override;
+		virtual int  addUvs(const float *uvs, size_t num_uvs) override;
 		virtual bool smoothNormals(const std::string &name, float angle) override;
 		virtual Object *createObject(const std::string &name, ParamMap &params) override;
 		virtual bool endObject() override;
+		virtual bool endObjects() override;
 		virtual bool addInstance(const std::string &base_object_name, const Matrix4 &obj_to_world) override;
+		virtual bool addInstances(const std::string &base_object_name, const float *obj_to_world, size_t num_instances) override;
+		virtual bool updateInstance(const std::string &base_object_name, size_t instance_number, const Matrix4 &obj_to_world) override;
+		virtual size_t getNumInstances(const std::string &base_object_name) const override;
+		virtual bool addObjectLod(const std::string &base_object_name, const std::string &lod_object_name, float max_screen_size) override;
+		virtual bool hasObjectLods() const override { return !object_lods_.empty(); }
 		virtual bool updateObjects() override;
-		virtual bool intersect(const Ray &ray, SurfacePoint &sp) const override;
-		virtual bool intersect(const DiffRay &ray, SurfacePoint &sp) const override;
-		virtual bool isShadowed(const RenderData &render_data, const Ray &ray, float &obj_index, float &mat_index) const override;
+		virtual bool intersect(const Ray &ray, SurfacePoint &sp, const Primitive **primary_hit = nullptr) const override;
+		virtual bool intersect(const DiffRay &ray, SurfacePoint &sp, const Primitive **primary_hit = nullptr) const override;
+		virtual bool isShadowed(const RenderData &render_data, const Ray &ray, float &obj_index, float &mat_index, const Primitive **last_occluder = nullptr) const override;
 		virtual bool isShadowed(RenderData &render_data, const Ray &ray, int max_depth, Rgb &filt, float &obj_index, float &mat_index) const override;
+		virtual std::vector<bool> intersect(const std::vector<Ray> &rays, std::vector<SurfacePoint> &sp) const override;
+		virtual std::vector<bool> isShadowed(const RenderData &render_data, const std::vector<Ray> &rays, const Primitive **last_occluder = nullptr) const override;
 		virtual Object *getObject(const std::string &name) const override;
+		virtual std::vector<const Object *> getObjects() const override;
+		virtual AcceleratorStats getAcceleratorStats() const override;
+		virtual void replaceMaterial(const Material *old_material, const Material *new_material) override;
 		void clearObjects();
+		bool calculatePendingObjects(); //!< calculates in parallel the objects ended since the last call, smoothing their normals if requested
+		void deduplicatePendingMeshes(); //!< replaces the pending meshes identical to another pending mesh up to a rigid transform by instances of it, before they are calculated
+		static bool smoothMesh(MeshObject *mesh_object, float angle, TaskPool *task_pool);
+		/*! replaces the instances of the base objects with levels of detail by instances of the levels chosen for them in the camera of the first render view.
+		 *  Returns true if any instance changed its level since the previous call, so the accelerator must be rebuilt */
+		bool selectObjectLods(std::vector<const Object *> &instances, std::vector<std::unique_ptr<Object>> &lod_instances);
 
 		Object *current_object_ = nullptr;
+		struct PendingObject
+		{
+			Object *object_;
+			const Material *material_;
+			float smooth_angle_; //!< negative when no smoothing was requested
+		};
+		std::vector<PendingObject> pending_objects_; //!< ended objects, calculated all together when the geometry ends instead of one by one while they are exported
 		std::unique_ptr<Accelerator> accelerator_;
 		std::map<std::string, std::unique_ptr<Object>> objects_;
+		std::map<std::string, std::vector<ObjectInstance *>> instances_; //!< instances of each base object, in creation order
+		struct ObjectLods
+		{
+			std::vector<const Object *> objects_; //!< sorted by increasing max screen size
+			std::vector<float> max_screen_sizes_; //!< projected diameter in pixels of the instance bound up to which each level is used
+		};
+		std::map<const Object *, ObjectLods> object_lods_; //!< levels of detail of each base object, the base object itself being used above the last max screen size
+		std::map<const Object *, std::vector<uint32_t>> instance_lods_; //!< level chosen in the previous build for each instance of each instance object, the base object being the level objects_.size()
+		std::vector<std::unique_ptr<Object>> lod_instances_; //!< instances of the chosen levels, referenced by the accelerator
 };
 
 END_YAFARAY
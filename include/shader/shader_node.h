@@ -85,6 +85,15 @@ class ShaderNode
 			\param dep empty (!) vector to return the dependencies
 			\return true if there exist dependencies, false if it does not depend on any other nodes */
 		virtual bool getDependencies(std::vector<const ShaderNode *> &dep) const { return false; }
+		//! false for the nodes whose results only depend on their inputs, so they are constant when their inputs are constant
+		virtual bool dependsOnSurfacePoint() const { return true; }
+		//! true when the node always evaluates the same results as this one, so the materials evaluate only one of them for each surface point
+		virtual bool isEquivalent(const ShaderNode &node) const { return false; }
+		/*! scalar result of the node from the alpha mask of its texture, without evaluating the node tree. Used by the transparent shadow tests,
+			it returns false when the alpha mask does not know the exact result, or for the nodes without one, that must be evaluated as usual */
+		virtual bool evalAlphaMask(const RenderData &render_data, const SurfacePoint &sp, float &value) const { return false; }
+		//! called by the materials using evalAlphaMask, so the texture of the node builds its alpha mask
+		virtual void requestAlphaMask() { }
 		/*! get the color value calculated on eval */
 		Rgba getColor(const NodeStack &stack) const { return stack(this->id_).col_; }
 		/*! get the scalar value calculated on eval */
@@ -35,10 +35,13 @@ class TextureMapperNode final : public ShaderNode
 		enum Coords : int { Uv, Global, Orco, Transformed, Normal, Reflect, Window, Stick, Stress, Tangent };
 		enum Projection : int { Plain = 0, Cube, Tube, Sphere };
 
-		TextureMapperNode(const Texture *texture) : tex_(texture) { }
+		TextureMapperNode(Texture *texture) : tex_(texture) { }
 		virtual void eval(NodeStack &stack, const RenderData &render_data, const SurfacePoint &sp) const override;
 		virtual void evalDerivative(NodeStack &stack, const RenderData &render_data, const SurfacePoint &sp) const override;
 		virtual bool configInputs(const ParamMap &params, const NodeFinder &find) override { return true; };
+		virtual bool isEquivalent(const ShaderNode &node) const override;
+		virtual bool evalAlphaMask(const RenderData &render_data, const SurfacePoint &sp, float &value) const override;
+		virtual void requestAlphaMask() override { tex_->requestAlphaMask(); }
 		//virtual void getDerivative(const surfacePoint_t &sp, float &du, float &dv) const;
 
 		void setup();
@@ -50,7 +53,7 @@ class TextureMapperNode final : public ShaderNode
 		int map_x_ = 1, map_y_ = 2, map_z_ = 3; //!< axis mapping; 0:set to zero, 1:x, 2:y, 3:z
 		Point3 p_du_, p_dv_, p_dw_;
 		float d_u_, d_v_, d_w_, d_uv_;
-		const Texture *tex_ = nullptr;
+		Texture *tex_ = nullptr;
 		Vec3 scale_;
 		Vec3 offset_;
 		float bump_str_ = 0.02f;
@@ -67,6 +70,7 @@ class ValueNode final : public ShaderNode
 		ValueNode(Rgba col, float val): color_(col), value_(val) {}
 		virtual void eval(NodeStack &stack, const RenderData &render_data, const SurfacePoint &sp) const override;
 		virtual bool configInputs(const ParamMap &params, const NodeFinder &find) override { return true; };
+		virtual bool dependsOnSurfacePoint() const override { return false; }
 
 		Rgba color_;
 		float value_;
@@ -86,6 +90,7 @@ class MixNode : public ShaderNode
 		virtual void eval(NodeStack &stack, const RenderData &render_data, const SurfacePoint &sp) const override;
 		virtual bool configInputs(const ParamMap &params, const NodeFinder &find) override;
 		virtual bool getDependencies(std::vector<const ShaderNode *> &dep) const override;
+		virtual bool dependsOnSurfacePoint() const override { return false; }
 
 		Rgba col_1_, col_2_;
 		float val_1_, val_2_, cfactor_;
@@ -47,6 +47,7 @@ class LayerNode final : public ShaderNode
 		virtual bool configInputs(const ParamMap &params, const NodeFinder &find) override;
 		//virtual void getDerivative(const surfacePoint_t &sp, float &du, float &dv) const;
 		virtual bool getDependencies(std::vector<const ShaderNode *> &dep) const override;
+		virtual bool dependsOnSurfacePoint() const override { return false; }
 
 		const ShaderNode *input_ = nullptr, *upper_layer_ = nullptr;
 		Flags flags_;
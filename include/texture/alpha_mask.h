@@ -0,0 +1,67 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_ALPHA_MASK_H
+#define YAFARAY_ALPHA_MASK_H
+
+#include "constants.h"
+#include <functional>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+BEGIN_YAFARAY
+
+class TaskPool;
+
+/*! Texels of an image texture whose scalar value is exactly 0 (opaque) or exactly 1 (clear), packed with 1 bit per texel when all the texels are
+ * 0 or 1 (cutout masks), or with 2 bits per texel otherwise, marking the other texels as partial. The transparent shadow tests use it as an exact
+ * early-out: when all the texels interpolated at a point are opaque or all are clear, the result is known without evaluating the material nodes.
+ * Each row starts in a new 32 bit word, so the rows are packed in parallel */
+class AlphaMask final
+{
+	public:
+		enum class Texel : uint32_t { Opaque = 0, Clear = 1, Partial = 2 };
+		/*! classifies the values of the texels given by the function. Returns false, leaving the mask empty, when no texel is exactly 0 or 1, as the mask would never be used */
+		bool build(int width, int height, const std::function<float(int x, int y)> &texel_value, TaskPool *task_pool);
+		bool isEmpty() const { return words_.empty(); }
+		int getWidth() const { return width_; }
+		int getHeight() const { return height_; }
+		int getBitsPerTexel() const { return static_cast<int>(bits_per_texel_); }
+		Texel getTexel(int x, int y) const
+		{
+			const uint32_t bit = static_cast<uint32_t>(x) * bits_per_texel_;
+			const uint32_t word = words_[static_cast<std::size_t>(y) * row_words_ + (bit >> 5)];
+			return static_cast<Texel>((word >> (bit & 31)) & texel_bits_);
+		}
+		std::size_t getMemorySize() const { return words_.size() * sizeof(uint32_t); }
+
+	private:
+		static Texel classify(float value) { return value == 0.f ? Texel::Opaque : (value == 1.f ? Texel::Clear : Texel::Partial); }
+		int width_ = 0;
+		int height_ = 0;
+		uint32_t bits_per_texel_ = 1;
+		uint32_t texel_bits_ = 1;
+		std::size_t row_words_ = 0;
+		std::vector<uint32_t> words_;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_ALPHA_MASK_H
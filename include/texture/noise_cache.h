@@ -0,0 +1,59 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_NOISE_CACHE_H
+#define YAFARAY_NOISE_CACHE_H
+
+#include "constants.h"
+#include "geometry/vector.h"
+#include <functional>
+#include <vector>
+
+BEGIN_YAFARAY
+
+class ParamMap;
+class TaskPool;
+
+/*! Values of a noise function baked in a regular 3D grid of points over a box of the texture space, sampled with
+ * trilinear interpolation instead of evaluating all the noise octaves in each look-up. The interpolation smooths the
+ * details smaller than the grid spacing, so it is only enabled when the texture sets a resolution fine enough for
+ * its noise. The points outside the box are not cached and their noise is evaluated as usual */
+class NoiseCache final
+{
+	public:
+		/*! Reads the "noise_cache_resolution" (number of grid points along each axis, 0 to disable the cache),
+		 * "noise_cache_min" and "noise_cache_max" (corners of the cached box, by default the [-1, 1] box of the orco and normalized mappings) parameters */
+		void setParams(const ParamMap &params);
+		bool isEnabled() const { return resolution_ > 1; }
+		//! evaluates the function at the grid points, in parallel with the task pool threads
+		void bake(const std::function<float(const Point3 &p)> &function, TaskPool *task_pool);
+		//! returns false if the point is outside the cached box or the cache is not baked
+		bool getValue(const Point3 &p, float &value) const;
+
+	private:
+		static constexpr int max_resolution_ = 512;
+		int resolution_ = 0;
+		Point3 min_ {-1.f, -1.f, -1.f}, max_ {1.f, 1.f, 1.f};
+		Vec3 inv_spacing_ {0.f};
+		std::vector<float> values_; //!< indexed by (x * resolution_ + y) * resolution_ + z, so the points along z are contiguous
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_NOISE_CACHE_H
@@ -33,6 +33,7 @@ BEGIN_YAFARAY
 class ParamMap;
 class Scene;
 class MipMapParams;
+class TaskPool;
 
 enum class InterpolationType : int { None, Bilinear, Bicubic, Trilinear, Ewa };
 
@@ -52,10 +53,22 @@ class Texture
 		virtual Rgba getColor(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const { return Rgba(0.f); }
 		virtual Rgba getRawColor(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const { return getColor(p, mipmap_params); }
 		virtual float getFloat(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const { return applyIntensityContrastAdjustments(getRawColor(p, mipmap_params).col2Bri()); }
+		//! same results as getColor and getFloat, for the textures able to calculate both with a single texture look-up
+		virtual void getColorAndFloat(const Point3 &p, const MipMapParams *mipmap_params, Rgba &color, float &value) const { color = getColor(p, mipmap_params); value = getFloat(p, mipmap_params); }
+		//! analytic gradient of getFloat at p, for the bump mapping. Returns false for the textures without one, which are differentiated with finite differences instead
+		virtual bool getFloatGradient(const Point3 &p, Vec3 &gradient) const { return false; }
+		//! getFloat at p without mipmaps when the alpha mask of the texture knows it exactly, see AlphaMask. Returns false otherwise, and for the textures without an alpha mask
+		virtual bool getAlphaMaskValue(const Point3 &p, float &value) const { return false; }
+		//! called by the materials reading their transparent shadows with getAlphaMaskValue, so only their textures build the alpha mask
+		virtual void requestAlphaMask() { }
 
 		/* gives the number of values in each dimension for discrete textures */
 		virtual void resolution(int &x, int &y, int &z) const { x = 0, y = 0, z = 0; };
 		virtual void generateMipMaps() {}
+		virtual void completeLoading(TaskPool *task_pool) {} //!< deferred loading steps, run by the scene for all the textures in parallel before rendering
+		//! image files loaded by the texture and their settings, the textures with the same key can share their images. Empty for the textures without images
+		virtual std::string getImagesKey() const { return ""; }
+		virtual void shareImages(const Texture &texture) {} //!< uses the images of a texture with the same images key instead of loading them again
 		void setAdjustments(float intensity, float contrast, float saturation, float hue, bool clamp, float factor_red, float factor_green, float factor_blue);
 		Rgba applyAdjustments(const Rgba &tex_col) const;
 		Rgba applyIntensityContrastAdjustments(const Rgba &tex_col) const;
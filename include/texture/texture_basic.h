@@ -22,6 +22,7 @@
 
 #include "texture/texture.h"
 #include "texture/noise_generator.h"
+#include "texture/noise_cache.h"
 
 BEGIN_YAFARAY
 
@@ -37,12 +38,15 @@ class CloudsTexture final : public Texture
 					  const std::string &ntype, const std::string &btype);
 		virtual Rgba getColor(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const override;
 		virtual float getFloat(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const override;;
+		virtual void completeLoading(TaskPool *task_pool) override;
+		float getTurbulence(const Point3 &p) const;
 
 		int depth_, bias_;
 		float size_;
 		bool hard_;
 		Rgb color_1_, color_2_;
 		std::unique_ptr<NoiseGenerator> n_gen_;
+		NoiseCache noise_cache_; //!< turbulence baked for the static clouds, when enabled by the texture parameters
 };
 
 
@@ -58,12 +62,16 @@ class MarbleTexture final : public Texture
 		virtual Rgba getColor(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const override;
 		virtual float getFloat(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const override;;
 
+		virtual void completeLoading(TaskPool *task_pool) override;
+		float getTurbulence(const Point3 &p) const;
+
 		int octaves_;
 		Rgb color_1_, color_2_;
 		float turb_, sharpness_, size_;
 		bool hard_;
 		std::unique_ptr<NoiseGenerator> n_gen_;
 		enum Shape {Sin, Saw, Tri} wshape_;
+		NoiseCache noise_cache_; //!< turbulence baked for the static marble, when enabled by the texture parameters
 };
 
 class WoodTexture final : public Texture
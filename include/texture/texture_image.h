@@ -25,11 +25,15 @@
 #define YAFARAY_TEXTURE_IMAGE_H
 
 #include "texture/texture.h"
+#include "texture/alpha_mask.h"
 #include "image/image.h"
+#include "common/memory_stats.h"
 
 BEGIN_YAFARAY
 
 class Format;
+class TaskPool;
+class HostPixelBuffer;
 
 class MipMapParams final
 {
@@ -52,26 +56,56 @@ class ImageTexture final : public Texture
 		virtual ~ImageTexture() override;
 
 	private:
-		ImageTexture(std::unique_ptr<Image> image);
+		ImageTexture() = default; //!< the image is loaded later, see completeLoading
 		virtual bool discrete() const override { return true; }
 		virtual bool isThreeD() const override { return false; }
 		virtual bool isNormalmap() const override { return normalmap_; }
 		virtual Rgba getColor(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const override;
 		virtual Rgba getRawColor(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const override;
+		virtual void getColorAndFloat(const Point3 &p, const MipMapParams *mipmap_params, Rgba &color, float &value) const override;
+		virtual bool getFloatGradient(const Point3 &p, Vec3 &gradient) const override;
+		virtual bool getAlphaMaskValue(const Point3 &p, float &value) const override;
+		virtual void requestAlphaMask() override;
 		virtual void resolution(int &x, int &y, int &z) const override;
 		virtual void generateMipMaps() override;
+		virtual void completeLoading(TaskPool *task_pool) override;
+		virtual std::string getImagesKey() const override { return images_key_; }
+		virtual void shareImages(const Texture &texture) override;
+		void buildMipMaps(TaskPool *task_pool);
+		void buildAlphaMask(TaskPool *task_pool); //!< marks the texels of the image whose float value is exactly 0 or 1 in the alpha mask, if there are any
 		void setCrop(float minx, float miny, float maxx, float maxy);
 		void findTextureInterpolationCoordinates(int &coord_0, int &coord_1, int &coord_2, int &coord_3, float &coord_decimal_part, float coord_float, int resolution, bool repeat, bool mirror) const;
 		Rgba noInterpolation(const Point3 &p, int mipmap_level = 0) const;
-		Rgba bilinearInterpolation(const Point3 &p, int mipmap_level = 0) const;
-		Rgba bicubicInterpolation(const Point3 &p, int mipmap_level = 0) const;
+		Rgba bilinearInterpolation(const Point3 &p, int mipmap_level = 0, Rgba *dcolor_dx = nullptr, Rgba *dcolor_dy = nullptr) const; //!< dcolor_dx and dcolor_dy, when given, receive the analytic derivatives of the color in texture coordinates
+		Rgba bicubicInterpolation(const Point3 &p, int mipmap_level = 0, Rgba *dcolor_dx = nullptr, Rgba *dcolor_dy = nullptr) const;
 		Rgba mipMapsTrilinearInterpolation(const Point3 &p, const MipMapParams *mipmap_params) const;
 		Rgba mipMapsEwaInterpolation(const Point3 &p, float max_anisotropy, const MipMapParams *mipmap_params) const;
 		Rgba ewaEllipticCalculation(const Point3 &p, float ds_0, float dt_0, float ds_1, float dt_1, int mipmap_level = 0) const;
 		void generateEwaLookupTable();
-		bool doMapping(Point3 &texp) const;
+		bool convertToTiled(const std::string &tile_file, uint64_t signature);
+		void blockCompress(TaskPool *task_pool, size_t first_level); //!< replaces the images from the first level by their block compressed copies
+		bool doMapping(Point3 &texp, Vec3 *jacobian = nullptr) const; //!< jacobian, when given, receives the derivatives of the mapped x and y with respect to the coordinates they come from
 		Rgba interpolateImage(const Point3 &p, const MipMapParams *mipmap_params) const;
 
+		//! Loading steps deferred until the scene completes the loading of all the textures in parallel
+		struct PendingLoading
+		{
+			std::unique_ptr<Format> format_; //!< decodes the image file, when it is not loaded from a tile file
+			std::shared_ptr<const HostPixelBuffer> pixel_buffer_; //!< pixels given by the host application instead of the image file
+			std::string image_file_;
+			Image::Optimization optimization_ = Image::Optimization::None;
+			ColorSpace color_space_ = ColorSpace::RawManualGamma;
+			float gamma_ = 1.f;
+			bool grayscale_ = false;
+			bool mipmaps_ = false; //!< kept for the interpolations using them, they are also generated to save them in the tile file otherwise
+			bool tiled_ = false;
+			bool use_tile_file_ = false;
+			std::string tile_file_;
+			bool block_compress_ = false;
+		};
+		//! returns false if the image file could not be decoded, leaving a black texture
+		bool decodeImage(PendingLoading &pending_loading, TaskPool *task_pool);
+
 		const int ewa_weight_lut_size_ = 128;
 		bool calc_alpha_, normalmap_;
 		bool grayscale_ = false;	//!< Converts the information loaded from the texture RGB to grayscale to reduce memory usage for bump or mask textures, for example. Alpha is ignored in this case.
@@ -80,13 +114,20 @@ class ImageTexture final : public Texture
 		float checker_dist_;
 		int xrepeat_, yrepeat_;
 		ClipMode tex_clip_mode_;
-		std::vector<std::unique_ptr<Image>> images_;
+		std::shared_ptr<std::vector<std::unique_ptr<Image>>> images_ = std::make_shared<std::vector<std::unique_ptr<Image>>>(); //!< the image followed by its mipmaps, all of them tiled when the texture is out of core. Shared by the textures with the same images key
+		std::string images_key_; //!< image file and the settings it is loaded with, see getImagesKey
 		ColorSpace original_image_file_color_space_;
 		float original_image_file_gamma_;
 		bool mirror_x_;
 		bool mirror_y_;
 		float trilinear_level_bias_ = 0.f; //!< manually specified delta to be added/subtracted from the calculated mipmap level. Negative values will choose higher resolution mipmaps than calculated, reducing the blurry artifacts at the cost of increasing texture noise. Positive values will choose lower resolution mipmaps than calculated. Default (and recommended) is 0.0 to use the calculated mipmaps as-is.
 		float ewa_max_anisotropy_ = 8.f; //!< Maximum anisotropy allowed for mipmap EWA algorithm. Higher values give better quality in textures seen from an angle, but render will be slower. Lower values will give more speed but lower quality in textures seen in an angle.
+		AlphaMask alpha_mask_; //!< exactly opaque and clear texels of the full resolution image for the transparent shadows, empty when there are none or no material requested it
+		bool alpha_mask_requested_ = false;
+		bool tiled_ = false; //!< out of core images, without alpha mask as reading all their texels would load them back in memory
+		HugePages::Mode huge_pages_mode_ = HugePages::Mode::None; //!< of the scene, for the images and mipmaps in memory
+		std::unique_ptr<PendingLoading> pending_loading_;
+		MemoryTracker memory_tracker_ {MemoryStats::Textures}; //!< only in the texture loading the images, not in the textures sharing them
 		static float *ewa_weight_lut_;
 };
 
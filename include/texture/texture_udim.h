@@ -0,0 +1,73 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_TEXTURE_UDIM_H
+#define YAFARAY_TEXTURE_UDIM_H
+
+#include "texture/texture.h"
+#include "common/param.h"
+#include <mutex>
+
+BEGIN_YAFARAY
+
+/*! Image texture made of the tiles of a UDIM texture set, with the file name given as a pattern with "<UDIM>" in place of the tile number.
+ * The tile 1001 covers the UV square [0,1)x[0,1), the numbers increasing by 1 along U (10 tiles per row) and by 10 along V.
+ * Each tile is an image texture created with the same parameters the first time a texture look-up falls in it, so the tiles never seen are never loaded.
+ * The out of core tiles ("tiled" parameter) are also read through the tile cache */
+class UdimTexture final : public Texture
+{
+	public:
+		static std::unique_ptr<Texture> factory(ParamMap &params, const Scene &scene);
+		static bool isUdimPattern(const std::string &file_name) { return file_name.find(udim_tag_) != std::string::npos; }
+
+	private:
+		UdimTexture(const ParamMap &params, const Scene &scene, const std::string &pattern, bool normalmap, int nominal_resolution);
+		virtual bool discrete() const override { return true; }
+		virtual bool isThreeD() const override { return false; }
+		virtual bool isNormalmap() const override { return normalmap_; }
+		virtual Rgba getColor(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const override;
+		virtual Rgba getRawColor(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const override;
+		virtual float getFloat(const Point3 &p, const MipMapParams *mipmap_params = nullptr) const override;
+		virtual void getColorAndFloat(const Point3 &p, const MipMapParams *mipmap_params, Rgba &color, float &value) const override;
+		virtual bool getFloatGradient(const Point3 &p, Vec3 &gradient) const override;
+		//! the tiles are only known when loaded, so the nominal resolution of the tiles is given instead
+		virtual void resolution(int &x, int &y, int &z) const override { x = y = nominal_resolution_; z = 0; }
+		//! the texture of the tile under the point, or nullptr outside of the tiles or for a missing tile file. tile_p receives the point in the coordinates of the tile texture
+		const Texture *getTile(const Point3 &p, Point3 &tile_p) const;
+		void loadTile(int tile_index) const;
+
+		struct Tile
+		{
+			std::once_flag loaded_;
+			std::unique_ptr<Texture> texture_;
+		};
+		static constexpr const char *udim_tag_ = "<UDIM>";
+		static constexpr int tiles_u_ = 10; //!< tiles per row in the UDIM numbering
+		static constexpr int max_tiles_v_ = 100;
+		ParamMap params_; //!< parameters of the image textures of the tiles, with the file name pattern
+		const Scene &scene_;
+		std::string pattern_;
+		bool normalmap_ = false;
+		int nominal_resolution_ = 4096;
+		mutable std::unique_ptr<Tile[]> tiles_;
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_TEXTURE_UDIM_H
@@ -0,0 +1,90 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_SSS_DIFFUSION_H
+#define YAFARAY_SSS_DIFFUSION_H
+
+#include "constants.h"
+#include "geometry/bound.h"
+#include "color/color.h"
+#include <array>
+#include <vector>
+
+BEGIN_YAFARAY
+
+/*! Radial diffuse reflectance of a semi-infinite scattering medium with the dipole approximation (Jensen et al. 2001).
+	The profile is tabulated once per volume handler, with the samples packed near the center where it is steepest */
+class DiffusionProfile final
+{
+	public:
+		DiffusionProfile(const Rgb &sigma_a, const Rgb &sigma_s_reduced, float ior);
+		//! Diffuse reflectance per unit area at the distance r of the point where the light entered
+		Rgb eval(float r) const;
+		float getMaxRadius() const { return max_radius_; } //!< the profile is 0 beyond this distance
+		float getMeanFreePath() const { return mean_free_path_; } //!< smallest diffusion mean free path 1/sigma_tr of the color channels
+		float getIor() const { return ior_; }
+		float getDiffuseFresnelReflectance() const { return f_dr_; }
+
+	private:
+		static constexpr int table_size_ = 256;
+		std::array<Rgb, table_size_> table_;
+		float max_radius_;
+		float mean_free_path_;
+		float ior_;
+		float f_dr_;
+};
+
+/*! Irradiance point cloud on the surface of an object with subsurface scattering, evaluated hierarchically with an octree
+	(Jensen and Buhler 2002). The far clusters of points are replaced by their total power at their area weighted center */
+class SssPointCloud final
+{
+	public:
+		struct Point
+		{
+			Point3 p_;
+			Vec3 n_;
+			float area_;
+			Rgb irradiance_;
+		};
+		SssPointCloud(std::vector<Point> &&points, float max_error);
+		//! Radiant exitance at p, with the light diffused from all the points of the cloud
+		Rgb radiantExitance(const Point3 &p, const DiffusionProfile &profile) const;
+		size_t getNumPoints() const { return points_.size(); }
+
+	private:
+		struct Node
+		{
+			Point3 center_; //!< area weighted position of the points of the node
+			float radius_; //!< half the diagonal of the bound of the points
+			Rgb power_; //!< irradiance times area of the points
+			std::array<int, 8> children_; //!< -1 for the missing children
+			int first_point_;
+			int num_points_;
+			bool leaf_;
+		};
+		int build(const Bound &bound, int first_point, int num_points, int depth);
+
+		std::vector<Point> points_; //!< sorted by leaf
+		std::vector<Node> nodes_;
+		float max_error_; //!< largest ratio between the size of a cluster and its distance for using it as a whole
+};
+
+END_YAFARAY
+
+#endif //YAFARAY_SSS_DIFFUSION_H
@@ -25,11 +25,14 @@
 #include "color/color.h"
 #include "common/memory.h"
 #include <map>
+#include <vector>
 
 BEGIN_YAFARAY
 
 class RenderData;
 struct PSample;
+class Random;
+class DiffusionProfile;
 class Light;
 class Ray;
 class ParamMap;
@@ -41,6 +44,8 @@ class VolumeHandler
 		static std::unique_ptr<VolumeHandler> factory(const ParamMap &params, const Scene &scene);
 		virtual bool transmittance(const RenderData &render_data, const Ray &ray, Rgb &col) const = 0;
 		virtual bool scatter(const RenderData &render_data, const Ray &ray, Ray &s_ray, PSample &s) const = 0;
+		//! diffusion profile for the integrators computing the subsurface scattering with an irradiance point cloud, nullptr for the volumes traced through
+		virtual const DiffusionProfile *getDiffusionProfile() const { return nullptr; }
 		virtual ~VolumeHandler() = default;
 };
 
@@ -72,6 +77,11 @@ class VolumeRegion
 
 		virtual Rgb tau(const Ray &ray, float step, float offset) const = 0;
 
+		//! Upper bound of sigmaT(p).energy() anywhere inside the region, used as majorant for delta and ratio tracking
+		virtual float majorant() const { return (s_a_ + s_s_).energy(); }
+		//! Unbiased estimate of the transmittance along the ray through the region, using ratio tracking against the majorant
+		float ratioTracking(const Ray &ray, Random &prng) const;
+
 		Bound::Cross crossBound(const Ray &ray) const
 		{
 			return b_box_.cross(ray, 10000.f);
@@ -80,7 +90,7 @@ class VolumeRegion
 		Bound getBb() const { return b_box_; }
 
 		int att_grid_x_, att_grid_y_, att_grid_z_; // FIXME: un-hardcode
-		std::map<const Light *, float *> attenuation_grid_map_; // FIXME: un-hardcode
+		std::map<const Light *, std::shared_ptr<const std::vector<float>>> attenuation_grid_map_; // FIXME: un-hardcode
 
 	protected:
 		Bound b_box_;
@@ -100,6 +110,7 @@ class DensityVolumeRegion : public VolumeRegion
 		virtual float density(Point3 p) const = 0;
 
 		virtual Rgb tau(const Ray &ray, float step_size, float offset) const override;
+		virtual float majorant() const override { return (s_a_ + s_s_).energy() * max_density_; }
 
 		virtual Rgb sigmaA(const Point3 &p, const Vec3 &v) const override
 		{
@@ -135,6 +146,7 @@ class DensityVolumeRegion : public VolumeRegion
 				return Rgb(0.f);
 		}
 
+		float max_density_ = 1.f; //!< upper bound of density() inside the region
 };
 
 
@@ -37,6 +37,8 @@ class ExpDensityVolumeRegion final : public DensityVolumeRegion
 	private:
 		ExpDensityVolumeRegion(Rgb sa, Rgb ss, Rgb le, float gg, Point3 pmin, Point3 pmax, int attgrid_scale, float aa, float bb);
 		virtual float density(Point3 p) const override;
+		//! closed form optical thickness, the integral of the exponential density along the ray
+		virtual Rgb tau(const Ray &ray, float step_size, float offset) const override;
 
 		float a_, b_;
 };
@@ -21,6 +21,7 @@
 #define YAFARAY_VOLUME_GRID_H
 
 #include "volume/volume.h"
+#include "volume/volume_sparse_grid.h"
 
 #include <fstream>
 #include <cstdlib>
@@ -36,14 +37,13 @@ class GridVolumeRegion final : public DensityVolumeRegion
 {
 	public:
 		static std::unique_ptr<VolumeRegion> factory(const ParamMap &params, const Scene &scene);
-		~GridVolumeRegion() override;
 
 	private:
 		GridVolumeRegion(Rgb sa, Rgb ss, Rgb le, float gg, Point3 pmin, Point3 pmax);
 		virtual float density(Point3 p) const override;
+		virtual Rgb tau(const Ray &ray, float step_size, float offset) const override;
 
-		float ***grid_ = nullptr;
-		int size_x_, size_y_, size_z_;
+		SparseGrid grid_;
 };
 
 END_YAFARAY
@@ -21,6 +21,9 @@
 #define YAFARAY_VOLUME_NOISE_H
 
 #include "volume/volume.h"
+#include <array>
+#include <atomic>
+#include <functional>
 
 BEGIN_YAFARAY
 
@@ -30,6 +33,35 @@ class ParamMap;
 class Scene;
 class Texture;
 
+/*! Density of a region baked into a regular grid of samples, interpolated trilinearly. The grid is split in bricks baked lazily by
+	the first thread reading them and published with atomic pointers, so only the bricks reached by the rays are baked and the threads
+	share them without locking. Two threads reaching a new brick at once both bake it and the second one discards its copy */
+class DensityBrickCache final
+{
+	public:
+		DensityBrickCache() = default;
+		DensityBrickCache(const DensityBrickCache &) = delete;
+		~DensityBrickCache();
+		//! resolution is the number of voxels along the largest side of the bound, 0 disables the cache
+		void init(const Bound &bound, int resolution, std::function<float(const Point3 &)> bake_density);
+		bool enabled() const { return num_bricks_ > 0; }
+		float density(const Point3 &p) const;
+
+	private:
+		static constexpr int brick_size_ = 8; //!< voxels along each side of a brick
+		static constexpr int brick_samples_ = brick_size_ + 1; //!< samples along each side of a brick, at the corners of its voxels
+		const float *bakeBrick(int brick_x, int brick_y, int brick_z) const;
+
+		Bound bound_;
+		std::array<int, 3> voxels_ {{0, 0, 0}};
+		std::array<int, 3> bricks_ {{0, 0, 0}};
+		std::array<float, 3> voxel_size_ {{1.f, 1.f, 1.f}};
+		int num_bricks_ = 0;
+		std::unique_ptr<std::atomic<const float *>[]> brick_samples_data_; //!< per brick, nullptr until it is baked
+		std::function<float(const Point3 &)> bake_density_;
+		mutable std::atomic<int64_t> baked_bytes_ {0};
+};
+
 class NoiseVolumeRegion final : public DensityVolumeRegion
 {
 	public:
@@ -37,20 +69,24 @@ class NoiseVolumeRegion final : public DensityVolumeRegion
 
 	private:
 		NoiseVolumeRegion(Rgb sa, Rgb ss, Rgb le, float gg, float cov, float sharp, float dens,
-						  Point3 pmin, Point3 pmax, int attgrid_scale, Texture *noise) :
+						  Point3 pmin, Point3 pmax, int attgrid_scale, Texture *noise, int cache_resolution) :
 				DensityVolumeRegion(sa, ss, le, gg, pmin, pmax, attgrid_scale)
 		{
 			tex_dist_noise_ = noise;
 			cover_ = cov;
 			sharpness_ = sharp * sharp;
 			density_ = dens;
+			max_density_ = dens; // the logistic cover function is bounded by 1
+			density_cache_.init(b_box_, cache_resolution, [this](const Point3 &p) { return noiseDensity(p); });
 		}
 		virtual float density(Point3 p) const override;
+		float noiseDensity(const Point3 &p) const; //!< evaluates the noise texture, without the cache
 
 		Texture *tex_dist_noise_;
 		float cover_;
 		float sharpness_;
 		float density_;
+		DensityBrickCache density_cache_; //!< optional, trades the noise evaluations of the ray marching for the interpolation of the baked density
 };
 
 END_YAFARAY
@@ -0,0 +1,75 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_VOLUME_REGION_TREE_H
+#define YAFARAY_VOLUME_REGION_TREE_H
+
+#include "constants.h"
+#include "geometry/bound.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+BEGIN_YAFARAY
+
+class VolumeRegion;
+
+/*! Bounding volume hierarchy over the bounds of the volume regions, so the volume integrators only visit the regions crossed by each ray
+	instead of all the regions of the scene. The nodes are stored depth first, the first child of an inner node follows it */
+class VolumeRegionTree final
+{
+	public:
+		//! region crossed by a ray, with the interval of the ray inside its bound clipped to the ray extent
+		struct Hit
+		{
+			const VolumeRegion *region_;
+			float enter_;
+			float leave_;
+		};
+		void build(const std::map<std::string, std::unique_ptr<VolumeRegion>> &volume_regions);
+		bool empty() const { return entries_.empty(); }
+		size_t size() const { return entries_.size(); }
+		/*! fills hits with the regions whose bounds the ray crosses between 0 and its tmax_ (unbounded when negative), sorted by their entry distance */
+		void intersect(const Ray &ray, std::vector<Hit> &hits) const;
+
+	private:
+		struct Entry
+		{
+			const VolumeRegion *region_;
+			Bound bound_;
+		};
+		struct Node
+		{
+			Bound bound_;
+			uint32_t first_; //!< first region of a leaf, or second child of an inner node
+			uint32_t count_; //!< regions of a leaf, 0 for the inner nodes
+		};
+		static constexpr uint32_t max_leaf_regions_ = 2;
+		static constexpr int max_depth_ = 64;
+		static constexpr float max_distance_ = 10000.f; //!< farthest crossing of the unbounded rays, as in VolumeRegion::crossBound
+		uint32_t buildNode(uint32_t begin, uint32_t end);
+
+		std::vector<Entry> entries_; //!< sorted so the regions of each leaf are contiguous
+		std::vector<Node> nodes_;
+};
+
+END_YAFARAY
+
+#endif // YAFARAY_VOLUME_REGION_TREE_H
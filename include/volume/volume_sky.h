@@ -43,9 +43,13 @@ class SkyVolumeRegion final : public VolumeRegion
 		virtual Rgb sigmaS(const Point3 &p, const Vec3 &v) const override;
 		virtual Rgb emission(const Point3 &p, const Vec3 &v) const override;
 		virtual Rgb tau(const Ray &ray, float step, float offset) const override;
+		virtual float majorant() const override { return (s_ray_ + s_mie_).energy(); }
 
 		Rgb s_ray_;
 		Rgb s_mie_;
+		float rayleigh_factor_; //!< Rayleigh phase function factor, with the Rayleigh scattering energy
+		float mie_k_; //!< Schlick approximation of the Henyey-Greenstein phase function for the Mie scattering
+		float mie_factor_;
 };
 
 END_YAFARAY
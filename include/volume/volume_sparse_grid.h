@@ -0,0 +1,93 @@
+#pragma once
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef YAFARAY_VOLUME_SPARSE_GRID_H
+#define YAFARAY_VOLUME_SPARSE_GRID_H
+
+#include "constants.h"
+#include "common/memory_stats.h"
+#include <vector>
+#include <cstdint>
+
+BEGIN_YAFARAY
+
+/*! Sparse voxel grid made of 8x8x8 blocks, only the blocks holding non-zero values are allocated.
+ *  After loading, buildMipLevels() computes the per-block min/max densities and a pyramid of coarser
+ *  min/max levels on top of them, used for empty space skipping and as local majorants. */
+class SparseGrid final
+{
+	public:
+		static constexpr int block_log_2_ = 3;
+		static constexpr int block_size_ = 1 << block_log_2_;
+		static constexpr int block_mask_ = block_size_ - 1;
+		static constexpr int block_voxels_ = block_size_ * block_size_ * block_size_;
+
+		struct MipLevel
+		{
+			int size_x_, size_y_, size_z_; //!< number of cells in this level, each cell covers (block_size_ << level) voxels per axis
+			std::vector<float> min_, max_;
+		};
+
+		void resize(int size_x, int size_y, int size_z);
+		void setVoxel(int x, int y, int z, float value);
+		float getVoxel(int x, int y, int z) const;
+		//! trilinear interpolation at the given (continuous) voxel coordinates, clamped to the grid
+		float interpolate(float x, float y, float z) const;
+		void buildMipLevels();
+
+		int getSizeX() const { return size_x_; }
+		int getSizeY() const { return size_y_; }
+		int getSizeZ() const { return size_z_; }
+		size_t getNumAllocatedBlocks() const { return block_data_.size() / block_voxels_; }
+		size_t getNumBlocks() const { return block_index_.size(); }
+		int getNumMipLevels() const { return static_cast<int>(mip_levels_.size()); }
+		const MipLevel &getMipLevel(int level) const { return mip_levels_[level]; }
+		//! maximum value of the block containing voxel (x, y, z)
+		float blockMax(int x, int y, int z) const;
+		float getMin() const { return mip_levels_.empty() ? 0.f : mip_levels_.back().min_[0]; }
+		float getMax() const { return mip_levels_.empty() ? 0.f : mip_levels_.back().max_[0]; }
+
+	private:
+		static constexpr uint32_t empty_block_ = 0xFFFFFFFF;
+		size_t blockIndex(int x, int y, int z) const { return ((z >> block_log_2_) * blocks_y_ + (y >> block_log_2_)) * blocks_x_ + (x >> block_log_2_); }
+		static size_t voxelOffset(int x, int y, int z) { return (((z & block_mask_) << block_log_2_) + (y & block_mask_)) * block_size_ + (x & block_mask_); }
+
+		int size_x_ = 0, size_y_ = 0, size_z_ = 0;
+		int blocks_x_ = 0, blocks_y_ = 0, blocks_z_ = 0;
+		std::vector<uint32_t> block_index_; //!< per block offset in block voxels into block_data_, or empty_block_
+		std::vector<float> block_data_;
+		std::vector<MipLevel> mip_levels_; //!< level 0 holds one cell per block, the last level a single cell for the whole grid
+		MemoryTracker memory_tracker_ {MemoryStats::Volumes}; //!< set once the mip levels are built
+};
+
+inline float SparseGrid::getVoxel(int x, int y, int z) const
+{
+	const uint32_t block = block_index_[blockIndex(x, y, z)];
+	if(block == empty_block_) return 0.f;
+	return block_data_[static_cast<size_t>(block) * block_voxels_ + voxelOffset(x, y, z)];
+}
+
+inline float SparseGrid::blockMax(int x, int y, int z) const
+{
+	return mip_levels_.front().max_[blockIndex(x, y, z)];
+}
+
+END_YAFARAY
+
+#endif // YAFARAY_VOLUME_SPARSE_GRID_H
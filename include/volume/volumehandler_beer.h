@@ -35,6 +35,7 @@ class BeerVolumeHandler : public VolumeHandler
 	protected:
 		BeerVolumeHandler(const Rgb &sigma): sigma_a_(sigma) {};
 		BeerVolumeHandler(const Rgb &acol, double dist);
+		Rgb getSigmaA() const { return sigma_a_; }
 
 	private:
 		virtual bool transmittance(const RenderData &render_data, const Ray &ray, Rgb &col) const override;
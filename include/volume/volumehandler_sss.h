@@ -21,6 +21,7 @@
 #define YAFARAY_VOLUMEHANDLER_SSS_H
 
 #include "volume/volumehandler_beer.h"
+#include "volume/sss_diffusion.h"
 
 BEGIN_YAFARAY
 
@@ -33,11 +34,14 @@ class SssVolumeHandler final : public BeerVolumeHandler
 		static std::unique_ptr<VolumeHandler> factory(const ParamMap &params, const Scene &scene);
 
 	private:
-		SssVolumeHandler(const Rgb &a_col, const Rgb &s_col, double dist);
+		enum class Mode : int { RandomWalk, Diffusion };
+		SssVolumeHandler(const Rgb &a_col, const Rgb &s_col, double dist, Mode mode, float ior);
 		virtual bool scatter(const RenderData &render_data, const Ray &ray, Ray &s_ray, PSample &s) const override;
+		virtual const DiffusionProfile *getDiffusionProfile() const override { return diffusion_profile_.get(); }
 
 		float dist_s_;
 		Rgb scatter_col_;
+		std::unique_ptr<const DiffusionProfile> diffusion_profile_; //!< only in the diffusion mode
 };
 
 END_YAFARAY
@@ -20,8 +20,16 @@
 #include "accelerator/accelerator_kdtree.h"
 #include "accelerator/accelerator_kdtree_multi_thread.h"
 #include "accelerator/accelerator_simple_test.h"
+#include "accelerator/accelerator_bvh.h"
+#include "accelerator/accelerator_embree.h"
 #include "common/logger.h"
 #include "common/param.h"
+#include "geometry/ray.h"
+#include "geometry/primitive.h"
+#include "geometry/surface.h"
+#include "geometry/matrix4.h"
+#include "material/material.h"
+#include "render/render_data.h"
 
 BEGIN_YAFARAY
 
@@ -38,6 +46,10 @@ std::unique_ptr<Accelerator> Accelerator::factory(const std::vector<const Primit
 	if(type == "yafaray-kdtree-original") accelerator = AcceleratorKdTree::factory(primitives_list, params);
 	else if(type == "yafaray-kdtree-multi-thread") accelerator = AcceleratorKdTreeMultiThread::factory(primitives_list, params);
 	else if(type == "yafaray-simpletest") accelerator = AcceleratorSimpleTest::factory(primitives_list, params);
+	else if(type == "yafaray-bvh") accelerator = AcceleratorBvh::factory(primitives_list, params);
+#ifdef HAVE_EMBREE
+	else if(type == "yafaray-embree") accelerator = AcceleratorEmbree::factory(primitives_list, params);
+#endif
 
 	if(accelerator) Y_INFO << "Accelerator type '" << type << "' created." << YENDL;
 	else
@@ -48,4 +60,34 @@ std::unique_ptr<Accelerator> Accelerator::factory(const std::vector<const Primit
 	return accelerator;
 }
 
+std::vector<AcceleratorIntersectData> Accelerator::intersectStream(const std::vector<Ray> &rays, const std::vector<float> &t_max) const
+{
+	std::vector<AcceleratorIntersectData> results;
+	results.reserve(rays.size());
+	for(size_t ray_num = 0; ray_num < rays.size(); ++ray_num) results.emplace_back(intersect(rays[ray_num], t_max[ray_num]));
+	return results;
+}
+
+std::vector<AcceleratorIntersectData> Accelerator::intersectStreamS(const std::vector<Ray> &rays, const std::vector<float> &t_max, float shadow_bias) const
+{
+	std::vector<AcceleratorIntersectData> results;
+	results.reserve(rays.size());
+	for(size_t ray_num = 0; ray_num < rays.size(); ++ray_num) results.emplace_back(intersectS(rays[ray_num], t_max[ray_num], shadow_bias));
+	return results;
+}
+
+bool Accelerator::accumulateTransparency(AcceleratorTsIntersectData &accelerator_intersect_data, RenderData &render_data, const MemoryArena::Marker &material_data_marker, const Primitive *primitive, const Ray &ray, const Matrix4 *obj_to_world)
+{
+	const Material *mat = primitive->getMaterial();
+	const Point3 hit_point = ray.from_ + accelerator_intersect_data.t_hit_ * ray.dir_;
+	SurfacePoint sp = primitive->getSurface(obj_to_world ? *obj_to_world * hit_point : hit_point, accelerator_intersect_data, obj_to_world);
+	sp.hit_primitive_ = primitive;
+	render_data.arena_.rewind(material_data_marker); //the material data of the previous hit is no longer needed
+	render_data.material_data_ = render_data.allocMaterialData(mat->getReqMem()); //the material data before the shadow test is restored by its caller
+	accelerator_intersect_data.transparent_color_ *= mat->getTransparency(render_data, sp, obj_to_world ? *obj_to_world * ray.dir_ : ray.dir_);
+	if(accelerator_intersect_data.transparent_color_.maximum() >= min_transparency_) return false;
+	accelerator_intersect_data.transparent_color_ = Rgb(0.f);
+	return true;
+}
+
 END_YAFARAY
@@ -0,0 +1,1134 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "yafaray_config.h"
+#include "accelerator/accelerator_bvh.h"
+#include "material/material.h"
+#include "render/render_data.h"
+#include "common/logger.h"
+#include "geometry/surface.h"
+#include "geometry/matrix4.h"
+#include "geometry/primitive.h"
+#include "geometry/intersect_data.h"
+#include "geometry/poly_double.h"
+#include "geometry/axis.h"
+#include "common/param.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <set>
+
+BEGIN_YAFARAY
+
+#ifdef YAFARAY_SIMD_DISPATCH
+//The kernels are inlined into their variants for each instruction set
+#define YAFARAY_SIMD_KERNEL __attribute__((always_inline)) inline
+#else
+#define YAFARAY_SIMD_KERNEL inline
+#endif
+
+std::unique_ptr<Accelerator> AcceleratorBvh::factory(const std::vector<const Primitive *> &primitives, ParamMap &params)
+{
+	AcceleratorBvh::Parameters parameters;
+
+	params.getParam("bvh_leaf_size", parameters.max_leaf_size_);
+	params.getParam("bvh_bins", parameters.num_bins_);
+	params.getParam("bvh_cost_ratio", parameters.cost_ratio_);
+	params.getParam("accelerator_threads", parameters.num_threads_);
+	params.getParam("accelerator_min_indices_threads", parameters.min_indices_to_spawn_threads_);
+	params.getParam("bvh_triangle_blocks", parameters.triangle_blocks_);
+	params.getParam("bvh_spatial_splits", parameters.spatial_splits_);
+	params.getParam("bvh_spatial_split_budget", parameters.spatial_split_budget_);
+	std::string huge_pages = "none";
+	params.getParam("huge_pages", huge_pages);
+	parameters.huge_pages_mode_ = HugePages::modeFromName(huge_pages);
+
+	auto accelerator = std::unique_ptr<Accelerator>(new AcceleratorBvh(primitives, parameters));
+	return accelerator;
+}
+
+AcceleratorBvh::AcceleratorBvh(const std::vector<const Primitive *> &primitives, const Parameters &parameters) : nodes_(LargeBufferAllocator<Node>(parameters.huge_pages_mode_)), triangle_blocks_(LargeBufferAllocator<TriangleBlock>(parameters.huge_pages_mode_))
+{
+	selectSimdKernels();
+	Parameters tree_build_parameters = parameters;
+	tree_build_parameters.max_leaf_size_ = std::max(1, tree_build_parameters.max_leaf_size_);
+	tree_build_parameters.num_bins_ = std::max(2, std::min(tree_build_parameters.num_bins_, 256));
+	const uint32_t num_primitives = static_cast<uint32_t>(primitives.size());
+	Y_INFO << "BVH: Starting build (" << num_primitives << " prims, bins:" << tree_build_parameters.num_bins_ << " cost_ratio:" << tree_build_parameters.cost_ratio_ << " leaf_size:" << tree_build_parameters.max_leaf_size_ << ") [using " << tree_build_parameters.num_threads_ << " threads, min indices to spawn threads: " << tree_build_parameters.min_indices_to_spawn_threads_ << "]" << YENDL;
+	const clock_t clock_start = clock();
+	std::vector<BuildPrimitive> build_primitives(num_primitives);
+	tree_bound_ = primitives.front()->getBound();
+	for(uint32_t prim_num = 0; prim_num < num_primitives; ++prim_num)
+	{
+		build_primitives[prim_num].bound_ = primitives[prim_num]->getBound();
+		build_primitives[prim_num].centroid_ = build_primitives[prim_num].bound_.center();
+		build_primitives[prim_num].primitive_index_ = prim_num;
+		build_primitives[prim_num].primitive_ = primitives[prim_num];
+		tree_bound_ = Bound(tree_bound_, build_primitives[prim_num].bound_);
+	}
+	Bound bound_start, bound_end;
+	const bool has_motion_blur = std::any_of(primitives.begin(), primitives.end(), [&](const Primitive *primitive) { return primitive->getMotionBounds(bound_start, bound_end); });
+	if(has_motion_blur && tree_build_parameters.spatial_splits_)
+	{
+		//The clipped references do not have motion bounds
+		Y_VERBOSE << "BVH: Spatial splits disabled, there are primitives with motion blur" << YENDL;
+		tree_build_parameters.spatial_splits_ = false;
+	}
+	if(tree_build_parameters.spatial_splits_)
+	{
+		//Overlap threshold relative to the whole tree, as proposed in the SBVH paper, so the spatial splits are only tried where the object splits do not work well
+		spatial_split_min_overlap_ = 1.0e-5f * surfaceArea(tree_bound_);
+		spatial_split_references_left_ = static_cast<int64_t>(std::max(0.f, tree_build_parameters.spatial_split_budget_) * num_primitives);
+	}
+	Stats stats;
+	if(tree_build_parameters.num_threads_ > 1) task_pool_ = std::unique_ptr<TaskPool>(new TaskPool(tree_build_parameters.num_threads_));
+	const std::unique_ptr<BuildNode> root = buildTree(build_primitives, 0, num_primitives, 0, tree_build_parameters, stats);
+	task_pool_.reset();
+	has_duplicated_references_ = stats.duplicated_references_ > 0;
+	nodes_.reserve(stats.interior_nodes_ + stats.leaves_);
+	primitives_.reserve(num_primitives + stats.duplicated_references_);
+	flattenTree(*root, primitives, parameters.triangle_blocks_);
+	buildRayMasks();
+	if(parameters.triangle_blocks_) buildTriangleBlocks();
+	if(has_motion_blur) buildMotionBounds();
+	memory_tracker_.set(vectorMemory_global(nodes_) + vectorMemory_global(primitives_) + vectorMemory_global(ray_masks_) + vectorMemory_global(motion_bounds_) + vectorMemory_global(triangle_blocks_));
+	const clock_t clock_elapsed = clock() - clock_start;
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "BVH: CPU total clocks (in seconds): " << static_cast<float>(clock_elapsed) / static_cast<float>(CLOCKS_PER_SEC) << "s (actual CPU work, including the work done by all threads added together)" << YENDL;
+	stats.outputLog(num_primitives, static_cast<uint32_t>(nodes_.size()));
+	stats_.accelerator_ = "yafaray-bvh";
+	stats_.build_ = {
+		{"cost_ratio", tree_build_parameters.cost_ratio_},
+		{"bins", tree_build_parameters.num_bins_},
+		{"max_leaf_size", tree_build_parameters.max_leaf_size_},
+		{"build_cpu_seconds", static_cast<float>(clock_elapsed) / static_cast<float>(CLOCKS_PER_SEC)},
+		{"nodes", nodes_.size()},
+		{"interior_nodes", stats.interior_nodes_},
+		{"leaves", stats.leaves_},
+		{"max_leaf_primitives", stats.max_leaf_primitives_},
+		{"forced_splits", stats.forced_splits_},
+		{"max_depth", stats.max_depth_},
+		{"spatial_splits", stats.spatial_splits_},
+		{"duplicated_references", stats.duplicated_references_},
+		{"simd_level", static_cast<int>(simd_level_)},
+	};
+}
+
+AcceleratorBvh::~AcceleratorBvh()
+{
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "BVH: Done" << YENDL;
+}
+
+void AcceleratorBvh::Stats::outputLog(uint32_t num_primitives, uint32_t num_nodes) const
+{
+	if(Y_LOG_HAS_VERBOSE)
+	{
+		Y_VERBOSE << "BVH: Primitives in tree: " << num_primitives << ", nodes: " << num_nodes << " (" << num_nodes * sizeof(Node) / 1024 << " KB)" << YENDL;
+		Y_VERBOSE << "BVH: Interior nodes: " << interior_nodes_ << " / leaf nodes: " << leaves_ << " (" << static_cast<float>(num_primitives) / leaves_ << " prims per leaf, max: " << max_leaf_primitives_ << ")" << YENDL;
+		Y_VERBOSE << "BVH: Tree depth: " << max_depth_ << ", forced (non-SAH) splits: " << forced_splits_ << YENDL;
+		if(spatial_splits_ > 0) Y_VERBOSE << "BVH: Spatial splits: " << spatial_splits_ << ", duplicated references: " << duplicated_references_ << " (" << 100.f * static_cast<float>(duplicated_references_) / num_primitives << "%)" << YENDL;
+	}
+}
+
+AcceleratorBvh::Stats &AcceleratorBvh::Stats::operator += (const Stats &stats)
+{
+	interior_nodes_ += stats.interior_nodes_;
+	leaves_ += stats.leaves_;
+	forced_splits_ += stats.forced_splits_;
+	max_leaf_primitives_ = std::max(max_leaf_primitives_, stats.max_leaf_primitives_);
+	max_depth_ = std::max(max_depth_, stats.max_depth_);
+	spatial_splits_ += stats.spatial_splits_;
+	duplicated_references_ += stats.duplicated_references_;
+	return *this;
+}
+
+float AcceleratorBvh::surfaceArea(const Bound &bound)
+{
+	const float x = bound.longX();
+	const float y = bound.longY();
+	const float z = bound.longZ();
+	return x * y + x * z + y * z;
+}
+
+// ============================================================
+/*!
+	recursively build the BVH using binned SAH over the primitive centroids
+*/
+std::unique_ptr<AcceleratorBvh::BuildNode> AcceleratorBvh::buildTree(std::vector<BuildPrimitive> &build_primitives, uint32_t begin, uint32_t end, int depth, const Parameters &parameters, Stats &stats) const
+{
+	std::unique_ptr<BuildNode> result;
+	buildTreeWorker(build_primitives, begin, end, depth, parameters, stats, result);
+	return result;
+}
+
+void AcceleratorBvh::buildTreeWorker(std::vector<BuildPrimitive> &build_primitives, uint32_t begin, uint32_t end, int depth, const Parameters &parameters, Stats &stats, std::unique_ptr<BuildNode> &result) const
+{
+	result = std::unique_ptr<BuildNode>(new BuildNode());
+	BuildNode &node = *result;
+	node.bound_ = build_primitives[begin].bound_;
+	Bound centroid_bound(build_primitives[begin].centroid_, build_primitives[begin].centroid_);
+	for(uint32_t prim_num = begin + 1; prim_num < end; ++prim_num)
+	{
+		node.bound_ = Bound(node.bound_, build_primitives[prim_num].bound_);
+		centroid_bound.include(build_primitives[prim_num].centroid_);
+	}
+	const uint32_t num_node_primitives = end - begin;
+	const auto make_leaf = [&]()
+	{
+		node.primitive_indices_.reserve(num_node_primitives);
+		for(uint32_t prim_num = begin; prim_num < end; ++prim_num) node.primitive_indices_.emplace_back(build_primitives[prim_num].primitive_index_);
+		++stats.leaves_;
+		stats.max_leaf_primitives_ = std::max(stats.max_leaf_primitives_, static_cast<int>(num_node_primitives));
+		stats.max_depth_ = std::max(stats.max_depth_, depth);
+	};
+	if(num_node_primitives == 1 || depth >= max_stack_ - 1)
+	{
+		make_leaf();
+		return;
+	}
+
+	const std::array<float, 3> centroid_extent {{ centroid_bound.longX(), centroid_bound.longY(), centroid_bound.longZ() }};
+	int axis = 0;
+	if(centroid_extent[1] > centroid_extent[axis]) axis = 1;
+	if(centroid_extent[2] > centroid_extent[axis]) axis = 2;
+
+	uint32_t middle = begin + num_node_primitives / 2;
+	SpatialSplit spatial_split;
+	bool use_spatial_split = false;
+	std::vector<BuildPrimitive> left_primitives, right_primitives; //Only for spatial splits, that create new references
+	if(centroid_extent[axis] <= 0.f)
+	{
+		//All centroids in the same point, SAH cannot separate them
+		if(num_node_primitives <= static_cast<uint32_t>(parameters.max_leaf_size_))
+		{
+			make_leaf();
+			return;
+		}
+		++stats.forced_splits_;
+	}
+	else
+	{
+		const int num_bins = parameters.num_bins_;
+		std::vector<Bin> bins(num_bins);
+		std::vector<float> costs(num_bins - 1);
+		const float inv_node_area = 1.f / std::max(surfaceArea(node.bound_), std::numeric_limits<float>::min());
+		float best_cost = std::numeric_limits<float>::infinity();
+		int best_axis = -1;
+		int best_split_bin = 0;
+		for(int bin_axis = 0; bin_axis < 3; ++bin_axis)
+		{
+			if(centroid_extent[bin_axis] <= 0.f) continue;
+			const float min = centroid_bound.a_[bin_axis];
+			const float bin_scale = static_cast<float>(num_bins) / centroid_extent[bin_axis];
+			for(auto &bin : bins) bin = {};
+			for(uint32_t prim_num = begin; prim_num < end; ++prim_num)
+			{
+				int bin_id = static_cast<int>((build_primitives[prim_num].centroid_[bin_axis] - min) * bin_scale);
+				if(bin_id >= num_bins) bin_id = num_bins - 1;
+				if(bins[bin_id].count_ == 0) bins[bin_id].bound_ = build_primitives[prim_num].bound_;
+				else bins[bin_id].bound_ = Bound(bins[bin_id].bound_, build_primitives[prim_num].bound_);
+				++bins[bin_id].count_;
+			}
+			//Sweep from the left accumulating area * count, then from the right adding the other side
+			Bound accumulated_bound;
+			uint32_t accumulated_count = 0;
+			for(int bin_id = 0; bin_id < num_bins - 1; ++bin_id)
+			{
+				if(bins[bin_id].count_ > 0)
+				{
+					accumulated_bound = (accumulated_count == 0) ? bins[bin_id].bound_ : Bound(accumulated_bound, bins[bin_id].bound_);
+					accumulated_count += bins[bin_id].count_;
+				}
+				costs[bin_id] = (accumulated_count > 0) ? accumulated_count * surfaceArea(accumulated_bound) : 0.f;
+			}
+			accumulated_count = 0;
+			for(int bin_id = num_bins - 1; bin_id > 0; --bin_id)
+			{
+				if(bins[bin_id].count_ > 0)
+				{
+					accumulated_bound = (accumulated_count == 0) ? bins[bin_id].bound_ : Bound(accumulated_bound, bins[bin_id].bound_);
+					accumulated_count += bins[bin_id].count_;
+				}
+				if(accumulated_count > 0) costs[bin_id - 1] += accumulated_count * surfaceArea(accumulated_bound);
+			}
+			for(int bin_id = 0; bin_id < num_bins - 1; ++bin_id)
+			{
+				const float cost = parameters.cost_ratio_ + costs[bin_id] * inv_node_area;
+				if(cost < best_cost)
+				{
+					best_cost = cost;
+					best_axis = bin_axis;
+					best_split_bin = bin_id;
+				}
+			}
+		}
+		if(parameters.spatial_splits_ && best_axis >= 0 && spatial_split_references_left_ > 0)
+		{
+			//Overlap of the children of the best object split
+			const float min = centroid_bound.a_[best_axis];
+			const float bin_scale = static_cast<float>(num_bins) / centroid_extent[best_axis];
+			Bound left_bound, right_bound;
+			bool left_empty = true, right_empty = true;
+			for(uint32_t prim_num = begin; prim_num < end; ++prim_num)
+			{
+				int bin_id = static_cast<int>((build_primitives[prim_num].centroid_[best_axis] - min) * bin_scale);
+				if(bin_id >= num_bins) bin_id = num_bins - 1;
+				Bound &side_bound = (bin_id <= best_split_bin) ? left_bound : right_bound;
+				bool &side_empty = (bin_id <= best_split_bin) ? left_empty : right_empty;
+				side_bound = side_empty ? build_primitives[prim_num].bound_ : Bound(side_bound, build_primitives[prim_num].bound_);
+				side_empty = false;
+			}
+			float overlap_area = 0.f;
+			if(!left_empty && !right_empty)
+			{
+				Point3 overlap_min, overlap_max;
+				bool overlap = true;
+				for(int axis_num = 0; axis_num < 3; ++axis_num)
+				{
+					overlap_min[axis_num] = std::max(left_bound.a_[axis_num], right_bound.a_[axis_num]);
+					overlap_max[axis_num] = std::min(left_bound.g_[axis_num], right_bound.g_[axis_num]);
+					if(overlap_min[axis_num] > overlap_max[axis_num]) overlap = false;
+				}
+				if(overlap) overlap_area = surfaceArea(Bound(overlap_min, overlap_max));
+			}
+			if(overlap_area > spatial_split_min_overlap_) spatial_split = findSpatialSplit(build_primitives, begin, end, node.bound_, parameters);
+		}
+		const float leaf_cost = static_cast<float>(num_node_primitives);
+		if(num_node_primitives <= static_cast<uint32_t>(parameters.max_leaf_size_) && std::min(best_cost, spatial_split.cost_) >= leaf_cost)
+		{
+			make_leaf();
+			return;
+		}
+		if(spatial_split.cost_ < best_cost)
+		{
+			//The budget check is not synchronized with the other build threads, so it can be exceeded slightly
+			const int64_t num_duplicated_estimated = static_cast<int64_t>(spatial_split.num_left_) + spatial_split.num_right_ - num_node_primitives;
+			if(spatial_split_references_left_ >= num_duplicated_estimated)
+			{
+				for(uint32_t prim_num = begin; prim_num < end; ++prim_num)
+				{
+					const BuildPrimitive &build_primitive = build_primitives[prim_num];
+					if(build_primitive.bound_.g_[spatial_split.axis_] <= spatial_split.position_) left_primitives.emplace_back(build_primitive);
+					else if(build_primitive.bound_.a_[spatial_split.axis_] >= spatial_split.position_) right_primitives.emplace_back(build_primitive);
+					else
+					{
+						BuildPrimitive left, right;
+						bool left_valid, right_valid;
+						splitReference(build_primitive, spatial_split.axis_, spatial_split.position_, left, right, left_valid, right_valid);
+						if(left_valid) left_primitives.emplace_back(left);
+						if(right_valid) right_primitives.emplace_back(right);
+					}
+				}
+				if(!left_primitives.empty() && !right_primitives.empty())
+				{
+					const int num_duplicated = static_cast<int>(left_primitives.size() + right_primitives.size()) - static_cast<int>(num_node_primitives);
+					axis = spatial_split.axis_;
+					use_spatial_split = true;
+					spatial_split_references_left_ -= num_duplicated;
+					++stats.spatial_splits_;
+					stats.duplicated_references_ += num_duplicated;
+				}
+				else
+				{
+					left_primitives.clear();
+					right_primitives.clear();
+				}
+			}
+		}
+		if(!use_spatial_split && best_axis >= 0)
+		{
+			axis = best_axis;
+			const float min = centroid_bound.a_[axis];
+			const float bin_scale = static_cast<float>(num_bins) / centroid_extent[axis];
+			const auto middle_it = std::partition(build_primitives.begin() + begin, build_primitives.begin() + end, [&](const BuildPrimitive &build_primitive)
+			{
+				int bin_id = static_cast<int>((build_primitive.centroid_[axis] - min) * bin_scale);
+				if(bin_id >= num_bins) bin_id = num_bins - 1;
+				return bin_id <= best_split_bin;
+			});
+			middle = static_cast<uint32_t>(middle_it - build_primitives.begin());
+		}
+		if(!use_spatial_split && (middle == begin || middle == end))
+		{
+			//Binning could not separate the primitives (for example due to float precision), split by count instead
+			middle = begin + num_node_primitives / 2;
+			std::nth_element(build_primitives.begin() + begin, build_primitives.begin() + middle, build_primitives.begin() + end, [axis](const BuildPrimitive &a, const BuildPrimitive &b) { return a.centroid_[axis] < b.centroid_[axis]; });
+			++stats.forced_splits_;
+		}
+	}
+
+	node.axis_ = axis;
+	++stats.interior_nodes_;
+	//After a spatial split the children are built from their own new references, otherwise from disjoint ranges of build_primitives
+	std::vector<BuildPrimitive> &left_build_primitives = use_spatial_split ? left_primitives : build_primitives;
+	std::vector<BuildPrimitive> &right_build_primitives = use_spatial_split ? right_primitives : build_primitives;
+	const uint32_t left_begin = use_spatial_split ? 0 : begin;
+	const uint32_t left_end = use_spatial_split ? static_cast<uint32_t>(left_primitives.size()) : middle;
+	const uint32_t right_begin = use_spatial_split ? 0 : middle;
+	const uint32_t right_end = use_spatial_split ? static_cast<uint32_t>(right_primitives.size()) : end;
+	const uint32_t num_left = left_end - left_begin;
+	const uint32_t num_right = right_end - right_begin;
+	if(task_pool_ && std::min(num_left, num_right) >= static_cast<uint32_t>(parameters.min_indices_to_spawn_threads_))
+	{
+		//Left and right subtrees work on different references, so they can be built concurrently. The left subtree is added as a task of the pool, that can be stolen by any idle thread
+		Stats stats_left;
+		Stats stats_right;
+		TaskPool::Group task_group(*task_pool_);
+		task_group.run([&]()
+		{
+			buildTreeWorker(left_build_primitives, left_begin, left_end, depth + 1, parameters, stats_left, node.children_[0]);
+		});
+		buildTreeWorker(right_build_primitives, right_begin, right_end, depth + 1, parameters, stats_right, node.children_[1]);
+		task_group.wait();
+		stats += stats_left;
+		stats += stats_right;
+	}
+	else
+	{
+		node.children_[0] = buildTree(left_build_primitives, left_begin, left_end, depth + 1, parameters, stats);
+		node.children_[1] = buildTree(right_build_primitives, right_begin, right_end, depth + 1, parameters, stats);
+	}
+}
+
+/*! Binned spatial split: the bins divide the node bound instead of the centroids bound, and the
+	references crossing several bins are clipped to each of them, counting them in the bins
+	where they enter and leave */
+AcceleratorBvh::SpatialSplit AcceleratorBvh::findSpatialSplit(const std::vector<BuildPrimitive> &build_primitives, uint32_t begin, uint32_t end, const Bound &node_bound, const Parameters &parameters) const
+{
+	const int num_bins = parameters.num_bins_;
+	const float inv_node_area = 1.f / std::max(surfaceArea(node_bound), std::numeric_limits<float>::min());
+	std::vector<SpatialBin> bins(num_bins);
+	std::vector<Bound> right_bounds(num_bins);
+	SpatialSplit best_split;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float min = node_bound.a_[axis];
+		const float extent = node_bound.g_[axis] - min;
+		if(extent <= 0.f) continue;
+		const float bin_width = extent / num_bins;
+		const float inv_bin_width = 1.f / bin_width;
+		for(auto &bin : bins) bin = {};
+		for(uint32_t prim_num = begin; prim_num < end; ++prim_num)
+		{
+			const BuildPrimitive &build_primitive = build_primitives[prim_num];
+			const int first_bin = std::max(0, std::min(num_bins - 1, static_cast<int>((build_primitive.bound_.a_[axis] - min) * inv_bin_width)));
+			const int last_bin = std::max(first_bin, std::min(num_bins - 1, static_cast<int>((build_primitive.bound_.g_[axis] - min) * inv_bin_width)));
+			for(int bin_id = first_bin; bin_id <= last_bin; ++bin_id)
+			{
+				Bound piece = build_primitive.bound_;
+				if(first_bin != last_bin)
+				{
+					Bound slab = build_primitive.bound_;
+					if(bin_id > first_bin) slab.a_[axis] = min + bin_id * bin_width;
+					if(bin_id < last_bin) slab.g_[axis] = min + (bin_id + 1) * bin_width;
+					if(!clipReference(build_primitive, slab, piece)) continue;
+				}
+				bins[bin_id].bound_ = bins[bin_id].empty_ ? piece : Bound(bins[bin_id].bound_, piece);
+				bins[bin_id].empty_ = false;
+			}
+			++bins[first_bin].entries_;
+			++bins[last_bin].exits_;
+		}
+		//Sweep from the right storing the bounds, then from the left evaluating the split planes between the bins
+		Bound accumulated_bound;
+		bool accumulated_empty = true;
+		for(int bin_id = num_bins - 1; bin_id > 0; --bin_id)
+		{
+			if(!bins[bin_id].empty_)
+			{
+				accumulated_bound = accumulated_empty ? bins[bin_id].bound_ : Bound(accumulated_bound, bins[bin_id].bound_);
+				accumulated_empty = false;
+			}
+			right_bounds[bin_id] = accumulated_bound; //Not used while empty, as there are no references on the right side then
+		}
+		accumulated_empty = true;
+		uint32_t num_left = 0;
+		uint32_t num_right = end - begin;
+		for(int bin_id = 0; bin_id < num_bins - 1; ++bin_id)
+		{
+			if(!bins[bin_id].empty_)
+			{
+				accumulated_bound = accumulated_empty ? bins[bin_id].bound_ : Bound(accumulated_bound, bins[bin_id].bound_);
+				accumulated_empty = false;
+			}
+			num_left += bins[bin_id].entries_;
+			num_right -= bins[bin_id].exits_;
+			if(num_left == 0 || num_right == 0) continue;
+			const float cost = parameters.cost_ratio_ + (num_left * surfaceArea(accumulated_bound) + num_right * surfaceArea(right_bounds[bin_id + 1])) * inv_node_area;
+			if(cost < best_split.cost_)
+			{
+				best_split.cost_ = cost;
+				best_split.axis_ = axis;
+				best_split.position_ = min + (bin_id + 1) * bin_width;
+				best_split.num_left_ = num_left;
+				best_split.num_right_ = num_right;
+			}
+		}
+	}
+	return best_split;
+}
+
+/*! Splits a reference crossing the plane at position in two references, one on each side. If the
+	primitive does not actually reach one of the sides (the reference bound is conservative), that
+	reference is not valid */
+void AcceleratorBvh::splitReference(const BuildPrimitive &build_primitive, int axis, float position, BuildPrimitive &left, BuildPrimitive &right, bool &left_valid, bool &right_valid)
+{
+	left = right = build_primitive;
+	Bound left_slab = build_primitive.bound_;
+	Bound right_slab = build_primitive.bound_;
+	left_slab.g_[axis] = position;
+	right_slab.a_[axis] = position;
+	left_valid = clipReference(build_primitive, left_slab, left.bound_);
+	right_valid = clipReference(build_primitive, right_slab, right.bound_);
+	left.centroid_ = left.bound_.center();
+	right.centroid_ = right.bound_.center();
+}
+
+/*! Bound of the part of the reference primitive inside the clip bound, using the primitive clipping
+	when supported. Returns false if the primitive is not inside the clip bound */
+bool AcceleratorBvh::clipReference(const BuildPrimitive &build_primitive, const Bound &clip_bound, Bound &result)
+{
+	result = clip_bound;
+	if(!build_primitive.primitive_->clippingSupport()) return true;
+	const std::array<Vec3Double, 2> bound {{
+		{ clip_bound.a_.x_, clip_bound.a_.y_, clip_bound.a_.z_ },
+		{ clip_bound.g_.x_, clip_bound.g_.y_, clip_bound.g_.z_ }
+	}};
+	const PolyDouble::ClipResultWithBound clip_result = build_primitive.primitive_->clipToBound(bound, ClipPlane::Pos::None, {}, nullptr);
+	if(clip_result.clip_result_code_ == PolyDouble::ClipResultWithBound::NoOverlapDisappeared) return false;
+	if(clip_result.clip_result_code_ != PolyDouble::ClipResultWithBound::Correct) return true; //Keep the conservative bound if the clipping failed
+	//The clipped bound is calculated in double precision, so it is limited to the clip bound to keep the references inside the node bound
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		result.a_[axis] = std::max(clip_bound.a_[axis], std::min(clip_bound.g_[axis], clip_result.box_.a_[axis]));
+		result.g_[axis] = std::min(clip_bound.g_[axis], std::max(clip_bound.a_[axis], clip_result.box_.g_[axis]));
+	}
+	return true;
+}
+
+uint32_t AcceleratorBvh::flattenTree(const BuildNode &build_node, const std::vector<const Primitive *> &primitives, bool align_leaves)
+{
+	const uint32_t node_id = static_cast<uint32_t>(nodes_.size());
+	nodes_.emplace_back();
+	nodes_[node_id].bound_ = build_node.bound_;
+	if(build_node.isLeaf())
+	{
+		//Padding so each leaf starts at the beginning of a triangle block
+		if(align_leaves) while(primitives_.size() % block_size_ != 0) primitives_.emplace_back(nullptr);
+		nodes_[node_id].createLeaf(static_cast<uint32_t>(primitives_.size()), static_cast<uint32_t>(build_node.primitive_indices_.size()));
+		for(const auto &primitive_index : build_node.primitive_indices_) primitives_.emplace_back(primitives[primitive_index]);
+	}
+	else
+	{
+		nodes_[node_id].createInterior(build_node.axis_);
+		flattenTree(*build_node.children_[0], primitives, align_leaves);
+		const uint32_t second_child_id = flattenTree(*build_node.children_[1], primitives, align_leaves);
+		nodes_[node_id].setSecondChild(second_child_id);
+	}
+	return node_id;
+}
+
+void AcceleratorBvh::buildTriangleBlocks()
+{
+	triangle_blocks_.resize((primitives_.size() + block_size_ - 1) / block_size_);
+	uint32_t num_triangles = 0;
+	for(size_t prim_num = 0; prim_num < primitives_.size(); ++prim_num)
+	{
+		TriangleBlock &block = triangle_blocks_[prim_num / block_size_];
+		const size_t lane = prim_num % block_size_;
+		std::array<Point3, 3> vertices;
+		if(!primitives_[prim_num] || !primitives_[prim_num]->getTriangleVertices(vertices))
+		{
+			//Zero vertices for the unused lanes, so the block test does not work with uninitialized values
+			for(int axis = 0; axis < 3; ++axis) block.vertex_0_[axis][lane] = block.vertex_1_[axis][lane] = block.vertex_2_[axis][lane] = 0.f;
+			block.epsilon_[lane] = 0.f;
+			continue;
+		}
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			block.vertex_0_[axis][lane] = vertices[0][axis];
+			block.vertex_1_[axis][lane] = vertices[1][axis];
+			block.vertex_2_[axis][lane] = vertices[2][axis];
+		}
+		block.epsilon_[lane] = 0.1f * min_raydist_global * std::max((vertices[1] - vertices[0]).length(), (vertices[2] - vertices[0]).length());
+		block.triangle_mask_ |= (1u << lane);
+		++num_triangles;
+	}
+	if(num_triangles == 0) triangle_blocks_.clear();
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "BVH: Precomputed triangles: " << num_triangles << " in " << triangle_blocks_.size() << " blocks (" << triangle_blocks_.size() * sizeof(TriangleBlock) / 1024 << " KB)" << YENDL;
+}
+
+void AcceleratorBvh::buildRayMasks()
+{
+	ray_masks_.resize(primitives_.size(), RayTypeNone);
+	for(size_t prim_num = 0; prim_num < primitives_.size(); ++prim_num)
+	{
+		const Primitive *primitive = primitives_[prim_num];
+		if(!primitive) continue; //padding
+		const Material *material = primitive->getMaterial();
+		ray_masks_[prim_num] = rayTypeMaskFromVisibility_global(primitive->getVisibility());
+		if(material) ray_masks_[prim_num] &= rayTypeMaskFromVisibility_global(material->getVisibility());
+	}
+}
+
+void AcceleratorBvh::buildMotionBounds()
+{
+	motion_bounds_.resize(nodes_.size());
+	uint32_t num_moving_primitives = 0;
+	//The children are always after their parent in the flattened tree
+	for(size_t node_id = nodes_.size(); node_id-- > 0;)
+	{
+		const Node &node = nodes_[node_id];
+		std::array<Bound, 2> &bounds = motion_bounds_[node_id];
+		if(node.isLeaf())
+		{
+			bool empty = true;
+			for(uint32_t prim_num = node.getPrimitivesOffset(); prim_num < node.getPrimitivesOffset() + node.getNumPrimitives(); ++prim_num)
+			{
+				const Primitive *primitive = primitives_[prim_num];
+				if(!primitive) continue;
+				std::array<Bound, 2> primitive_bounds;
+				if(primitive->getMotionBounds(primitive_bounds[0], primitive_bounds[1])) ++num_moving_primitives;
+				else primitive_bounds[0] = primitive_bounds[1] = primitive->getBound();
+				for(int time_id = 0; time_id < 2; ++time_id) bounds[time_id] = empty ? primitive_bounds[time_id] : Bound(bounds[time_id], primitive_bounds[time_id]);
+				empty = false;
+			}
+		}
+		else
+		{
+			const std::array<Bound, 2> &bounds_left = motion_bounds_[node_id + 1];
+			const std::array<Bound, 2> &bounds_right = motion_bounds_[node.getSecondChild()];
+			for(int time_id = 0; time_id < 2; ++time_id) bounds[time_id] = Bound(bounds_left[time_id], bounds_right[time_id]);
+		}
+	}
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "BVH: Motion blur bounds for " << num_moving_primitives << " moving primitives (" << motion_bounds_.size() * sizeof(motion_bounds_[0]) / 1024 << " KB)" << YENDL;
+}
+
+inline Bound AcceleratorBvh::nodeBound(uint32_t node_id, float time) const
+{
+	if(motion_bounds_.empty()) return nodes_[node_id].bound_;
+	const std::array<Bound, 2> &bounds = motion_bounds_[node_id];
+	const float time_clamped = std::max(0.f, std::min(1.f, time));
+	return { bounds[0].a_ + time_clamped * (bounds[1].a_ - bounds[0].a_), bounds[0].g_ + time_clamped * (bounds[1].g_ - bounds[0].g_) };
+}
+
+AcceleratorBvh::TriangleRay::TriangleRay(const Ray &ray) : from_ {{ ray.from_.x_, ray.from_.y_, ray.from_.z_ }}
+{
+	axis_z_ = 0;
+	if(std::abs(ray.dir_[1]) > std::abs(ray.dir_[axis_z_])) axis_z_ = 1;
+	if(std::abs(ray.dir_[2]) > std::abs(ray.dir_[axis_z_])) axis_z_ = 2;
+	axis_x_ = (axis_z_ + 1) % 3;
+	axis_y_ = (axis_x_ + 1) % 3;
+	//Keep the winding of the triangles so the sign of the edge functions is consistent
+	if(ray.dir_[axis_z_] < 0.f) std::swap(axis_x_, axis_y_);
+	shear_x_ = ray.dir_[axis_x_] / ray.dir_[axis_z_];
+	shear_y_ = ray.dir_[axis_y_] / ray.dir_[axis_z_];
+	shear_z_ = 1.f / ray.dir_[axis_z_];
+}
+
+// ============================================================
+/*!
+	Watertight ray-triangle intersection ("Watertight Ray/Triangle Intersection", Woop, Benthin and Wald)
+	of one ray against all the triangles of a block. No ray passes between two triangles sharing an edge,
+	as the edge functions are evaluated exactly (falling back to double precision) when they are zero.
+	The lane loops have no branches, so they can be vectorized by the compiler.
+	Returns a mask with one bit for each lane hit at a distance not lower than the lane epsilon
+*/
+YAFARAY_SIMD_KERNEL uint32_t AcceleratorBvh::intersectBlock(const TriangleBlock &block, const TriangleRay &triangle_ray, TriangleBlockHits &hits)
+{
+	const int kx = triangle_ray.axis_x_;
+	const int ky = triangle_ray.axis_y_;
+	const int kz = triangle_ray.axis_z_;
+	std::array<float, block_size_> a_x, a_y, b_x, b_y, c_x, c_y, t_scaled, det;
+	std::array<float, block_size_> &u = hits.barycentric_u_;
+	std::array<float, block_size_> &v = hits.barycentric_v_;
+	std::array<float, block_size_> &w = hits.barycentric_w_;
+	for(uint32_t lane = 0; lane < block_size_; ++lane)
+	{
+		const float a_z = block.vertex_0_[kz][lane] - triangle_ray.from_[kz];
+		const float b_z = block.vertex_1_[kz][lane] - triangle_ray.from_[kz];
+		const float c_z = block.vertex_2_[kz][lane] - triangle_ray.from_[kz];
+		a_x[lane] = block.vertex_0_[kx][lane] - triangle_ray.from_[kx] - triangle_ray.shear_x_ * a_z;
+		a_y[lane] = block.vertex_0_[ky][lane] - triangle_ray.from_[ky] - triangle_ray.shear_y_ * a_z;
+		b_x[lane] = block.vertex_1_[kx][lane] - triangle_ray.from_[kx] - triangle_ray.shear_x_ * b_z;
+		b_y[lane] = block.vertex_1_[ky][lane] - triangle_ray.from_[ky] - triangle_ray.shear_y_ * b_z;
+		c_x[lane] = block.vertex_2_[kx][lane] - triangle_ray.from_[kx] - triangle_ray.shear_x_ * c_z;
+		c_y[lane] = block.vertex_2_[ky][lane] - triangle_ray.from_[ky] - triangle_ray.shear_y_ * c_z;
+		u[lane] = c_x[lane] * b_y[lane] - c_y[lane] * b_x[lane];
+		v[lane] = a_x[lane] * c_y[lane] - a_y[lane] * c_x[lane];
+		w[lane] = b_x[lane] * a_y[lane] - b_y[lane] * a_x[lane];
+		t_scaled[lane] = triangle_ray.shear_z_ * (a_z * u[lane] + b_z * v[lane] + c_z * w[lane]);
+	}
+	for(uint32_t lane = 0; lane < block_size_; ++lane)
+	{
+		//Rare case of a ray crossing exactly an edge or a vertex, recalculated in double precision
+		if(u[lane] != 0.f && v[lane] != 0.f && w[lane] != 0.f) continue;
+		u[lane] = static_cast<float>(static_cast<double>(c_x[lane]) * b_y[lane] - static_cast<double>(c_y[lane]) * b_x[lane]);
+		v[lane] = static_cast<float>(static_cast<double>(a_x[lane]) * c_y[lane] - static_cast<double>(a_y[lane]) * c_x[lane]);
+		w[lane] = static_cast<float>(static_cast<double>(b_x[lane]) * a_y[lane] - static_cast<double>(b_y[lane]) * a_x[lane]);
+		const float a_z = block.vertex_0_[kz][lane] - triangle_ray.from_[kz];
+		const float b_z = block.vertex_1_[kz][lane] - triangle_ray.from_[kz];
+		const float c_z = block.vertex_2_[kz][lane] - triangle_ray.from_[kz];
+		t_scaled[lane] = triangle_ray.shear_z_ * (a_z * u[lane] + b_z * v[lane] + c_z * w[lane]);
+	}
+	uint32_t hit_mask = 0;
+	for(uint32_t lane = 0; lane < block_size_; ++lane)
+	{
+		det[lane] = u[lane] + v[lane] + w[lane];
+		const float inv_det = det[lane] != 0.f ? 1.f / det[lane] : 0.f;
+		hits.t_[lane] = t_scaled[lane] * inv_det;
+		u[lane] *= inv_det;
+		v[lane] *= inv_det;
+		w[lane] *= inv_det;
+		//Both triangle sides are accepted, as in the triangle primitive intersect
+		const bool same_sign = (u[lane] >= 0.f && v[lane] >= 0.f && w[lane] >= 0.f) || (u[lane] <= 0.f && v[lane] <= 0.f && w[lane] <= 0.f);
+		const bool hit = same_sign && det[lane] != 0.f && hits.t_[lane] >= block.epsilon_[lane];
+		hit_mask |= (static_cast<uint32_t>(hit) << lane);
+	}
+	return hit_mask & block.triangle_mask_;
+}
+
+// ============================================================
+/*!
+	calls hit_func(primitive, intersect_data) for each primitive of the leaf seen by the ray type, in order,
+	stopping when it returns true. The triangles stored in blocks are tested with the block test and only
+	reported when hit, other primitives are always reported with their own intersect result
+*/
+template <typename HitFunc>
+inline bool AcceleratorBvh::intersectLeaf(const Node &node, const Ray &ray, const TriangleRay &triangle_ray, uint8_t ray_type, const HitFunc &hit_func) const
+{
+	const uint32_t primitives_end = node.getPrimitivesOffset() + node.getNumPrimitives();
+	if(triangle_blocks_.empty())
+	{
+		for(uint32_t prim_num = node.getPrimitivesOffset(); prim_num < primitives_end; ++prim_num)
+		{
+			if(!(ray_masks_[prim_num] & ray_type)) continue;
+			const Primitive *primitive = primitives_[prim_num];
+			if(hit_func(primitive, primitive->intersect(ray))) return true;
+		}
+		return false;
+	}
+	TriangleBlockHits hits;
+	for(uint32_t block_begin = node.getPrimitivesOffset(); block_begin < primitives_end; block_begin += block_size_)
+	{
+		const TriangleBlock &block = triangle_blocks_[block_begin / block_size_];
+		const uint32_t block_end = std::min(block_begin + block_size_, primitives_end);
+		uint32_t visible_mask = 0;
+		for(uint32_t prim_num = block_begin; prim_num < block_end; ++prim_num) visible_mask |= static_cast<uint32_t>((ray_masks_[prim_num] & ray_type) != 0) << (prim_num - block_begin);
+		if(!visible_mask) continue;
+		const uint32_t hit_mask = (block.triangle_mask_ & visible_mask) ? intersect_block_(block, triangle_ray, hits) : 0;
+		for(uint32_t prim_num = block_begin; prim_num < block_end; ++prim_num)
+		{
+			const uint32_t lane = prim_num - block_begin;
+			if(!(visible_mask & (1u << lane))) continue;
+			const Primitive *primitive = primitives_[prim_num];
+			if(block.triangle_mask_ & (1u << lane))
+			{
+				if(!(hit_mask & (1u << lane))) continue;
+				IntersectData intersect_data;
+				intersect_data.hit_ = true;
+				intersect_data.t_hit_ = hits.t_[lane];
+				intersect_data.barycentric_u_ = hits.barycentric_u_[lane];
+				intersect_data.barycentric_v_ = hits.barycentric_v_[lane];
+				intersect_data.barycentric_w_ = hits.barycentric_w_[lane];
+				intersect_data.time_ = ray.time_;
+				if(hit_func(primitive, intersect_data)) return true;
+			}
+			else if(hit_func(primitive, primitive->intersect(ray))) return true;
+		}
+	}
+	return false;
+}
+
+inline bool AcceleratorBvh::crossesNode(const Bound &bound, const Point3 &from, const Vec3 &inv_dir, float t_max)
+{
+	float t_enter = 0.f;
+	float t_leave = t_max;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		float t_near = (bound.a_[axis] - from[axis]) * inv_dir[axis];
+		float t_far = (bound.g_[axis] - from[axis]) * inv_dir[axis];
+		if(t_near > t_far) std::swap(t_near, t_far);
+		//Written so a NaN (0 * inf with axis-parallel rays on a slab border) never narrows the interval
+		t_enter = t_near > t_enter ? t_near : t_enter;
+		t_leave = t_far < t_leave ? t_far : t_leave;
+		if(t_enter > t_leave) return false;
+	}
+	return true;
+}
+
+//============================
+/*! The standard intersect function,
+	returns the closest hit within dist
+*/
+AcceleratorIntersectData AcceleratorBvh::intersect(const Ray &ray, float t_max) const
+{
+	AcceleratorIntersectData accelerator_intersect_data;
+	accelerator_intersect_data.t_max_ = t_max;
+	if(nodes_.empty()) return accelerator_intersect_data;
+	const Vec3 inv_dir(1.f / ray.dir_.x_, 1.f / ray.dir_.y_, 1.f / ray.dir_.z_);
+	const std::array<bool, 3> dir_is_negative {{ inv_dir.x_ < 0.f, inv_dir.y_ < 0.f, inv_dir.z_ < 0.f }};
+	const TriangleRay triangle_ray = triangle_blocks_.empty() ? TriangleRay() : TriangleRay(ray);
+	std::array<uint32_t, max_stack_> stack;
+	int stack_size = 0;
+	uint32_t node_id = 0;
+	while(true)
+	{
+		const Node &node = nodes_[node_id];
+		if(crossesNode(nodeBound(node_id, ray.time_), ray.from_, inv_dir, accelerator_intersect_data.t_max_))
+		{
+			if(node.isLeaf())
+			{
+				intersectLeaf(node, ray, triangle_ray, RayTypeRadiance, [&](const Primitive *primitive, const IntersectData &intersect_data) -> bool
+				{
+					if(!intersect_data.hit_ || intersect_data.t_hit_ >= accelerator_intersect_data.t_max_ || intersect_data.t_hit_ < ray.tmin_) return false;
+					accelerator_intersect_data.setIntersectData(intersect_data);
+					accelerator_intersect_data.t_max_ = intersect_data.t_hit_;
+					accelerator_intersect_data.hit_primitive_ = primitive;
+					return false;
+				});
+			}
+			else
+			{
+				//Visit first the child closer to the ray origin
+				if(dir_is_negative[node.getSplitAxis()])
+				{
+					stack[stack_size++] = node_id + 1;
+					node_id = node.getSecondChild();
+				}
+				else
+				{
+					stack[stack_size++] = node.getSecondChild();
+					node_id = node_id + 1;
+				}
+				continue;
+			}
+		}
+		if(stack_size == 0) break;
+		node_id = stack[--stack_size];
+	}
+	return accelerator_intersect_data;
+}
+
+AcceleratorIntersectData AcceleratorBvh::intersectS(const Ray &ray, float t_max, float) const
+{
+	if(nodes_.empty()) return {};
+	const Vec3 inv_dir(1.f / ray.dir_.x_, 1.f / ray.dir_.y_, 1.f / ray.dir_.z_);
+	const TriangleRay triangle_ray = triangle_blocks_.empty() ? TriangleRay() : TriangleRay(ray);
+	AcceleratorIntersectData accelerator_intersect_data;
+	std::array<uint32_t, max_stack_> stack;
+	int stack_size = 0;
+	uint32_t node_id = 0;
+	while(true)
+	{
+		const Node &node = nodes_[node_id];
+		if(crossesNode(nodeBound(node_id, ray.time_), ray.from_, inv_dir, t_max))
+		{
+			if(node.isLeaf())
+			{
+				const bool hit = intersectLeaf(node, ray, triangle_ray, RayTypeShadow, [&](const Primitive *primitive, const IntersectData &intersect_data) -> bool
+				{
+					if(!intersect_data.hit_ || intersect_data.t_hit_ >= t_max || intersect_data.t_hit_ < 0.f) return false;
+					accelerator_intersect_data.setIntersectData(intersect_data);
+					accelerator_intersect_data.hit_primitive_ = primitive;
+					return true;
+				});
+				if(hit) return accelerator_intersect_data;
+			}
+			else
+			{
+				//For shadow rays any hit is valid, so the traversal order is not important
+				stack[stack_size++] = node.getSecondChild();
+				node_id = node_id + 1;
+				continue;
+			}
+		}
+		if(stack_size == 0) break;
+		node_id = stack[--stack_size];
+	}
+	return {};
+}
+
+//============================
+/*! Ray stream intersection: the rays are traversed in packets of packet_size_ rays, each
+	node is tested against all the active rays of the packet at the same time
+*/
+std::vector<AcceleratorIntersectData> AcceleratorBvh::intersectStream(const std::vector<Ray> &rays, const std::vector<float> &t_max) const
+{
+	std::vector<AcceleratorIntersectData> results(rays.size());
+	if(nodes_.empty())
+	{
+		for(size_t ray_num = 0; ray_num < rays.size(); ++ray_num) results[ray_num].t_max_ = t_max[ray_num];
+		return results;
+	}
+	for(size_t first_ray = 0; first_ray < rays.size(); first_ray += packet_size_) intersectPacket(rays, t_max, first_ray, results);
+	return results;
+}
+
+std::vector<AcceleratorIntersectData> AcceleratorBvh::intersectStreamS(const std::vector<Ray> &rays, const std::vector<float> &t_max, float) const
+{
+	std::vector<AcceleratorIntersectData> results(rays.size());
+	if(nodes_.empty()) return results;
+	for(size_t first_ray = 0; first_ray < rays.size(); first_ray += packet_size_) intersectPacketS(rays, t_max, first_ray, results);
+	return results;
+}
+
+AcceleratorBvh::RayPacket::RayPacket(const std::vector<Ray> &rays, const std::vector<float> &t_max, size_t first_ray)
+{
+	num_rays_ = static_cast<uint32_t>(std::min(static_cast<size_t>(packet_size_), rays.size() - first_ray));
+	active_mask_ = (1u << num_rays_) - 1;
+	for(uint32_t lane = 0; lane < packet_size_; ++lane)
+	{
+		//Unused lanes get a negative t_max so they never cross any node
+		const bool used = lane < num_rays_;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			from_[axis][lane] = used ? rays[first_ray + lane].from_[axis] : 0.f;
+			inv_dir_[axis][lane] = used ? 1.f / rays[first_ray + lane].dir_[axis] : 1.f;
+		}
+		t_max_[lane] = used ? t_max[first_ray + lane] : -1.f;
+	}
+}
+
+YAFARAY_SIMD_KERNEL uint32_t AcceleratorBvh::crossesNode(const Bound &bound, const RayPacket &packet, uint32_t active_mask)
+{
+	std::array<float, packet_size_> t_enter;
+	std::array<float, packet_size_> t_leave;
+	for(uint32_t lane = 0; lane < packet_size_; ++lane)
+	{
+		t_enter[lane] = 0.f;
+		t_leave[lane] = packet.t_max_[lane];
+	}
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float bound_min = bound.a_[axis];
+		const float bound_max = bound.g_[axis];
+		for(uint32_t lane = 0; lane < packet_size_; ++lane)
+		{
+			const float t_0 = (bound_min - packet.from_[axis][lane]) * packet.inv_dir_[axis][lane];
+			const float t_1 = (bound_max - packet.from_[axis][lane]) * packet.inv_dir_[axis][lane];
+			const float t_near = std::min(t_0, t_1);
+			const float t_far = std::max(t_0, t_1);
+			//Same NaN handling as the single ray test
+			t_enter[lane] = t_near > t_enter[lane] ? t_near : t_enter[lane];
+			t_leave[lane] = t_far < t_leave[lane] ? t_far : t_leave[lane];
+		}
+	}
+	uint32_t crossed_mask = 0;
+	for(uint32_t lane = 0; lane < packet_size_; ++lane)
+	{
+		if(t_enter[lane] <= t_leave[lane]) crossed_mask |= (1u << lane);
+	}
+	return crossed_mask & active_mask;
+}
+
+// ============================================================
+/*!
+	Variants of the kernels for each instruction set. They are compiled from the same code without
+	FMA, which would change the rounding, so all the farm nodes render exactly the same images.
+	The AVX-512 CPUs use the AVX2 variants, as the 8 rays packets and 4 triangles blocks do not fill
+	the 512 bits registers
+*/
+#ifdef YAFARAY_SIMD_DISPATCH
+__attribute__((target("sse4.2"))) uint32_t AcceleratorBvh::crossesNodeSse42(const Bound &bound, const RayPacket &packet, uint32_t active_mask) { return crossesNode(bound, packet, active_mask); }
+__attribute__((target("avx2"))) uint32_t AcceleratorBvh::crossesNodeAvx2(const Bound &bound, const RayPacket &packet, uint32_t active_mask) { return crossesNode(bound, packet, active_mask); }
+__attribute__((target("sse4.2"))) uint32_t AcceleratorBvh::intersectBlockSse42(const TriangleBlock &block, const TriangleRay &triangle_ray, TriangleBlockHits &hits) { return intersectBlock(block, triangle_ray, hits); }
+__attribute__((target("avx2"))) uint32_t AcceleratorBvh::intersectBlockAvx2(const TriangleBlock &block, const TriangleRay &triangle_ray, TriangleBlockHits &hits) { return intersectBlock(block, triangle_ray, hits); }
+#endif
+
+void AcceleratorBvh::selectSimdKernels()
+{
+	const SysInfo::SimdLevel cpu_simd_level = SysInfo().getSimdLevel();
+#ifdef YAFARAY_SIMD_DISPATCH
+	if(cpu_simd_level >= SysInfo::SimdLevel::Avx2)
+	{
+		crosses_node_packet_ = crossesNodeAvx2;
+		intersect_block_ = intersectBlockAvx2;
+		simd_level_ = SysInfo::SimdLevel::Avx2;
+	}
+	else if(cpu_simd_level >= SysInfo::SimdLevel::Sse42)
+	{
+		crosses_node_packet_ = crossesNodeSse42;
+		intersect_block_ = intersectBlockSse42;
+		simd_level_ = SysInfo::SimdLevel::Sse42;
+	}
+#endif
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "BVH: Using the " << SysInfo::getSimdLevelName(simd_level_) << " ray kernels (CPU SIMD level: " << SysInfo::getSimdLevelName(cpu_simd_level) << ")" << YENDL;
+}
+
+void AcceleratorBvh::intersectPacket(const std::vector<Ray> &rays, const std::vector<float> &t_max, size_t first_ray, std::vector<AcceleratorIntersectData> &results) const
+{
+	RayPacket packet(rays, t_max, first_ray);
+	for(uint32_t lane = 0; lane < packet.num_rays_; ++lane) results[first_ray + lane].t_max_ = packet.t_max_[lane];
+	//Traversal order chosen with the first ray direction, assuming that the rays in the packet are coherent
+	const Vec3 &dir = rays[first_ray].dir_;
+	const std::array<bool, 3> dir_is_negative {{ dir.x_ < 0.f, dir.y_ < 0.f, dir.z_ < 0.f }};
+	std::array<TriangleRay, packet_size_> triangle_rays;
+	if(!triangle_blocks_.empty()) for(uint32_t lane = 0; lane < packet.num_rays_; ++lane) triangle_rays[lane] = TriangleRay(rays[first_ray + lane]);
+	std::array<uint32_t, max_stack_> stack;
+	int stack_size = 0;
+	uint32_t node_id = 0;
+	while(true)
+	{
+		const Node &node = nodes_[node_id];
+		const uint32_t crossed_mask = crosses_node_packet_(node.bound_, packet, packet.active_mask_);
+		if(crossed_mask)
+		{
+			if(node.isLeaf())
+			{
+				for(uint32_t lane = 0; lane < packet.num_rays_; ++lane)
+				{
+					if(!(crossed_mask & (1u << lane))) continue;
+					const Ray &ray = rays[first_ray + lane];
+					AcceleratorIntersectData &accelerator_intersect_data = results[first_ray + lane];
+					intersectLeaf(node, ray, triangle_rays[lane], RayTypeRadiance, [&](const Primitive *primitive, const IntersectData &intersect_data) -> bool
+					{
+						if(!intersect_data.hit_ || intersect_data.t_hit_ >= accelerator_intersect_data.t_max_ || intersect_data.t_hit_ < ray.tmin_) return false;
+						accelerator_intersect_data.setIntersectData(intersect_data);
+						accelerator_intersect_data.t_max_ = intersect_data.t_hit_;
+						accelerator_intersect_data.hit_primitive_ = primitive;
+						return false;
+					});
+					packet.t_max_[lane] = accelerator_intersect_data.t_max_;
+				}
+			}
+			else
+			{
+				if(dir_is_negative[node.getSplitAxis()])
+				{
+					stack[stack_size++] = node_id + 1;
+					node_id = node.getSecondChild();
+				}
+				else
+				{
+					stack[stack_size++] = node.getSecondChild();
+					node_id = node_id + 1;
+				}
+				continue;
+			}
+		}
+		if(stack_size == 0) break;
+		node_id = stack[--stack_size];
+	}
+}
+
+void AcceleratorBvh::intersectPacketS(const std::vector<Ray> &rays, const std::vector<float> &t_max, size_t first_ray, std::vector<AcceleratorIntersectData> &results) const
+{
+	RayPacket packet(rays, t_max, first_ray);
+	std::array<TriangleRay, packet_size_> triangle_rays;
+	if(!triangle_blocks_.empty()) for(uint32_t lane = 0; lane < packet.num_rays_; ++lane) triangle_rays[lane] = TriangleRay(rays[first_ray + lane]);
+	std::array<uint32_t, max_stack_> stack;
+	int stack_size = 0;
+	uint32_t node_id = 0;
+	while(true)
+	{
+		const Node &node = nodes_[node_id];
+		const uint32_t crossed_mask = crosses_node_packet_(node.bound_, packet, packet.active_mask_);
+		if(crossed_mask)
+		{
+			if(node.isLeaf())
+			{
+				for(uint32_t lane = 0; lane < packet.num_rays_; ++lane)
+				{
+					if(!(crossed_mask & (1u << lane))) continue;
+					const Ray &ray = rays[first_ray + lane];
+					intersectLeaf(node, ray, triangle_rays[lane], RayTypeShadow, [&](const Primitive *primitive, const IntersectData &intersect_data) -> bool
+					{
+						if(!intersect_data.hit_ || intersect_data.t_hit_ >= packet.t_max_[lane] || intersect_data.t_hit_ < 0.f) return false;
+						results[first_ray + lane].setIntersectData(intersect_data);
+						results[first_ray + lane].hit_primitive_ = primitive;
+						//Any hit is enough for shadow rays, so the ray is removed from the packet
+						packet.active_mask_ &= ~(1u << lane);
+						return true;
+					});
+				}
+				if(!packet.active_mask_) return;
+			}
+			else
+			{
+				stack[stack_size++] = node.getSecondChild();
+				node_id = node_id + 1;
+				continue;
+			}
+		}
+		if(stack_size == 0) break;
+		node_id = stack[--stack_size];
+	}
+}
+
+/*=============================================================
+	allow for transparent shadows.
+=============================================================*/
+
+AcceleratorTsIntersectData AcceleratorBvh::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float, const Matrix4 *obj_to_world) const
+{
+	AcceleratorTsIntersectData accelerator_intersect_data;
+	if(nodes_.empty()) return accelerator_intersect_data;
+	const Vec3 inv_dir(1.f / ray.dir_.x_, 1.f / ray.dir_.y_, 1.f / ray.dir_.z_);
+	const std::array<bool, 3> dir_is_negative {{ inv_dir.x_ < 0.f, inv_dir.y_ < 0.f, inv_dir.z_ < 0.f }};
+	const TriangleRay triangle_ray = triangle_blocks_.empty() ? TriangleRay() : TriangleRay(ray);
+	const MemoryArena::Marker material_data_marker = render_data.arena_.getMarker();
+	int depth = 0;
+	std::set<const Primitive *> filtered;
+	std::array<uint32_t, max_stack_> stack;
+	int stack_size = 0;
+	uint32_t node_id = 0;
+	while(true)
+	{
+		const Node &node = nodes_[node_id];
+		if(crossesNode(nodeBound(node_id, ray.time_), ray.from_, inv_dir, t_max))
+		{
+			if(node.isLeaf())
+			{
+				const bool hit = intersectLeaf(node, ray, triangle_ray, RayTypeShadow, [&](const Primitive *primitive, const IntersectData &intersect_data) -> bool
+				{
+					if(!intersect_data.hit_ || intersect_data.t_hit_ >= t_max || intersect_data.t_hit_ < ray.tmin_) return false;
+					const Material *mat = primitive->getMaterial();
+					accelerator_intersect_data.setIntersectData(intersect_data);
+					accelerator_intersect_data.hit_primitive_ = primitive;
+					if(!mat->isTransparent()) return true;
+					//The spatial splits reference the primitives crossing their planes in several leaves, so those are filtered as in the kd-trees
+					if(has_duplicated_references_ && !filtered.insert(primitive).second) return false;
+					if(depth >= max_depth) return true;
+					++depth;
+					return accumulateTransparency(accelerator_intersect_data, render_data, material_data_marker, primitive, ray, obj_to_world);
+				});
+				if(hit) return accelerator_intersect_data;
+			}
+			else
+			{
+				if(dir_is_negative[node.getSplitAxis()])
+				{
+					stack[stack_size++] = node_id + 1;
+					node_id = node.getSecondChild();
+				}
+				else
+				{
+					stack[stack_size++] = node.getSecondChild();
+					node_id = node_id + 1;
+				}
+				continue;
+			}
+		}
+		if(stack_size == 0) break;
+		node_id = stack[--stack_size];
+	}
+	accelerator_intersect_data.hit_ = false;
+	return accelerator_intersect_data;
+}
+
+END_YAFARAY
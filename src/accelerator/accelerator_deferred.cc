@@ -0,0 +1,167 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "accelerator/accelerator_deferred.h"
+#include "scene/yafaray/object_deferred.h"
+#include "scene/yafaray/object_mesh.h"
+#include "geometry/bound.h"
+#include "common/logger.h"
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+AcceleratorDeferred::AcceleratorDeferred(const DeferredObject &object, const ParamMap &params, std::shared_ptr<Cache> cache) : object_(object), params_(params), cache_(std::move(cache))
+{
+	//the meshes are loaded from the render threads, which are already using all the cores
+	params_["accelerator_threads"] = 1;
+}
+
+AcceleratorDeferred::~AcceleratorDeferred()
+{
+	cache_->remove(this);
+}
+
+Bound AcceleratorDeferred::getBound() const
+{
+	return object_.getBound();
+}
+
+AcceleratorStats AcceleratorDeferred::getStats() const
+{
+	AcceleratorStats stats;
+	stats.accelerator_ = "deferred";
+	const std::shared_ptr<const Geometry> geometry = std::atomic_load(&geometry_);
+	stats.build_ = {
+		{"loads", num_loads_.load()},
+		{"loaded_bytes", geometry ? geometry->bytes_ : 0},
+	};
+	if(geometry) stats.children_.emplace_back(geometry->accelerator_->getStats());
+	return stats;
+}
+
+std::shared_ptr<const AcceleratorDeferred::Geometry> AcceleratorDeferred::acquire() const
+{
+	std::shared_ptr<const Geometry> geometry = std::atomic_load(&geometry_);
+	if(!geometry || geometry->material_ != object_.getMaterial())
+	{
+		if(load_failed_.load(std::memory_order_relaxed)) return nullptr;
+		std::lock_guard<std::mutex> lock_guard(load_mutex_);
+		geometry = std::atomic_load(&geometry_);
+		if(!geometry || geometry->material_ != object_.getMaterial()) geometry = load();
+		if(!geometry) return nullptr;
+	}
+	const uint64_t tick = cache_->tick();
+	if(last_used_.load(std::memory_order_relaxed) != tick) last_used_.store(tick, std::memory_order_relaxed);
+	return geometry;
+}
+
+std::shared_ptr<const AcceleratorDeferred::Geometry> AcceleratorDeferred::load() const
+{
+	std::unique_ptr<MeshObject> mesh = object_.loadMesh();
+	const std::vector<const Primitive *> primitives = mesh ? mesh->getPrimitives() : std::vector<const Primitive *>();
+	if(primitives.empty())
+	{
+		load_failed_ = true;
+		return nullptr;
+	}
+	ParamMap params = params_;
+	params["num_primitives"] = static_cast<int>(primitives.size());
+	std::unique_ptr<Accelerator> accelerator = Accelerator::factory(primitives, params);
+	if(!accelerator)
+	{
+		load_failed_ = true;
+		return nullptr;
+	}
+	const size_t bytes = mesh->getMemory() + accelerator->getMemory();
+	auto geometry = std::make_shared<const Geometry>(Geometry{std::move(mesh), std::move(accelerator), object_.getMaterial(), bytes});
+	std::atomic_store(&geometry_, geometry);
+	++num_loads_;
+	cache_->insert(this, bytes);
+	return geometry;
+}
+
+void AcceleratorDeferred::evict() const
+{
+	std::atomic_store(&geometry_, std::shared_ptr<const Geometry>());
+}
+
+AcceleratorIntersectData AcceleratorDeferred::intersect(const Ray &ray, float t_max) const
+{
+	if(!object_.getBound().cross(ray, t_max).crossed_) return {};
+	std::shared_ptr<const Geometry> geometry = acquire();
+	if(!geometry) return {};
+	AcceleratorIntersectData accelerator_intersect_data = geometry->accelerator_->intersect(ray, t_max);
+	if(accelerator_intersect_data.hit_) accelerator_intersect_data.hit_geometry_ = std::move(geometry);
+	return accelerator_intersect_data;
+}
+
+AcceleratorIntersectData AcceleratorDeferred::intersectS(const Ray &ray, float t_max, float shadow_bias) const
+{
+	if(!object_.getBound().cross(ray, t_max).crossed_) return {};
+	std::shared_ptr<const Geometry> geometry = acquire();
+	if(!geometry) return {};
+	//the shadow hits are not shaded, and their primitives are not kept as occluders as they are hit in object space
+	return geometry->accelerator_->intersectS(ray, t_max, shadow_bias);
+}
+
+AcceleratorTsIntersectData AcceleratorDeferred::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *obj_to_world) const
+{
+	if(!object_.getBound().cross(ray, t_max).crossed_) return {};
+	std::shared_ptr<const Geometry> geometry = acquire();
+	if(!geometry) return {};
+	return geometry->accelerator_->intersectTs(render_data, ray, max_depth, t_max, shadow_bias, obj_to_world);
+}
+
+void AcceleratorDeferred::Cache::insert(const AcceleratorDeferred *accelerator, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock_guard(mutex_);
+	tick_.fetch_add(1, std::memory_order_relaxed);
+	auto entry = std::find_if(loaded_.begin(), loaded_.end(), [accelerator](const std::pair<const AcceleratorDeferred *, size_t> &loaded) { return loaded.first == accelerator; });
+	if(entry != loaded_.end())
+	{
+		used_ -= entry->second;
+		entry->second = bytes;
+	}
+	else loaded_.emplace_back(accelerator, bytes);
+	used_ += bytes;
+	//the geometries are evicted by only clearing their pointer, as the accelerator evicted can be loading again meanwhile
+	while(budget_ > 0 && used_ > budget_ && loaded_.size() > 1)
+	{
+		auto oldest = loaded_.end();
+		for(auto it = loaded_.begin(); it != loaded_.end(); ++it)
+		{
+			if(it->first == accelerator) continue;
+			if(oldest == loaded_.end() || it->first->last_used_.load(std::memory_order_relaxed) < oldest->first->last_used_.load(std::memory_order_relaxed)) oldest = it;
+		}
+		oldest->first->evict();
+		used_ -= oldest->second;
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Deferred: evicted the geometry of object '" << oldest->first->object_.getName() << "' (" << oldest->second / 1024 << " KB)" << YENDL;
+		loaded_.erase(oldest);
+	}
+}
+
+void AcceleratorDeferred::Cache::remove(const AcceleratorDeferred *accelerator)
+{
+	std::lock_guard<std::mutex> lock_guard(mutex_);
+	auto entry = std::find_if(loaded_.begin(), loaded_.end(), [accelerator](const std::pair<const AcceleratorDeferred *, size_t> &loaded) { return loaded.first == accelerator; });
+	if(entry == loaded_.end()) return;
+	used_ -= entry->second;
+	loaded_.erase(entry);
+}
+
+END_YAFARAY
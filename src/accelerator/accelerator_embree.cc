@@ -0,0 +1,503 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifdef HAVE_EMBREE
+
+#include "accelerator/accelerator_embree.h"
+#include "accelerator/accelerator_two_level.h"
+#include "scene/yafaray/object_mesh.h"
+#include "scene/yafaray/primitive_triangle.h"
+#include "geometry/object.h"
+#include "geometry/matrix4.h"
+#include "geometry/ray.h"
+#include "material/material.h"
+#include "common/logger.h"
+#include "common/param.h"
+#include "render/render_data.h"
+#include <embree3/rtcore.h>
+#include <algorithm>
+#include <map>
+#include <limits>
+#include <string>
+
+BEGIN_YAFARAY
+
+//! primitives of an Embree geometry, by their Embree primitive id
+struct AcceleratorEmbree::Geometry
+{
+	bool triangles_ = false; //!< triangle geometry, otherwise user geometry intersected by the primitive intersect function
+	std::vector<const Primitive *> primitives_;
+	std::vector<uint8_t> ray_masks_; //!< RayTypeMask of each primitive, from the object and material visibility
+};
+
+//! Embree passes the context to the callbacks, so the state of the ray being traced follows the Embree context
+struct AcceleratorEmbree::IntersectContext
+{
+	RTCIntersectContext context_; //!< must be the first member, as the callbacks receive a pointer to it
+	const AcceleratorEmbree *accelerator_;
+	uint8_t ray_type_;
+	const Primitive *hit_primitive_ = nullptr; //!< primitive accepted by the last hit, as the occlusion rays do not return it
+	const Matrix4 *hit_obj_to_world_ = nullptr;
+	IntersectData user_intersect_data_; //!< intersect data of the last user primitive accepted, the closest one if the closest hit is a user primitive
+	//transparent shadows
+	AcceleratorTsIntersectData *ts_intersect_data_ = nullptr;
+	RenderData *render_data_ = nullptr;
+	const MemoryArena::Marker *material_data_marker_ = nullptr;
+	const Matrix4 *obj_to_world_ = nullptr; //!< of this accelerator, when it is nested in the object space of an instance
+	int max_depth_ = 0;
+	int depth_ = 0;
+	std::vector<std::pair<const Primitive *, const Matrix4 *>> transparent_hits_; //!< as the spatial splits of the Embree high quality build can report the same hit more than once
+};
+
+static void embreeError_global(void *, RTCError code, const char *message)
+{
+	Y_ERROR << "Embree: error " << static_cast<int>(code) << ": " << (message ? message : "") << YENDL;
+}
+
+static RTCRayHit embreeRayHit_global(const Ray &ray, float t_min, float t_max)
+{
+	RTCRayHit ray_hit;
+	ray_hit.ray.org_x = ray.from_.x_;
+	ray_hit.ray.org_y = ray.from_.y_;
+	ray_hit.ray.org_z = ray.from_.z_;
+	ray_hit.ray.tnear = t_min;
+	ray_hit.ray.dir_x = ray.dir_.x_;
+	ray_hit.ray.dir_y = ray.dir_.y_;
+	ray_hit.ray.dir_z = ray.dir_.z_;
+	ray_hit.ray.time = ray.time_;
+	ray_hit.ray.tfar = t_max;
+	ray_hit.ray.mask = 0xFFFFFFFF;
+	ray_hit.ray.id = 0;
+	ray_hit.ray.flags = 0;
+	ray_hit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+	ray_hit.hit.primID = RTC_INVALID_GEOMETRY_ID;
+	ray_hit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+	return ray_hit;
+}
+
+//! the ray of a callback, in the object space of the instance being traversed
+static Ray yafarayRay_global(RTCRayN *ray, unsigned int n, unsigned int i)
+{
+	return Ray(Point3(RTCRayN_org_x(ray, n, i), RTCRayN_org_y(ray, n, i), RTCRayN_org_z(ray, n, i)), Vec3(RTCRayN_dir_x(ray, n, i), RTCRayN_dir_y(ray, n, i), RTCRayN_dir_z(ray, n, i)), RTCRayN_tnear(ray, n, i), RTCRayN_tfar(ray, n, i), RTCRayN_time(ray, n, i));
+}
+
+std::unique_ptr<Accelerator> AcceleratorEmbree::factory(const std::vector<const Primitive *> &primitives, ParamMap &params)
+{
+	return factory(primitives, {}, params);
+}
+
+std::unique_ptr<Accelerator> AcceleratorEmbree::factory(const std::vector<const Primitive *> &primitives, const std::vector<const Object *> &instances, ParamMap &params)
+{
+	for(const auto &instance : instances)
+	{
+		if(instance->isDeferred())
+		{
+			Y_INFO << "Embree: the deferred objects are not supported by Embree, using the two-level accelerator with Embree for each base object" << YENDL;
+			return AcceleratorTwoLevel::factory(primitives, instances, params);
+		}
+	}
+	int num_threads = 0;
+	params.getParam("accelerator_threads", num_threads);
+	auto accelerator = std::unique_ptr<AcceleratorEmbree>(new AcceleratorEmbree(num_threads));
+	if(!accelerator->device_) return nullptr;
+	accelerator->scene_ = accelerator->newScene();
+	accelerator->addGeometries(accelerator->scene_, primitives);
+	accelerator->instance_matrices_.resize(accelerator->scene_geometries_.front().size(), nullptr);
+	accelerator->instance_object_scenes_.resize(accelerator->scene_geometries_.front().size(), 0);
+	std::map<const Object *, size_t> base_object_scenes; //!< index of the scene of each base object in scene_geometries_, 0 if it has no primitives
+	for(const auto &instance : instances)
+	{
+		const Object *base_object = instance->getBaseObject();
+		if(!base_object || instance->numInstances() == 0) continue;
+		auto base_object_scene = base_object_scenes.find(base_object);
+		if(base_object_scene == base_object_scenes.end())
+		{
+			const std::vector<const Primitive *> base_primitives = base_object->getPrimitives();
+			size_t object_scene_index = 0;
+			if(!base_primitives.empty())
+			{
+				RTCScene object_scene = accelerator->newScene();
+				accelerator->addGeometries(object_scene, base_primitives);
+				rtcCommitScene(object_scene);
+				accelerator->object_scenes_.push_back(object_scene);
+				object_scene_index = accelerator->object_scenes_.size();
+			}
+			base_object_scene = base_object_scenes.insert({base_object, object_scene_index}).first;
+		}
+		if(base_object_scene->second == 0) continue;
+		for(size_t instance_number = 0; instance_number < instance->numInstances(); ++instance_number)
+		{
+			accelerator->addInstance(base_object_scene->second, instance->getInstanceObjToWorldMatrix(instance_number));
+		}
+	}
+	accelerator->commit();
+	Y_INFO << "Embree: " << accelerator->num_primitives_ << " primitives in " << accelerator->geometries_.size() << " geometries, " << accelerator->num_instances_ << " instances of " << accelerator->object_scenes_.size() << " base objects" << YENDL;
+	return accelerator;
+}
+
+AcceleratorEmbree::AcceleratorEmbree(int num_threads)
+{
+	const std::string config = num_threads > 0 ? "threads=" + std::to_string(num_threads) : "";
+	device_ = rtcNewDevice(config.c_str());
+	if(!device_)
+	{
+		Y_ERROR << "Embree: the device could not be created, error " << static_cast<int>(rtcGetDeviceError(nullptr)) << YENDL;
+		return;
+	}
+	rtcSetDeviceErrorFunction(device_, embreeError_global, nullptr);
+}
+
+AcceleratorEmbree::~AcceleratorEmbree()
+{
+	if(scene_) rtcReleaseScene(scene_);
+	for(const auto &object_scene : object_scenes_) rtcReleaseScene(object_scene);
+	if(device_) rtcReleaseDevice(device_);
+}
+
+AcceleratorStats AcceleratorEmbree::getStats() const
+{
+	AcceleratorStats stats;
+	stats.accelerator_ = "embree";
+	stats.build_ = {
+		{"primitives", num_primitives_},
+		{"geometries", geometries_.size()},
+		{"instances", num_instances_},
+		{"base_objects", object_scenes_.size()},
+	};
+	return stats;
+}
+
+RTCScene AcceleratorEmbree::newScene() const
+{
+	RTCScene scene = rtcNewScene(device_);
+	rtcSetSceneBuildQuality(scene, RTC_BUILD_QUALITY_HIGH);
+	return scene;
+}
+
+// ============================================================
+/*!
+	adds to the scene a triangle geometry for the static triangles of each mesh, using the mesh vertices and the
+	face indices, and a single user geometry for the rest of the primitives
+*/
+void AcceleratorEmbree::addGeometries(RTCScene scene, const std::vector<const Primitive *> &primitives)
+{
+	std::map<const MeshObject *, std::vector<const Primitive *>> mesh_triangles;
+	std::vector<const Primitive *> user_primitives;
+	for(const auto &primitive : primitives)
+	{
+		Bound bound_start, bound_end;
+		const MeshObject *mesh_object = dynamic_cast<const MeshObject *>(primitive->getObject());
+		if(mesh_object && dynamic_cast<const TrianglePrimitive *>(primitive) && !primitive->getMotionBounds(bound_start, bound_end)) mesh_triangles[mesh_object].push_back(primitive);
+		else user_primitives.push_back(primitive);
+	}
+	scene_geometries_.emplace_back();
+	std::vector<const Geometry *> &scene_geometries = scene_geometries_.back();
+	auto add_geometry = [&](RTCGeometry rtc_geometry, std::unique_ptr<Geometry> geometry)
+	{
+		for(const auto &primitive : geometry->primitives_)
+		{
+			const Material *material = primitive->getMaterial();
+			uint8_t ray_mask = rayTypeMaskFromVisibility_global(primitive->getVisibility());
+			if(material) ray_mask &= rayTypeMaskFromVisibility_global(material->getVisibility());
+			geometry->ray_masks_.push_back(ray_mask);
+		}
+		num_primitives_ += geometry->primitives_.size();
+		rtcSetGeometryUserData(rtc_geometry, geometry.get());
+		rtcSetGeometryIntersectFilterFunction(rtc_geometry, filterHits);
+		rtcSetGeometryOccludedFilterFunction(rtc_geometry, filterHits);
+		rtcCommitGeometry(rtc_geometry);
+		const unsigned int geometry_id = rtcAttachGeometry(scene, rtc_geometry);
+		rtcReleaseGeometry(rtc_geometry);
+		if(scene_geometries.size() <= geometry_id) scene_geometries.resize(geometry_id + 1, nullptr);
+		scene_geometries[geometry_id] = geometry.get();
+		geometries_.push_back(std::move(geometry));
+	};
+	for(const auto &mesh : mesh_triangles)
+	{
+		const LargeVector<Point3> &points = mesh.first->getPoints();
+		RTCGeometry rtc_geometry = rtcNewGeometry(device_, RTC_GEOMETRY_TYPE_TRIANGLE);
+		float *vertices = static_cast<float *>(rtcSetNewGeometryBuffer(rtc_geometry, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, 3 * sizeof(float), points.size()));
+		for(size_t point_num = 0; point_num < points.size(); ++point_num)
+		{
+			for(int axis = 0; axis < 3; ++axis) vertices[3 * point_num + axis] = points[point_num][axis];
+		}
+		unsigned int *indices = static_cast<unsigned int *>(rtcSetNewGeometryBuffer(rtc_geometry, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, 3 * sizeof(unsigned int), mesh.second.size()));
+		auto geometry = std::unique_ptr<Geometry>(new Geometry);
+		geometry->triangles_ = true;
+		geometry->primitives_ = mesh.second;
+		for(size_t triangle_num = 0; triangle_num < mesh.second.size(); ++triangle_num)
+		{
+			const FacePrimitive::VertexArray<int> vertices_indices = static_cast<const TrianglePrimitive *>(mesh.second[triangle_num])->getVerticesIndices();
+			for(int vertex_num = 0; vertex_num < 3; ++vertex_num) indices[3 * triangle_num + vertex_num] = static_cast<unsigned int>(vertices_indices[vertex_num]);
+		}
+		add_geometry(rtc_geometry, std::move(geometry));
+	}
+	if(!user_primitives.empty())
+	{
+		RTCGeometry rtc_geometry = rtcNewGeometry(device_, RTC_GEOMETRY_TYPE_USER);
+		rtcSetGeometryUserPrimitiveCount(rtc_geometry, static_cast<unsigned int>(user_primitives.size()));
+		rtcSetGeometryBoundsFunction(rtc_geometry, userPrimitiveBounds, nullptr);
+		rtcSetGeometryIntersectFunction(rtc_geometry, intersectUserPrimitive);
+		rtcSetGeometryOccludedFunction(rtc_geometry, occludedUserPrimitive);
+		auto geometry = std::unique_ptr<Geometry>(new Geometry);
+		geometry->primitives_ = std::move(user_primitives);
+		add_geometry(rtc_geometry, std::move(geometry));
+	}
+}
+
+void AcceleratorEmbree::addInstance(size_t object_scene_index, const Matrix4 *obj_to_world)
+{
+	Matrix4 world_to_obj = *obj_to_world;
+	world_to_obj.inverse();
+	if(world_to_obj.invalid())
+	{
+		Y_WARNING << "Embree: instance with a non-invertible transformation matrix, skipping it" << YENDL;
+		return;
+	}
+	RTCGeometry rtc_geometry = rtcNewGeometry(device_, RTC_GEOMETRY_TYPE_INSTANCE);
+	rtcSetGeometryInstancedScene(rtc_geometry, object_scenes_[object_scene_index - 1]);
+	const unsigned int geometry_id = rtcAttachGeometry(scene_, rtc_geometry);
+	rtcReleaseGeometry(rtc_geometry);
+	if(instance_matrices_.size() <= geometry_id)
+	{
+		instance_matrices_.resize(geometry_id + 1, nullptr);
+		instance_object_scenes_.resize(geometry_id + 1, 0);
+		scene_geometries_.front().resize(geometry_id + 1, nullptr);
+	}
+	instance_matrices_[geometry_id] = obj_to_world;
+	instance_object_scenes_[geometry_id] = object_scene_index;
+	setInstanceTransform(geometry_id);
+	++num_instances_;
+}
+
+void AcceleratorEmbree::setInstanceTransform(unsigned int geometry_id) const
+{
+	const Matrix4 &obj_to_world = *instance_matrices_[geometry_id];
+	float transform[12];
+	for(int row = 0; row < 3; ++row)
+	{
+		for(int column = 0; column < 4; ++column) transform[4 * row + column] = obj_to_world[row][column];
+	}
+	RTCGeometry rtc_geometry = rtcGetGeometry(scene_, geometry_id);
+	rtcSetGeometryTransform(rtc_geometry, 0, RTC_FORMAT_FLOAT3X4_ROW_MAJOR, transform);
+	rtcCommitGeometry(rtc_geometry);
+}
+
+void AcceleratorEmbree::commit()
+{
+	rtcCommitScene(scene_);
+	RTCBounds bounds;
+	rtcGetSceneBounds(scene_, &bounds);
+	bound_ = Bound(Point3(bounds.lower_x, bounds.lower_y, bounds.lower_z), Point3(bounds.upper_x, bounds.upper_y, bounds.upper_z));
+}
+
+bool AcceleratorEmbree::refit()
+{
+	if(num_instances_ == 0) return false;
+	for(unsigned int geometry_id = 0; geometry_id < instance_matrices_.size(); ++geometry_id)
+	{
+		if(!instance_matrices_[geometry_id]) continue;
+		Matrix4 world_to_obj = *instance_matrices_[geometry_id];
+		world_to_obj.inverse();
+		//Rebuilding skips the non-invertible instances
+		if(world_to_obj.invalid()) return false;
+		setInstanceTransform(geometry_id);
+	}
+	//Embree keeps the object scenes and only rebuilds the top level over the instances
+	commit();
+	return true;
+}
+
+const AcceleratorEmbree::Geometry *AcceleratorEmbree::getHitGeometry(unsigned int instance_id, unsigned int geometry_id) const
+{
+	const std::vector<const Geometry *> &scene_geometries = scene_geometries_[instance_id == RTC_INVALID_GEOMETRY_ID ? 0 : instance_object_scenes_[instance_id]];
+	return geometry_id < scene_geometries.size() ? scene_geometries[geometry_id] : nullptr;
+}
+
+bool AcceleratorEmbree::acceptHit(IntersectContext &context, const Geometry &geometry, unsigned int primitive_id, const Ray &ray, const IntersectData &intersect_data)
+{
+	if(!(geometry.ray_masks_[primitive_id] & context.ray_type_)) return false;
+	const Primitive *primitive = geometry.primitives_[primitive_id];
+	const unsigned int instance_id = context.context_.instID[0];
+	const Matrix4 *obj_to_world = instance_id == RTC_INVALID_GEOMETRY_ID ? context.obj_to_world_ : context.accelerator_->instance_matrices_[instance_id];
+	if(context.ts_intersect_data_)
+	{
+		AcceleratorTsIntersectData &ts_intersect_data = *context.ts_intersect_data_;
+		ts_intersect_data.setIntersectData(intersect_data);
+		if(primitive->getMaterial()->isTransparent() && context.depth_ < context.max_depth_)
+		{
+			const std::pair<const Primitive *, const Matrix4 *> transparent_hit {primitive, obj_to_world};
+			if(std::find(context.transparent_hits_.begin(), context.transparent_hits_.end(), transparent_hit) != context.transparent_hits_.end()) return false;
+			context.transparent_hits_.push_back(transparent_hit);
+			++context.depth_;
+			if(!accumulateTransparency(ts_intersect_data, *context.render_data_, *context.material_data_marker_, primitive, ray, obj_to_world)) return false;
+		}
+	}
+	context.hit_primitive_ = primitive;
+	context.hit_obj_to_world_ = obj_to_world;
+	return true;
+}
+
+void AcceleratorEmbree::filterHits(const RTCFilterFunctionNArguments *args)
+{
+	IntersectContext &context = *reinterpret_cast<IntersectContext *>(const_cast<RTCIntersectContext *>(args->context));
+	const Geometry &geometry = *static_cast<const Geometry *>(args->geometryUserPtr);
+	for(unsigned int i = 0; i < args->N; ++i)
+	{
+		if(args->valid[i] == 0) continue;
+		const Ray ray = yafarayRay_global(args->ray, args->N, i);
+		const float u = RTCHitN_u(args->hit, args->N, i);
+		const float v = RTCHitN_v(args->hit, args->N, i);
+		IntersectData intersect_data;
+		intersect_data.hit_ = true;
+		intersect_data.t_hit_ = RTCRayN_tfar(args->ray, args->N, i);
+		//Embree uses the same barycentric coordinates as TrianglePrimitive::intersect
+		intersect_data.barycentric_u_ = 1.f - u - v;
+		intersect_data.barycentric_v_ = u;
+		intersect_data.barycentric_w_ = v;
+		intersect_data.time_ = ray.time_;
+		if(!acceptHit(context, geometry, RTCHitN_primID(args->hit, args->N, i), ray, intersect_data)) args->valid[i] = 0;
+	}
+}
+
+void AcceleratorEmbree::intersectUserPrimitive(const RTCIntersectFunctionNArguments *args)
+{
+	IntersectContext &context = *reinterpret_cast<IntersectContext *>(args->context);
+	const Geometry &geometry = *static_cast<const Geometry *>(args->geometryUserPtr);
+	RTCRayN *rays = RTCRayHitN_RayN(args->rayhit, args->N);
+	RTCHitN *hits = RTCRayHitN_HitN(args->rayhit, args->N);
+	for(unsigned int i = 0; i < args->N; ++i)
+	{
+		if(args->valid[i] == 0) continue;
+		const Ray ray = yafarayRay_global(rays, args->N, i);
+		const IntersectData intersect_data = geometry.primitives_[args->primID]->intersect(ray);
+		if(!intersect_data.hit_ || intersect_data.t_hit_ < ray.tmin_ || intersect_data.t_hit_ >= ray.tmax_) continue;
+		if(!acceptHit(context, geometry, args->primID, ray, intersect_data)) continue;
+		context.user_intersect_data_ = intersect_data;
+		RTCRayN_tfar(rays, args->N, i) = intersect_data.t_hit_;
+		RTCHitN_primID(hits, args->N, i) = args->primID;
+		RTCHitN_geomID(hits, args->N, i) = args->geomID;
+		RTCHitN_instID(hits, args->N, i, 0) = context.context_.instID[0];
+	}
+}
+
+void AcceleratorEmbree::occludedUserPrimitive(const RTCOccludedFunctionNArguments *args)
+{
+	IntersectContext &context = *reinterpret_cast<IntersectContext *>(args->context);
+	const Geometry &geometry = *static_cast<const Geometry *>(args->geometryUserPtr);
+	for(unsigned int i = 0; i < args->N; ++i)
+	{
+		if(args->valid[i] == 0) continue;
+		const Ray ray = yafarayRay_global(args->ray, args->N, i);
+		const IntersectData intersect_data = geometry.primitives_[args->primID]->intersect(ray);
+		if(!intersect_data.hit_ || intersect_data.t_hit_ < ray.tmin_ || intersect_data.t_hit_ >= ray.tmax_) continue;
+		if(!acceptHit(context, geometry, args->primID, ray, intersect_data)) continue;
+		context.user_intersect_data_ = intersect_data;
+		RTCRayN_tfar(args->ray, args->N, i) = -std::numeric_limits<float>::infinity(); //occluded
+	}
+}
+
+void AcceleratorEmbree::userPrimitiveBounds(const RTCBoundsFunctionArguments *args)
+{
+	const Primitive *primitive = static_cast<const Geometry *>(args->geometryUserPtr)->primitives_[args->primID];
+	Bound bound_start, bound_end;
+	//The moving primitives are bounded for the whole frame time
+	const Bound bound = primitive->getMotionBounds(bound_start, bound_end) ? Bound(bound_start, bound_end) : primitive->getBound();
+	args->bounds_o->lower_x = bound.a_.x_;
+	args->bounds_o->lower_y = bound.a_.y_;
+	args->bounds_o->lower_z = bound.a_.z_;
+	args->bounds_o->upper_x = bound.g_.x_;
+	args->bounds_o->upper_y = bound.g_.y_;
+	args->bounds_o->upper_z = bound.g_.z_;
+}
+
+AcceleratorIntersectData AcceleratorEmbree::intersect(const Ray &ray, float t_max) const
+{
+	AcceleratorIntersectData accelerator_intersect_data;
+	accelerator_intersect_data.t_max_ = t_max;
+	IntersectContext context;
+	rtcInitIntersectContext(&context.context_);
+	context.accelerator_ = this;
+	context.ray_type_ = RayTypeRadiance;
+	RTCRayHit ray_hit = embreeRayHit_global(ray, ray.tmin_, t_max);
+	rtcIntersect1(scene_, &context.context_, &ray_hit);
+	if(ray_hit.hit.geomID == RTC_INVALID_GEOMETRY_ID) return accelerator_intersect_data;
+	const Geometry *geometry = getHitGeometry(ray_hit.hit.instID[0], ray_hit.hit.geomID);
+	if(!geometry) return accelerator_intersect_data;
+	if(geometry->triangles_)
+	{
+		accelerator_intersect_data.hit_ = true;
+		accelerator_intersect_data.t_hit_ = ray_hit.ray.tfar;
+		accelerator_intersect_data.barycentric_u_ = 1.f - ray_hit.hit.u - ray_hit.hit.v;
+		accelerator_intersect_data.barycentric_v_ = ray_hit.hit.u;
+		accelerator_intersect_data.barycentric_w_ = ray_hit.hit.v;
+		accelerator_intersect_data.time_ = ray.time_;
+	}
+	else accelerator_intersect_data.setIntersectData(context.user_intersect_data_);
+	accelerator_intersect_data.t_max_ = accelerator_intersect_data.t_hit_;
+	accelerator_intersect_data.hit_primitive_ = geometry->primitives_[ray_hit.hit.primID];
+	if(ray_hit.hit.instID[0] != RTC_INVALID_GEOMETRY_ID) accelerator_intersect_data.obj_to_world_ = instance_matrices_[ray_hit.hit.instID[0]];
+	return accelerator_intersect_data;
+}
+
+AcceleratorIntersectData AcceleratorEmbree::intersectS(const Ray &ray, float t_max, float) const
+{
+	AcceleratorIntersectData accelerator_intersect_data;
+	IntersectContext context;
+	rtcInitIntersectContext(&context.context_);
+	context.accelerator_ = this;
+	context.ray_type_ = RayTypeShadow;
+	//As in the native accelerators any hit in front of the shadow ray origin blocks it, as the origin is already moved by the ray minimum distance
+	RTCRayHit ray_hit = embreeRayHit_global(ray, 0.f, t_max);
+	rtcOccluded1(scene_, &context.context_, &ray_hit.ray);
+	if(ray_hit.ray.tfar >= 0.f) return accelerator_intersect_data;
+	accelerator_intersect_data.hit_ = true;
+	accelerator_intersect_data.hit_primitive_ = context.hit_primitive_;
+	accelerator_intersect_data.obj_to_world_ = context.hit_obj_to_world_;
+	return accelerator_intersect_data;
+}
+
+AcceleratorTsIntersectData AcceleratorEmbree::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float, const Matrix4 *obj_to_world) const
+{
+	AcceleratorTsIntersectData accelerator_intersect_data;
+	const MemoryArena::Marker material_data_marker = render_data.arena_.getMarker();
+	IntersectContext context;
+	rtcInitIntersectContext(&context.context_);
+	context.accelerator_ = this;
+	context.ray_type_ = RayTypeShadow;
+	context.ts_intersect_data_ = &accelerator_intersect_data;
+	context.render_data_ = &render_data;
+	context.material_data_marker_ = &material_data_marker;
+	context.obj_to_world_ = obj_to_world;
+	context.max_depth_ = max_depth;
+	//The transparent hits are accumulated and rejected in the filter callbacks, so the occlusion query only stops at the opaque hits or when the transparency is negligible
+	RTCRayHit ray_hit = embreeRayHit_global(ray, ray.tmin_, t_max);
+	rtcOccluded1(scene_, &context.context_, &ray_hit.ray);
+	if(ray_hit.ray.tfar >= 0.f)
+	{
+		accelerator_intersect_data.hit_ = false;
+		return accelerator_intersect_data;
+	}
+	accelerator_intersect_data.hit_ = true;
+	accelerator_intersect_data.hit_primitive_ = context.hit_primitive_;
+	return accelerator_intersect_data;
+}
+
+END_YAFARAY
+
+#endif // HAVE_EMBREE
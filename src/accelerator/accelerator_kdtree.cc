@@ -18,9 +18,11 @@
 
 #include "accelerator/accelerator_kdtree.h"
 #include "material/material.h"
+#include "render/render_data.h"
 #include "scene/scene.h"
 #include "common/logger.h"
 #include "geometry/surface.h"
+#include "geometry/matrix4.h"
 #include "geometry/primitive.h"
 #include "common/param.h"
 #include "output/output.h"
@@ -105,6 +107,7 @@ AcceleratorKdTree::AcceleratorKdTree(const std::vector<const Primitive *> &primi
 			  left_prims.get(), right_prims.get(), edges, // <= working memory
 	          r_mem_size, 0, 0);
 
+	memory_tracker_.set(allocated_nodes_count_ * sizeof(Node) + static_cast<size_t>(kd_stats_.kd_prims_) * sizeof(const Primitive *) + (total_prims_ + prim_clip_thresh_ + 1) * sizeof(Bound));
 	//print some stats:
 	c_end = clock() - c_start;
 	if(Y_LOG_HAS_VERBOSE)
@@ -914,12 +917,12 @@ AcceleratorIntersectData AcceleratorKdTree::intersectS(const Ray &ray, float t_m
 =============================================================*/
 
 
-AcceleratorTsIntersectData AcceleratorKdTree::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias) const
+AcceleratorTsIntersectData AcceleratorKdTree::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *obj_to_world) const
 {
-	return intersectTs(render_data, ray, max_depth, t_max, shadow_bias, nodes_.get(), tree_bound_);
+	return intersectTs(render_data, ray, max_depth, t_max, shadow_bias, obj_to_world, nodes_.get(), tree_bound_);
 }
 
-AcceleratorTsIntersectData AcceleratorKdTree::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Node *nodes, const Bound &tree_bound)
+AcceleratorTsIntersectData AcceleratorKdTree::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *obj_to_world, const Node *nodes, const Bound &tree_bound)
 	{
 	AcceleratorTsIntersectData accelerator_intersect_data;
 	const Bound::Cross cross = tree_bound.cross(ray, t_max);
@@ -938,6 +941,7 @@ AcceleratorTsIntersectData AcceleratorKdTree::intersectTs(RenderData &render_dat
 	else inv_dir_z = 1.f / ray.dir_.z_;
 
 	Vec3 inv_dir(inv_dir_x, inv_dir_y, inv_dir_z);
+	const MemoryArena::Marker material_data_marker = render_data.arena_.getMarker();
 	int depth = 0;
 
 	std::set<const Primitive *> filtered;
@@ -1017,7 +1021,7 @@ AcceleratorTsIntersectData AcceleratorKdTree::intersectTs(RenderData &render_dat
 		}
 
 		// Check for intersections inside leaf node
-		const auto &primitive_intersection = [](AcceleratorTsIntersectData &accelerator_intersect_data, std::set<const Primitive *> &filtered, RenderData &render_data, int &depth, int max_depth, const Primitive *primitive, const Ray &ray, float t_max) -> bool
+		const auto &primitive_intersection = [](AcceleratorTsIntersectData &accelerator_intersect_data, std::set<const Primitive *> &filtered, RenderData &render_data, const MemoryArena::Marker &material_data_marker, int &depth, int max_depth, const Primitive *primitive, const Ray &ray, float t_max, const Matrix4 *obj_to_world) -> bool
 		{
 			const IntersectData intersect_data = primitive->intersect(ray);
 			if(intersect_data.hit_)
@@ -1033,10 +1037,8 @@ AcceleratorTsIntersectData AcceleratorKdTree::intersectTs(RenderData &render_dat
 						if(filtered.insert(primitive).second)
 						{
 							if(depth >= max_depth) return true;
-							const Point3 hit_point = ray.from_ + accelerator_intersect_data.t_hit_ * ray.dir_;
-							const SurfacePoint sp = primitive->getSurface(hit_point, accelerator_intersect_data);
-							accelerator_intersect_data.transparent_color_ *= mat->getTransparency(render_data, sp, ray.dir_);
 							++depth;
+							if(accumulateTransparency(accelerator_intersect_data, render_data, material_data_marker, primitive, ray, obj_to_world)) return true;
 						}
 					}
 				}
@@ -1047,7 +1049,7 @@ AcceleratorTsIntersectData AcceleratorKdTree::intersectTs(RenderData &render_dat
 		if(n_primitives == 1)
 		{
 			const Primitive *primitive = curr_node->one_primitive_;
-			if(primitive_intersection(accelerator_intersect_data, filtered, render_data, depth, max_depth, primitive, ray, t_max)) return accelerator_intersect_data;
+			if(primitive_intersection(accelerator_intersect_data, filtered, render_data, material_data_marker, depth, max_depth, primitive, ray, t_max, obj_to_world)) return accelerator_intersect_data;
 		}
 		else
 		{
@@ -1055,7 +1057,7 @@ AcceleratorTsIntersectData AcceleratorKdTree::intersectTs(RenderData &render_dat
 			for(uint32_t i = 0; i < n_primitives; ++i)
 			{
 				const Primitive *primitive = prims[i];
-				if(primitive_intersection(accelerator_intersect_data, filtered, render_data, depth, max_depth, primitive, ray, t_max)) return accelerator_intersect_data;
+				if(primitive_intersection(accelerator_intersect_data, filtered, render_data, material_data_marker, depth, max_depth, primitive, ray, t_max, obj_to_world)) return accelerator_intersect_data;
 			}
 		}
 		entry_idx = exit_idx;
@@ -18,13 +18,19 @@
 
 #include "accelerator/accelerator_kdtree_multi_thread.h"
 #include "material/material.h"
+#include "render/render_data.h"
 #include "scene/scene.h"
 #include "common/logger.h"
 #include "geometry/surface.h"
+#include "geometry/matrix4.h"
 #include "geometry/primitive.h"
 #include "geometry/axis.h"
 #include "common/param.h"
+#include "common/file.h"
 #include "output/output.h"
+#include <unordered_map>
+#include <sstream>
+#include <iomanip>
 
 BEGIN_YAFARAY
 
@@ -38,18 +44,19 @@ std::unique_ptr<Accelerator> AcceleratorKdTreeMultiThread::factory(const std::ve
 	params.getParam("empty_bonus", parameters.empty_bonus_);
 	params.getParam("accelerator_threads", parameters.num_threads_);
 	params.getParam("accelerator_min_indices_threads", parameters.min_indices_to_spawn_threads_);
+	params.getParam("accelerator_cache_dir", parameters.cache_dir_);
+	std::string huge_pages = "none";
+	params.getParam("huge_pages", huge_pages);
+	parameters.huge_pages_mode_ = HugePages::modeFromName(huge_pages);
 
 	auto accelerator = std::unique_ptr<Accelerator>(new AcceleratorKdTreeMultiThread(primitives, parameters));
 	return accelerator;
 }
 
-AcceleratorKdTreeMultiThread::AcceleratorKdTreeMultiThread(const std::vector<const Primitive *> &primitives, const Parameters &parameters)
+AcceleratorKdTreeMultiThread::AcceleratorKdTreeMultiThread(const std::vector<const Primitive *> &primitives, const Parameters &parameters) : nodes_(LargeBufferAllocator<Node>(parameters.huge_pages_mode_))
 {
-	Parameters tree_build_parameters = parameters;
-
 	const uint32_t num_primitives = static_cast<uint32_t>(primitives.size());
-	Y_INFO << "Kd-Tree MultiThread: Starting build (" << num_primitives << " prims, cost_ratio:" << parameters.cost_ratio_ << " empty_bonus:" << parameters.empty_bonus_ << ") [using " << tree_build_parameters.num_threads_ << " threads, min indices to spawn threads: " << tree_build_parameters.min_indices_to_spawn_threads_ << "]" << YENDL;
-	clock_t clock_start = clock();
+	Parameters tree_build_parameters = parameters;
 	if(tree_build_parameters.max_depth_ <= 0) tree_build_parameters.max_depth_ = static_cast<int>(7.0f + 1.66f * log(static_cast<float>(num_primitives)));
 	const double log_leaves = 1.442695f * log(static_cast<double >(num_primitives)); // = base2 log
 	if(tree_build_parameters.max_leaf_size_ <= 0)
@@ -61,6 +68,23 @@ AcceleratorKdTreeMultiThread::AcceleratorKdTreeMultiThread(const std::vector<con
 	if(tree_build_parameters.max_depth_ > kd_max_stack_) tree_build_parameters.max_depth_ = kd_max_stack_; //to prevent our stack to overflow
 	//experiment: add penalty to cost ratio to reduce memory usage on huge scenes
 	if(log_leaves > 16.0) tree_build_parameters.cost_ratio_ += 0.25 * (log_leaves - 16.0);
+	std::string cache_path;
+	uint64_t cache_hash = 0;
+	if(!parameters.cache_dir_.empty())
+	{
+		cache_hash = cacheHash(primitives, parameters);
+		std::stringstream cache_base_name;
+		cache_base_name << "yafaray_kdtree_mt_" << std::hex << std::setfill('0') << std::setw(16) << cache_hash;
+		cache_path = Path(parameters.cache_dir_, cache_base_name.str(), "cache").getFullPath();
+		if(loadCache(cache_path, cache_hash, primitives))
+		{
+			memory_tracker_.set(vectorMemory_global(nodes_) + vectorMemory_global(primitives_));
+			stats_ = makeStats(tree_build_parameters, {}, 0.f, true);
+			return;
+		}
+	}
+	Y_INFO << "Kd-Tree MultiThread: Starting build (" << num_primitives << " prims, cost_ratio:" << parameters.cost_ratio_ << " empty_bonus:" << parameters.empty_bonus_ << ") [using " << tree_build_parameters.num_threads_ << " threads, min indices to spawn threads: " << tree_build_parameters.min_indices_to_spawn_threads_ << "]" << YENDL;
+	clock_t clock_start = clock();
 	std::vector<Bound> bounds;
 	bounds.reserve(num_primitives);
 	tree_bound_ = primitives.front()->getBound();
@@ -82,17 +106,138 @@ AcceleratorKdTreeMultiThread::AcceleratorKdTreeMultiThread(const std::vector<con
 	std::vector<uint32_t> prim_indices(num_primitives);
 	for(uint32_t prim_num = 0; prim_num < num_primitives; prim_num++) prim_indices[prim_num] = prim_num;
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Kd-Tree MultiThread: Starting recursive build..." << YENDL;
-	const Result kd_tree_result = buildTree(primitives, tree_bound_, prim_indices, 0, 0, 0, bounds, tree_build_parameters, ClipPlane::Pos::None, {}, {});
-	nodes_ = std::move(kd_tree_result.nodes_);
+	if(tree_build_parameters.num_threads_ > 1) task_pool_ = std::unique_ptr<TaskPool>(new TaskPool(tree_build_parameters.num_threads_));
+	Result kd_tree_result = buildTree(primitives, tree_bound_, prim_indices, 0, 0, 0, bounds, tree_build_parameters, ClipPlane::Pos::None, {}, prim_indices);
+	task_pool_.reset();
+	nodes_.assign(kd_tree_result.nodes_.begin(), kd_tree_result.nodes_.end());
+	primitives_ = std::move(kd_tree_result.primitives_);
+	memory_tracker_.set(vectorMemory_global(nodes_) + vectorMemory_global(primitives_));
 	//print some stats:
 	const clock_t clock_elapsed = clock() - clock_start;
+	const float build_seconds = static_cast<float>(clock_elapsed) / static_cast<float>(CLOCKS_PER_SEC);
 	if(Y_LOG_HAS_VERBOSE)
 	{
-		Y_VERBOSE << "Kd-Tree MultiThread: CPU total clocks (in seconds): " << static_cast<float>(clock_elapsed) / static_cast<float>(CLOCKS_PER_SEC) << "s (actual CPU work, including the work done by all threads added together)" << YENDL;
+		Y_VERBOSE << "Kd-Tree MultiThread: CPU total clocks (in seconds): " << build_seconds << "s (actual CPU work, including the work done by all threads added together)" << YENDL;
 		Y_VERBOSE << "Kd-Tree MultiThread: used/allocated nodes: " << nodes_.size() << "/" << nodes_.capacity()
 				  << " (" << 100.f * static_cast<float>(nodes_.size()) / nodes_.capacity() << "%)" << YENDL;
+		Y_VERBOSE << "Kd-Tree MultiThread: nodes memory: " << nodes_.size() * sizeof(Node) / 1024 << " KB, leaf primitive references: " << primitives_.size() << " (" << primitives_.size() * sizeof(const Primitive *) / 1024 << " KB)" << YENDL;
 	}
 	kd_tree_result.stats_.outputLog(num_primitives, tree_build_parameters.max_leaf_size_);
+	stats_ = makeStats(tree_build_parameters, kd_tree_result.stats_, build_seconds, false);
+	if(!cache_path.empty() && !saveCache(cache_path, cache_hash, primitives)) Y_WARNING << "Kd-Tree MultiThread: Could not save the tree to cache file '" << cache_path << "'" << YENDL;
+}
+
+// ============================================================
+/*!
+	FNV-1a hash of the tree parameters and the primitives geometry, in order, as the cache
+	stores the leaf primitives as indices into the primitives list. Triangles are hashed by
+	their vertices, other primitives by their bounds
+*/
+uint64_t AcceleratorKdTreeMultiThread::cacheHash(const std::vector<const Primitive *> &primitives, const Parameters &parameters)
+{
+	uint64_t hash = 14695981039346656037ull;
+	const auto hash_bytes = [&hash](const void *data, size_t size)
+	{
+		const unsigned char *bytes = static_cast<const unsigned char *>(data);
+		for(size_t byte_num = 0; byte_num < size; ++byte_num)
+		{
+			hash ^= bytes[byte_num];
+			hash *= 1099511628211ull;
+		}
+	};
+	hash_bytes(&parameters.max_depth_, sizeof(parameters.max_depth_));
+	hash_bytes(&parameters.max_leaf_size_, sizeof(parameters.max_leaf_size_));
+	hash_bytes(&parameters.cost_ratio_, sizeof(parameters.cost_ratio_));
+	hash_bytes(&parameters.empty_bonus_, sizeof(parameters.empty_bonus_));
+	const uint32_t num_primitives = static_cast<uint32_t>(primitives.size());
+	hash_bytes(&num_primitives, sizeof(num_primitives));
+	for(const auto &primitive : primitives)
+	{
+		std::array<Point3, 3> vertices;
+		if(primitive->getTriangleVertices(vertices))
+		{
+			for(const auto &vertex : vertices) hash_bytes(&vertex.x_, 3 * sizeof(float));
+		}
+		else
+		{
+			const Bound bound = primitive->getBound();
+			hash_bytes(&bound.a_.x_, 3 * sizeof(float));
+			hash_bytes(&bound.g_.x_, 3 * sizeof(float));
+		}
+	}
+	return hash;
+}
+
+bool AcceleratorKdTreeMultiThread::loadCache(const std::string &path, uint64_t hash, const std::vector<const Primitive *> &primitives)
+{
+	if(!File::exists(path, true)) return false;
+	File file(path);
+	if(!file.open("rb")) return false;
+	std::string header;
+	uint64_t file_hash = 0;
+	uint32_t num_primitives = 0, num_nodes = 0, num_leaf_primitives = 0;
+	std::array<float, 6> bound;
+	file.read(header);
+	bool result = header == cache_header_;
+	result = result && file.read<uint64_t>(file_hash) && file_hash == hash;
+	result = result && file.read<uint32_t>(num_primitives) && num_primitives == primitives.size();
+	result = result && file.read<uint32_t>(num_nodes) && num_nodes > 0;
+	result = result && file.read<uint32_t>(num_leaf_primitives);
+	for(auto &coordinate : bound) result = result && file.read<float>(coordinate);
+	std::vector<uint32_t> leaf_primitive_indices;
+	if(result)
+	{
+		nodes_.resize(num_nodes);
+		leaf_primitive_indices.resize(num_leaf_primitives);
+		result = file.read(nodes_) && file.read(leaf_primitive_indices);
+	}
+	file.close();
+	//Validate the node references, so a corrupt file cannot cause out of bounds accesses during the traversal
+	for(uint32_t node_id = 0; result && node_id < num_nodes; ++node_id)
+	{
+		const Node &node = nodes_[node_id];
+		if(node.isLeaf()) result = static_cast<uint64_t>(node.getPrimitivesOffset()) + node.nPrimitives() <= num_leaf_primitives;
+		else result = node_id + 1 < num_nodes && node.getRightChild() < num_nodes;
+	}
+	for(uint32_t index_num = 0; result && index_num < num_leaf_primitives; ++index_num) result = leaf_primitive_indices[index_num] < num_primitives;
+	if(!result)
+	{
+		nodes_.clear();
+		Y_WARNING << "Kd-Tree MultiThread: Cache file '" << path << "' is not valid for this geometry, rebuilding the tree" << YENDL;
+		return false;
+	}
+	tree_bound_ = Bound({bound[0], bound[1], bound[2]}, {bound[3], bound[4], bound[5]});
+	primitives_.reserve(num_leaf_primitives);
+	for(const auto &index : leaf_primitive_indices) primitives_.emplace_back(primitives[index]);
+	Y_INFO << "Kd-Tree MultiThread: Loaded tree from cache file '" << path << "' (" << num_primitives << " prims, " << num_nodes << " nodes)" << YENDL;
+	return true;
+}
+
+bool AcceleratorKdTreeMultiThread::saveCache(const std::string &path, uint64_t hash, const std::vector<const Primitive *> &primitives) const
+{
+	std::unordered_map<const Primitive *, uint32_t> primitive_indices;
+	primitive_indices.reserve(primitives.size());
+	for(uint32_t prim_num = 0; prim_num < primitives.size(); ++prim_num) primitive_indices[primitives[prim_num]] = prim_num;
+	std::vector<uint32_t> leaf_primitive_indices;
+	leaf_primitive_indices.reserve(primitives_.size());
+	for(const auto &primitive : primitives_) leaf_primitive_indices.emplace_back(primitive_indices[primitive]);
+	//Written to a temporary file first, so an interrupted save never leaves a truncated cache file
+	const std::string path_tmp = path + ".tmp";
+	File file(path_tmp);
+	if(!file.open("wb")) return false;
+	bool result = file.append(std::string(cache_header_));
+	result = result && file.append<uint64_t>(hash);
+	result = result && file.append<uint32_t>(static_cast<uint32_t>(primitives.size()));
+	result = result && file.append<uint32_t>(static_cast<uint32_t>(nodes_.size()));
+	result = result && file.append<uint32_t>(static_cast<uint32_t>(leaf_primitive_indices.size()));
+	for(int axis = 0; axis < 3; ++axis) result = result && file.append<float>(tree_bound_.a_[axis]);
+	for(int axis = 0; axis < 3; ++axis) result = result && file.append<float>(tree_bound_.g_[axis]);
+	result = result && file.append(nodes_) && file.append(leaf_primitive_indices);
+	file.close();
+	if(result) result = File::rename(path_tmp, path, true, true);
+	else File::remove(path_tmp, true);
+	if(result && Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Kd-Tree MultiThread: Tree saved to cache file '" << path << "'" << YENDL;
+	return result;
 }
 
 void AcceleratorKdTreeMultiThread::Stats::outputLog(uint32_t num_primitives, int max_leaf_size) const
@@ -124,6 +269,41 @@ AcceleratorKdTreeMultiThread::Stats AcceleratorKdTreeMultiThread::Stats::operato
 	return *this;
 }
 
+/*! The node counters are obtained from the tree, so they are also available when the tree was loaded from
+	the cache. The clipping and bad split counters are only available when the tree was built */
+AcceleratorStats AcceleratorKdTreeMultiThread::makeStats(const Parameters &parameters, const Stats &build_stats, float build_seconds, bool loaded_from_cache) const
+{
+	uint32_t num_leaves = 0, num_empty_leaves = 0;
+	for(const auto &node : nodes_)
+	{
+		if(!node.isLeaf()) continue;
+		++num_leaves;
+		if(node.nPrimitives() == 0) ++num_empty_leaves;
+	}
+	AcceleratorStats stats;
+	stats.accelerator_ = "yafaray-kdtree-multi-thread";
+	stats.build_ = {
+		{"cost_ratio", parameters.cost_ratio_},
+		{"empty_bonus", parameters.empty_bonus_},
+		{"max_depth", parameters.max_depth_},
+		{"max_leaf_size", parameters.max_leaf_size_},
+		{"loaded_from_cache", loaded_from_cache ? 1 : 0},
+		{"build_cpu_seconds", build_seconds},
+		{"nodes", nodes_.size()},
+		{"interior_nodes", nodes_.size() - num_leaves},
+		{"leaves", num_leaves},
+		{"empty_leaves", num_empty_leaves},
+		{"leaf_primitives", primitives_.size()},
+		{"clipped_primitives", build_stats.clip_},
+		{"bad_clips", build_stats.bad_clip_},
+		{"null_clips", build_stats.null_clip_},
+		{"early_outs", build_stats.early_out_},
+		{"depth_limit_leaves", build_stats.depth_limit_reached_},
+		{"bad_splits", build_stats.num_bad_splits_},
+	};
+	return stats;
+}
+
 AcceleratorKdTreeMultiThread::~AcceleratorKdTreeMultiThread()
 {
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Kd-Tree MultiThread: Done" << YENDL;
@@ -135,7 +315,25 @@ AcceleratorKdTreeMultiThread::~AcceleratorKdTreeMultiThread()
 	and binning => O(n)
 */
 
-AcceleratorKdTreeMultiThread::SplitCost AcceleratorKdTreeMultiThread::pigeonMinCost(float e_bonus, float cost_ratio, const std::vector<Bound> &bounds, const Bound &node_bound, const std::vector<uint32_t> &prim_indices)
+AcceleratorKdTreeMultiThread::SplitCost AcceleratorKdTreeMultiThread::pigeonMinCost(float e_bonus, float cost_ratio, const std::vector<Bound> &bounds, const Bound &node_bound, const std::vector<uint32_t> &prim_indices, TaskPool *task_pool)
+{
+	std::array<SplitCost, 3> axis_splits;
+	if(task_pool)
+	{
+		//Each axis has its own bins, so the three axes of the large nodes near the root are binned at the same time by the idle threads
+		TaskPool::Group task_group(*task_pool);
+		for(int axis = 0; axis < 2; ++axis) task_group.run([&, axis]() { axis_splits[axis] = pigeonMinCostAxis(axis, e_bonus, cost_ratio, bounds, node_bound, prim_indices); });
+		axis_splits[2] = pigeonMinCostAxis(2, e_bonus, cost_ratio, bounds, node_bound, prim_indices);
+		task_group.wait();
+	}
+	else for(int axis = 0; axis < 3; ++axis) axis_splits[axis] = pigeonMinCostAxis(axis, e_bonus, cost_ratio, bounds, node_bound, prim_indices);
+	//The axes are compared in order, so the first one wins the ties and the tree does not depend on the number of threads
+	SplitCost split = axis_splits[0];
+	for(int axis = 1; axis < 3; ++axis) if(axis_splits[axis].cost_ < split.cost_) split = axis_splits[axis];
+	return split;
+}
+
+AcceleratorKdTreeMultiThread::SplitCost AcceleratorKdTreeMultiThread::pigeonMinCostAxis(int axis, float e_bonus, float cost_ratio, const std::vector<Bound> &bounds, const Bound &node_bound, const std::vector<uint32_t> &prim_indices)
 {
 	const uint32_t num_prim_indices = static_cast<uint32_t>(prim_indices.size());
 	static constexpr int max_bin = 1024;
@@ -147,132 +345,128 @@ AcceleratorKdTreeMultiThread::SplitCost AcceleratorKdTreeMultiThread::pigeonMinC
 	split.cost_ = std::numeric_limits<float>::infinity();
 	const float inv_total_sa = 1.f / (node_bound_axes[0] * node_bound_axes[1] + node_bound_axes[0] * node_bound_axes[2] + node_bound_axes[1] * node_bound_axes[2]);
 
-	for(int axis = 0; axis < 3; ++axis)
+	const float s = max_bin * inv_node_bound_axes[axis];
+	const float min = node_bound.a_[axis];
+	// pigeonhole sort:
+	for(uint32_t prim_num = 0; prim_num < num_prim_indices; ++prim_num)
 	{
-		const float s = max_bin * inv_node_bound_axes[axis];
-		const float min = node_bound.a_[axis];
-		// pigeonhole sort:
-		for(uint32_t prim_num = 0; prim_num < num_prim_indices; ++prim_num)
+		const Bound &bbox = bounds[prim_indices[prim_num]];
+		const float t_low = bbox.a_[axis];
+		const float t_up  = bbox.g_[axis];
+		int b_left = static_cast<int>((t_low - min) * s);
+		int b_right = static_cast<int>((t_up - min) * s);
+		if(b_left < 0) b_left = 0;
+		else if(b_left > max_bin) b_left = max_bin;
+		if(b_right < 0) b_right = 0;
+		else if(b_right > max_bin) b_right = max_bin;
+
+		if(t_low == t_up)
 		{
-			const Bound &bbox = bounds[prim_indices[prim_num]];
-			const float t_low = bbox.a_[axis];
-			const float t_up  = bbox.g_[axis];
-			int b_left = static_cast<int>((t_low - min) * s);
-			int b_right = static_cast<int>((t_up - min) * s);
-			if(b_left < 0) b_left = 0;
-			else if(b_left > max_bin) b_left = max_bin;
-			if(b_right < 0) b_right = 0;
-			else if(b_right > max_bin) b_right = max_bin;
-
-			if(t_low == t_up)
+			if(bins[b_left].empty() || (t_low >= bins[b_left].t_ && !bins[b_left].empty()))
 			{
-				if(bins[b_left].empty() || (t_low >= bins[b_left].t_ && !bins[b_left].empty()))
-				{
-					bins[b_left].t_ = t_low;
-					bins[b_left].c_both_++;
-				}
-				else
-				{
-					bins[b_left].c_left_++;
-					bins[b_left].c_right_++;
-				}
-				bins[b_left].n_ += 2;
+				bins[b_left].t_ = t_low;
+				bins[b_left].c_both_++;
 			}
 			else
 			{
-				if(bins[b_left].empty() || (t_low > bins[b_left].t_ && !bins[b_left].empty()))
-				{
-					bins[b_left].t_ = t_low;
-					bins[b_left].c_left_ += bins[b_left].c_both_ + bins[b_left].c_bleft_;
-					bins[b_left].c_right_ += bins[b_left].c_both_;
-					bins[b_left].c_both_ = bins[b_left].c_bleft_ = 0;
-					bins[b_left].c_bleft_++;
-				}
-				else if(t_low == bins[b_left].t_)
-				{
-					bins[b_left].c_bleft_++;
-				}
-				else bins[b_left].c_left_++;
-				bins[b_left].n_++;
-
-				bins[b_right].c_right_++;
-				if(bins[b_right].empty() || t_up > bins[b_right].t_)
-				{
-					bins[b_right].t_ = t_up;
-					bins[b_right].c_left_ += bins[b_right].c_both_ + bins[b_right].c_bleft_;
-					bins[b_right].c_right_ += bins[b_right].c_both_;
-					bins[b_right].c_both_ = bins[b_right].c_bleft_ = 0;
-				}
-				bins[b_right].n_++;
+				bins[b_left].c_left_++;
+				bins[b_left].c_right_++;
 			}
+			bins[b_left].n_ += 2;
 		}
-		const int next_axis = Axis::next(axis);
-		const int prev_axis = Axis::prev(axis);
-		const float cap_area = node_bound_axes[next_axis] * node_bound_axes[prev_axis];
-		const float cap_perim = node_bound_axes[next_axis] + node_bound_axes[prev_axis];
+		else
+		{
+			if(bins[b_left].empty() || (t_low > bins[b_left].t_ && !bins[b_left].empty()))
+			{
+				bins[b_left].t_ = t_low;
+				bins[b_left].c_left_ += bins[b_left].c_both_ + bins[b_left].c_bleft_;
+				bins[b_left].c_right_ += bins[b_left].c_both_;
+				bins[b_left].c_both_ = bins[b_left].c_bleft_ = 0;
+				bins[b_left].c_bleft_++;
+			}
+			else if(t_low == bins[b_left].t_)
+			{
+				bins[b_left].c_bleft_++;
+			}
+			else bins[b_left].c_left_++;
+			bins[b_left].n_++;
 
-		uint32_t num_left = 0;
-		uint32_t num_right = num_prim_indices;
-		// cumulate prims and evaluate cost
-		for(const auto &bin : bins)
+			bins[b_right].c_right_++;
+			if(bins[b_right].empty() || t_up > bins[b_right].t_)
+			{
+				bins[b_right].t_ = t_up;
+				bins[b_right].c_left_ += bins[b_right].c_both_ + bins[b_right].c_bleft_;
+				bins[b_right].c_right_ += bins[b_right].c_both_;
+				bins[b_right].c_both_ = bins[b_right].c_bleft_ = 0;
+			}
+			bins[b_right].n_++;
+		}
+	}
+	const int next_axis = Axis::next(axis);
+	const int prev_axis = Axis::prev(axis);
+	const float cap_area = node_bound_axes[next_axis] * node_bound_axes[prev_axis];
+	const float cap_perim = node_bound_axes[next_axis] + node_bound_axes[prev_axis];
+
+	uint32_t num_left = 0;
+	uint32_t num_right = num_prim_indices;
+	// cumulate prims and evaluate cost
+	for(const auto &bin : bins)
+	{
+		if(!bin.empty())
 		{
-			if(!bin.empty())
+			num_left += bin.c_left_;
+			num_right -= bin.c_right_;
+			// cost:
+			const float edget = bin.t_;
+			if(edget > node_bound.a_[axis] && edget < node_bound.g_[axis])
 			{
-				num_left += bin.c_left_;
-				num_right -= bin.c_right_;
-				// cost:
-				const float edget = bin.t_;
-				if(edget > node_bound.a_[axis] && edget < node_bound.g_[axis])
+				// Compute cost for split at _i_th edge
+				const float l_below = edget - node_bound.a_[axis];
+				const float l_above = node_bound.g_[axis] - edget;
+				const float below_sa = cap_area + l_below * cap_perim;
+				const float above_sa = cap_area + l_above * cap_perim;
+				const float raw_costs = (below_sa * num_left + above_sa * num_right);
+				float eb;
+				if(num_right == 0) eb = (0.1f + l_above * inv_node_bound_axes[axis]) * e_bonus * raw_costs;
+				else if(num_left == 0) eb = (0.1f + l_below * inv_node_bound_axes[axis]) * e_bonus * raw_costs;
+				else eb = 0.f;
+
+				const float cost = cost_ratio + inv_total_sa * (raw_costs - eb);
+
+				// Update best split if this is lowest cost so far
+				if(cost < split.cost_)
 				{
-					// Compute cost for split at _i_th edge
-					const float l_below = edget - node_bound.a_[axis];
-					const float l_above = node_bound.g_[axis] - edget;
-					const float below_sa = cap_area + l_below * cap_perim;
-					const float above_sa = cap_area + l_above * cap_perim;
-					const float raw_costs = (below_sa * num_left + above_sa * num_right);
-					float eb;
-					if(num_right == 0) eb = (0.1f + l_above * inv_node_bound_axes[axis]) * e_bonus * raw_costs;
-					else if(num_left == 0) eb = (0.1f + l_below * inv_node_bound_axes[axis]) * e_bonus * raw_costs;
-					else eb = 0.f;
-
-					const float cost = cost_ratio + inv_total_sa * (raw_costs - eb);
-
-					// Update best split if this is lowest cost so far
-					if(cost < split.cost_)
-					{
-						split.t_ = edget;
-						split.cost_ = cost;
-						split.axis_ = axis;
-					}
+					split.t_ = edget;
+					split.cost_ = cost;
+					split.axis_ = axis;
 				}
-				num_left += bin.c_both_ + bin.c_bleft_;
-				num_right -= bin.c_both_;
 			}
-		} // for all bins
-		if(num_left != num_prim_indices || num_right != 0)
+			num_left += bin.c_both_ + bin.c_bleft_;
+			num_right -= bin.c_both_;
+		}
+	} // for all bins
+	if(num_left != num_prim_indices || num_right != 0)
+	{
+		if(Y_LOG_HAS_VERBOSE)
 		{
-			if(Y_LOG_HAS_VERBOSE)
-			{
-				int c_1 = 0, c_2 = 0, c_3 = 0, c_4 = 0, c_5 = 0;
-				Y_VERBOSE << "SCREWED!!\n";
-				for(const auto &bin : bins) { c_1 += bin.n_; std::cout << bin.n_ << " ";}
-				Y_VERBOSE << "\nn total: " << c_1 << "\n";
-				for(const auto &bin : bins) { c_2 += bin.c_left_; Y_VERBOSE << bin.c_left_ << " ";}
-				Y_VERBOSE << "\nc_left total: " << c_2 << "\n";
-				for(const auto &bin : bins) { c_3 += bin.c_bleft_; Y_VERBOSE << bin.c_bleft_ << " ";}
-				Y_VERBOSE << "\nc_bleft total: " << c_3 << "\n";
-				for(const auto &bin : bins) { c_4 += bin.c_both_; Y_VERBOSE << bin.c_both_ << " ";}
-				Y_VERBOSE << "\nc_both total: " << c_4 << "\n";
-				for(const auto &bin : bins) { c_5 += bin.c_right_; Y_VERBOSE << bin.c_right_ << " ";}
-				Y_VERBOSE << "\nc_right total: " << c_5 << "\n";
-				Y_VERBOSE << "\nnPrims: " << num_prim_indices << " num_left: " << num_left << " num_right: " << num_right << "\n";
-				Y_VERBOSE << "total left: " << c_2 + c_3 + c_4 << "\ntotal right: " << c_4 + c_5 << "\n";
-				Y_VERBOSE << "n/2: " << c_1 / 2 << "\n";
-			}
-			throw std::logic_error("cost function mismatch");
+			int c_1 = 0, c_2 = 0, c_3 = 0, c_4 = 0, c_5 = 0;
+			Y_VERBOSE << "SCREWED!!\n";
+			for(const auto &bin : bins) { c_1 += bin.n_; std::cout << bin.n_ << " ";}
+			Y_VERBOSE << "\nn total: " << c_1 << "\n";
+			for(const auto &bin : bins) { c_2 += bin.c_left_; Y_VERBOSE << bin.c_left_ << " ";}
+			Y_VERBOSE << "\nc_left total: " << c_2 << "\n";
+			for(const auto &bin : bins) { c_3 += bin.c_bleft_; Y_VERBOSE << bin.c_bleft_ << " ";}
+			Y_VERBOSE << "\nc_bleft total: " << c_3 << "\n";
+			for(const auto &bin : bins) { c_4 += bin.c_both_; Y_VERBOSE << bin.c_both_ << " ";}
+			Y_VERBOSE << "\nc_both total: " << c_4 << "\n";
+			for(const auto &bin : bins) { c_5 += bin.c_right_; Y_VERBOSE << bin.c_right_ << " ";}
+			Y_VERBOSE << "\nc_right total: " << c_5 << "\n";
+			Y_VERBOSE << "\nnPrims: " << num_prim_indices << " num_left: " << num_left << " num_right: " << num_right << "\n";
+			Y_VERBOSE << "total left: " << c_2 + c_3 + c_4 << "\ntotal right: " << c_4 + c_5 << "\n";
+			Y_VERBOSE << "n/2: " << c_1 / 2 << "\n";
 		}
-		for(auto &bin : bins) bin.reset();
-	} // for all axis
+		throw std::logic_error("cost function mismatch");
+	}
 	return split;
 }
 
@@ -478,7 +672,7 @@ void AcceleratorKdTreeMultiThread::buildTreeWorker(const std::vector<const Primi
 	if(num_new_indices <= static_cast<uint32_t>(parameters.max_leaf_size_) || depth >= parameters.max_depth_)
 	{
 		Node node;
-		const Stats leaf_stats = node.createLeaf(new_primitive_indices, primitives);
+		const Stats leaf_stats = node.createLeaf(new_primitive_indices, primitives, result.primitives_);
 		result.stats_ += leaf_stats;
 		result.nodes_.emplace_back(node);
 		if(depth >= parameters.max_depth_) result.stats_.depth_limit_reached_++;
@@ -487,8 +681,10 @@ void AcceleratorKdTreeMultiThread::buildTreeWorker(const std::vector<const Primi
 
 	//<< calculate cost for all axes and chose minimum >>
 	const float modified_empty_bonus = parameters.empty_bonus_ * (1.1 - static_cast<float>(depth) / static_cast<float>(parameters.max_depth_));
+	//The large nodes near the root are split before there are enough subtrees for all the threads, so their split search and classification are parallelized too
+	TaskPool *node_task_pool = (task_pool_ && num_new_indices >= static_cast<uint32_t>(parameters.min_indices_to_spawn_threads_)) ? task_pool_.get() : nullptr;
 	SplitCost split;
-	if(num_new_indices > pigeon_sort_threshold) split = pigeonMinCost(modified_empty_bonus, parameters.cost_ratio_, new_bounds, node_bound, new_indices);
+	if(num_new_indices > pigeon_sort_threshold) split = pigeonMinCost(modified_empty_bonus, parameters.cost_ratio_, new_bounds, node_bound, new_indices, node_task_pool);
 	else split = minimalCost(modified_empty_bonus, parameters.cost_ratio_, node_bound, new_indices, new_bounds);
 	result.stats_.early_out_ += split.stats_early_out_;
 	//<< if (minimum > leafcost) increase bad refines >>
@@ -497,7 +693,7 @@ void AcceleratorKdTreeMultiThread::buildTreeWorker(const std::vector<const Primi
 	   split.axis_ == Axis::None || bad_refines == 2)
 	{
 		Node node;
-		const Stats leaf_stats = node.createLeaf(new_primitive_indices, primitives);
+		const Stats leaf_stats = node.createLeaf(new_primitive_indices, primitives, result.primitives_);
 		result.stats_ += leaf_stats;
 		result.nodes_.emplace_back(node);
 		if(bad_refines == 2) ++result.stats_.num_bad_splits_;
@@ -512,21 +708,38 @@ void AcceleratorKdTreeMultiThread::buildTreeWorker(const std::vector<const Primi
 	std::vector<uint32_t> right_primitive_indices;
 	if(num_new_indices > pigeon_sort_threshold) // we did pigeonhole
 	{
-		for(uint32_t prim_num = 0; prim_num < num_new_indices; prim_num++)
+		//The indices are classified in fixed chunks concatenated in order, so the children get the same indices with any number of threads
+		static constexpr uint32_t classify_chunk_size = 16384;
+		const size_t num_chunks = (num_new_indices + classify_chunk_size - 1) / classify_chunk_size;
+		std::vector<std::vector<uint32_t>> chunk_left_indices(num_chunks);
+		std::vector<std::vector<uint32_t>> chunk_right_indices(num_chunks);
+		parallelFor_global(node_task_pool, num_chunks, [&](size_t chunk_begin, size_t chunk_end)
 		{
-			const int prim_id = new_indices.get()[prim_num];
-			if(new_bounds.get()[prim_id].a_[split.axis_] >= split.t_)
-			{
-				right_indices.emplace_back(prim_id);
-			}
-			else
+			for(size_t chunk = chunk_begin; chunk < chunk_end; ++chunk)
 			{
-				left_indices.emplace_back(prim_id);
-				if(new_bounds.get()[prim_id].g_[split.axis_] > split.t_)
+				const uint32_t prim_num_end = std::min(static_cast<uint32_t>((chunk + 1) * classify_chunk_size), num_new_indices);
+				for(uint32_t prim_num = static_cast<uint32_t>(chunk * classify_chunk_size); prim_num < prim_num_end; prim_num++)
 				{
-					right_indices.emplace_back(prim_id);
+					const int prim_id = new_indices.get()[prim_num];
+					if(new_bounds.get()[prim_id].a_[split.axis_] >= split.t_)
+					{
+						chunk_right_indices[chunk].emplace_back(prim_id);
+					}
+					else
+					{
+						chunk_left_indices[chunk].emplace_back(prim_id);
+						if(new_bounds.get()[prim_id].g_[split.axis_] > split.t_)
+						{
+							chunk_right_indices[chunk].emplace_back(prim_id);
+						}
+					}
 				}
 			}
+		}, 1);
+		for(size_t chunk = 0; chunk < num_chunks; ++chunk)
+		{
+			left_indices.insert(left_indices.end(), chunk_left_indices[chunk].begin(), chunk_left_indices[chunk].end());
+			right_indices.insert(right_indices.end(), chunk_right_indices[chunk].begin(), chunk_right_indices[chunk].end());
 		}
 		split_pos = split.t_;
 		left_primitive_indices = left_indices;
@@ -609,19 +822,19 @@ void AcceleratorKdTreeMultiThread::buildTreeWorker(const std::vector<const Primi
 	}
 #endif //POLY_CLIPPING_MULTITHREAD > 0
 
-	if(num_current_threads_ < parameters.num_threads_ && (left_primitive_indices.size() >= (right_primitive_indices.size() / 10)) && (right_primitive_indices.size() >= (left_primitive_indices.size() / 10)) && (left_primitive_indices.size() >= static_cast<size_t>(parameters.min_indices_to_spawn_threads_)))
+	if(task_pool_ && left_primitive_indices.size() >= static_cast<size_t>(parameters.min_indices_to_spawn_threads_) && right_primitive_indices.size() >= static_cast<size_t>(parameters.min_indices_to_spawn_threads_))
 	{
+		//The left subtree is added as a task of the pool, that can be stolen by any idle thread, while this thread continues with the right subtree
 		const uint32_t next_free_node_original = static_cast<uint32_t>(next_node_id + result.nodes_.size());
 		Result result_left;
-		auto left_worker = std::thread(&AcceleratorKdTreeMultiThread::buildTreeWorker, this, primitives, bound_left, left_indices, depth + 1, next_free_node_original, bad_refines, new_bounds, parameters, left_clip_plane, new_polygons, left_primitive_indices, std::ref(result_left));
-		num_current_threads_++;
 		Result result_right;
-		auto right_worker = std::thread(&AcceleratorKdTreeMultiThread::buildTreeWorker, this, primitives, bound_right, right_indices, depth + 1, 0, bad_refines, new_bounds, parameters, right_clip_plane, new_polygons, right_primitive_indices, std::ref(result_right)); //We don't need to specify next_free_node (set to 0) because all internor node right childs will be modified later adding the left nodes list size once it's known
-		num_current_threads_++;
-		left_worker.join();
-		num_current_threads_--;
-		right_worker.join();
-		num_current_threads_--;
+		TaskPool::Group task_group(*task_pool_);
+		task_group.run([&]()
+		{
+			buildTreeWorker(primitives, bound_left, left_indices, depth + 1, next_free_node_original, bad_refines, new_bounds, parameters, left_clip_plane, new_polygons, left_primitive_indices, result_left);
+		});
+		buildTreeWorker(primitives, bound_right, right_indices, depth + 1, 0, bad_refines, new_bounds, parameters, right_clip_plane, new_polygons, right_primitive_indices, result_right); //We don't need to specify next_free_node (set to 0) because all internor node right childs will be modified later adding the left nodes list size once it's known
+		task_group.wait();
 
 		result.stats_ += result_left.stats_;
 		result.stats_ += result_right.stats_;
@@ -635,8 +848,8 @@ void AcceleratorKdTreeMultiThread::buildTreeWorker(const std::vector<const Primi
 			if(!right_node.isLeaf()) right_node.setRightChild(right_node.getRightChild() + next_free_node_left);
 		}
 		result.nodes_.reserve(next_free_node_original + num_nodes_left + result_right.nodes_.size());
-		result.nodes_.insert(result.nodes_.end(), result_left.nodes_.begin(), result_left.nodes_.end());
-		result.nodes_.insert(result.nodes_.end(), result_right.nodes_.begin(), result_right.nodes_.end());
+		appendResult(result, result_left);
+		appendResult(result, result_right);
 	}
 	else
 	{
@@ -644,28 +857,43 @@ void AcceleratorKdTreeMultiThread::buildTreeWorker(const std::vector<const Primi
 		const Result result_left = buildTree(primitives, bound_left, left_indices, depth + 1, next_node_id + result.nodes_.size(), bad_refines, new_bounds, parameters, left_clip_plane, new_polygons, left_primitive_indices);
 		result.stats_ += result_left.stats_;
 		result.nodes_.back().setRightChild(next_node_id + result.nodes_.size() + result_left.nodes_.size());
-		result.nodes_.insert(result.nodes_.end(), result_left.nodes_.begin(), result_left.nodes_.end());
+		appendResult(result, result_left);
 
 		//<< recurse right child >>
 		const Result result_right = buildTree(primitives, bound_right, right_indices, depth + 1, next_node_id + result.nodes_.size(), bad_refines, new_bounds, parameters, right_clip_plane, new_polygons, right_primitive_indices);
 		result.stats_ += result_right.stats_;
-		result.nodes_.insert(result.nodes_.end(), result_right.nodes_.begin(), result_right.nodes_.end());
+		appendResult(result, result_right);
 	}
 }
 
+/*! Appends the nodes and leaf primitives of a subtree result, offsetting the subtree
+	leaves so they reference the primitives in the appended position */
+void AcceleratorKdTreeMultiThread::appendResult(Result &result, const Result &sub_result)
+{
+	const uint32_t primitives_offset = static_cast<uint32_t>(result.primitives_.size());
+	result.nodes_.reserve(result.nodes_.size() + sub_result.nodes_.size());
+	for(Node node : sub_result.nodes_)
+	{
+		if(node.isLeaf()) node.setPrimitivesOffset(node.getPrimitivesOffset() + primitives_offset);
+		result.nodes_.emplace_back(node);
+	}
+	result.primitives_.insert(result.primitives_.end(), sub_result.primitives_.begin(), sub_result.primitives_.end());
+}
+
 //============================
 /*! The standard intersect function,
 	returns the closest hit within dist
 */
 AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersect(const Ray &ray, float t_max) const
 {
-	return intersect(ray, t_max, nodes_, tree_bound_);
+	return intersect(ray, t_max, nodes_.data(), primitives_, tree_bound_);
 }
 
-AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersect(const Ray &ray, float t_max, const std::vector<Node> &nodes, const Bound &tree_bound)
+AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersect(const Ray &ray, float t_max, const Node *nodes, const std::vector<const Primitive *> &primitives, const Bound &tree_bound)
 {
 	AcceleratorIntersectData accelerator_intersect_data;
 	accelerator_intersect_data.t_max_ = t_max;
+	AcceleratorRayStats ray_stats;
 	const Bound::Cross cross = tree_bound.cross(ray, t_max);
 	if(!cross.crossed_) { return {}; }
 
@@ -674,7 +902,7 @@ AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersect(const Ray &ray,
 	std::array<Stack, kd_max_stack_> stack;
 	const Node *far_child;
 	const Node *curr_node;
-	curr_node = nodes.data();
+	curr_node = nodes;
 
 	int entry_id = 0;
 	stack[entry_id].t_ = cross.enter_;
@@ -698,6 +926,7 @@ AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersect(const Ray &ray,
 		// loop until leaf is found
 		while(!curr_node->isLeaf())
 		{
+			ray_stats.addNode();
 			const int axis = curr_node->splitAxis();
 			const float split_val = curr_node->splitPos();
 
@@ -774,8 +1003,11 @@ AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersect(const Ray &ray,
 				}
 			}
 		};
-		for(const auto &prim : curr_node->primitives_)
+		ray_stats.addLeaf(curr_node->nPrimitives());
+		const uint32_t primitives_end = curr_node->getPrimitivesOffset() + curr_node->nPrimitives();
+		for(uint32_t prim_num = curr_node->getPrimitivesOffset(); prim_num < primitives_end; ++prim_num)
 		{
+			const Primitive *prim = primitives[prim_num];
 			primitive_intersection(accelerator_intersect_data, prim, ray);
 		}
 		if(accelerator_intersect_data.hit_ && accelerator_intersect_data.t_max_ <= stack[exit_id].t_)
@@ -792,18 +1024,19 @@ AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersect(const Ray &ray,
 
 AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersectS(const Ray &ray, float t_max, float shadow_bias) const
 {
-	return intersectS(ray, t_max, shadow_bias, nodes_, tree_bound_);
+	return intersectS(ray, t_max, shadow_bias, nodes_.data(), primitives_, tree_bound_);
 }
 
-AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersectS(const Ray &ray, float t_max, float, const std::vector<Node> &nodes, const Bound &tree_bound)
+AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersectS(const Ray &ray, float t_max, float, const Node *nodes, const std::vector<const Primitive *> &primitives, const Bound &tree_bound)
 {
 	AcceleratorIntersectData accelerator_intersect_data;
+	AcceleratorRayStats ray_stats;
 	const Bound::Cross cross = tree_bound.cross(ray, t_max);
 	if(!cross.crossed_) { return {}; }
 	const Vec3 inv_dir(1.f / ray.dir_.x_, 1.f / ray.dir_.y_, 1.f / ray.dir_.z_);
 	std::array<Stack, kd_max_stack_> stack;
 	const Node *far_child, *curr_node;
-	curr_node = nodes.data();
+	curr_node = nodes;
 	int entry_id = 0;
 	stack[entry_id].t_ = cross.enter_;
 
@@ -826,6 +1059,7 @@ AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersectS(const Ray &ray
 		// loop until leaf is found
 		while(!curr_node->isLeaf())
 		{
+			ray_stats.addNode();
 			const int axis = curr_node->splitAxis();
 			const float split_val = curr_node->splitPos();
 			if(stack[entry_id].point_[axis] <= split_val)
@@ -902,10 +1136,17 @@ AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersectS(const Ray &ray
 			}
 			return false;
 		};
-		for(const auto &prim : curr_node->primitives_)
+		ray_stats.addLeaf(curr_node->nPrimitives());
+		const uint32_t primitives_end = curr_node->getPrimitivesOffset() + curr_node->nPrimitives();
+		for(uint32_t prim_num = curr_node->getPrimitivesOffset(); prim_num < primitives_end; ++prim_num)
+		{
+			const Primitive *prim = primitives[prim_num];
+			if(primitive_intersection(accelerator_intersect_data, prim, ray, t_max))
 			{
-				if(primitive_intersection(accelerator_intersect_data, prim, ray, t_max)) return accelerator_intersect_data;
+				ray_stats.setEarlyOut();
+				return accelerator_intersect_data;
 			}
+		}
 		entry_id = exit_id;
 		curr_node = stack[exit_id].node_;
 		exit_id = stack[entry_id].prev_stack_id_;
@@ -918,14 +1159,15 @@ AcceleratorIntersectData AcceleratorKdTreeMultiThread::intersectS(const Ray &ray
 =============================================================*/
 
 
-AcceleratorTsIntersectData AcceleratorKdTreeMultiThread::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias) const
+AcceleratorTsIntersectData AcceleratorKdTreeMultiThread::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *obj_to_world) const
 {
-	return intersectTs(render_data, ray, max_depth, t_max, shadow_bias, nodes_, tree_bound_);
+	return intersectTs(render_data, ray, max_depth, t_max, shadow_bias, obj_to_world, nodes_.data(), primitives_, tree_bound_);
 }
 
-AcceleratorTsIntersectData AcceleratorKdTreeMultiThread::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float, const std::vector<Node> &nodes, const Bound &tree_bound)
+AcceleratorTsIntersectData AcceleratorKdTreeMultiThread::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float, const Matrix4 *obj_to_world, const Node *nodes, const std::vector<const Primitive *> &primitives, const Bound &tree_bound)
 {
 	AcceleratorTsIntersectData accelerator_intersect_data;
+	AcceleratorRayStats ray_stats;
 	const Bound::Cross cross = tree_bound.cross(ray, t_max);
 	if(!cross.crossed_) { return {}; }
 
@@ -942,12 +1184,13 @@ AcceleratorTsIntersectData AcceleratorKdTreeMultiThread::intersectTs(RenderData
 	else inv_dir_z = 1.f / ray.dir_.z_;
 
 	Vec3 inv_dir(inv_dir_x, inv_dir_y, inv_dir_z);
+	const MemoryArena::Marker material_data_marker = render_data.arena_.getMarker();
 	int depth = 0;
 
 	std::set<const Primitive *> filtered;
 	std::array<Stack, kd_max_stack_> stack;
 	const Node *far_child, *curr_node;
-	curr_node = nodes.data();
+	curr_node = nodes;
 
 	int entry_id = 0;
 	stack[entry_id].t_ = cross.enter_;
@@ -971,6 +1214,7 @@ AcceleratorTsIntersectData AcceleratorKdTreeMultiThread::intersectTs(RenderData
 		// loop until leaf is found
 		while(!curr_node->isLeaf())
 		{
+			ray_stats.addNode();
 			const int axis = curr_node->splitAxis();
 			const float split_val = curr_node->splitPos();
 			if(stack[entry_id].point_[axis] <= split_val)
@@ -1021,7 +1265,7 @@ AcceleratorTsIntersectData AcceleratorKdTreeMultiThread::intersectTs(RenderData
 		}
 
 		// Check for intersections inside leaf node
-		const auto &primitive_intersection = [](AcceleratorTsIntersectData &accelerator_intersect_data, std::set<const Primitive *> &filtered, RenderData &render_data, int &depth, int max_depth, const Primitive *primitive, const Ray &ray, float t_max) -> bool
+		const auto &primitive_intersection = [](AcceleratorTsIntersectData &accelerator_intersect_data, std::set<const Primitive *> &filtered, RenderData &render_data, const MemoryArena::Marker &material_data_marker, int &depth, int max_depth, const Primitive *primitive, const Ray &ray, float t_max, const Matrix4 *obj_to_world) -> bool
 		{
 			const IntersectData intersect_data = primitive->intersect(ray);
 			if(intersect_data.hit_)
@@ -1037,10 +1281,8 @@ AcceleratorTsIntersectData AcceleratorKdTreeMultiThread::intersectTs(RenderData
 						if(filtered.insert(primitive).second)
 						{
 							if(depth >= max_depth) return true;
-							const Point3 hit_point = ray.from_ + accelerator_intersect_data.t_hit_ * ray.dir_;
-							const SurfacePoint sp = primitive->getSurface(hit_point, accelerator_intersect_data);
-							accelerator_intersect_data.transparent_color_ *= mat->getTransparency(render_data, sp, ray.dir_);
 							++depth;
+							if(accumulateTransparency(accelerator_intersect_data, render_data, material_data_marker, primitive, ray, obj_to_world)) return true;
 						}
 					}
 				}
@@ -1049,9 +1291,16 @@ AcceleratorTsIntersectData AcceleratorKdTreeMultiThread::intersectTs(RenderData
 		};
 
 
-		for(const auto &prim : curr_node->primitives_)
+		ray_stats.addLeaf(curr_node->nPrimitives());
+		const uint32_t primitives_end = curr_node->getPrimitivesOffset() + curr_node->nPrimitives();
+		for(uint32_t prim_num = curr_node->getPrimitivesOffset(); prim_num < primitives_end; ++prim_num)
 		{
-				if(primitive_intersection(accelerator_intersect_data, filtered, render_data, depth, max_depth, prim, ray, t_max)) return accelerator_intersect_data;
+			const Primitive *prim = primitives[prim_num];
+			if(primitive_intersection(accelerator_intersect_data, filtered, render_data, material_data_marker, depth, max_depth, prim, ray, t_max, obj_to_world))
+			{
+				ray_stats.setEarlyOut();
+				return accelerator_intersect_data;
+			}
 		}
 		entry_id = exit_id;
 		curr_node = stack[exit_id].node_;
@@ -98,7 +98,7 @@ AcceleratorIntersectData AcceleratorSimpleTest::intersectS(const Ray &ray, float
 	return {};
 }
 
-AcceleratorTsIntersectData AcceleratorSimpleTest::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float dist, float shadow_bias) const
+AcceleratorTsIntersectData AcceleratorSimpleTest::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float dist, float shadow_bias, const Matrix4 *obj_to_world) const
 {
 	for(const auto &object_data : objects_data_)
 	{
@@ -0,0 +1,167 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "accelerator/accelerator_stats.h"
+#include "common/thread.h"
+#include "common/render_stats.h"
+#include <set>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+BEGIN_YAFARAY
+
+/*! Traversal counters of a thread, registered while the thread is alive and added to
+	the counters of the finished threads when the thread ends */
+class AcceleratorThreadStats final
+{
+	public:
+		AcceleratorThreadStats();
+		~AcceleratorThreadStats();
+		AcceleratorTraversalStats stats_;
+};
+
+static std::mutex thread_stats_mutex_global;
+static std::set<const AcceleratorThreadStats *> thread_stats_global;
+static AcceleratorTraversalStats finished_threads_stats_global;
+
+AcceleratorThreadStats::AcceleratorThreadStats()
+{
+	std::lock_guard<std::mutex> lock_guard(thread_stats_mutex_global);
+	thread_stats_global.insert(this);
+}
+
+AcceleratorThreadStats::~AcceleratorThreadStats()
+{
+	std::lock_guard<std::mutex> lock_guard(thread_stats_mutex_global);
+	finished_threads_stats_global += stats_;
+	thread_stats_global.erase(this);
+}
+
+AcceleratorTraversalStats &AcceleratorTraversalStats::operator += (const AcceleratorTraversalStats &stats)
+{
+	rays_ += stats.rays_;
+	shadow_rays_ += stats.shadow_rays_;
+	nodes_visited_ += stats.nodes_visited_;
+	leaves_visited_ += stats.leaves_visited_;
+	primitive_tests_ += stats.primitive_tests_;
+	shadow_early_outs_ += stats.shadow_early_outs_;
+	return *this;
+}
+
+AcceleratorTraversalStats &AcceleratorTraversalStats::threadStats()
+{
+	thread_local AcceleratorThreadStats thread_stats;
+	return thread_stats.stats_;
+}
+
+AcceleratorTraversalStats AcceleratorTraversalStats::total()
+{
+	std::lock_guard<std::mutex> lock_guard(thread_stats_mutex_global);
+	AcceleratorTraversalStats result = finished_threads_stats_global;
+	for(const auto &thread_stats : thread_stats_global) result += thread_stats->stats_;
+	return result;
+}
+
+void AcceleratorTraversalStats::reset()
+{
+	std::lock_guard<std::mutex> lock_guard(thread_stats_mutex_global);
+	finished_threads_stats_global = {};
+	for(const auto &thread_stats : thread_stats_global) const_cast<AcceleratorThreadStats *>(thread_stats)->stats_ = {};
+}
+
+#ifdef RENDER_STATS
+AcceleratorRayStats::~AcceleratorRayStats()
+{
+	AcceleratorTraversalStats &thread_stats = AcceleratorTraversalStats::threadStats();
+	if(early_out_) ++thread_stats.shadow_early_outs_;
+	thread_stats.nodes_visited_ += nodes_visited_;
+	thread_stats.leaves_visited_ += leaves_visited_;
+	thread_stats.primitive_tests_ += primitive_tests_;
+}
+#endif
+
+//! JSON string literal, with the quotes, backslashes and control characters escaped
+static std::string jsonString_global(const std::string &str)
+{
+	std::stringstream json;
+	json << '"';
+	for(const char c : str)
+	{
+		if(c == '"' || c == '\\') json << '\\' << c;
+		else if(static_cast<unsigned char>(c) < 0x20) json << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+		else json << c;
+	}
+	json << '"';
+	return json.str();
+}
+
+//! JSON number, or null for the NaN and infinite values, which JSON cannot represent
+static std::string jsonNumber_global(double value)
+{
+	if(!std::isfinite(value)) return "null";
+	std::stringstream json;
+	json << value;
+	return json.str();
+}
+
+std::string AcceleratorStats::toJson(bool with_traversal) const
+{
+	std::stringstream json;
+	json << "{\"accelerator\": " << jsonString_global(accelerator_) << ", \"build\": {";
+	for(size_t build_num = 0; build_num < build_.size(); ++build_num)
+	{
+		if(build_num > 0) json << ", ";
+		json << jsonString_global(build_[build_num].first) << ": " << jsonNumber_global(build_[build_num].second);
+	}
+	json << "}";
+	if(!children_.empty())
+	{
+		json << ", \"children\": [";
+		for(size_t child_num = 0; child_num < children_.size(); ++child_num)
+		{
+			if(child_num > 0) json << ", ";
+			json << children_[child_num].toJson(false);
+		}
+		json << "]";
+	}
+	if(with_traversal)
+	{
+		//The ratios of a render without rays are written as null
+		const double num_rays = static_cast<double>(traversal_.rays_ + traversal_.shadow_rays_);
+		json << ", \"traversal\": {";
+		json << "\"rays\": " << traversal_.rays_;
+		json << ", \"shadow_rays\": " << traversal_.shadow_rays_;
+		if(RenderStats::enabled())
+		{
+			json << ", \"nodes_visited\": " << traversal_.nodes_visited_;
+			json << ", \"leaves_visited\": " << traversal_.leaves_visited_;
+			json << ", \"primitive_tests\": " << traversal_.primitive_tests_;
+			json << ", \"shadow_early_outs\": " << traversal_.shadow_early_outs_;
+			json << ", \"nodes_per_ray\": " << jsonNumber_global(traversal_.nodes_visited_ / num_rays);
+			json << ", \"leaves_per_ray\": " << jsonNumber_global(traversal_.leaves_visited_ / num_rays);
+			json << ", \"primitive_tests_per_ray\": " << jsonNumber_global(traversal_.primitive_tests_ / num_rays);
+		}
+		else json << ", \"nodes_visited\": null, \"leaves_visited\": null, \"primitive_tests\": null, \"shadow_early_outs\": null, \"nodes_per_ray\": null, \"leaves_per_ray\": null, \"primitive_tests_per_ray\": null";
+		json << "}";
+	}
+	json << "}";
+	return json.str();
+}
+
+END_YAFARAY
@@ -0,0 +1,332 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "accelerator/accelerator_two_level.h"
+#include "accelerator/accelerator_deferred.h"
+#include "geometry/object.h"
+#include "scene/yafaray/object_deferred.h"
+#include "common/logger.h"
+#include "common/param.h"
+#include <algorithm>
+#include <array>
+#include <map>
+
+BEGIN_YAFARAY
+
+std::unique_ptr<Accelerator> AcceleratorTwoLevel::factory(const std::vector<const Primitive *> &primitives, const std::vector<const Object *> &instances, ParamMap &params)
+{
+	std::unique_ptr<Accelerator> primitives_accelerator;
+	if(!primitives.empty())
+	{
+		ParamMap primitives_params = params;
+		primitives_params["num_primitives"] = static_cast<int>(primitives.size());
+		primitives_accelerator = Accelerator::factory(primitives, primitives_params);
+	}
+	std::vector<std::unique_ptr<Accelerator>> object_accelerators;
+	std::map<const Object *, const Accelerator *> base_object_accelerators;
+	std::shared_ptr<AcceleratorDeferred::Cache> deferred_cache;
+	std::vector<Instance> instances_data;
+	size_t num_instances = 0;
+	for(const auto &instance : instances) num_instances += instance->numInstances();
+	instances_data.reserve(num_instances);
+	for(const auto &instance : instances)
+	{
+		//the deferred objects are instances of themselves
+		const Object *base_object = instance->isDeferred() ? instance : instance->getBaseObject();
+		if(!base_object || instance->numInstances() == 0) continue;
+		auto base_object_accelerator = base_object_accelerators.find(base_object);
+		if(base_object_accelerator == base_object_accelerators.end() && base_object->isDeferred())
+		{
+			if(!deferred_cache)
+			{
+				int budget_mb = 0;
+				params.getParam("deferred_geometry_budget", budget_mb);
+				deferred_cache = std::make_shared<AcceleratorDeferred::Cache>(static_cast<size_t>(std::max(0, budget_mb)) * 1024 * 1024);
+			}
+			object_accelerators.emplace_back(new AcceleratorDeferred(static_cast<const DeferredObject &>(*base_object), params, deferred_cache));
+			base_object_accelerator = base_object_accelerators.insert({base_object, object_accelerators.back().get()}).first;
+		}
+		else if(base_object_accelerator == base_object_accelerators.end())
+		{
+			const std::vector<const Primitive *> base_primitives = base_object->getPrimitives();
+			const Accelerator *accelerator = nullptr;
+			if(!base_primitives.empty())
+			{
+				ParamMap object_params = params;
+				object_params["num_primitives"] = static_cast<int>(base_primitives.size());
+				object_accelerators.emplace_back(Accelerator::factory(base_primitives, object_params));
+				accelerator = object_accelerators.back().get();
+			}
+			base_object_accelerator = base_object_accelerators.insert({base_object, accelerator}).first;
+		}
+		if(!base_object_accelerator->second) continue;
+		for(size_t instance_number = 0; instance_number < instance->numInstances(); ++instance_number)
+		{
+			const Matrix4 *obj_to_world = instance->getInstanceObjToWorldMatrix(instance_number);
+			Matrix4 world_to_obj = *obj_to_world;
+			world_to_obj.inverse();
+			if(world_to_obj.invalid())
+			{
+				Y_WARNING << "TwoLevel: instance of object '" << base_object->getName() << "' has a non-invertible transformation matrix, skipping it" << YENDL;
+				continue;
+			}
+			instances_data.push_back({base_object_accelerator->second, obj_to_world, world_to_obj, instanceBound(base_object_accelerator->second->getBound(), *obj_to_world)});
+		}
+	}
+	Y_INFO << "TwoLevel: " << instances_data.size() << " instances of " << object_accelerators.size() << " base objects, " << primitives.size() << " non-instanced primitives" << YENDL;
+	auto accelerator = std::unique_ptr<Accelerator>(new AcceleratorTwoLevel(std::move(primitives_accelerator), std::move(object_accelerators), std::move(instances_data)));
+	return accelerator;
+}
+
+AcceleratorTwoLevel::AcceleratorTwoLevel(std::unique_ptr<Accelerator> primitives_accelerator, std::vector<std::unique_ptr<Accelerator>> object_accelerators, std::vector<Instance> instances) : primitives_accelerator_(std::move(primitives_accelerator)), object_accelerators_(std::move(object_accelerators)), instances_(std::move(instances))
+{
+	if(!instances_.empty())
+	{
+		nodes_.reserve(2 * instances_.size());
+		buildTree(0, static_cast<uint32_t>(instances_.size()), 0);
+		tree_bound_ = nodes_.front().bound_;
+		if(primitives_accelerator_) tree_bound_ = Bound(tree_bound_, primitives_accelerator_->getBound());
+	}
+	else if(primitives_accelerator_) tree_bound_ = primitives_accelerator_->getBound();
+	memory_tracker_.set(vectorMemory_global(nodes_) + vectorMemory_global(instances_)); //the nested accelerators track their own memory
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "TwoLevel: Top level nodes: " << nodes_.size() << " (" << nodes_.size() * sizeof(Node) / 1024 << " KB)" << YENDL;
+}
+
+AcceleratorStats AcceleratorTwoLevel::getStats() const
+{
+	AcceleratorStats stats;
+	stats.accelerator_ = "two-level";
+	stats.build_ = {
+		{"instances", instances_.size()},
+		{"base_objects", object_accelerators_.size()},
+		{"top_level_nodes", nodes_.size()},
+	};
+	if(primitives_accelerator_) stats.children_.emplace_back(primitives_accelerator_->getStats());
+	for(const auto &object_accelerator : object_accelerators_) stats.children_.emplace_back(object_accelerator->getStats());
+	return stats;
+}
+
+// ============================================================
+/*!
+	recursively build the top level tree splitting the instances at the median
+	of their bound centers along the largest axis. Returns the node index
+*/
+uint32_t AcceleratorTwoLevel::buildTree(uint32_t begin, uint32_t end, int depth)
+{
+	const uint32_t node_id = static_cast<uint32_t>(nodes_.size());
+	nodes_.emplace_back();
+	Bound bound = instances_[begin].bound_;
+	Bound centroid_bound(instances_[begin].bound_.center(), instances_[begin].bound_.center());
+	for(uint32_t instance_num = begin + 1; instance_num < end; ++instance_num)
+	{
+		bound = Bound(bound, instances_[instance_num].bound_);
+		centroid_bound.include(instances_[instance_num].bound_.center());
+	}
+	nodes_[node_id].bound_ = bound;
+	if(end - begin <= max_leaf_size_ || depth >= max_stack_ - 1)
+	{
+		nodes_[node_id].createLeaf(begin, end - begin);
+		return node_id;
+	}
+	const int axis = centroid_bound.largestAxis();
+	const uint32_t middle = (begin + end) / 2;
+	std::nth_element(instances_.begin() + begin, instances_.begin() + middle, instances_.begin() + end, [axis](const Instance &a, const Instance &b) { return a.bound_.center()[axis] < b.bound_.center()[axis]; });
+	nodes_[node_id].createInterior(axis);
+	buildTree(begin, middle, depth + 1);
+	const uint32_t second_child = buildTree(middle, end, depth + 1);
+	nodes_[node_id].setSecondChild(second_child);
+	return node_id;
+}
+
+// ============================================================
+/*!
+	recalculates the instance bounds and inverse matrices after their matrices changed, and then
+	the top level node bounds bottom-up. The children are always stored after their parents,
+	so the nodes are updated in reverse order. The bottom level accelerators are not modified
+*/
+bool AcceleratorTwoLevel::refit()
+{
+	for(auto &instance : instances_)
+	{
+		Matrix4 world_to_obj = *instance.obj_to_world_;
+		world_to_obj.inverse();
+		//Rebuilding skips the non-invertible instances
+		if(world_to_obj.invalid()) return false;
+		instance.world_to_obj_ = world_to_obj;
+		instance.bound_ = instanceBound(instance.accelerator_->getBound(), *instance.obj_to_world_);
+	}
+	for(size_t node_num = nodes_.size(); node_num-- > 0;)
+	{
+		Node &node = nodes_[node_num];
+		if(node.isLeaf())
+		{
+			node.bound_ = instances_[node.getInstancesOffset()].bound_;
+			for(uint32_t instance_num = node.getInstancesOffset() + 1; instance_num < node.getInstancesOffset() + node.getNumInstances(); ++instance_num) node.bound_ = Bound(node.bound_, instances_[instance_num].bound_);
+		}
+		else node.bound_ = Bound(nodes_[node_num + 1].bound_, nodes_[node.getSecondChild()].bound_);
+	}
+	if(!nodes_.empty())
+	{
+		tree_bound_ = nodes_.front().bound_;
+		if(primitives_accelerator_) tree_bound_ = Bound(tree_bound_, primitives_accelerator_->getBound());
+	}
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "TwoLevel: Refitted " << instances_.size() << " instances, " << nodes_.size() << " top level nodes" << YENDL;
+	return true;
+}
+
+Bound AcceleratorTwoLevel::instanceBound(const Bound &object_bound, const Matrix4 &obj_to_world)
+{
+	const Point3 object_corner = obj_to_world * object_bound.a_;
+	Bound world_bound(object_corner, object_corner);
+	for(int corner = 1; corner < 8; ++corner)
+	{
+		const Point3 p { (corner & 1) ? object_bound.g_.x_ : object_bound.a_.x_, (corner & 2) ? object_bound.g_.y_ : object_bound.a_.y_, (corner & 4) ? object_bound.g_.z_ : object_bound.a_.z_ };
+		world_bound.include(obj_to_world * p);
+	}
+	return world_bound;
+}
+
+Ray AcceleratorTwoLevel::objectRay(const Instance &instance, const Ray &ray)
+{
+	//The direction is not normalized after the transformation, so the ray distances are the same in world and object space
+	return { instance.world_to_obj_ * ray.from_, instance.world_to_obj_ * ray.dir_, ray.tmin_, ray.tmax_, ray.time_ };
+}
+
+// ============================================================
+/*!
+	calls instance_func(instance, object_ray) for each instance crossed by the ray, visiting
+	the nearest child first. Stops when instance_func returns true. t_max can be reduced
+	by instance_func during the traversal
+*/
+template <typename InstanceFunc>
+void AcceleratorTwoLevel::traverse(const Ray &ray, const float &t_max, const InstanceFunc &instance_func) const
+{
+	if(nodes_.empty()) return;
+	const std::array<bool, 3> dir_is_negative {{ ray.dir_.x_ < 0.f, ray.dir_.y_ < 0.f, ray.dir_.z_ < 0.f }};
+	std::array<uint32_t, max_stack_> stack;
+	int stack_size = 0;
+	uint32_t node_id = 0;
+	while(true)
+	{
+		const Node &node = nodes_[node_id];
+		if(node.bound_.cross(ray, t_max).crossed_)
+		{
+			if(node.isLeaf())
+			{
+				const uint32_t instances_end = node.getInstancesOffset() + node.getNumInstances();
+				for(uint32_t instance_num = node.getInstancesOffset(); instance_num < instances_end; ++instance_num)
+				{
+					const Instance &instance = instances_[instance_num];
+					if(node.getNumInstances() > 1 && !instance.bound_.cross(ray, t_max).crossed_) continue;
+					if(instance_func(instance, objectRay(instance, ray))) return;
+				}
+			}
+			else
+			{
+				if(dir_is_negative[node.getSplitAxis()])
+				{
+					stack[stack_size++] = node_id + 1;
+					node_id = node.getSecondChild();
+				}
+				else
+				{
+					stack[stack_size++] = node.getSecondChild();
+					node_id = node_id + 1;
+				}
+				continue;
+			}
+		}
+		if(stack_size == 0) break;
+		node_id = stack[--stack_size];
+	}
+}
+
+AcceleratorIntersectData AcceleratorTwoLevel::intersect(const Ray &ray, float t_max) const
+{
+	AcceleratorIntersectData accelerator_intersect_data;
+	if(primitives_accelerator_)
+	{
+		accelerator_intersect_data = primitives_accelerator_->intersect(ray, t_max);
+		if(accelerator_intersect_data.hit_) t_max = accelerator_intersect_data.t_max_;
+	}
+	traverse(ray, t_max, [&](const Instance &instance, const Ray &object_ray) -> bool
+	{
+		const AcceleratorIntersectData instance_intersect_data = instance.accelerator_->intersect(object_ray, t_max);
+		if(instance_intersect_data.hit_ && instance_intersect_data.t_max_ < t_max)
+		{
+			accelerator_intersect_data = instance_intersect_data;
+			accelerator_intersect_data.obj_to_world_ = instance.obj_to_world_;
+			t_max = accelerator_intersect_data.t_max_;
+		}
+		return false;
+	});
+	return accelerator_intersect_data;
+}
+
+AcceleratorIntersectData AcceleratorTwoLevel::intersectS(const Ray &ray, float t_max, float shadow_bias) const
+{
+	if(primitives_accelerator_)
+	{
+		const AcceleratorIntersectData accelerator_intersect_data = primitives_accelerator_->intersectS(ray, t_max, shadow_bias);
+		if(accelerator_intersect_data.hit_) return accelerator_intersect_data;
+	}
+	AcceleratorIntersectData accelerator_intersect_data;
+	traverse(ray, t_max, [&](const Instance &instance, const Ray &object_ray) -> bool
+	{
+		accelerator_intersect_data = instance.accelerator_->intersectS(object_ray, t_max, shadow_bias);
+		accelerator_intersect_data.obj_to_world_ = instance.obj_to_world_;
+		return accelerator_intersect_data.hit_;
+	});
+	return accelerator_intersect_data;
+}
+
+/*=============================================================
+	allow for transparent shadows.
+	The transparency depth limit is applied separately to each instance
+=============================================================*/
+
+AcceleratorTsIntersectData AcceleratorTwoLevel::intersectTs(RenderData &render_data, const Ray &ray, int max_depth, float t_max, float shadow_bias, const Matrix4 *) const
+{
+	AcceleratorTsIntersectData accelerator_intersect_data;
+	if(primitives_accelerator_)
+	{
+		accelerator_intersect_data = primitives_accelerator_->intersectTs(render_data, ray, max_depth, t_max, shadow_bias);
+		if(accelerator_intersect_data.hit_) return accelerator_intersect_data;
+	}
+	Rgb transparent_color = accelerator_intersect_data.transparent_color_;
+	traverse(ray, t_max, [&](const Instance &instance, const Ray &object_ray) -> bool
+	{
+		const AcceleratorTsIntersectData instance_intersect_data = instance.accelerator_->intersectTs(render_data, object_ray, max_depth, t_max, shadow_bias, instance.obj_to_world_);
+		transparent_color *= instance_intersect_data.transparent_color_;
+		if(!instance_intersect_data.hit_)
+		{
+			if(transparent_color.maximum() >= min_transparency_) return false;
+			//The instances crossed so far already block the ray, the rest of them are not evaluated
+			transparent_color = Rgb(0.f);
+			accelerator_intersect_data.hit_ = true;
+			return true;
+		}
+		accelerator_intersect_data = instance_intersect_data;
+		accelerator_intersect_data.obj_to_world_ = instance.obj_to_world_;
+		return true;
+	});
+	accelerator_intersect_data.transparent_color_ = transparent_color;
+	return accelerator_intersect_data;
+}
+
+END_YAFARAY
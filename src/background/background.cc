@@ -45,4 +45,9 @@ std::shared_ptr<Background> Background::factory(ParamMap &params, Scene &scene)
 	else return nullptr;
 }
 
+Rgb Background::evalFiltered(const Ray &ray, float angle) const
+{
+	return eval(ray, true);
+}
+
 END_YAFARAY
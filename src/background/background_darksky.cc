@@ -169,7 +169,13 @@ double DarkSkyBackground::perezFunction(const double *lam, double cos_theta, dou
 
 inline Rgb DarkSkyBackground::getSkyCol(const Ray &ray) const
 {
-	Vec3 iw = ray.dir_;
+	if(sky_table_.isEnabled()) return sky_table_.getColor(ray.dir_);
+	return computeSkyCol(ray.dir_);
+}
+
+Rgb DarkSkyBackground::computeSkyCol(const Vec3 &dir) const
+{
+	Vec3 iw = dir;
 	iw.z_ += alt_;
 	iw.normalize();
 
@@ -251,6 +257,8 @@ std::shared_ptr<Background> DarkSkyBackground::factory(ParamMap &params, Scene &
 	params.getParam("cast_shadows_sun", cast_shadows_sun);
 
 	params.getParam("night", night);
+	int sky_table_resolution = 256;
+	params.getParam("sky_table_resolution", sky_table_resolution);
 
 	ColorConv::ColorSpace color_s = ColorConv::CieRgbECs;
 	if(cs == "CIE (E)") color_s = ColorConv::CieRgbECs;
@@ -265,6 +273,8 @@ std::shared_ptr<Background> DarkSkyBackground::factory(ParamMap &params, Scene &
 	}
 
 	auto dark_sky = std::make_shared<DarkSkyBackground>(DarkSkyBackground(dir, turb, power, bright, clamp, av, bv, cv, dv, ev, altitude, night, exp, gamma_enc, color_s, bgl, caus));
+	const DarkSkyBackground *dark_sky_model = dark_sky.get();
+	dark_sky->sky_table_.bake(sky_table_resolution, [dark_sky_model](const Vec3 &sky_dir) { return dark_sky_model->computeSkyCol(sky_dir); });
 
 	if(add_sun && math::radToDeg(math::acos(dir.z_)) < 100.0)
 	{
@@ -118,7 +118,13 @@ double SunSkyBackground::angleBetween(double thetav, double phiv) const
 
 inline Rgb SunSkyBackground::getSkyCol(const Ray &ray) const
 {
-	Vec3 iw = ray.dir_;
+	if(sky_table_.isEnabled()) return sky_table_.getColor(ray.dir_);
+	return computeSkyCol(ray.dir_);
+}
+
+Rgb SunSkyBackground::computeSkyCol(const Vec3 &dir) const
+{
+	Vec3 iw = dir;
 	iw.normalize();
 	double hfade = 1, nfade = 1;
 
@@ -217,8 +223,12 @@ std::shared_ptr<Background> SunSkyBackground::factory(ParamMap &params, Scene &s
 
 	params.getParam("with_caustic", caus);
 	params.getParam("with_diffuse", diff);
+	int sky_table_resolution = 256;
+	params.getParam("sky_table_resolution", sky_table_resolution);
 
 	auto new_sunsky = std::make_shared<SunSkyBackground>(SunSkyBackground(dir, turb, av, bv, cv, dv, ev, power, bgl, true));
+	const SunSkyBackground *sunsky = new_sunsky.get();
+	new_sunsky->sky_table_.bake(sky_table_resolution, [sunsky](const Vec3 &sky_dir) { return sunsky->computeSkyCol(sky_dir); });
 
 	if(bgl)
 	{
@@ -20,16 +20,21 @@
 
 #include "background/background_texture.h"
 #include "common/logger.h"
-#include "texture/texture.h"
+#include "texture/texture_image.h"
 #include "common/param.h"
 #include "scene/scene.h"
 #include "light/light.h"
 #include "output/output.h"
+#include "photon/photon_maps_state.h"
+#include "background/prefiltered_environment.h"
+#include "common/session.h"
 
 BEGIN_YAFARAY
 
-TextureBackground::TextureBackground(const Texture *texture, Projection proj, float bpower, float rot, bool ibl, float ibl_blur, bool with_caustic):
-		tex_(texture), project_(proj), power_(bpower), ibl_blur_mipmap_level_(math::pow(ibl_blur, 2.f))
+static constexpr size_t max_cached_prefiltered_global = 4;
+
+TextureBackground::TextureBackground(const Texture *texture, Projection proj, float bpower, float rot, bool ibl, float ibl_blur, bool with_caustic, int prefilter_resolution, int prefilter_levels):
+		tex_(texture), project_(proj), power_(bpower), ibl_blur_(ibl_blur), ibl_blur_mipmap_level_(math::pow(ibl_blur, 2.f)), prefilter_resolution_(prefilter_resolution), prefilter_levels_(prefilter_levels)
 {
 	with_ibl_ = ibl;
 	shoot_caustic_ = with_caustic;
@@ -45,6 +50,93 @@ Rgb TextureBackground::operator()(const Ray &ray, RenderData &render_data, bool
 }
 
 Rgb TextureBackground::eval(const Ray &ray, bool use_ibl_blur) const
+{
+	if(!use_ibl_blur || ibl_blur_ <= 0.f) return evalTexture(ray, nullptr);
+	if(!prefiltered_ || !prefiltered_->hasRadiance())
+	{
+		const MipMapParams mipmap_params(ibl_blur_mipmap_level_);
+		return evalTexture(ray, &mipmap_params);
+	}
+	//The IBL blur is used as the GGX roughness, below the first prefiltered level it is interpolated with the texture itself
+	const float min_roughness = prefiltered_->getMinRoughness();
+	if(ibl_blur_ >= min_roughness) return prefiltered_->getRadiance(ray.dir_, ibl_blur_);
+	const Rgb col = evalTexture(ray, nullptr);
+	return col + (ibl_blur_ / min_roughness) * (prefiltered_->getRadiance(ray.dir_, min_roughness) - col);
+}
+
+bool TextureBackground::evalIrradiance(const Vec3 &normal, Rgb &irradiance) const
+{
+	if(!prefiltered_) return false;
+	irradiance = prefiltered_->getIrradiance(normal);
+	return true;
+}
+
+void TextureBackground::init(Scene &scene)
+{
+	const int num_levels = (ibl_blur_ > 0.f && prefilter_resolution_ > 0) ? prefilter_levels_ : 0;
+	uint64_t key = getDistributionKey();
+	if(key != 0)
+	{
+		key = PhotonMapsState::hashCombine(key, static_cast<uint64_t>(num_levels > 0 ? prefilter_resolution_ : 0));
+		key = PhotonMapsState::hashCombine(key, static_cast<uint64_t>(num_levels));
+	}
+	prefiltered_ = nullptr;
+	if(key != 0)
+	{
+		std::lock_guard<std::mutex> lock_guard(scene.getSession().mutx_);
+		const auto cached = scene.getSession().prefiltered_environments_.find(key);
+		if(cached != scene.getSession().prefiltered_environments_.end()) prefiltered_ = cached->second;
+	}
+	if(prefiltered_)
+	{
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "TextureBackground: prefiltered background reused from the previous render" << YENDL;
+		return;
+	}
+	prefiltered_ = std::make_shared<const PrefilteredEnvironment>([this](const Vec3 &dir, float angle) { return evalFiltered(Ray(Point3(0.f), dir), angle); }, prefilter_resolution_, num_levels, scene.getNumThreads());
+	if(key != 0)
+	{
+		std::lock_guard<std::mutex> lock_guard(scene.getSession().mutx_);
+		auto &prefiltered_environments = scene.getSession().prefiltered_environments_;
+		if(prefiltered_environments.size() >= max_cached_prefiltered_global) prefiltered_environments.erase(prefiltered_environments.begin());
+		prefiltered_environments[key] = prefiltered_;
+	}
+}
+
+Rgb TextureBackground::evalFiltered(const Ray &ray, float angle) const
+{
+	int width, height, depth;
+	tex_->resolution(width, height, depth);
+	const int max_size = std::max(width, height);
+	if(max_size <= 1) return evalTexture(ray, nullptr);
+	const float texel_angle = (project_ == Angular) ? math::mult_pi_by_2 / width : M_PI / height;
+	if(angle <= texel_angle) return evalTexture(ray, nullptr);
+	//The mipmaps halve the size down to 1x1, the forced level goes from 0 (the image) to 1 (the last mipmap)
+	const float num_mipmaps = std::ceil(math::log2(static_cast<float>(max_size)));
+	const MipMapParams mipmap_params(std::min(1.f, math::log2(angle / texel_angle) / num_mipmaps));
+	return evalTexture(ray, &mipmap_params);
+}
+
+uint64_t TextureBackground::getDistributionKey() const
+{
+	const std::string images_key = tex_->getImagesKey();
+	if(images_key.empty()) return 0;
+	uint64_t key = PhotonMapsState::hashCombine(static_cast<uint64_t>(std::hash<std::string>{}(images_key)), static_cast<uint64_t>(project_));
+	key = PhotonMapsState::hashCombine(key, rotation_);
+	key = PhotonMapsState::hashCombine(key, power_);
+	constexpr int num_texels = 64;
+	Ray ray(Point3(0.f), Vec3(0.f));
+	for(int i = 0; i < num_texels; ++i)
+	{
+		invSpheremap_global(std::fmod(i * 0.618034f, 1.f), (i + 0.5f) / num_texels, ray.dir_);
+		const Rgb col = evalTexture(ray, nullptr);
+		key = PhotonMapsState::hashCombine(key, col.r_);
+		key = PhotonMapsState::hashCombine(key, col.g_);
+		key = PhotonMapsState::hashCombine(key, col.b_);
+	}
+	return key == 0 ? 1 : key;
+}
+
+Rgb TextureBackground::evalTexture(const Ray &ray, const MipMapParams *mipmap_params) const
 {
 	float u = 0.f, v = 0.f;
 	if(project_ == Angular)
@@ -64,12 +156,7 @@ Rgb TextureBackground::eval(const Ray &ray, bool use_ibl_blur) const
 		if(u > 1.f) u -= 2.f;
 	}
 
-	Rgb ret;
-	if(use_ibl_blur)
-	{
-		ret = tex_->getColor(Point3(u, v, 0.f)); //FIXME!
-	}
-	else ret = tex_->getColor(Point3(u, v, 0.f));
+	Rgb ret = tex_->getColor(Point3(u, v, 0.f), mipmap_params);
 
 	const float min_component = 1.0e-5f;
 	if(ret.r_ < min_component) ret.r_ = min_component;
@@ -92,6 +179,8 @@ std::shared_ptr<Background> TextureBackground::factory(ParamMap &params, Scene &
 	bool caust = true;
 	bool diffuse = true;
 	bool cast_shadows = true;
+	int prefilter_resolution = 64;
+	int prefilter_levels = 5;
 
 	if(!params.getParam("texture", texname))
 	{
@@ -117,8 +206,10 @@ std::shared_ptr<Background> TextureBackground::factory(ParamMap &params, Scene &
 	params.getParam("with_caustic", caust);
 	params.getParam("with_diffuse", diffuse);
 	params.getParam("cast_shadows", cast_shadows);
+	params.getParam("ibl_prefilter_resolution", prefilter_resolution);
+	params.getParam("ibl_prefilter_levels", prefilter_levels);
 
-	auto tex_bg = std::make_shared<TextureBackground>(TextureBackground(tex, pr, power, rot, ibl, ibl_blur, caust));
+	auto tex_bg = std::make_shared<TextureBackground>(TextureBackground(tex, pr, power, rot, ibl, ibl_blur, caust, std::max(0, prefilter_resolution), std::max(1, prefilter_levels)));
 
 	if(ibl)
 	{
@@ -133,8 +224,9 @@ std::shared_ptr<Background> TextureBackground::factory(ParamMap &params, Scene &
 		if(ibl_blur > 0.f)
 		{
 			Y_INFO << "TextureBackground: starting background SmartIBL blurring with IBL Blur factor=" << ibl_blur << YENDL;
+			//The mipmaps are also read by the prefiltering, so each of its samples averages the texels of its solid angle
 			tex->generateMipMaps();
-			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "TextureBackground: background SmartIBL blurring done using mipmaps." << YENDL;
+			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "TextureBackground: background SmartIBL blurring done using " << (prefilter_resolution > 0 ? "prefiltered GGX levels." : "mipmaps.") << YENDL;
 		}
 
 		Light *bglight = scene.createLight("textureBackground_bgLight", bgp);
@@ -0,0 +1,143 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "background/prefiltered_environment.h"
+#include "common/logger.h"
+#include "common/task_pool.h"
+#include "sampler/sample.h"
+#include "texture/texture.h"
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+//! real spherical harmonics up to order 2 for a normalized direction
+static void shBasis_global(const Vec3 &dir, float basis[9])
+{
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * dir.y_;
+	basis[2] = 0.488603f * dir.z_;
+	basis[3] = 0.488603f * dir.x_;
+	basis[4] = 1.092548f * dir.x_ * dir.y_;
+	basis[5] = 1.092548f * dir.y_ * dir.z_;
+	basis[6] = 0.315392f * (3.f * dir.z_ * dir.z_ - 1.f);
+	basis[7] = 1.092548f * dir.x_ * dir.z_;
+	basis[8] = 0.546274f * (dir.x_ * dir.x_ - dir.y_ * dir.y_);
+}
+
+PrefilteredEnvironment::PrefilteredEnvironment(const RadianceFunction &radiance, int resolution, int num_levels, int num_threads)
+{
+	TaskPool task_pool(num_threads);
+	projectIrradiance(radiance, task_pool);
+	if(resolution <= 0 || num_levels <= 0) return;
+	levels_.resize(num_levels);
+	for(int level = 0; level < num_levels; ++level)
+	{
+		const float roughness = static_cast<float>(level + 1) / num_levels;
+		//The rougher levels are smoother, so each one has half the resolution of the previous one
+		const int level_resolution = std::max(8, resolution >> level);
+		const float texel_angle = M_PI / level_resolution;
+		levels_[level].bake(level_resolution, [&](const Vec3 &dir) { return convolveGgx(radiance, dir, roughness, texel_angle); }, &task_pool);
+	}
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "PrefilteredEnvironment: " << num_levels << " GGX levels from " << levels_.front().getHeight() << " rows prefiltered" << YENDL;
+}
+
+Rgb PrefilteredEnvironment::convolveGgx(const RadianceFunction &radiance, const Vec3 &dir, float roughness, float min_angle)
+{
+	//The view and reflected directions are assumed to be the normal, so the lobe only depends on the direction and can be tabulated (Karis 2013)
+	constexpr int num_samples = 32;
+	const float alpha_2 = std::max(1.0e-4f, roughness * roughness * roughness * roughness);
+	Vec3 u, v;
+	Vec3::createCs(dir, u, v);
+	Rgb sum(0.f);
+	float weight_sum = 0.f;
+	for(int i = 0; i < num_samples; ++i)
+	{
+		const float s_1 = (i + 0.5f) / num_samples;
+		const float s_2 = sample::riVdC(static_cast<unsigned int>(i));
+		const float cos_h_2 = (1.f - s_1) / (1.f + (alpha_2 - 1.f) * s_1);
+		const float cos_h = math::sqrt(cos_h_2);
+		const float sin_h = math::sqrt(std::max(0.f, 1.f - cos_h_2));
+		const float phi = math::mult_pi_by_2 * s_2;
+		const Vec3 half = sin_h * math::cos(phi) * u + sin_h * math::sin(phi) * v + cos_h * dir;
+		const Vec3 light = 2.f * cos_h * half - dir;
+		const float cos_l = light * dir;
+		if(cos_l <= 0.f) continue;
+		//The pdf of the light direction is D / 4 with the view along the normal. Each sample reads the environment averaged over its share of the lobe solid angle
+		const float d_denominator = cos_h_2 * (alpha_2 - 1.f) + 1.f;
+		const float pdf = alpha_2 / (4.f * M_PI * d_denominator * d_denominator);
+		const float angle = std::max(min_angle, math::sqrt(1.f / (num_samples * pdf)));
+		sum += cos_l * radiance(light, angle);
+		weight_sum += cos_l;
+	}
+	return weight_sum > 0.f ? sum / weight_sum : radiance(dir, min_angle);
+}
+
+void PrefilteredEnvironment::projectIrradiance(const RadianceFunction &radiance, TaskPool &task_pool)
+{
+	constexpr int height = 32;
+	constexpr int width = 2 * height;
+	const float cell_angle = M_PI / height;
+	const float cell_solid_angle = cell_angle * (math::mult_pi_by_2 / width);
+	std::vector<std::array<Rgb, 9>> row_sums(height);
+	parallelFor_global(&task_pool, height, [&](size_t begin, size_t end)
+	{
+		Vec3 dir;
+		float basis[9];
+		for(size_t y = begin; y < end; ++y)
+		{
+			row_sums[y].fill(Rgb(0.f));
+			const float v = (y + 0.5f) / height;
+			const float solid_angle = cell_solid_angle * math::sin(v * M_PI);
+			for(int x = 0; x < width; ++x)
+			{
+				invSpheremap_global((x + 0.5f) / width, v, dir);
+				const Rgb col = solid_angle * radiance(dir, cell_angle);
+				shBasis_global(dir, basis);
+				for(int i = 0; i < 9; ++i) row_sums[y][i] += basis[i] * col;
+			}
+		}
+	}, 1);
+	irradiance_sh_.fill(Rgb(0.f));
+	for(const auto &row_sum : row_sums) for(int i = 0; i < 9; ++i) irradiance_sh_[i] += row_sum[i];
+	//Convolution with the clamped cosine for each band (pi, 2pi/3 and pi/4), divided by pi
+	const float band_factors[3] = { 1.f, 2.f / 3.f, 0.25f };
+	for(int i = 0; i < 9; ++i) irradiance_sh_[i] *= band_factors[i == 0 ? 0 : (i < 4 ? 1 : 2)];
+}
+
+Rgb PrefilteredEnvironment::getRadiance(const Vec3 &dir, float roughness) const
+{
+	const int num_levels = static_cast<int>(levels_.size());
+	const float position = std::max(0.f, std::min(roughness * num_levels - 1.f, static_cast<float>(num_levels - 1)));
+	const int level = std::min(static_cast<int>(position), num_levels - 1);
+	const Rgb col = levels_[level].getColor(dir);
+	if(level + 1 == num_levels) return col;
+	const float t = position - level;
+	return t > 0.f ? col + t * (levels_[level + 1].getColor(dir) - col) : col;
+}
+
+Rgb PrefilteredEnvironment::getIrradiance(const Vec3 &normal) const
+{
+	float basis[9];
+	shBasis_global(normal, basis);
+	Rgb irradiance(0.f);
+	for(int i = 0; i < 9; ++i) irradiance += basis[i] * irradiance_sh_[i];
+	irradiance.clampRgb0();
+	return irradiance;
+}
+
+END_YAFARAY
@@ -0,0 +1,77 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "background/sky_table.h"
+#include "common/logger.h"
+#include "texture/texture.h"
+#include "common/task_pool.h"
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+constexpr int SkyTable::max_resolution_;
+
+void SkyTable::bake(int resolution, const std::function<Rgb(const Vec3 &dir)> &function, TaskPool *task_pool)
+{
+	colors_.clear();
+	if(resolution <= 0) return;
+	if(resolution > max_resolution_)
+	{
+		Y_WARNING << "SkyTable: resolution " << resolution << " too big, using " << max_resolution_ << " instead" << YENDL;
+		resolution = max_resolution_;
+	}
+	height_ = std::max(resolution, 2);
+	width_ = 2 * height_;
+	colors_.resize(static_cast<size_t>(width_) * height_);
+	const float inv_width = 1.f / width_;
+	const float inv_height = 1.f / height_;
+	parallelFor_global(task_pool, static_cast<size_t>(height_), [&](size_t begin, size_t end)
+	{
+		Vec3 dir;
+		for(size_t y = begin; y < end; ++y)
+		{
+			const float v = (y + 0.5f) * inv_height;
+			for(int x = 0; x < width_; ++x)
+			{
+				invSpheremap_global((x + 0.5f) * inv_width, v, dir);
+				colors_[y * width_ + x] = function(dir);
+			}
+		}
+	}, 1);
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "SkyTable: baked " << width_ << "x" << height_ << " texels" << YENDL;
+}
+
+Rgb SkyTable::getColor(const Vec3 &dir) const
+{
+	float u, v;
+	spheremap_global(dir, u, v);
+	float fx = u * width_ - 0.5f;
+	if(fx < 0.f) fx += width_;
+	const float fy = std::max(0.f, std::min(v * height_ - 0.5f, static_cast<float>(height_ - 1)));
+	const int x_0 = std::min(static_cast<int>(fx), width_ - 1);
+	const int y_0 = std::min(static_cast<int>(fy), height_ - 2);
+	const int x_1 = (x_0 + 1 == width_) ? 0 : x_0 + 1;
+	const float tx = fx - x_0, ty = fy - y_0;
+	const Rgb *row_0 = &colors_[static_cast<size_t>(y_0) * width_];
+	const Rgb *row_1 = row_0 + width_;
+	const Rgb col_0 = row_0[x_0] + tx * (row_0[x_1] - row_0[x_0]);
+	const Rgb col_1 = row_1[x_0] + tx * (row_1[x_1] - row_1[x_0]);
+	return col_0 + ty * (col_1 - col_0);
+}
+
+END_YAFARAY
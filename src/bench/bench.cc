@@ -0,0 +1,277 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "yafaray_config.h"
+#include "common/param.h"
+#include "common/session.h"
+#include "common/file.h"
+#include "scene/scene.h"
+#include "accelerator/accelerator_stats.h"
+#include "common/memory_stats.h"
+#include "import/import_xml.h"
+#include "render/imagefilm.h"
+#include "common/console.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifdef WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace::yafaray4;
+
+struct BenchResult
+{
+	std::string scene_;
+	bool success_ = false;
+	double setup_seconds_ = 0.0; //!< XML parsing and scene setup
+	Scene::RenderTimes render_times_;
+	uint64_t rays_ = 0;
+	uint64_t camera_samples_ = 0;
+	double peak_rss_mb_ = 0.0;
+	std::string memory_stats_; //!< tracked memory of each subsystem, as JSON
+	std::vector<ImageFilm::ConvergencePass> convergence_; //!< only when the scene has a reference image
+};
+
+//! Options of the convergence mode, which renders the scenes progressively and measures the error of each pass
+struct ConvergenceOptions
+{
+	int passes_ = 0; //!< overrides the AA passes of the XML files if greater than 0
+	double rel_mse_threshold_ = 0.01;
+};
+
+//! peak resident memory of the process, so with several scenes it is the maximum of the scenes rendered so far
+double peakRssMb_global()
+{
+#ifdef WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0.0;
+	return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+#ifdef __APPLE__
+	return usage.ru_maxrss / (1024.0 * 1024.0); //in bytes
+#else
+	return usage.ru_maxrss / 1024.0; //in kilobytes
+#endif
+#endif
+}
+
+std::string jsonEscape_global(const std::string &str)
+{
+	std::string escaped;
+	for(const char c : str)
+	{
+		if(c == '"' || c == '\\') escaped += '\\';
+		escaped += c;
+	}
+	return escaped;
+}
+
+BenchResult renderScene_global(const std::string &xml_file_path, const std::string &reference_path, int threads, const ConvergenceOptions &convergence_options)
+{
+	BenchResult result;
+	result.scene_ = Path(xml_file_path).getBaseName();
+	ParamMap params;
+	const auto setup_start = std::chrono::steady_clock::now();
+	std::unique_ptr<Scene> scene = parseXmlFile_global(xml_file_path.c_str(), params, "LinearRGB", 1.f);
+	if(!scene) return result;
+	if(threads >= -1) params["threads"] = threads;
+	params["logging_save_txt"] = false;
+	params["logging_save_html"] = false;
+	if(!reference_path.empty())
+	{
+		params["convergence_reference"] = reference_path;
+		if(convergence_options.passes_ > 0) params["AA_passes"] = convergence_options.passes_;
+	}
+	if(!scene->setupScene(*scene, params)) return result;
+	const std::chrono::duration<double> setup_seconds = std::chrono::steady_clock::now() - setup_start;
+	result.setup_seconds_ = setup_seconds.count();
+	scene->getSession().setInteractive(false);
+	scene->render();
+	result.success_ = !scene->getRenderControl().aborted();
+	result.render_times_ = scene->getRenderTimes();
+	const AcceleratorStats accelerator_stats = scene->getAcceleratorStats();
+	result.rays_ = accelerator_stats.traversal_.rays_ + accelerator_stats.traversal_.shadow_rays_;
+	result.camera_samples_ = scene->getNumCameraSamples();
+	result.memory_stats_ = MemoryStats::toJson();
+	if(scene->getImageFilm()) result.convergence_ = scene->getImageFilm()->getConvergence();
+	scene->clearAll();
+	result.peak_rss_mb_ = peakRssMb_global();
+	return result;
+}
+
+/*! Writes the error of each pass with the time including the preprocessing, as the photon integrators spend part of
+ * their time there. The efficiency is 1 / (relMSE * time) at the last pass, so it does not depend on the number of passes
+ * for a converging integrator, and the time to threshold is the time of the first pass with a relMSE below the threshold */
+void convergenceToJson_global(std::stringstream &ss, const BenchResult &r, double rel_mse_threshold)
+{
+	double time_to_threshold = -1.0;
+	ss << ",\"convergence\":[";
+	for(size_t i = 0; i < r.convergence_.size(); ++i)
+	{
+		const ImageFilm::ConvergencePass &pass = r.convergence_[i];
+		const double seconds = r.render_times_.preprocess_ + pass.seconds_;
+		if(time_to_threshold < 0.0 && pass.rel_mse_ <= rel_mse_threshold) time_to_threshold = seconds;
+		if(i > 0) ss << ",";
+		ss << "{\"pass\":" << pass.pass_ << ",\"seconds\":" << seconds << ",\"rmse\":" << pass.rmse_ << ",\"rel_mse\":" << pass.rel_mse_ << "}";
+	}
+	ss << "]";
+	const ImageFilm::ConvergencePass &last_pass = r.convergence_.back();
+	const double last_seconds = r.render_times_.preprocess_ + last_pass.seconds_;
+	ss << ",\"rel_mse_threshold\":" << rel_mse_threshold;
+	if(time_to_threshold >= 0.0) ss << ",\"time_to_threshold\":" << time_to_threshold;
+	else ss << ",\"time_to_threshold\":null";
+	if(last_pass.rel_mse_ > 0.0 && last_seconds > 0.0) ss << ",\"efficiency\":" << 1.0 / (last_pass.rel_mse_ * last_seconds);
+	else ss << ",\"efficiency\":null";
+}
+
+std::string toJson_global(const std::vector<BenchResult> &results, int threads, const ConvergenceOptions &convergence_options)
+{
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(4);
+	ss << "{\"version\":\"" << jsonEscape_global(YAFARAY_BUILD_VERSION) << "\"";
+	if(threads >= -1) ss << ",\"threads\":" << threads; //otherwise the threads of each XML file
+	ss << ",\"scenes\":[";
+	for(size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchResult &r = results[i];
+		//The rays include the photon and preprocess rays, so they are divided by the preprocess and render time
+		const double trace_seconds = r.render_times_.preprocess_ + r.render_times_.render_;
+		const double mrays_per_second = trace_seconds > 0.0 ? r.rays_ / trace_seconds * 1e-6 : 0.0;
+		const double samples_per_second = r.render_times_.render_ > 0.0 ? r.camera_samples_ / r.render_times_.render_ : 0.0;
+		if(i > 0) ss << ",";
+		ss << "{\"scene\":\"" << jsonEscape_global(r.scene_) << "\",\"success\":" << (r.success_ ? "true" : "false");
+		ss << ",\"setup_seconds\":" << r.setup_seconds_;
+		ss << ",\"textures_seconds\":" << r.render_times_.textures_;
+		ss << ",\"build_seconds\":" << r.render_times_.accelerator_build_;
+		ss << ",\"preprocess_seconds\":" << r.render_times_.preprocess_;
+		ss << ",\"render_seconds\":" << r.render_times_.render_;
+		ss << ",\"output_seconds\":" << r.render_times_.output_;
+		ss << ",\"rays\":" << r.rays_ << ",\"mrays_per_second\":" << mrays_per_second;
+		ss << ",\"camera_samples\":" << r.camera_samples_ << ",\"samples_per_second\":" << samples_per_second;
+		ss << ",\"peak_rss_mb\":" << r.peak_rss_mb_;
+		if(!r.memory_stats_.empty()) ss << ",\"memory\":" << r.memory_stats_;
+		if(!r.convergence_.empty()) convergenceToJson_global(ss, r, convergence_options.rel_mse_threshold_);
+		ss << "}";
+	}
+	ss << "]}";
+	return ss.str();
+}
+
+/*! Renders the scenes of a scene list, normally the scenes generated by tests/bench/generate_scenes.py, and writes
+ * the setup, accelerator build and render times, the ray and sample rates and the peak memory of each scene as JSON,
+ * to compare the performance of different builds or machines.
+ * The scenes with a reference image are rendered in the convergence mode, to compare integrators and samplers at equal
+ * noise instead of at equal samples: the error against the reference is measured after each pass */
+int main(int argc, char *argv[])
+{
+	CliParser parse(argc, argv, 1, 0, "You need to set the scene list file.");
+
+	parse.setAppName("YafaRay benchmark",
+					 "[OPTIONS]... <scene list file>\n<scene list file> : text file with one XML scene file per line, optionally followed by a reference image file of the converged render, paths relative to the list file directory");
+
+	parse.setOption("vl", "verbosity-level", false, "Set console verbosity level, options are the same as for yafaray-xml (default \"warning\")\n");
+	parse.setOption("t", "threads", false, "Overrides threads setting on the XML files, for auto selection use -1.");
+	parse.setOption("o", "output", false, "JSON results file, by default the results are only printed.");
+	parse.setOption("p", "passes", false, "Overrides the AA passes of the XML files of the scenes with a reference image.");
+	parse.setOption("ct", "convergence-threshold", false, "relMSE of the time to threshold of the scenes with a reference image (default 0.01).");
+	parse.setOption("v", "version", true, "Displays this program's version.");
+	parse.setOption("h", "help", true, "Displays this help text.");
+
+	const bool parse_ok = parse.parseCommandLine();
+
+	if(parse.getFlag("h"))
+	{
+		parse.printUsage();
+		return 0;
+	}
+
+	if(parse.getFlag("v"))
+	{
+		Y_INFO << "YafaRay benchmark" << YENDL << "Built with YafaRay Core version " << YAFARAY_BUILD_VERSION << YENDL;
+		return 0;
+	}
+
+	if(!parse_ok)
+	{
+		parse.printError();
+		parse.printUsage();
+		return 1;
+	}
+
+	const std::string verb_level = parse.getOptionString("vl");
+	logger_global.setConsoleMasterVerbosity(verb_level.empty() ? "warning" : verb_level);
+	logger_global.setLogMasterVerbosity("mute");
+
+	const std::vector<std::string> files = parse.getCleanArgs();
+	if(files.empty()) return 1;
+	const int threads = parse.getOptionInteger("t");
+	ConvergenceOptions convergence_options;
+	convergence_options.passes_ = parse.getOptionInteger("p");
+	const std::string threshold_string = parse.getOptionString("ct");
+	if(!threshold_string.empty()) convergence_options.rel_mse_threshold_ = atof(threshold_string.c_str());
+
+	std::ifstream scene_list(files.at(0));
+	if(!scene_list.is_open())
+	{
+		Y_ERROR << "Benchmark: Couldn't open the scene list file '" << files.at(0) << "'" << YENDL;
+		return 1;
+	}
+	const std::string scenes_dir = Path(files.at(0)).getDirectory();
+	std::vector<BenchResult> results;
+	std::string line;
+	while(std::getline(scene_list, line))
+	{
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		line.erase(0, line.find_first_not_of(" \t"));
+		if(line.empty() || line[0] == '#') continue;
+		std::string xml_file, reference_file;
+		std::stringstream(line) >> xml_file >> reference_file;
+		const auto list_path = [&scenes_dir](const std::string &path) { return (path.empty() || scenes_dir.empty() || path[0] == '/') ? path : scenes_dir + "/" + path; };
+		const std::string xml_file_path = list_path(xml_file);
+		results.push_back(renderScene_global(xml_file_path, list_path(reference_file), threads, convergence_options));
+		const BenchResult &r = results.back();
+		if(!r.success_) Y_ERROR << "Benchmark: The scene '" << xml_file_path << "' could not be rendered" << YENDL;
+		else Y_INFO << "Benchmark: " << r.scene_ << ": setup " << r.setup_seconds_ << "s, build " << r.render_times_.accelerator_build_ << "s, render " << r.render_times_.render_ << "s" << YENDL;
+	}
+
+	const std::string json = toJson_global(results, threads, convergence_options);
+	const std::string output_path = parse.getOptionString("o");
+	if(output_path.empty()) std::cout << json << std::endl;
+	else
+	{
+		std::ofstream output(output_path);
+		output << json << std::endl;
+		if(!output)
+		{
+			Y_ERROR << "Benchmark: Couldn't write the results file '" << output_path << "'" << YENDL;
+			return 1;
+		}
+		Y_INFO << "Benchmark: Results saved to '" << output_path << "'" << YENDL;
+	}
+	for(const auto &r : results) if(!r.success_) return 1;
+	return 0;
+}
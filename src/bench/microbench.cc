@@ -0,0 +1,559 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "yafaray_config.h"
+#include "common/param.h"
+#include "common/logger.h"
+#include "common/console.h"
+#include "scene/scene.h"
+#include "geometry/object.h"
+#include "geometry/primitive.h"
+#include "geometry/surface.h"
+#include "accelerator/accelerator.h"
+#include "material/material.h"
+#include "texture/texture_image.h"
+#include "render/imagefilm.h"
+#include "render/imagesplitter.h"
+#include "render/render_data.h"
+#include "color/color_layers.h"
+#include "photon/photon.h"
+#include "photon/hashgrid.h"
+#include "math/random.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace::yafaray4;
+
+/*! A kernel runs its operation the given number of times over canned inputs, and returns a value depending on all the
+ * results so the compiler cannot discard the work. The inputs are created once per group, the first time one of its kernels runs */
+struct Kernel
+{
+	std::string name_;
+	std::function<double(size_t num_operations)> run_;
+};
+
+struct KernelResult
+{
+	std::string name_;
+	size_t operations_ = 0; //!< per repetition
+	double min_ns_ = 0.0; //!< nanoseconds per operation of the fastest and median repetitions
+	double median_ns_ = 0.0;
+};
+
+std::string texture_file_global = YAFARAY_MICROBENCH_TEXTURE_FILE;
+volatile double results_sink_global = 0.0;
+
+Vec3 randomDirection_global(Random &prng)
+{
+	const float z = 1.f - 2.f * prng();
+	const float r = std::sqrt(std::max(0.f, 1.f - z * z));
+	const float phi = 2.f * M_PI * prng();
+	return {r * std::cos(phi), r * std::sin(phi), z};
+}
+
+/*! Bumpy sphere mesh of about 130k triangles with its accelerators, and canned rays towards random points of the mesh
+ * bound, half of them hitting the mesh. The surface points of the hits are the inputs of the material kernels */
+struct GeometryFixture
+{
+	GeometryFixture();
+	std::unique_ptr<Scene> scene_;
+	std::vector<const Primitive *> primitives_;
+	std::vector<std::pair<std::string, std::unique_ptr<Accelerator>>> accelerators_;
+	std::vector<Ray> rays_;
+	std::vector<Ray> triangle_rays_; //!< one ray towards the center of each of the first triangles of the mesh
+	std::vector<SurfacePoint> surface_points_;
+	std::vector<std::pair<std::string, const Material *>> materials_;
+	static constexpr int rings_ = 256;
+	static constexpr int segments_ = 256;
+	static constexpr size_t num_rays_ = 1 << 16;
+};
+
+GeometryFixture::GeometryFixture()
+{
+	ParamMap scene_params;
+	scene_params["type"] = std::string("yafaray");
+	scene_ = Scene::factory(scene_params);
+
+	const std::vector<std::pair<std::string, ParamMap>> material_params {
+		{"shinydiffusemat", {}}, {"glossy", {}}, {"coated_glossy", {}}, {"glass", {}}, {"rough_glass", {}}, {"mirror", {}}
+	};
+	for(const auto &it : material_params)
+	{
+		ParamMap params = it.second;
+		params["type"] = it.first;
+		params["color"] = Rgb(0.8f, 0.6f, 0.4f);
+		params["diffuse_color"] = Rgb(0.5f, 0.5f, 0.5f);
+		std::list<ParamMap> eparams;
+		const Material *material = scene_->createMaterial(it.first, params, eparams);
+		if(material) materials_.push_back({it.first, material});
+	}
+
+	scene_->startObjects();
+	ParamMap object_params;
+	object_params["type"] = std::string("mesh");
+	object_params["num_vertices"] = (rings_ + 1) * segments_;
+	object_params["num_faces"] = 2 * rings_ * segments_;
+	scene_->createObject("mesh", object_params);
+	scene_->setCurrentMaterial(materials_.empty() ? nullptr : materials_.front().second);
+	for(int ring = 0; ring <= rings_; ++ring)
+	{
+		const float theta = M_PI * ring / rings_;
+		for(int segment = 0; segment < segments_; ++segment)
+		{
+			const float phi = 2.f * M_PI * segment / segments_;
+			const float radius = 1.f + 0.05f * std::sin(13.f * theta) * std::cos(17.f * phi);
+			scene_->addVertex({radius * std::sin(theta) * std::cos(phi), radius * std::sin(theta) * std::sin(phi), radius * std::cos(theta)});
+		}
+	}
+	for(int ring = 0; ring < rings_; ++ring)
+	{
+		for(int segment = 0; segment < segments_; ++segment)
+		{
+			const int a = ring * segments_ + segment, b = ring * segments_ + (segment + 1) % segments_;
+			scene_->addFace({a, a + segments_, b + segments_});
+			scene_->addFace({a, b + segments_, b});
+		}
+	}
+	scene_->endObject();
+	scene_->endObjects();
+	primitives_ = scene_->getObject("mesh")->getPrimitives();
+
+	for(const std::string type : {"yafaray-kdtree-original", "yafaray-kdtree-multi-thread", "yafaray-bvh"})
+	{
+		ParamMap params;
+		params["type"] = type;
+		params["num_primitives"] = static_cast<int>(primitives_.size());
+		accelerators_.push_back({type, Accelerator::factory(primitives_, params)});
+	}
+
+	Random prng(123);
+	rays_.reserve(num_rays_);
+	for(size_t i = 0; i < num_rays_; ++i)
+	{
+		const Point3 from = Point3(0.f, 0.f, 0.f) + 3.f * randomDirection_global(prng);
+		const Point3 to(1.4f * prng() - 0.7f, 1.4f * prng() - 0.7f, 1.4f * prng() - 0.7f);
+		Vec3 dir = to - from;
+		rays_.emplace_back(from, dir.normalize(), 0.f, -1.f);
+	}
+
+	const size_t num_triangles = std::min(primitives_.size(), num_rays_);
+	for(size_t i = 0; i < num_triangles; ++i)
+	{
+		std::array<Point3, 3> vertices;
+		primitives_[i]->getTriangleVertices(vertices, nullptr);
+		const Point3 center((vertices[0].x_ + vertices[1].x_ + vertices[2].x_) / 3.f, (vertices[0].y_ + vertices[1].y_ + vertices[2].y_) / 3.f, (vertices[0].z_ + vertices[1].z_ + vertices[2].z_) / 3.f);
+		const Point3 from = center + 0.5f * randomDirection_global(prng);
+		Vec3 dir = center - from;
+		triangle_rays_.emplace_back(from, dir.normalize(), 0.f, -1.f);
+	}
+
+	const Accelerator &accelerator = *accelerators_.back().second;
+	for(const Ray &ray : rays_)
+	{
+		const AcceleratorIntersectData data = accelerator.intersect(ray, std::numeric_limits<float>::infinity());
+		if(!data.hit_) continue;
+		surface_points_.push_back(data.hit_primitive_->getSurface(ray.from_ + data.t_hit_ * ray.dir_, data, nullptr));
+		if(surface_points_.size() == 4096) break;
+	}
+}
+
+const GeometryFixture &geometryFixture_global()
+{
+	static const GeometryFixture fixture;
+	return fixture;
+}
+
+void addGeometryKernels_global(std::vector<Kernel> &kernels)
+{
+	for(const std::string type : {"yafaray-kdtree-original", "yafaray-kdtree-multi-thread", "yafaray-bvh"})
+	{
+		auto accelerator = [type]() -> const Accelerator &
+		{
+			for(const auto &it : geometryFixture_global().accelerators_) if(it.first == type) return *it.second;
+			return *geometryFixture_global().accelerators_.front().second;
+		};
+		kernels.push_back({"accelerator.intersect/" + type, [accelerator](size_t num_operations)
+		{
+			const GeometryFixture &fixture = geometryFixture_global();
+			const Accelerator &acc = accelerator();
+			double sum = 0.0;
+			for(size_t i = 0; i < num_operations; ++i)
+			{
+				const AcceleratorIntersectData data = acc.intersect(fixture.rays_[i % fixture.rays_.size()], std::numeric_limits<float>::infinity());
+				if(data.hit_) sum += data.t_hit_;
+			}
+			return sum;
+		}});
+		kernels.push_back({"accelerator.intersectS/" + type, [accelerator](size_t num_operations)
+		{
+			const GeometryFixture &fixture = geometryFixture_global();
+			const Accelerator &acc = accelerator();
+			double sum = 0.0;
+			for(size_t i = 0; i < num_operations; ++i)
+			{
+				const AcceleratorIntersectData data = acc.intersectS(fixture.rays_[i % fixture.rays_.size()], 3.f, 0.f);
+				if(data.hit_) sum += 1.0;
+			}
+			return sum;
+		}});
+	}
+	kernels.push_back({"triangle.intersect", [](size_t num_operations)
+	{
+		const GeometryFixture &fixture = geometryFixture_global();
+		double sum = 0.0;
+		for(size_t i = 0; i < num_operations; ++i)
+		{
+			const size_t index = i % fixture.triangle_rays_.size();
+			const IntersectData data = fixture.primitives_[index]->intersect(fixture.triangle_rays_[index], nullptr);
+			if(data.hit_) sum += data.t_hit_;
+		}
+		return sum;
+	}});
+}
+
+void addMaterialKernels_global(std::vector<Kernel> &kernels)
+{
+	for(const std::string type : {"shinydiffusemat", "glossy", "coated_glossy", "glass", "rough_glass", "mirror"})
+	{
+		//Each operation initializes the BSDF of a surface point, as the integrators do before evaluating or sampling it
+		auto run = [type](size_t num_operations, bool sample)
+		{
+			const GeometryFixture &fixture = geometryFixture_global();
+			const Material *material = nullptr;
+			for(const auto &it : fixture.materials_) if(it.first == type) material = it.second;
+			if(!material || fixture.surface_points_.empty()) return 0.0;
+			Random prng(456);
+			RenderData render_data(&prng);
+			std::vector<Vec3> directions(256);
+			for(auto &dir : directions) dir = randomDirection_global(prng);
+			double sum = 0.0;
+			for(size_t i = 0; i < num_operations; ++i)
+			{
+				SurfacePoint sp = fixture.surface_points_[i % fixture.surface_points_.size()];
+				sp.material_ = material;
+				render_data.arena_.reset();
+				render_data.material_data_ = render_data.allocMaterialData(material->getReqMem());
+				BsdfFlags bsdfs;
+				material->initBsdf(render_data, sp, bsdfs);
+				Vec3 wo = directions[i % directions.size()];
+				if(wo * sp.n_ < 0.f) wo = -wo;
+				Rgb col;
+				if(sample)
+				{
+					Vec3 wi;
+					float w = 0.f;
+					Sample s(prng(), prng(), BsdfFlags::All);
+					col = material->sample(render_data, sp, wo, wi, s, w);
+				}
+				else col = material->eval(render_data, sp, wo, directions[(i + 1) % directions.size()], BsdfFlags::All);
+				sum += col.energy();
+			}
+			return sum;
+		};
+		kernels.push_back({"material.eval/" + type, [run](size_t num_operations) { return run(num_operations, false); }});
+		kernels.push_back({"material.sample/" + type, [run](size_t num_operations) { return run(num_operations, true); }});
+	}
+}
+
+//! One image texture per interpolation type, all with the same image file
+struct TextureFixture
+{
+	TextureFixture();
+	std::unique_ptr<Scene> scene_;
+	std::vector<std::pair<std::string, const Texture *>> textures_;
+};
+
+TextureFixture::TextureFixture()
+{
+	ParamMap scene_params;
+	scene_params["type"] = std::string("yafaray");
+	scene_ = Scene::factory(scene_params);
+	for(const std::string interpolation : {"none", "bilinear", "bicubic", "mipmap_trilinear", "mipmap_ewa"})
+	{
+		ParamMap params;
+		params["type"] = std::string("image");
+		params["filename"] = texture_file_global;
+		params["interpolate"] = interpolation;
+		const Texture *texture = scene_->createTexture("texture_" + interpolation, params);
+		if(texture) textures_.push_back({interpolation, texture});
+	}
+	scene_->completePendingTextures();
+	if(textures_.empty()) Y_ERROR << "Microbenchmark: Couldn't load the texture file '" << texture_file_global << "'" << YENDL;
+}
+
+const TextureFixture &textureFixture_global()
+{
+	static const TextureFixture fixture;
+	return fixture;
+}
+
+void addTextureKernels_global(std::vector<Kernel> &kernels)
+{
+	for(const std::string interpolation : {"none", "bilinear", "bicubic", "mipmap_trilinear", "mipmap_ewa"})
+	{
+		kernels.push_back({"texture.getColor/" + interpolation, [interpolation](size_t num_operations)
+		{
+			const Texture *texture = nullptr;
+			for(const auto &it : textureFixture_global().textures_) if(it.first == interpolation) texture = it.second;
+			if(!texture) return 0.0;
+			Random prng(789);
+			std::vector<Point3> points(4096);
+			for(auto &p : points) p = {static_cast<float>(2.f * prng() - 1.f), static_cast<float>(2.f * prng() - 1.f), 0.f};
+			//Anisotropic footprint of about 4x1 texels of a 1024 texels wide level
+			const MipMapParams mipmap_params(4.f / 1024.f, 0.f, 0.f, 1.f / 1024.f);
+			double sum = 0.0;
+			for(size_t i = 0; i < num_operations; ++i) sum += texture->getColor(points[i % points.size()], &mipmap_params).r_;
+			return sum;
+		}});
+	}
+}
+
+void addImageFilmKernels_global(std::vector<Kernel> &kernels)
+{
+	const std::vector<std::pair<std::string, ImageFilm::FilterType>> filters {
+		{"box", ImageFilm::FilterType::Box}, {"mitchell", ImageFilm::FilterType::Mitchell}, {"gauss", ImageFilm::FilterType::Gauss}, {"lanczos", ImageFilm::FilterType::Lanczos}
+	};
+	for(const auto &filter : filters)
+	{
+		//The samples are added to the thread accumulation of a tile, as the tiled integrators do
+		const ImageFilm::FilterType filter_type = filter.second;
+		kernels.push_back({"imagefilm.addSample/" + filter.first, [filter_type](size_t num_operations)
+		{
+			RenderControl render_control;
+			Layers layers;
+			layers.setLayer(Layer::Combined, Layer(Layer::Combined, Image::Type::ColorAlpha));
+			const std::map<std::string, UniquePtr_t<ColorOutput>> outputs;
+			ImageFilm image_film(256, 256, 0, 0, 1, render_control, layers, outputs, 1.5f, filter_type, false, 64);
+			image_film.init(render_control, 1);
+			RenderArea area;
+			if(!image_film.nextArea(area)) return 0.0;
+			ColorLayers color_layers(layers);
+			color_layers(Layer::Combined).color_ = Rgba(0.5f, 0.25f, 0.125f, 1.f);
+			Random prng(321);
+			std::vector<std::pair<float, float>> offsets(256);
+			for(auto &offset : offsets) offset = {static_cast<float>(prng()), static_cast<float>(prng())};
+			for(size_t i = 0; i < num_operations; ++i)
+			{
+				const int x = area.sx_0_ + static_cast<int>(i % (area.sx_1_ - area.sx_0_));
+				const int y = area.sy_0_ + static_cast<int>((i / (area.sx_1_ - area.sx_0_)) % (area.sy_1_ - area.sy_0_));
+				const auto &offset = offsets[i % offsets.size()];
+				image_film.addSample(x, y, offset.first, offset.second, &area, 0, 0, 0.1f, &color_layers);
+			}
+			return static_cast<double>(area.accumulation_.weights_.front());
+		}});
+	}
+}
+
+//! Photons distributed in a unit cube, in a photon map (point kd-tree) and in a hash grid
+struct PhotonFixture
+{
+	PhotonFixture();
+	PhotonMap photon_map_ {"microbenchmark", 1};
+	HashGrid hash_grid_;
+	std::vector<Point3> lookup_points_;
+	static constexpr size_t num_photons_ = 500000;
+	static constexpr unsigned int num_gathered_ = 50;
+	static constexpr float gather_radius_ = 0.03f;
+};
+
+PhotonFixture::PhotonFixture()
+{
+	Random prng(654);
+	hash_grid_.setParm(2.0 * gather_radius_, num_photons_, Bound(Point3(0.f, 0.f, 0.f), Point3(1.f, 1.f, 1.f)));
+	for(size_t i = 0; i < num_photons_; ++i)
+	{
+		Photon photon(randomDirection_global(prng), Point3(prng(), prng(), prng()), Rgb(prng(), prng(), prng()));
+		photon_map_.pushPhoton(photon);
+		hash_grid_.pushPhoton(photon);
+	}
+	photon_map_.updateTree();
+	hash_grid_.updateGrid();
+	lookup_points_.resize(4096);
+	for(auto &p : lookup_points_) p = {static_cast<float>(prng()), static_cast<float>(prng()), static_cast<float>(prng())};
+}
+
+PhotonFixture &photonFixture_global()
+{
+	static PhotonFixture fixture;
+	return fixture;
+}
+
+void addPhotonKernels_global(std::vector<Kernel> &kernels)
+{
+	kernels.push_back({"photonmap.gather", [](size_t num_operations)
+	{
+		const PhotonFixture &fixture = photonFixture_global();
+		std::vector<FoundPhoton> found(PhotonFixture::num_gathered_ + 1);
+		double sum = 0.0;
+		for(size_t i = 0; i < num_operations; ++i)
+		{
+			float sq_radius = PhotonFixture::gather_radius_ * PhotonFixture::gather_radius_;
+			sum += fixture.photon_map_.gather(fixture.lookup_points_[i % fixture.lookup_points_.size()], found.data(), PhotonFixture::num_gathered_, sq_radius);
+		}
+		return sum;
+	}});
+	kernels.push_back({"photonmap.findNearest", [](size_t num_operations)
+	{
+		const PhotonFixture &fixture = photonFixture_global();
+		double sum = 0.0;
+		for(size_t i = 0; i < num_operations; ++i)
+		{
+			const Photon *photon = fixture.photon_map_.findNearest(fixture.lookup_points_[i % fixture.lookup_points_.size()], Vec3(0.f, 0.f, 1.f), PhotonFixture::gather_radius_);
+			if(photon) sum += photon->position().x_;
+		}
+		return sum;
+	}});
+	kernels.push_back({"hashgrid.gather", [](size_t num_operations)
+	{
+		PhotonFixture &fixture = photonFixture_global();
+		std::vector<FoundPhoton> found(PhotonFixture::num_gathered_ + 1);
+		double sum = 0.0;
+		for(size_t i = 0; i < num_operations; ++i)
+		{
+			sum += fixture.hash_grid_.gather(fixture.lookup_points_[i % fixture.lookup_points_.size()], found.data(), PhotonFixture::num_gathered_, PhotonFixture::gather_radius_ * PhotonFixture::gather_radius_);
+		}
+		return sum;
+	}});
+}
+
+double runKernel_global(const Kernel &kernel, size_t num_operations)
+{
+	const auto start = std::chrono::steady_clock::now();
+	results_sink_global = results_sink_global + kernel.run_(num_operations);
+	const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+	return seconds.count();
+}
+
+/*! Doubles the number of operations until a run takes a tenth of the minimum time, then runs the repetitions with
+ * enough operations to take the minimum time each. The first run also creates the inputs of the kernel group */
+KernelResult measureKernel_global(const Kernel &kernel, double min_seconds, int repetitions)
+{
+	size_t num_operations = 1;
+	runKernel_global(kernel, num_operations);
+	double seconds = 0.0;
+	while((seconds = runKernel_global(kernel, num_operations)) < 0.1 * min_seconds && num_operations < (static_cast<size_t>(1) << 40)) num_operations *= 2;
+	num_operations = std::max(num_operations, static_cast<size_t>(num_operations * min_seconds / std::max(seconds, 1e-9)));
+	std::vector<double> ns_per_operation;
+	for(int repetition = 0; repetition < repetitions; ++repetition) ns_per_operation.push_back(runKernel_global(kernel, num_operations) * 1e9 / num_operations);
+	std::sort(ns_per_operation.begin(), ns_per_operation.end());
+	KernelResult result;
+	result.name_ = kernel.name_;
+	result.operations_ = num_operations;
+	result.min_ns_ = ns_per_operation.front();
+	result.median_ns_ = ns_per_operation[ns_per_operation.size() / 2];
+	return result;
+}
+
+std::string toJson_global(const std::vector<KernelResult> &results)
+{
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(2);
+	ss << "{\"version\":\"" << YAFARAY_BUILD_VERSION << "\",\"kernels\":[";
+	for(size_t i = 0; i < results.size(); ++i)
+	{
+		if(i > 0) ss << ",";
+		ss << "{\"name\":\"" << results[i].name_ << "\",\"operations\":" << results[i].operations_ << ",\"min_ns\":" << results[i].min_ns_ << ",\"median_ns\":" << results[i].median_ns_ << "}";
+	}
+	ss << "]}";
+	return ss.str();
+}
+
+/*! Measures the time per operation of the renderer kernels (accelerator traversal, triangle intersection, BSDF evaluation
+ * and sampling, texture interpolation, image film sample filtering and photon lookups) on canned inputs, so a performance
+ * regression can be attributed to a kernel instead of only to a whole render. All the kernels run in a single thread */
+int main(int argc, char *argv[])
+{
+	CliParser parse(argc, argv, 0, 0, "");
+
+	parse.setAppName("YafaRay microbenchmarks", "[OPTIONS]...");
+
+	parse.setOption("f", "filter", false, "Runs only the kernels whose name contains this text, for example \"accelerator\" or \"yafaray-bvh\".");
+	parse.setOption("l", "list", true, "Lists the kernel names without running them.");
+	parse.setOption("mt", "min-time", false, "Minimum time in seconds of each repetition of a kernel (default 0.2).");
+	parse.setOption("r", "repetitions", false, "Repetitions of each kernel, the fastest and the median ones are reported (default 5).");
+	parse.setOption("tf", "texture-file", false, "Image file of the texture kernels, by default the test01 texture of the source tree.");
+	parse.setOption("o", "output", false, "JSON results file, by default the results are only printed.");
+	parse.setOption("vl", "verbosity-level", false, "Set console verbosity level, options are the same as for yafaray-xml (default \"warning\")\n");
+	parse.setOption("h", "help", true, "Displays this help text.");
+
+	const bool parse_ok = parse.parseCommandLine();
+
+	if(parse.getFlag("h"))
+	{
+		parse.printUsage();
+		return 0;
+	}
+
+	if(!parse_ok)
+	{
+		parse.printError();
+		parse.printUsage();
+		return 1;
+	}
+
+	const std::string verb_level = parse.getOptionString("vl");
+	logger_global.setConsoleMasterVerbosity(verb_level.empty() ? "warning" : verb_level);
+	logger_global.setLogMasterVerbosity("mute");
+
+	const std::string min_time_string = parse.getOptionString("mt");
+	const double min_seconds = min_time_string.empty() ? 0.2 : std::max(0.001, atof(min_time_string.c_str()));
+	const int repetitions = parse.isSet("r") ? std::max(1, parse.getOptionInteger("r")) : 5;
+	if(parse.isSet("tf")) texture_file_global = parse.getOptionString("tf");
+	const std::string filter = parse.getOptionString("f");
+
+	std::vector<Kernel> kernels;
+	addGeometryKernels_global(kernels);
+	addMaterialKernels_global(kernels);
+	addTextureKernels_global(kernels);
+	addImageFilmKernels_global(kernels);
+	addPhotonKernels_global(kernels);
+
+	std::vector<KernelResult> results;
+	for(const auto &kernel : kernels)
+	{
+		if(!filter.empty() && kernel.name_.find(filter) == std::string::npos) continue;
+		if(parse.getFlag("l"))
+		{
+			std::cout << kernel.name_ << std::endl;
+			continue;
+		}
+		results.push_back(measureKernel_global(kernel, min_seconds, repetitions));
+		const KernelResult &r = results.back();
+		std::cout << std::left << std::setw(50) << r.name_ << std::right << std::fixed << std::setprecision(2) << std::setw(12) << r.min_ns_ << " ns" << std::setw(12) << r.median_ns_ << " ns (median)" << std::endl;
+	}
+	if(parse.getFlag("l")) return 0;
+
+	const std::string output_path = parse.getOptionString("o");
+	if(!output_path.empty())
+	{
+		std::ofstream output(output_path);
+		output << toJson_global(results) << std::endl;
+		if(!output)
+		{
+			Y_ERROR << "Microbenchmark: Couldn't write the results file '" << output_path << "'" << YENDL;
+			return 1;
+		}
+	}
+	return 0;
+}
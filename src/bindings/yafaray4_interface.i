@@ -37,6 +37,11 @@
 
 %{
 #include <sstream>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include "render/monitor.h"
 #include "output/output.h"
 #include "interface/interface.h"
@@ -49,35 +54,70 @@
 
 BEGIN_YAFARAY
 
+/*! The pixels of each layer are stored with the exported channels in the Blender rows order (the bottom row first) and exposed
+ * through the Python buffer protocol as a read only (height, width, channels) float32 array, so numpy.frombuffer or memoryview
+ * can read the whole image without copying it or building a Python tuple for each pixel. The buffer is valid while the output
+ * that created the tile exists */
 struct Tile
 {
 	PyObject_HEAD //Important! Python automatically reads/writes this head by position within the struct (not by name!), the class *must never* have anything located before the head or it will be overwritten in a very messy way!
 	int area_x_0_ = 0, area_x_1_ = 0;
 	int area_y_0_ = 0, area_y_1_ = 0;
-	ImageLayer *image_layer_ = nullptr; //The Python Object header needs to know the size of the object, better to use simple raw pointers to contained objects to get a reliable size. Do not use smart pointers or classes here or weird random crashes will happen!
+	Layer *layer_ = nullptr; //The Python Object header needs to know the size of the object, better to use simple raw pointers to contained objects to get a reliable size. Do not use smart pointers or classes here or weird random crashes will happen!
+	float *pixels_ = nullptr;
+	int width_ = 0, height_ = 0, num_channels_ = 0;
+	bool grayscale_ = false, has_alpha_ = false; //!< of the internal image type of the layer, the exported channels are computed as if the colors were stored in it
+	Py_ssize_t shape_[3], strides_[3]; //!< of the buffer protocol view
 	//Important: the PyObject_New function does *not* initialize the structure with its default values, an explicit init function needed to initialize and allocate any pointer(s)
-	void init() { area_x_0_ = 0; area_x_1_ = 0; area_y_0_ = 0; area_y_1_ = 0; image_layer_ = new ImageLayer(); }
-	~Tile() { delete image_layer_; }
+	void init(int width, int height, const Layer &layer);
+	void setColor(int x, int y, const Rgba &color);
+	const float *getPixel(int x, int y) const { return pixels_ + (static_cast<size_t>(height_ - 1 - y) * width_ + x) * num_channels_; }
+	~Tile() { delete layer_; delete[] pixels_; }
 };
 
+inline void Tile::init(int width, int height, const Layer &layer)
+{
+	area_x_0_ = 0; area_x_1_ = 0; area_y_0_ = 0; area_y_1_ = 0;
+	layer_ = new Layer(layer);
+	width_ = width;
+	height_ = height;
+	num_channels_ = layer.getNumExportedChannels();
+	grayscale_ = Image::isGrayscale(layer.getImageType());
+	has_alpha_ = Image::hasAlpha(layer.getImageType());
+	const size_t num_values = static_cast<size_t>(width) * height * num_channels_;
+	pixels_ = new float[num_values];
+	for(size_t i = 0; i < num_values; ++i) pixels_[i] = (num_channels_ == 4 && i % 4 == 3) ? 1.f : 0.f;
+	shape_[0] = height; shape_[1] = width; shape_[2] = num_channels_;
+	strides_[2] = sizeof(float); strides_[1] = num_channels_ * strides_[2]; strides_[0] = width * strides_[1];
+}
+
+inline void Tile::setColor(int x, int y, const Rgba &color)
+{
+	float *pixel = pixels_ + (static_cast<size_t>(height_ - 1 - y) * width_ + x) * num_channels_;
+	const float alpha = has_alpha_ ? color.a_ : 1.f;
+	if(grayscale_)
+	{
+		const float value = (color.r_ + color.g_ + color.b_) / 3.f;
+		for(int i = 0; i < num_channels_; ++i) pixel[i] = (i == 3) ? alpha : value;
+	}
+	else
+	{
+		pixel[0] = color.r_;
+		if(num_channels_ >= 3) { pixel[1] = color.g_; pixel[2] = color.b_; }
+		if(num_channels_ == 4) pixel[3] = alpha;
+	}
+}
+
 class TilesLayers final : public Collection<Layer::Type, Tile>  //Actual buffer of images in the rendering process, one entry for each enabled layer.
 {
 	public:
 		void setColor(int x, int y, const ColorLayer &color_layer);
-		Rgba getColor(int x, int y, const Layer &layer);
 };
 
 inline void TilesLayers::setColor(int x, int y, const ColorLayer &color_layer)
 {
 	Tile *tile = find(color_layer.layer_type_);
-	if(tile) tile->image_layer_->image_->setColor(x, y, color_layer.color_);
-}
-
-inline Rgba TilesLayers::getColor(int x, int y, const Layer &layer)
-{
-	const Tile *tile = find(layer.getType());
-	if(tile) return tile->image_layer_->image_->getColor(x, y);
-	else return {0.f};
+	if(tile) tile->setColor(x, y, color_layer.color_);
 }
 
 static Py_ssize_t pythonTileSize_global(const Tile *tile)
@@ -91,7 +131,7 @@ static Py_ssize_t pythonTileSize_global(const Tile *tile)
 
 static PyObject *pythonTileSubscriptInt_global(const Tile *tile, int py_index)
 {
-	const int num_channels = tile->image_layer_->layer_.getNumExportedChannels();
+	const int num_channels = tile->num_channels_;
 	// Check boundaries and fill w and h
 	if(py_index >= pythonTileSize_global(tile) || py_index < 0)
 	{
@@ -115,23 +155,37 @@ static PyObject *pythonTileSubscriptInt_global(const Tile *tile, int py_index)
 	vy = (tile->area_y_0_ + area_h - 1) - vy;
 
 	// Get pixel
-	const Rgba color = tile->image_layer_->image_->getColor(vx, vy);
+	const float *pixel = tile->getPixel(vx, vy);
 
 	PyObject* groupPix = PyTuple_New(num_channels);
-	if(num_channels >= 1)
-	{
-		PyTuple_SET_ITEM(groupPix, 0, PyFloat_FromDouble(color.r_));
-	}
-	if(num_channels >= 3)
+	for(int i = 0; i < num_channels; ++i)
 	{
-		PyTuple_SET_ITEM(groupPix, 1, PyFloat_FromDouble(color.g_));
-		PyTuple_SET_ITEM(groupPix, 2, PyFloat_FromDouble(color.b_));
+		PyTuple_SET_ITEM(groupPix, i, PyFloat_FromDouble(pixel[i]));
 	}
-	if(num_channels == 4)
+	return groupPix;
+}
+
+static int pythonTileGetBuffer_global(Tile *tile, Py_buffer *view, int flags)
+{
+	if((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
 	{
-		PyTuple_SET_ITEM(groupPix, 3, PyFloat_FromDouble(color.a_));
+		PyErr_SetString(PyExc_BufferError, "The render tile buffers are read only.");
+		view->obj = nullptr;
+		return -1;
 	}
-	return groupPix;
+	view->obj = reinterpret_cast<PyObject *>(tile);
+	Py_INCREF(view->obj);
+	view->buf = tile->pixels_;
+	view->len = tile->shape_[0] * tile->strides_[0];
+	view->readonly = 1;
+	view->itemsize = sizeof(float);
+	view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? const_cast<char *>("f") : nullptr;
+	view->ndim = 3;
+	view->shape = (flags & PyBUF_ND) == PyBUF_ND ? tile->shape_ : nullptr;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? tile->strides_ : nullptr;
+	view->suboffsets = nullptr;
+	view->internal = nullptr;
+	return 0;
 }
 
 static void pythonTileDelete_global(Tile *tile)
@@ -149,6 +203,12 @@ PySequenceMethods sequence_methods =
 	( ssizeargfunc ) pythonTileSubscriptInt_global
 };
 
+PyBufferProcs buffer_methods =
+{
+	( getbufferproc ) pythonTileGetBuffer_global,
+	nullptr
+};
+
 PyTypeObject python_tile_type_global =
 {
 	PyVarObject_HEAD_INIT(nullptr, 0)
@@ -169,11 +229,123 @@ PyTypeObject python_tile_type_global =
 	nullptr,                       		/* reprfunc tp_str; */
 	nullptr,								/* getattrofunc tp_getattro; */
 	nullptr,								/* setattrofunc tp_setattro; */
-	nullptr,                       		/* PyBufferProcs *tp_as_buffer; */
+	&buffer_methods,					/* PyBufferProcs *tp_as_buffer; */
 	Py_TPFLAGS_DEFAULT,         		/* long tp_flags; */
 };
 
 
+/*! Callbacks of the render threads to Python, queued and delivered from a single thread while Interface::render runs, or from Interface::renderAsync until
+ * its job is waited for or deleted, so the render threads never wait for the GIL.
+ * The queued events are delivered in batches taking the GIL once per batch, at most about 30 batches per second, and only the latest progress of a batch is reported.
+ * When the dispatcher is not running the events are delivered right away in the calling thread */
+class PythonCallbackDispatcher final
+{
+	public:
+		static PythonCallbackDispatcher &get()
+		{
+			static PythonCallbackDispatcher dispatcher;
+			return dispatcher;
+		}
+
+		//! called without the GIL, as the dispatcher thread takes it
+		void start()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if(running_) return;
+			running_ = true;
+			stopping_ = false;
+			thread_ = std::thread(&PythonCallbackDispatcher::run, this);
+		}
+
+		//! delivers the pending events and ends the dispatcher thread, called without the GIL
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if(!running_) return;
+				stopping_ = true;
+			}
+			condition_.notify_all();
+			thread_.join();
+			std::lock_guard<std::mutex> lock(mutex_);
+			running_ = false;
+		}
+
+		//! the event is called with the GIL held
+		void post(std::function<void()> event)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if(running_)
+				{
+					events_.emplace_back(std::move(event));
+					return;
+				}
+			}
+			callWithGil(event);
+		}
+
+		//! as post, but replacing the progress event not delivered yet
+		void postProgress(std::function<void()> event)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if(running_)
+				{
+					progress_event_ = std::move(event);
+					return;
+				}
+			}
+			callWithGil(event);
+		}
+
+	private:
+		static void callWithGil(const std::function<void()> &event)
+		{
+			PyGILState_STATE gstate = PyGILState_Ensure();
+			event();
+			PyGILState_Release(gstate);
+		}
+
+		void run()
+		{
+			std::vector<std::function<void()>> events;
+			std::function<void()> progress_event;
+			while(true)
+			{
+				bool stopping = false;
+				{
+					std::unique_lock<std::mutex> lock(mutex_);
+					condition_.wait(lock, [this] { return stopping_ || !events_.empty() || progress_event_; });
+					events.swap(events_);
+					progress_event.swap(progress_event_);
+					stopping = stopping_;
+				}
+				if(!events.empty() || progress_event)
+				{
+					PyGILState_STATE gstate = PyGILState_Ensure();
+					for(const auto &event : events) event();
+					if(progress_event) progress_event();
+					PyGILState_Release(gstate);
+					events.clear();
+					progress_event = nullptr;
+				}
+				if(stopping) break;
+				//The events of the next batch accumulate meanwhile, so the host gets fewer and larger batches
+				std::unique_lock<std::mutex> lock(mutex_);
+				condition_.wait_for(lock, std::chrono::milliseconds(33), [this] { return stopping_; });
+			}
+		}
+
+		std::mutex mutex_;
+		std::condition_variable condition_;
+		std::vector<std::function<void()>> events_;
+		std::function<void()> progress_event_;
+		std::thread thread_;
+		bool running_ = false;
+		bool stopping_ = false;
+};
+
 class PythonOutput : public ColorOutput
 {
 
@@ -193,6 +365,32 @@ public:
 		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PRTEXT(setRenderCallbacks after) PR(py_draw_area_callback_) PR(py_flush_callback_) PREND;
 	}
 
+	/*! When set, the finished and highlighted areas call it with only the area rectangle and view name (x, y, width, height, view_name)
+	 * instead of calling the draw area callback, and the pixels are read from the layer buffers returned by getLayerBuffers */
+	void setAreaReadyCallback(PyObject *py_area_ready_callback) { py_area_ready_callback_ = py_area_ready_callback; }
+
+	//! Returns a tuple of (layer name, tile) pairs of the render view, the tiles support the buffer protocol over the whole image
+	PyObject *getLayerBuffers(const std::string &view_name)
+	{
+		SWIG_PYTHON_THREAD_BEGIN_BLOCK;
+		PyObject *group_tile = nullptr;
+		auto tiles_view = tiles_views_.find(view_name);
+		if(tiles_view == tiles_views_.end()) group_tile = PyTuple_New(0);
+		else
+		{
+			for(auto &tile : *tiles_view->second)
+			{
+				tile.second.area_x_0_ = 0;
+				tile.second.area_x_1_ = width_;
+				tile.second.area_y_0_ = 0;
+				tile.second.area_y_1_ = height_;
+			}
+			group_tile = buildLayersTuple(tiles_view->second.get());
+		}
+		SWIG_PYTHON_THREAD_END_BLOCK;
+		return group_tile;
+	}
+
     virtual void init(int width, int height, const Layers *layers, const std::map<std::string, std::unique_ptr<RenderView>> *render_views) override
     { 
 		SWIG_PYTHON_THREAD_BEGIN_BLOCK; 
@@ -208,12 +406,8 @@ public:
 			const Layers layers_exported = layers_->getLayersWithExportedImages();
 			for(const auto &it : layers_exported)
 			{
-				Image::Type image_type = it.second.getImageType();
-				std::unique_ptr<Image> image = Image::factory(width, height, image_type, Image::Optimization::None);
 				Tile *tile = PyObject_New(Tile, &python_tile_type_global);
-				tile->init();
-				tile->image_layer_->image_ = std::move(image);
-				tile->image_layer_->layer_ = it.second;
+				tile->init(width, height, it.second);
 				tiles_layers->set(it.first, *tile);
 			}
 			tiles_views_[render_view.first] = std::move(tiles_layers);
@@ -237,97 +431,103 @@ public:
 		return true;
 	}
 
+	virtual bool putTile(int x_0, int y_0, int width, int height, const ColorLayerTile &color_layer_tile) override
+	{
+		Tile *tile = tiles_views_.at(current_render_view_->getName())->find(color_layer_tile.layer_type_);
+		if(!tile) return true;
+		static_assert(sizeof(Rgba) == 4 * sizeof(float), "Rgba is expected to be stored as 4 contiguous floats");
+		const bool copy_rows = tile->num_channels_ == 4 && !tile->grayscale_ && tile->has_alpha_;
+		for(int j = 0; j < height; ++j)
+		{
+			const Rgba *colors = color_layer_tile.colors_ + static_cast<size_t>(j) * color_layer_tile.row_stride_;
+			if(copy_rows) std::memcpy(const_cast<float *>(tile->getPixel(x_0, y_0 + j)), colors, width * sizeof(Rgba));
+			else for(int i = 0; i < width; ++i) tile->setColor(x_0 + i, y_0 + j, colors[i]);
+		}
+		return true;
+	}
+
 	virtual bool isPreview() const override { return preview_; }
 
 	virtual void flush(const RenderControl &render_control) override
 	{
 		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PRTEXT(flush) PREND;
 		if(!py_flush_callback_) return;
+		const std::string view_name = current_render_view_->getName();
+		PythonCallbackDispatcher::get().post([this, view_name]() { callFlush(view_name); });
+	}
 
-		SWIG_PYTHON_THREAD_BEGIN_BLOCK;
-		PyGILState_STATE gstate;
-		gstate = PyGILState_Ensure();
+	virtual void flushArea(int x0, int y0, int x1, int y1) override
+	{
+		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PRTEXT(flushArea) PREND;
+		// Do nothing if we are rendering preview_ renders
+		if(preview_ || (!py_draw_area_callback_ && !py_area_ready_callback_)) return;
+		const std::string view_name = current_render_view_->getName();
+		PythonCallbackDispatcher::get().post([this, x0, y0, x1, y1, view_name]() { callDrawArea(x0, y0, x1, y1, view_name); });
+	}
+
+	virtual void highlightArea(int x0, int y0, int x1, int y1) override
+	{
+		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PRTEXT(highlightArea) PREND;
+		// Do nothing if we are rendering preview_ renders
+		if(preview_ || (!py_draw_area_callback_ && !py_area_ready_callback_)) return;
 		const std::string view_name = current_render_view_->getName();
+		//The corners are drawn right away, so they never overwrite the pixels of the area when its callback is delivered after the area was rendered
+		Tile *tile = tiles_views_.at(view_name)->find(Layer::Combined);
+		const int line_length = std::min(4, std::min(y1 - y0 - 1, x1 - x0 - 1));
+		drawCorner(tile, x0 - border_x_, y0 - border_y_, line_length, TL_CORNER);
+		drawCorner(tile, x1 - border_x_, y0 - border_y_, line_length, TR_CORNER);
+		drawCorner(tile, x0 - border_x_, y1 - border_y_, line_length, BL_CORNER);
+		drawCorner(tile, x1 - border_x_, y1 - border_y_, line_length, BR_CORNER);
+		PythonCallbackDispatcher::get().post([this, x0, y0, x1, y1, view_name]() { callHighlightArea(x0, y0, x1, y1, view_name); });
+	}
+
+private:
+	//! The callbacks are called by the callback dispatcher with the GIL held
+	void callFlush(const std::string &view_name)
+	{
 		TilesLayers *tiles_layers = tiles_views_.at(view_name).get();
-		const size_t num_tiles_layers = tiles_layers->size();
-		PyObject* groupTile = PyTuple_New(num_tiles_layers);
-		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupTile) PREND; if(groupTile) //if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupTile->ob_refcnt) PREND;
-		size_t tuple_index = 0;
 		for(auto &tile : *tiles_layers)
 		{
 			tile.second.area_x_0_ = 0;
 			tile.second.area_x_1_ = width_;
 			tile.second.area_y_0_ = 0;
 			tile.second.area_y_1_ = height_;
-			std::string layer_name = tile.second.image_layer_->layer_.getExportedImageName();
-			if(layer_name.empty()) layer_name = tile.second.image_layer_->layer_.getTypeName();
-			//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(view_name) PR(tuple_index) PR(tiles_layers->size()) PR(Layer::getTypeName(tile.first)) PR(tiles_layers) PR(&tile.second) PREND;
-			PyObject* groupItem = Py_BuildValue("sO", layer_name.c_str(), &tile.second);
-			//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupItem) PREND; if(groupItem) //if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupItem->ob_refcnt) PREND;
-			PyTuple_SET_ITEM(groupTile, tuple_index, groupItem);
-			++tuple_index;
 		}
+		PyObject* groupTile = buildLayersTuple(tiles_layers);
 		PyObject* result = PyObject_CallFunction(py_flush_callback_, "iisO", width_, height_, view_name.c_str(), groupTile);
 		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(result) PREND; if(result) //if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(result->ob_refcnt) PREND;
 
 		Py_XDECREF(result);
 		Py_XDECREF(groupTile);
-
-		PyGILState_Release(gstate);
-		SWIG_PYTHON_THREAD_END_BLOCK; 
 	}
 
-	virtual void flushArea(int x0, int y0, int x1, int y1) override
+	void callDrawArea(int x0, int y0, int x1, int y1, const std::string &view_name)
 	{
-		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PRTEXT(flushArea) PREND;
-		// Do nothing if we are rendering preview_ renders
-		if(preview_ || !py_draw_area_callback_) return;
-
-		SWIG_PYTHON_THREAD_BEGIN_BLOCK;
-		PyGILState_STATE gstate;
-		gstate = PyGILState_Ensure();
-
-		const std::string view_name = current_render_view_->getName();
+		const int area_width = x1 - x0;
+		const int area_height = y1 - y0;
+		if(py_area_ready_callback_)
+		{
+			callAreaReady(x0 - border_x_, height_ - (y1 - border_y_), area_width, area_height, view_name);
+			return;
+		}
 		TilesLayers *tiles_layers = tiles_views_.at(view_name).get();
-		const size_t num_tiles_layers = tiles_layers->size();
-		PyObject* groupTile = PyTuple_New(num_tiles_layers);
-		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupTile) PREND; if(groupTile) //if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupTile->ob_refcnt) PREND;
-		size_t tuple_index = 0;
 		for(auto &tile : *tiles_layers)
 		{
 			tile.second.area_x_0_ = x0 - border_x_;
 			tile.second.area_x_1_ = x1 - border_x_;
 			tile.second.area_y_0_ = y0 - border_y_;
 			tile.second.area_y_1_ = y1 - border_y_;
-			std::string layer_name = tile.second.image_layer_->layer_.getExportedImageName();
-			if(layer_name.empty()) layer_name = tile.second.image_layer_->layer_.getTypeName();
-			//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(view_name) PR(tuple_index) PR(tiles_layers->size()) PR(Layer::getTypeName(tile.first)) PR(tiles_layers) PR(&tile.second) PR(tile.second.getTypeName()) PREND;
-			PyObject* groupItem = Py_BuildValue("sO", layer_name.c_str(), &tile.second);
-			//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupItem) PREND; if(groupItem) //if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupItem->ob_refcnt) PREND;
-			PyTuple_SET_ITEM(groupTile, tuple_index, groupItem);
-			++tuple_index;
 		}
-
-		const int area_width = x1 - x0;
-		const int area_height = y1 - y0;
+		PyObject* groupTile = buildLayersTuple(tiles_layers);
 		PyObject* result = PyObject_CallFunction(py_draw_area_callback_, "iiiisO", x0 - border_x_, height_ - (y1 - border_y_), area_width, area_height, view_name.c_str(), groupTile);
 		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(result) PREND; if(result) //if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(result->ob_refcnt) PREND;
 
 		Py_XDECREF(result);
 		Py_XDECREF(groupTile);
-		
-		PyGILState_Release(gstate);
-		SWIG_PYTHON_THREAD_END_BLOCK; 
 	}
 
-	virtual void highlightArea(int x0, int y0, int x1, int y1) override
+	void callHighlightArea(int x0, int y0, int x1, int y1, const std::string &view_name)
 	{
-		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PRTEXT(highlightArea) PREND;
-		// Do nothing if we are rendering preview_ renders
-		if(preview_ || !py_draw_area_callback_) return;
-
-		SWIG_PYTHON_THREAD_BEGIN_BLOCK;
-		const std::string view_name = current_render_view_->getName();
 		TilesLayers *tiles_layers = tiles_views_.at(view_name).get();
 		Tile *tile = tiles_layers->find(Layer::Combined);
 
@@ -338,21 +538,18 @@ public:
 
 		int w = x1 - x0;
 		int h = y1 - y0;
-		int lineL = std::min( 4, std::min( h - 1, w - 1 ) );
-
-		drawCorner(tile, tile->area_x_0_, tile->area_y_0_, lineL, TL_CORNER);
-		drawCorner(tile, tile->area_x_1_, tile->area_y_0_, lineL, TR_CORNER);
-		drawCorner(tile, tile->area_x_0_, tile->area_y_1_, lineL, BL_CORNER);
-		drawCorner(tile, tile->area_x_1_, tile->area_y_1_, lineL, BR_CORNER);
 
-		PyGILState_STATE gstate;
-		gstate = PyGILState_Ensure();
+		if(py_area_ready_callback_)
+		{
+			callAreaReady(tile->area_x_0_, height_ - tile->area_y_1_, w, h, view_name);
+			return;
+		}
 
 		PyObject* groupTile = PyTuple_New(1);
 		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupTile) PREND; if(groupTile) //if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupTile->ob_refcnt) PREND;
 
-		std::string layer_name = tile->image_layer_->layer_.getExportedImageName();
-		if(layer_name.empty()) layer_name = tile->image_layer_->layer_.getTypeName();
+		std::string layer_name = tile->layer_->getExportedImageName();
+		if(layer_name.empty()) layer_name = tile->layer_->getTypeName();
 		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(view_name) PR(tiles_layers->size()) PR(Layer::getTypeName(Layer::Combined)) PR(tiles_layers) PR(tile) PREND;
 		PyObject* groupItem = Py_BuildValue("sO", layer_name.c_str(), tile);
 		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupItem) PREND; if(groupItem) //if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(groupItem->ob_refcnt) PREND;
@@ -363,12 +560,29 @@ public:
 		
 		Py_XDECREF(result);
 		Py_XDECREF(groupTile);
+	}
 
-		PyGILState_Release(gstate);
-		SWIG_PYTHON_THREAD_END_BLOCK; 
+	PyObject *buildLayersTuple(TilesLayers *tiles_layers) const
+	{
+		PyObject* groupTile = PyTuple_New(tiles_layers->size());
+		size_t tuple_index = 0;
+		for(auto &tile : *tiles_layers)
+		{
+			std::string layer_name = tile.second.layer_->getExportedImageName();
+			if(layer_name.empty()) layer_name = tile.second.layer_->getTypeName();
+			PyObject* groupItem = Py_BuildValue("sO", layer_name.c_str(), &tile.second);
+			PyTuple_SET_ITEM(groupTile, tuple_index, groupItem);
+			++tuple_index;
+		}
+		return groupTile;
+	}
+
+	void callAreaReady(int x, int y, int width, int height, const std::string &view_name) const
+	{
+		PyObject* result = PyObject_CallFunction(py_area_ready_callback_, "iiiis", x, y, width, height, view_name.c_str());
+		Py_XDECREF(result);
 	}
 
-private:
 	enum corner { TL_CORNER, TR_CORNER, BL_CORNER, BR_CORNER };
 	void drawCorner(Tile *tile, int x, int y, int len, corner pos)
 	{
@@ -414,12 +628,12 @@ private:
 
 		for(int i = minX; i < maxX; ++i)
 		{
-			tile->image_layer_->image_->setColor(i, y, {0.625f, 0.f, 0.f, 1.f});
+			tile->setColor(i, y, {0.625f, 0.f, 0.f, 1.f});
 		}
 
 		for(int j = minY; j < maxY; ++j)
 		{
-			tile->image_layer_->image_->setColor(x, j, {0.625f, 0.f, 0.f, 1.f});
+			tile->setColor(x, j, {0.625f, 0.f, 0.f, 1.f});
 		}
 	}
 
@@ -428,21 +642,36 @@ private:
 	bool preview_ = false;
 	PyObject *py_draw_area_callback_ = nullptr;
 	PyObject *py_flush_callback_ = nullptr;
+	PyObject *py_area_ready_callback_ = nullptr;
 	std::map<std::string, std::unique_ptr<TilesLayers>> tiles_views_;
 };
 
 class YafPyProgress : public ProgressBar
 {
 public:
-	YafPyProgress(PyObject *callback) : py_callback_(callback) {}
+	//! called with the GIL held. The renders started with Interface::renderAsync outlive the call, so their progress bar keeps its own reference to the callback
+	YafPyProgress(PyObject *callback, bool own_reference = false) : py_callback_(callback == Py_None ? nullptr : callback), own_reference_(own_reference && py_callback_)
+	{
+		if(own_reference_) Py_INCREF(py_callback_);
+	}
+
+	virtual ~YafPyProgress() override
+	{
+		if(!own_reference_) return;
+		//Deleted by the render thread, without the GIL
+		PyObject *py_callback = py_callback_;
+		PythonCallbackDispatcher::get().post([py_callback]() { Py_DECREF(py_callback); });
+	}
 
 	void report_progress(float percent)
 	{
-		PyGILState_STATE gstate;
-		gstate = PyGILState_Ensure();
-		PyObject* result = PyObject_CallFunction(py_callback_, "sf", "progress", percent);
-		Py_XDECREF(result);
-		PyGILState_Release(gstate);
+		if(!py_callback_) return;
+		PyObject *py_callback = py_callback_;
+		PythonCallbackDispatcher::get().postProgress([py_callback, percent]()
+		{
+			PyObject* result = PyObject_CallFunction(py_callback, "sf", "progress", percent);
+			Py_XDECREF(result);
+		});
 	}
 
 	virtual void init(int total_steps) override
@@ -466,22 +695,19 @@ public:
 
 	virtual void setTag(const char* text) override
 	{
-		tag_ = std::string(text);
-		PyGILState_STATE gstate;
-		gstate = PyGILState_Ensure();
-		PyObject* result = PyObject_CallFunction(py_callback_, "ss", "tag", text);
-		Py_XDECREF(result);
-		PyGILState_Release(gstate);
+		setTag(std::string(text));
 	}
 
 	virtual void setTag(std::string text) override
 	{
 		tag_ = text;
-		PyGILState_STATE gstate;
-		gstate = PyGILState_Ensure();
-		PyObject* result = PyObject_CallFunction(py_callback_, "ss", "tag", text.c_str());
-		Py_XDECREF(result);
-		PyGILState_Release(gstate);
+		if(!py_callback_) return;
+		PyObject *py_callback = py_callback_;
+		PythonCallbackDispatcher::get().post([py_callback, text]()
+		{
+			PyObject* result = PyObject_CallFunction(py_callback, "ss", "tag", text.c_str());
+			Py_XDECREF(result);
+		});
 	}
 	
 	virtual std::string getTag() const override { return tag_; }
@@ -490,11 +716,44 @@ public:
 
 private:
 	PyObject *py_callback_ = nullptr;
+	bool own_reference_ = false;
 	float steps_to_percent_;
 	int done_steps_, num_steps_;
 	std::string tag_;
 };
 
+/*! Read-only view of a C-contiguous Python buffer of 32 bit floats ('f') or ints ('i'), grouped in elements of num_components values */
+class BulkBuffer final
+{
+	public:
+		BulkBuffer(PyObject *obj, char format, size_t num_components) : num_components_(num_components)
+		{
+			if(PyObject_GetBuffer(obj, &view_, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) return; //Python exception already set
+			acquired_ = true;
+			const char *view_format = view_.format ? view_.format : "B";
+			if(*view_format == '@' || *view_format == '=' || *view_format == '<') ++view_format;
+			const bool format_ok = (format == 'f' && *view_format == 'f') || (format == 'i' && (*view_format == 'i' || *view_format == 'l') && view_.itemsize == 4);
+			if(!format_ok || view_.itemsize != 4 || (view_.len / view_.itemsize) % num_components_ != 0)
+			{
+				if(format == 'i') PyErr_SetString(PyExc_TypeError, "Need a contiguous int32 buffer with 3 indices per triangle.");
+				else if(num_components_ == 12) PyErr_SetString(PyExc_TypeError, "Need a contiguous float32 buffer with 12 values (the 3 first rows of the 4x4 matrix) per instance.");
+				else PyErr_SetString(PyExc_TypeError, "Need a contiguous float32 buffer with 3 (vertices, normals) or 2 (uvs) values per element.");
+				return;
+			}
+			valid_ = true;
+		}
+		~BulkBuffer() { if(acquired_) PyBuffer_Release(&view_); }
+		bool valid() const { return valid_; }
+		const void *data() const { return view_.buf; }
+		unsigned int numElements() const { return static_cast<unsigned int>(view_.len / view_.itemsize / num_components_); }
+
+	private:
+		Py_buffer view_;
+		size_t num_components_;
+		bool acquired_ = false;
+		bool valid_ = false;
+};
+
 END_YAFARAY
 
 %}
@@ -514,15 +773,110 @@ END_YAFARAY
 	$1 = $input;
 }
 
+%exception yafaray4::Interface::addVertices { $action if(PyErr_Occurred()) SWIG_fail; }
+%exception yafaray4::Interface::addNormals { $action if(PyErr_Occurred()) SWIG_fail; }
+%exception yafaray4::Interface::addFaces { $action if(PyErr_Occurred()) SWIG_fail; }
+%exception yafaray4::Interface::addUvs { $action if(PyErr_Occurred()) SWIG_fail; }
+%exception yafaray4::Interface::addInstances { $action if(PyErr_Occurred()) SWIG_fail; }
+%exception yafaray4::Interface::addImageBuffer { $action if(PyErr_Occurred()) SWIG_fail; }
+%newobject yafaray4::Interface::renderAsync;
+
 %extend yafaray4::Interface
 {
+	/* Bulk mesh ingestion from objects supporting the Python buffer protocol (numpy arrays, array.array, memoryview...).
+	 * Buffers must be C-contiguous: float32 for vertices, orco, normals and uvs, int32 for the indices */
+	int addVertices(PyObject *vertices, PyObject *orco = nullptr)
+	{
+		BulkBuffer vertices_buffer(vertices, 'f', 3);
+		if(!vertices_buffer.valid()) return -1;
+		if(orco && orco != Py_None)
+		{
+			BulkBuffer orco_buffer(orco, 'f', 3);
+			if(!orco_buffer.valid() || orco_buffer.numElements() != vertices_buffer.numElements()) return -1;
+			return self->addVertices(static_cast<const float *>(vertices_buffer.data()), vertices_buffer.numElements(), static_cast<const float *>(orco_buffer.data()));
+		}
+		return self->addVertices(static_cast<const float *>(vertices_buffer.data()), vertices_buffer.numElements());
+	}
+
+	void addNormals(PyObject *normals)
+	{
+		BulkBuffer normals_buffer(normals, 'f', 3);
+		if(normals_buffer.valid()) self->addNormals(static_cast<const float *>(normals_buffer.data()), normals_buffer.numElements());
+	}
+
+	bool addFaces(PyObject *vert_indices, PyObject *uv_indices = nullptr)
+	{
+		BulkBuffer vert_indices_buffer(vert_indices, 'i', 3);
+		if(!vert_indices_buffer.valid()) return false;
+		if(uv_indices && uv_indices != Py_None)
+		{
+			BulkBuffer uv_indices_buffer(uv_indices, 'i', 3);
+			if(!uv_indices_buffer.valid() || uv_indices_buffer.numElements() != vert_indices_buffer.numElements()) return false;
+			return self->addFaces(static_cast<const int *>(vert_indices_buffer.data()), vert_indices_buffer.numElements(), static_cast<const int *>(uv_indices_buffer.data()));
+		}
+		return self->addFaces(static_cast<const int *>(vert_indices_buffer.data()), vert_indices_buffer.numElements());
+	}
+
+	int addUvs(PyObject *uvs)
+	{
+		BulkBuffer uvs_buffer(uvs, 'f', 2);
+		if(!uvs_buffer.valid()) return -1;
+		return self->addUvs(static_cast<const float *>(uvs_buffer.data()), uvs_buffer.numElements());
+	}
+
+	/* Bulk instancing, obj_to_world being a float32 buffer with the 3 first rows of the matrix of each instance, for example a numpy array of shape (N, 3, 4) */
+	bool addInstances(const char *base_object_name, PyObject *obj_to_world)
+	{
+		BulkBuffer obj_to_world_buffer(obj_to_world, 'f', 12);
+		if(!obj_to_world_buffer.valid()) return false;
+		return self->addInstances(base_object_name, static_cast<const float *>(obj_to_world_buffer.data()), obj_to_world_buffer.numElements());
+	}
+
+	/* Image pixels for the image textures with the "image_buffer" parameter, from a C-contiguous uint8 or float32 buffer with num_channels values per pixel,
+	 * for example a numpy array of shape (height, width, num_channels). The pixels are copied, so the buffer can be released after the call */
+	bool addImageBuffer(const char *name, PyObject *pixels, int width, int height, int num_channels, bool bottom_up = false)
+	{
+		Py_buffer view;
+		if(PyObject_GetBuffer(pixels, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) return false; //Python exception already set
+		const char *view_format = view.format ? view.format : "B";
+		if(*view_format == '@' || *view_format == '=' || *view_format == '<') ++view_format;
+		const bool float_data = *view_format == 'f' && view.itemsize == 4;
+		const bool byte_data = *view_format == 'B' && view.itemsize == 1;
+		if((!float_data && !byte_data) || width <= 0 || height <= 0 || view.len != static_cast<Py_ssize_t>(width) * height * num_channels * view.itemsize)
+		{
+			PyBuffer_Release(&view);
+			PyErr_SetString(PyExc_TypeError, "Need a contiguous uint8 or float32 buffer with width * height * num_channels values.");
+			return false;
+		}
+		const long long row_stride = static_cast<long long>(width) * num_channels * view.itemsize;
+		const char *first_row = static_cast<const char *>(view.buf) + (bottom_up ? (height - 1) * row_stride : 0);
+		const bool result = self->addImageBuffer(name, first_row, width, height, num_channels, float_data, bottom_up ? -row_stride : row_stride, false);
+		PyBuffer_Release(&view);
+		return result;
+	}
+
 	void render(PyObject *py_progress_callback)
 	{
 		auto pbar_wrap = std::unique_ptr<YafPyProgress>(new YafPyProgress(py_progress_callback));
 		//if(Y_LOG_HAS_DEBUG) Y_DEBUG PR(py_progress_callback) PREND;
 		Py_BEGIN_ALLOW_THREADS;
+		//The callbacks of the render threads are delivered by the dispatcher thread, which needs the GIL released until it ends
+		PythonCallbackDispatcher::get().start();
 		self->render(pbar_wrap.get());
+		PythonCallbackDispatcher::get().stop();
+		Py_END_ALLOW_THREADS;
+	}
+
+	//! starts the render in its own thread. The callbacks of the render threads are delivered by the dispatcher thread until the job is waited for or deleted
+	RenderJob *renderAsync(PyObject *py_progress_callback = nullptr)
+	{
+		auto pbar_wrap = new YafPyProgress(py_progress_callback, true);
+		RenderJob *job = nullptr;
+		Py_BEGIN_ALLOW_THREADS;
+		PythonCallbackDispatcher::get().start();
+		job = self->renderAsync(pbar_wrap, true);
 		Py_END_ALLOW_THREADS;
+		return job;
 	}
 }
 
@@ -531,6 +885,7 @@ END_YAFARAY
 %{
 #include "constants.h"
 #include "interface/interface.h"
+#include "interface/render_job.h"
 #include "export/export_xml.h"
 #include "output/output_image.h"
 #include "output/output_memory.h"
@@ -567,6 +922,8 @@ namespace yafaray4
 		public:
 		PythonOutput(int width, int height, int border_x, int border_y, bool preview, const std::string &color_space, float gamma, bool with_alpha, bool alpha_premultiply);
 		void setRenderCallbacks(PyObject *py_draw_area_callback, PyObject *py_flush_callback);
+		void setAreaReadyCallback(PyObject *py_area_ready_callback);
+		PyObject *getLayerBuffers(const std::string &view_name);
 		void setLoggingParams(const ParamMap &params) override;
 		void setBadgeParams(const ParamMap &params) override;
 		virtual ~PythonOutput() override;
@@ -603,6 +960,63 @@ namespace yafaray4
 		float getVal(int row, int col) { return matrix_[row][col]; }
 	};
 
+	//! Render started by Interface::renderAsync, the areas are polled with pollArea
+	class RenderJob
+	{
+		public:
+#ifndef SWIGPYTHON // Python gets versions releasing the GIL while they block, see the RenderJob extension below
+		~RenderJob();
+		void wait();
+		bool waitPass(int pass);
+#endif
+		bool finished() const;
+		void cancel();
+		int completedPasses() const;
+		bool areasDropped();
+	};
+
+#ifdef SWIGPYTHON  // Begining of python specific code
+	%extend RenderJob
+	{
+		/* The render threads deliver their callbacks through the dispatcher thread, which takes the GIL, so the GIL is released while
+		 * waiting for them. The dispatcher is stopped once the render has ended, delivering its last callbacks */
+		~RenderJob()
+		{
+			Py_BEGIN_ALLOW_THREADS;
+			delete self;
+			PythonCallbackDispatcher::get().stop();
+			Py_END_ALLOW_THREADS;
+		}
+
+		void wait()
+		{
+			Py_BEGIN_ALLOW_THREADS;
+			self->wait();
+			PythonCallbackDispatcher::get().stop();
+			Py_END_ALLOW_THREADS;
+		}
+
+		bool waitPass(int pass)
+		{
+			bool completed = false;
+			Py_BEGIN_ALLOW_THREADS;
+			completed = self->waitPass(pass);
+			Py_END_ALLOW_THREADS;
+			return completed;
+		}
+
+		//! next area finished by the render threads as a (x_0, y_0, x_1, y_1) tuple, or None when there are none left
+		PyObject *pollArea()
+		{
+			int x_0, y_0, x_1, y_1;
+			if(!self->pollArea(x_0, y_0, x_1, y_1)) Py_RETURN_NONE;
+			return Py_BuildValue("(iiii)", x_0, y_0, x_1, y_1);
+		}
+	}
+#endif //SWIGPYTHON  // End of python specific code
+
+	%newobject Interface::renderAsync;
+
 	// Interfaces
 	class Interface
 	{
@@ -620,8 +1034,19 @@ namespace yafaray4
 		virtual bool addFace(int a, int b, int c); //!< add a triangle given vertex indices and material pointer
 		virtual bool addFace(int a, int b, int c, int uv_a, int uv_b, int uv_c); //!< add a triangle given vertex and uv indices and material pointer
 		virtual int  addUv(float u, float v); //!< add a UV coordinate pair; returns index to be used for addTriangle
+#ifndef SWIGPYTHON // Python gets buffer protocol versions of these, see the Interface extension above
+		virtual int  addVertices(const float *vertices, unsigned int num_vertices, const float *orco = nullptr); //!< add num_vertices vertices (and optionally their Orco) from contiguous x, y, z buffers; returns the index of the first one
+		virtual void addNormals(const float *normals, unsigned int num_normals); //!< add num_normals vertex normals from a contiguous x, y, z buffer
+		virtual bool addFaces(const int *vert_indices, unsigned int num_faces, const int *uv_indices = nullptr); //!< add num_faces triangles from contiguous buffers of 3 vertex (and optionally 3 uv) indices per triangle
+		virtual int  addUvs(const float *uvs, unsigned int num_uvs); //!< add num_uvs UV coordinate pairs from a contiguous u, v buffer; returns the index of the first one
+#endif
 		virtual bool smoothMesh(const char *name, double angle); //!< smooth vertex normals of mesh with given ID and angle (in degrees)
 		virtual bool addInstance(const char *base_object_name, const Matrix4 &obj_to_world);
+#ifndef SWIGPYTHON // Python gets a buffer protocol version, see the Interface extension above
+		virtual bool addInstances(const char *base_object_name, const float *obj_to_world, unsigned int num_instances); //!< add num_instances instances of the base object from a contiguous buffer with the 3 first rows of the matrix of each instance (12 floats per instance, row-major)
+#endif
+		virtual bool updateInstance(const char *base_object_name, unsigned int instance_number, const Matrix4 &obj_to_world); //!< transform-only update of the instance_number-th instance added for the base object, refitting the accelerator instead of rebuilding it when possible
+		virtual bool addObjectLod(const char *base_object_name, const char *lod_object_name, float max_screen_size); //!< the instances of the base object projecting on at most max_screen_size pixels in the camera use the lod object instead
 		// functions to build paramMaps instead of passing them from Blender
 		// (decouling implementation details of STL containers, paraMap_t etc. as much as possible)
 		virtual void paramsSetVector(const char *name, double x, double y, double z);
@@ -643,18 +1068,25 @@ namespace yafaray4
 		virtual Object *createObject(const char *name);
 		virtual Light *createLight(const char *name);
 		virtual Texture *createTexture(const char *name);
+		virtual bool addImageBuffer(const char *name, const void *data, int width, int height, int num_channels, bool float_data, long long row_stride, bool reference_host_memory = false);
 		virtual Material *createMaterial(const char *name);
 		virtual Camera *createCamera(const char *name);
 		virtual Background *createBackground(const char *name);
 		virtual Integrator *createIntegrator(const char *name);
 		virtual VolumeRegion *createVolumeRegion(const char *name);
 		virtual RenderView *createRenderView(const char *name);
+		virtual Camera *updateCamera(const char *name); //!< replace the camera with the current parameters for an interactive re-render
+		virtual Material *updateMaterial(const char *name); //!< replace the material with the current parameters for an interactive re-render
+		virtual Light *updateLight(const char *name); //!< replace the light with the current parameters for an interactive re-render
 		virtual ColorOutput *createOutput(const char *name, bool auto_delete = true); //!< ColorOutput creation, usually for internally-owned outputs that are destroyed when the scene is deleted or when libYafaRay instance is closed. If the client wants to keep ownership, it can set the "auto_delete" to false.
 		virtual ColorOutput *createOutput(const char *name, ColorOutput *output, bool auto_delete = false); //!< ColorOutput creation, usually for externally client-owned and client-supplied outputs that are *NOT* destroyed when the scene is deleted or when libYafaRay instance is closed. If the client wants to transfer ownership to libYafaRay, it can set the "auto_delete" to true.
 		bool removeOutput(const char *name);
 		virtual void clearOutputs();
 		virtual void clearAll();
 		virtual void render(ProgressBar *pb = nullptr, bool auto_delete_progress_bar = false); //!< render the scene...
+#ifndef SWIGPYTHON // Python gets a version delivering the callbacks with the dispatcher thread, see the Interface extension above
+		RenderJob *renderAsync(ProgressBar *pb = nullptr, bool auto_delete_progress_bar = false); //!< starts the render in its own thread, deleting the job waits for the render to end
+#endif
 		virtual void defineLayer(const std::string &layer_type_name, const std::string &exported_image_type_name, const std::string &exported_image_name, const std::string &image_type_name = "");
 		virtual bool setupLayersParameters();
 		virtual void abort();
@@ -665,6 +1097,9 @@ namespace yafaray4
 		void setConsoleVerbosityLevel(const std::string &str_v_level);
 		void setLogVerbosityLevel(const std::string &str_v_level);
 		std::string getVersion() const; //!< Get version to check against the exporters
+		std::string getAcceleratorStatsJson() const; //!< accelerator build and traversal counters of the last render, in JSON format
+		std::string getMemoryStatsJson() const; //!< current and peak memory of each subsystem since the start of the last render, in JSON format
+		std::string getRenderProgressStatsJson() const; //!< rays per second, samples, estimated time left, render threads utilization and current memory of the render in progress, in JSON format. Thread safe, can be polled while rendering
 
 		/*! Console Printing wrappers to report in color with yafaray's own console coloring */
 		void printDebug(const std::string &msg) const;
@@ -689,17 +1124,27 @@ namespace yafaray4
 		virtual unsigned int getNextFreeId() override;
 		virtual bool endObject() override;
 		virtual bool addInstance(const char *base_object_name, const Matrix4 &obj_to_world) override;
+		virtual bool addInstances(const char *base_object_name, const float *obj_to_world, unsigned int num_instances) override;
+		virtual bool updateInstance(const char *base_object_name, unsigned int instance_number, const Matrix4 &obj_to_world) override;
+		virtual bool addObjectLod(const char *base_object_name, const char *lod_object_name, float max_screen_size) override;
 		virtual int  addVertex(double x, double y, double z) override; //!< add vertex to mesh; returns index to be used for addTriangle
 		virtual int  addVertex(double x, double y, double z, double ox, double oy, double oz) override; //!< add vertex with Orco to mesh; returns index to be used for addTriangle
 		virtual void addNormal(double nx, double ny, double nz) override; //!< add vertex normal to mesh; the vertex that will be attached to is the last one inserted by addVertex method
 		virtual bool addFace(int a, int b, int c) override;
 		virtual bool addFace(int a, int b, int c, int uv_a, int uv_b, int uv_c) override;
 		virtual int  addUv(float u, float v) override;
+#ifndef SWIGPYTHON
+		virtual int  addVertices(const float *vertices, unsigned int num_vertices, const float *orco = nullptr) override;
+		virtual void addNormals(const float *normals, unsigned int num_normals) override;
+		virtual bool addFaces(const int *vert_indices, unsigned int num_faces, const int *uv_indices = nullptr) override;
+		virtual int  addUvs(const float *uvs, unsigned int num_uvs) override;
+#endif
 		virtual bool smoothMesh(const char *name, double angle) override;
 		virtual void setCurrentMaterial(const char *name) override;
 		virtual Object *createObject(const char *name) override;
 		virtual Light *createLight(const char *name) override;
 		virtual Texture *createTexture(const char *name) override;
+		virtual bool addImageBuffer(const char *name, const void *data, int width, int height, int num_channels, bool float_data, long long row_stride, bool reference_host_memory = false) override;
 		virtual Material *createMaterial(const char *name) override;
 		virtual Camera *createCamera(const char *name) override;
 		virtual Background *createBackground(const char *name) override;
@@ -711,6 +1156,7 @@ namespace yafaray4
 		virtual void clearOutputs() override { }
 		virtual void render(ProgressBar *pb = nullptr, bool auto_delete_progress_bar = false) override; //!< render the scene...
 		void setXmlColorSpace(std::string color_space_string, float gamma_val);
+		void setBinaryGeometry(bool binary_geometry);
 	};
 
 }
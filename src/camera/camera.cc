@@ -70,4 +70,22 @@ Camera::Camera(const Point3 &pos, const Point3 &look, const Point3 &up, int resx
 	far_clip_ = far_clip_distance;
 }
 
+void Camera::shootRays(const CameraRaySample *samples, size_t num_samples, DiffRay *rays, float *weights, bool differentials) const
+{
+	for(size_t i = 0; i < num_samples; ++i)
+	{
+		const CameraRaySample &sample = samples[i];
+		rays[i] = shootRay(sample.px_, sample.py_, sample.lens_u_, sample.lens_v_, weights[i]);
+		if(!differentials || weights[i] == 0.f) continue;
+		float wt_dummy;
+		const Ray x_ray = shootRay(sample.px_ + 1.f, sample.py_, sample.lens_u_, sample.lens_v_, wt_dummy);
+		rays[i].xfrom_ = x_ray.from_;
+		rays[i].xdir_ = x_ray.dir_;
+		const Ray y_ray = shootRay(sample.px_, sample.py_ + 1.f, sample.lens_u_, sample.lens_v_, wt_dummy);
+		rays[i].yfrom_ = y_ray.from_;
+		rays[i].ydir_ = y_ray.dir_;
+		rays[i].has_differentials_ = true;
+	}
+}
+
 END_YAFARAY
@@ -61,6 +61,27 @@ Ray OrthographicCamera::shootRay(float px, float py, float lu, float lv, float &
 	return ray;
 }
 
+void OrthographicCamera::shootRays(const CameraRaySample *samples, size_t num_samples, DiffRay *rays, float *weights, bool differentials) const
+{
+	//All the rays are parallel, so the rays of the next pixels only start one step of the image plane axes away
+	const float tmin = rayPlaneIntersection_global(Ray(pos_, vto_), near_plane_);
+	const float tmax = rayPlaneIntersection_global(Ray(pos_, vto_), far_plane_);
+	for(size_t i = 0; i < num_samples; ++i)
+	{
+		const CameraRaySample &sample = samples[i];
+		weights[i] = 1.f;
+		DiffRay &ray = rays[i];
+		ray = DiffRay(pos_ + vright_ * sample.px_ + vup_ * sample.py_, vto_);
+		ray.tmin_ = tmin;
+		ray.tmax_ = tmax;
+		if(!differentials) continue;
+		ray.xfrom_ = ray.from_ + vright_;
+		ray.yfrom_ = ray.from_ + vup_;
+		ray.xdir_ = ray.ydir_ = vto_;
+		ray.has_differentials_ = true;
+	}
+}
+
 Point3 OrthographicCamera::screenproject(const Point3 &p) const
 {
 	Point3 s;
@@ -146,6 +146,44 @@ Ray PerspectiveCamera::shootRay(float px, float py, float lu, float lv, float &w
 	return ray;
 }
 
+void PerspectiveCamera::shootRays(const CameraRaySample *samples, size_t num_samples, DiffRay *rays, float *weights, bool differentials) const
+{
+	for(size_t i = 0; i < num_samples; ++i)
+	{
+		const CameraRaySample &sample = samples[i];
+		weights[i] = 1.f;
+		DiffRay &ray = rays[i];
+		ray = DiffRay();
+		ray.from_ = position_;
+		//The directions to the next pixels only differ in one step of the image plane axes, from the same lens point
+		const Vec3 dir = vright_ * sample.px_ + vup_ * sample.py_ + vto_;
+		ray.dir_ = dir;
+		ray.dir_.normalize();
+		ray.tmin_ = rayPlaneIntersection_global(ray, near_plane_);
+		ray.tmax_ = rayPlaneIntersection_global(ray, far_plane_);
+		if(differentials)
+		{
+			ray.xdir_ = (dir + vright_).normalize();
+			ray.ydir_ = (dir + vup_).normalize();
+			ray.has_differentials_ = true;
+		}
+		if(aperture_ != 0.f)
+		{
+			float u, v;
+			getLensUv(sample.lens_u_, sample.lens_v_, u, v);
+			const Vec3 li = dof_rt_ * u + dof_up_ * v;
+			ray.from_ += Point3(li);
+			ray.dir_ = ((ray.dir_ * dof_distance_) - li).normalize();
+			if(differentials)
+			{
+				ray.xdir_ = ((ray.xdir_ * dof_distance_) - li).normalize();
+				ray.ydir_ = ((ray.ydir_ * dof_distance_) - li).normalize();
+			}
+		}
+		ray.xfrom_ = ray.yfrom_ = ray.from_;
+	}
+}
+
 Point3 PerspectiveCamera::screenproject(const Point3 &p) const
 {
 	const Vec3 dir = p - position_;
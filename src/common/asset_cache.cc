@@ -0,0 +1,117 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/asset_cache.h"
+#include "common/file.h"
+#include "common/logger.h"
+#include <sstream>
+#include <iomanip>
+#include <random>
+
+BEGIN_YAFARAY
+
+static uint64_t hashBytes_global(const char *data, uint64_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for(uint64_t i = 0; i < size; ++i)
+	{
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string AssetCache::getContentKey(const char *data, uint64_t size)
+{
+	std::stringstream content_key;
+	content_key << std::hex << std::setw(16) << std::setfill('0') << hashBytes_global(data, size) << std::dec << "-" << size;
+	return content_key.str();
+}
+
+std::string AssetCache::getCachedPath(const std::string &cache_dir, const std::string &content_key, const std::string &extension)
+{
+	return cache_dir + "/" + content_key + (extension.empty() ? "" : "." + extension);
+}
+
+std::string AssetCache::getIndexedContentKey(const std::string &index_path, const std::string &index_key)
+{
+	//The index file has the index key in its first line, to tell apart the index keys with the same hash, and the content key in the second one
+	const MappedFile index_file(index_path);
+	if(!index_file.isOpen()) return "";
+	const std::string index(index_file.data(), index_file.size());
+	const size_t line_end = index.find('\n');
+	if(line_end == std::string::npos || index.compare(0, line_end, index_key) != 0) return "";
+	return index.substr(line_end + 1);
+}
+
+std::string AssetCache::copyToCache(const std::string &cache_dir, const std::string &file_path, const std::string &extension)
+{
+	const MappedFile original_file(file_path);
+	if(!original_file.isOpen()) return "";
+	const std::string content_key = getContentKey(original_file.data(), original_file.size());
+	const std::string cached_path = getCachedPath(cache_dir, content_key, extension);
+	if(File::exists(cached_path, true)) return content_key;
+	//Written to a temporary file renamed at the end, so the other processes sharing the cache never see partial copies
+	const std::string temp_path = cached_path + "." + std::to_string(std::random_device()()) + ".tmp";
+	File temp_file(temp_path);
+	bool result = temp_file.open("wb") && temp_file.append<char>(original_file.data(), static_cast<size_t>(original_file.size()));
+	temp_file.close();
+	if(!result || !File::rename(temp_path, cached_path, true, true))
+	{
+		File::remove(temp_path, true);
+		return "";
+	}
+	return content_key;
+}
+
+std::string AssetCache::getLocalPath(const std::string &cache_dir, const std::string &file_path, const std::string &content_key)
+{
+	if(cache_dir.empty()) return file_path;
+	const std::string extension = Path(file_path).getExtension();
+	if(!content_key.empty())
+	{
+		const std::string cached_path = getCachedPath(cache_dir, content_key, extension);
+		if(File::exists(cached_path, true)) return cached_path;
+	}
+	uint64_t file_size = 0;
+	int64_t modification_time = 0;
+	if(!File::getInfo(file_path, file_size, modification_time)) return file_path; //neither cached nor readable, the caller reports the missing file
+	std::stringstream index_key_stream;
+	index_key_stream << file_path << "|" << file_size << "|" << modification_time;
+	const std::string index_key = index_key_stream.str();
+	const std::string index_path = cache_dir + "/" + getContentKey(index_key.data(), index_key.size()) + ".index";
+	std::string cached_content_key = getIndexedContentKey(index_path, index_key);
+	if(!cached_content_key.empty())
+	{
+		const std::string cached_path = getCachedPath(cache_dir, cached_content_key, extension);
+		if(File::exists(cached_path, true)) return cached_path;
+	}
+	cached_content_key = copyToCache(cache_dir, file_path, extension);
+	if(cached_content_key.empty())
+	{
+		Y_WARNING << "AssetCache: could not copy '" << file_path << "' to the cache directory '" << cache_dir << "', using the original file" << YENDL;
+		return file_path;
+	}
+	if(!content_key.empty() && content_key != cached_content_key) Y_WARNING << "AssetCache: the contents of '" << file_path << "' do not match the expected content key '" << content_key << "', using the current contents" << YENDL;
+	File index_file(index_path);
+	index_file.save(index_key + "\n" + cached_content_key, true);
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "AssetCache: copied '" << file_path << "' to the cache as '" << cached_content_key << "'" << YENDL;
+	return getCachedPath(cache_dir, cached_content_key, extension);
+}
+
+END_YAFARAY
@@ -78,10 +78,10 @@ std::string Badge::getRenderInfo(const RenderControl &render_control) const
 	if(!YAFARAY_BUILD_PLATFORM.empty()) compiler = YAFARAY_BUILD_PLATFORM + "-" + YAFARAY_BUILD_COMPILER;
 	ss_badge << "\nYafaRay (" << YAFARAY_BUILD_VERSION << ")" << " " << YAFARAY_BUILD_OS << " " << YAFARAY_BUILD_ARCHITECTURE << " (" << compiler << ")";
 	ss_badge << std::setprecision(2);
-	double times = g_timer_global.getTimeNotStopping("rendert");
-	if(render_control.finished()) times = g_timer_global.getTime("rendert");
+	double times = render_control.getTimer().getTimeNotStopping("rendert");
+	if(render_control.finished()) times = render_control.getTimer().getTime("rendert");
 	int timem, timeh;
-	g_timer_global.splitTime(times, &times, &timem, &timeh);
+	Timer::splitTime(times, &times, &timem, &timeh);
 	ss_badge << " | " << image_width_ << "x" << image_height_;
 	if(render_control.inProgress()) ss_badge << " | " << (render_control.resumed() ? "film loaded + " : "") << "in progress " << std::fixed << std::setprecision(1) << render_control.currentPassPercent() << "% of pass: " << render_control.currentPass() << " / " << render_control.totalPasses();
 	else if(render_control.aborted()) ss_badge << " | " << (render_control.resumed() ? "film loaded + " : "") << "stopped at " << std::fixed << std::setprecision(1) << render_control.currentPassPercent() << "% of pass: " << render_control.currentPass() << " / " << render_control.totalPasses();
@@ -97,9 +97,9 @@ std::string Badge::getRenderInfo(const RenderControl &render_control) const
 	if(timem > 0) ss_badge << " " << timem << "m";
 	ss_badge << " " << times << "s";
 
-	times = g_timer_global.getTimeNotStopping("rendert") + g_timer_global.getTime("prepass");
-	if(render_control.finished()) times = g_timer_global.getTime("rendert") + g_timer_global.getTime("prepass");
-	g_timer_global.splitTime(times, &times, &timem, &timeh);
+	times = render_control.getTimer().getTimeNotStopping("rendert") + render_control.getTimer().getTime("prepass");
+	if(render_control.finished()) times = render_control.getTimer().getTime("rendert") + render_control.getTimer().getTime("prepass");
+	Timer::splitTime(times, &times, &timem, &timeh);
 	ss_badge << " | Total time:";
 	if(timeh > 0) ss_badge << " " << timeh << "h";
 	if(timem > 0) ss_badge << " " << timem << "m";
@@ -29,6 +29,9 @@
 #include <windows.h>
 #else //defined(_WIN32)
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif //defined(_WIN32)
 #include <iostream>
 #include <ctime>
@@ -172,8 +175,7 @@ bool File::read(std::string &str) const
 	char ch;
 	do
 	{
-		read(ch);
-		if(ch == 0x00) break;
+		if(!read(ch) || ch == 0x00) break;
 		else str += ch;
 	}
 	while(true);
@@ -183,8 +185,7 @@ bool File::read(std::string &str) const
 bool File::read(char *buffer, size_t size) const
 {
 	if(!fp_) return false;
-	::fread(buffer, 1, size, fp_);
-	return true;
+	return ::fread(buffer, 1, size, fp_) == size;
 }
 
 bool File::append(const std::string &str)
@@ -196,8 +197,17 @@ bool File::append(const std::string &str)
 bool File::append(const char *buffer, size_t size)
 {
 	if(!fp_) return false;
-	std::fwrite(buffer, 1, size, fp_);
-	return true;
+	return std::fwrite(buffer, 1, size, fp_) == size;
+}
+
+bool File::seek(uint64_t position)
+{
+	if(!fp_) return false;
+#if defined(_WIN32)
+	return _fseeki64(fp_, static_cast<__int64>(position), SEEK_SET) == 0;
+#else //defined(_WIN32)
+	return fseeko(fp_, static_cast<off_t>(position), SEEK_SET) == 0;
+#endif //defined(_WIN32)
 }
 
 int File::close()
@@ -264,6 +274,21 @@ bool File::exists(const std::string &path, bool files_only)
 	else return errno != ENOENT;
 }
 
+bool File::getInfo(const std::string &path, uint64_t &size, int64_t &modification_time)
+{
+#if defined(_WIN32)
+	struct _stat64 buf;
+	if(::_wstat64(utf8ToWutf16Le_global(path).c_str(), &buf) != 0) return false;
+#else //_WIN32
+	struct ::stat buf;
+	if(::stat(path.c_str(), &buf) != 0) return false;
+#endif //_WIN32
+	if((buf.st_mode & S_IFMT) != S_IFREG) return false;
+	size = static_cast<uint64_t>(buf.st_size);
+	modification_time = static_cast<int64_t>(buf.st_mtime);
+	return true;
+}
+
 std::vector<std::string> File::listFiles(const std::string &directory)
 {
 	std::vector<std::string> files;
@@ -301,4 +326,45 @@ std::vector<std::string> File::listFiles(const std::string &directory)
 	return files;
 }
 
+MappedFile::MappedFile(const std::string &path)
+{
+#if defined(_WIN32)
+	HANDLE file_handle = CreateFileW(utf8ToWutf16Le_global(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file_handle == INVALID_HANDLE_VALUE) return;
+	file_handle_ = file_handle;
+	LARGE_INTEGER file_size;
+	if(!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart <= 0) return;
+	HANDLE mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(!mapping_handle) return;
+	mapping_handle_ = mapping_handle;
+	data_ = static_cast<const char *>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	if(data_) size_ = static_cast<uint64_t>(file_size.QuadPart);
+#else //defined(_WIN32)
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0) return;
+	struct stat file_stat;
+	if(::fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+	{
+		void *data = ::mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		if(data != MAP_FAILED)
+		{
+			data_ = static_cast<const char *>(data);
+			size_ = static_cast<uint64_t>(file_stat.st_size);
+		}
+	}
+	::close(fd); //the mapping keeps its own reference to the file
+#endif //defined(_WIN32)
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(_WIN32)
+	if(data_) UnmapViewOfFile(data_);
+	if(mapping_handle_) CloseHandle(mapping_handle_);
+	if(file_handle_) CloseHandle(file_handle_);
+#else //defined(_WIN32)
+	if(data_) ::munmap(const_cast<char *>(data_), static_cast<size_t>(size_));
+#endif //defined(_WIN32)
+}
+
 END_YAFARAY
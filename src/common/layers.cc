@@ -115,6 +115,7 @@ std::map<std::string, Layer::Type> Layer::initMapTypeNamesTypes()
 	map_typename_type["debug-dudx-dvdx"] = Layer::DebugDudxDvdx;
 	map_typename_type["debug-dudy-dvdy"] = Layer::DebugDudyDvdy;
 	map_typename_type["debug-dudxy-dvdxy"] = Layer::DebugDudxyDvdxy;
+	map_typename_type["debug-render-time"] = Layer::DebugRenderTime;
 	return map_typename_type;
 }
 
@@ -163,7 +164,8 @@ Image::Type Layer::getDefaultImageType(const Type &type)
 		case ObjIndexNorm:
 		case MatIndexAbs:
 		case MatIndexNorm:
-		case VolumeTransmittance: return Image::Type::Gray;
+		case VolumeTransmittance:
+		case DebugRenderTime: return Image::Type::Gray;
 
 		case ObjIndexMask:
 		case ObjIndexMaskShadow:
@@ -205,7 +207,8 @@ bool Layer::applyColorSpace(const Type &type)
 		case MatIndexAbs:
 		case MatIndexAutoAbs:
 		case AaSamples:
-		case DebugSamplingFactor: return false;
+		case DebugSamplingFactor:
+		case DebugRenderTime: return false;
 		default: return true;
 	}
 }
@@ -265,12 +268,61 @@ Layer::Flags Layer::getFlags(const Type &type)
 		case DebugDpdxy:
 		case DebugDudxDvdx:
 		case DebugDudyDvdy:
-		case DebugDudxyDvdxy: return Layer::Flags::DebugLayers;
+		case DebugDudxyDvdxy:
+		case DebugRenderTime: return Layer::Flags::DebugLayers;
 
 		default: return Layer::Flags::BasicLayers;
 	}
 }
 
+bool Layer::allowsHalfFloat(const Type &type)
+{
+	switch(type)
+	{
+		case DiffuseColor:
+		case GlossyColor:
+		case TransColor:
+		case SubsurfaceColor:
+		case NormalSmooth:
+		case NormalGeom:
+		case Uv:
+		case BarycentricUvw:
+		case Ao:
+		case AoClay:
+		case ObjIndexNorm:
+		case ObjIndexAuto:
+		case MatIndexNorm:
+		case MatIndexAuto:
+		case ObjIndexMask:
+		case ObjIndexMaskShadow:
+		case ObjIndexMaskAll:
+		case MatIndexMask:
+		case MatIndexMaskShadow:
+		case MatIndexMaskAll:
+		case DebugWireframe:
+		case DebugFacesEdges:
+		case DebugObjectsEdges:
+		case Toon: return true;
+		default: return false;
+	}
+}
+
+bool Layer::isPointSampled(const Type &type)
+{
+	switch(type)
+	{
+		case ObjIndexAbs:
+		case ObjIndexNorm:
+		case ObjIndexAuto:
+		case ObjIndexAutoAbs:
+		case MatIndexAbs:
+		case MatIndexNorm:
+		case MatIndexAuto:
+		case MatIndexAutoAbs: return true;
+		default: return false;
+	}
+}
+
 std::string Layer::print() const
 {
 	std::stringstream ss;
@@ -27,6 +27,7 @@
 #include "color/color_console.h"
 #include <algorithm>
 #include <cmath>
+#include <chrono>
 
 BEGIN_YAFARAY
 
@@ -183,33 +184,266 @@ void Logger::clearAll()
 	image_path_.clear();
 }
 
-Logger &Logger::out(int verbosity_level)
+void LogStream::start(Logger *logger, int verbosity_level, bool enabled)
 {
+	if(enabled_ && stream_.tellp() > 0) finish(stream_.str()); //the previous message was not ended with YENDL
+	logger_ = logger;
+	verbosity_level_ = verbosity_level;
+	enabled_ = enabled;
+	if(enabled_) date_time_ = std::time(nullptr);
+}
+
+void LogStream::finish(std::string &&text)
+{
+	static const std::ostringstream default_format;
+	logger_->addMessage(verbosity_level_, date_time_, std::move(text));
+	stream_.str(std::string());
+	stream_.clear();
+	stream_.copyfmt(default_format); //so the manipulators of a message do not change the format of the next ones
+}
+
+LogStream &LogStream::operator<<(std::ostream &(*obj)(std::ostream &))
+{
+	if(!enabled_) return *this;
+	stream_ << obj;
+	std::string text = stream_.str();
+	if(!text.empty() && text.back() == '\n') finish(std::move(text)); //std::endl ends the message
+	return *this;
+}
+
+struct LogMessage
+{
+	int verbosity_level_;
+	std::time_t date_time_;
+	std::string text_;
+};
+
+//! Lock free queue of the messages of a thread, with a single producer (the thread) and a single consumer (the background thread)
+class LogRing final
+{
+	public:
+		bool push(LogMessage &&message); //!< false if full
+		bool pop(LogMessage &message); //!< false if empty
+		std::atomic<bool> in_use_ {false}; //!< owned by a thread. The rings of the finished threads are reused by the new ones
+
+	private:
+		static constexpr size_t capacity_ = 1024;
+		std::vector<LogMessage> slots_ = std::vector<LogMessage>(capacity_);
+		std::atomic<size_t> head_ {0}; //!< next slot to be written, only changed by the producer
+		std::atomic<size_t> tail_ {0}; //!< next slot to be read, only changed by the consumer
+};
+
+constexpr size_t LogRing::capacity_;
+
+bool LogRing::push(LogMessage &&message)
+{
+	const size_t head = head_.load(std::memory_order_relaxed);
+	if(head - tail_.load(std::memory_order_acquire) >= capacity_) return false;
+	slots_[head % capacity_] = std::move(message);
+	head_.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+bool LogRing::pop(LogMessage &message)
+{
+	const size_t tail = tail_.load(std::memory_order_relaxed);
+	if(tail == head_.load(std::memory_order_acquire)) return false;
+	message = std::move(slots_[tail % capacity_]);
+	tail_.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+struct Logger::AsyncState
+{
+	struct Repeats
+	{
+		int verbosity_level_;
+		int count_;
+	};
+	std::atomic<bool> enabled_ {false};
+	std::mutex control_mutex_; //!< for startAsync() and stopAsync()
+	int nesting_ = 0;
+	std::thread thread_;
+	std::mutex wake_mutex_;
+	std::condition_variable wake_;
+	bool stop_ = false;
+	std::mutex rings_mutex_; //!< locked by the threads only to get their ring, once per thread
+	std::vector<std::unique_ptr<LogRing>> rings_;
+	std::atomic<uint64_t> rate_limited_ {0}; //!< messages discarded by the rate limit since the last summary
+	std::atomic<uint64_t> dropped_ {0}; //!< messages discarded because the ring of their thread was full since the last summary
+	std::unordered_map<std::string, Repeats> repeats_; //!< messages written in the current window and their repetitions, keyed by the message text. Only used by the background thread
+	std::chrono::steady_clock::time_point window_start_;
+};
+
+//! Ring of the calling thread, released when the thread finishes
+struct LogThreadRing
+{
+	~LogThreadRing() { if(ring_) ring_->in_use_ = false; }
+	const Logger *logger_ = nullptr;
+	LogRing *ring_ = nullptr;
+	std::time_t rate_window_ = 0;
+	int rate_count_ = 0;
+};
+
+Logger::Logger() : async_(new AsyncState)
+{
+}
+
+Logger::~Logger()
+{
+	if(async_->thread_.joinable())
+	{
+		async_->nesting_ = 1;
+		stopAsync();
+	}
+}
+
+LogStream &Logger::out(int verbosity_level)
+{
+	thread_local LogStream log_stream;
+	log_stream.start(this, verbosity_level, verbosity_level <= console_master_verbosity_level_ || verbosity_level <= log_master_verbosity_level_);
+	return log_stream;
+}
+
+void Logger::addMessage(int verbosity_level, std::time_t date_time, std::string &&text)
+{
+	if(async_->enabled_.load(std::memory_order_acquire))
+	{
+		thread_local LogThreadRing thread_ring;
+		if(thread_ring.logger_ != this)
+		{
+			if(thread_ring.ring_) thread_ring.ring_->in_use_ = false;
+			thread_ring.ring_ = nullptr;
+			std::lock_guard<std::mutex> lock_guard(async_->rings_mutex_);
+			for(auto &ring : async_->rings_)
+			{
+				if(!ring->in_use_.exchange(true))
+				{
+					thread_ring.ring_ = ring.get();
+					break;
+				}
+			}
+			if(!thread_ring.ring_)
+			{
+				async_->rings_.emplace_back(new LogRing);
+				thread_ring.ring_ = async_->rings_.back().get();
+				thread_ring.ring_->in_use_ = true;
+			}
+			thread_ring.logger_ = this;
+		}
+		//The errors are never rate limited, they are rare and the reason of a failed render
+		if(async_rate_limit_ > 0 && verbosity_level != VlError)
+		{
+			if(date_time != thread_ring.rate_window_)
+			{
+				thread_ring.rate_window_ = date_time;
+				thread_ring.rate_count_ = 0;
+			}
+			if(++thread_ring.rate_count_ > async_rate_limit_)
+			{
+				async_->rate_limited_.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+		}
+		if(!thread_ring.ring_->push({verbosity_level, date_time, std::move(text)})) async_->dropped_.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
 #if !defined(_WIN32) || defined(__MINGW32__)
 	//Don't lock if building with Visual Studio because it cause hangs when executing YafaRay in Windows 7 for some weird reason!
 	std::lock_guard<std::mutex> lock_guard(mutx_);
-#else
 #endif
-	verbosity_level_ = verbosity_level;
+	writeMessage(verbosity_level, date_time, text);
+}
+
+void Logger::startAsync()
+{
+	std::lock_guard<std::mutex> lock_guard(async_->control_mutex_);
+	if(async_->nesting_++ > 0) return;
+	async_->stop_ = false;
+	async_->window_start_ = std::chrono::steady_clock::now();
+	async_->enabled_.store(true, std::memory_order_release);
+	async_->thread_ = std::thread([this]()
+	{
+		while(true)
+		{
+			{
+				std::unique_lock<std::mutex> lk(async_->wake_mutex_);
+				if(async_->wake_.wait_for(lk, std::chrono::milliseconds(50), [this] { return async_->stop_; })) break;
+			}
+			drainAsync();
+		}
+	});
+}
+
+void Logger::stopAsync()
+{
+	std::lock_guard<std::mutex> lock_guard(async_->control_mutex_);
+	if(async_->nesting_ == 0 || --async_->nesting_ > 0) return;
+	async_->enabled_.store(false, std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> lk(async_->wake_mutex_);
+		async_->stop_ = true;
+	}
+	async_->wake_.notify_one();
+	if(async_->thread_.joinable()) async_->thread_.join();
+	async_->window_start_ = std::chrono::steady_clock::time_point(); //so the last repetitions are summarized now
+	drainAsync();
+}
+
+void Logger::drainAsync()
+{
+	std::vector<LogMessage> messages;
+	{
+		std::lock_guard<std::mutex> lock_guard(async_->rings_mutex_);
+		LogMessage message;
+		for(auto &ring : async_->rings_)
+		{
+			while(ring->pop(message)) messages.push_back(std::move(message));
+		}
+	}
+	std::stable_sort(messages.begin(), messages.end(), [](const LogMessage &a, const LogMessage &b) { return a.date_time_ < b.date_time_; });
+
+	std::lock_guard<std::mutex> lock_guard(mutx_);
+	for(auto &message : messages)
+	{
+		const auto inserted = async_->repeats_.insert({message.text_, {message.verbosity_level_, 0}});
+		if(inserted.second) writeMessage(message.verbosity_level_, message.date_time_, message.text_);
+		else ++inserted.first->second.count_;
+	}
+	const auto now = std::chrono::steady_clock::now();
+	if(now - async_->window_start_ < std::chrono::seconds(1)) return;
 	const std::time_t current_datetime = std::time(nullptr);
+	for(const auto &repeats : async_->repeats_)
+	{
+		if(repeats.second.count_ > 0) writeMessage(repeats.second.verbosity_level_, current_datetime, "(repeated " + std::to_string(repeats.second.count_) + " more times) " + repeats.first);
+	}
+	async_->repeats_.clear();
+	const uint64_t rate_limited = async_->rate_limited_.exchange(0, std::memory_order_relaxed);
+	if(rate_limited > 0) writeMessage(VlWarning, current_datetime, "Logger: " + std::to_string(rate_limited) + " messages discarded by the limit of " + std::to_string(async_rate_limit_) + " messages per second and thread\n");
+	const uint64_t dropped = async_->dropped_.exchange(0, std::memory_order_relaxed);
+	if(dropped > 0) writeMessage(VlWarning, current_datetime, "Logger: " + std::to_string(dropped) + " messages discarded because the log queue was full\n");
+	async_->window_start_ = now;
+}
 
-	if(verbosity_level_ <= log_master_verbosity_level_)
+void Logger::writeMessage(int verbosity_level, std::time_t date_time, const std::string &text)
+{
+	if(verbosity_level <= log_master_verbosity_level_)
 	{
-		if(previous_log_event_date_time_ == 0) previous_log_event_date_time_ = current_datetime;
-		const double duration = std::difftime(current_datetime, previous_log_event_date_time_);
-		memory_log_.push_back(LogEntry(current_datetime, duration, verbosity_level_, ""));
-		previous_log_event_date_time_ = current_datetime;
+		if(previous_log_event_date_time_ == 0) previous_log_event_date_time_ = date_time;
+		const double duration = std::difftime(date_time, previous_log_event_date_time_);
+		memory_log_.push_back(LogEntry(date_time, duration, verbosity_level, text));
+		previous_log_event_date_time_ = date_time;
 	}
 
-	if(verbosity_level_ <= console_master_verbosity_level_)
+	if(verbosity_level <= console_master_verbosity_level_)
 	{
-		if(previous_console_event_date_time_ == 0) previous_console_event_date_time_ = current_datetime;
-		const double duration = std::difftime(current_datetime, previous_console_event_date_time_);
+		if(previous_console_event_date_time_ == 0) previous_console_event_date_time_ = date_time;
+		const double duration = std::difftime(date_time, previous_console_event_date_time_);
 		std::string date_time_str;
-		if(print_datetime_) date_time_str = "[" + Logger::printTime(current_datetime) + "] ";
+		if(print_datetime_) date_time_str = "[" + Logger::printTime(date_time) + "] ";
 		if(console_log_colors_enabled_)
 		{
-			switch(verbosity_level_)
+			switch(verbosity_level)
 			{
 				case VlDebug: std::cout << ConsoleColor(ConsoleColor::Magenta) << date_time_str << "DEBUG"; break;
 				case VlVerbose: std::cout << ConsoleColor(ConsoleColor::Green) << date_time_str << "VERB"; break;
@@ -222,7 +456,7 @@ Logger &Logger::out(int verbosity_level)
 		}
 		else
 		{
-			switch(verbosity_level_)
+			switch(verbosity_level)
 			{
 				case VlDebug: std::cout << date_time_str << "DEBUG"; break;
 				case VlVerbose: std::cout << date_time_str << "VERB"; break;
@@ -236,9 +470,9 @@ Logger &Logger::out(int verbosity_level)
 		if(duration == 0) std::cout << ": ";
 		else std::cout << " (" << Logger::printDurationSimpleFormat(duration) << "): ";
 		if(console_log_colors_enabled_) std::cout << ConsoleColor();
-		previous_console_event_date_time_ = current_datetime;
+		std::cout << text << std::flush;
+		previous_console_event_date_time_ = date_time;
 	}
-	return *this;
 }
 
 int Logger::vlevelFromString(std::string str_v_level)
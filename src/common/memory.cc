@@ -20,6 +20,12 @@
 #include "common/logger.h"
 #include "output/output.h"
 #include "render/monitor.h"
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 BEGIN_YAFARAY
 
@@ -38,4 +44,96 @@ void CustomDeleter<T>::operator()(T *object)
 template struct CustomDeleter<ColorOutput>;
 template struct CustomDeleter<ProgressBar>;
 
+static std::mutex huge_pages_mutex_global;
+static std::unordered_map<void *, size_t> huge_pages_mappings_global; //!< mapped size of each huge page block, to release only the blocks allocated by HugePages
+static constexpr size_t huge_page_size_global = 2 * 1024 * 1024;
+static constexpr size_t gigantic_page_size_global = 1024 * 1024 * 1024;
+
+HugePages::Mode HugePages::modeFromName(const std::string &mode_name)
+{
+	if(mode_name == "transparent") return Mode::Transparent;
+	else if(mode_name == "explicit") return Mode::Explicit;
+	if(mode_name != "none") Y_WARNING << "HugePages: unknown mode '" << mode_name << "', huge pages disabled" << YENDL;
+	return Mode::None;
+}
+
+std::string HugePages::modeName(Mode mode)
+{
+	if(mode == Mode::Transparent) return "transparent";
+	else if(mode == Mode::Explicit) return "explicit";
+	else return "none";
+}
+
+#if defined(__linux__)
+static void *mapHugePages_global(size_t bytes, HugePages::Mode mode, size_t &mapped_size)
+{
+	if(mode == HugePages::Mode::Explicit)
+	{
+#if defined(MAP_HUGETLB)
+		//Trying first the 1GB pages for the blocks big enough, then the 2MB pages
+		for(const size_t page_size : {gigantic_page_size_global, huge_page_size_global})
+		{
+			if(page_size == gigantic_page_size_global && bytes < gigantic_page_size_global) continue;
+			int page_flags = MAP_HUGETLB;
+#if defined(MAP_HUGE_SHIFT)
+			page_flags |= (page_size == gigantic_page_size_global ? 30 : 21) << MAP_HUGE_SHIFT;
+#endif
+			mapped_size = (bytes + page_size - 1) / page_size * page_size;
+			void *p = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | page_flags, -1, 0);
+			if(p != MAP_FAILED) return p;
+		}
+#endif
+		Y_VERBOSE << "HugePages: not enough reserved huge pages for " << bytes << " bytes, using transparent huge pages" << YENDL;
+	}
+	//Over-allocating to align the block to the huge page size, so the kernel can back it with huge pages from the start
+	const size_t size = (bytes + huge_page_size_global - 1) / huge_page_size_global * huge_page_size_global;
+	void *p = mmap(nullptr, size + huge_page_size_global, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED) return nullptr;
+	const uintptr_t start = reinterpret_cast<uintptr_t>(p);
+	const uintptr_t aligned = (start + huge_page_size_global - 1) & ~static_cast<uintptr_t>(huge_page_size_global - 1);
+	if(aligned > start) munmap(p, aligned - start);
+	const size_t tail = huge_page_size_global - (aligned - start);
+	if(tail > 0) munmap(reinterpret_cast<void *>(aligned + size), tail);
+#if defined(MADV_HUGEPAGE)
+	madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+#endif
+	mapped_size = size;
+	return reinterpret_cast<void *>(aligned);
+}
+#endif
+
+void *HugePages::allocate(size_t bytes, Mode mode)
+{
+	if(mode == Mode::None || bytes < minAllocationSize()) return nullptr;
+#if defined(__linux__)
+	size_t mapped_size = 0;
+	void *p = mapHugePages_global(bytes, mode, mapped_size);
+	if(!p) return nullptr;
+	std::lock_guard<std::mutex> lock_guard(huge_pages_mutex_global);
+	huge_pages_mappings_global[p] = mapped_size;
+	return p;
+#else
+	return nullptr;
+#endif
+}
+
+bool HugePages::deallocate(void *p, size_t bytes)
+{
+	if(!p || bytes < minAllocationSize()) return false;
+#if defined(__linux__)
+	size_t mapped_size = 0;
+	{
+		std::lock_guard<std::mutex> lock_guard(huge_pages_mutex_global);
+		const auto mapping = huge_pages_mappings_global.find(p);
+		if(mapping == huge_pages_mappings_global.end()) return false;
+		mapped_size = mapping->second;
+		huge_pages_mappings_global.erase(mapping);
+	}
+	munmap(p, mapped_size);
+	return true;
+#else
+	return false;
+#endif
+}
+
 END_YAFARAY
\ No newline at end of file
@@ -0,0 +1,125 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/memory_stats.h"
+#include <array>
+#include <atomic>
+#include <iomanip>
+#include <sstream>
+
+BEGIN_YAFARAY
+
+struct MemoryCounters
+{
+	std::atomic<int64_t> current_ {0};
+	std::atomic<int64_t> peak_ {0};
+	std::atomic<int64_t> count_ {0};
+};
+
+//! the last one is the total of all the categories
+static std::array<MemoryCounters, MemoryStats::NumCategories + 1> memory_counters_global;
+
+static void updatePeak_global(MemoryCounters &counters, int64_t current)
+{
+	int64_t peak = counters.peak_.load(std::memory_order_relaxed);
+	while(current > peak && !counters.peak_.compare_exchange_weak(peak, current, std::memory_order_relaxed)) { }
+}
+
+static MemoryStats::Usage getCounters_global(const MemoryCounters &counters)
+{
+	MemoryStats::Usage usage;
+	usage.current_ = counters.current_.load(std::memory_order_relaxed);
+	usage.peak_ = counters.peak_.load(std::memory_order_relaxed);
+	usage.count_ = counters.count_.load(std::memory_order_relaxed);
+	return usage;
+}
+
+void MemoryStats::add(Category category, int64_t bytes, int64_t count)
+{
+	MemoryCounters &counters = memory_counters_global[category];
+	MemoryCounters &total = memory_counters_global[NumCategories];
+	updatePeak_global(counters, counters.current_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+	updatePeak_global(total, total.current_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+	if(count != 0)
+	{
+		counters.count_.fetch_add(count, std::memory_order_relaxed);
+		total.count_.fetch_add(count, std::memory_order_relaxed);
+	}
+}
+
+MemoryStats::Usage MemoryStats::getUsage(Category category)
+{
+	return getCounters_global(memory_counters_global[category]);
+}
+
+MemoryStats::Usage MemoryStats::getTotal()
+{
+	return getCounters_global(memory_counters_global[NumCategories]);
+}
+
+std::string MemoryStats::getCategoryName(Category category)
+{
+	switch(category)
+	{
+		case Meshes: return "meshes";
+		case Accelerators: return "accelerators";
+		case Textures: return "textures";
+		case TextureTiles: return "texture_tiles";
+		case Photons: return "photons";
+		case ImageFilm: return "image_film";
+		case Volumes: return "volumes";
+		default: return "";
+	}
+}
+
+void MemoryStats::resetPeaks()
+{
+	for(auto &counters : memory_counters_global) counters.peak_.store(counters.current_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+std::string MemoryStats::toJson()
+{
+	std::stringstream ss;
+	ss << "{";
+	for(int category = 0; category <= NumCategories; ++category)
+	{
+		const Usage usage = (category == NumCategories) ? getTotal() : getUsage(static_cast<Category>(category));
+		if(category > 0) ss << ",";
+		ss << "\"" << (category == NumCategories ? std::string("total") : getCategoryName(static_cast<Category>(category))) << "\":{\"current_bytes\":" << usage.current_ << ",\"peak_bytes\":" << usage.peak_ << ",\"count\":" << usage.count_ << "}";
+	}
+	ss << "}";
+	return ss.str();
+}
+
+std::string MemoryStats::toString()
+{
+	const double mib = 1.0 / (1024.0 * 1024.0);
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	const Usage total = getTotal();
+	ss << "total " << total.current_ * mib << " MiB (peak " << total.peak_ * mib << " MiB)";
+	for(int category = 0; category < NumCategories; ++category)
+	{
+		const Usage usage = getUsage(static_cast<Category>(category));
+		if(usage.peak_ == 0) continue;
+		ss << ", " << getCategoryName(static_cast<Category>(category)) << " " << usage.current_ * mib << " MiB (peak " << usage.peak_ * mib << " MiB, " << usage.count_ << ")";
+	}
+	return ss.str();
+}
+
+END_YAFARAY
@@ -21,6 +21,8 @@
 #include "color/color.h"
 #include "geometry/matrix4.h"
 #include "common/logger.h"
+#include <algorithm>
+#include <cstring>
 
 BEGIN_YAFARAY
 
@@ -234,10 +236,25 @@ void ParamMap::printDebug() const
 }
 
 
-Parameter &ParamMap::operator[](const std::string &key) { return dicc_[key]; }
+static inline bool nameLess_global(const std::pair<std::string, Parameter> &param, const char *name) { return strcmp(param.first.c_str(), name) < 0; }
+
+const Parameter *ParamMap::find(const char *name) const
+{
+	const auto i = std::lower_bound(dicc_.begin(), dicc_.end(), name, nameLess_global);
+	if(i != dicc_.end() && i->first == name) return &i->second;
+	return nullptr;
+}
+
+Parameter &ParamMap::operator[](const std::string &key)
+{
+	auto i = std::lower_bound(dicc_.begin(), dicc_.end(), key.c_str(), nameLess_global);
+	if(i == dicc_.end() || i->first != key) i = dicc_.emplace(i, key, Parameter());
+	return i->second;
+}
+
 void ParamMap::clear() { dicc_.clear(); }
 
-std::map<std::string, Parameter>::const_iterator ParamMap::begin() const { return dicc_.begin(); }
-std::map<std::string, Parameter>::const_iterator ParamMap::end() const { return dicc_.end(); }
+ParamMap::Container::const_iterator ParamMap::begin() const { return dicc_.begin(); }
+ParamMap::Container::const_iterator ParamMap::end() const { return dicc_.end(); }
 
 END_YAFARAY
@@ -0,0 +1,139 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/render_stats.h"
+#include "common/thread.h"
+#include <set>
+#include <sstream>
+
+BEGIN_YAFARAY
+
+constexpr int RenderStats::num_buckets_;
+
+#ifdef RENDER_STATS
+
+/*! Slots of a thread, aligned to their own cache lines so the threads never write in the same cache line.
+	They are registered while the thread is alive and added to the pending counters when the thread ends */
+class alignas(64) RenderStatsThreadSlots final
+{
+	public:
+		RenderStatsThreadSlots();
+		~RenderStatsThreadSlots();
+		RenderStats stats_;
+};
+
+thread_local RenderStats *render_stats_thread_slots_global = nullptr;
+static std::mutex thread_slots_mutex_global;
+static std::set<RenderStatsThreadSlots *> thread_slots_global;
+static RenderStats finished_threads_stats_global; //!< counters of the threads ended since the previous pass
+static RenderStats render_total_global;
+
+RenderStatsThreadSlots::RenderStatsThreadSlots()
+{
+	std::lock_guard<std::mutex> lock_guard(thread_slots_mutex_global);
+	thread_slots_global.insert(this);
+}
+
+RenderStatsThreadSlots::~RenderStatsThreadSlots()
+{
+	std::lock_guard<std::mutex> lock_guard(thread_slots_mutex_global);
+	finished_threads_stats_global += stats_;
+	thread_slots_global.erase(this);
+	render_stats_thread_slots_global = nullptr;
+}
+
+RenderStats *RenderStats::registerThread()
+{
+	thread_local RenderStatsThreadSlots thread_slots;
+	render_stats_thread_slots_global = &thread_slots.stats_;
+	return render_stats_thread_slots_global;
+}
+
+RenderStats RenderStats::collectPass()
+{
+	std::lock_guard<std::mutex> lock_guard(thread_slots_mutex_global);
+	RenderStats result = finished_threads_stats_global;
+	finished_threads_stats_global = { };
+	for(auto &thread_slots : thread_slots_global)
+	{
+		result += thread_slots->stats_;
+		thread_slots->stats_ = { };
+	}
+	render_total_global += result;
+	return result;
+}
+
+RenderStats RenderStats::renderTotal()
+{
+	std::lock_guard<std::mutex> lock_guard(thread_slots_mutex_global);
+	return render_total_global;
+}
+
+void RenderStats::reset()
+{
+	std::lock_guard<std::mutex> lock_guard(thread_slots_mutex_global);
+	finished_threads_stats_global = { };
+	render_total_global = { };
+	for(auto &thread_slots : thread_slots_global) thread_slots->stats_ = { };
+}
+
+#else
+
+RenderStats *RenderStats::registerThread() { return nullptr; }
+RenderStats RenderStats::collectPass() { return { }; }
+RenderStats RenderStats::renderTotal() { return { }; }
+void RenderStats::reset() { }
+
+#endif //RENDER_STATS
+
+RenderStats &RenderStats::operator += (const RenderStats &stats)
+{
+	for(int counter = 0; counter < NumCounters; ++counter) counters_[counter] += stats.counters_[counter];
+	for(int histogram = 0; histogram < NumHistograms; ++histogram)
+	{
+		for(int bucket = 0; bucket < num_buckets_; ++bucket) histograms_[histogram][bucket] += stats.histograms_[histogram][bucket];
+	}
+	return *this;
+}
+
+std::string RenderStats::toJson() const
+{
+	static const char *counter_names[NumCounters] = { "camera_samples", "rays", "shadow_rays", "shadow_cache_hits", "bsdf_samples", "texture_lookups" };
+	static const char *histogram_names[NumHistograms] = { "path_bounces" };
+	std::stringstream json;
+	json << "{";
+	for(int counter = 0; counter < NumCounters; ++counter)
+	{
+		if(counter > 0) json << ", ";
+		json << "\"" << counter_names[counter] << "\": " << counters_[counter];
+	}
+	for(int histogram = 0; histogram < NumHistograms; ++histogram)
+	{
+		json << ", \"" << histogram_names[histogram] << "\": [";
+		for(int bucket = 0; bucket < num_buckets_; ++bucket)
+		{
+			if(bucket > 0) json << ", ";
+			json << histograms_[histogram][bucket];
+		}
+		json << "]";
+	}
+	json << "}";
+	return json.str();
+}
+
+END_YAFARAY
@@ -17,6 +17,7 @@
  */
 #include "common/session.h"
 #include "photon/photon.h"
+#include "photon/photon_maps_state.h"
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -27,9 +28,6 @@ BEGIN_YAFARAY
 // Initialization of the master instance of yafLog
 Logger logger_global{ };
 
-// Initialization of the master session instance
-Session session_global{ };
-
 Session::Session()
 {
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Session:started" << YENDL;
@@ -42,6 +40,7 @@ Session::Session()
 	diffuse_map_->setName("Diffuse Photon Map");
 	radiance_map_ = std::unique_ptr<PhotonMap>(new PhotonMap);
 	radiance_map_->setName("FG Radiance Photon Map");
+	photon_maps_state_ = std::unique_ptr<PhotonMapsState>(new PhotonMapsState);
 }
 
 Session::~Session()
@@ -55,10 +54,5 @@ void Session::setInteractive(bool interactive)
 	interactive_ = interactive;
 }
 
-bool Session::isInteractive()
-{
-	return interactive_;
-}
-
 END_YAFARAY
 
@@ -27,6 +27,12 @@
 #include <sys/sysctl.h>
 #elif _WIN32
 #include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <fstream>
+#include <sstream>
+#include <string>
 #endif
 #if HAVE_UNISTD_H
 #include <unistd.h>
@@ -61,4 +67,103 @@ int SysInfo::getNumSystemThreads() const
 	return nthreads;
 }
 
+#if !defined(__APPLE__) && !defined(_WIN32) && defined(__linux__)
+static std::vector<int> parseCpuList(const std::string &cpu_list) //Parses Linux cpu lists such as "0-7,16-23"
+{
+	std::vector<int> cpus;
+	std::stringstream stream(cpu_list);
+	std::string range;
+	while(std::getline(stream, range, ','))
+	{
+		if(range.empty() || range[0] < '0' || range[0] > '9') continue;
+		const size_t dash = range.find('-');
+		const int first = std::stoi(range.substr(0, dash));
+		const int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+		for(int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+	}
+	return cpus;
+}
+#endif
+
+std::vector<int> SysInfo::getNumaCpuOrder() const
+{
+	std::vector<std::vector<int>> node_cpus;
+#if !defined(__APPLE__) && !defined(_WIN32) && defined(__linux__)
+	for(int node = 0; ; ++node)
+	{
+		std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		if(!file.is_open()) break;
+		std::string cpu_list;
+		std::getline(file, cpu_list);
+		std::vector<int> cpus = parseCpuList(cpu_list);
+		if(!cpus.empty()) node_cpus.push_back(cpus);
+	}
+#endif
+	std::vector<int> cpu_order;
+	if(node_cpus.empty())
+	{
+		const int nthreads = getNumSystemThreads();
+		for(int cpu = 0; cpu < nthreads; ++cpu) cpu_order.push_back(cpu);
+		return cpu_order;
+	}
+	for(size_t index = 0; ; ++index)
+	{
+		bool cpus_left = false;
+		for(const auto &cpus : node_cpus)
+		{
+			if(index >= cpus.size()) continue;
+			cpu_order.push_back(cpus[index]);
+			cpus_left = true;
+		}
+		if(!cpus_left) break;
+	}
+	return cpu_order;
+}
+
+SysInfo::SimdLevel SysInfo::getSimdLevel() const
+{
+#ifdef YAFARAY_SIMD_DISPATCH
+	static const SimdLevel simd_level = []
+	{
+		//__builtin_cpu_supports also checks that the OS saves the AVX registers
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")) return SimdLevel::Avx512;
+		if(__builtin_cpu_supports("avx2")) return SimdLevel::Avx2;
+		if(__builtin_cpu_supports("sse4.2")) return SimdLevel::Sse42;
+		return SimdLevel::Generic;
+	}();
+	return simd_level;
+#else
+	return SimdLevel::Generic;
+#endif
+}
+
+std::string SysInfo::getSimdLevelName(SimdLevel simd_level)
+{
+	switch(simd_level)
+	{
+		case SimdLevel::Sse42: return "SSE4.2";
+		case SimdLevel::Avx2: return "AVX2";
+		case SimdLevel::Avx512: return "AVX-512";
+		default: return "Generic";
+	}
+}
+
+bool SysInfo::pinCurrentThread(int cpu_id) const
+{
+	if(cpu_id < 0) return false;
+#if defined(_WIN32)
+	if(cpu_id >= static_cast<int>(8 * sizeof(DWORD_PTR))) return false;
+	return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu_id) != 0;
+#elif !defined(__APPLE__) && defined(__linux__)
+	if(cpu_id >= CPU_SETSIZE) return false;
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpu_id, &cpu_set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+	return false; //macOS does not allow pinning threads to CPUs
+#endif
+}
+
 END_YAFARAY
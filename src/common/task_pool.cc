@@ -0,0 +1,186 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/task_pool.h"
+#include "common/sysinfo.h"
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+static thread_local const TaskPool *current_task_pool_global = nullptr;
+static thread_local size_t current_queue_id_global = 0;
+
+TaskPool::TaskPool(int num_threads, const std::vector<int> &worker_cpus)
+{
+	if(num_threads < 1) num_threads = 1;
+	for(int queue_id = 0; queue_id < num_threads; ++queue_id) queues_.emplace_back(new Queue);
+	for(int queue_id = 1; queue_id < num_threads; ++queue_id)
+	{
+		const int cpu_id = worker_cpus.empty() ? -1 : worker_cpus[(queue_id - 1) % worker_cpus.size()];
+		workers_.emplace_back(&TaskPool::workerLoop, this, static_cast<size_t>(queue_id), cpu_id);
+	}
+}
+
+TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> lock_guard(sleep_mutex_);
+		finish_ = true;
+	}
+	sleep_condition_.notify_all();
+	for(auto &worker : workers_) worker.join();
+}
+
+size_t TaskPool::currentQueueId() const
+{
+	return current_task_pool_global == this ? current_queue_id_global : 0;
+}
+
+void TaskPool::push(Task task)
+{
+	Queue &queue = *queues_[currentQueueId()];
+	{
+		std::lock_guard<std::mutex> lock_guard(queue.mutex_);
+		queue.tasks_.emplace_back(std::move(task));
+	}
+	++num_queued_tasks_;
+	//Locking the sleep mutex so the notification cannot be lost between the check of the sleeping condition and the wait
+	{
+		std::lock_guard<std::mutex> lock_guard(sleep_mutex_);
+	}
+	sleep_condition_.notify_one();
+}
+
+bool TaskPool::runPendingTask()
+{
+	const size_t num_queues = queues_.size();
+	const size_t own_queue_id = currentQueueId();
+	Task task;
+	bool found = false;
+	for(size_t queue_num = 0; queue_num < num_queues && !found; ++queue_num)
+	{
+		const size_t queue_id = (own_queue_id + queue_num) % num_queues;
+		Queue &queue = *queues_[queue_id];
+		std::lock_guard<std::mutex> lock_guard(queue.mutex_);
+		if(queue.tasks_.empty()) continue;
+		if(queue_id == own_queue_id)
+		{
+			task = std::move(queue.tasks_.back());
+			queue.tasks_.pop_back();
+		}
+		else
+		{
+			task = std::move(queue.tasks_.front());
+			queue.tasks_.pop_front();
+		}
+		found = true;
+	}
+	if(!found) return false;
+	--num_queued_tasks_;
+	task.function_();
+	--task.group_->num_unfinished_tasks_;
+	return true;
+}
+
+void TaskPool::workerLoop(size_t queue_id, int cpu_id)
+{
+	if(cpu_id >= 0) SysInfo().pinCurrentThread(cpu_id); //pinned before running any task, so the memory first touched by the tasks is allocated in the NUMA node of this CPU
+	current_task_pool_global = this;
+	current_queue_id_global = queue_id;
+	while(true)
+	{
+		if(runPendingTask()) continue;
+		std::unique_lock<std::mutex> lock(sleep_mutex_);
+		sleep_condition_.wait(lock, [this] { return finish_ || num_queued_tasks_ > 0; });
+		if(finish_ && num_queued_tasks_ == 0) break;
+	}
+}
+
+void TaskPool::Group::run(std::function<void()> function)
+{
+	if(task_pool_.workers_.empty())
+	{
+		function();
+		return;
+	}
+	++num_unfinished_tasks_;
+	task_pool_.push({std::move(function), this});
+}
+
+void TaskPool::Group::wait()
+{
+	while(num_unfinished_tasks_ > 0)
+	{
+		if(!task_pool_.runPendingTask()) std::this_thread::yield();
+	}
+}
+
+size_t TaskGraph::add(std::function<void()> function, const std::vector<size_t> &dependencies)
+{
+	const size_t node_id = nodes_.size();
+	nodes_.emplace_back(new Node);
+	nodes_.back()->function_ = std::move(function);
+	nodes_.back()->num_pending_dependencies_ = static_cast<int>(dependencies.size());
+	for(const size_t dependency : dependencies) nodes_[dependency]->dependents_.push_back(node_id);
+	return node_id;
+}
+
+void TaskGraph::runNode(TaskPool::Group &task_group, size_t node_id)
+{
+	task_group.run([this, &task_group, node_id]
+	{
+		Node &node = *nodes_[node_id];
+		node.function_();
+		for(const size_t dependent : node.dependents_)
+		{
+			if(--nodes_[dependent]->num_pending_dependencies_ == 0) runNode(task_group, dependent);
+		}
+	});
+}
+
+void TaskGraph::run()
+{
+	//The tasks without dependencies are collected before running any task, as the running tasks decrease the pending dependencies of the others
+	std::vector<size_t> initial_nodes;
+	for(size_t node_id = 0; node_id < nodes_.size(); ++node_id)
+	{
+		if(nodes_[node_id]->num_pending_dependencies_ == 0) initial_nodes.push_back(node_id);
+	}
+	TaskPool::Group task_group(task_pool_);
+	for(const size_t node_id : initial_nodes) runNode(task_group, node_id);
+	task_group.wait();
+}
+
+void parallelFor_global(TaskPool *task_pool, size_t size, const std::function<void(size_t begin, size_t end)> &function, size_t min_chunk_size)
+{
+	const size_t num_chunks = task_pool ? std::min(4 * static_cast<size_t>(task_pool->getNumThreads()), (size + min_chunk_size - 1) / min_chunk_size) : 1;
+	if(num_chunks <= 1)
+	{
+		function(0, size);
+		return;
+	}
+	const size_t chunk_size = (size + num_chunks - 1) / num_chunks;
+	TaskPool::Group task_group(*task_pool);
+	for(size_t begin = 0; begin < size; begin += chunk_size)
+	{
+		task_group.run([&function, begin, chunk_size, size] { function(begin, std::min(begin + chunk_size, size)); });
+	}
+	task_group.wait();
+}
+
+END_YAFARAY
@@ -24,8 +24,6 @@
 
 BEGIN_YAFARAY
 
-Timer g_timer_global;
-
 bool Timer::addEvent(const std::string &name)
 {
 	if(includes(name)) return false;
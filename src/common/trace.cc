@@ -0,0 +1,121 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common/trace.h"
+#include "common/file.h"
+#include "common/logger.h"
+#include "common/thread.h"
+#include <chrono>
+#include <sstream>
+#include <vector>
+
+BEGIN_YAFARAY
+
+struct TraceEvent
+{
+	const char *category_;
+	const char *name_;
+	std::string args_;
+	int thread_id_;
+	int64_t begin_;
+	int64_t duration_;
+};
+
+std::atomic<bool> Trace::enabled_ {false};
+static std::mutex trace_mutex_global;
+static std::string trace_file_global;
+static std::chrono::steady_clock::time_point trace_start_global;
+static std::vector<TraceEvent> trace_events_global;
+static std::atomic<int> trace_next_thread_id_global {0};
+
+static std::string jsonString_global(const std::string &str)
+{
+	std::string result = "\"";
+	for(const char c : str)
+	{
+		if(c == '"' || c == '\\') result += '\\';
+		if(static_cast<unsigned char>(c) < 0x20) result += ' ';
+		else result += c;
+	}
+	return result + "\"";
+}
+
+void Trace::setFile(const std::string &file_path)
+{
+	std::lock_guard<std::mutex> lock_guard(trace_mutex_global);
+	if(file_path == trace_file_global) return; //keeps the spans recorded in the previous renders of the same session
+	trace_file_global = file_path;
+	trace_events_global.clear();
+	trace_start_global = std::chrono::steady_clock::now();
+	enabled_.store(!file_path.empty(), std::memory_order_relaxed);
+}
+
+int64_t Trace::now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - trace_start_global).count();
+}
+
+void Trace::addSpan(const char *category, const char *name, std::string &&args, int64_t begin, int64_t end)
+{
+	thread_local const int thread_id = trace_next_thread_id_global++;
+	std::lock_guard<std::mutex> lock_guard(trace_mutex_global);
+	trace_events_global.push_back({category, name, std::move(args), thread_id, begin, end - begin});
+}
+
+bool Trace::save()
+{
+	std::lock_guard<std::mutex> lock_guard(trace_mutex_global);
+	if(trace_file_global.empty()) return false;
+	std::stringstream json;
+	json << "{\"traceEvents\": [";
+	for(size_t event_num = 0; event_num < trace_events_global.size(); ++event_num)
+	{
+		const TraceEvent &event = trace_events_global[event_num];
+		json << (event_num > 0 ? ",\n" : "\n");
+		json << "{\"name\": \"" << event.name_ << "\", \"cat\": \"" << event.category_ << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread_id_;
+		json << ", \"ts\": " << event.begin_ << ", \"dur\": " << event.duration_;
+		if(!event.args_.empty()) json << ", \"args\": {" << event.args_ << "}";
+		json << "}";
+	}
+	json << "\n], \"displayTimeUnit\": \"ms\"}\n";
+	std::FILE *fp = File::open(trace_file_global, "wb");
+	if(!fp)
+	{
+		Y_WARNING << "Trace: could not open the trace file '" << trace_file_global << "'" << YENDL;
+		return false;
+	}
+	const std::string json_string = json.str();
+	const bool written = std::fwrite(json_string.data(), 1, json_string.size(), fp) == json_string.size();
+	File::close(fp);
+	if(written) Y_INFO << "Trace: saved " << trace_events_global.size() << " spans to '" << trace_file_global << "'" << YENDL;
+	else Y_WARNING << "Trace: could not write the trace file '" << trace_file_global << "'" << YENDL;
+	return written;
+}
+
+std::string &TraceSpan::addArgName(const char *name)
+{
+	if(!args_.empty()) args_ += ", ";
+	return args_ += std::string("\"") + name + "\": ";
+}
+
+void TraceSpan::addArg(const char *name, const std::string &value)
+{
+	if(enabled_) addArgName(name) += jsonString_global(value);
+}
+
+END_YAFARAY
@@ -21,11 +21,118 @@
 #include "scene/scene.h"
 #include "geometry/matrix4.h"
 #include "common/param.h"
+#include "common/file.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <locale>
 
 BEGIN_YAFARAY
 
-XmlExport::XmlExport(const char *fname) : xml_name_(std::string(fname))
+constexpr char XmlExport::geometry_file_header_[];
+constexpr size_t XmlExport::file_buffer_size_;
+
+//! Decimal digits of the value (including the sign) written without the stream formatting and locale
+static char *writeInt_global(char *out, long long value)
+{
+	unsigned long long magnitude = value < 0 ? 0ULL - static_cast<unsigned long long>(value) : static_cast<unsigned long long>(value);
+	if(value < 0) *out++ = '-';
+	char digits[20];
+	int num_digits = 0;
+	do
+	{
+		digits[num_digits++] = static_cast<char>('0' + magnitude % 10);
+		magnitude /= 10;
+	} while(magnitude > 0);
+	while(num_digits > 0) *out++ = digits[--num_digits];
+	return out;
+}
+
+/*! Writes the value as the default stream formatting does (6 significant digits, fixed or scientific notation like %g) without
+ *  the stream and locale overhead, so the decimal point is always '.' */
+static char *writeFloat_global(char *out, double value)
 {
+	constexpr int precision = 6;
+	static const std::vector<double> powers_of_ten = []
+	{
+		std::vector<double> powers(309);
+		for(size_t i = 0; i < powers.size(); ++i) powers[i] = std::pow(10.0, static_cast<double>(i));
+		return powers;
+	}();
+	if(!std::isfinite(value) || (value != 0.0 && (std::abs(value) < 1e-290 || std::abs(value) > 1e290)))
+	{
+		return out + snprintf(out, 32, "%g", value); //unusual values, the conversion of NaN, infinity and extreme exponents is not affected by the locale
+	}
+	if(std::signbit(value))
+	{
+		*out++ = '-';
+		value = -value;
+	}
+	if(value == 0.0)
+	{
+		*out++ = '0';
+		return out;
+	}
+	auto scaled_digits = [&](int exponent)
+	{
+		const int shift = precision - 1 - exponent;
+		return static_cast<long long>(std::nearbyint(shift >= 0 ? value * powers_of_ten[shift] : value / powers_of_ten[-shift])); //to the nearest even on the ties, as printf
+	};
+	int exponent = static_cast<int>(std::floor(std::log10(value)));
+	long long digits = scaled_digits(exponent);
+	if(digits < 100000) digits = scaled_digits(--exponent); //log10 can be one unit off close to the powers of ten
+	if(digits >= 1000000)
+	{
+		++exponent;
+		digits = scaled_digits(exponent);
+		if(digits >= 1000000) digits /= 10; //rounded up to the next power of ten
+	}
+	char text[precision];
+	for(int i = precision - 1; i >= 0; --i, digits /= 10) text[i] = static_cast<char>('0' + digits % 10);
+	int num_digits = precision;
+	while(num_digits > 1 && text[num_digits - 1] == '0') --num_digits;
+	if(exponent < -4 || exponent >= precision)
+	{
+		*out++ = text[0];
+		if(num_digits > 1)
+		{
+			*out++ = '.';
+			for(int i = 1; i < num_digits; ++i) *out++ = text[i];
+		}
+		*out++ = 'e';
+		*out++ = exponent < 0 ? '-' : '+';
+		if(std::abs(exponent) < 10) *out++ = '0';
+		return writeInt_global(out, std::abs(exponent));
+	}
+	if(exponent < 0)
+	{
+		*out++ = '0';
+		*out++ = '.';
+		for(int i = -1; i > exponent; --i) *out++ = '0';
+		for(int i = 0; i < num_digits; ++i) *out++ = text[i];
+		return out;
+	}
+	for(int i = 0; i <= exponent; ++i) *out++ = text[i];
+	if(num_digits > exponent + 1)
+	{
+		*out++ = '.';
+		for(int i = exponent + 1; i < num_digits; ++i) *out++ = text[i];
+	}
+	return out;
+}
+
+template <size_t N>
+static inline char *writeText_global(char *out, const char (&text)[N])
+{
+	memcpy(out, text, N - 1);
+	return out + N - 1;
+}
+
+XmlExport::XmlExport(const char *fname) : file_buffer_(new char[file_buffer_size_]), xml_name_(std::string(fname))
+{
+	//The buffer must be set before opening the file. The classic locale keeps the decimal point of the parameters independent of the user locale
+	xml_file_.rdbuf()->pubsetbuf(file_buffer_.get(), file_buffer_size_);
+	xml_file_.imbue(std::locale::classic());
 	xml_file_.open(xml_name_.c_str());
 	if(!xml_file_.is_open())
 	{
@@ -40,6 +147,24 @@ XmlExport::XmlExport(const char *fname) : xml_name_(std::string(fname))
 void XmlExport::createScene()
 {
 	xml_file_ << "<scene>\n\n";
+	if(binary_geometry_)
+	{
+		Path geometry_path(xml_name_);
+		geometry_path.setExtension("geometry");
+		geometry_file_.open(geometry_path.getFullPath(), std::ios::binary | std::ios::trunc);
+		if(!geometry_file_.is_open())
+		{
+			Y_WARNING << "XmlExport: Couldn't open " << geometry_path.getFullPath() << ", writing the geometry to the XML file" << YENDL;
+			binary_geometry_ = false;
+		}
+		else
+		{
+			geometry_offset_ = 0;
+			writeGeometryData(geometry_file_header_, sizeof(geometry_file_header_));
+			//The XML file refers to the geometry file by name, so both can be moved together
+			xml_file_ << "<geometry_file sval=\"" << geometry_path.getBaseName() << "." << geometry_path.getExtension() << "\"/>\n\n";
+		}
+	}
 	xml_file_ << "<scene_parameters>\n";
 	writeParamMap(*params_);
 	params_->clear();
@@ -54,6 +179,7 @@ void XmlExport::clearAll()
 		xml_file_.flush();
 		xml_file_.close();
 	}
+	if(geometry_file_.is_open()) geometry_file_.close();
 	params_->clear();
 	eparams_->clear();
 	cparams_ = params_.get();
@@ -91,26 +217,122 @@ unsigned int XmlExport::getNextFreeId()
 
 bool XmlExport::endObject()
 {
+	flushGeometryBlock();
 	xml_file_ << "</object>\n";
 	return true;
 }
 
+uint64_t XmlExport::writeGeometryData(const void *data, size_t size)
+{
+	const uint64_t offset = geometry_offset_;
+	geometry_file_.write(static_cast<const char *>(data), size);
+	geometry_offset_ += size;
+	return offset;
+}
+
+void XmlExport::writeVerticesBlock(const float *vertices, size_t num_vertices, const float *orco)
+{
+	xml_file_ << "\t<vertices count=\"" << num_vertices << "\" offset=\"" << writeGeometryData(vertices, 3 * num_vertices * sizeof(float)) << "\"";
+	if(orco) xml_file_ << " orco_offset=\"" << writeGeometryData(orco, 3 * num_vertices * sizeof(float)) << "\"";
+	xml_file_ << "/>\n";
+}
+
+void XmlExport::writeFacesBlock(const int *vert_indices, size_t num_faces, const int *uv_indices)
+{
+	xml_file_ << "\t<faces count=\"" << num_faces << "\" offset=\"" << writeGeometryData(vert_indices, 3 * num_faces * sizeof(int)) << "\"";
+	if(uv_indices) xml_file_ << " uv_offset=\"" << writeGeometryData(uv_indices, 3 * num_faces * sizeof(int)) << "\"";
+	xml_file_ << "/>\n";
+}
+
+void XmlExport::startGeometryBlock(GeometryBlock block)
+{
+	if(block != geometry_block_) flushGeometryBlock();
+	geometry_block_ = block;
+}
+
+void XmlExport::flushGeometryBlock()
+{
+	switch(geometry_block_)
+	{
+		case GeometryBlock::Vertices: writeVerticesBlock(block_values_.data(), block_values_.size() / 3, nullptr); break;
+		case GeometryBlock::VerticesOrco: writeVerticesBlock(block_values_.data(), block_values_.size() / 3, block_orco_.data()); break;
+		case GeometryBlock::Normals: xml_file_ << "\t<normals count=\"" << block_values_.size() / 3 << "\" offset=\"" << writeGeometryData(block_values_.data(), block_values_.size() * sizeof(float)) << "\"/>\n"; break;
+		case GeometryBlock::Faces: writeFacesBlock(block_indices_.data(), block_indices_.size() / 3, nullptr); break;
+		case GeometryBlock::FacesUv: writeFacesBlock(block_indices_.data(), block_indices_.size() / 3, block_uv_indices_.data()); break;
+		case GeometryBlock::Uvs: xml_file_ << "\t<uvs count=\"" << block_values_.size() / 2 << "\" offset=\"" << writeGeometryData(block_values_.data(), block_values_.size() * sizeof(float)) << "\"/>\n"; break;
+		default: break;
+	}
+	geometry_block_ = GeometryBlock::None;
+	block_values_.clear();
+	block_orco_.clear();
+	block_indices_.clear();
+	block_uv_indices_.clear();
+}
+
 int XmlExport::addVertex(double x, double y, double z)
 {
-	xml_file_ << "\t<p x=\"" << x << "\" y=\"" << y << "\" z=\"" << z << "\"/>\n";
+	if(binary_geometry_)
+	{
+		startGeometryBlock(GeometryBlock::Vertices);
+		block_values_.insert(block_values_.end(), {static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)});
+		return 0;
+	}
+	char line[128];
+	char *c = writeText_global(line, "\t<p x=\"");
+	c = writeFloat_global(c, x);
+	c = writeText_global(c, "\" y=\"");
+	c = writeFloat_global(c, y);
+	c = writeText_global(c, "\" z=\"");
+	c = writeFloat_global(c, z);
+	c = writeText_global(c, "\"/>\n");
+	xml_file_.write(line, c - line);
 	return 0;
 }
 
 int XmlExport::addVertex(double x, double y, double z, double ox, double oy, double oz)
 {
-	xml_file_ << "\t<p x=\"" << x << "\" y=\"" << y << "\" z=\"" << z
-			  << "\" ox=\"" << ox << "\" oy=\"" << oy << "\" oz=\"" << oz << "\"/>\n";
+	if(binary_geometry_)
+	{
+		startGeometryBlock(GeometryBlock::VerticesOrco);
+		block_values_.insert(block_values_.end(), {static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)});
+		block_orco_.insert(block_orco_.end(), {static_cast<float>(ox), static_cast<float>(oy), static_cast<float>(oz)});
+		return 0;
+	}
+	char line[256];
+	char *c = writeText_global(line, "\t<p x=\"");
+	c = writeFloat_global(c, x);
+	c = writeText_global(c, "\" y=\"");
+	c = writeFloat_global(c, y);
+	c = writeText_global(c, "\" z=\"");
+	c = writeFloat_global(c, z);
+	c = writeText_global(c, "\" ox=\"");
+	c = writeFloat_global(c, ox);
+	c = writeText_global(c, "\" oy=\"");
+	c = writeFloat_global(c, oy);
+	c = writeText_global(c, "\" oz=\"");
+	c = writeFloat_global(c, oz);
+	c = writeText_global(c, "\"/>\n");
+	xml_file_.write(line, c - line);
 	return 0;
 }
 
 void XmlExport::addNormal(double x, double y, double z)
 {
-	xml_file_ << "\t<n x=\"" << x << "\" y=\"" << y << "\" z=\"" << z << "\"/>\n";
+	if(binary_geometry_)
+	{
+		startGeometryBlock(GeometryBlock::Normals);
+		block_values_.insert(block_values_.end(), {static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)});
+		return;
+	}
+	char line[128];
+	char *c = writeText_global(line, "\t<n x=\"");
+	c = writeFloat_global(c, x);
+	c = writeText_global(c, "\" y=\"");
+	c = writeFloat_global(c, y);
+	c = writeText_global(c, "\" z=\"");
+	c = writeFloat_global(c, z);
+	c = writeText_global(c, "\"/>\n");
+	xml_file_.write(line, c - line);
 }
 
 void XmlExport::setCurrentMaterial(const char *name)
@@ -118,6 +340,7 @@ void XmlExport::setCurrentMaterial(const char *name)
 	const std::string name_str(name);
 	if(name_str != current_material_) //need to set current material
 	{
+		flushGeometryBlock();
 		xml_file_ << "\t<set_material sval=\"" << name_str << "\"/>\n";
 		current_material_ = name_str;
 	}
@@ -125,23 +348,128 @@ void XmlExport::setCurrentMaterial(const char *name)
 
 bool XmlExport::addFace(int a, int b, int c)
 {
-	xml_file_ << "\t<f a=\"" << a << "\" b=\"" << b << "\" c=\"" << c << "\"/>\n";
+	if(binary_geometry_)
+	{
+		startGeometryBlock(GeometryBlock::Faces);
+		block_indices_.insert(block_indices_.end(), {a, b, c});
+		return true;
+	}
+	char line[128];
+	char *l = writeText_global(line, "\t<f a=\"");
+	l = writeInt_global(l, a);
+	l = writeText_global(l, "\" b=\"");
+	l = writeInt_global(l, b);
+	l = writeText_global(l, "\" c=\"");
+	l = writeInt_global(l, c);
+	l = writeText_global(l, "\"/>\n");
+	xml_file_.write(line, l - line);
 	return true;
 }
 
 bool XmlExport::addFace(int a, int b, int c, int uv_a, int uv_b, int uv_c)
 {
-	xml_file_ << "\t<f a=\"" << a << "\" b=\"" << b << "\" c=\"" << c
-			  << "\" uv_a=\"" << uv_a << "\" uv_b=\"" << uv_b << "\" uv_c=\"" << uv_c << "\"/>\n";
+	if(binary_geometry_)
+	{
+		startGeometryBlock(GeometryBlock::FacesUv);
+		block_indices_.insert(block_indices_.end(), {a, b, c});
+		block_uv_indices_.insert(block_uv_indices_.end(), {uv_a, uv_b, uv_c});
+		return true;
+	}
+	char line[192];
+	char *l = writeText_global(line, "\t<f a=\"");
+	l = writeInt_global(l, a);
+	l = writeText_global(l, "\" b=\"");
+	l = writeInt_global(l, b);
+	l = writeText_global(l, "\" c=\"");
+	l = writeInt_global(l, c);
+	l = writeText_global(l, "\" uv_a=\"");
+	l = writeInt_global(l, uv_a);
+	l = writeText_global(l, "\" uv_b=\"");
+	l = writeInt_global(l, uv_b);
+	l = writeText_global(l, "\" uv_c=\"");
+	l = writeInt_global(l, uv_c);
+	l = writeText_global(l, "\"/>\n");
+	xml_file_.write(line, l - line);
 	return true;
 }
 
 int XmlExport::addUv(float u, float v)
 {
-	xml_file_ << "\t<uv u=\"" << u << "\" v=\"" << v << "\"/>\n";
+	if(binary_geometry_)
+	{
+		startGeometryBlock(GeometryBlock::Uvs);
+		block_values_.insert(block_values_.end(), {u, v});
+		return n_uvs_++;
+	}
+	char line[96];
+	char *c = writeText_global(line, "\t<uv u=\"");
+	c = writeFloat_global(c, u);
+	c = writeText_global(c, "\" v=\"");
+	c = writeFloat_global(c, v);
+	c = writeText_global(c, "\"/>\n");
+	xml_file_.write(line, c - line);
 	return n_uvs_++;
 }
 
+int XmlExport::addVertices(const float *vertices, unsigned int num_vertices, const float *orco)
+{
+	if(binary_geometry_)
+	{
+		flushGeometryBlock();
+		writeVerticesBlock(vertices, num_vertices, orco);
+		return 0;
+	}
+	for(unsigned int i = 0; i < num_vertices; ++i)
+	{
+		const float *p = vertices + 3 * i;
+		if(orco) addVertex(p[0], p[1], p[2], orco[3 * i], orco[3 * i + 1], orco[3 * i + 2]);
+		else addVertex(p[0], p[1], p[2]);
+	}
+	return 0;
+}
+
+void XmlExport::addNormals(const float *normals, unsigned int num_normals)
+{
+	if(binary_geometry_)
+	{
+		flushGeometryBlock();
+		xml_file_ << "\t<normals count=\"" << num_normals << "\" offset=\"" << writeGeometryData(normals, 3 * static_cast<size_t>(num_normals) * sizeof(float)) << "\"/>\n";
+		return;
+	}
+	for(unsigned int i = 0; i < num_normals; ++i) addNormal(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]);
+}
+
+bool XmlExport::addFaces(const int *vert_indices, unsigned int num_faces, const int *uv_indices)
+{
+	if(binary_geometry_)
+	{
+		flushGeometryBlock();
+		writeFacesBlock(vert_indices, num_faces, uv_indices);
+		return true;
+	}
+	for(unsigned int i = 0; i < num_faces; ++i)
+	{
+		const int *f = vert_indices + 3 * i;
+		if(uv_indices) addFace(f[0], f[1], f[2], uv_indices[3 * i], uv_indices[3 * i + 1], uv_indices[3 * i + 2]);
+		else addFace(f[0], f[1], f[2]);
+	}
+	return true;
+}
+
+int XmlExport::addUvs(const float *uvs, unsigned int num_uvs)
+{
+	const int first_uv = n_uvs_;
+	if(binary_geometry_)
+	{
+		flushGeometryBlock();
+		xml_file_ << "\t<uvs count=\"" << num_uvs << "\" offset=\"" << writeGeometryData(uvs, 2 * static_cast<size_t>(num_uvs) * sizeof(float)) << "\"/>\n";
+		n_uvs_ += num_uvs;
+		return first_uv;
+	}
+	for(unsigned int i = 0; i < num_uvs; ++i) addUv(uvs[2 * i], uvs[2 * i + 1]);
+	return first_uv;
+}
+
 bool XmlExport::smoothMesh(const char *name, double angle)
 {
 	xml_file_ << "<smooth object_name=\"" << name << "\" angle=\"" << angle << "\"/>\n";
@@ -216,6 +544,49 @@ bool XmlExport::addInstance(const char *base_object_name, const Matrix4 &obj_to_
 	return true;
 }
 
+bool XmlExport::addInstances(const char *base_object_name, const float *obj_to_world, unsigned int num_instances)
+{
+	//the XML format has no instance arrays, each instance is written on its own
+	for(unsigned int instance_number = 0; instance_number < num_instances; ++instance_number)
+	{
+		Matrix4 matrix(1.f);
+		for(int row = 0; row < 3; ++row)
+			for(int col = 0; col < 4; ++col) matrix[row][col] = obj_to_world[12 * instance_number + 4 * row + col];
+		addInstance(base_object_name, matrix);
+	}
+	return true;
+}
+
+bool XmlExport::updateInstance(const char *base_object_name, unsigned int instance_number, const Matrix4 &obj_to_world)
+{
+	Y_WARNING << "XmlExport: Instance updates cannot be exported, the XML file only describes the whole scene" << YENDL;
+	return false;
+}
+
+bool XmlExport::addObjectLod(const char *base_object_name, const char *lod_object_name, float max_screen_size)
+{
+	xml_file_ << "<object_lod base_object_name=\"" << base_object_name << "\" lod_object_name=\"" << lod_object_name << "\" max_screen_size=\"" << max_screen_size << "\"/>\n";
+	return true;
+}
+
+Camera *XmlExport::updateCamera(const char *name)
+{
+	Y_WARNING << "XmlExport: Camera updates cannot be exported, the XML file only describes the whole scene" << YENDL;
+	return nullptr;
+}
+
+Material *XmlExport::updateMaterial(const char *name)
+{
+	Y_WARNING << "XmlExport: Material updates cannot be exported, the XML file only describes the whole scene" << YENDL;
+	return nullptr;
+}
+
+Light *XmlExport::updateLight(const char *name)
+{
+	Y_WARNING << "XmlExport: Light updates cannot be exported, the XML file only describes the whole scene" << YENDL;
+	return nullptr;
+}
+
 void XmlExport::writeParamMap(const ParamMap &param_map, int indent)
 {
 	const std::string tabs(indent, '\t');
@@ -253,6 +624,12 @@ Texture *XmlExport::createTexture(const char *name)
 	return nullptr;
 }
 
+bool XmlExport::addImageBuffer(const char *name, const void *data, int width, int height, int num_channels, bool float_data, long long row_stride, bool reference_host_memory)
+{
+	Y_WARNING << "XmlExport: Image buffers cannot be exported, the textures using the image buffer '" << name << "' need an image file instead" << YENDL;
+	return false;
+}
+
 Material *XmlExport::createMaterial(const char *name)
 {
 	xml_file_ << "\n<material name=\"" << name << "\">\n";
@@ -326,6 +703,7 @@ void XmlExport::render(ProgressBar *pb, bool)
 	xml_file_ << "</scene>" << YENDL;
 	xml_file_.flush();
 	xml_file_.close();
+	if(geometry_file_.is_open()) geometry_file_.close();
 }
 
 void XmlExport::setXmlColorSpace(std::string color_space_string, float gamma_val)
@@ -0,0 +1,73 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "yafaray_config.h"
+#include "common/console.h"
+#include "common/logger.h"
+#include "render/film_merger.h"
+#include <thread>
+
+using namespace::yafaray4;
+
+/*! Merges the film files saved by the computer nodes of a multi-computer render into one film file. The merged film can
+ * be loaded by a render with the "load-save" film mode to write the images, adding more samples if needed */
+int main(int argc, char *argv[])
+{
+	CliParser parse(argc, argv, 3, 1, "You need to set the output film file and at least one input film file.");
+
+	parse.setAppName("YafaRay film merge",
+					 "[OPTIONS]... <output film file> <input film file>...\n<output film file> : film file to write with the merged films\n<input film file> : film files saved by each computer node");
+
+	parse.setOption("vl", "verbosity-level", false, "Set console verbosity level, options are the same as for yafaray-xml\n");
+	parse.setOption("t", "threads", false, "Number of threads merging the films, by default the number of threads of the system\n");
+	parse.setOption("v", "version", true, "Displays this program's version.");
+	parse.setOption("h", "help", true, "Displays this help text.");
+
+	const bool parse_ok = parse.parseCommandLine();
+
+	if(parse.getFlag("h"))
+	{
+		parse.printUsage();
+		return 0;
+	}
+
+	if(parse.getFlag("v"))
+	{
+		Y_INFO << "YafaRay film merge" << YENDL << "Built with YafaRay Core version " << YAFARAY_BUILD_VERSION << YENDL;
+		return 0;
+	}
+
+	if(!parse_ok)
+	{
+		parse.printError();
+		parse.printUsage();
+		return 1;
+	}
+
+	const std::string verb_level = parse.getOptionString("vl");
+	logger_global.setConsoleMasterVerbosity(verb_level.empty() ? "info" : verb_level);
+
+	const std::vector<std::string> files = parse.getCleanArgs();
+	if(files.size() < 2) return 1;
+
+	int threads = parse.getOptionInteger("t");
+	if(threads <= 0) threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	const FilmMerger film_merger(threads);
+	return film_merger.merge(std::vector<std::string>(files.begin() + 1, files.end()), files.front()) ? 0 : 1;
+}
@@ -29,6 +29,20 @@
 
 BEGIN_YAFARAY
 
+constexpr float LinearTable8Bit::inv_max_8_bit_;
+
+LinearTable8Bit::LinearTable8Bit(const ColorSpace &color_space, float gamma) : color_space_(color_space), gamma_(gamma)
+{
+	by_channel_ = color_space != XyzD65;
+	if(!by_channel_) return;
+	for(int value = 0; value < 256; ++value)
+	{
+		Rgb color(value * inv_max_8_bit_);
+		color.linearRgbFromColorSpace(color_space, gamma);
+		table_[value] = color.r_;
+	}
+}
+
 std::unique_ptr<Format> Format::factory(ParamMap &params)
 {
 	if(Y_LOG_HAS_DEBUG)
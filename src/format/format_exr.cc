@@ -26,21 +26,35 @@
 #include "common/logger.h"
 #include "common/param.h"
 #include "common/file.h"
+#include "common/sysinfo.h"
+#include "common/task_pool.h"
 #include "image/image_buffers.h"
 #include "image/image_layers.h"
 #include "scene/scene.h"
 
 #include <ImfOutputFile.h>
+#include <ImfTiledOutputFile.h>
+#include <ImfTileDescription.h>
 #include <ImfChannelList.h>
 #include <ImfRgbaFile.h>
 #include <ImfArray.h>
 #include <IexThrowErrnoExc.h>
+#include <ImfThreading.h>
+#include <algorithm>
+#include <mutex>
 
 using namespace Imf;
 using namespace Imath;
 
 BEGIN_YAFARAY
 
+//! The scanlines or tiles of the files are compressed and decompressed in parallel by the global OpenEXR threads, set up once for all the files
+static void setupThreads_global()
+{
+	static std::once_flag thread_count_flag;
+	std::call_once(thread_count_flag, [] { setGlobalThreadCount(SysInfo().getNumSystemThreads()); });
+}
+
 //Class C_IStream from "Reading and Writing OpenEXR Image Files with the IlmImf Library" in the OpenEXR sources
 class CiStream: public Imf::IStream
 {
@@ -179,9 +193,10 @@ bool ExrFormat::saveToFile(const std::string &name, const Image *image)
 	header.channels().insert("B", Channel(HALF));
 	header.channels().insert("A", Channel(HALF));
 
+	setupThreads_global();
 	std::FILE *fp = File::open(name.c_str(), "wb");
 	CoStream ostr(fp, name.c_str());
-	OutputFile file(ostr, header);
+	OutputFile file(ostr, header, globalThreadCount());
 
 	Imf::Array2D<Imf::Rgba> pixels;
 	pixels.resizeErase(h, w);
@@ -298,9 +313,10 @@ bool ExrFormat::saveToFileMultiChannel(const std::string &name, const ImageLayer
 		fb.insert(channel_a, Slice(HALF, data_ptr + 3 * chan_size, totchan_size, w_0 * totchan_size));
 	}
 
+	setupThreads_global();
 	FILE *fp = File::open(name.c_str(), "wb");
 	CoStream ostr(fp, name.c_str());
-	OutputFile file(ostr, header);
+	OutputFile file(ostr, header, globalThreadCount());
 	file.setFrameBuffer(fb);
 
 	bool result = true;
@@ -340,31 +356,35 @@ std::unique_ptr<Image> ExrFormat::loadFromFile(const std::string &name, const Im
 	std::unique_ptr<Image> image;
 	try
 	{
+		setupThreads_global();
 		CiStream istr(fp, name.c_str());
-		RgbaInputFile file(istr);
+		RgbaInputFile file(istr, globalThreadCount());
 		const Box2i dw = file.dataWindow();
 		const int width  = dw.max.x - dw.min.x + 1;
 		const int height = dw.max.y - dw.min.y + 1;
 		const Image::Type type = Image::getTypeFromSettings(true, grayscale_);
-		image = Image::factory(width, height, type, optimization);
+		image = Image::factory(width, height, type, optimization, huge_pages_mode_);
 		Imf::Array2D<Imf::Rgba> pixels;
 		pixels.resizeErase(width, height);
 		file.setFrameBuffer(&pixels[0][0] - dw.min.y - dw.min.x * height, height, 1);
 		file.readPixels(dw.min.y, dw.max.y);
 
-		for(int i = 0; i < width; ++i)
+		parallelFor_global(task_pool_, width, [&](size_t begin, size_t end)
 		{
-			for(int j = 0; j < height; ++j)
+			for(int i = static_cast<int>(begin); i < static_cast<int>(end); ++i)
 			{
-				Rgba color;
-				color.r_ = pixels[i][j].r;
-				color.g_ = pixels[i][j].g;
-				color.b_ = pixels[i][j].b;
-				color.a_ = pixels[i][j].a;
-				color.linearRgbFromColorSpace(color_space, gamma);
-				image->setColor(i, j, color);
+				for(int j = 0; j < height; ++j)
+				{
+					Rgba color;
+					color.r_ = pixels[i][j].r;
+					color.g_ = pixels[i][j].g;
+					color.b_ = pixels[i][j].b;
+					color.a_ = pixels[i][j].a;
+					color.linearRgbFromColorSpace(color_space, gamma);
+					image->setColor(i, j, color);
+				}
 			}
-		}
+		}, std::max(1, 8192 / height));
 	}
 	catch(const std::exception &exc)
 	{
@@ -379,6 +399,103 @@ std::unique_ptr<Format> ExrFormat::factory(ParamMap &params)
 	return std::unique_ptr<Format>(new ExrFormat());
 }
 
+struct ExrTiledWriter::FileData
+{
+	FileData(std::FILE *fp, const std::string &name, const Header &header) : stream_(fp, name.c_str()), file_(stream_, header, globalThreadCount()) { }
+	CoStream stream_; //!< declared before the file, which writes its tile offsets table to the stream when destroyed
+	TiledOutputFile file_;
+	std::vector<Imf::Rgba> pixels_; //!< half float pixels of the tile being written
+};
+
+ExrTiledWriter::ExrTiledWriter(const std::string &name, int width, int height, int tile_size, const std::vector<std::string> &layer_names) : layer_names_(layer_names), width_(width), height_(height), tile_size_(tile_size)
+{
+	Header header(width, height);
+	header.compression() = ZIP_COMPRESSION;
+	header.lineOrder() = RANDOM_Y; //the tiles are written in the order the render areas are finished
+	header.setTileDescription(TileDescription(tile_size, tile_size, ONE_LEVEL));
+	for(const auto &layer_name : layer_names_)
+	{
+		for(const char *channel : {"R", "G", "B", "A"}) header.channels().insert(layer_name + "." + channel, Channel(HALF));
+	}
+	setupThreads_global();
+	std::FILE *fp = File::open(name.c_str(), "wb");
+	if(!fp)
+	{
+		Y_ERROR << "ExrTiledWriter: Cannot open file " << name << YENDL;
+		return;
+	}
+	try
+	{
+		file_data_ = std::unique_ptr<FileData>(new FileData(fp, name, header));
+	}
+	catch(const std::exception &exc)
+	{
+		Y_ERROR << "ExrTiledWriter: " << exc.what() << YENDL;
+		file_data_ = nullptr;
+	}
+}
+
+ExrTiledWriter::~ExrTiledWriter()
+{
+	try
+	{
+		file_data_ = nullptr;
+	}
+	catch(const std::exception &exc)
+	{
+		Y_ERROR << "ExrTiledWriter: " << exc.what() << YENDL;
+	}
+}
+
+bool ExrTiledWriter::writeTile(int tile_x, int tile_y, const std::vector<const Rgba *> &layers_colors)
+{
+	if(!file_data_) return false;
+	const int x_0 = tile_x * tile_size_;
+	const int y_0 = tile_y * tile_size_;
+	const int tile_width = std::min(tile_size_, width_ - x_0);
+	const int tile_height = std::min(tile_size_, height_ - y_0);
+	const size_t tile_pixels = static_cast<size_t>(tile_width) * tile_height;
+	std::vector<Imf::Rgba> &pixels = file_data_->pixels_;
+	pixels.resize(tile_pixels * layer_names_.size());
+	const int chan_size = sizeof(half);
+	const int totchan_size = 4 * chan_size;
+	FrameBuffer fb;
+	for(size_t layer = 0; layer < layer_names_.size(); ++layer)
+	{
+		Imf::Rgba *layer_pixels = &pixels[layer * tile_pixels];
+		for(int j = 0; j < tile_height; ++j)
+		{
+			const Rgba *colors = layers_colors[layer] + static_cast<size_t>(j) * tile_size_;
+			for(int i = 0; i < tile_width; ++i)
+			{
+				Imf::Rgba &pixel = layer_pixels[j * tile_width + i];
+				pixel.r = colors[i].r_;
+				pixel.g = colors[i].g_;
+				pixel.b = colors[i].b_;
+				pixel.a = colors[i].a_;
+			}
+		}
+		//The slices are addressed with the image coordinates, so their origin is moved to the top-left corner of the tile
+		char *data_ptr = reinterpret_cast<char *>(layer_pixels) - (static_cast<ptrdiff_t>(y_0) * tile_width + x_0) * totchan_size;
+		const std::string &layer_name = layer_names_[layer];
+		fb.insert(layer_name + ".R", Slice(HALF, data_ptr, totchan_size, tile_width * totchan_size));
+		fb.insert(layer_name + ".G", Slice(HALF, data_ptr + chan_size, totchan_size, tile_width * totchan_size));
+		fb.insert(layer_name + ".B", Slice(HALF, data_ptr + 2 * chan_size, totchan_size, tile_width * totchan_size));
+		fb.insert(layer_name + ".A", Slice(HALF, data_ptr + 3 * chan_size, totchan_size, tile_width * totchan_size));
+	}
+	try
+	{
+		file_data_->file_.setFrameBuffer(fb);
+		file_data_->file_.writeTile(tile_x, tile_y);
+	}
+	catch(const std::exception &exc)
+	{
+		Y_ERROR << "ExrTiledWriter: " << exc.what() << YENDL;
+		return false;
+	}
+	return true;
+}
+
 END_YAFARAY
 
 #endif // HAVE_OPENEXR
@@ -49,7 +49,7 @@ std::unique_ptr<Image> HdrFormat::loadFromFile(const std::string &name, const Im
 		return nullptr;
 	}
 	const Image::Type type = Image::getTypeFromSettings(true, grayscale_);
-	std::unique_ptr<Image> image = Image::factory(width, height, type, optimization);
+	std::unique_ptr<Image> image = Image::factory(width, height, type, optimization, huge_pages_mode_);
 	const int scan_width = (header_.y_first_) ? width : height;
 	// run length encoding is not allowed so read flat and exit
 	if((scan_width < 8) || (scan_width > 0x7fff))
@@ -203,8 +203,9 @@ std::unique_ptr<Image> JpgFormat::loadFromFile(const std::string &name, const Im
 	const int width = info.output_width;
 	const int height = info.output_height;
 	const Image::Type type = Image::getTypeFromSettings(false, grayscale_);
-	std::unique_ptr<Image> image = Image::factory(width, height, type, optimization);
+	std::unique_ptr<Image> image = Image::factory(width, height, type, optimization, huge_pages_mode_);
 
+	const LinearTable8Bit linear_table(color_space, gamma);
 	uint8_t *scanline = new uint8_t[width * info.output_components];
 	for(int y = 0; info.output_scanline < info.output_height; ++y)
 	{
@@ -214,16 +215,14 @@ std::unique_ptr<Image> JpgFormat::loadFromFile(const std::string &name, const Im
 			Rgba color;
 			if(is_gray)
 			{
-				const float colscan = scanline[x] * inv_max_8_bit_;
-				color.set(colscan, colscan, colscan, 1.f);
+				image->setColor(x, y, linear_table.getColor(scanline[x], scanline[x], scanline[x], 255));
+				continue;
 			}
 			else if(is_rgb)
 			{
 				const int ix = x * 3;
-				color.set(scanline[ix] * inv_max_8_bit_,
-						  scanline[ix + 1] * inv_max_8_bit_,
-						  scanline[ix + 2] * inv_max_8_bit_,
-				          1.f);
+				image->setColor(x, y, linear_table.getColor(scanline[ix], scanline[ix + 1], scanline[ix + 2], 255));
+				continue;
 			}
 			else if(is_cmyk)
 			{
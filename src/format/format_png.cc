@@ -27,7 +27,9 @@
 #include "common/logger.h"
 #include "common/param.h"
 #include "common/file.h"
+#include "common/task_pool.h"
 #include "scene/scene.h"
+#include <algorithm>
 
 #include <png.h>
 #include "format/format_png_util.h"
@@ -243,7 +245,7 @@ std::unique_ptr<Image> PngFormat::readFromStructs(const PngStructs &png_structs,
 	// even 2,147,483,647 (max signed int positive value) pixels on one side is purpostrous
 	// at 1 channel, 8 bits per channel and the other side of 1 pixel wide the resulting image uses 2gb of memory
 	const Image::Type type = Image::getTypeFromSettings(has_alpha, (num_chan == 1 || grayscale_));
-	std::unique_ptr<Image> image = Image::factory(w, h, type, optimization);
+	std::unique_ptr<Image> image = Image::factory(w, h, type, optimization, huge_pages_mode_);
 	auto row_pointers = std::unique_ptr<png_bytep[]>(new png_bytep[h]);
 	int bit_mult = 1;
 	if(bit_depth == 16) bit_mult = 2;
@@ -252,76 +254,95 @@ std::unique_ptr<Image> PngFormat::readFromStructs(const PngStructs &png_structs,
 	float divisor = 1.f;
 	if(bit_depth == 8) divisor = inv_max_8_bit_;
 	else if(bit_depth == 16) divisor = inv_max_16_bit_;
-	for(size_t x = 0; x < w; x++)
+	const LinearTable8Bit linear_table(color_space, gamma);
+	//The decoded rows are converted to linear RGB in parallel, by columns as the texels of each column are consecutive in the image
+	parallelFor_global(task_pool_, w, [&](size_t begin, size_t end)
 	{
-		for(size_t y = 0; y < h; y++)
+		for(size_t x = begin; x < end; x++)
 		{
-			Rgba color;
-			const int i = x * num_chan * bit_mult;
-			if(bit_depth < 16)
+			for(size_t y = 0; y < h; y++)
 			{
-				switch(num_chan)
+				Rgba color;
+				const int i = x * num_chan * bit_mult;
+				if(bit_depth == 8)
 				{
-					case 4:
-						color.set(row_pointers[y][i] * divisor,
-								  row_pointers[y][i + 1] * divisor,
-								  row_pointers[y][i + 2] * divisor,
-								  row_pointers[y][i + 3] * divisor);
-						break;
-					case 3:
-						color.set(row_pointers[y][i] * divisor,
-								  row_pointers[y][i + 1] * divisor,
-								  row_pointers[y][i + 2] * divisor,
-								  1.f);
-						break;
-					case 2:
+					const uint8_t *texel = &row_pointers[y][i];
+					switch(num_chan)
 					{
-						const float c = row_pointers[y][i] * divisor;
-						color.set(c, c, c, row_pointers[y][i + 1] * divisor);
-						break;
-					}
-					case 1:
-					{
-						const float c = row_pointers[y][i] * divisor;
-						color.set(c, c, c, 1.f);
-						break;
+						case 4: color = linear_table.getColor(texel[0], texel[1], texel[2], texel[3]); break;
+						case 3: color = linear_table.getColor(texel[0], texel[1], texel[2], 255); break;
+						case 2: color = linear_table.getColor(texel[0], texel[0], texel[0], texel[1]); break;
+						case 1: color = linear_table.getColor(texel[0], texel[0], texel[0], 255); break;
 					}
 				}
-			}
-			else
-			{
-				switch(num_chan)
+				else
 				{
-					case 4:
-						color.set(static_cast<uint16_t>((row_pointers[y][i] << 8) | row_pointers[y][i + 1]) * divisor,
-								  static_cast<uint16_t>((row_pointers[y][i + 2] << 8) | row_pointers[y][i + 3]) * divisor,
-								  static_cast<uint16_t>((row_pointers[y][i + 4] << 8) | row_pointers[y][i + 5]) * divisor,
-								  static_cast<uint16_t>((row_pointers[y][i + 6] << 8) | row_pointers[y][i + 7]) * divisor);
-						break;
-					case 3:
-						color.set(static_cast<uint16_t>((row_pointers[y][i] << 8) | row_pointers[y][i + 1]) * divisor,
-								  static_cast<uint16_t>((row_pointers[y][i + 2] << 8) | row_pointers[y][i + 3]) * divisor,
-								  static_cast<uint16_t>((row_pointers[y][i + 4] << 8) | row_pointers[y][i + 5]) * divisor,
-						          1.f);
-						break;
-					case 2:
+					if(bit_depth < 16)
 					{
-						const float c = static_cast<uint16_t>((row_pointers[y][i] << 8) | row_pointers[y][i + 1]) * divisor;
-						color.set(c, c, c, static_cast<uint16_t>((row_pointers[y][i + 2] << 8) | row_pointers[y][i + 3]) * divisor);
-						break;
+						switch(num_chan)
+						{
+							case 4:
+								color.set(row_pointers[y][i] * divisor,
+										  row_pointers[y][i + 1] * divisor,
+										  row_pointers[y][i + 2] * divisor,
+										  row_pointers[y][i + 3] * divisor);
+								break;
+							case 3:
+								color.set(row_pointers[y][i] * divisor,
+										  row_pointers[y][i + 1] * divisor,
+										  row_pointers[y][i + 2] * divisor,
+										  1.f);
+								break;
+							case 2:
+							{
+								const float c = row_pointers[y][i] * divisor;
+								color.set(c, c, c, row_pointers[y][i + 1] * divisor);
+								break;
+							}
+							case 1:
+							{
+								const float c = row_pointers[y][i] * divisor;
+								color.set(c, c, c, 1.f);
+								break;
+							}
+						}
 					}
-					case 1:
+					else
 					{
-						const float c = static_cast<uint16_t>((row_pointers[y][i] << 8) | row_pointers[y][i + 1]) * divisor;
-						color.set(c, c, c, 1.f);
-						break;
+						switch(num_chan)
+						{
+							case 4:
+								color.set(static_cast<uint16_t>((row_pointers[y][i] << 8) | row_pointers[y][i + 1]) * divisor,
+										  static_cast<uint16_t>((row_pointers[y][i + 2] << 8) | row_pointers[y][i + 3]) * divisor,
+										  static_cast<uint16_t>((row_pointers[y][i + 4] << 8) | row_pointers[y][i + 5]) * divisor,
+										  static_cast<uint16_t>((row_pointers[y][i + 6] << 8) | row_pointers[y][i + 7]) * divisor);
+								break;
+							case 3:
+								color.set(static_cast<uint16_t>((row_pointers[y][i] << 8) | row_pointers[y][i + 1]) * divisor,
+										  static_cast<uint16_t>((row_pointers[y][i + 2] << 8) | row_pointers[y][i + 3]) * divisor,
+										  static_cast<uint16_t>((row_pointers[y][i + 4] << 8) | row_pointers[y][i + 5]) * divisor,
+								          1.f);
+								break;
+							case 2:
+							{
+								const float c = static_cast<uint16_t>((row_pointers[y][i] << 8) | row_pointers[y][i + 1]) * divisor;
+								color.set(c, c, c, static_cast<uint16_t>((row_pointers[y][i + 2] << 8) | row_pointers[y][i + 3]) * divisor);
+								break;
+							}
+							case 1:
+							{
+								const float c = static_cast<uint16_t>((row_pointers[y][i] << 8) | row_pointers[y][i + 1]) * divisor;
+								color.set(c, c, c, 1.f);
+								break;
+							}
+						}
 					}
+					color.linearRgbFromColorSpace(color_space, gamma);
 				}
+				image->setColor(x, y, color);
 			}
-			color.linearRgbFromColorSpace(color_space, gamma);
-			image->setColor(x, y, color);
 		}
-	}
+	}, std::max(static_cast<size_t>(1), static_cast<size_t>(8192 / h)));
 	png_read_end(png_structs.png_ptr_, png_structs.info_ptr_);
 	png_destroy_read_struct(&png_structs.png_ptr_, &png_structs.info_ptr_, nullptr);
 	// cleanup:
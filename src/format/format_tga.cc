@@ -298,7 +298,7 @@ std::unique_ptr<Image> TgaFormat::loadFromFile(const std::string &name, const Im
 	const bool has_alpha = (alpha_bit_depth != 0 || header.cm_entry_bit_depth_ == 32);
 	Image::Type type = Image::getTypeFromSettings(has_alpha, grayscale_);
 	if(!has_alpha && !grayscale_ && (header.cm_entry_bit_depth_ == 16 || header.cm_entry_bit_depth_ == 32 || header.bit_depth_ == 16 || header.bit_depth_ == 32)) type = Image::Type::ColorAlpha;
-	std::unique_ptr<Image> image = Image::factory(header.width_, header.height_, type, optimization);
+	std::unique_ptr<Image> image = Image::factory(header.width_, header.height_, type, optimization, huge_pages_mode_);
 	color_map_ = nullptr;
 	// Read the colormap if needed
 	if(has_color_map)
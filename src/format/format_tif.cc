@@ -27,6 +27,10 @@
 #include "common/param.h"
 #include "scene/scene.h"
 #include "color/color.h"
+#include "common/task_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
 #if defined(_WIN32)
 #include "common/string.h"
@@ -39,14 +43,19 @@ namespace libtiff
 
 BEGIN_YAFARAY
 
-bool TifFormat::saveToFile(const std::string &name, const Image *image)
+static libtiff::TIFF *open_global(const std::string &name, const char *mode)
 {
 #if defined(_WIN32)
 	std::wstring wname = utf8ToWutf16Le_global(name);
-	libtiff::TIFF *out = libtiff::TIFFOpenW(wname.c_str(), "w");	//Windows needs the path in UTF16LE (unicode, UTF16, little endian) so we have to convert the UTF8 path to UTF16
+	return libtiff::TIFFOpenW(wname.c_str(), mode);	//Windows needs the path in UTF16LE (unicode, UTF16, little endian) so we have to convert the UTF8 path to UTF16
 #else
-	libtiff::TIFF *out = libtiff::TIFFOpen(name.c_str(), "w");
+	return libtiff::TIFFOpen(name.c_str(), mode);
 #endif
+}
+
+bool TifFormat::saveToFile(const std::string &name, const Image *image)
+{
+	libtiff::TIFF *out = open_global(name, "w");
 	if(!out)
 	{
 		Y_ERROR << getFormatName() << ": Cannot open file " << name << YENDL;
@@ -98,12 +107,7 @@ bool TifFormat::saveToFile(const std::string &name, const Image *image)
 
 std::unique_ptr<Image> TifFormat::loadFromFile(const std::string &name, const Image::Optimization &optimization, const ColorSpace &color_space, float gamma)
 {
-#if defined(_WIN32)
-	std::wstring wname = utf8ToWutf16Le_global(name);
-	libtiff::TIFF *tif = libtiff::TIFFOpenW(wname.c_str(), "r");	//Windows needs the path in UTF16LE (unicode, UTF16, little endian) so we have to convert the UTF8 path to UTF16
-#else
-	libtiff::TIFF *tif = libtiff::TIFFOpen(name.c_str(), "r");
-#endif
+	libtiff::TIFF *tif = open_global(name, "r");
 	if(!tif)
 	{
 		Y_ERROR << getFormatName() << ": Cannot open file " << name << YENDL;
@@ -113,31 +117,79 @@ std::unique_ptr<Image> TifFormat::loadFromFile(const std::string &name, const Im
 	libtiff::uint32 w, h;
 	TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
 	TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
-	libtiff::uint32 *tiff_data = (libtiff::uint32 *)libtiff::_TIFFmalloc(w * h * sizeof(libtiff::uint32));
-	if(!libtiff::TIFFReadRGBAImage(tif, w, h, tiff_data, 0))
+	//The image is decoded by blocks of rows, the strips or rows of tiles of the file, so they are decoded in parallel
+	const bool is_tiled = libtiff::TIFFIsTiled(tif);
+	libtiff::uint32 block_width = w, block_height = h;
+	if(is_tiled)
+	{
+		TIFFGetField(tif, TIFFTAG_TILEWIDTH, &block_width);
+		TIFFGetField(tif, TIFFTAG_TILELENGTH, &block_height);
+	}
+	else
+	{
+		TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &block_height);
+		block_height = std::min(block_height, h);
+	}
+	libtiff::TIFFClose(tif);
+	if(block_width == 0 || block_height == 0)
 	{
 		Y_ERROR << getFormatName() << ": Error reading TIFF file" << YENDL;
 		return nullptr;
 	}
+
 	const Image::Type type = Image::getTypeFromSettings(true, grayscale_);
-	std::unique_ptr<Image> image = Image::factory(w, h, type, optimization);
-	int i = 0;
-	for(int y = static_cast<int>(h) - 1; y >= 0; y--)
+	std::unique_ptr<Image> image = Image::factory(w, h, type, optimization, huge_pages_mode_);
+	const LinearTable8Bit linear_table(color_space, gamma);
+	const size_t num_blocks = (h + block_height - 1) / block_height;
+	std::atomic<bool> decoded {true};
+	parallelFor_global(task_pool_, num_blocks, [&](size_t begin, size_t end)
 	{
-		for(int x = 0; x < static_cast<int>(w); x++)
+		//Each task reads its blocks with its own handle of the file, as libtiff handles cannot be shared between threads
+		libtiff::TIFF *block_tif = open_global(name, "r");
+		if(!block_tif)
+		{
+			decoded = false;
+			return;
+		}
+		std::vector<libtiff::uint32> block_data(static_cast<size_t>(block_width) * block_height);
+		for(size_t block = begin; block < end && decoded; ++block)
 		{
-			Rgba color;
-			color.set((float)TIFFGetR(tiff_data[i]) * inv_max_8_bit_,
-					  (float)TIFFGetG(tiff_data[i]) * inv_max_8_bit_,
-					  (float)TIFFGetB(tiff_data[i]) * inv_max_8_bit_,
-					  (float)TIFFGetA(tiff_data[i]) * inv_max_8_bit_);
-			color.linearRgbFromColorSpace(color_space, gamma);
-			image->setColor(x, y, color);
-			++i;
+			const libtiff::uint32 row = static_cast<libtiff::uint32>(block * block_height);
+			const libtiff::uint32 num_rows = std::min(block_height, h - row);
+			for(libtiff::uint32 column = 0; column < w; column += block_width)
+			{
+				//The blocks are decoded with the origin at their bottom left corner. The tiles always have their full height, with the rows below the image bottom at their start
+				const libtiff::uint32 num_columns = std::min(block_width, w - column);
+				libtiff::uint32 first_data_row;
+				if(is_tiled)
+				{
+					if(!libtiff::TIFFReadRGBATile(block_tif, column, row, block_data.data())) decoded = false;
+					first_data_row = block_height - num_rows;
+				}
+				else
+				{
+					if(!libtiff::TIFFReadRGBAStrip(block_tif, row, block_data.data())) decoded = false;
+					first_data_row = 0;
+				}
+				if(!decoded) break;
+				for(libtiff::uint32 data_row = 0; data_row < num_rows; ++data_row)
+				{
+					const int y = static_cast<int>(row + num_rows - 1 - data_row);
+					const libtiff::uint32 *data = &block_data[static_cast<size_t>(first_data_row + data_row) * block_width];
+					for(libtiff::uint32 x = 0; x < num_columns; ++x)
+					{
+						image->setColor(column + x, y, linear_table.getColor(TIFFGetR(data[x]), TIFFGetG(data[x]), TIFFGetB(data[x]), TIFFGetA(data[x])));
+					}
+				}
+			}
 		}
+		libtiff::TIFFClose(block_tif);
+	}, 1);
+	if(!decoded)
+	{
+		Y_ERROR << getFormatName() << ": Error reading TIFF file" << YENDL;
+		return nullptr;
 	}
-	libtiff::_TIFFfree(tiff_data);
-	libtiff::TIFFClose(tif);
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getFormatName() << ": Done." << YENDL;
 	return image;
 }
@@ -19,10 +19,12 @@
 #include "geometry/object.h"
 #include "scene/yafaray/object_mesh.h"
 #include "scene/yafaray/object_curve.h"
+#include "scene/yafaray/object_deferred.h"
 #include "scene/yafaray/object_primitive.h"
 #include "scene/yafaray/primitive_sphere.h"
 #include "common/param.h"
 #include "common/logger.h"
+#include <algorithm>
 
 BEGIN_YAFARAY
 
@@ -37,6 +39,7 @@ std::unique_ptr<Object> Object::factory(ParamMap &params, const Scene &scene)
 	params.getParam("type", type);
 	if(type == "mesh") return MeshObject::factory(params, scene);
 	else if(type == "curve") return CurveObject::factory(params, scene);
+	else if(type == "deferred") return DeferredObject::factory(params, scene);
 	else if(type == "sphere")
 	{
 		auto object = std::unique_ptr<PrimitiveObject>(new PrimitiveObject);
@@ -46,4 +49,11 @@ std::unique_ptr<Object> Object::factory(ParamMap &params, const Scene &scene)
 	else return nullptr;
 }
 
+int Object::writePrimitives(const Primitive **primitives) const
+{
+	const std::vector<const Primitive *> object_primitives = getPrimitives();
+	std::copy(object_primitives.begin(), object_primitives.end(), primitives);
+	return static_cast<int>(object_primitives.size());
+}
+
 END_YAFARAY
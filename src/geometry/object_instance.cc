@@ -22,10 +22,28 @@
 
 BEGIN_YAFARAY
 
-ObjectInstance::ObjectInstance(const Object &base_object, const Matrix4 &obj_to_world) : base_object_(base_object), obj_to_world_(new Matrix4(obj_to_world))
+ObjectInstance::ObjectInstance(const Object &base_object, const Matrix4 &obj_to_world) : base_object_(base_object), obj_to_world_(new Matrix4(obj_to_world)), world_to_obj_(new Matrix4(obj_to_world))
 {
+	world_to_obj_->inverse();
+}
+
+void ObjectInstance::setObjToWorldMatrix(const Matrix4 &obj_to_world)
+{
+	*obj_to_world_ = obj_to_world;
+	*world_to_obj_ = obj_to_world;
+	world_to_obj_->inverse();
+}
+
+const Matrix4 *ObjectInstance::getWorldToObjMatrix() const
+{
+	return world_to_obj_ && !world_to_obj_->invalid() ? world_to_obj_.get() : nullptr;
+}
+
+void ObjectInstance::createPrimitiveInstances() const
+{
+	if(!primitive_instances_.empty()) return;
 	const std::vector<const Primitive *> primitives = base_object_.getPrimitives();
-	primitive_instances_.reserve(base_object.numPrimitives());
+	primitive_instances_.reserve(primitives.size());
 	for(const auto &primitive : primitives)
 	{
 		primitive_instances_.emplace_back(new PrimitiveInstance(primitive, *this));
@@ -34,11 +52,20 @@ ObjectInstance::ObjectInstance(const Object &base_object, const Matrix4 &obj_to_
 
 const std::vector<const Primitive *> ObjectInstance::getPrimitives() const
 {
+	createPrimitiveInstances();
 	std::vector<const Primitive *> result;
+	result.reserve(primitive_instances_.size());
 	for(const auto &primitive_instance : primitive_instances_) result.emplace_back(primitive_instance.get());
 	return result;
 }
 
+int ObjectInstance::writePrimitives(const Primitive **primitives) const
+{
+	createPrimitiveInstances();
+	for(const auto &primitive_instance : primitive_instances_) *primitives++ = primitive_instance.get();
+	return static_cast<int>(primitive_instances_.size());
+}
+
 /*void ObjectInstance::sample(float s_1, float s_2, Point3 &p, Vec3 &n) const
 {
 	base_->sample(s_1, s_2, p, n);
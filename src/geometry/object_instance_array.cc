@@ -1,7 +1,5 @@
 /****************************************************************************
- *
  *      This is part of the libYafaRay package
- *      Copyright (C) 2002 Alejandro Conty Estévez
  *
  *      This library is free software; you can redistribute it and/or
  *      modify it under the terms of the GNU Lesser General Public
@@ -16,13 +14,25 @@
  *      You should have received a copy of the GNU Lesser General Public
  *      License along with this library; if not, write to the Free Software
  *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
- *
  */
 
-#include "math/random.h"
+#include "geometry/object_instance_array.h"
+#include "geometry/primitive.h"
 
 BEGIN_YAFARAY
 
-int FastRandom::myseed_ = 123212;
+ObjectInstanceArray::ObjectInstanceArray(const Object &base_object, const float *obj_to_world, size_t num_instances) : ObjectInstance(base_object)
+{
+	obj_to_world_matrices_.resize(num_instances);
+	for(size_t instance_number = 0; instance_number < num_instances; ++instance_number)
+	{
+		const float *rows = obj_to_world + 12 * instance_number;
+		Matrix4 &matrix = obj_to_world_matrices_[instance_number];
+		for(int row = 0; row < 3; ++row)
+			for(int col = 0; col < 4; ++col) matrix[row][col] = rows[4 * row + col];
+		matrix[3][0] = matrix[3][1] = matrix[3][2] = 0.f;
+		matrix[3][3] = 1.f;
+	}
+}
 
-END_YAFARAY
\ No newline at end of file
+END_YAFARAY
@@ -37,6 +37,12 @@ SurfacePoint Primitive::getSurface(const Point3 &hit, const IntersectData &data,
 	return {};
 }
 
+void Primitive::getOrco(const SurfacePoint &sp, Point3 &orco_p, Vec3 &orco_ng) const
+{
+	orco_p = sp.p_;
+	orco_ng = sp.ng_;
+}
+
 IntersectData Primitive::intersect(const Ray &ray, const Matrix4 *obj_to_world) const
 {
 	return {};
@@ -21,14 +21,24 @@
 #include "geometry/surface.h"
 #include "geometry/matrix4.h"
 #include "geometry/bound.h"
+#include "geometry/ray.h"
 
 BEGIN_YAFARAY
 
+PrimitiveInstance::PrimitiveInstance(const Primitive *base_primitive, const ObjectInstance &object_instance) : Primitive(object_instance), base_primitive_(base_primitive)
+{
+}
+
 Bound PrimitiveInstance::getBound(const Matrix4 *) const
 {
 	return base_primitive_->getBound(base_object_.getObjToWorldMatrix());
 }
 
+bool PrimitiveInstance::getMotionBounds(Bound &bound_start, Bound &bound_end, const Matrix4 *) const
+{
+	return base_primitive_->getMotionBounds(bound_start, bound_end, base_object_.getObjToWorldMatrix());
+}
+
 bool PrimitiveInstance::intersectsBound(const ExBound &b, const Matrix4 *) const
 {
 	return base_primitive_->intersectsBound(b, base_object_.getObjToWorldMatrix());
@@ -41,7 +51,17 @@ PolyDouble::ClipResultWithBound PrimitiveInstance::clipToBound(const std::array<
 
 IntersectData PrimitiveInstance::intersect(const Ray &ray, const Matrix4 *) const
 {
-	return base_primitive_->intersect(ray, base_object_.getObjToWorldMatrix());
+	//The ray is transformed once to object space instead of transforming the base primitive vertices to world space in each test
+	const Matrix4 *world_to_obj = static_cast<const ObjectInstance &>(base_object_).getWorldToObjMatrix();
+	if(!world_to_obj) return base_primitive_->intersect(ray, base_object_.getObjToWorldMatrix());
+	//The direction is not normalized after the transformation, so the ray distances and barycentric coordinates are the same in world and object space
+	const Ray object_ray { (*world_to_obj) * ray.from_, (*world_to_obj) * ray.dir_, ray.tmin_, ray.tmax_, ray.time_ };
+	return base_primitive_->intersect(object_ray, nullptr);
+}
+
+bool PrimitiveInstance::getTriangleVertices(std::array<Point3, 3> &vertices, const Matrix4 *) const
+{
+	return base_primitive_->getTriangleVertices(vertices, base_object_.getObjToWorldMatrix());
 }
 
 SurfacePoint PrimitiveInstance::getSurface(const Point3 &hit_point, const IntersectData &intersect_data, const Matrix4 *) const
@@ -18,23 +18,40 @@
 
 #include "geometry/surface.h"
 #include "geometry/ray.h"
+#include "geometry/primitive.h"
 #include "math/interpolation.h"
+#include <algorithm>
 
 BEGIN_YAFARAY
 
 SurfacePoint SurfacePoint::blendSurfacePoints(SurfacePoint const &sp_0, SurfacePoint const &sp_1, float alpha)
 {
 	SurfacePoint result(sp_0);
-	result.n_ = math::lerp(sp_0.n_, sp_1.n_, alpha);
-	result.nu_ = math::lerp(sp_0.nu_, sp_1.nu_, alpha);
-	result.nv_ = math::lerp(sp_0.nv_, sp_1.nv_, alpha);
-	result.dp_du_ = math::lerp(sp_0.dp_du_, sp_1.dp_du_, alpha);
-	result.dp_dv_ = math::lerp(sp_0.dp_dv_, sp_1.dp_dv_, alpha);
-	result.ds_du_ = math::lerp(sp_0.ds_du_, sp_1.ds_du_, alpha);
-	result.ds_dv_ = math::lerp(sp_0.ds_dv_, sp_1.ds_dv_, alpha);
+	result.blend(sp_1, alpha);
 	return result;
 }
 
+void SurfacePoint::blend(const SurfacePoint &sp, float alpha)
+{
+	n_ = math::lerp(n_, sp.n_, alpha);
+	nu_ = math::lerp(nu_, sp.nu_, alpha);
+	nv_ = math::lerp(nv_, sp.nv_, alpha);
+	dp_du_ = math::lerp(dp_du_, sp.dp_du_, alpha);
+	dp_dv_ = math::lerp(dp_dv_, sp.dp_dv_, alpha);
+	ds_du_ = math::lerp(ds_du_, sp.ds_du_, alpha);
+	ds_dv_ = math::lerp(ds_dv_, sp.ds_dv_, alpha);
+}
+
+void SurfacePoint::getOrco(Point3 &orco_p, Vec3 &orco_ng) const
+{
+	if(hit_primitive_) hit_primitive_->getOrco(*this, orco_p, orco_ng);
+	else
+	{
+		orco_p = p_;
+		orco_ng = ng_;
+	}
+}
+
 SpDifferentials::SpDifferentials(const SurfacePoint &spoint, const DiffRay &ray): sp_(spoint)
 {
 	if(ray.has_differentials_)
@@ -51,6 +68,17 @@ SpDifferentials::SpDifferentials(const SurfacePoint &spoint, const DiffRay &ray)
 		dp_dx_ = px - sp_.p_;
 		dp_dy_ = py - sp_.p_;
 	}
+	else if(ray.hasCone())
+	{
+		//The cone footprint is an ellipse on the surface, stretched along the ray direction projected on the surface
+		const float width = ray.getConeWidth((sp_.p_ - ray.from_).length());
+		const float cos_n = std::abs(ray.dir_ * sp_.n_);
+		Vec3 stretch_axis = ray.dir_ - (ray.dir_ * sp_.n_) * sp_.n_;
+		if(stretch_axis.lengthSqr() < 1e-12f) stretch_axis = sp_.nu_;
+		stretch_axis.normalize();
+		dp_dx_ = stretch_axis * (width / std::max(cos_n, 0.05f));
+		dp_dy_ = (sp_.n_ ^ stretch_axis) * width;
+	}
 	else
 	{
 		//dudx = dvdx = 0.;
@@ -59,55 +87,28 @@ SpDifferentials::SpDifferentials(const SurfacePoint &spoint, const DiffRay &ray)
 	}
 }
 
-void SpDifferentials::reflectedRay(const DiffRay &in, DiffRay &out) const
+void SpDifferentials::reflectedRay(const SurfacePoint &sp, const DiffRay &in, DiffRay &out)
 {
-	if(!in.has_differentials_)
+	if(!in.has_differentials_ && !in.hasCone())
 	{
-		out.has_differentials_ = false;
+		out.setCone(0.f, 0.f);
 		return;
 	}
-	// Compute ray differential _rd_ for specular reflection
-	out.has_differentials_ = true;
-	out.xfrom_ = sp_.p_ + dp_dx_;
-	out.yfrom_ = sp_.p_ + dp_dy_;
-	// Compute differential reflected directions
-	//	Normal dndx = bsdf->dgShading.dndu * bsdf->dgShading.dudx +
-	//				  bsdf->dgShading.dndv * bsdf->dgShading.dvdx;
-	//	Normal dndy = bsdf->dgShading.dndu * bsdf->dgShading.dudy +
-	//				  bsdf->dgShading.dndv * bsdf->dgShading.dvdy;
-	const Vec3 dwodx = in.dir_ - in.xdir_, dwody = in.dir_ - in.ydir_;
-	const float d_d_ndx = (dwodx * sp_.n_); // + (out.dir * dndx);
-	const float d_d_ndy = (dwody * sp_.n_); // + (out.dir * dndy);
-	out.xdir_ = out.dir_ - dwodx + 2 * (/* (out.dir * sp.N) * dndx + */ d_d_ndx * sp_.n_);
-	out.ydir_ = out.dir_ - dwody + 2 * (/* (out.dir * sp.N) * dndy + */ d_d_ndy * sp_.n_);
+	//The surface curvature is not taken into account, so a reflection keeps the cone spread
+	out.setCone(in.getConeWidth((sp.p_ - in.from_).length()), in.getConeSpread());
 }
 
-void SpDifferentials::refractedRay(const DiffRay &in, DiffRay &out, float ior) const
+void SpDifferentials::refractedRay(const SurfacePoint &sp, const DiffRay &in, DiffRay &out, float ior)
 {
-	if(!in.has_differentials_)
+	if(!in.has_differentials_ && !in.hasCone())
 	{
-		out.has_differentials_ = false;
+		out.setCone(0.f, 0.f);
 		return;
 	}
-	//RayDifferential rd(p, wi);
-	out.has_differentials_ = true;
-	out.xfrom_ = sp_.p_ + dp_dx_;
-	out.yfrom_ = sp_.p_ + dp_dy_;
-	//if (Dot(wo, n) < 0) eta = 1.f / eta;
-
-	//Normal dndx = bsdf->dgShading.dndu * bsdf->dgShading.dudx + bsdf->dgShading.dndv * bsdf->dgShading.dvdx;
-	//Normal dndy = bsdf->dgShading.dndu * bsdf->dgShading.dudy + bsdf->dgShading.dndv * bsdf->dgShading.dvdy;
-
-	const Vec3 dwodx = in.dir_ - in.xdir_, dwody = in.dir_ - in.ydir_;
-	const float d_d_ndx = (dwodx * sp_.n_); // + Dot(wo, dndx);
-	const float d_d_ndy = (dwody * sp_.n_); // + Dot(wo, dndy);
-
-	//	float mu = IOR * (in.dir * sp.N) - (out.dir * sp.N);
-	const float dmudx = (ior - (ior * ior * (in.dir_ * sp_.n_)) / (out.dir_ * sp_.n_)) * d_d_ndx;
-	const float dmudy = (ior - (ior * ior * (in.dir_ * sp_.n_)) / (out.dir_ * sp_.n_)) * d_d_ndy;
-
-	out.xdir_ = out.dir_ + ior * dwodx - (/* mu * dndx + */ dmudx * sp_.n_);
-	out.ydir_ = out.dir_ + ior * dwody - (/* mu * dndy + */ dmudy * sp_.n_);
+	//Small angles scale by the ratio of the indices of refraction when crossing the surface
+	const bool entering = (in.dir_ * sp.n_) < 0.f;
+	const float spread_ratio = (ior > 0.f) ? (entering ? 1.f / ior : ior) : 1.f;
+	out.setCone(in.getConeWidth((sp.p_ - in.from_).length()), in.getConeSpread() * spread_ratio);
 }
 
 float SpDifferentials::projectedPixelArea()
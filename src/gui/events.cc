@@ -21,11 +21,6 @@
 
 #include "events.h"
 
-GuiUpdateEvent::GuiUpdateEvent(const QRect &rect, bool full_update)
-	: QEvent((QEvent::Type)GuiUpdate), m_rect_(rect), m_full_(full_update)
-{
-}
-
 GuiAreaHighliteEvent::GuiAreaHighliteEvent(const QRect &rect)
 	: QEvent((QEvent::Type)GuiAreaHighlite), m_rect_(rect)
 {
@@ -28,25 +28,11 @@
 
 enum CustomEvents
 {
-	GuiUpdate = QEvent::User,
-	GuiAreaHighlite,
+	GuiAreaHighlite = QEvent::User,
 	ProgressUpdate,
 	ProgressUpdateTag
 };
 
-// this event is just to trigger an update in a widget from
-// outside the main thread
-class GuiUpdateEvent : public QEvent
-{
-	public:
-		GuiUpdateEvent(const QRect &rect, bool full_update = false);
-		inline QRect rect() { return m_rect_; }
-		inline bool fullUpdate() { return m_full_; }
-	private:
-		QRect m_rect_;
-		bool m_full_;
-};
-
 class GuiAreaHighliteEvent : public QEvent
 {
 	public:
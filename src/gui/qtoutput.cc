@@ -23,6 +23,7 @@
 #include "events.h"
 #include "color/color_layers.h"
 #include <QCoreApplication>
+#include <vector>
 
 QtOutput::QtOutput(RenderWidget *render): render_buffer_(render)
 {
@@ -54,14 +55,36 @@ bool QtOutput::putPixel(int x, int y, const yafaray4::ColorLayer &color_layer)
 	return true;
 }
 
+bool QtOutput::putTile(int x_0, int y_0, int width, int height, const yafaray4::ColorLayerTile &color_layer_tile)
+{
+	//The tile is converted in local buffers and copied into the widget buffers at once, locking them only once
+	std::vector<QRgb> colors(static_cast<size_t>(width) * height), alphas(static_cast<size_t>(width) * height);
+	for(int j = 0; j < height; ++j)
+	{
+		const yafaray4::Rgba *tile_colors = color_layer_tile.colors_ + static_cast<size_t>(j) * color_layer_tile.row_stride_;
+		for(int i = 0; i < width; ++i)
+		{
+			const size_t index = static_cast<size_t>(j) * width + i;
+			const int r = std::max(0, std::min(255, (int)(tile_colors[i].r_ * 255.f)));
+			const int g = std::max(0, std::min(255, (int)(tile_colors[i].g_ * 255.f)));
+			const int b = std::max(0, std::min(255, (int)(tile_colors[i].b_ * 255.f)));
+			const int a = std::max(0, std::min(255, (int)(tile_colors[i].a_ * 255.f)));
+			colors[index] = qRgb(r, g, b);
+			alphas[index] = qRgb(a, a, a);
+		}
+	}
+	render_buffer_->setTile(x_0, y_0, width, height, colors.data(), alphas.data());
+	return true;
+}
+
 void QtOutput::flush(const yafaray4::RenderControl &render_control)
 {
-	QCoreApplication::postEvent(render_buffer_, new GuiUpdateEvent(QRect(), true));
+	render_buffer_->markAllDirty();
 }
 
 void QtOutput::flushArea(int x_0, int y_0, int x_1, int y_1)
 {
-	QCoreApplication::postEvent(render_buffer_, new GuiUpdateEvent(QRect(x_0, y_0, x_1 - x_0, y_1 - y_0)));
+	render_buffer_->markDirty(QRect(x_0, y_0, x_1 - x_0, y_1 - y_0));
 }
 
 void QtOutput::highlightArea(int x_0, int y_0, int x_1, int y_1)
@@ -37,6 +37,7 @@ class QtOutput final : public yafaray4::ColorOutput
 
 		// inherited from yafaray4::colorOutput_t
 		virtual bool putPixel(int x, int y, const yafaray4::ColorLayer &color_layer) override;
+		virtual bool putTile(int x_0, int y_0, int width, int height, const yafaray4::ColorLayerTile &color_layer_tile) override;
 		virtual void flush(const yafaray4::RenderControl &render_control) override;
 		virtual void flushArea(int x_0, int y_0, int x_1, int y_1) override;
 		virtual void highlightArea(int x_0, int y_0, int x_1, int y_1) override;
@@ -24,9 +24,13 @@
 #include <QPushButton>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QTimerEvent>
 #include "renderwidget.h"
 #include "events.h"
 #include <iostream>
+#include <cstring>
+
+static constexpr int repaint_interval_global = 40; //!< milliseconds between the repaints of the areas updated while rendering
 
 /*=====================================
 /	RenderWidget implementation
@@ -65,6 +69,8 @@ void RenderWidget::setup(const QSize &s)
 
 void RenderWidget::initBuffers()
 {
+	buffer_mutex_.lock();
+	dirty_region_ = QRegion();
 	color_buffer_ = QImage(image_size_, QImage::Format_RGB32);
 	color_buffer_.fill(0);
 
@@ -76,6 +82,7 @@ void RenderWidget::initBuffers()
 	active_buffer_ = &color_buffer_;
 
 	pix_ = QPixmap::fromImage(*active_buffer_);
+	buffer_mutex_.unlock();
 	setPixmap(pix_);
 }
 
@@ -84,11 +91,20 @@ void RenderWidget::startRendering()
 	rendering_ = true;
 	scale_factor_ = 1.0;
 	initBuffers();
+	if(repaint_timer_id_ == 0) repaint_timer_id_ = startTimer(repaint_interval_global);
 }
 
 void RenderWidget::finishRendering()
 {
 	rendering_ = false;
+	if(repaint_timer_id_ != 0)
+	{
+		killTimer(repaint_timer_id_);
+		repaint_timer_id_ = 0;
+	}
+	buffer_mutex_.lock();
+	dirty_region_ = QRegion();
+	buffer_mutex_.unlock();
 	pix_ = QPixmap::fromImage(*active_buffer_);
 	setPixmap(pix_);
 	update();
@@ -103,6 +119,37 @@ void RenderWidget::setPixel(int x, int y, QRgb color, QRgb alpha)
 	alpha_channel_.setPixel(ix, iy, alpha);
 }
 
+void RenderWidget::setTile(int x, int y, int width, int height, const QRgb *colors, const QRgb *alphas)
+{
+	const int ix = x + border_start_.x();
+	const int iy = y + border_start_.y();
+	const int i_0 = std::max(0, -ix);
+	const int i_1 = std::min(width, color_buffer_.width() - ix);
+	if(i_1 <= i_0) return;
+	buffer_mutex_.lock();
+	for(int j = std::max(0, -iy); j < std::min(height, color_buffer_.height() - iy); ++j)
+	{
+		const size_t offset = static_cast<size_t>(j) * width + i_0;
+		std::memcpy(reinterpret_cast<QRgb *>(color_buffer_.scanLine(iy + j)) + ix + i_0, colors + offset, (i_1 - i_0) * sizeof(QRgb));
+		std::memcpy(reinterpret_cast<QRgb *>(alpha_channel_.scanLine(iy + j)) + ix + i_0, alphas + offset, (i_1 - i_0) * sizeof(QRgb));
+	}
+	buffer_mutex_.unlock();
+}
+
+void RenderWidget::markDirty(const QRect &rect)
+{
+	buffer_mutex_.lock();
+	dirty_region_ += rect;
+	buffer_mutex_.unlock();
+}
+
+void RenderWidget::markAllDirty()
+{
+	buffer_mutex_.lock();
+	dirty_region_ = QRegion(color_buffer_.rect());
+	buffer_mutex_.unlock();
+}
+
 void RenderWidget::paintColorBuffer()
 {
 	buffer_mutex_.lock();
@@ -157,33 +204,7 @@ void RenderWidget::zoomOut(QPoint m_pos)
 
 bool RenderWidget::event(QEvent *e)
 {
-	if(e->type() == (QEvent::Type)GuiUpdate && rendering_)
-	{
-		GuiUpdateEvent *ge = (GuiUpdateEvent *)e;
-
-		ge->accept();
-
-		if(ge->fullUpdate())
-		{
-			buffer_mutex_.lock();
-			QPainter p(&pix_);
-			p.drawImage(QPoint(0, 0), *active_buffer_);
-			buffer_mutex_.unlock();
-			update();
-		}
-		else
-		{
-			buffer_mutex_.lock();
-			QPainter p(&pix_);
-			p.drawImage(ge->rect(), *active_buffer_, ge->rect());
-			buffer_mutex_.unlock();
-			update(ge->rect());
-
-		}
-
-		return true;
-	}
-	else if(e->type() == (QEvent::Type)GuiAreaHighlite && rendering_)
+	if(e->type() == (QEvent::Type)GuiAreaHighlite && rendering_)
 	{
 		GuiAreaHighliteEvent *ge = (GuiAreaHighliteEvent *)e;
 		buffer_mutex_.lock();
@@ -232,6 +253,26 @@ void RenderWidget::paintEvent(QPaintEvent *e)
 	painter.drawPixmap(r, pix_, r);
 }
 
+void RenderWidget::timerEvent(QTimerEvent *e)
+{
+	if(e->timerId() != repaint_timer_id_)
+	{
+		QLabel::timerEvent(e);
+		return;
+	}
+	//All the areas updated since the last repaint are copied to the pixmap and repainted at once
+	QRegion dirty_region;
+	buffer_mutex_.lock();
+	dirty_region.swap(dirty_region_);
+	if(!dirty_region.isEmpty())
+	{
+		QPainter p(&pix_);
+		for(const QRect &rect : dirty_region.rects()) p.drawImage(rect, *active_buffer_, rect);
+	}
+	buffer_mutex_.unlock();
+	if(!dirty_region.isEmpty()) update(dirty_region);
+}
+
 void RenderWidget::wheelEvent(QWheelEvent *e)
 {
 	e->accept();
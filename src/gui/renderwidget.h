@@ -29,6 +29,7 @@
 #include <QScrollArea>
 #include <QScrollBar>
 #include <QMutex>
+#include <QRegion>
 
 class RenderWidget: public QLabel
 {
@@ -49,6 +50,11 @@ class RenderWidget: public QLabel
 		void finishRendering();
 
 		void setPixel(int x, int y, QRgb color, QRgb alpha);
+		//! Copies the rows of a tile of width x height pixels into the buffers, the colors and alphas in row order
+		void setTile(int x, int y, int width, int height, const QRgb *colors, const QRgb *alphas);
+		//! Marks an area to be repainted, the areas marked are repainted together at a fixed rate while rendering. Can be called from the render threads
+		void markDirty(const QRect &rect);
+		void markAllDirty();
 
 		void paintColorBuffer();
 		void paintAlpha();
@@ -66,6 +72,7 @@ class RenderWidget: public QLabel
 		virtual void mousePressEvent(QMouseEvent *e);
 		virtual void mouseReleaseEvent(QMouseEvent *e);
 		virtual void mouseMoveEvent(QMouseEvent *e);
+		virtual void timerEvent(QTimerEvent *e);
 
 	private:
 		bool use_zbuf_;
@@ -84,6 +91,8 @@ class RenderWidget: public QLabel
 
 		QPixmap pix_;
 		QMutex buffer_mutex_;
+		QRegion dirty_region_; //!< areas updated since the last repaint, protected by buffer_mutex_
+		int repaint_timer_id_ = 0;
 
 		QImage color_buffer_;
 		QImage alpha_channel_;
@@ -30,6 +30,10 @@
 #include "image/image_gray_weight.h"
 #include "image/image_gray.h"
 #include "image/image_gray_optimized.h"
+#include "image/image_color_alpha_half.h"
+#include "image/image_color_half.h"
+#include "image/image_gray_alpha_half.h"
+#include "image/image_gray_half.h"
 #include "common/logger.h"
 #include "common/param.h"
 
@@ -39,24 +43,61 @@
 
 BEGIN_YAFARAY
 
-std::unique_ptr<Image> Image::factory(int width, int height, const Type &type, const Optimization &optimization)
+std::unique_ptr<Image> Image::factory(int width, int height, const Type &type, const Optimization &optimization, HugePages::Mode huge_pages_mode)
 {
 	if(Y_LOG_HAS_DEBUG) Y_DEBUG PRTEXT(**Image::factory) PREND;
-	if(type == Type::ColorAlphaWeight) return std::unique_ptr<Image>(new ImageColorAlphaWeight(width, height));
-	else if(type == Type::GrayAlphaWeight) return std::unique_ptr<Image>(new ImageGrayAlphaWeight(width, height));
-	else if(type == Type::ColorAlpha && optimization == Optimization::None) return std::unique_ptr<Image>(new ImageColorAlpha(width, height));
-	else if(type == Type::ColorAlpha && optimization == Optimization::Optimized) return std::unique_ptr<Image>(new ImageColorAlphaOptimized(width, height));
-	else if(type == Type::ColorAlpha && optimization == Optimization::Compressed) return std::unique_ptr<Image>(new ImageColorAlphaCompressed(width, height));
-	else if(type == Type::Color && optimization == Optimization::None) return std::unique_ptr<Image>(new ImageColor(width, height));
-	else if(type == Type::Color && optimization == Optimization::Optimized) return std::unique_ptr<Image>(new ImageColorOptimized(width, height));
-	else if(type == Type::Color && optimization == Optimization::Compressed) return std::unique_ptr<Image>(new ImageColorCompressed(width, height));
-	else if(type == Type::GrayAlpha) return std::unique_ptr<Image>(new ImageGrayAlpha(width, height));
-	else if(type == Type::GrayWeight) return std::unique_ptr<Image>(new ImageGrayWeight(width, height));
-	else if(type == Type::Gray && optimization == Optimization::None) return std::unique_ptr<Image>(new ImageGray(width, height));
-	else if(type == Type::Gray && (optimization == Optimization::Optimized || optimization == Optimization::Compressed)) return std::unique_ptr<Image>(new ImageGrayOptimized(width, height));
+	if(optimization == Optimization::BlockCompressed) return factory(width, height, type, Optimization::None, huge_pages_mode);
+	else if(type == Type::ColorAlphaWeight) return std::unique_ptr<Image>(new ImageColorAlphaWeight(width, height, huge_pages_mode));
+	else if(type == Type::GrayAlphaWeight) return std::unique_ptr<Image>(new ImageGrayAlphaWeight(width, height, huge_pages_mode));
+	else if(type == Type::ColorAlpha && optimization == Optimization::HalfFloat) return std::unique_ptr<Image>(new ImageColorAlphaHalf(width, height, huge_pages_mode));
+	else if(type == Type::Color && optimization == Optimization::HalfFloat) return std::unique_ptr<Image>(new ImageColorHalf(width, height, huge_pages_mode));
+	else if(type == Type::GrayAlpha && optimization == Optimization::HalfFloat) return std::unique_ptr<Image>(new ImageGrayAlphaHalf(width, height, huge_pages_mode));
+	else if(type == Type::Gray && optimization == Optimization::HalfFloat) return std::unique_ptr<Image>(new ImageGrayHalf(width, height, huge_pages_mode));
+	else if(type == Type::ColorAlpha && optimization == Optimization::None) return std::unique_ptr<Image>(new ImageColorAlpha(width, height, huge_pages_mode));
+	else if(type == Type::ColorAlpha && optimization == Optimization::Optimized) return std::unique_ptr<Image>(new ImageColorAlphaOptimized(width, height, huge_pages_mode));
+	else if(type == Type::ColorAlpha && optimization == Optimization::Compressed) return std::unique_ptr<Image>(new ImageColorAlphaCompressed(width, height, huge_pages_mode));
+	else if(type == Type::Color && optimization == Optimization::None) return std::unique_ptr<Image>(new ImageColor(width, height, huge_pages_mode));
+	else if(type == Type::Color && optimization == Optimization::Optimized) return std::unique_ptr<Image>(new ImageColorOptimized(width, height, huge_pages_mode));
+	else if(type == Type::Color && optimization == Optimization::Compressed) return std::unique_ptr<Image>(new ImageColorCompressed(width, height, huge_pages_mode));
+	else if(type == Type::GrayAlpha) return std::unique_ptr<Image>(new ImageGrayAlpha(width, height, huge_pages_mode));
+	else if(type == Type::GrayWeight) return std::unique_ptr<Image>(new ImageGrayWeight(width, height, huge_pages_mode));
+	else if(type == Type::Gray && optimization == Optimization::None) return std::unique_ptr<Image>(new ImageGray(width, height, huge_pages_mode));
+	else if(type == Type::Gray && (optimization == Optimization::Optimized || optimization == Optimization::Compressed)) return std::unique_ptr<Image>(new ImageGrayOptimized(width, height, huge_pages_mode));
 	else return nullptr;
 }
 
+void Image::getColumnColors(int x, int y, int num, Rgba *colors) const
+{
+	for(int texel = 0; texel < num; ++texel) colors[texel] = getColor(x, y + texel);
+}
+
+size_t Image::getMemorySize() const
+{
+	return static_cast<size_t>(width_) * height_ * getPixelSize(getType(), getOptimization());
+}
+
+size_t Image::getPixelSize(const Type &type, const Optimization &optimization)
+{
+	if(optimization == Optimization::BlockCompressed) return getPixelSize(type, Optimization::None);
+	else if(type == Type::ColorAlphaWeight) return sizeof(Pixel);
+	else if(type == Type::GrayAlphaWeight) return sizeof(PixelGrayAlpha);
+	else if(type == Type::ColorAlpha && optimization == Optimization::HalfFloat) return sizeof(RgbaHalf);
+	else if(type == Type::Color && optimization == Optimization::HalfFloat) return sizeof(RgbHalf);
+	else if(type == Type::GrayAlpha && optimization == Optimization::HalfFloat) return sizeof(GrayAlphaHalf);
+	else if(type == Type::Gray && optimization == Optimization::HalfFloat) return sizeof(GrayHalf);
+	else if(type == Type::ColorAlpha && optimization == Optimization::None) return sizeof(RgbAlpha);
+	else if(type == Type::ColorAlpha && optimization == Optimization::Optimized) return sizeof(Rgba1010108);
+	else if(type == Type::ColorAlpha && optimization == Optimization::Compressed) return sizeof(Rgba7773);
+	else if(type == Type::Color && optimization == Optimization::None) return sizeof(Rgb);
+	else if(type == Type::Color && optimization == Optimization::Optimized) return sizeof(Rgb101010);
+	else if(type == Type::Color && optimization == Optimization::Compressed) return sizeof(Rgb565);
+	else if(type == Type::GrayAlpha) return sizeof(GrayAlpha);
+	else if(type == Type::GrayWeight) return sizeof(PixelGray);
+	else if(type == Type::Gray && optimization == Optimization::None) return sizeof(Gray);
+	else if(type == Type::Gray) return sizeof(Gray8);
+	else return 0;
+}
+
 Image::Type Image::imageTypeWithAlpha(Type image_type)
 {
 	if(image_type == Type::Gray) image_type = Type::GrayAlpha;
@@ -146,6 +187,8 @@ Image::Optimization Image::getOptimizationTypeFromName(const std::string &optimi
 	if(optimization_type_name == "none") return Image::Optimization::None;
 	else if(optimization_type_name == "optimized") return Image::Optimization::Optimized;
 	else if(optimization_type_name == "compressed") return Image::Optimization::Compressed;
+	else if(optimization_type_name == "block_compressed") return Image::Optimization::BlockCompressed;
+	else if(optimization_type_name == "half_float") return Image::Optimization::HalfFloat;
 	else return Image::Optimization::Optimized;
 }
 
@@ -157,6 +200,8 @@ std::string Image::getOptimizationName(const Optimization &optimization_type)
 		case Image::Optimization::None: return "none";
 		case Image::Optimization::Optimized: return "optimized";
 		case Image::Optimization::Compressed: return "compressed";
+		case Image::Optimization::BlockCompressed: return "block_compressed";
+		case Image::Optimization::HalfFloat: return "half_float";
 		default: return "optimized";
 	}
 }
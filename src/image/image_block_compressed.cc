@@ -0,0 +1,262 @@
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+
+#include "image/image_block_compressed.h"
+#include "common/task_pool.h"
+#include "color/color.h"
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+constexpr int ImageBlockCompressed::block_size_;
+
+//! Continuous version of the half float bit pattern of a positive value, roughly logarithmic so the HDR endpoints and levels keep the same relative precision at any brightness
+static float hdrCode_global(float value)
+{
+	if(!(value > 0.f)) return 0.f; //negative values and NaN
+	if(value >= 65504.f) return 31743.f; //largest half float
+	int exponent;
+	const float mantissa = std::frexp(value, &exponent);
+	const int half_exponent = exponent + 14;
+	if(half_exponent <= 0) return value * 16777216.f; //half float subnormals, in steps of 2^-24
+	return (half_exponent + 2.f * mantissa - 1.f) * 1024.f;
+}
+
+static float hdrValue_global(float code)
+{
+	if(code < 1024.f) return code / 16777216.f;
+	const int half_exponent = static_cast<int>(code / 1024.f);
+	return std::ldexp(1.f + code / 1024.f - half_exponent, half_exponent - 15);
+}
+
+/*! Encodes 16 texels, with their channels in quantization steps, as the endpoints of their principal axis rounded to the quantization steps
+ * and the index of the nearest of the levels between the endpoints for each texel */
+static void encodeEndpoints_global(const std::array<std::array<float, 3>, 16> &texels, const std::array<int, 3> &max_steps, int num_levels, std::array<int, 3> &endpoint_0, std::array<int, 3> &endpoint_1, std::array<int, 16> &indices)
+{
+	std::array<float, 3> mean {{ 0.f, 0.f, 0.f }};
+	for(const auto &texel : texels) for(int chan = 0; chan < 3; ++chan) mean[chan] += texel[chan] / 16.f;
+	std::array<float, 6> covariance {{ 0.f, 0.f, 0.f, 0.f, 0.f, 0.f }}; //xx, xy, xz, yy, yz, zz
+	for(const auto &texel : texels)
+	{
+		const float dx = texel[0] - mean[0], dy = texel[1] - mean[1], dz = texel[2] - mean[2];
+		covariance[0] += dx * dx; covariance[1] += dx * dy; covariance[2] += dx * dz;
+		covariance[3] += dy * dy; covariance[4] += dy * dz; covariance[5] += dz * dz;
+	}
+	//Principal axis by power iteration, starting from the covariance row of the channel with the largest variance
+	std::array<float, 3> axis;
+	if(covariance[0] >= covariance[3] && covariance[0] >= covariance[5]) axis = {{ covariance[0], covariance[1], covariance[2] }};
+	else if(covariance[3] >= covariance[5]) axis = {{ covariance[1], covariance[3], covariance[4] }};
+	else axis = {{ covariance[2], covariance[4], covariance[5] }};
+	for(int iteration = 0; iteration < 8; ++iteration)
+	{
+		const std::array<float, 3> product {{
+				covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+				covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+				covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] }};
+		const float norm = std::max({ std::abs(product[0]), std::abs(product[1]), std::abs(product[2]) });
+		if(norm <= 0.f) break;
+		for(int chan = 0; chan < 3; ++chan) axis[chan] = product[chan] / norm;
+	}
+	const float axis_length_squared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float t_min = 0.f, t_max = 0.f;
+	if(axis_length_squared > 0.f)
+	{
+		for(int chan = 0; chan < 3; ++chan) axis[chan] /= std::sqrt(axis_length_squared);
+		t_min = t_max = (texels[0][0] - mean[0]) * axis[0] + (texels[0][1] - mean[1]) * axis[1] + (texels[0][2] - mean[2]) * axis[2];
+		for(const auto &texel : texels)
+		{
+			const float t = (texel[0] - mean[0]) * axis[0] + (texel[1] - mean[1]) * axis[1] + (texel[2] - mean[2]) * axis[2];
+			t_min = std::min(t_min, t);
+			t_max = std::max(t_max, t);
+		}
+	}
+	else axis = {{ 0.f, 0.f, 0.f }}; //all the texels are the same
+	std::array<float, 3> direction; //between the rounded endpoints
+	float direction_length_squared = 0.f;
+	for(int chan = 0; chan < 3; ++chan)
+	{
+		endpoint_0[chan] = std::max(0, std::min(max_steps[chan], static_cast<int>(std::lround(mean[chan] + axis[chan] * t_min))));
+		endpoint_1[chan] = std::max(0, std::min(max_steps[chan], static_cast<int>(std::lround(mean[chan] + axis[chan] * t_max))));
+		direction[chan] = static_cast<float>(endpoint_1[chan] - endpoint_0[chan]);
+		direction_length_squared += direction[chan] * direction[chan];
+	}
+	//The levels are evenly spaced between the endpoints, so the nearest one is the rounded projection of the texel on the line between them
+	for(int texel_id = 0; texel_id < 16; ++texel_id)
+	{
+		if(direction_length_squared <= 0.f)
+		{
+			indices[texel_id] = 0;
+			continue;
+		}
+		float projection = 0.f;
+		for(int chan = 0; chan < 3; ++chan) projection += (texels[texel_id][chan] - endpoint_0[chan]) * direction[chan];
+		indices[texel_id] = std::max(0, std::min(num_levels - 1, static_cast<int>(std::lround(projection / direction_length_squared * (num_levels - 1)))));
+	}
+}
+
+//! Encodes 16 values in [0, 1] as two 8 bit endpoints followed by the 3 bit index of the nearest of the 8 levels between them for each value
+static uint64_t encodeSingleChannel_global(const std::array<float, 16> &values)
+{
+	const auto min_max = std::minmax_element(values.begin(), values.end());
+	const int endpoint_0 = static_cast<int>(std::lround(std::max(0.f, std::min(1.f, *min_max.first)) * 255.f));
+	const int endpoint_1 = static_cast<int>(std::lround(std::max(0.f, std::min(1.f, *min_max.second)) * 255.f));
+	uint64_t block = static_cast<uint64_t>(endpoint_0) | static_cast<uint64_t>(endpoint_1) << 8;
+	if(endpoint_1 == endpoint_0) return block;
+	for(int texel_id = 0; texel_id < 16; ++texel_id)
+	{
+		const int index = std::max(0, std::min(7, static_cast<int>(std::lround((values[texel_id] * 255.f - endpoint_0) * 7.f / (endpoint_1 - endpoint_0)))));
+		block |= static_cast<uint64_t>(index) << (16 + 3 * texel_id);
+	}
+	return block;
+}
+
+static float decodeSingleChannel_global(uint64_t block, int texel_id)
+{
+	const int endpoint_0 = static_cast<int>(block & 0xFF);
+	const int endpoint_1 = static_cast<int>((block >> 8) & 0xFF);
+	const int index = static_cast<int>((block >> (16 + 3 * texel_id)) & 0x7);
+	return (endpoint_0 * (7 - index) + endpoint_1 * index) / (7.f * 255.f);
+}
+
+ImageBlockCompressed::ImageBlockCompressed(int width, int height, const Type &type, bool hdr) : Image(width, height), type_(type), hdr_(hdr), num_blocks_x_((width + block_size_ - 1) / block_size_), words_per_block_(hdr ? 2 : 1)
+{
+	const size_t num_blocks = static_cast<size_t>(num_blocks_x_) * ((height + block_size_ - 1) / block_size_);
+	blocks_.resize(num_blocks * words_per_block_);
+	if(Image::hasAlpha(type)) alpha_blocks_.resize(num_blocks);
+}
+
+std::unique_ptr<Image> ImageBlockCompressed::compress(const Image &image, TaskPool *task_pool)
+{
+	const Type type = image.getType();
+	if(type != Type::Gray && type != Type::GrayAlpha && type != Type::Color && type != Type::ColorAlpha) return nullptr;
+	if(image.getOptimization() == Optimization::BlockCompressed) return nullptr;
+	std::unique_ptr<ImageBlockCompressed> result(new ImageBlockCompressed(image.getWidth(), image.getHeight(), type, image.getOptimization() == Optimization::None));
+	const int num_blocks_x = result->num_blocks_x_;
+	parallelFor_global(task_pool, (image.getHeight() + block_size_ - 1) / block_size_, [&](size_t begin, size_t end)
+	{
+		for(size_t block_y = begin; block_y < end; ++block_y) for(int block_x = 0; block_x < num_blocks_x; ++block_x) result->encodeBlock(image, block_x, block_y);
+	}, 16);
+	return std::unique_ptr<Image>(std::move(result));
+}
+
+void ImageBlockCompressed::encodeBlock(const Image &image, int block_x, int block_y)
+{
+	//The texels outside the image in the blocks of the right and bottom edges repeat the last ones
+	std::array<Rgba, 16> colors;
+	for(int texel_y = 0; texel_y < block_size_; ++texel_y)
+	{
+		const int y = std::min(block_y * block_size_ + texel_y, height_ - 1);
+		for(int texel_x = 0; texel_x < block_size_; ++texel_x) colors[texel_y * block_size_ + texel_x] = image.getColor(std::min(block_x * block_size_ + texel_x, width_ - 1), y);
+	}
+	const size_t block_index = static_cast<size_t>(block_y) * num_blocks_x_ + block_x;
+	const bool grayscale = Image::isGrayscale(type_);
+	if(hdr_)
+	{
+		std::array<std::array<float, 3>, 16> texels;
+		for(int texel_id = 0; texel_id < 16; ++texel_id)
+		{
+			const Rgba &color = colors[texel_id];
+			if(grayscale) texels[texel_id].fill(hdrCode_global((color.r_ + color.g_ + color.b_) / 3.f) / 32.f);
+			else texels[texel_id] = {{ hdrCode_global(color.r_) / 32.f, hdrCode_global(color.g_) / 32.f, hdrCode_global(color.b_) / 32.f }};
+		}
+		std::array<int, 3> endpoint_0, endpoint_1;
+		std::array<int, 16> indices;
+		encodeEndpoints_global(texels, {{ 1023, 1023, 1023 }}, 16, endpoint_0, endpoint_1, indices);
+		uint64_t endpoints = 0, block_indices = 0;
+		for(int chan = 0; chan < 3; ++chan) endpoints |= static_cast<uint64_t>(endpoint_0[chan]) << (10 * chan) | static_cast<uint64_t>(endpoint_1[chan]) << (10 * (chan + 3));
+		for(int texel_id = 0; texel_id < 16; ++texel_id) block_indices |= static_cast<uint64_t>(indices[texel_id]) << (4 * texel_id);
+		blocks_[2 * block_index] = endpoints;
+		blocks_[2 * block_index + 1] = block_indices;
+	}
+	else if(grayscale)
+	{
+		std::array<float, 16> values;
+		for(int texel_id = 0; texel_id < 16; ++texel_id) values[texel_id] = (colors[texel_id].r_ + colors[texel_id].g_ + colors[texel_id].b_) / 3.f;
+		blocks_[block_index] = encodeSingleChannel_global(values);
+	}
+	else
+	{
+		std::array<std::array<float, 3>, 16> texels;
+		for(int texel_id = 0; texel_id < 16; ++texel_id)
+		{
+			const Rgba &color = colors[texel_id];
+			texels[texel_id] = {{
+					std::sqrt(std::max(0.f, std::min(1.f, color.r_))) * 31.f,
+					std::sqrt(std::max(0.f, std::min(1.f, color.g_))) * 63.f,
+					std::sqrt(std::max(0.f, std::min(1.f, color.b_))) * 31.f }};
+		}
+		std::array<int, 3> endpoint_0, endpoint_1;
+		std::array<int, 16> indices;
+		encodeEndpoints_global(texels, {{ 31, 63, 31 }}, 4, endpoint_0, endpoint_1, indices);
+		uint64_t block = static_cast<uint64_t>(endpoint_0[0] << 11 | endpoint_0[1] << 5 | endpoint_0[2]) | static_cast<uint64_t>(endpoint_1[0] << 11 | endpoint_1[1] << 5 | endpoint_1[2]) << 16;
+		for(int texel_id = 0; texel_id < 16; ++texel_id) block |= static_cast<uint64_t>(indices[texel_id]) << (32 + 2 * texel_id);
+		blocks_[block_index] = block;
+	}
+	if(!alpha_blocks_.empty())
+	{
+		std::array<float, 16> alphas;
+		for(int texel_id = 0; texel_id < 16; ++texel_id) alphas[texel_id] = colors[texel_id].a_;
+		alpha_blocks_[block_index] = encodeSingleChannel_global(alphas);
+	}
+}
+
+Rgba ImageBlockCompressed::getColor(int x, int y) const
+{
+	const size_t block_index = getBlockIndex(x, y);
+	const int texel_id = getTexelIndex(x, y);
+	const float alpha = alpha_blocks_.empty() ? 1.f : decodeSingleChannel_global(alpha_blocks_[block_index], texel_id);
+	if(hdr_)
+	{
+		const uint64_t endpoints = blocks_[2 * block_index];
+		const int index = static_cast<int>((blocks_[2 * block_index + 1] >> (4 * texel_id)) & 0xF);
+		std::array<float, 3> rgb;
+		for(int chan = 0; chan < 3; ++chan)
+		{
+			const int endpoint_0 = static_cast<int>((endpoints >> (10 * chan)) & 0x3FF);
+			const int endpoint_1 = static_cast<int>((endpoints >> (10 * (chan + 3))) & 0x3FF);
+			rgb[chan] = hdrValue_global((endpoint_0 * (15 - index) + endpoint_1 * index) * (32.f / 15.f));
+		}
+		return { rgb[0], rgb[1], rgb[2], alpha };
+	}
+	else if(Image::isGrayscale(type_)) return { decodeSingleChannel_global(blocks_[block_index], texel_id), alpha };
+	else
+	{
+		const uint64_t block = blocks_[block_index];
+		const int index = static_cast<int>((block >> (32 + 2 * texel_id)) & 0x3);
+		const int color_0 = static_cast<int>(block & 0xFFFF);
+		const int color_1 = static_cast<int>((block >> 16) & 0xFFFF);
+		const auto decode = [index](int endpoint_0, int endpoint_1, int max_steps)
+		{
+			const float value = (endpoint_0 * (3 - index) + endpoint_1 * index) / (3.f * max_steps);
+			return value * value; //the colors are encoded with gamma 2
+		};
+		return { decode(color_0 >> 11, color_1 >> 11, 31), decode((color_0 >> 5) & 0x3F, (color_1 >> 5) & 0x3F, 63), decode(color_0 & 0x1F, color_1 & 0x1F, 31), alpha };
+	}
+}
+
+float ImageBlockCompressed::getFloat(int x, int y) const
+{
+	return getColor(x, y).r_;
+}
+
+END_YAFARAY
@@ -0,0 +1,83 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "image/image_host_buffer.h"
+#include "color/color.h"
+#include <cstring>
+
+BEGIN_YAFARAY
+
+HostPixelBuffer::HostPixelBuffer(const void *data, int width, int height, int num_channels, bool float_data, int64_t row_stride, bool reference_host_memory) : width_(width), height_(height), num_channels_(num_channels), float_data_(float_data), row_stride_(row_stride)
+{
+	pixel_size_ = num_channels * (float_data ? sizeof(float) : sizeof(uint8_t));
+	if(reference_host_memory)
+	{
+		data_ = static_cast<const uint8_t *>(data);
+		return;
+	}
+	//The copy is packed top-down, whatever the row stride of the host buffer
+	const size_t row_size = static_cast<size_t>(width * pixel_size_);
+	owned_data_.resize(row_size * height);
+	for(int y = 0; y < height; ++y) std::memcpy(&owned_data_[y * row_size], static_cast<const uint8_t *>(data) + y * row_stride, row_size);
+	data_ = owned_data_.data();
+	row_stride_ = static_cast<int64_t>(row_size);
+}
+
+ImageHostBuffer::ImageHostBuffer(std::shared_ptr<const HostPixelBuffer> buffer, const ColorSpace &color_space, float gamma) : Image(buffer->getWidth(), buffer->getHeight()), buffer_(std::move(buffer)), color_space_(color_space), gamma_(gamma), linear_table_(color_space, gamma)
+{
+}
+
+Image::Type ImageHostBuffer::getType() const
+{
+	switch(buffer_->getNumChannels())
+	{
+		case 1: return Type::Gray;
+		case 2: return Type::GrayAlpha;
+		case 3: return Type::Color;
+		default: return Type::ColorAlpha;
+	}
+}
+
+Rgba ImageHostBuffer::getColor(int x, int y) const
+{
+	const uint8_t *pixel = buffer_->getPixel(x, y);
+	if(!buffer_->isFloat())
+	{
+		switch(buffer_->getNumChannels())
+		{
+			case 1: return linear_table_.getColor(pixel[0], pixel[0], pixel[0], 255);
+			case 2: return linear_table_.getColor(pixel[0], pixel[0], pixel[0], pixel[1]);
+			case 3: return linear_table_.getColor(pixel[0], pixel[1], pixel[2], 255);
+			default: return linear_table_.getColor(pixel[0], pixel[1], pixel[2], pixel[3]);
+		}
+	}
+	float values[4];
+	std::memcpy(values, pixel, buffer_->getNumChannels() * sizeof(float)); //the host rows do not need to be aligned to floats
+	Rgba color;
+	switch(buffer_->getNumChannels())
+	{
+		case 1: color.set(values[0], values[0], values[0], 1.f); break;
+		case 2: color.set(values[0], values[0], values[0], values[1]); break;
+		case 3: color.set(values[0], values[1], values[2], 1.f); break;
+		default: color.set(values[0], values[1], values[2], values[3]); break;
+	}
+	color.linearRgbFromColorSpace(color_space_, gamma_);
+	return color;
+}
+
+END_YAFARAY
@@ -0,0 +1,104 @@
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include "image/image_sparse.h"
+#include "color/color.h"
+
+BEGIN_YAFARAY
+
+constexpr int ImageSparse::tile_size_;
+
+ImageSparse::ImageSparse(int width, int height, const Type &type, const Optimization &optimization) : Image(width, height), type_(type), optimization_(optimization)
+{
+	num_tiles_x_ = (width + tile_size_ - 1) >> tile_shift_;
+	num_tiles_ = num_tiles_x_ * ((height + tile_size_ - 1) >> tile_shift_);
+	tiles_ = std::unique_ptr<std::atomic<Image *>[]>(new std::atomic<Image *>[num_tiles_]);
+	for(int i = 0; i < num_tiles_; ++i) tiles_[i].store(nullptr, std::memory_order_relaxed);
+}
+
+ImageSparse::~ImageSparse()
+{
+	clear();
+}
+
+Image *ImageSparse::getOrCreateTile(int x, int y)
+{
+	std::atomic<Image *> &tile = tiles_[getTileIndex(x, y)];
+	Image *tile_image = tile.load(std::memory_order_acquire);
+	if(tile_image) return tile_image;
+	std::lock_guard<std::mutex> lock_guard(mutex_);
+	tile_image = tile.load(std::memory_order_relaxed);
+	if(!tile_image)
+	{
+		tile_image = Image::factory(tile_size_, tile_size_, type_, optimization_).release();
+		tile.store(tile_image, std::memory_order_release);
+		++num_allocated_tiles_;
+	}
+	return tile_image;
+}
+
+Rgba ImageSparse::getColor(int x, int y) const
+{
+	const Image *tile = getTile(x, y);
+	return tile ? tile->getColor(x & tile_mask_, y & tile_mask_) : Rgba(0.f);
+}
+
+float ImageSparse::getFloat(int x, int y) const
+{
+	const Image *tile = getTile(x, y);
+	return tile ? tile->getFloat(x & tile_mask_, y & tile_mask_) : 0.f;
+}
+
+float ImageSparse::getWeight(int x, int y) const
+{
+	const Image *tile = getTile(x, y);
+	return tile ? tile->getWeight(x & tile_mask_, y & tile_mask_) : 0.f;
+}
+
+void ImageSparse::setColor(int x, int y, const Rgba &col)
+{
+	if(!getTile(x, y) && col.r_ == 0.f && col.g_ == 0.f && col.b_ == 0.f && col.a_ == 0.f) return; //the pixel is already zero
+	getOrCreateTile(x, y)->setColor(x & tile_mask_, y & tile_mask_, col);
+}
+
+void ImageSparse::setFloat(int x, int y, float val)
+{
+	if(!getTile(x, y) && val == 0.f) return;
+	getOrCreateTile(x, y)->setFloat(x & tile_mask_, y & tile_mask_, val);
+}
+
+void ImageSparse::setWeight(int x, int y, float val)
+{
+	if(!getTile(x, y) && val == 0.f) return;
+	getOrCreateTile(x, y)->setWeight(x & tile_mask_, y & tile_mask_, val);
+}
+
+void ImageSparse::clear()
+{
+	for(int i = 0; i < num_tiles_; ++i) delete tiles_[i].exchange(nullptr, std::memory_order_acq_rel);
+	num_allocated_tiles_ = 0;
+}
+
+size_t ImageSparse::getMemorySize() const
+{
+	return num_tiles_ * sizeof(std::atomic<Image *>) + static_cast<size_t>(num_allocated_tiles_.load(std::memory_order_relaxed)) * tile_size_ * tile_size_ * getPixelSize(type_, optimization_);
+}
+
+END_YAFARAY
@@ -0,0 +1,288 @@
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include "image/image_tiled.h"
+#include "image/tile_cache.h"
+#include "color/color.h"
+#include "common/file.h"
+#include "common/logger.h"
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+BEGIN_YAFARAY
+
+const std::string ImageTiled::tile_file_header_ = "YafaRay Tiled Image v1";
+constexpr int ImageTiled::tile_size_;
+constexpr int ImageTiled::max_channels_;
+
+static std::atomic<uint32_t> next_tiled_image_id_global {1};
+
+struct RecentTile
+{
+	uint64_t key_ = 0; //!< the image ids start at 1, so key 0 is never used
+	std::shared_ptr<const Image> tile_;
+};
+
+//!< Last tiles used by each thread, so the neighbour texel lookups of the texture interpolations do not lock the tile cache
+static thread_local std::array<RecentTile, 16> recent_tiles_global;
+
+static bool isTileable_global(const Image::Type &type)
+{
+	return type == Image::Type::Gray || type == Image::Type::GrayAlpha || type == Image::Type::Color || type == Image::Type::ColorAlpha;
+}
+
+//! Channels stored in the tile file for each image type: gray, gray + alpha, rgb or rgb + alpha
+static std::array<float, 4> channelsFromColor_global(const Rgba &color, const Image::Type &type)
+{
+	if(type == Image::Type::Gray) return {{ color.r_, 0.f, 0.f, 0.f }};
+	else if(type == Image::Type::GrayAlpha) return {{ color.r_, color.a_, 0.f, 0.f }};
+	else return {{ color.r_, color.g_, color.b_, color.a_ }};
+}
+
+static Rgba colorFromChannels_global(const std::array<float, 4> &channels, const Image::Type &type)
+{
+	if(type == Image::Type::Gray) return { channels[0], 1.f };
+	else if(type == Image::Type::GrayAlpha) return { channels[0], channels[1] };
+	else if(type == Image::Type::Color) return { channels[0], channels[1], channels[2], 1.f };
+	else return { channels[0], channels[1], channels[2], channels[3] };
+}
+
+ImageTiled::ImageTiled(std::shared_ptr<const MappedFile> file, uint64_t data_offset, int width, int height, const Type &type, const Optimization &optimization) : Image(width, height), file_(std::move(file)), data_offset_(data_offset), type_(type), optimization_(optimization), num_tiles_x_((width + tile_size_ - 1) / tile_size_), id_(next_tiled_image_id_global++)
+{
+}
+
+ImageTiled::~ImageTiled()
+{
+	tile_cache_global.removeImage(id_);
+}
+
+Rgba ImageTiled::getColor(int x, int y) const
+{
+	return getTile(x, y)->getColor(x % tile_size_, y % tile_size_);
+}
+
+void ImageTiled::getColumnColors(int x, int y, int num, Rgba *colors) const
+{
+	while(num > 0)
+	{
+		const int num_in_tile = std::min(num, tile_size_ - y % tile_size_);
+		getTile(x, y)->getColumnColors(x % tile_size_, y % tile_size_, num_in_tile, colors);
+		y += num_in_tile;
+		colors += num_in_tile;
+		num -= num_in_tile;
+	}
+}
+
+float ImageTiled::getFloat(int x, int y) const
+{
+	return getTile(x, y)->getFloat(x % tile_size_, y % tile_size_);
+}
+
+const Image *ImageTiled::getTile(int x, int y) const
+{
+	const int tile_x = x / tile_size_;
+	const int tile_y = y / tile_size_;
+	const uint64_t key = (static_cast<uint64_t>(id_) << 32) | static_cast<uint32_t>(tile_y * num_tiles_x_ + tile_x);
+	RecentTile &recent_tile = recent_tiles_global[(key ^ (key >> 32)) % recent_tiles_global.size()];
+	if(recent_tile.key_ != key)
+	{
+		std::shared_ptr<const Image> tile = tile_cache_global.findTile(key);
+		if(!tile)
+		{
+			tile = loadTile(tile_x, tile_y);
+			tile = tile_cache_global.insertTile(key, tile, static_cast<size_t>(tile->getWidth()) * tile->getHeight() * getPixelSize(type_, optimization_));
+		}
+		recent_tile.key_ = key;
+		recent_tile.tile_ = std::move(tile);
+	}
+	return recent_tile.tile_.get();
+}
+
+std::shared_ptr<const Image> ImageTiled::loadTile(int tile_x, int tile_y) const
+{
+	const int tile_width = std::min(tile_size_, width_ - tile_x * tile_size_);
+	const int tile_height = std::min(tile_size_, height_ - tile_y * tile_size_);
+	//Bounded again for the channels array, although loadTileFile already rejects the files with more channels
+	const int num_channels = std::min(getNumChannels(), max_channels_);
+	const size_t channel_size = getChannelSize(optimization_);
+	//All the rows of tiles above are full height, and all the tiles to the left in the same row have the same height as this one
+	const uint64_t texel_offset = static_cast<uint64_t>(tile_y) * tile_size_ * width_ + static_cast<uint64_t>(tile_x) * tile_size_ * tile_height;
+	const char *data = file_->data() + data_offset_ + texel_offset * num_channels * channel_size;
+	std::unique_ptr<Image> tile = Image::factory(tile_width, tile_height, type_, optimization_);
+	std::array<float, max_channels_> channels {{ 0.f, 0.f, 0.f, 0.f }};
+	for(int y = 0; y < tile_height; ++y)
+	{
+		for(int x = 0; x < tile_width; ++x)
+		{
+			for(int channel = 0; channel < num_channels; ++channel)
+			{
+				if(optimization_ == Optimization::None) std::memcpy(&channels[channel], data, sizeof(float));
+				else
+				{
+					uint16_t value;
+					std::memcpy(&value, data, sizeof(uint16_t));
+					channels[channel] = static_cast<float>(value) / 65535.f;
+				}
+				data += channel_size;
+			}
+			tile->setColor(x, y, colorFromChannels_global(channels, type_));
+		}
+	}
+	return std::shared_ptr<const Image>(std::move(tile));
+}
+
+bool ImageTiled::saveTileFile(const std::string &path, uint64_t signature, const std::vector<std::unique_ptr<Image>> &images)
+{
+	if(images.empty()) return false;
+	const Type type = images.front()->getType();
+	const Optimization optimization = images.front()->getOptimization();
+	if(!isTileable_global(type)) return false;
+	const int num_channels = getNumChannels(type);
+	const size_t channel_size = getChannelSize(optimization);
+	//Written to a temporary file first, so an interrupted save never leaves a truncated tile file
+	const std::string path_tmp = path + ".tmp";
+	File file(path_tmp);
+	if(!file.open("wb")) return false;
+	bool result = file.append(tile_file_header_);
+	result = result && file.append<uint64_t>(signature);
+	result = result && file.append<int32_t>(static_cast<int32_t>(type));
+	result = result && file.append<int32_t>(static_cast<int32_t>(optimization));
+	result = result && file.append<int32_t>(tile_size_);
+	result = result && file.append<uint32_t>(static_cast<uint32_t>(images.size()));
+	uint64_t data_offset = tile_file_header_.size() + 1 + sizeof(uint64_t) + 3 * sizeof(int32_t) + sizeof(uint32_t) + images.size() * (2 * sizeof(int32_t) + sizeof(uint64_t));
+	for(const auto &image : images)
+	{
+		result = result && image->getType() == type && image->getOptimization() == optimization;
+		result = result && file.append<int32_t>(image->getWidth());
+		result = result && file.append<int32_t>(image->getHeight());
+		result = result && file.append<uint64_t>(data_offset);
+		data_offset += static_cast<uint64_t>(image->getWidth()) * image->getHeight() * num_channels * channel_size;
+	}
+	std::vector<char> tile_data;
+	for(const auto &image : images)
+	{
+		const int width = image->getWidth();
+		const int height = image->getHeight();
+		for(int tile_y = 0; result && tile_y * tile_size_ < height; ++tile_y)
+		{
+			for(int tile_x = 0; result && tile_x * tile_size_ < width; ++tile_x)
+			{
+				const int x_end = std::min(width, (tile_x + 1) * tile_size_);
+				const int y_end = std::min(height, (tile_y + 1) * tile_size_);
+				tile_data.clear();
+				for(int y = tile_y * tile_size_; y < y_end; ++y)
+				{
+					for(int x = tile_x * tile_size_; x < x_end; ++x)
+					{
+						const std::array<float, 4> channels = channelsFromColor_global(image->getColor(x, y), type);
+						for(int channel = 0; channel < num_channels; ++channel)
+						{
+							char bytes[sizeof(float)];
+							if(optimization == Optimization::None) std::memcpy(bytes, &channels[channel], sizeof(float));
+							else
+							{
+								const uint16_t value = static_cast<uint16_t>(std::max(0.f, std::min(1.f, channels[channel])) * 65535.f + 0.5f);
+								std::memcpy(bytes, &value, sizeof(uint16_t));
+							}
+							tile_data.insert(tile_data.end(), bytes, bytes + channel_size);
+						}
+					}
+				}
+				result = file.append(tile_data);
+			}
+		}
+	}
+	file.close();
+	if(result) result = File::rename(path_tmp, path, true, true);
+	else File::remove(path_tmp, true);
+	if(result && Y_LOG_HAS_VERBOSE) Y_VERBOSE << "ImageTiled: saved " << images.size() << " image levels to tile file '" << path << "'" << YENDL;
+	return result;
+}
+
+std::vector<std::unique_ptr<Image>> ImageTiled::loadTileFile(const std::string &path, uint64_t signature)
+{
+	std::vector<std::unique_ptr<Image>> images;
+	if(!File::exists(path, true)) return images;
+	auto file = std::make_shared<const MappedFile>(path);
+	if(!file->isOpen()) return images;
+	uint64_t position = 0;
+	const auto read = [&file, &position](void *value, size_t size) -> bool
+	{
+		if(position + size > file->size()) return false;
+		std::memcpy(value, file->data() + position, size);
+		position += size;
+		return true;
+	};
+	const bool header_valid = file->size() > tile_file_header_.size() && std::memcmp(file->data(), tile_file_header_.c_str(), tile_file_header_.size() + 1) == 0;
+	position = tile_file_header_.size() + 1;
+	uint64_t file_signature = 0;
+	int32_t type = 0, optimization = 0, tile_size = 0;
+	uint32_t num_images = 0;
+	bool result = header_valid && read(&file_signature, sizeof(file_signature)) && file_signature == signature;
+	result = result && read(&type, sizeof(type)) && isTileable_global(static_cast<Type>(type)) && getNumChannels(static_cast<Type>(type)) <= max_channels_;
+	result = result && read(&optimization, sizeof(optimization)) && optimization >= static_cast<int32_t>(Optimization::None) && optimization <= static_cast<int32_t>(Optimization::Compressed);
+	result = result && read(&tile_size, sizeof(tile_size)) && tile_size == tile_size_;
+	result = result && read(&num_images, sizeof(num_images)) && num_images > 0;
+	for(uint32_t image_num = 0; result && image_num < num_images; ++image_num)
+	{
+		int32_t width = 0, height = 0;
+		uint64_t data_offset = 0;
+		result = read(&width, sizeof(width)) && read(&height, sizeof(height)) && read(&data_offset, sizeof(data_offset)) && width > 0 && height > 0;
+		//Validate the image sizes, so a corrupt file cannot cause out of bounds accesses when loading the tiles
+		result = result && data_offset + static_cast<uint64_t>(width) * height * getNumChannels(static_cast<Type>(type)) * getChannelSize(static_cast<Optimization>(optimization)) <= file->size();
+		if(result) images.emplace_back(std::unique_ptr<Image>(new ImageTiled(file, data_offset, width, height, static_cast<Type>(type), static_cast<Optimization>(optimization))));
+	}
+	if(!result)
+	{
+		if(header_valid) Y_WARNING << "ImageTiled: tile file '" << path << "' does not match the image or its settings, ignoring it" << YENDL;
+		images.clear();
+	}
+	else if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "ImageTiled: loaded " << num_images << " image levels from tile file '" << path << "'" << YENDL;
+	return images;
+}
+
+std::vector<std::unique_ptr<Image>> ImageTiled::readTileFile(const std::string &path, uint64_t signature, bool mipmaps, HugePages::Mode huge_pages_mode)
+{
+	std::vector<std::unique_ptr<Image>> images = loadTileFile(path, signature);
+	if(!mipmaps && images.size() > 1) images.resize(1);
+	for(auto &image : images)
+	{
+		const ImageTiled *tiled_image = static_cast<const ImageTiled *>(image.get());
+		std::unique_ptr<Image> image_in_memory = Image::factory(tiled_image->getWidth(), tiled_image->getHeight(), tiled_image->type_, tiled_image->optimization_, huge_pages_mode);
+		//Decoded tile by tile without the tile cache, so reading the file does not evict the tiles of the out of core textures
+		for(int tile_y = 0; tile_y * tile_size_ < tiled_image->getHeight(); ++tile_y)
+		{
+			for(int tile_x = 0; tile_x < tiled_image->num_tiles_x_; ++tile_x)
+			{
+				const std::shared_ptr<const Image> tile = tiled_image->loadTile(tile_x, tile_y);
+				for(int y = 0; y < tile->getHeight(); ++y)
+				{
+					for(int x = 0; x < tile->getWidth(); ++x) image_in_memory->setColor(tile_x * tile_size_ + x, tile_y * tile_size_ + y, tile->getColor(x, y));
+				}
+			}
+		}
+		image = std::move(image_in_memory);
+	}
+	return images;
+}
+
+END_YAFARAY
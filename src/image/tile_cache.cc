@@ -0,0 +1,94 @@
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include "image/tile_cache.h"
+#include "image/image.h"
+#include "common/memory_stats.h"
+
+BEGIN_YAFARAY
+
+TileCache tile_cache_global;
+
+constexpr int TileCache::num_shards_;
+
+size_t TileCache::getUsed() const
+{
+	size_t used = 0;
+	for(const auto &shard : shards_)
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex_);
+		used += shard.used_;
+	}
+	return used;
+}
+
+std::shared_ptr<const Image> TileCache::findTile(uint64_t key)
+{
+	Shard &shard = getShard(key);
+	std::lock_guard<std::mutex> lock(shard.mutex_);
+	const auto it = shard.tiles_.find(key);
+	if(it == shard.tiles_.end()) return nullptr;
+	shard.lru_.splice(shard.lru_.begin(), shard.lru_, it->second.lru_position_);
+	return it->second.tile_;
+}
+
+std::shared_ptr<const Image> TileCache::insertTile(uint64_t key, std::shared_ptr<const Image> tile, size_t size)
+{
+	Shard &shard = getShard(key);
+	std::lock_guard<std::mutex> lock(shard.mutex_);
+	const auto it = shard.tiles_.find(key);
+	if(it != shard.tiles_.end()) return it->second.tile_;
+	const size_t shard_budget = budget_ / num_shards_;
+	//The least recently used tiles are evicted before inserting, so the shard never exceeds its budget except when a single tile is bigger than it
+	while(!shard.lru_.empty() && shard.used_ + size > shard_budget)
+	{
+		const auto evicted = shard.tiles_.find(shard.lru_.back());
+		shard.used_ -= evicted->second.size_;
+		MemoryStats::add(MemoryStats::TextureTiles, -static_cast<int64_t>(evicted->second.size_), -1);
+		shard.tiles_.erase(evicted);
+		shard.lru_.pop_back();
+	}
+	shard.lru_.push_front(key);
+	shard.tiles_[key] = {tile, size, shard.lru_.begin()};
+	shard.used_ += size;
+	MemoryStats::add(MemoryStats::TextureTiles, static_cast<int64_t>(size), 1);
+	return tile;
+}
+
+void TileCache::removeImage(uint32_t image_id)
+{
+	for(auto &shard : shards_)
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex_);
+		for(auto it = shard.tiles_.begin(); it != shard.tiles_.end();)
+		{
+			if(static_cast<uint32_t>(it->first >> 32) == image_id)
+			{
+				shard.used_ -= it->second.size_;
+				MemoryStats::add(MemoryStats::TextureTiles, -static_cast<int64_t>(it->second.size_), -1);
+				shard.lru_.erase(it->second.lru_position_);
+				it = shard.tiles_.erase(it);
+			}
+			else ++it;
+		}
+	}
+}
+
+END_YAFARAY
@@ -24,11 +24,17 @@
 #include "color/color.h"
 #include "output/output.h"
 #include "geometry/matrix4.h"
+#include "common/file.h"
+#include "common/asset_cache.h"
+#include "export/export_xml.h"
+#include "common/sysinfo.h"
+#include "common/task_pool.h"
 
 #if HAVE_XML
 #include <libxml/parser.h>
 #endif
 #include <cstring>
+#include <limits>
 
 BEGIN_YAFARAY
 
@@ -144,19 +150,330 @@ static xmlSAXHandler my_handler_global =
 	myError_global,
 	myFatalError_global
 };
-#endif // HAVE_XML
 
-std::unique_ptr<Scene> parseXmlFile_global(const char *filename, ParamMap &render, const std::string &color_space_string, float input_gamma)
+/*=============================================================
+/ pre-parsing of the object geometry in parallel
+=============================================================*/
+
+struct XmlAttribute
 {
-#if HAVE_XML
+	const char *name_, *name_end_;
+	const char *value_, *value_end_;
+	bool isName(const char *name) const { return static_cast<size_t>(name_end_ - name_) == strlen(name) && !memcmp(name_, name, name_end_ - name_); }
+};
+
+static const char *findText_global(const char *begin, const char *end, const char *text)
+{
+	const size_t text_size = strlen(text);
+	while(static_cast<size_t>(end - begin) >= text_size)
+	{
+		begin = static_cast<const char *>(memchr(begin, text[0], end - begin - text_size + 1));
+		if(!begin) return nullptr;
+		if(!memcmp(begin, text, text_size)) return begin;
+		++begin;
+	}
+	return nullptr;
+}
+
+static inline bool isXmlSpace_global(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+static inline const char *skipXmlSpaces_global(const char *c, const char *end)
+{
+	while(c < end && isXmlSpace_global(*c)) ++c;
+	return c;
+}
+
+/*! Reads the attributes of the tag starting at c up to its end. Returns nullptr if the tag is not self closed or it
+ *  has entities or too many attributes, which are left to the XML parser */
+static const char *readXmlAttributes_global(const char *c, const char *end, XmlAttribute *attributes, int max_attributes, int &num_attributes)
+{
+	num_attributes = 0;
+	while(true)
+	{
+		c = skipXmlSpaces_global(c, end);
+		if(end - c >= 2 && c[0] == '/' && c[1] == '>') return c + 2;
+		if(c >= end || num_attributes == max_attributes) return nullptr;
+		XmlAttribute &attribute = attributes[num_attributes++];
+		attribute.name_ = c;
+		while(c < end && *c != '=' && !isXmlSpace_global(*c) && *c != '/' && *c != '>') ++c;
+		attribute.name_end_ = c;
+		c = skipXmlSpaces_global(c, end);
+		if(c >= end || *c != '=' || attribute.name_ == attribute.name_end_) return nullptr;
+		c = skipXmlSpaces_global(c + 1, end);
+		if(c >= end || (*c != '"' && *c != '\'')) return nullptr;
+		const char *value_end = static_cast<const char *>(memchr(c + 1, *c, end - c - 1));
+		if(!value_end) return nullptr;
+		attribute.value_ = c + 1;
+		attribute.value_end_ = value_end;
+		if(memchr(attribute.value_, '&', value_end - attribute.value_) || memchr(attribute.value_, '<', value_end - attribute.value_)) return nullptr;
+		c = value_end + 1;
+	}
+}
+
+//! Same conversions as atof and atoi, but only if the whole attribute value is a finite number. Otherwise the XML parser reports it
+static bool readXmlFloat_global(const XmlAttribute &attribute, float &value)
+{
+	char *value_end;
+	value = static_cast<float>(strtod(attribute.value_, &value_end));
+	return value_end == attribute.value_end_ && math::isValid(value);
+}
+
+static bool readXmlInt_global(const XmlAttribute &attribute, int &value)
+{
+	char *value_end;
+	const long long_value = strtol(attribute.value_, &value_end, 10);
+	value = static_cast<int>(long_value);
+	return value_end == attribute.value_end_ && long_value == value;
+}
+
+static XmlGeometryRun &geometryRun_global(XmlGeometryBlock &block, XmlGeometryRun::Type type)
+{
+	if(block.empty() || block.back().type_ != type)
+	{
+		block.emplace_back();
+		block.back().type_ = type;
+	}
+	return block.back();
+}
+
+/*! Parses the elements of an object, from its start tag to its end tag. The points, normals, faces and uvs are stored in
+ *  geometry blocks and the other elements are copied to the text, with a placeholder element in place of each block.
+ *  Returns false if anything is not in the plain form written by the exporters (comments, entities, wrong attributes...),
+ *  so the object is left to the XML parser and its warnings */
+static bool preParseXmlObject_global(const char *c, const char *end, size_t object_index, std::string &text, std::vector<XmlGeometryBlock> &blocks)
+{
+	constexpr int max_attributes = 8;
+	XmlAttribute attributes[max_attributes];
+	int num_attributes;
+	XmlGeometryBlock block;
+	auto flush_block = [&]()
+	{
+		if(block.empty()) return;
+		text += "<parsed_geometry object=\"" + std::to_string(object_index) + "\" block=\"" + std::to_string(blocks.size()) + "\"/>\n";
+		blocks.push_back(std::move(block));
+		block.clear();
+	};
+	while(true)
+	{
+		c = skipXmlSpaces_global(c, end);
+		if(c >= end) break;
+		if(*c != '<' || end - c < 2 || c[1] == '!' || c[1] == '?' || c[1] == '/') return false;
+		const char *element = c + 1;
+		const char *element_end = element;
+		while(element_end < end && !isXmlSpace_global(*element_end) && *element_end != '/' && *element_end != '>') ++element_end;
+		const std::string element_name(element, element_end);
+		if(element_name == "p" || element_name == "n" || element_name == "uv")
+		{
+			c = readXmlAttributes_global(element_end, end, attributes, max_attributes, num_attributes);
+			if(!c) return false;
+			float values[3] = { 0.f, 0.f, 0.f }, orco[3] = { 0.f, 0.f, 0.f };
+			bool has_orco = false;
+			int components = 0;
+			const char *names = element_name == "uv" ? "uv" : "xyz";
+			for(int n = 0; n < num_attributes; ++n)
+			{
+				const XmlAttribute &attribute = attributes[n];
+				const size_t name_size = attribute.name_end_ - attribute.name_;
+				const bool is_orco = element_name == "p" && name_size == 2 && attribute.name_[0] == 'o';
+				if(name_size != 1 && !is_orco) return false;
+				const char *component = strchr(names, is_orco ? attribute.name_[1] : attribute.name_[0]);
+				if(!component || !*component) return false;
+				float &value = (is_orco ? orco : values)[component - names];
+				if(!readXmlFloat_global(attribute, value)) return false;
+				has_orco |= is_orco;
+				++components;
+			}
+			if(element_name == "n")
+			{
+				if(components != 3) return false; //the XML parser warns and ignores it
+				XmlGeometryRun &run = geometryRun_global(block, XmlGeometryRun::Normals);
+				run.values_.insert(run.values_.end(), values, values + 3);
+				++run.num_;
+			}
+			else if(element_name == "uv")
+			{
+				XmlGeometryRun &run = geometryRun_global(block, XmlGeometryRun::Uvs);
+				run.values_.insert(run.values_.end(), values, values + 2);
+				++run.num_;
+			}
+			else
+			{
+				XmlGeometryRun &run = geometryRun_global(block, has_orco ? XmlGeometryRun::VerticesOrco : XmlGeometryRun::Vertices);
+				run.values_.insert(run.values_.end(), values, values + 3);
+				if(has_orco) run.orco_.insert(run.orco_.end(), orco, orco + 3);
+				++run.num_;
+			}
+		}
+		else if(element_name == "f")
+		{
+			c = readXmlAttributes_global(element_end, end, attributes, max_attributes, num_attributes);
+			if(!c) return false;
+			int vertices[4], uvs[4];
+			int num_vertices = 0, num_uvs = 0;
+			for(int n = 0; n < num_attributes; ++n)
+			{
+				const XmlAttribute &attribute = attributes[n];
+				const size_t name_size = attribute.name_end_ - attribute.name_;
+				if(name_size == 1 && attribute.name_[0] >= 'a' && attribute.name_[0] <= 'd' && num_vertices < 4)
+				{
+					if(!readXmlInt_global(attribute, vertices[num_vertices++])) return false;
+				}
+				else if(name_size > 3 && !memcmp(attribute.name_, "uv_", 3) && num_uvs < 4)
+				{
+					if(!readXmlInt_global(attribute, uvs[num_uvs++])) return false;
+				}
+				else return false;
+			}
+			if(num_vertices != 3) continue; //other primitives are ignored by the meshes
+			XmlGeometryRun &run = geometryRun_global(block, XmlGeometryRun::Faces);
+			run.indices_.insert(run.indices_.end(), vertices, vertices + 3);
+			if(num_uvs > 0 && run.uv_indices_.empty()) run.uv_indices_.resize(3 * run.num_, -1);
+			if(!run.uv_indices_.empty()) for(int n = 0; n < 3; ++n) run.uv_indices_.push_back(n < num_uvs ? uvs[n] : -1);
+			++run.num_;
+		}
+		else
+		{
+			//Other elements are copied whole for the XML parser
+			flush_block();
+			const char *tag_end = element_end;
+			while(tag_end < end && *tag_end != '>')
+			{
+				if(*tag_end == '"' || *tag_end == '\'')
+				{
+					tag_end = static_cast<const char *>(memchr(tag_end + 1, *tag_end, end - tag_end - 1));
+					if(!tag_end) return false;
+				}
+				++tag_end;
+			}
+			if(tag_end >= end) return false;
+			const char *element_last = tag_end + 1;
+			if(tag_end[-1] != '/')
+			{
+				element_last = findText_global(element_last, end, ("</" + element_name + ">").c_str());
+				if(!element_last) return false;
+				element_last += element_name.size() + 3;
+			}
+			if(findText_global(c, element_last, "<!")) return false;
+			text.append(c, element_last);
+			text += '\n';
+			c = element_last;
+		}
+	}
+	flush_block();
+	return true;
+}
+
+/*! Finds the objects of the XML document and parses their geometry with the worker threads. The document is
+ *  returned with the parsed geometry replaced by placeholders, to parse the rest in order with the XML parser.
+ *  Returns false if there is no geometry to parse in advance */
+static bool preParseXmlDocument_global(const MappedFile &file, XmlParser &parser, std::string &document)
+{
+	struct ObjectRange { const char *begin_, *end_; }; //!< between the object start and end tags
+	std::vector<ObjectRange> objects;
+	const char *data = file.data();
+	const char *end = data + file.size();
+	for(const char *c = data; (c = static_cast<const char *>(memchr(c, '<', end - c))); )
+	{
+		if(end - c >= 4 && !memcmp(c, "<!--", 4))
+		{
+			c = findText_global(c + 4, end, "-->");
+			if(!c) break;
+		}
+		else if(end - c >= 9 && !memcmp(c, "<![CDATA[", 9))
+		{
+			c = findText_global(c + 9, end, "]]>");
+			if(!c) break;
+		}
+		else if(end - c >= 7 && !memcmp(c, "<object", 7))
+		{
+			const char *object_begin = skipXmlSpaces_global(c + 7, end);
+			if(object_begin < end && *object_begin == '>')
+			{
+				const char *object_end = findText_global(object_begin + 1, end, "</object>");
+				if(!object_end) break;
+				objects.push_back({object_begin + 1, object_end});
+				c = object_end;
+			}
+		}
+		++c;
+	}
+	if(objects.empty()) return false;
 
-	ColorSpace input_color_space = Rgb::colorSpaceFromName(color_space_string);
-	XmlParser parser(render, input_color_space, input_gamma);
-	if(xmlSAXUserParseFile(&my_handler_global, &parser, filename) < 0)
+	std::vector<std::string> texts(objects.size());
+	std::vector<char> parsed(objects.size(), false);
+	parser.parsed_geometry_.resize(objects.size());
+	TaskPool task_pool(SysInfo().getNumSystemThreads());
+	parallelFor_global(&task_pool, objects.size(), [&](size_t first_object, size_t last_object)
+	{
+		for(size_t object = first_object; object < last_object; ++object)
+		{
+			parsed[object] = preParseXmlObject_global(objects[object].begin_, objects[object].end_, object, texts[object], parser.parsed_geometry_[object]);
+			if(!parsed[object])
+			{
+				texts[object].clear();
+				parser.parsed_geometry_[object].clear();
+			}
+		}
+	}, 1);
+
+	size_t num_parsed = 0, document_size = file.size();
+	for(size_t object = 0; object < objects.size(); ++object)
+	{
+		if(!parsed[object]) continue;
+		++num_parsed;
+		document_size = document_size - (objects[object].end_ - objects[object].begin_) + texts[object].size() + 1;
+	}
+	if(num_parsed == 0) return false;
+	document.clear();
+	document.reserve(document_size);
+	const char *position = data;
+	for(size_t object = 0; object < objects.size(); ++object)
+	{
+		if(!parsed[object]) continue;
+		document.append(position, objects[object].begin_);
+		document += '\n';
+		document += texts[object];
+		position = objects[object].end_;
+		texts[object] = std::string();
+	}
+	document.append(position, end);
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "XMLParser: Parsed the geometry of " << num_parsed << " of " << objects.size() << " objects in parallel" << YENDL;
+	return true;
+}
+#endif // HAVE_XML
+
+#if HAVE_XML
+static bool parseXmlDocument_global(const char *filename, XmlParser &parser)
+{
+	parser.xml_directory_ = Path(filename).getDirectory();
+	std::string document;
+	bool pre_parsed = false;
+	{
+		const MappedFile file(filename);
+		pre_parsed = file.isOpen() && preParseXmlDocument_global(file, parser, document);
+	}
+	//The memory parsing is limited to int sizes, larger documents are parsed from the file without the pre-parsed geometry
+	if(pre_parsed && document.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
+	{
+		pre_parsed = false;
+		parser.parsed_geometry_.clear();
+		std::string().swap(document);
+	}
+	const int result = pre_parsed ? xmlSAXUserParseMemory(&my_handler_global, &parser, document.data(), static_cast<int>(document.size())) : xmlSAXUserParseFile(&my_handler_global, &parser, filename);
+	if(result < 0)
 	{
 		Y_ERROR << "XMLParser: Parsing the file " << filename << YENDL;
-		return nullptr;
+		return false;
 	}
+	return true;
+}
+#endif // HAVE_XML
+
+std::unique_ptr<Scene> parseXmlFile_global(const char *filename, ParamMap &render, const std::string &color_space_string, float input_gamma)
+{
+#if HAVE_XML
+	XmlParser parser(render, Rgb::colorSpaceFromName(color_space_string), input_gamma);
+	if(!parseXmlDocument_global(filename, parser)) return nullptr;
 	return parser.getScene();
 #else
 	Y_WARNING << "XMLParser: yafray was compiled without XML support, cannot parse file." << YENDL;
@@ -164,6 +481,21 @@ std::unique_ptr<Scene> parseXmlFile_global(const char *filename, ParamMap &rende
 #endif
 }
 
+bool parseXmlUpdateFile_global(const char *filename, std::unique_ptr<Scene> &scene, ParamMap &render, const std::string &color_space_string, float input_gamma)
+{
+#if HAVE_XML
+	XmlParser parser(render, Rgb::colorSpaceFromName(color_space_string), input_gamma);
+	parser.scene_ = std::move(scene);
+	parser.updating_ = true;
+	const bool result = parseXmlDocument_global(filename, parser);
+	scene = parser.getScene();
+	return result;
+#else
+	Y_WARNING << "XMLParser: yafray was compiled without XML support, cannot parse file." << YENDL;
+	return false;
+#endif
+}
+
 #if HAVE_XML
 /*=============================================================
 / parser functions
@@ -176,6 +508,52 @@ XmlParser::XmlParser(ParamMap &r, ColorSpace input_color_space, float input_gamm
 	pushState(startElDocument_global, endElDocument_global, "___no_name___");
 }
 
+bool XmlParser::openGeometryFile(const std::string &file_name)
+{
+	const std::string original_path = (xml_directory_.empty() || file_name.find_first_of("\\/") == 0) ? file_name : xml_directory_ + "/" + file_name;
+	const std::string path = scene_ ? AssetCache::getLocalPath(scene_->getAssetCacheDir(), original_path) : original_path;
+	auto geometry_file = std::unique_ptr<const MappedFile>(new MappedFile(path));
+	const size_t header_size = sizeof(XmlExport::geometry_file_header_);
+	if(!geometry_file->isOpen() || geometry_file->size() < header_size || memcmp(geometry_file->data(), XmlExport::geometry_file_header_, header_size) != 0)
+	{
+		Y_ERROR << "XMLParser: Couldn't open the geometry file '" << path << "'" << YENDL;
+		return false;
+	}
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "XMLParser: Reading the geometry from '" << path << "'" << YENDL;
+	geometry_file_ = std::move(geometry_file);
+	return true;
+}
+
+template <typename T>
+const T *XmlParser::getGeometryData(const char *offset, size_t num_values) const
+{
+	if(!geometry_file_ || !offset) return nullptr;
+	const uint64_t position = strtoull(offset, nullptr, 10);
+	//The arrays are written one after the other with 4 bytes elements, so they are aligned in the mapping
+	if(position % alignof(T) != 0 || position > geometry_file_->size() || num_values * sizeof(T) > geometry_file_->size() - position) return nullptr;
+	return reinterpret_cast<const T *>(geometry_file_->data() + position);
+}
+
+bool XmlParser::addParsedGeometry(size_t object_index, size_t block_index)
+{
+	if(object_index >= parsed_geometry_.size() || block_index >= parsed_geometry_[object_index].size()) return false;
+	XmlGeometryBlock &block = parsed_geometry_[object_index][block_index];
+	bool valid = true;
+	for(const XmlGeometryRun &run : block)
+	{
+		switch(run.type_)
+		{
+			case XmlGeometryRun::Vertices: valid &= scene_->addVertices(run.values_.data(), run.num_) >= 0; break;
+			case XmlGeometryRun::VerticesOrco: valid &= scene_->addVertices(run.values_.data(), run.num_, run.orco_.data()) >= 0; break;
+			case XmlGeometryRun::Normals: valid &= scene_->addNormals(run.values_.data(), run.num_); break;
+			case XmlGeometryRun::Faces: valid &= scene_->addFaces(run.indices_.data(), run.num_, run.uv_indices_.empty() ? nullptr : run.uv_indices_.data()); break;
+			case XmlGeometryRun::Uvs: valid &= scene_->addUvs(run.values_.data(), run.num_) >= 0; break;
+		}
+	}
+	XmlGeometryBlock().swap(block); //the scene has its own copy
+	return valid;
+}
+
 void XmlParser::pushState(StartElementCb_t start, EndElementCb_t end, const std::string &element_name)
 {
 	ParserState state;
@@ -384,6 +762,25 @@ void startElScene_global(XmlParser &parser, const char *element, const char **at
 		parser.scene_->endObjects();
 		parser.pushState(startElDummy_global, endElDummy_global, "___no_name___");
 	}
+	else if(!strcmp(element, "object_lod"))
+	{
+		std::string base_object_name, lod_object_name;
+		float max_screen_size = 0.f;
+		for(int n = 0; attrs[n]; ++n)
+		{
+			if(!strcmp(attrs[n], "base_object_name")) base_object_name = attrs[n + 1];
+			else if(!strcmp(attrs[n], "lod_object_name")) lod_object_name = attrs[n + 1];
+			else if(!strcmp(attrs[n], "max_screen_size")) max_screen_size = atof(attrs[n + 1]);
+		}
+		if(!parser.scene_->addObjectLod(base_object_name, lod_object_name, max_screen_size)) Y_ERROR << "XMLParser: Couldn't add the level of detail '" << lod_object_name << "' of object '" << base_object_name << "'" << YENDL;
+		parser.pushState(startElDummy_global, endElDummy_global, "___no_name___");
+	}
+	else if(!strcmp(element, "geometry_file"))
+	{
+		if(attrs[0] && !strcmp(attrs[0], "sval")) parser.openGeometryFile(attrs[1]);
+		else Y_ERROR << "XMLParser: No file name given for the geometry file!" << YENDL;
+		parser.pushState(startElDummy_global, endElDummy_global, "___no_name___");
+	}
 	else if(!strcmp(element, "render"))
 	{
 		parser.cparams_ = &parser.render_;
@@ -418,6 +815,7 @@ void startElObject_global(XmlParser &parser, const char *element, const char **a
 	parser.setLastElementName(element);
 	parser.setLastElementNameAttrs(attrs);
 
+	if(parser.skipping_object_) return;
 	if(!strcmp(element, "p"))
 	{
 		Point3 p, op;
@@ -482,6 +880,52 @@ void startElObject_global(XmlParser &parser, const char *element, const char **a
 		}
 		parser.scene_->addUv(u, v);
 	}
+	else if(!strcmp(element, "vertices") || !strcmp(element, "normals") || !strcmp(element, "faces") || !strcmp(element, "uvs"))
+	{
+		//Blocks of the binary geometry file, passed to the scene without converting them
+		size_t count = 0;
+		const char *offset = nullptr, *extra_offset = nullptr;
+		for(; attrs && attrs[0]; attrs += 2)
+		{
+			if(!strcmp(attrs[0], "count")) count = strtoull(attrs[1], nullptr, 10);
+			else if(!strcmp(attrs[0], "offset")) offset = attrs[1];
+			else if(!strcmp(attrs[0], "orco_offset") || !strcmp(attrs[0], "uv_offset")) extra_offset = attrs[1];
+		}
+		bool valid = true;
+		if(!strcmp(element, "vertices"))
+		{
+			const float *vertices = parser.getGeometryData<float>(offset, 3 * count);
+			const float *orco = parser.getGeometryData<float>(extra_offset, 3 * count);
+			valid = vertices && (orco || !extra_offset) && parser.scene_->addVertices(vertices, count, orco) >= 0;
+		}
+		else if(!strcmp(element, "normals"))
+		{
+			const float *normals = parser.getGeometryData<float>(offset, 3 * count);
+			valid = normals && parser.scene_->addNormals(normals, count);
+		}
+		else if(!strcmp(element, "faces"))
+		{
+			const int *vert_indices = parser.getGeometryData<int>(offset, 3 * count);
+			const int *uv_indices = parser.getGeometryData<int>(extra_offset, 3 * count);
+			valid = vert_indices && (uv_indices || !extra_offset) && parser.scene_->addFaces(vert_indices, count, uv_indices);
+		}
+		else
+		{
+			const float *uvs = parser.getGeometryData<float>(offset, 2 * count);
+			valid = uvs && parser.scene_->addUvs(uvs, count) >= 0;
+		}
+		if(!valid) Y_ERROR << "XMLParser: Invalid <" << element << "> block of the geometry file" << YENDL;
+	}
+	else if(!strcmp(element, "parsed_geometry"))
+	{
+		size_t object_index = 0, block_index = 0;
+		for(; attrs && attrs[0]; attrs += 2)
+		{
+			if(!strcmp(attrs[0], "object")) object_index = strtoull(attrs[1], nullptr, 10);
+			else if(!strcmp(attrs[0], "block")) block_index = strtoull(attrs[1], nullptr, 10);
+		}
+		if(!parser.addParsedGeometry(object_index, block_index)) Y_ERROR << "XMLParser: Invalid pre-parsed geometry block" << YENDL;
+	}
 	else if(!strcmp(element, "set_material"))
 	{
 		std::string mat_name(attrs[1]);
@@ -493,6 +937,14 @@ void startElObject_global(XmlParser &parser, const char *element, const char **a
 	{
 		std::string element_name;
 		if(!strcmp(attrs[0], "name")) element_name = attrs[1];
+		if(parser.updating_ && parser.scene_->getObject(element_name))
+		{
+			//The geometry of the objects of the previous frames is kept, with its accelerator
+			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "XMLParser: Keeping the existing object '" << element_name << "'" << YENDL;
+			parser.skipping_object_ = true;
+			parser.pushState(startElDummy_global, endElDummy_global, "___no_name___");
+			return;
+		}
 		parser.pushState(startElParammap_global, endElParammap_global, element_name);
 	}
 }
@@ -501,7 +953,8 @@ void endElObject_global(XmlParser &parser, const char *element)
 {
 	if(!strcmp(element, "object"))
 	{
-		if(!parser.scene_->endObject()) Y_ERROR << "XMLParser: Invalid scene state on endObject()!" << YENDL;
+		if(parser.skipping_object_) parser.skipping_object_ = false;
+		else if(!parser.scene_->endObject()) Y_ERROR << "XMLParser: Invalid scene state on endObject()!" << YENDL;
 		if(!parser.scene_->endObjects()) Y_ERROR << "XMLParser: Invalid scene state on endGeometry()!" << YENDL;
 		parser.popState();
 	}
@@ -525,7 +978,18 @@ void startElInstance_global(XmlParser &parser, const char *element, const char *
 				m[i][j] = atof(attrs[n + 1]);
 			}
 		}
-		parser.scene_->addInstance(parser.stateElementName(), m);
+		const std::string &base_object_name = parser.stateElementName();
+		if(parser.updating_)
+		{
+			//The instances of the update replace the transforms of the existing instances of the base object in the same order
+			const size_t instance_number = parser.instance_numbers_[base_object_name]++;
+			if(instance_number < parser.scene_->getNumInstances(base_object_name))
+			{
+				parser.scene_->updateInstance(base_object_name, instance_number, m);
+				return;
+			}
+		}
+		parser.scene_->addInstance(base_object_name, m);
 	}
 }
 
@@ -569,23 +1033,44 @@ void endElParammap_global(XmlParser &parser, const char *element)
 		{
 			if(!strcmp(element, "scene_parameters"))
 			{
+				if(parser.updating_)
+				{
+					parser.popState(); parser.params_.clear(); parser.eparams_.clear();
+					return;
+				}
 				parser.scene_ = Scene::factory(parser.params_);
 				if(!parser.scene_)
 				{
 					Y_ERROR << "XML Loader: scene could not be created." << YENDL;
 				}
 			}
-			else if(!strcmp(element, "material")) parser.scene_->createMaterial(element_name, parser.params_, parser.eparams_);
+			else if(!strcmp(element, "material"))
+			{
+				if(parser.updating_) parser.scene_->updateMaterial(element_name, parser.params_, parser.eparams_);
+				else parser.scene_->createMaterial(element_name, parser.params_, parser.eparams_);
+			}
 			else if(!strcmp(element, "integrator")) parser.scene_->createIntegrator(element_name, parser.params_);
-			else if(!strcmp(element, "light")) parser.scene_->createLight(element_name, parser.params_);
+			else if(!strcmp(element, "light"))
+			{
+				if(parser.updating_) parser.scene_->updateLight(element_name, parser.params_);
+				else parser.scene_->createLight(element_name, parser.params_);
+			}
 			else if(!strcmp(element, "texture")) parser.scene_->createTexture(element_name, parser.params_);
-			else if(!strcmp(element, "camera")) parser.scene_->createCamera(element_name, parser.params_);
+			else if(!strcmp(element, "camera"))
+			{
+				if(parser.updating_) parser.scene_->updateCamera(element_name, parser.params_);
+				else parser.scene_->createCamera(element_name, parser.params_);
+			}
 			else if(!strcmp(element, "background")) parser.scene_->createBackground(element_name, parser.params_);
 			else if(!strcmp(element, "object_parameters")) parser.scene_->createObject(element_name, parser.params_);
 			else if(!strcmp(element, "volumeregion")) parser.scene_->createVolumeRegion(element_name, parser.params_);
 			else if(!strcmp(element, "layers_parameters")) parser.scene_->setupLayersParameters(parser.params_);
 			else if(!strcmp(element, "layer")) parser.scene_->defineLayer(parser.params_);
-			else if(!strcmp(element, "output")) parser.scene_->createOutput(element_name, parser.params_);
+			else if(!strcmp(element, "output"))
+			{
+				if(parser.updating_) parser.scene_->removeOutput(element_name); //the frame outputs use their own image file names
+				parser.scene_->createOutput(element_name, parser.params_);
+			}
 			else if(!strcmp(element, "render_view")) parser.scene_->createRenderView(element_name, parser.params_);
 			else Y_WARNING << "XMLParser: Unexpected end-tag of scene element!" << YENDL;
 		}
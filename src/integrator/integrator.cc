@@ -23,6 +23,7 @@
 #include "integrator/surface/integrator_path_tracer.h"
 #include "integrator/surface/integrator_photon_mapping.h"
 #include "integrator/surface/integrator_sppm.h"
+#include "integrator/surface/integrator_vcm.h"
 #include "integrator/surface/integrator_debug.h"
 #include "integrator/volume/integrator_empty_volume.h"
 #include "integrator/volume/integrator_sky.h"
@@ -51,6 +52,7 @@ std::unique_ptr<Integrator> Integrator::factory(ParamMap &params, const Scene &s
 	else if(type == "pathtracing") return PathIntegrator::factory(params, scene);
 	else if(type == "photonmapping") return PhotonIntegrator::factory(params, scene);
 	else if(type == "SPPM") return SppmIntegrator::factory(params, scene);
+	else if(type == "vcm") return VcmIntegrator::factory(params, scene);
 	else if(type == "none") return EmptyVolumeIntegrator::factory(params, scene);
 	else if(type == "EmissionIntegrator") return EmissionIntegrator::factory(params, scene);
 	else if(type == "SingleScatterIntegrator") return SingleScatterIntegrator::factory(params, scene);
@@ -32,6 +32,8 @@
 #include "sampler/halton.h"
 #include "sampler/sample_pdf1d.h"
 #include "render/render_data.h"
+#include "common/memory.h"
+#include "math/random.h"
 
 BEGIN_YAFARAY
 
@@ -49,9 +51,10 @@ static constexpr int min_path_length_global = 3;
 #define BIDIR_DEBUG 0
 #define BIDIR_DO_LIGHTIMAGE 1
 
-/*! class that holds some vertex y_i/z_i (depending on wether it is a light or camera path)
+/*! class that holds some vertex y_i/z_i (depending on wether it is a light or camera path).
+    The material user data follows the vertex members inline, so a vertex and its BSDF data are contiguous in the path arena
 */
-class PathVertex
+class alignas(64) PathVertex
 {
 	public:
 		SurfacePoint sp_;  //!< surface point at which the path vertex lies
@@ -63,9 +66,11 @@ class PathVertex
 		float g_;            //!< geometric factor G(x_i-1, x_i), required for MIS
 		float qi_wo_;        //!< russian roulette probability for terminating path
 		float qi_wi_;        //!< russian roulette probability for terminating path when generating path in opposite direction
+		float rr_wo_;        //!< probability with which the path was actually continued after this vertex, qi_wo_ is still used for the MIS weights
 		float cos_wi_, cos_wo_; //!< (absolute) cosine of the incoming (wi) and sampled (wo) path direction
 		float pdf_wi_, pdf_wo_; //!< the pdf for sampling wi from wo and wo from wi respectively
-		void *userdata_;     //!< user data of the material at sp (required for sampling and evaluating)
+		void *material_data_;  //!< data of the material at sp (required for sampling and evaluating), userdata_ unless the material needs more memory
+		alignas(16) mutable unsigned char userdata_[Integrator::getUserDataSize()]; //!< inline storage for the material data
 };
 
 /*! vertices of a connected path going forward from light to eye;
@@ -123,7 +128,15 @@ void checkPath_global(std::vector<PathEvalVertex> &p, int s, int t)
 class PathData
 {
 	public:
-		std::vector<PathVertex> light_path_, eye_path_;
+		void resize(int max_path_length)
+		{
+			vertices_.resize(2 * max_path_length);
+			light_path_ = vertices_.data();
+			eye_path_ = vertices_.data() + max_path_length;
+			path_.resize(max_path_length * 2 + 1);
+		}
+		std::vector<PathVertex, AlignedAllocator<PathVertex, 64>> vertices_; //!< per thread arena with the vertices of the light path followed by those of the eye path, aligned to cache lines
+		PathVertex *light_path_ = nullptr, *eye_path_ = nullptr;
 		std::vector<PathEvalVertex> path_;
 		//pathCon_t pc;
 		// additional information for current path connection:
@@ -150,26 +163,25 @@ bool BidirectionalIntegrator::preprocess(const RenderControl &render_control, co
 	for(int t = 0; t < scene_->getNumThreads(); ++t)
 	{
 		PathData &path_data = thread_data_[t];
-		path_data.eye_path_.resize(max_path_length_global);
-		path_data.light_path_.resize(max_path_length_global);
-		path_data.path_.resize(max_path_length_global * 2 + 1);
-		for(int i = 0; i < max_path_length_global; ++i) path_data.light_path_[i].userdata_ = malloc(user_data_size_);
-		for(int i = 0; i < max_path_length_global; ++i) path_data.eye_path_[i].userdata_ = malloc(user_data_size_);
+		path_data.resize(max_path_length_global);
 		path_data.n_paths_ = 0;
 	}
-	// initialize userdata (todo!)
 	lights_ = render_view->getLightsVisible();
 	int num_lights = lights_.size();
 	f_num_lights_ = 1.f / (float) num_lights;
-	auto energies = std::unique_ptr<float[]>(new float[num_lights]);
-	for(int i = 0; i < num_lights; ++i) energies[i] = lights_[i]->totalEnergy().energy();
-	light_power_d_ = std::unique_ptr<Pdf1D>(new Pdf1D(energies.get(), num_lights));
+	light_power_d_ = render_view->getLightsVisiblePowerPdf();
+	if(!light_power_d_)
+	{
+		Y_ERROR << getName() << ": no visible lights with emitted energy, cannot trace the light paths" << YENDL;
+		return false;
+	}
 
+	inv_light_power_d_.clear();
 	for(int i = 0; i < num_lights; ++i) inv_light_power_d_[lights_[i]] = light_power_d_->func_[i] * light_power_d_->inv_integral_;
 
 	if(Y_LOG_HAS_DEBUG)
 	{
-		for(int i = 0; i < num_lights; ++i) Y_DEBUG << getName() << ": " << energies[i] << " (" << light_power_d_->func_[i] << ") " << YENDL;
+		for(int i = 0; i < num_lights; ++i) Y_DEBUG << getName() << ": " << lights_[i]->totalEnergy().energy() << " (" << light_power_d_->func_[i] << ") " << YENDL;
 		Y_DEBUG << getName() << ": preprocess(): lights: " << num_lights << " invIntegral:" << light_power_d_->inv_integral_ << YENDL;
 	}
 
@@ -233,13 +245,7 @@ void BidirectionalIntegrator::cleanup()
 {
 	//	if(Y_LOG_HAS_DEBUG) Y_DEBUG << integratorName << ": " << "cleanup: flushing light image" << YENDL;
 	int n_paths = 0;
-	for(int i = 0; i < (int)thread_data_.size(); ++i)
-	{
-		PathData &path_data = thread_data_[i];
-		n_paths += path_data.n_paths_;
-		for(int i = 0; i < max_path_length_global; ++i) free(path_data.light_path_[i].userdata_);
-		for(int i = 0; i < max_path_length_global; ++i) free(path_data.eye_path_[i].userdata_);
-	}
+	for(const auto &path_data : thread_data_) n_paths += path_data.n_paths_;
 	if(image_film_) image_film_->setNumDensitySamples(n_paths); //dirty hack...
 }
 
@@ -255,7 +261,7 @@ Rgba BidirectionalIntegrator::integrate(RenderData &render_data, const DiffRay &
 	Ray testray = ray;
 	float alpha = 1.f;
 
-	if(scene_->intersect(testray, sp))
+	if(scene_->intersect(testray, sp, render_data.takePrimaryHit()))
 	{
 		Vec3 wo = -ray.dir_;
 		static int dbg = 0;
@@ -263,14 +269,14 @@ Rgba BidirectionalIntegrator::integrate(RenderData &render_data, const DiffRay &
 		PathData &path_data = thread_data_[render_data.thread_id_];
 		++path_data.n_paths_;
 		Random &prng = *(render_data.prng_);
-		PathVertex &ve = path_data.eye_path_.front();
-		PathVertex &vl = path_data.light_path_.front();
+		PathVertex &ve = path_data.eye_path_[0];
+		PathVertex &vl = path_data.light_path_[0];
 		int n_eye = 1, n_light = 1;
 		// setup ve
 		ve.f_s_ = Rgb(1.f); // some random guess...need to read up on importance paths
 		ve.alpha_ = Rgb(1.f);
 		ve.sp_.p_ = ray.from_;
-		ve.qi_wo_ = ve.qi_wi_ = 1.f; // definitely no russian roulette here...
+		ve.qi_wo_ = ve.qi_wi_ = ve.rr_wo_ = 1.f; // definitely no russian roulette here...
 		// temporary!
 		float cu, cv;
 		float cam_pdf = 0.0;
@@ -309,7 +315,7 @@ Rgba BidirectionalIntegrator::integrate(RenderData &render_data, const DiffRay &
 		vl.f_s_ = Rgb(1.f); // veach set this to L_e^(1)(y0->y1), a BSDF like value; not available yet, cancels out anyway when using direct lighting
 		vl.alpha_ = pcol / ls.area_pdf_; // as above, this should not contain the "light BSDF"...missing lightNumPdf!
 		vl.g_ = 0.f; //unused actually...
-		vl.qi_wo_ = vl.qi_wi_ = 1.f; // definitely no russian roulette here...
+		vl.qi_wo_ = vl.qi_wi_ = vl.rr_wo_ = 1.f; // definitely no russian roulette here...
 		vl.cos_wo_ = ls.flags_.hasAny(Light::Flags::Singular) ? 1.0 : std::abs(vl.sp_.n_ * lray.dir_); //singularities have no surface, hence no normal
 		vl.cos_wi_ = 1.f;
 		vl.pdf_wo_ = ls.dir_pdf_;
@@ -360,8 +366,8 @@ Rgba BidirectionalIntegrator::integrate(RenderData &render_data, const DiffRay &
 				if(wt > 0.f)
 				{
 					//eval is done in place here...
-					PathVertex v = path_data.eye_path_[t - 1];
-					render_data.arena_ = v.userdata_;
+					const PathVertex &v = path_data.eye_path_[t - 1];
+					render_data.material_data_ = v.material_data_;
 					Rgb emit = v.sp_.material_->emit(render_data, v.sp_, v.wi_);
 					col += wt * v.alpha_ * emit;
 				}
@@ -408,6 +414,7 @@ Rgba BidirectionalIntegrator::integrate(RenderData &render_data, const DiffRay &
 			if(ColorLayer *color_layer = color_layers->find(Layer::Ao))
 			{
 				BsdfFlags bsdfs;
+				render_data.material_data_ = render_data.allocMaterialData(sp.material_->getReqMem());
 				sp.material_->initBsdf(render_data, sp, bsdfs);
 				color_layer->color_ += sampleAmbientOcclusionLayer(render_data, sp, wo);
 			}
@@ -450,10 +457,10 @@ Rgba BidirectionalIntegrator::integrate(RenderData &render_data, const DiffRay &
 
 /* ============================================================
     createPath: create (sub-)path from given starting point
-    important: resize path to maxLen *before* calling this function!
+    important: path must have room for maxLen vertices!
  ============================================================ */
 
-int BidirectionalIntegrator::createPath(RenderData &render_data, const Ray &start, std::vector<PathVertex> &path, int max_len) const
+int BidirectionalIntegrator::createPath(RenderData &render_data, const Ray &start, PathVertex *path, int max_len) const
 {
 	static int dbg = 0;
 	Random &prng = *render_data.prng_;
@@ -468,13 +475,14 @@ int BidirectionalIntegrator::createPath(RenderData &render_data, const Ray &star
 		if(!scene_->intersect(ray, v.sp_)) break;
 		const Material *mat = v.sp_.material_;
 		// compute alpha_i+1 = alpha_i * fs(wi, wo) / P_proj(wo), where P_proj = bsdf_pdf(wo) / cos(wo*N)
-		v.alpha_ = v_prev.alpha_ * v_prev.f_s_ * v_prev.cos_wo_ / (v_prev.pdf_wo_ * v_prev.qi_wo_);
+		v.alpha_ = v_prev.alpha_ * v_prev.f_s_ * v_prev.cos_wo_ / (v_prev.pdf_wo_ * v_prev.rr_wo_);
 		v.wi_ = -ray.dir_;
 		v.cos_wi_ = std::abs(ray.dir_ * v.sp_.n_);
 		v.ds_ = (v.sp_.p_ - v_prev.sp_.p_).lengthSqr();
 		v.g_ = v_prev.cos_wo_ * v.cos_wi_ / v.ds_;
 		++n_vert;
-		render_data.arena_ = v.userdata_;
+		v.material_data_ = (mat->getReqMem() <= sizeof(v.userdata_)) ? v.userdata_ : render_data.allocMaterialData(mat->getReqMem());
+		render_data.material_data_ = v.material_data_;
 		//if(dbg<10) if(Y_LOG_HAS_DEBUG) Y_DEBUG << integratorName << ": " << nVert << "  mat: " << (void*) mat << " alpha:" << v.alpha << " p_f_s:" << v_prev.f_s << " qi:"<< v_prev.qi << YENDL;
 		mat->initBsdf(render_data, v.sp_, m_bsdf);
 		// create tentative sample for next path segment
@@ -488,9 +496,16 @@ int BidirectionalIntegrator::createPath(RenderData &render_data, const Ray &star
 		if(n_vert > min_path_length_global)
 		{
 			v.qi_wo_ = std::min(0.98f, v.f_s_.col2Bri() * v.cos_wo_ / v.pdf_wo_);
-			if(prng() > v.qi_wo_) break; // terminate path with russian roulette
+			v.rr_wo_ = v.qi_wo_;
+			if(russian_roulette_type_ == RussianRouletteType::Throughput)
+			{
+				//survival proportional to the subpath weight after this vertex relative to the weight at its first vertex. As the MIS weights only need to be consistent between strategies, they keep using the local qi_wo_
+				const float start_weight = path[1].alpha_.maximum();
+				if(start_weight > 0.f) v.rr_wo_ = std::min(1.f, (v.alpha_ * v.f_s_).maximum() * v.cos_wo_ / (v.pdf_wo_ * start_weight));
+			}
+			if(prng() > v.rr_wo_) break; // terminate path with russian roulette
 		}
-		else v.qi_wo_ = 1.f;
+		else v.qi_wo_ = v.rr_wo_ = 1.f;
 
 		if(s.sampled_flags_.hasAny(BsdfFlags::Specular)) // specular surfaces need special treatment...
 		{
@@ -564,7 +579,7 @@ inline bool BidirectionalIntegrator::connectPaths(RenderData &render_data, int s
 	float cos_y = std::abs(y.sp_.n_ * vec);
 	float cos_z = std::abs(z.sp_.n_ * vec);
 
-	render_data.arena_ = y.userdata_;
+	render_data.material_data_ = y.material_data_;
 	x_l.pdf_f_ = y.sp_.material_->pdf(render_data, y.sp_, y.wi_, vec, BsdfFlags::All); // light vert to eye vert
 	x_l.pdf_b_ = y.sp_.material_->pdf(render_data, y.sp_, vec, y.wi_, BsdfFlags::All); // light vert to prev. light vert
 	if(x_l.pdf_f_ < 1e-6f) return false;
@@ -573,7 +588,7 @@ inline bool BidirectionalIntegrator::connectPaths(RenderData &render_data, int s
 	pd.f_y_ = y.sp_.material_->eval(render_data, y.sp_, y.wi_, vec, BsdfFlags::All);
 	pd.f_y_ += y.sp_.material_->emit(render_data, y.sp_, vec);
 
-	render_data.arena_ = z.userdata_;
+	render_data.material_data_ = z.material_data_;
 	x_e.pdf_b_ = z.sp_.material_->pdf(render_data, z.sp_, z.wi_, -vec, BsdfFlags::All); // eye vert to light vert
 	x_e.pdf_f_ = z.sp_.material_->pdf(render_data, z.sp_, -vec, z.wi_, BsdfFlags::All); // eye vert to prev eye vert
 	if(x_e.pdf_b_ < 1e-6f) return false;
@@ -667,7 +682,7 @@ inline bool BidirectionalIntegrator::connectLPath(RenderData &render_data, int t
 	x_e.g_ = std::abs(cos_wo * cos_z) / (l_ray.tmax_ * l_ray.tmax_); // or use Ng??
 	pd.w_l_e_ = vec;
 	pd.d_yz_ = l_ray.tmax_;
-	render_data.arena_ = z.userdata_;
+	render_data.material_data_ = z.material_data_;
 	x_e.pdf_b_ = z.sp_.material_->pdf(render_data, z.sp_, z.wi_, l_ray.dir_, BsdfFlags::All); //eye to light
 	if(x_e.pdf_b_ < 1e-6f) return false;
 	x_e.pdf_f_ = z.sp_.material_->pdf(render_data, z.sp_, l_ray.dir_, z.wi_, BsdfFlags::All); // eye to prev eye
@@ -716,7 +731,7 @@ inline bool BidirectionalIntegrator::connectPathE(const RenderView *render_view,
 
 	x_e.specular_ = false; // cannot query yet...
 
-	render_data.arena_ = y.userdata_;
+	render_data.material_data_ = y.material_data_;
 	x_l.pdf_f_ = y.sp_.material_->pdf(render_data, y.sp_, y.wi_, vec, BsdfFlags::All); // light vert to eye vert
 	if(x_l.pdf_f_ < 1e-6f) return false;
 	x_l.pdf_b_ = y.sp_.material_->pdf(render_data, y.sp_, vec, y.wi_, BsdfFlags::All); // light vert to prev. light vert
@@ -914,7 +929,7 @@ Rgb BidirectionalIntegrator::evalPathE(RenderData &render_data, int s, PathData
 	if(shadowed) return Rgb(0.f);
 
 	//eval material
-	render_data.arena_ = y.userdata_;
+	render_data.material_data_ = y.material_data_;
 	//Rgb f_y = y.sp.material->eval(state, y.sp, y.wi, pd.w_l_e, BSDF_ALL);
 	//TODO:
 	Rgb c_uw = y.alpha_ * M_PI * pd.f_y_ * pd.path_[s].g_;
@@ -1095,6 +1110,7 @@ std::unique_ptr<Integrator> BidirectionalIntegrator::factory(ParamMap &params, c
 	bool bg_transp_refract = false;
 	bool transp_shad = false;
 	int shadow_depth = 4;
+	std::string russian_roulette_type_str = "bsdf";
 
 	params.getParam("transpShad", transp_shad);
 	params.getParam("shadowDepth", shadow_depth);
@@ -1104,6 +1120,7 @@ std::unique_ptr<Integrator> BidirectionalIntegrator::factory(ParamMap &params, c
 	params.getParam("AO_color", ao_col);
 	params.getParam("bg_transp", bg_transp);
 	params.getParam("bg_transp_refract", bg_transp_refract);
+	params.getParam("russian_roulette_type", russian_roulette_type_str);
 
 	auto inte = std::unique_ptr<BidirectionalIntegrator>(new BidirectionalIntegrator(transp_shad, shadow_depth));
 
@@ -1117,6 +1134,8 @@ std::unique_ptr<Integrator> BidirectionalIntegrator::factory(ParamMap &params, c
 	inte->transp_background_ = bg_transp;
 	inte->transp_refracted_background_ = bg_transp_refract;
 
+	inte->russian_roulette_type_ = (russian_roulette_type_str == "throughput") ? RussianRouletteType::Throughput : RussianRouletteType::Bsdf;
+
 	return inte;
 }
 
@@ -71,19 +71,17 @@ Rgba DebugIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int
 {
 	Rgb col(0.0);
 	SurfacePoint sp;
-	void *o_udat = render_data.arena_;
+	void *o_udat = render_data.material_data_;
 	const bool old_lights_geometry_material_emit = render_data.lights_geometry_material_emit_;
 	//shoot ray into scene
-	if(scene_->intersect(ray, sp))
+	if(scene_->intersect(ray, sp, render_data.takePrimaryHit()))
 	{
 		if(show_pn_)
 		{
 			// Normals perturbed by materials
-			alignas (16) unsigned char userdata[user_data_size_];
-			render_data.arena_ = static_cast<void *>(userdata);
-
 			BsdfFlags bsdfs;
 			const Material *material = sp.material_;
+			render_data.material_data_ = render_data.allocMaterialData(material->getReqMem());
 			material->initBsdf(render_data, sp, bsdfs);
 		}
 		if(debug_type_ == N)
@@ -102,7 +100,7 @@ Rgba DebugIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int
 			col = Rgb((sp.ds_dv_.x_ + 1.f) * .5f, (sp.ds_dv_.y_ + 1.f) * .5f, (sp.ds_dv_.z_ + 1.f) * .5f);
 
 	}
-	render_data.arena_ = o_udat;
+	render_data.material_data_ = o_udat;
 	render_data.lights_geometry_material_emit_ = old_lights_geometry_material_emit;
 	return Rgba(col, 1.f);
 }
@@ -50,8 +50,8 @@ bool DirectLightIntegrator::preprocess(const RenderControl &render_control, cons
 	image_film_ = image_film;
 	bool success = true;
 	std::stringstream set;
-	g_timer_global.addEvent("prepass");
-	g_timer_global.start("prepass");
+	scene_->getRenderControl().getTimer().addEvent("prepass");
+	scene_->getRenderControl().getTimer().start("prepass");
 
 	set << "Direct Light  ";
 
@@ -67,6 +67,10 @@ bool DirectLightIntegrator::preprocess(const RenderControl &render_control, cons
 	}
 
 	lights_ = render_view->getLightsVisible();
+	createSubsurfaceClouds();
+	//The shading kernel is selected once per render, so the photon caustics and ambient occlusion checks are compiled out of it
+	if(use_photon_caustics_) integrate_kernel_ = use_ambient_occlusion_ ? &DirectLightIntegrator::integrateKernel<true, true> : &DirectLightIntegrator::integrateKernel<true, false>;
+	else integrate_kernel_ = use_ambient_occlusion_ ? &DirectLightIntegrator::integrateKernel<false, true> : &DirectLightIntegrator::integrateKernel<false, false>;
 
 	if(use_photon_caustics_)
 	{
@@ -84,10 +88,10 @@ bool DirectLightIntegrator::preprocess(const RenderControl &render_control, cons
 		else if(photon_map_processing_ == PhotonsGenerateAndSave) set << " (saving photon maps to file)";
 	}
 
-	g_timer_global.stop("prepass");
-	Y_INFO << getName() << ": Photonmap building time: " << std::fixed << std::setprecision(1) << g_timer_global.getTime("prepass") << "s" << " (" << scene_->getNumThreadsPhotons() << " thread(s))" << YENDL;
+	scene_->getRenderControl().getTimer().stop("prepass");
+	Y_INFO << getName() << ": Photonmap building time: " << std::fixed << std::setprecision(1) << scene_->getRenderControl().getTimer().getTime("prepass") << "s" << " (" << scene_->getNumThreadsPhotons() << " thread(s))" << YENDL;
 
-	set << "| photon maps: " << std::fixed << std::setprecision(1) << g_timer_global.getTime("prepass") << "s" << " [" << scene_->getNumThreadsPhotons() << " thread(s)]";
+	set << "| photon maps: " << std::fixed << std::setprecision(1) << scene_->getRenderControl().getTimer().getTime("prepass") << "s" << " [" << scene_->getNumThreadsPhotons() << " thread(s)]";
 
 	render_info_ += set.str();
 
@@ -100,13 +104,19 @@ bool DirectLightIntegrator::preprocess(const RenderControl &render_control, cons
 }
 
 Rgba DirectLightIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers, const RenderView *render_view) const
+{
+	return (this->*integrate_kernel_)(render_data, ray, additional_depth, color_layers);
+}
+
+template <bool photon_caustics, bool ambient_occlusion>
+Rgba DirectLightIntegrator::integrateKernel(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers) const
 {
 	const bool layers_used = render_data.raylevel_ == 0 && color_layers && color_layers->getFlags() != Layer::Flags::None;
 
 	Rgb col(0.0);
 	float alpha;
 	SurfacePoint sp;
-	void *o_udat = render_data.arena_;
+	void *o_udat = render_data.material_data_;
 	const bool old_lights_geometry_material_emit = render_data.lights_geometry_material_emit_;
 
 	if(transp_background_) alpha = 0.0;
@@ -114,12 +124,10 @@ Rgba DirectLightIntegrator::integrate(RenderData &render_data, const DiffRay &ra
 
 	// Shoot ray into scene
 
-	if(scene_->intersect(ray, sp)) // If it hits
+	if(scene_->intersect(ray, sp, render_data.takePrimaryHit())) // If it hits
 	{
-		alignas (16) unsigned char userdata[user_data_size_];
-		render_data.arena_ = static_cast<void *>(userdata);
-
 		const Material *material = sp.material_;
+		render_data.material_data_ = render_data.allocMaterialData(material->getReqMem());
 		BsdfFlags bsdfs;
 
 		const Vec3 wo = -ray.dir_;
@@ -140,11 +148,13 @@ Rgba DirectLightIntegrator::integrate(RenderData &render_data, const DiffRay &ra
 			}
 		}
 
+		if(!subsurface_clouds_.empty()) col += estimateSubsurfaceDiffusion(sp, wo);
+
 		if(bsdfs.hasAny(BsdfFlags::Diffuse))
 		{
 			col += estimateAllDirectLight(render_data, sp, wo, color_layers);
 
-			if(use_photon_caustics_)
+			if(photon_caustics)
 			{
 				Rgb col_tmp = estimateCausticPhotons(render_data, sp, wo);
 				if(aa_noise_params_.clamp_indirect_ > 0) col_tmp.clampProportionalRgb(aa_noise_params_.clamp_indirect_);
@@ -155,7 +165,7 @@ Rgba DirectLightIntegrator::integrate(RenderData &render_data, const DiffRay &ra
 				}
 			}
 
-			if(use_ambient_occlusion_) col += sampleAmbientOcclusion(render_data, sp, wo);
+			if(ambient_occlusion) col += sampleAmbientOcclusion(render_data, sp, wo);
 		}
 
 		recursiveRaytrace(render_data, ray, bsdfs, sp, wo, col, alpha, additional_depth, color_layers);
@@ -195,7 +205,7 @@ Rgba DirectLightIntegrator::integrate(RenderData &render_data, const DiffRay &ra
 		}
 	}
 
-	render_data.arena_ = o_udat;
+	render_data.material_data_ = o_udat;
 	render_data.lights_geometry_material_emit_ = old_lights_geometry_material_emit;
 
 	Rgb col_vol_transmittance = scene_->vol_integrator_->transmittance(render_data, ray);
@@ -218,6 +228,7 @@ std::unique_ptr<Integrator> DirectLightIntegrator::factory(ParamMap &params, con
 {
 	bool transp_shad = false;
 	bool caustics = false;
+	bool c_projection = true;
 	bool do_ao = false;
 	int shadow_depth = 5;
 	int raydepth = 5, c_depth = 10;
@@ -229,6 +240,8 @@ std::unique_ptr<Integrator> DirectLightIntegrator::factory(ParamMap &params, con
 	bool bg_transp = false;
 	bool bg_transp_refract = false;
 	std::string photon_maps_processing_str = "generate";
+	int sss_max_points = 50000;
+	float sss_max_error = 0.3f;
 
 	params.getParam("raydepth", raydepth);
 	params.getParam("transpShad", transp_shad);
@@ -238,6 +251,7 @@ std::unique_ptr<Integrator> DirectLightIntegrator::factory(ParamMap &params, con
 	params.getParam("caustic_mix", search);
 	params.getParam("caustic_depth", c_depth);
 	params.getParam("caustic_radius", c_rad);
+	params.getParam("caustic_projection", c_projection);
 	params.getParam("do_AO", do_ao);
 	params.getParam("AO_samples", ao_samples);
 	params.getParam("AO_distance", ao_dist);
@@ -245,6 +259,10 @@ std::unique_ptr<Integrator> DirectLightIntegrator::factory(ParamMap &params, con
 	params.getParam("bg_transp", bg_transp);
 	params.getParam("bg_transp_refract", bg_transp_refract);
 	params.getParam("photon_maps_processing", photon_maps_processing_str);
+	params.getParam("sss_max_points", sss_max_points);
+	params.getParam("sss_max_error", sss_max_error);
+	bool adaptive_light_samples = false;
+	params.getParam("adaptive_light_samples", adaptive_light_samples);
 
 	auto inte = std::unique_ptr<DirectLightIntegrator>(new DirectLightIntegrator(transp_shad, shadow_depth, raydepth));
 	// caustic settings
@@ -253,7 +271,9 @@ std::unique_ptr<Integrator> DirectLightIntegrator::factory(ParamMap &params, con
 	inte->n_caus_search_ = search;
 	inte->caus_depth_ = c_depth;
 	inte->caus_radius_ = c_rad;
+	inte->caustic_projection_ = c_projection;
 	// AO settings
+	inte->adaptive_light_samples_ = adaptive_light_samples;
 	inte->use_ambient_occlusion_ = do_ao;
 	inte->ao_samples_ = ao_samples;
 	inte->ao_dist_ = ao_dist;
@@ -261,6 +281,9 @@ std::unique_ptr<Integrator> DirectLightIntegrator::factory(ParamMap &params, con
 	// Background settings
 	inte->transp_background_ = bg_transp;
 	inte->transp_refracted_background_ = bg_transp_refract;
+	// Subsurface scattering settings
+	inte->sss_max_points_ = std::max(1, sss_max_points);
+	inte->sss_max_error_ = std::max(0.f, sss_max_error);
 
 	if(photon_maps_processing_str == "generate-save") inte->photon_map_processing_ = PhotonsGenerateAndSave;
 	else if(photon_maps_processing_str == "load") inte->photon_map_processing_ = PhotonsLoad;
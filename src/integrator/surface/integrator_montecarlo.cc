@@ -23,19 +23,28 @@
 #include "common/layers.h"
 #include "color/color_layers.h"
 #include "common/logger.h"
+#include "common/render_stats.h"
 #include "material/material.h"
 #include "scene/scene.h"
 #include "volume/volume.h"
 #include "common/session.h"
 #include "light/light.h"
+#include "light/light_tree.h"
 #include "color/spectrum.h"
 #include "sampler/halton.h"
 #include "render/imagefilm.h"
 #include "render/monitor.h"
 #include "photon/photon.h"
+#include "photon/photon_maps_state.h"
+#include "geometry/object.h"
 #include "sampler/sample.h"
 #include "sampler/sample_pdf1d.h"
 #include "render/render_data.h"
+#include "render/render_view.h"
+#include "volume/sss_diffusion.h"
+#include "geometry/primitive.h"
+#include "math/random.h"
+#include "common/file.h"
 
 #ifdef __clang__
 #define inline  // aka inline removal
@@ -44,11 +53,25 @@
 BEGIN_YAFARAY
 
 static constexpr int loffs_delta_global = 4567; //just some number to have different sequences per light...and it's a prime even...
+static constexpr int max_light_samples_factor_global = 4; //!< the adaptive light samples give each light at most this many times its own number of samples
 
 //Constructor and destructor defined here to avoid issues with std::unique_ptr<Pdf1D> being Pdf1D incomplete in the header (forward declaration)
 MonteCarloIntegrator::MonteCarloIntegrator() = default;
 MonteCarloIntegrator::~MonteCarloIntegrator() = default;
 
+void MonteCarloIntegrator::shareViewPreprocess(bool share)
+{
+	if(share == sharing_view_preprocess_) return;
+	if(share)
+	{
+		//The photon maps shot (or loaded) for the previous render view are in memory
+		view_photon_map_processing_ = photon_map_processing_;
+		photon_map_processing_ = PhotonsReuse;
+	}
+	else photon_map_processing_ = view_photon_map_processing_;
+	sharing_view_preprocess_ = share;
+}
+
 Rgb MonteCarloIntegrator::estimateAllDirectLight(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, ColorLayers *color_layers) const
 {
 	const bool layers_used = render_data.raylevel_ == 0 && color_layers && color_layers->getFlags() != Layer::Flags::None;
@@ -69,20 +92,95 @@ Rgb MonteCarloIntegrator::estimateAllDirectLight(RenderData &render_data, const
 	return col;
 }
 
-Rgb MonteCarloIntegrator::estimateOneDirectLight(RenderData &render_data, const SurfacePoint &sp, Vec3 wo, int n) const
+Rgb MonteCarloIntegrator::estimateOneDirectLight(RenderData &render_data, const SurfacePoint &sp, Vec3 wo, int n, bool skip_background_lights) const
 {
 	const int light_num = lights_.size();
 
 	if(light_num == 0) return Rgb(0.f); //??? if you get this far the lights must be >= 1 but, what the hell... :)
 
 	Halton hal_2(2,  scene_->getImageFilm()->getBaseSamplingOffset() + correlative_sample_number_[render_data.thread_id_] - 1); //Probably with this change the parameter "n" is no longer necessary, but I will keep it just in case I have to revert back this change!
-	const int lnum = std::min(static_cast<int>(hal_2.getNext() * static_cast<float>(light_num)), light_num - 1);
+	const float s_light = hal_2.getNext();
 
 	++correlative_sample_number_[render_data.thread_id_];
 
+	if(light_tree_)
+	{
+		float light_pmf;
+		const int lnum = light_tree_->sample(sp.p_, sp.n_, s_light, light_pmf);
+		if(lnum < 0 || light_pmf <= 0.f) return Rgb(0.f); //no light can illuminate this point
+		if(skip_background_lights && lights_[lnum]->illuminatesFromBackground()) return Rgb(0.f);
+		return doLightEstimation(render_data, lights_[lnum], sp, wo, lnum) / light_pmf;
+	}
+
+	if(light_power_pdf_)
+	{
+		float light_num_pdf;
+		const int lnum = light_power_pdf_->dSampleAlias(s_light, &light_num_pdf, nullptr);
+		if(light_num_pdf <= 0.f) return Rgb(0.f);
+		if(skip_background_lights && lights_[lnum]->illuminatesFromBackground()) return Rgb(0.f);
+		//dSample returns the probability multiplied by the number of lights
+		return doLightEstimation(render_data, lights_[lnum], sp, wo, lnum) * (light_num / light_num_pdf);
+	}
+
+	const int lnum = std::min(static_cast<int>(s_light * static_cast<float>(light_num)), light_num - 1);
+	if(skip_background_lights && lights_[lnum]->illuminatesFromBackground()) return Rgb(0.f);
 	return doLightEstimation(render_data, lights_[lnum], sp, wo, lnum) * light_num;
 }
 
+void MonteCarloIntegrator::setupLightSampling(const RenderView *render_view)
+{
+	light_tree_ = nullptr;
+	light_power_pdf_ = nullptr;
+	if(light_sampling_ == LightSampling::Power)
+	{
+		light_power_pdf_ = render_view->getLightsVisiblePowerPdf();
+		if(!light_power_pdf_ && !lights_.empty()) Y_WARNING << getName() << ": the visible lights have no emitted energy, selecting them uniformly instead" << YENDL;
+	}
+	if(light_sampling_ == LightSampling::LightTree && !lights_.empty())
+	{
+		light_tree_ = std::unique_ptr<LightTree>(new LightTree(lights_));
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": light tree built with " << light_tree_->numBoundedLights() << " bounded lights of " << lights_.size() << YENDL;
+	}
+}
+
+int MonteCarloIntegrator::lightSamples(const RenderData &render_data, const Light *light, unsigned int loffs) const
+{
+	if(adaptive_light_samples_ && loffs < render_data.light_sample_stats_.size() && render_data.light_sample_stats_[loffs].allocated_samples_ > 0) return render_data.light_sample_stats_[loffs].allocated_samples_;
+	return static_cast<int>(std::ceil(light->nSamples() * aa_light_sample_multiplier_));
+}
+
+void MonteCarloIntegrator::addLightSampleStats(RenderData &render_data, unsigned int loffs, int num_samples, double sum, double sum_2) const
+{
+	std::vector<RenderData::LightSampleStats> &light_sample_stats = render_data.light_sample_stats_;
+	if(light_sample_stats.size() <= loffs) light_sample_stats.resize(lights_.size());
+	light_sample_stats[loffs].sum_ += sum;
+	light_sample_stats[loffs].sum_2_ += sum_2;
+	light_sample_stats[loffs].num_samples_ += num_samples;
+	if(++render_data.light_estimations_ < light_samples_update_interval_) return;
+	render_data.light_estimations_ = 0;
+
+	//The variance of the sum of the light estimates for a given number of samples is minimal when the samples of each light are proportional to the standard deviation of its samples (Neyman allocation).
+	//The lights always keep one sample, so the estimate stays unbiased, and the occluded or constant lights are left with just that one
+	double samples_budget = 0.0, deviations_sum = 0.0;
+	std::vector<double> deviations(light_sample_stats.size(), -1.0);
+	for(size_t light_id = 0; light_id < light_sample_stats.size(); ++light_id)
+	{
+		const RenderData::LightSampleStats &stats = light_sample_stats[light_id];
+		if(stats.num_samples_ == 0) continue;
+		const double mean = stats.sum_ / stats.num_samples_;
+		deviations[light_id] = std::sqrt(std::max(0.0, stats.sum_2_ / stats.num_samples_ - mean * mean));
+		deviations_sum += deviations[light_id];
+		samples_budget += std::ceil(lights_[light_id]->nSamples() * aa_light_sample_multiplier_);
+	}
+	for(size_t light_id = 0; light_id < light_sample_stats.size(); ++light_id)
+	{
+		if(deviations[light_id] < 0.0) continue;
+		const int max_samples = max_light_samples_factor_global * static_cast<int>(std::ceil(lights_[light_id]->nSamples() * aa_light_sample_multiplier_));
+		const int samples = (deviations_sum > 0.0) ? static_cast<int>(std::round(samples_budget * deviations[light_id] / deviations_sum)) : 1;
+		light_sample_stats[light_id].allocated_samples_ = std::min(max_samples, std::max(1, samples));
+	}
+}
+
 Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light *light, const SurfacePoint &sp, const Vec3 &wo, const unsigned int  &loffs, ColorLayers *color_layers) const
 {
 	const bool layers_used = render_data.raylevel_ == 0 && color_layers && color_layers->getFlags() != Layer::Flags::None;
@@ -97,7 +195,13 @@ Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light
 	float light_pdf;
 	float mask_obj_index = 0.f, mask_mat_index = 0.f;
 
+	//Light linking: the objects can exclude the link groups of some lights
+	if(sp.object_ && !(sp.object_->getLightLinkMask() & light->getLinkMask())) return col;
+
 	bool cast_shadows = light->castShadows() && material->getReceiveShadows();
+	//Last primitive blocking the shadow rays of this light in this thread, the neighbouring shading points are often shadowed by the same primitive
+	if(render_data.light_occluders_.size() <= loffs) render_data.light_occluders_.resize(loffs + 1, nullptr);
+	const Primitive **last_occluder = &render_data.light_occluders_[loffs];
 
 	// handle lights with delta distribution, e.g. point and directional lights
 	if(light->diracLight())
@@ -110,7 +214,7 @@ Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light
 			if(scene_->shadow_bias_auto_) light_ray.tmin_ = scene_->shadow_bias_ * std::max(1.f, Vec3(sp.p_).length());
 			else light_ray.tmin_ = scene_->shadow_bias_;
 
-			if(cast_shadows) shadowed = (tr_shad_) ? scene_->isShadowed(render_data, light_ray, s_depth_, scol, mask_obj_index, mask_mat_index) : scene_->isShadowed(render_data, light_ray, mask_obj_index, mask_mat_index);
+			if(cast_shadows) shadowed = (tr_shad_) ? scene_->isShadowed(render_data, light_ray, s_depth_, scol, mask_obj_index, mask_mat_index) : scene_->isShadowed(render_data, light_ray, mask_obj_index, mask_mat_index, last_occluder);
 			else shadowed = false;
 
 			const float angle_light_normal = (material->isFlat() ? 1.f : std::abs(sp.n_ * light_ray.dir_));	//If the material has the special attribute "isFlat()" then we will not multiply the surface reflection by the cosine of the angle between light and normal
@@ -161,33 +265,99 @@ Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light
 	}
 	else // area light and suchlike
 	{
-		int n = (int) ceilf(light->nSamples() * aa_light_sample_multiplier_);
+		int n = lightSamples(render_data, light, loffs);
 		if(render_data.ray_division_ > 1) n = std::max(1, n / render_data.ray_division_);
 		const float inv_ns = 1.f / (float)n;
-		const unsigned int offs = n * render_data.pixel_sample_ + render_data.sampling_offs_ + l_offs;
+		const unsigned int offs = n * render_data.pixel_sample_;
+		const unsigned int light_seed = render_data.sampling_offs_ + l_offs;
 		const bool can_intersect = light->canIntersect();
 		Rgb ccol(0.0);
 		LSample ls;
 
-		Halton hal_2(2, offs - 1);
-		Halton hal_3(3, offs - 1);
-
 		Rgba col_shadow(0.f), col_shadow_obj_mask(0.f), col_shadow_mat_mask(0.f), col_diff_dir(0.f), col_diff_no_shadow(0.f), col_glossy_dir(0.f);
 
-		for(int i = 0; i < n; ++i)
+		//Without transparent shadows, the shadow rays of all the light samples are traced together as a ray stream before shading them, so the accelerator traverses them in packets. The stream does not report the objects casting the shadows, needed by the shadow mask layers
+		const bool batch_shadows = cast_shadows && !tr_shad_ && n > 1 && !(layers_used && color_layers->isDefinedAny({Layer::MatIndexMaskShadow, Layer::ObjIndexMaskShadow}));
+		std::vector<LSample> batch_samples;
+		std::vector<int> batch_ray_ids; //!< ray of each light sample in the stream, -1 when the light could not be sampled
+		std::vector<Ray> batch_rays;
+		std::vector<bool> batch_shadowed;
+		std::vector<Rgb> batch_surf_cols; //!< BSDF of the light samples in the stream, evaluated together
+		if(batch_shadows)
 		{
-			// ...get sample val...
-			ls.s_1_ = hal_2.getNext();
-			ls.s_2_ = hal_3.getNext();
+			batch_samples.resize(n);
+			batch_ray_ids.assign(n, -1);
+			batch_rays.reserve(n);
+			for(int i = 0; i < n; ++i)
+			{
+				batch_samples[i].s_1_ = sampler_->sample(1, offs + i, light_seed);
+				batch_samples[i].s_2_ = sampler_->sample(2, offs + i, light_seed);
+				if(light->illumSample(sp, batch_samples[i], light_ray))
+				{
+					if(scene_->shadow_bias_auto_) light_ray.tmin_ = scene_->shadow_bias_ * std::max(1.f, Vec3(sp.p_).length());
+					else light_ray.tmin_ = scene_->shadow_bias_;
+					batch_ray_ids[i] = static_cast<int>(batch_rays.size());
+					batch_rays.push_back(light_ray);
+				}
+			}
+			if(!batch_rays.empty()) batch_shadowed = scene_->isShadowed(render_data, batch_rays, last_occluder);
+			//The BSDF is evaluated for all the directions of the samples at once, only for the samples shaded below
+			const bool eval_shadowed = layers_used && color_layers->find(Layer::DiffuseNoShadow);
+			std::vector<Vec3> eval_dirs;
+			std::vector<int> eval_ray_ids;
+			eval_dirs.reserve(batch_rays.size());
+			eval_ray_ids.reserve(batch_rays.size());
+			for(int i = 0; i < n; ++i)
+			{
+				const int ray_id = batch_ray_ids[i];
+				if(ray_id < 0 || !((!batch_shadowed[ray_id] && batch_samples[i].pdf_ > 1e-6f) || eval_shadowed)) continue;
+				eval_dirs.push_back(batch_rays[ray_id].dir_);
+				eval_ray_ids.push_back(ray_id);
+			}
+			if(!eval_dirs.empty())
+			{
+				std::vector<Rgb> eval_cols(eval_dirs.size());
+				material->evalBatch(render_data, sp, wo, eval_dirs.data(), static_cast<int>(eval_dirs.size()), BsdfFlags::All, eval_cols.data());
+				batch_surf_cols.resize(batch_rays.size());
+				for(size_t i = 0; i < eval_ray_ids.size(); ++i) batch_surf_cols[eval_ray_ids[i]] = eval_cols[i];
+			}
+		}
 
-			if(light->illumSample(sp, ls, light_ray))
+		double sample_sum = 0.0, sample_sum_2 = 0.0;
+		for(int i = 0; i < n; ++i)
+		{
+			const Rgb ccol_before_sample = ccol;
+			bool sampled;
+			if(batch_shadows)
+			{
+				ls = batch_samples[i];
+				sampled = (batch_ray_ids[i] >= 0);
+				if(sampled)
+				{
+					light_ray = batch_rays[batch_ray_ids[i]];
+					shadowed = batch_shadowed[batch_ray_ids[i]];
+				}
+			}
+			else
 			{
-				// ...shadowed...
-				if(scene_->shadow_bias_auto_) light_ray.tmin_ = scene_->shadow_bias_ * std::max(1.f, Vec3(sp.p_).length());
-				else light_ray.tmin_ = scene_->shadow_bias_;
+				// ...get sample val...
+				ls.s_1_ = sampler_->sample(1, offs + i, light_seed);
+				ls.s_2_ = sampler_->sample(2, offs + i, light_seed);
+
+				sampled = light->illumSample(sp, ls, light_ray);
+				if(sampled)
+				{
+					// ...shadowed...
+					if(scene_->shadow_bias_auto_) light_ray.tmin_ = scene_->shadow_bias_ * std::max(1.f, Vec3(sp.p_).length());
+					else light_ray.tmin_ = scene_->shadow_bias_;
+
+					if(cast_shadows) shadowed = (tr_shad_) ? scene_->isShadowed(render_data, light_ray, s_depth_, scol, mask_obj_index, mask_mat_index) : scene_->isShadowed(render_data, light_ray, mask_obj_index, mask_mat_index, last_occluder);
+					else shadowed = false;
+				}
+			}
 
-				if(cast_shadows) shadowed = (tr_shad_) ? scene_->isShadowed(render_data, light_ray, s_depth_, scol, mask_obj_index, mask_mat_index) : scene_->isShadowed(render_data, light_ray, mask_obj_index, mask_mat_index);
-				else shadowed = false;
+			if(sampled)
+			{
 
 				if((!shadowed && ls.pdf_ > 1e-6f)  || (layers_used && color_layers->find(Layer::DiffuseNoShadow)))
 				{
@@ -195,7 +365,7 @@ Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light
 					if(tr_shad_ && cast_shadows) ls.col_ *= scol;
 					const Rgb transmit_col = scene_->vol_integrator_->transmittance(render_data, light_ray);
 					ls.col_ *= transmit_col;
-					const Rgb surf_col = material->eval(render_data, sp, wo, light_ray.dir_, BsdfFlags::All);
+					const Rgb surf_col = batch_shadows ? batch_surf_cols[batch_ray_ids[i]] : material->eval(render_data, sp, wo, light_ray.dir_, BsdfFlags::All);
 
 					if(layers_used && (!shadowed && ls.pdf_ > 1e-6f) && color_layers->find(Layer::Shadow)) col_shadow += Rgb(1.f);
 
@@ -277,7 +447,14 @@ Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light
 					if(color_layers->find(Layer::ObjIndexMaskShadow) && mask_obj_index == mask_params.obj_index_) col_shadow_obj_mask += Rgb(1.f);
 				}
 			}
+			if(adaptive_light_samples_)
+			{
+				const double sample_luminance = (ccol - ccol_before_sample).energy();
+				sample_sum += sample_luminance;
+				sample_sum_2 += sample_luminance * sample_luminance;
+			}
 		}
+		if(adaptive_light_samples_) addLightSampleStats(render_data, loffs, n, sample_sum, sample_sum_2);
 
 		col += ccol * inv_ns;
 
@@ -306,9 +483,6 @@ Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light
 				if(color_layers->find(Layer::Glossy)) col_glossy_dir = Rgba(0.f);
 			}
 
-			hal_2.setStart(offs - 1);
-			hal_3.setStart(offs - 1);
-
 			for(int i = 0; i < n; ++i)
 			{
 				Ray b_ray;
@@ -317,15 +491,16 @@ Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light
 
 				b_ray.from_ = sp.p_;
 
-				const float s_1 = hal_2.getNext();
-				const float s_2 = hal_3.getNext();
+				const float s_1 = sampler_->sample(1, offs + i, light_seed);
+				const float s_2 = sampler_->sample(2, offs + i, light_seed);
 				float W = 0.f;
 
 				Sample s(s_1, s_2, BsdfFlags::Glossy | BsdfFlags::Diffuse | BsdfFlags::Dispersive | BsdfFlags::Reflect | BsdfFlags::Transmit);
+				RenderStats::add(RenderStats::BsdfSamples);
 				const Rgb surf_col = material->sample(render_data, sp, wo, b_ray.dir_, s, W);
 				if(s.pdf_ > 1e-6f && light->intersect(b_ray, b_ray.tmax_, lcol, light_pdf))
 				{
-					if(cast_shadows) shadowed = (tr_shad_) ? scene_->isShadowed(render_data, b_ray, s_depth_, scol, mask_obj_index, mask_mat_index) : scene_->isShadowed(render_data, b_ray, mask_obj_index, mask_mat_index);
+					if(cast_shadows) shadowed = (tr_shad_) ? scene_->isShadowed(render_data, b_ray, s_depth_, scol, mask_obj_index, mask_mat_index) : scene_->isShadowed(render_data, b_ray, mask_obj_index, mask_mat_index, last_occluder);
 					else shadowed = false;
 
 					if((!shadowed && light_pdf > 1e-6f) || (layers_used && color_layers->find(Layer::DiffuseNoShadow)))
@@ -342,6 +517,7 @@ Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light
 						{
 							if(color_layers->isDefinedAny({Layer::Diffuse, Layer::DiffuseNoShadow}))
 							{
+								RenderStats::add(RenderStats::BsdfSamples);
 								const Rgb tmp_col = material->sample(render_data, sp, wo, b_ray.dir_, s, W) * lcol * w * W;
 								col_diff_no_shadow += tmp_col;
 								if((!shadowed && light_pdf > 1e-6f) && s.sampled_flags_.hasAny(BsdfFlags::Diffuse)) col_diff_dir += tmp_col;
@@ -349,6 +525,7 @@ Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light
 
 							if(color_layers->find(Layer::Glossy))
 							{
+								RenderStats::add(RenderStats::BsdfSamples);
 								const Rgb tmp_col = material->sample(render_data, sp, wo, b_ray.dir_, s, W) * lcol * w * W;
 								if((!shadowed && light_pdf > 1e-6f) && s.sampled_flags_.hasAny(BsdfFlags::Glossy)) col_glossy_dir += tmp_col;
 							}
@@ -374,7 +551,7 @@ Rgb MonteCarloIntegrator::doLightEstimation(RenderData &render_data, const Light
 	return col;
 }
 
-void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_caus_photons, Pdf1D *light_power_d, int num_lights, const std::vector<const Light *> &caus_lights, int caus_depth, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot)
+void MonteCarloIntegrator::causticWorker(std::vector<Photon> &caustic_photons, unsigned int &photons_shot, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_caus_photons, Pdf1D *light_power_d, int num_lights, const std::vector<const Light *> &caus_lights, int caus_depth, PhotonShootingProgress &progress, int pb_step, const std::vector<unsigned int> *paths, std::vector<unsigned int> *photon_paths, uint64_t *path_objects)
 {
 	bool done = false;
 	float s_1, s_2, s_3, s_4, s_5, s_6, s_7, s_l;
@@ -382,9 +559,16 @@ void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id,
 	float light_num_pdf, light_pdf;
 
 	unsigned int curr = 0;
-	const unsigned int n_caus_photons_thread = 1 + ((n_caus_photons - 1) / scene->getNumThreadsPhotons());
-
-	std::vector<Photon> local_caustic_photons;
+	const unsigned int n_threads = scene->getNumThreadsPhotons();
+	unsigned int n_caus_photons_thread = 1 + ((n_caus_photons - 1) / n_threads);
+	unsigned int first_path = n_caus_photons_thread * thread_id;
+	if(paths) //only the given paths are shot, split among the threads
+	{
+		const unsigned int n_paths = paths->size();
+		const unsigned int n_paths_thread = (n_paths + n_threads - 1) / n_threads;
+		first_path = std::min(n_paths, n_paths_thread * thread_id);
+		n_caus_photons_thread = std::min(n_paths, first_path + n_paths_thread) - first_path;
+	}
 
 	SurfacePoint sp_1, sp_2;
 	SurfacePoint *hit = &sp_1, *hit_2 = &sp_2;
@@ -392,16 +576,18 @@ void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id,
 
 	RenderData render_data;
 	render_data.cam_ = render_view->getCamera();
-	alignas (16) unsigned char userdata[user_data_size_];
-	render_data.arena_ = static_cast<void *>(userdata);
 
-	local_caustic_photons.clear();
-	local_caustic_photons.reserve(n_caus_photons_thread);
+	//Each thread stores its photons in its own chunk, merged into the photon map when all the threads have finished
+	caustic_photons.clear();
+	caustic_photons.reserve(n_caus_photons_thread);
+	if(photon_paths) photon_paths->clear();
+	done = (n_caus_photons_thread == 0);
 
 	while(!done)
 	{
-		const unsigned int haltoncurr = curr + n_caus_photons_thread * thread_id;
+		const unsigned int haltoncurr = paths ? (*paths)[first_path + curr] : first_path + curr;
 
+		render_data.arena_.reset(); //the material data is only needed while tracing each photon
 		render_data.chromatic_ = true;
 		render_data.wavelength_ = sample::riS(haltoncurr);
 
@@ -416,18 +602,17 @@ void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id,
 
 		if(light_num >= num_lights)
 		{
-			caustic_map->mutx_.lock();
 			Y_ERROR << getName() << ": lightPDF sample error! " << s_l << "/" << light_num << YENDL;
-			caustic_map->mutx_.unlock();
 			return;
 		}
 
-		Rgb pcol = caus_lights[light_num]->emitPhoton(s_1, s_2, s_3, s_4, ray, light_pdf);
+		Rgb pcol = caustic_targets_.empty() ? caus_lights[light_num]->emitPhoton(s_1, s_2, s_3, s_4, ray, light_pdf) : caus_lights[light_num]->emitPhotonTowards(caustic_targets_, s_1, s_2, s_3, s_4, ray, light_pdf);
 		ray.tmin_ = scene->ray_min_dist_;
 		ray.tmax_ = -1.0;
 		pcol *= f_num_lights * light_pdf / light_num_pdf; //remember that lightPdf is the inverse of th pdf, hence *=...
 		if(pcol.isBlack())
 		{
+			if(path_objects) path_objects[haltoncurr] = 0;
 			++curr;
 			done = (curr >= n_caus_photons_thread);
 			continue;
@@ -438,14 +623,14 @@ void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id,
 		bool direct_photon = true;
 		const Material *material = nullptr;
 		const VolumeHandler *vol = nullptr;
+		uint64_t objects = 0;
 
 		while(scene->intersect(ray, *hit_2))
 		{
+			if(path_objects && hit_2->object_) objects |= PhotonMapsState::objectBit(hit_2->object_->getName());
 			if(std::isnan(pcol.r_) || std::isnan(pcol.g_) || std::isnan(pcol.b_))
 			{
-				caustic_map->mutx_.lock();
 				Y_WARNING << getName() << ": NaN (photon color)" << YENDL;
-				caustic_map->mutx_.unlock();
 				break;
 			}
 			Rgb transm(1.f), vcol;
@@ -461,6 +646,7 @@ void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id,
 			std::swap(hit, hit_2);
 			Vec3 wi = -ray.dir_, wo;
 			material = hit->material_;
+			render_data.material_data_ = render_data.allocMaterialData(material->getReqMem());
 			material->initBsdf(render_data, *hit, bsdfs);
 			if(bsdfs.hasAny((BsdfFlags::Diffuse | BsdfFlags::Glossy)))
 			{
@@ -468,7 +654,8 @@ void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id,
 				if(caustic_photon)
 				{
 					Photon np(wi, hit->p_, pcol);
-					local_caustic_photons.push_back(np);
+					caustic_photons.push_back(np);
+					if(photon_paths) photon_paths->push_back(haltoncurr);
 				}
 			}
 			// need to break in the middle otherwise we scatter the photon and then discard it => redundant
@@ -506,24 +693,68 @@ void MonteCarloIntegrator::causticWorker(PhotonMap *caustic_map, int thread_id,
 			ray.tmax_ = -1.0;
 			++n_bounces;
 		}
+		if(path_objects) path_objects[haltoncurr] = objects;
 		++curr;
 		if(curr % pb_step == 0)
 		{
-			pb->mutx_.lock();
-			pb->update();
-			pb->mutx_.unlock();
-			if(render_control.aborted()) { return; }
+			progress.addStep();
+			if(render_control.aborted()) { photons_shot = curr; return; }
 		}
 		done = (curr >= n_caus_photons_thread);
 	}
-	caustic_map->mutx_.lock();
-	caustic_map->appendVector(local_caustic_photons, curr);
-	total_photons_shot += curr;
-	caustic_map->mutx_.unlock();
+	photons_shot = curr;
+}
+
+void MonteCarloIntegrator::createCausticTargets()
+{
+	caustic_targets_.clear();
+	if(!caustic_projection_) return;
+	//Too many spheres would make the emission of each photon slow, then they are merged into one around all of them
+	static constexpr size_t max_targets = 64;
+	for(const Object *object : scene_->getObjects())
+	{
+		if(object->isBaseObject()) continue;
+		bool has_bound = false;
+		Bound bound;
+		for(const Primitive *primitive : object->getPrimitives())
+		{
+			const Material *material = primitive->getMaterial();
+			if(!material || !material->getFlags().hasAny(BsdfFlags::Specular | BsdfFlags::Glossy | BsdfFlags::Dispersive)) continue;
+			if(has_bound) bound = Bound(bound, primitive->getBound());
+			else bound = primitive->getBound();
+			has_bound = true;
+		}
+		if(has_bound) caustic_targets_.push_back({bound.center(), 0.5f * (bound.g_ - bound.a_).length() + scene_->ray_min_dist_});
+	}
+	if(caustic_targets_.size() > max_targets)
+	{
+		Bound bound(caustic_targets_.front().center_, caustic_targets_.front().center_);
+		for(const auto &target : caustic_targets_)
+		{
+			bound.include(target.center_ - Vec3(target.radius_));
+			bound.include(target.center_ + Vec3(target.radius_));
+		}
+		caustic_targets_.assign(1, {bound.center(), 0.5f * (bound.g_ - bound.a_).length()});
+	}
+}
+
+void MonteCarloIntegrator::setupCheckpointPhotonMaps(const RenderView *render_view)
+{
+	const ImageFilm *image_film = scene_->getImageFilm();
+	if(!image_film->checkpointsEnabled() || photon_map_processing_ == PhotonsReuse) return;
+	if(File::exists(image_film->getCheckpointPath(render_view->getName()), true)) photon_map_processing_ = PhotonsLoad;
+	else if(photon_map_processing_ == PhotonsGenerateOnly) photon_map_processing_ = PhotonsGenerateAndSave;
+}
+
+std::string MonteCarloIntegrator::getPhotonMapPath(const std::string &map_name) const
+{
+	const ImageFilm *image_film = scene_->getImageFilm();
+	return (image_film->checkpointsEnabled() ? image_film->getCheckpointParams().path_ : image_film->getFilmSavePath()) + "_" + map_name + ".photonmap";
 }
 
 bool MonteCarloIntegrator::createCausticMap(const RenderView *render_view, const RenderControl &render_control)
 {
+	setupCheckpointPhotonMaps(render_view);
 	std::shared_ptr<ProgressBar> pb;
 	if(intpb_) pb = intpb_;
 	else pb = std::make_shared<ConsoleProgressBar>(80);
@@ -531,9 +762,9 @@ bool MonteCarloIntegrator::createCausticMap(const RenderView *render_view, const
 	if(photon_map_processing_ == PhotonsLoad)
 	{
 		pb->setTag("Loading caustic photon map from file...");
-		const std::string filename = scene_->getImageFilm()->getFilmSavePath() + "_caustic.photonmap";
+		const std::string filename = getPhotonMapPath("caustic");
 		Y_INFO << getName() << ": Loading caustic photon map from: " << filename << ". If it does not match the scene you could have crashes and/or incorrect renders, USE WITH CARE!" << YENDL;
-		if(session_global.caustic_map_.get()->load(filename))
+		if(scene_->getSession().caustic_map_.get()->load(filename))
 		{
 			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Caustic map loaded." << YENDL;
 			return true;
@@ -548,7 +779,7 @@ bool MonteCarloIntegrator::createCausticMap(const RenderView *render_view, const
 	if(photon_map_processing_ == PhotonsReuse)
 	{
 		Y_INFO << getName() << ": Reusing caustics photon map from memory. If it does not match the scene you could have crashes and/or incorrect renders, USE WITH CARE!" << YENDL;
-		if(session_global.caustic_map_.get()->nPhotons() == 0)
+		if(scene_->getSession().caustic_map_.get()->nPhotons() == 0)
 		{
 			photon_map_processing_ = PhotonsGenerateOnly;
 			Y_WARNING << getName() << ": One of the photon maps in memory was empty, they cannot be reused: changing to Generate mode." << YENDL;
@@ -556,10 +787,11 @@ bool MonteCarloIntegrator::createCausticMap(const RenderView *render_view, const
 		else return true;
 	}
 
-	session_global.caustic_map_.get()->clear();
-	session_global.caustic_map_.get()->setNumPaths(0);
-	session_global.caustic_map_.get()->reserveMemory(n_caus_photons_);
-	session_global.caustic_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+	scene_->getSession().caustic_map_.get()->clear();
+	scene_->getSession().caustic_map_.get()->setNumPaths(0);
+	scene_->getSession().caustic_map_.get()->reserveMemory(n_caus_photons_);
+	scene_->getSession().caustic_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+	scene_->getSession().caustic_map_.get()->setHugePagesMode(scene_->getHugePagesMode());
 
 	Ray ray;
 	std::vector<const Light *> caus_lights;
@@ -576,10 +808,17 @@ bool MonteCarloIntegrator::createCausticMap(const RenderView *render_view, const
 
 	if(num_lights > 0)
 	{
+		createCausticTargets();
+		if(caustic_projection_ && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Shooting the caustic photons towards " << caustic_targets_.size() << " object(s) with specular, glossy or dispersive materials" << YENDL;
+
 		float light_num_pdf, light_pdf;
 		const float f_num_lights = (float)num_lights;
 		auto energies = std::unique_ptr<float[]>(new float[num_lights]);
-		for(int i = 0; i < num_lights; ++i) energies[i] = caus_lights[i]->totalEnergy().energy();
+		//With the projection map the lights are chosen by the power they send towards the caustic objects
+		for(int i = 0; i < num_lights; ++i) energies[i] = caus_lights[i]->totalEnergy().energy() * causticEmissionFraction(*caus_lights[i]);
+		bool no_energy = true;
+		for(int i = 0; i < num_lights; ++i) if(energies[i] > 0.f) no_energy = false;
+		if(no_energy) for(int i = 0; i < num_lights; ++i) energies[i] = caus_lights[i]->totalEnergy().energy();
 		auto light_power_d = std::unique_ptr<Pdf1D>(new Pdf1D(energies.get(), num_lights));
 
 		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Light(s) photon color testing for caustics map:" << YENDL;
@@ -587,7 +826,7 @@ bool MonteCarloIntegrator::createCausticMap(const RenderView *render_view, const
 		for(int i = 0; i < num_lights; ++i)
 		{
 			Rgb pcol(0.f);
-			pcol = caus_lights[i]->emitPhoton(.5, .5, .5, .5, ray, light_pdf);
+			pcol = caustic_targets_.empty() ? caus_lights[i]->emitPhoton(.5, .5, .5, .5, ray, light_pdf) : caus_lights[i]->emitPhotonTowards(caustic_targets_, .5, .5, .5, .5, ray, light_pdf);
 			light_num_pdf = light_power_d->func_[i] * light_power_d->inv_integral_;
 			pcol *= f_num_lights * light_pdf / light_num_pdf; //remember that lightPdf is the inverse of the pdf, hence *=...
 			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Light [" << i + 1 << "] Photon col:" << pcol << " | lnpdf: " << light_num_pdf << YENDL;
@@ -608,28 +847,35 @@ bool MonteCarloIntegrator::createCausticMap(const RenderView *render_view, const
 		Y_PARAMS << getName() << ": Shooting " << n_caus_photons_ << " photons across " << n_threads << " threads (" << (n_caus_photons_ / n_threads) << " photons/thread)" << YENDL;
 
 		std::vector<std::thread> threads;
-		for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&MonteCarloIntegrator::causticWorker, this, session_global.caustic_map_.get(), i, scene_, render_view, std::ref(render_control), n_caus_photons_, light_power_d.get(), num_lights, caus_lights, caus_depth_, pb.get(), pb_step, std::ref(curr)));
+		std::vector<std::vector<Photon>> caustic_photon_chunks(n_threads);
+		std::vector<unsigned int> photons_shot(n_threads, 0);
+		PhotonShootingProgress progress(pb.get());
+		for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&MonteCarloIntegrator::causticWorker, this, std::ref(caustic_photon_chunks[i]), std::ref(photons_shot[i]), i, scene_, render_view, std::ref(render_control), n_caus_photons_, light_power_d.get(), num_lights, caus_lights, caus_depth_, std::ref(progress), pb_step, nullptr, nullptr, nullptr));
 		for(auto &t : threads) t.join();
+		progress.flush();
+
+		for(const auto &shot : photons_shot) curr += shot;
+		scene_->getSession().caustic_map_.get()->appendChunks(caustic_photon_chunks, curr);
 
 		pb->done();
 		pb->setTag("Caustic photon map built.");
 		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Done." << YENDL;
 		Y_INFO << getName() << ": Shot " << curr << " caustic photons from " << num_lights << " light(s)." << YENDL;
-		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Stored caustic photons: " << session_global.caustic_map_.get()->nPhotons() << YENDL;
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Stored caustic photons: " << scene_->getSession().caustic_map_.get()->nPhotons() << YENDL;
 
-		if(session_global.caustic_map_.get()->nPhotons() > 0)
+		if(scene_->getSession().caustic_map_.get()->nPhotons() > 0)
 		{
 			pb->setTag("Building caustic photons kd-tree...");
-			session_global.caustic_map_.get()->updateTree();
+			scene_->getSession().caustic_map_.get()->updateTree();
 			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Done." << YENDL;
 		}
 
 		if(photon_map_processing_ == PhotonsGenerateAndSave)
 		{
 			pb->setTag("Saving caustic photon map to file...");
-			std::string filename = scene_->getImageFilm()->getFilmSavePath() + "_caustic.photonmap";
+			std::string filename = getPhotonMapPath("caustic");
 			Y_INFO << getName() << ": Saving caustic photon map to: " << filename << YENDL;
-			if(session_global.caustic_map_.get()->save(filename) && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Caustic map saved." << YENDL;
+			if(scene_->getSession().caustic_map_.get()->save(filename) && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Caustic map saved." << YENDL;
 		}
 	}
 	else if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": No caustic source lights found, skiping caustic map building..." << YENDL;
@@ -638,14 +884,16 @@ bool MonteCarloIntegrator::createCausticMap(const RenderView *render_view, const
 
 Rgb MonteCarloIntegrator::estimateCausticPhotons(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	if(!session_global.caustic_map_.get()->ready()) return Rgb(0.f);
+	if(!scene_->getSession().caustic_map_.get()->ready()) return Rgb(0.f);
 
-	auto gathered = std::unique_ptr<FoundPhoton[]>(new FoundPhoton[n_caus_search_]);//(foundPhoton_t *)alloca(nCausSearch * sizeof(foundPhoton_t));
+	//The gathered photons are kept in the render thread arena, whose blocks are reused at every shading point
+	const MemoryArena::Marker arena_marker = render_data.arena_.getMarker();
+	FoundPhoton *gathered = render_data.arena_.alloc<FoundPhoton>(n_caus_search_);
 	int n_gathered = 0;
 
 	float g_radius_square = caus_radius_ * caus_radius_;
 
-	n_gathered = session_global.caustic_map_.get()->gather(sp.p_, gathered.get(), n_caus_search_, g_radius_square);
+	n_gathered = scene_->getSession().caustic_map_.get()->gather(sp.p_, gathered, n_caus_search_, g_radius_square);
 
 	g_radius_square = 1.f / g_radius_square;
 
@@ -665,8 +913,9 @@ Rgb MonteCarloIntegrator::estimateCausticPhotons(RenderData &render_data, const
 			k = sample::kernel(gathered[i].dist_square_, g_radius_square);
 			sum += surf_col * k * photon->color();
 		}
-		sum *= 1.f / (float(session_global.caustic_map_.get()->nPaths()));
+		sum *= 1.f / (float(scene_->getSession().caustic_map_.get()->nPaths()));
 	}
+	render_data.arena_.rewind(arena_marker);
 	return sum;
 }
 
@@ -675,15 +924,11 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 	const bool layers_used = render_data.raylevel_ == 0 && color_layers && color_layers->getFlags() != Layer::Flags::None;
 
 	const Material *material = sp.material_;
-	const SpDifferentials sp_diff(sp, ray);
 
 	render_data.raylevel_++;
 
 	if(render_data.raylevel_ <= (r_depth_ + additional_depth))
 	{
-		Halton hal_2(2);
-		Halton hal_3(3);
-
 		// dispersive effects with recursive raytracing:
 		if(bsdfs.hasAny(BsdfFlags::Dispersive) && render_data.chromatic_)
 		{
@@ -696,7 +941,7 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 			render_data.ray_division_ *= dsam;
 			int branch = render_data.ray_division_ * old_offset;
 			const float d_1 = 1.f / (float)dsam;
-			const float ss_1 = sample::riS(render_data.pixel_sample_ + render_data.sampling_offs_);
+			const float ss_1 = sampleWavelength(render_data.pixel_sample_, render_data.sampling_offs_);
 			Rgb dcol(0.f), vcol(1.f);
 			float w = 0.f;
 
@@ -704,13 +949,14 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 			for(int ns = 0; ns < dsam; ++ns)
 			{
 				render_data.wavelength_ = (ns + ss_1) * d_1;
-				render_data.dc_1_ = Halton::lowDiscrepancySampling(2 * render_data.raylevel_ + 1, branch + render_data.sampling_offs_);
-				render_data.dc_2_ = Halton::lowDiscrepancySampling(2 * render_data.raylevel_ + 2, branch + render_data.sampling_offs_);
+				render_data.dc_1_ = sampler_->sample(2 * render_data.raylevel_ + 1, branch, render_data.sampling_offs_);
+				render_data.dc_2_ = sampler_->sample(2 * render_data.raylevel_ + 2, branch, render_data.sampling_offs_);
 				if(old_division > 1) render_data.wavelength_ = math::addMod1(render_data.wavelength_, old_dc_1);
 				render_data.ray_offset_ = branch;
 				++branch;
 				Sample s(0.5f, 0.5f, BsdfFlags::Reflect | BsdfFlags::Transmit | BsdfFlags::Dispersive);
 				Vec3 wi;
+				RenderStats::add(RenderStats::BsdfSamples);
 				const Rgb mcol = material->sample(render_data, sp, wo, wi, s, w);
 
 				if(s.pdf_ > 1.0e-6f && s.sampled_flags_.hasAny(BsdfFlags::Dispersive))
@@ -759,27 +1005,24 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 			if(render_data.ray_division_ > 1) gsam = std::max(1, gsam / old_division);
 			render_data.ray_division_ *= gsam;
 			int branch = render_data.ray_division_ * old_offset;
-			unsigned int offs = gsam * render_data.pixel_sample_ + render_data.sampling_offs_;
+			unsigned int offs = gsam * render_data.pixel_sample_;
 			const float d_1 = 1.f / (float)gsam;
 			Rgb gcol(0.f), vcol(1.f);
 
-			hal_2.setStart(offs);
-			hal_3.setStart(offs);
-
 			Rgb gcol_indirect_accum;
 			Rgb gcol_reflect_accum;
 			Rgb gcol_transmit_accum;
 
 			for(int ns = 0; ns < gsam; ++ns)
 			{
-				render_data.dc_1_ = Halton::lowDiscrepancySampling(2 * render_data.raylevel_ + 1, branch + render_data.sampling_offs_);
-				render_data.dc_2_ = Halton::lowDiscrepancySampling(2 * render_data.raylevel_ + 2, branch + render_data.sampling_offs_);
+				render_data.dc_1_ = sampler_->sample(2 * render_data.raylevel_ + 1, branch, render_data.sampling_offs_);
+				render_data.dc_2_ = sampler_->sample(2 * render_data.raylevel_ + 2, branch, render_data.sampling_offs_);
 				render_data.ray_offset_ = branch;
 				++offs;
 				++branch;
 
-				const float s_1 = hal_2.getNext();
-				const float s_2 = hal_3.getNext();
+				const float s_1 = sampler_->sample(1, offs, render_data.sampling_offs_);
+				const float s_2 = sampler_->sample(2, offs, render_data.sampling_offs_);
 
 				if(material->getFlags().hasAny(BsdfFlags::Glossy))
 				{
@@ -788,12 +1031,13 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 						float w = 0.f;
 						Sample s(s_1, s_2, BsdfFlags::Glossy | BsdfFlags::Reflect);
 						Vec3 wi;
+						RenderStats::add(RenderStats::BsdfSamples);
 						const Rgb mcol = material->sample(render_data, sp, wo, wi, s, w);
 						DiffRay ref_ray(sp.p_, wi, scene_->ray_min_dist_);
 						if(diff_rays_enabled_)
 						{
-							if(s.sampled_flags_.hasAny(BsdfFlags::Reflect)) sp_diff.reflectedRay(ray, ref_ray);
-							else if(s.sampled_flags_.hasAny(BsdfFlags::Transmit)) sp_diff.refractedRay(ray, ref_ray, material->getMatIor());
+							if(s.sampled_flags_.hasAny(BsdfFlags::Reflect)) SpDifferentials::reflectedRay(sp, ray, ref_ray);
+							else if(s.sampled_flags_.hasAny(BsdfFlags::Transmit)) SpDifferentials::refractedRay(sp, ray, ref_ray, material->getMatIor());
 						}
 						Rgba integ = static_cast<Rgb>(integrate(render_data, ref_ray, additional_depth, nullptr, nullptr));
 						const VolumeHandler *vol;
@@ -812,12 +1056,13 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 						float w[2];
 						Vec3 dir[2];
 
+						RenderStats::add(RenderStats::BsdfSamples);
 						mcol[0] = material->sample(render_data, sp, wo, dir, mcol[1], s, w);
 
 						if(s.sampled_flags_.hasAny(BsdfFlags::Reflect) && !s.sampled_flags_.hasAny(BsdfFlags::Dispersive))
 						{
 							DiffRay ref_ray = DiffRay(sp.p_, dir[0], scene_->ray_min_dist_);
-							if(diff_rays_enabled_) sp_diff.reflectedRay(ray, ref_ray);
+							if(diff_rays_enabled_) SpDifferentials::reflectedRay(sp, ray, ref_ray);
 							Rgba integ = integrate(render_data, ref_ray, additional_depth, nullptr, nullptr);
 							const VolumeHandler *vol;
 							if(bsdfs.hasAny(BsdfFlags::Volumetric) && (vol = material->getVolumeHandler(sp.ng_ * ref_ray.dir_ < 0)))
@@ -833,7 +1078,7 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 						if(s.sampled_flags_.hasAny(BsdfFlags::Transmit))
 						{
 							DiffRay ref_ray = DiffRay(sp.p_, dir[1], scene_->ray_min_dist_);
-							if(diff_rays_enabled_) sp_diff.refractedRay(ray, ref_ray, material->getMatIor());
+							if(diff_rays_enabled_) SpDifferentials::refractedRay(sp, ray, ref_ray, material->getMatIor());
 							Rgba integ = integrate(render_data, ref_ray, additional_depth, nullptr, nullptr);
 							const VolumeHandler *vol;
 							if(bsdfs.hasAny(BsdfFlags::Volumetric) && (vol = material->getVolumeHandler(sp.ng_ * ref_ray.dir_ < 0)))
@@ -885,7 +1130,7 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 			if(specular.reflect_.enabled_)
 			{
 				DiffRay ref_ray(sp.p_, specular.reflect_.dir_, scene_->ray_min_dist_);
-				if(diff_rays_enabled_) sp_diff.reflectedRay(ray, ref_ray);
+				if(diff_rays_enabled_) SpDifferentials::reflectedRay(sp, ray, ref_ray);
 				Rgb integ = integrate(render_data, ref_ray, additional_depth, nullptr, nullptr);
 				const VolumeHandler *vol;
 				Rgb vcol;
@@ -900,7 +1145,7 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 					if(ColorLayer *color_layer = color_layers->find(Layer::ReflectPerfect)) color_layer->color_ += col_ind;
 				}
 			}
-			if(specular.refract_.enabled_)
+			if(specular.refract_.enabled_ && !findSubsurfaceCloud(sp, wo))
 			{
 				DiffRay ref_ray;
 				float transp_bias_factor = material->getTransparentBiasFactor();
@@ -912,7 +1157,7 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 				}
 				else ref_ray = DiffRay(sp.p_, specular.refract_.dir_, scene_->ray_min_dist_);
 
-				if(diff_rays_enabled_) sp_diff.refractedRay(ray, ref_ray, material->getMatIor());
+				if(diff_rays_enabled_) SpDifferentials::refractedRay(sp, ray, ref_ray, material->getMatIor());
 				Rgba integ = integrate(render_data, ref_ray, additional_depth, nullptr, nullptr);
 
 				const VolumeHandler *vol;
@@ -934,6 +1179,16 @@ void MonteCarloIntegrator::recursiveRaytrace(RenderData &render_data, const Diff
 	--render_data.raylevel_;
 }
 
+Rgb MonteCarloIntegrator::unoccludedColor(const RenderData &render_data, const std::vector<Ray> &occlusion_rays, const std::vector<Rgb> &occlusion_colors) const
+{
+	Rgb col(0.f);
+	if(occlusion_rays.empty()) return col;
+	//Only whether anything is hit within the ambient occlusion distance is needed, so the rays are traced together as a stream
+	const std::vector<bool> occluded = scene_->isShadowed(render_data, occlusion_rays);
+	for(size_t i = 0; i < occlusion_rays.size(); ++i) if(!occluded[i]) col += occlusion_colors[i];
+	return col;
+}
+
 Rgb MonteCarloIntegrator::sampleAmbientOcclusion(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
 	Rgb col(0.f);
@@ -944,13 +1199,15 @@ Rgb MonteCarloIntegrator::sampleAmbientOcclusion(RenderData &render_data, const
 	float mask_obj_index = 0.f, mask_mat_index = 0.f;
 	int n = ao_samples_;//(int) ceilf(aoSamples*getSampleMultiplier());
 	if(render_data.ray_division_ > 1) n = std::max(1, n / render_data.ray_division_);
-	const unsigned int offs = n * render_data.pixel_sample_ + render_data.sampling_offs_;
-	Halton hal_2(2, offs - 1);
-	Halton hal_3(3, offs - 1);
+	const unsigned int offs = n * render_data.pixel_sample_;
+	std::vector<Ray> occlusion_rays;
+	std::vector<Rgb> occlusion_colors;
+	occlusion_rays.reserve(n);
+	occlusion_colors.reserve(n);
 	for(int i = 0; i < n; ++i)
 	{
-		float s_1 = hal_2.getNext();
-		float s_2 = hal_3.getNext();
+		float s_1 = sampler_->sample(1, offs + i, render_data.sampling_offs_);
+		float s_2 = sampler_->sample(2, offs + i, render_data.sampling_offs_);
 		if(render_data.ray_division_ > 1)
 		{
 			s_1 = math::addMod1(s_1, render_data.dc_1_);
@@ -961,20 +1218,26 @@ Rgb MonteCarloIntegrator::sampleAmbientOcclusion(RenderData &render_data, const
 		light_ray.tmax_ = ao_dist_;
 		float w = 0.f;
 		Sample s(s_1, s_2, BsdfFlags::Glossy | BsdfFlags::Diffuse | BsdfFlags::Reflect);
+		RenderStats::add(RenderStats::BsdfSamples);
 		const Rgb surf_col = material->sample(render_data, sp, wo, light_ray.dir_, s, w);
 		if(material->getFlags().hasAny(BsdfFlags::Emit))
 		{
 			col += material->emit(render_data, sp, wo) * s.pdf_;
 		}
-		Rgb scol;
-		const bool shadowed = (tr_shad_) ? scene_->isShadowed(render_data, light_ray, s_depth_, scol, mask_obj_index, mask_mat_index) : scene_->isShadowed(render_data, light_ray, mask_obj_index, mask_mat_index);
-		if(!shadowed)
+		const Rgb occlusion_col = ao_col_ * surf_col * std::abs(sp.n_ * light_ray.dir_) * w;
+		if(occlusion_col.isBlack()) continue;
+		if(tr_shad_) //the transparent materials hit are evaluated, so these rays are traced one by one
+		{
+			Rgb scol;
+			if(!scene_->isShadowed(render_data, light_ray, s_depth_, scol, mask_obj_index, mask_mat_index)) col += scol * occlusion_col;
+		}
+		else
 		{
-			const float cos = std::abs(sp.n_ * light_ray.dir_);
-			if(tr_shad_) col += ao_col_ * scol * surf_col * cos * w;
-			else col += ao_col_ * surf_col * cos * w;
+			occlusion_rays.push_back(light_ray);
+			occlusion_colors.push_back(occlusion_col);
 		}
 	}
+	col += unoccludedColor(render_data, occlusion_rays, occlusion_colors);
 	return col / static_cast<float>(n);
 }
 
@@ -985,16 +1248,17 @@ Rgb MonteCarloIntegrator::sampleAmbientOcclusionLayer(RenderData &render_data, c
 	Ray light_ray;
 	light_ray.from_ = sp.p_;
 	light_ray.dir_ = Vec3(0.f);
-	float mask_obj_index = 0.f, mask_mat_index = 0.f;
 	int n = ao_samples_;//(int) ceilf(aoSamples*getSampleMultiplier());
 	if(render_data.ray_division_ > 1) n = std::max(1, n / render_data.ray_division_);
-	const unsigned int offs = n * render_data.pixel_sample_ + render_data.sampling_offs_;
-	Halton hal_2(2, offs - 1);
-	Halton hal_3(3, offs - 1);
+	const unsigned int offs = n * render_data.pixel_sample_;
+	std::vector<Ray> occlusion_rays;
+	std::vector<Rgb> occlusion_colors;
+	occlusion_rays.reserve(n);
+	occlusion_colors.reserve(n);
 	for(int i = 0; i < n; ++i)
 	{
-		float s_1 = hal_2.getNext();
-		float s_2 = hal_3.getNext();
+		float s_1 = sampler_->sample(1, offs + i, render_data.sampling_offs_);
+		float s_2 = sampler_->sample(2, offs + i, render_data.sampling_offs_);
 		if(render_data.ray_division_ > 1)
 		{
 			s_1 = math::addMod1(s_1, render_data.dc_1_);
@@ -1005,19 +1269,18 @@ Rgb MonteCarloIntegrator::sampleAmbientOcclusionLayer(RenderData &render_data, c
 		light_ray.tmax_ = ao_dist_;
 		float w = 0.f;
 		Sample s(s_1, s_2, BsdfFlags::Glossy | BsdfFlags::Diffuse | BsdfFlags::Reflect);
+		RenderStats::add(RenderStats::BsdfSamples);
 		const Rgb surf_col = material->sample(render_data, sp, wo, light_ray.dir_, s, w);
 		if(material->getFlags().hasAny(BsdfFlags::Emit))
 		{
 			col += material->emit(render_data, sp, wo) * s.pdf_;
 		}
-		const bool shadowed = scene_->isShadowed(render_data, light_ray, mask_obj_index, mask_mat_index);
-		if(!shadowed)
-		{
-			float cos = std::abs(sp.n_ * light_ray.dir_);
-			//if(trShad) col += aoCol * scol * surfCol * cos * W;
-			col += ao_col_ * surf_col * cos * w;
-		}
+		const Rgb occlusion_col = ao_col_ * surf_col * std::abs(sp.n_ * light_ray.dir_) * w;
+		if(occlusion_col.isBlack()) continue;
+		occlusion_rays.push_back(light_ray);
+		occlusion_colors.push_back(occlusion_col);
 	}
+	col += unoccludedColor(render_data, occlusion_rays, occlusion_colors);
 	return col / static_cast<float>(n);
 }
 
@@ -1028,16 +1291,17 @@ Rgb MonteCarloIntegrator::sampleAmbientOcclusionClayLayer(RenderData &render_dat
 	Ray light_ray;
 	light_ray.from_ = sp.p_;
 	light_ray.dir_ = Vec3(0.f);
-	float mask_obj_index = 0.f, mask_mat_index = 0.f;
 	int n = ao_samples_;
 	if(render_data.ray_division_ > 1) n = std::max(1, n / render_data.ray_division_);
-	const unsigned int offs = n * render_data.pixel_sample_ + render_data.sampling_offs_;
-	Halton hal_2(2, offs - 1);
-	Halton hal_3(3, offs - 1);
+	const unsigned int offs = n * render_data.pixel_sample_;
+	std::vector<Ray> occlusion_rays;
+	std::vector<Rgb> occlusion_colors;
+	occlusion_rays.reserve(n);
+	occlusion_colors.reserve(n);
 	for(int i = 0; i < n; ++i)
 	{
-		float s_1 = hal_2.getNext();
-		float s_2 = hal_3.getNext();
+		float s_1 = sampler_->sample(1, offs + i, render_data.sampling_offs_);
+		float s_2 = sampler_->sample(2, offs + i, render_data.sampling_offs_);
 		if(render_data.ray_division_ > 1)
 		{
 			s_1 = math::addMod1(s_1, render_data.dc_1_);
@@ -1054,15 +1318,160 @@ Rgb MonteCarloIntegrator::sampleAmbientOcclusionClayLayer(RenderData &render_dat
 		{
 			col += material->emit(render_data, sp, wo) * s.pdf_;
 		}
-		const bool shadowed = scene_->isShadowed(render_data, light_ray, mask_obj_index, mask_mat_index);
-		if(!shadowed)
+		const Rgb occlusion_col = ao_col_ * surf_col * std::abs(sp.n_ * light_ray.dir_) * w;
+		if(occlusion_col.isBlack()) continue;
+		occlusion_rays.push_back(light_ray);
+		occlusion_colors.push_back(occlusion_col);
+	}
+	col += unoccludedColor(render_data, occlusion_rays, occlusion_colors);
+	return col / static_cast<float>(n);
+}
+
+//! Irradiance at a point of an irradiance point cloud, with the light transmitted through the surface into the medium
+static Rgb pointCloudIrradiance_global(const Scene &scene, const std::vector<const Light *> &lights, RenderData &render_data, const SurfacePoint &sp, float ior, Random &prng)
+{
+	Rgb irradiance(0.f);
+	float mask_obj_index = 0.f, mask_mat_index = 0.f;
+	const auto transmitted = [&](const Light *light, Ray &light_ray, const Rgb &light_col)
+	{
+		const float cos_n = sp.n_ * light_ray.dir_;
+		if(cos_n <= 0.f) return Rgb(0.f);
+		if(scene.shadow_bias_auto_) light_ray.tmin_ = scene.shadow_bias_ * std::max(1.f, Vec3(sp.p_).length());
+		else light_ray.tmin_ = scene.shadow_bias_;
+		if(light->castShadows() && scene.isShadowed(render_data, light_ray, mask_obj_index, mask_mat_index)) return Rgb(0.f);
+		float kr, kt;
+		Vec3::fresnel(light_ray.dir_, sp.n_, ior, kr, kt);
+		return light_col * (cos_n * kt);
+	};
+	for(const Light *light : lights)
+	{
+		Ray light_ray;
+		light_ray.from_ = sp.p_;
+		if(light->diracLight())
 		{
-			float cos = std::abs(sp.n_ * light_ray.dir_);
-			//if(trShad) col += aoCol * scol * surfCol * cos * W;
-			col += ao_col_ * surf_col * cos * w;
+			Rgb light_col(0.f);
+			if(light->illuminate(sp, light_col, light_ray)) irradiance += transmitted(light, light_ray, light_col);
+		}
+		else
+		{
+			const int n = std::max(1, light->nSamples());
+			Rgb light_irradiance(0.f);
+			LSample ls;
+			for(int i = 0; i < n; ++i)
+			{
+				ls.s_1_ = prng();
+				ls.s_2_ = prng();
+				if(light->illumSample(sp, ls, light_ray) && ls.pdf_ > 1e-6f) light_irradiance += transmitted(light, light_ray, ls.col_) * (1.f / ls.pdf_);
+			}
+			irradiance += light_irradiance * (1.f / static_cast<float>(n));
 		}
 	}
-	return col / static_cast<float>(n);
+	return irradiance;
+}
+
+void MonteCarloIntegrator::createSubsurfaceClouds()
+{
+	subsurface_clouds_.clear();
+	int total_points = 0;
+	for(const Object *object : scene_->getObjects())
+	{
+		if(object->isBaseObject()) continue;
+		//A single diffusion profile per object, the primitives with other materials do not diffuse the light into it
+		const Material *sss_material = nullptr;
+		const DiffusionProfile *profile = nullptr;
+		std::vector<const Primitive *> primitives;
+		std::vector<float> areas;
+		float total_area = 0.f;
+		for(const Primitive *primitive : object->getPrimitives())
+		{
+			const Material *material = primitive->getMaterial();
+			if(!material) continue;
+			if(!sss_material)
+			{
+				const VolumeHandler *vol = material->getVolumeHandler(true);
+				if(!vol || !vol->getDiffusionProfile()) continue;
+				sss_material = material;
+				profile = vol->getDiffusionProfile();
+			}
+			else if(material != sss_material) continue;
+			primitives.push_back(primitive);
+			areas.push_back(primitive->surfaceArea());
+			total_area += areas.back();
+		}
+		if(!profile || total_area <= 0.f) continue;
+
+		//The points are spaced at half the diffusion mean free path, as far as the maximum number of points allows
+		const float point_spacing = 0.5f * profile->getMeanFreePath();
+		const float density = std::min(static_cast<float>(sss_max_points_), std::max(1.f, total_area / (point_spacing * point_spacing))) / total_area;
+		//Each point stands for the same area, also in the small primitives that get a point only now and then from the random rounding
+		const float point_area = 1.f / density;
+		std::vector<SssPointCloud::Point> points;
+		Random prng(static_cast<unsigned int>(subsurface_clouds_.size() + 1));
+		for(size_t primitive_id = 0; primitive_id < primitives.size(); ++primitive_id)
+		{
+			const int num_primitive_points = static_cast<int>(areas[primitive_id] * density + prng());
+			for(int i = 0; i < num_primitive_points; ++i)
+			{
+				SssPointCloud::Point point;
+				primitives[primitive_id]->sample(prng(), prng(), point.p_, point.n_);
+				point.area_ = point_area;
+				point.irradiance_ = Rgb(0.f);
+				points.push_back(point);
+			}
+		}
+
+		static constexpr size_t points_per_task = 256;
+		TaskPool task_pool(scene_->getNumThreads());
+		TaskPool::Group task_group(task_pool);
+		for(size_t first_point = 0; first_point < points.size(); first_point += points_per_task)
+		{
+			task_group.run([&, first_point]()
+			{
+				RenderData render_data;
+				Random task_prng(static_cast<unsigned int>(first_point + 1));
+				SurfacePoint sp;
+				sp.material_ = sss_material;
+				sp.object_ = object;
+				for(size_t point_id = first_point; point_id < std::min(points.size(), first_point + points_per_task); ++point_id)
+				{
+					SssPointCloud::Point &point = points[point_id];
+					sp.p_ = point.p_;
+					sp.n_ = sp.ng_ = point.n_;
+					point.irradiance_ = pointCloudIrradiance_global(*scene_, lights_, render_data, sp, profile->getIor(), task_prng);
+				}
+			});
+		}
+		task_group.wait();
+
+		total_points += static_cast<int>(points.size());
+		SubsurfaceCloud subsurface_cloud;
+		subsurface_cloud.profile_ = profile;
+		subsurface_cloud.cloud_ = std::unique_ptr<const SssPointCloud>(new SssPointCloud(std::move(points), sss_max_error_));
+		subsurface_clouds_[object] = std::move(subsurface_cloud);
+	}
+	if(!subsurface_clouds_.empty()) Y_INFO << getName() << ": Subsurface scattering point clouds: " << subsurface_clouds_.size() << " object(s), " << total_points << " point(s)" << YENDL;
+}
+
+const MonteCarloIntegrator::SubsurfaceCloud *MonteCarloIntegrator::findSubsurfaceCloud(const SurfacePoint &sp, const Vec3 &wo) const
+{
+	if(subsurface_clouds_.empty() || sp.ng_ * wo <= 0.f) return nullptr;
+	const auto subsurface_cloud = subsurface_clouds_.find(sp.object_);
+	if(subsurface_cloud == subsurface_clouds_.end()) return nullptr;
+	const VolumeHandler *vol = sp.material_->getVolumeHandler(true);
+	if(!vol || vol->getDiffusionProfile() != subsurface_cloud->second.profile_) return nullptr;
+	return &subsurface_cloud->second;
+}
+
+Rgb MonteCarloIntegrator::estimateSubsurfaceDiffusion(const SurfacePoint &sp, const Vec3 &wo) const
+{
+	const SubsurfaceCloud *subsurface_cloud = findSubsurfaceCloud(sp, wo);
+	if(!subsurface_cloud) return Rgb(0.f);
+	const DiffusionProfile &profile = *subsurface_cloud->profile_;
+	//Radiance leaving the surface from the diffused exitance, with the Fresnel transmittance towards wo normalized over the hemisphere (Jensen and Buhler 2002)
+	float kr, kt;
+	Vec3::fresnel(wo, sp.n_, profile.getIor(), kr, kt);
+	const float normalization = kt / (M_PI * std::max(0.01f, 1.f - profile.getDiffuseFresnelReflectance()));
+	return subsurface_cloud->cloud_->radiantExitance(sp.p_, profile) * normalization;
 }
 
 END_YAFARAY
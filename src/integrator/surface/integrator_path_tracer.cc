@@ -31,8 +31,12 @@
 #include "volume/volume.h"
 #include "sampler/halton.h"
 #include "common/logger.h"
+#include "common/render_stats.h"
 #include "render/render_data.h"
 #include "render/imagesplitter.h"
+#include "math/random.h"
+#include "color/spectrum.h"
+#include <chrono>
 
 BEGIN_YAFARAY
 
@@ -55,10 +59,22 @@ bool PathIntegrator::preprocess(const RenderControl &render_control, const Rende
 {
 	image_film_ = image_film;
 	std::stringstream set;
-	g_timer_global.addEvent("prepass");
-	g_timer_global.start("prepass");
+	scene_->getRenderControl().getTimer().addEvent("prepass");
+	scene_->getRenderControl().getTimer().start("prepass");
 
 	lights_ = render_view->getLightsVisible();
+	setupLightSampling(render_view);
+	createSubsurfaceClouds();
+	wavefront_thread_data_.clear();
+	if(wavefront_) wavefront_thread_data_.resize(scene_->getNumThreads());
+	bounce_costs_.assign(scene_->getNumThreads(), std::vector<float>(max_bounces_ + 1, 0.f));
+	sd_tree_.reset();
+	path_guiding_pass_ = 0;
+	path_guiding_recording_ = false;
+	if(path_guiding_) sd_tree_ = std::unique_ptr<SdTree>(new SdTree(scene_->getSceneBound(), path_guiding_parameters_));
+	//The bounce loop is selected once per render, with the basic kernel for the configurations without any of the extended features
+	const bool extended_features = path_splitting_max_ > 1 || russian_roulette_type_ == RussianRouletteType::WeightWindow || hero_wavelength_ || path_guiding_ || ibl_irradiance_depth_ > 0;
+	trace_path_bounces_ = extended_features ? &PathIntegrator::tracePathBounces<true> : &PathIntegrator::tracePathBounces<false>;
 
 	set << "Path Tracing  ";
 
@@ -67,6 +83,11 @@ bool PathIntegrator::preprocess(const RenderControl &render_control, const Rende
 		set << "ShadowDepth=" << s_depth_ << "  ";
 	}
 	set << "RayDepth=" << r_depth_ << " npaths=" << n_paths_ << " bounces=" << max_bounces_ << " min_bounces=" << russian_roulette_min_bounces_ << " ";
+	if(wavefront_) set << "wavefront ";
+	if(russian_roulette_type_ == RussianRouletteType::WeightWindow) set << "RR=weight_window(" << russian_roulette_weight_low_ << ") ";
+	if(path_splitting_max_ > 1) set << "splitting=" << path_splitting_max_ << "(" << path_splitting_weight_ << ") ";
+	if(path_guiding_) set << "guiding=" << path_guiding_fraction_ << "(training passes=" << path_guiding_training_passes_ << ") ";
+	if(ibl_irradiance_depth_ > 0) set << "IBL irradiance from depth=" << ibl_irradiance_depth_ << " ";
 
 	bool success = true;
 	trace_caustics_ = false;
@@ -104,10 +125,10 @@ bool PathIntegrator::preprocess(const RenderControl &render_control, const Rende
 		else if(photon_map_processing_ == PhotonsGenerateAndSave) set << " (saving photon maps to file)";
 	}
 
-	g_timer_global.stop("prepass");
-	Y_INFO << getName() << ": Photonmap building time: " << std::fixed << std::setprecision(1) << g_timer_global.getTime("prepass") << "s" << " (" << scene_->getNumThreadsPhotons() << " thread(s))" << YENDL;
+	scene_->getRenderControl().getTimer().stop("prepass");
+	Y_INFO << getName() << ": Photonmap building time: " << std::fixed << std::setprecision(1) << scene_->getRenderControl().getTimer().getTime("prepass") << "s" << " (" << scene_->getNumThreadsPhotons() << " thread(s))" << YENDL;
 
-	set << "| photon maps: " << std::fixed << std::setprecision(1) << g_timer_global.getTime("prepass") << "s" << " [" << scene_->getNumThreadsPhotons() << " thread(s)]";
+	set << "| photon maps: " << std::fixed << std::setprecision(1) << scene_->getRenderControl().getTimer().getTime("prepass") << "s" << " [" << scene_->getNumThreadsPhotons() << " thread(s)]";
 
 	render_info_ += set.str();
 
@@ -119,23 +140,33 @@ bool PathIntegrator::preprocess(const RenderControl &render_control, const Rende
 	return success;
 }
 
+void PathIntegrator::prePass(int samples, int offset, bool adaptive, const RenderControl &render_control, const RenderView *render_view)
+{
+	if(!sd_tree_) return;
+	//The radiance recorded in the previous pass guides the paths of this pass, until the training passes are finished
+	if(path_guiding_pass_ > 0 && path_guiding_pass_ <= path_guiding_training_passes_)
+	{
+		sd_tree_->update();
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": guiding tree updated, " << sd_tree_->getNumLeaves() << " spatial leaves, " << sd_tree_->getNumDirectionalNodes() << " directional nodes" << YENDL;
+	}
+	path_guiding_recording_ = path_guiding_pass_ < path_guiding_training_passes_;
+	++path_guiding_pass_;
+}
+
 Rgba PathIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers, const RenderView *render_view) const
 {
 	const bool layers_used = render_data.raylevel_ == 0 && color_layers && color_layers->getFlags() != Layer::Flags::None;
 
-	static int calls = 0;
-	++calls;
 	Rgb col(0.0);
 	float alpha;
 	SurfacePoint sp;
-	void *o_udat = render_data.arena_;
-	float w = 0.f;
+	void *o_udat = render_data.material_data_;
 
 	if(transp_background_) alpha = 0.0;
 	else alpha = 1.0;
 
 	//shoot ray into scene
-	if(scene_->intersect(ray, sp))
+	if(scene_->intersect(ray, sp, render_data.takePrimaryHit()))
 	{
 		// if camera ray initialize sampling offset:
 		if(render_data.raylevel_ == 0)
@@ -143,18 +174,12 @@ Rgba PathIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int
 			render_data.lights_geometry_material_emit_ = true;
 			//...
 		}
-		alignas (16) unsigned char userdata[user_data_size_];
-		render_data.arena_ = static_cast<void *>(userdata);
 		BsdfFlags bsdfs;
 
 		const Material *material = sp.material_;
+		render_data.material_data_ = render_data.allocMaterialData(material->getReqMem());
 		material->initBsdf(render_data, sp, bsdfs);
 		Vec3 wo = -ray.dir_;
-		const VolumeHandler *vol;
-		Rgb vcol(0.f);
-
-		Random &prng = *(render_data.prng_);
-
 		if(additional_depth < material->getAdditionalDepth()) additional_depth = material->getAdditionalDepth();
 
 		// contribution of light emitting surfaces
@@ -168,6 +193,9 @@ Rgba PathIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int
 			}
 		}
 
+		// contribution of the light diffused under the surface
+		if(!subsurface_clouds_.empty()) col += estimateSubsurfaceDiffusion(sp, wo);
+
 		if(bsdfs.hasAny(BsdfFlags::Diffuse))
 		{
 			col += estimateAllDirectLight(render_data, sp, wo, color_layers);
@@ -197,24 +225,23 @@ Rgba PathIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int
 			Rgb path_col(0.0), wl_col;
 			path_flags |= (BsdfFlags::Diffuse | BsdfFlags::Reflect | BsdfFlags::Transmit);
 			int n_samples = std::max(1, n_paths_ / render_data.ray_division_);
-			for(int i = 0; i < n_samples; ++i)
+			if(wavefront_) path_col = tracePathsWavefront(render_data, sp, wo, material, n_samples, was_chromatic, path_flags, color_layers);
+			else for(int i = 0; i < n_samples; ++i)
 			{
-				void *first_udat = render_data.arena_;
-				alignas (16) unsigned char n_userdata[user_data_size_];
-				void *n_udat = static_cast<void *>(n_userdata);
-				unsigned int offs = n_paths_ * render_data.pixel_sample_ + render_data.sampling_offs_ + i; // some redunancy here...
+				void *first_udat = render_data.material_data_;
+				const unsigned int offs = n_paths_ * render_data.pixel_sample_ + i; //sample index of the path in the pixel, the pixel sampling offset is the seed of the sampler
 				Rgb throughput(1.0);
 				Rgb lcol, scol;
-				SurfacePoint sp_1 = sp, sp_2;
-				SurfacePoint *hit = &sp_1, *hit_2 = &sp_2;
+				SurfacePoint sp_1 = sp;
+				SurfacePoint *hit = &sp_1;
 				Vec3 pwo = wo;
 				Ray p_ray;
 
 				render_data.chromatic_ = was_chromatic;
-				if(was_chromatic) render_data.wavelength_ = sample::riS(offs);
+				if(was_chromatic) render_data.wavelength_ = sampleWavelength(offs, render_data.sampling_offs_);
 				//this mat already is initialized, just sample (diffuse...non-specular?)
-				float s_1 = sample::riVdC(offs);
-				float s_2 = Halton::lowDiscrepancySampling(2, offs);
+				float s_1 = sampler_->sample(1, offs, render_data.sampling_offs_);
+				float s_2 = sampler_->sample(2, offs, render_data.sampling_offs_);
 				if(render_data.ray_division_ > 1)
 				{
 					s_1 = math::addMod1(s_1, render_data.dc_1_);
@@ -222,20 +249,29 @@ Rgba PathIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int
 				}
 				// do proper sampling now...
 				Sample s(s_1, s_2, path_flags);
-				scol = material->sample(render_data, sp, pwo, p_ray.dir_, s, w);
+				float guiding_pdf = 0.f;
+				scol = sampleBsdf(render_data, sp, material, bsdfs, path_flags, pwo, p_ray.dir_, s, guiding_pdf);
 
-				scol *= w;
 				throughput = scol;
+				HeroWavelengths hero_wavelengths(render_data.wavelength_);
+				HeroWavelengths *hero = (was_chromatic && hero_wavelength_) ? &hero_wavelengths : nullptr;
+				if(hero && s.sampled_flags_.hasAny(BsdfFlags::Dispersive)) heroWavelengthVertex(render_data, sp, material, pwo, p_ray.dir_, *hero, throughput);
 				render_data.lights_geometry_material_emit_ = false;
+				const bool record_guiding = path_guiding_recording_ && guiding_pdf > 0.f;
+				const GuidingVertex guiding_vertex {sp.p_, p_ray.dir_, throughput, Rgb(0.f), guiding_pdf};
 
 				p_ray.tmin_ = scene_->ray_min_dist_;
 				p_ray.tmax_ = -1.0;
 				p_ray.from_ = sp.p_;
 
-				if(!scene_->intersect(p_ray, *hit)) continue; //hit background
+				if(!scene_->intersect(p_ray, *hit)) //hit background
+				{
+					if(record_guiding) recordGuidingVertex(render_data, guiding_vertex, Rgb(0.f));
+					continue;
+				}
 
-				render_data.arena_ = n_udat;
 				const Material *p_mat = hit->material_;
+				render_data.material_data_ = render_data.allocMaterialData(p_mat->getReqMem());
 				BsdfFlags mat_bsd_fs;
 				p_mat->initBsdf(render_data, *hit, mat_bsd_fs);
 				if(s.sampled_flags_ != BsdfFlags::None) pwo = -p_ray.dir_; //Fix for white dots in path tracing with shiny diffuse with transparent PNG texture and transparent shadows, especially in Win32, (precision?). Sometimes the first sampling does not take place and pRay.dir is not initialized, so before this change when that happened pwo = -pRay.dir was getting a random non-initialized value! This fix makes that, if the first sample fails for some reason, pwo is not modified and the rest of the sampling continues with the same pwo value. FIXME: Question: if the first sample fails, should we continue as now or should we exit the loop with the "continue" command?
@@ -250,82 +286,10 @@ Rgba PathIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int
 					}
 				}
 
-				path_col += lcol * throughput;
-
-				bool caustic = false;
-
-				for(int depth = 1; depth < max_bounces_; ++depth)
-				{
-					int d_4 = 4 * depth;
-					s.s_1_ = Halton::lowDiscrepancySampling(d_4 + 3, offs); //ourRandom();//
-					s.s_2_ = Halton::lowDiscrepancySampling(d_4 + 4, offs); //ourRandom();//
-
-					if(render_data.ray_division_ > 1)
-					{
-						s_1 = math::addMod1(s_1, render_data.dc_1_);
-						s_2 = math::addMod1(s_2, render_data.dc_2_);
-					}
-
-					s.flags_ = BsdfFlags::All;
-
-					scol = p_mat->sample(render_data, *hit, pwo, p_ray.dir_, s, w);
-					scol *= w;
-
-					if(scol.isBlack()) break;
-
-					throughput *= scol;
-					caustic = trace_caustics_ && s.sampled_flags_.hasAny(BsdfFlags::Specular | BsdfFlags::Glossy | BsdfFlags::Filter);
-					render_data.lights_geometry_material_emit_ = caustic;
-
-					p_ray.tmin_ = scene_->ray_min_dist_;
-					p_ray.tmax_ = -1.0;
-					p_ray.from_ = hit->p_;
-
-					if(!scene_->intersect(p_ray, *hit_2)) //hit background
-					{
-						const auto &background = scene_->getBackground();
-						if((caustic && background && background->hasIbl() && background->shootsCaustic()))
-						{
-							path_col += throughput * (*background)(p_ray, render_data, true);
-						}
-						break;
-					}
-
-					std::swap(hit, hit_2);
-					p_mat = hit->material_;
-					p_mat->initBsdf(render_data, *hit, mat_bsd_fs);
-					pwo = -p_ray.dir_;
-
-					if(mat_bsd_fs.hasAny(BsdfFlags::Diffuse)) lcol = estimateOneDirectLight(render_data, *hit, pwo, offs);
-					else lcol = Rgb(0.f);
-
-					if(mat_bsd_fs.hasAny(BsdfFlags::Volumetric) && (vol = p_mat->getVolumeHandler(hit->n_ * pwo < 0)))
-					{
-						if(vol->transmittance(render_data, p_ray, vcol)) throughput *= vcol;
-					}
-
-					// Russian roulette for terminating paths with low probability
-					if(depth > russian_roulette_min_bounces_)
-					{
-						float random_value = prng();
-						float probability = throughput.maximum();
-						if(probability <= 0.f || probability < random_value) break;
-						throughput *= 1.f / probability;
-					}
-
-					if(mat_bsd_fs.hasAny(BsdfFlags::Emit) && caustic)
-					{
-						const Rgb col_tmp = p_mat->emit(render_data, *hit, pwo);
-						lcol += col_tmp;
-						if(layers_used)
-						{
-							if(ColorLayer *color_layer = color_layers->find(Layer::Emit)) color_layer->color_ += col_tmp;
-						}
-					}
-
-					path_col += lcol * throughput;
-				}
-				render_data.arena_ = first_udat;
+				const Rgb sample_col = lcol * throughput + (this->*trace_path_bounces_)(render_data, *hit, pwo, mat_bsd_fs, throughput, 1, offs, 0.f, 0.f, true, hero, color_layers);
+				if(record_guiding) recordGuidingVertex(render_data, guiding_vertex, sample_col);
+				path_col += sample_col;
+				render_data.material_data_ = first_udat;
 
 			}
 			col += path_col / n_samples;
@@ -370,7 +334,7 @@ Rgba PathIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int
 		}
 	}
 
-	render_data.arena_ = o_udat;
+	render_data.material_data_ = o_udat;
 
 	const Rgb col_vol_transmittance = scene_->vol_integrator_->transmittance(render_data, ray);
 	const Rgb col_vol_integration = scene_->vol_integrator_->integrate(render_data, ray);
@@ -388,6 +352,444 @@ Rgba PathIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int
 	return Rgba(col, alpha);
 }
 
+template <bool extended_features>
+Rgb PathIntegrator::tracePathBounces(RenderData &render_data, const SurfacePoint &start_hit, const Vec3 &start_wo, const BsdfFlags &start_bsdfs, Rgb throughput, int first_depth, unsigned int offs, float dc_1, float dc_2, bool split_allowed, HeroWavelengths *hero, ColorLayers *color_layers) const
+{
+	const bool layers_used = render_data.raylevel_ == 0 && color_layers && color_layers->getFlags() != Layer::Flags::None;
+	//In the basic kernel the checks of the splitting, weight window, hero wavelength, guiding and IBL irradiance features are constant and compiled out
+	const bool measure_costs = extended_features && russian_roulette_type_ == RussianRouletteType::WeightWindow;
+	if(!extended_features) hero = nullptr;
+	Random &prng = *(render_data.prng_);
+	void *start_udat = render_data.material_data_; //the BSDF of the start hit is already initialized here
+	SurfacePoint sp_1 = start_hit, sp_2;
+	SurfacePoint *hit = &sp_1, *hit_2 = &sp_2;
+	const Material *p_mat = start_hit.material_;
+	BsdfFlags mat_bsd_fs = start_bsdfs;
+	Vec3 pwo = start_wo;
+	Ray p_ray;
+	Rgb path_col(0.f);
+	Rgb vcol(0.f);
+	const VolumeHandler *vol;
+	std::vector<GuidingVertex> guiding_vertices;
+
+	for(int depth = first_depth; depth < max_bounces_; ++depth)
+	{
+		RenderStats::addToHistogram(RenderStats::PathBounces, depth);
+		// Splitting of the high weight paths: the copies continue from the same vertex with decorrelated samples
+		if(extended_features && split_allowed && path_splitting_max_ > 1)
+		{
+			const int num_splits = pathSplits(throughput, depth, render_data.thread_id_);
+			if(num_splits > 1)
+			{
+				throughput *= 1.f / static_cast<float>(num_splits);
+				void *current_udat = render_data.material_data_;
+				for(int split = 1; split < num_splits; ++split)
+				{
+					const float split_dc_1 = prng(), split_dc_2 = prng();
+					HeroWavelengths split_hero = hero ? *hero : HeroWavelengths(0.f); //the copies continue with their own spectral weights
+					path_col += tracePathBounces<extended_features>(render_data, *hit, pwo, mat_bsd_fs, throughput, depth, offs, split_dc_1, split_dc_2, false, hero ? &split_hero : nullptr, color_layers);
+					render_data.material_data_ = current_udat;
+				}
+			}
+		}
+		split_allowed = true;
+		const std::chrono::steady_clock::time_point bounce_start = measure_costs ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+		int d_4 = 4 * depth;
+		Sample s(math::addMod1(sampler_->sample(d_4 + 3, offs, render_data.sampling_offs_), dc_1), math::addMod1(sampler_->sample(d_4 + 4, offs, render_data.sampling_offs_), dc_2), BsdfFlags::All);
+		float guiding_pdf = 0.f;
+		const Rgb scol = sampleBsdf(render_data, *hit, p_mat, mat_bsd_fs, BsdfFlags::All, pwo, p_ray.dir_, s, guiding_pdf);
+
+		if(scol.isBlack()) break;
+
+		throughput *= scol;
+		if(hero && s.sampled_flags_.hasAny(BsdfFlags::Dispersive)) heroWavelengthVertex(render_data, *hit, p_mat, pwo, p_ray.dir_, *hero, throughput);
+		if(extended_features && path_guiding_recording_ && guiding_pdf > 0.f) guiding_vertices.push_back({hit->p_, p_ray.dir_, throughput, path_col, guiding_pdf});
+		const bool caustic = trace_caustics_ && s.sampled_flags_.hasAny(BsdfFlags::Specular | BsdfFlags::Glossy | BsdfFlags::Filter);
+		render_data.lights_geometry_material_emit_ = caustic;
+
+		p_ray.tmin_ = scene_->ray_min_dist_;
+		p_ray.tmax_ = -1.0;
+		p_ray.from_ = hit->p_;
+
+		if(!scene_->intersect(p_ray, *hit_2)) //hit background
+		{
+			const auto &background = scene_->getBackground();
+			if((caustic && background && background->hasIbl() && background->shootsCaustic()))
+			{
+				path_col += throughput * (*background)(p_ray, render_data, true);
+			}
+			break;
+		}
+
+		std::swap(hit, hit_2);
+		p_mat = hit->material_;
+		render_data.material_data_ = render_data.allocMaterialData(p_mat->getReqMem());
+		p_mat->initBsdf(render_data, *hit, mat_bsd_fs);
+		pwo = -p_ray.dir_;
+
+		Rgb irradiance_col;
+		const bool ends_with_irradiance = extended_features && endsWithIrradiance(render_data, *hit, pwo, mat_bsd_fs, depth, irradiance_col);
+		Rgb lcol(0.f);
+		if(mat_bsd_fs.hasAny(BsdfFlags::Diffuse)) lcol = estimateOneDirectLight(render_data, *hit, pwo, offs, ends_with_irradiance);
+
+		if(mat_bsd_fs.hasAny(BsdfFlags::Volumetric) && (vol = p_mat->getVolumeHandler(hit->n_ * pwo < 0)))
+		{
+			if(vol->transmittance(render_data, p_ray, vcol)) throughput *= vcol;
+		}
+
+		// Russian roulette for terminating paths with low probability
+		if(depth > russian_roulette_min_bounces_)
+		{
+			const float random_value = prng();
+			const float probability = survivalProbability(throughput, depth, render_data.thread_id_);
+			if(probability <= 0.f || probability < random_value) break;
+			throughput *= 1.f / probability;
+		}
+
+		if(mat_bsd_fs.hasAny(BsdfFlags::Emit) && caustic)
+		{
+			const Rgb col_tmp = p_mat->emit(render_data, *hit, pwo);
+			lcol += col_tmp;
+			if(layers_used)
+			{
+				if(ColorLayer *color_layer = color_layers->find(Layer::Emit)) color_layer->color_ += col_tmp;
+			}
+		}
+
+		if(ends_with_irradiance) lcol += irradiance_col;
+		path_col += lcol * throughput;
+		if(measure_costs) addBounceCost(depth, render_data.thread_id_, std::chrono::duration<float>(std::chrono::steady_clock::now() - bounce_start).count());
+		if(ends_with_irradiance) break;
+	}
+	if(extended_features) for(const auto &guiding_vertex : guiding_vertices) recordGuidingVertex(render_data, guiding_vertex, path_col - guiding_vertex.path_col_);
+	render_data.material_data_ = start_udat;
+	return path_col;
+}
+
+constexpr int PathIntegrator::HeroWavelengths::num_wavelengths_;
+
+PathIntegrator::HeroWavelengths::HeroWavelengths(float hero_wavelength)
+{
+	for(int i = 0; i < num_wavelengths_; ++i)
+	{
+		wavelengths_[i] = math::addMod1(hero_wavelength, static_cast<float>(i) / num_wavelengths_);
+		bsdf_ratios_[i] = Rgb(1.f);
+		pdf_ratios_[i] = 1.f;
+	}
+}
+
+Rgb PathIntegrator::HeroWavelengths::spectralFactor() const
+{
+	Rgb factor(0.f);
+	float pdf_sum = 0.f;
+	for(int i = 0; i < num_wavelengths_; ++i)
+	{
+		if(pdf_ratios_[i] <= 0.f) continue;
+		Rgb wl_col;
+		wl2Rgb_global(wavelengths_[i], wl_col);
+		factor += bsdf_ratios_[i] * wl_col;
+		pdf_sum += pdf_ratios_[i];
+	}
+	return factor * (1.f / pdf_sum); //the hero wavelength always keeps its pdf ratio 1
+}
+
+void PathIntegrator::heroWavelengthVertex(RenderData &render_data, const SurfacePoint &sp, const Material *material, const Vec3 &wo, const Vec3 &wi, HeroWavelengths &hero, Rgb &throughput) const
+{
+	const float hero_wavelength = render_data.wavelength_;
+	//The specular dispersion has no pdf, a different wavelength would have been refracted in another direction
+	const float hero_pdf = material->pdf(render_data, sp, wo, wi, BsdfFlags::All);
+	const Rgb hero_bsdf = material->eval(render_data, sp, wo, wi, BsdfFlags::All);
+	for(int i = 1; i < HeroWavelengths::num_wavelengths_; ++i)
+	{
+		if(hero.pdf_ratios_[i] <= 0.f) continue;
+		if(hero_pdf <= 0.f)
+		{
+			hero.pdf_ratios_[i] = 0.f;
+			continue;
+		}
+		render_data.wavelength_ = hero.wavelengths_[i];
+		hero.pdf_ratios_[i] *= material->pdf(render_data, sp, wo, wi, BsdfFlags::All) / hero_pdf;
+		const Rgb bsdf = material->eval(render_data, sp, wo, wi, BsdfFlags::All);
+		hero.bsdf_ratios_[i].r_ *= hero_bsdf.r_ > 0.f ? bsdf.r_ / hero_bsdf.r_ : 0.f;
+		hero.bsdf_ratios_[i].g_ *= hero_bsdf.g_ > 0.f ? bsdf.g_ / hero_bsdf.g_ : 0.f;
+		hero.bsdf_ratios_[i].b_ *= hero_bsdf.b_ > 0.f ? bsdf.b_ / hero_bsdf.b_ : 0.f;
+	}
+	render_data.wavelength_ = hero_wavelength;
+	//The channels of the previous factor that are 0 cannot become positive, as the wavelengths that were 0 in them stay 0
+	const Rgb factor = hero.spectralFactor();
+	throughput.r_ *= hero.factor_.r_ > 0.f ? factor.r_ / hero.factor_.r_ : 0.f;
+	throughput.g_ *= hero.factor_.g_ > 0.f ? factor.g_ / hero.factor_.g_ : 0.f;
+	throughput.b_ *= hero.factor_.b_ > 0.f ? factor.b_ / hero.factor_.b_ : 0.f;
+	hero.factor_ = factor;
+}
+
+Rgb PathIntegrator::sampleBsdf(RenderData &render_data, const SurfacePoint &sp, const Material *material, const BsdfFlags &bsdfs, const BsdfFlags &sample_flags, const Vec3 &wo, Vec3 &wi, Sample &s, float &guiding_pdf) const
+{
+	guiding_pdf = 0.f;
+	if(!sd_tree_ || !isGuidable(bsdfs))
+	{
+		float w = 0.f;
+		RenderStats::add(RenderStats::BsdfSamples);
+		Rgb scol = material->sample(render_data, sp, wo, wi, s, w);
+		scol *= w;
+		return scol;
+	}
+	const DirectionalQuadtree *guiding_tree = sd_tree_->getSamplingTree(sp.p_);
+	const float guiding_fraction = guiding_tree ? path_guiding_fraction_ : 0.f;
+	if(guiding_fraction > 0.f && (*render_data.prng_)() < guiding_fraction)
+	{
+		wi = guiding_tree->sample(s.s_1_, s.s_2_);
+		s.sampled_flags_ = ((sp.ng_ * wo) * (sp.ng_ * wi) < 0.f) ? BsdfFlags::Translucency : BsdfFlags::DiffuseReflect;
+	}
+	else
+	{
+		float w = 0.f;
+		RenderStats::add(RenderStats::BsdfSamples);
+		material->sample(render_data, sp, wo, wi, s, w);
+		if(s.sampled_flags_ == BsdfFlags::None) return Rgb(0.f);
+	}
+	//The material pdfs and BSDFs are both scaled by pi, so the pdf is converted to solid angle and the ratio is kept
+	const float bsdf_pdf = material->pdf(render_data, sp, wo, wi, sample_flags) * static_cast<float>(M_1_PI);
+	guiding_pdf = (1.f - guiding_fraction) * bsdf_pdf;
+	if(guiding_tree) guiding_pdf += guiding_fraction * guiding_tree->pdf(wi);
+	if(guiding_pdf <= 0.f) return Rgb(0.f);
+	return material->eval(render_data, sp, wo, wi, sample_flags) * (std::abs(wi * sp.n_) * static_cast<float>(M_1_PI) / guiding_pdf);
+}
+
+void PathIntegrator::recordGuidingVertex(RenderData &render_data, const GuidingVertex &vertex, const Rgb &contribution) const
+{
+	//The contribution divided by the throughput up to the vertex estimates the radiance incident along the sampled direction
+	float radiance = 0.f;
+	if(vertex.throughput_.r_ > 0.f) radiance += contribution.r_ / vertex.throughput_.r_;
+	if(vertex.throughput_.g_ > 0.f) radiance += contribution.g_ / vertex.throughput_.g_;
+	if(vertex.throughput_.b_ > 0.f) radiance += contribution.b_ / vertex.throughput_.b_;
+	Random &prng = *(render_data.prng_);
+	sd_tree_->record(vertex.p_, vertex.wi_, radiance * 0.333333f / vertex.pdf_, {{static_cast<float>(prng()), static_cast<float>(prng()), static_cast<float>(prng())}});
+}
+
+float PathIntegrator::bounceCostFactor(int depth, int thread_id) const
+{
+	const std::vector<float> &bounce_costs = bounce_costs_[thread_id];
+	if(depth >= static_cast<int>(bounce_costs.size()) || bounce_costs[1] <= 0.f || bounce_costs[depth] <= 0.f) return 1.f;
+	return std::sqrt(bounce_costs[1] / bounce_costs[depth]);
+}
+
+void PathIntegrator::addBounceCost(int depth, int thread_id, float cost) const
+{
+	std::vector<float> &bounce_costs = bounce_costs_[thread_id];
+	if(depth >= static_cast<int>(bounce_costs.size())) return;
+	if(bounce_costs[depth] <= 0.f) bounce_costs[depth] = cost;
+	else bounce_costs[depth] += (cost - bounce_costs[depth]) * bounce_cost_smoothing_;
+}
+
+float PathIntegrator::survivalProbability(const Rgb &throughput, int depth, int thread_id) const
+{
+	if(russian_roulette_type_ == RussianRouletteType::Throughput) return std::min(1.f, throughput.maximum());
+	//The efficiency (inverse of variance * time) is maximized with survival probabilities proportional to the path weight divided by the square root of the cost of continuing it
+	const float weight = throughput.maximum() * bounceCostFactor(depth, thread_id);
+	if(weight >= russian_roulette_weight_low_) return 1.f;
+	return weight / russian_roulette_weight_low_;
+}
+
+int PathIntegrator::pathSplits(const Rgb &throughput, int depth, int thread_id) const
+{
+	const float weight = throughput.maximum() * bounceCostFactor(depth, thread_id);
+	if(weight <= path_splitting_weight_) return 1;
+	return std::min(path_splitting_max_, static_cast<int>(std::ceil(weight / path_splitting_weight_)));
+}
+
+Rgb PathIntegrator::tracePathsWavefront(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Material *material, int n_samples, bool was_chromatic, BsdfFlags path_flags, ColorLayers *color_layers) const
+{
+	const bool layers_used = render_data.raylevel_ == 0 && color_layers && color_layers->getFlags() != Layer::Flags::None;
+
+	WavefrontData &wavefront_data = wavefront_thread_data_[render_data.thread_id_];
+	std::vector<PathState> &paths = wavefront_data.paths_;
+	std::vector<int> &active_paths = wavefront_data.active_paths_;
+	paths.resize(n_samples);
+	active_paths.clear();
+	void *first_udat = render_data.material_data_;
+	Random &prng = *(render_data.prng_);
+	Rgb path_col(0.f);
+
+	//Each path keeps its own material data, spectral and emission state, which are swapped into render_data before running any of its phases
+	auto resumePath = [&](const PathState &path, int path_id)
+	{
+		render_data.material_data_ = path.material_data_;
+		render_data.chromatic_ = path.chromatic_;
+		render_data.wavelength_ = path.wavelength_;
+		render_data.lights_geometry_material_emit_ = path.caustic_;
+	};
+	auto suspendPath = [&](PathState &path)
+	{
+		path.chromatic_ = render_data.chromatic_;
+		path.wavelength_ = render_data.wavelength_;
+	};
+
+	//the first path segment starts from the already initialized material of the camera hit
+	for(int i = 0; i < n_samples; ++i)
+	{
+		PathState &path = paths[i];
+		path.material_data_ = first_udat;
+		path.offs_ = n_paths_ * render_data.pixel_sample_ + i;
+		render_data.chromatic_ = was_chromatic;
+		if(was_chromatic) render_data.wavelength_ = sampleWavelength(path.offs_, render_data.sampling_offs_);
+		float s_1 = sampler_->sample(1, path.offs_, render_data.sampling_offs_);
+		float s_2 = sampler_->sample(2, path.offs_, render_data.sampling_offs_);
+		if(render_data.ray_division_ > 1)
+		{
+			s_1 = math::addMod1(s_1, render_data.dc_1_);
+			s_2 = math::addMod1(s_2, render_data.dc_2_);
+		}
+		Sample s(s_1, s_2, path_flags);
+		float w = 0.f;
+		path.ray_ = Ray();
+		RenderStats::add(RenderStats::BsdfSamples);
+		path.throughput_ = material->sample(render_data, sp, wo, path.ray_.dir_, s, w);
+		path.throughput_ *= w;
+		path.pwo_ = wo;
+		if(s.sampled_flags_ != BsdfFlags::None) path.pwo_ = -path.ray_.dir_; //See the same fix in integrate()
+		path.ray_.tmin_ = scene_->ray_min_dist_;
+		path.ray_.tmax_ = -1.0;
+		path.ray_.from_ = sp.p_;
+		path.caustic_ = false;
+		suspendPath(path);
+		active_paths.push_back(i);
+	}
+
+	const bool measure_costs = russian_roulette_type_ == RussianRouletteType::WeightWindow;
+	for(int depth = 0; depth < max_bounces_ && !active_paths.empty(); ++depth)
+	{
+		const std::chrono::steady_clock::time_point bounce_start = measure_costs ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+		const size_t bounce_paths = active_paths.size();
+		size_t num_active = 0;
+		if(depth > 0)
+		{
+			//Sampling phase: next direction of each active path
+			for(const int path_id : active_paths)
+			{
+				PathState &path = paths[path_id];
+				resumePath(path, path_id);
+				const int d_4 = 4 * depth;
+				Sample s(sampler_->sample(d_4 + 3, path.offs_, render_data.sampling_offs_), sampler_->sample(d_4 + 4, path.offs_, render_data.sampling_offs_), BsdfFlags::All);
+				float w = 0.f;
+				RenderStats::add(RenderStats::BsdfSamples);
+				Rgb scol = path.material_->sample(render_data, path.hit_, path.pwo_, path.ray_.dir_, s, w);
+				scol *= w;
+				suspendPath(path);
+				if(scol.isBlack()) continue;
+				path.throughput_ *= scol;
+				path.caustic_ = trace_caustics_ && s.sampled_flags_.hasAny(BsdfFlags::Specular | BsdfFlags::Glossy | BsdfFlags::Filter);
+				path.ray_.tmin_ = scene_->ray_min_dist_;
+				path.ray_.tmax_ = -1.0;
+				path.ray_.from_ = path.hit_.p_;
+				active_paths[num_active++] = path_id;
+			}
+			active_paths.resize(num_active);
+		}
+
+		//Intersection phase: the rays of all the active paths are traced together as one ray stream
+		wavefront_data.rays_.clear();
+		for(const int path_id : active_paths) wavefront_data.rays_.push_back(paths[path_id].ray_);
+		const std::vector<bool> hits = scene_->intersect(wavefront_data.rays_, wavefront_data.hits_);
+		num_active = 0;
+		for(size_t ray_id = 0; ray_id < active_paths.size(); ++ray_id)
+		{
+			const int path_id = active_paths[ray_id];
+			PathState &path = paths[path_id];
+			path.ray_ = wavefront_data.rays_[ray_id];
+			if(!hits[ray_id]) //hit background
+			{
+				const auto &background = scene_->getBackground();
+				if(depth > 0 && path.caustic_ && background && background->hasIbl() && background->shootsCaustic())
+				{
+					resumePath(path, path_id);
+					path_col += path.throughput_ * (*background)(path.ray_, render_data, true);
+					suspendPath(path);
+				}
+				continue;
+			}
+			path.hit_ = wavefront_data.hits_[ray_id];
+			path.material_ = path.hit_.material_;
+			active_paths[num_active++] = path_id;
+		}
+		active_paths.resize(num_active);
+
+		//Shading phase, grouped by material so consecutive paths run the same material code
+		groupByMaterial(active_paths, [&paths](int path_id) { return paths[path_id].material_; });
+		for(const int path_id : active_paths)
+		{
+			PathState &path = paths[path_id];
+			path.material_data_ = render_data.allocMaterialData(path.material_->getReqMem());
+			resumePath(path, path_id);
+			path.material_->initBsdf(render_data, path.hit_, path.bsdfs_);
+			if(depth > 0) path.pwo_ = -path.ray_.dir_;
+			suspendPath(path);
+		}
+
+		//Direct lighting phase, tracing the shadow rays of the light estimations
+		num_active = 0;
+		for(const int path_id : active_paths)
+		{
+			PathState &path = paths[path_id];
+			resumePath(path, path_id);
+			Rgb irradiance_col;
+			const bool ends_with_irradiance = depth > 0 && endsWithIrradiance(render_data, path.hit_, path.pwo_, path.bsdfs_, depth, irradiance_col);
+			Rgb lcol(0.f);
+			if(depth == 0 || path.bsdfs_.hasAny(BsdfFlags::Diffuse)) lcol = estimateOneDirectLight(render_data, path.hit_, path.pwo_, path.offs_, ends_with_irradiance);
+			if(depth > 0)
+			{
+				const VolumeHandler *vol;
+				if(path.bsdfs_.hasAny(BsdfFlags::Volumetric) && (vol = path.material_->getVolumeHandler(path.hit_.n_ * path.pwo_ < 0)))
+				{
+					Rgb vcol(0.f);
+					if(vol->transmittance(render_data, path.ray_, vcol)) path.throughput_ *= vcol;
+				}
+				// Russian roulette for terminating paths with low probability
+				if(depth > russian_roulette_min_bounces_)
+				{
+					const float random_value = prng();
+					const float probability = survivalProbability(path.throughput_, depth, render_data.thread_id_);
+					if(probability <= 0.f || probability < random_value)
+					{
+						suspendPath(path);
+						continue;
+					}
+					path.throughput_ *= 1.f / probability;
+				}
+			}
+			if(path.bsdfs_.hasAny(BsdfFlags::Emit) && (depth == 0 || path.caustic_))
+			{
+				const Rgb col_tmp = path.material_->emit(render_data, path.hit_, path.pwo_);
+				lcol += col_tmp;
+				if(layers_used)
+				{
+					if(ColorLayer *color_layer = color_layers->find(Layer::Emit)) color_layer->color_ += col_tmp;
+				}
+			}
+			if(ends_with_irradiance) lcol += irradiance_col;
+			path_col += lcol * path.throughput_;
+			suspendPath(path);
+			if(!ends_with_irradiance) active_paths[num_active++] = path_id;
+		}
+		active_paths.resize(num_active);
+		if(measure_costs) addBounceCost(depth, render_data.thread_id_, std::chrono::duration<float>(std::chrono::steady_clock::now() - bounce_start).count() / bounce_paths);
+	}
+	render_data.lights_geometry_material_emit_ = false;
+	render_data.material_data_ = first_udat;
+	return path_col;
+}
+
+bool PathIntegrator::endsWithIrradiance(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const BsdfFlags &bsdfs, int depth, Rgb &irradiance_col) const
+{
+	if(ibl_irradiance_depth_ <= 0 || depth < ibl_irradiance_depth_ || !isGuidable(bsdfs)) return false;
+	const Background *background = scene_->getBackground();
+	Rgb irradiance;
+	if(!background || !background->hasIbl() || !background->evalIrradiance((sp.n_ * wo < 0.f) ? -sp.n_ : sp.n_, irradiance)) return false;
+	irradiance_col = sp.material_->getReflectivity(render_data, sp, BsdfFlags::DiffuseReflect) * irradiance;
+	return true;
+}
+
 std::unique_ptr<Integrator> PathIntegrator::factory(ParamMap &params, const Scene &scene)
 {
 	bool transp_shad = false, no_rec = false;
@@ -404,6 +806,20 @@ std::unique_ptr<Integrator> PathIntegrator::factory(ParamMap &params, const Scen
 	bool bg_transp = false;
 	bool bg_transp_refract = false;
 	std::string photon_maps_processing_str = "generate";
+	std::string light_sampling_str = "uniform";
+	bool wavefront = false;
+	bool hero_wavelength = false;
+	std::string russian_roulette_type_str = "throughput";
+	float russian_roulette_weight_low = 0.1f;
+	int path_splitting_max = 1;
+	float path_splitting_weight = 0.5f;
+	bool path_guiding = false;
+	int path_guiding_training_passes = 4;
+	int ibl_irradiance_depth = 0;
+	float path_guiding_fraction = 0.5f;
+	SdTree::Parameters path_guiding_parameters;
+	int sss_max_points = 50000;
+	float sss_max_error = 0.3f;
 
 	params.getParam("raydepth", raydepth);
 	params.getParam("transpShad", transp_shad);
@@ -419,6 +835,23 @@ std::unique_ptr<Integrator> PathIntegrator::factory(ParamMap &params, const Scen
 	params.getParam("AO_distance", ao_dist);
 	params.getParam("AO_color", ao_col);
 	params.getParam("photon_maps_processing", photon_maps_processing_str);
+	params.getParam("sss_max_points", sss_max_points);
+	params.getParam("sss_max_error", sss_max_error);
+	params.getParam("light_sampling", light_sampling_str);
+	bool adaptive_light_samples = false;
+	params.getParam("adaptive_light_samples", adaptive_light_samples);
+	params.getParam("wavefront", wavefront);
+	params.getParam("hero_wavelength", hero_wavelength);
+	params.getParam("russian_roulette_type", russian_roulette_type_str);
+	params.getParam("russian_roulette_weight_low", russian_roulette_weight_low);
+	params.getParam("path_splitting_max", path_splitting_max);
+	params.getParam("path_splitting_weight", path_splitting_weight);
+	params.getParam("path_guiding", path_guiding);
+	params.getParam("path_guiding_training_passes", path_guiding_training_passes);
+	params.getParam("path_guiding_fraction", path_guiding_fraction);
+	params.getParam("path_guiding_spatial_threshold", path_guiding_parameters.spatial_threshold_);
+	params.getParam("path_guiding_directional_threshold", path_guiding_parameters.directional_threshold_);
+	params.getParam("ibl_irradiance_depth", ibl_irradiance_depth);
 
 	auto inte = std::unique_ptr<PathIntegrator>(new PathIntegrator(transp_shad, shadow_depth));
 	if(params.getParam("caustic_type", c_method))
@@ -431,14 +864,17 @@ std::unique_ptr<Integrator> PathIntegrator::factory(ParamMap &params, const Scen
 		{
 			double c_rad = 0.25;
 			int c_depth = 10, search = 100, photons = 500000;
+			bool c_projection = true;
 			params.getParam("photons", photons);
 			params.getParam("caustic_mix", search);
 			params.getParam("caustic_depth", c_depth);
 			params.getParam("caustic_radius", c_rad);
+			params.getParam("caustic_projection", c_projection);
 			inte->n_caus_photons_ = photons;
 			inte->n_caus_search_ = search;
 			inte->caus_depth_ = c_depth;
 			inte->caus_radius_ = c_rad;
+			inte->caustic_projection_ = c_projection;
 		}
 	}
 	inte->r_depth_ = raydepth;
@@ -447,9 +883,24 @@ std::unique_ptr<Integrator> PathIntegrator::factory(ParamMap &params, const Scen
 	inte->max_bounces_ = bounces;
 	inte->russian_roulette_min_bounces_ = russian_roulette_min_bounces;
 	inte->no_recursive_ = no_rec;
+	inte->wavefront_ = wavefront;
+	inte->hero_wavelength_ = hero_wavelength && !wavefront; //the wavefront mode keeps one wavelength per path yet
+	inte->russian_roulette_type_ = (russian_roulette_type_str == "weight_window") ? RussianRouletteType::WeightWindow : RussianRouletteType::Throughput;
+	inte->russian_roulette_weight_low_ = std::max(russian_roulette_weight_low, 1e-4f);
+	inte->path_splitting_max_ = wavefront ? 1 : std::max(1, path_splitting_max); //the wavefront mode does not split its paths yet
+	inte->path_splitting_weight_ = std::max(path_splitting_weight, 1e-4f);
+	inte->path_guiding_ = path_guiding && !wavefront; //the wavefront mode does not guide its paths yet
+	inte->path_guiding_training_passes_ = std::max(1, path_guiding_training_passes);
+	inte->path_guiding_fraction_ = std::max(0.f, std::min(path_guiding_fraction, 1.f));
+	inte->path_guiding_parameters_ = path_guiding_parameters;
+	inte->path_guiding_parameters_.spatial_threshold_ = std::max(1, inte->path_guiding_parameters_.spatial_threshold_);
+	inte->path_guiding_parameters_.directional_threshold_ = std::max(inte->path_guiding_parameters_.directional_threshold_, 1e-4f);
+	inte->ibl_irradiance_depth_ = std::max(0, ibl_irradiance_depth);
 	// Background settings
 	inte->transp_background_ = bg_transp;
 	inte->transp_refracted_background_ = bg_transp_refract;
+	inte->sss_max_points_ = std::max(1, sss_max_points);
+	inte->sss_max_error_ = std::max(0.f, sss_max_error);
 	// AO settings
 	inte->use_ambient_occlusion_ = do_ao;
 	inte->ao_samples_ = ao_samples;
@@ -461,6 +912,11 @@ std::unique_ptr<Integrator> PathIntegrator::factory(ParamMap &params, const Scen
 	else if(photon_maps_processing_str == "reuse-previous") inte->photon_map_processing_ = PhotonsReuse;
 	else inte->photon_map_processing_ = PhotonsGenerateOnly;
 
+	inte->adaptive_light_samples_ = adaptive_light_samples;
+	if(light_sampling_str == "power") inte->light_sampling_ = LightSampling::Power;
+	else if(light_sampling_str == "light_tree") inte->light_sampling_ = LightSampling::LightTree;
+	else inte->light_sampling_ = LightSampling::Uniform;
+
 	return inte;
 }
 
@@ -29,6 +29,7 @@
 #include "render/monitor.h"
 #include "sampler/halton.h"
 #include "sampler/sample.h"
+#include "math/random.h"
 #include "sampler/sample_pdf1d.h"
 #include "light/light.h"
 #include "material/material.h"
@@ -36,28 +37,62 @@
 #include "background/background.h"
 #include "render/imagefilm.h"
 #include "render/render_data.h"
+#include "photon/photon_maps_state.h"
+#include "geometry/object.h"
+#include <limits>
 
 BEGIN_YAFARAY
 
+//! sorts the radiance points along a Morton curve over their bounding box, so the chunks of consecutive points taken by the pre-gather workers are compact regions looking up the same photons
+static void sortRadPointsSpatially_global(std::vector<RadData> &rad_points)
+{
+	if(rad_points.size() < 2) return;
+	Point3 p_min = rad_points.front().pos_, p_max = rad_points.front().pos_;
+	for(const auto &rad_point : rad_points)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			p_min[axis] = std::min(p_min[axis], rad_point.pos_[axis]);
+			p_max[axis] = std::max(p_max[axis], rad_point.pos_[axis]);
+		}
+	}
+	constexpr int bits_per_axis = 10;
+	const auto morton_code = [&](const Point3 &p)
+	{
+		uint32_t code = 0;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			const float extent = p_max[axis] - p_min[axis];
+			const float normalized = extent > 0.f ? (p[axis] - p_min[axis]) / extent : 0.f;
+			const uint32_t cell = std::min(static_cast<uint32_t>(normalized * (1 << bits_per_axis)), static_cast<uint32_t>((1 << bits_per_axis) - 1));
+			for(int bit = 0; bit < bits_per_axis; ++bit) code |= ((cell >> bit) & 1) << (3 * bit + axis);
+		}
+		return code;
+	};
+	std::vector<std::pair<uint32_t, uint32_t>> codes(rad_points.size());
+	for(size_t i = 0; i < rad_points.size(); ++i) codes[i] = {morton_code(rad_points[i].pos_), static_cast<uint32_t>(i)};
+	std::sort(codes.begin(), codes.end());
+	std::vector<RadData> sorted;
+	sorted.reserve(rad_points.size());
+	for(const auto &code : codes) sorted.push_back(rad_points[code.second]);
+	rad_points.swap(sorted);
+}
+
 void PhotonIntegrator::preGatherWorker(PreGatherData *gdata, float ds_rad, int n_search)
 {
-	unsigned int start, end, total;
+	constexpr unsigned int chunk_size = 32;
+	const unsigned int total = gdata->rad_points_.size();
 	float ds_radius_2 = ds_rad * ds_rad;
 
-	gdata->mutx_.lock();
-	start = gdata->fetched_;
-	total = gdata->rad_points_.size();
-	end = gdata->fetched_ = std::min(total, start + 32);
-	gdata->mutx_.unlock();
-
 	auto gathered = std::unique_ptr<FoundPhoton[]>(new FoundPhoton[n_search]);
 
 	float radius = 0.f;
 	float i_scale = 1.f / ((float)gdata->diffuse_map_->nPaths() * M_PI);
 	float scale = 0.f;
 
-	while(start < total)
+	for(unsigned int start = gdata->fetched_.fetch_add(chunk_size); start < total; start = gdata->fetched_.fetch_add(chunk_size))
 	{
+		const unsigned int end = std::min(total, start + chunk_size);
 		for(unsigned int n = start; n < end; ++n)
 		{
 			radius = ds_radius_2;//actually the square radius...
@@ -82,11 +117,9 @@ void PhotonIntegrator::preGatherWorker(PreGatherData *gdata, float ds_rad, int n
 
 			gdata->radiance_vec_[n] = Photon(rnorm, gdata->rad_points_[n].pos_, sum);
 		}
-		gdata->mutx_.lock();
-		start = gdata->fetched_;
-		end = gdata->fetched_ = std::min(total, start + 32);
-		gdata->pbar_->update(32);
-		gdata->mutx_.unlock();
+		gdata->progress_steps_ += end - start;
+		std::unique_lock<std::mutex> progress_lock(gdata->progress_mutx_, std::try_to_lock);
+		if(progress_lock.owns_lock()) gdata->pbar_->update(gdata->progress_steps_.exchange(0));
 	}
 }
 
@@ -105,7 +138,7 @@ PhotonIntegrator::PhotonIntegrator(unsigned int d_photons, unsigned int c_photon
 	max_bounces_ = 5;
 }
 
-void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_diffuse_photons, const Pdf1D *light_power_d, int num_d_lights, const std::vector<const Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, bool final_gather, PreGatherData &pgdat)
+void PhotonIntegrator::diffuseWorker(std::vector<Photon> &diffuse_photons, std::vector<RadData> &rad_points, unsigned int &photons_shot, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_diffuse_photons, const Pdf1D *light_power_d, int num_d_lights, const std::vector<const Light *> &tmplights, PhotonShootingProgress &progress, int pb_step, int max_bounces, bool final_gather, const std::vector<unsigned int> *paths, std::vector<unsigned int> *photon_paths, std::vector<unsigned int> *rad_point_paths, uint64_t *path_objects)
 {
 	Ray ray;
 	float light_num_pdf, light_pdf, s_1, s_2, s_3, s_4, s_5, s_6, s_7, s_l;
@@ -117,27 +150,36 @@ void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, cons
 
 	SurfacePoint sp;
 	RenderData render_data;
-	alignas (16) unsigned char userdata[user_data_size_];
-	render_data.arena_ = static_cast<void *>(userdata);
 	render_data.cam_ = render_view->getCamera();
 
 	float f_num_lights = (float)num_d_lights;
 
-	unsigned int n_diffuse_photons_thread = 1 + ((n_diffuse_photons - 1) / scene->getNumThreadsPhotons());
-
-	std::vector<Photon> local_diffuse_photons;
-	std::vector<RadData> local_rad_points;
+	const unsigned int n_threads = scene->getNumThreadsPhotons();
+	unsigned int n_diffuse_photons_thread = 1 + ((n_diffuse_photons - 1) / n_threads);
+	unsigned int first_path = n_diffuse_photons_thread * thread_id;
+	if(paths) //only the given paths are shot, split among the threads
+	{
+		const unsigned int n_paths = paths->size();
+		const unsigned int n_paths_thread = (n_paths + n_threads - 1) / n_threads;
+		first_path = std::min(n_paths, n_paths_thread * thread_id);
+		n_diffuse_photons_thread = std::min(n_paths, first_path + n_paths_thread) - first_path;
+	}
 
-	local_diffuse_photons.clear();
-	local_diffuse_photons.reserve(n_diffuse_photons_thread);
-	local_rad_points.clear();
+	//Each thread stores its photons in its own chunk, merged into the photon map when all the threads have finished
+	diffuse_photons.clear();
+	diffuse_photons.reserve(n_diffuse_photons_thread);
+	rad_points.clear();
+	if(photon_paths) photon_paths->clear();
+	if(rad_point_paths) rad_point_paths->clear();
+	done = (n_diffuse_photons_thread == 0);
 
 	float inv_diff_photons = 1.f / (float)n_diffuse_photons;
 
 	while(!done)
 	{
-		unsigned int haltoncurr = curr + n_diffuse_photons_thread * thread_id;
+		unsigned int haltoncurr = paths ? (*paths)[first_path + curr] : first_path + curr;
 
+		render_data.arena_.reset(); //the material data is only needed while tracing each photon
 		s_1 = sample::riVdC(haltoncurr);
 		s_2 = Halton::lowDiscrepancySampling(2, haltoncurr);
 		s_3 = Halton::lowDiscrepancySampling(3, haltoncurr);
@@ -147,9 +189,7 @@ void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, cons
 		int light_num = light_power_d->dSample(s_l, &light_num_pdf);
 		if(light_num >= num_d_lights)
 		{
-			diffuse_map->mutx_.lock();
 			Y_ERROR << getName() << ": lightPDF sample error! " << s_l << "/" << light_num << YENDL;
-			diffuse_map->mutx_.unlock();
 			return;
 		}
 
@@ -160,6 +200,7 @@ void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, cons
 
 		if(pcol.isBlack())
 		{
+			if(path_objects) path_objects[haltoncurr] = 0;
 			++curr;
 			done = (curr >= n_diffuse_photons_thread);
 			continue;
@@ -170,14 +211,14 @@ void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, cons
 		bool direct_photon = true;
 		const Material *material = nullptr;
 		BsdfFlags bsdfs;
+		uint64_t objects = 0;
 
 		while(scene->intersect(ray, sp))
 		{
+			if(path_objects && sp.object_) objects |= PhotonMapsState::objectBit(sp.object_->getName());
 			if(std::isnan(pcol.r_) || std::isnan(pcol.g_) || std::isnan(pcol.b_))
 			{
-				diffuse_map->mutx_.lock();
 				Y_WARNING << getName() << ": NaN  on photon color for light" << light_num + 1 << "." << YENDL;
-				diffuse_map->mutx_.unlock();
 				continue;
 			}
 
@@ -195,6 +236,7 @@ void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, cons
 
 			Vec3 wi = -ray.dir_, wo;
 			material = sp.material_;
+			render_data.material_data_ = render_data.allocMaterialData(material->getReqMem());
 			material->initBsdf(render_data, sp, bsdfs);
 
 			if(bsdfs.hasAny(BsdfFlags::Diffuse))
@@ -203,17 +245,19 @@ void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, cons
 				if(!caustic_photon)
 				{
 					Photon np(wi, sp.p_, pcol);
-					local_diffuse_photons.push_back(np);
+					diffuse_photons.push_back(np);
+					if(photon_paths) photon_paths->push_back(haltoncurr);
 				}
 				// create entry for radiance photon:
 				// don't forget to choose subset only, face normal forward; geometric vs. smooth normal?
-				if(final_gather && FastRandom::getNextFloatNormalized() < 0.125 && !caustic_photon)
+				if(final_gather && CounterRandom::getFloat(haltoncurr, n_bounces, 0) < 0.125 && !caustic_photon)
 				{
 					Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wi);
 					RadData rd(sp.p_, n);
 					rd.refl_ = material->getReflectivity(render_data, sp, BsdfFlags::Diffuse | BsdfFlags::Glossy | BsdfFlags::Reflect);
 					rd.transm_ = material->getReflectivity(render_data, sp, BsdfFlags::Diffuse | BsdfFlags::Glossy | BsdfFlags::Transmit);
-					local_rad_points.push_back(rd);
+					rad_points.push_back(rd);
+					if(rad_point_paths) rad_point_paths->push_back(haltoncurr);
 				}
 			}
 			// need to break in the middle otherwise we scatter the photon and then discard it => redundant
@@ -242,24 +286,16 @@ void PhotonIntegrator::diffuseWorker(PhotonMap *diffuse_map, int thread_id, cons
 			ray.tmax_ = -1.0;
 			++n_bounces;
 		}
+		if(path_objects) path_objects[haltoncurr] = objects;
 		++curr;
 		if(curr % pb_step == 0)
 		{
-			pb->mutx_.lock();
-			pb->update();
-			pb->mutx_.unlock();
-			if(render_control.aborted()) { return; }
+			progress.addStep();
+			if(render_control.aborted()) { photons_shot = curr; return; }
 		}
 		done = (curr >= n_diffuse_photons_thread);
 	}
-	diffuse_map->mutx_.lock();
-	diffuse_map->appendVector(local_diffuse_photons, curr);
-	total_photons_shot += curr;
-	diffuse_map->mutx_.unlock();
-
-	pgdat.mutx_.lock();
-	pgdat.rad_points_.insert(std::end(pgdat.rad_points_), std::begin(local_rad_points), std::end(local_rad_points));
-	pgdat.mutx_.unlock();
+	photons_shot = curr;
 }
 
 void PhotonIntegrator::photonMapKdTreeWorker(PhotonMap *photon_map)
@@ -267,18 +303,106 @@ void PhotonIntegrator::photonMapKdTreeWorker(PhotonMap *photon_map)
 	photon_map->updateTree();
 }
 
+bool PhotonIntegrator::findChangedPaths(std::vector<unsigned int> &diffuse_paths, std::vector<unsigned int> &caustic_paths) const
+{
+	PhotonMapsState &state = *scene_->getSession().photon_maps_state_;
+	std::vector<const Light *> diffuse_lights, caustic_lights;
+	for(const auto &light : lights_)
+	{
+		if(light->shootsDiffuseP()) diffuse_lights.push_back(light);
+		if(light->shootsCausticP()) caustic_lights.push_back(light);
+	}
+
+	//The light energies choose the light of each path, so when they change all the paths are different
+	uint64_t settings = 0;
+	for(const uint64_t value : { uint64_t(n_diffuse_photons_), uint64_t(n_caus_photons_), uint64_t(max_bounces_), uint64_t(caus_depth_), uint64_t(use_photon_diffuse_), uint64_t(use_photon_caustics_), uint64_t(final_gather_), uint64_t(diffuse_lights.size()), uint64_t(caustic_lights.size()) }) settings = PhotonMapsState::hashCombine(settings, value);
+	for(const auto &lights : { &diffuse_lights, &caustic_lights })
+	{
+		for(const auto &light : *lights)
+		{
+			const Rgb energy = light->totalEnergy();
+			for(const float value : { energy.r_, energy.g_, energy.b_ }) settings = PhotonMapsState::hashCombine(settings, value);
+		}
+	}
+	//The caustic photons are shot towards the caustic objects, so when they move all the caustic paths are different
+	for(const auto &target : caustic_targets_)
+	{
+		for(const float value : { target.center_.x_, target.center_.y_, target.center_.z_, target.radius_ }) settings = PhotonMapsState::hashCombine(settings, value);
+	}
+	std::vector<uint64_t> diffuse_signatures, caustic_signatures;
+	for(const auto &light : diffuse_lights) diffuse_signatures.push_back(PhotonMapsState::lightSignature(*light));
+	for(const auto &light : caustic_lights) caustic_signatures.push_back(PhotonMapsState::lightSignature(*light));
+	std::map<std::string, uint64_t> object_signatures = PhotonMapsState::objectSignatures(*scene_);
+
+	const PhotonMap *diffuse_map = scene_->getSession().diffuse_map_.get();
+	const PhotonMap *caustic_map = scene_->getSession().caustic_map_.get();
+	bool incremental = state.valid_ && state.settings_ == settings;
+	if(use_photon_diffuse_) incremental = incremental && diffuse_map->hasPathTags() && scene_->getSession().diffuse_map_->getPathObjects().size() == n_diffuse_photons_;
+	if(use_photon_caustics_) incremental = incremental && caustic_map->hasPathTags() && scene_->getSession().caustic_map_->getPathObjects().size() == n_caus_photons_;
+
+	if(incremental)
+	{
+		uint64_t changed_objects = 0;
+		for(const auto &object : object_signatures)
+		{
+			auto old_object = state.objects_.find(object.first);
+			if(old_object == state.objects_.end() || old_object->second != object.second) changed_objects |= PhotonMapsState::objectBit(object.first);
+		}
+		for(const auto &old_object : state.objects_)
+		{
+			if(object_signatures.find(old_object.first) == object_signatures.end()) changed_objects |= PhotonMapsState::objectBit(old_object.first);
+		}
+
+		auto find_paths = [this, changed_objects](const std::vector<const Light *> &lights, const std::vector<uint64_t> &signatures, const std::vector<uint64_t> &old_signatures, const std::vector<uint64_t> &path_objects, bool diffuse, std::vector<unsigned int> &paths)
+		{
+			std::vector<float> energies;
+			for(const auto &light : lights) energies.push_back(light->totalEnergy().energy() * (diffuse ? 1.f : causticEmissionFraction(*light)));
+			const Pdf1D light_power_d(energies.data(), energies.size());
+			const unsigned int n_paths = path_objects.size();
+			const float inv_paths = 1.f / (float)n_paths;
+			for(unsigned int path = 0; path < n_paths; ++path)
+			{
+				float light_num_pdf;
+				//The same light number as the one chosen by the photon workers
+				const float s_l = diffuse ? float(path) * inv_paths : float(path) / float(n_paths);
+				const int light_num = light_power_d.dSample(s_l, &light_num_pdf);
+				if((path_objects[path] & changed_objects) || light_num >= (int)lights.size() || signatures[light_num] != old_signatures[light_num]) paths.push_back(path);
+			}
+		};
+		if(use_photon_diffuse_ && !diffuse_lights.empty()) find_paths(diffuse_lights, diffuse_signatures, state.diffuse_lights_, scene_->getSession().diffuse_map_->getPathObjects(), true, diffuse_paths);
+		if(use_photon_caustics_ && !caustic_lights.empty()) find_paths(caustic_lights, caustic_signatures, state.caustic_lights_, scene_->getSession().caustic_map_->getPathObjects(), false, caustic_paths);
+	}
+
+	state.settings_ = settings;
+	state.diffuse_lights_.swap(diffuse_signatures);
+	state.caustic_lights_.swap(caustic_signatures);
+	state.objects_.swap(object_signatures);
+	return incremental;
+}
+
 bool PhotonIntegrator::preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *image_film)
 {
 	image_film_ = image_film;
+	setupCheckpointPhotonMaps(render_view);
 	std::shared_ptr<ProgressBar> pb;
 	if(intpb_) pb = intpb_;
 	else pb = std::make_shared<ConsoleProgressBar>(80);
 
 	lookup_rad_ = 4 * ds_radius_ * ds_radius_;
 
+	irradiance_cache_.reset();
+	if(final_gather_ && use_irradiance_cache_)
+	{
+		const Bound scene_bound = scene_->getSceneBound();
+		const float scene_size = (scene_bound.g_ - scene_bound.a_).length();
+		irradiance_cache_min_radius_ = 0.001f * scene_size;
+		irradiance_cache_max_radius_ = 0.1f * scene_size;
+		irradiance_cache_ = std::unique_ptr<IrradianceCache>(new IrradianceCache(scene_bound, irradiance_cache_accuracy_));
+	}
+
 	std::stringstream set;
-	g_timer_global.addEvent("prepass");
-	g_timer_global.start("prepass");
+	scene_->getRenderControl().getTimer().addEvent("prepass");
+	scene_->getRenderControl().getTimer().start("prepass");
 
 	Y_INFO << getName() << ": Starting preprocess..." << YENDL;
 
@@ -291,6 +415,7 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 	set << "RayDepth=" << r_depth_ << "  ";
 
 	lights_ = render_view->getLightsVisible();
+	setupLightSampling(render_view);
 	std::vector<const Light *> tmplights;
 
 	if(use_photon_caustics_)
@@ -306,6 +431,7 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 	if(final_gather_)
 	{
 		set << " FG paths=" << n_paths_ << " bounces=" << gather_bounces_ << "  ";
+		if(use_irradiance_cache_) set << "irradiance cache accuracy=" << irradiance_cache_accuracy_ << " samples=" << irradiance_cache_samples_ << "  ";
 	}
 
 	if(photon_map_processing_ == PhotonsLoad)
@@ -317,9 +443,9 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 		if(use_photon_caustics_)
 		{
 			pb->setTag("Loading caustic photon map from file...");
-			const std::string filename = scene_->getImageFilm()->getFilmSavePath() + "_caustic.photonmap";
+			const std::string filename = getPhotonMapPath("caustic");
 			Y_INFO << getName() << ": Loading caustic photon map from: " << filename << ". If it does not match the scene you could have crashes and/or incorrect renders, USE WITH CARE!" << YENDL;
-			if(session_global.caustic_map_.get()->load(filename))
+			if(scene_->getSession().caustic_map_.get()->load(filename))
 			{
 				if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Caustic map loaded." << YENDL;
 			}
@@ -329,9 +455,9 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 		if(use_photon_diffuse_)
 		{
 			pb->setTag("Loading diffuse photon map from file...");
-			const std::string filename = scene_->getImageFilm()->getFilmSavePath() + "_diffuse.photonmap";
+			const std::string filename = getPhotonMapPath("diffuse");
 			Y_INFO << getName() << ": Loading diffuse photon map from: " << filename << ". If it does not match the scene you could have crashes and/or incorrect renders, USE WITH CARE!" << YENDL;
-			if(session_global.diffuse_map_.get()->load(filename))
+			if(scene_->getSession().diffuse_map_.get()->load(filename))
 			{
 				if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Diffuse map loaded." << YENDL;
 			}
@@ -341,9 +467,9 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 		if(use_photon_diffuse_ && final_gather_)
 		{
 			pb->setTag("Loading FG radiance photon map from file...");
-			const std::string filename = scene_->getImageFilm()->getFilmSavePath() + "_fg_radiance.photonmap";
+			const std::string filename = getPhotonMapPath("fg_radiance");
 			Y_INFO << getName() << ": Loading FG radiance photon map from: " << filename << ". If it does not match the scene you could have crashes and/or incorrect renders, USE WITH CARE!" << YENDL;
-			if(session_global.radiance_map_.get()->load(filename))
+			if(scene_->getSession().radiance_map_.get()->load(filename))
 			{
 				if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": FG radiance map loaded." << YENDL;
 			}
@@ -357,12 +483,33 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 		}
 	}
 
+	const int n_threads_photons = scene_->getNumThreadsPhotons();
+	//rounding the number of photons so it's a number divisible by the number of threads (distribute uniformly among the threads). At least 1 photon per thread
+	n_diffuse_photons_ = std::max((unsigned int) n_threads_photons, (n_diffuse_photons_ / n_threads_photons) * n_threads_photons);
+	n_caus_photons_ = std::max((unsigned int) n_threads_photons, (n_caus_photons_ / n_threads_photons) * n_threads_photons);
+
+	if(use_photon_caustics_) createCausticTargets();
+	PhotonMapsState &maps_state = *scene_->getSession().photon_maps_state_;
+	std::vector<unsigned int> diffuse_paths, caustic_paths;
+	bool update_maps = false;
+	if(photon_map_processing_ == PhotonsUpdate)
+	{
+		update_maps = findChangedPaths(diffuse_paths, caustic_paths);
+		if(update_maps && diffuse_paths.empty() && caustic_paths.empty())
+		{
+			Y_INFO << getName() << ": The scene changes do not affect the photon maps, reusing them from memory." << YENDL;
+			photon_map_processing_ = PhotonsReuse;
+		}
+		else if(update_maps) Y_INFO << getName() << ": Updating the photon maps in memory, shooting again " << diffuse_paths.size() << " diffuse and " << caustic_paths.size() << " caustic photon paths." << YENDL;
+		else Y_INFO << getName() << ": The photon maps in memory cannot be updated for this scene, generating them again." << YENDL;
+	}
+
 	if(photon_map_processing_ == PhotonsReuse)
 	{
 		if(use_photon_caustics_)
 		{
 			Y_INFO << getName() << ": Reusing caustics photon map from memory. If it does not match the scene you could have crashes and/or incorrect renders, USE WITH CARE!" << YENDL;
-			if(session_global.caustic_map_.get()->nPhotons() == 0)
+			if(scene_->getSession().caustic_map_.get()->nPhotons() == 0)
 			{
 				Y_WARNING << getName() << ": Caustic photon map enabled but empty, cannot be reused: changing to Generate mode." << YENDL;
 				photon_map_processing_ = PhotonsGenerateOnly;
@@ -372,7 +519,7 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 		if(use_photon_diffuse_)
 		{
 			Y_INFO << getName() << ": Reusing diffuse photon map from memory. If it does not match the scene you could have crashes and/or incorrect renders, USE WITH CARE!" << YENDL;
-			if(session_global.diffuse_map_.get()->nPhotons() == 0)
+			if(scene_->getSession().diffuse_map_.get()->nPhotons() == 0)
 			{
 				Y_WARNING << getName() << ": Diffuse photon map enabled but empty, cannot be reused: changing to Generate mode." << YENDL;
 				photon_map_processing_ = PhotonsGenerateOnly;
@@ -382,7 +529,7 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 		if(final_gather_)
 		{
 			Y_INFO << getName() << ": Reusing FG radiance photon map from memory. If it does not match the scene you could have crashes and/or incorrect renders, USE WITH CARE!" << YENDL;
-			if(session_global.radiance_map_.get()->nPhotons() == 0)
+			if(scene_->getSession().radiance_map_.get()->nPhotons() == 0)
 			{
 				Y_WARNING << getName() << ": FG radiance photon map enabled but empty, cannot be reused: changing to Generate mode." << YENDL;
 				photon_map_processing_ = PhotonsGenerateOnly;
@@ -398,14 +545,15 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 	{
 		set << " (reusing photon maps from memory)";
 	}
+	else if(photon_map_processing_ == PhotonsUpdate) set << " (updating photon maps in memory)";
 	else if(photon_map_processing_ == PhotonsGenerateAndSave) set << " (saving photon maps to file)";
 
 	if(photon_map_processing_ == PhotonsLoad || photon_map_processing_ == PhotonsReuse)
 	{
-		g_timer_global.stop("prepass");
-		Y_INFO << getName() << ": Photonmap building time: " << std::fixed << std::setprecision(1) << g_timer_global.getTime("prepass") << "s" << YENDL;
+		scene_->getRenderControl().getTimer().stop("prepass");
+		Y_INFO << getName() << ": Photonmap building time: " << std::fixed << std::setprecision(1) << scene_->getRenderControl().getTimer().getTime("prepass") << "s" << YENDL;
 
-		set << " [" << std::fixed << std::setprecision(1) << g_timer_global.getTime("prepass") << "s" << "]";
+		set << " [" << std::fixed << std::setprecision(1) << scene_->getRenderControl().getTimer().getTime("prepass") << "s" << "]";
 
 		render_info_ += set.str();
 
@@ -416,19 +564,58 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 		return true;
 	}
 
-	session_global.diffuse_map_.get()->clear();
-	session_global.diffuse_map_.get()->setNumPaths(0);
-	session_global.diffuse_map_.get()->reserveMemory(n_diffuse_photons_);
-	session_global.diffuse_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+	//The state only matches the maps again once they have been completely shot
+	maps_state.valid_ = false;
+	const bool track_paths = (photon_map_processing_ == PhotonsUpdate);
 
-	session_global.caustic_map_.get()->clear();
-	session_global.caustic_map_.get()->setNumPaths(0);
-	session_global.caustic_map_.get()->reserveMemory(n_caus_photons_);
-	session_global.caustic_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+	if(update_maps)
+	{
+		//Only the photons and radiance points of the paths shot again are removed
+		std::vector<bool> removed(n_diffuse_photons_, false);
+		for(const auto &path : diffuse_paths) removed[path] = true;
+		scene_->getSession().diffuse_map_.get()->removePaths(removed);
+		size_t kept = 0;
+		for(size_t i = 0; i < maps_state.rad_points_.size(); ++i)
+		{
+			if(removed[maps_state.rad_point_paths_[i]]) continue;
+			maps_state.rad_points_[kept] = maps_state.rad_points_[i];
+			maps_state.rad_point_paths_[kept] = maps_state.rad_point_paths_[i];
+			++kept;
+		}
+		maps_state.rad_points_.erase(maps_state.rad_points_.begin() + kept, maps_state.rad_points_.end());
+		maps_state.rad_point_paths_.resize(kept);
 
-	session_global.radiance_map_.get()->clear();
-	session_global.radiance_map_.get()->setNumPaths(0);
-	session_global.radiance_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+		removed.assign(n_caus_photons_, false);
+		for(const auto &path : caustic_paths) removed[path] = true;
+		scene_->getSession().caustic_map_.get()->removePaths(removed);
+	}
+	else
+	{
+		scene_->getSession().diffuse_map_.get()->clear();
+		scene_->getSession().diffuse_map_.get()->setNumPaths(0);
+		scene_->getSession().diffuse_map_.get()->reserveMemory(n_diffuse_photons_);
+
+		scene_->getSession().caustic_map_.get()->clear();
+		scene_->getSession().caustic_map_.get()->setNumPaths(0);
+		scene_->getSession().caustic_map_.get()->reserveMemory(n_caus_photons_);
+
+		maps_state.rad_points_.clear();
+		maps_state.rad_point_paths_.clear();
+		if(track_paths)
+		{
+			scene_->getSession().diffuse_map_.get()->getPathObjects().assign(n_diffuse_photons_, 0);
+			scene_->getSession().caustic_map_.get()->getPathObjects().assign(n_caus_photons_, 0);
+		}
+	}
+	scene_->getSession().diffuse_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+	scene_->getSession().diffuse_map_.get()->setHugePagesMode(scene_->getHugePagesMode());
+	scene_->getSession().caustic_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+	scene_->getSession().caustic_map_.get()->setHugePagesMode(scene_->getHugePagesMode());
+
+	scene_->getSession().radiance_map_.get()->clear();
+	scene_->getSession().radiance_map_.get()->setNumPaths(0);
+	scene_->getSession().radiance_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+	scene_->getSession().radiance_map_.get()->setHugePagesMode(scene_->getHugePagesMode());
 
 	Ray ray;
 	float light_num_pdf, light_pdf;
@@ -441,10 +628,8 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 	//shoot photons
 	unsigned int curr = 0;
 	// for radiance map:
-	PreGatherData pgdat(session_global.diffuse_map_.get());
+	PreGatherData pgdat(scene_->getSession().diffuse_map_.get());
 	RenderData render_data;
-	alignas (16) unsigned char userdata[user_data_size_];
-	render_data.arena_ = static_cast<void *>(userdata);
 	render_data.cam_ = render_view->getCamera();
 	int pb_step;
 
@@ -495,13 +680,30 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 
 		int n_threads = scene_->getNumThreadsPhotons();
 
-		n_diffuse_photons_ = std::max((unsigned int) n_threads, (n_diffuse_photons_ / n_threads) * n_threads); //rounding the number of diffuse photons so it's a number divisible by the number of threads (distribute uniformly among the threads). At least 1 photon per thread
-
 		Y_PARAMS << getName() << ": Shooting " << n_diffuse_photons_ << " photons across " << n_threads << " threads (" << (n_diffuse_photons_ / n_threads) << " photons/thread)" << YENDL;
 
 		std::vector<std::thread> threads;
-		for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&PhotonIntegrator::diffuseWorker, this, session_global.diffuse_map_.get(), i, scene_, render_view, std::ref(render_control), n_diffuse_photons_, light_power_d_.get(), num_d_lights, tmplights, pb.get(), pb_step, std::ref(curr), max_bounces_, final_gather_, std::ref(pgdat)));
+		std::vector<std::vector<Photon>> diffuse_photon_chunks(n_threads);
+		std::vector<std::vector<RadData>> rad_point_chunks(n_threads);
+		std::vector<std::vector<unsigned int>> diffuse_path_chunks(n_threads), rad_point_path_chunks(n_threads);
+		std::vector<unsigned int> photons_shot(n_threads, 0);
+		uint64_t *path_objects = track_paths ? scene_->getSession().diffuse_map_.get()->getPathObjects().data() : nullptr;
+		PhotonShootingProgress progress(pb.get());
+		for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&PhotonIntegrator::diffuseWorker, this, std::ref(diffuse_photon_chunks[i]), std::ref(rad_point_chunks[i]), std::ref(photons_shot[i]), i, scene_, render_view, std::ref(render_control), n_diffuse_photons_, light_power_d_.get(), num_d_lights, tmplights, std::ref(progress), pb_step, max_bounces_, final_gather_, update_maps ? &diffuse_paths : nullptr, track_paths ? &diffuse_path_chunks[i] : nullptr, track_paths ? &rad_point_path_chunks[i] : nullptr, path_objects));
 		for(auto &t : threads) t.join();
+		progress.flush();
+
+		for(const auto &shot : photons_shot) curr += shot;
+		//When updating, the paths shot again were already counted
+		scene_->getSession().diffuse_map_.get()->appendChunks(diffuse_photon_chunks, update_maps ? 0 : curr, track_paths ? &diffuse_path_chunks : nullptr);
+		if(update_maps) pgdat.rad_points_ = maps_state.rad_points_;
+		for(const auto &chunk : rad_point_chunks) pgdat.rad_points_.insert(std::end(pgdat.rad_points_), std::begin(chunk), std::end(chunk));
+		if(track_paths)
+		{
+			//Kept before removing the radiance points too close to each other, which depends on all of them
+			maps_state.rad_points_ = pgdat.rad_points_;
+			for(const auto &chunk : rad_point_path_chunks) maps_state.rad_point_paths_.insert(std::end(maps_state.rad_point_paths_), std::begin(chunk), std::end(chunk));
+		}
 
 		pb->done();
 		pb->setTag("Diffuse photon map built.");
@@ -510,13 +712,13 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 
 		tmplights.clear();
 
-		if(session_global.diffuse_map_.get()->nPhotons() < 50)
+		if(scene_->getSession().diffuse_map_.get()->nPhotons() < 50)
 		{
 			Y_ERROR << getName() << ": Too few diffuse photons, stopping now." << YENDL;
 			return false;
 		}
 
-		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Stored diffuse photons: " << session_global.diffuse_map_.get()->nPhotons() << YENDL;
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Stored diffuse photons: " << scene_->getSession().diffuse_map_.get()->nPhotons() << YENDL;
 	}
 	else
 	{
@@ -525,20 +727,20 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 
 	std::thread diffuse_map_build_kd_tree_thread;
 
-	if(use_photon_diffuse_ && session_global.diffuse_map_.get()->nPhotons() > 0 && scene_->getNumThreadsPhotons() >= 2)
+	if(use_photon_diffuse_ && scene_->getSession().diffuse_map_.get()->nPhotons() > 0 && scene_->getNumThreadsPhotons() >= 2)
 	{
 		Y_INFO << getName() << ": Building diffuse photons kd-tree:" << YENDL;
 		pb->setTag("Building diffuse photons kd-tree...");
 
-		diffuse_map_build_kd_tree_thread = std::thread(&PhotonIntegrator::photonMapKdTreeWorker, this, session_global.diffuse_map_.get());
+		diffuse_map_build_kd_tree_thread = std::thread(&PhotonIntegrator::photonMapKdTreeWorker, this, scene_->getSession().diffuse_map_.get());
 	}
 	else
 
-		if(use_photon_diffuse_ && session_global.diffuse_map_.get()->nPhotons() > 0)
+		if(use_photon_diffuse_ && scene_->getSession().diffuse_map_.get()->nPhotons() > 0)
 		{
 			Y_INFO << getName() << ": Building diffuse photons kd-tree:" << YENDL;
 			pb->setTag("Building diffuse photons kd-tree...");
-			session_global.diffuse_map_.get()->updateTree();
+			scene_->getSession().diffuse_map_.get()->updateTree();
 			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Done." << YENDL;
 		}
 
@@ -564,14 +766,19 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 		f_num_lights = (float)num_c_lights;
 		energies = std::unique_ptr<float[]>(new float[num_c_lights]);
 
-		for(int i = 0; i < num_c_lights; ++i) energies[i] = tmplights[i]->totalEnergy().energy();
+		if(caustic_projection_ && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Shooting the caustic photons towards " << caustic_targets_.size() << " object(s) with specular, glossy or dispersive materials" << YENDL;
+		//With the projection map the lights are chosen by the power they send towards the caustic objects
+		for(int i = 0; i < num_c_lights; ++i) energies[i] = tmplights[i]->totalEnergy().energy() * causticEmissionFraction(*tmplights[i]);
+		bool no_energy = true;
+		for(int i = 0; i < num_c_lights; ++i) if(energies[i] > 0.f) no_energy = false;
+		if(no_energy) for(int i = 0; i < num_c_lights; ++i) energies[i] = tmplights[i]->totalEnergy().energy();
 
 		light_power_d_ = std::unique_ptr<Pdf1D>(new Pdf1D(energies.get(), num_c_lights));
 
 		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Light(s) photon color testing for caustics map:" << YENDL;
 		for(int i = 0; i < num_c_lights; ++i)
 		{
-			pcol = tmplights[i]->emitPhoton(.5, .5, .5, .5, ray, light_pdf);
+			pcol = caustic_targets_.empty() ? tmplights[i]->emitPhoton(.5, .5, .5, .5, ray, light_pdf) : tmplights[i]->emitPhotonTowards(caustic_targets_, .5, .5, .5, .5, ray, light_pdf);
 			light_num_pdf = light_power_d_->func_[i] * light_power_d_->inv_integral_;
 			pcol *= f_num_lights * light_pdf / light_num_pdf; //remember that lightPdf is the inverse of the pdf, hence *=...
 			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Light [" << i + 1 << "] Photon col:" << pcol << " | lnpdf: " << light_num_pdf << YENDL;
@@ -585,18 +792,25 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 
 		int n_threads = scene_->getNumThreadsPhotons();
 
-		n_caus_photons_ = std::max((unsigned int) n_threads, (n_caus_photons_ / n_threads) * n_threads); //rounding the number of diffuse photons so it's a number divisible by the number of threads (distribute uniformly among the threads). At least 1 photon per thread
-
 		Y_PARAMS << getName() << ": Shooting " << n_caus_photons_ << " photons across " << n_threads << " threads (" << (n_caus_photons_ / n_threads) << " photons/thread)" << YENDL;
 
 		std::vector<std::thread> threads;
-		for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&PhotonIntegrator::causticWorker, this, session_global.caustic_map_.get(), i, scene_, render_view, std::ref(render_control), n_caus_photons_, light_power_d_.get(), num_c_lights, tmplights, caus_depth_, pb.get(), pb_step, std::ref(curr)));
+		std::vector<std::vector<Photon>> caustic_photon_chunks(n_threads);
+		std::vector<std::vector<unsigned int>> caustic_path_chunks(n_threads);
+		std::vector<unsigned int> photons_shot(n_threads, 0);
+		uint64_t *path_objects = track_paths ? scene_->getSession().caustic_map_.get()->getPathObjects().data() : nullptr;
+		PhotonShootingProgress progress(pb.get());
+		for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&PhotonIntegrator::causticWorker, this, std::ref(caustic_photon_chunks[i]), std::ref(photons_shot[i]), i, scene_, render_view, std::ref(render_control), n_caus_photons_, light_power_d_.get(), num_c_lights, tmplights, caus_depth_, std::ref(progress), pb_step, update_maps ? &caustic_paths : nullptr, track_paths ? &caustic_path_chunks[i] : nullptr, path_objects));
 		for(auto &t : threads) t.join();
+		progress.flush();
+
+		for(const auto &shot : photons_shot) curr += shot;
+		scene_->getSession().caustic_map_.get()->appendChunks(caustic_photon_chunks, update_maps ? 0 : curr, track_paths ? &caustic_path_chunks : nullptr);
 
 		pb->done();
 		pb->setTag("Caustics photon map built.");
 		Y_INFO << getName() << ": Shot " << curr << " caustic photons from " << num_c_lights << " light(s)." << YENDL;
-		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Stored caustic photons: " << session_global.caustic_map_.get()->nPhotons() << YENDL;
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Stored caustic photons: " << scene_->getSession().caustic_map_.get()->nPhotons() << YENDL;
 	}
 	else
 	{
@@ -607,25 +821,25 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 
 	std::thread caustic_map_build_kd_tree_thread;
 
-	if(use_photon_caustics_ && session_global.caustic_map_.get()->nPhotons() > 0 && scene_->getNumThreadsPhotons() >= 2)
+	if(use_photon_caustics_ && scene_->getSession().caustic_map_.get()->nPhotons() > 0 && scene_->getNumThreadsPhotons() >= 2)
 	{
 		Y_INFO << getName() << ": Building caustic photons kd-tree:" << YENDL;
 		pb->setTag("Building caustic photons kd-tree...");
 
-		caustic_map_build_kd_tree_thread = std::thread(&PhotonIntegrator::photonMapKdTreeWorker, this, session_global.caustic_map_.get());
+		caustic_map_build_kd_tree_thread = std::thread(&PhotonIntegrator::photonMapKdTreeWorker, this, scene_->getSession().caustic_map_.get());
 	}
 	else
 	{
-		if(use_photon_caustics_ && session_global.caustic_map_.get()->nPhotons() > 0)
+		if(use_photon_caustics_ && scene_->getSession().caustic_map_.get()->nPhotons() > 0)
 		{
 			Y_INFO << getName() << ": Building caustic photons kd-tree:" << YENDL;
 			pb->setTag("Building caustic photons kd-tree...");
-			session_global.caustic_map_.get()->updateTree();
+			scene_->getSession().caustic_map_.get()->updateTree();
 			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Done." << YENDL;
 		}
 	}
 
-	if(use_photon_diffuse_ && session_global.diffuse_map_.get()->nPhotons() > 0 && scene_->getNumThreadsPhotons() >= 2)
+	if(use_photon_diffuse_ && scene_->getSession().diffuse_map_.get()->nPhotons() > 0 && scene_->getNumThreadsPhotons() >= 2)
 	{
 		diffuse_map_build_kd_tree_thread.join();
 		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Diffuse photon map: done." << YENDL;
@@ -634,7 +848,7 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 	if(use_photon_diffuse_ && final_gather_) //create radiance map:
 	{
 		// == remove too close radiance points ==//
-		auto r_tree = std::unique_ptr<kdtree::PointKdTree<RadData>>(new kdtree::PointKdTree<RadData>(pgdat.rad_points_, "FG Radiance Photon Map", scene_->getNumThreadsPhotons()));
+		auto r_tree = std::unique_ptr<kdtree::PointKdTree<RadData>>(new kdtree::PointKdTree<RadData>(pgdat.rad_points_, "FG Radiance Photon Map", scene_->getNumThreadsPhotons(), scene_->getHugePagesMode()));
 		std::vector< RadData > cleaned;
 		for(unsigned int i = 0; i < pgdat.rad_points_.size(); ++i)
 		{
@@ -647,6 +861,7 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 			}
 		}
 		pgdat.rad_points_.swap(cleaned);
+		sortRadPointsSpatially_global(pgdat.rad_points_);
 		// ================ //
 		int n_threads = scene_->getNumThreads();
 		pgdat.radiance_vec_.resize(pgdat.rad_points_.size());
@@ -658,16 +873,17 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 		std::vector<std::thread> threads;
 		for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&PhotonIntegrator::preGatherWorker, this, &pgdat, ds_radius_, n_diffuse_search_));
 		for(auto &t : threads) t.join();
+		pgdat.pbar_->update(pgdat.progress_steps_.exchange(0));
 
-		session_global.radiance_map_.get()->swapVector(pgdat.radiance_vec_);
+		scene_->getSession().radiance_map_.get()->swapVector(pgdat.radiance_vec_);
 		pgdat.pbar_->done();
 		pgdat.pbar_->setTag("Pregathering radiance data done...");
 		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Radiance tree built... Updating the tree..." << YENDL;
-		session_global.radiance_map_.get()->updateTree();
+		scene_->getSession().radiance_map_.get()->updateTree();
 		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Done." << YENDL;
 	}
 
-	if(use_photon_caustics_ && session_global.caustic_map_.get()->nPhotons() > 0 && scene_->getNumThreadsPhotons() >= 2)
+	if(use_photon_caustics_ && scene_->getSession().caustic_map_.get()->nPhotons() > 0 && scene_->getNumThreadsPhotons() >= 2)
 	{
 		caustic_map_build_kd_tree_thread.join();
 		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Caustic photon map: done." << YENDL;
@@ -678,32 +894,34 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 		if(use_photon_diffuse_)
 		{
 			pb->setTag("Saving diffuse photon map to file...");
-			const std::string filename = scene_->getImageFilm()->getFilmSavePath() + "_diffuse.photonmap";
+			const std::string filename = getPhotonMapPath("diffuse");
 			Y_INFO << getName() << ": Saving diffuse photon map to: " << filename << YENDL;
-			if(session_global.diffuse_map_.get()->save(filename) && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Diffuse map saved." << YENDL;
+			if(scene_->getSession().diffuse_map_.get()->save(filename) && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Diffuse map saved." << YENDL;
 		}
 
 		if(use_photon_caustics_)
 		{
 			pb->setTag("Saving caustic photon map to file...");
-			const std::string filename = scene_->getImageFilm()->getFilmSavePath() + "_caustic.photonmap";
+			const std::string filename = getPhotonMapPath("caustic");
 			Y_INFO << getName() << ": Saving caustic photon map to: " << filename << YENDL;
-			if(session_global.caustic_map_.get()->save(filename) && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Caustic map saved." << YENDL;
+			if(scene_->getSession().caustic_map_.get()->save(filename) && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Caustic map saved." << YENDL;
 		}
 
 		if(use_photon_diffuse_ && final_gather_)
 		{
 			pb->setTag("Saving FG radiance photon map to file...");
-			const std::string filename = scene_->getImageFilm()->getFilmSavePath() + "_fg_radiance.photonmap";
+			const std::string filename = getPhotonMapPath("fg_radiance");
 			Y_INFO << getName() << ": Saving FG radiance photon map to: " << filename << YENDL;
-			if(session_global.radiance_map_.get()->save(filename) && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": FG radiance map saved." << YENDL;
+			if(scene_->getSession().radiance_map_.get()->save(filename) && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": FG radiance map saved." << YENDL;
 		}
 	}
 
-	g_timer_global.stop("prepass");
-	Y_INFO << getName() << ": Photonmap building time: " << std::fixed << std::setprecision(1) << g_timer_global.getTime("prepass") << "s" << " (" << scene_->getNumThreadsPhotons() << " thread(s))" << YENDL;
+	if(track_paths) maps_state.valid_ = !render_control.aborted();
+
+	scene_->getRenderControl().getTimer().stop("prepass");
+	Y_INFO << getName() << ": Photonmap building time: " << std::fixed << std::setprecision(1) << scene_->getRenderControl().getTimer().getTime("prepass") << "s" << " (" << scene_->getNumThreadsPhotons() << " thread(s))" << YENDL;
 
-	set << "| photon maps: " << std::fixed << std::setprecision(1) << g_timer_global.getTime("prepass") << "s" << " [" << scene_->getNumThreadsPhotons() << " thread(s)]";
+	set << "| photon maps: " << std::fixed << std::setprecision(1) << scene_->getRenderControl().getTimer().getTime("prepass") << "s" << " [" << scene_->getNumThreadsPhotons() << " thread(s)]";
 
 	render_info_ += set.str();
 
@@ -720,26 +938,13 @@ bool PhotonIntegrator::preprocess(const RenderControl &render_control, const Ren
 Rgb PhotonIntegrator::finalGathering(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
 	Rgb path_col(0.0);
-	void *first_udat = render_data.arena_;
-	alignas (16) unsigned char userdata[user_data_size_];
-	void *n_udat = static_cast<void *>(userdata);
-	const VolumeHandler *vol;
-	Rgb vcol(0.f);
 	float w = 0.f;
 
 	int n_sampl = (int) ceilf(std::max(1, n_paths_ / render_data.ray_division_) * aa_indirect_sample_multiplier_);
 	for(int i = 0; i < n_sampl; ++i)
 	{
-		Rgb throughput(1.0);
-		float length = 0;
-		SurfacePoint hit = sp;
-		Vec3 pwo = wo;
-		Ray pRay;
-		BsdfFlags mat_bsd_fs;
-		bool did_hit;
-		const Material *p_mat = sp.material_;
+		Ray p_ray;
 		unsigned int offs = n_paths_ * render_data.pixel_sample_ + render_data.sampling_offs_ + i; // some redundancy here...
-		Rgb lcol, scol;
 		// "zero'th" FG bounce:
 		float s_1 = sample::riVdC(offs);
 		float s_2 = Halton::lowDiscrepancySampling(2, offs);
@@ -750,116 +955,241 @@ Rgb PhotonIntegrator::finalGathering(RenderData &render_data, const SurfacePoint
 		}
 
 		Sample s(s_1, s_2, BsdfFlags::Diffuse | BsdfFlags::Reflect | BsdfFlags::Transmit); // glossy/dispersion/specular done via recursive raytracing
-		scol = p_mat->sample(render_data, hit, pwo, pRay.dir_, s, w);
+		Rgb scol = sp.material_->sample(render_data, sp, wo, p_ray.dir_, s, w);
 
 		scol *= w;
 		if(scol.isBlack()) continue;
 
-		pRay.tmin_ = scene_->ray_min_dist_;
-		pRay.tmax_ = -1.0;
-		pRay.from_ = hit.p_;
-		throughput = scol;
+		p_ray.from_ = sp.p_;
+		path_col += scol * traceGatherPath(render_data, p_ray, offs);
+	}
+	return path_col / (float)n_sampl;
+}
 
-		if(!(did_hit = scene_->intersect(pRay, hit))) continue;   //hit background
+Rgb PhotonIntegrator::traceGatherPath(RenderData &render_data, Ray &p_ray, unsigned int offs, float *first_hit_distance) const
+{
+	Rgb path_col(0.0);
+	const VolumeHandler *vol;
+	Rgb vcol(0.f);
+	float w = 0.f;
+	Rgb throughput(1.0);
+	SurfacePoint hit;
+	BsdfFlags mat_bsd_fs;
+	Rgb lcol, scol;
+
+	p_ray.tmin_ = scene_->ray_min_dist_;
+	p_ray.tmax_ = -1.0;
+	bool did_hit = scene_->intersect(p_ray, hit);
+	if(!did_hit) return path_col;   //hit background
+	if(first_hit_distance) *first_hit_distance = p_ray.tmax_;
+
+	void *first_udat = render_data.material_data_;
+	const Material *p_mat = hit.material_;
+	float length = p_ray.tmax_;
+	mat_bsd_fs = p_mat->getFlags();
+	bool has_spec = mat_bsd_fs.hasAny(BsdfFlags::Specular);
+	bool caustic = false;
+	bool close = length < gather_dist_;
+	bool do_bounce = close || has_spec;
+	// further bounces construct a path just as with path tracing:
+	for(int depth = 0; depth < gather_bounces_ && do_bounce; ++depth)
+	{
+		int d_4 = 4 * depth;
+		const Vec3 pwo = -p_ray.dir_;
+		render_data.material_data_ = render_data.allocMaterialData(p_mat->getReqMem());
+		p_mat->initBsdf(render_data, hit, mat_bsd_fs);
 
-		p_mat = hit.material_;
-		length = pRay.tmax_;
-		render_data.arena_ = n_udat;
-		mat_bsd_fs = p_mat->getFlags();
-		bool has_spec = mat_bsd_fs.hasAny(BsdfFlags::Specular);
-		bool caustic = false;
-		bool close = length < gather_dist_;
-		bool do_bounce = close || has_spec;
-		// further bounces construct a path just as with path tracing:
-		for(int depth = 0; depth < gather_bounces_ && do_bounce; ++depth)
+		if(mat_bsd_fs.hasAny(BsdfFlags::Volumetric) && (vol = p_mat->getVolumeHandler(hit.n_ * pwo < 0)))
 		{
-			int d_4 = 4 * depth;
-			pwo = -pRay.dir_;
-			p_mat->initBsdf(render_data, hit, mat_bsd_fs);
+			if(vol->transmittance(render_data, p_ray, vcol)) throughput *= vcol;
+		}
 
-			if(mat_bsd_fs.hasAny(BsdfFlags::Volumetric) && (vol = p_mat->getVolumeHandler(hit.n_ * pwo < 0)))
+		if(mat_bsd_fs.hasAny(BsdfFlags::Diffuse))
+		{
+			if(close)
 			{
-				if(vol->transmittance(render_data, pRay, vcol)) throughput *= vcol;
+				lcol = estimateOneDirectLight(render_data, hit, pwo, offs);
 			}
-
-			if(mat_bsd_fs.hasAny(BsdfFlags::Diffuse))
+			else if(caustic)
 			{
-				if(close)
-				{
-					lcol = estimateOneDirectLight(render_data, hit, pwo, offs);
-				}
-				else if(caustic)
-				{
-					Vec3 sf = SurfacePoint::normalFaceForward(hit.ng_, hit.n_, pwo);
-					const Photon *nearest = session_global.radiance_map_.get()->findNearest(hit.p_, sf, lookup_rad_);
-					if(nearest) lcol = nearest->color();
-				}
-
-				if(close || caustic)
-				{
-					if(mat_bsd_fs.hasAny(BsdfFlags::Emit)) lcol += p_mat->emit(render_data, hit, pwo);
-					path_col += lcol * throughput;
-				}
+				Vec3 sf = SurfacePoint::normalFaceForward(hit.ng_, hit.n_, pwo);
+				const Photon *nearest = scene_->getSession().radiance_map_.get()->findNearest(hit.p_, sf, lookup_rad_);
+				if(nearest) lcol = nearest->color();
 			}
 
-			s_1 = Halton::lowDiscrepancySampling(d_4 + 3, offs);
-			s_2 = Halton::lowDiscrepancySampling(d_4 + 4, offs);
-
-			if(render_data.ray_division_ > 1)
+			if(close || caustic)
 			{
-				s_1 = math::addMod1(s_1, render_data.dc_1_);
-				s_2 = math::addMod1(s_2, render_data.dc_2_);
+				if(mat_bsd_fs.hasAny(BsdfFlags::Emit)) lcol += p_mat->emit(render_data, hit, pwo);
+				path_col += lcol * throughput;
 			}
+		}
+
+		float s_1 = Halton::lowDiscrepancySampling(d_4 + 3, offs);
+		float s_2 = Halton::lowDiscrepancySampling(d_4 + 4, offs);
+
+		if(render_data.ray_division_ > 1)
+		{
+			s_1 = math::addMod1(s_1, render_data.dc_1_);
+			s_2 = math::addMod1(s_2, render_data.dc_2_);
+		}
+
+		Sample sb(s_1, s_2, (close) ? BsdfFlags::All : BsdfFlags::AllSpecular | BsdfFlags::Filter);
+		scol = p_mat->sample(render_data, hit, pwo, p_ray.dir_, sb, w);
+
+		if(sb.pdf_ <= 1.0e-6f)
+		{
+			did_hit = false;
+			break;
+		}
 
-			Sample sb(s_1, s_2, (close) ? BsdfFlags::All : BsdfFlags::AllSpecular | BsdfFlags::Filter);
-			scol = p_mat->sample(render_data, hit, pwo, pRay.dir_, sb, w);
+		scol *= w;
 
-			if(sb.pdf_ <= 1.0e-6f)
+		p_ray.tmin_ = scene_->ray_min_dist_;
+		p_ray.tmax_ = -1.0;
+		p_ray.from_ = hit.p_;
+		throughput *= scol;
+		did_hit = scene_->intersect(p_ray, hit);
+
+		if(!did_hit) //hit background
+		{
+			const auto &background = scene_->getBackground();
+			if(caustic && background && background->hasIbl() && background->shootsCaustic())
 			{
-				did_hit = false;
-				break;
+				path_col += throughput * (*background)(p_ray, render_data, true);
 			}
+			break;
+		}
 
-			scol *= w;
+		p_mat = hit.material_;
+		length += p_ray.tmax_;
+		caustic = (caustic || !depth) && sb.sampled_flags_.hasAny(BsdfFlags::Specular | BsdfFlags::Filter);
+		close = length < gather_dist_;
+		do_bounce = caustic || close;
+	}
 
-			pRay.tmin_ = scene_->ray_min_dist_;
-			pRay.tmax_ = -1.0;
-			pRay.from_ = hit.p_;
-			throughput *= scol;
-			did_hit = scene_->intersect(pRay, hit);
+	if(did_hit)
+	{
+		render_data.material_data_ = render_data.allocMaterialData(p_mat->getReqMem());
+		p_mat->initBsdf(render_data, hit, mat_bsd_fs);
+		if(mat_bsd_fs.hasAny(BsdfFlags::Diffuse | BsdfFlags::Glossy))
+		{
+			Vec3 sf = SurfacePoint::normalFaceForward(hit.ng_, hit.n_, -p_ray.dir_);
+			const Photon *nearest = scene_->getSession().radiance_map_.get()->findNearest(hit.p_, sf, lookup_rad_);
+			if(nearest) lcol = nearest->color();
+			if(mat_bsd_fs.hasAny(BsdfFlags::Emit)) lcol += p_mat->emit(render_data, hit, -p_ray.dir_);
+			path_col += lcol * throughput;
+		}
+	}
+	render_data.material_data_ = first_udat;
+	return path_col;
+}
 
-			if(!did_hit) //hit background
+Rgb PhotonIntegrator::cachedFinalGathering(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
+{
+	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
+	Rgb irradiance;
+	if(!irradiance_cache_->interpolate(sp.p_, n, irradiance)) irradiance = addIrradianceRecord(render_data, sp, n);
+	// the cached irradiance is reflected with the diffuse component at the shading point, assumed lambertian
+	return sp.material_->eval(render_data, sp, wo, n, BsdfFlags::Diffuse) * irradiance;
+}
+
+Rgb PhotonIntegrator::addIrradianceRecord(RenderData &render_data, const SurfacePoint &sp, const Vec3 &n) const
+{
+	// stratified cosine weighted hemisphere, with about pi times more strata in phi than in theta
+	const int num_theta = std::max(1, static_cast<int>(std::round(std::sqrt(irradiance_cache_samples_ / M_PI))));
+	const int num_phi = std::max(1, (irradiance_cache_samples_ + num_theta / 2) / num_theta);
+	const int num_samples = num_theta * num_phi;
+	Vec3 u, v;
+	Vec3::createCs(n, u, v);
+
+	std::vector<Rgb> radiance(num_samples);
+	std::vector<float> distance(num_samples);
+	std::vector<float> sin_theta(num_samples);
+	Rgb irradiance(0.f);
+	std::array<Rgb, 3> rotational_gradient {{ Rgb(0.f), Rgb(0.f), Rgb(0.f) }};
+	std::array<Rgb, 3> translational_gradient {{ Rgb(0.f), Rgb(0.f), Rgb(0.f) }};
+	float inv_distance_sum = 0.f;
+	const unsigned int offs_start = num_samples * render_data.pixel_sample_ + render_data.sampling_offs_;
+
+	for(int k = 0; k < num_phi; ++k)
+	{
+		Rgb tan_theta_sum(0.f);
+		for(int j = 0; j < num_theta; ++j)
+		{
+			const int index = k * num_theta + j;
+			const float sin_theta_2 = (j + static_cast<float>((*render_data.prng_)())) / num_theta;
+			const float cos_theta = std::sqrt(std::max(0.f, 1.f - sin_theta_2));
+			const float phi = math::mult_pi_by_2 * (k + static_cast<float>((*render_data.prng_)())) / num_phi;
+			sin_theta[index] = std::sqrt(sin_theta_2);
+			Ray ray;
+			ray.from_ = sp.p_;
+			ray.dir_ = (u * math::cos(phi) + v * math::sin(phi)) * sin_theta[index] + n * cos_theta;
+			float hit_distance = -1.f;
+			radiance[index] = traceGatherPath(render_data, ray, offs_start + index, &hit_distance);
+			if(hit_distance > 0.f)
 			{
-				const auto &background = scene_->getBackground();
-				if(caustic && background && background->hasIbl() && background->shootsCaustic())
-				{
-					path_col += throughput * (*background)(pRay, render_data, true);
-				}
-				break;
+				distance[index] = hit_distance;
+				inv_distance_sum += 1.f / hit_distance;
 			}
-
-			p_mat = hit.material_;
-			length += pRay.tmax_;
-			caustic = (caustic || !depth) && sb.sampled_flags_.hasAny(BsdfFlags::Specular | BsdfFlags::Filter);
-			close = length < gather_dist_;
-			do_bounce = caustic || close;
+			else distance[index] = std::numeric_limits<float>::infinity();
+			irradiance += radiance[index];
+			tan_theta_sum += radiance[index] * (sin_theta[index] / std::max(cos_theta, 1.0e-3f));
 		}
+		// rotational gradient (Ward and Heckbert 1992), the direction perpendicular to the center of the phi stratum
+		const float phi_center = math::mult_pi_by_2 * (k + 0.5f) / num_phi;
+		const Vec3 v_k = v * math::cos(phi_center) - u * math::sin(phi_center);
+		rotational_gradient[0] += tan_theta_sum * v_k.x_;
+		rotational_gradient[1] += tan_theta_sum * v_k.y_;
+		rotational_gradient[2] += tan_theta_sum * v_k.z_;
+	}
 
-		if(did_hit)
+	// translational gradient: the motion of the boundaries between the theta and the phi strata, with the distances to the closest side
+	for(int k = 0; k < num_phi; ++k)
+	{
+		const int k_prev = (k + num_phi - 1) % num_phi;
+		Rgb theta_boundaries(0.f), phi_boundaries(0.f);
+		for(int j = 0; j < num_theta; ++j)
 		{
-			p_mat->initBsdf(render_data, hit, mat_bsd_fs);
-			if(mat_bsd_fs.hasAny(BsdfFlags::Diffuse | BsdfFlags::Glossy))
+			const int index = k * num_theta + j;
+			if(j > 0)
 			{
-				Vec3 sf = SurfacePoint::normalFaceForward(hit.ng_, hit.n_, -pRay.dir_);
-				const Photon *nearest = session_global.radiance_map_.get()->findNearest(hit.p_, sf, lookup_rad_);
-				if(nearest) lcol = nearest->color();
-				if(mat_bsd_fs.hasAny(BsdfFlags::Emit)) lcol += p_mat->emit(render_data, hit, -pRay.dir_);
-				path_col += lcol * throughput;
+				const float sin_theta_2_boundary = static_cast<float>(j) / num_theta;
+				const float min_distance = std::min(distance[index], distance[index - 1]);
+				theta_boundaries += (radiance[index] - radiance[index - 1]) * (std::sqrt(sin_theta_2_boundary) * (1.f - sin_theta_2_boundary) / min_distance);
 			}
+			const int index_prev = k_prev * num_theta + j;
+			const float min_distance = std::min(distance[index], distance[index_prev]);
+			phi_boundaries += (radiance[index] - radiance[index_prev]) * (1.f / (2.f * num_theta * std::max(sin_theta[index], 1.0e-3f) * min_distance));
 		}
-		render_data.arena_ = first_udat;
+		const float phi_center = math::mult_pi_by_2 * (k + 0.5f) / num_phi;
+		const float phi_boundary = math::mult_pi_by_2 * k / num_phi;
+		const Vec3 u_k = u * math::cos(phi_center) + v * math::sin(phi_center);
+		const Vec3 v_k = v * math::cos(phi_boundary) - u * math::sin(phi_boundary);
+		theta_boundaries *= math::mult_pi_by_2 / num_phi;
+		translational_gradient[0] += theta_boundaries * u_k.x_ + phi_boundaries * v_k.x_;
+		translational_gradient[1] += theta_boundaries * u_k.y_ + phi_boundaries * v_k.y_;
+		translational_gradient[2] += theta_boundaries * u_k.z_ + phi_boundaries * v_k.z_;
 	}
-	return path_col / (float)n_sampl;
+
+	// the diffuse component of the materials evaluates to the albedo, so the records store the irradiance divided by pi
+	const float scale = 1.f / num_samples;
+	IrradianceCache::Record record;
+	record.p_ = sp.p_;
+	record.n_ = n;
+	record.irradiance_ = irradiance * scale;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		record.rotational_gradient_[axis] = rotational_gradient[axis] * scale;
+		record.translational_gradient_[axis] = translational_gradient[axis] * static_cast<float>(M_1_PI);
+	}
+
+	// harmonic mean distance, limited so the translational gradient does not change the irradiance more than itself inside the record
+	float radius = (inv_distance_sum > 0.f) ? num_samples / inv_distance_sum : irradiance_cache_max_radius_;
+	const float gradient_bri = Vec3(record.translational_gradient_[0].col2Bri(), record.translational_gradient_[1].col2Bri(), record.translational_gradient_[2].col2Bri()).length();
+	if(gradient_bri > 0.f) radius = std::min(radius, record.irradiance_.col2Bri() / gradient_bri);
+	record.radius_ = std::max(irradiance_cache_min_radius_, std::min(irradiance_cache_max_radius_, radius));
+	irradiance_cache_->add(record);
+	return record.irradiance_;
 }
 
 Rgba PhotonIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers, const RenderView *render_view) const
@@ -873,16 +1203,15 @@ Rgba PhotonIntegrator::integrate(RenderData &render_data, const DiffRay &ray, in
 	float alpha;
 	SurfacePoint sp;
 
-	void *o_udat = render_data.arena_;
+	void *o_udat = render_data.material_data_;
 	const bool old_lights_geometry_material_emit = render_data.lights_geometry_material_emit_;
 
 	if(transp_background_) alpha = 0.0;
 	else alpha = 1.0;
 
-	if(scene_->intersect(ray, sp))
+	if(scene_->intersect(ray, sp, render_data.takePrimaryHit()))
 	{
-		alignas (16) unsigned char userdata[user_data_size_];
-		render_data.arena_ = static_cast<void *>(userdata);
+		render_data.material_data_ = render_data.allocMaterialData(sp.material_->getReqMem());
 
 		if(render_data.raylevel_ == 0)
 		{
@@ -911,7 +1240,7 @@ Rgba PhotonIntegrator::integrate(RenderData &render_data, const DiffRay &ray, in
 			if(show_map_)
 			{
 				Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
-				const Photon *nearest = session_global.radiance_map_.get()->findNearest(sp.p_, n, lookup_rad_);
+				const Photon *nearest = scene_->getSession().radiance_map_.get()->findNearest(sp.p_, n, lookup_rad_);
 				if(nearest) col += nearest->color();
 			}
 			else
@@ -921,7 +1250,7 @@ Rgba PhotonIntegrator::integrate(RenderData &render_data, const DiffRay &ray, in
 					if(ColorLayer *color_layer = color_layers->find(Layer::Radiance))
 					{
 						Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
-						const Photon *nearest = session_global.radiance_map_.get()->findNearest(sp.p_, n, lookup_rad_);
+						const Photon *nearest = scene_->getSession().radiance_map_.get()->findNearest(sp.p_, n, lookup_rad_);
 						if(nearest) color_layer->color_ = nearest->color();
 					}
 				}
@@ -940,7 +1269,8 @@ Rgba PhotonIntegrator::integrate(RenderData &render_data, const DiffRay &ray, in
 				if(bsdfs.hasAny(BsdfFlags::Diffuse))
 				{
 					col += estimateAllDirectLight(render_data, sp, wo, color_layers);
-					Rgb col_tmp = finalGathering(render_data, sp, wo);
+					// the translucent materials are gathered on both sides, so they are not cached
+					Rgb col_tmp = (irradiance_cache_ && !bsdfs.hasAny(BsdfFlags::Transmit)) ? cachedFinalGathering(render_data, sp, wo) : finalGathering(render_data, sp, wo);
 					if(aa_noise_params_.clamp_indirect_ > 0.f) col_tmp.clampProportionalRgb(aa_noise_params_.clamp_indirect_);
 					col += col_tmp;
 					if(layers_used)
@@ -955,7 +1285,7 @@ Rgba PhotonIntegrator::integrate(RenderData &render_data, const DiffRay &ray, in
 			if(use_photon_diffuse_ && show_map_)
 			{
 				Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
-				const Photon *nearest = session_global.diffuse_map_.get()->findNearest(sp.p_, n, ds_radius_);
+				const Photon *nearest = scene_->getSession().diffuse_map_.get()->findNearest(sp.p_, n, ds_radius_);
 				if(nearest) col += nearest->color();
 			}
 			else
@@ -965,7 +1295,7 @@ Rgba PhotonIntegrator::integrate(RenderData &render_data, const DiffRay &ray, in
 					if(ColorLayer *color_layer = color_layers->find(Layer::Radiance))
 					{
 						Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
-						const Photon *nearest = session_global.radiance_map_.get()->findNearest(sp.p_, n, lookup_rad_);
+						const Photon *nearest = scene_->getSession().radiance_map_.get()->findNearest(sp.p_, n, lookup_rad_);
 						if(nearest) color_layer->color_ = nearest->color();
 					}
 				}
@@ -985,17 +1315,18 @@ Rgba PhotonIntegrator::integrate(RenderData &render_data, const DiffRay &ray, in
 					col += estimateAllDirectLight(render_data, sp, wo, color_layers);
 				}
 
-				FoundPhoton *gathered = (FoundPhoton *)alloca(n_diffuse_search_ * sizeof(FoundPhoton));
+				const MemoryArena::Marker arena_marker = render_data.arena_.getMarker();
+				FoundPhoton *gathered = render_data.arena_.alloc<FoundPhoton>(n_diffuse_search_); //instead of the stack, too small for big photon searches
 				float radius = ds_radius_; //actually the square radius...
 
 				int n_gathered = 0;
 
-				if(use_photon_diffuse_ && session_global.diffuse_map_.get()->nPhotons() > 0) n_gathered = session_global.diffuse_map_.get()->gather(sp.p_, gathered, n_diffuse_search_, radius);
+				if(use_photon_diffuse_ && scene_->getSession().diffuse_map_.get()->nPhotons() > 0) n_gathered = scene_->getSession().diffuse_map_.get()->gather(sp.p_, gathered, n_diffuse_search_, radius);
 				if(use_photon_diffuse_ && n_gathered > 0)
 				{
 					if(n_gathered > n_max) n_max = n_gathered;
 
-					float scale = 1.f / ((float)session_global.diffuse_map_.get()->nPaths() * radius * M_PI);
+					float scale = 1.f / ((float)scene_->getSession().diffuse_map_.get()->nPaths() * radius * M_PI);
 					for(int i = 0; i < n_gathered; ++i)
 					{
 						const Vec3 pdir = gathered[i].photon_->direction();
@@ -1009,6 +1340,7 @@ Rgba PhotonIntegrator::integrate(RenderData &render_data, const DiffRay &ray, in
 						}
 					}
 				}
+				render_data.arena_.rewind(arena_marker);
 			}
 		}
 
@@ -1061,7 +1393,7 @@ Rgba PhotonIntegrator::integrate(RenderData &render_data, const DiffRay &ray, in
 		}
 	}
 
-	render_data.arena_ = o_udat;
+	render_data.material_data_ = o_udat;
 	render_data.lights_geometry_material_emit_ = old_lights_geometry_material_emit;
 
 	Rgb col_vol_transmittance = scene_->vol_integrator_->transmittance(render_data, ray);
@@ -1094,6 +1426,9 @@ std::unique_ptr<Integrator> PhotonIntegrator::factory(ParamMap &params, const Sc
 	int bounces = 5;
 	int fg_paths = 32;
 	int fg_bounces = 2;
+	bool irradiance_cache = false;
+	float irradiance_cache_accuracy = 0.25f;
+	int irradiance_cache_samples = 256;
 	float ds_rad = 0.1;
 	float c_rad = 0.01;
 	float gather_dist = 0.2;
@@ -1106,6 +1441,8 @@ std::unique_ptr<Integrator> PhotonIntegrator::factory(ParamMap &params, const Sc
 	bool caustics = true;
 	bool diffuse = true;
 	std::string photon_maps_processing_str = "generate";
+	std::string light_sampling_str = "uniform";
+	bool c_projection = true;
 
 	params.getParam("caustics", caustics);
 	params.getParam("diffuse", diffuse);
@@ -1126,6 +1463,9 @@ std::unique_ptr<Integrator> PhotonIntegrator::factory(ParamMap &params, const Sc
 	params.getParam("fg_bounces", fg_bounces);
 	gather_dist = ds_rad;
 	params.getParam("fg_min_pathlen", gather_dist);
+	params.getParam("irradiance_cache", irradiance_cache);
+	params.getParam("irradiance_cache_accuracy", irradiance_cache_accuracy);
+	params.getParam("irradiance_cache_samples", irradiance_cache_samples);
 	params.getParam("show_map", show_map);
 	params.getParam("bg_transp", bg_transp);
 	params.getParam("bg_transp_refract", bg_transp_refract);
@@ -1134,6 +1474,10 @@ std::unique_ptr<Integrator> PhotonIntegrator::factory(ParamMap &params, const Sc
 	params.getParam("AO_distance", ao_dist);
 	params.getParam("AO_color", ao_col);
 	params.getParam("photon_maps_processing", photon_maps_processing_str);
+	params.getParam("caustic_projection", c_projection);
+	params.getParam("light_sampling", light_sampling_str);
+	bool adaptive_light_samples = false;
+	params.getParam("adaptive_light_samples", adaptive_light_samples);
 
 	auto inte = std::unique_ptr<PhotonIntegrator>(new PhotonIntegrator(num_photons, num_c_photons, transp_shad, shadow_depth, ds_rad, c_rad));
 
@@ -1146,10 +1490,14 @@ std::unique_ptr<Integrator> PhotonIntegrator::factory(ParamMap &params, const Sc
 	inte->final_gather_ = final_gather;
 	inte->max_bounces_ = bounces;
 	inte->caus_depth_ = bounces;
+	inte->caustic_projection_ = c_projection;
 	inte->n_paths_ = fg_paths;
 	inte->gather_bounces_ = fg_bounces;
 	inte->show_map_ = show_map;
 	inte->gather_dist_ = gather_dist;
+	inte->use_irradiance_cache_ = irradiance_cache;
+	inte->irradiance_cache_accuracy_ = std::max(0.01f, irradiance_cache_accuracy);
+	inte->irradiance_cache_samples_ = std::max(1, irradiance_cache_samples);
 	// Background settings
 	inte->transp_background_ = bg_transp;
 	inte->transp_refracted_background_ = bg_transp_refract;
@@ -1162,8 +1510,14 @@ std::unique_ptr<Integrator> PhotonIntegrator::factory(ParamMap &params, const Sc
 	if(photon_maps_processing_str == "generate-save") inte->photon_map_processing_ = PhotonsGenerateAndSave;
 	else if(photon_maps_processing_str == "load") inte->photon_map_processing_ = PhotonsLoad;
 	else if(photon_maps_processing_str == "reuse-previous") inte->photon_map_processing_ = PhotonsReuse;
+	else if(photon_maps_processing_str == "update-changed") inte->photon_map_processing_ = PhotonsUpdate;
 	else inte->photon_map_processing_ = PhotonsGenerateOnly;
 
+	inte->adaptive_light_samples_ = adaptive_light_samples;
+	if(light_sampling_str == "power") inte->light_sampling_ = LightSampling::Power;
+	else if(light_sampling_str == "light_tree") inte->light_sampling_ = LightSampling::LightTree;
+	else inte->light_sampling_ = LightSampling::Uniform;
+
 	return inte;
 }
 
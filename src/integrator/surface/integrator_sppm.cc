@@ -28,8 +28,10 @@
 #include "render/monitor.h"
 #include "common/timer.h"
 #include "render/imagefilm.h"
+#include "render/render_checkpoint.h"
 #include "camera/camera.h"
 #include "sampler/sample.h"
+#include "math/random.h"
 #include "sampler/sample_pdf1d.h"
 #include "light/light.h"
 #include "material/material.h"
@@ -64,6 +66,8 @@ bool SppmIntegrator::render(RenderControl &render_control, const RenderView *ren
 {
 	std::stringstream pass_string;
 	aa_noise_params_ = scene_->getAaParameters();
+	num_camera_samples_ = 0;
+	setupPrimaryHitCache(render_view);
 
 	std::stringstream aa_settings;
 	aa_settings << " passes=" << pass_num_ << " samples=" << aa_noise_params_.samples_ << " inc_samples=" << aa_noise_params_.inc_samples_;
@@ -98,14 +102,14 @@ bool SppmIntegrator::render(RenderControl &render_control, const RenderView *ren
 	Y_INFO << getName() << ": " << pass_string.str() << YENDL;
 	if(intpb_) intpb_->setTag(pass_string.str().c_str());
 
-	g_timer_global.addEvent("rendert");
-	g_timer_global.start("rendert");
+	scene_->getRenderControl().getTimer().addEvent("rendert");
+	scene_->getRenderControl().getTimer().start("rendert");
 
 	image_film_->resetImagesAutoSaveTimer();
-	g_timer_global.addEvent("imagesAutoSaveTimer");
+	scene_->getRenderControl().getTimer().addEvent("imagesAutoSaveTimer");
 
 	image_film_->resetFilmAutoSaveTimer();
-	g_timer_global.addEvent("filmAutoSaveTimer");
+	scene_->getRenderControl().getTimer().addEvent("filmAutoSaveTimer");
 
 	image_film_->init(render_control, pass_num_);
 	image_film_->setAaNoiseParams(aa_noise_params_);
@@ -119,33 +123,46 @@ bool SppmIntegrator::render(RenderControl &render_control, const RenderView *ren
 
 	Y_INFO << getName() << ": " << pass_string.str() << YENDL;
 
-	const Camera *camera = render_view->getCamera();
-
 	max_depth_ = 0.f;
 	min_depth_ = 1e38f;
 
-	diff_rays_enabled_ = session_global.getDifferentialRaysEnabled();	//enable ray differentials for mipmap calculation if there is at least one image texture using Mipmap interpolation
+	diff_rays_enabled_ = scene_->getSession().getDifferentialRaysEnabled();	//enable ray differentials for mipmap calculation if there is at least one image texture using Mipmap interpolation
 
 	if(scene_->getLayers().isDefinedAny({Layer::ZDepthNorm, Layer::Mist})) precalcDepths(render_view);
 
 	int acum_aa_samples = 1;
 
 	initializePpm(render_view); // seems could integrate into the preRender
-	if(render_control.resumed())
+	std::string initial_estimate = "no";
+	if(pm_ire_) initial_estimate = "yes";
+
+	//The hit points, the photon counters and the film of a checkpoint replace the ones of the first pass
+	int first_pass = 1;
+	int resampled_pixels = 0;
+	bool aa_threshold_changed = false;
+	const bool checkpoint_resumed = loadCheckpoint(render_view, render_control, pass_num_, first_pass, acum_aa_samples, resampled_pixels, aa_threshold_changed);
+	if(photon_splatting_)
+	{
+		// the photons of each pass are splatted into the visible points recorded in the previous eye pass, so the first ones are recorded without rendering
+		visible_points_.assign(scene_->getNumThreads(), {});
+		record_visible_points_only_ = true;
+		renderPass(render_view, 1, checkpoint_resumed ? acum_aa_samples - 1 : 0, false, first_pass - 1, render_control);
+		record_visible_points_only_ = false;
+	}
+	if(checkpoint_resumed) Y_INFO << getName() << ": Resuming the render from the checkpoint after pass " << first_pass << YENDL;
+	else if(render_control.resumed())
 	{
 		acum_aa_samples = image_film_->getSamplingOffset();
 		renderPass(render_view, 0, acum_aa_samples, false, 0, render_control);
 	}
 	else renderPass(render_view, 1, 0, false, 0, render_control);
 
-	std::string initial_estimate = "no";
-	if(pm_ire_) initial_estimate = "yes";
-
 	pm_ire_ = false;
+	if(!checkpoint_resumed) saveCheckpoint(render_view, render_control, 1, acum_aa_samples, resampled_pixels, aa_threshold_changed);
 
-	int hp_num = camera->resX() * camera->resY();
-	int pass_info = 1;
-	for(int i = 1; i < pass_num_; ++i) //progress pass, the offset start from 1 as it is 0 based.
+	const size_t hp_num = hit_points_.size();
+	int pass_info = first_pass;
+	for(int i = first_pass; i < pass_num_; ++i) //progress pass, the offset start from 1 as it is 0 based.
 	{
 		if(render_control.aborted()) break;
 		pass_info = i + 1;
@@ -154,13 +171,16 @@ bool SppmIntegrator::render(RenderControl &render_control, const RenderView *ren
 		renderPass(render_view, 1, acum_aa_samples, false, i, render_control); // offset are only related to the passNum, since we alway have only one sample.
 		acum_aa_samples += 1;
 		Y_INFO << getName() << ": This pass refined " << n_refined_ << " of " << hp_num << " pixels." << YENDL;
+		saveCheckpoint(render_view, render_control, i + 1, acum_aa_samples, resampled_pixels, aa_threshold_changed);
 	}
+	removeCheckpoint(render_view, render_control);
+	visible_points_.clear(); // the visible points of the last pass do not receive photons
 	max_depth_ = 0.f;
-	g_timer_global.stop("rendert");
-	g_timer_global.stop("imagesAutoSaveTimer");
-	g_timer_global.stop("filmAutoSaveTimer");
+	scene_->getRenderControl().getTimer().stop("rendert");
+	scene_->getRenderControl().getTimer().stop("imagesAutoSaveTimer");
+	scene_->getRenderControl().getTimer().stop("filmAutoSaveTimer");
 	render_control.setFinished();
-	Y_INFO << getName() << ": Overall rendertime: " << g_timer_global.getTime("rendert") << "s." << YENDL;
+	Y_INFO << getName() << ": Overall rendertime: " << scene_->getRenderControl().getTimer().getTime("rendert") << "s." << YENDL;
 
 	// Integrator Settings for "drawRenderSettings()" in imageFilm, SPPM has own render method, so "getSettings()"
 	// in integrator.h has no effect and Integrator settings won't be printed to the parameter badge.
@@ -209,6 +229,7 @@ bool SppmIntegrator::renderTile(RenderArea &a, const RenderView *render_view, co
 	const Layers &layers = scene_->getLayers();
 	const MaskParams mask_params = layers.getMaskParams();
 	ColorLayers color_layers(layers);
+	uint64_t num_camera_samples = 0;
 
 	for(int i = a.y_; i < end_y; ++i)
 	{
@@ -224,6 +245,7 @@ bool SppmIntegrator::renderTile(RenderArea &a, const RenderView *render_view, co
 			{
 				rstate.setDefaults();
 				rstate.pixel_sample_ = pass_offs + sample;
+				rstate.arena_.reset();
 				rstate.time_ = math::addMod1((float) sample * d_1, toff); //(0.5+(float)sample)*d1;
 				// the (1/n, Larcher&Pillichshammer-Seq.) only gives good coverage when total sample count is known
 				// hence we use scrambled (Sobol, van-der-Corput) for multipass AA
@@ -237,8 +259,10 @@ bool SppmIntegrator::renderTile(RenderArea &a, const RenderView *render_view, co
 					lens_v = Halton::lowDiscrepancySampling(4, rstate.pixel_sample_ + rstate.sampling_offs_);
 				}
 				c_ray = camera->shootRay(j + dx, i + dy, lens_u, lens_v, wt); // wt need to be considered
+				++num_camera_samples;
 				if(wt == 0.0)
 				{
+					if(record_visible_points_only_) continue;
 					image_film_->addSample(j, i, dx, dy, &a, sample, aa_pass_number, inv_aa_max_possible_samples, &color_layers); //maybe not need
 					continue;
 				}
@@ -258,28 +282,19 @@ bool SppmIntegrator::renderTile(RenderArea &a, const RenderView *render_view, co
 				c_ray.time_ = rstate.time_;
 
 				//for sppm progressive
-				int index = ((i - y_start_film) * camera->resX()) + (j - x_start_film);
-				HitPoint &hp = hit_points_[index];
+				const int index = ((i - y_start_film) * image_film_->getWidth()) + (j - x_start_film);
+				rstate.primary_hit_ = primaryHitSlot(index, dx, dy);
 
-				GatherInfo g_info = traceGatherRay(rstate, c_ray, hp);
-				hp.constant_randiance_ += g_info.constant_randiance_; // accumulate the constant radiance for later usage.
+				GatherInfo g_info = traceGatherRay(rstate, c_ray, index);
+				if(record_visible_points_only_) continue;
+				hit_points_.constant_randiance_[index] += g_info.constant_randiance_; // accumulate the constant radiance for later usage.
 
 				// progressive refinement
-				const float alpha = 0.7f; // another common choice is 0.8, seems not changed much.
-
-				// The author's refine formular
-				if(g_info.photon_count_ > 0)
-				{
-					float g = std::min((hp.acc_photon_count_ + alpha * g_info.photon_count_) / (hp.acc_photon_count_ + g_info.photon_count_), 1.0f);
-					hp.radius_2_ *= g;
-					hp.acc_photon_count_ += g_info.photon_count_ * alpha;
-					hp.acc_photon_flux_ = (hp.acc_photon_flux_ + g_info.photon_flux_) * g;
-					n_refined_++; // record the pixel that has refined.
-				}
+				if(g_info.photon_count_ > 0) refineHitPoint(index, g_info.photon_flux_, g_info.photon_count_);
 
 				//radiance estimate
 				//colorPasses.probe_mult(PASS_INT_DIFFUSE_INDIRECT, 1.f / (hp.radius2 * M_PI * totalnPhotons));
-				const Rgba col_indirect = hp.acc_photon_flux_ / (hp.radius_2_ * M_PI * totaln_photons_);
+				const Rgba col_indirect = hit_points_.getFlux(index) / (hit_points_.radius_2_[index] * M_PI * totaln_photons_);
 				Rgba color = col_indirect;
 				color += g_info.constant_randiance_;
 				color.a_ = g_info.constant_randiance_.a_; //the alpha value is hold in the constantRadiance variable
@@ -344,10 +359,116 @@ bool SppmIntegrator::renderTile(RenderArea &a, const RenderView *render_view, co
 			}
 		}
 	}
+	num_camera_samples_ += num_camera_samples;
+	a.num_camera_samples_ = num_camera_samples;
+	return true;
+}
+
+void HitPoints::resize(size_t size, float radius_2, bool half_flux)
+{
+	half_flux_ = half_flux;
+	radius_2_.assign(size, radius_2);
+	acc_photon_count_.assign(size, 0);
+	constant_randiance_.assign(size, Rgba(0.f));
+	radius_setted_.assign(size, false);
+	acc_photon_flux_.clear();
+	acc_photon_flux_half_.clear();
+	if(half_flux_) acc_photon_flux_half_.resize(size);
+	else acc_photon_flux_.assign(size, Rgba(0.f));
+}
+
+void HitPoints::refine(size_t index, const Rgba &photon_flux, float photon_count)
+{
+	const float alpha = 0.7f; // another common choice is 0.8, seems not changed much.
+
+	// The author's refine formular
+	float g = std::min((acc_photon_count_[index] + alpha * photon_count) / (acc_photon_count_[index] + photon_count), 1.0f);
+	radius_2_[index] *= g;
+	acc_photon_count_[index] += photon_count * alpha;
+	setFlux(index, (getFlux(index) + photon_flux) * g);
+}
+
+void HitPoints::save(RenderCheckpoint &checkpoint) const
+{
+	checkpoint.add("sppm.radius_2", radius_2_);
+	checkpoint.add("sppm.photon_count", acc_photon_count_);
+	checkpoint.add("sppm.constant_radiance", constant_randiance_);
+	checkpoint.add("sppm.radius_set", radius_setted_);
+	if(half_flux_) checkpoint.add("sppm.flux_half", acc_photon_flux_half_);
+	else checkpoint.add("sppm.flux", acc_photon_flux_);
+}
+
+bool HitPoints::load(const RenderCheckpoint &checkpoint)
+{
+	const size_t num_hit_points = size();
+	const float *radius_2 = checkpoint.get<float>("sppm.radius_2", num_hit_points);
+	const int64_t *photon_count = checkpoint.get<int64_t>("sppm.photon_count", num_hit_points);
+	const Rgba *constant_radiance = checkpoint.get<Rgba>("sppm.constant_radiance", num_hit_points);
+	const unsigned char *radius_set = checkpoint.get<unsigned char>("sppm.radius_set", num_hit_points);
+	const Rgba *flux = half_flux_ ? nullptr : checkpoint.get<Rgba>("sppm.flux", num_hit_points);
+	const RgbaHalf *flux_half = half_flux_ ? checkpoint.get<RgbaHalf>("sppm.flux_half", num_hit_points) : nullptr;
+	if(!radius_2 || !photon_count || !constant_radiance || !radius_set || (!flux && !flux_half)) return false;
+	radius_2_.assign(radius_2, radius_2 + num_hit_points);
+	acc_photon_count_.assign(photon_count, photon_count + num_hit_points);
+	constant_randiance_.assign(constant_radiance, constant_radiance + num_hit_points);
+	radius_setted_.assign(radius_set, radius_set + num_hit_points);
+	if(flux_half) acc_photon_flux_half_.assign(flux_half, flux_half + num_hit_points);
+	else acc_photon_flux_.assign(flux, flux + num_hit_points);
+	return true;
+}
+
+void SppmIntegrator::saveIntegratorCheckpoint(RenderCheckpoint &checkpoint) const
+{
+	hit_points_.save(checkpoint);
+	const uint64_t photons[2] { totaln_photons_, photon_index_base_ };
+	checkpoint.add("sppm.photons", photons, 2);
+}
+
+bool SppmIntegrator::loadIntegratorCheckpoint(const RenderCheckpoint &checkpoint)
+{
+	const uint64_t *photons = checkpoint.get<uint64_t>("sppm.photons", 2);
+	if(!photons || !hit_points_.load(checkpoint)) return false;
+	totaln_photons_ = photons[0];
+	photon_index_base_ = static_cast<unsigned int>(photons[1]);
 	return true;
 }
 
-void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_photons, const Pdf1D *light_power_d, int num_d_lights, const std::vector<const Light *> &tmplights, ProgressBar *pb, int pb_step, unsigned int &total_photons_shot, int max_bounces, Random &prng)
+void SppmIntegrator::refineHitPoint(size_t hit_point, const Rgba &photon_flux, float photon_count)
+{
+	hit_points_.refine(hit_point, photon_flux, photon_count);
+	n_refined_++; // record the pixel that has refined.
+}
+
+void SppmIntegrator::refineVisiblePoints()
+{
+	//the photons received by all the visible points of each pixel are added before refining its hit point
+	std::vector<Rgba> pixel_flux(hit_points_.size(), Rgba(0.f));
+	std::vector<float> pixel_count(hit_points_.size(), 0.f);
+	for(size_t i = 0; i < visible_point_grid_.size(); ++i)
+	{
+		Rgba flux;
+		float count;
+		visible_point_grid_.getPhotons(i, flux, count);
+		const unsigned int hit_point = visible_point_grid_[i].hit_point_;
+		pixel_flux[hit_point] += flux;
+		pixel_count[hit_point] += count;
+	}
+	//The hit points are refined in parallel, each chunk streams through its part of the arrays
+	parallelFor_global(render_thread_pool_.get(), hit_points_.size(), [&](size_t begin, size_t end)
+	{
+		unsigned int n_refined = 0;
+		for(size_t i = begin; i < end; ++i)
+		{
+			if(pixel_count[i] <= 0.f) continue;
+			hit_points_.refine(i, pixel_flux[i], pixel_count[i]);
+			++n_refined;
+		}
+		n_refined_ += n_refined;
+	});
+	visible_point_grid_.clear();
+}
+
+void SppmIntegrator::photonWorker(std::vector<Photon> &diffuse_photons, std::vector<Photon> &caustic_photons, unsigned int &photons_shot, int thread_id, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, unsigned int n_photons, unsigned int first_photon, unsigned int last_photon, const Pdf1D *light_power_d, int num_d_lights, const std::vector<const Light *> &tmplights, PhotonShootingProgress &progress, int pb_step, int max_bounces)
 {
 	Ray ray;
 	float light_num_pdf, light_pdf, s_1, s_2, s_3, s_4, s_5, s_6, s_7, s_l;
@@ -358,22 +479,23 @@ void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map
 	unsigned int curr = 0;
 
 	SurfacePoint sp;
+	Random prng;
 	RenderData render_data(&prng);
-	alignas (16) unsigned char userdata[user_data_size_];
-	render_data.arena_ = static_cast<void *>(userdata);
 	render_data.cam_ = render_view->getCamera();
 
 	float f_num_lights = (float)num_d_lights;
 
-	unsigned int n_photons_thread = 1 + ((n_photons - 1) / scene->getNumThreadsPhotons());
-
-	std::vector<Photon> local_caustic_photons;
-	local_caustic_photons.clear();
-	local_caustic_photons.reserve(n_photons_thread);
+	const unsigned int n_photons_thread = last_photon - first_photon;
+	if(n_photons_thread == 0) done = true;
 
-	std::vector<Photon> local_diffuse_photons;
-	local_diffuse_photons.clear();
-	local_diffuse_photons.reserve(n_photons_thread);
+	//Each thread stores its photons in its own chunks, merged into the photon maps or the hashgrid when all the threads have finished. When splatting, the photons are not stored
+	caustic_photons.clear();
+	diffuse_photons.clear();
+	if(!photon_splatting_)
+	{
+		caustic_photons.reserve(n_photons_thread);
+		diffuse_photons.reserve(n_photons_thread);
+	}
 
 	//Pregather  photons
 	float inv_diff_photons = 1.f / (float)n_photons;
@@ -383,39 +505,45 @@ void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map
 
 	while(!done)
 	{
-		unsigned int haltoncurr = curr + n_photons_thread * thread_id;
+		//Each thread shoots its own contiguous range of the photons of the pass, and every sample of a photon only depends on its index,
+		//so the photons are the same regardless of the number of threads and the order in which they run
+		unsigned int haltoncurr = first_photon + curr;
+		render_data.arena_.reset(); //the material data is only needed while tracing each photon
 
 		render_data.chromatic_ = true;
 		render_data.wavelength_ = Halton::lowDiscrepancySampling(5, haltoncurr);
 
 		// Tried LD, get bad and strange results for some stategy.
-		{
-			std::lock_guard<std::mutex> lock_halton(mutex_);
-			s_1 = hal_1_.getNext();
-			s_2 = hal_2_.getNext();
-			s_3 = hal_3_.getNext();
-			s_4 = hal_4_.getNext();
-		}
+		// The Halton sequences continue across the passes, so each pass shoots new photons
+		const unsigned int halton_index = photon_index_base_ + haltoncurr;
+		prng = Random(CounterRandom::getInt(halton_index, 0, 3)); //for the materials choosing their components randomly, such as the blend material
+		s_1 = Halton(2, halton_index).getNext();
+		s_2 = Halton(3, halton_index).getNext();
+		s_3 = Halton(5, halton_index).getNext();
+		s_4 = Halton(7, halton_index).getNext();
 
 		s_l = float(haltoncurr) * inv_diff_photons; // Does sL also need more random for each pass?
 		int light_num = light_power_d->dSample(s_l, &light_num_pdf);
 		if(light_num >= num_d_lights)
 		{
-			diffuse_map->mutx_.lock();
 			Y_ERROR << getName() << ": lightPDF sample error! " << s_l << "/" << light_num << "\n";
-			diffuse_map->mutx_.unlock();
 			return;
 		}
 
+		PhotonGuide::Sample guide_sample;
+		if(photon_guiding_) guide_sample = photon_guide_.sampleEmission(light_num, s_1, s_2, s_3, s_4);
+		bool useful_photon = false;
+
 		pcol = tmplights[light_num]->emitPhoton(s_1, s_2, s_3, s_4, ray, light_pdf);
 		ray.tmin_ = scene->ray_min_dist_;
 		ray.tmax_ = -1.0;
-		pcol *= f_num_lights * light_pdf / light_num_pdf; //remember that lightPdf is the inverse of th pdf, hence *=...
+		pcol *= f_num_lights * light_pdf * guide_sample.inv_pdf_ / light_num_pdf; //remember that lightPdf is the inverse of th pdf, hence *=...
 
 		if(pcol.isBlack())
 		{
+			if(photon_guiding_) photon_guide_.addPhoton(thread_id, light_num, guide_sample, false);
 			++curr;
-			done = (curr >= n_photons);
+			done = (curr >= n_photons_thread);
 			continue;
 		}
 
@@ -429,9 +557,7 @@ void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map
 		{
 			if(std::isnan(pcol.r_) || std::isnan(pcol.g_) || std::isnan(pcol.b_))
 			{
-				diffuse_map->mutx_.lock();
 				Y_WARNING << getName() << ": NaN  on photon color for light" << light_num + 1 << "." << YENDL;
-				diffuse_map->mutx_.unlock();
 				continue;
 			}
 
@@ -449,40 +575,33 @@ void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map
 
 			Vec3 wi = -ray.dir_, wo;
 			material = sp.material_;
+			render_data.material_data_ = render_data.allocMaterialData(material->getReqMem());
 			material->initBsdf(render_data, sp, bsdfs);
 
 			//deposit photon on diffuse surface, now we only have one map for all, elimate directPhoton for we estimate it directly
 			if(!direct_photon && !caustic_photon && bsdfs.hasAny(BsdfFlags::Diffuse))
 			{
-				Photon np(wi, sp.p_, pcol);// pcol used here
-
-				if(b_hashgrid_) photon_grid_.pushPhoton(np);
-				else
-				{
-					local_diffuse_photons.push_back(np);
-				}
+				if(photon_splatting_) visible_point_grid_.splat(sp.p_, wi, pcol, false);
+				else diffuse_photons.push_back(Photon(wi, sp.p_, pcol));// pcol used here
 				nd_photon_stored++;
+				if(photon_guiding_ && !useful_photon) useful_photon = photon_guide_.isVisible(sp.p_);
 			}
 			// add caustic photon
 			if(!direct_photon && caustic_photon && bsdfs.hasAny(BsdfFlags::Diffuse | BsdfFlags::Glossy))
 			{
-				Photon np(wi, sp.p_, pcol);// pcol used here
-
-				if(b_hashgrid_) photon_grid_.pushPhoton(np);
-				else
-				{
-					local_caustic_photons.push_back(np);
-				}
+				if(photon_splatting_) visible_point_grid_.splat(sp.p_, wi, pcol, true);
+				else caustic_photons.push_back(Photon(wi, sp.p_, pcol));// pcol used here
 				nd_photon_stored++;
+				if(photon_guiding_ && !useful_photon) useful_photon = photon_guide_.isVisible(sp.p_);
 			}
 
 			// need to break in the middle otherwise we scatter the photon and then discard it => redundant
 			if(n_bounces == max_bounces) break;
 
 			// scatter photon
-			s_5 = FastRandom::getNextFloatNormalized(); // now should use this to see correctness
-			s_6 = FastRandom::getNextFloatNormalized();
-			s_7 = FastRandom::getNextFloatNormalized();
+			s_5 = CounterRandom::getFloat(halton_index, n_bounces, 0);
+			s_6 = CounterRandom::getFloat(halton_index, n_bounces, 1);
+			s_7 = CounterRandom::getFloat(halton_index, n_bounces, 2);
 
 			PSample sample(s_5, s_6, s_7, BsdfFlags::All, pcol, transm);
 
@@ -509,46 +628,48 @@ void SppmIntegrator::photonWorker(PhotonMap *diffuse_map, PhotonMap *caustic_map
 			ray.tmax_ = -1.0;
 			++n_bounces;
 		}
+		if(photon_guiding_) photon_guide_.addPhoton(thread_id, light_num, guide_sample, useful_photon);
 		++curr;
 		if(curr % pb_step == 0)
 		{
-			pb->mutx_.lock();
-			pb->update();
-			pb->mutx_.unlock();
-			if(render_control.aborted()) { return; }
+			progress.addStep();
+			if(render_control.aborted()) { photons_shot = curr; return; }
 		}
 		done = (curr >= n_photons_thread);
 	}
-	diffuse_map->mutx_.lock();
-	caustic_map->mutx_.lock();
-	diffuse_map->appendVector(local_diffuse_photons, curr);
-	caustic_map->appendVector(local_caustic_photons, curr);
-	total_photons_shot += curr;
-	caustic_map->mutx_.unlock();
-	diffuse_map->mutx_.unlock();
+	photons_shot = curr;
 }
 
 
 //photon pass, scatter photon
 void SppmIntegrator::prePass(int samples, int offset, bool adaptive, const RenderControl &render_control, const RenderView *render_view)
 {
-	g_timer_global.addEvent("prepass");
-	g_timer_global.start("prepass");
+	if(photon_splatting_)
+	{
+		visible_point_grid_.build(visible_points_);
+		if(visible_point_grid_.empty()) return; // the first eye pass only records the visible points, there is nothing to splat into yet
+	}
+
+	scene_->getRenderControl().getTimer().addEvent("prepass");
+	scene_->getRenderControl().getTimer().start("prepass");
 
 	Y_INFO << getName() << ": Starting Photon tracing pass..." << YENDL;
 
-	if(b_hashgrid_) photon_grid_.clear();
+	if(photon_splatting_) Y_INFO << getName() << ": Splatting the photons into " << visible_point_grid_.size() << " visible points" << YENDL;
+	else if(b_hashgrid_) photon_grid_.clear();
 	else
 	{
-		session_global.diffuse_map_.get()->clear();
-		session_global.diffuse_map_.get()->setNumPaths(0);
-		session_global.diffuse_map_.get()->reserveMemory(n_photons_);
-		session_global.diffuse_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
-
-		session_global.caustic_map_.get()->clear();
-		session_global.caustic_map_.get()->setNumPaths(0);
-		session_global.caustic_map_.get()->reserveMemory(n_photons_);
-		session_global.caustic_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+		scene_->getSession().diffuse_map_.get()->clear();
+		scene_->getSession().diffuse_map_.get()->setNumPaths(0);
+		scene_->getSession().diffuse_map_.get()->reserveMemory(n_photons_);
+		scene_->getSession().diffuse_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+		scene_->getSession().diffuse_map_.get()->setHugePagesMode(scene_->getHugePagesMode());
+
+		scene_->getSession().caustic_map_.get()->clear();
+		scene_->getSession().caustic_map_.get()->setNumPaths(0);
+		scene_->getSession().caustic_map_.get()->reserveMemory(n_photons_);
+		scene_->getSession().caustic_map_.get()->setNumThreadsPkDtree(scene_->getNumThreadsPhotons());
+		scene_->getSession().caustic_map_.get()->setHugePagesMode(scene_->getHugePagesMode());
 	}
 
 	lights_ = render_view->getLightsVisible();
@@ -575,6 +696,7 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive, const Rende
 	energies = std::unique_ptr<float[]>(new float[num_d_lights]);
 
 	for(int i = 0; i < num_d_lights; ++i) energies[i] = tmplights[i]->totalEnergy().energy();
+	if(photon_guiding_) for(int i = 0; i < num_d_lights; ++i) energies[i] *= photon_guide_.getLightFactor(i); //the lights whose photons are seen are chosen more often, and their photons carry less power
 
 	light_power_d_ = std::unique_ptr<Pdf1D>(new Pdf1D(energies.get(), num_d_lights));
 
@@ -590,11 +712,6 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive, const Rende
 
 	//shoot photons
 	unsigned int curr = 0;
-	Random prng(rand() + offset * (4517) + 123);
-	RenderData render_data(&prng);
-	alignas (16) unsigned char userdata[user_data_size_];
-	render_data.arena_ = static_cast<void *>(userdata);
-	render_data.cam_ = render_view->getCamera();
 
 	std::shared_ptr<ProgressBar> pb;
 	std::string previous_progress_tag;
@@ -617,13 +734,39 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive, const Rende
 
 	int n_threads = scene_->getNumThreadsPhotons();
 
-	n_photons_ = std::max((unsigned int) n_threads, (n_photons_ / n_threads) * n_threads); //rounding the number of diffuse photons so it's a number divisible by the number of threads (distribute uniformly among the threads). At least 1 photon per thread
+	n_photons_ = std::max(1U, n_photons_);
 
 	Y_PARAMS << getName() << ": Shooting " << n_photons_ << " photons across " << n_threads << " threads (" << (n_photons_ / n_threads) << " photons/thread)" << YENDL;
 
 	std::vector<std::thread> threads;
-	for(int i = 0; i < n_threads; ++i) threads.push_back(std::thread(&SppmIntegrator::photonWorker, this, session_global.diffuse_map_.get(), session_global.caustic_map_.get(), i, scene_, render_view, std::ref(render_control), n_photons_, light_power_d_.get(), num_d_lights, tmplights, pb.get(), pb_step, std::ref(curr), max_bounces_, std::ref(prng)));
+	std::vector<std::vector<Photon>> diffuse_photon_chunks(n_threads), caustic_photon_chunks(n_threads);
+	std::vector<unsigned int> photons_shot(n_threads, 0);
+	PhotonShootingProgress progress(pb.get());
+	for(int i = 0; i < n_threads; ++i)
+	{
+		const unsigned int first_photon = static_cast<unsigned int>(static_cast<uint64_t>(n_photons_) * i / n_threads);
+		const unsigned int last_photon = static_cast<unsigned int>(static_cast<uint64_t>(n_photons_) * (i + 1) / n_threads);
+		threads.push_back(std::thread(&SppmIntegrator::photonWorker, this, std::ref(diffuse_photon_chunks[i]), std::ref(caustic_photon_chunks[i]), std::ref(photons_shot[i]), i, scene_, render_view, std::ref(render_control), n_photons_, first_photon, last_photon, light_power_d_.get(), num_d_lights, tmplights, std::ref(progress), pb_step, max_bounces_));
+	}
 	for(auto &t : threads) t.join();
+	progress.flush();
+
+	for(const auto &shot : photons_shot) curr += shot;
+	if(photon_guiding_) photon_guide_.update();
+	if(photon_splatting_) refineVisiblePoints();
+	else if(b_hashgrid_)
+	{
+		for(int i = 0; i < n_threads; ++i)
+		{
+			photon_grid_.photons_.insert(std::end(photon_grid_.photons_), std::begin(diffuse_photon_chunks[i]), std::end(diffuse_photon_chunks[i]));
+			photon_grid_.photons_.insert(std::end(photon_grid_.photons_), std::begin(caustic_photon_chunks[i]), std::end(caustic_photon_chunks[i]));
+		}
+	}
+	else
+	{
+		scene_->getSession().diffuse_map_.get()->appendChunks(diffuse_photon_chunks, curr);
+		scene_->getSession().caustic_map_.get()->appendChunks(caustic_photon_chunks, curr);
+	}
 
 	pb->done();
 	pb->setTag(previous_progress_tag + " - photon map built.");
@@ -631,30 +774,31 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive, const Rende
 	Y_INFO << getName() << ": Shot " << curr << " photons from " << num_d_lights << " light(s)" << YENDL;
 
 	totaln_photons_ +=  n_photons_;	// accumulate the total photon number, not using nPath for the case of hashgrid.
+	photon_index_base_ += n_photons_;
 
-	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Stored photons: " << session_global.diffuse_map_.get()->nPhotons() + session_global.caustic_map_.get()->nPhotons() << YENDL;
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Stored photons: " << scene_->getSession().diffuse_map_.get()->nPhotons() + scene_->getSession().caustic_map_.get()->nPhotons() << YENDL;
 
 	if(b_hashgrid_)
 	{
 		Y_INFO << getName() << ": Building photons hashgrid:" << YENDL;
-		photon_grid_.updateGrid();
+		photon_grid_.updateGrid(scene_->getNumThreadsPhotons());
 		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Done." << YENDL;
 	}
-	else
+	else if(!photon_splatting_)
 	{
-		if(session_global.diffuse_map_.get()->nPhotons() > 0)
+		if(scene_->getSession().diffuse_map_.get()->nPhotons() > 0)
 		{
 			Y_INFO << getName() << ": Building diffuse photons kd-tree:" << YENDL;
-			session_global.diffuse_map_.get()->updateTree();
+			scene_->getSession().diffuse_map_.get()->updateTree();
 			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Done." << YENDL;
 		}
-		if(session_global.caustic_map_.get()->nPhotons() > 0)
+		if(scene_->getSession().caustic_map_.get()->nPhotons() > 0)
 		{
 			Y_INFO << getName() << ": Building caustic photons kd-tree:" << YENDL;
-			session_global.caustic_map_.get()->updateTree();
+			scene_->getSession().caustic_map_.get()->updateTree();
 			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Done." << YENDL;
 		}
-		if(session_global.diffuse_map_.get()->nPhotons() < 50)
+		if(scene_->getSession().diffuse_map_.get()->nPhotons() < 50)
 		{
 			Y_ERROR << getName() << ": Too few photons, stopping now." << YENDL;
 			return;
@@ -663,12 +807,12 @@ void SppmIntegrator::prePass(int samples, int offset, bool adaptive, const Rende
 
 	tmplights.clear();
 
-	g_timer_global.stop("prepass");
+	scene_->getRenderControl().getTimer().stop("prepass");
 
 	if(b_hashgrid_)
-		Y_INFO << getName() << ": PhotonGrid building time: " << g_timer_global.getTime("prepass") << YENDL;
+		Y_INFO << getName() << ": PhotonGrid building time: " << scene_->getRenderControl().getTimer().getTime("prepass") << YENDL;
 	else
-		Y_INFO << getName() << ": PhotonMap building time: " << g_timer_global.getTime("prepass") << YENDL;
+		Y_INFO << getName() << ": PhotonMap building time: " << scene_->getRenderControl().getTimer().getTime("prepass") << YENDL;
 
 	if(intpb_)
 	{
@@ -685,7 +829,7 @@ Rgba SppmIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int
 }
 
 
-GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yafaray4::DiffRay &ray, yafaray4::HitPoint &hp, ColorLayers *color_layers)
+GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yafaray4::DiffRay &ray, size_t hit_point, ColorLayers *color_layers)
 {
 	const bool layers_used = render_data.raylevel_ == 1 && color_layers && color_layers->getFlags() != Layer::Flags::None;
 
@@ -697,16 +841,15 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 	float alpha;
 	SurfacePoint sp;
 
-	void *o_udat = render_data.arena_;
+	void *o_udat = render_data.material_data_;
 	const bool old_lights_geometry_material_emit = render_data.lights_geometry_material_emit_;
 
 	if(transp_background_) alpha = 0.0;
 	else alpha = 1.0;
 
-	if(scene_->intersect(ray, sp))
+	if(scene_->intersect(ray, sp, render_data.takePrimaryHit()))
 	{
-		alignas (16) unsigned char userdata[user_data_size_];
-		render_data.arena_ = static_cast<void *>(userdata);
+		render_data.material_data_ = render_data.allocMaterialData(sp.material_->getReqMem());
 		if(render_data.raylevel_ == 0)
 		{
 			render_data.chromatic_ = true;
@@ -729,7 +872,6 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 			if(ColorLayer *color_layer = color_layers->find(Layer::Emit)) color_layer->color_ += col_emit;
 		}
 		render_data.lights_geometry_material_emit_ = false;
-		SpDifferentials sp_diff(sp, ray);
 
 		if(bsdfs.hasAny(BsdfFlags::Diffuse))
 		{
@@ -737,40 +879,59 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 		}
 
 		// estimate radiance using photon map
-		auto gathered = std::unique_ptr<FoundPhoton[]>(new FoundPhoton[n_max_gather_global]);
+		const MemoryArena::Marker arena_marker = render_data.arena_.getMarker();
+		FoundPhoton *gathered = render_data.arena_.alloc<FoundPhoton>(n_max_gather_global); //reuses the blocks of the render thread arena at every shading point
 
 		//if PM_IRE is on. we should estimate the initial radius using the photonMaps. (PM_IRE is only for the first pass, so not consume much time)
-		if(pm_ire_ && !hp.radius_setted_) // "waste" two gather here as it has two maps now. This make the logic simple.
+		if(pm_ire_ && !hit_points_.radius_setted_[hit_point]) // "waste" two gather here as it has two maps now. This make the logic simple.
 		{
 			float radius_1 = ds_radius_ * ds_radius_;
 			float radius_2 = radius_1;
 			int n_gathered_1 = 0, n_gathered_2 = 0;
 
-			if(session_global.diffuse_map_.get()->nPhotons() > 0)
-				n_gathered_1 = session_global.diffuse_map_.get()->gather(sp.p_, gathered.get(), n_search_, radius_1);
-			if(session_global.caustic_map_.get()->nPhotons() > 0)
-				n_gathered_2 = session_global.caustic_map_.get()->gather(sp.p_, gathered.get(), n_search_, radius_2);
+			if(scene_->getSession().diffuse_map_.get()->nPhotons() > 0)
+				n_gathered_1 = scene_->getSession().diffuse_map_.get()->gather(sp.p_, gathered, n_search_, radius_1);
+			if(scene_->getSession().caustic_map_.get()->nPhotons() > 0)
+				n_gathered_2 = scene_->getSession().caustic_map_.get()->gather(sp.p_, gathered, n_search_, radius_2);
 			if(n_gathered_1 > 0 || n_gathered_2 > 0) // it none photon gathered, we just skip.
 			{
 				if(radius_1 < radius_2) // we choose the smaller one to be the initial radius.
-					hp.radius_2_ = radius_1;
+					hit_points_.radius_2_[hit_point] = radius_1;
 				else
-					hp.radius_2_ = radius_2;
+					hit_points_.radius_2_[hit_point] = radius_2;
 
-				hp.radius_setted_ = true;
+				hit_points_.radius_setted_[hit_point] = true;
 			}
 		}
 
 		int n_gathered = 0;
-		float radius_2 = hp.radius_2_;
+		float radius_2 = hit_points_.radius_2_[hit_point];
+		if(photon_guiding_) photon_guide_.markVisible(sp.p_, std::sqrt(radius_2)); //the photons of the next passes deposited here are the useful ones
 
-		if(b_hashgrid_)
-			n_gathered = photon_grid_.gather(sp.p_, gathered.get(), n_max_gather_global, radius_2); // disable now
+		if(photon_splatting_)
+		{
+			//the photons of the next pass are splatted into the visible point, as they would be gathered here from both photon maps
+			std::vector<VisiblePoint> &visible_points = visible_points_[render_data.thread_id_];
+			VisiblePoint visible_point;
+			visible_point.p_ = sp.p_;
+			visible_point.n_ = (sp.n_ * wo < 0.f) ? -sp.n_ : sp.n_;
+			visible_point.reflect_col_ = material->eval(render_data, sp, wo, visible_point.n_, BsdfFlags::Diffuse);
+			visible_point.transmit_col_ = material->eval(render_data, sp, wo, -visible_point.n_, BsdfFlags::Diffuse);
+			visible_point.radius_2_ = radius_2;
+			visible_point.hit_point_ = static_cast<unsigned int>(hit_point);
+			visible_point.caustics_ = bsdfs.hasAny(BsdfFlags::Diffuse);
+			g_info.visible_points_ = &visible_points;
+			g_info.visible_points_begin_ = visible_points.size();
+			visible_points.push_back(visible_point);
+			g_info.visible_points_end_ = visible_points.size();
+		}
+		else if(b_hashgrid_)
+			n_gathered = photon_grid_.gather(sp.p_, gathered, n_max_gather_global, radius_2); // disable now
 		else
 		{
-			if(session_global.diffuse_map_.get()->nPhotons() > 0) // this is needed to avoid a runtime error.
+			if(scene_->getSession().diffuse_map_.get()->nPhotons() > 0) // this is needed to avoid a runtime error.
 			{
-				n_gathered = session_global.diffuse_map_.get()->gather(sp.p_, gathered.get(), n_max_gather_global, radius_2); //we always collected all the photon inside the radius
+				n_gathered = scene_->getSession().diffuse_map_.get()->gather(sp.p_, gathered, n_max_gather_global, radius_2); //we always collected all the photon inside the radius
 			}
 
 			if(n_gathered > 0)
@@ -819,11 +980,11 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 			}
 
 			// gather caustics photons
-			if(bsdfs.hasAny(BsdfFlags::Diffuse) && session_global.caustic_map_.get()->ready())
+			if(bsdfs.hasAny(BsdfFlags::Diffuse) && scene_->getSession().caustic_map_.get()->ready())
 			{
 
-				radius_2 = hp.radius_2_; //reset radius2 & nGathered
-				n_gathered = session_global.caustic_map_.get()->gather(sp.p_, gathered.get(), n_max_gather_global, radius_2);
+				radius_2 = hit_points_.radius_2_[hit_point]; //reset radius2 & nGathered
+				n_gathered = scene_->getSession().caustic_map_.get()->gather(sp.p_, gathered, n_max_gather_global, radius_2);
 				if(n_gathered > 0)
 				{
 					Rgb surf_col(0.f);
@@ -845,6 +1006,7 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 				}
 			}
 		}
+		render_data.arena_.rewind(arena_marker);
 
 		render_data.raylevel_++;
 		if(render_data.raylevel_ <= (r_depth_ + additional_depth))
@@ -889,8 +1051,8 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 						Rgb wl_col;
 						wl2Rgb_global(render_data.wavelength_, wl_col);
 						ref_ray = DiffRay(sp.p_, wi, scene_->ray_min_dist_);
-						t_cing = traceGatherRay(render_data, ref_ray, hp);
-						t_cing.photon_flux_ *= mcol * wl_col * w;
+						t_cing = traceGatherRay(render_data, ref_ray, hit_point);
+						t_cing.scaleFlux(mcol * wl_col * w);
 						t_cing.constant_randiance_ *= mcol * wl_col * w;
 
 						if(layers_used)
@@ -899,19 +1061,18 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 						}
 
 						render_data.chromatic_ = true;
+						cing += t_cing;
 					}
-					cing += t_cing;
 				}
 				if(bsdfs.hasAny(BsdfFlags::Volumetric) && (vol = material->getVolumeHandler(sp.ng_ * ref_ray.dir_ < 0)))
 				{
 					vol->transmittance(render_data, ref_ray, vcol);
-					cing.photon_flux_ *= vcol;
+					cing.scaleFlux(vcol);
 					cing.constant_randiance_ *= vcol;
 				}
 
 				g_info.constant_randiance_ += cing.constant_randiance_ * d_1;
-				g_info.photon_flux_ += cing.photon_flux_ * d_1;
-				g_info.photon_count_ += cing.photon_count_ * d_1;
+				g_info.addPhotons(cing, Rgb(d_1), d_1);
 
 				if(layers_used)
 				{
@@ -979,8 +1140,8 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 						Rgb mcol = material->sample(render_data, sp, wo, wi, s, w);
 						Rgba integ = 0.f;
 						ref_ray = DiffRay(sp.p_, wi, scene_->ray_min_dist_);
-						if(s.sampled_flags_.hasAny(BsdfFlags::Reflect)) sp_diff.reflectedRay(ray, ref_ray);
-						else if(s.sampled_flags_.hasAny(BsdfFlags::Transmit)) sp_diff.refractedRay(ray, ref_ray, material->getMatIor());
+						if(s.sampled_flags_.hasAny(BsdfFlags::Reflect)) SpDifferentials::reflectedRay(sp, ray, ref_ray);
+						else if(s.sampled_flags_.hasAny(BsdfFlags::Transmit)) SpDifferentials::refractedRay(sp, ray, ref_ray, material->getMatIor());
 						integ = (Rgb) integrate(render_data, ref_ray, additional_depth, nullptr, nullptr);
 
 						if(bsdfs.hasAny(BsdfFlags::Volumetric) && (vol = material->getVolumeHandler(sp.ng_ * ref_ray.dir_ < 0)))
@@ -989,8 +1150,8 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 						}
 
 						//gcol += tmpColorPasses.probe_add(PASS_INT_GLOSSY_INDIRECT, (Rgb)integ * mcol * W, state.raylevel == 1);
-						t_ging = traceGatherRay(render_data, ref_ray, hp);
-						t_ging.photon_flux_ *= mcol * w;
+						t_ging = traceGatherRay(render_data, ref_ray, hit_point);
+						t_ging.scaleFlux(mcol * w);
 						t_ging.constant_randiance_ *= mcol * w;
 						ging += t_ging;
 					}
@@ -1007,7 +1168,7 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 						if(s.sampled_flags_.hasAny(BsdfFlags::Reflect) && !s.sampled_flags_.hasAny(BsdfFlags::Dispersive))
 						{
 							ref_ray = DiffRay(sp.p_, dir[0], scene_->ray_min_dist_);
-							sp_diff.reflectedRay(ray, ref_ray);
+							SpDifferentials::reflectedRay(sp, ray, ref_ray);
 							integ = integrate(render_data, ref_ray, additional_depth, nullptr, nullptr);
 							if(bsdfs.hasAny(BsdfFlags::Volumetric) && (vol = material->getVolumeHandler(sp.ng_ * ref_ray.dir_ < 0)))
 							{
@@ -1015,8 +1176,8 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 							}
 							Rgb col_reflect_factor = mcol[0] * w[0];
 
-							t_ging = traceGatherRay(render_data, ref_ray, hp);
-							t_ging.photon_flux_ *= col_reflect_factor;
+							t_ging = traceGatherRay(render_data, ref_ray, hit_point);
+							t_ging.scaleFlux(col_reflect_factor);
 							t_ging.constant_randiance_ *= col_reflect_factor;
 
 							if(layers_used)
@@ -1029,7 +1190,7 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 						if(s.sampled_flags_.hasAny(BsdfFlags::Transmit))
 						{
 							ref_ray = DiffRay(sp.p_, dir[1], scene_->ray_min_dist_);
-							sp_diff.refractedRay(ray, ref_ray, material->getMatIor());
+							SpDifferentials::refractedRay(sp, ray, ref_ray, material->getMatIor());
 							integ = integrate(render_data, ref_ray, additional_depth, nullptr, nullptr);
 							if(bsdfs.hasAny(BsdfFlags::Volumetric) && (vol = material->getVolumeHandler(sp.ng_ * ref_ray.dir_ < 0)))
 							{
@@ -1038,8 +1199,8 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 
 							Rgb col_transmit_factor = mcol[1] * w[1];
 							alpha = integ.a_;
-							t_ging = traceGatherRay(render_data, ref_ray, hp);
-							t_ging.photon_flux_ *= col_transmit_factor;
+							t_ging = traceGatherRay(render_data, ref_ray, hit_point);
+							t_ging.scaleFlux(col_transmit_factor);
 							t_ging.constant_randiance_ *= col_transmit_factor;
 							if(layers_used)
 							{
@@ -1054,12 +1215,12 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 						ref_ray = DiffRay(sp.p_, wi, scene_->ray_min_dist_);
 						if(diff_rays_enabled_)
 						{
-							if(s.sampled_flags_.hasAny(BsdfFlags::Reflect)) sp_diff.reflectedRay(ray, ref_ray);
-							else if(s.sampled_flags_.hasAny(BsdfFlags::Transmit)) sp_diff.refractedRay(ray, ref_ray, material->getMatIor());
+							if(s.sampled_flags_.hasAny(BsdfFlags::Reflect)) SpDifferentials::reflectedRay(sp, ray, ref_ray);
+							else if(s.sampled_flags_.hasAny(BsdfFlags::Transmit)) SpDifferentials::refractedRay(sp, ray, ref_ray, material->getMatIor());
 						}
 
-						t_ging = traceGatherRay(render_data, ref_ray, hp);
-						t_ging.photon_flux_ *= mcol * W;
+						t_ging = traceGatherRay(render_data, ref_ray, hit_point);
+						t_ging.scaleFlux(mcol * W);
 						t_ging.constant_randiance_ *= mcol * W;
 						if(layers_used)
 						{
@@ -1072,7 +1233,7 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 					{
 						if(vol->transmittance(render_data, ref_ray, vcol))
 						{
-							ging.photon_flux_ *= vcol;
+							ging.scaleFlux(vcol);
 							ging.constant_randiance_ *= vcol;
 						}
 					}
@@ -1080,8 +1241,7 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 				}
 
 				g_info.constant_randiance_ += ging.constant_randiance_ * d_1;
-				g_info.photon_flux_ += ging.photon_flux_ * d_1;
-				g_info.photon_count_ += ging.photon_count_ * d_1;
+				g_info.addPhotons(ging, Rgb(d_1), d_1);
 
 				if(layers_used)
 				{
@@ -1116,8 +1276,8 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 				if(specular.reflect_.enabled_)
 				{
 					DiffRay ref_ray(sp.p_, specular.reflect_.dir_, scene_->ray_min_dist_);
-					if(diff_rays_enabled_) sp_diff.reflectedRay(ray, ref_ray); // compute the ray differentaitl
-					GatherInfo refg = traceGatherRay(render_data, ref_ray, hp);
+					if(diff_rays_enabled_) SpDifferentials::reflectedRay(sp, ray, ref_ray); // compute the ray differentaitl
+					GatherInfo refg = traceGatherRay(render_data, ref_ray, hit_point);
 					const VolumeHandler *vol;
 					if(bsdfs.hasAny(BsdfFlags::Volumetric) && (vol = material->getVolumeHandler(sp.ng_ * ref_ray.dir_ < 0)))
 					{
@@ -1125,7 +1285,7 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 						if(vol->transmittance(render_data, ref_ray, vcol))
 						{
 							refg.constant_randiance_ *= vcol;
-							refg.photon_flux_ *= vcol;
+							refg.scaleFlux(vcol);
 						}
 					}
 					const Rgba col_radiance_reflect = refg.constant_randiance_ * Rgba(specular.reflect_.col_);
@@ -1134,14 +1294,13 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 					{
 						if(ColorLayer *color_layer = color_layers->find(Layer::ReflectPerfect)) color_layer->color_ += col_radiance_reflect;
 					}
-					g_info.photon_flux_ += refg.photon_flux_ * Rgba(specular.reflect_.col_);
-					g_info.photon_count_ += refg.photon_count_;
+					g_info.addPhotons(refg, specular.reflect_.col_);
 				}
 				if(specular.refract_.enabled_)
 				{
 					DiffRay ref_ray(sp.p_, specular.refract_.dir_, scene_->ray_min_dist_);
-					if(diff_rays_enabled_) sp_diff.refractedRay(ray, ref_ray, material->getMatIor());
-					GatherInfo refg = traceGatherRay(render_data, ref_ray, hp);
+					if(diff_rays_enabled_) SpDifferentials::refractedRay(sp, ray, ref_ray, material->getMatIor());
+					GatherInfo refg = traceGatherRay(render_data, ref_ray, hit_point);
 					const VolumeHandler *vol;
 					if(bsdfs.hasAny(BsdfFlags::Volumetric) && (vol = material->getVolumeHandler(sp.ng_ * ref_ray.dir_ < 0)))
 					{
@@ -1149,7 +1308,7 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 						if(vol->transmittance(render_data, ref_ray, vcol))
 						{
 							refg.constant_randiance_ *= vcol;
-							refg.photon_flux_ *= vcol;
+							refg.scaleFlux(vcol);
 						}
 					}
 					const Rgba col_radiance_refract = refg.constant_randiance_ * Rgba(specular.refract_.col_);
@@ -1158,8 +1317,7 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 					{
 						if(ColorLayer *color_layer = color_layers->find(Layer::RefractPerfect)) color_layer->color_ += col_radiance_refract;
 					}
-					g_info.photon_flux_ += refg.photon_flux_ * Rgba(specular.refract_.col_);
-					g_info.photon_count_ += refg.photon_count_;
+					g_info.addPhotons(refg, specular.refract_.col_);
 					alpha = refg.constant_randiance_.a_;
 				}
 			}
@@ -1202,7 +1360,7 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 		}
 	}
 
-	render_data.arena_ = o_udat;
+	render_data.material_data_ = o_udat;
 	render_data.lights_geometry_material_emit_ = old_lights_geometry_material_emit;
 
 	Rgba col_vol_transmittance = scene_->vol_integrator_->transmittance(render_data, ray);
@@ -1224,27 +1382,18 @@ GatherInfo SppmIntegrator::traceGatherRay(yafaray4::RenderData &render_data, yaf
 void SppmIntegrator::initializePpm(const RenderView *render_view)
 {
 	const Camera *camera = render_view->getCamera();
-	unsigned int resolution = camera->resX() * camera->resY();
+	//Only the pixels of the film get hit points, so a cropped render only keeps the hit points of its region
+	const unsigned int resolution = image_film_->getWidth() * image_film_->getHeight();
 
-	hit_points_.reserve(resolution);
 	Bound b_box = scene_->getSceneBound(); // Now using Scene Bound, this could get a bigger initial radius, and need more tests
 
 	// initialize SPPM statistics
 	float initial_radius = ((b_box.longX() + b_box.longY() + b_box.longZ()) / 3.f) / ((camera->resX() + camera->resY()) / 2.0f) * 2.f ;
 	initial_radius = std::min(initial_radius, 1.f); //Fix the overflow bug
-	for(unsigned int i = 0; i < resolution; i++)
-	{
-		HitPoint hp;
-		hp.acc_photon_flux_  = Rgba(0.f);
-		hp.acc_photon_count_ = 0;
-		hp.radius_2_ = (initial_radius * initial_factor_) * (initial_radius * initial_factor_);
-		hp.constant_randiance_ = Rgba(0.f);
-		hp.radius_setted_ = false;	   // the flag used for IRE
-
-		hit_points_.push_back(hp);
-	}
+	hit_points_.resize(resolution, (initial_radius * initial_factor_) * (initial_radius * initial_factor_), half_flux_);
 
 	if(b_hashgrid_) photon_grid_.setParm(initial_radius * 2.f, n_photons_, b_box);
+	if(photon_guiding_) photon_guide_.init(render_view->getLightsVisible().size(), scene_->getNumThreadsPhotons(), initial_radius * initial_factor_ * 2.f, std::max(1U << 16, 2 * resolution));
 
 }
 
@@ -1252,6 +1401,9 @@ std::unique_ptr<Integrator> SppmIntegrator::factory(ParamMap &params, const Scen
 {
 	bool transp_shad = false;
 	bool pm_ire = false;
+	bool photon_splatting = false;
+	bool half_flux = false;
+	bool photon_guiding = false;
 	int shadow_depth = 5; //may used when integrate Direct Light
 	int raydepth = 5;
 	int pass_num = 1000;
@@ -1278,6 +1430,9 @@ std::unique_ptr<Integrator> SppmIntegrator::factory(ParamMap &params, const Scen
 	params.getParam("photonRadius", ds_rad);
 	params.getParam("searchNum", search_num);
 	params.getParam("pmIRE", pm_ire);
+	params.getParam("photon_splatting", photon_splatting);
+	params.getParam("sppm_half_flux", half_flux);
+	params.getParam("photon_guiding", photon_guiding);
 
 	params.getParam("bg_transp", bg_transp);
 	params.getParam("bg_transp_refract", bg_transp_refract);
@@ -1293,7 +1448,10 @@ std::unique_ptr<Integrator> SppmIntegrator::factory(ParamMap &params, const Scen
 
 	inte->ds_radius_ = ds_rad; // under tests enable now
 	inte->n_search_ = search_num;
-	inte->pm_ire_ = pm_ire;
+	inte->photon_splatting_ = photon_splatting;
+	inte->half_flux_ = half_flux;
+	inte->photon_guiding_ = photon_guiding;
+	inte->pm_ire_ = pm_ire && !photon_splatting; // the initial radius estimate gathers from the photon maps
 	// Background settings
 	inte->transp_background_ = bg_transp;
 	inte->transp_refracted_background_ = bg_transp_refract;
@@ -25,6 +25,9 @@
 
 #include "integrator/surface/integrator_tiled.h"
 #include "common/logger.h"
+#include "common/render_stats.h"
+#include "common/trace.h"
+#include "accelerator/accelerator_stats.h"
 #include "common/session.h"
 #include "common/layers.h"
 #include "material/material.h"
@@ -33,6 +36,9 @@
 #include "common/timer.h"
 #include "sampler/halton.h"
 #include "render/imagefilm.h"
+#include "render/render_checkpoint.h"
+#include "render/render_view.h"
+#include "common/file.h"
 #include "camera/camera.h"
 #include "scene/scene.h"
 #include "render/monitor.h"
@@ -41,23 +47,44 @@
 #include "color/color_layers.h"
 #include "render/render_data.h"
 #include "output/output.h"
+#include "common/sysinfo.h"
+#include "math/random.h"
+#include "common/task_pool.h"
+#include <chrono>
 
 BEGIN_YAFARAY
 
 
-std::vector<int> TiledIntegrator::correlative_sample_number_(0);
-
-void TiledIntegrator::renderWorker(TiledIntegrator *integrator, const Scene *scene, const RenderView *render_view, const RenderControl &render_control, ThreadControl *control, int thread_id, int samples, int offset, bool adaptive, int aa_pass)
+void TiledIntegrator::renderWorker(TiledIntegrator *integrator, const Scene *scene, const RenderView *render_view, RenderControl &render_control, ThreadControl *control, int thread_id, int samples, int offset, bool adaptive, int aa_pass)
 {
 	RenderArea a;
+	//The areas are requested for the pool thread running the worker and not for the worker number, as each worker can run in a different pool thread in each pass while the pool threads stay in the same cores
+	const int area_thread_id = render_thread_pool_ ? render_thread_pool_->getCurrentThreadId() - 1 : thread_id;
 
-	while(image_film_->nextArea(a))
+	while(image_film_->nextArea(a, area_thread_id))
 	{
 		if(render_control.aborted()) break;
-		integrator->renderTile(a, render_view, render_control, samples, offset, adaptive, thread_id, aa_pass);
+		const auto tile_start = std::chrono::steady_clock::now();
+		const AcceleratorTraversalStats &traversal_stats = AcceleratorTraversalStats::threadStats();
+		const uint64_t rays_start = traversal_stats.rays_;
+		const uint64_t shadow_rays_start = traversal_stats.shadow_rays_;
+		a.num_camera_samples_ = 0;
+		{
+			TraceSpan trace_span("render", "tile");
+			trace_span.addArg("x", a.x_);
+			trace_span.addArg("y", a.y_);
+			trace_span.addArg("w", a.w_);
+			trace_span.addArg("h", a.h_);
+			trace_span.addArg("pass", aa_pass + 1);
+			integrator->renderTile(a, render_view, render_control, samples, offset, adaptive, thread_id, aa_pass);
+		}
+
+		const float tile_seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - tile_start).count();
+		render_control.addTileStats(thread_id, a.w_ * a.h_, tile_seconds, traversal_stats.rays_ - rays_start, traversal_stats.shadow_rays_ - shadow_rays_start, a.num_camera_samples_);
 
 		std::unique_lock<std::mutex> lk(control->m_);
-		control->areas_.push_back(a);
+		control->tile_costs_.push_back({a.x_, a.y_, a.w_, a.h_, tile_seconds});
+		control->areas_.push_back(std::move(a)); //moved, as the area carries its own accumulation buffer
 		control->c_.notify_one();
 
 	}
@@ -78,17 +105,19 @@ void TiledIntegrator::precalcDepths(const RenderView *render_view)
 	else
 	{
 		DiffRay ray;
-		// We sample the scene at render resolution to get the precision required for AA
-		int w = camera->resX();
-		int h = camera->resY();
+		// We sample the scene at render resolution to get the precision required for AA, only in the film region for cropped renders
+		const int x_0 = image_film_->getCx0();
+		const int y_0 = image_film_->getCy0();
+		const int x_1 = x_0 + image_film_->getWidth();
+		const int y_1 = y_0 + image_film_->getHeight();
 		float wt = 0.f; // Dummy variable
 		SurfacePoint sp;
-		for(int i = 0; i < h; ++i)
+		for(int i = y_0; i < y_1; ++i)
 		{
-			for(int j = 0; j < w; ++j)
+			for(int j = x_0; j < x_1; ++j)
 			{
 				ray.tmax_ = -1.f;
-				ray = camera->shootRay(i, j, 0.5f, 0.5f, wt);
+				ray = camera->shootRay(j, i, 0.5f, 0.5f, wt);
 				scene_->intersect(ray, sp);
 				if(ray.tmax_ > max_depth_) max_depth_ = ray.tmax_;
 				if(ray.tmax_ < min_depth_ && ray.tmax_ >= 0.f) min_depth_ = ray.tmax_;
@@ -103,6 +132,9 @@ bool TiledIntegrator::render(RenderControl &render_control, const RenderView *re
 {
 	std::stringstream pass_string;
 	aa_noise_params_ = scene_->getAaParameters();
+	sampler_ = Sampler::factory(aa_noise_params_.sampler_type_);
+	num_camera_samples_ = 0;
+	setupPrimaryHitCache(render_view);
 
 	std::stringstream aa_settings;
 	aa_settings << " passes=" << aa_noise_params_.passes_;
@@ -112,7 +144,12 @@ bool TiledIntegrator::render(RenderControl &render_control, const RenderView *re
 	else if(aa_noise_params_.dark_detection_type_ == AaNoiseParams::DarkDetectionType::Curve) aa_settings << " AA.thr(curve)";
 	else aa_settings << " AA thr=" << aa_noise_params_.threshold_;
 
+	if(aa_noise_params_.sampler_type_ == AaNoiseParams::SamplerType::Sobol) aa_settings << " sampler=sobol";
+
 	aa_settings << " var.edge=" << aa_noise_params_.variance_edge_size_ << " var.pix=" << aa_noise_params_.variance_pixels_ << " clamp=" << aa_noise_params_.clamp_samples_ << " ind.clamp=" << aa_noise_params_.clamp_indirect_;
+	if(aa_noise_params_.time_budget_ > 0.f) aa_settings << " time.budget=" << aa_noise_params_.time_budget_ << "s";
+	if(aa_noise_params_.noise_target_ > 0.f) aa_settings << " noise.target=" << aa_noise_params_.noise_target_ << "%";
+	if(aa_noise_params_.variance_sampling_) aa_settings << " var.sampling";
 
 	aa_noise_info_ += aa_settings.str();
 
@@ -145,6 +182,8 @@ bool TiledIntegrator::render(RenderControl &render_control, const RenderView *re
 		Y_VERBOSE << "AA_variance_pixels: " << aa_noise_params_.variance_pixels_ << YENDL;
 		Y_VERBOSE << "AA_clamp_samples: " << aa_noise_params_.clamp_samples_ << YENDL;
 		Y_VERBOSE << "AA_clamp_indirect: " << aa_noise_params_.clamp_indirect_ << YENDL;
+		if(aa_noise_params_.time_budget_ > 0.f) Y_VERBOSE << "AA_time_budget: " << aa_noise_params_.time_budget_ << "s" << YENDL;
+		if(aa_noise_params_.noise_target_ > 0.f) Y_VERBOSE << "AA_noise_target: " << aa_noise_params_.noise_target_ << "% of the pixels above the AA threshold" << YENDL;
 	}
 	Y_PARAMS << "Max. " << aa_noise_params_.samples_ + std::max(0, aa_noise_params_.passes_ - 1) * aa_noise_params_.inc_samples_ << " total samples" << YENDL;
 
@@ -153,8 +192,8 @@ bool TiledIntegrator::render(RenderControl &render_control, const RenderView *re
 	Y_INFO << pass_string.str() << YENDL;
 	if(intpb_) intpb_->setTag(pass_string.str().c_str());
 
-	g_timer_global.addEvent("rendert");
-	g_timer_global.start("rendert");
+	scene_->getRenderControl().getTimer().addEvent("rendert");
+	scene_->getRenderControl().getTimer().start("rendert");
 
 	image_film_->init(render_control, aa_noise_params_.passes_);
 	image_film_->setAaNoiseParams(aa_noise_params_);
@@ -171,7 +210,7 @@ bool TiledIntegrator::render(RenderControl &render_control, const RenderView *re
 	max_depth_ = 0.f;
 	min_depth_ = 1e38f;
 
-	diff_rays_enabled_ = session_global.getDifferentialRaysEnabled();	//enable ray differentials for mipmap calculation if there is at least one image texture using Mipmap interpolation
+	diff_rays_enabled_ = scene_->getSession().getDifferentialRaysEnabled();	//enable ray differentials for mipmap calculation if there is at least one image texture using Mipmap interpolation
 
 	if(scene_->getLayers().isDefinedAny({Layer::ZDepthNorm, Layer::Mist})) precalcDepths(render_view);
 
@@ -179,19 +218,44 @@ bool TiledIntegrator::render(RenderControl &render_control, const RenderView *re
 	correlative_sample_number_.resize(scene_->getNumThreads());
 	std::fill(correlative_sample_number_.begin(), correlative_sample_number_.end(), 0);
 
-	if(render_control.resumed())
+	//The render time of a camera sample measured in the last pass is used to fit the samples of the next pass in the time budget
+	const auto render_start = std::chrono::steady_clock::now();
+	auto elapsed_seconds = [&render_start]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start).count(); };
+	double sample_seconds = 0.0;
+	auto timed_render_pass = [&](int samples, int offset, bool adaptive, int aa_pass_number)
 	{
-		renderPass(render_view, 0, image_film_->getSamplingOffset(), false, 0, render_control);
-	}
-	else renderPass(render_view, aa_noise_params_.samples_, 0, false, 0, render_control);
+		const uint64_t camera_samples_start = num_camera_samples_;
+		const double pass_start = elapsed_seconds();
+		renderPass(render_view, samples, offset, adaptive, aa_pass_number, render_control);
+		const uint64_t pass_camera_samples = num_camera_samples_ - camera_samples_start;
+		if(pass_camera_samples > 0) sample_seconds = (elapsed_seconds() - pass_start) / pass_camera_samples;
+	};
 
 	bool aa_threshold_changed = true;
 	int resampled_pixels = 0;
 	int acum_aa_samples = aa_noise_params_.samples_;
+	int first_pass = 1;
+	const bool checkpoint_resumed = loadCheckpoint(render_view, render_control, aa_noise_params_.passes_, first_pass, acum_aa_samples, resampled_pixels, aa_threshold_changed);
 
-	for(int i = 1; i < aa_noise_params_.passes_; ++i)
+	if(!render_control.resumed() && !checkpoint_resumed) renderPreview(render_view, render_control);
+
+	if(checkpoint_resumed) Y_INFO << getName() << ": Resuming the render from the checkpoint after pass " << first_pass << YENDL;
+	else if(render_control.resumed())
+	{
+		timed_render_pass(0, image_film_->getSamplingOffset(), false, 0);
+	}
+	else timed_render_pass(aa_noise_params_.samples_, 0, false, 0);
+	if(!checkpoint_resumed) saveCheckpoint(render_view, render_control, 1, acum_aa_samples, resampled_pixels, aa_threshold_changed);
+
+	double next_pass_seconds = 0.0; //!< time of the last resampling check, to know if there is time left for another one
+	for(int i = first_pass; i < aa_noise_params_.passes_; ++i)
 	{
 		if(render_control.aborted()) break;
+		if(aa_noise_params_.time_budget_ > 0.f && elapsed_seconds() + next_pass_seconds >= aa_noise_params_.time_budget_)
+		{
+			Y_INFO << getName() << ": Render time budget of " << aa_noise_params_.time_budget_ << "s reached after " << i << " passes" << YENDL;
+			break;
+		}
 
 		//scene->getSurfIntegrator()->setSampleMultiplier(scene->getSurfIntegrator()->getSampleMultiplier() * AA_sample_multiplier_factor);
 
@@ -211,15 +275,39 @@ bool TiledIntegrator::render(RenderControl &render_control, const RenderView *re
 		else
 		{
 			image_film_->setAaThreshold(aa_noise_params_.threshold_);
+			const double next_pass_start = elapsed_seconds();
 			resampled_pixels = image_film_->nextPass(render_view, render_control, true, getName());
+			next_pass_seconds = elapsed_seconds() - next_pass_start;
 			aa_threshold_changed = false;
+			const float resampled_percent = 100.f * resampled_pixels / image_film_->getTotalPixels();
+			if(aa_noise_params_.noise_target_ > 0.f && resampled_percent <= aa_noise_params_.noise_target_)
+			{
+				Y_INFO << getName() << ": Noise target reached after " << i << " passes, " << resampled_percent << "% of the pixels above the AA threshold (target " << aa_noise_params_.noise_target_ << "%)" << YENDL;
+				break;
+			}
 		}
 
 		int aa_samples_mult = (int) ceilf(aa_noise_params_.inc_samples_ * aa_sample_multiplier_);
 
+		if(aa_noise_params_.time_budget_ > 0.f && resampled_pixels > 0 && sample_seconds > 0.0)
+		{
+			const double seconds_left = aa_noise_params_.time_budget_ - elapsed_seconds();
+			const double affordable_samples = seconds_left / (sample_seconds * resampled_pixels);
+			if(affordable_samples < 1.0)
+			{
+				Y_INFO << getName() << ": Render time budget of " << aa_noise_params_.time_budget_ << "s does not allow another pass, stopping after " << i << " passes" << YENDL;
+				break;
+			}
+			if(affordable_samples < aa_samples_mult)
+			{
+				if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Reducing the samples of pass " << i + 1 << " from " << aa_samples_mult << " to " << static_cast<int>(affordable_samples) << " to fit in the render time budget, " << seconds_left << "s left" << YENDL;
+				aa_samples_mult = static_cast<int>(affordable_samples);
+			}
+		}
+
 		if(Y_LOG_HAS_DEBUG) Y_DEBUG << "acumAASamples=" << acum_aa_samples << " AA_samples=" << aa_noise_params_.samples_ << " AA_samples_mult=" << aa_samples_mult << YENDL;
 
-		if(resampled_pixels > 0) renderPass(render_view, aa_samples_mult, acum_aa_samples, true, i, render_control);
+		if(resampled_pixels > 0) timed_render_pass(aa_samples_mult, acum_aa_samples, true, i);
 
 		acum_aa_samples += aa_samples_mult;
 
@@ -232,11 +320,13 @@ bool TiledIntegrator::render(RenderControl &render_control, const RenderView *re
 
 			if(aa_noise_params_.threshold_ > 0.f) aa_threshold_changed = true;
 		}
+		saveCheckpoint(render_view, render_control, i + 1, acum_aa_samples, resampled_pixels, aa_threshold_changed);
 	}
+	removeCheckpoint(render_view, render_control);
 	max_depth_ = 0.f;
-	g_timer_global.stop("rendert");
+	scene_->getRenderControl().getTimer().stop("rendert");
 	render_control.setFinished();
-	Y_INFO << getName() << ": Overall rendertime: " << g_timer_global.getTime("rendert") << "s" << YENDL;
+	Y_INFO << getName() << ": Overall rendertime: " << scene_->getRenderControl().getTimer().getTime("rendert") << "s" << YENDL;
 
 	return true;
 }
@@ -246,47 +336,261 @@ bool TiledIntegrator::renderPass(const RenderView *render_view, int samples, int
 {
 	if(Y_LOG_HAS_DEBUG) Y_DEBUG << "Sampling: samples=" << samples << " Offset=" << offset << " Base Offset=" << + image_film_->getBaseSamplingOffset() << "  AA_pass_number=" << aa_pass_number << YENDL;
 
+	TraceSpan trace_span("render", "AA pass");
+	trace_span.addArg("pass", aa_pass_number + 1);
+	trace_span.addArg("samples", samples);
 	prePass(samples, (offset + image_film_->getBaseSamplingOffset()), adaptive, render_control, render_view);
 
 	int nthreads = scene_->getNumThreads();
 
 	render_control.setCurrentPass(aa_pass_number + 1);
+	render_control.setPassPixels(image_film_->getPassPixels(), nthreads);
 
 	image_film_->setSamplingOffset(offset + samples);
 
+	//The render threads are kept between passes, the pool has one thread more than the render threads because the calling thread is counted as one of its threads but it does not run render workers, it outputs the finished areas instead
+	const bool threads_pinning = scene_->getThreadsPinning();
+	if(!render_thread_pool_ || render_thread_pool_->getNumThreads() != nthreads + 1 || render_threads_pinned_ != threads_pinning)
+	{
+		std::vector<int> worker_cpus;
+		if(threads_pinning)
+		{
+			worker_cpus = SysInfo().getNumaCpuOrder();
+			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": pinning " << nthreads << " render threads to " << worker_cpus.size() << " CPUs" << YENDL;
+		}
+		render_thread_pool_ = std::unique_ptr<TaskPool>(new TaskPool(nthreads + 1, worker_cpus));
+		render_threads_pinned_ = threads_pinning;
+	}
+
 	ThreadControl tc;
-	std::vector<std::thread> threads;
+	TaskPool::Group render_workers(*render_thread_pool_);
+	const int worker_offset = offset + image_film_->getBaseSamplingOffset();
 	for(int i = 0; i < nthreads; ++i)
 	{
-		threads.push_back(std::thread(&TiledIntegrator::renderWorker, this, this, scene_, render_view, std::ref(render_control), &tc, i, samples, (offset + image_film_->getBaseSamplingOffset()), adaptive, aa_pass_number));
+		render_workers.run([this, render_view, &render_control, &tc, i, samples, worker_offset, adaptive, aa_pass_number]
+		{
+			renderWorker(this, scene_, render_view, render_control, &tc, i, samples, worker_offset, adaptive, aa_pass_number);
+		});
 	}
 
+	//The finished areas are swapped out of the shared queue and output with the queue unlocked, so the render threads never wait for the color outputs when queuing their areas
+	std::vector<RenderArea> finished_areas;
 	std::unique_lock<std::mutex> lk(tc.m_);
-	while(tc.finished_threads_ < nthreads)
+	while(true)
+	{
+		tc.c_.wait(lk, [&tc, nthreads] { return !tc.areas_.empty() || tc.finished_threads_ >= nthreads; });
+		const bool all_threads_finished = (tc.finished_threads_ >= nthreads);
+		finished_areas.swap(tc.areas_);
+		lk.unlock();
+		for(auto &area : finished_areas) image_film_->finishArea(render_view, render_control, area);
+		finished_areas.clear();
+		if(all_threads_finished) break;
+		lk.lock();
+	}
+
+	render_workers.wait(); //the workers may still be returning after increasing the number of finished threads
+
+	last_pass_tile_costs_.swap(tc.tile_costs_);
+	if(Y_LOG_HAS_VERBOSE && !last_pass_tile_costs_.empty())
 	{
-		tc.c_.wait(lk);
-		for(size_t i = 0; i < tc.areas_.size(); ++i)
+		float total_seconds = 0.f;
+		const TileCost *slowest = &last_pass_tile_costs_.front();
+		for(const auto &tile_cost : last_pass_tile_costs_)
 		{
-			image_film_->finishArea(render_view, render_control, tc.areas_[i]);
+			total_seconds += tile_cost.seconds_;
+			if(tile_cost.seconds_ > slowest->seconds_) slowest = &tile_cost;
 		}
-		tc.areas_.clear();
+		const float average_seconds = total_seconds / last_pass_tile_costs_.size();
+		Y_VERBOSE << getName() << ": Tile costs of pass " << aa_pass_number + 1 << ": " << last_pass_tile_costs_.size() << " tiles, average " << average_seconds * 1000.f << "ms, slowest tile at (" << slowest->x_ << ", " << slowest->y_ << ") size " << slowest->w_ << "x" << slowest->h_ << " " << slowest->seconds_ * 1000.f << "ms (" << (average_seconds > 0.f ? slowest->seconds_ / average_seconds : 1.f) << " times the average)" << YENDL;
 	}
 
-	for(auto &t : threads) t.join();	//join all threads (although they probably have exited already, but not necessarily):
+	if(RenderStats::enabled())
+	{
+		const RenderStats pass_stats = RenderStats::collectPass();
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Render stats of pass " << aa_pass_number + 1 << ": " << pass_stats.toJson() << YENDL;
+	}
 
 	return true; //hm...quite useless the return value :)
 }
 
+void TiledIntegrator::renderPreview(const RenderView *render_view, const RenderControl &render_control)
+{
+	if(aa_noise_params_.preview_levels_ <= 0) return;
+	std::vector<ColorOutput *> outputs;
+	for(const auto &output : scene_->getOutputs())
+	{
+		if(output.second && !output.second->isImageOutput()) outputs.push_back(output.second.get());
+	}
+	if(outputs.empty()) return;
+
+	const Camera *camera = render_view->getCamera();
+	const int x_0 = image_film_->getCx0();
+	const int y_0 = image_film_->getCy0();
+	const int width = image_film_->getWidth();
+	const int height = image_film_->getHeight();
+	const int nthreads = scene_->getNumThreads();
+	TaskPool task_pool(nthreads);
+	std::vector<Rgba> coarse_colors;
+	std::vector<Rgba> band_colors;
+	for(int level = std::min(aa_noise_params_.preview_levels_, 6); level >= 1; --level)
+	{
+		const int step = 1 << level;
+		const int coarse_width = (width + step - 1) / step;
+		const int coarse_height = (height + step - 1) / step;
+		coarse_colors.assign(static_cast<size_t>(coarse_width) * coarse_height, Rgba(0.f));
+		{
+			//Each task renders the interleaved rows of one render thread, with its thread id, so the per thread data of the integrators is not shared
+			TaskPool::Group task_group(task_pool);
+			for(int thread_id = 0; thread_id < nthreads; ++thread_id)
+			{
+				task_group.run([&, thread_id, step, coarse_width, coarse_height]()
+				{
+					Random prng(123 + thread_id);
+					RenderData render_data(&prng);
+					render_data.thread_id_ = thread_id;
+					render_data.cam_ = camera;
+					ColorLayers color_layers(scene_->getLayers());
+					for(int coarse_y = thread_id; coarse_y < coarse_height; coarse_y += nthreads)
+					{
+						if(render_control.aborted()) return;
+						const int y = y_0 + std::min(coarse_y * step + step / 2, height - 1);
+						for(int coarse_x = 0; coarse_x < coarse_width; ++coarse_x)
+						{
+							const int x = x_0 + std::min(coarse_x * step + step / 2, width - 1);
+							float wt = 0.f;
+							const DiffRay ray = camera->shootRay(x + 0.5f, y + 0.5f, 0.5f, 0.5f, wt);
+							if(wt == 0.f) continue;
+							color_layers.setDefaultColors();
+							render_data.setDefaults();
+							render_data.arena_.reset();
+							render_data.pixel_number_ = camera->resX() * y + x;
+							render_data.sampling_offs_ = sample::fnv32ABuf(y * sample::fnv32ABuf(x));
+							render_data.pixel_sample_ = 0;
+							render_data.time_ = 0.5f;
+							coarse_colors[static_cast<size_t>(coarse_y) * coarse_width + coarse_x] = integrate(render_data, ray, 0, &color_layers, render_view);
+						}
+					}
+				});
+			}
+			task_group.wait();
+		}
+		if(render_control.aborted()) return;
+
+		//The coarse image is upscaled to the full resolution with the nearest neighbour, in bands of rows to limit the memory used
+		const int band_height = step * std::max(1, 64 / step);
+		for(int band_y = 0; band_y < height; band_y += band_height)
+		{
+			const int band_rows = std::min(band_height, height - band_y);
+			band_colors.resize(static_cast<size_t>(width) * band_rows);
+			for(int j = 0; j < band_rows; ++j)
+			{
+				const Rgba *coarse_row = &coarse_colors[static_cast<size_t>((band_y + j) / step) * coarse_width];
+				for(int i = 0; i < width; ++i) band_colors[static_cast<size_t>(j) * width + i] = coarse_row[i / step];
+			}
+			const std::vector<ColorLayerTile> color_layers_tiles {{ Layer::Combined, band_colors.data(), width }};
+			for(auto output : outputs)
+			{
+				output->putTile(0, band_y, width, band_rows, color_layers_tiles);
+				output->flushArea(x_0, y_0 + band_y, x_0 + width, y_0 + band_y + band_rows);
+			}
+		}
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Preview at 1/" << step << " of the resolution shown" << YENDL;
+	}
+}
+
+float TiledIntegrator::sampleWavelength(unsigned int index, unsigned int seed) const
+{
+	if(aa_noise_params_.sampler_type_ == AaNoiseParams::SamplerType::Sobol) return sampler_->sample(3, index, seed);
+	return sample::riS(index + seed);
+}
+
+//! state of the passes loop of the tiled and SPPM renders in the render checkpoints
+struct PassesCheckpoint
+{
+	int32_t next_pass_;
+	int32_t acum_aa_samples_;
+	int32_t resampled_pixels_;
+	int32_t aa_threshold_changed_;
+	float aa_sample_multiplier_, aa_light_sample_multiplier_, aa_indirect_sample_multiplier_;
+};
+
+void TiledIntegrator::saveCheckpoint(const RenderView *render_view, const RenderControl &render_control, int next_pass, int acum_aa_samples, int resampled_pixels, bool aa_threshold_changed) const
+{
+	if(!image_film_->checkpointsEnabled() || render_control.aborted() || next_pass % std::max(1, image_film_->getCheckpointParams().interval_passes_) != 0) return;
+	RenderCheckpoint checkpoint;
+	const std::string name = getName();
+	checkpoint.add("integrator.name", name.data(), name.size());
+	const PassesCheckpoint passes { next_pass, acum_aa_samples, resampled_pixels, aa_threshold_changed ? 1 : 0, aa_sample_multiplier_, aa_light_sample_multiplier_, aa_indirect_sample_multiplier_ };
+	checkpoint.addValue("integrator.passes", passes);
+	saveIntegratorCheckpoint(checkpoint);
+	image_film_->saveCheckpoint(checkpoint);
+	const std::string path = image_film_->getCheckpointPath(render_view->getName());
+	if(checkpoint.save(path) && Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": Render checkpoint saved to '" << path << "' after pass " << next_pass << YENDL;
+}
+
+bool TiledIntegrator::loadCheckpoint(const RenderView *render_view, RenderControl &render_control, int num_passes, int &next_pass, int &acum_aa_samples, int &resampled_pixels, bool &aa_threshold_changed)
+{
+	if(!image_film_->checkpointsEnabled()) return false;
+	const std::string path = image_film_->getCheckpointPath(render_view->getName());
+	if(!File::exists(path, true)) return false;
+	RenderCheckpoint checkpoint;
+	if(!checkpoint.load(path)) return false;
+	const std::string name = getName();
+	const char *saved_name = checkpoint.get<char>("integrator.name", name.size());
+	PassesCheckpoint passes;
+	if(!saved_name || name.compare(0, name.size(), saved_name, name.size()) != 0 || !checkpoint.getValue("integrator.passes", passes))
+	{
+		Y_WARNING << getName() << ": The render checkpoint '" << path << "' was saved by another integrator, starting the render from the beginning" << YENDL;
+		return false;
+	}
+	//The film is only changed if the whole checkpoint matches it, and it is cleared again if the integrator state does not match
+	if(!image_film_->loadCheckpoint(checkpoint))
+	{
+		Y_WARNING << getName() << ": The render checkpoint '" << path << "' does not match this render, starting the render from the beginning" << YENDL;
+		return false;
+	}
+	if(!loadIntegratorCheckpoint(checkpoint))
+	{
+		Y_WARNING << getName() << ": The render checkpoint '" << path << "' does not match the integrator settings, starting the render from the beginning" << YENDL;
+		image_film_->init(render_control, num_passes);
+		image_film_->setAaNoiseParams(aa_noise_params_);
+		return false;
+	}
+	next_pass = passes.next_pass_;
+	acum_aa_samples = passes.acum_aa_samples_;
+	resampled_pixels = passes.resampled_pixels_;
+	aa_threshold_changed = passes.aa_threshold_changed_ != 0;
+	aa_sample_multiplier_ = passes.aa_sample_multiplier_;
+	aa_light_sample_multiplier_ = passes.aa_light_sample_multiplier_;
+	aa_indirect_sample_multiplier_ = passes.aa_indirect_sample_multiplier_;
+	//The AA threshold lowered by the resampled pixels floor is kept by the film
+	aa_noise_params_.threshold_ = image_film_->getAaThreshold();
+	render_control.setCurrentPass(next_pass);
+	return true;
+}
+
+void TiledIntegrator::removeCheckpoint(const RenderView *render_view, const RenderControl &render_control) const
+{
+	if(!image_film_->checkpointsEnabled() || render_control.aborted()) return;
+	const std::string path = image_film_->getCheckpointPath(render_view->getName());
+	if(File::exists(path, true)) File::remove(path, true);
+}
+
+void TiledIntegrator::setupPrimaryHitCache(const RenderView *render_view)
+{
+	primary_hit_cache_.clear();
+	primary_hit_cache_.shrink_to_fit();
+	if(!scene_->getPrimaryHitCache() || render_view->getCamera()->sampleLense()) return;
+	primary_hit_cache_.resize(static_cast<size_t>(image_film_->getTotalPixels()) * primary_hit_strata_, nullptr);
+}
+
 bool TiledIntegrator::renderTile(RenderArea &a, const RenderView *render_view, const RenderControl &render_control, int n_samples, int offset, bool adaptive, int thread_id, int aa_pass_number)
 {
 	int x;
 	const Camera *camera = render_view->getCamera();
 	x = camera->resX();
-	DiffRay c_ray;
-	Ray d_ray;
 	float dx = 0.5, dy = 0.5, d_1 = 1.0 / (float)n_samples;
 	float lens_u = 0.5f, lens_v = 0.5f;
-	float wt, wt_dummy;
 	Random prng(rand() + offset * (x * a.y_ + a.x_) + 123);
 	RenderData rstate(&prng);
 	rstate.thread_id_ = thread_id;
@@ -305,10 +609,18 @@ bool TiledIntegrator::renderTile(RenderArea &a, const RenderView *render_view, c
 
 	Halton hal_u(3);
 	Halton hal_v(5);
-
-	const Layers &layers = scene_->getLayers();
-	const MaskParams &mask_params = layers.getMaskParams();
-	ColorLayers color_layers(layers);
+	const bool sobol = aa_noise_params_.sampler_type_ == AaNoiseParams::SamplerType::Sobol;
+
+	ColorLayers color_layers(scene_->getLayers());
+	const bool sort_by_material = scene_->getShadingSortByMaterial();
+	std::vector<CameraSample> camera_samples;
+	if(sort_by_material) camera_samples.reserve(max_sorted_camera_samples_);
+	uint64_t num_camera_samples = 0;
+	//The camera rays of each row of the area are shot in one batch once all its samples are generated
+	std::vector<CameraSample> row_camera_samples;
+	std::vector<CameraRaySample> row_ray_samples;
+	std::vector<DiffRay> row_rays;
+	std::vector<float> row_weights;
 
 	const Image *sampling_factor_image_pass = (*image_film_->getImageLayers())(Layer::DebugSamplingFactor).image_.get();
 
@@ -317,6 +629,8 @@ bool TiledIntegrator::renderTile(RenderArea &a, const RenderView *render_view, c
 
 	for(int i = a.y_; i < end_y; ++i)
 	{
+		row_camera_samples.clear();
+		row_ray_samples.clear();
 		for(int j = a.x_; j < end_x; ++j)
 		{
 			if(render_control.aborted()) break;
@@ -337,6 +651,7 @@ bool TiledIntegrator::renderTile(RenderArea &a, const RenderView *render_view, c
 
 					if(mat_sample_factor > 0.f && mat_sample_factor < 1.f) mat_sample_factor = 1.f;	//This is to ensure in the edges between objects and background we always shoot samples. Otherwise we might not shoot enough samples at the boundaries with the background where they are needed for antialiasing. However if the factor is equal to 0.f (as in the background) then no more samples will be shot
 				}
+				mat_sample_factor *= image_film_->getVarianceSampleFactor(j - film_cx_0, i - film_cy_0);
 
 				if(mat_sample_factor != 1.f)
 				{
@@ -351,19 +666,31 @@ bool TiledIntegrator::renderTile(RenderArea &a, const RenderView *render_view, c
 			rstate.sampling_offs_ = sample::fnv32ABuf(i * sample::fnv32ABuf(j)); //fnv_32a_buf(rstate.pixelNumber);
 			float toff = Halton::lowDiscrepancySampling(5, pass_offs + rstate.sampling_offs_); // **shall be just the pass number...**
 
+			//the camera samples get a seed of their own, so they are not correlated with the integrator samples of the same index
+			const unsigned int camera_seed = sample::fnv32ABuf(rstate.sampling_offs_);
+
 			hal_u.setStart(pass_offs + rstate.sampling_offs_);
 			hal_v.setStart(pass_offs + rstate.sampling_offs_);
 
 			for(int sample = 0; sample < n_samples_adjusted; ++sample)
 			{
-				color_layers.setDefaultColors();
-				rstate.setDefaults();
 				rstate.pixel_sample_ = pass_offs + sample;
 				rstate.time_ = math::addMod1((float) sample * d_1, toff); //(0.5+(float)sample)*d1;
 
+				if(sobol)
+				{
+					rstate.time_ = sampler_->sample(4, rstate.pixel_sample_, camera_seed);
+					dx = sampler_->sample(0, rstate.pixel_sample_, camera_seed);
+					dy = sampler_->sample(1, rstate.pixel_sample_, camera_seed);
+					if(sample_lns)
+					{
+						lens_u = sampler_->sample(2, rstate.pixel_sample_, camera_seed);
+						lens_v = sampler_->sample(3, rstate.pixel_sample_, camera_seed);
+					}
+				}
 				// the (1/n, Larcher&Pillichshammer-Seq.) only gives good coverage when total sample count is known
 				// hence we use scrambled (Sobol, van-der-Corput) for multipass AA
-				if(aa_noise_params_.passes_ > 1)
+				else if(aa_noise_params_.passes_ > 1)
 				{
 					dx = sample::riVdC(rstate.pixel_sample_, rstate.sampling_offs_);
 					dy = sample::riS(rstate.pixel_sample_, rstate.sampling_offs_);
@@ -374,88 +701,169 @@ bool TiledIntegrator::renderTile(RenderArea &a, const RenderView *render_view, c
 					dy = sample::riLp(sample + rstate.sampling_offs_);
 				}
 
-				if(sample_lns)
+				if(sample_lns && !sobol)
 				{
 					lens_u = hal_u.getNext();
 					lens_v = hal_v.getNext();
 				}
-				c_ray = camera->shootRay(j + dx, i + dy, lens_u, lens_v, wt);
+				RenderStats::add(RenderStats::CameraSamples);
+				++num_camera_samples;
+				row_ray_samples.push_back({ j + dx, i + dy, lens_u, lens_v });
+				CameraSample camera_sample;
+				camera_sample.x_ = j;
+				camera_sample.y_ = i;
+				camera_sample.sample_ = sample;
+				camera_sample.dx_ = dx;
+				camera_sample.dy_ = dy;
+				camera_sample.pixel_sample_ = rstate.pixel_sample_;
+				camera_sample.pixel_number_ = rstate.pixel_number_;
+				camera_sample.sampling_offs_ = rstate.sampling_offs_;
+				camera_sample.time_ = rstate.time_;
+				row_camera_samples.push_back(camera_sample);
+			}
+		}
 
-				if(wt == 0.0)
-				{
-					image_film_->addSample(j, i, dx, dy, &a, sample, aa_pass_number, inv_aa_max_possible_samples, &color_layers);
-					continue;
-				}
-				if(diff_rays_enabled_)
-				{
-					//setup ray differentials
-					d_ray = camera->shootRay(j + 1 + dx, i + dy, lens_u, lens_v, wt_dummy);
-					c_ray.xfrom_ = d_ray.from_;
-					c_ray.xdir_ = d_ray.dir_;
-					d_ray = camera->shootRay(j + dx, i + 1 + dy, lens_u, lens_v, wt_dummy);
-					c_ray.yfrom_ = d_ray.from_;
-					c_ray.ydir_ = d_ray.dir_;
-					c_ray.has_differentials_ = true;
-				}
+		const size_t num_row_samples = row_camera_samples.size();
+		if(num_row_samples == 0 || render_control.aborted()) continue;
+		row_rays.resize(num_row_samples);
+		row_weights.resize(num_row_samples);
+		camera->shootRays(row_ray_samples.data(), num_row_samples, row_rays.data(), row_weights.data(), diff_rays_enabled_);
+		for(size_t sample_id = 0; sample_id < num_row_samples; ++sample_id)
+		{
+			CameraSample &camera_sample = row_camera_samples[sample_id];
+			camera_sample.ray_ = row_rays[sample_id];
+			camera_sample.wt_ = row_weights[sample_id];
+			camera_sample.ray_.time_ = camera_sample.time_;
+
+			if(!sort_by_material)
+			{
+				renderCameraSample(rstate, camera_sample, a, color_layers, render_view, aa_pass_number, inv_aa_max_possible_samples);
+				continue;
+			}
+			camera_samples.push_back(camera_sample);
+			if(camera_samples.size() >= max_sorted_camera_samples_)
+			{
+				renderCameraSamplesSorted(rstate, camera_samples, a, color_layers, render_view, aa_pass_number, inv_aa_max_possible_samples);
+				camera_samples.clear();
+			}
+		}
+	}
+	if(!camera_samples.empty() && !render_control.aborted()) renderCameraSamplesSorted(rstate, camera_samples, a, color_layers, render_view, aa_pass_number, inv_aa_max_possible_samples);
+	num_camera_samples_ += num_camera_samples;
+	a.num_camera_samples_ = num_camera_samples;
+	return true;
+}
 
-				c_ray.time_ = rstate.time_;
+void TiledIntegrator::renderCameraSample(RenderData &render_data, const CameraSample &camera_sample, RenderArea &a, ColorLayers &color_layers, const RenderView *render_view, int aa_pass_number, float inv_aa_max_possible_samples) const
+{
+	if(color_layers.isCombinedOnly()) renderCameraSampleLayers<true>(render_data, camera_sample, a, color_layers, render_view, aa_pass_number, inv_aa_max_possible_samples);
+	else renderCameraSampleLayers<false>(render_data, camera_sample, a, color_layers, render_view, aa_pass_number, inv_aa_max_possible_samples);
+}
+
+template <bool combined_only>
+void TiledIntegrator::renderCameraSampleLayers(RenderData &render_data, const CameraSample &camera_sample, RenderArea &a, ColorLayers &color_layers, const RenderView *render_view, int aa_pass_number, float inv_aa_max_possible_samples) const
+{
+	Rgba &combined_color = color_layers(Layer::Combined).color_;
+	if(combined_only) combined_color = Layer::getDefaultColor(Layer::Combined);
+	else color_layers.setDefaultColors();
+	render_data.setDefaults();
+	render_data.arena_.reset(); //no material data is kept between camera samples
+	render_data.pixel_sample_ = camera_sample.pixel_sample_;
+	render_data.pixel_number_ = camera_sample.pixel_number_;
+	render_data.sampling_offs_ = camera_sample.sampling_offs_;
+	render_data.time_ = camera_sample.time_;
+	render_data.primary_hit_ = primaryHitSlot((camera_sample.y_ - image_film_->getCy0()) * image_film_->getWidth() + camera_sample.x_ - image_film_->getCx0(), camera_sample.dx_, camera_sample.dy_);
+
+	if(camera_sample.wt_ == 0.f)
+	{
+		image_film_->addSample(camera_sample.x_, camera_sample.y_, camera_sample.dx_, camera_sample.dy_, &a, camera_sample.sample_, aa_pass_number, inv_aa_max_possible_samples, &color_layers);
+		return;
+	}
+
+	if(combined_only)
+	{
+		combined_color = integrate(render_data, camera_sample.ray_, 0, &color_layers, render_view);
+		combined_color *= camera_sample.wt_;
+		if(combined_color.a_ > 1.f) combined_color.a_ = 1.f;
+		image_film_->addSample(camera_sample.x_, camera_sample.y_, camera_sample.dx_, camera_sample.dy_, &a, camera_sample.sample_, aa_pass_number, inv_aa_max_possible_samples, &color_layers);
+		return;
+	}
 
-				color_layers(Layer::Combined).color_ = integrate(rstate, c_ray, 0, &color_layers, render_view);
+	const MaskParams &mask_params = scene_->getLayers().getMaskParams();
+	ColorLayer *render_time_layer = color_layers.getFlags().hasAny(Layer::Flags::DebugLayers) ? color_layers.find(Layer::DebugRenderTime) : nullptr;
+	const auto integrate_start = render_time_layer ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+	combined_color = integrate(render_data, camera_sample.ray_, 0, &color_layers, render_view);
+	if(render_time_layer)
+	{
+		const float microseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - integrate_start).count();
+		render_time_layer->color_ = Rgba(microseconds, microseconds, microseconds, 1.f);
+	}
 
-				for(auto &it : color_layers)
+	for(auto &it : color_layers)
+	{
+		switch(it.first)
+		{
+			case Layer::ObjIndexMask:
+			case Layer::ObjIndexMaskShadow:
+			case Layer::ObjIndexMaskAll:
+			case Layer::MatIndexMask:
+			case Layer::MatIndexMaskShadow:
+			case Layer::MatIndexMaskAll:
+				it.second.color_ *= camera_sample.wt_;
+				if(it.second.color_.a_ > 1.f) it.second.color_.a_ = 1.f;
+				it.second.color_.clampRgb01();
+				if(mask_params.invert_)
 				{
-					switch(it.first)
-					{
-						case Layer::ObjIndexMask:
-						case Layer::ObjIndexMaskShadow:
-						case Layer::ObjIndexMaskAll:
-						case Layer::MatIndexMask:
-						case Layer::MatIndexMaskShadow:
-						case Layer::MatIndexMaskAll:
-							it.second.color_ *= wt;
-							if(it.second.color_.a_ > 1.f) it.second.color_.a_ = 1.f;
-							it.second.color_.clampRgb01();
-							if(mask_params.invert_)
-							{
-								it.second.color_ = Rgba(1.f) - it.second.color_;
-							}
-							if(!mask_params.only_)
-							{
-								Rgba col_combined = color_layers(Layer::Combined).color_;
-								col_combined.a_ = 1.f;
-								it.second.color_ *= col_combined;
-							}
-							break;
-						case Layer::ZDepthAbs:
-							if(c_ray.tmax_ < 0.f) it.second.color_ = Rgba(0.f, 0.f); // Show background as fully transparent
-							else it.second.color_ = Rgb(c_ray.tmax_);
-							it.second.color_ *= wt;
-							if(it.second.color_.a_ > 1.f) it.second.color_.a_ = 1.f;
-							break;
-						case Layer::ZDepthNorm:
-							if(c_ray.tmax_ < 0.f) it.second.color_ = Rgba(0.f, 0.f); // Show background as fully transparent
-							else it.second.color_ = Rgb(1.f - (c_ray.tmax_ - min_depth_) * max_depth_); // Distance normalization
-							it.second.color_ *= wt;
-							if(it.second.color_.a_ > 1.f) it.second.color_.a_ = 1.f;
-							break;
-						case Layer::Mist:
-							if(c_ray.tmax_ < 0.f) it.second.color_ = Rgba(0.f, 0.f); // Show background as fully transparent
-							else it.second.color_ = Rgb((c_ray.tmax_ - min_depth_) * max_depth_); // Distance normalization
-							it.second.color_ *= wt;
-							if(it.second.color_.a_ > 1.f) it.second.color_.a_ = 1.f;
-							break;
-						default:
-							it.second.color_ *= wt;
-							if(it.second.color_.a_ > 1.f) it.second.color_.a_ = 1.f;
-							break;
-					}
+					it.second.color_ = Rgba(1.f) - it.second.color_;
 				}
-
-				image_film_->addSample(j, i, dx, dy, &a, sample, aa_pass_number, inv_aa_max_possible_samples, &color_layers);
-			}
+				if(!mask_params.only_)
+				{
+					Rgba col_combined = combined_color;
+					col_combined.a_ = 1.f;
+					it.second.color_ *= col_combined;
+				}
+				break;
+			case Layer::ZDepthAbs:
+				if(camera_sample.ray_.tmax_ < 0.f) it.second.color_ = Rgba(0.f, 0.f); // Show background as fully transparent
+				else it.second.color_ = Rgb(camera_sample.ray_.tmax_);
+				it.second.color_ *= camera_sample.wt_;
+				if(it.second.color_.a_ > 1.f) it.second.color_.a_ = 1.f;
+				break;
+			case Layer::ZDepthNorm:
+				if(camera_sample.ray_.tmax_ < 0.f) it.second.color_ = Rgba(0.f, 0.f); // Show background as fully transparent
+				else it.second.color_ = Rgb(1.f - (camera_sample.ray_.tmax_ - min_depth_) * max_depth_); // Distance normalization
+				it.second.color_ *= camera_sample.wt_;
+				if(it.second.color_.a_ > 1.f) it.second.color_.a_ = 1.f;
+				break;
+			case Layer::Mist:
+				if(camera_sample.ray_.tmax_ < 0.f) it.second.color_ = Rgba(0.f, 0.f); // Show background as fully transparent
+				else it.second.color_ = Rgb((camera_sample.ray_.tmax_ - min_depth_) * max_depth_); // Distance normalization
+				it.second.color_ *= camera_sample.wt_;
+				if(it.second.color_.a_ > 1.f) it.second.color_.a_ = 1.f;
+				break;
+			default:
+				it.second.color_ *= camera_sample.wt_;
+				if(it.second.color_.a_ > 1.f) it.second.color_.a_ = 1.f;
+				break;
 		}
 	}
-	return true;
+
+	image_film_->addSample(camera_sample.x_, camera_sample.y_, camera_sample.dx_, camera_sample.dy_, &a, camera_sample.sample_, aa_pass_number, inv_aa_max_possible_samples, &color_layers);
+}
+
+void TiledIntegrator::renderCameraSamplesSorted(RenderData &render_data, const std::vector<CameraSample> &camera_samples, RenderArea &a, ColorLayers &color_layers, const RenderView *render_view, int aa_pass_number, float inv_aa_max_possible_samples) const
+{
+	//The camera rays are intersected first as one ray stream, only to know the material of their first hit
+	std::vector<Ray> rays;
+	rays.reserve(camera_samples.size());
+	for(const auto &camera_sample : camera_samples) rays.push_back(camera_sample.ray_);
+	std::vector<SurfacePoint> hits;
+	const std::vector<bool> hit = scene_->intersect(rays, hits);
+
+	std::vector<int> camera_sample_ids(camera_samples.size());
+	for(size_t id = 0; id < camera_samples.size(); ++id) camera_sample_ids[id] = static_cast<int>(id);
+	groupByMaterial(camera_sample_ids, [&](int id) { return hit[id] ? hits[id].material_ : nullptr; });
+	for(const int id : camera_sample_ids) renderCameraSample(render_data, camera_samples[id], a, color_layers, render_view, aa_pass_number, inv_aa_max_possible_samples);
 }
 
 void TiledIntegrator::generateCommonLayers(RenderData &render_data, const SurfacePoint &sp, const DiffRay &ray, ColorLayers *color_layers) const
@@ -0,0 +1,582 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "integrator/surface/integrator_vcm.h"
+#include "color/color_layers.h"
+#include "common/logger.h"
+#include "common/param.h"
+#include "camera/camera.h"
+#include "render/imagefilm.h"
+#include "render/render_view.h"
+#include "render/render_data.h"
+#include "render/render_checkpoint.h"
+#include "scene/scene.h"
+#include "light/light.h"
+#include "light/light_tree.h"
+#include "material/material.h"
+#include "background/background.h"
+#include "sampler/sample_pdf1d.h"
+#include "math/random.h"
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+BEGIN_YAFARAY
+
+/*	The MIS quantities follow the notation of Georgiev et al. 2012 and their SmallVCM implementation. The pdfs of the
+	materials and lights are scaled by pi (a diffuse BSDF has the pdf |cos|), so they are divided by pi for the MIS
+	quantities, which compare them with the camera pdf and the merging areas. The contributions keep the scaled values,
+	which cancel out with the scaled BSDF and light colors as in the other integrators */
+static constexpr float inv_pi_global = static_cast<float>(M_1_PI);
+
+VcmIntegrator::VcmIntegrator(Mode mode, int max_path_length, int num_light_paths, float radius_factor, float radius_alpha, int num_connections) : max_path_length_(max_path_length), num_light_paths_(num_light_paths), num_connections_(num_connections), radius_factor_(radius_factor), radius_alpha_(radius_alpha)
+{
+	use_vc_ = (mode != Mode::Ppm);
+	use_vm_ = (mode != Mode::Bpt);
+}
+
+bool VcmIntegrator::preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *image_film)
+{
+	image_film_ = image_film;
+	lights_ = render_view->getLightsVisible();
+	light_power_d_ = render_view->getLightsVisiblePowerPdf();
+	if(!light_power_d_)
+	{
+		Y_ERROR << getName() << ": no visible lights with emitted energy, cannot trace the light paths" << YENDL;
+		return false;
+	}
+	const int num_lights = lights_.size();
+	light_pick_pdfs_.resize(num_lights);
+	for(int i = 0; i < num_lights; ++i) light_pick_pdfs_[i] = light_power_d_->func_[i] * light_power_d_->inv_integral_ / num_lights;
+
+	emitting_lights_.clear();
+	std::vector<float> energies;
+	for(int i = 0; i < num_lights; ++i)
+	{
+		LightBounds bounds;
+		if(!lights_[i]->getBounds(bounds)) continue;
+		emitting_lights_.push_back(i);
+		energies.push_back(lights_[i]->totalEnergy().energy());
+	}
+	emit_pick_pdfs_.assign(num_lights, 0.f);
+	emitting_power_d_ = nullptr;
+	if(!emitting_lights_.empty()) emitting_power_d_ = std::unique_ptr<Pdf1D>(new Pdf1D(energies.data(), energies.size()));
+	if(emitting_power_d_ && emitting_power_d_->integral_ > 0.f)
+	{
+		for(size_t i = 0; i < emitting_lights_.size(); ++i) emit_pick_pdfs_[emitting_lights_[i]] = emitting_power_d_->func_[i] * emitting_power_d_->inv_integral_ / emitting_lights_.size();
+	}
+	else
+	{
+		emitting_power_d_ = nullptr;
+		Y_WARNING << getName() << ": no visible lights with bounded emission, only the eye subpaths will be traced" << YENDL;
+	}
+
+	const Camera *camera = render_view->getCamera();
+	light_tracing_ = use_vc_ && emitting_power_d_ && !camera->sampleLense();
+	image_film_->setDensityEstimation(light_tracing_);
+	light_tracing_factor_ = M_PI / (static_cast<float>(image_film_->getWidth()) * image_film_->getHeight());
+	background_light_ = scene_->getBackground() && scene_->getBackground()->hasIbl();
+
+	const Bound scene_bound = scene_->getSceneBound();
+	base_radius_ = radius_factor_ * 0.5f * (scene_bound.g_ - scene_bound.a_).length();
+	pass_ = 0;
+	total_light_paths_ = 0;
+
+	const int num_threads = scene_->getNumThreads();
+	light_prngs_.clear();
+	light_render_data_.clear();
+	for(int i = 0; i < num_threads; ++i)
+	{
+		light_prngs_.push_back(std::unique_ptr<Random>(new Random(123 + (i + 1) * 4517)));
+		light_render_data_.push_back(std::unique_ptr<RenderData>(new RenderData(light_prngs_.back().get())));
+		light_render_data_.back()->cam_ = camera;
+		light_render_data_.back()->thread_id_ = i;
+	}
+
+	std::stringstream set;
+	set << "VCM  ";
+	if(!use_vm_) set << "mode=BPT  ";
+	else if(!use_vc_) set << "mode=PPM  ";
+	set << "LightPaths=" << num_light_paths_ << " Radius=" << base_radius_ << " Alpha=" << radius_alpha_ << "  ";
+	render_info_ += set.str();
+
+	return true;
+}
+
+void VcmIntegrator::prePass(int samples, int offset, bool adaptive, const RenderControl &render_control, const RenderView *render_view)
+{
+	++pass_;
+	pass_light_paths_ = emitting_power_d_ ? num_light_paths_ : 0;
+	radius_ = std::max(1.0e-7f, base_radius_ * std::pow(static_cast<float>(pass_), 0.5f * (radius_alpha_ - 1.f)));
+	const float radius_2 = radius_ * radius_;
+	//The merging strategy of a light vertex has the pdf of its connection times the probability of one of the light subpaths landing in the merging disk
+	const float eta_vcm = M_PI * radius_2 * pass_light_paths_;
+	mis_vm_weight_factor_ = (use_vm_ && eta_vcm > 0.f) ? eta_vcm : 0.f;
+	mis_vc_weight_factor_ = (use_vc_ && eta_vcm > 0.f) ? 1.f / eta_vcm : 0.f;
+	vm_normalization_ = (pass_light_paths_ > 0) ? 1.f / (radius_2 * pass_light_paths_) : 0.f; //the pi of the merging disk area cancels out with the pi of the light subpath throughput
+
+	light_vertices_.clear();
+	if(pass_light_paths_ > 0)
+	{
+		const Camera *camera = render_view->getCamera();
+		const int num_threads = light_render_data_.size();
+		std::vector<std::vector<LightVertex>> thread_light_vertices(num_threads);
+		std::vector<std::thread> threads;
+		for(int i = 0; i < num_threads; ++i)
+		{
+			const int num_paths = pass_light_paths_ * (i + 1) / num_threads - pass_light_paths_ * i / num_threads;
+			threads.push_back(std::thread(&VcmIntegrator::lightPathWorker, this, std::ref(thread_light_vertices[i]), i, num_paths, camera));
+		}
+		for(auto &t : threads) t.join();
+
+		size_t num_light_vertices = 0;
+		for(const auto &vertices : thread_light_vertices) num_light_vertices += vertices.size();
+		light_vertices_.reserve(num_light_vertices);
+		for(auto &vertices : thread_light_vertices)
+		{
+			light_vertices_.insert(light_vertices_.end(), std::make_move_iterator(vertices.begin()), std::make_move_iterator(vertices.end()));
+			std::vector<LightVertex>().swap(vertices);
+		}
+		total_light_paths_ += pass_light_paths_;
+		if(light_tracing_) image_film_->setNumDensitySamples(total_light_paths_);
+	}
+
+	const float mean_light_path_vertices = (pass_light_paths_ > 0) ? static_cast<float>(light_vertices_.size()) / pass_light_paths_ : 0.f;
+	pass_connections_ = (num_connections_ > 0) ? num_connections_ : std::max(1, static_cast<int>(std::lround(mean_light_path_vertices)));
+	connection_factor_ = mean_light_path_vertices / pass_connections_;
+	if(use_vm_ && !light_vertices_.empty()) buildLightVertexGrid();
+
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << getName() << ": pass " << pass_ << ", " << pass_light_paths_ << " light subpaths with " << light_vertices_.size() << " vertices, merging radius " << radius_ << YENDL;
+}
+
+void VcmIntegrator::cleanup()
+{
+	if(image_film_ && light_tracing_) image_film_->setNumDensitySamples(total_light_paths_);
+	std::vector<LightVertex>().swap(light_vertices_);
+	std::vector<unsigned int>().swap(grid_cell_starts_);
+	for(auto &render_data : light_render_data_) render_data->arena_.reset();
+}
+
+void VcmIntegrator::saveIntegratorCheckpoint(RenderCheckpoint &checkpoint) const
+{
+	//the light tracing image is kept by the film as its density image
+	const int32_t passes[2] { pass_, total_light_paths_ };
+	checkpoint.add("vcm.passes", passes, 2);
+}
+
+bool VcmIntegrator::loadIntegratorCheckpoint(const RenderCheckpoint &checkpoint)
+{
+	const int32_t *passes = checkpoint.get<int32_t>("vcm.passes", 2);
+	if(!passes) return false;
+	pass_ = passes[0];
+	total_light_paths_ = passes[1];
+	return true;
+}
+
+void VcmIntegrator::lightPathWorker(std::vector<LightVertex> &light_vertices, int thread_id, int num_paths, const Camera *camera) const
+{
+	RenderData &render_data = *light_render_data_[thread_id];
+	render_data.arena_.reset(); //the material data of the light vertices of the previous pass are not used anymore
+	render_data.chromatic_ = true;
+	Random &prng = *render_data.prng_;
+	light_vertices.clear();
+	light_vertices.reserve(num_paths * 2);
+
+	for(int path = 0; path < num_paths; ++path)
+	{
+		float emitting_light_pdf;
+		const int emitting_light = std::min(static_cast<int>(emitting_lights_.size()) - 1, emitting_power_d_->dSample(prng(), &emitting_light_pdf));
+		const int light_id = emitting_lights_[emitting_light];
+		const float light_pick_pdf = emit_pick_pdfs_[light_id];
+		SurfacePoint light_sp;
+		LSample ls(&light_sp);
+		ls.s_1_ = prng(), ls.s_2_ = prng(), ls.s_3_ = prng(), ls.s_4_ = prng();
+		Ray ray;
+		const Rgb light_col = lights_[light_id]->emitSample(ray.dir_, ls);
+		if(light_col.isBlack() || ls.area_pdf_ <= 0.f || ls.dir_pdf_ <= 0.f) continue;
+
+		const float emission_pdf = ls.area_pdf_ * ls.dir_pdf_ * light_pick_pdf;
+		const float cos_light = ls.flags_.hasAny(Light::Flags::Singular) ? 1.f : std::abs(light_sp.n_ * ray.dir_); //singularities have no surface, hence no normal
+		SubpathState state;
+		state.throughput_ = light_col * cos_light / emission_pdf;
+		//The eye subpaths only hit the lights through specular vertices, where no other strategy is possible, so there is no strategy
+		//ending on the light source to account for (d_vc_ = 0), the same as for the lights with a delta distribution
+		state.d_vcm_ = ls.area_pdf_ * light_pick_pdf * inv_pi_global / (emission_pdf * inv_pi_global * inv_pi_global);
+		ray.from_ = light_sp.p_;
+		ray.tmin_ = scene_->ray_min_dist_;
+		ray.tmax_ = -1.f;
+
+		SurfacePoint sp;
+		while(scene_->intersect(ray, sp))
+		{
+			const Vec3 wi = -ray.dir_;
+			const float cos_in = std::abs(sp.n_ * wi);
+			if(cos_in <= 0.f) break;
+			state.d_vcm_ *= (sp.p_ - ray.from_).lengthSqr() / cos_in;
+			state.d_vc_ /= cos_in;
+			state.d_vm_ /= cos_in;
+
+			const Material *material = sp.material_;
+			BsdfFlags bsdfs;
+			render_data.material_data_ = render_data.allocMaterialData(material->getReqMem());
+			material->initBsdf(render_data, sp, bsdfs);
+			if(bsdfs.hasAny(BsdfFlags::Diffuse | BsdfFlags::Glossy))
+			{
+				const LightVertex vertex {sp, render_data.material_data_, state.throughput_, wi, state.d_vcm_, state.d_vc_, state.d_vm_, state.path_length_};
+				light_vertices.push_back(vertex);
+				if(light_tracing_) connectToCamera(render_data, vertex, camera);
+			}
+			if(state.path_length_ + 2 > max_path_length_) break; //the shortest eye subpath adds another two segments to the light vertices
+			if(!sampleScattering(render_data, sp, wi, state, ray)) break;
+			++state.path_length_;
+		}
+	}
+}
+
+bool VcmIntegrator::sampleScattering(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, SubpathState &state, Ray &ray) const
+{
+	Random &prng = *render_data.prng_;
+	const Material *material = sp.material_;
+	Sample s(prng(), prng(), BsdfFlags::All);
+	float w = 0.f;
+	Vec3 wi;
+	const Rgb f = material->sample(render_data, sp, wo, wi, s, w);
+	if(f.isBlack() || s.pdf_ <= 0.f) return false;
+
+	const float cos_out = std::abs(sp.n_ * wi);
+	if(s.sampled_flags_.hasAny(BsdfFlags::Specular))
+	{
+		//the direct and reverse pdfs of a specular direction are the same delta, which cancels out
+		state.d_vcm_ = 0.f;
+		state.d_vc_ *= cos_out;
+		state.d_vm_ *= cos_out;
+	}
+	else
+	{
+		const float dir_pdf = s.pdf_ * inv_pi_global;
+		const float rev_pdf = material->pdf(render_data, sp, wi, wo, BsdfFlags::All) * inv_pi_global;
+		state.d_vc_ = (cos_out / dir_pdf) * (state.d_vc_ * rev_pdf + state.d_vcm_ + mis_vm_weight_factor_);
+		state.d_vm_ = (cos_out / dir_pdf) * (state.d_vm_ * rev_pdf + state.d_vcm_ * mis_vc_weight_factor_ + 1.f);
+		state.d_vcm_ = 1.f / dir_pdf;
+		state.specular_path_ = false;
+	}
+	state.throughput_ *= f * w;
+	ray = Ray(sp.p_, wi, scene_->ray_min_dist_);
+	return true;
+}
+
+void VcmIntegrator::connectToCamera(RenderData &render_data, const LightVertex &vertex, const Camera *camera) const
+{
+	Vec3 dir_to_camera = camera->getPosition() - vertex.sp_.p_;
+	const float dist_2 = dir_to_camera.lengthSqr();
+	if(dist_2 <= 0.f) return;
+	const float dist = math::sqrt(dist_2);
+	dir_to_camera *= 1.f / dist;
+	float u, v, camera_pdf;
+	if(!camera->project(Ray(camera->getPosition(), -dir_to_camera), 0.f, 0.f, u, v, camera_pdf)) return;
+
+	render_data.material_data_ = vertex.material_data_;
+	const Material *material = vertex.sp_.material_;
+	const Rgb f = material->eval(render_data, vertex.sp_, vertex.wi_, dir_to_camera, BsdfFlags::All);
+	if(f.isBlack()) return;
+	const float rev_pdf = material->pdf(render_data, vertex.sp_, dir_to_camera, vertex.wi_, BsdfFlags::All) * inv_pi_global;
+	//The projection pdf of the camera is 8 pi / (image plane area at unit distance * cos^3), and the importance of one pixel is resX * resY times the one of the whole image
+	const float image_to_solid_angle = camera_pdf * static_cast<float>(0.125 * M_1_PI) * camera->resX() * camera->resY();
+	const float camera_pdf_a = image_to_solid_angle * std::abs(vertex.sp_.n_ * dir_to_camera) / dist_2;
+	const float w_light = (camera_pdf_a / pass_light_paths_) * (mis_vm_weight_factor_ + vertex.d_vcm_ + vertex.d_vc_ * rev_pdf);
+	const float mis_weight = 1.f / (w_light + 1.f);
+
+	float mask_obj_index = 0.f, mask_mat_index = 0.f;
+	const Ray shadow_ray(vertex.sp_.p_, dir_to_camera, scene_->shadow_bias_, dist);
+	if(scene_->isShadowed(render_data, shadow_ray, mask_obj_index, mask_mat_index)) return;
+
+	//Normalized by the film with its size over the number of light subpaths
+	const Rgb contribution = (mis_weight * light_tracing_factor_ * camera_pdf_a) * vertex.throughput_ * f;
+	float ix, iy;
+	const float idx = std::modf(u, &ix);
+	const float idy = std::modf(v, &iy);
+	image_film_->addDensitySample(contribution, ix, iy, idx, idy);
+}
+
+Rgb VcmIntegrator::connectToLight(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const SubpathState &state) const
+{
+	Random &prng = *render_data.prng_;
+	float light_pdf;
+	const int light_id = std::min(static_cast<int>(lights_.size()) - 1, light_power_d_->dSample(prng(), &light_pdf));
+	const Light *light = lights_[light_id];
+	SurfacePoint light_sp;
+	LSample ls(&light_sp);
+	ls.s_1_ = prng(), ls.s_2_ = prng();
+	Ray light_ray;
+	light_ray.from_ = sp.p_;
+	if(!light->illumSample(sp, ls, light_ray) || ls.col_.isBlack() || ls.pdf_ <= 0.f) return Rgb(0.f);
+	const Material *material = sp.material_;
+	const Rgb f = material->eval(render_data, sp, wo, light_ray.dir_, BsdfFlags::All);
+	if(f.isBlack()) return Rgb(0.f);
+
+	const float cos_to_light = std::abs(sp.n_ * light_ray.dir_);
+	const float direct_pdf = ls.pdf_ * light_pick_pdfs_[light_id];
+	float w_light = 0.f;
+	if(emit_pick_pdfs_[light_id] > 0.f)
+	{
+		float area_pdf = 0.f, dir_pdf = 0.f, cos_at_light = 1.f;
+		light->emitPdf(light_sp, -light_ray.dir_, area_pdf, dir_pdf, cos_at_light);
+		if(cos_at_light > 0.f)
+		{
+			const float emission_pdf = area_pdf * dir_pdf * emit_pick_pdfs_[light_id] * inv_pi_global * inv_pi_global;
+			const float rev_pdf = material->pdf(render_data, sp, light_ray.dir_, wo, BsdfFlags::All) * inv_pi_global;
+			w_light = (emission_pdf * cos_to_light / (direct_pdf * inv_pi_global * cos_at_light)) * (mis_vm_weight_factor_ + state.d_vcm_ + state.d_vc_ * rev_pdf);
+		}
+	}
+	const float mis_weight = 1.f / (w_light + 1.f);
+
+	float mask_obj_index = 0.f, mask_mat_index = 0.f;
+	light_ray.tmin_ = scene_->shadow_bias_;
+	if(scene_->isShadowed(render_data, light_ray, mask_obj_index, mask_mat_index)) return Rgb(0.f);
+	return (mis_weight * cos_to_light / direct_pdf) * ls.col_ * f;
+}
+
+Rgb VcmIntegrator::connectToLightVertices(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const SubpathState &state) const
+{
+	Random &prng = *render_data.prng_;
+	void *const material_data = render_data.material_data_;
+	const Material *material = sp.material_;
+	Rgb col(0.f);
+	for(int i = 0; i < pass_connections_; ++i)
+	{
+		const LightVertex &vertex = light_vertices_[std::min(light_vertices_.size() - 1, static_cast<size_t>(prng() * light_vertices_.size()))];
+		if(vertex.path_length_ + 1 + state.path_length_ > max_path_length_) continue;
+		Vec3 dir = vertex.sp_.p_ - sp.p_;
+		const float dist_2 = dir.lengthSqr();
+		if(dist_2 <= 0.f) continue;
+		const float dist = math::sqrt(dist_2);
+		dir *= 1.f / dist;
+
+		render_data.material_data_ = material_data;
+		const Rgb eye_f = material->eval(render_data, sp, wo, dir, BsdfFlags::All);
+		if(eye_f.isBlack()) continue;
+		const float eye_dir_pdf = material->pdf(render_data, sp, wo, dir, BsdfFlags::All) * inv_pi_global;
+		const float eye_rev_pdf = material->pdf(render_data, sp, dir, wo, BsdfFlags::All) * inv_pi_global;
+
+		render_data.material_data_ = vertex.material_data_;
+		const Material *light_material = vertex.sp_.material_;
+		const Rgb light_f = light_material->eval(render_data, vertex.sp_, vertex.wi_, -dir, BsdfFlags::All);
+		if(light_f.isBlack()) continue;
+		const float light_dir_pdf = light_material->pdf(render_data, vertex.sp_, vertex.wi_, -dir, BsdfFlags::All) * inv_pi_global;
+		const float light_rev_pdf = light_material->pdf(render_data, vertex.sp_, -dir, vertex.wi_, BsdfFlags::All) * inv_pi_global;
+
+		const float cos_eye = std::abs(sp.n_ * dir);
+		const float cos_light = std::abs(vertex.sp_.n_ * dir);
+		const float w_light = (eye_dir_pdf * cos_light / dist_2) * (mis_vm_weight_factor_ + vertex.d_vcm_ + vertex.d_vc_ * light_rev_pdf);
+		const float w_eye = (light_dir_pdf * cos_eye / dist_2) * (mis_vm_weight_factor_ + state.d_vcm_ + state.d_vc_ * eye_rev_pdf);
+		const float mis_weight = 1.f / (w_light + 1.f + w_eye);
+
+		float mask_obj_index = 0.f, mask_mat_index = 0.f;
+		const Ray shadow_ray(sp.p_, dir, scene_->shadow_bias_, dist);
+		if(scene_->isShadowed(render_data, shadow_ray, mask_obj_index, mask_mat_index)) continue;
+		col += (mis_weight * cos_eye * cos_light / dist_2) * eye_f * light_f * vertex.throughput_;
+	}
+	render_data.material_data_ = material_data;
+	return col * connection_factor_;
+}
+
+Rgb VcmIntegrator::mergeLightVertices(RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const SubpathState &state) const
+{
+	const Material *material = sp.material_;
+	const float radius_2 = radius_ * radius_;
+	//With cells twice the radius, the merging sphere overlaps at most two cells along each axis
+	const int x_0 = static_cast<int>(std::floor((sp.p_.x_ - radius_) * grid_inv_cell_size_));
+	const int y_0 = static_cast<int>(std::floor((sp.p_.y_ - radius_) * grid_inv_cell_size_));
+	const int z_0 = static_cast<int>(std::floor((sp.p_.z_ - radius_) * grid_inv_cell_size_));
+	unsigned int visited_cells[8];
+	int num_visited_cells = 0;
+	Rgb col(0.f);
+	for(int z = z_0; z <= z_0 + 1; ++z)
+	{
+		for(int y = y_0; y <= y_0 + 1; ++y)
+		{
+			for(int x = x_0; x <= x_0 + 1; ++x)
+			{
+				const unsigned int cell = gridCell(x, y, z);
+				if(std::find(visited_cells, visited_cells + num_visited_cells, cell) != visited_cells + num_visited_cells) continue; //hash collision of the cells around the point
+				visited_cells[num_visited_cells++] = cell;
+				for(unsigned int i = grid_cell_starts_[cell]; i < grid_cell_starts_[cell + 1]; ++i)
+				{
+					const LightVertex &vertex = light_vertices_[i];
+					if((vertex.sp_.p_ - sp.p_).lengthSqr() > radius_2) continue;
+					if(vertex.path_length_ + state.path_length_ > max_path_length_) continue;
+					const Rgb f = material->eval(render_data, sp, wo, vertex.wi_, BsdfFlags::All);
+					if(f.isBlack()) continue;
+					const float eye_dir_pdf = material->pdf(render_data, sp, wo, vertex.wi_, BsdfFlags::All) * inv_pi_global;
+					const float eye_rev_pdf = material->pdf(render_data, sp, vertex.wi_, wo, BsdfFlags::All) * inv_pi_global;
+					const float w_light = vertex.d_vcm_ * mis_vc_weight_factor_ + vertex.d_vm_ * eye_dir_pdf;
+					const float w_eye = state.d_vcm_ * mis_vc_weight_factor_ + state.d_vm_ * eye_rev_pdf;
+					col += (1.f / (w_light + 1.f + w_eye)) * f * vertex.throughput_;
+				}
+			}
+		}
+	}
+	return col * vm_normalization_;
+}
+
+void VcmIntegrator::buildLightVertexGrid()
+{
+	//Counting sort of the light vertices by hash cell, as in the photon HashGrid, so the vertices of each cell are contiguous
+	const size_t num_vertices = light_vertices_.size();
+	grid_inv_cell_size_ = 1.f / (2.f * radius_);
+	grid_size_ = std::max(static_cast<unsigned int>(num_vertices), 1U);
+	std::vector<unsigned int> vertex_cells(num_vertices);
+	grid_cell_starts_.assign(grid_size_ + 1, 0);
+	for(size_t i = 0; i < num_vertices; ++i)
+	{
+		const Point3 &p = light_vertices_[i].sp_.p_;
+		vertex_cells[i] = gridCell(static_cast<int>(std::floor(p.x_ * grid_inv_cell_size_)), static_cast<int>(std::floor(p.y_ * grid_inv_cell_size_)), static_cast<int>(std::floor(p.z_ * grid_inv_cell_size_)));
+		++grid_cell_starts_[vertex_cells[i] + 1];
+	}
+	for(unsigned int cell = 0; cell < grid_size_; ++cell) grid_cell_starts_[cell + 1] += grid_cell_starts_[cell];
+	std::vector<unsigned int> positions(grid_cell_starts_.begin(), grid_cell_starts_.end() - 1);
+	std::vector<LightVertex> sorted_vertices(num_vertices);
+	for(size_t i = 0; i < num_vertices; ++i) sorted_vertices[positions[vertex_cells[i]]++] = light_vertices_[i];
+	light_vertices_.swap(sorted_vertices);
+}
+
+Rgb VcmIntegrator::traceEyePath(RenderData &render_data, const Ray &ray, SurfacePoint sp, const Camera *camera) const
+{
+	SubpathState state;
+	if(light_tracing_)
+	{
+		float u, v, camera_pdf = 0.f;
+		if(camera->project(ray, 0.f, 0.f, u, v, camera_pdf) && camera_pdf > 0.f) state.d_vcm_ = pass_light_paths_ / (camera_pdf * static_cast<float>(0.125 * M_1_PI) * camera->resX() * camera->resY());
+	}
+	Rgb col(0.f);
+	Ray eye_ray(ray);
+	while(true)
+	{
+		const Vec3 wo = -eye_ray.dir_;
+		const float cos_in = std::abs(sp.n_ * wo);
+		if(cos_in <= 0.f) break;
+		state.d_vcm_ *= (sp.p_ - eye_ray.from_).lengthSqr() / cos_in;
+		state.d_vc_ /= cos_in;
+		state.d_vm_ /= cos_in;
+
+		const Material *material = sp.material_;
+		BsdfFlags bsdfs;
+		render_data.material_data_ = render_data.allocMaterialData(material->getReqMem());
+		material->initBsdf(render_data, sp, bsdfs);
+		if(bsdfs.hasAny(BsdfFlags::Emit))
+		{
+			//Only the eye subpaths through specular vertices can reach the lights, the others are connected to them
+			render_data.lights_geometry_material_emit_ = state.specular_path_;
+			col += state.throughput_ * material->emit(render_data, sp, wo);
+		}
+		if(state.path_length_ >= max_path_length_) break;
+
+		if(bsdfs.hasAny(BsdfFlags::Diffuse | BsdfFlags::Glossy))
+		{
+			if(use_vc_) col += state.throughput_ * connectToLight(render_data, sp, wo, state);
+			if(use_vc_ && !light_vertices_.empty()) col += state.throughput_ * connectToLightVertices(render_data, sp, wo, state);
+			if(use_vm_ && !light_vertices_.empty()) col += state.throughput_ * mergeLightVertices(render_data, sp, wo, state);
+		}
+		if(!sampleScattering(render_data, sp, wo, state, eye_ray)) break;
+		++state.path_length_;
+		if(!scene_->intersect(eye_ray, sp))
+		{
+			//The background light samples the background from the non specular vertices
+			if(scene_->getBackground() && (!background_light_ || state.specular_path_)) col += state.throughput_ * (*scene_->getBackground())(eye_ray, render_data);
+			break;
+		}
+	}
+	return col;
+}
+
+Rgba VcmIntegrator::integrate(RenderData &render_data, const DiffRay &ray, int additional_depth, ColorLayers *color_layers, const RenderView *render_view) const
+{
+	const bool layers_used = render_data.raylevel_ == 0 && color_layers && color_layers->getFlags() != Layer::Flags::None;
+
+	Rgb col(0.f);
+	SurfacePoint sp;
+	float alpha = 1.f;
+
+	if(scene_->intersect(ray, sp, render_data.takePrimaryHit()))
+	{
+		col = traceEyePath(render_data, ray, sp, render_view->getCamera());
+		if(layers_used) generateCommonLayers(render_data, sp, ray, color_layers);
+	}
+	else
+	{
+		if(transp_background_) alpha = 0.f;
+
+		if(scene_->getBackground() && !transp_refracted_background_)
+		{
+			const Rgb col_tmp = (*scene_->getBackground())(ray, render_data);
+			col += col_tmp;
+			if(layers_used)
+			{
+				if(ColorLayer *color_layer = color_layers->find(Layer::Env)) color_layer->color_ += col_tmp;
+			}
+		}
+	}
+
+	Rgb col_vol_transmittance = scene_->vol_integrator_->transmittance(render_data, ray);
+	Rgb col_vol_integration = scene_->vol_integrator_->integrate(render_data, ray);
+
+	if(transp_background_) alpha = std::max(alpha, 1.f - col_vol_transmittance.r_);
+
+	if(layers_used)
+	{
+		if(ColorLayer *color_layer = color_layers->find(Layer::VolumeTransmittance)) color_layer->color_ += col_vol_transmittance;
+		if(ColorLayer *color_layer = color_layers->find(Layer::VolumeIntegration)) color_layer->color_ += col_vol_integration;
+	}
+
+	col = (col * col_vol_transmittance) + col_vol_integration;
+	return Rgba(col, alpha);
+}
+
+std::unique_ptr<Integrator> VcmIntegrator::factory(ParamMap &params, const Scene &scene)
+{
+	std::string mode_str = "vcm";
+	int bounces = 8;
+	int num_light_paths = 250000;
+	double radius_factor = 0.003;
+	double radius_alpha = 0.75;
+	int num_connections = 0;
+	bool bg_transp = false;
+	bool bg_transp_refract = false;
+
+	params.getParam("vcm_mode", mode_str);
+	params.getParam("bounces", bounces);
+	params.getParam("vcm_light_paths", num_light_paths);
+	params.getParam("vcm_radius_factor", radius_factor);
+	params.getParam("vcm_radius_alpha", radius_alpha);
+	params.getParam("vcm_connections", num_connections);
+	params.getParam("bg_transp", bg_transp);
+	params.getParam("bg_transp_refract", bg_transp_refract);
+
+	Mode mode = Mode::Vcm;
+	if(mode_str == "bpt") mode = Mode::Bpt;
+	else if(mode_str == "ppm") mode = Mode::Ppm;
+	auto inte = std::unique_ptr<VcmIntegrator>(new VcmIntegrator(mode, std::max(1, bounces) + 1, std::max(1, num_light_paths), std::max(1.0e-6f, static_cast<float>(radius_factor)), std::min(1.f, std::max(0.f, static_cast<float>(radius_alpha))), std::max(0, num_connections)));
+
+	// Background settings
+	inte->transp_background_ = bg_transp;
+	inte->transp_refracted_background_ = bg_transp_refract;
+
+	return inte;
+}
+
+END_YAFARAY
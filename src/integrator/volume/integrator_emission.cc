@@ -25,11 +25,19 @@
 
 BEGIN_YAFARAY
 
+static thread_local std::vector<VolumeRegionTree::Hit> ray_hits_global; //!< per thread scratch buffer for the volume regions crossed by each ray
+
+bool EmissionIntegrator::preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *)
+{
+	volume_tree_.build(scene_->getVolumeRegions());
+	return true;
+}
+
 Rgba EmissionIntegrator::transmittance(RenderData &render_data, const Ray &ray) const
 {
-	Rgba result(1.f);
-	auto &volumes = scene_->getVolumeRegions();
-	for(const auto &v : volumes) result *= v.second.get()->tau(ray, 0, 0);
+	Rgba result(0.f);
+	volume_tree_.intersect(ray, ray_hits_global);
+	for(const auto &hit : ray_hits_global) result += hit.region_->tau(ray, 0, 0);
 	result = Rgba(math::exp(-result.getR()), math::exp(-result.getG()), math::exp(-result.getB()));
 	return result;
 }
@@ -37,24 +45,20 @@ Rgba EmissionIntegrator::transmittance(RenderData &render_data, const Ray &ray)
 Rgba EmissionIntegrator::integrate(RenderData &render_data, const Ray &ray, int additional_depth) const {
 	int n = 10; // samples + 1 on the ray inside the volume
 	Rgba result(0.f);
-	bool hit = ray.tmax_ > 0.f;
-	auto &volumes = scene_->getVolumeRegions();
-	for(const auto &v : volumes)
+	volume_tree_.intersect(ray, ray_hits_global);
+	for(const auto &hit : ray_hits_global)
 	{
-		Bound::Cross cross = v.second.get()->crossBound(ray);
-		if(!cross.crossed_) continue;
-		if(hit && ray.tmax_ < cross.enter_) continue;
-		if(hit && ray.tmax_ < cross.leave_) cross.leave_ = ray.tmax_;
-		float step = (cross.leave_ - cross.enter_) / static_cast<float>(n); // length between two sample points
+		const VolumeRegion *vr = hit.region_;
+		float step = (hit.leave_ - hit.enter_) / static_cast<float>(n); // length between two sample points
 		--n;
-		float pos = cross.enter_ + 0.5 * step;
+		float pos = hit.enter_ + 0.5 * step;
 		Rgb tr(1.f);
 		for(int i = 0; i < n; ++i)
 		{
 			Ray step_ray(ray.from_ + (ray.dir_ * pos), ray.dir_, 0, step, 0);
-			Rgb step_tau = v.second->tau(step_ray, 0, 0);
+			Rgb step_tau = vr->tau(step_ray, 0, 0);
 			tr *= Rgba(math::exp(-step_tau.getR()), math::exp(-step_tau.getG()), math::exp(-step_tau.getB()));
-			result += tr * v.second->emission(step_ray.from_, step_ray.dir_);
+			result += tr * vr->emission(step_ray.from_, step_ray.dir_);
 			pos += step;
 		}
 		result *= step;
@@ -26,16 +26,135 @@
 #include "light/light.h"
 #include "common/param.h"
 #include "render/render_data.h"
+#include "photon/photon_maps_state.h"
+#include "common/session.h"
+#include "common/task_pool.h"
+#include "math/random.h"
 
 BEGIN_YAFARAY
 
-SingleScatterIntegrator::SingleScatterIntegrator(float s_size, bool adapt, bool opt) {
+//! per thread scratch buffers for the volume regions crossed by the camera rays and by the light rays, which are traced while marching the camera rays
+static thread_local std::vector<VolumeRegionTree::Hit> ray_hits_global, light_ray_hits_global;
+
+//! calls f for the regions of the hits whose interval contains the ray distance t. With t increasing between the calls, the hits left behind are skipped from first_hit on
+template <typename F>
+static void forEachRegionAt_global(const std::vector<VolumeRegionTree::Hit> &hits, size_t &first_hit, float t, F f)
+{
+	while(first_hit < hits.size() && hits[first_hit].leave_ < t) ++first_hit;
+	for(size_t i = first_hit; i < hits.size() && hits[i].enter_ <= t; ++i)
+	{
+		if(hits[i].leave_ >= t) f(*hits[i].region_);
+	}
+}
+
+SingleScatterIntegrator::SingleScatterIntegrator(float s_size, bool adapt, bool opt, bool tracking) {
 	adaptive_ = adapt;
+	tracking_ = tracking;
 	step_size_ = s_size;
 	optimize_ = opt;
 	adaptive_step_size_ = s_size * 100.0f;
 
-	Y_PARAMS << "SingleScatter: stepSize: " << step_size_ << " adaptive: " << adaptive_ << " optimize: " << optimize_ << YENDL;
+	Y_PARAMS << "SingleScatter: stepSize: " << step_size_ << " adaptive: " << adaptive_ << " optimize: " << optimize_ << " tracking: " << tracking_ << YENDL;
+}
+
+//! hash of the volume bounds, attenuation grid size and extinction sampled at the grid points, changes when the volume is moved or edited
+static uint64_t volumeSignature_global(const VolumeRegion &vr)
+{
+	const Bound bb = vr.getBb();
+	uint64_t hash = 0;
+	for(const float value : { bb.a_.x_, bb.a_.y_, bb.a_.z_, bb.g_.x_, bb.g_.y_, bb.g_.z_, vr.majorant() }) hash = PhotonMapsState::hashCombine(hash, value);
+	for(const int value : { vr.att_grid_x_, vr.att_grid_y_, vr.att_grid_z_ }) hash = PhotonMapsState::hashCombine(hash, static_cast<uint64_t>(value));
+	for(int z = 0; z < vr.att_grid_z_; ++z)
+	{
+		for(int y = 0; y < vr.att_grid_y_; ++y)
+		{
+			for(int x = 0; x < vr.att_grid_x_; ++x)
+			{
+				const Point3 p(bb.longX() * x / vr.att_grid_x_ + bb.a_.x_,
+							   bb.longY() * y / vr.att_grid_y_ + bb.a_.y_,
+							   bb.longZ() * z / vr.att_grid_z_ + bb.a_.z_);
+				const Rgb sigma_t = vr.sigmaT(p, Vec3());
+				for(const float value : { sigma_t.r_, sigma_t.g_, sigma_t.b_ }) hash = PhotonMapsState::hashCombine(hash, value);
+			}
+		}
+	}
+	return hash;
+}
+
+void SingleScatterIntegrator::computeAttenuationSlice(const VolumeRegion &vr, const Light &light, int z, float *attenuation_grid) const
+{
+	const Bound bb = vr.getBb();
+
+	const int x_size = vr.att_grid_x_;
+	const int y_size = vr.att_grid_y_;
+	const int z_size = vr.att_grid_z_;
+
+	const float x_size_inv = 1.f / (float)x_size;
+	const float y_size_inv = 1.f / (float)y_size;
+	const float z_size_inv = 1.f / (float)z_size;
+
+	Rgb lcol(0.0);
+
+	for(int y = 0; y < y_size; ++y)
+	{
+		for(int x = 0; x < x_size; ++x)
+		{
+			// generate the world position inside the grid
+			Point3 p(bb.longX() * x_size_inv * x + bb.a_.x_,
+					 bb.longY() * y_size_inv * y + bb.a_.y_,
+					 bb.longZ() * z_size_inv * z + bb.a_.z_);
+
+			SurfacePoint sp;
+			sp.p_ = p;
+
+			Ray light_ray;
+
+			light_ray.from_ = sp.p_;
+
+			// handle lights with delta distribution, e.g. point and directional lights
+			if(light.diracLight())
+			{
+				bool ill = light.illuminate(sp, lcol, light_ray);
+				light_ray.tmin_ = scene_->shadow_bias_;
+				if(light_ray.tmax_ < 0.f) light_ray.tmax_ = 1e10;  // infinitely distant light
+
+				// transmittance from the point p in the volume to the light (i.e. how much light reaches p)
+				Rgb lightstep_tau(0.f);
+				if(ill)
+				{
+					volume_tree_.intersect(light_ray, light_ray_hits_global);
+					for(const auto &hit : light_ray_hits_global) lightstep_tau += hit.region_->tau(light_ray, step_size_, 0.0f);
+				}
+
+				float light_tr = math::exp(-lightstep_tau.energy());
+				attenuation_grid[x + y * x_size + y_size * x_size * z] = light_tr;
+			}
+			else // area light and suchlike
+			{
+				float light_tr = 0;
+				int n = light.nSamples() >> 1; // samples / 2
+				if(n < 1) n = 1;
+				LSample ls;
+				for(int i = 0; i < n; ++i)
+				{
+					ls.s_1_ = 0.5f; //(*state.prng)();
+					ls.s_2_ = 0.5f; //(*state.prng)();
+
+					light.illumSample(sp, ls, light_ray);
+					light_ray.tmin_ = scene_->shadow_bias_;
+					if(light_ray.tmax_ < 0.f) light_ray.tmax_ = 1e10;  // infinitely distant light
+
+					// transmittance from the point p in the volume to the light (i.e. how much light reaches p)
+					Rgb lightstep_tau(0.f);
+					volume_tree_.intersect(light_ray, light_ray_hits_global);
+					for(const auto &hit : light_ray_hits_global) lightstep_tau += hit.region_->tau(light_ray, step_size_, 0.0f);
+					light_tr += math::exp(-lightstep_tau.energy());
+				}
+
+				attenuation_grid[x + y * x_size + y_size * x_size * z] = light_tr / (float)n;
+			}
+		}
+	}
 }
 
 bool SingleScatterIntegrator::preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *)
@@ -44,102 +163,73 @@ bool SingleScatterIntegrator::preprocess(const RenderControl &render_control, co
 
 	lights_ = render_view->getLightsVisible();
 	const auto &volumes = scene_->getVolumeRegions();
+	volume_tree_.build(volumes);
 	vr_size_ = volumes.size();
 	i_vr_size_ = 1.f / (float)vr_size_;
 
 	if(optimize_)
 	{
+		// the grids of the previous render are reused when neither the volumes nor the light changed. Every grid depends on all the volumes, as the light rays cross all of them
+		uint64_t volumes_signature = PhotonMapsState::hashCombine(uint64_t(0), step_size_);
+		std::vector<uint64_t> volume_signatures;
 		for(const auto &v : volumes)
 		{
-			const auto &vr = v.second;
-			Bound bb = vr->getBb();
-
-			int x_size = vr->att_grid_x_;
-			int y_size = vr->att_grid_y_;
-			int z_size = vr->att_grid_z_;
-
-			float x_size_inv = 1.f / (float)x_size;
-			float y_size_inv = 1.f / (float)y_size;
-			float z_size_inv = 1.f / (float)z_size;
+			volume_signatures.push_back(volumeSignature_global(*v.second));
+			volumes_signature = PhotonMapsState::hashCombine(volumes_signature, volume_signatures.back());
+		}
+		std::vector<uint64_t> light_signatures;
+		for(const auto &l : lights_) light_signatures.push_back(PhotonMapsState::lightSignature(*l));
+
+		std::map<uint64_t, std::shared_ptr<const std::vector<float>>> attenuation_grids;
+		int num_reused_grids = 0;
+		TaskPool task_pool(scene_->getNumThreads());
+		TaskPool::Group task_group(task_pool);
+		size_t volume_id = 0;
+		for(const auto &v : volumes)
+		{
+			const VolumeRegion *vr = v.second.get();
+			const uint64_t volume_signature = PhotonMapsState::hashCombine(volumes_signature, volume_signatures[volume_id++]);
+			const int x_size = vr->att_grid_x_;
+			const int y_size = vr->att_grid_y_;
+			const int z_size = vr->att_grid_z_;
+			v.second->attenuation_grid_map_.clear();
 
 			Y_PARAMS << "SingleScatter: volume, attGridMaps with size: " << x_size << " " << y_size << " " << x_size << std::endl;
 
-			for(auto l = lights_.begin(); l != lights_.end(); ++l)
+			for(size_t light_id = 0; light_id < lights_.size(); ++light_id)
 			{
-				Rgb lcol(0.0);
-
-				float *attenuation_grid = (float *)malloc(x_size * y_size * z_size * sizeof(float));
-				vr->attenuation_grid_map_[(*l)] = attenuation_grid;
-
-				for(int z = 0; z < z_size; ++z)
+				const Light *light = lights_[light_id];
+				const uint64_t signature = PhotonMapsState::hashCombine(volume_signature, light_signatures[light_id]);
+				auto cached_grid = attenuation_grids.find(signature);
+				if(cached_grid == attenuation_grids.end())
 				{
-					for(int y = 0; y < y_size; ++y)
+					cached_grid = scene_->getSession().attenuation_grids_.find(signature);
+					if(cached_grid != scene_->getSession().attenuation_grids_.end())
 					{
-						for(int x = 0; x < x_size; ++x)
-						{
-							// generate the world position inside the grid
-							Point3 p(bb.longX() * x_size_inv * x + bb.a_.x_,
-									 bb.longY() * y_size_inv * y + bb.a_.y_,
-									 bb.longZ() * z_size_inv * z + bb.a_.z_);
-
-							SurfacePoint sp;
-							sp.p_ = p;
-
-							Ray light_ray;
-
-							light_ray.from_ = sp.p_;
-
-							// handle lights with delta distribution, e.g. point and directional lights
-							if((*l)->diracLight())
-							{
-								bool ill = (*l)->illuminate(sp, lcol, light_ray);
-								light_ray.tmin_ = scene_->shadow_bias_;
-								if(light_ray.tmax_ < 0.f) light_ray.tmax_ = 1e10;  // infinitely distant light
-
-								// transmittance from the point p in the volume to the light (i.e. how much light reaches p)
-								Rgb lightstep_tau(0.f);
-								if(ill)
-								{
-									for(const auto &v_2 : volumes)
-									{
-										lightstep_tau += v_2.second->tau(light_ray, step_size_, 0.0f);
-									}
-								}
-
-								float light_tr = math::exp(-lightstep_tau.energy());
-								attenuation_grid[x + y * x_size + y_size * x_size * z] = light_tr;
-							}
-							else // area light and suchlike
-							{
-								float light_tr = 0;
-								int n = (*l)->nSamples() >> 1; // samples / 2
-								if(n < 1) n = 1;
-								LSample ls;
-								for(int i = 0; i < n; ++i)
-								{
-									ls.s_1_ = 0.5f; //(*state.prng)();
-									ls.s_2_ = 0.5f; //(*state.prng)();
-
-									(*l)->illumSample(sp, ls, light_ray);
-									light_ray.tmin_ = scene_->shadow_bias_;
-									if(light_ray.tmax_ < 0.f) light_ray.tmax_ = 1e10;  // infinitely distant light
-
-									// transmittance from the point p in the volume to the light (i.e. how much light reaches p)
-									Rgb lightstep_tau(0.f);
-									for(const auto &v_2 : volumes)
-									{
-										lightstep_tau += v_2.second->tau(light_ray, step_size_, 0.0f);
-									}
-									light_tr += math::exp(-lightstep_tau.energy());
-								}
-
-								attenuation_grid[x + y * x_size + y_size * x_size * z] = light_tr / (float)n;
-							}
-						}
+						cached_grid = attenuation_grids.insert(*cached_grid).first;
+						++num_reused_grids;
 					}
 				}
+				if(cached_grid != attenuation_grids.end())
+				{
+					v.second->attenuation_grid_map_[light] = cached_grid->second;
+					continue;
+				}
+
+				auto attenuation_grid = std::make_shared<std::vector<float>>(x_size * y_size * z_size);
+				v.second->attenuation_grid_map_[light] = attenuation_grid;
+				attenuation_grids[signature] = attenuation_grid;
+				float *attenuation_grid_data = attenuation_grid->data();
+				for(int z = 0; z < z_size; ++z)
+				{
+					task_group.run([this, vr, light, z, attenuation_grid_data] { computeAttenuationSlice(*vr, *light, z, attenuation_grid_data); });
+				}
 			}
 		}
+		task_group.wait();
+		// only the grids used in this render are kept for the next one
+		scene_->getSession().attenuation_grids_ = std::move(attenuation_grids);
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "SingleScatter: " << num_reused_grids << " of " << scene_->getSession().attenuation_grids_.size() << " attenuation grids reused from the previous render" << YENDL;
 	}
 
 	return true;
@@ -153,7 +243,6 @@ Rgb SingleScatterIntegrator::getInScatter(RenderData &render_data, Ray &step_ray
 
 	Ray light_ray;
 	light_ray.from_ = sp.p_;
-	const auto &volumes = scene_->getVolumeRegions();
 
 	for(auto l = lights_.begin(); l != lights_.end(); ++l)
 	{
@@ -174,23 +263,13 @@ Rgb SingleScatterIntegrator::getInScatter(RenderData &render_data, Ray &step_ray
 					if(optimize_)
 					{
 						// replaced by
-						for(const auto &v : volumes)
-						{
-							const Bound::Cross cross = v.second->crossBound(light_ray);
-							if(cross.crossed_) light_tr += v.second->attenuation(sp.p_, (*l));
-						}
+						volume_tree_.intersect(light_ray, light_ray_hits_global);
+						for(const auto &hit : light_ray_hits_global) light_tr += hit.region_->attenuation(sp.p_, (*l));
 					}
 					else
 					{
-						// replaced by
-						Rgb lightstep_tau(0.f);
-						for(const auto &v : volumes)
-						{
-							const Bound::Cross cross = v.second->crossBound(light_ray);
-							if(cross.crossed_) lightstep_tau += v.second->tau(light_ray, current_step, 0.f);
-						}
 						// transmittance from the point p in the volume to the light (i.e. how much light reaches p)
-						light_tr = math::exp(-lightstep_tau.energy());
+						light_tr = lightTransmittance(render_data, light_ray, current_step);
 					}
 					in_scatter += light_tr * lcol;
 				}
@@ -224,30 +303,13 @@ Rgb SingleScatterIntegrator::getInScatter(RenderData &render_data, Ray &step_ray
 						if(optimize_)
 						{
 							// replaced by
-							for(const auto &v : volumes)
-							{
-								const Bound::Cross cross = v.second->crossBound(light_ray);
-								if(cross.crossed_)
-								{
-									light_tr += v.second->attenuation(sp.p_, (*l));
-									break;
-								}
-							}
+							volume_tree_.intersect(light_ray, light_ray_hits_global);
+							if(!light_ray_hits_global.empty()) light_tr += light_ray_hits_global.front().region_->attenuation(sp.p_, (*l));
 						}
 						else
 						{
-							// replaced by
-							Rgb lightstep_tau(0.f);
-							for(const auto &v : volumes)
-							{
-								const Bound::Cross cross = v.second->crossBound(light_ray);
-								if(cross.crossed_)
-								{
-									lightstep_tau += v.second->tau(light_ray, current_step * 4.f, 0.0f);
-								}
-							}
 							// transmittance from the point p in the volume to the light (i.e. how much light reaches p)
-							light_tr += math::exp(-lightstep_tau.energy());
+							light_tr += lightTransmittance(render_data, light_ray, current_step * 4.f);
 						}
 
 					}
@@ -264,19 +326,34 @@ Rgb SingleScatterIntegrator::getInScatter(RenderData &render_data, Ray &step_ray
 	return in_scatter;
 }
 
+float SingleScatterIntegrator::lightTransmittance(RenderData &render_data, const Ray &light_ray, float step) const
+{
+	volume_tree_.intersect(light_ray, light_ray_hits_global);
+	if(tracking_)
+	{
+		float light_tr = 1.f;
+		for(const auto &hit : light_ray_hits_global) light_tr *= hit.region_->ratioTracking(light_ray, *render_data.prng_);
+		return light_tr;
+	}
+	Rgb lightstep_tau(0.f);
+	for(const auto &hit : light_ray_hits_global) lightstep_tau += hit.region_->tau(light_ray, step, 0.f);
+	return math::exp(-lightstep_tau.energy());
+}
+
 Rgba SingleScatterIntegrator::transmittance(RenderData &render_data, const Ray &ray) const {
 	if(vr_size_ == 0) return {1.f};
 	Rgba tr(1.f);
-	const auto &volumes = scene_->getVolumeRegions();
-	for(const auto &v : volumes)
+	volume_tree_.intersect(ray, ray_hits_global);
+	for(const auto &hit : ray_hits_global)
 	{
-		const Bound::Cross cross = v.second->crossBound(ray);
-		if(cross.crossed_)
+		if(tracking_)
 		{
-			const float random = (*render_data.prng_)();
-			const Rgb optical_thickness = v.second->tau(ray, step_size_, random);
-			tr *= Rgba(math::exp(-optical_thickness.energy()));
+			tr *= Rgba(hit.region_->ratioTracking(ray, *render_data.prng_));
+			continue;
 		}
+		const float random = (*render_data.prng_)();
+		const Rgb optical_thickness = hit.region_->tau(ray, step_size_, random);
+		tr *= Rgba(math::exp(-optical_thickness.energy()));
 	}
 
 	return tr;
@@ -289,24 +366,16 @@ Rgba SingleScatterIntegrator::integrate(RenderData &render_data, const Ray &ray,
 	//return result;
 	if(vr_size_ == 0) return result;
 
-	bool hit = (ray.tmax_ > 0.f);
-	const auto &volumes = scene_->getVolumeRegions();
-
-	// find min t0 and max t1
-	for(const auto &v : volumes)
-	{
-		Bound::Cross cross = v.second->crossBound(ray);
-		if(!cross.crossed_) continue;
-		if(hit && ray.tmax_ < cross.enter_) continue;
-
-		if(cross.enter_ < 0.f) cross.enter_ = 0.f;
-		if(hit && ray.tmax_ < cross.leave_) cross.leave_ = ray.tmax_;
-		if(cross.leave_ > t_1) t_1 = cross.leave_;
-		if(cross.enter_ < t_0) t_0 = cross.enter_;
-	}
+	// the regions crossed by the ray, sorted along it, span from the entry of the first one to the farthest exit
+	std::vector<VolumeRegionTree::Hit> &hits = ray_hits_global;
+	volume_tree_.intersect(ray, hits);
+	if(hits.empty()) return result;
+	t_0 = hits.front().enter_;
+	for(const auto &hit : hits) t_1 = std::max(t_1, hit.leave_);
 
 	float dist = t_1 - t_0;
 	if(dist < 1e-3f) return result;
+	if(tracking_) return integrateDeltaTracking(render_data, ray, hits, t_0, t_1);
 
 	float pos;
 	int samples;
@@ -326,15 +395,14 @@ Rgba SingleScatterIntegrator::integrate(RenderData &render_data, const Ray &ray,
 		accum_density.resize(samples);
 
 		accum_density.at(0) = 0.f;
+		size_t first_hit = 0;
 		for(int i = 0; i < samples; ++i)
 		{
-			Point3 p = ray.from_ + (step_size_ * i + pos) * ray.dir_;
+			const float t = step_size_ * i + pos;
+			Point3 p = ray.from_ + t * ray.dir_;
 
 			float density = 0;
-			for(const auto &v : volumes)
-			{
-				density += v.second->sigmaT(p, Vec3()).energy();
-			}
+			forEachRegionAt_global(hits, first_hit, t, [&](const VolumeRegion &vr) { density += vr.sigmaT(p, Vec3()).energy(); });
 
 			density_samples.at(i) = density;
 			if(i > 0)
@@ -357,6 +425,7 @@ Rgba SingleScatterIntegrator::integrate(RenderData &render_data, const Ray &ray,
 
 	Rgb step_tau(0.f);
 	int lookahead_samples = adaptive_resolution / 10;
+	size_t first_hit = 0;
 
 	for(int step_sample = 0; step_sample < samples; step_sample += step_length)
 	{
@@ -383,14 +452,7 @@ Rgba SingleScatterIntegrator::integrate(RenderData &render_data, const Ray &ray,
 		}
 		else
 		{
-			for(const auto &v : volumes)
-			{
-				const Bound::Cross cross = v.second->crossBound(step_ray);
-				if(cross.crossed_)
-				{
-					step_tau += v.second->sigmaT(step_ray.from_, step_ray.dir_) * current_step;
-				}
-			}
+			forEachRegionAt_global(hits, first_hit, pos, [&](const VolumeRegion &vr) { step_tau += vr.sigmaT(step_ray.from_, step_ray.dir_) * current_step; });
 		}
 
 		tr_tmp = math::exp(-step_tau.energy());
@@ -406,14 +468,7 @@ Rgba SingleScatterIntegrator::integrate(RenderData &render_data, const Ray &ray,
 		}
 
 		float sigma_s = 0.0f;
-		for(const auto &v : volumes)
-		{
-			const Bound::Cross cross = v.second->crossBound(step_ray);
-			if(cross.crossed_)
-			{
-				sigma_s += v.second->sigmaS(step_ray.from_, step_ray.dir_).energy();
-			}
-		}
+		forEachRegionAt_global(hits, first_hit, pos, [&](const VolumeRegion &vr) { sigma_s += vr.sigmaS(step_ray.from_, step_ray.dir_).energy(); });
 
 		// with a sigma_s close to 0, no light can be scattered -> computation can be skipped
 
@@ -455,14 +510,55 @@ Rgba SingleScatterIntegrator::integrate(RenderData &render_data, const Ray &ray,
 	return result;
 }
 
+Rgba SingleScatterIntegrator::integrateDeltaTracking(RenderData &render_data, const Ray &ray, const std::vector<VolumeRegionTree::Hit> &hits, float t_0, float t_1) const {
+	Rgba result(0.f);
+
+	// the sum of the majorants of all the regions along the ray bounds the combined extinction
+	float sigma_maj = 0.f;
+	for(const auto &hit : hits) sigma_maj += hit.region_->majorant();
+	if(sigma_maj <= 0.f) return result;
+	const float inv_sigma_maj = 1.f / sigma_maj;
+
+	float pos = t_0;
+	size_t first_hit = 0;
+	while(true)
+	{
+		pos -= math::log(1.f - (*render_data.prng_)()) * inv_sigma_maj;
+		if(pos >= t_1) break;
+
+		const Point3 p = ray.from_ + (ray.dir_ * pos);
+		float sigma_s = 0.f;
+		float sigma_t = 0.f;
+		forEachRegionAt_global(hits, first_hit, pos, [&](const VolumeRegion &vr)
+		{
+			const float region_sigma_s = vr.sigmaS(p, ray.dir_).energy();
+			sigma_s += region_sigma_s;
+			sigma_t += region_sigma_s + vr.sigmaA(p, ray.dir_).energy();
+		});
+
+		// real collision with probability sigma_t / sigma_maj, otherwise a null collision and tracking goes on
+		if((*render_data.prng_)() * sigma_maj < sigma_t)
+		{
+			// the collision pdf already accounts for the transmittance up to p, only the albedo remains
+			Ray step_ray(p, ray.dir_, 0, step_size_, 0);
+			result += getInScatter(render_data, step_ray, step_size_) * (sigma_s / sigma_t);
+			break;
+		}
+	}
+	result.a_ = 1.0f; // FIXME: get correct alpha value, does it even matter?
+	return result;
+}
+
 std::unique_ptr<Integrator> SingleScatterIntegrator::factory(ParamMap &params, const Scene &scene) {
 	bool adapt = false;
 	bool opt = false;
+	bool tracking = false;
 	float s_size = 1.f;
 	params.getParam("stepSize", s_size);
 	params.getParam("adaptive", adapt);
 	params.getParam("optimize", opt);
-	return std::unique_ptr<Integrator>(new SingleScatterIntegrator(s_size, adapt, opt));
+	params.getParam("tracking", tracking);
+	return std::unique_ptr<Integrator>(new SingleScatterIntegrator(s_size, adapt, opt, tracking));
 }
 
 END_YAFARAY
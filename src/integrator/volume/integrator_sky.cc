@@ -23,6 +23,8 @@
 #include "light/light.h"
 #include "common/param.h"
 #include "render/render_data.h"
+#include "math/random.h"
+#include <algorithm>
 
 BEGIN_YAFARAY
 
@@ -47,8 +49,25 @@ float mieScatter_global(float theta)
 	return (1.f - ((theta - 80.f) / 100.f)) * 0.1644f + ((theta - 80.f) / 100.f) * 0.1;
 }
 
-SkyIntegrator::SkyIntegrator(float s_size, float a, float ss, float t) {
-	step_size_ = s_size;
+/*! Integral of the density of the exponential atmosphere along a ray of length s, relative to the density at the ray origin altitude h_0:
+ * (1 - exp(-alpha * cos_theta * s)) / (alpha * cos_theta), with its limit for the almost horizontal rays */
+static float densityLength_global(float alpha, float h_0, float cos_theta, float s)
+{
+	const float x = alpha * cos_theta * s;
+	const float relative_length = std::abs(x) < 1e-4f ? 1.f - 0.5f * x : (1.f - math::exp(-x)) / x;
+	return math::exp(-alpha * h_0) * s * relative_length;
+}
+
+/*! Single scattering integral along the ray of the density attenuated by the optical depth from the ray origin. As the density is the derivative of the
+ * optical depth divided by beta, it has the closed form (1 - exp(-tau(s))) / beta, instead of ray marching the density and the optical depth of each step */
+static float scatteringIntegral_global(float beta, float alpha, float h_0, float cos_theta, float s)
+{
+	const float density_length = densityLength_global(alpha, h_0, cos_theta, s);
+	const float tau = beta * density_length;
+	return tau < 1e-4f ? density_length * (1.f - 0.5f * tau) : (1.f - math::exp(-tau)) / beta;
+}
+
+SkyIntegrator::SkyIntegrator(float a, float ss, float t, int table_resolution) : table_resolution_(table_resolution) {
 	alpha_ = a;
 	//sigma_t = ss;
 	turbidity_ = t;
@@ -81,9 +100,48 @@ SkyIntegrator::SkyIntegrator(float s_size, float a, float ss, float t) {
 bool SkyIntegrator::preprocess(const RenderControl &render_control, const RenderView *render_view, ImageFilm *)
 {
 	background_ = scene_->getBackground();
+	//The background (and its sun) is evaluated once in the directions gathered by the in-scattering, and the sources of all the view directions baked in tables
+	hemisphere_radiance_.clear();
+	if(background_)
+	{
+		const int v_vec = 3;
+		const int u_vec = 8;
+		for(int v = 0; v < v_vec; v++)
+		{
+			const float theta = (v * 0.3f + 0.2f) * 0.5f * M_PI;
+			for(int u = 0; u < u_vec; u++)
+			{
+				const float phi = u * 2.0f * M_PI / (float)u_vec;
+				const Vec3 w(math::sin(theta) * math::cos(phi), math::sin(theta) * math::sin(phi), math::cos(theta));
+				const Ray bgray(Point3(0, 0, 0), w, 0, 1, 0);
+				hemisphere_radiance_.emplace_back(w, background_->eval(bgray));
+			}
+		}
+	}
+	rayleigh_source_table_.bake(table_resolution_, [this](const Vec3 &dir) { Rgb s_0_r, s_0_m; inScatteredSources(dir, s_0_r, s_0_m); return s_0_r; });
+	mie_source_table_.bake(table_resolution_, [this](const Vec3 &dir) { Rgb s_0_r, s_0_m; inScatteredSources(dir, s_0_r, s_0_m); return s_0_m; });
 	return true;
 }
 
+void SkyIntegrator::inScatteredSources(const Vec3 &dir, Rgb &s_0_r, Rgb &s_0_m) const
+{
+	s_0_r = Rgb(0.f);
+	s_0_m = Rgb(0.f);
+	if(hemisphere_radiance_.empty()) return;
+	const Vec3 view_dir = Vec3(dir).normalize();
+	const float k = 0.67f;
+	for(const auto &radiance : hemisphere_radiance_)
+	{
+		const float cos_angle = radiance.first * view_dir;
+		const float b_r_angular = b_r_ * 3 / (2 * M_PI * 8) * (1.0f + cos_angle * cos_angle);
+		const float b_m_angular = b_m_ / (2 * k * M_PI) * mieScatter_global(math::acos(std::max(-1.f, std::min(1.f, cos_angle))));
+		s_0_m += radiance.second * b_m_angular;
+		s_0_r += radiance.second * b_r_angular;
+	}
+	s_0_r *= 1.f / static_cast<float>(hemisphere_radiance_.size());
+	s_0_m *= 1.f / static_cast<float>(hemisphere_radiance_.size());
+}
+
 Rgba SkyIntegrator::skyTau(const Ray &ray) const {
 	//std::cout << " ray.from: " << ray.from << " ray.dir: " << ray.dir << " ray.tmax: " << ray.tmax << " t0: " << t0 << " t1: " << t1 << std::endl;
 	/*
@@ -134,16 +192,11 @@ Rgba SkyIntegrator::skyTau(const Ray &ray, float beta, float alpha) const {
 
 	s = ray.tmax_ * scale_;
 
-	Rgb tau_val(0.f);
-
 	float cos_theta = ray.dir_.z_;
 
 	float h_0 = ray.from_.z_ * scale_;
 
-	tau_val = Rgba(beta * math::exp(-alpha * h_0) * (1.f - math::exp(-alpha * cos_theta * s)) / (alpha * cos_theta));
-	//tauVal = Rgba(-beta / (alpha * cos_theta) * ( exp(-alpha * (h0 + cos_theta * s)) - exp(-alpha*h0) ));
-
-	return tau_val;
+	return Rgba(beta * densityLength_global(alpha, h_0, cos_theta, s));
 }
 
 Rgba SkyIntegrator::transmittance(RenderData &render_data, const Ray &ray) const {
@@ -156,92 +209,34 @@ Rgba SkyIntegrator::transmittance(RenderData &render_data, const Ray &ray) const
 }
 
 Rgba SkyIntegrator::integrate(RenderData &render_data, const Ray &ray, int additional_depth) const {
-	//return Rgba(0.f);
-	Rgba i_r(0.f);
-	Rgba i_m(0.f);
-
-	float s;
 	if(ray.tmax_ < 0.f) return Rgba(0.f);
-	else s = ray.tmax_ * scale_;
+	const float s = ray.tmax_ * scale_;
 
-	Rgba s_0_r(0.f); // light scattered into the view ray over the complete hemisphere
-	Rgba s_0_m(0.f); // light scattered into the view ray over the complete hemisphere
-	int v_vec = 3;
-	int u_vec = 8;
-	for(int v = 0; v < v_vec; v++)
+	Rgb s_0_r, s_0_m; // light scattered into the view ray over the complete hemisphere
+	if(rayleigh_source_table_.isEnabled())
 	{
-		float theta = (v * 0.3f + 0.2f) * 0.5f * M_PI;
-		for(int u = 0; u < u_vec; u++)
-		{
-			float phi = (u /* + (*render_data.prng)() */) * 2.0f * M_PI / (float)u_vec;
-			float z = math::cos(theta);
-			float x = math::sin(theta) * math::cos(phi);
-			float y = math::sin(theta) * math::sin(phi);
-			Vec3 w(x, y, z);
-			Ray bgray(Point3(0, 0, 0), w, 0, 1, 0);
-			Rgb l_s = background_->eval(bgray);
-			float b_r_angular = b_r_ * 3 / (2 * M_PI * 8) * (1.0f + (w * (-ray.dir_)) * (w * (-ray.dir_)));
-			float k = 0.67f;
-			float angle = math::acos(w * (ray.dir_));
-			float b_m_angular = b_m_ / (2 * k * M_PI) * mieScatter_global(angle);
-			//std::cout << "w: " << w << " theta: " << theta << " -ray.dir: " << -ray.dir << " angle: " << angle << " mie ang " << b_m_angular << std::endl;
-			s_0_m = s_0_m + Rgba(l_s) * b_m_angular;
-			s_0_r = s_0_r + Rgba(l_s) * b_r_angular;
-		}
-		//std::cout << "w: " << w << " theta: " << theta << " phi: " << phi << " S0: " << S0 << std::endl;
-	}
-
-	s_0_r = s_0_r * (1.f / (float)(u_vec * v_vec)); //* 10.f; // FIXME: bad again, *10 scaling to make it look better
-	s_0_m = s_0_m * (1.f / (float)(u_vec * v_vec));
-
-	//std::cout << " S0_m: " << S0_m.energy() << std::endl;
-
-	float cos_theta = ray.dir_.z_;
-
-	float h_0 = ray.from_.z_ * scale_;
-
-	float step = step_size_ * scale_;
-
-	float pos = 0.f + (*render_data.prng_)() * step;
-
-	while(pos < s)
-	{
-		Ray step_ray(ray.from_, ray.dir_, 0, pos / scale_, 0);
-
-		float u_r = math::exp(-alpha_r_ * (h_0 + pos * cos_theta));
-		float u_m = math::exp(-alpha_m_ * (h_0 + pos * cos_theta));
-
-		Rgba tau_m = skyTau(step_ray, b_m_, alpha_m_);
-		Rgba tau_r = skyTau(step_ray, b_r_, alpha_r_);
-
-		float tr_r = math::exp(-tau_r.energy());
-		float tr_m = math::exp(-tau_m.energy());
-
-		//if (Tr < 1e-3) // || u < 1e-3)
-		//	break;
-
-		i_r += tr_r * u_r * step;
-		i_m += tr_m * u_m * step;
-
-		//std::cout << /* tau_r.energy() << " " << Tr_r << " " <<  */ I_m.energy() << " " << Tr_m << " " << pos << " " << cos_theta << std::endl;
-
-		pos += step;
+		s_0_r = rayleigh_source_table_.getColor(ray.dir_);
+		s_0_m = mie_source_table_.getColor(ray.dir_);
 	}
+	else inScatteredSources(ray.dir_, s_0_r, s_0_m);
 
-	//std::cout << "result: " << S0_m * I_m << " " << I_m.energy() << " " << S0_m.energy() << std::endl;
-	return s_0_r * i_r + s_0_m * i_m;
+	const float cos_theta = ray.dir_.z_;
+	const float h_0 = ray.from_.z_ * scale_;
+	const float i_r = scatteringIntegral_global(b_r_, alpha_r_, h_0, cos_theta, s);
+	const float i_m = scatteringIntegral_global(b_m_, alpha_m_, h_0, cos_theta, s);
+	return Rgba(s_0_r * i_r + s_0_m * i_m);
 }
 
 std::unique_ptr<Integrator> SkyIntegrator::factory(ParamMap &params, const Scene &scene) {
-	float s_size = 1.f;
 	float a = .5f;
 	float ss = .1f;
 	float t = 3.f;
-	params.getParam("stepSize", s_size);
+	int table_resolution = 64;
 	params.getParam("sigma_t", ss);
 	params.getParam("alpha", a);
 	params.getParam("turbidity", t);
-	return std::unique_ptr<Integrator>(new SkyIntegrator(s_size, a, ss, t));
+	params.getParam("table_resolution", table_resolution); //rows of the in-scattering tables, 0 to sum the hemisphere radiance in each ray
+	return std::unique_ptr<Integrator>(new SkyIntegrator(a, ss, t, table_resolution));
 }
 
 
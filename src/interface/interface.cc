@@ -22,10 +22,14 @@
 #include "common/session.h"
 #include "scene/scene.h"
 #include "geometry/matrix4.h"
+#include "accelerator/accelerator_stats.h"
+#include "common/memory_stats.h"
 #include "render/imagefilm.h"
+#include "image/image_host_buffer.h"
 #include "common/param.h"
 #include "output/output.h"
 #include "render/monitor.h"
+#include "interface/render_job.h"
 #include <signal.h>
 
 #ifdef WIN32
@@ -111,7 +115,7 @@ bool Interface::setupLayersParameters()
 
 bool Interface::setInteractive(bool interactive)
 {
-	session_global.setInteractive(interactive);
+	scene_->getSession().setInteractive(interactive);
 	return true;
 }
 
@@ -152,6 +156,23 @@ bool Interface::addFace(int a, int b, int c, int uv_a, int uv_b, int uv_c)
 
 int Interface::addUv(float u, float v) { return scene_->addUv(u, v); }
 
+int Interface::addVertices(const float *vertices, unsigned int num_vertices, const float *orco)
+{
+	return scene_->addVertices(vertices, num_vertices, orco);
+}
+
+void Interface::addNormals(const float *normals, unsigned int num_normals)
+{
+	scene_->addNormals(normals, num_normals);
+}
+
+bool Interface::addFaces(const int *vert_indices, unsigned int num_faces, const int *uv_indices)
+{
+	return scene_->addFaces(vert_indices, num_faces, uv_indices);
+}
+
+int Interface::addUvs(const float *uvs, unsigned int num_uvs) { return scene_->addUvs(uvs, num_uvs); }
+
 bool Interface::smoothMesh(const char *name, double angle) { return scene_->smoothNormals(name, angle); }
 
 bool Interface::addInstance(const char *base_object_name, const Matrix4 &obj_to_world)
@@ -159,6 +180,21 @@ bool Interface::addInstance(const char *base_object_name, const Matrix4 &obj_to_
 	return scene_->addInstance(base_object_name, obj_to_world);
 }
 
+bool Interface::addInstances(const char *base_object_name, const float *obj_to_world, unsigned int num_instances)
+{
+	return scene_->addInstances(base_object_name, obj_to_world, num_instances);
+}
+
+bool Interface::updateInstance(const char *base_object_name, unsigned int instance_number, const Matrix4 &obj_to_world)
+{
+	return scene_->updateInstance(base_object_name, instance_number, obj_to_world);
+}
+
+bool Interface::addObjectLod(const char *base_object_name, const char *lod_object_name, float max_screen_size)
+{
+	return scene_->addObjectLod(base_object_name, lod_object_name, max_screen_size);
+}
+
 void Interface::paramsSetVector(const char *name, double x, double y, double z)
 {
 	(*cparams_)[std::string(name)] = Parameter(Vec3(x, y, z));
@@ -263,12 +299,25 @@ void Interface::paramsEndList()
 Object *Interface::createObject(const char *name) { return scene_->createObject(name, *params_); }
 Light *Interface::createLight(const char *name) { return scene_->createLight(name, *params_); }
 Texture *Interface::createTexture(const char *name) { return scene_->createTexture(name, *params_); }
+
+bool Interface::addImageBuffer(const char *name, const void *data, int width, int height, int num_channels, bool float_data, long long row_stride, bool reference_host_memory)
+{
+	if(!data || width <= 0 || height <= 0 || num_channels < 1 || num_channels > 4)
+	{
+		Y_ERROR << "Interface: invalid image buffer '" << name << "'" << YENDL;
+		return false;
+	}
+	return scene_->addImageBuffer(name, std::make_shared<const HostPixelBuffer>(data, width, height, num_channels, float_data, row_stride, reference_host_memory));
+}
 Material *Interface::createMaterial(const char *name) { return scene_->createMaterial(name, *params_, *eparams_); }
 Camera *Interface::createCamera(const char *name) { return scene_->createCamera(name, *params_); }
 Background *Interface::createBackground(const char *name) { return scene_->createBackground(name, *params_).get(); }
 Integrator *Interface::createIntegrator(const char *name) { return scene_->createIntegrator(name, *params_); }
 VolumeRegion *Interface::createVolumeRegion(const char *name) { return scene_->createVolumeRegion(name, *params_); }
 RenderView *Interface::createRenderView(const char *name) { return scene_->createRenderView(name, *params_); }
+Camera *Interface::updateCamera(const char *name) { return scene_->updateCamera(name, *params_); }
+Material *Interface::updateMaterial(const char *name) { return scene_->updateMaterial(name, *params_, *eparams_); }
+Light *Interface::updateLight(const char *name) { return scene_->updateLight(name, *params_); }
 
 ColorOutput *Interface::createOutput(const char *name, bool auto_delete)
 {
@@ -318,6 +367,23 @@ std::string Interface::getVersion() const
 	return YAFARAY_BUILD_VERSION;
 }
 
+std::string Interface::getAcceleratorStatsJson() const
+{
+	if(!scene_) return {};
+	return scene_->getAcceleratorStats().toJson();
+}
+
+std::string Interface::getMemoryStatsJson() const
+{
+	return MemoryStats::toJson();
+}
+
+std::string Interface::getRenderProgressStatsJson() const
+{
+	if(!scene_) return {};
+	return scene_->getRenderControl().getProgressStats().toJson();
+}
+
 void Interface::printDebug(const std::string &msg) const
 {
 	if(Y_LOG_HAS_DEBUG) Y_DEBUG << msg << YENDL;
@@ -356,6 +422,11 @@ void Interface::render(ProgressBar *pb, bool auto_delete_progress_bar)
 	scene_->render();
 }
 
+RenderJob *Interface::renderAsync(ProgressBar *pb, bool auto_delete_progress_bar)
+{
+	return new RenderJob(*this, scene_ ? &scene_->getRenderControl() : nullptr, pb, auto_delete_progress_bar);
+}
+
 void Interface::enablePrintDateTime(bool value)
 {
 	logger_global.enablePrintDateTime(value);
@@ -0,0 +1,156 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "interface/render_job.h"
+#include "interface/interface.h"
+
+BEGIN_YAFARAY
+
+constexpr size_t RenderJob::area_queue_capacity_;
+
+RenderAreaQueue::RenderAreaQueue(size_t capacity)
+{
+	size_t size = 1;
+	while(size < capacity) size *= 2;
+	cells_ = std::unique_ptr<Cell[]>(new Cell[size]);
+	for(size_t i = 0; i < size; ++i) cells_[i].sequence_.store(i, std::memory_order_relaxed);
+	mask_ = size - 1;
+}
+
+bool RenderAreaQueue::push(const Area &area)
+{
+	size_t position = push_position_.load(std::memory_order_relaxed);
+	while(true)
+	{
+		Cell &cell = cells_[position & mask_];
+		const size_t sequence = cell.sequence_.load(std::memory_order_acquire);
+		const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+		if(difference == 0)
+		{
+			if(push_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				cell.area_ = area;
+				cell.sequence_.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if(difference < 0) return false; //the cell still has the area pushed a whole turn before
+		else position = push_position_.load(std::memory_order_relaxed);
+	}
+}
+
+bool RenderAreaQueue::pop(Area &area)
+{
+	size_t position = pop_position_.load(std::memory_order_relaxed);
+	while(true)
+	{
+		Cell &cell = cells_[position & mask_];
+		const size_t sequence = cell.sequence_.load(std::memory_order_acquire);
+		const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+		if(difference == 0)
+		{
+			if(pop_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				area = cell.area_;
+				cell.sequence_.store(position + mask_ + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if(difference < 0) return false; //nothing pushed in the cell yet
+		else position = pop_position_.load(std::memory_order_relaxed);
+	}
+}
+
+RenderJob::RenderJob(Interface &interface, RenderControl *render_control, ProgressBar *pb, bool auto_delete_progress_bar) : interface_(interface), render_control_(render_control)
+{
+	if(render_control_) render_control_->setListener(this);
+	thread_ = std::thread([this, pb, auto_delete_progress_bar]()
+	{
+		interface_.render(pb, auto_delete_progress_bar);
+		if(render_control_) render_control_->setListener(nullptr);
+		std::lock_guard<std::mutex> lock_guard(waiters_mutex_);
+		finished_ = true;
+		for(auto &waiter : waiters_) waiter.promise_.set_value(false);
+		waiters_.clear();
+	});
+}
+
+RenderJob::~RenderJob()
+{
+	wait();
+}
+
+void RenderJob::wait()
+{
+	if(thread_.joinable()) thread_.join();
+}
+
+void RenderJob::cancel()
+{
+	if(!finished_) interface_.abort();
+}
+
+std::shared_future<bool> RenderJob::passFuture(int pass)
+{
+	std::lock_guard<std::mutex> lock_guard(waiters_mutex_);
+	if(pass <= completed_passes_ || finished_)
+	{
+		std::promise<bool> promise;
+		promise.set_value(pass <= completed_passes_);
+		return promise.get_future().share();
+	}
+	for(const auto &waiter : waiters_) if(waiter.pass_ == pass) return waiter.future_;
+	waiters_.emplace_back();
+	PassWaiter &waiter = waiters_.back();
+	waiter.pass_ = pass;
+	waiter.future_ = waiter.promise_.get_future().share();
+	return waiter.future_;
+}
+
+bool RenderJob::pollArea(int &x_0, int &y_0, int &x_1, int &y_1)
+{
+	RenderAreaQueue::Area area;
+	if(!areas_.pop(area)) return false;
+	x_0 = area.x_0_;
+	y_0 = area.y_0_;
+	x_1 = area.x_1_;
+	y_1 = area.y_1_;
+	return true;
+}
+
+void RenderJob::areaFinished(int x_0, int y_0, int x_1, int y_1)
+{
+	if(!areas_.push({x_0, y_0, x_1, y_1})) areas_dropped_ = true;
+}
+
+void RenderJob::passesCompleted(int num_passes)
+{
+	std::lock_guard<std::mutex> lock_guard(waiters_mutex_);
+	if(num_passes > completed_passes_) completed_passes_ = num_passes;
+	for(auto waiter = waiters_.begin(); waiter != waiters_.end(); )
+	{
+		if(waiter->pass_ <= num_passes)
+		{
+			waiter->promise_.set_value(true);
+			waiter = waiters_.erase(waiter);
+		}
+		else ++waiter;
+	}
+}
+
+END_YAFARAY
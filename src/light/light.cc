@@ -41,18 +41,28 @@ std::unique_ptr<Light> Light::factory(ParamMap &params, const Scene &scene)
 		params.printDebug();
 	}
 	std::string type;
+	int link_group = 0;
 	params.getParam("type", type);
-	if(type == "arealight") return AreaLight::factory(params, scene);
-	else if(type == "bgPortalLight") return BackgroundPortalLight::factory(params, scene);
-	else if(type == "meshlight") return MeshLight::factory(params, scene);
-	else if(type == "bglight") return BackgroundLight::factory(params, scene);
-	else if(type == "directional") return DirectionalLight::factory(params, scene);
-	else if(type == "ieslight") return IesLight::factory(params, scene);
-	else if(type == "pointlight") return PointLight::factory(params, scene);
-	else if(type == "spherelight") return SphereLight::factory(params, scene);
-	else if(type == "spotlight") return SpotLight::factory(params, scene);
-	else if(type == "sunlight") return SunLight::factory(params, scene);
-	else return nullptr;
+	params.getParam("link_group", link_group);
+	std::unique_ptr<Light> light;
+	if(type == "arealight") light = AreaLight::factory(params, scene);
+	else if(type == "bgPortalLight") light = BackgroundPortalLight::factory(params, scene);
+	else if(type == "meshlight") light = MeshLight::factory(params, scene);
+	else if(type == "bglight") light = BackgroundLight::factory(params, scene);
+	else if(type == "directional") light = DirectionalLight::factory(params, scene);
+	else if(type == "ieslight") light = IesLight::factory(params, scene);
+	else if(type == "pointlight") light = PointLight::factory(params, scene);
+	else if(type == "spherelight") light = SphereLight::factory(params, scene);
+	else if(type == "spotlight") light = SpotLight::factory(params, scene);
+	else if(type == "sunlight") light = SunLight::factory(params, scene);
+	if(!light) return nullptr;
+	if(link_group < 0 || link_group > 31)
+	{
+		Y_WARNING << "Light: link_group " << link_group << " out of the range 0-31, using the group 0" << YENDL;
+		link_group = 0;
+	}
+	light->setLinkGroup(link_group);
+	return light;
 }
 
 END_YAFARAY
@@ -19,6 +19,7 @@
  */
 
 #include "light/light_area.h"
+#include "light/light_tree.h"
 #include "geometry/surface.h"
 #include "scene/yafaray/object_yafaray.h"
 #include "common/param.h"
@@ -161,6 +162,20 @@ float AreaLight::illumPdf(const SurfacePoint &sp, const SurfacePoint &sp_light)
 	return cos_n > 0 ? r_2 * M_PI / (area_ * cos_n) : 0.f;
 }
 
+bool AreaLight::getBounds(LightBounds &bounds) const
+{
+	bounds.bound_ = Bound(corner_, corner_);
+	bounds.bound_.include(c_2_);
+	bounds.bound_.include(c_3_);
+	bounds.bound_.include(c_4_);
+	bounds.axis_ = normal_;
+	bounds.cos_theta_o_ = 1.f;
+	bounds.cos_theta_e_ = 0.f;
+	bounds.intensity_ = color_.energy() * area_ * M_1_PI; //color includes the PI factor
+	bounds.two_sided_ = false;
+	return true;
+}
+
 void AreaLight::emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const
 {
 	area_pdf = inv_area_ * M_PI;
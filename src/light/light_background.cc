@@ -25,13 +25,15 @@
 #include "common/param.h"
 #include "scene/scene.h"
 #include "geometry/surface.h"
-#include "sampler/sample_pdf1d.h"
+#include "common/session.h"
+#include "common/task_pool.h"
 
 BEGIN_YAFARAY
 
 static constexpr int max_vsamples_global = 360;
 static constexpr int max_usamples_global = 720;
 static constexpr int min_samples_global = 16;
+static constexpr size_t max_cached_distributions_global = 4;
 
 static constexpr float smpl_off_global = 0.4999f;
 static constexpr float sigma_global = 0.000001f;
@@ -64,50 +66,86 @@ BackgroundLight::BackgroundLight(int sampl, bool invert_intersect, bool light_en
 
 void BackgroundLight::init(Scene &scene)
 {
-	auto fu = std::unique_ptr<float[]>(new float[max_usamples_global]);
-	auto fv = std::unique_ptr<float[]>(new float[max_vsamples_global]);
-	const int nv = max_vsamples_global;
-
-	Ray ray;
-	ray.from_ = Point3(0.f);
-	const float inv = 1.f / (float)nv;
-	u_dist_ = std::unique_ptr<std::unique_ptr<Pdf1D>[]>(new std::unique_ptr<Pdf1D>[nv]);
-	for(int y = 0; y < nv; y++)
+	const uint64_t distribution_key = background_->getDistributionKey();
+	distribution_ = nullptr;
+	if(distribution_key != 0)
 	{
-		const float fy = ((float)y + 0.5f) * inv;
-		const float sintheta = sinSample_global(fy);
-		const int nu = min_samples_global + (int)(sintheta * (max_usamples_global - min_samples_global));
-		const float inu = 1.f / (float)nu;
-
-		for(int x = 0; x < nu; x++)
+		std::lock_guard<std::mutex> lock_guard(scene.getSession().mutx_);
+		const auto cached_distribution = scene.getSession().background_distributions_.find(distribution_key);
+		if(cached_distribution != scene.getSession().background_distributions_.end()) distribution_ = cached_distribution->second;
+	}
+	if(distribution_)
+	{
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "BackgroundLight: distribution reused from the previous render" << YENDL;
+	}
+	else
+	{
+		distribution_ = buildDistribution(scene.getNumThreads());
+		if(distribution_key != 0)
 		{
-			const float fx = ((float)x + 0.5f) * inu;
-			invSpheremap_global(fx, fy, ray.dir_);
-			fu[x] = background_->eval(ray, true).energy() * sintheta;
+			std::lock_guard<std::mutex> lock_guard(scene.getSession().mutx_);
+			auto &distributions = scene.getSession().background_distributions_;
+			//Only the distributions of a few different backgrounds are kept, to switch between them without building them again
+			if(distributions.size() >= max_cached_distributions_global) distributions.erase(distributions.begin());
+			distributions[distribution_key] = distribution_;
 		}
-
-		u_dist_[y] = std::unique_ptr<Pdf1D>(new Pdf1D(fu.get(), nu));
-		fv[y] = u_dist_[y]->integral_;
 	}
+}
 
-	v_dist_ = std::unique_ptr<Pdf1D>(new Pdf1D(fv.get(), nv));
-
-	Bound w = scene.getSceneBound();
-	world_center_ = 0.5 * (w.a_ + w.g_);
-	world_radius_ = 0.5 * (w.g_ - w.a_).length();
+void BackgroundLight::initSceneBound(const Bound &scene_bound)
+{
+	world_center_ = 0.5 * (scene_bound.a_ + scene_bound.g_);
+	world_radius_ = 0.5 * (scene_bound.g_ - scene_bound.a_).length();
 	a_pdf_ = world_radius_ * world_radius_;
 	world_pi_factor_ = (math::mult_pi_by_2 * a_pdf_);
 }
 
+std::shared_ptr<const BackgroundDistribution> BackgroundLight::buildDistribution(int num_threads) const
+{
+	auto distribution = std::make_shared<BackgroundDistribution>();
+	const int nv = max_vsamples_global;
+	const float inv = 1.f / (float)nv;
+	//The background is averaged over the size of a row, so images much bigger than the distribution are not undersampled
+	const float row_angle = M_PI * inv;
+	distribution->u_dist_.resize(nv);
+	std::vector<float> fv(nv);
+	TaskPool task_pool(num_threads);
+	parallelFor_global(&task_pool, nv, [&](size_t begin, size_t end)
+	{
+		std::vector<float> fu(max_usamples_global);
+		Ray ray;
+		ray.from_ = Point3(0.f);
+		for(size_t y = begin; y < end; ++y)
+		{
+			const float fy = ((float)y + 0.5f) * inv;
+			const float sintheta = sinSample_global(fy);
+			const int nu = min_samples_global + (int)(sintheta * (max_usamples_global - min_samples_global));
+			const float inu = 1.f / (float)nu;
+
+			for(int x = 0; x < nu; x++)
+			{
+				const float fx = ((float)x + 0.5f) * inu;
+				invSpheremap_global(fx, fy, ray.dir_);
+				fu[x] = background_->evalFiltered(ray, row_angle).energy() * sintheta;
+			}
+
+			distribution->u_dist_[y] = Pdf1D(fu.data(), nu);
+			fv[y] = distribution->u_dist_[y].integral_;
+		}
+	}, 4);
+	distribution->v_dist_ = Pdf1D(fv.data(), nv);
+	return distribution;
+}
+
 inline float BackgroundLight::calcFromSample(float s_1, float s_2, float &u, float &v, bool inv) const
 {
 	int iv;
 	float pdf_1 = 0.f, pdf_2 = 0.f;
-	v = v_dist_->sample(s_2, &pdf_2);
-	iv = clampSample_global(addOff_global(v), v_dist_->count_);
-	u = u_dist_[iv]->sample(s_1, &pdf_1);
-	u *= u_dist_[iv]->inv_count_;
-	v *= v_dist_->inv_count_;
+	v = distribution_->v_dist_.sampleAlias(s_2, &pdf_2);
+	iv = clampSample_global(addOff_global(v), distribution_->v_dist_.count_);
+	u = distribution_->u_dist_[iv].sampleAlias(s_1, &pdf_1);
+	u *= distribution_->u_dist_[iv].inv_count_;
+	v *= distribution_->v_dist_.inv_count_;
 	if(inv)return CALC_INV_PDF(pdf_1, pdf_2, v);
 	return CALC_PDF(pdf_1, pdf_2, v);
 }
@@ -116,10 +154,10 @@ inline float BackgroundLight::calcFromDir(const Vec3 &dir, float &u, float &v, b
 {
 	float pdf_1 = 0.f, pdf_2 = 0.f;
 	spheremap_global(dir, u, v); // Returns u,v pair in [0,1] range
-	const int iv = clampSample_global(addOff_global(v * v_dist_->count_), v_dist_->count_);
-	const int iu = clampSample_global(addOff_global(u * u_dist_[iv]->count_), u_dist_[iv]->count_);
-	pdf_1 = u_dist_[iv]->func_[iu] * u_dist_[iv]->inv_integral_;
-	pdf_2 = v_dist_->func_[iv] * v_dist_->inv_integral_;
+	const int iv = clampSample_global(addOff_global(v * distribution_->v_dist_.count_), distribution_->v_dist_.count_);
+	const int iu = clampSample_global(addOff_global(u * distribution_->u_dist_[iv].count_), distribution_->u_dist_[iv].count_);
+	pdf_1 = distribution_->u_dist_[iv].func_[iu] * distribution_->u_dist_[iv].inv_integral_;
+	pdf_2 = distribution_->v_dist_.func_[iv] * distribution_->v_dist_.inv_integral_;
 	if(inv)return CALC_INV_PDF(pdf_1, pdf_2, v);
 	return CALC_PDF(pdf_1, pdf_2, v);
 }
@@ -29,9 +29,17 @@
 #include "scene/yafaray/object_mesh.h"
 #include "scene/yafaray/primitive_face.h"
 #include <limits>
+#include <algorithm>
 
 BEGIN_YAFARAY
 
+constexpr int BackgroundPortalLight::max_weighted_faces_;
+
+//! the faces seen under a smaller solid angle are sampled by area, as the spherical triangle sampling loses precision with them
+static constexpr float min_spherical_solid_angle_global = 3e-4f;
+//! fraction of the samples distributed by the background luminance, the rest only by solid angle so all the visible faces get samples
+static constexpr float luminance_weight_global = 0.75f;
+
 BackgroundPortalLight::BackgroundPortalLight(const std::string &object_name, int sampl, float pow, bool light_enabled, bool cast_shadows):
 		object_name_(object_name), samples_(sampl), power_(pow)
 {
@@ -65,16 +73,17 @@ void BackgroundPortalLight::initIs()
 	params["empty_bonus"] = 0.33f;
 
 	accelerator_ = Accelerator::factory(primitives_, params);
+
+	if(solid_angle_sampling_ && num_primitives_ > max_weighted_faces_)
+	{
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "bgPortalLight: more than " << max_weighted_faces_ << " faces, sampling them by area" << YENDL;
+		solid_angle_sampling_ = false;
+	}
 }
 
 void BackgroundPortalLight::init(Scene &scene)
 {
 	bg_ = scene.getBackground();
-	Bound w = scene.getSceneBound();
-	float world_radius = 0.5 * (w.g_ - w.a_).length();
-	a_pdf_ = world_radius * world_radius;
-
-	world_center_ = 0.5 * (w.a_ + w.g_);
 	mesh_object_ = static_cast<MeshObject *>(scene.getObject(object_name_));
 	if(mesh_object_)
 	{
@@ -85,23 +94,149 @@ void BackgroundPortalLight::init(Scene &scene)
 	}
 }
 
+void BackgroundPortalLight::initSceneBound(const Bound &scene_bound)
+{
+	float world_radius = 0.5 * (scene_bound.g_ - scene_bound.a_).length();
+	a_pdf_ = world_radius * world_radius;
+
+	world_center_ = 0.5 * (scene_bound.a_ + scene_bound.g_);
+}
+
 void BackgroundPortalLight::sampleSurface(Point3 &p, Vec3 &n, float s_1, float s_2) const
 {
-	float prim_pdf;
-	int prim_num = area_dist_->dSample(s_1, &prim_pdf);
+	float prim_pdf, ss_1;
+	const int prim_num = area_dist_->dSampleAlias(s_1, &prim_pdf, &ss_1);
 	if(prim_num >= area_dist_->count_)
 	{
 		Y_WARNING << "bgPortalLight: Sampling error!" << YENDL;
 		return;
 	}
-	float ss_1, delta = area_dist_->cdf_[prim_num + 1];
-	if(prim_num > 0)
+	static_cast<const FacePrimitive *>(primitives_[prim_num])->sample(ss_1, s_2, p, n);
+}
+
+bool BackgroundPortalLight::faceWeights(const Point3 &p, FaceWeights &weights) const
+{
+	float total_solid_angle = 0.f, total_luminance = 0.f;
+	for(int i = 0; i < num_primitives_; ++i)
 	{
-		delta -= area_dist_->cdf_[prim_num];
-		ss_1 = (s_1 - area_dist_->cdf_[prim_num]) / delta;
+		const FacePrimitive *face = static_cast<const FacePrimitive *>(primitives_[i]);
+		const auto vertices = face->getVertices();
+		float solid_angle = 0.f, luminance = 0.f;
+		if((p - vertices[0]) * face->getGeometricNormal() > 0.f)
+		{
+			const int num_vertices = static_cast<int>(face->numVertices());
+			std::array<Vec3, FacePrimitive::max_vertices_> dirs;
+			Vec3 centroid_dir(0.f);
+			for(int v = 0; v < num_vertices; ++v)
+			{
+				dirs[v] = vertices[v] - p;
+				centroid_dir += dirs[v];
+				dirs[v].normalize();
+			}
+			for(int v = 1; v < num_vertices - 1; ++v) solid_angle += sample::sphericalTriangleArea(dirs[0], dirs[v], dirs[v + 1]);
+			//The background through the face is approximated by its color towards the face center averaged over the size of the face
+			if(solid_angle > 0.f) luminance = solid_angle * bg_->evalFiltered(Ray(p, centroid_dir.normalize()), math::sqrt(solid_angle)).energy();
+		}
+		weights.solid_angle_[i] = solid_angle;
+		weights.probability_[i] = luminance;
+		total_solid_angle += solid_angle;
+		total_luminance += luminance;
 	}
-	else ss_1 = s_1 / delta;
-	static_cast<const FacePrimitive *>(primitives_[prim_num])->sample(ss_1, s_2, p, n);
+	if(total_solid_angle <= 0.f) return false;
+	const float luminance_factor = (total_luminance > 0.f) ? luminance_weight_global / total_luminance : 0.f;
+	const float solid_angle_factor = ((total_luminance > 0.f) ? 1.f - luminance_weight_global : 1.f) / total_solid_angle;
+	for(int i = 0; i < num_primitives_; ++i) weights.probability_[i] = weights.probability_[i] * luminance_factor + weights.solid_angle_[i] * solid_angle_factor;
+	return true;
+}
+
+float BackgroundPortalLight::faceDirPdf(const FaceWeights &weights, int face_num, float dist_sqr, float cos_angle) const
+{
+	const float solid_angle = weights.solid_angle_[face_num];
+	if(solid_angle <= 0.f || cos_angle <= 0.f) return 0.f;
+	if(solid_angle < min_spherical_solid_angle_global) return weights.probability_[face_num] * dist_sqr * M_PI / (primitives_[face_num]->surfaceArea() * cos_angle);
+	return weights.probability_[face_num] * M_PI / solid_angle;
+}
+
+float BackgroundPortalLight::dirPdfSolidAngle(const Point3 &p, const Primitive *face, float dist_sqr, float cos_angle) const
+{
+	const auto face_it = std::find(primitives_.begin(), primitives_.end(), face);
+	if(face_it == primitives_.end()) return 0.f;
+	FaceWeights weights;
+	if(!faceWeights(p, weights)) return 0.f;
+	return faceDirPdf(weights, static_cast<int>(face_it - primitives_.begin()), dist_sqr, cos_angle);
+}
+
+bool BackgroundPortalLight::illumSampleSolidAngle(const SurfacePoint &sp, LSample &s, Ray &wi) const
+{
+	FaceWeights weights;
+	if(!faceWeights(sp.p_, weights)) return false;
+	//The face is selected with the first sample, which is then remapped to sample the face itself
+	float s_1 = s.s_1_;
+	int face_num = 0;
+	float cdf = 0.f;
+	for(; face_num < num_primitives_ - 1; ++face_num)
+	{
+		if(s_1 < cdf + weights.probability_[face_num]) break;
+		cdf += weights.probability_[face_num];
+	}
+	while(face_num > 0 && weights.probability_[face_num] <= 0.f) cdf -= weights.probability_[--face_num];
+	if(weights.probability_[face_num] <= 0.f) return false;
+	s_1 = std::max(0.f, std::min((s_1 - cdf) / weights.probability_[face_num], 0.99999994f));
+
+	const FacePrimitive *face = static_cast<const FacePrimitive *>(primitives_[face_num]);
+	const Vec3 n = face->getGeometricNormal();
+	Point3 p;
+	Vec3 ldir;
+	float dist;
+	if(weights.solid_angle_[face_num] < min_spherical_solid_angle_global)
+	{
+		Vec3 face_n;
+		face->sample(s_1, s.s_2_, p, face_n);
+		ldir = p - sp.p_;
+		dist = ldir.normLen();
+		if(dist <= 0.f) return false;
+	}
+	else
+	{
+		const auto vertices = face->getVertices();
+		const int num_vertices = static_cast<int>(face->numVertices());
+		std::array<Vec3, FacePrimitive::max_vertices_> dirs;
+		for(int v = 0; v < num_vertices; ++v) dirs[v] = (vertices[v] - sp.p_).normalize();
+		//The faces with more than 3 vertices are split in triangles, selected by their solid angle
+		int v = 1;
+		for(float triangle_cdf = 0.f; v < num_vertices - 2; ++v)
+		{
+			const float triangle_probability = sample::sphericalTriangleArea(dirs[0], dirs[v], dirs[v + 1]) / weights.solid_angle_[face_num];
+			if(s_1 < triangle_cdf + triangle_probability)
+			{
+				s_1 = std::min((s_1 - triangle_cdf) / triangle_probability, 0.99999994f);
+				break;
+			}
+			triangle_cdf += triangle_probability;
+			if(v == num_vertices - 3) s_1 = std::max(0.f, std::min((s_1 - triangle_cdf) / std::max(1.f - triangle_cdf, 1.0e-6f), 0.99999994f));
+		}
+		ldir = sample::sphericalTriangle(dirs[0], dirs[v], dirs[v + 1], s_1, s.s_2_);
+		const float cos_dir = ldir * n;
+		if(cos_dir >= 0.f) return false;
+		dist = ((vertices[0] - sp.p_) * n) / cos_dir;
+		if(dist <= 0.f) return false;
+		p = sp.p_ + dist * ldir;
+	}
+	const float cos_angle = -(ldir * n);
+	if(cos_angle <= 0.f) return false;
+
+	wi.tmax_ = dist;
+	wi.dir_ = ldir;
+	s.col_ = bg_->eval(wi, true) * power_;
+	s.pdf_ = faceDirPdf(weights, face_num, dist * dist, cos_angle);
+	if(s.pdf_ <= 0.f) return false;
+	s.flags_ = flags_;
+	if(s.sp_)
+	{
+		s.sp_->p_ = p;
+		s.sp_->n_ = s.sp_->ng_ = n;
+	}
+	return true;
 }
 
 Rgb BackgroundPortalLight::totalEnergy() const
@@ -126,6 +261,7 @@ Rgb BackgroundPortalLight::totalEnergy() const
 bool BackgroundPortalLight::illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const
 {
 	if(photonOnly()) return false;
+	if(solid_angle_sampling_) return illumSampleSolidAngle(sp, s, wi);
 
 	Vec3 n;
 	Point3 p;
@@ -195,8 +331,18 @@ bool BackgroundPortalLight::intersect(const Ray &ray, float &t, Rgb &col, float
 	const Vec3 n = accelerator_intersect_data.hit_primitive_->getGeometricNormal();
 	float cos_angle = ray.dir_ * (-n);
 	if(cos_angle <= 0.f) return false;
-	const float idist_sqr = 1.f / (t * t);
-	ipdf = idist_sqr * area_ * cos_angle * (1.f / M_PI);
+	t = accelerator_intersect_data.t_max_;
+	if(solid_angle_sampling_)
+	{
+		const float pdf = dirPdfSolidAngle(ray.from_, accelerator_intersect_data.hit_primitive_, t * t, cos_angle);
+		if(pdf <= 0.f) return false;
+		ipdf = 1.f / pdf;
+	}
+	else
+	{
+		const float idist_sqr = 1.f / (t * t);
+		ipdf = idist_sqr * area_ * cos_angle * (1.f / M_PI);
+	}
 	col = bg_->eval(ray, true) * power_;
 	col.clampProportionalRgb(clamp_intersect_); //trick to reduce light sampling noise at the expense of realism and inexact overall light. 0.f disables clamping
 	return true;
@@ -207,7 +353,15 @@ float BackgroundPortalLight::illumPdf(const SurfacePoint &sp, const SurfacePoint
 	Vec3 wo = sp.p_ - sp_light.p_;
 	float r_2 = wo.normLenSqr();
 	float cos_n = wo * sp_light.ng_;
-	return cos_n > 0 ? (r_2 * M_PI / (area_ * cos_n)) : 0.f;
+	if(cos_n <= 0.f) return 0.f;
+	if(solid_angle_sampling_ && accelerator_)
+	{
+		//The face of the light point is the first one found from the shading point
+		const AcceleratorIntersectData accelerator_intersect_data = accelerator_->intersect(Ray(sp.p_, -wo), std::sqrt(r_2) * 1.001f);
+		if(!accelerator_intersect_data.hit_) return 0.f;
+		return dirPdfSolidAngle(sp.p_, accelerator_intersect_data.hit_primitive_, r_2, cos_n);
+	}
+	return r_2 * M_PI / (area_ * cos_n);
 }
 
 void BackgroundPortalLight::emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const
@@ -228,6 +382,7 @@ std::unique_ptr<Light> BackgroundPortalLight::factory(ParamMap &params, const Sc
 	bool light_enabled = true;
 	bool cast_shadows = true;
 	bool p_only = false;
+	bool solid_angle_sampling = true;
 
 	params.getParam("object_name", object_name);
 	params.getParam("samples", samples);
@@ -237,12 +392,14 @@ std::unique_ptr<Light> BackgroundPortalLight::factory(ParamMap &params, const Sc
 	params.getParam("photon_only", p_only);
 	params.getParam("light_enabled", light_enabled);
 	params.getParam("cast_shadows", cast_shadows);
+	params.getParam("solid_angle_sampling", solid_angle_sampling);
 
 	auto light = std::unique_ptr<BackgroundPortalLight>(new BackgroundPortalLight(object_name, samples, pow, light_enabled, cast_shadows));
 
 	light->shoot_caustic_ = shoot_c;
 	light->shoot_diffuse_ = shoot_d;
 	light->photon_only_ = p_only;
+	light->solid_angle_sampling_ = solid_angle_sampling;
 
 	return light;
 }
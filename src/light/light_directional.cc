@@ -39,15 +39,14 @@ DirectionalLight::DirectionalLight(const Point3 &pos, Vec3 dir, const Rgb &col,
 	major_axis_ = (d.x_ > d.y_) ? ((d.x_ > d.z_) ? 0 : 2) : ((d.y_ > d.z_) ? 1 : 2);
 }
 
-void DirectionalLight::init(Scene &scene)
+void DirectionalLight::initSceneBound(const Bound &scene_bound)
 {
 	// calculate necessary parameters for photon mapping if the light
 	//  is set to illuminate the whole scene:
-	Bound w = scene.getSceneBound();
-	world_radius_ = 0.5 * (w.g_ - w.a_).length();
+	world_radius_ = 0.5 * (scene_bound.g_ - scene_bound.a_).length();
 	if(infinite_)
 	{
-		position_ = 0.5 * (w.a_ + w.g_);
+		position_ = 0.5 * (scene_bound.a_ + scene_bound.g_);
 		radius_ = world_radius_;
 	}
 	area_pdf_ = 1.f / (radius_ * radius_); // Pi cancels out with our weird conventions :p
@@ -98,6 +97,67 @@ Rgb DirectionalLight::emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray
 	return color_;
 }
 
+//! Disk of the target projected on the emission plane, false if the target is behind the light
+static bool targetDisk_global(const Point3 &position, const Vec3 &direction, bool infinite, const ProjectionTarget &target, Point3 &center)
+{
+	const float height = (target.center_ - position) * direction;
+	if(!infinite && height > target.radius_) return false;
+	center = target.center_ - height * direction;
+	return true;
+}
+
+float DirectionalLight::projectionFraction(const std::vector<ProjectionTarget> &targets) const
+{
+	if(targets.empty()) return 1.f;
+	float area = 0.f;
+	for(const auto &target : targets)
+	{
+		Point3 center;
+		if(targetDisk_global(position_, direction_, infinite_, target, center)) area += M_PI * target.radius_ * target.radius_;
+	}
+	return std::min(1.f, area / static_cast<float>(M_PI * radius_ * radius_));
+}
+
+Rgb DirectionalLight::emitPhotonTowards(const std::vector<ProjectionTarget> &targets, float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const
+{
+	//The target is chosen proportionally to the area of its disk on the emission plane and the photon starts uniformly in it. The pdf of the point adds the disks of all the targets containing it
+	float area = 0.f;
+	for(const auto &target : targets)
+	{
+		Point3 center;
+		if(targetDisk_global(position_, direction_, infinite_, target, center)) area += target.radius_ * target.radius_;
+	}
+	if(area <= 0.f) return emitPhoton(s_1, s_2, s_3, s_4, ray, ipdf);
+
+	const float target_sample = s_3 * area;
+	float accumulated_area = 0.f;
+	Point3 center = position_;
+	float radius = 0.f;
+	for(const auto &target : targets)
+	{
+		if(!targetDisk_global(position_, direction_, infinite_, target, center)) continue;
+		radius = target.radius_;
+		accumulated_area += radius * radius;
+		if(target_sample < accumulated_area) break;
+	}
+	float u, v;
+	Vec3::shirleyDisk(s_1, s_2, u, v);
+	const Point3 from = center + radius * (u * du_ + v * dv_);
+	ray.dir_ = -direction_;
+	ray.from_ = from;
+	if(infinite_) ray.from_ += direction_ * world_radius_;
+
+	int num_disks = 0;
+	for(const auto &target : targets)
+	{
+		Point3 target_center;
+		if(targetDisk_global(position_, direction_, infinite_, target, target_center) && (from - target_center).lengthSqr() <= target.radius_ * target.radius_) ++num_disks;
+	}
+	ipdf = M_PI * area / static_cast<float>(std::max(1, num_disks));
+	if((from - position_).lengthSqr() > radius_ * radius_) return Rgb(0.f); //outside of the light
+	return color_;
+}
+
 Rgb DirectionalLight::emitSample(Vec3 &wo, LSample &s) const
 {
 	//todo
@@ -19,14 +19,20 @@
  */
 
 #include "light/light_ies.h"
+#include "light/light_tree.h"
 #include "geometry/surface.h"
 #include "sampler/sample.h"
 #include "light/light_ies_data.h"
 #include "geometry/ray.h"
 #include "common/param.h"
+#include <algorithm>
 
 BEGIN_YAFARAY
 
+static constexpr int dist_theta_steps_global = 64; //!< rows of the emission distribution, from the light axis to the cone edge
+static constexpr int dist_phi_steps_global = 64; //!< columns of the emission distribution, around the light axis
+static constexpr int dist_subsamples_global = 3; //!< per cell and dimension, the cells take the maximum intensity so the narrow peaks of the profile are not missed
+
 IesLight::IesLight(const Point3 &from, const Point3 &to, const Rgb &col, float power, const std::string ies_file, int smpls, bool s_sha, float ang, bool b_light_enabled, bool b_cast_shadows):
 		Light(Light::Flags::Singular), position_(from), samples_(smpls), soft_shadow_(s_sha)
 {
@@ -45,7 +51,76 @@ IesLight::IesLight(const Point3 &from, const Point3 &to, const Rgb &col, float p
 
 		color_ = col * power;
 		tot_energy_ = math::mult_pi_by_2 * (1.f - 0.5f * cos_end_);
+		theta_end_ = ies_data_->getMaxVAngle();
+		cone_solid_angle_ = math::mult_pi_by_2 * (1.f - cos_end_);
+		buildEmitDistribution();
+	}
+}
+
+void IesLight::buildEmitDistribution()
+{
+	//The cells are regular in the angle to the axis, so the profiles are also sampled finely close to the axis. Their solid angle is included with the sine
+	std::vector<float> f_theta(dist_theta_steps_global);
+	std::vector<float> f_phi(dist_phi_steps_global);
+	phi_dist_.resize(dist_theta_steps_global);
+	const float sub_step = 1.f / dist_subsamples_global;
+	for(int theta_step = 0; theta_step < dist_theta_steps_global; ++theta_step)
+	{
+		const float sin_theta = math::sin((theta_step + 0.5f) * theta_end_ / dist_theta_steps_global);
+		for(int phi_step = 0; phi_step < dist_phi_steps_global; ++phi_step)
+		{
+			float max_rad = 0.f;
+			for(int j = 0; j < dist_subsamples_global; ++j)
+			{
+				const float theta = (theta_step + (j + 0.5f) * sub_step) * theta_end_ / dist_theta_steps_global;
+				for(int i = 0; i < dist_subsamples_global; ++i)
+				{
+					const float phi = (phi_step + (i + 0.5f) * sub_step) * math::mult_pi_by_2 / dist_phi_steps_global;
+					const Vec3 dir = (math::cos(theta) * dir_ + math::sin(theta) * (math::cos(phi) * du_ + math::sin(phi) * dv_)).normalize();
+					float u, v;
+					getAngles(u, v, dir, dir * dir_);
+					max_rad = std::max(max_rad, ies_data_->getRadiance(u, v));
+				}
+			}
+			f_phi[phi_step] = max_rad * sin_theta;
+		}
+		//The rows without emission are never selected, they are only made valid distributions
+		const bool row_emits = *std::max_element(f_phi.begin(), f_phi.end()) > 0.f;
+		if(!row_emits) std::fill(f_phi.begin(), f_phi.end(), 1.f);
+		phi_dist_[theta_step] = Pdf1D(f_phi.data(), dist_phi_steps_global);
+		f_theta[theta_step] = row_emits ? phi_dist_[theta_step].integral_ : 0.f;
 	}
+	if(*std::max_element(f_theta.begin(), f_theta.end()) <= 0.f) std::fill(f_theta.begin(), f_theta.end(), 1.f);
+	theta_dist_ = Pdf1D(f_theta.data(), dist_theta_steps_global);
+}
+
+Vec3 IesLight::sampleEmitDir(float s_1, float s_2, float &pdf) const
+{
+	float pdf_theta, pdf_phi;
+	const float theta_sample = theta_dist_.sampleAlias(s_2, &pdf_theta);
+	const int theta_step = std::max(0, std::min(static_cast<int>(theta_sample), dist_theta_steps_global - 1));
+	const float phi_sample = phi_dist_[theta_step].sampleAlias(s_1, &pdf_phi);
+	const float theta = theta_sample * theta_end_ / dist_theta_steps_global;
+	const float phi = phi_sample * math::mult_pi_by_2 / dist_phi_steps_global;
+	const float sin_theta = math::sin(theta);
+	//The pdf over the unit square of the grid, divided by the solid angle of its area
+	pdf = (sin_theta > 0.f) ? pdf_theta * pdf_phi / (theta_end_ * math::mult_pi_by_2 * sin_theta) : 0.f;
+	return (math::cos(theta) * dir_ + sin_theta * (math::cos(phi) * du_ + math::sin(phi) * dv_)).normalize();
+}
+
+float IesLight::emitDirPdf(const Vec3 &dir) const
+{
+	const float cos_theta = std::max(-1.f, std::min(1.f, dir * dir_));
+	const float theta = math::acos(cos_theta);
+	const float sin_theta = math::sin(theta);
+	if(theta > theta_end_ || sin_theta <= 0.f) return 0.f;
+	float phi = std::atan2(dir * dv_, dir * du_);
+	if(phi < 0.f) phi += math::mult_pi_by_2;
+	const int theta_step = std::max(0, std::min(static_cast<int>(theta / theta_end_ * dist_theta_steps_global), dist_theta_steps_global - 1));
+	const int phi_step = std::max(0, std::min(static_cast<int>(phi / math::mult_pi_by_2 * dist_phi_steps_global), dist_phi_steps_global - 1));
+	const float pdf_theta = theta_dist_.func_[theta_step] * theta_dist_.inv_integral_;
+	const float pdf_phi = phi_dist_[theta_step].func_[phi_step] * phi_dist_[theta_step].inv_integral_;
+	return pdf_theta * pdf_phi / (theta_end_ * math::mult_pi_by_2 * sin_theta);
 }
 
 void IesLight::getAngles(float &u, float &v, const Vec3 &dir, const float &costheta) const
@@ -133,20 +208,22 @@ bool IesLight::intersect(const Ray &ray, float &t, Rgb &col, float &ipdf) const
 Rgb IesLight::emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const
 {
 	ray.from_ = position_;
-	ray.dir_ = sample::cone(dir_, du_, dv_, cos_end_, s_1, s_2);
+	float dir_pdf;
+	ray.dir_ = sampleEmitDir(s_1, s_2, dir_pdf);
 
 	ipdf = 0.f;
 
 	float cosa = ray.dir_ * dir_;
 
-	if(cosa < cos_end_) return Rgb(0.f);
+	if(cosa < cos_end_ || dir_pdf <= 0.f) return Rgb(0.f);
 
 	float u, v;
 	getAngles(u, v, ray.dir_, cosa);
 
 	float rad = ies_data_->getRadiance(u, v);
 
-	ipdf = rad;
+	//Relative to the uniform sampling of the cone, so the photons keep the same power
+	ipdf = rad / (dir_pdf * cone_solid_angle_);
 
 	return color_;
 }
@@ -156,19 +233,31 @@ Rgb IesLight::emitSample(Vec3 &wo, LSample &s) const
 	s.sp_->p_ = position_;
 	s.flags_ = flags_;
 
-	wo = sample::cone(dir_, du_, dv_, cos_end_, s.s_3_, s.s_4_);
+	float dir_pdf;
+	wo = sampleEmitDir(s.s_3_, s.s_4_, dir_pdf);
 
 	float u, v;
 	getAngles(u, v, wo, wo * dir_);
 
 	float rad = ies_data_->getRadiance(u, v);
 
-	s.dir_pdf_ = (rad > 0.f) ? (tot_energy_ / rad) : 0.f;
+	s.dir_pdf_ = (rad > 0.f) ? (tot_energy_ / rad) * dir_pdf * cone_solid_angle_ : 0.f;
 	s.area_pdf_ = 1.f;
 
 	return color_ * rad * tot_energy_;
 }
 
+bool IesLight::getBounds(LightBounds &bounds) const
+{
+	bounds.bound_ = Bound(position_, position_);
+	bounds.axis_ = dir_;
+	bounds.cos_theta_o_ = 1.f;
+	bounds.cos_theta_e_ = cos_end_;
+	bounds.intensity_ = color_.energy();
+	bounds.two_sided_ = false;
+	return true;
+}
+
 void IesLight::emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const
 {
 	cos_wo = 1.f;
@@ -184,7 +273,7 @@ void IesLight::emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf,
 
 	float rad = ies_data_->getRadiance(u, v);
 
-	dir_pdf = (rad > 0.f) ? (tot_energy_ / rad) : 0.f;
+	dir_pdf = (rad > 0.f) ? (tot_energy_ / rad) * emitDirPdf(wo) * cone_solid_angle_ : 0.f;
 }
 
 std::unique_ptr<Light> IesLight::factory(ParamMap &params, const Scene &scene)
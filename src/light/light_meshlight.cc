@@ -21,6 +21,7 @@
 #include <limits>
 
 #include "light/light_meshlight.h"
+#include "light/light_tree.h"
 #include "background/background.h"
 #include "texture/texture.h"
 #include "common/param.h"
@@ -46,18 +47,37 @@ void MeshLight::initIs()
 {
 	num_primitives_ = mesh_object_->numPrimitives();
 	primitives_ = mesh_object_->getPrimitives();
-	auto areas = std::unique_ptr<float[]>(new float[num_primitives_]);
+	primitives_areas_.resize(num_primitives_);
 	double total_area = 0.0;
 	for(int i = 0; i < num_primitives_; ++i)
 	{
-		areas[i] = static_cast<const FacePrimitive *>(primitives_[i])->surfaceArea();
-		total_area += areas[i];
+		primitives_areas_[i] = static_cast<const FacePrimitive *>(primitives_[i])->surfaceArea();
+		total_area += primitives_areas_[i];
 	}
-	area_dist_ = std::unique_ptr<Pdf1D>(new Pdf1D(areas.get(), num_primitives_));
+	area_dist_ = std::unique_ptr<Pdf1D>(new Pdf1D(primitives_areas_.data(), num_primitives_));
 	area_ = static_cast<float>(total_area);
 	inv_area_ = static_cast<float>(1.0 / total_area);
 	accelerator_ = nullptr;
 
+	//The illumination samples choose the primitives with a light tree over their bounds and normals, so the primitives facing away from
+	//the illuminated point or far from it are rarely sampled. The emission samples keep choosing them by area
+	primitives_tree_ = nullptr;
+	if(num_primitives_ > 1)
+	{
+		std::vector<LightBounds> primitives_bounds(num_primitives_);
+		for(int i = 0; i < num_primitives_; ++i)
+		{
+			primitives_bounds[i].bound_ = primitives_[i]->getBound();
+			primitives_bounds[i].axis_ = primitives_[i]->getGeometricNormal();
+			primitives_bounds[i].cos_theta_o_ = 1.f;
+			primitives_bounds[i].cos_theta_e_ = 0.f;
+			primitives_bounds[i].intensity_ = color_.energy() * primitives_areas_[i] * M_1_PI;
+			primitives_bounds[i].two_sided_ = double_sided_;
+		}
+		primitives_tree_ = std::unique_ptr<LightTree>(new LightTree(primitives_bounds));
+		if(primitives_tree_->numBoundedLights() == 0) primitives_tree_ = nullptr;
+	}
+
 	ParamMap params;
 	params["type"] = std::string("kdtree"); //Do not remove the std::string(), entering directly a string literal can be confused with bool until C++17 new string literals
 	params["num_primitives"] = num_primitives_;
@@ -82,24 +102,42 @@ void MeshLight::init(Scene &scene)
 	}
 }
 
-void MeshLight::sampleSurface(Point3 &p, Vec3 &n, float s_1, float s_2) const
+int MeshLight::sampleSurface(Point3 &p, Vec3 &n, float s_1, float s_2) const
 {
-	float prim_pdf;
-	int prim_num = area_dist_->dSample(s_1, &prim_pdf);
+	float prim_pdf, ss_1;
+	const int prim_num = area_dist_->dSampleAlias(s_1, &prim_pdf, &ss_1);
 	if(prim_num >= area_dist_->count_)
 	{
 		Y_WARNING << "MeshLight: Sampling error!" << YENDL;
-		return;
+		return -1;
 	}
-	float ss_1, delta = area_dist_->cdf_[prim_num + 1];
-	if(prim_num > 0)
+	static_cast<const FacePrimitive *>(primitives_[prim_num])->sample(ss_1, s_2, p, n);
+	//	++stats[primNum];
+	return prim_num;
+}
+
+int MeshLight::sampleSurface(const Point3 &from, Point3 &p, Vec3 &n, float s_1, float s_2, float &area_pdf) const
+{
+	if(!primitives_tree_)
 	{
-		delta -= area_dist_->cdf_[prim_num];
-		ss_1 = (s_1 - area_dist_->cdf_[prim_num]) / delta;
+		area_pdf = inv_area_;
+		return sampleSurface(p, n, s_1, s_2);
 	}
-	else ss_1 = s_1 / delta;
+	//The normal of the illuminated point is not used, so the pdf can also be computed in intersect() where it is not known
+	float prim_pmf, ss_1;
+	const int prim_num = primitives_tree_->sample(from, Vec3(0.f), s_1, prim_pmf, &ss_1);
+	if(prim_num < 0) return -1;
 	static_cast<const FacePrimitive *>(primitives_[prim_num])->sample(ss_1, s_2, p, n);
-	//	++stats[primNum];
+	area_pdf = prim_pmf / primitives_areas_[prim_num];
+	return prim_num;
+}
+
+float MeshLight::surfacePdf(const Point3 &from, const Primitive *primitive) const
+{
+	if(!primitives_tree_ || !primitive) return inv_area_;
+	const int prim_num = static_cast<const FacePrimitive *>(primitive)->getSelfIndex();
+	if(prim_num >= num_primitives_ || primitives_[prim_num] != primitive) return inv_area_;
+	return primitives_tree_->pmf(from, Vec3(0.f), prim_num) / primitives_areas_[prim_num];
 }
 
 Rgb MeshLight::totalEnergy() const { return (double_sided_ ? 2.f * color_ * area_ : color_ * area_); }
@@ -110,7 +148,9 @@ bool MeshLight::illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const
 
 	Vec3 n;
 	Point3 p;
-	sampleSurface(p, n, s.s_1_, s.s_2_);
+	float area_pdf;
+	const int prim_num = sampleSurface(sp.p_, p, n, s.s_1_, s.s_2_, area_pdf);
+	if(prim_num < 0) return false;
 
 	Vec3 ldir = p - sp.p_;
 	//normalize vec and compute inverse square distance
@@ -131,15 +171,16 @@ bool MeshLight::illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const
 	wi.dir_ = ldir;
 
 	s.col_ = color_;
-	// pdf = distance^2 / area * cos(norm, ldir);
-	float area_mul_cosangle = area_ * cos_angle;
+	// pdf = distance^2 * area_pdf / cos(norm, ldir);
+	float cosangle_div_area_pdf = cos_angle / area_pdf;
 	//TODO: replace the hardcoded value (1e-8f) by a macro for min/max values: here used, to avoid dividing by zero
-	s.pdf_ = dist_sqr * M_PI / ((area_mul_cosangle == 0.f) ? 1e-8f : area_mul_cosangle);
+	s.pdf_ = dist_sqr * M_PI / ((cosangle_div_area_pdf == 0.f) ? 1e-8f : cosangle_div_area_pdf);
 	s.flags_ = flags_;
 	if(s.sp_)
 	{
 		s.sp_->p_ = p;
 		s.sp_->n_ = s.sp_->ng_ = n;
+		s.sp_->hit_primitive_ = primitives_[prim_num];
 	}
 	return true;
 }
@@ -164,8 +205,9 @@ Rgb MeshLight::emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray,
 Rgb MeshLight::emitSample(Vec3 &wo, LSample &s) const
 {
 	s.area_pdf_ = inv_area_ * M_PI;
-	sampleSurface(s.sp_->p_, s.sp_->ng_, s.s_3_, s.s_4_);
+	const int prim_num = sampleSurface(s.sp_->p_, s.sp_->ng_, s.s_3_, s.s_4_);
 	s.sp_->n_ = s.sp_->ng_;
+	s.sp_->hit_primitive_ = (prim_num >= 0) ? primitives_[prim_num] : nullptr;
 	Vec3 du, dv;
 	Vec3::createCs(s.sp_->ng_, du, dv);
 
@@ -198,8 +240,11 @@ bool MeshLight::intersect(const Ray &ray, float &t, Rgb &col, float &ipdf) const
 		if(double_sided_) cos_angle = std::abs(cos_angle);
 		else return false;
 	}
+	const float area_pdf = surfacePdf(ray.from_, accelerator_intersect_data.hit_primitive_);
+	if(area_pdf <= 0.f) return false; //illumSample cannot choose this primitive for this point, it cannot illuminate it
+	t = accelerator_intersect_data.t_max_;
 	const float idist_sqr = 1.f / (t * t);
-	ipdf = idist_sqr * area_ * cos_angle * (1.f / M_PI);
+	ipdf = idist_sqr * cos_angle * (1.f / (M_PI * area_pdf));
 	col = color_;
 	return true;
 }
@@ -209,7 +254,28 @@ float MeshLight::illumPdf(const SurfacePoint &sp, const SurfacePoint &sp_light)
 	Vec3 wo = sp.p_ - sp_light.p_;
 	float r_2 = wo.normLenSqr();
 	float cos_n = wo * sp_light.ng_;
-	return cos_n > 0 ? r_2 * M_PI / (area_ * cos_n) : (double_sided_ ? r_2 * M_PI / (area_ * -cos_n) : 0.f);
+	const float area_pdf = surfacePdf(sp.p_, sp_light.hit_primitive_);
+	return cos_n > 0 ? r_2 * M_PI * area_pdf / cos_n : (double_sided_ ? r_2 * M_PI * area_pdf / -cos_n : 0.f);
+}
+
+bool MeshLight::getBounds(LightBounds &bounds) const
+{
+	if(primitives_.empty()) return false;
+	//The normals cone is built merging the normals of all the triangles
+	bounds = LightBounds();
+	for(const auto &primitive : primitives_)
+	{
+		LightBounds primitive_bounds;
+		primitive_bounds.bound_ = primitive->getBound();
+		primitive_bounds.axis_ = primitive->getGeometricNormal();
+		primitive_bounds.cos_theta_o_ = 1.f;
+		primitive_bounds.intensity_ = 1.f;
+		bounds = LightBounds::merge(bounds, primitive_bounds);
+	}
+	bounds.cos_theta_e_ = 0.f;
+	bounds.intensity_ = color_.energy() * area_ * M_1_PI;
+	bounds.two_sided_ = double_sided_;
+	return true;
 }
 
 void MeshLight::emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const
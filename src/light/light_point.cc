@@ -19,6 +19,7 @@
  */
 
 #include "light/light_point.h"
+#include "light/light_tree.h"
 #include "geometry/surface.h"
 #include "sampler/sample.h"
 #include "geometry/ray.h"
@@ -84,6 +85,70 @@ Rgb PointLight::emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray,
 	return color_;
 }
 
+//! Cosine of the half angle of the cone from position towards the target, false if the position is inside it
+static bool targetCone_global(const Point3 &position, const ProjectionTarget &target, Vec3 &axis, float &cos_max)
+{
+	axis = target.center_ - position;
+	const float dist_sqr = axis.lengthSqr();
+	const float radius_sqr = target.radius_ * target.radius_;
+	if(dist_sqr <= radius_sqr) return false;
+	axis *= 1.f / math::sqrt(dist_sqr);
+	cos_max = math::sqrt(1.f - radius_sqr / dist_sqr);
+	return true;
+}
+
+float PointLight::projectionFraction(const std::vector<ProjectionTarget> &targets) const
+{
+	if(targets.empty()) return 1.f;
+	float solid_angle = 0.f;
+	for(const auto &target : targets)
+	{
+		Vec3 axis;
+		float cos_max;
+		if(!targetCone_global(position_, target, axis, cos_max)) return 1.f;
+		solid_angle += math::mult_pi_by_2 * (1.f - cos_max);
+	}
+	return std::min(1.f, solid_angle / static_cast<float>(4.0 * M_PI));
+}
+
+Rgb PointLight::emitPhotonTowards(const std::vector<ProjectionTarget> &targets, float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const
+{
+	//The target is chosen proportionally to its solid angle and the direction is sampled uniformly in its cone. The pdf of the direction adds the cones of all the targets containing it
+	float solid_angle = 0.f;
+	for(const auto &target : targets)
+	{
+		Vec3 axis;
+		float cos_max;
+		if(!targetCone_global(position_, target, axis, cos_max)) return emitPhoton(s_1, s_2, s_3, s_4, ray, ipdf);
+		solid_angle += math::mult_pi_by_2 * (1.f - cos_max);
+	}
+	if(targets.empty() || solid_angle <= 0.f) return emitPhoton(s_1, s_2, s_3, s_4, ray, ipdf);
+
+	const float target_sample = s_3 * solid_angle;
+	float accumulated_solid_angle = 0.f;
+	Vec3 axis, du, dv;
+	float cos_max = 1.f;
+	for(const auto &target : targets)
+	{
+		if(!targetCone_global(position_, target, axis, cos_max)) continue;
+		accumulated_solid_angle += math::mult_pi_by_2 * (1.f - cos_max);
+		if(target_sample < accumulated_solid_angle) break;
+	}
+	Vec3::createCs(axis, du, dv);
+	ray.from_ = position_;
+	ray.dir_ = sample::cone(axis, du, dv, cos_max, s_1, s_2);
+
+	int num_cones = 0;
+	for(const auto &target : targets)
+	{
+		Vec3 target_axis;
+		float target_cos_max;
+		if(targetCone_global(position_, target, target_axis, target_cos_max) && ray.dir_ * target_axis >= target_cos_max) ++num_cones;
+	}
+	ipdf = solid_angle / static_cast<float>(std::max(1, num_cones));
+	return color_;
+}
+
 Rgb PointLight::emitSample(Vec3 &wo, LSample &s) const
 {
 	s.sp_->p_ = position_;
@@ -94,6 +159,16 @@ Rgb PointLight::emitSample(Vec3 &wo, LSample &s) const
 	return color_;
 }
 
+bool PointLight::getBounds(LightBounds &bounds) const
+{
+	bounds.bound_ = Bound(position_, position_);
+	bounds.cos_theta_o_ = -1.f;
+	bounds.cos_theta_e_ = 0.f;
+	bounds.intensity_ = color_.energy();
+	bounds.two_sided_ = false;
+	return true;
+}
+
 void PointLight::emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const
 {
 	area_pdf = 1.f;
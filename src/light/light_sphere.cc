@@ -19,6 +19,7 @@
  */
 
 #include "light/light_sphere.h"
+#include "light/light_tree.h"
 #include "geometry/surface.h"
 #include "scene/yafaray/object_yafaray.h"
 #include "common/param.h"
@@ -66,6 +67,13 @@ inline bool sphereIntersect_global(const Ray &ray, const Point3 &c, float r_2, f
 	return true;
 }
 
+//! 1 - cosine of the half angle of the cone in which the sphere is seen, without the cancellation of 1 - sqrt(1 - sin^2) for the small or distant spheres
+static inline float coneOneMinusCos_global(float square_radius, float dist_sqr)
+{
+	const float sin_alpha_sqr = square_radius / dist_sqr;
+	return sin_alpha_sqr / (1.f + math::sqrt(1.f - sin_alpha_sqr));
+}
+
 bool SphereLight::illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const
 {
 	if(photonOnly()) return false;
@@ -75,21 +83,23 @@ bool SphereLight::illumSample(const SurfacePoint &sp, LSample &s, Ray &wi) const
 	if(dist_sqr <= square_radius_) return false; //only emit light on the outside!
 
 	float dist = math::sqrt(dist_sqr);
-	float idist_sqr = 1.f / (dist_sqr);
-	float cos_alpha = math::sqrt(1.f - square_radius_ * idist_sqr);
+	const float one_minus_cos_alpha = coneOneMinusCos_global(square_radius_, dist_sqr);
 	cdir *= 1.f / dist;
 	Vec3 du, dv;
 	Vec3::createCs(cdir, du, dv);
 
-	wi.dir_ = sample::cone(cdir, du, dv, cos_alpha, s.s_1_, s.s_2_);
-	float d_1, d_2;
-	if(!sphereIntersect_global(wi, center_, square_radius_epsilon_, d_1, d_2))
-	{
-		return false;
-	}
+	//Uniform sample of the cone of directions seen by the sphere. The distance to the sphere is computed from the sampled angle
+	//instead of intersecting the ray, so the directions grazing the sphere are not lost by the rounding errors
+	const float one_minus_cos_theta = one_minus_cos_alpha * s.s_2_;
+	const float cos_theta = 1.f - one_minus_cos_theta;
+	const float sin_theta_sqr = one_minus_cos_theta * (2.f - one_minus_cos_theta);
+	const float sin_theta = math::sqrt(sin_theta_sqr);
+	const float phi = math::mult_pi_by_2 * s.s_1_;
+	wi.dir_ = (du * math::cos(phi) + dv * math::sin(phi)) * sin_theta + cdir * cos_theta;
+	const float d_1 = dist * cos_theta - math::sqrt(std::max(0.f, square_radius_ - dist_sqr * sin_theta_sqr));
 	wi.tmax_ = d_1;
 
-	s.pdf_ = 1.f / (2.f * (1.f - cos_alpha));
+	s.pdf_ = 1.f / (2.f * one_minus_cos_alpha);
 	s.col_ = color_;
 	s.flags_ = flags_;
 	if(s.sp_)
@@ -108,9 +118,7 @@ bool SphereLight::intersect(const Ray &ray, float &t, Rgb &col, float &ipdf) con
 		Vec3 cdir = center_ - ray.from_;
 		float dist_sqr = cdir.lengthSqr();
 		if(dist_sqr <= square_radius_) return false; //only emit light on the outside!
-		float idist_sqr = 1.f / (dist_sqr);
-		float cos_alpha = math::sqrt(1.f - square_radius_ * idist_sqr);
-		ipdf = 2.f * (1.f - cos_alpha);
+		ipdf = 2.f * coneOneMinusCos_global(square_radius_, dist_sqr);
 		col = color_;
 		return true;
 	}
@@ -122,9 +130,17 @@ float SphereLight::illumPdf(const SurfacePoint &sp, const SurfacePoint &sp_light
 	Vec3 cdir = center_ - sp.p_;
 	float dist_sqr = cdir.lengthSqr();
 	if(dist_sqr <= square_radius_) return 0.f; //only emit light on the outside!
-	float idist_sqr = 1.f / (dist_sqr);
-	float cos_alpha = math::sqrt(1.f - square_radius_ * idist_sqr);
-	return 1.f / (2.f * (1.f - cos_alpha));
+	return 1.f / (2.f * coneOneMinusCos_global(square_radius_, dist_sqr));
+}
+
+bool SphereLight::getBounds(LightBounds &bounds) const
+{
+	bounds.bound_ = Bound(center_ - Vec3(radius_), center_ + Vec3(radius_));
+	bounds.cos_theta_o_ = -1.f;
+	bounds.cos_theta_e_ = 0.f;
+	bounds.intensity_ = color_.energy() * area_ * 0.25f * M_1_PI; //projected area
+	bounds.two_sided_ = false;
+	return true;
 }
 
 void SphereLight::emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const
@@ -19,11 +19,12 @@
  */
 
 #include "light/light_spot.h"
+#include "light/light_tree.h"
 #include "geometry/surface.h"
 #include "geometry/ray.h"
 #include "sampler/sample.h"
-#include "sampler/sample_pdf1d.h"
 #include "common/param.h"
+#include "common/logger.h"
 
 BEGIN_YAFARAY
 
@@ -42,14 +43,6 @@ SpotLight::SpotLight(const Point3 &from, const Point3 &to, const Rgb &col, float
 	cos_end_ = math::cos(rad_angle);
 	icos_diff_ = 1.0 / (cos_start_ - cos_end_);
 
-	auto f = std::unique_ptr<float[]>(new float[65]);
-	for(int i = 0; i < 65; i++)
-	{
-		float v = (float)i / 64.f;
-		f[i] = v * v * (3.f - 2.f * v);
-	}
-	pdf_ = std::unique_ptr<Pdf1D>(new Pdf1D(f.get(), 65));
-
 	/* the integral of the smoothstep is 0.5, and since it gets applied to the cos, and each delta cos
 		corresponds to a constant surface are of the (partial) emitting sphere, we can actually simply
 		compute the energie emitted from both areas, the constant and blending one...
@@ -65,6 +58,23 @@ SpotLight::SpotLight(const Point3 &from, const Point3 &to, const Rgb &col, float
 	interv_2_ *= sum;
 }
 
+/*! Samples x in [0,1] with a density proportional to the smoothstep falloff 3x^2 - 2x^3, inverting its cdf 2x^3 - x^4 with Newton iterations.
+	The cdf is convex and not below x^4, so starting from s^(1/4) the iterations approach the solution monotonically from above.
+	Returns x and the density 6x^2 - 4x^3, twice the falloff because its integral is 0.5 */
+static float sampleSmoothstep_global(float s, float &pdf)
+{
+	float x = math::pow(s, 0.25f);
+	for(int i = 0; i < 6; ++i)
+	{
+		const float x_2 = x * x;
+		const float density = x_2 * (6.f - 4.f * x);
+		if(density <= 0.f) break;
+		x -= (x_2 * x * (2.f - x) - s) / density;
+	}
+	pdf = x * x * (6.f - 4.f * x);
+	return x;
+}
+
 Rgb SpotLight::totalEnergy() const
 {
 	return color_ * math::mult_pi_by_2 * (1.f - 0.5f * (cos_start_ + cos_end_));
@@ -154,13 +164,14 @@ Rgb SpotLight::emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray,
 	else // sample in the falloff area
 	{
 		float spdf;
-		float sm_2 = pdf_->sample(s_2, &spdf) * pdf_->inv_count_;
+		float sm_2 = sampleSmoothstep_global(s_2, spdf);
+		if(spdf <= 0.f) return Rgb(0.f);
 		ipdf = math::mult_pi_by_2 * (cos_start_ - cos_end_) / (interv_2_ * spdf);
 		double cos_ang = cos_end_ + (cos_start_ - cos_end_) * (double)sm_2;
 		double sin_ang = math::sqrt(1.0 - cos_ang * cos_ang);
 		float t_1 = math::mult_pi_by_2 * s_1;
 		ray.dir_ = (du_ * math::cos(t_1) + dv_ * math::sin(t_1)) * (float)sin_ang + dir_ * (float)cos_ang;
-		return color_ * spdf * pdf_->integral_; // scale is just the actual falloff function, since spdf is func * invIntegral...
+		return color_ * (0.5f * spdf); // scale is just the actual falloff function, since spdf is twice the falloff
 	}
 	return color_;
 }
@@ -178,18 +189,28 @@ Rgb SpotLight::emitSample(Vec3 &wo, LSample &s) const
 	else // sample in the falloff area
 	{
 		float spdf;
-		float sm_2 = pdf_->sample(s.s_2_, &spdf) * pdf_->inv_count_;
+		float sm_2 = sampleSmoothstep_global(s.s_2_, spdf);
 		s.dir_pdf_ = (interv_2_ * spdf) / (math::mult_pi_by_2 * (cos_start_ - cos_end_));
 		double cos_ang = cos_end_ + (cos_start_ - cos_end_) * (double)sm_2;
 		double sin_ang = math::sqrt(1.0 - cos_ang * cos_ang);
 		float t_1 = math::mult_pi_by_2 * s.s_1_;
 		wo = (du_ * math::cos(t_1) + dv_ * math::sin(t_1)) * (float)sin_ang + dir_ * (float)cos_ang;
-		float v = sm_2 * sm_2 * (3.f - 2.f * sm_2);
-		return color_ * v;
+		return color_ * (0.5f * spdf); //the falloff at the sampled angle
 	}
 	return color_;
 }
 
+bool SpotLight::getBounds(LightBounds &bounds) const
+{
+	bounds.bound_ = Bound(position_, position_);
+	bounds.axis_ = dir_;
+	bounds.cos_theta_o_ = 1.f;
+	bounds.cos_theta_e_ = cos_end_;
+	bounds.intensity_ = color_.energy();
+	bounds.two_sided_ = false;
+	return true;
+}
+
 void SpotLight::emitPdf(const SurfacePoint &sp, const Vec3 &wo, float &area_pdf, float &dir_pdf, float &cos_wo) const
 {
 	area_pdf = 1.f;
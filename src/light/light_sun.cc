@@ -35,17 +35,17 @@ SunLight::SunLight(Vec3 dir, const Rgb &col, float inte, float angle, int n_samp
 	Vec3::createCs(dir, du_, dv_);
 	if(angle > 80.f) angle = 80.f;
 	cos_angle_ = math::cos(math::degToRad(angle));
+	tan_angle_ = std::tan(math::degToRad(angle));
 	invpdf_ = (math::mult_pi_by_2 * (1.f - cos_angle_));
 	pdf_ = 1.0 / invpdf_;
 	col_pdf_ = color_ * pdf_;
 }
 
-void SunLight::init(Scene &scene)
+void SunLight::initSceneBound(const Bound &scene_bound)
 {
 	// calculate necessary parameters for photon mapping
-	Bound w = scene.getSceneBound();
-	world_radius_ = 0.5 * (w.g_ - w.a_).length();
-	world_center_ = 0.5 * (w.a_ + w.g_);
+	world_radius_ = 0.5 * (scene_bound.g_ - scene_bound.a_).length();
+	world_center_ = 0.5 * (scene_bound.a_ + scene_bound.g_);
 	e_pdf_ = (M_PI * world_radius_ * world_radius_);
 }
 
@@ -77,7 +77,7 @@ bool SunLight::intersect(const Ray &ray, float &t, Rgb &col, float &ipdf) const
 Rgb SunLight::emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const
 {
 	float u, v;
-	Vec3::shirleyDisk(s_3, s_4, u, v);
+	Vec3::shirleyDisk(s_1, s_2, u, v);
 
 	Vec3 ldir = sample::cone(direction_, du_, dv_, cos_angle_, s_3, s_4);
 	Vec3 du_2, dv_2;
@@ -91,6 +91,75 @@ Rgb SunLight::emitPhoton(float s_1, float s_2, float s_3, float s_4, Ray &ray, f
 	return col_pdf_ * e_pdf_;
 }
 
+void SunLight::targetDisk(const ProjectionTarget &target, Point3 &center, float &radius) const
+{
+	const float height = (target.center_ - world_center_) * direction_;
+	center = target.center_ - height * direction_;
+	radius = target.radius_ + (std::abs(height) + target.radius_) * tan_angle_;
+}
+
+float SunLight::projectionFraction(const std::vector<ProjectionTarget> &targets) const
+{
+	if(targets.empty()) return 1.f;
+	float area = 0.f;
+	for(const auto &target : targets)
+	{
+		Point3 center;
+		float radius;
+		targetDisk(target, center, radius);
+		area += radius * radius;
+	}
+	return std::min(1.f, area / (world_radius_ * world_radius_));
+}
+
+Rgb SunLight::emitPhotonTowards(const std::vector<ProjectionTarget> &targets, float s_1, float s_2, float s_3, float s_4, Ray &ray, float &ipdf) const
+{
+	//As in the directional light, the photons start uniformly in the disks of the targets, the target being chosen proportionally to the area of its disk with s_3, which is then reused to sample the direction in the sun cone
+	if(targets.empty()) return emitPhoton(s_1, s_2, s_3, s_4, ray, ipdf);
+	float area = 0.f;
+	for(const auto &target : targets)
+	{
+		Point3 center;
+		float radius;
+		targetDisk(target, center, radius);
+		area += radius * radius;
+	}
+	const float target_sample = s_3 * area;
+	float accumulated_area = 0.f;
+	Point3 center;
+	float radius = 0.f;
+	for(const auto &target : targets)
+	{
+		targetDisk(target, center, radius);
+		const float target_area = radius * radius;
+		if(target_sample < accumulated_area + target_area || &target == &targets.back())
+		{
+			s_3 = std::min(1.f, std::max(0.f, (target_sample - accumulated_area) / target_area));
+			break;
+		}
+		accumulated_area += target_area;
+	}
+	float u, v;
+	Vec3::shirleyDisk(s_1, s_2, u, v);
+	const Point3 from = center + radius * (u * du_ + v * dv_);
+
+	int num_disks = 0;
+	for(const auto &target : targets)
+	{
+		Point3 target_center;
+		float target_radius;
+		targetDisk(target, target_center, target_radius);
+		if((from - target_center).lengthSqr() <= target_radius * target_radius) ++num_disks;
+	}
+	const Vec3 ldir = sample::cone(direction_, du_, dv_, cos_angle_, s_3, s_4);
+	ipdf = invpdf_;
+	ray.from_ = from + world_radius_ * ldir;
+	ray.tmax_ = -1;
+	ray.dir_ = -ldir;
+	//The photons carry the power crossing the disks, pi * area in total, shared by the disks overlapping at the starting point
+	return col_pdf_ * static_cast<float>(M_PI * area / std::max(1, num_disks));
+}
+
 
 std::unique_ptr<Light> SunLight::factory(ParamMap &params, const Scene &scene)
 {
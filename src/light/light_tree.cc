@@ -0,0 +1,321 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "light/light_tree.h"
+#include "light/light.h"
+#include "math/math.h"
+#include <algorithm>
+#include <array>
+#include <limits>
+
+BEGIN_YAFARAY
+
+//cos(theta_a - theta_b) and sin(theta_a - theta_b), clamped to 0 when theta_a < theta_b
+static inline float cosSubClamped_global(float sin_theta_a, float cos_theta_a, float sin_theta_b, float cos_theta_b)
+{
+	if(cos_theta_a > cos_theta_b) return 1.f;
+	return cos_theta_a * cos_theta_b + sin_theta_a * sin_theta_b;
+}
+
+static inline float sinSubClamped_global(float sin_theta_a, float cos_theta_a, float sin_theta_b, float cos_theta_b)
+{
+	if(cos_theta_a > cos_theta_b) return 0.f;
+	return sin_theta_a * cos_theta_b - cos_theta_a * sin_theta_b;
+}
+
+static inline float safeSqrt_global(float x) { return x > 0.f ? math::sqrt(x) : 0.f; }
+
+float LightBounds::importance(const Point3 &p, const Vec3 &n) const
+{
+	//Distance to the center, limited to the size of the bound to avoid the singularity when the point is inside it
+	const Point3 center = bound_.center();
+	Vec3 wi = p - center;
+	const Vec3 diagonal = bound_.g_ - bound_.a_;
+	const float distance_2 = std::max({wi.lengthSqr(), 0.5f * diagonal.length(), 1e-8f});
+	if(wi.lengthSqr() > 0.f) wi.normalize();
+
+	//Angle between the cone axis and the direction to the point, minus the normals cone angle and the angle subtended by the bound
+	float cos_theta_w = axis_ * wi;
+	if(two_sided_) cos_theta_w = std::abs(cos_theta_w);
+	const float sin_theta_w = safeSqrt_global(1.f - cos_theta_w * cos_theta_w);
+	const float radius_2 = 0.25f * diagonal.lengthSqr();
+	const float center_distance_2 = (p - center).lengthSqr();
+	const float cos_theta_b = (center_distance_2 < radius_2) ? -1.f : safeSqrt_global(1.f - radius_2 / center_distance_2);
+	const float sin_theta_b = safeSqrt_global(1.f - cos_theta_b * cos_theta_b);
+	const float sin_theta_o = safeSqrt_global(1.f - cos_theta_o_ * cos_theta_o_);
+	const float cos_theta_x = cosSubClamped_global(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o_);
+	const float sin_theta_x = sinSubClamped_global(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o_);
+	const float cos_theta_p = cosSubClamped_global(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+	if(cos_theta_p <= cos_theta_e_) return 0.f;
+
+	float result = intensity_ * cos_theta_p / distance_2;
+	if(n.lengthSqr() > 0.f)
+	{
+		//Both sides of the surface, for the transmissive materials
+		const float cos_theta_i = std::abs(wi * n);
+		const float sin_theta_i = safeSqrt_global(1.f - cos_theta_i * cos_theta_i);
+		result *= cosSubClamped_global(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+	}
+	return std::max(result, 0.f);
+}
+
+LightBounds LightBounds::merge(const LightBounds &a, const LightBounds &b)
+{
+	if(a.intensity_ <= 0.f) return b;
+	if(b.intensity_ <= 0.f) return a;
+	LightBounds result;
+	result.bound_ = Bound(a.bound_, b.bound_);
+	result.intensity_ = a.intensity_ + b.intensity_;
+	result.cos_theta_e_ = std::min(a.cos_theta_e_, b.cos_theta_e_);
+	result.two_sided_ = a.two_sided_ || b.two_sided_;
+
+	//Smallest cone containing both normals cones
+	const float theta_a = math::acos(a.cos_theta_o_);
+	const float theta_b = math::acos(b.cos_theta_o_);
+	const float theta_d = math::acos(a.axis_ * b.axis_);
+	if(std::min(theta_d + theta_b, static_cast<float>(M_PI)) <= theta_a)
+	{
+		result.axis_ = a.axis_;
+		result.cos_theta_o_ = a.cos_theta_o_;
+		return result;
+	}
+	if(std::min(theta_d + theta_a, static_cast<float>(M_PI)) <= theta_b)
+	{
+		result.axis_ = b.axis_;
+		result.cos_theta_o_ = b.cos_theta_o_;
+		return result;
+	}
+	const float theta_o = 0.5f * (theta_a + theta_d + theta_b);
+	Vec3 rotation_axis = a.axis_ ^ b.axis_;
+	if(theta_o >= M_PI || rotation_axis.lengthSqr() <= 0.f) return result; //the default cone is the entire sphere
+	rotation_axis.normalize();
+	//Rotates the axis of a towards the axis of b (Rodrigues rotation formula)
+	const float theta_r = theta_o - theta_a;
+	const float cos_theta_r = math::cos(theta_r);
+	const float sin_theta_r = math::sin(theta_r);
+	result.axis_ = a.axis_ * cos_theta_r + (rotation_axis ^ a.axis_) * sin_theta_r + rotation_axis * ((rotation_axis * a.axis_) * (1.f - cos_theta_r));
+	result.axis_.normalize();
+	result.cos_theta_o_ = math::cos(theta_o);
+	return result;
+}
+
+LightTree::LightTree(const std::vector<const Light *> &lights)
+{
+	std::vector<BuildLight> build_lights;
+	for(size_t i = 0; i < lights.size(); ++i)
+	{
+		LightBounds bounds;
+		if(lights[i]->getBounds(bounds))
+		{
+			if(bounds.intensity_ > 0.f)
+			{
+				build_lights.push_back({bounds, static_cast<int>(i)});
+				bounded_lights_.push_back(static_cast<int>(i));
+			}
+		}
+		else infinite_lights_.push_back(static_cast<int>(i));
+	}
+	build(build_lights, static_cast<int>(lights.size()));
+}
+
+LightTree::LightTree(const std::vector<LightBounds> &emitters_bounds)
+{
+	std::vector<BuildLight> build_lights;
+	for(size_t i = 0; i < emitters_bounds.size(); ++i)
+	{
+		if(emitters_bounds[i].intensity_ > 0.f)
+		{
+			build_lights.push_back({emitters_bounds[i], static_cast<int>(i)});
+			bounded_lights_.push_back(static_cast<int>(i));
+		}
+	}
+	build(build_lights, static_cast<int>(emitters_bounds.size()));
+}
+
+void LightTree::build(std::vector<BuildLight> &build_lights, int num_lights)
+{
+	leaf_nodes_.assign(num_lights, -1);
+	if(build_lights.empty()) return;
+	nodes_.reserve(2 * build_lights.size() - 1);
+	buildTree(build_lights, 0, static_cast<int>(build_lights.size()));
+}
+
+float LightTree::orientationCost(const LightBounds &bounds, const Bound &node_bound, int axis)
+{
+	//Surface area orientation heuristic (SAOH): the solid angle of the emission cones weighted by the intensity and the bound area, penalizing the splits along the shorter axes
+	const float theta_o = math::acos(bounds.cos_theta_o_);
+	const float theta_e = math::acos(bounds.cos_theta_e_);
+	const float theta_w = std::min(theta_o + theta_e, static_cast<float>(M_PI));
+	const float sin_theta_o = safeSqrt_global(1.f - bounds.cos_theta_o_ * bounds.cos_theta_o_);
+	const float m_omega = 2.f * M_PI * (1.f - bounds.cos_theta_o_) + 0.5f * M_PI * (2.f * theta_w * sin_theta_o - math::cos(theta_o - 2.f * theta_w) - 2.f * theta_o * sin_theta_o + bounds.cos_theta_o_);
+	const Vec3 node_diagonal = node_bound.g_ - node_bound.a_;
+	const float node_axis_length = axis == 0 ? node_diagonal.x_ : (axis == 1 ? node_diagonal.y_ : node_diagonal.z_);
+	const float max_length = std::max(node_diagonal.x_, std::max(node_diagonal.y_, node_diagonal.z_));
+	const float regularization = (node_axis_length > 0.f) ? max_length / node_axis_length : 1.f;
+	const Vec3 diagonal = bounds.bound_.g_ - bounds.bound_.a_;
+	const float area = 2.f * (diagonal.x_ * diagonal.y_ + diagonal.x_ * diagonal.z_ + diagonal.y_ * diagonal.z_);
+	//The area is limited so the point lights, with empty bounds, are not considered free
+	return bounds.intensity_ * m_omega * regularization * std::max(area, 1e-6f);
+}
+
+int LightTree::buildTree(std::vector<BuildLight> &build_lights, int begin, int end)
+{
+	const int node_id = static_cast<int>(nodes_.size());
+	nodes_.push_back(Node());
+	if(end - begin == 1)
+	{
+		nodes_[node_id].bounds_ = build_lights[begin].bounds_;
+		nodes_[node_id].index_ = build_lights[begin].light_index_;
+		nodes_[node_id].is_leaf_ = true;
+		leaf_nodes_[build_lights[begin].light_index_] = node_id;
+		return node_id;
+	}
+
+	LightBounds node_bounds = build_lights[begin].bounds_;
+	Bound centroid_bound(build_lights[begin].bounds_.bound_.center(), build_lights[begin].bounds_.bound_.center());
+	for(int i = begin + 1; i < end; ++i)
+	{
+		node_bounds = LightBounds::merge(node_bounds, build_lights[i].bounds_);
+		centroid_bound.include(build_lights[i].bounds_.bound_.center());
+	}
+
+	float best_cost = std::numeric_limits<float>::infinity();
+	int best_axis = -1, best_bin = -1;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float axis_min = centroid_bound.a_[axis];
+		const float axis_max = centroid_bound.g_[axis];
+		if(axis_max <= axis_min) continue;
+		std::array<LightBounds, num_bins_> bins;
+		for(int i = begin; i < end; ++i)
+		{
+			const int bin = std::min(num_bins_ - 1, static_cast<int>(num_bins_ * (build_lights[i].bounds_.bound_.center()[axis] - axis_min) / (axis_max - axis_min)));
+			bins[bin] = LightBounds::merge(bins[bin], build_lights[i].bounds_);
+		}
+		for(int split = 0; split < num_bins_ - 1; ++split)
+		{
+			LightBounds left, right;
+			for(int bin = 0; bin <= split; ++bin) left = LightBounds::merge(left, bins[bin]);
+			for(int bin = split + 1; bin < num_bins_; ++bin) right = LightBounds::merge(right, bins[bin]);
+			if(left.intensity_ <= 0.f || right.intensity_ <= 0.f) continue;
+			const float cost = orientationCost(left, node_bounds.bound_, axis) + orientationCost(right, node_bounds.bound_, axis);
+			if(cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = split;
+			}
+		}
+	}
+
+	int middle;
+	if(best_axis == -1) middle = (begin + end) / 2; //all the centroids in the same position
+	else
+	{
+		const float axis_min = centroid_bound.a_[best_axis];
+		const float axis_max = centroid_bound.g_[best_axis];
+		const auto middle_it = std::partition(build_lights.begin() + begin, build_lights.begin() + end, [&](const BuildLight &build_light)
+		{
+			const int bin = std::min(num_bins_ - 1, static_cast<int>(num_bins_ * (build_light.bounds_.bound_.center()[best_axis] - axis_min) / (axis_max - axis_min)));
+			return bin <= best_bin;
+		});
+		middle = static_cast<int>(middle_it - build_lights.begin());
+		if(middle == begin || middle == end) middle = (begin + end) / 2;
+	}
+
+	buildTree(build_lights, begin, middle);
+	const int second_child = buildTree(build_lights, middle, end);
+	nodes_[node_id + 1].parent_ = node_id;
+	nodes_[second_child].parent_ = node_id;
+	nodes_[node_id].bounds_ = node_bounds;
+	nodes_[node_id].index_ = second_child;
+	return node_id;
+}
+
+int LightTree::sample(const Point3 &p, const Vec3 &n, float s, float &pmf, float *s_remapped) const
+{
+	pmf = 0.f;
+	const int num_infinite_lights = static_cast<int>(infinite_lights_.size());
+	const int num_choices = num_infinite_lights + (nodes_.empty() ? 0 : 1);
+	if(num_choices == 0) return -1;
+	const float infinite_probability = static_cast<float>(num_infinite_lights) / static_cast<float>(num_choices);
+	if(s < infinite_probability)
+	{
+		pmf = 1.f / static_cast<float>(num_choices);
+		const int choice = std::min(static_cast<int>(s * num_choices), num_infinite_lights - 1);
+		if(s_remapped) *s_remapped = std::min(s * num_choices - choice, 0.99999994f);
+		return infinite_lights_[choice];
+	}
+
+	//The sample is rescaled at each level to choose between the children proportionally to their importance
+	s = std::min((s - infinite_probability) / (1.f - infinite_probability), 0.99999994f);
+	pmf = 1.f - infinite_probability;
+	int node_id = 0;
+	while(!nodes_[node_id].is_leaf_)
+	{
+		const int child_0 = node_id + 1;
+		const int child_1 = nodes_[node_id].index_;
+		const float importance_0 = nodes_[child_0].bounds_.importance(p, n);
+		const float importance_1 = nodes_[child_1].bounds_.importance(p, n);
+		if(importance_0 <= 0.f && importance_1 <= 0.f) return -1;
+		const float probability_0 = importance_0 / (importance_0 + importance_1);
+		if(s < probability_0)
+		{
+			s = std::min(s / probability_0, 0.99999994f);
+			pmf *= probability_0;
+			node_id = child_0;
+		}
+		else
+		{
+			s = std::min((s - probability_0) / (1.f - probability_0), 0.99999994f);
+			pmf *= 1.f - probability_0;
+			node_id = child_1;
+		}
+	}
+	if(node_id == 0 && nodes_[0].bounds_.importance(p, n) <= 0.f) return -1; //single light in the tree, not checked by any parent
+	if(s_remapped) *s_remapped = s;
+	return nodes_[node_id].index_;
+}
+
+float LightTree::pmf(const Point3 &p, const Vec3 &n, int index) const
+{
+	if(index < 0 || index >= static_cast<int>(leaf_nodes_.size())) return 0.f;
+	const int num_infinite_lights = static_cast<int>(infinite_lights_.size());
+	const int num_choices = num_infinite_lights + (nodes_.empty() ? 0 : 1);
+	int node_id = leaf_nodes_[index];
+	if(node_id < 0) return std::find(infinite_lights_.begin(), infinite_lights_.end(), index) != infinite_lights_.end() ? 1.f / static_cast<float>(num_choices) : 0.f;
+	if(node_id == 0) return nodes_[0].bounds_.importance(p, n) > 0.f ? 1.f / static_cast<float>(num_choices) : 0.f;
+
+	//The same choices of sample() from the leaf up to the root
+	float result = 1.f - static_cast<float>(num_infinite_lights) / static_cast<float>(num_choices);
+	while(node_id != 0)
+	{
+		const int parent_id = nodes_[node_id].parent_;
+		const int child_0 = parent_id + 1;
+		const int child_1 = nodes_[parent_id].index_;
+		const float importance_0 = nodes_[child_0].bounds_.importance(p, n);
+		const float importance_1 = nodes_[child_1].bounds_.importance(p, n);
+		const float importance = (node_id == child_0) ? importance_0 : importance_1;
+		if(importance <= 0.f) return 0.f;
+		result *= importance / (importance_0 + importance_1);
+		node_id = parent_id;
+	}
+	return result;
+}
+
+END_YAFARAY
@@ -24,6 +24,7 @@
 #include "import/import_xml.h"
 #include "common/console.h"
 #include "output/output_image.h"
+#include <fstream>
 #include <signal.h>
 
 #ifdef WIN32
@@ -101,6 +102,7 @@ int main(int argc, char *argv[])
 	parse.setOption("t", "threads", false, "Overrides threads setting on the XML file, for auto selection use -1.");
 	parse.setOption("pbp", "params_badge_position", false, "Sets position of the params badge: \"none\", \"top\" or \"bottom\".");
 	parse.setOption("l", "log-file-output", false, "Enable log file output(s): \"none\", \"txt\", \"html\" or \"txt+html\". Log file name will be same as selected image name,");
+	parse.setOption("fl", "frame-list", false, "Text file with one XML file per line, rendered in sequence as the next frames after the input XML file.\n                                       Each frame XML file can be a complete scene or only the changes from the previous frame: the cameras,\n                                       materials, lights and outputs replace the existing ones, the instances update the existing transforms\n                                       and the existing objects and textures are kept, with their accelerator, mipmaps and photon maps states.\n");
 
 	bool parse_ok = parse.parseCommandLine();
 
@@ -156,36 +158,67 @@ int main(int argc, char *argv[])
 	params.getParam("denoise_h_lum", denoise_h_lum);
 	params.getParam("denoise_mix", denoise_mix);
 
-	if(threads >= -1) params["threads"] = threads;
-
-	std::string log_file_types = parse.getOptionString("l");
-	if(log_file_types == "none")
+	const std::string log_file_types = parse.getOptionString("l");
+	const std::string params_badge_position = parse.getOptionString("pbp");
+	//The command line settings override the render parameters of each frame
+	auto set_command_line_params = [&](ParamMap &params)
 	{
-		params["logging_save_txt"] = false;
-		params["logging_save_html"] = false;
-	}
-	if(log_file_types == "txt")
+		if(threads >= -1) params["threads"] = threads;
+		if(log_file_types == "none")
+		{
+			params["logging_save_txt"] = false;
+			params["logging_save_html"] = false;
+		}
+		if(log_file_types == "txt")
+		{
+			params["logging_save_txt"] = true;
+			params["logging_save_html"] = false;
+		}
+		if(log_file_types == "html")
+		{
+			params["logging_save_txt"] = false;
+			params["logging_save_html"] = true;
+		}
+		if(log_file_types == "txt+html")
+		{
+			params["logging_save_txt"] = true;
+			params["logging_save_html"] = true;
+		}
+		if(!params_badge_position.empty()) params["badge_position"] = params_badge_position;
+	};
+
+	std::vector<std::string> frame_file_paths;
+	const std::string frame_list_path = parse.getOptionString("fl");
+	if(!frame_list_path.empty())
 	{
-		params["logging_save_txt"] = true;
-		params["logging_save_html"] = false;
+		std::ifstream frame_list(frame_list_path);
+		if(!frame_list.is_open())
+		{
+			Y_ERROR << "XML Loader: Couldn't open the frame list file '" << frame_list_path << "'" << YENDL;
+			exit(1);
+		}
+		std::string line;
+		while(std::getline(frame_list, line))
+		{
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			line.erase(0, line.find_first_not_of(" \t"));
+			if(!line.empty() && line[0] != '#') frame_file_paths.push_back(line);
+		}
 	}
-	if(log_file_types == "html")
-	{
-		params["logging_save_txt"] = false;
-		params["logging_save_html"] = true;
-	}
-	if(log_file_types == "txt+html")
-	{
-		params["logging_save_txt"] = true;
-		params["logging_save_html"] = true;
-	}
-
-	std::string params_badge_position = parse.getOptionString("pbp");
-	if(!params_badge_position.empty()) params["badge_position"] = params_badge_position;
 
+	set_command_line_params(params);
 	if(! scene->setupScene(*scene, params)) return 1;
-	session_global.setInteractive(false);
+	scene->getSession().setInteractive(false);
 	scene->render();
+	//The next frames are applied to the same scene, so the unchanged items are not created again
+	for(size_t frame = 0; frame < frame_file_paths.size() && !scene->getRenderControl().aborted(); ++frame)
+	{
+		Y_INFO << "XML Loader: Rendering the frame " << frame + 2 << " of " << frame_file_paths.size() + 1 << ", '" << frame_file_paths[frame] << "'" << YENDL;
+		if(!parseXmlUpdateFile_global(frame_file_paths[frame].c_str(), scene, params, input_color_space_string, input_gamma) || !scene) exit(1);
+		set_command_line_params(params);
+		if(!scene->setupScene(*scene, params)) return 1;
+		scene->render();
+	}
 	scene->clearAll();
 	return 0;
 }
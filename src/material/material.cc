@@ -154,9 +154,38 @@ bool Material::scatterPhoton(const RenderData &render_data, const SurfacePoint &
 	return false;
 }
 
+void Material::evalBatch(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 *wl, int num_directions, const BsdfFlags &types, Rgb *cols) const
+{
+	for(int i = 0; i < num_directions; ++i) cols[i] = eval(render_data, sp, wo, wl[i], types);
+}
+
 Rgb Material::getReflectivity(const RenderData &render_data, const SurfacePoint &sp, BsdfFlags flags) const
 {
 	if(!flags.hasAny((BsdfFlags::Transmit | BsdfFlags::Reflect) & bsdf_flags_)) return Rgb(0.f);
+	if(!isReflectivityConstant()) return estimateReflectivity(render_data, sp, flags);
+	const unsigned int flags_value = static_cast<unsigned int>(flags);
+	for(const auto &entry : reflectivity_cache_)
+	{
+		if(entry.flags_.load(std::memory_order_acquire) == flags_value) return entry.reflectivity_;
+	}
+	const Rgb reflectivity = estimateReflectivity(render_data, sp, flags);
+	std::lock_guard<std::mutex> lock_guard(reflectivity_cache_mutex_);
+	for(auto &entry : reflectivity_cache_)
+	{
+		const unsigned int entry_flags = entry.flags_.load(std::memory_order_relaxed);
+		if(entry_flags == flags_value) break; //cached meanwhile by another thread
+		if(entry_flags == BsdfFlags::None)
+		{
+			entry.reflectivity_ = reflectivity;
+			entry.flags_.store(flags_value, std::memory_order_release);
+			break;
+		}
+	}
+	return reflectivity;
+}
+
+Rgb Material::estimateReflectivity(const RenderData &render_data, const SurfacePoint &sp, BsdfFlags flags) const
+{
 	Rgb total(0.f);
 	for(int i = 0; i < 16; ++i)
 	{
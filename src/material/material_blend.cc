@@ -24,6 +24,7 @@
 #include "common/param.h"
 #include "common/logger.h"
 #include "math/interpolation.h"
+#include "math/random.h"
 #include "render/render_data.h"
 
 BEGIN_YAFARAY
@@ -33,7 +34,7 @@ BlendMaterial::BlendMaterial(const Material *m_1, const Material *m_2, float bva
 {
 	visibility_ = visibility;
 	bsdf_flags_ = mat_1_->getFlags() | mat_2_->getFlags();
-	mmem_1_ = mat_1_->getReqMem();
+	mmem_1_ = RenderData::alignMaterialDataSize(mat_1_->getReqMem());
 	recalc_blend_ = false;
 	blend_val_ = bval;
 	blended_ior_ = (mat_1_->getMatIor() + mat_2_->getMatIor()) * 0.5f;
@@ -51,56 +52,90 @@ inline float BlendMaterial::getBlendVal(const RenderData &render_data, const Sur
 {
 	if(recalc_blend_)
 	{
-		void *old_dat = render_data.arena_;
-		NodeStack stack(render_data.arena_);
+		void *old_dat = render_data.material_data_;
+		NodeStack stack(render_data.material_data_);
 		evalNodes(render_data, sp, color_nodes_sorted_, stack);
 		const float blend_val = blend_shader_->getScalar(stack);
-		render_data.arena_ = old_dat;
+		render_data.material_data_ = old_dat;
 		return blend_val;
 	}
 	else return blend_val_;
 }
 
+inline BlendMaterial::BlendData &BlendMaterial::getBlendData(const RenderData &render_data) const
+{
+	return *reinterpret_cast<BlendData *>(static_cast<char *>(render_data.material_data_) + req_node_mem_);
+}
+
+const Material *BlendMaterial::getPickedMaterial(const RenderData &render_data) const
+{
+	if(!stochastic_) return nullptr;
+	const Branch branch = getBlendData(render_data).branch_;
+	if(branch == Branch::Both) return nullptr;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_0_;
+	if(branch == Branch::Material1) return mat_1_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_1_;
+	return mat_2_;
+}
+
 void BlendMaterial::initBsdf(const RenderData &render_data, SurfacePoint &sp, BsdfFlags &bsdf_types) const
 {
-	void *old_udat = render_data.arena_;
+	void *old_udat = render_data.material_data_;
 	bsdf_types = BsdfFlags::None;
-	const float blend_val = getBlendVal(render_data, sp);
-
-	SurfacePoint sp_0 = sp;
+	//The blend value is evaluated only here and kept in the material data, so eval, sample and pdf never run the blend shader nodes again, however many light samples are taken at the surface point
+	BlendData &blend_data = getBlendData(render_data);
+	blend_data.blend_val_ = getBlendVal(render_data, sp);
+	blend_data.branch_ = Branch::Both;
+	const float blend_val = blend_data.blend_val_;
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + req_mem_;
-	mat_1_->initBsdf(render_data, sp_0, mat_1_flags_);
+	if(stochastic_)
+	{
+		//Picking each material with its blend weight as probability is an unbiased estimate of the blend, so the picked material result needs no reweighting. Without a random number generator, for example when shooting photons, both materials are blended
+		if(render_data.prng_) blend_data.branch_ = ((*render_data.prng_)() < blend_val) ? Branch::Material2 : Branch::Material1;
+		if(const Material *picked = getPickedMaterial(render_data))
+		{
+			picked->initBsdf(render_data, sp, bsdf_types);
+			render_data.material_data_ = old_udat;
+			return;
+		}
+	}
 
+	//Only the second material works on a copy, the first one updates the surface point in place and the copy is blended into it
 	SurfacePoint sp_1 = sp;
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + mmem_1_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_0_;
+	mat_1_->initBsdf(render_data, sp, mat_1_flags_);
+
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_1_;
 	mat_2_->initBsdf(render_data, sp_1, mat_2_flags_);
 
-	sp = SurfacePoint::blendSurfacePoints(sp_0, sp_1, blend_val);
+	sp.blend(sp_1, blend_val);
 
 	bsdf_types = mat_1_flags_ | mat_2_flags_;
 
 	//todo: bump mapping blending
-	render_data.arena_ = old_udat;
+	render_data.material_data_ = old_udat;
 }
 
 Rgb BlendMaterial::eval(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wl, const BsdfFlags &bsdfs, bool force_eval) const
 {
-	NodeStack stack(render_data.arena_);
-	const float blend_val = getBlendVal(render_data, sp);
-
-	void *old_udat = render_data.arena_;
-
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + req_mem_;
-	Rgb col_1 = mat_1_->eval(render_data, sp, wo, wl, bsdfs);
+	NodeStack stack(render_data.material_data_);
+	void *old_udat = render_data.material_data_;
+	Rgb col_1;
+	if(const Material *picked = getPickedMaterial(render_data)) col_1 = picked->eval(render_data, sp, wo, wl, bsdfs, force_eval);
+	else
+	{
+		const float blend_val = getBlendData(render_data).blend_val_;
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + mmem_1_;
-	const Rgb col_2 = mat_2_->eval(render_data, sp, wo, wl, bsdfs);
+		render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_0_;
+		col_1 = mat_1_->eval(render_data, sp, wo, wl, bsdfs);
 
-	render_data.arena_ = old_udat;
+		render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_1_;
+		const Rgb col_2 = mat_2_->eval(render_data, sp, wo, wl, bsdfs);
 
-	col_1 = math::lerp(col_1, col_2, blend_val);
+		col_1 = math::lerp(col_1, col_2, blend_val);
+	}
+	render_data.material_data_ = old_udat;
 
 	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
 	applyWireFrame(col_1, wire_frame_amount, sp);
@@ -109,8 +144,19 @@ Rgb BlendMaterial::eval(const RenderData &render_data, const SurfacePoint &sp, c
 
 Rgb BlendMaterial::sample(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, Vec3 &wi, Sample &s, float &w) const
 {
-	NodeStack stack(render_data.arena_);
-	const float blend_val = getBlendVal(render_data, sp);
+	NodeStack stack(render_data.material_data_);
+	{
+		void *old_udat = render_data.material_data_;
+		if(const Material *picked = getPickedMaterial(render_data))
+		{
+			Rgb col = picked->sample(render_data, sp, wo, wi, s, w);
+			render_data.material_data_ = old_udat;
+			const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
+			applyWireFrame(col, wire_frame_amount, sp);
+			return col;
+		}
+	}
+	const float blend_val = getBlendData(render_data).blend_val_;
 
 	bool mat_1_sampled = false;
 	bool mat_2_sampled = false;
@@ -119,18 +165,18 @@ Rgb BlendMaterial::sample(const RenderData &render_data, const SurfacePoint &sp,
 	Sample s_1 = s, s_2 = s;
 	Vec3 wi_1(0.f), wi_2(0.f);
 	float w_1 = 0.f, w_2 = 0.f;
-	void *old_udat = render_data.arena_;
+	void *old_udat = render_data.material_data_;
 
 	s_2.pdf_ = s_1.pdf_ = s.pdf_ = 0.f;
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + req_mem_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_0_;
 	if(s.flags_.hasAny(mat_1_flags_))
 	{
 		col_1 = mat_1_->sample(render_data, sp, wo, wi_1, s_1, w_1);
 		mat_1_sampled = true;
 	}
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + mmem_1_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_1_;
 	if(s.flags_.hasAny(mat_2_flags_))
 	{
 		col_2 = mat_2_->sample(render_data, sp, wo, wi_2, s_2, w_2);
@@ -183,7 +229,7 @@ Rgb BlendMaterial::sample(const RenderData &render_data, const SurfacePoint &sp,
 		w = w_2;
 	}
 
-	render_data.arena_ = old_udat;
+	render_data.material_data_ = old_udat;
 
 	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
 	applyWireFrame(col_1, wire_frame_amount, sp);
@@ -192,16 +238,17 @@ Rgb BlendMaterial::sample(const RenderData &render_data, const SurfacePoint &sp,
 
 Rgb BlendMaterial::sample(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, Vec3 *const dir, Rgb &tcol, Sample &s, float *const w) const
 {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 
-	const float blend_val = getBlendVal(render_data, sp);
-	void *old_udat = render_data.arena_;
+	void *old_udat = render_data.material_data_;
 	Rgb col;
-	if(blend_val <= 0.f) col = mat_1_->sample(render_data, sp, wo, dir, tcol, s, w);
+	const float blend_val = getBlendData(render_data).blend_val_;
+	if(const Material *picked = getPickedMaterial(render_data)) col = picked->sample(render_data, sp, wo, dir, tcol, s, w);
+	else if(blend_val <= 0.f) col = mat_1_->sample(render_data, sp, wo, dir, tcol, s, w);
 	else if(blend_val >= 1.f) col = mat_2_->sample(render_data, sp, wo, dir, tcol, s, w);
 	else col = math::lerp(mat_1_->sample(render_data, sp, wo, dir, tcol, s, w), mat_2_->sample(render_data, sp, wo, dir, tcol, s, w), blend_val);
 
-	render_data.arena_ = old_udat;
+	render_data.material_data_ = old_udat;
 
 	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
 	applyWireFrame(col, wire_frame_amount, sp);
@@ -211,16 +258,22 @@ Rgb BlendMaterial::sample(const RenderData &render_data, const SurfacePoint &sp,
 
 float BlendMaterial::pdf(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, const BsdfFlags &bsdfs) const
 {
-	const float blend_val = getBlendVal(render_data, sp);
-	void *old_udat = render_data.arena_;
+	void *old_udat = render_data.material_data_;
+	if(const Material *picked = getPickedMaterial(render_data))
+	{
+		const float pdf = picked->pdf(render_data, sp, wo, wi, bsdfs);
+		render_data.material_data_ = old_udat;
+		return pdf;
+	}
+	const float blend_val = getBlendData(render_data).blend_val_;
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + req_mem_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_0_;
 	float pdf_1 = mat_1_->pdf(render_data, sp, wo, wi, bsdfs);
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + mmem_1_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_1_;
 	const float pdf_2 = mat_2_->pdf(render_data, sp, wo, wi, bsdfs);
 
-	render_data.arena_ = old_udat;
+	render_data.material_data_ = old_udat;
 
 	pdf_1 = math::lerp(pdf_1, pdf_2, blend_val);
 	return pdf_1;
@@ -229,14 +282,23 @@ float BlendMaterial::pdf(const RenderData &render_data, const SurfacePoint &sp,
 Material::Specular BlendMaterial::getSpecular(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
 	Specular specular, specular_1, specular_2;
-	NodeStack stack(render_data.arena_);
-	const float blend_val = getBlendVal(render_data, sp);
-	void *old_udat = render_data.arena_;
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + req_mem_;
+	NodeStack stack(render_data.material_data_);
+	void *old_udat = render_data.material_data_;
+	if(const Material *picked = getPickedMaterial(render_data))
+	{
+		specular = picked->getSpecular(render_data, sp, wo);
+		render_data.material_data_ = old_udat;
+		const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
+		if(specular.reflect_.enabled_) applyWireFrame(specular.reflect_.col_, wire_frame_amount, sp);
+		if(specular.refract_.enabled_) applyWireFrame(specular.refract_.col_, wire_frame_amount, sp);
+		return specular;
+	}
+	const float blend_val = getBlendData(render_data).blend_val_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_0_;
 	specular_1 = mat_1_->getSpecular(render_data, sp, wo);
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + mmem_1_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_1_;
 	specular_2 = mat_2_->getSpecular(render_data, sp, wo);
-	render_data.arena_ = old_udat;
+	render_data.material_data_ = old_udat;
 	specular.reflect_.enabled_ = specular_1.reflect_.enabled_ | specular_2.reflect_.enabled_;
 	if(specular.reflect_.enabled_)
 	{
@@ -294,19 +356,19 @@ bool BlendMaterial::isTransparent() const
 
 Rgb BlendMaterial::getTransparency(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 	const float blend_val = getBlendVal(render_data, sp);
-	void *old_udat = render_data.arena_;
+	void *old_udat = render_data.material_data_;
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + req_mem_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_0_;
 	Rgb col_1 = mat_1_->getTransparency(render_data, sp, wo);
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + mmem_1_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_1_;
 	const Rgb col_2 = mat_2_->getTransparency(render_data, sp, wo);
 
 	col_1 = math::lerp(col_1, col_2, blend_val);
 
-	render_data.arena_ = old_udat;
+	render_data.material_data_ = old_udat;
 
 	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
 	applyWireFrame(col_1, wire_frame_amount, sp);
@@ -315,21 +377,21 @@ Rgb BlendMaterial::getTransparency(const RenderData &render_data, const SurfaceP
 
 float BlendMaterial::getAlpha(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 
 	if(isTransparent())
 	{
-		void *old_udat = render_data.arena_;
+		void *old_udat = render_data.material_data_;
 
-		render_data.arena_ = static_cast<char *>(render_data.arena_) + req_mem_;
+		render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_0_;
 		float al_1 = mat_1_->getAlpha(render_data, sp, wo);
 
-		render_data.arena_ = static_cast<char *>(render_data.arena_) + mmem_1_;
+		render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_1_;
 		const float al_2 = mat_2_->getAlpha(render_data, sp, wo);
 
 		al_1 = std::min(al_1, al_2);
 
-		render_data.arena_ = old_udat;
+		render_data.material_data_ = old_udat;
 
 		const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
 		applyWireFrame(al_1, wire_frame_amount, sp);
@@ -344,19 +406,24 @@ float BlendMaterial::getAlpha(const RenderData &render_data, const SurfacePoint
 
 Rgb BlendMaterial::emit(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	NodeStack stack(render_data.arena_);
-	const float blend_val = getBlendVal(render_data, sp);
-	void *old_udat = render_data.arena_;
+	NodeStack stack(render_data.material_data_);
+	void *old_udat = render_data.material_data_;
+	Rgb col_1;
+	if(const Material *picked = getPickedMaterial(render_data)) col_1 = picked->emit(render_data, sp, wo);
+	else
+	{
+		const float blend_val = getBlendData(render_data).blend_val_;
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + req_mem_;
-	Rgb col_1 = mat_1_->emit(render_data, sp, wo);
+		render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_0_;
+		col_1 = mat_1_->emit(render_data, sp, wo);
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + mmem_1_;
-	const Rgb col_2 = mat_2_->emit(render_data, sp, wo);
+		render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_1_;
+		const Rgb col_2 = mat_2_->emit(render_data, sp, wo);
 
-	col_1 = math::lerp(col_1, col_2, blend_val);
+		col_1 = math::lerp(col_1, col_2, blend_val);
+	}
 
-	render_data.arena_ = old_udat;
+	render_data.material_data_ = old_udat;
 
 	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
 	applyWireFrame(col_1, wire_frame_amount, sp);
@@ -365,15 +432,21 @@ Rgb BlendMaterial::emit(const RenderData &render_data, const SurfacePoint &sp, c
 
 bool BlendMaterial::scatterPhoton(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wi, Vec3 &wo, PSample &s) const
 {
-	const float blend_val = getBlendVal(render_data, sp);
-	void *old_udat = render_data.arena_;
+	void *old_udat = render_data.material_data_;
+	if(const Material *picked = getPickedMaterial(render_data))
+	{
+		const bool ret = picked->scatterPhoton(render_data, sp, wi, wo, s);
+		render_data.material_data_ = old_udat;
+		return ret;
+	}
+	const float blend_val = getBlendData(render_data).blend_val_;
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + req_mem_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_0_;
 	bool ret = mat_1_->scatterPhoton(render_data, sp, wi, wo, s);
 	const Rgb col_1 = s.color_;
 	const float pdf_1 = s.pdf_;
 
-	render_data.arena_ = static_cast<char *>(render_data.arena_) + mmem_1_;
+	render_data.material_data_ = static_cast<char *>(render_data.material_data_) + mmem_1_;
 	ret = ret || mat_2_->scatterPhoton(render_data, sp, wi, wo, s);
 	const Rgb col_2 = s.color_;
 	const float pdf_2 = s.pdf_;
@@ -381,7 +454,7 @@ bool BlendMaterial::scatterPhoton(const RenderData &render_data, const SurfacePo
 	s.color_ = math::lerp(col_1, col_2, blend_val);
 	s.pdf_ = math::lerp(pdf_1, pdf_2, blend_val);
 
-	render_data.arena_ = old_udat;
+	render_data.material_data_ = old_udat;
 	return ret;
 }
 
@@ -418,6 +491,8 @@ std::unique_ptr<Material> BlendMaterial::factory(ParamMap &params, std::list<Par
 	const Material *m_2 = scene.getMaterial(name);
 	if(!m_1 || !m_2) return nullptr;
 	params.getParam("blend_value", blend_val);
+	bool stochastic = false;
+	params.getParam("stochastic", stochastic); //pick one of the materials at each surface point instead of blending both
 
 	params.getParam("receive_shadows", receive_shadows);
 	params.getParam("visibility", s_visibility);
@@ -440,6 +515,7 @@ std::unique_ptr<Material> BlendMaterial::factory(ParamMap &params, std::list<Par
 	mat->wireframe_exponent_ = wire_frame_exponent;
 	mat->wireframe_color_ = wire_frame_color;
 	mat->setSamplingFactor(samplingfactor);
+	mat->stochastic_ = stochastic;
 
 	std::vector<ShaderNode *> roots;
 	if(mat->loadNodes(eparams, scene))
@@ -466,7 +542,8 @@ std::unique_ptr<Material> BlendMaterial::factory(ParamMap &params, std::list<Par
 		return nullptr;
 	}
 	mat->solveNodesOrder(roots);
-	mat->req_mem_ = sizeof(bool) + mat->req_node_mem_;
+	mat->mmem_0_ = RenderData::alignMaterialDataSize(mat->req_node_mem_ + sizeof(BlendData));
+	mat->req_mem_ = mat->mmem_0_ + mat->mmem_1_ + mat->mat_2_->getReqMem(); //the data of both blended materials is included, so nested blend materials get all the memory they need
 	return mat;
 }
 
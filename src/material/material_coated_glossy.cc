@@ -23,6 +23,7 @@
 #include "shader/shader_node.h"
 #include "sampler/sample.h"
 #include "material/material_utils_microfacet.h"
+#include "material/microfacet_albedo.h"
 #include "common/param.h"
 #include "geometry/surface.h"
 #include "common/logger.h"
@@ -67,12 +68,12 @@ CoatedGlossyMaterial::CoatedGlossyMaterial(const Rgb &col, const Rgb &dcol, cons
 
 void CoatedGlossyMaterial::initBsdf(const RenderData &render_data, SurfacePoint &sp, BsdfFlags &bsdf_types) const
 {
-	MDat *dat = (MDat *)render_data.arena_;
-	dat->stack_ = (char *)render_data.arena_ + sizeof(MDat);
+	MDat *dat = (MDat *)render_data.material_data_;
+	dat->stack_ = (char *)render_data.material_data_ + sizeof(MDat);
 	NodeStack stack(dat->stack_);
 	if(bump_shader_) evalBump(stack, render_data, sp, bump_shader_);
 
-	for(const auto &node : color_nodes_) node->eval(stack, render_data, sp);
+	evalNodes(render_data, sp, color_nodes_, stack);
 	bsdf_types = bsdf_flags_;
 	dat->diffuse_ = diffuse_;
 	dat->glossy_ = glossy_reflection_shader_ ? glossy_reflection_shader_->getScalar(stack) : reflectivity_;
@@ -127,9 +128,16 @@ float CoatedGlossyMaterial::orenNayar(const Vec3 &wi, const Vec3 &wo, const Vec3
 
 }
 
+inline float CoatedGlossyMaterial::energyCompensation(const NodeStack &stack, float reflectance, float wo_n, float wi_n) const
+{
+	if(!albedo_table_) return 0.f;
+	const float exponent = anisotropic_ ? 0.5f * (exp_u_ + exp_v_) : (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_);
+	return albedo_table_->multipleScattering(wo_n, wi_n, exponent, reflectance);
+}
+
 Rgb CoatedGlossyMaterial::eval(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, const BsdfFlags &bsdfs, bool force_eval) const
 {
-	MDat *dat = (MDat *)render_data.arena_;
+	MDat *dat = (MDat *)render_data.material_data_;
 	Rgb col(0.f);
 	const bool diffuse_flag = bsdfs.hasAny(BsdfFlags::Diffuse);
 
@@ -155,10 +163,12 @@ Rgb CoatedGlossyMaterial::eval(const RenderData &render_data, const SurfacePoint
 		{
 			const Vec3 hs(h * sp.nu_, h * sp.nv_, h * n);
 			glossy = kt * asAnisoD_global(hs, exp_u_, exp_v_) * schlickFresnel_global(cos_wi_h, dat->glossy_) / asDivisor_global(cos_wi_h, wo_n, wi_n);
+			glossy += kt * energyCompensation(stack, dat->glossy_, wo_n, wi_n);
 		}
 		else
 		{
 			glossy = kt * blinnD_global(h * n, (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_)) * schlickFresnel_global(cos_wi_h, dat->glossy_) / asDivisor_global(cos_wi_h, wo_n, wi_n);
+			glossy += kt * energyCompensation(stack, dat->glossy_, wo_n, wi_n);
 		}
 		col = glossy * (glossy_shader_ ? glossy_shader_->getColor(stack) : gloss_color_);
 	}
@@ -183,7 +193,7 @@ Rgb CoatedGlossyMaterial::eval(const RenderData &render_data, const SurfacePoint
 
 Rgb CoatedGlossyMaterial::sample(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, Vec3 &wi, Sample &s, float &w) const
 {
-	const MDat *dat = (MDat *)render_data.arena_;
+	const MDat *dat = (MDat *)render_data.material_data_;
 	const NodeStack stack(dat->stack_);
 
 	const float cos_ng_wo = sp.ng_ * wo;
@@ -322,12 +332,14 @@ Rgb CoatedGlossyMaterial::sample(const RenderData &render_data, const SurfacePoi
 			{
 				s.pdf_ += asAnisoPdf_global(hs, cos_wo_h, exp_u_, exp_v_) * width[rc_index[C_GLOSSY]];
 				glossy = asAnisoD_global(hs, exp_u_, exp_v_) * schlickFresnel_global(cos_wo_h, dat->glossy_) / asDivisor_global(cos_wo_h, wo_n, wi_n);
+				glossy += energyCompensation(stack, dat->glossy_, wo_n, wi_n);
 			}
 			else
 			{
 				float cos_hn = h * n;
 				s.pdf_ += blinnPdf_global(cos_hn, cos_wo_h, (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_)) * width[rc_index[C_GLOSSY]];
 				glossy = blinnD_global(cos_hn, (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_)) * schlickFresnel_global(cos_wo_h, dat->glossy_) / asDivisor_global(cos_wo_h, wo_n, wi_n);
+				glossy += energyCompensation(stack, dat->glossy_, wo_n, wi_n);
 			}
 			scolor = glossy * kt * (glossy_shader_ ? glossy_shader_->getColor(stack) : gloss_color_);
 		}
@@ -365,7 +377,7 @@ Rgb CoatedGlossyMaterial::sample(const RenderData &render_data, const SurfacePoi
 
 float CoatedGlossyMaterial::pdf(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, const BsdfFlags &flags) const
 {
-	const MDat *dat = (MDat *)render_data.arena_;
+	const MDat *dat = (MDat *)render_data.material_data_;
 	const NodeStack stack(dat->stack_);
 	const bool transmit = ((sp.ng_ * wo) * (sp.ng_ * wi)) < 0.f;
 	if(transmit) return 0.f;
@@ -413,7 +425,7 @@ float CoatedGlossyMaterial::pdf(const RenderData &render_data, const SurfacePoin
 Material::Specular CoatedGlossyMaterial::getSpecular(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
 	Specular specular;
-	const MDat *dat = (MDat *)render_data.arena_;
+	const MDat *dat = (MDat *)render_data.material_data_;
 	const NodeStack stack(dat->stack_);
 	const bool outside = sp.ng_ * wo >= 0;
 	Vec3 n, ng;
@@ -476,6 +488,8 @@ std::unique_ptr<Material> CoatedGlossyMaterial::factory(ParamMap &params, std::l
 	params.getParam("as_diffuse", as_diff);
 	params.getParam("exponent", exponent);
 	params.getParam("anisotropic", aniso);
+	bool energy_compensation = false;
+	params.getParam("energy_compensation", energy_compensation); //adds back the energy lost by the glossy lobe at high roughness and grazing angles
 	params.getParam("IOR", ior);
 	params.getParam("mirror_color", mir_col);
 	params.getParam("specular_reflect", mirror_strength);
@@ -517,6 +531,7 @@ std::unique_ptr<Material> CoatedGlossyMaterial::factory(ParamMap &params, std::l
 		mat->exp_u_ = e_u;
 		mat->exp_v_ = e_v;
 	}
+	if(energy_compensation) mat->albedo_table_ = &BlinnAlbedoTable::get();
 
 	if(params.getParam("diffuse_brdf", name))
 	{
@@ -576,14 +591,14 @@ std::unique_ptr<Material> CoatedGlossyMaterial::factory(ParamMap &params, std::l
 		if(mat->wireframe_shader_)    mat->getNodeList(mat->wireframe_shader_, mat->color_nodes_);
 		if(mat->diffuse_reflection_shader_)  mat->getNodeList(mat->diffuse_reflection_shader_, mat->color_nodes_);
 		if(mat->mirror_color_shader_)  mat->getNodeList(mat->mirror_color_shader_, mat->color_nodes_);
-		if(mat->bump_shader_) mat->getNodeList(mat->bump_shader_, mat->bump_nodes_);
+		if(mat->bump_shader_) mat->getNodeList(mat->bump_shader_, mat->bump_nodes_, false);
 	}
 	mat->req_mem_ = mat->req_node_mem_ + sizeof(MDat);
 	return mat;
 }
 
 Rgb CoatedGlossyMaterial::getDiffuseColor(const RenderData &render_data) const {
-	MDat *dat = (MDat *)render_data.arena_;
+	MDat *dat = (MDat *)render_data.material_data_;
 	NodeStack stack(dat->stack_);
 
 	if(as_diffuse_ || with_diffuse_) return (diffuse_reflection_shader_ ? diffuse_reflection_shader_->getScalar(stack) : 1.f) * (diffuse_shader_ ? diffuse_shader_->getColor(stack) : diff_color_);
@@ -591,14 +606,14 @@ Rgb CoatedGlossyMaterial::getDiffuseColor(const RenderData &render_data) const {
 }
 
 Rgb CoatedGlossyMaterial::getGlossyColor(const RenderData &render_data) const {
-	MDat *dat = (MDat *)render_data.arena_;
+	MDat *dat = (MDat *)render_data.material_data_;
 	NodeStack stack(dat->stack_);
 
 	return (glossy_reflection_shader_ ? glossy_reflection_shader_->getScalar(stack) : reflectivity_) * (glossy_shader_ ? glossy_shader_->getColor(stack) : gloss_color_);
 }
 
 Rgb CoatedGlossyMaterial::getMirrorColor(const RenderData &render_data) const {
-	MDat *dat = (MDat *)render_data.arena_;
+	MDat *dat = (MDat *)render_data.material_data_;
 	NodeStack stack(dat->stack_);
 
 	return (mirror_shader_ ? mirror_shader_->getScalar(stack) : mirror_strength_) * (mirror_color_shader_ ? mirror_color_shader_->getColor(stack) : mirror_color_);
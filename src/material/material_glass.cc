@@ -48,9 +48,9 @@ GlassMaterial::GlassMaterial(float ior, Rgb filt_c, const Rgb &srcol, double dis
 
 void GlassMaterial::initBsdf(const RenderData &render_data, SurfacePoint &sp, BsdfFlags &bsdf_types) const
 {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 	if(bump_shader_) evalBump(stack, render_data, sp, bump_shader_);
-	for(const auto &node : color_nodes_) node->eval(stack, render_data, sp);
+	evalNodes(render_data, sp, color_nodes_, stack);
 	bsdf_types = bsdf_flags_;
 }
 
@@ -58,7 +58,7 @@ void GlassMaterial::initBsdf(const RenderData &render_data, SurfacePoint &sp, Bs
 
 Rgb GlassMaterial::sample(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, Vec3 &wi, Sample &s, float &w) const
 {
-	const NodeStack stack(render_data.arena_);
+	const NodeStack stack(render_data.material_data_);
 	if(!s.flags_.hasAny(BsdfFlags::Specular) && !(s.flags_.hasAny(bsdf_flags_ & BsdfFlags::Dispersive) && render_data.chromatic_))
 	{
 		s.pdf_ = 0.f;
@@ -201,7 +201,7 @@ Rgb GlassMaterial::sample(const RenderData &render_data, const SurfacePoint &sp,
 
 Rgb GlassMaterial::getTransparency(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	const NodeStack stack(render_data.arena_);
+	const NodeStack stack(render_data.material_data_);
 	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
 	float kr, kt;
 	Vec3::fresnel(wo, n, (ior_shader_ ? ior_shader_->getScalar(stack) : ior_), kr, kt);
@@ -213,7 +213,7 @@ Rgb GlassMaterial::getTransparency(const RenderData &render_data, const SurfaceP
 
 float GlassMaterial::getAlpha(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	const NodeStack stack(render_data.arena_);
+	const NodeStack stack(render_data.material_data_);
 	float alpha = 1.0 - getTransparency(render_data, sp, wo).energy();
 	if(alpha < 0.0f) alpha = 0.0f;
 	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
@@ -224,7 +224,7 @@ float GlassMaterial::getAlpha(const RenderData &render_data, const SurfacePoint
 Material::Specular GlassMaterial::getSpecular(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
 	Material::Specular specular;
-	const NodeStack stack(render_data.arena_);
+	const NodeStack stack(render_data.material_data_);
 	const bool outside = sp.ng_ * wo > 0;
 	Vec3 n;
 	const float cos_wo_n = sp.n_ * wo;
@@ -364,7 +364,18 @@ std::unique_ptr<Material> GlassMaterial::factory(ParamMap &params, std::list< Pa
 			if(params.getParam("name", name))
 			{
 				ParamMap map;
-				map["type"] = std::string("beer");
+				Rgb scatter_col;
+				if(params.getParam("scatter_color", scatter_col))
+				{
+					//subsurface scattering, traced as a random walk or replaced by a diffusion profile with "sss_mode" = "diffusion"
+					std::string sss_mode = "random_walk";
+					params.getParam("sss_mode", sss_mode);
+					map["type"] = std::string("sss");
+					map["scatter_col"] = scatter_col;
+					map["mode"] = sss_mode;
+					map["ior"] = Parameter(ior);
+				}
+				else map["type"] = std::string("beer");
 				map["absorption_col"] = absorp;
 				map["absorption_dist"] = Parameter(dist);
 				mat->vol_i_ = scene.createVolumeHandler(name, map);
@@ -403,19 +414,19 @@ std::unique_ptr<Material> GlassMaterial::factory(ParamMap &params, std::list< Pa
 		if(mat->filter_color_shader_) mat->getNodeList(mat->filter_color_shader_, mat->color_nodes_);
 		if(mat->ior_shader_) mat->getNodeList(mat->ior_shader_, mat->color_nodes_);
 		if(mat->wireframe_shader_)    mat->getNodeList(mat->wireframe_shader_, mat->color_nodes_);
-		if(mat->bump_shader_) mat->getNodeList(mat->bump_shader_, mat->bump_nodes_);
+		if(mat->bump_shader_) mat->getNodeList(mat->bump_shader_, mat->bump_nodes_, false);
 	}
 	mat->req_mem_ = mat->req_node_mem_;
 	return mat;
 }
 
 Rgb GlassMaterial::getGlossyColor(const RenderData &render_data) const {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 	return (mirror_color_shader_ ? mirror_color_shader_->getColor(stack) : specular_reflection_color_);
 }
 
 Rgb GlassMaterial::getTransColor(const RenderData &render_data) const {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 	if(filter_color_shader_ || filter_color_.minimum() < .99f)	return (filter_color_shader_ ? filter_color_shader_->getColor(stack) : filter_color_);
 	else
 	{
@@ -426,7 +437,7 @@ Rgb GlassMaterial::getTransColor(const RenderData &render_data) const {
 }
 
 Rgb GlassMaterial::getMirrorColor(const RenderData &render_data) const {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 	return (mirror_color_shader_ ? mirror_color_shader_->getColor(stack) : specular_reflection_color_);
 }
 
@@ -22,6 +22,7 @@
 #include "shader/shader_node.h"
 #include "sampler/sample.h"
 #include "material/material_utils_microfacet.h"
+#include "material/microfacet_albedo.h"
 #include "common/param.h"
 #include "geometry/surface.h"
 #include "common/logger.h"
@@ -50,12 +51,12 @@ GlossyMaterial::GlossyMaterial(const Rgb &col, const Rgb &dcol, float reflect, f
 
 void GlossyMaterial::initBsdf(const RenderData &render_data, SurfacePoint &sp, BsdfFlags &bsdf_types) const
 {
-	MDat *dat = (MDat *)render_data.arena_;
-	dat->stack_ = (char *)render_data.arena_ + sizeof(MDat);
+	MDat *dat = (MDat *)render_data.material_data_;
+	dat->stack_ = (char *)render_data.material_data_ + sizeof(MDat);
 	NodeStack stack(dat->stack_);
 	if(bump_shader_) evalBump(stack, render_data, sp, bump_shader_);
 
-	for(const auto &node : color_nodes_) node->eval(stack, render_data, sp);
+	evalNodes(render_data, sp, color_nodes_, stack);
 	bsdf_types = bsdf_flags_;
 	dat->m_diffuse_ = diffuse_;
 	dat->m_glossy_ = glossy_reflection_shader_ ? glossy_reflection_shader_->getScalar(stack) : reflectivity_;
@@ -109,6 +110,13 @@ float GlossyMaterial::orenNayar(const Vec3 &wi, const Vec3 &wo, const Vec3 &n, b
 	}
 }
 
+inline float GlossyMaterial::energyCompensation(const NodeStack &stack, float reflectance, float wo_n, float wi_n) const
+{
+	if(!albedo_table_) return 0.f;
+	const float exponent = anisotropic_ ? 0.5f * (exp_u_ + exp_v_) : (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_);
+	return albedo_table_->multipleScattering(wo_n, wi_n, exponent, reflectance);
+}
+
 Rgb GlossyMaterial::eval(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, const BsdfFlags &bsdfs, bool force_eval) const
 {
 	if(!force_eval)	//If the flag force_eval = true then the next line will be skipped, necessary for the Glossy Direct render pass
@@ -116,7 +124,7 @@ Rgb GlossyMaterial::eval(const RenderData &render_data, const SurfacePoint &sp,
 		if(!bsdfs.hasAny(BsdfFlags::Diffuse) || ((sp.ng_ * wi) * (sp.ng_ * wo)) < 0.f) return Rgb(0.f);
 	}
 
-	MDat *dat = (MDat *)render_data.arena_;
+	MDat *dat = (MDat *)render_data.material_data_;
 	Rgb col(0.f);
 	const bool diffuse_flag = bsdfs.hasAny(BsdfFlags::Diffuse);
 
@@ -135,10 +143,12 @@ Rgb GlossyMaterial::eval(const RenderData &render_data, const SurfacePoint &sp,
 		{
 			const Vec3 hs(h * sp.nu_, h * sp.nv_, h * n);
 			glossy = asAnisoD_global(hs, exp_u_, exp_v_) * schlickFresnel_global(cos_wi_h, dat->m_glossy_) / asDivisor_global(cos_wi_h, wo_n, wi_n);
+			glossy += energyCompensation(stack, dat->m_glossy_, wo_n, wi_n);
 		}
 		else
 		{
 			glossy = blinnD_global(h * n, (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_)) * schlickFresnel_global(cos_wi_h, dat->m_glossy_) / asDivisor_global(cos_wi_h, wo_n, wi_n);
+			glossy += energyCompensation(stack, dat->m_glossy_, wo_n, wi_n);
 		}
 		col = glossy * (glossy_shader_ ? glossy_shader_->getColor(stack) : gloss_color_);
 	}
@@ -162,9 +172,71 @@ Rgb GlossyMaterial::eval(const RenderData &render_data, const SurfacePoint &sp,
 }
 
 
+void GlossyMaterial::evalBatch(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 *wl, int num_directions, const BsdfFlags &bsdfs, Rgb *cols) const
+{
+	if(!bsdfs.hasAny(BsdfFlags::Diffuse))
+	{
+		for(int i = 0; i < num_directions; ++i) cols[i] = Rgb(0.f);
+		return;
+	}
+	//The textures and the terms depending only on wo are evaluated once for all the directions
+	const MDat *dat = (const MDat *)render_data.material_data_;
+	const NodeStack stack(dat->stack_);
+	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
+	const float cos_ng_wo = sp.ng_ * wo;
+	const float wo_n = std::abs(wo * n);
+	const bool with_glossy = as_diffuse_ || bsdfs.hasAny(BsdfFlags::Glossy);
+	const float exponent = (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_);
+	const Rgb glossy_col = with_glossy ? (glossy_shader_ ? glossy_shader_->getColor(stack) : gloss_color_) : Rgb(0.f);
+	Rgb diffuse_col(0.f);
+	if(with_diffuse_)
+	{
+		diffuse_col = dat->m_diffuse_ * (1.f - dat->m_glossy_) * (diffuse_shader_ ? diffuse_shader_->getColor(stack) : diff_color_);
+		if(diffuse_reflection_shader_) diffuse_col *= diffuse_reflection_shader_->getScalar(stack);
+	}
+	const double texture_sigma = (sigma_oren_shader_ ? sigma_oren_shader_->getScalar(stack) : 0.f);
+	const bool use_texture_sigma = (sigma_oren_shader_ ? true : false);
+	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
+
+	//The geometric terms of each block of directions are computed in lanes, in a loop without calls so it can be vectorized
+	constexpr int num_lanes = 8;
+	float same_side[num_lanes], wi_n[num_lanes], cos_wi_h[num_lanes], cos_n_h[num_lanes], cos_u_h[num_lanes], cos_v_h[num_lanes];
+	for(int first = 0; first < num_directions; first += num_lanes)
+	{
+		const int lanes = std::min(num_lanes, num_directions - first);
+		const Vec3 *wi = wl + first;
+		for(int lane = 0; lane < lanes; ++lane)
+		{
+			const Vec3 h = (wo + wi[lane]).normalize();
+			same_side[lane] = (sp.ng_ * wi[lane]) * cos_ng_wo;
+			wi_n[lane] = std::abs(wi[lane] * n);
+			cos_wi_h[lane] = std::max(0.f, wi[lane] * h);
+			cos_n_h[lane] = h * n;
+			cos_u_h[lane] = h * sp.nu_;
+			cos_v_h[lane] = h * sp.nv_;
+		}
+		for(int lane = 0; lane < lanes; ++lane)
+		{
+			Rgb &col = cols[first + lane];
+			col = Rgb(0.f);
+			if(same_side[lane] < 0.f) continue;
+			if(with_glossy)
+			{
+				float glossy;
+				if(anisotropic_) glossy = asAnisoD_global(Vec3(cos_u_h[lane], cos_v_h[lane], cos_n_h[lane]), exp_u_, exp_v_) * schlickFresnel_global(cos_wi_h[lane], dat->m_glossy_) / asDivisor_global(cos_wi_h[lane], wo_n, wi_n[lane]);
+				else glossy = blinnD_global(cos_n_h[lane], exponent) * schlickFresnel_global(cos_wi_h[lane], dat->m_glossy_) / asDivisor_global(cos_wi_h[lane], wo_n, wi_n[lane]);
+				glossy += energyCompensation(stack, dat->m_glossy_, wo_n, wi_n[lane]);
+				col = glossy * glossy_col;
+			}
+			if(with_diffuse_) col += oren_nayar_ ? diffuse_col * orenNayar(wi[lane], wo, n, use_texture_sigma, texture_sigma) : diffuse_col;
+			applyWireFrame(col, wire_frame_amount, sp);
+		}
+	}
+}
+
 Rgb GlossyMaterial::sample(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, Vec3 &wi, Sample &s, float &w) const
 {
-	const MDat *dat = (MDat *)render_data.arena_;
+	const MDat *dat = (MDat *)render_data.material_data_;
 	const float cos_ng_wo = sp.ng_ * wo;
 	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);//(cos_Ng_wo < 0) ? -sp.N : sp.N;
 	Vec3 Hs;
@@ -206,11 +278,13 @@ Rgb GlossyMaterial::sample(const RenderData &render_data, const SurfacePoint &sp
 					const Vec3 hs(h * sp.nu_, h * sp.nv_, cos_n_h);
 					s.pdf_ = s.pdf_ * cur_p_diffuse + asAnisoPdf_global(hs, cos_wo_h, exp_u_, exp_v_) * (1.f - cur_p_diffuse);
 					glossy = asAnisoD_global(hs, exp_u_, exp_v_) * schlickFresnel_global(cos_wi_h, dat->m_glossy_) / asDivisor_global(cos_wi_h, wo_n, wi_n);
+					glossy += energyCompensation(stack, dat->m_glossy_, wo_n, wi_n);
 				}
 				else
 				{
 					s.pdf_ = s.pdf_ * cur_p_diffuse + blinnPdf_global(cos_n_h, cos_wo_h, (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_)) * (1.f - cur_p_diffuse);
 					glossy = blinnD_global(cos_n_h, (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_)) * schlickFresnel_global(cos_wi_h, dat->m_glossy_) / asDivisor_global(cos_wi_h, wo_n, wi_n);
+					glossy += energyCompensation(stack, dat->m_glossy_, wo_n, wi_n);
 				}
 			}
 			s.sampled_flags_ = BsdfFlags::Diffuse | BsdfFlags::Reflect;
@@ -273,6 +347,7 @@ Rgb GlossyMaterial::sample(const RenderData &render_data, const SurfacePoint &sp
 			wi_n = std::abs(wi * n);
 			s.pdf_ = asAnisoPdf_global(Hs, cos_wo_h, exp_u_, exp_v_);
 			glossy = asAnisoD_global(Hs, exp_u_, exp_v_) * schlickFresnel_global(cos_wo_h, dat->m_glossy_) / asDivisor_global(cos_wo_h, wo_n, wi_n);
+			glossy += energyCompensation(stack, dat->m_glossy_, wo_n, wi_n);
 		}
 		else
 		{
@@ -299,6 +374,7 @@ Rgb GlossyMaterial::sample(const RenderData &render_data, const SurfacePoint &sp
 			const float cos_hn = h * n;
 			s.pdf_ = blinnPdf_global(cos_hn, cos_wo_h, (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_));
 			glossy = blinnD_global(cos_hn, (exponent_shader_ ? exponent_shader_->getScalar(stack) : exponent_)) * schlickFresnel_global(cos_wo_h, dat->m_glossy_) / asDivisor_global(cos_wo_h, wo_n, wi_n);
+			glossy += energyCompensation(stack, dat->m_glossy_, wo_n, wi_n);
 		}
 		scolor = glossy * (glossy_shader_ ? glossy_shader_->getColor(stack) : gloss_color_);
 		s.sampled_flags_ = as_diffuse_ ? BsdfFlags::Diffuse | BsdfFlags::Reflect : BsdfFlags::Glossy | BsdfFlags::Reflect;
@@ -325,7 +401,7 @@ Rgb GlossyMaterial::sample(const RenderData &render_data, const SurfacePoint &sp
 
 float GlossyMaterial::pdf(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, const BsdfFlags &flags) const
 {
-	const MDat *dat = (MDat *)render_data.arena_;
+	const MDat *dat = (MDat *)render_data.material_data_;
 	const NodeStack stack(dat->stack_);
 	if((sp.ng_ * wo) * (sp.ng_ * wi) < 0.f) return 0.f;
 	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
@@ -393,6 +469,8 @@ std::unique_ptr<Material> GlossyMaterial::factory(ParamMap &params, std::list< P
 	params.getParam("as_diffuse", as_diff);
 	params.getParam("exponent", exponent);
 	params.getParam("anisotropic", aniso);
+	bool energy_compensation = false;
+	params.getParam("energy_compensation", energy_compensation); //adds back the energy lost by the glossy lobe at high roughness and grazing angles
 
 	params.getParam("receive_shadows", receive_shadows);
 	params.getParam("visibility", s_visibility);
@@ -429,6 +507,7 @@ std::unique_ptr<Material> GlossyMaterial::factory(ParamMap &params, std::list< P
 		mat->exp_u_ = e_u;
 		mat->exp_v_ = e_v;
 	}
+	if(energy_compensation) mat->albedo_table_ = &BlinnAlbedoTable::get();
 
 	if(params.getParam("diffuse_brdf", name))
 	{
@@ -479,7 +558,7 @@ std::unique_ptr<Material> GlossyMaterial::factory(ParamMap &params, std::list< P
 		if(mat->exponent_shader_) mat->getNodeList(mat->exponent_shader_, mat->color_nodes_);
 		if(mat->wireframe_shader_)    mat->getNodeList(mat->wireframe_shader_, mat->color_nodes_);
 		if(mat->diffuse_reflection_shader_)  mat->getNodeList(mat->diffuse_reflection_shader_, mat->color_nodes_);
-		if(mat->bump_shader_) mat->getNodeList(mat->bump_shader_, mat->bump_nodes_);
+		if(mat->bump_shader_) mat->getNodeList(mat->bump_shader_, mat->bump_nodes_, false);
 	}
 
 	mat->req_mem_ = mat->req_node_mem_ + sizeof(MDat);
@@ -488,7 +567,7 @@ std::unique_ptr<Material> GlossyMaterial::factory(ParamMap &params, std::list< P
 }
 
 Rgb GlossyMaterial::getDiffuseColor(const RenderData &render_data) const {
-	MDat *dat = (MDat *)render_data.arena_;
+	MDat *dat = (MDat *)render_data.material_data_;
 	NodeStack stack(dat->stack_);
 
 	if(as_diffuse_ || with_diffuse_) return (diffuse_reflection_shader_ ? diffuse_reflection_shader_->getScalar(stack) : 1.f) * (diffuse_shader_ ? diffuse_shader_->getColor(stack) : diff_color_);
@@ -496,7 +575,7 @@ Rgb GlossyMaterial::getDiffuseColor(const RenderData &render_data) const {
 }
 
 Rgb GlossyMaterial::getGlossyColor(const RenderData &render_data) const {
-	MDat *dat = (MDat *)render_data.arena_;
+	MDat *dat = (MDat *)render_data.material_data_;
 	NodeStack stack(dat->stack_);
 
 	return (glossy_reflection_shader_ ? glossy_reflection_shader_->getScalar(stack) : reflectivity_) * (glossy_shader_ ? glossy_shader_->getColor(stack) : gloss_color_);
@@ -34,49 +34,50 @@ MaskMaterial::MaskMaterial(const Material *m_1, const Material *m_2, float thres
 }
 
 #define PTR_ADD(ptr,sz) ((char*)ptr+(sz))
+static constexpr size_t mask_data_size_global = RenderData::alignMaterialDataSize(sizeof(bool)); //!< the mask value, padded so the data of the masked materials stays aligned
 void MaskMaterial::initBsdf(const RenderData &render_data, SurfacePoint &sp, BsdfFlags &bsdf_types) const
 {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 	evalNodes(render_data, sp, color_nodes_, stack);
 	const float val = mask_->getScalar(stack); //mask->getFloat(sp.P);
 	const bool mv = val > threshold_;
-	*(bool *)render_data.arena_ = mv;
-	render_data.arena_ = PTR_ADD(render_data.arena_, sizeof(bool));
+	*(bool *)render_data.material_data_ = mv;
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, mask_data_size_global);
 	if(mv) mat_2_->initBsdf(render_data, sp, bsdf_types);
 	else mat_1_->initBsdf(render_data, sp, bsdf_types);
-	render_data.arena_ = PTR_ADD(render_data.arena_, -sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, -static_cast<std::ptrdiff_t>(mask_data_size_global));
 }
 
 Rgb MaskMaterial::eval(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, const BsdfFlags &bsdfs, bool force_eval) const
 {
-	const bool mv = *(bool *)render_data.arena_;
+	const bool mv = *(bool *)render_data.material_data_;
 	Rgb col;
-	render_data.arena_ = PTR_ADD(render_data.arena_, sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, mask_data_size_global);
 	if(mv) col = mat_2_->eval(render_data, sp, wo, wi, bsdfs);
 	else   col = mat_1_->eval(render_data, sp, wo, wi, bsdfs);
-	render_data.arena_ = PTR_ADD(render_data.arena_, -sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, -static_cast<std::ptrdiff_t>(mask_data_size_global));
 	return col;
 }
 
 Rgb MaskMaterial::sample(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, Vec3 &wi, Sample &s, float &w) const
 {
-	const bool mv = *(bool *)render_data.arena_;
+	const bool mv = *(bool *)render_data.material_data_;
 	Rgb col;
-	render_data.arena_ = PTR_ADD(render_data.arena_, sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, mask_data_size_global);
 	if(mv) col = mat_2_->sample(render_data, sp, wo, wi, s, w);
 	else   col = mat_1_->sample(render_data, sp, wo, wi, s, w);
-	render_data.arena_ = PTR_ADD(render_data.arena_, -sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, -static_cast<std::ptrdiff_t>(mask_data_size_global));
 	return col;
 }
 
 float MaskMaterial::pdf(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 &wi, const BsdfFlags &bsdfs) const
 {
-	const bool mv = *(bool *)render_data.arena_;
+	const bool mv = *(bool *)render_data.material_data_;
 	float pdf;
-	render_data.arena_ = PTR_ADD(render_data.arena_, sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, mask_data_size_global);
 	if(mv) pdf = mat_2_->pdf(render_data, sp, wo, wi, bsdfs);
 	else   pdf = mat_1_->pdf(render_data, sp, wo, wi, bsdfs);
-	render_data.arena_ = PTR_ADD(render_data.arena_, -sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, -static_cast<std::ptrdiff_t>(mask_data_size_global));
 	return pdf;
 }
 
@@ -87,9 +88,14 @@ bool MaskMaterial::isTransparent() const
 
 Rgb MaskMaterial::getTransparency(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	NodeStack stack(render_data.arena_);
-	evalNodes(render_data, sp, color_nodes_, stack);
-	float val = mask_->getScalar(stack);
+	//The alpha mask of the mask texture, when it has one, picks the material without evaluating the mask nodes
+	float val;
+	if(!shadow_alpha_mask_ || !mask_->evalAlphaMask(render_data, sp, val))
+	{
+		NodeStack stack(render_data.material_data_);
+		evalNodes(render_data, sp, color_nodes_, stack);
+		val = mask_->getScalar(stack);
+	}
 	bool mv = val > 0.5;
 	if(mv) return mat_2_->getTransparency(render_data, sp, wo);
 	else   return mat_1_->getTransparency(render_data, sp, wo);
@@ -98,33 +104,33 @@ Rgb MaskMaterial::getTransparency(const RenderData &render_data, const SurfacePo
 Material::Specular MaskMaterial::getSpecular(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
 	Specular specular;
-	const bool mv = *(bool *)render_data.arena_;
-	render_data.arena_ = PTR_ADD(render_data.arena_, sizeof(bool));
+	const bool mv = *(bool *)render_data.material_data_;
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, mask_data_size_global);
 	if(mv) specular = mat_2_->getSpecular(render_data, sp, wo);
 	else specular = mat_1_->getSpecular(render_data, sp, wo);
-	render_data.arena_ = PTR_ADD(render_data.arena_, -sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, -static_cast<std::ptrdiff_t>(mask_data_size_global));
 	return specular;
 }
 
 Rgb MaskMaterial::emit(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	const bool mv = *(bool *)render_data.arena_;
+	const bool mv = *(bool *)render_data.material_data_;
 	Rgb col;
-	render_data.arena_ = PTR_ADD(render_data.arena_, sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, mask_data_size_global);
 	if(mv) col = mat_2_->emit(render_data, sp, wo);
 	else   col = mat_1_->emit(render_data, sp, wo);
-	render_data.arena_ = PTR_ADD(render_data.arena_, -sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, -static_cast<std::ptrdiff_t>(mask_data_size_global));
 	return col;
 }
 
 float MaskMaterial::getAlpha(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	const bool mv = *(bool *)render_data.arena_;
+	const bool mv = *(bool *)render_data.material_data_;
 	float alpha;
-	render_data.arena_ = PTR_ADD(render_data.arena_, sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, mask_data_size_global);
 	if(mv) alpha = mat_2_->getAlpha(render_data, sp, wo);
 	else   alpha = mat_1_->getAlpha(render_data, sp, wo);
-	render_data.arena_ = PTR_ADD(render_data.arena_, -sizeof(bool));
+	render_data.material_data_ = PTR_ADD(render_data.material_data_, -static_cast<std::ptrdiff_t>(mask_data_size_global));
 	return alpha;
 }
 
@@ -142,13 +148,16 @@ std::unique_ptr<Material> MaskMaterial::factory(ParamMap &params, std::list< Par
 	double thresh = 0.5;
 	std::string s_visibility = "normal";
 	bool receive_shadows = true;
+	bool shadow_alpha_mask = true;
 	params.getParam("threshold", thresh);
 	params.getParam("receive_shadows", receive_shadows);
+	params.getParam("shadow_alpha_mask", shadow_alpha_mask);
 	params.getParam("visibility", s_visibility);
 
 	const Visibility visibility = visibilityFromString_global(s_visibility);
 	auto mat = std::unique_ptr<MaskMaterial>(new MaskMaterial(m_1, m_2, thresh, visibility));
 	mat->receive_shadows_ = receive_shadows;
+	mat->shadow_alpha_mask_ = shadow_alpha_mask;
 
 	std::vector<ShaderNode *> roots;
 	if(mat->loadNodes(eparams, scene))
@@ -170,8 +179,9 @@ std::unique_ptr<Material> MaskMaterial::factory(ParamMap &params, std::list< Par
 		return nullptr;
 	}
 	mat->solveNodesOrder(roots);
+	if(mat->shadow_alpha_mask_ && mat->mask_) mat->mask_->requestAlphaMask();
 	size_t input_req = std::max(m_1->getReqMem(), m_2->getReqMem());
-	mat->req_mem_ = std::max(mat->req_node_mem_, sizeof(bool) + input_req);
+	mat->req_mem_ = std::max(mat->req_node_mem_, mask_data_size_global + input_req);
 	return mat;
 }
 
@@ -20,6 +20,9 @@
 #include "common/logger.h"
 #include "common/param.h"
 #include "shader/shader_node.h"
+#include "geometry/surface.h"
+#include "render/render_data.h"
+#include <algorithm>
 
 BEGIN_YAFARAY
 
@@ -56,7 +59,15 @@ NodeMaterial::~NodeMaterial()
 }
 
 void NodeMaterial::evalNodes(const RenderData &render_data, const SurfacePoint &sp, const std::vector<ShaderNode *> &nodes, NodeStack &stack) const {
-	for(const auto &node : nodes) node->eval(stack, render_data, sp);
+	for(const auto &constant_result : constant_results_) stack[constant_result.first] = constant_result.second;
+	for(const auto &node : nodes)
+	{
+		const unsigned int id = node->getId();
+		if(constant_nodes_[id]) continue;
+		const ShaderNode *equivalent_node = equivalent_nodes_[id];
+		if(equivalent_node) stack[id] = stack(equivalent_node->getId());
+		else node->eval(stack, render_data, sp);
+	}
 }
 
 void NodeMaterial::solveNodesOrder(const std::vector<ShaderNode *> &roots)
@@ -73,6 +84,55 @@ void NodeMaterial::solveNodesOrder(const std::vector<ShaderNode *> &roots)
 		n->setId(i);
 	}
 	req_node_mem_ = color_nodes_sorted_.size() * sizeof(NodeResult);
+	foldConstantNodes(roots);
+	//For example several texture mappers of the same texture with the same mapping, used by different material components
+	equivalent_nodes_.assign(color_nodes_sorted_.size(), nullptr);
+	for(unsigned int i = 1; i < color_nodes_sorted_.size(); ++i)
+	{
+		if(constant_nodes_[i]) continue;
+		for(unsigned int j = 0; j < i; ++j)
+		{
+			if(!constant_nodes_[j] && !equivalent_nodes_[j] && color_nodes_sorted_[j]->isEquivalent(*color_nodes_sorted_[i]))
+			{
+				equivalent_nodes_[i] = color_nodes_sorted_[j];
+				break;
+			}
+		}
+	}
+}
+
+void NodeMaterial::foldConstantNodes(const std::vector<ShaderNode *> &roots)
+{
+	//The nodes not using the surface point, neither directly nor through their inputs, are evaluated only once here
+	const size_t num_nodes = color_nodes_sorted_.size();
+	constant_nodes_.assign(num_nodes, false);
+	std::vector<NodeResult> constant_stack_data(num_nodes);
+	NodeStack constant_stack(constant_stack_data.data());
+	RenderData render_data;
+	SurfacePoint sp;
+	std::vector<char> results_needed(num_nodes, false);
+	for(const auto &root : roots) results_needed[root->getId()] = true;
+	for(unsigned int i = 0; i < num_nodes; ++i)
+	{
+		const ShaderNode *node = color_nodes_sorted_[i];
+		std::vector<const ShaderNode *> dependency_nodes;
+		node->getDependencies(dependency_nodes);
+		bool constant = !node->dependsOnSurfacePoint();
+		for(const auto &dependency_node : dependency_nodes) constant = constant && constant_nodes_[dependency_node->getId()];
+		if(constant)
+		{
+			node->eval(constant_stack, render_data, sp);
+			constant_nodes_[i] = true;
+		}
+		else for(const auto &dependency_node : dependency_nodes) results_needed[dependency_node->getId()] = true;
+	}
+	//Only the constant results read by the material or by the varying nodes are copied to the stack, the others are dead after folding
+	constant_results_.clear();
+	for(unsigned int i = 0; i < num_nodes; ++i)
+	{
+		if(constant_nodes_[i] && results_needed[i]) constant_results_.emplace_back(i, constant_stack_data[i]);
+	}
+	if(Y_LOG_HAS_VERBOSE && !constant_results_.empty()) Y_VERBOSE << "NodeMaterial: " << std::count(constant_nodes_.begin(), constant_nodes_.end(), true) << " of " << num_nodes << " shader nodes folded into " << constant_results_.size() << " constant results" << YENDL;
 }
 
 /*! get a list of all nodes that are in the tree given by root
@@ -80,13 +140,25 @@ void NodeMaterial::solveNodesOrder(const std::vector<ShaderNode *> &roots)
 	since "solveNodesOrder" sorts allNodes, calling getNodeList afterwards gives
 	a list in evaluation order. multiple calls are merged in "nodes" */
 
-void NodeMaterial::getNodeList(const ShaderNode *root, std::vector<ShaderNode *> &nodes)
+void NodeMaterial::getNodeList(const ShaderNode *root, std::vector<ShaderNode *> &nodes, bool eval_nodes_list)
 {
 	std::set<const ShaderNode *> in_tree;
 	for(const auto &node : nodes) in_tree.insert(node);
 	recursiveFinder_global(root, in_tree);
+	//The nodes equivalent to others copy their results, so the lists must also evaluate those others
+	if(eval_nodes_list)
+	{
+		for(const auto &node : color_nodes_sorted_)
+		{
+			if(in_tree.find(node) != in_tree.end() && node->getId() < equivalent_nodes_.size() && equivalent_nodes_[node->getId()]) in_tree.insert(equivalent_nodes_[node->getId()]);
+		}
+	}
 	nodes.clear();
-	for(const auto &node : color_nodes_sorted_) if(in_tree.find(node) != in_tree.end()) nodes.push_back(node);
+	for(const auto &node : color_nodes_sorted_)
+	{
+		if(eval_nodes_list && node->getId() < constant_nodes_.size() && constant_nodes_[node->getId()]) continue; //their results are copied by evalNodes
+		if(in_tree.find(node) != in_tree.end()) nodes.push_back(node);
+	}
 }
 
 void NodeMaterial::evalBump(NodeStack &stack, const RenderData &render_data, SurfacePoint &sp, const ShaderNode *bump_shader_node) const
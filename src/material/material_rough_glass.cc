@@ -45,15 +45,15 @@ RoughGlassMaterial::RoughGlassMaterial(float ior, Rgb filt_c, const Rgb &srcol,
 
 void RoughGlassMaterial::initBsdf(const RenderData &render_data, SurfacePoint &sp, BsdfFlags &bsdf_types) const
 {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 	if(bump_shader_) evalBump(stack, render_data, sp, bump_shader_);
-	for(const auto &node : color_nodes_) node->eval(stack, render_data, sp);
+	evalNodes(render_data, sp, color_nodes_, stack);
 	bsdf_types = bsdf_flags_;
 }
 
 Rgb RoughGlassMaterial::sample(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, Vec3 &wi, Sample &s, float &w) const
 {
-	const NodeStack stack(render_data.arena_);
+	const NodeStack stack(render_data.material_data_);
 	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
 	const bool outside = sp.ng_ * wo > 0.f;
 	s.pdf_ = 1.f;
@@ -145,7 +145,7 @@ Rgb RoughGlassMaterial::sample(const RenderData &render_data, const SurfacePoint
 
 Rgb RoughGlassMaterial::sample(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, Vec3 *const dir, Rgb &tcol, Sample &s, float *const w) const
 {
-	const NodeStack stack(render_data.arena_);
+	const NodeStack stack(render_data.material_data_);
 	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
 	const bool outside = sp.ng_ * wo > 0.f;
 	s.pdf_ = 1.f;
@@ -243,7 +243,7 @@ Rgb RoughGlassMaterial::sample(const RenderData &render_data, const SurfacePoint
 
 Rgb RoughGlassMaterial::getTransparency(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	const NodeStack stack(render_data.arena_);
+	const NodeStack stack(render_data.material_data_);
 	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
 	float kr, kt;
 	Vec3::fresnel(wo, n, (ior_shader_ ? ior_shader_->getScalar(stack) : ior_), kr, kt);
@@ -255,7 +255,7 @@ Rgb RoughGlassMaterial::getTransparency(const RenderData &render_data, const Sur
 
 float RoughGlassMaterial::getAlpha(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	const NodeStack stack(render_data.arena_);
+	const NodeStack stack(render_data.material_data_);
 	float alpha = std::max(0.f, std::min(1.f, 1.f - getTransparency(render_data, sp, wo).energy()));
 	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
 	applyWireFrame(alpha, wire_frame_amount, sp);
@@ -387,7 +387,7 @@ std::unique_ptr<Material> RoughGlassMaterial::factory(ParamMap &params, std::lis
 		if(mat->ior_shader_) mat->getNodeList(mat->ior_shader_, mat->color_nodes_);
 		if(mat->wireframe_shader_) mat->getNodeList(mat->wireframe_shader_, mat->color_nodes_);
 		if(mat->filter_col_shader_) mat->getNodeList(mat->filter_col_shader_, mat->color_nodes_);
-		if(mat->bump_shader_) mat->getNodeList(mat->bump_shader_, mat->bump_nodes_);
+		if(mat->bump_shader_) mat->getNodeList(mat->bump_shader_, mat->bump_nodes_, false);
 	}
 	mat->req_mem_ = mat->req_node_mem_;
 
@@ -395,17 +395,17 @@ std::unique_ptr<Material> RoughGlassMaterial::factory(ParamMap &params, std::lis
 }
 
 Rgb RoughGlassMaterial::getGlossyColor(const RenderData &render_data) const {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 	return (mirror_color_shader_ ? mirror_color_shader_->getColor(stack) : specular_reflection_color_);
 }
 
 Rgb RoughGlassMaterial::getTransColor(const RenderData &render_data) const {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 	return (filter_col_shader_ ? filter_col_shader_->getColor(stack) : filter_color_);
 }
 
 Rgb RoughGlassMaterial::getMirrorColor(const RenderData &render_data) const {
-	NodeStack stack(render_data.arena_);
+	NodeStack stack(render_data.material_data_);
 	return (mirror_color_shader_ ? mirror_color_shader_->getColor(stack) : specular_reflection_color_);
 }
 
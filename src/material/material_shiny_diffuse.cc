@@ -134,15 +134,15 @@ static inline void accumulate_global(const float *component, float *accum, float
 
 void ShinyDiffuseMaterial::initBsdf(const RenderData &render_data, SurfacePoint &sp, BsdfFlags &bsdf_types) const
 {
-	SdDat *dat = (SdDat *)render_data.arena_;
+	SdDat *dat = (SdDat *)render_data.material_data_;
 	memset(dat, 0, 8 * sizeof(float));
-	dat->node_stack_ = (char *)render_data.arena_ + sizeof(SdDat);
+	dat->node_stack_ = (char *)render_data.material_data_ + sizeof(SdDat);
 	//create our "stack" to save node results
 	NodeStack stack(dat->node_stack_);
 
 	//bump mapping (extremely experimental)
 	if(bump_shader_) evalBump(stack, render_data, sp, bump_shader_);
-	for(const auto &node : color_nodes_) node->eval(stack, render_data, sp);
+	evalNodes(render_data, sp, color_nodes_, stack);
 	bsdf_types = bsdf_flags_;
 	getComponents(vi_nodes_, stack, dat->component_);
 }
@@ -210,7 +210,7 @@ Rgb ShinyDiffuseMaterial::eval(const RenderData &render_data, const SurfacePoint
 	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
 	if(!bsdfs.hasAny(bsdf_flags_ & BsdfFlags::Diffuse)) return Rgb(0.f);
 
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 
 	float cur_ior_squared;
@@ -250,9 +250,66 @@ Rgb ShinyDiffuseMaterial::eval(const RenderData &render_data, const SurfacePoint
 	return result;
 }
 
+void ShinyDiffuseMaterial::evalBatch(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo, const Vec3 *wl, int num_directions, const BsdfFlags &bsdfs, Rgb *cols) const
+{
+	if(!bsdfs.hasAny(bsdf_flags_ & BsdfFlags::Diffuse))
+	{
+		for(int i = 0; i < num_directions; ++i) cols[i] = Rgb(0.f);
+		return;
+	}
+	//Only the side of the directions and the Oren Nayar term depend on them, the Fresnel term and the textures are evaluated once for all of them
+	const SdDat *dat = (SdDat *)render_data.material_data_;
+	const NodeStack stack(dat->node_stack_);
+	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
+	const float cos_ng_wo = sp.ng_ * wo;
+	float cur_ior_squared;
+	if(ior_shader_)
+	{
+		cur_ior_squared = ior_ + ior_shader_->getScalar(stack);
+		cur_ior_squared *= cur_ior_squared;
+	}
+	else cur_ior_squared = ior_squared_;
+	const float kr = getFresnelKr(wo, n, cur_ior_squared);
+	const float m_t = (1.f - kr * dat->component_[0]) * (1.f - dat->component_[1]);
+	const Rgb diffuse_col = (diffuse_shader_ ? diffuse_shader_->getColor(stack) : diffuse_color_);
+	const Rgb translucent_col = dat->component_[2] * m_t * diffuse_col;
+	const float m_d = m_t * (1.f - dat->component_[2]) * dat->component_[3];
+	const double texture_sigma = (sigma_oren_shader_ ? sigma_oren_shader_->getScalar(stack) : 0.f);
+	const bool use_texture_sigma = (sigma_oren_shader_ ? true : false);
+	const float diffuse_refl = (diffuse_refl_shader_ ? diffuse_refl_shader_->getScalar(stack) : 1.f);
+	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
+
+	constexpr int num_lanes = 8;
+	float cos_ng_wl[num_lanes], cos_n_wl[num_lanes];
+	for(int first = 0; first < num_directions; first += num_lanes)
+	{
+		const int lanes = std::min(num_lanes, num_directions - first);
+		const Vec3 *wi = wl + first;
+		for(int lane = 0; lane < lanes; ++lane)
+		{
+			cos_ng_wl[lane] = sp.ng_ * wi[lane];
+			cos_n_wl[lane] = n * wi[lane];
+		}
+		for(int lane = 0; lane < lanes; ++lane)
+		{
+			Rgb &col = cols[first + lane];
+			if(is_translucent_ && (cos_ng_wo * cos_ng_wl[lane]) < 0.f) col = translucent_col; // light comes from opposite side of surface
+			else if(cos_n_wl[lane] < 0.0 && !flat_material_) col = Rgb(0.f);
+			else
+			{
+				float m_d_lane = m_d;
+				if(use_oren_nayar_) m_d_lane *= orenNayar(wo, wi[lane], n, use_texture_sigma, texture_sigma);
+				if(diffuse_refl_shader_) m_d_lane *= diffuse_refl;
+				col = m_d_lane * diffuse_col;
+				applyWireFrame(col, wire_frame_amount, sp);
+			}
+		}
+	}
+}
+
 Rgb ShinyDiffuseMaterial::emit(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 	Rgb result = (diffuse_shader_ ? diffuse_shader_->getColor(stack) * emit_strength_ : emit_color_);
 	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
@@ -265,7 +322,7 @@ Rgb ShinyDiffuseMaterial::sample(const RenderData &render_data, const SurfacePoi
 	float accum_c[4];
 	const float cos_ng_wo = sp.ng_ * wo;
 	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 
 	float cur_ior_squared;
@@ -358,7 +415,7 @@ float ShinyDiffuseMaterial::pdf(const RenderData &render_data, const SurfacePoin
 {
 	if(!bsdfs.hasAny(BsdfFlags::Diffuse)) return 0.f;
 
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 
 	float pdf = 0.f;
@@ -403,6 +460,27 @@ float ShinyDiffuseMaterial::pdf(const RenderData &render_data, const SurfacePoin
 	return pdf / sum;
 }
 
+/** Reflectivity of the diffuse components.
+ *  Without Fresnel effect and Oren Nayar the lambertian reflection and the translucency sampled by
+ *  the reflectivity estimation of the base class have a constant weight, so their colors are returned directly
+ */
+Rgb ShinyDiffuseMaterial::getReflectivity(const RenderData &render_data, const SurfacePoint &sp, BsdfFlags flags) const
+{
+	if(has_fresnel_effect_ || use_oren_nayar_) return NodeMaterial::getReflectivity(render_data, sp, flags);
+	if(!flags.hasAny((BsdfFlags::Transmit | BsdfFlags::Reflect) & bsdf_flags_)) return Rgb(0.f);
+	const SdDat *dat = (SdDat *)render_data.material_data_;
+	const NodeStack stack(dat->node_stack_);
+	float accum_c[4];
+	accumulate_global(dat->component_, accum_c, 1.f);
+	float strength = 0.f;
+	if(is_translucent_ && (flags & BsdfFlags::Translucency) == BsdfFlags::Translucency) strength += accum_c[2];
+	if(is_diffuse_ && (flags & BsdfFlags::DiffuseReflect) == BsdfFlags::DiffuseReflect) strength += accum_c[3];
+	Rgb result = strength * (diffuse_shader_ ? diffuse_shader_->getColor(stack) : diffuse_color_);
+	const float wire_frame_amount = (wireframe_shader_ ? wireframe_shader_->getScalar(stack) * wireframe_amount_ : wireframe_amount_);
+	applyWireFrame(result, wire_frame_amount, sp);
+	return result;
+}
+
 
 /** Perfect specular reflection.
  *  Calculate perfect specular reflection and refraction from the material for
@@ -418,7 +496,7 @@ float ShinyDiffuseMaterial::pdf(const RenderData &render_data, const SurfacePoin
 Material::Specular ShinyDiffuseMaterial::getSpecular(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
 	Specular specular;
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 	const bool backface = wo * sp.ng_ < 0.f;
 	const Vec3 n  = backface ? -sp.n_ : sp.n_;
@@ -463,8 +541,19 @@ Rgb ShinyDiffuseMaterial::getTransparency(const RenderData &render_data, const S
 {
 	if(!is_transparent_) return Rgb(0.f);
 
-	NodeStack stack(render_data.arena_);
-	for(const auto &node : color_nodes_sorted_) node->eval(stack, render_data, sp);
+	if(shadow_alpha_mask_)
+	{
+		//The opaque texels of a cutout mask block the light whatever the rest of the material, and the transmitted color only needs the nodes when it is textured or reflected
+		float transparency;
+		if(transparency_shader_->evalAlphaMask(render_data, sp, transparency))
+		{
+			if(transparency <= 0.f) return Rgb(0.f);
+			if(!is_mirror_ && (!diffuse_shader_ || transmit_filter_strength_ <= 0.f)) return transparency * (transmit_filter_strength_ * diffuse_color_ + Rgb(1.f - transmit_filter_strength_));
+		}
+	}
+
+	NodeStack stack(render_data.material_data_);
+	evalNodes(render_data, sp, color_nodes_sorted_, stack);
 	float accum = 1.f;
 	const Vec3 n = SurfacePoint::normalFaceForward(sp.ng_, sp.n_, wo);
 
@@ -492,7 +581,7 @@ Rgb ShinyDiffuseMaterial::getTransparency(const RenderData &render_data, const S
 
 float ShinyDiffuseMaterial::getAlpha(const RenderData &render_data, const SurfacePoint &sp, const Vec3 &wo) const
 {
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 
 	if(is_transparent_)
@@ -529,6 +618,7 @@ std::unique_ptr<Material> ShinyDiffuseMaterial::factory(ParamMap &params, std::l
 	std::string s_visibility = "normal";
 	bool receive_shadows = true;
 	bool flat_material = false;
+	bool shadow_alpha_mask = true;
 	float ior = 1.33f;
 	double transmit_filter_strength = 1.0;
 	int mat_pass_index = 0;
@@ -554,6 +644,7 @@ std::unique_ptr<Material> ShinyDiffuseMaterial::factory(ParamMap &params, std::l
 
 	params.getParam("receive_shadows",  receive_shadows);
 	params.getParam("flat_material",  flat_material);
+	params.getParam("shadow_alpha_mask",  shadow_alpha_mask);
 	params.getParam("visibility", s_visibility);
 	params.getParam("mat_pass_index",   mat_pass_index);
 	params.getParam("additionaldepth",   additionaldepth);
@@ -650,42 +741,45 @@ std::unique_ptr<Material> ShinyDiffuseMaterial::factory(ParamMap &params, std::l
 		if(mat->diffuse_refl_shader_)  mat->getNodeList(mat->diffuse_refl_shader_, mat->color_nodes_);
 		if(mat->ior_shader_)                mat->getNodeList(mat->ior_shader_, mat->color_nodes_);
 		if(mat->wireframe_shader_)    mat->getNodeList(mat->wireframe_shader_, mat->color_nodes_);
-		if(mat->bump_shader_)         mat->getNodeList(mat->bump_shader_, mat->bump_nodes_);
+		if(mat->bump_shader_)         mat->getNodeList(mat->bump_shader_, mat->bump_nodes_, false);
 	}
 	mat->config();
+	//The wireframe changes the transparency near the edges, so it needs the full evaluation
+	mat->shadow_alpha_mask_ = shadow_alpha_mask && mat->transparency_shader_ && mat->wireframe_amount_ <= 0.f;
+	if(mat->shadow_alpha_mask_) mat->transparency_shader_->requestAlphaMask();
 	return mat;
 }
 
 Rgb ShinyDiffuseMaterial::getDiffuseColor(const RenderData &render_data) const {
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 	if(is_diffuse_) return (diffuse_refl_shader_ ? diffuse_refl_shader_->getScalar(stack) : diffuse_strength_) * (diffuse_shader_ ? diffuse_shader_->getColor(stack) : diffuse_color_);
 	else return Rgb(0.f);
 }
 
 Rgb ShinyDiffuseMaterial::getGlossyColor(const RenderData &render_data) const {
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 	if(is_mirror_) return (mirror_shader_ ? mirror_shader_->getScalar(stack) : mirror_strength_) * (mirror_color_shader_ ? mirror_color_shader_->getColor(stack) : mirror_color_);
 	else return Rgb(0.f);
 }
 
 Rgb ShinyDiffuseMaterial::getTransColor(const RenderData &render_data) const {
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 	if(is_transparent_) return (transparency_shader_ ? transparency_shader_->getScalar(stack) : transparency_strength_) * (diffuse_shader_ ? diffuse_shader_->getColor(stack) : diffuse_color_);
 	else return Rgb(0.f);
 }
 
 Rgb ShinyDiffuseMaterial::getMirrorColor(const RenderData &render_data) const {
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 	if(is_mirror_) return (mirror_shader_ ? mirror_shader_->getScalar(stack) : mirror_strength_) * (mirror_color_shader_ ? mirror_color_shader_->getColor(stack) : mirror_color_);
 	else return Rgb(0.f);
 }
 
 Rgb ShinyDiffuseMaterial::getSubSurfaceColor(const RenderData &render_data) const {
-	const SdDat *dat = (SdDat *)render_data.arena_;
+	const SdDat *dat = (SdDat *)render_data.material_data_;
 	const NodeStack stack(dat->node_stack_);
 	if(is_translucent_) return (translucency_shader_ ? translucency_shader_->getScalar(stack) : translucency_strength_) * (diffuse_shader_ ? diffuse_shader_->getColor(stack) : diffuse_color_);
 	else return Rgb(0.f);
@@ -0,0 +1,113 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "material/microfacet_albedo.h"
+#include "math/math.h"
+#include "geometry/vector.h"
+#include "color/color.h"
+#include "material/material_utils_microfacet.h"
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+constexpr int BlinnAlbedoTable::cos_size_;
+constexpr int BlinnAlbedoTable::exponent_size_;
+constexpr float BlinnAlbedoTable::max_exponent_;
+
+const BlinnAlbedoTable &BlinnAlbedoTable::get()
+{
+	static const BlinnAlbedoTable table;
+	return table;
+}
+
+float BlinnAlbedoTable::exponentCoordinate(float exponent)
+{
+	return 1.f - std::min(1.f, std::max(0.f, std::log(1.f + exponent) / std::log(1.f + max_exponent_)));
+}
+
+BlinnAlbedoTable::BlinnAlbedoTable()
+{
+	//Stratified importance sampling of the half vector with the lobe distribution. With the pdf of the sampled incident direction, D(h) / (8 pi (cos(wo, h) + ...)), the estimator
+	//of the albedo only depends on the cosines, see GlossyMaterial::eval
+	constexpr int strata = 32;
+	for(int e = 0; e < exponent_size_; ++e)
+	{
+		const float exponent = std::pow(1.f + max_exponent_, 1.f - static_cast<float>(e) / (exponent_size_ - 1)) - 1.f;
+		for(int c = 0; c < cos_size_; ++c)
+		{
+			const float cos_wo = std::max(0.001f, static_cast<float>(c) / (cos_size_ - 1));
+			const Vec3 wo(std::sqrt(1.f - cos_wo * cos_wo), 0.f, cos_wo);
+			double sum = 0.0;
+			for(int i = 0; i < strata; ++i)
+			{
+				for(int j = 0; j < strata; ++j)
+				{
+					Vec3 h;
+					blinnSample_global(h, (i + 0.5f) / strata, (j + 0.5f) / strata, exponent);
+					const float cos_wo_h = wo * h;
+					if(cos_wo_h <= 0.f) continue;
+					const Vec3 wi = 2.f * cos_wo_h * h - wo;
+					const float cos_wi = wi.z_;
+					if(cos_wi <= 0.f) continue;
+					sum += cos_wi * cos_wo_h / (cos_wo_h * std::max(cos_wi, cos_wo) * 0.99f + 0.04f);
+				}
+			}
+			albedo_[e * cos_size_ + c] = std::min(1.f, static_cast<float>(sum / (strata * strata)));
+		}
+		double average = 0.0;
+		for(int c = 0; c < cos_size_; ++c)
+		{
+			const float trapezoid_weight = (c == 0 || c == cos_size_ - 1) ? 0.5f : 1.f;
+			average += trapezoid_weight * albedo_[e * cos_size_ + c] * static_cast<float>(c) / (cos_size_ - 1);
+		}
+		average_albedo_[e] = std::min(1.f, static_cast<float>(2.0 * average / (cos_size_ - 1)));
+	}
+}
+
+float BlinnAlbedoTable::albedo(float cos_theta, float exponent) const
+{
+	const float x = std::min(1.f, std::max(0.f, cos_theta)) * (cos_size_ - 1);
+	const float y = exponentCoordinate(exponent) * (exponent_size_ - 1);
+	const int x_0 = std::min(static_cast<int>(x), cos_size_ - 2);
+	const int y_0 = std::min(static_cast<int>(y), exponent_size_ - 2);
+	const float dx = x - x_0;
+	const float dy = y - y_0;
+	const float *row_0 = &albedo_[y_0 * cos_size_ + x_0];
+	const float *row_1 = row_0 + cos_size_;
+	return (row_0[0] * (1.f - dx) + row_0[1] * dx) * (1.f - dy) + (row_1[0] * (1.f - dx) + row_1[1] * dx) * dy;
+}
+
+float BlinnAlbedoTable::averageAlbedo(float exponent) const
+{
+	const float y = exponentCoordinate(exponent) * (exponent_size_ - 1);
+	const int y_0 = std::min(static_cast<int>(y), exponent_size_ - 2);
+	const float dy = y - y_0;
+	return average_albedo_[y_0] * (1.f - dy) + average_albedo_[y_0 + 1] * dy;
+}
+
+float BlinnAlbedoTable::multipleScattering(float cos_wo, float cos_wi, float exponent, float reflectance) const
+{
+	const float average_albedo = averageAlbedo(exponent);
+	if(average_albedo >= 0.999f) return 0.f;
+	const float lobe = (1.f - albedo(cos_wo, exponent)) * (1.f - albedo(cos_wi, exponent)) / (M_PI * (1.f - average_albedo));
+	//The energy lost by the bounces between the microfacets is tinted by the average Fresnel, which for the Schlick approximation is r + (1 - r) / 21
+	const float average_fresnel = reflectance + (1.f - reflectance) / 21.f;
+	return lobe * average_fresnel * average_fresnel * average_albedo / (1.f - average_fresnel * (1.f - average_albedo));
+}
+
+END_YAFARAY
@@ -21,6 +21,9 @@
 #include "output/output_image.h"
 #include "output/output_memory.h"
 #include "output/output_debug.h"
+#ifdef HAVE_OPENEXR
+#include "output/output_exr_stream.h"
+#endif // HAVE_OPENEXR
 #include "color/color_layers.h"
 #include "scene/scene.h"
 #include "common/logger.h"
@@ -40,6 +43,9 @@ UniquePtr_t<ColorOutput> ColorOutput::factory(const ParamMap &params, const Scen
 	if(type == "image_output") return ImageOutput::factory(params, scene);
 	else if(type == "memory_output") return MemoryInputOutput::factory(params, scene);
 	else if(type == "debug_output") return DebugOutput::factory(params, scene);
+#ifdef HAVE_OPENEXR
+	else if(type == "exr_stream_output") return ExrStreamOutput::factory(params, scene);
+#endif // HAVE_OPENEXR
 	else return nullptr;
 }
 
@@ -76,6 +82,44 @@ bool ColorOutput::putPixel(int x, int y, const ColorLayers &color_layers)
 	return true;
 }
 
+bool ColorOutput::putTile(int x_0, int y_0, int width, int height, const std::vector<ColorLayerTile> &color_layers_tiles)
+{
+	preprocessed_tile_colors_.resize(static_cast<size_t>(width) * height);
+	for(const auto &color_layer_tile : color_layers_tiles)
+	{
+		ColorLayer color_layer;
+		color_layer.layer_type_ = color_layer_tile.layer_type_;
+		for(int j = 0; j < height; ++j)
+		{
+			const Rgba *colors = color_layer_tile.colors_ + static_cast<size_t>(j) * color_layer_tile.row_stride_;
+			Rgba *preprocessed_colors = &preprocessed_tile_colors_[static_cast<size_t>(j) * width];
+			for(int i = 0; i < width; ++i)
+			{
+				color_layer.color_ = colors[i];
+				preprocessed_colors[i] = preProcessColor(color_layer).color_;
+			}
+		}
+		if(!putTile(x_0, y_0, width, height, ColorLayerTile(color_layer_tile.layer_type_, preprocessed_tile_colors_.data(), width))) return false;
+	}
+	return true;
+}
+
+bool ColorOutput::putTile(int x_0, int y_0, int width, int height, const ColorLayerTile &color_layer_tile)
+{
+	ColorLayer color_layer;
+	color_layer.layer_type_ = color_layer_tile.layer_type_;
+	for(int j = 0; j < height; ++j)
+	{
+		const Rgba *colors = color_layer_tile.colors_ + static_cast<size_t>(j) * color_layer_tile.row_stride_;
+		for(int i = 0; i < width; ++i)
+		{
+			color_layer.color_ = colors[i];
+			if(!putPixel(x_0 + i, y_0 + j, color_layer)) return false;
+		}
+	}
+	return true;
+}
+
 ColorLayer ColorOutput::preProcessColor(const ColorLayer &color_layer)
 {
 	ColorLayer result = color_layer;
@@ -0,0 +1,209 @@
+/****************************************************************************
+ *
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifdef HAVE_OPENEXR
+
+#include "output/output_exr_stream.h"
+#include "format/format_exr.h"
+#include "color/color_layers.h"
+#include "common/logger.h"
+#include "common/file.h"
+#include "common/param.h"
+#include "render/render_view.h"
+
+BEGIN_YAFARAY
+
+UniquePtr_t<ColorOutput> ExrStreamOutput::factory(const ParamMap &params, const Scene &scene)
+{
+	std::string name;
+	std::string image_path;
+	int tile_size = 64;
+	std::string color_space_str = "LinearRGB";
+	float gamma = 1.f;
+	bool with_alpha = true;
+	bool alpha_premultiply = false;
+
+	params.getParam("name", name);
+	params.getParam("image_path", image_path);
+	params.getParam("tile_size", tile_size);
+	params.getParam("color_space", color_space_str);
+	params.getParam("gamma", gamma);
+	params.getParam("alpha_channel", with_alpha);
+	params.getParam("alpha_premultiply", alpha_premultiply);
+
+	const ColorSpace color_space = Rgb::colorSpaceFromName(color_space_str);
+	return UniquePtr_t<ColorOutput>(new ExrStreamOutput(image_path, std::max(8, tile_size), name, color_space, gamma, with_alpha, alpha_premultiply));
+}
+
+ExrStreamOutput::ExrStreamOutput(const std::string &image_path, int tile_size, const std::string &name, const ColorSpace color_space, float gamma, bool with_alpha, bool alpha_premultiply) : ColorOutput(name, color_space, gamma, with_alpha, alpha_premultiply), image_path_(image_path), tile_size_(tile_size)
+{
+	//Empty
+}
+
+ExrStreamOutput::~ExrStreamOutput()
+{
+	closeFile();
+}
+
+void ExrStreamOutput::init(int width, int height, const Layers *layers, const std::map<std::string, std::unique_ptr<RenderView>> *render_views)
+{
+	closeFile();
+	ColorOutput::init(width, height, layers, render_views);
+	layer_types_.clear();
+	for(const auto &it : layers_->getLayersWithExportedImages()) layer_types_.push_back(it.first);
+}
+
+bool ExrStreamOutput::openFile()
+{
+	closeFile();
+	file_render_view_ = current_render_view_;
+	std::string file_path = image_path_;
+	const std::string view_name = current_render_view_ ? current_render_view_->getName() : "";
+	if(!view_name.empty())
+	{
+		const Path path(image_path_);
+		file_path = Path(path.getDirectory(), path.getBaseName() + " (view " + view_name + ")", path.getExtension()).getFullPath();
+	}
+	std::vector<std::string> layer_names;
+	for(const auto &layer_type : layer_types_)
+	{
+		std::string layer_name = Layer::getTypeName(layer_type);
+		const std::string exported_image_name = layers_->find(layer_type) ? layers_->find(layer_type)->getExportedImageName() : "";
+		if(!exported_image_name.empty()) layer_name += "-" + exported_image_name;
+		layer_names.push_back("RenderLayer." + layer_name);
+	}
+	Y_INFO << name_ << ": Streaming the render tiles to the file \"" << file_path << "\"" << YENDL;
+	writer_ = std::unique_ptr<ExrTiledWriter>(new ExrTiledWriter(file_path, width_, height_, tile_size_, layer_names));
+	if(!writer_->isOpen())
+	{
+		writer_ = nullptr;
+		return false;
+	}
+	written_tiles_.assign(writer_->getNumTilesX() * writer_->getNumTilesY(), false);
+	pending_tiles_.clear();
+	return true;
+}
+
+void ExrStreamOutput::closeFile()
+{
+	if(!writer_) return;
+	//The tiles not written yet are written with the colors put so far, all the tiles of a tiled EXR must be written
+	for(size_t tile_index = 0; tile_index < written_tiles_.size(); ++tile_index)
+	{
+		if(written_tiles_[tile_index]) continue;
+		const auto pending_tile = pending_tiles_.find(static_cast<int>(tile_index));
+		writeTile(static_cast<int>(tile_index), pending_tile != pending_tiles_.end() ? &pending_tile->second : nullptr);
+	}
+	pending_tiles_.clear();
+	written_tiles_.clear();
+	writer_ = nullptr;
+	file_render_view_ = nullptr;
+}
+
+ExrStreamOutput::PendingTile &ExrStreamOutput::getPendingTile(int tile_index)
+{
+	auto it = pending_tiles_.find(tile_index);
+	if(it != pending_tiles_.end()) return it->second;
+	PendingTile &pending_tile = pending_tiles_[tile_index];
+	const size_t tile_pixels = static_cast<size_t>(tile_size_) * tile_size_;
+	pending_tile.colors_.resize(tile_pixels * layer_types_.size());
+	for(size_t layer = 0; layer < layer_types_.size(); ++layer) std::fill_n(pending_tile.colors_.begin() + layer * tile_pixels, tile_pixels, Layer::getDefaultColor(layer_types_[layer]));
+	pending_tile.final_pixels_.assign(tile_pixels * layer_types_.size(), false);
+	return pending_tile;
+}
+
+bool ExrStreamOutput::writeTile(int tile_index, const PendingTile *pending_tile)
+{
+	written_tiles_[tile_index] = true;
+	const size_t tile_pixels = static_cast<size_t>(tile_size_) * tile_size_;
+	std::vector<Rgba> default_colors;
+	std::vector<const Rgba *> layers_colors;
+	if(!pending_tile)
+	{
+		default_colors.resize(tile_pixels * layer_types_.size());
+		for(size_t layer = 0; layer < layer_types_.size(); ++layer) std::fill_n(default_colors.begin() + layer * tile_pixels, tile_pixels, Layer::getDefaultColor(layer_types_[layer]));
+	}
+	const Rgba *colors = pending_tile ? pending_tile->colors_.data() : default_colors.data();
+	for(size_t layer = 0; layer < layer_types_.size(); ++layer) layers_colors.push_back(colors + layer * tile_pixels);
+	const int num_tiles_x = writer_->getNumTilesX();
+	return writer_->writeTile(tile_index % num_tiles_x, tile_index / num_tiles_x, layers_colors);
+}
+
+bool ExrStreamOutput::putPixel(int x, int y, const ColorLayer &color_layer)
+{
+	return putTile(x, y, 1, 1, ColorLayerTile(color_layer.layer_type_, &color_layer.color_, 1));
+}
+
+bool ExrStreamOutput::putTile(int x_0, int y_0, int width, int height, const ColorLayerTile &color_layer_tile)
+{
+	const auto layer_it = std::find(layer_types_.begin(), layer_types_.end(), color_layer_tile.layer_type_);
+	if(layer_it == layer_types_.end()) return true;
+	const size_t layer = layer_it - layer_types_.begin();
+	if((!writer_ || file_render_view_ != current_render_view_) && !openFile()) return false;
+
+	const size_t tile_pixels = static_cast<size_t>(tile_size_) * tile_size_;
+	const int num_tiles_x = writer_->getNumTilesX();
+	bool result = true;
+	for(int tile_y = y_0 / tile_size_; tile_y <= (y_0 + height - 1) / tile_size_; ++tile_y)
+	{
+		for(int tile_x = x_0 / tile_size_; tile_x <= (x_0 + width - 1) / tile_size_; ++tile_x)
+		{
+			const int tile_index = tile_y * num_tiles_x + tile_x;
+			if(written_tiles_[tile_index]) continue; //already final, the colors put again by the flush of the film are the same
+			PendingTile &pending_tile = getPendingTile(tile_index);
+			const int i_0 = std::max(x_0, tile_x * tile_size_), i_1 = std::min(x_0 + width, (tile_x + 1) * tile_size_);
+			const int j_0 = std::max(y_0, tile_y * tile_size_), j_1 = std::min(y_0 + height, (tile_y + 1) * tile_size_);
+			for(int j = j_0; j < j_1; ++j)
+			{
+				const Rgba *colors = color_layer_tile.colors_ + static_cast<size_t>(j - y_0) * color_layer_tile.row_stride_;
+				const size_t row_index = layer * tile_pixels + static_cast<size_t>(j - tile_y * tile_size_) * tile_size_;
+				for(int i = i_0; i < i_1; ++i)
+				{
+					const size_t index = row_index + (i - tile_x * tile_size_);
+					Rgba color = colors[i - x_0];
+					if(!with_alpha_) color.a_ = 1.f;
+					pending_tile.colors_[index] = color;
+					if(final_areas_ && !pending_tile.final_pixels_[index])
+					{
+						pending_tile.final_pixels_[index] = true;
+						++pending_tile.num_final_pixels_;
+					}
+				}
+			}
+			if(pending_tile.num_final_pixels_ == static_cast<size_t>(getTileWidth(tile_x)) * getTileHeight(tile_y) * layer_types_.size())
+			{
+				if(!writeTile(tile_index, &pending_tile)) result = false;
+				pending_tiles_.erase(tile_index);
+			}
+		}
+	}
+	return result;
+}
+
+void ExrStreamOutput::flush(const RenderControl &render_control)
+{
+	if(!writer_) return;
+	Y_INFO << name_ << ": Writing the " << pending_tiles_.size() << " pending tiles and closing the streamed EXR file" << YENDL;
+	closeFile();
+}
+
+END_YAFARAY
+
+#endif // HAVE_OPENEXR
@@ -28,6 +28,9 @@
 #include "image/image_layers.h"
 #include "render/render_view.h"
 #include "scene/scene.h"
+#include "common/sysinfo.h"
+#include "common/task_pool.h"
+#include <algorithm>
 
 BEGIN_YAFARAY
 
@@ -111,6 +114,20 @@ bool ImageOutput::putPixel(int x, int y, const ColorLayer &color_layer)
 	else return false;
 }
 
+bool ImageOutput::putTile(int x_0, int y_0, int width, int height, const ColorLayerTile &color_layer_tile)
+{
+	if(!image_layers_) return false;
+	ImageLayer *image_layer = image_layers_->find(color_layer_tile.layer_type_);
+	if(!image_layer) return true;
+	Image *image = image_layer->image_.get();
+	for(int j = 0; j < height; ++j)
+	{
+		const Rgba *colors = color_layer_tile.colors_ + static_cast<size_t>(j) * color_layer_tile.row_stride_;
+		for(int i = 0; i < width; ++i) image->setColor(x_0 + i + border_x_, y_0 + j + border_y_, colors[i]);
+	}
+	return true;
+}
+
 void ImageOutput::flush(const RenderControl &render_control)
 {
 	Path path(image_path_);
@@ -126,29 +143,29 @@ void ImageOutput::flush(const RenderControl &render_control)
 	
 	if(format)
 	{
+		//The badge is drawn once for all the files, which are then encoded in parallel, each one with its own format handler
+		const std::unique_ptr<Image> badge_image = (badge_.getPosition() != Badge::Position::None) ? generateBadgeImage(render_control) : nullptr;
+		std::vector<std::pair<std::string, Layer::Type>> files; //!< file name and layer of each single layer file
+		if(!directory.empty()) directory += "/";
+		std::string multi_layer_file_name;
 		if(multi_layer_ && format->supportsMultiLayer())
 		{
 			if(view_name == current_render_view_->getName())
 			{
-				saveImageFile(image_path_, Layer::Combined, format.get(), render_control); //This should not be necessary but Blender API seems to be limited and the API "load_from_file" function does not work (yet) with multilayered images, so I have to generate this extra combined pass file so it's displayed in the Blender window.
+				files.emplace_back(image_path_, Layer::Combined); //This should not be necessary but Blender API seems to be limited and the API "load_from_file" function does not work (yet) with multilayered images, so I have to generate this extra combined pass file so it's displayed in the Blender window.
 			}
-
-			if(!directory.empty()) directory += "/";
-			const std::string fname_pass = directory + base_name + " (" + "multilayer" + ")." + ext;
-			saveImageFileMultiChannel(fname_pass, format.get(), render_control);
-
-			logger_global.setImagePath(fname_pass); //to show the image in the HTML log output
+			multi_layer_file_name = directory + base_name + " (" + "multilayer" + ")." + ext;
+			logger_global.setImagePath(multi_layer_file_name); //to show the image in the HTML log output
 		}
 		else
 		{
-			if(!directory.empty()) directory += "/";
 			for(const auto &image_layer : *image_layers_)
 			{
 				const Layer::Type layer_type = image_layer.first;
 				const std::string exported_image_name = image_layer.second.layer_.getExportedImageName();
 				if(layer_type == Layer::Combined)
 				{
-					saveImageFile(image_path_, layer_type, format.get(), render_control); //default imagehandler filename, when not using views nor passes and for reloading into Blender
+					files.emplace_back(image_path_, layer_type); //default imagehandler filename, when not using views nor passes and for reloading into Blender
 					logger_global.setImagePath(image_path_); //to show the image in the HTML log output
 				}
 
@@ -158,10 +175,33 @@ void ImageOutput::flush(const RenderControl &render_control)
 					std::string fname_pass = directory + base_name + " [" + layer_type_name;
 					if(!exported_image_name.empty()) fname_pass += " - " + exported_image_name;
 					fname_pass += "]." + ext;
-					saveImageFile(fname_pass, layer_type, format.get(), render_control);
+					files.emplace_back(fname_pass, layer_type);
 				}
 			}
 		}
+
+		const int num_files = static_cast<int>(files.size()) + (multi_layer_file_name.empty() ? 0 : 1);
+		TaskPool task_pool(std::max(1, std::min(num_files, SysInfo().getNumSystemThreads())));
+		TaskPool::Group task_group(task_pool);
+		for(const auto &file : files)
+		{
+			task_group.run([this, &file, &params, &badge_image, &render_control]()
+			{
+				ParamMap format_params = params;
+				const std::unique_ptr<Format> file_format = Format::factory(format_params);
+				if(file_format) saveImageFile(file.first, file.second, file_format.get(), render_control, badge_image.get());
+			});
+		}
+		if(!multi_layer_file_name.empty())
+		{
+			task_group.run([this, &multi_layer_file_name, &params, &badge_image, &render_control]()
+			{
+				ParamMap format_params = params;
+				const std::unique_ptr<Format> file_format = Format::factory(format_params);
+				if(file_format) saveImageFileMultiChannel(multi_layer_file_name, file_format.get(), render_control, badge_image.get());
+			});
+		}
+		task_group.wait();
 	}
 	if(save_log_txt_)
 	{
@@ -180,7 +220,7 @@ void ImageOutput::flush(const RenderControl &render_control)
 	}
 }
 
-void ImageOutput::saveImageFile(const std::string &filename, const Layer::Type &layer_type, Format *format, const RenderControl &render_control)
+void ImageOutput::saveImageFile(const std::string &filename, const Layer::Type &layer_type, Format *format, const RenderControl &render_control, const Image *badge_image)
 {
 	if(render_control.inProgress()) Y_INFO << name_ << ": Autosaving partial render (" << math::roundFloatPrecision(render_control.currentPassPercent(), 0.01) << "% of pass " << render_control.currentPass() << " of " << render_control.totalPasses() << ") file as \"" << filename << "\"...  " << printDenoiseParams() << YENDL;
 	else Y_INFO << name_ << ": Saving file as \"" << filename << "\"...  " << printDenoiseParams() << YENDL;
@@ -193,12 +233,11 @@ void ImageOutput::saveImageFile(const std::string &filename, const Layer::Type &
 		return;
 	}
 
-	if(badge_.getPosition() != Badge::Position::None)
+	if(badge_image)
 	{
-		const std::unique_ptr<Image> badge_image = generateBadgeImage(render_control);
 		Image::Position badge_image_position = Image::Position::Bottom;
 		if(badge_.getPosition() == Badge::Position::Top) badge_image_position = Image::Position::Top;
-		image = Image::getComposedImage(image.get(), badge_image.get(), badge_image_position);
+		image = Image::getComposedImage(image.get(), badge_image, badge_image_position);
 		if(!image)
 		{
 			Y_WARNING << name_ << ": Image could not be composed with badge and could not be saved." << YENDL;
@@ -244,17 +283,16 @@ void ImageOutput::saveImageFile(const std::string &filename, const Layer::Type &
 	}
 }
 
-void ImageOutput::saveImageFileMultiChannel(const std::string &filename, Format *format, const RenderControl &render_control)
+void ImageOutput::saveImageFileMultiChannel(const std::string &filename, Format *format, const RenderControl &render_control, const Image *badge_image)
 {
-	if(badge_.getPosition() != Badge::Position::None)
+	if(badge_image)
 	{
-		std::unique_ptr<Image> badge_image = generateBadgeImage(render_control);
 		Image::Position badge_image_position = Image::Position::Bottom;
 		if(badge_.getPosition() == Badge::Position::Top) badge_image_position = Image::Position::Top;
 		ImageLayers image_layers_badge;
 		for(const auto &image_layer : *image_layers_)
 		{
-			std::unique_ptr<Image> image_layer_badge = Image::getComposedImage(image_layer.second.image_.get(), badge_image.get(), badge_image_position);
+			std::unique_ptr<Image> image_layer_badge = Image::getComposedImage(image_layer.second.image_.get(), badge_image, badge_image_position);
 			image_layers_badge.set(image_layer.first, {std::move(image_layer_badge), image_layer.second.layer_});
 		}
 		format->saveToFileMultiChannel(filename, &image_layers_badge);
@@ -21,6 +21,7 @@
 #include "color/color_layers.h"
 #include "common/param.h"
 #include "scene/scene.h"
+#include <cstring>
 
 BEGIN_YAFARAY
 
@@ -56,6 +57,17 @@ bool MemoryInputOutput::putPixel(int x, int y, const ColorLayer &color_layer)
 	return true;
 }
 
+bool MemoryInputOutput::putTile(int x_0, int y_0, int width, int height, const ColorLayerTile &color_layer_tile)
+{
+	static_assert(sizeof(Rgba) == 4 * sizeof(float), "Rgba is expected to be stored as 4 contiguous floats");
+	for(int j = 0; j < height; ++j)
+	{
+		const Rgba *colors = color_layer_tile.colors_ + static_cast<size_t>(j) * color_layer_tile.row_stride_;
+		std::memcpy(&image_mem_[(x_0 + width_ * (y_0 + j)) * 4], colors, width * sizeof(Rgba));
+	}
+	return true;
+}
+
 void MemoryInputOutput::flush(const RenderControl &render_control) { }
 
 END_YAFARAY
@@ -18,9 +18,26 @@
 
 #include "photon/hashgrid.h"
 #include "photon/photon.h"
+#include <atomic>
+#include <thread>
+#include <functional>
 
 BEGIN_YAFARAY
 
+//! Splits [0, size) in one contiguous range per thread and calls the function for each range in its own thread
+static void parallelRanges_global(size_t size, int num_threads, const std::function<void(size_t, size_t)> &function)
+{
+	const size_t num_ranges = std::max(static_cast<size_t>(1), std::min(static_cast<size_t>(num_threads), size / 4096));
+	if(num_ranges == 1)
+	{
+		function(0, size);
+		return;
+	}
+	std::vector<std::thread> threads;
+	for(size_t i = 0; i < num_ranges; ++i) threads.push_back(std::thread(function, size * i / num_ranges, size * (i + 1) / num_ranges));
+	for(auto &t : threads) t.join();
+}
+
 HashGrid::HashGrid(double cell_size, unsigned int grid_size, yafaray4::Bound b_box)
 	: cell_size_(cell_size), grid_size_(grid_size), bounding_box_(b_box)
 {
@@ -29,7 +46,7 @@ HashGrid::HashGrid(double cell_size, unsigned int grid_size, yafaray4::Bound b_b
 
 void HashGrid::setParm(double cell_size, unsigned int grid_size, Bound b_box)
 {
-	cell_size = cell_size;
+	cell_size_ = cell_size;
 	inv_cell_size_ = 1. / cell_size;
 	grid_size_ = grid_size;
 	bounding_box_ = b_box;
@@ -38,6 +55,8 @@ void HashGrid::setParm(double cell_size, unsigned int grid_size, Bound b_box)
 void HashGrid::clear()
 {
 	photons_.clear();
+	cell_starts_.clear();
+	memory_tracker_.set(0);
 }
 
 void HashGrid::pushPhoton(Photon &p)
@@ -45,56 +64,86 @@ void HashGrid::pushPhoton(Photon &p)
 	photons_.push_back(p);
 }
 
+inline unsigned int HashGrid::cellIndex(const Point3 &p)
+{
+	const Point3 hashindex = (p - bounding_box_.a_) * inv_cell_size_;
+	return hash(std::abs(static_cast<int>(hashindex.x_)), std::abs(static_cast<int>(hashindex.y_)), std::abs(static_cast<int>(hashindex.z_)));
+}
 
-void HashGrid::updateGrid()
+void HashGrid::updateGrid(int num_threads)
 {
+	const size_t num_photons = photons_.size();
+	if(grid_size_ == 0) grid_size_ = 1;
 
-	if(!hash_grid_)
+	//Counting sort of the photons by cell: count the photons of each cell, compute the cell offsets and scatter the photons to them
+	std::vector<unsigned int> photon_cells(num_photons);
+	std::unique_ptr<std::atomic<unsigned int>[]> cell_counts(new std::atomic<unsigned int>[grid_size_]);
+	parallelRanges_global(grid_size_, num_threads, [&](size_t begin, size_t end)
 	{
-		hash_grid_ = std::unique_ptr<std::unique_ptr<std::list<const Photon *>>[]>(new std::unique_ptr<std::list<const Photon *>>[grid_size_]);
-
-		for(unsigned int i = 0; i < grid_size_; ++i)
+		for(size_t i = begin; i < end; ++i) cell_counts[i].store(0, std::memory_order_relaxed);
+	});
+	parallelRanges_global(num_photons, num_threads, [&](size_t begin, size_t end)
+	{
+		for(size_t i = begin; i < end; ++i)
 		{
-			hash_grid_[i] = nullptr;
+			photon_cells[i] = cellIndex(photons_[i].pos_);
+			cell_counts[photon_cells[i]].fetch_add(1, std::memory_order_relaxed);
 		}
-	}
-	else
+	});
+
+	//Prefix sum in two passes over one block of cells per thread: the sums of the blocks first, then the offsets within each block
+	cell_starts_.resize(grid_size_ + 1);
+	const size_t num_blocks = std::max(1, num_threads);
+	std::vector<unsigned int> block_starts(num_blocks + 1, 0);
+	auto block_begin = [&](size_t block) { return grid_size_ * block / num_blocks; };
+	parallelRanges_global(num_blocks, num_threads, [&](size_t begin, size_t end)
 	{
-		for(unsigned int i = 0; i < grid_size_; ++i)
+		for(size_t block = begin; block < end; ++block)
 		{
-			if(hash_grid_[i])
+			unsigned int sum = 0;
+			for(size_t i = block_begin(block); i < block_begin(block + 1); ++i) sum += cell_counts[i].load(std::memory_order_relaxed);
+			block_starts[block + 1] = sum;
+		}
+	});
+	for(size_t block = 0; block < num_blocks; ++block) block_starts[block + 1] += block_starts[block];
+	parallelRanges_global(num_blocks, num_threads, [&](size_t begin, size_t end)
+	{
+		for(size_t block = begin; block < end; ++block)
+		{
+			unsigned int start = block_starts[block];
+			for(size_t i = block_begin(block); i < block_begin(block + 1); ++i)
 			{
-				hash_grid_[i]->clear(); // fix me! too many time consumed here
+				cell_starts_[i] = start;
+				start += cell_counts[i].load(std::memory_order_relaxed);
+				cell_counts[i].store(cell_starts_[i], std::memory_order_relaxed); //the counts become the insertion positions of the scatter
 			}
 		}
-	}
+	});
+	cell_starts_[grid_size_] = static_cast<unsigned int>(num_photons);
 
-	//travel the vector to build the Grid
-	for(auto itr = photons_.begin(); itr != photons_.end(); ++itr)
+	std::vector<Photon> sorted_photons(num_photons);
+	parallelRanges_global(num_photons, num_threads, [&](size_t begin, size_t end)
 	{
-		Point3 hashindex  = ((*itr).pos_ - bounding_box_.a_) * inv_cell_size_;
-
-		int ix = abs(int(hashindex.x_));
-		int iy = abs(int(hashindex.y_));
-		int iz = abs(int(hashindex.z_));
-
-		unsigned int index = hash(ix, iy, iz);
-
-		if(!hash_grid_[index]) hash_grid_[index] = std::unique_ptr<std::list<const Photon *>>(new std::list<const Photon *>());
+		for(size_t i = begin; i < end; ++i) sorted_photons[cell_counts[photon_cells[i]].fetch_add(1, std::memory_order_relaxed)] = photons_[i];
+	});
+	photons_.swap(sorted_photons);
 
-		hash_grid_[index]->push_front(&(*itr));
-	}
-	unsigned int notused = 0;
-	for(unsigned int i = 0; i < grid_size_; ++i)
+	if(Y_LOG_HAS_VERBOSE)
 	{
-		if(!hash_grid_[i] || hash_grid_[i]->size() == 0) notused++;
+		unsigned int notused = 0;
+		for(unsigned int i = 0; i < grid_size_; ++i)
+		{
+			if(cell_starts_[i] == cell_starts_[i + 1]) notused++;
+		}
+		Y_VERBOSE << "HashGrid: there are " << notused << " enties not used!" << YENDL;
 	}
-	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "HashGrid: there are " << notused << " enties not used!" << std::endl;
+	memory_tracker_.set(vectorMemory_global(photons_) + vectorMemory_global(cell_starts_));
 }
 
 unsigned int HashGrid::gather(const Point3 &p, FoundPhoton *found, unsigned int k, float sq_radius)
 {
 	unsigned int count = 0;
+	if(cell_starts_.empty()) return count;
 	float radius = math::sqrt(sq_radius);
 
 	Point3 rad(radius, radius, radius);
@@ -107,15 +156,13 @@ unsigned int HashGrid::gather(const Point3 &p, FoundPhoton *found, unsigned int
 		{
 			for(int ix = abs(int(b_min.x_)); ix <= abs(int(b_max.x_)); ix++)
 			{
-				int hv = hash(ix, iy, iz);
-
-				if(hash_grid_[hv] == nullptr) continue;
-
-				for(auto itr = hash_grid_[hv]->begin(); itr != hash_grid_[hv]->end(); ++itr)
+				const unsigned int hv = hash(ix, iy, iz);
+				const unsigned int cell_end = cell_starts_[hv + 1];
+				for(unsigned int i = cell_starts_[hv]; i < cell_end && count < k; ++i)
 				{
-					if(((*itr)->pos_ - p).lengthSqr() < sq_radius)
+					if((photons_[i].pos_ - p).lengthSqr() < sq_radius)
 					{
-						found[count++] = FoundPhoton((*itr), sq_radius);
+						found[count++] = FoundPhoton(&photons_[i], sq_radius);
 					}
 				}
 			}
@@ -124,4 +171,4 @@ unsigned int HashGrid::gather(const Point3 &p, FoundPhoton *found, unsigned int
 	return count;
 }
 
-END_YAFARAY
\ No newline at end of file
+END_YAFARAY
@@ -0,0 +1,140 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "photon/irradiance_cache.h"
+#include <cmath>
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+static constexpr int max_depth_global = 16;
+
+IrradianceCache::Node::~Node()
+{
+	for(auto &child : children_) delete child.load(std::memory_order_relaxed);
+	Entry *entry = entries_.load(std::memory_order_relaxed);
+	while(entry)
+	{
+		Entry *next = entry->next_;
+		delete entry;
+		entry = next;
+	}
+}
+
+IrradianceCache::IrradianceCache(const Bound &bound, float accuracy) : accuracy_(accuracy)
+{
+	//Slightly enlarged, so the points on the scene bound faces are inside
+	const Vec3 margin = (bound.g_ - bound.a_) * 0.001f + Vec3(1.0e-4f);
+	bound_.set(Point3(bound.a_.x_ - margin.x_, bound.a_.y_ - margin.y_, bound.a_.z_ - margin.z_), Point3(bound.g_.x_ + margin.x_, bound.g_.y_ + margin.y_, bound.g_.z_ + margin.z_));
+}
+
+IrradianceCache::~IrradianceCache()
+{
+	OwnedRecord *record = records_.load(std::memory_order_relaxed);
+	while(record)
+	{
+		OwnedRecord *next = record->next_;
+		delete record;
+		record = next;
+	}
+}
+
+Bound IrradianceCache::childBound(const Bound &bound, int child)
+{
+	const Point3 center((bound.a_.x_ + bound.g_.x_) * 0.5f, (bound.a_.y_ + bound.g_.y_) * 0.5f, (bound.a_.z_ + bound.g_.z_) * 0.5f);
+	return Bound(Point3((child & 1) ? center.x_ : bound.a_.x_, (child & 2) ? center.y_ : bound.a_.y_, (child & 4) ? center.z_ : bound.a_.z_),
+				 Point3((child & 1) ? bound.g_.x_ : center.x_, (child & 2) ? bound.g_.y_ : center.y_, (child & 4) ? bound.g_.z_ : center.z_));
+}
+
+void IrradianceCache::add(const Record &record)
+{
+	OwnedRecord *owned = new OwnedRecord { record, records_.load(std::memory_order_relaxed) };
+	while(!records_.compare_exchange_weak(owned->next_, owned, std::memory_order_release, std::memory_order_relaxed));
+
+	//Beyond this distance the estimated error of the record is above the accuracy even for the same normal
+	const float r = record.radius_ * accuracy_;
+	const Bound record_bound(Point3(record.p_.x_ - r, record.p_.y_ - r, record.p_.z_ - r), Point3(record.p_.x_ + r, record.p_.y_ + r, record.p_.z_ + r));
+	add(&root_, bound_, &owned->record_, record_bound, 12.f * r * r, 0);
+	num_records_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void IrradianceCache::add(Node *node, const Bound &node_bound, const Record *record, const Bound &record_bound, float record_diagonal_2, int depth)
+{
+	//The records are stored in all the nodes they overlap, at the first depth where the nodes are smaller than the records
+	if(depth == max_depth_global || (node_bound.g_ - node_bound.a_).lengthSqr() < record_diagonal_2)
+	{
+		Entry *entry = new Entry { record, node->entries_.load(std::memory_order_relaxed) };
+		while(!node->entries_.compare_exchange_weak(entry->next_, entry, std::memory_order_release, std::memory_order_relaxed));
+		return;
+	}
+	for(int i = 0; i < 8; ++i)
+	{
+		const Bound child_bound = childBound(node_bound, i);
+		if(child_bound.a_.x_ > record_bound.g_.x_ || child_bound.g_.x_ < record_bound.a_.x_ ||
+				child_bound.a_.y_ > record_bound.g_.y_ || child_bound.g_.y_ < record_bound.a_.y_ ||
+				child_bound.a_.z_ > record_bound.g_.z_ || child_bound.g_.z_ < record_bound.a_.z_) continue;
+		Node *child = node->children_[i].load(std::memory_order_acquire);
+		if(!child)
+		{
+			Node *new_child = new Node();
+			if(node->children_[i].compare_exchange_strong(child, new_child, std::memory_order_acq_rel)) child = new_child;
+			else delete new_child; //another thread created it first, child is now that one
+		}
+		add(child, child_bound, record, record_bound, record_diagonal_2, depth + 1);
+	}
+}
+
+bool IrradianceCache::interpolate(const Point3 &p, const Vec3 &n, Rgb &irradiance) const
+{
+	if(p.x_ < bound_.a_.x_ || p.x_ > bound_.g_.x_ || p.y_ < bound_.a_.y_ || p.y_ > bound_.g_.y_ || p.z_ < bound_.a_.z_ || p.z_ > bound_.g_.z_) return false;
+	Rgb sum(0.f);
+	float sum_weights = 0.f;
+	const float inv_accuracy = 1.f / accuracy_;
+	const Node *node = &root_;
+	Bound node_bound = bound_;
+	while(node)
+	{
+		for(const Entry *entry = node->entries_.load(std::memory_order_acquire); entry; entry = entry->next_)
+		{
+			const Record &record = *entry->record_;
+			const Vec3 d = p - record.p_;
+			//The records in front of the point do not see the same surroundings
+			if(d * (n + record.n_) * 0.5f < -0.01f * record.radius_) continue;
+			const float error = d.length() / record.radius_ + std::sqrt(std::max(0.f, 1.f - n * record.n_));
+			if(error >= accuracy_) continue;
+			//Ward's weight minus its value at the accuracy, so the records fade out before being discarded
+			const float weight = 1.f / std::max(error, 1.0e-6f) - inv_accuracy;
+			const Vec3 rotation = record.n_ ^ n;
+			Rgb record_irradiance = record.irradiance_;
+			record_irradiance += record.rotational_gradient_[0] * rotation.x_ + record.rotational_gradient_[1] * rotation.y_ + record.rotational_gradient_[2] * rotation.z_;
+			record_irradiance += record.translational_gradient_[0] * d.x_ + record.translational_gradient_[1] * d.y_ + record.translational_gradient_[2] * d.z_;
+			record_irradiance.clampRgb0();
+			sum += record_irradiance * weight;
+			sum_weights += weight;
+		}
+		const Point3 center((node_bound.a_.x_ + node_bound.g_.x_) * 0.5f, (node_bound.a_.y_ + node_bound.g_.y_) * 0.5f, (node_bound.a_.z_ + node_bound.g_.z_) * 0.5f);
+		const int child = (p.x_ > center.x_ ? 1 : 0) + (p.y_ > center.y_ ? 2 : 0) + (p.z_ > center.z_ ? 4 : 0);
+		node_bound = childBound(node_bound, child);
+		node = node->children_[child].load(std::memory_order_acquire);
+	}
+	if(sum_weights <= 0.f) return false;
+	irradiance = sum / sum_weights;
+	return true;
+}
+
+END_YAFARAY
@@ -18,43 +18,108 @@
 
 #include "photon/photon.h"
 #include "common/file.h"
+#include <thread>
+#include <cstring>
+#include <algorithm>
 
 BEGIN_YAFARAY
 
-PhotonGather::PhotonGather(uint32_t mp, const Point3 &p): p_(p)
+static constexpr char file_id_v2_global[16] = "YAF_PHOTONMAPv2";
+static constexpr uint32_t file_byte_order_global = 0x01020304;
+static constexpr uint64_t file_alignment_global = 64; //!< of the file sections, for the cache lines
+static constexpr size_t file_photons_chunk_global = 1 << 20; //!< photons quantized at once when saving
+static constexpr float gather_radius_margin_global = 2.f; //!< enlargement of the estimated square radius of the photon gathers
+static constexpr size_t gather_buffer_ratio_global = 2; //!< size of the photon gather buffer relative to the number of photons looked up
+
+/*! Header of the version 2 files. The file sections are at the offsets in the header, aligned so they can be used directly
+	from a memory mapping of the file. The file is only valid in platforms with the same byte order */
+struct PhotonMapFileHeader
+{
+	char id_[16];
+	uint32_t byte_order_;
+	uint32_t header_size_;
+	int32_t paths_;
+	float search_radius_;
+	uint32_t num_photons_;
+	uint32_t num_nodes_;
+	float bound_[6];
+	uint64_t nodes_offset_;
+	uint64_t leaf_positions_offset_[3];
+	uint64_t photons_offset_;
+	uint64_t file_size_;
+};
+
+//! Photon quantized for the version 2 files, stored in the order of the tree leaves, whose positions are also those of the photons
+struct PackedPhoton
+{
+	unsigned char rgbe_[4];
+	unsigned char theta_, phi_;
+	unsigned char padding_[2];
+};
+
+static_assert(sizeof(kdtree::KdNode) == 8, "The photon map files store the kd-tree nodes as they are in memory");
+static_assert(sizeof(PackedPhoton) == 8, "Unexpected packed photon size");
+
+static uint64_t alignFileOffset_global(uint64_t offset)
+{
+	return (offset + file_alignment_global - 1) / file_alignment_global * file_alignment_global;
+}
+
+void PhotonMap::clear()
+{
+	photons_.clear();
+	photon_paths_.clear();
+	path_objects_.clear();
+	tree_ = nullptr;
+	mapped_file_ = nullptr;
+	updated_ = false;
+	updateMemoryTracker();
+}
+
+void PhotonMap::updateMemoryTracker()
+{
+	memory_tracker_.set(vectorMemory_global(photons_) + vectorMemory_global(photon_paths_) + vectorMemory_global(path_objects_) + (tree_ ? tree_->getMemorySize() : 0));
+}
+
+PhotonGather::PhotonGather(uint32_t mp, const Point3 &p, FoundPhoton *photons, uint32_t capacity): p_(p), photons_(photons), n_lookup_(mp), capacity_(capacity)
 {
-	photons_ = 0;
-	n_lookup_ = mp;
 	found_photons_ = 0;
 }
 
 void PhotonGather::operator()(const Photon *photon, float dist_2, float &max_dist_squared) const
 {
-	// Do usual photon heap management
-	if(found_photons_ < n_lookup_)
+	photons_[found_photons_++] = FoundPhoton(photon, dist_2);
+	if(found_photons_ == capacity_)
 	{
-		// Add photon to unordered array of photons
-		photons_[found_photons_++] = FoundPhoton(photon, dist_2);
-		if(found_photons_ == n_lookup_)
-		{
-			std::make_heap(&photons_[0], &photons_[n_lookup_]);
-			max_dist_squared = photons_[0].dist_square_;
-		}
+		std::nth_element(&photons_[0], &photons_[n_lookup_ - 1], &photons_[capacity_]);
+		max_dist_squared = photons_[n_lookup_ - 1].dist_square_;
+		found_photons_ = n_lookup_;
 	}
-	else
+}
+
+void PhotonGather::finish(float &max_dist_squared) const
+{
+	if(found_photons_ < n_lookup_) return;
+	if(found_photons_ > n_lookup_)
 	{
-		// Remove most distant photon from heap and add new photon
-		std::pop_heap(&photons_[0], &photons_[n_lookup_]);
-		photons_[n_lookup_ - 1] = FoundPhoton(photon, dist_2);
-		std::push_heap(&photons_[0], &photons_[n_lookup_]);
-		max_dist_squared = photons_[0].dist_square_;
+		std::nth_element(&photons_[0], &photons_[n_lookup_ - 1], &photons_[found_photons_]);
+		found_photons_ = n_lookup_;
+		max_dist_squared = photons_[n_lookup_ - 1].dist_square_;
 	}
+	else max_dist_squared = std::max_element(&photons_[0], &photons_[n_lookup_])->dist_square_;
 }
 
 bool PhotonMap::load(const std::string &filename)
 {
 	clear();
 
+	auto mapped_file = std::unique_ptr<MappedFile>(new MappedFile(filename));
+	if(mapped_file->isOpen() && mapped_file->size() >= sizeof(file_id_v2_global) && std::memcmp(mapped_file->data(), file_id_v2_global, sizeof(file_id_v2_global)) == 0)
+	{
+		return loadMapped(std::move(mapped_file), filename);
+	}
+	mapped_file = nullptr;
+
 	File file(filename);
 	if(!file.open("rb"))
 	{
@@ -87,49 +152,250 @@ bool PhotonMap::load(const std::string &filename)
 		file.read<float>(p.c_.b_);
 	}
 	file.close();
+	photon_paths_.clear();
+	path_objects_.clear();
 
 	updateTree();
 	return true;
 }
 
+bool PhotonMap::loadMapped(std::unique_ptr<MappedFile> mapped_file, const std::string &filename)
+{
+	PhotonMapFileHeader header;
+	if(mapped_file->size() < sizeof(header))
+	{
+		Y_WARNING << "PhotonMap file '" << filename << "' is truncated, aborting load operation" << YENDL;
+		return false;
+	}
+	std::memcpy(&header, mapped_file->data(), sizeof(header));
+	if(header.byte_order_ != file_byte_order_global || header.header_size_ != sizeof(header))
+	{
+		Y_WARNING << "PhotonMap file '" << filename << "' was saved in a platform with a different byte order or header, aborting load operation" << YENDL;
+		return false;
+	}
+	const uint64_t num_photons = header.num_photons_;
+	auto section_valid = [&](uint64_t offset, uint64_t size) { return size == 0 || (offset % sizeof(float) == 0 && offset <= header.file_size_ && size <= header.file_size_ - offset); };
+	bool valid = header.file_size_ == mapped_file->size() && (num_photons == 0 || header.num_nodes_ > 0);
+	valid = valid && section_valid(header.nodes_offset_, header.num_nodes_ * sizeof(kdtree::KdNode)) && section_valid(header.photons_offset_, num_photons * sizeof(PackedPhoton));
+	for(const auto &offset : header.leaf_positions_offset_) valid = valid && section_valid(offset, num_photons * sizeof(float));
+	if(!valid)
+	{
+		Y_WARNING << "PhotonMap file '" << filename << "' is truncated or corrupted, aborting load operation" << YENDL;
+		return false;
+	}
+
+	paths_ = header.paths_;
+	search_radius_ = header.search_radius_;
+	if(num_photons == 0) return true;
+
+	const char *data = mapped_file->data();
+	const std::array<const float *, 3> leaf_positions {{ reinterpret_cast<const float *>(data + header.leaf_positions_offset_[0]), reinterpret_cast<const float *>(data + header.leaf_positions_offset_[1]), reinterpret_cast<const float *>(data + header.leaf_positions_offset_[2]) }};
+	const PackedPhoton *packed_photons = reinterpret_cast<const PackedPhoton *>(data + header.photons_offset_);
+
+	//The gather procedures get pointers to full photons, so the quantized photons are decoded, in leaf order so the tree can use them directly
+	photons_.resize(num_photons);
+	auto decode = [&](size_t begin, size_t end)
+	{
+		for(size_t i = begin; i < end; ++i)
+		{
+			const PackedPhoton &packed = packed_photons[i];
+			Rgbe rgbe;
+			std::memcpy(rgbe.rgbe_, packed.rgbe_, sizeof(packed.rgbe_));
+			const Vec3 dir = (packed.theta_ == 255) ? Vec3(0.f) : dirconverter_global.convert(packed.theta_, packed.phi_);
+			photons_[i] = Photon(dir, Point3(leaf_positions[0][i], leaf_positions[1][i], leaf_positions[2][i]), rgbe);
+		}
+	};
+	const size_t num_threads = std::max(1, threads_pkd_tree_);
+	const size_t chunk = (num_photons + num_threads - 1) / num_threads;
+	std::vector<std::thread> threads;
+	for(size_t begin = 0; begin < num_photons; begin += chunk) threads.push_back(std::thread(decode, begin, std::min<size_t>(num_photons, begin + chunk)));
+	for(auto &t : threads) t.join();
+
+	const Bound bound(Point3(header.bound_[0], header.bound_[1], header.bound_[2]), Point3(header.bound_[3], header.bound_[4], header.bound_[5]));
+	tree_ = std::unique_ptr<kdtree::PointKdTree<Photon>>(new kdtree::PointKdTree<Photon>(photons_, reinterpret_cast<const kdtree::KdNode *>(data + header.nodes_offset_), header.num_nodes_, leaf_positions, bound));
+	mapped_file_ = std::move(mapped_file);
+	updated_ = true;
+	updateMemoryTracker();
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "PhotonMap: " << name_ << " loaded " << num_photons << " photons with their kd-tree from '" << filename << "'" << YENDL;
+	return true;
+}
+
 bool PhotonMap::save(const std::string &filename) const
 {
+	//The built tree is saved too, so it is built here if it is not up to date
+	std::unique_ptr<kdtree::PointKdTree<Photon>> built_tree;
+	const kdtree::PointKdTree<Photon> *tree = tree_.get();
+	if(!photons_.empty() && (!updated_ || !tree))
+	{
+		built_tree = std::unique_ptr<kdtree::PointKdTree<Photon>>(new kdtree::PointKdTree<Photon>(photons_, name_, threads_pkd_tree_, huge_pages_mode_));
+		tree = built_tree.get();
+	}
+	const uint64_t num_photons = photons_.size();
+	const uint32_t num_nodes = num_photons > 0 ? tree->getNumNodes() : 0;
+
+	PhotonMapFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.id_, file_id_v2_global, sizeof(header.id_));
+	header.byte_order_ = file_byte_order_global;
+	header.header_size_ = sizeof(header);
+	header.paths_ = paths_;
+	header.search_radius_ = search_radius_;
+	header.num_photons_ = static_cast<uint32_t>(num_photons);
+	header.num_nodes_ = num_nodes;
+	if(num_photons > 0)
+	{
+		const Bound &bound = tree->getBound();
+		const float bound_values[6] { bound.a_.x_, bound.a_.y_, bound.a_.z_, bound.g_.x_, bound.g_.y_, bound.g_.z_ };
+		std::copy(std::begin(bound_values), std::end(bound_values), std::begin(header.bound_));
+	}
+	uint64_t offset = alignFileOffset_global(sizeof(header));
+	header.nodes_offset_ = offset;
+	offset = alignFileOffset_global(offset + num_nodes * sizeof(kdtree::KdNode));
+	for(auto &leaf_positions_offset : header.leaf_positions_offset_)
+	{
+		leaf_positions_offset = offset;
+		offset = alignFileOffset_global(offset + num_photons * sizeof(float));
+	}
+	header.photons_offset_ = offset;
+	header.file_size_ = offset + num_photons * sizeof(PackedPhoton);
+	if(num_photons == 0) header.file_size_ = sizeof(header); //only the header
+
 	File file(filename);
-	file.open("wb");
-	file.append(std::string("YAF_PHOTONMAPv1"));
-	file.append(name_);
-	file.append<int>(paths_);
-	file.append<float>(search_radius_);
-	file.append<int>(threads_pkd_tree_);
-	file.append<unsigned int>((unsigned int) photons_.size());
-	for(const auto &p : photons_)
-	{
-		file.append<float>(p.pos_.x_);
-		file.append<float>(p.pos_.y_);
-		file.append<float>(p.pos_.z_);
-		file.append<float>(p.c_.r_);
-		file.append<float>(p.c_.g_);
-		file.append<float>(p.c_.b_);
+	if(!file.open("wb"))
+	{
+		Y_WARNING << "PhotonMap file '" << filename << "' could not be created, aborting save operation" << YENDL;
+		return false;
+	}
+	uint64_t written = 0;
+	auto pad_to = [&](uint64_t position)
+	{
+		const std::vector<char> padding(position - written, 0);
+		written = position;
+		return file.append(padding);
+	};
+	bool result = file.append(header);
+	written = sizeof(header);
+	if(num_photons > 0)
+	{
+		result = result && pad_to(header.nodes_offset_) && file.append(tree->getNodes(), num_nodes);
+		written += num_nodes * sizeof(kdtree::KdNode);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			result = result && pad_to(header.leaf_positions_offset_[axis]) && file.append(tree->getLeafPositions(axis), num_photons);
+			written += num_photons * sizeof(float);
+		}
+		result = result && pad_to(header.photons_offset_);
+		std::vector<PackedPhoton> packed_photons;
+		for(uint64_t begin = 0; result && begin < num_photons; begin += file_photons_chunk_global)
+		{
+			const uint64_t end = std::min<uint64_t>(num_photons, begin + file_photons_chunk_global);
+			packed_photons.resize(end - begin);
+			for(uint64_t i = begin; i < end; ++i)
+			{
+				const Photon &photon = photons_[tree->getLeafElement(i)];
+				PackedPhoton &packed = packed_photons[i - begin];
+				const Rgbe rgbe(photon.color());
+				std::memcpy(packed.rgbe_, rgbe.rgbe_, sizeof(packed.rgbe_));
+				const Vec3 dir = photon.direction();
+				if(dir.null()) packed.theta_ = packed.phi_ = 255;
+				else
+				{
+					const std::pair<unsigned char, unsigned char> angles = dirconverter_global.convert(dir);
+					packed.theta_ = angles.first;
+					packed.phi_ = angles.second;
+				}
+				packed.padding_[0] = packed.padding_[1] = 0;
+			}
+			result = file.append(packed_photons);
+		}
 	}
 	file.close();
-	return true;
+	if(!result) Y_WARNING << "PhotonMap file '" << filename << "' could not be written completely" << YENDL;
+	return result;
+}
+
+void PhotonMap::appendChunks(const std::vector<std::vector<Photon>> &chunks, unsigned int paths, const std::vector<std::vector<unsigned int>> *path_chunks)
+{
+	const size_t num_chunks = chunks.size();
+	std::vector<size_t> offsets(num_chunks + 1, photons_.size());
+	for(size_t i = 0; i < num_chunks; ++i) offsets[i + 1] = offsets[i] + chunks[i].size();
+	const bool tagged = path_chunks && hasPathTags();
+	photons_.resize(offsets[num_chunks]);
+	if(tagged) photon_paths_.resize(offsets[num_chunks]);
+	else photon_paths_.clear();
+	auto copy_chunk = [&](size_t i)
+	{
+		std::copy(std::begin(chunks[i]), std::end(chunks[i]), std::begin(photons_) + offsets[i]);
+		if(tagged) std::copy(std::begin((*path_chunks)[i]), std::end((*path_chunks)[i]), std::begin(photon_paths_) + offsets[i]);
+	};
+	if(num_chunks > 1 && threads_pkd_tree_ > 1)
+	{
+		std::vector<std::thread> threads;
+		for(size_t i = 0; i < num_chunks; ++i) threads.push_back(std::thread(copy_chunk, i));
+		for(auto &t : threads) t.join();
+	}
+	else for(size_t i = 0; i < num_chunks; ++i) copy_chunk(i);
+	updated_ = false;
+	paths_ += paths;
+}
+
+void PhotonMap::removePaths(const std::vector<bool> &removed)
+{
+	if(!hasPathTags()) return;
+	size_t kept = 0;
+	for(size_t i = 0; i < photons_.size(); ++i)
+	{
+		if(removed[photon_paths_[i]]) continue;
+		photons_[kept] = photons_[i];
+		photon_paths_[kept] = photon_paths_[i];
+		++kept;
+	}
+	photons_.resize(kept);
+	photon_paths_.resize(kept);
+	tree_ = nullptr;
+	updated_ = false;
+	updateMemoryTracker();
 }
 
 void PhotonMap::updateTree()
 {
 	if(photons_.size() > 0)
 	{
-		tree_ = std::unique_ptr<kdtree::PointKdTree<Photon>>(new kdtree::PointKdTree<Photon>(photons_, name_, threads_pkd_tree_));
+		tree_ = std::unique_ptr<kdtree::PointKdTree<Photon>>(new kdtree::PointKdTree<Photon>(photons_, name_, threads_pkd_tree_, huge_pages_mode_));
 		updated_ = true;
 	}
 	else tree_ = nullptr;
+	mapped_file_ = nullptr;
+	updateMemoryTracker();
 }
 
 int PhotonMap::gather(const Point3 &p, FoundPhoton *found, unsigned int k, float &sq_radius) const
 {
-	PhotonGather proc(k, p);
-	proc.photons_ = found;
+	if(k == 0) return 0;
+	//The estimate is enlarged so that it usually holds k photons, at the cost of collecting some more
+	const float estimated_sq_radius = gather_radius_margin_global * tree_->estimateSqRadius(p, k);
+	if(estimated_sq_radius < sq_radius)
+	{
+		float bounded_sq_radius = estimated_sq_radius;
+		const int n_found = boundedGather(p, found, k, bounded_sq_radius);
+		if(n_found == static_cast<int>(k))
+		{
+			sq_radius = bounded_sq_radius;
+			return n_found;
+		}
+	}
+	return boundedGather(p, found, k, sq_radius);
+}
+
+int PhotonMap::boundedGather(const Point3 &p, FoundPhoton *found, unsigned int k, float &sq_radius) const
+{
+	static thread_local std::vector<FoundPhoton> buffer;
+	const size_t capacity = gather_buffer_ratio_global * k;
+	if(buffer.size() < capacity) buffer.resize(capacity);
+	PhotonGather proc(k, p, buffer.data(), capacity);
 	tree_->lookup(p, proc, sq_radius);
+	proc.finish(sq_radius);
+	std::copy(buffer.begin(), buffer.begin() + proc.found_photons_, found);
 	return proc.found_photons_;
 }
 
@@ -141,7 +407,6 @@ const Photon *PhotonMap::findNearest(const Point3 &p, const Vec3 &n, float dist)
 	return proc.nearest_;
 }
 
-#ifdef SMALL_PHOTONS
 DirConverter dirconverter_global;
 
 DirConverter::DirConverter()
@@ -169,6 +434,5 @@ std::pair<unsigned char, unsigned char> DirConverter::convert(const Vec3 &dir) {
 	else if(p < 0) p += 256;
 	return std::pair<unsigned char, unsigned char>(t, p);
 }
-#endif // SMALL_PHOTONS
 
 END_YAFARAY
@@ -0,0 +1,151 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "photon/photon_guide.h"
+#include "geometry/vector.h"
+#include <cmath>
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+static constexpr float uniform_mix_global = 0.2f; //!< fraction of the photons sampled uniformly, so the paths not seen yet are still explored
+
+void PhotonGuide::init(int num_lights, int num_threads, float cell_size, unsigned int hash_size)
+{
+	num_lights_ = num_lights;
+	ready_ = false;
+	inv_cell_size_ = 1.f / cell_size;
+	hash_size_ = std::max(1U, hash_size);
+	visible_cells_ = std::unique_ptr<std::atomic<unsigned char>[]>(new std::atomic<unsigned char>[hash_size_]);
+	for(unsigned int i = 0; i < hash_size_; ++i) visible_cells_[i].store(0, std::memory_order_relaxed);
+	Statistics statistics;
+	statistics.histograms_.resize(num_lights);
+	statistics.emitted_.assign(num_lights, 0.0);
+	thread_statistics_.assign(num_threads, statistics);
+	accumulated_ = statistics;
+	distributions_ = std::vector<std::array<Distribution, 2>>(num_lights);
+	light_factors_.assign(num_lights, 1.f);
+}
+
+void PhotonGuide::markVisible(const Point3 &p, float radius)
+{
+	radius = std::min(radius, 1.f / inv_cell_size_); //at most two cells along each axis
+	const int x_0 = static_cast<int>(std::floor((p.x_ - radius) * inv_cell_size_)), x_1 = static_cast<int>(std::floor((p.x_ + radius) * inv_cell_size_));
+	const int y_0 = static_cast<int>(std::floor((p.y_ - radius) * inv_cell_size_)), y_1 = static_cast<int>(std::floor((p.y_ + radius) * inv_cell_size_));
+	const int z_0 = static_cast<int>(std::floor((p.z_ - radius) * inv_cell_size_)), z_1 = static_cast<int>(std::floor((p.z_ + radius) * inv_cell_size_));
+	for(int z = z_0; z <= z_1; ++z)
+		for(int y = y_0; y <= y_1; ++y)
+			for(int x = x_0; x <= x_1; ++x) visible_cells_[hash(x, y, z)].store(1, std::memory_order_relaxed);
+}
+
+bool PhotonGuide::isVisible(const Point3 &p) const
+{
+	const unsigned int cell = hash(static_cast<int>(std::floor(p.x_ * inv_cell_size_)), static_cast<int>(std::floor(p.y_ * inv_cell_size_)), static_cast<int>(std::floor(p.z_ * inv_cell_size_)));
+	return visible_cells_[cell].load(std::memory_order_relaxed) != 0;
+}
+
+PhotonGuide::Sample PhotonGuide::sampleEmission(int light, float &s_1, float &s_2, float &s_3, float &s_4) const
+{
+	Sample sample;
+	if(!ready_)
+	{
+		sample.cells_[0] = std::min(resolution_ - 1, static_cast<int>(s_1 * resolution_)) * resolution_ + std::min(resolution_ - 1, static_cast<int>(s_2 * resolution_));
+		sample.cells_[1] = std::min(resolution_ - 1, static_cast<int>(s_3 * resolution_)) * resolution_ + std::min(resolution_ - 1, static_cast<int>(s_4 * resolution_));
+		return sample;
+	}
+	const float pdf = distributions_[light][0].sample(s_1, s_2, sample.cells_[0]) * distributions_[light][1].sample(s_3, s_4, sample.cells_[1]);
+	sample.inv_pdf_ = 1.f / pdf; //the uniform mix keeps the pdf away from zero
+	return sample;
+}
+
+void PhotonGuide::addPhoton(int thread_id, int light, const Sample &sample, bool useful)
+{
+	Statistics &statistics = thread_statistics_[thread_id];
+	statistics.emitted_[light] += 1.0;
+	if(!useful) return;
+	//Weighted with the inverse pdf, the histograms estimate the useful photons of the uniform emission and do not reinforce their own guiding
+	for(int pair = 0; pair < 2; ++pair) statistics.histograms_[light][pair].useful_[sample.cells_[pair]] += sample.inv_pdf_;
+}
+
+void PhotonGuide::update()
+{
+	for(auto &statistics : thread_statistics_)
+	{
+		for(int light = 0; light < num_lights_; ++light)
+		{
+			accumulated_.emitted_[light] += statistics.emitted_[light];
+			statistics.emitted_[light] = 0.0;
+			for(int pair = 0; pair < 2; ++pair)
+			{
+				for(int cell = 0; cell < num_cells_; ++cell) accumulated_.histograms_[light][pair].useful_[cell] += statistics.histograms_[light][pair].useful_[cell];
+				statistics.histograms_[light][pair].clear();
+			}
+		}
+	}
+	std::vector<float> useful_fractions(num_lights_, 0.f);
+	float max_useful_fraction = 0.f;
+	for(int light = 0; light < num_lights_; ++light)
+	{
+		if(accumulated_.emitted_[light] <= 0.0) continue;
+		const auto &useful = accumulated_.histograms_[light][0].useful_;
+		double useful_sum = 0.0;
+		for(const auto &cell_useful : useful) useful_sum += cell_useful;
+		useful_fractions[light] = static_cast<float>(useful_sum / accumulated_.emitted_[light]);
+		max_useful_fraction = std::max(max_useful_fraction, useful_fractions[light]);
+	}
+	if(max_useful_fraction <= 0.f) return; //no photon was seen yet, keep the uniform emission
+	for(int light = 0; light < num_lights_; ++light)
+	{
+		light_factors_[light] = uniform_mix_global + (1.f - uniform_mix_global) * useful_fractions[light] / max_useful_fraction;
+		for(int pair = 0; pair < 2; ++pair) distributions_[light][pair].build(accumulated_.histograms_[light][pair]);
+	}
+	ready_ = true;
+}
+
+void PhotonGuide::Distribution::build(const Histogram &histogram)
+{
+	float useful_sum = 0.f;
+	for(const auto &cell_useful : histogram.useful_) useful_sum += cell_useful;
+	const float uniform = (useful_sum > 0.f) ? uniform_mix_global * useful_sum / num_cells_ : 1.f;
+	const float guided = (useful_sum > 0.f) ? 1.f - uniform_mix_global : 0.f;
+	std::array<float, resolution_> row_sums;
+	for(int row = 0; row < resolution_; ++row)
+	{
+		std::array<float, resolution_> values;
+		for(int column = 0; column < resolution_; ++column) values[column] = uniform + guided * histogram.useful_[row * resolution_ + column];
+		conditional_[row] = std::unique_ptr<Pdf1D>(new Pdf1D(values.data(), resolution_));
+		row_sums[row] = 0.f;
+		for(const auto &value : values) row_sums[row] += value;
+	}
+	marginal_ = std::unique_ptr<Pdf1D>(new Pdf1D(row_sums.data(), resolution_));
+}
+
+float PhotonGuide::Distribution::sample(float &s_a, float &s_b, int &cell) const
+{
+	float pdf_a, pdf_b;
+	const float x = marginal_->sample(s_a, &pdf_a);
+	const int row = std::min(resolution_ - 1, static_cast<int>(x));
+	const float y = conditional_[row]->sample(s_b, &pdf_b);
+	const int column = std::min(resolution_ - 1, static_cast<int>(y));
+	s_a = std::min(x / resolution_, 0.99999994f);
+	s_b = std::min(y / resolution_, 0.99999994f);
+	cell = row * resolution_ + column;
+	return pdf_a * pdf_b;
+}
+
+END_YAFARAY
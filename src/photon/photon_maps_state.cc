@@ -0,0 +1,75 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "photon/photon_maps_state.h"
+#include "light/light.h"
+#include "scene/scene.h"
+#include "geometry/object.h"
+#include "geometry/primitive.h"
+#include "geometry/bound.h"
+#include "geometry/ray.h"
+#include <cstring>
+
+BEGIN_YAFARAY
+
+uint64_t PhotonMapsState::hashCombine(uint64_t hash, uint64_t value)
+{
+	return hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+}
+
+uint64_t PhotonMapsState::hashCombine(uint64_t hash, float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return hashCombine(hash, static_cast<uint64_t>(bits));
+}
+
+uint64_t PhotonMapsState::lightSignature(const Light &light)
+{
+	static constexpr float samples[3][4] { { 0.5f, 0.5f, 0.5f, 0.5f }, { 0.1f, 0.3f, 0.7f, 0.9f }, { 0.9f, 0.7f, 0.3f, 0.1f } };
+	uint64_t hash = 0;
+	for(const auto &s : samples)
+	{
+		Ray ray;
+		float ipdf = 0.f;
+		const Rgb col = light.emitPhoton(s[0], s[1], s[2], s[3], ray, ipdf);
+		for(const float value : { ray.from_.x_, ray.from_.y_, ray.from_.z_, ray.dir_.x_, ray.dir_.y_, ray.dir_.z_, col.r_, col.g_, col.b_, ipdf }) hash = hashCombine(hash, value);
+	}
+	return hash;
+}
+
+std::map<std::string, uint64_t> PhotonMapsState::objectSignatures(const Scene &scene)
+{
+	std::map<std::string, uint64_t> signatures;
+	for(const auto &object : scene.getObjects())
+	{
+		uint64_t hash = static_cast<uint64_t>(object->numPrimitives());
+		for(const auto &primitive : object->getPrimitives())
+		{
+			const Bound bound = primitive->getBound();
+			for(const float value : { bound.a_.x_, bound.a_.y_, bound.a_.z_, bound.g_.x_, bound.g_.y_, bound.g_.z_ }) hash = hashCombine(hash, value);
+			//A material update gives the primitives a new material, the replaced ones are kept alive so their addresses are not reused
+			hash = hashCombine(hash, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(primitive->getMaterial())));
+		}
+		//The instances share the name of their base object, their hashes are added so their order does not matter
+		signatures[object->getName()] += hash;
+	}
+	return signatures;
+}
+
+END_YAFARAY
@@ -0,0 +1,137 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "photon/visible_point_grid.h"
+#include <cmath>
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+static constexpr double max_cells_per_point_global = 2.0; //!< the cells are enlarged when the grid would have more cells than this per visible point
+
+void VisiblePointGrid::clear()
+{
+	points_.clear();
+	photon_sums_.reset();
+	cell_starts_.clear();
+	num_cells_ = {{0, 0, 0}};
+}
+
+void VisiblePointGrid::build(std::vector<std::vector<VisiblePoint>> &visible_points)
+{
+	clear();
+	size_t num_points = 0;
+	for(const auto &thread_points : visible_points) num_points += thread_points.size();
+	if(num_points == 0) return;
+
+	std::vector<VisiblePoint> points;
+	points.reserve(num_points);
+	float max_radius_2 = 0.f;
+	bool first = true;
+	for(auto &thread_points : visible_points)
+	{
+		for(const auto &point : thread_points)
+		{
+			if(first)
+			{
+				bound_.set(point.p_, point.p_);
+				first = false;
+			}
+			else bound_.include(point.p_);
+			max_radius_2 = std::max(max_radius_2, point.radius_2_);
+			points.push_back(point);
+		}
+		std::vector<VisiblePoint>().swap(thread_points);
+	}
+
+	//The cells are at least as large as the largest search radius, so the photons only need to look into the neighbouring cells
+	double cell_size = std::max(1.0e-6, std::sqrt(static_cast<double>(max_radius_2)));
+	const double extents[3] { bound_.longX(), bound_.longY(), bound_.longZ() };
+	const double max_cells = max_cells_per_point_global * num_points;
+	double total_cells = 1.0;
+	for(const auto &extent : extents) total_cells *= std::floor(extent / cell_size) + 1.0;
+	if(total_cells > max_cells) cell_size *= std::cbrt(total_cells / max_cells);
+	inv_cell_size_ = static_cast<float>(1.0 / cell_size);
+	for(int axis = 0; axis < 3; ++axis) num_cells_[axis] = static_cast<int>(std::floor(extents[axis] / cell_size)) + 1;
+	const size_t grid_size = static_cast<size_t>(num_cells_[0]) * num_cells_[1] * num_cells_[2];
+
+	//Counting sort of the points by cell
+	std::vector<unsigned int> point_cells(num_points);
+	cell_starts_.assign(grid_size + 1, 0);
+	for(size_t i = 0; i < num_points; ++i)
+	{
+		const Vec3 pos = (points[i].p_ - bound_.a_) * inv_cell_size_;
+		const int x = std::min(static_cast<int>(pos.x_), num_cells_[0] - 1);
+		const int y = std::min(static_cast<int>(pos.y_), num_cells_[1] - 1);
+		const int z = std::min(static_cast<int>(pos.z_), num_cells_[2] - 1);
+		point_cells[i] = x + num_cells_[0] * (y + num_cells_[1] * z);
+		++cell_starts_[point_cells[i] + 1];
+	}
+	for(size_t cell = 0; cell < grid_size; ++cell) cell_starts_[cell + 1] += cell_starts_[cell];
+	std::vector<unsigned int> cursors(cell_starts_.begin(), cell_starts_.end() - 1);
+	points_.resize(num_points);
+	for(size_t i = 0; i < num_points; ++i) points_[cursors[point_cells[i]]++] = points[i];
+	photon_sums_ = std::unique_ptr<PhotonSums[]>(new PhotonSums[num_points]);
+}
+
+void VisiblePointGrid::atomicAdd(std::atomic<float> &value, float addend)
+{
+	float current = value.load(std::memory_order_relaxed);
+	while(!value.compare_exchange_weak(current, current + addend, std::memory_order_relaxed));
+}
+
+void VisiblePointGrid::splat(const Point3 &p, const Vec3 &dir, const Rgb &col, bool caustic)
+{
+	if(points_.empty()) return;
+	const Vec3 pos = (p - bound_.a_) * inv_cell_size_;
+	const int cell[3] { static_cast<int>(std::floor(pos.x_)), static_cast<int>(std::floor(pos.y_)), static_cast<int>(std::floor(pos.z_)) };
+	for(int z = std::max(0, cell[2] - 1); z <= std::min(num_cells_[2] - 1, cell[2] + 1); ++z)
+	{
+		for(int y = std::max(0, cell[1] - 1); y <= std::min(num_cells_[1] - 1, cell[1] + 1); ++y)
+		{
+			const int x_begin = std::max(0, cell[0] - 1), x_end = std::min(num_cells_[0] - 1, cell[0] + 1);
+			if(x_begin > x_end) continue;
+			//The cells of a row are contiguous, so their points are too
+			const unsigned int row = num_cells_[0] * (y + num_cells_[1] * z);
+			for(unsigned int i = cell_starts_[row + x_begin]; i < cell_starts_[row + x_end + 1]; ++i)
+			{
+				const VisiblePoint &point = points_[i];
+				if(caustic && !point.caustics_) continue;
+				if((point.p_ - p).lengthSqr() > point.radius_2_) continue;
+				const int side = (point.n_ * dir >= 0.f) ? 0 : 3;
+				PhotonSums &sums = photon_sums_[i];
+				atomicAdd(sums.sums_[side], col.r_);
+				atomicAdd(sums.sums_[side + 1], col.g_);
+				atomicAdd(sums.sums_[side + 2], col.b_);
+				sums.count_.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+}
+
+void VisiblePointGrid::getPhotons(size_t index, Rgba &flux, float &count) const
+{
+	const VisiblePoint &point = points_[index];
+	const PhotonSums &sums = photon_sums_[index];
+	const Rgb reflected(sums.sums_[0].load(std::memory_order_relaxed), sums.sums_[1].load(std::memory_order_relaxed), sums.sums_[2].load(std::memory_order_relaxed));
+	const Rgb transmitted(sums.sums_[3].load(std::memory_order_relaxed), sums.sums_[4].load(std::memory_order_relaxed), sums.sums_[5].load(std::memory_order_relaxed));
+	flux = Rgba(point.weight_ * (point.reflect_col_ * reflected + point.transmit_col_ * transmitted));
+	count = point.count_weight_ * sums.count_.load(std::memory_order_relaxed);
+}
+
+END_YAFARAY
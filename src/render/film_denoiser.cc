@@ -0,0 +1,114 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "render/film_denoiser.h"
+#include "common/task_pool.h"
+#include <cmath>
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+static constexpr float kernel_global[3] = { 3.f / 8.f, 1.f / 4.f, 1.f / 16.f }; //!< B3 spline taps, from the center outwards
+
+void FilmDenoiser::denoise(std::vector<Rgb> &colors, const Features &features, int width, int height, int band_height) const
+{
+	if(width <= 0 || height <= 0 || params_.iterations_ <= 0) return;
+	const size_t num_pixels = static_cast<size_t>(width) * height;
+	band_height = std::max(1, band_height);
+	std::vector<Rgb> colors_out(num_pixels);
+	std::vector<Rgb> compressed(num_pixels);
+	TaskPool task_pool(num_threads_);
+	const float sigma_color = std::max(1e-4f, params_.sigma_color_);
+	float inv_sigma_color_2 = 1.f / (sigma_color * sigma_color);
+	for(int iteration_num = 0, step = 1; iteration_num < params_.iterations_; ++iteration_num, step *= 2)
+	{
+		{
+			//The color differences are measured with the colors compressed to 0..1, so the differences of the bright pixels do not stop the filter everywhere
+			TaskPool::Group task_group(task_pool);
+			for(int y_0 = 0; y_0 < height; y_0 += band_height)
+			{
+				task_group.run([&, y_0]()
+				{
+					const size_t end = static_cast<size_t>(std::min(height, y_0 + band_height)) * width;
+					for(size_t i = static_cast<size_t>(y_0) * width; i < end; ++i) compressed[i] = colors[i] * (1.f / (1.f + std::max(0.f, colors[i].energy())));
+				});
+			}
+			task_group.wait();
+		}
+		{
+			TaskPool::Group task_group(task_pool);
+			for(int y_0 = 0; y_0 < height; y_0 += band_height)
+			{
+				task_group.run([&, y_0, step, inv_sigma_color_2]()
+				{
+					iteration(colors, colors_out, compressed, features, width, height, y_0, std::min(height, y_0 + band_height), step, inv_sigma_color_2);
+				});
+			}
+			task_group.wait();
+		}
+		colors.swap(colors_out);
+		inv_sigma_color_2 *= 4.f;
+	}
+}
+
+void FilmDenoiser::iteration(const std::vector<Rgb> &colors_in, std::vector<Rgb> &colors_out, const std::vector<Rgb> &compressed, const Features &features, int width, int height, int y_0, int y_1, int step, float inv_sigma_color_2) const
+{
+	const bool use_normals = !features.normals_.empty();
+	const bool use_albedo = !features.albedo_.empty();
+	const bool use_depth = !features.depth_.empty();
+	const float inv_sigma_normal = 0.5f / std::max(1e-4f, params_.sigma_normal_); //!< half the square difference of unit normals is 1 - cosine
+	const float inv_sigma_albedo_2 = 1.f / std::max(1e-8f, params_.sigma_albedo_ * params_.sigma_albedo_);
+	const float sigma_depth = std::max(1e-4f, params_.sigma_depth_);
+	for(int y = y_0; y < y_1; ++y)
+	{
+		for(int x = 0; x < width; ++x)
+		{
+			const size_t p = static_cast<size_t>(y) * width + x;
+			const Rgb &compressed_p = compressed[p];
+			const float inv_depth_tolerance = use_depth ? 1.f / (sigma_depth * std::max(1e-4f, features.depth_[p])) : 0.f;
+			Rgb sum(0.f);
+			float weight_sum = 0.f;
+			for(int j = -2; j <= 2; ++j)
+			{
+				const int y_q = y + j * step;
+				if(y_q < 0 || y_q >= height) continue;
+				for(int i = -2; i <= 2; ++i)
+				{
+					const int x_q = x + i * step;
+					if(x_q < 0 || x_q >= width) continue;
+					const size_t q = static_cast<size_t>(y_q) * width + x_q;
+					const Rgb color_diff = compressed[q] - compressed_p;
+					float exponent = (color_diff.r_ * color_diff.r_ + color_diff.g_ * color_diff.g_ + color_diff.b_ * color_diff.b_) * inv_sigma_color_2;
+					if(use_normals) exponent += (features.normals_[q] - features.normals_[p]).lengthSqr() * inv_sigma_normal;
+					if(use_albedo)
+					{
+						const Rgb albedo_diff = features.albedo_[q] - features.albedo_[p];
+						exponent += (albedo_diff.r_ * albedo_diff.r_ + albedo_diff.g_ * albedo_diff.g_ + albedo_diff.b_ * albedo_diff.b_) * inv_sigma_albedo_2;
+					}
+					if(use_depth) exponent += std::abs(features.depth_[q] - features.depth_[p]) * inv_depth_tolerance;
+					const float weight = kernel_global[std::abs(i)] * kernel_global[std::abs(j)] * std::exp(-exponent);
+					sum += colors_in[q] * weight;
+					weight_sum += weight;
+				}
+			}
+			colors_out[p] = sum * (1.f / weight_sum); //the center pixel always has a positive weight
+		}
+	}
+}
+
+END_YAFARAY
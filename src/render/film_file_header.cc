@@ -0,0 +1,109 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "render/film_file_header.h"
+#include "common/file.h"
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+static constexpr char film_format_legacy_global[] = "YAF_FILMv4_0_0"; //!< all the weights followed by all the pixels of each layer, it can only be read and written as a whole
+static constexpr char film_format_chunked_global[] = "YAF_FILMv4_1_0"; //!< film split in chunks at known file positions, so chunks can be read and rewritten independently
+static constexpr char film_format_chunked_layers_global[] = "YAF_FILMv4_2_0"; //!< chunked, also storing the type of each layer so the films can be merged without the scene
+
+constexpr int FilmFileHeader::chunk_size_global;
+
+bool FilmFileHeader::read(const File &file)
+{
+	std::string header;
+	file.read(header);
+	if(header == film_format_chunked_layers_global) format_ = Format::ChunkedLayers;
+	else if(header == film_format_chunked_global) format_ = Format::Chunked;
+	else if(header == film_format_legacy_global) format_ = Format::Legacy;
+	else return false;
+	bool result_ok = file.read<unsigned int>(computer_node_);
+	result_ok = result_ok && file.read<unsigned int>(base_sampling_offset_);
+	result_ok = result_ok && file.read<unsigned int>(sampling_offset_);
+	result_ok = result_ok && file.read<int>(width_);
+	result_ok = result_ok && file.read<int>(height_);
+	result_ok = result_ok && file.read<int>(cx_0_);
+	result_ok = result_ok && file.read<int>(cx_1_);
+	result_ok = result_ok && file.read<int>(cy_0_);
+	result_ok = result_ok && file.read<int>(cy_1_);
+	result_ok = result_ok && file.read<int>(num_layers_);
+	if(!result_ok || num_layers_ < 0) return false;
+	if(!isChunked()) return true;
+	result_ok = file.read<int>(chunk_size_);
+	if(format_ == Format::ChunkedLayers)
+	{
+		layer_types_.resize(num_layers_);
+		result_ok = result_ok && file.read(layer_types_);
+		if(std::find(layer_types_.begin(), layer_types_.end(), -1) != layer_types_.end()) layer_types_.clear();
+	}
+	else layer_types_.clear();
+	return result_ok;
+}
+
+bool FilmFileHeader::write(File &file) const
+{
+	bool result_ok = file.append(std::string(film_format_chunked_layers_global));
+	result_ok = result_ok && file.append<unsigned int>(computer_node_);
+	result_ok = result_ok && file.append<unsigned int>(base_sampling_offset_);
+	result_ok = result_ok && file.append<unsigned int>(sampling_offset_);
+	result_ok = result_ok && file.append<int>(width_);
+	result_ok = result_ok && file.append<int>(height_);
+	result_ok = result_ok && file.append<int>(cx_0_);
+	result_ok = result_ok && file.append<int>(cx_1_);
+	result_ok = result_ok && file.append<int>(cy_0_);
+	result_ok = result_ok && file.append<int>(cy_1_);
+	result_ok = result_ok && file.append<int>(num_layers_);
+	result_ok = result_ok && file.append<int>(chunk_size_global);
+	//The layer types are written as -1 when they are not known, in the films merged from films saved without them
+	if(static_cast<int>(layer_types_.size()) == num_layers_) return result_ok && file.append(layer_types_);
+	else return result_ok && file.append(std::vector<int>(num_layers_, -1));
+}
+
+uint64_t FilmFileHeader::getSize() const
+{
+	//Format string with its terminating null, computer node and sampling offsets, image size and borders, number of layers, chunk size and layer types
+	switch(format_)
+	{
+		case Format::Legacy: return sizeof(film_format_legacy_global) + 3 * sizeof(unsigned int) + 7 * sizeof(int);
+		case Format::Chunked: return sizeof(film_format_chunked_global) + 3 * sizeof(unsigned int) + 8 * sizeof(int);
+		default: return sizeof(film_format_chunked_layers_global) + 3 * sizeof(unsigned int) + (8 + static_cast<uint64_t>(num_layers_)) * sizeof(int);
+	}
+}
+
+uint64_t FilmFileHeader::getChunkFilePosition(int chunk_x, int chunk_y) const
+{
+	const uint64_t pixel_size = sizeof(float) * getPixelSize();
+	const int chunk_row_height = std::min(chunk_size_global, height_ - chunk_y * chunk_size_global);
+	//All the chunk rows above are complete rows of the image, and the chunks to the left in the same row have the full chunk width
+	const uint64_t pixels_before = static_cast<uint64_t>(chunk_y) * chunk_size_global * width_ + static_cast<uint64_t>(chunk_x) * chunk_size_global * chunk_row_height;
+	return getSize() + pixels_before * pixel_size;
+}
+
+void FilmFileHeader::getChunkArea(int chunk_x, int chunk_y, int &x_0, int &y_0, int &x_1, int &y_1) const
+{
+	x_0 = chunk_x * chunk_size_global;
+	y_0 = chunk_y * chunk_size_global;
+	x_1 = std::min(width_, x_0 + chunk_size_global);
+	y_1 = std::min(height_, y_0 + chunk_size_global);
+}
+
+END_YAFARAY
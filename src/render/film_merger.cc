@@ -0,0 +1,171 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "render/film_merger.h"
+#include "render/film_file_header.h"
+#include "common/layers.h"
+#include "common/file.h"
+#include "common/logger.h"
+#include "common/task_pool.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+struct MergedFilm
+{
+	std::string path_;
+	FilmFileHeader header_;
+	std::unique_ptr<MappedFile> mapped_file_;
+};
+
+static bool sameFilmLayout_global(const FilmFileHeader &header_1, const FilmFileHeader &header_2)
+{
+	return header_1.width_ == header_2.width_ && header_1.height_ == header_2.height_ && header_1.cx_0_ == header_2.cx_0_ && header_1.cx_1_ == header_2.cx_1_ && header_1.cy_0_ == header_2.cy_0_ && header_1.cy_1_ == header_2.cy_1_ && header_1.num_layers_ == header_2.num_layers_ && header_1.chunk_size_ == header_2.chunk_size_ && (header_1.layer_types_.empty() || header_2.layer_types_.empty() || header_1.layer_types_ == header_2.layer_types_);
+}
+
+bool FilmMerger::merge(const std::vector<std::string> &input_paths, const std::string &output_path) const
+{
+	std::vector<MergedFilm> films;
+	for(const auto &input_path : input_paths)
+	{
+		MergedFilm film;
+		film.path_ = input_path;
+		File file(input_path);
+		if(!file.open("rb") || !film.header_.read(file))
+		{
+			Y_WARNING << "FilmMerger: '" << input_path << "' is not a film file, skipping it" << YENDL;
+			continue;
+		}
+		file.close();
+		if(!film.header_.isChunked() || film.header_.chunk_size_ != FilmFileHeader::chunk_size_global)
+		{
+			Y_WARNING << "FilmMerger: '" << input_path << "' is in an old film format, load and save it again with a render to convert it. Skipping it" << YENDL;
+			continue;
+		}
+		if(!films.empty() && !sameFilmLayout_global(films.front().header_, film.header_))
+		{
+			Y_WARNING << "FilmMerger: '" << input_path << "' has a different size, borders or layers than '" << films.front().path_ << "', skipping it" << YENDL;
+			continue;
+		}
+		//Two films of the same node and sampling offsets have the same samples, merging them would not reduce the noise
+		const auto repeated_film = std::find_if(films.begin(), films.end(), [&film](const MergedFilm &merged_film)
+		{
+			return merged_film.header_.computer_node_ == film.header_.computer_node_ && merged_film.header_.base_sampling_offset_ == film.header_.base_sampling_offset_;
+		});
+		if(repeated_film != films.end())
+		{
+			Y_WARNING << "FilmMerger: '" << input_path << "' has the same computer node " << film.header_.computer_node_ << " and base sampling offset " << film.header_.base_sampling_offset_ << " as '" << repeated_film->path_ << "', skipping it" << YENDL;
+			continue;
+		}
+		film.mapped_file_ = std::unique_ptr<MappedFile>(new MappedFile(input_path));
+		if(!film.mapped_file_->isOpen() || film.mapped_file_->size() < film.header_.getFileSize())
+		{
+			Y_WARNING << "FilmMerger: '" << input_path << "' is truncated or could not be mapped, skipping it" << YENDL;
+			continue;
+		}
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "FilmMerger: merging '" << input_path << "', computer node " << film.header_.computer_node_ << ", sampling offset " << film.header_.sampling_offset_ << YENDL;
+		films.push_back(std::move(film));
+	}
+	if(films.empty())
+	{
+		Y_ERROR << "FilmMerger: no film to merge" << YENDL;
+		return false;
+	}
+
+	FilmFileHeader header = films.front().header_;
+	header.format_ = FilmFileHeader::Format::ChunkedLayers;
+	for(const auto &film : films)
+	{
+		header.base_sampling_offset_ = std::max(header.base_sampling_offset_, film.header_.base_sampling_offset_);
+		header.sampling_offset_ = std::max(header.sampling_offset_, film.header_.sampling_offset_);
+		if(header.layer_types_.empty()) header.layer_types_ = film.header_.layer_types_;
+	}
+	if(header.layer_types_.empty()) Y_WARNING << "FilmMerger: the films do not store their layer types, the index and debug layers will be added as the color layers" << YENDL;
+	//The point sampled layers keep the value of the first film rendering each pixel instead of adding them
+	std::vector<bool> point_sampled_layers(header.num_layers_, false);
+	for(size_t layer = 0; layer < header.layer_types_.size(); ++layer) point_sampled_layers[layer] = Layer::isPointSampled(static_cast<Layer::Type>(header.layer_types_[layer]));
+
+	{
+		File output_file(output_path);
+		if(!output_file.open("wb") || !header.write(output_file))
+		{
+			Y_ERROR << "FilmMerger: could not write the film file '" << output_path << "'" << YENDL;
+			return false;
+		}
+	}
+
+	std::atomic<bool> result_ok {true};
+	TaskPool task_pool(num_threads_);
+	TaskPool::Group task_group(task_pool);
+	for(int chunk_y = 0; chunk_y < header.getChunksY(); ++chunk_y)
+	{
+		task_group.run([&, chunk_y]()
+		{
+			if(!result_ok) return;
+			const uint64_t position = header.getChunkFilePosition(0, chunk_y);
+			const size_t row_floats = static_cast<size_t>(header.width_) * (std::min(header.height_, (chunk_y + 1) * FilmFileHeader::chunk_size_global) - chunk_y * FilmFileHeader::chunk_size_global) * header.getPixelSize();
+			//The chunk rows are at the same positions in all the films, films with different headers were skipped
+			const uint64_t film_position = films.front().header_.getChunkFilePosition(0, chunk_y);
+			std::vector<float> merged(row_floats);
+			std::memcpy(merged.data(), films.front().mapped_file_->data() + film_position, row_floats * sizeof(float));
+			for(size_t film_id = 1; film_id < films.size(); ++film_id)
+			{
+				const char *film_row = films[film_id].mapped_file_->data() + films[film_id].header_.getChunkFilePosition(0, chunk_y);
+				size_t offset = 0;
+				for(int chunk_x = 0; chunk_x < header.getChunksX(); ++chunk_x)
+				{
+					int x_0, y_0, x_1, y_1;
+					header.getChunkArea(chunk_x, chunk_y, x_0, y_0, x_1, y_1);
+					const size_t num_pixels = static_cast<size_t>(x_1 - x_0) * (y_1 - y_0);
+					for(int layer = -1; layer < header.num_layers_; ++layer)
+					{
+						//Each chunk has its weights followed by the colors of each layer
+						const size_t num_floats = (layer < 0) ? num_pixels : 4 * num_pixels;
+						float *merged_data = merged.data() + offset;
+						for(size_t i = 0; i < num_floats; ++i)
+						{
+							float value;
+							std::memcpy(&value, film_row + (offset + i) * sizeof(float), sizeof(float));
+							if(layer < 0 || !point_sampled_layers[layer]) merged_data[i] += value;
+							else if(i % 4 == 0 && merged_data[i] == 0.f && merged_data[i + 1] == 0.f && merged_data[i + 2] == 0.f)
+							{
+								std::memcpy(merged_data + i, film_row + (offset + i) * sizeof(float), 4 * sizeof(float));
+							}
+						}
+						offset += num_floats;
+					}
+				}
+			}
+			File output_file(output_path);
+			if(!output_file.open("r+b") || !output_file.seek(position) || !output_file.append(merged)) result_ok = false;
+		});
+	}
+	task_group.wait();
+	if(!result_ok)
+	{
+		Y_ERROR << "FilmMerger: could not write the film file '" << output_path << "'" << YENDL;
+		return false;
+	}
+	Y_INFO << "FilmMerger: merged " << films.size() << " films into '" << output_path << "'" << YENDL;
+	return true;
+}
+
+END_YAFARAY
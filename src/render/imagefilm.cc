@@ -21,6 +21,9 @@
  */
 
 #include "render/imagefilm.h"
+#include "render/film_file_header.h"
+#include "render/render_checkpoint.h"
+#include "image/image_sparse.h"
 #include "common/logger.h"
 #include "common/session.h"
 #include "output/output.h"
@@ -28,6 +31,7 @@
 #include "scene/scene.h"
 #include "common/file.h"
 #include "common/param.h"
+#include "common/string.h"
 #include "render/monitor.h"
 #include "common/timer.h"
 #include "color/color_layers.h"
@@ -42,9 +46,28 @@ BEGIN_YAFARAY
 
 static constexpr int filter_table_size_global = 16;
 static constexpr int max_filter_size_global = 8;
+static constexpr int film_chunk_size_global = FilmFileHeader::chunk_size_global;
+static constexpr int min_dynamic_split_size_global = 8; //!< areas are not split in halves at the end of the passes below this size
 
 typedef float FilterFunc_t(float dx, float dy);
 
+static thread_local std::vector<Rgba> sample_colors_global; //!< per thread scratch buffer for the clamped colors of each sample in addSample
+
+static inline bool isBlack_global(const Rgba &col) { return col.r_ == 0.f && col.g_ == 0.f && col.b_ == 0.f; }
+
+//! Adds a color loaded from a film file to a pixel, the point sampled layers keep the value already rendered in the pixel if there is one
+static inline void addLoadedColor_global(Image &image, bool point_sampled, int x, int y, const Rgba &col)
+{
+	if(!point_sampled) image.setColor(x, y, image.getColor(x, y) + col);
+	else if(isBlack_global(image.getColor(x, y))) image.setColor(x, y, col);
+}
+
+static inline void atomicAdd_global(std::atomic<float> &value, float addend)
+{
+	float current = value.load(std::memory_order_relaxed);
+	while(!value.compare_exchange_weak(current, current + addend, std::memory_order_relaxed));
+}
+
 
 std::unique_ptr<ImageFilm> ImageFilm::factory(const ParamMap &params, Scene *scene)
 {
@@ -82,6 +105,21 @@ std::unique_ptr<ImageFilm> ImageFilm::factory(const ParamMap &params, Scene *sce
 	params.getParam("film_autosave_interval_type", film_autosave_interval_type_str);
 	params.getParam("film_autosave_interval_passes", film_load_save.auto_save_.interval_passes_);
 	params.getParam("film_autosave_interval_seconds", film_load_save.auto_save_.interval_seconds_);
+	ImageFilm::CheckpointParams checkpoint_params;
+	params.getParam("film_checkpoint_path", checkpoint_params.path_); //render checkpoints with the film and the integrator state, to resume interrupted renders
+	params.getParam("film_checkpoint_interval_passes", checkpoint_params.interval_passes_);
+	std::string convergence_reference;
+	params.getParam("convergence_reference", convergence_reference);
+	FilmDenoiser::Params denoise_params;
+	params.getParam("film_denoise", denoise_params.enabled_);
+	params.getParam("film_denoise_intermediate", denoise_params.intermediate_);
+	params.getParam("film_denoise_iterations", denoise_params.iterations_);
+	params.getParam("film_denoise_sigma_color", denoise_params.sigma_color_);
+	params.getParam("film_denoise_sigma_normal", denoise_params.sigma_normal_);
+	params.getParam("film_denoise_sigma_albedo", denoise_params.sigma_albedo_);
+	params.getParam("film_denoise_sigma_depth", denoise_params.sigma_depth_);
+	bool half_float_layers = false;
+	params.getParam("film_half_float_layers", half_float_layers); //the layers that do not need float precision are accumulated in half floats
 
 	if(Y_LOG_HAS_DEBUG) Y_DEBUG << "Images autosave: " << images_autosave_interval_type_string << ", " << images_autosave_params.interval_passes_ << ", " << images_autosave_params.interval_seconds_ << YENDL;
 
@@ -109,17 +147,25 @@ std::unique_ptr<ImageFilm> ImageFilm::factory(const ParamMap &params, Scene *sce
 	ImageSplitter::TilesOrderType tiles_order_type = ImageSplitter::CentreRandom;
 	if(tiles_order == "linear") tiles_order_type = ImageSplitter::Linear;
 	else if(tiles_order == "random") tiles_order_type = ImageSplitter::Random;
+	else if(tiles_order == "hilbert") tiles_order_type = ImageSplitter::Hilbert;
+	else if(tiles_order == "morton") tiles_order_type = ImageSplitter::Morton;
 	else if(tiles_order != "centre" && Y_LOG_HAS_VERBOSE) Y_VERBOSE << "ImageFilm: " << "Defaulting to Centre tiles order." << YENDL; // this is info imho not a warning
 
-	auto film = std::unique_ptr<ImageFilm>(new ImageFilm(width, height, xstart, ystart, scene->getNumThreads(), scene->getRenderControl(), scene->getLayers(), scene->getOutputs(), filt_sz, type, show_sampled_pixels, tile_size, tiles_order_type));
+	auto film = std::unique_ptr<ImageFilm>(new ImageFilm(width, height, xstart, ystart, scene->getNumThreads(), scene->getRenderControl(), scene->getLayers(), scene->getOutputs(), filt_sz, type, show_sampled_pixels, tile_size, tiles_order_type, half_float_layers, scene->getHugePagesMode()));
 
 	film->setImagesAutoSaveParams(images_autosave_params);
 	film->setFilmLoadSaveParams(film_load_save);
+	film->setCheckpointParams(checkpoint_params);
+	film->setDenoiseParams(denoise_params);
+	film->setSession(&scene->getSession());
+	if(!convergence_reference.empty()) film->setConvergenceReference(convergence_reference);
 
 	if(images_autosave_params.interval_type_ == ImageFilm::AutoSaveParams::IntervalType::Pass) Y_INFO << "ImageFilm: " << "AutoSave partially rendered image every " << images_autosave_params.interval_passes_ << " passes" << YENDL;
 
 	if(images_autosave_params.interval_type_ == ImageFilm::AutoSaveParams::IntervalType::Time) Y_INFO << "ImageFilm: " << "AutoSave partially rendered image every " << images_autosave_params.interval_seconds_ << " seconds" << YENDL;
 
+	if(!checkpoint_params.path_.empty()) Y_INFO << "ImageFilm: " << "Saving render checkpoints to '" << checkpoint_params.path_ << "' every " << checkpoint_params.interval_passes_ << " passes, resuming from it if it exists" << YENDL;
+
 	if(film_load_save.mode_ != ImageFilm::FilmLoadSave::Save) Y_INFO << "ImageFilm: " << "Enabling imageFilm file saving feature" << YENDL;
 	if(film_load_save.mode_ == ImageFilm::FilmLoadSave::LoadAndSave) Y_INFO << "ImageFilm: " << "Enabling imageFilm Loading feature. It will load and combine the ImageFilm files from the currently selected image output folder before start rendering, autodetecting each film format (binary/text) automatically. If they don't match exactly the scene, bad results could happen. Use WITH CARE!" << YENDL;
 
@@ -130,10 +176,13 @@ std::unique_ptr<ImageFilm> ImageFilm::factory(const ParamMap &params, Scene *sce
 	return film;
 }
 
-ImageFilm::ImageFilm (int width, int height, int xstart, int ystart, int num_threads, RenderControl &render_control, const Layers &layers, const std::map<std::string, UniquePtr_t<ColorOutput>> &outputs, float filter_size, FilterType filt, bool show_sam_mask, int t_size, ImageSplitter::TilesOrderType tiles_order_type) : width_(width), height_(height), cx_0_(xstart), cy_0_(ystart), show_mask_(show_sam_mask), tile_size_(t_size), tiles_order_(tiles_order_type), num_threads_(num_threads), layers_(layers), outputs_(outputs), filterw_(filter_size * 0.5), flags_(width, height), weights_(width, height)
+ImageFilm::ImageFilm (int width, int height, int xstart, int ystart, int num_threads, RenderControl &render_control, const Layers &layers, const std::map<std::string, UniquePtr_t<ColorOutput>> &outputs, float filter_size, FilterType filt, bool show_sam_mask, int t_size, ImageSplitter::TilesOrderType tiles_order_type, bool half_float_layers, HugePages::Mode huge_pages_mode) : width_(width), height_(height), cx_0_(xstart), cy_0_(ystart), show_mask_(show_sam_mask), tile_size_(t_size), tiles_order_(tiles_order_type), num_threads_(num_threads), layers_(layers), outputs_(outputs), filterw_(filter_size * 0.5), flags_(width, height), weights_(width, height, huge_pages_mode)
 {
 	cx_1_ = xstart + width;
 	cy_1_ = ystart + height;
+	film_chunks_x_ = (width + film_chunk_size_global - 1) / film_chunk_size_global;
+	film_chunks_y_ = (height + film_chunk_size_global - 1) / film_chunk_size_global;
+	film_chunks_modified_.assign(film_chunks_x_ * film_chunks_y_, true);
 	filter_table_ = std::unique_ptr<float[]>(new float[filter_table_size_global * filter_table_size_global]);
 
 	//Creation of the image buffers for the render passes
@@ -141,9 +190,14 @@ ImageFilm::ImageFilm (int width, int height, int xstart, int ystart, int num_thr
 	{
 		Image::Type image_type = l.second.getImageType();
 		image_type = Image::imageTypeWithAlpha(image_type); //Alpha channel is needed in all images of the weight normalization process will cause problems
-		std::unique_ptr<Image> image = Image::factory(width, height, image_type, Image::Optimization::None);
+		const Image::Optimization optimization = (half_float_layers && Layer::allowsHalfFloat(l.first)) ? Image::Optimization::HalfFloat : Image::Optimization::None;
+		//The index and debug layers are usually written only in some parts of the image, their tiles are allocated when written
+		std::unique_ptr<Image> image;
+		if(Layer::getFlags(l.first).hasAny(Layer::Flags::IndexLayers | Layer::Flags::DebugLayers)) image = std::unique_ptr<Image>(new ImageSparse(width, height, image_type, optimization));
+		else image = Image::factory(width, height, image_type, optimization, huge_pages_mode);
 		image_layers_.set(l.first, {std::move(image), l.second});
 	}
+	for(const auto &it : image_layers_) point_sampled_layers_.push_back(Layer::isPointSampled(it.first));
 
 	density_image_ = nullptr;
 	estimate_density_ = false;
@@ -173,6 +227,13 @@ ImageFilm::ImageFilm (int width, int height, int xstart, int ystart, int num_thr
 		}
 	}
 
+	if(ffunc == math::filter::box)
+	{
+		//Separable filter: the weights of the pixels covered by each sample are the product of a column weight and a row weight
+		filter_table_1d_ = std::unique_ptr<float[]>(new float[filter_table_size_global]);
+		for(int x = 0; x < filter_table_size_global; ++x) filter_table_1d_[x] = ffunc((x + .5f) * scale, 0.f);
+	}
+
 	table_scale_ = 0.9999 * filter_table_size_global / filterw_;
 	area_cnt_ = 0;
 
@@ -184,6 +245,28 @@ ImageFilm::ImageFilm (int width, int height, int xstart, int ystart, int num_thr
 	aa_noise_params_.variance_edge_size_ = 10;
 	aa_noise_params_.variance_pixels_ = 0;
 	aa_noise_params_.clamp_samples_ = 0.f;
+	updateMemoryTracker();
+}
+
+bool ImageFilm::isPreview() const
+{
+	return session_ && session_->isPreview();
+}
+
+bool ImageFilm::isInteractive() const
+{
+	return session_ && session_->isInteractive();
+}
+
+void ImageFilm::updateMemoryTracker()
+{
+	const size_t num_pixels = static_cast<size_t>(width_) * height_;
+	size_t memory_size = num_pixels * (sizeof(Gray) + sizeof(bool));
+	for(const auto &it : image_layers_) memory_size += it.second.image_->getMemorySize();
+	if(density_image_) memory_size += num_pixels * sizeof(Rgb);
+	memory_size += vectorMemory_global(luminance_moments_) + vectorMemory_global(variance_sample_factors_);
+	if(convergence_reference_) memory_size += convergence_reference_->getMemorySize();
+	memory_tracker_.set(memory_size);
 }
 
 void ImageFilm::init(RenderControl &render_control, int num_passes)
@@ -193,41 +276,50 @@ void ImageFilm::init(RenderControl &render_control, int num_passes)
 	{
 		it.second.image_->clear();
 	}
+	std::fill(film_chunks_modified_.begin(), film_chunks_modified_.end(), true);
+	film_file_saved_ = false;
 
 	// Clear density image
 	if(estimate_density_)
 	{
-		if(!density_image_) density_image_ = std::unique_ptr<ImageBuffer2D<Rgb>>(new ImageBuffer2D<Rgb>(width_, height_));
-		else density_image_->clear();
+		clearDensityImage();
 	}
+	if(aa_noise_params_.variance_sampling_) luminance_moments_.assign(static_cast<size_t>(width_) * height_, {{0.f, 0.f}});
+	else std::vector<std::array<float, 2>>().swap(luminance_moments_);
+	std::vector<float>().swap(variance_sample_factors_);
+	updateMemoryTracker();
 
 	// Setup the bucket splitter
 	if(split_)
 	{
 		next_area_ = 0;
-		splitter_ = std::unique_ptr<ImageSplitter>(new ImageSplitter(width_, height_, cx_0_, cy_0_, tile_size_, tiles_order_, num_threads_));
-		area_cnt_ = splitter_->size();
+		dynamic_split_areas_.clear();
+		num_dynamic_split_areas_ = 0;
+		splitter_ = std::unique_ptr<ImageSplitter>(new ImageSplitter(width_, height_, cx_0_, cy_0_, tile_size_, tiles_order_));
 	}
-	else area_cnt_ = 1;
+	const int num_pass_pixels = setupPassAreas(true);
 
-	if(progress_bar_) progress_bar_->init(width_ * height_);
+	if(progress_bar_) progress_bar_->init(num_pass_pixels);
 	render_control.setCurrentPassPercent(progress_bar_->getPercent());
 
 	abort_ = false;
 	completed_cnt_ = 0;
 	n_pass_ = 1;
 	n_passes_ = num_passes;
+	convergence_.clear();
+	convergence_measure_seconds_ = 0.0;
+	convergence_start_ = std::chrono::steady_clock::now();
 
 	images_auto_save_params_.pass_counter_ = 0;
 	film_load_save_.auto_save_.pass_counter_ = 0;
 	resetImagesAutoSaveTimer();
 	resetFilmAutoSaveTimer();
-	g_timer_global.addEvent("imagesAutoSaveTimer");
-	g_timer_global.addEvent("filmAutoSaveTimer");
-	g_timer_global.start("imagesAutoSaveTimer");
-	g_timer_global.start("filmAutoSaveTimer");
+	render_control.getTimer().addEvent("imagesAutoSaveTimer");
+	render_control.getTimer().addEvent("filmAutoSaveTimer");
+	render_control.getTimer().start("imagesAutoSaveTimer");
+	render_control.getTimer().start("filmAutoSaveTimer");
 
-	if(!session_global.isPreview())	// Avoid doing the Film Load & Save operations and updating the film check values when we are just rendering a preview!
+	if(!isPreview())	// Avoid doing the Film Load & Save operations and updating the film check values when we are just rendering a preview!
 	{
 		if(film_load_save_.mode_ == FilmLoadSave::LoadAndSave) imageFilmLoadAllInFolder(render_control);	//Load all the existing Film in the images output folder, combining them together. It will load only the Film files with the same "base name" as the output image film (including file name, computer node name and frame) to allow adding samples to animations.
 		if(film_load_save_.mode_ == FilmLoadSave::LoadAndSave || film_load_save_.mode_ == FilmLoadSave::Save) imageFilmFileBackup(); //If the imageFilm is set to Save, at the start rename the previous film file as a "backup" just in case the user has made a mistake and wants to get the previous film back.
@@ -236,8 +328,11 @@ void ImageFilm::init(RenderControl &render_control, int num_passes)
 
 int ImageFilm::nextPass(const RenderView *render_view, RenderControl &render_control, bool adaptive_aa, std::string integrator_name, bool skip_nrender_layer)
 {
+	measureConvergence();
 	splitter_mutex_.lock();
 	next_area_ = 0;
+	dynamic_split_areas_.clear();
+	num_dynamic_split_areas_ = 0;
 	splitter_mutex_.unlock();
 	n_pass_++;
 	images_auto_save_params_.pass_counter_++;
@@ -249,7 +344,7 @@ int ImageFilm::nextPass(const RenderView *render_view, RenderControl &render_con
 
 	if(Y_LOG_HAS_DEBUG) Y_DEBUG << "nPass=" << n_pass_ << " imagesAutoSavePassCounter=" << images_auto_save_params_.pass_counter_ << " filmAutoSavePassCounter=" << film_load_save_.auto_save_.pass_counter_ << YENDL;
 
-	if(render_control.inProgress() && !session_global.isPreview())	//avoid saving images/film if we are just rendering material/world/lights preview windows, etc
+	if(render_control.inProgress() && !isPreview())	//avoid saving images/film if we are just rendering material/world/lights preview windows, etc
 	{
 		if((images_auto_save_params_.interval_type_ == ImageFilm::AutoSaveParams::IntervalType::Pass) && (images_auto_save_params_.pass_counter_ >= images_auto_save_params_.interval_passes_))
 		{
@@ -287,7 +382,8 @@ int ImageFilm::nextPass(const RenderView *render_view, RenderControl &render_con
 			}
 		}
 
-		for(int y = 0; y < height_ - 1; ++y)
+		if(!luminance_moments_.empty()) flagPixelsByVariance(sampling_factor_image_pass);
+		else for(int y = 0; y < height_ - 1; ++y)
 		{
 			for(int x = 0; x < width_ - 1; ++x)
 			{
@@ -391,7 +487,7 @@ int ImageFilm::nextPass(const RenderView *render_view, RenderControl &render_con
 				{
 					++n_resample;
 
-					if(session_global.isInteractive() && show_mask_)
+					if(isInteractive() && show_mask_)
 					{
 						float mat_sample_factor = 1.f;
 						const float weight = weights_(x, y).getFloat();
@@ -424,8 +520,9 @@ int ImageFilm::nextPass(const RenderView *render_view, RenderControl &render_con
 	{
 		n_resample = height_ * width_;
 	}
+	const int num_pass_pixels = setupPassAreas(!(adaptive_aa && aa_noise_params_.threshold_ > 0.f));
 
-	if(session_global.isInteractive())
+	if(isInteractive())
 	{
 		for(auto &output : outputs_)
 		{
@@ -441,7 +538,7 @@ int ImageFilm::nextPass(const RenderView *render_view, RenderControl &render_con
 
 	if(progress_bar_)
 	{
-		progress_bar_->init(width_ * height_);
+		progress_bar_->init(num_pass_pixels);
 		render_control.setCurrentPassPercent(progress_bar_->getPercent());
 		progress_bar_->setTag(pass_string.str().c_str());
 	}
@@ -450,7 +547,211 @@ int ImageFilm::nextPass(const RenderView *render_view, RenderControl &render_con
 	return n_resample;
 }
 
-bool ImageFilm::nextArea(RenderArea &a)
+void ImageFilm::flagPixelsByVariance(const Image *sampling_factor_image_pass)
+{
+	//the luminance of the combined samples has a weighted variance of moment / weight - mean^2, and their filter weights an effective number of samples of weight^2 / sum of the squared weights
+	const Image *combined_image = image_layers_(Layer::Combined).image_.get();
+	variance_sample_factors_.assign(static_cast<size_t>(width_) * height_, 1.f);
+	std::vector<size_t> error_pixels;
+	double error_sum = 0.0;
+	for(int y = 0; y < height_; ++y)
+	{
+		for(int x = 0; x < width_; ++x)
+		{
+			const size_t index = static_cast<size_t>(y) * width_ + x;
+			const float weight = weights_(x, y).getFloat();
+			const std::array<float, 2> &moments = luminance_moments_[index];
+			if(weight <= 0.f || moments[1] <= 0.f)
+			{
+				//not rendered yet or only loaded from a film file, without moments
+				flags_.set(x, y, true);
+				continue;
+			}
+			if(sampling_factor_image_pass && !background_resampling_ && sampling_factor_image_pass->getFloat(x, y) == 0.f) continue;
+			const Rgba pix_col = combined_image->getColor(x, y).normalized(weight);
+			const float pix_col_bri = pix_col.abscol2Bri();
+			const float mean = (pix_col.r_ + pix_col.g_ + pix_col.b_) / 3.f;
+			const float variance = std::max(0.f, moments[0] / weight - mean * mean);
+			const float error = std::sqrt(variance * moments[1]) / weight;
+			float aa_thresh_scaled = aa_noise_params_.threshold_;
+			if(aa_noise_params_.dark_detection_type_ == AaNoiseParams::DarkDetectionType::Linear && aa_noise_params_.dark_threshold_factor_ > 0.f) aa_thresh_scaled = aa_noise_params_.threshold_ * ((1.f - aa_noise_params_.dark_threshold_factor_) + (pix_col_bri * aa_noise_params_.dark_threshold_factor_));
+			else if(aa_noise_params_.dark_detection_type_ == AaNoiseParams::DarkDetectionType::Curve) aa_thresh_scaled = darkThresholdCurveInterpolate(pix_col_bri);
+			if(error < aa_thresh_scaled) continue;
+			flags_.set(x, y, true);
+			variance_sample_factors_[index] = error;
+			error_pixels.push_back(index);
+			error_sum += error;
+		}
+	}
+	if(error_pixels.empty()) return;
+	//the flagged pixels share the samples of the pass in proportion to their error, limited so no pixel gets too few or too many of them
+	constexpr float min_factor = 0.5f, max_factor = 4.f;
+	const float inv_mean_error = static_cast<float>(error_pixels.size() / error_sum);
+	for(const size_t index : error_pixels) variance_sample_factors_[index] = std::min(max_factor, std::max(min_factor, variance_sample_factors_[index] * inv_mean_error));
+}
+
+bool ImageFilm::setConvergenceReference(const std::string &file_path)
+{
+	ParamMap format_params;
+	format_params["type"] = toLower_global(Path(file_path).getExtension());
+	std::unique_ptr<Format> format = Format::factory(format_params);
+	if(!format)
+	{
+		Y_WARNING << "ImageFilm: Couldn't create the image handler of the convergence reference '" << file_path << "'" << YENDL;
+		return false;
+	}
+	std::unique_ptr<Image> image = format->loadFromFile(file_path, Image::Optimization::None, format->isHdr() ? LinearRgb : Srgb, 1.f);
+	if(!image)
+	{
+		Y_WARNING << "ImageFilm: Couldn't load the convergence reference '" << file_path << "'" << YENDL;
+		return false;
+	}
+	if(image->getWidth() != width_ || image->getHeight() != height_)
+	{
+		Y_WARNING << "ImageFilm: The convergence reference '" << file_path << "' is " << image->getWidth() << "x" << image->getHeight() << " but the render is " << width_ << "x" << height_ << ", the convergence will not be measured" << YENDL;
+		return false;
+	}
+	convergence_reference_ = std::move(image);
+	updateMemoryTracker();
+	Y_INFO << "ImageFilm: Measuring the convergence of each pass against the reference '" << file_path << "'" << YENDL;
+	return true;
+}
+
+void ImageFilm::measureConvergence()
+{
+	if(!convergence_reference_ || (!convergence_.empty() && convergence_.back().pass_ >= n_pass_)) return;
+	const auto start = std::chrono::steady_clock::now();
+	const Image *image = image_layers_(Layer::Combined).image_.get();
+	double sum_squared_error = 0.0, sum_relative_squared_error = 0.0;
+	for(int y = 0; y < height_; ++y)
+	{
+		for(int x = 0; x < width_; ++x)
+		{
+			const Rgb color = image->getColor(x, y).normalized(weights_(x, y).getFloat());
+			const Rgb reference = convergence_reference_->getColor(x, y);
+			for(const auto &channel : {std::make_pair(color.r_, reference.r_), std::make_pair(color.g_, reference.g_), std::make_pair(color.b_, reference.b_)})
+			{
+				const double error = static_cast<double>(channel.first) - channel.second;
+				sum_squared_error += error * error;
+				sum_relative_squared_error += error * error / (static_cast<double>(channel.second) * channel.second + 0.01);
+			}
+		}
+	}
+	const double num_values = 3.0 * width_ * height_;
+	ConvergencePass convergence_pass;
+	convergence_pass.pass_ = n_pass_;
+	convergence_pass.rmse_ = std::sqrt(sum_squared_error / num_values);
+	convergence_pass.rel_mse_ = sum_relative_squared_error / num_values;
+	const std::chrono::duration<double> pass_seconds = start - convergence_start_;
+	convergence_pass.seconds_ = pass_seconds.count() - convergence_measure_seconds_;
+	convergence_.push_back(convergence_pass);
+	const std::chrono::duration<double> measure_seconds = std::chrono::steady_clock::now() - start;
+	convergence_measure_seconds_ += measure_seconds.count();
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "ImageFilm: Convergence after pass " << n_pass_ << ": " << convergence_pass.seconds_ << "s, RMSE " << convergence_pass.rmse_ << ", relMSE " << convergence_pass.rel_mse_ << YENDL;
+}
+
+bool ImageFilm::isComputerNodeArea(const RenderArea &a) const
+{
+	if(num_computer_nodes_ <= 1) return true;
+	//The tiles are assigned by their position in the tiles grid and not by their order, as the order and the subdivision of the last tiles can be different in each node
+	const int num_tiles_x = (width_ + tile_size_ - 1) / tile_size_;
+	const int tile_index = ((a.y_ - cy_0_) / tile_size_) * num_tiles_x + (a.x_ - cx_0_) / tile_size_;
+	return static_cast<unsigned int>(tile_index) % num_computer_nodes_ == computer_node_;
+}
+
+int ImageFilm::setupPassAreas(bool all_pixels)
+{
+	if(!split_)
+	{
+		area_cnt_ = 1;
+		pass_pixels_ = width_ * height_;
+		return pass_pixels_;
+	}
+	//The areas without pixels flagged for more samples are skipped and the others are shrunk to the bounding box of their flagged pixels, so the late adaptive passes only pay for the pixels still being sampled
+	const int num_areas = splitter_->size();
+	pass_areas_.resize(num_areas);
+	pass_areas_left_.assign(num_areas + 1, 0);
+	area_cnt_ = 0;
+	int num_pass_pixels = 0;
+	RenderArea area;
+	for(int n = num_areas - 1; n >= 0; --n)
+	{
+		splitter_->getArea(n, area);
+		ImageSplitter::Region &pass_area = pass_areas_[n];
+		pass_area = {area.x_, area.y_, 0, 0};
+		if(isComputerNodeArea(area))
+		{
+			if(all_pixels) pass_area = {area.x_, area.y_, area.w_, area.h_};
+			else
+			{
+				int x_min = area.x_ + area.w_, y_min = area.y_ + area.h_, x_max = -1, y_max = -1;
+				for(int y = area.y_; y < area.y_ + area.h_; ++y)
+				{
+					for(int x = area.x_; x < area.x_ + area.w_; ++x)
+					{
+						if(!flags_.get(x - cx_0_, y - cy_0_)) continue;
+						x_min = std::min(x_min, x);
+						x_max = std::max(x_max, x);
+						y_min = std::min(y_min, y);
+						y_max = std::max(y_max, y);
+					}
+				}
+				if(x_max >= 0) pass_area = {x_min, y_min, x_max - x_min + 1, y_max - y_min + 1};
+			}
+		}
+		if(pass_area.w_ > 0)
+		{
+			++area_cnt_;
+			num_pass_pixels += pass_area.w_ * pass_area.h_;
+		}
+		pass_areas_left_[n] = area_cnt_;
+	}
+	//With the curve orders each render thread is given the same contiguous range of areas in every pass, so it renders again the part of the image whose geometry and textures are still in its caches
+	thread_areas_.clear();
+	if(num_threads_ > 1 && splitter_->isCurveOrder())
+	{
+		thread_areas_.resize(num_threads_);
+		for(int thread_id = 0; thread_id < num_threads_; ++thread_id) thread_areas_[thread_id] = {num_areas * thread_id / num_threads_, num_areas * (thread_id + 1) / num_threads_};
+	}
+	pass_pixels_ = num_pass_pixels;
+	return num_pass_pixels;
+}
+
+int ImageFilm::passAreasLeft() const
+{
+	const int num_areas = splitter_->size();
+	if(thread_areas_.empty()) return pass_areas_left_[std::min(static_cast<int>(next_area_), num_areas)];
+	int areas_left = 0;
+	for(const auto &thread_areas : thread_areas_) areas_left += pass_areas_left_[thread_areas.first] - pass_areas_left_[thread_areas.second];
+	return areas_left;
+}
+
+int ImageFilm::nextThreadArea(int thread_id)
+{
+	//The areas are taken from the start of the thread range, and once it is exhausted the last area of the range with more areas left is stolen, so the other thread keeps the areas nearest to the ones it is rendering
+	if(thread_id >= 0 && thread_id < static_cast<int>(thread_areas_.size()))
+	{
+		std::pair<int, int> &own_areas = thread_areas_[thread_id];
+		while(own_areas.first < own_areas.second && pass_areas_[own_areas.first].w_ <= 0) ++own_areas.first;
+		if(own_areas.first < own_areas.second) return own_areas.first++;
+	}
+	std::pair<int, int> *victim_areas = nullptr;
+	int victim_areas_left = 0;
+	for(auto &thread_areas : thread_areas_)
+	{
+		const int areas_left = pass_areas_left_[thread_areas.first] - pass_areas_left_[thread_areas.second];
+		if(areas_left > victim_areas_left)
+		{
+			victim_areas = &thread_areas;
+			victim_areas_left = areas_left;
+		}
+	}
+	if(!victim_areas) return -1;
+	while(pass_areas_[victim_areas->second - 1].w_ <= 0) --victim_areas->second;
+	return --victim_areas->second;
+}
+
+bool ImageFilm::nextArea(RenderArea &a, int thread_id)
 {
 	if(abort_) return false;
 
@@ -458,19 +759,84 @@ bool ImageFilm::nextArea(RenderArea &a)
 
 	if(split_)
 	{
-		int n;
+		bool area_found = false;
 		splitter_mutex_.lock();
-		n = next_area_++;
+		if(!dynamic_split_areas_.empty())
+		{
+			const ImageSplitter::Region &region = dynamic_split_areas_.back();
+			a.x_ = region.x_;
+			a.y_ = region.y_;
+			a.w_ = region.w_;
+			a.h_ = region.h_;
+			dynamic_split_areas_.pop_back();
+			area_found = true;
+		}
+		else if(!thread_areas_.empty())
+		{
+			const int area_index = nextThreadArea(thread_id);
+			area_found = splitter_->getArea(area_index, a);
+			if(area_found)
+			{
+				const ImageSplitter::Region &pass_area = pass_areas_[area_index];
+				a.x_ = pass_area.x_;
+				a.y_ = pass_area.y_;
+				a.w_ = pass_area.w_;
+				a.h_ = pass_area.h_;
+			}
+		}
+		else
+		{
+			int area_index = 0;
+			do
+			{
+				area_index = next_area_++;
+				area_found = splitter_->getArea(area_index, a);
+			}
+			while(area_found && pass_areas_[area_index].w_ <= 0);
+			if(area_found)
+			{
+				const ImageSplitter::Region &pass_area = pass_areas_[area_index];
+				a.x_ = pass_area.x_;
+				a.y_ = pass_area.y_;
+				a.w_ = pass_area.w_;
+				a.h_ = pass_area.h_;
+			}
+		}
+		if(area_found && num_threads_ > 1)
+		{
+			//When there are less areas left than threads, the area is split in halves, so the threads that would be idle at the end of the pass can take the other halves
+			int areas_left = passAreasLeft() + static_cast<int>(dynamic_split_areas_.size());
+			while(areas_left < num_threads_ && std::max(a.w_, a.h_) >= 2 * min_dynamic_split_size_global)
+			{
+				ImageSplitter::Region other_half;
+				if(a.w_ >= a.h_)
+				{
+					const int half_w = a.w_ / 2;
+					other_half = {a.x_ + half_w, a.y_, a.w_ - half_w, a.h_};
+					a.w_ = half_w;
+				}
+				else
+				{
+					const int half_h = a.h_ / 2;
+					other_half = {a.x_, a.y_ + half_h, a.w_, a.h_ - half_h};
+					a.h_ = half_h;
+				}
+				dynamic_split_areas_.push_back(other_half);
+				++num_dynamic_split_areas_;
+				++areas_left;
+			}
+		}
 		splitter_mutex_.unlock();
 
-		if(splitter_->getArea(n, a))
+		if(area_found)
 		{
 			a.sx_0_ = a.x_ + ifilterw;
 			a.sx_1_ = a.x_ + a.w_ - ifilterw;
 			a.sy_0_ = a.y_ + ifilterw;
 			a.sy_1_ = a.y_ + a.h_ - ifilterw;
+			initAreaAccumulation(a);
 
-			if(session_global.isInteractive())
+			if(isInteractive())
 			{
 				out_mutex_.lock();
 				int end_x = a.x_ + a.w_, end_y = a.y_ + a.h_;
@@ -494,19 +860,116 @@ bool ImageFilm::nextArea(RenderArea &a)
 		a.sx_1_ = a.x_ + a.w_ - ifilterw;
 		a.sy_0_ = a.y_ + ifilterw;
 		a.sy_1_ = a.y_ + a.h_ - ifilterw;
+		initAreaAccumulation(a);
 		++area_cnt_;
 		return true;
 	}
 	return false;
 }
 
+void ImageFilm::initAreaAccumulation(RenderArea &a) const
+{
+	const int ifilterw = (int) ceil(filterw_);
+	RenderArea::Accumulation &accumulation = a.accumulation_;
+	accumulation.x_0_ = std::max(cx_0_, a.x_ - ifilterw);
+	accumulation.y_0_ = std::max(cy_0_, a.y_ - ifilterw);
+	accumulation.w_ = std::min(cx_1_, a.x_ + a.w_ + ifilterw) - accumulation.x_0_;
+	accumulation.h_ = std::min(cy_1_, a.y_ + a.h_ + ifilterw) - accumulation.y_0_;
+	const size_t num_pixels = static_cast<size_t>(accumulation.w_) * accumulation.h_;
+	accumulation.modified_ = false;
+	accumulation.weights_.assign(num_pixels, 0.f);
+	accumulation.colors_.assign(num_pixels * image_layers_.size(), Rgba(0.f));
+	accumulation.moments_.assign(luminance_moments_.empty() ? 0 : num_pixels, {{0.f, 0.f}});
+}
+
+void ImageFilm::mergeAreaAccumulation(RenderArea &a)
+{
+	RenderArea::Accumulation &accumulation = a.accumulation_;
+	const size_t num_pixels = accumulation.weights_.size();
+	if(num_pixels == 0) return;
+	if(!accumulation.modified_)
+	{
+		accumulation.weights_.clear();
+		accumulation.colors_.clear();
+		accumulation.moments_.clear();
+		return;
+	}
+
+	image_mutex_.lock();
+	for(int j = 0; j < accumulation.h_; ++j)
+	{
+		const int y = accumulation.y_0_ + j - cy_0_;
+		for(int i = 0; i < accumulation.w_; ++i)
+		{
+			const int x = accumulation.x_0_ + i - cx_0_;
+			const size_t index = static_cast<size_t>(j) * accumulation.w_ + i;
+			weights_(x, y).setFloat(weights_(x, y).getFloat() + accumulation.weights_[index]);
+			if(!accumulation.moments_.empty())
+			{
+				std::array<float, 2> &moments = luminance_moments_[static_cast<size_t>(y) * width_ + x];
+				moments[0] += accumulation.moments_[index][0];
+				moments[1] += accumulation.moments_[index][1];
+			}
+			const Rgba *pixel_colors = &accumulation.colors_[index * image_layers_.size()];
+			size_t layer = 0;
+			for(auto &it : image_layers_)
+			{
+				if(!point_sampled_layers_[layer++]) it.second.image_->setColor(x, y, it.second.image_->getColor(x, y) + *pixel_colors);
+				++pixel_colors;
+			}
+		}
+	}
+	markFilmChunksModified(accumulation.x_0_ - cx_0_, accumulation.y_0_ - cy_0_, accumulation.x_0_ + accumulation.w_ - 1 - cx_0_, accumulation.y_0_ + accumulation.h_ - 1 - cy_0_);
+	image_mutex_.unlock();
+
+	//Cleared so the samples are not merged again if the area is finished more than once
+	accumulation.weights_.clear();
+	accumulation.colors_.clear();
+	accumulation.moments_.clear();
+}
+
+template <typename PixelColorFunc>
+bool ImageFilm::putOutputsTile(int x_0, int y_0, int width, int height, const Layers &layers, bool include_image_outputs, const PixelColorFunc &pixel_color)
+{
+	const size_t num_pixels = static_cast<size_t>(width) * height;
+	output_tile_colors_.resize(num_pixels * layers.size());
+	std::vector<ColorLayerTile> color_layers_tiles;
+	color_layers_tiles.reserve(layers.size());
+	size_t layer_offset = 0;
+	for(const auto &layer : layers)
+	{
+		const Layer::Type layer_type = layer.first;
+		Rgba *colors = &output_tile_colors_[layer_offset];
+		const ImageLayer *image_layer = image_layers_.find(layer_type);
+		for(int j = 0; j < height; ++j)
+		{
+			for(int i = 0; i < width; ++i)
+			{
+				colors[j * width + i] = image_layer ? pixel_color(layer_type, *image_layer->image_, x_0 + i, y_0 + j) : Layer::getDefaultColor(layer_type);
+			}
+		}
+		color_layers_tiles.emplace_back(layer_type, colors, width);
+		layer_offset += num_pixels;
+	}
+
+	bool result = true;
+	for(auto &output : outputs_)
+	{
+		if(output.second && (include_image_outputs || !output.second->isImageOutput()))
+		{
+			if(!output.second->putTile(x_0, y_0, width, height, color_layers_tiles)) result = false;
+		}
+	}
+	return result;
+}
+
 void ImageFilm::finishArea(const RenderView *render_view, RenderControl &render_control, RenderArea &a)
 {
+	mergeAreaAccumulation(a);
+
 	out_mutex_.lock();
 	int end_x = a.x_ + a.w_ - cx_0_, end_y = a.y_ + a.h_ - cy_0_;
 
-	ColorLayers color_layers(layers_);
-
 	if(layers_.isDefined(Layer::DebugFacesEdges))
 	{
 		generateDebugFacesEdges(a.x_ - cx_0_, end_x, a.y_ - cy_0_, end_y, true);
@@ -517,43 +980,28 @@ void ImageFilm::finishArea(const RenderView *render_view, RenderControl &render_
 		generateToonAndDebugObjectEdges(a.x_ - cx_0_, end_x, a.y_ - cy_0_, end_y, true);
 	}
 
-	for(int j = a.y_ - cy_0_; j < end_y; ++j)
+	//The pixels of the areas of the last pass are not rendered again, so the outputs can save them already
+	const bool final_areas = render_control.totalPasses() > 0 && render_control.currentPass() >= render_control.totalPasses();
+	for(auto &output : outputs_) if(output.second) output.second->setFinalAreas(final_areas);
+	const bool outputs_ok = putOutputsTile(a.x_ - cx_0_, a.y_ - cy_0_, a.w_, a.h_, layers_, false, [this](Layer::Type layer_type, const Image &image, int i, int j)
 	{
-		for(int i = a.x_ - cx_0_; i < end_x; ++i)
+		const float weight = weights_(i, j).getFloat();
+		if(layer_type == Layer::AaSamples) return Rgba(weight);
+		Rgba color = Layer::isPointSampled(layer_type) ? Rgba(image.getColor(i, j), 1.f) : image.getColor(i, j).normalized(weight);
+		if(layer_type == Layer::ObjIndexAbs ||
+				layer_type == Layer::ObjIndexAutoAbs ||
+				layer_type == Layer::MatIndexAbs ||
+				layer_type == Layer::MatIndexAutoAbs
+		  )
 		{
-			const float weight = weights_(i, j).getFloat();
-			for(const auto &it : image_layers_)
-			{
-				const Layer::Type layer_type = it.first;
-				if(layer_type == Layer::AaSamples)
-				{
-					color_layers(layer_type).color_ = weight;
-				}
-				else if(layer_type == Layer::ObjIndexAbs ||
-						layer_type == Layer::ObjIndexAutoAbs ||
-						layer_type == Layer::MatIndexAbs ||
-						layer_type == Layer::MatIndexAutoAbs
-						)
-				{
-					color_layers(layer_type).color_ = it.second.image_->getColor(i, j).normalized(weight);
-					color_layers(layer_type).color_.ceil(); //To correct the antialiasing and ceil the "mixed" values to the upper integer
-				}
-				else
-				{
-					color_layers(layer_type).color_ = it.second.image_->getColor(i, j).normalized(weight);
-				}
-			}
-			for(auto &output : outputs_)
-			{
-				if(output.second && !output.second->isImageOutput())
-				{
-					if(!output.second->putPixel(i, j, color_layers)) abort_ = true;
-				}
-			}
+			color.ceil(); //To correct the antialiasing and ceil the "mixed" values to the upper integer
 		}
-	}
+		return color;
+	});
+	if(!outputs_ok) abort_ = true;
+	for(auto &output : outputs_) if(output.second) output.second->setFinalAreas(false);
 
-	if(session_global.isInteractive())
+	if(isInteractive())
 	{
 		for(auto &output : outputs_)
 		{
@@ -563,18 +1011,19 @@ void ImageFilm::finishArea(const RenderView *render_view, RenderControl &render_
 			}
 		}
 	}
+	render_control.notifyAreaFinished(a.x_, a.y_, end_x + cx_0_, end_y + cy_0_);
 
-	if(render_control.inProgress() && !session_global.isPreview())	//avoid saving images/film if we are just rendering material/world/lights preview windows, etc
+	if(render_control.inProgress() && !isPreview())	//avoid saving images/film if we are just rendering material/world/lights preview windows, etc
 	{
-		g_timer_global.stop("imagesAutoSaveTimer");
-		images_auto_save_params_.timer_ += g_timer_global.getTime("imagesAutoSaveTimer");
+		render_control.getTimer().stop("imagesAutoSaveTimer");
+		images_auto_save_params_.timer_ += render_control.getTimer().getTime("imagesAutoSaveTimer");
 		if(images_auto_save_params_.timer_ < 0.f) resetImagesAutoSaveTimer(); //to solve some strange very negative value when using yafaray-xml, race condition somewhere?
-		g_timer_global.start("imagesAutoSaveTimer");
+		render_control.getTimer().start("imagesAutoSaveTimer");
 
-		g_timer_global.stop("filmAutoSaveTimer");
-		film_load_save_.auto_save_.timer_ += g_timer_global.getTime("filmAutoSaveTimer");
+		render_control.getTimer().stop("filmAutoSaveTimer");
+		film_load_save_.auto_save_.timer_ += render_control.getTimer().getTime("filmAutoSaveTimer");
 		if(film_load_save_.auto_save_.timer_ < 0.f) resetFilmAutoSaveTimer(); //to solve some strange very negative value when using yafaray-xml, race condition somewhere?
-		g_timer_global.start("filmAutoSaveTimer");
+		render_control.getTimer().start("filmAutoSaveTimer");
 
 		if((images_auto_save_params_.interval_type_ == ImageFilm::AutoSaveParams::IntervalType::Time) && (images_auto_save_params_.timer_ > images_auto_save_params_.interval_seconds_))
 		{
@@ -593,7 +1042,7 @@ void ImageFilm::finishArea(const RenderView *render_view, RenderControl &render_
 
 	if(progress_bar_)
 	{
-		if(++completed_cnt_ == area_cnt_) progress_bar_->done();
+		if(++completed_cnt_ == area_cnt_ + num_dynamic_split_areas_) progress_bar_->done();
 		else progress_bar_->update(a.w_ * a.h_);
 		render_control.setCurrentPassPercent(progress_bar_->getPercent());
 	}
@@ -611,7 +1060,8 @@ void ImageFilm::flush(const RenderView *render_view, const RenderControl &render
 
 	float density_factor = 0.f;
 
-	if(estimate_density_ && num_density_samples_ > 0) density_factor = (float) (width_ * height_) / (float) num_density_samples_;
+	const int num_density_samples = num_density_samples_.load(std::memory_order_relaxed);
+	if(estimate_density_ && num_density_samples > 0) density_factor = (float) (width_ * height_) / (float) num_density_samples;
 
 	const Layers layers = layers_.getLayersWithImages();
 	if(layers.isDefined(Layer::DebugFacesEdges))
@@ -623,42 +1073,36 @@ void ImageFilm::flush(const RenderView *render_view, const RenderControl &render
 		generateToonAndDebugObjectEdges(0, width_, 0, height_, false);
 	}
 
-	ColorLayers color_layers(layers);
-	for(int j = 0; j < height_; j++)
+	std::vector<Rgb> denoised_colors;
+	if(denoise_params_.enabled_ && (flags & RegularImage) && (render_control.finished() || denoise_params_.intermediate_)) denoised_colors = getDenoisedCombined();
+
+	//Output in bands of rows, to limit the memory used by the temporary tiles
+	for(int y_0 = 0; y_0 < height_; y_0 += tile_size_)
 	{
-		for(int i = 0; i < width_; i++)
+		putOutputsTile(0, y_0, width_, std::min(tile_size_, height_ - y_0), layers, true, [this, flags, density_factor, &denoised_colors](Layer::Type layer_type, const Image &image, int i, int j)
 		{
 			const float weight = weights_(i, j).getFloat();
-			for(const auto &it : image_layers_)
+			Rgba color(0.f);
+			if(layer_type == Layer::AaSamples)
 			{
-				const Layer::Type layer_type = it.first;
-				if(layer_type == Layer::AaSamples)
-				{
-					color_layers(layer_type).color_ = it.second.image_->getColor(i, j).normalized(weight);
-				}
-				else if(layer_type == Layer::ObjIndexAbs ||
-						layer_type == Layer::ObjIndexAutoAbs ||
-						layer_type == Layer::MatIndexAbs ||
-						layer_type == Layer::MatIndexAutoAbs
-						)
-				{
-					color_layers(layer_type).color_ = it.second.image_->getColor(i, j).normalized(weight);
-					color_layers(layer_type).color_.ceil(); //To correct the antialiasing and ceil the "mixed" values to the upper integer
-				}
-				else
-				{
-					if(flags & RegularImage) color_layers(layer_type).color_ = it.second.image_->getColor(i, j).normalized(weight);
-					else color_layers(layer_type).color_ = Rgba(0.f);
-				}
-
-				if(estimate_density_ && (flags & Densityimage) && layer_type == Layer::Combined && density_factor > 0.f) color_layers(layer_type).color_ += Rgba((*density_image_)(i, j) * density_factor, 0.f);
+				color = image.getColor(i, j).normalized(weight);
 			}
-
-			for(auto &output : outputs_)
+			else if(layer_type == Layer::ObjIndexAbs ||
+					layer_type == Layer::ObjIndexAutoAbs ||
+					layer_type == Layer::MatIndexAbs ||
+					layer_type == Layer::MatIndexAutoAbs
+				   )
 			{
-				if(output.second) output.second->putPixel(i, j, color_layers);
+				color = Rgba(image.getColor(i, j), 1.f);
+				color.ceil(); //To correct the antialiasing and ceil the "mixed" values to the upper integer
 			}
-		}
+			else if(Layer::isPointSampled(layer_type)) color = Rgba(image.getColor(i, j), 1.f);
+			else if(layer_type == Layer::Combined && !denoised_colors.empty()) color = Rgba(denoised_colors[static_cast<size_t>(j) * width_ + i], image.getColor(i, j).normalized(weight).a_);
+			else if(flags & RegularImage) color = image.getColor(i, j).normalized(weight);
+
+			if(estimate_density_ && (flags & Densityimage) && layer_type == Layer::Combined && density_factor > 0.f) color += Rgba(getDensityColor(i, j) * density_factor, 0.f);
+			return color;
+		});
 	}
 
 	for(auto &output : outputs_)
@@ -690,13 +1134,13 @@ void ImageFilm::flush(const RenderView *render_view, const RenderControl &render
 
 	if(render_control.finished())
 	{
-		if(!session_global.isPreview() && (film_load_save_.mode_ == FilmLoadSave::LoadAndSave || film_load_save_.mode_ == FilmLoadSave::Save))
+		if(!isPreview() && (film_load_save_.mode_ == FilmLoadSave::LoadAndSave || film_load_save_.mode_ == FilmLoadSave::Save))
 		{
 			imageFilmSave();
 		}
 
-		g_timer_global.stop("imagesAutoSaveTimer");
-		g_timer_global.stop("filmAutoSaveTimer");
+		render_control.getTimer().stop("imagesAutoSaveTimer");
+		render_control.getTimer().stop("filmAutoSaveTimer");
 
 		logger_global.clearMemoryLog();
 		out_mutex_.unlock();
@@ -704,6 +1148,44 @@ void ImageFilm::flush(const RenderView *render_view, const RenderControl &render
 	}
 }
 
+std::vector<Rgb> ImageFilm::getDenoisedCombined() const
+{
+	const size_t num_pixels = static_cast<size_t>(width_) * height_;
+	std::vector<Rgb> colors(num_pixels);
+	FilmDenoiser::Features features;
+	const Image *combined_image = image_layers_(Layer::Combined).image_.get();
+	const ImageLayer *normal_layer = image_layers_.find(Layer::NormalSmooth);
+	const ImageLayer *albedo_layer = image_layers_.find(Layer::DiffuseColor);
+	const ImageLayer *depth_layer = image_layers_.find(Layer::ZDepthAbs);
+	if(normal_layer) features.normals_.resize(num_pixels);
+	if(albedo_layer) features.albedo_.resize(num_pixels);
+	if(depth_layer) features.depth_.resize(num_pixels);
+	for(int j = 0; j < height_; ++j)
+	{
+		for(int i = 0; i < width_; ++i)
+		{
+			const size_t pixel = static_cast<size_t>(j) * width_ + i;
+			const float weight = weights_(i, j).getFloat();
+			colors[pixel] = combined_image->getColor(i, j).normalized(weight);
+			if(normal_layer)
+			{
+				//The normals are stored as (n + 1) / 2 with alpha 1 on the surfaces, so the background and the pixel coverage give shorter normals
+				const Rgba normal_color = normal_layer->image_->getColor(i, j).normalized(weight);
+				features.normals_[pixel] = Vec3(2.f * normal_color.r_ - normal_color.a_, 2.f * normal_color.g_ - normal_color.a_, 2.f * normal_color.b_ - normal_color.a_);
+			}
+			if(albedo_layer) features.albedo_[pixel] = albedo_layer->image_->getColor(i, j).normalized(weight);
+			if(depth_layer)
+			{
+				const Rgba depth_color = depth_layer->image_->getColor(i, j).normalized(weight);
+				features.depth_[pixel] = depth_color.a_ > 0.f ? depth_color.r_ / depth_color.a_ : 0.f;
+			}
+		}
+	}
+	const FilmDenoiser denoiser(denoise_params_, num_threads_);
+	denoiser.denoise(colors, features, width_, height_, tile_size_);
+	return colors;
+}
+
 bool ImageFilm::doMoreSamples(int x, int y) const
 {
 	return aa_noise_params_.threshold_ <= 0.f || flags_.get(x - cx_0_, y - cy_0_);
@@ -711,8 +1193,10 @@ bool ImageFilm::doMoreSamples(int x, int y) const
 
 /* CAUTION! Implemantation of this function needs to be thread safe for samples that
 	contribute to pixels outside the area a AND pixels that might get
-	contributions from outside area a! (yes, really!) */
-void ImageFilm::addSample(int x, int y, float dx, float dy, const RenderArea *a, int num_sample, int aa_pass_number, float inv_aa_max_possible_samples, ColorLayers *color_layers)
+	contributions from outside area a! (yes, really!)
+	The samples of the area a, including the pixels in the filter border around it, are accumulated
+	without locking into the thread-private area buffer, so only the samples outside it lock the film */
+void ImageFilm::addSample(int x, int y, float dx, float dy, RenderArea *a, int num_sample, int aa_pass_number, float inv_aa_max_possible_samples, ColorLayers *color_layers)
 {
 	int dx_0, dx_1, dy_0, dy_1, x_0, x_1, y_0, y_1;
 
@@ -745,28 +1229,118 @@ void ImageFilm::addSample(int x, int y, float dx, float dy, const RenderArea *a,
 	x_0 = x + dx_0; x_1 = x + dx_1;
 	y_0 = y + dy_0; y_1 = y + dy_1;
 
+	// filter weights of all the covered pixels, computed once per sample and shared by all the layers
+	const int filter_w = x_1 - x_0 + 1;
+	const int filter_h = y_1 - y_0 + 1;
+	float filter_weights[(max_filter_size_global + 1) * (max_filter_size_global + 1)];
+	if(filter_table_1d_)
+	{
+		float x_weights[max_filter_size_global + 1], y_weights[max_filter_size_global + 1];
+		for(int i = 0; i < filter_w; ++i) x_weights[i] = filter_table_1d_[x_index[i]];
+		for(int j = 0; j < filter_h; ++j) y_weights[j] = filter_table_1d_[y_index[j]];
+		for(int j = 0; j < filter_h; ++j)
+		{
+			for(int i = 0; i < filter_w; ++i) filter_weights[j * filter_w + i] = y_weights[j] * x_weights[i];
+		}
+	}
+	else
+	{
+		for(int j = 0; j < filter_h; ++j)
+		{
+			for(int i = 0; i < filter_w; ++i) filter_weights[j * filter_w + i] = filter_table_[y_index[j] * filter_table_size_global + x_index[i]];
+		}
+	}
+
+	// clamped sample colors of all the layers, in the image layers order
+	const size_t num_layers = image_layers_.size();
+	std::vector<Rgba> &sample_colors = sample_colors_global;
+	sample_colors.resize(num_layers);
+	size_t layer = 0;
+	for(const auto &it : image_layers_)
+	{
+		Rgba col = color_layers ? (*color_layers)(it.first).color_ : 0.f;
+		col.clampProportionalRgb(aa_noise_params_.clamp_samples_);
+		sample_colors[layer++] = col;
+	}
+
+	//the combined layer is the first image layer, as they are sorted by type
+	const bool add_moments = !luminance_moments_.empty();
+	const float sample_luminance = add_moments ? (sample_colors[0].r_ + sample_colors[0].g_ + sample_colors[0].b_) / 3.f : 0.f;
+	const float sample_luminance_2 = sample_luminance * sample_luminance;
+
+	//The point sampled layers are not filtered, the first sample with a value is written in the sample pixel
+	bool has_point_sampled_layers = false;
+	for(const bool point_sampled : point_sampled_layers_) has_point_sampled_layers = has_point_sampled_layers || point_sampled;
+	const auto set_point_sampled_colors = [&]()
+	{
+		size_t point_layer = 0;
+		for(auto &it : image_layers_)
+		{
+			const Rgba &col = sample_colors[point_layer];
+			if(point_sampled_layers_[point_layer++] && !isBlack_global(col) && isBlack_global(it.second.image_->getColor(x - cx_0_, y - cy_0_))) it.second.image_->setColor(x - cx_0_, y - cy_0_, col);
+		}
+	};
+
+	if(a && !a->accumulation_.weights_.empty())
+	{
+		RenderArea::Accumulation &accumulation = a->accumulation_;
+		if(x_0 >= accumulation.x_0_ && x_1 < accumulation.x_0_ + accumulation.w_ && y_0 >= accumulation.y_0_ && y_1 < accumulation.y_0_ + accumulation.h_)
+		{
+			accumulation.modified_ = true;
+			if(has_point_sampled_layers) set_point_sampled_colors(); //the pixels of the render area are only sampled by the thread rendering it, and the merges of the areas skip these layers
+			const Rgba *sample_colors_data = sample_colors.data();
+			for(int j = 0; j < filter_h; ++j)
+			{
+				const size_t row_index = static_cast<size_t>(y_0 + j - accumulation.y_0_) * accumulation.w_ + (x_0 - accumulation.x_0_);
+				for(int i = 0; i < filter_w; ++i)
+				{
+					const float filter_wt = filter_weights[j * filter_w + i];
+					const size_t index = row_index + i;
+					accumulation.weights_[index] += filter_wt;
+					if(add_moments)
+					{
+						accumulation.moments_[index][0] += filter_wt * sample_luminance_2;
+						accumulation.moments_[index][1] += filter_wt * filter_wt;
+					}
+					Rgba *pixel_colors = &accumulation.colors_[index * num_layers];
+					if(has_point_sampled_layers)
+					{
+						for(size_t l = 0; l < num_layers; ++l) if(!point_sampled_layers_[l]) pixel_colors[l] += sample_colors_data[l] * filter_wt;
+					}
+					else if(num_layers == 1) pixel_colors[0] += sample_colors_data[0] * filter_wt; //only the combined layer, the most common case
+					else for(size_t l = 0; l < num_layers; ++l) pixel_colors[l] += sample_colors_data[l] * filter_wt;
+				}
+			}
+			return;
+		}
+	}
+
 	image_mutex_.lock();
 
+	if(has_point_sampled_layers) set_point_sampled_colors();
 	for(int j = y_0; j <= y_1; ++j)
 	{
 		for(int i = x_0; i <= x_1; ++i)
 		{
-			// get filter value at pixel (x,y)
-			const int offset = y_index[j - y_0] * filter_table_size_global + x_index[i - x_0];
-			const float filter_wt = filter_table_[offset];
+			const float filter_wt = filter_weights[(j - y_0) * filter_w + (i - x_0)];
 			weights_(i - cx_0_, j - cy_0_).setFloat(weights_(i - cx_0_, j - cy_0_).getFloat() + filter_wt);
+			if(add_moments)
+			{
+				std::array<float, 2> &moments = luminance_moments_[static_cast<size_t>(j - cy_0_) * width_ + (i - cx_0_)];
+				moments[0] += filter_wt * sample_luminance_2;
+				moments[1] += filter_wt * filter_wt;
+			}
 
 			// update pixel values with filtered sample contribution
+			layer = 0;
 			for(auto &it : image_layers_)
 			{
-				Rgba col = color_layers ? (*color_layers)(it.first).color_ : 0.f;
-
-				col.clampProportionalRgb(aa_noise_params_.clamp_samples_);
-
-				it.second.image_->setColor(i - cx_0_, j - cy_0_, it.second.image_->getColor(i - cx_0_, j - cy_0_) + (col * filter_wt));
+				if(!point_sampled_layers_[layer]) it.second.image_->setColor(i - cx_0_, j - cy_0_, it.second.image_->getColor(i - cx_0_, j - cy_0_) + (sample_colors[layer] * filter_wt));
+				++layer;
 			}
 		}
 	}
+	markFilmChunksModified(x_0 - cx_0_, y_0 - cy_0_, x_1 - cx_0_, y_1 - cy_0_);
 
 	image_mutex_.unlock();
 }
@@ -804,38 +1378,38 @@ void ImageFilm::addDensitySample(const Rgb &c, int x, int y, float dx, float dy,
 	x_0 = x + dx_0; x_1 = x + dx_1;
 	y_0 = y + dy_0; y_1 = y + dy_1;
 
-	density_image_mutex_.lock();
-
 	for(int j = y_0; j <= y_1; ++j)
 	{
 		for(int i = x_0; i <= x_1; ++i)
 		{
 			int offset = y_index[j - y_0] * filter_table_size_global + x_index[i - x_0];
 
-			Rgb &pixel = (*density_image_)(i - cx_0_, j - cy_0_);
-			pixel += c * filter_table_[offset];
+			//Only the light tracing threads splatting to the same pixel at once contend, instead of all of them for a film lock
+			std::atomic<float> *pixel = &density_image_[3 * (static_cast<size_t>(j - cy_0_) * width_ + (i - cx_0_))];
+			const float weight = filter_table_[offset];
+			atomicAdd_global(pixel[0], c.r_ * weight);
+			atomicAdd_global(pixel[1], c.g_ * weight);
+			atomicAdd_global(pixel[2], c.b_ * weight);
 		}
 	}
 
-	++num_density_samples_;
-
-	density_image_mutex_.unlock();
+	num_density_samples_.fetch_add(1, std::memory_order_relaxed);
 }
 
 void ImageFilm::setDensityEstimation(bool enable)
 {
-	if(enable)
-	{
-		if(!density_image_) density_image_ = std::unique_ptr<ImageBuffer2D<Rgb>>(new ImageBuffer2D<Rgb>(width_, height_));
-		else density_image_->clear();
-	}
-	else
-	{
-		density_image_ = nullptr;
-	}
+	if(enable) clearDensityImage();
+	else density_image_ = nullptr;
 	estimate_density_ = enable;
 }
 
+void ImageFilm::clearDensityImage()
+{
+	const size_t num_values = 3 * static_cast<size_t>(width_) * height_;
+	if(!density_image_) density_image_ = std::unique_ptr<std::atomic<float>[]>(new std::atomic<float>[num_values]);
+	for(size_t i = 0; i < num_values; ++i) density_image_[i].store(0.f, std::memory_order_relaxed);
+}
+
 void ImageFilm::setProgressBar(std::shared_ptr<ProgressBar> pb)
 {
 	progress_bar_ = std::move(pb);
@@ -869,6 +1443,16 @@ std::string ImageFilm::getFilmPath() const
 	return film_path;
 }
 
+std::string ImageFilm::getCheckpointPath(const std::string &view_name) const
+{
+	std::stringstream node;
+	node << std::setfill('0') << std::setw(4) << computer_node_;
+	std::string checkpoint_path = checkpoint_params_.path_ + " - node " + node.str();
+	if(!view_name.empty()) checkpoint_path += " - view " + view_name;
+	checkpoint_path += ".checkpoint";
+	return checkpoint_path;
+}
+
 bool ImageFilm::imageFilmLoad(const std::string &filename)
 {
 	Y_INFO << "imageFilm: Loading film from: \"" << filename << YENDL;
@@ -880,101 +1464,129 @@ bool ImageFilm::imageFilmLoad(const std::string &filename)
 		return false;
 	}
 
-	std::string header;
-	file.read(header);
-	if(header != "YAF_FILMv4_0_0")
+	FilmFileHeader loaded_header;
+	if(!loaded_header.read(file))
 	{
 		Y_WARNING << "imageFilm file '" << filename << "' does not contain a valid YafaRay image file";
 		file.close();
 		return false;
 	}
-	file.read<unsigned int>(computer_node_);
-	file.read<unsigned int>(base_sampling_offset_);
-	file.read<unsigned int>(sampling_offset_);
+	const bool chunked_format = loaded_header.isChunked();
+	const unsigned int loaded_base_sampling_offset = loaded_header.base_sampling_offset_;
+	const unsigned int loaded_sampling_offset = loaded_header.sampling_offset_;
 
-	int filmload_check_w;
-	file.read<int>(filmload_check_w);
+	const int filmload_check_w = loaded_header.width_;
 	if(filmload_check_w != width_)
 	{
 		Y_WARNING << "imageFilm: loading/reusing film check failed. Image width, expected=" << width_ << ", in reused/loaded film=" << filmload_check_w << YENDL;
 		return false;
 	}
 
-	int filmload_check_h;
-	file.read<int>(filmload_check_h);
+	const int filmload_check_h = loaded_header.height_;
 	if(filmload_check_h != height_)
 	{
 		Y_WARNING << "imageFilm: loading/reusing film check failed. Image height, expected=" << height_ << ", in reused/loaded film=" << filmload_check_h << YENDL;
 		return false;
 	}
 
-	int filmload_check_cx_0;
-	file.read<int>(filmload_check_cx_0);
+	const int filmload_check_cx_0 = loaded_header.cx_0_;
 	if(filmload_check_cx_0 != cx_0_)
 	{
 		Y_WARNING << "imageFilm: loading/reusing film check failed. Border cx0, expected=" << cx_0_ << ", in reused/loaded film=" << filmload_check_cx_0 << YENDL;
 		return false;
 	}
 
-	int filmload_check_cx_1;
-	file.read<int>(filmload_check_cx_1);
+	const int filmload_check_cx_1 = loaded_header.cx_1_;
 	if(filmload_check_cx_1 != cx_1_)
 	{
 		Y_WARNING << "imageFilm: loading/reusing film check failed. Border cx1, expected=" << cx_1_ << ", in reused/loaded film=" << filmload_check_cx_1 << YENDL;
 		return false;
 	}
 
-	int filmload_check_cy_0;
-	file.read<int>(filmload_check_cy_0);
+	const int filmload_check_cy_0 = loaded_header.cy_0_;
 	if(filmload_check_cy_0 != cy_0_)
 	{
 		Y_WARNING << "imageFilm: loading/reusing film check failed. Border cy0, expected=" << cy_0_ << ", in reused/loaded film=" << filmload_check_cy_0 << YENDL;
 		return false;
 	}
 
-	int filmload_check_cy_1;
-	file.read<int>(filmload_check_cy_1);
+	const int filmload_check_cy_1 = loaded_header.cy_1_;
 	if(filmload_check_cy_1 != cy_1_)
 	{
 		Y_WARNING << "imageFilm: loading/reusing film check failed. Border cy1, expected=" << cy_1_ << ", in reused/loaded film=" << filmload_check_cy_1 << YENDL;
 		return false;
 	}
 
-	int loaded_image_layers_size;
-	file.read<int>(loaded_image_layers_size);
+	const int loaded_image_layers_size = loaded_header.num_layers_;
 	if(loaded_image_layers_size != static_cast<int>(image_layers_.size()))
 	{
 		Y_WARNING << "imageFilm: loading/reusing film check failed. Number of image layers, expected=" << image_layers_.size() << ", in reused/loaded film=" << loaded_image_layers_size << YENDL;
 		return false;
 	}
 
-	for(int y = 0; y < height_; ++y)
+	bool result_ok = true;
+	if(chunked_format)
 	{
-		for(int x = 0; x < width_; ++x)
+		const int filmload_check_chunk_size = loaded_header.chunk_size_;
+		if(filmload_check_chunk_size != film_chunk_size_global)
 		{
-			float weight;
-			file.read<float>(weight);
-			weights_(x, y).setFloat(weight);
+			Y_WARNING << "imageFilm: loading/reusing film check failed. Chunk size, expected=" << film_chunk_size_global << ", in reused/loaded film=" << filmload_check_chunk_size << YENDL;
+			return false;
+		}
+		if(!loaded_header.layer_types_.empty() && loaded_header.layer_types_ != getFilmFileHeader().layer_types_)
+		{
+			Y_WARNING << "imageFilm: loading/reusing film check failed. The film has different layers" << YENDL;
+			return false;
+		}
+		//The chunks are read one by one and added to the film, so the memory used does not depend on the film size
+		std::vector<float> chunk_data;
+		for(int chunk_y = 0; chunk_y < film_chunks_y_ && result_ok; ++chunk_y)
+		{
+			for(int chunk_x = 0; chunk_x < film_chunks_x_ && result_ok; ++chunk_x)
+			{
+				result_ok = addFilmChunk(file, chunk_x, chunk_y, chunk_data);
+			}
 		}
 	}
-
-	for(auto &it : image_layers_)
+	else
 	{
+		//Legacy format, with all the weights followed by all the pixels of each layer
 		for(int y = 0; y < height_; ++y)
 		{
 			for(int x = 0; x < width_; ++x)
 			{
-				Rgba col;
-				file.read<float>(col.r_);
-				file.read<float>(col.g_);
-				file.read<float>(col.b_);
-				file.read<float>(col.a_);
-				it.second.image_->setColor(x, y, col);
+				float weight;
+				result_ok = result_ok && file.read<float>(weight);
+				weights_(x, y).setFloat(weights_(x, y).getFloat() + weight);
 			}
 		}
-	}
 
+		for(auto &it : image_layers_)
+		{
+			const bool point_sampled = Layer::isPointSampled(it.first);
+			for(int y = 0; y < height_; ++y)
+			{
+				for(int x = 0; x < width_; ++x)
+				{
+					Rgba col;
+					result_ok = result_ok && file.read<float>(col.r_);
+					result_ok = result_ok && file.read<float>(col.g_);
+					result_ok = result_ok && file.read<float>(col.b_);
+					result_ok = result_ok && file.read<float>(col.a_);
+					addLoadedColor_global(*it.second.image_, point_sampled, x, y, col);
+				}
+			}
+		}
+	}
 	file.close();
+	if(!result_ok)
+	{
+		Y_WARNING << "imageFilm: film file '" << filename << "' is truncated, the film might be partially loaded" << YENDL;
+		return false;
+	}
+	if(sampling_offset_ < loaded_sampling_offset) sampling_offset_ = loaded_sampling_offset;
+	if(base_sampling_offset_ < loaded_base_sampling_offset) base_sampling_offset_ = loaded_base_sampling_offset;
+	std::fill(film_chunks_modified_.begin(), film_chunks_modified_.end(), true);
 	return true;
 }
 
@@ -1023,35 +1635,13 @@ void ImageFilm::imageFilmLoadAllInFolder(RenderControl &render_control)
 	bool any_film_loaded = false;
 	for(const auto &film_file : film_file_paths_list)
 	{
-		auto loaded_film = std::unique_ptr<ImageFilm>(new ImageFilm(width_, height_, cx_0_, cy_0_, num_threads_, render_control, layers_, outputs_, 1.0, FilterType::Box));
-		if(!loaded_film->imageFilmLoad(film_file))
+		//Each film is added directly into this film, chunk by chunk, so merging the films of many nodes does not need them all in memory
+		if(!imageFilmLoad(film_file))
 		{
 			Y_WARNING << "ImageFilm: Could not load film file '" << film_file << "'" << YENDL;
 			continue;
 		}
 		else any_film_loaded = true;
-
-		for(int i = 0; i < width_; ++i)
-		{
-			for(int j = 0; j < height_; ++j)
-			{
-				weights_(i, j).setFloat(weights_(i, j).getFloat() + loaded_film->weights_(i, j).getFloat());
-			}
-		}
-
-		for(auto &it : image_layers_)
-		{
-			const ImageLayers &loaded_image_layers = loaded_film->image_layers_;
-			for(int i = 0; i < width_; ++i)
-			{
-				for(int j = 0; j < height_; ++j)
-				{
-					it.second.image_->setColor(i, j, it.second.image_->getColor(i, j) + loaded_image_layers(it.first).image_->getColor(i, j));
-				}
-			}
-		}
-		if(sampling_offset_ < loaded_film->sampling_offset_) sampling_offset_ = loaded_film->sampling_offset_;
-		if(base_sampling_offset_ < loaded_film->base_sampling_offset_) base_sampling_offset_ = loaded_film->base_sampling_offset_;
 		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "ImageFilm: loaded film '" << film_file << "'" << YENDL;
 	}
 	if(any_film_loaded) render_control.setResumed();
@@ -1074,21 +1664,6 @@ bool ImageFilm::imageFilmSave()
 		progress_bar_->setTag(pass_string.str().c_str());
 	}
 
-	const std::string film_path = getFilmPath();
-	File file(film_path);
-	file.open("wb");
-	file.append(std::string("YAF_FILMv4_0_0"));
-	file.append<unsigned int>(computer_node_);
-	file.append<unsigned int>(base_sampling_offset_);
-	file.append<unsigned int>(sampling_offset_);
-	file.append<int>(width_);
-	file.append<int>(height_);
-	file.append<int>(cx_0_);
-	file.append<int>(cx_1_);
-	file.append<int>(cy_0_);
-	file.append<int>(cy_1_);
-	file.append<int>((int) image_layers_.size());
-
 	const int weights_w = weights_.getWidth();
 	if(weights_w != width_)
 	{
@@ -1101,14 +1676,6 @@ bool ImageFilm::imageFilmSave()
 		Y_WARNING << "ImageFilm saving problems, film weights height " << height_ << " different from internal 2D image height " << weights_h << YENDL;
 		result_ok = false;
 	}
-	for(int y = 0; y < height_; ++y)
-	{
-		for(int x = 0; x < width_; ++x)
-		{
-			file.append<float>(weights_(x, y).getFloat());
-		}
-	}
-
 	for(const auto &img : image_layers_)
 	{
 		const int img_w = img.second.image_->getWidth();
@@ -1125,23 +1692,143 @@ bool ImageFilm::imageFilmSave()
 			result_ok = false;
 			break;
 		}
-		for(int y = 0; y < height_; ++y)
+	}
+	if(!result_ok)
+	{
+		if(progress_bar_) progress_bar_->setTag(old_tag);
+		return false;
+	}
+
+	//The modified chunks are taken under the image lock, any chunk modified while saving will be saved again in the next save
+	image_mutex_.lock();
+	std::vector<bool> chunks_to_save(film_chunks_modified_.size(), false);
+	chunks_to_save.swap(film_chunks_modified_);
+	image_mutex_.unlock();
+
+	const std::string film_path = getFilmPath();
+	File file(film_path);
+	//If this film already saved the whole file, only the modified chunks are overwritten in place
+	const bool update_file = film_file_saved_ && File::exists(film_path, true) && file.open("r+b");
+	if(!update_file)
+	{
+		file.open("wb");
+		std::fill(chunks_to_save.begin(), chunks_to_save.end(), true);
+	}
+	const FilmFileHeader header = getFilmFileHeader();
+	header.write(file);
+
+	std::vector<float> chunk_data;
+	size_t num_saved_chunks = 0;
+	for(int chunk_y = 0; chunk_y < film_chunks_y_ && result_ok; ++chunk_y)
+	{
+		for(int chunk_x = 0; chunk_x < film_chunks_x_ && result_ok; ++chunk_x)
 		{
-			for(int x = 0; x < width_; ++x)
-			{
-				const Rgba &col = img.second.image_->getColor(x, y);
-				file.append<float>(col.r_);
-				file.append<float>(col.g_);
-				file.append<float>(col.b_);
-				file.append<float>(col.a_);
-			}
+			if(!chunks_to_save[chunk_y * film_chunks_x_ + chunk_x]) continue;
+			if(update_file) result_ok = file.seek(header.getChunkFilePosition(chunk_x, chunk_y));
+			result_ok = result_ok && saveFilmChunk(file, chunk_x, chunk_y, chunk_data);
+			++num_saved_chunks;
 		}
 	}
 	file.close();
+	if(result_ok) film_file_saved_ = true;
+	else
+	{
+		Y_WARNING << "ImageFilm saving problems, could not write the film file '" << film_path << "'" << YENDL;
+		film_file_saved_ = false;
+	}
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "imageFilm: saved " << num_saved_chunks << " of " << chunks_to_save.size() << " film chunks" << YENDL;
 	if(progress_bar_) progress_bar_->setTag(old_tag);
 	return result_ok;
 }
 
+FilmFileHeader ImageFilm::getFilmFileHeader() const
+{
+	FilmFileHeader header;
+	header.computer_node_ = computer_node_;
+	header.base_sampling_offset_ = base_sampling_offset_;
+	header.sampling_offset_ = sampling_offset_;
+	header.width_ = width_;
+	header.height_ = height_;
+	header.cx_0_ = cx_0_;
+	header.cx_1_ = cx_1_;
+	header.cy_0_ = cy_0_;
+	header.cy_1_ = cy_1_;
+	header.num_layers_ = static_cast<int>(image_layers_.size());
+	for(const auto &img : image_layers_) header.layer_types_.push_back(static_cast<int>(img.first));
+	return header;
+}
+
+void ImageFilm::getFilmChunkArea(int chunk_x, int chunk_y, int &x_0, int &y_0, int &x_1, int &y_1) const
+{
+	x_0 = chunk_x * film_chunk_size_global;
+	y_0 = chunk_y * film_chunk_size_global;
+	x_1 = std::min(width_, x_0 + film_chunk_size_global);
+	y_1 = std::min(height_, y_0 + film_chunk_size_global);
+}
+
+bool ImageFilm::saveFilmChunk(File &file, int chunk_x, int chunk_y, std::vector<float> &chunk_data) const
+{
+	int x_0, y_0, x_1, y_1;
+	getFilmChunkArea(chunk_x, chunk_y, x_0, y_0, x_1, y_1);
+	chunk_data.clear();
+	for(int y = y_0; y < y_1; ++y)
+	{
+		for(int x = x_0; x < x_1; ++x) chunk_data.push_back(weights_(x, y).getFloat());
+	}
+	for(const auto &img : image_layers_)
+	{
+		for(int y = y_0; y < y_1; ++y)
+		{
+			for(int x = x_0; x < x_1; ++x)
+			{
+				const Rgba col = img.second.image_->getColor(x, y);
+				chunk_data.push_back(col.r_);
+				chunk_data.push_back(col.g_);
+				chunk_data.push_back(col.b_);
+				chunk_data.push_back(col.a_);
+			}
+		}
+	}
+	return file.append(chunk_data);
+}
+
+bool ImageFilm::addFilmChunk(File &file, int chunk_x, int chunk_y, std::vector<float> &chunk_data)
+{
+	int x_0, y_0, x_1, y_1;
+	getFilmChunkArea(chunk_x, chunk_y, x_0, y_0, x_1, y_1);
+	const size_t num_pixels = static_cast<size_t>(x_1 - x_0) * (y_1 - y_0);
+	chunk_data.resize(num_pixels * (1 + 4 * image_layers_.size()));
+	if(!file.read(chunk_data)) return false;
+	const float *data = chunk_data.data();
+	for(int y = y_0; y < y_1; ++y)
+	{
+		for(int x = x_0; x < x_1; ++x, ++data) weights_(x, y).setFloat(weights_(x, y).getFloat() + *data);
+	}
+	for(auto &img : image_layers_)
+	{
+		const bool point_sampled = Layer::isPointSampled(img.first);
+		for(int y = y_0; y < y_1; ++y)
+		{
+			for(int x = x_0; x < x_1; ++x, data += 4)
+			{
+				addLoadedColor_global(*img.second.image_, point_sampled, x, y, Rgba(data[0], data[1], data[2], data[3]));
+			}
+		}
+	}
+	return true;
+}
+
+void ImageFilm::markFilmChunksModified(int x_0, int y_0, int x_1, int y_1)
+{
+	for(int chunk_y = y_0 / film_chunk_size_global; chunk_y <= y_1 / film_chunk_size_global; ++chunk_y)
+	{
+		for(int chunk_x = x_0 / film_chunk_size_global; chunk_x <= x_1 / film_chunk_size_global; ++chunk_x)
+		{
+			film_chunks_modified_[chunk_y * film_chunks_x_ + chunk_x] = true;
+		}
+	}
+}
+
 void ImageFilm::imageFilmFileBackup() const
 {
 	std::stringstream pass_string;
@@ -1170,6 +1857,127 @@ void ImageFilm::imageFilmFileBackup() const
 	if(progress_bar_) progress_bar_->setTag(old_tag);
 }
 
+//! sizes and counters of the film in the render checkpoints
+struct FilmCheckpointHeader
+{
+	int32_t width_, height_, cx_0_, cy_0_;
+	int32_t num_layers_;
+	int32_t n_pass_;
+	uint32_t base_sampling_offset_, sampling_offset_;
+	int32_t num_density_samples_;
+	float aa_threshold_;
+};
+
+void ImageFilm::saveCheckpoint(RenderCheckpoint &checkpoint) const
+{
+	const size_t num_pixels = static_cast<size_t>(width_) * height_;
+	FilmCheckpointHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.width_ = width_;
+	header.height_ = height_;
+	header.cx_0_ = cx_0_;
+	header.cy_0_ = cy_0_;
+	header.num_layers_ = static_cast<int32_t>(image_layers_.size());
+	header.n_pass_ = n_pass_;
+	header.base_sampling_offset_ = base_sampling_offset_;
+	header.sampling_offset_ = sampling_offset_;
+	header.num_density_samples_ = num_density_samples_.load(std::memory_order_relaxed);
+	header.aa_threshold_ = aa_noise_params_.threshold_;
+	checkpoint.addValue("film.header", header);
+	checkpoint.add("film.layer_types", getFilmFileHeader().layer_types_);
+
+	//The pixels are saved in row order, the layers one after the other
+	std::vector<float> values(num_pixels);
+	for(int y = 0; y < height_; ++y) for(int x = 0; x < width_; ++x) values[static_cast<size_t>(y) * width_ + x] = weights_(x, y).getFloat();
+	checkpoint.add("film.weights", values);
+	values.resize(4 * num_pixels * image_layers_.size());
+	float *data = values.data();
+	for(const auto &img : image_layers_)
+	{
+		for(int y = 0; y < height_; ++y)
+		{
+			for(int x = 0; x < width_; ++x, data += 4)
+			{
+				const Rgba col = img.second.image_->getColor(x, y);
+				data[0] = col.r_; data[1] = col.g_; data[2] = col.b_; data[3] = col.a_;
+			}
+		}
+	}
+	checkpoint.add("film.layers", values);
+	std::vector<uint8_t> flags(num_pixels);
+	for(int y = 0; y < height_; ++y) for(int x = 0; x < width_; ++x) flags[static_cast<size_t>(y) * width_ + x] = flags_.get(x, y) ? 1 : 0;
+	checkpoint.add("film.flags", flags);
+	if(!luminance_moments_.empty()) checkpoint.add("film.moments", luminance_moments_);
+	if(!variance_sample_factors_.empty()) checkpoint.add("film.variance_factors", variance_sample_factors_);
+	if(density_image_)
+	{
+		values.resize(3 * num_pixels);
+		for(size_t i = 0; i < values.size(); ++i) values[i] = density_image_[i].load(std::memory_order_relaxed);
+		checkpoint.add("film.density", values);
+	}
+}
+
+bool ImageFilm::loadCheckpoint(const RenderCheckpoint &checkpoint)
+{
+	const size_t num_pixels = static_cast<size_t>(width_) * height_;
+	FilmCheckpointHeader header;
+	if(!checkpoint.getValue("film.header", header)) return false;
+	if(header.width_ != width_ || header.height_ != height_ || header.cx_0_ != cx_0_ || header.cy_0_ != cy_0_ || header.num_layers_ != static_cast<int32_t>(image_layers_.size()))
+	{
+		Y_WARNING << "ImageFilm: the render checkpoint was saved for a film with a different size or number of layers" << YENDL;
+		return false;
+	}
+	std::vector<int> layer_types(image_layers_.size());
+	const float *weights = checkpoint.get<float>("film.weights", num_pixels);
+	const float *layers = checkpoint.get<float>("film.layers", 4 * num_pixels * image_layers_.size());
+	const uint8_t *flags = checkpoint.get<uint8_t>("film.flags", num_pixels);
+	if(!checkpoint.get("film.layer_types", layer_types) || layer_types != getFilmFileHeader().layer_types_ || !weights || !layers || !flags)
+	{
+		Y_WARNING << "ImageFilm: the render checkpoint was saved for a film with different layers, or it is incomplete" << YENDL;
+		return false;
+	}
+	//The optional statistics must match the ones of this render, or the next passes would be sampled differently
+	const std::array<float, 2> *moments = luminance_moments_.empty() ? nullptr : checkpoint.get<std::array<float, 2>>("film.moments", num_pixels);
+	const float *variance_factors = checkpoint.get<float>("film.variance_factors", num_pixels);
+	const float *density = density_image_ ? checkpoint.get<float>("film.density", 3 * num_pixels) : nullptr;
+	if((!luminance_moments_.empty() && !moments) || (density_image_ && !density))
+	{
+		Y_WARNING << "ImageFilm: the render checkpoint was saved without the variance sampling or the light density image of this render" << YENDL;
+		return false;
+	}
+
+	if(moments) std::copy(moments, moments + num_pixels, luminance_moments_.begin());
+	if(variance_factors) variance_sample_factors_.assign(variance_factors, variance_factors + num_pixels);
+	if(density)
+	{
+		for(size_t i = 0; i < 3 * num_pixels; ++i) density_image_[i].store(density[i], std::memory_order_relaxed);
+		num_density_samples_.store(header.num_density_samples_, std::memory_order_relaxed);
+	}
+	for(int y = 0; y < height_; ++y)
+	{
+		for(int x = 0; x < width_; ++x)
+		{
+			const size_t pixel = static_cast<size_t>(y) * width_ + x;
+			weights_(x, y).setFloat(weights[pixel]);
+			flags_.set(x, y, flags[pixel] != 0);
+		}
+	}
+	for(auto &img : image_layers_)
+	{
+		for(int y = 0; y < height_; ++y)
+		{
+			for(int x = 0; x < width_; ++x, layers += 4) img.second.image_->setColor(x, y, Rgba(layers[0], layers[1], layers[2], layers[3]));
+		}
+	}
+	n_pass_ = header.n_pass_;
+	base_sampling_offset_ = header.base_sampling_offset_;
+	sampling_offset_ = header.sampling_offset_;
+	aa_noise_params_.threshold_ = header.aa_threshold_;
+	std::fill(film_chunks_modified_.begin(), film_chunks_modified_.end(), true);
+	updateMemoryTracker();
+	return true;
+}
+
 
 //The next edge detection, debug faces/object edges and toon functions will only work if YafaRay is built with OpenCV support
 #ifdef HAVE_OPENCV
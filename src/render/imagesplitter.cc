@@ -22,18 +22,46 @@
 
 BEGIN_YAFARAY
 
+//! interleaves the bits of the tile coordinates, so the tiles are visited in nested Z shaped blocks
+static uint64_t mortonCode_global(uint32_t x, uint32_t y)
+{
+	uint64_t code = 0;
+	for(int bit = 0; bit < 32; ++bit) code |= (static_cast<uint64_t>((x >> bit) & 1) << (2 * bit)) | (static_cast<uint64_t>((y >> bit) & 1) << (2 * bit + 1));
+	return code;
+}
+
+//! distance along the Hilbert curve filling a grid of side n (power of two). Unlike the Morton order, consecutive tiles are always neighbours
+static uint64_t hilbertIndex_global(uint32_t n, uint32_t x, uint32_t y)
+{
+	uint64_t index = 0;
+	for(uint32_t s = n / 2; s > 0; s /= 2)
+	{
+		const uint32_t rx = (x & s) > 0 ? 1 : 0;
+		const uint32_t ry = (y & s) > 0 ? 1 : 0;
+		index += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+		if(ry == 0)
+		{
+			if(rx == 1)
+			{
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return index;
+}
+
 // currently only supports creation of scanrow-ordered tiles
 // shuffling would of course be easy, but i don't find that too usefull really,
 // it does maximum damage to the coherency gain and visual feedback is medicore too
 
-ImageSplitter::ImageSplitter(int w, int h, int x_0, int y_0, int bsize, TilesOrderType torder, int nthreads): blocksize_(bsize), tilesorder_(torder)
+ImageSplitter::ImageSplitter(int w, int h, int x_0, int y_0, int bsize, TilesOrderType torder): blocksize_(bsize), tilesorder_(torder)
 {
 	int nx, ny;
 	nx = (w + blocksize_ - 1) / blocksize_;
 	ny = (h + blocksize_ - 1) / blocksize_;
 
-	std::vector<Region> regions_raw;
-
 	for(int j = 0; j < ny; ++j)
 	{
 		for(int i = 0; i < nx; ++i)
@@ -43,66 +71,38 @@ ImageSplitter::ImageSplitter(int w, int h, int x_0, int y_0, int bsize, TilesOrd
 			r.y_ = y_0 + j * blocksize_;
 			r.w_ = std::min(blocksize_, x_0 + w - r.x_);
 			r.h_ = std::min(blocksize_, y_0 + h - r.y_);
-			regions_raw.push_back(r);
+			regions_.push_back(r);
 		}
 	}
 
+	//The last tiles are no longer subdivided here, ImageFilm::nextArea splits the areas in halves when there are less areas left than threads
 	switch(tilesorder_)
 	{
-		case Random:		std::random_shuffle(regions_raw.begin(), regions_raw.end());
+		case Random:		std::random_shuffle(regions_.begin(), regions_.end());
+			break;
 		case CentreRandom:	std::random_shuffle(regions_.begin(), regions_.end());
 			std::sort(regions_.begin(), regions_.end(), ImageSpliterCentreSorter(w, h, x_0, y_0));
-		case Linear:		break;
-		default:			break;
-	}
-
-	std::vector<Region> regions_subdivided;
-
-	for(size_t rn = 0; rn < regions_raw.size(); ++rn)
-	{
-		if(nthreads == 1 || blocksize_ <= 4 || rn < regions_raw.size() - 2 * nthreads)	//If blocksize is more than 4, resubdivide the last (2 x nunber of threads) so their block size is progressively smaller (better CPU/thread usage in the last tiles to avoid/mitigate having one big tile at the end with only 1 CPU thread)
-		{
-			regions_.push_back(regions_raw[rn]);
-		}
-		else
+			break;
+		case Hilbert:
+		case Morton:
 		{
-			int blocksize_2 = blocksize_;
-			if(rn > regions_raw.size() - nthreads) blocksize_2 = std::max(4, blocksize_ / 4);
-			else if(rn <= regions_raw.size() - nthreads) blocksize_2 = std::max(4, blocksize_ / 2);
-			int nx_2, ny_2;
-			nx_2 = (regions_raw[rn].w_ + blocksize_2 - 1) / blocksize_2;
-			ny_2 = (regions_raw[rn].h_ + blocksize_2 - 1) / blocksize_2;
-
-			for(int j = 0; j < ny_2; ++j)
+			//The tiles are sorted by their position along the curve, so the consecutive tiles (and any range of them given to a render thread) cover compact parts of the image
+			uint32_t grid_size = 1;
+			while(grid_size < static_cast<uint32_t>(std::max(nx, ny))) grid_size *= 2;
+			std::vector<std::pair<uint64_t, Region>> sorted_regions;
+			sorted_regions.reserve(regions_.size());
+			for(const Region &r : regions_)
 			{
-				for(int i = 0; i < nx_2; ++i)
-				{
-					Region r;
-					r.x_ = regions_raw[rn].x_ + i * blocksize_2;
-					r.y_ = regions_raw[rn].y_ + j * blocksize_2;
-					r.w_ = std::min(blocksize_2, regions_raw[rn].x_ + regions_raw[rn].w_ - r.x_);
-					r.h_ = std::min(blocksize_2, regions_raw[rn].y_ + regions_raw[rn].h_ - r.y_);
-					regions_subdivided.push_back(r);
-				}
+				const uint32_t i = static_cast<uint32_t>((r.x_ - x_0) / blocksize_), j = static_cast<uint32_t>((r.y_ - y_0) / blocksize_);
+				sorted_regions.push_back({tilesorder_ == Hilbert ? hilbertIndex_global(grid_size, i, j) : mortonCode_global(i, j), r});
 			}
-		}
-	}
-
-	switch(tilesorder_)
-	{
-		case Random:		std::random_shuffle(regions_.begin(), regions_.end());
-			std::random_shuffle(regions_subdivided.begin(), regions_subdivided.end());
-			break;
-		case CentreRandom:	std::random_shuffle(regions_.begin(), regions_.end());
-			std::sort(regions_.begin(), regions_.end(), ImageSpliterCentreSorter(w, h, x_0, y_0));
-			std::random_shuffle(regions_subdivided.begin(), regions_subdivided.end());
-			std::sort(regions_subdivided.begin(), regions_subdivided.end(), ImageSpliterCentreSorter(w, h, x_0, y_0));
+			std::sort(sorted_regions.begin(), sorted_regions.end(), [](const std::pair<uint64_t, Region> &a, const std::pair<uint64_t, Region> &b) { return a.first < b.first; });
+			for(size_t n = 0; n < regions_.size(); ++n) regions_[n] = sorted_regions[n].second;
 			break;
+		}
 		case Linear: 		break;
 		default:			break;
 	}
-
-	regions_.insert(regions_.end(), regions_subdivided.begin(), regions_subdivided.end());
 }
 
 bool ImageSplitter::getArea(int n, RenderArea &area)
@@ -0,0 +1,162 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "render/render_checkpoint.h"
+#include "common/file.h"
+#include "common/logger.h"
+
+BEGIN_YAFARAY
+
+static constexpr char file_id_global[16] = "YAF_CHECKPOINT1";
+static constexpr uint32_t file_byte_order_global = 0x01020304;
+static constexpr uint64_t file_alignment_global = 64; //!< of the file sections, for the cache lines
+
+/*! The header is followed by the table of the sections, and then by the sections at the offsets in the table */
+struct CheckpointFileHeader
+{
+	char id_[16];
+	uint32_t byte_order_;
+	uint32_t header_size_;
+	uint32_t num_sections_;
+	uint32_t section_entry_size_;
+	uint64_t file_size_;
+};
+
+struct CheckpointSectionEntry
+{
+	char name_[48];
+	uint64_t offset_;
+	uint64_t size_;
+};
+
+static uint64_t alignFileOffset_global(uint64_t offset)
+{
+	return (offset + file_alignment_global - 1) / file_alignment_global * file_alignment_global;
+}
+
+RenderCheckpoint::RenderCheckpoint() = default;
+RenderCheckpoint::~RenderCheckpoint() = default;
+
+bool RenderCheckpoint::save(const std::string &path) const
+{
+	CheckpointFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.id_, file_id_global, sizeof(header.id_));
+	header.byte_order_ = file_byte_order_global;
+	header.header_size_ = sizeof(header);
+	header.num_sections_ = static_cast<uint32_t>(sections_.size());
+	header.section_entry_size_ = sizeof(CheckpointSectionEntry);
+
+	std::vector<CheckpointSectionEntry> entries(sections_.size());
+	uint64_t offset = alignFileOffset_global(sizeof(header) + entries.size() * sizeof(CheckpointSectionEntry));
+	for(size_t i = 0; i < sections_.size(); ++i)
+	{
+		CheckpointSectionEntry &entry = entries[i];
+		std::memset(&entry, 0, sizeof(entry));
+		if(sections_[i].first.size() >= sizeof(entry.name_))
+		{
+			Y_WARNING << "RenderCheckpoint: section name '" << sections_[i].first << "' too long, aborting save operation" << YENDL;
+			return false;
+		}
+		std::memcpy(entry.name_, sections_[i].first.data(), sections_[i].first.size());
+		entry.offset_ = offset;
+		entry.size_ = sections_[i].second.size();
+		offset = alignFileOffset_global(offset + entry.size_);
+	}
+	header.file_size_ = offset;
+
+	const std::string temp_path = path + ".tmp";
+	File file(temp_path);
+	if(!file.open("wb"))
+	{
+		Y_WARNING << "RenderCheckpoint: file '" << temp_path << "' could not be created, aborting save operation" << YENDL;
+		return false;
+	}
+	uint64_t written = 0;
+	auto pad_to = [&](uint64_t position)
+	{
+		const std::vector<char> padding(position - written, 0);
+		written = position;
+		return file.append(padding);
+	};
+	bool result = file.append(header) && file.append(entries);
+	written = sizeof(header) + entries.size() * sizeof(CheckpointSectionEntry);
+	for(size_t i = 0; i < sections_.size() && result; ++i)
+	{
+		result = pad_to(entries[i].offset_) && file.append(sections_[i].second);
+		written += entries[i].size_;
+	}
+	result = result && pad_to(header.file_size_);
+	file.close();
+	if(!result || !File::rename(temp_path, path, true, true))
+	{
+		Y_WARNING << "RenderCheckpoint: could not write the file '" << path << "'" << YENDL;
+		File::remove(temp_path, true);
+		return false;
+	}
+	return true;
+}
+
+bool RenderCheckpoint::load(const std::string &path)
+{
+	loaded_sections_.clear();
+	mapped_file_ = std::unique_ptr<MappedFile>(new MappedFile(path));
+	CheckpointFileHeader header;
+	if(!mapped_file_->isOpen() || mapped_file_->size() < sizeof(header) || std::memcmp(mapped_file_->data(), file_id_global, sizeof(file_id_global)) != 0)
+	{
+		mapped_file_ = nullptr;
+		return false;
+	}
+	std::memcpy(&header, mapped_file_->data(), sizeof(header));
+	const uint64_t table_end = sizeof(header) + static_cast<uint64_t>(header.num_sections_) * sizeof(CheckpointSectionEntry);
+	if(header.byte_order_ != file_byte_order_global || header.header_size_ != sizeof(header) || header.section_entry_size_ != sizeof(CheckpointSectionEntry) || header.file_size_ != mapped_file_->size() || table_end > header.file_size_)
+	{
+		Y_WARNING << "RenderCheckpoint: file '" << path << "' is truncated or was saved in a platform with a different byte order, aborting load operation" << YENDL;
+		mapped_file_ = nullptr;
+		return false;
+	}
+	const CheckpointSectionEntry *entries = reinterpret_cast<const CheckpointSectionEntry *>(mapped_file_->data() + sizeof(header));
+	for(uint32_t i = 0; i < header.num_sections_; ++i)
+	{
+		const CheckpointSectionEntry &entry = entries[i];
+		if(entry.offset_ % file_alignment_global != 0 || entry.offset_ > header.file_size_ || entry.size_ > header.file_size_ - entry.offset_)
+		{
+			Y_WARNING << "RenderCheckpoint: file '" << path << "' is corrupted, aborting load operation" << YENDL;
+			loaded_sections_.clear();
+			mapped_file_ = nullptr;
+			return false;
+		}
+		loaded_sections_[std::string(entry.name_, strnlen(entry.name_, sizeof(entry.name_)))] = {entry.offset_, entry.size_};
+	}
+	return true;
+}
+
+size_t RenderCheckpoint::getSectionSize(const std::string &name) const
+{
+	const auto section = loaded_sections_.find(name);
+	return section == loaded_sections_.end() ? 0 : static_cast<size_t>(section->second.second);
+}
+
+const char *RenderCheckpoint::getSectionData(const std::string &name, size_t size) const
+{
+	const auto section = loaded_sections_.find(name);
+	if(section == loaded_sections_.end() || section->second.second != size) return nullptr;
+	return mapped_file_->data() + section->second.first;
+}
+
+END_YAFARAY
@@ -17,6 +17,9 @@
  */
 
 #include "render/render_control.h"
+#include "common/memory_stats.h"
+#include <sstream>
+#include <algorithm>
 
 BEGIN_YAFARAY
 
@@ -30,6 +33,16 @@ void RenderControl::setStarted()
 	total_passes_ = 0;
 	current_pass_ = 0;
 	current_pass_percent_ = 0.f;
+	render_start_ = std::chrono::steady_clock::now();
+	rays_ = 0;
+	shadow_rays_ = 0;
+	camera_samples_ = 0;
+	pass_pixels_ = 0;
+	pass_pixels_done_ = 0;
+	pass_tile_seconds_ = 0.0;
+	total_pixels_done_ = 0;
+	total_tile_seconds_ = 0.0;
+	thread_busy_seconds_.clear();
 }
 
 void RenderControl::setResumed()
@@ -43,9 +56,14 @@ void RenderControl::setResumed()
 
 void RenderControl::setFinished()
 {
-	std::lock_guard<std::mutex>lock_guard(mutx_);
-	render_in_progress_ = false;
-	render_finished_ = true;
+	int completed_passes;
+	{
+		std::lock_guard<std::mutex>lock_guard(mutx_);
+		render_in_progress_ = false;
+		render_finished_ = true;
+		completed_passes = render_aborted_ ? current_pass_ - 1 : current_pass_; //the aborted pass is not complete
+	}
+	if(listener_ && completed_passes > 0) listener_->passesCompleted(completed_passes);
 }
 
 void RenderControl::setAborted()
@@ -63,8 +81,12 @@ void RenderControl::setTotalPasses(int total_passes)
 
 void RenderControl::setCurrentPass(int current_pass)
 {
-	std::lock_guard<std::mutex>lock_guard(mutx_);
-	current_pass_ = current_pass;
+	{
+		std::lock_guard<std::mutex>lock_guard(mutx_);
+		current_pass_ = current_pass;
+	}
+	//Starting a pass completes the previous ones
+	if(listener_ && current_pass > 1) listener_->passesCompleted(current_pass - 1);
 }
 
 void RenderControl::setCurrentPassPercent(float current_pass_percent)
@@ -83,6 +105,83 @@ void RenderControl::setRenderInfo(const std::string &render_settings)
 	render_info_ = render_settings;
 }
 
+void RenderControl::setPassPixels(int pass_pixels, int num_threads)
+{
+	std::lock_guard<std::mutex>lock_guard(mutx_);
+	pass_pixels_ = pass_pixels;
+	pass_pixels_done_ = 0;
+	pass_tile_seconds_ = 0.0;
+	if(static_cast<int>(thread_busy_seconds_.size()) < num_threads) thread_busy_seconds_.resize(num_threads, 0.0);
+}
+
+void RenderControl::addTileStats(int thread_id, int pixels, float seconds, uint64_t rays, uint64_t shadow_rays, uint64_t camera_samples)
+{
+	std::lock_guard<std::mutex>lock_guard(mutx_);
+	rays_ += rays;
+	shadow_rays_ += shadow_rays;
+	camera_samples_ += camera_samples;
+	pass_pixels_done_ += pixels;
+	pass_tile_seconds_ += seconds;
+	total_pixels_done_ += pixels;
+	total_tile_seconds_ += seconds;
+	if(thread_id >= static_cast<int>(thread_busy_seconds_.size())) thread_busy_seconds_.resize(thread_id + 1, 0.0);
+	thread_busy_seconds_[thread_id] += seconds;
+}
+
+RenderProgressStats RenderControl::getProgressStats() const
+{
+	RenderProgressStats stats;
+	{
+		std::lock_guard<std::mutex>lock_guard(mutx_);
+		if(render_in_progress_ || render_finished_) stats.elapsed_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start_).count();
+		stats.rays_ = rays_;
+		stats.shadow_rays_ = shadow_rays_;
+		stats.camera_samples_ = camera_samples_;
+		stats.current_pass_ = current_pass_;
+		stats.total_passes_ = total_passes_;
+		stats.current_pass_percent_ = current_pass_percent_;
+		const int num_threads = static_cast<int>(thread_busy_seconds_.size());
+		//The cost per pixel of the current pass is used once it has finished tiles, as the passes can have very different numbers of samples per pixel
+		double seconds_per_pixel = 0.0;
+		if(pass_pixels_done_ > 0) seconds_per_pixel = pass_tile_seconds_ / pass_pixels_done_;
+		else if(total_pixels_done_ > 0) seconds_per_pixel = total_tile_seconds_ / total_pixels_done_;
+		if(render_in_progress_ && num_threads > 0 && seconds_per_pixel > 0.0)
+		{
+			stats.pass_eta_seconds_ = std::max(0, pass_pixels_ - pass_pixels_done_) * seconds_per_pixel / num_threads;
+			stats.eta_seconds_ = stats.pass_eta_seconds_ + std::max(0, total_passes_ - current_pass_) * static_cast<double>(pass_pixels_) * seconds_per_pixel / num_threads;
+		}
+		else if(render_finished_)
+		{
+			stats.pass_eta_seconds_ = 0.0;
+			stats.eta_seconds_ = 0.0;
+		}
+		stats.thread_busy_ratios_.reserve(num_threads);
+		for(const double busy_seconds : thread_busy_seconds_) stats.thread_busy_ratios_.push_back(stats.elapsed_seconds_ > 0.0 ? std::min(1.0, busy_seconds / stats.elapsed_seconds_) : 0.0);
+	}
+	if(stats.elapsed_seconds_ > 0.0)
+	{
+		stats.rays_per_second_ = stats.rays_ / stats.elapsed_seconds_;
+		stats.shadow_rays_per_second_ = stats.shadow_rays_ / stats.elapsed_seconds_;
+		stats.camera_samples_per_second_ = stats.camera_samples_ / stats.elapsed_seconds_;
+	}
+	stats.memory_bytes_ = MemoryStats::getTotal().current_;
+	return stats;
+}
+
+std::string RenderProgressStats::toJson() const
+{
+	std::stringstream ss;
+	ss << "{\"elapsed_seconds\":" << elapsed_seconds_;
+	ss << ",\"rays\":" << rays_ << ",\"shadow_rays\":" << shadow_rays_ << ",\"camera_samples\":" << camera_samples_;
+	ss << ",\"rays_per_second\":" << rays_per_second_ << ",\"shadow_rays_per_second\":" << shadow_rays_per_second_ << ",\"camera_samples_per_second\":" << camera_samples_per_second_;
+	ss << ",\"current_pass\":" << current_pass_ << ",\"total_passes\":" << total_passes_ << ",\"current_pass_percent\":" << current_pass_percent_;
+	ss << ",\"pass_eta_seconds\":" << pass_eta_seconds_ << ",\"eta_seconds\":" << eta_seconds_;
+	ss << ",\"thread_busy_ratios\":[";
+	for(size_t i = 0; i < thread_busy_ratios_.size(); ++i) ss << (i > 0 ? "," : "") << thread_busy_ratios_[i];
+	ss << "],\"memory_bytes\":" << memory_bytes_ << "}";
+	return ss.str();
+}
+
 bool RenderControl::inProgress() const
 {
 	return render_in_progress_;
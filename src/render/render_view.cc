@@ -77,6 +77,18 @@ bool RenderView::init(const Scene &scene)
 		Y_ERROR << "RenderView '" << name_ << "': Lights not found in the scene." << YENDL;
 		return false;
 	}
+
+	lights_visible_power_pdf_ = nullptr;
+	const std::vector<const Light *> lights_visible = getLightsVisible();
+	const int num_lights_visible = static_cast<int>(lights_visible.size());
+	std::vector<float> energies(num_lights_visible);
+	float total_energy = 0.f;
+	for(int i = 0; i < num_lights_visible; ++i)
+	{
+		energies[i] = lights_visible[i]->totalEnergy().energy();
+		total_energy += energies[i];
+	}
+	if(total_energy > 0.f) lights_visible_power_pdf_ = std::unique_ptr<Pdf1D>(new Pdf1D(energies.data(), num_lights_visible));
 	return true;
 }
 
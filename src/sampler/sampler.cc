@@ -0,0 +1,97 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "sampler/sampler.h"
+#include "sampler/halton.h"
+#include "sampler/sample.h"
+#include "math/math.h"
+
+BEGIN_YAFARAY
+
+constexpr int SamplerSobol::num_dimensions_;
+
+std::unique_ptr<Sampler> Sampler::factory(AaNoiseParams::SamplerType type)
+{
+	if(type == AaNoiseParams::SamplerType::Sobol) return std::unique_ptr<Sampler>(new SamplerSobol());
+	return std::unique_ptr<Sampler>(new SamplerHalton());
+}
+
+float SamplerHalton::sample(int dimension, unsigned int index, unsigned int seed) const
+{
+	return static_cast<float>(Halton::lowDiscrepancySampling(dimension, index + seed));
+}
+
+SamplerSobol::SamplerSobol()
+{
+	//Primitive polynomials and initial direction numbers of the dimensions 2 to 4 from Joe and Kuo, the first dimension is the van der Corput sequence
+	struct Polynomial { int degree_; uint32_t coefficients_; std::array<uint32_t, 3> initial_; };
+	static const std::array<Polynomial, num_dimensions_ - 1> polynomials_global {{ {1, 0, {{1, 0, 0}}}, {2, 1, {{1, 3, 0}}}, {3, 1, {{1, 3, 1}}} }};
+	for(int bit = 0; bit < 32; ++bit) directions_[0][bit] = 1u << (31 - bit);
+	for(int dim = 1; dim < num_dimensions_; ++dim)
+	{
+		const Polynomial &polynomial = polynomials_global[dim - 1];
+		const int s = polynomial.degree_;
+		std::array<uint32_t, 32> &v = directions_[dim];
+		for(int bit = 0; bit < s; ++bit) v[bit] = polynomial.initial_[bit] << (31 - bit);
+		for(int bit = s; bit < 32; ++bit)
+		{
+			v[bit] = v[bit - s] ^ (v[bit - s] >> s);
+			for(int k = 1; k < s; ++k) if((polynomial.coefficients_ >> (s - 1 - k)) & 1u) v[bit] ^= v[bit - k];
+		}
+	}
+}
+
+uint32_t SamplerSobol::reverseBits(uint32_t x)
+{
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+	x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+	x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+	return ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+}
+
+uint32_t SamplerSobol::nestedUniformScramble(uint32_t x, uint32_t seed)
+{
+	//Laine-Karras style permutation on the reversed bits, each bit is only flipped depending on the more significant bits of x
+	x = reverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverseBits(x);
+}
+
+uint32_t SamplerSobol::sobol(uint32_t index, int dimension) const
+{
+	const std::array<uint32_t, 32> &v = directions_[dimension];
+	uint32_t result = 0;
+	for(int bit = 0; index; index >>= 1, ++bit) if(index & 1u) result ^= v[bit];
+	return result;
+}
+
+float SamplerSobol::sample(int dimension, unsigned int index, unsigned int seed) const
+{
+	const uint32_t group_seed = hashCombine(seed, sample::fnv32ABuf(static_cast<unsigned int>(dimension / num_dimensions_)));
+	const int group_dimension = dimension % num_dimensions_;
+	const uint32_t shuffled_index = nestedUniformScramble(index, group_seed);
+	const uint32_t x = nestedUniformScramble(sobol(shuffled_index, group_dimension), hashCombine(group_seed, static_cast<uint32_t>(group_dimension)));
+	return std::min(static_cast<float>(static_cast<double>(x) * math::sample_mult_ratio), 0.99999994f);
+}
+
+END_YAFARAY
@@ -0,0 +1,315 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "sampler/sd_tree.h"
+#include "math/math.h"
+#include <cmath>
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+static constexpr float max_square_coordinate_global = 0.99999994f; //!< largest float below 1, the square coordinates are kept in [0, 1)
+
+DirectionalQuadtree::DirectionalQuadtree()
+{
+	nodes_.resize(1);
+}
+
+DirectionalQuadtree::DirectionalQuadtree(const DirectionalQuadtree &tree) : nodes_(tree.nodes_), total_(tree.total_)
+{
+	num_samples_.store(tree.getNumSamples(), std::memory_order_relaxed);
+}
+
+DirectionalQuadtree &DirectionalQuadtree::operator=(const DirectionalQuadtree &tree)
+{
+	nodes_ = tree.nodes_;
+	total_ = tree.total_;
+	num_samples_.store(tree.getNumSamples(), std::memory_order_relaxed);
+	return *this;
+}
+
+std::array<float, 2> DirectionalQuadtree::dirToSquare(const Vec3 &dir)
+{
+	const float cos_theta = std::max(-1.f, std::min(1.f, dir.z_));
+	float phi = std::atan2(dir.y_, dir.x_);
+	if(phi < 0.f) phi += static_cast<float>(math::mult_pi_by_2);
+	return {{ std::min((cos_theta + 1.f) * 0.5f, max_square_coordinate_global), std::min(phi * static_cast<float>(math::div_1_by_2pi), max_square_coordinate_global) }};
+}
+
+Vec3 DirectionalQuadtree::squareToDir(float u, float v)
+{
+	const float cos_theta = 2.f * u - 1.f;
+	const float sin_theta = std::sqrt(std::max(0.f, 1.f - cos_theta * cos_theta));
+	const float phi = v * static_cast<float>(math::mult_pi_by_2);
+	return { sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta };
+}
+
+int DirectionalQuadtree::childIndex(std::array<float, 2> &p)
+{
+	const int x = p[0] >= 0.5f ? 1 : 0;
+	const int y = p[1] >= 0.5f ? 1 : 0;
+	p[0] = std::min(2.f * p[0] - x, max_square_coordinate_global);
+	p[1] = std::min(2.f * p[1] - y, max_square_coordinate_global);
+	return x + 2 * y;
+}
+
+void DirectionalQuadtree::atomicAdd(std::atomic<float> &value, float addend)
+{
+	float current = value.load(std::memory_order_relaxed);
+	while(!value.compare_exchange_weak(current, current + addend, std::memory_order_relaxed));
+}
+
+void DirectionalQuadtree::record(const Vec3 &dir, float value)
+{
+	std::array<float, 2> p = dirToSquare(dir);
+	size_t node_id = 0;
+	while(true)
+	{
+		Node &node = nodes_[node_id];
+		const int child = childIndex(p);
+		if(node.children_[child] == 0)
+		{
+			atomicAdd(node.sums_[child], value);
+			return;
+		}
+		node_id = node.children_[child];
+	}
+}
+
+void DirectionalQuadtree::build()
+{
+	total_ = buildNode(0);
+}
+
+float DirectionalQuadtree::buildNode(size_t node_id)
+{
+	for(int child = 0; child < 4; ++child)
+	{
+		const uint32_t child_id = nodes_[node_id].children_[child];
+		if(child_id != 0) nodes_[node_id].sums_[child].store(buildNode(child_id), std::memory_order_relaxed);
+	}
+	return nodes_[node_id].sum();
+}
+
+void DirectionalQuadtree::refine(const DirectionalQuadtree &reference, float subdivision_threshold, int max_depth)
+{
+	nodes_.clear();
+	nodes_.resize(1);
+	total_ = 0.f;
+	num_samples_.store(0, std::memory_order_relaxed);
+	if(reference.total_ <= 0.f)
+	{
+		//Nothing was learnt from the reference tree, so its structure is kept
+		nodes_ = reference.nodes_;
+		for(auto &node : nodes_) for(auto &sum : node.sums_) sum.store(0.f, std::memory_order_relaxed);
+		return;
+	}
+	struct StackItem
+	{
+		uint32_t node_id_;
+		int reference_id_; //!< -1 if the reference tree was not subdivided that deep, then its energy is assumed to be uniform inside the cell
+		float fraction_; //!< fraction of the reference energy inside the cell
+		int depth_;
+	};
+	std::vector<StackItem> stack;
+	stack.push_back({0, 0, 1.f, 1});
+	while(!stack.empty())
+	{
+		const StackItem item = stack.back();
+		stack.pop_back();
+		for(int child = 0; child < 4; ++child)
+		{
+			float child_fraction;
+			int child_reference_id = -1;
+			if(item.reference_id_ >= 0)
+			{
+				const Node &reference_node = reference.nodes_[item.reference_id_];
+				child_fraction = reference_node.sums_[child].load(std::memory_order_relaxed) / reference.total_;
+				if(reference_node.children_[child] != 0) child_reference_id = static_cast<int>(reference_node.children_[child]);
+			}
+			else child_fraction = item.fraction_ * 0.25f;
+			if(item.depth_ < max_depth && child_fraction > subdivision_threshold)
+			{
+				const uint32_t child_id = static_cast<uint32_t>(nodes_.size());
+				nodes_.emplace_back();
+				nodes_[item.node_id_].children_[child] = child_id;
+				stack.push_back({child_id, child_reference_id, child_fraction, item.depth_ + 1});
+			}
+		}
+	}
+}
+
+Vec3 DirectionalQuadtree::sample(float s_1, float s_2) const
+{
+	if(total_ <= 0.f) return squareToDir(s_1, s_2);
+	float origin_u = 0.f, origin_v = 0.f, size = 1.f;
+	size_t node_id = 0;
+	while(true)
+	{
+		const Node &node = nodes_[node_id];
+		const float sums[4] = { node.sums_[0].load(std::memory_order_relaxed), node.sums_[1].load(std::memory_order_relaxed), node.sums_[2].load(std::memory_order_relaxed), node.sums_[3].load(std::memory_order_relaxed) };
+		const float total = sums[0] + sums[1] + sums[2] + sums[3];
+		if(total <= 0.f) break;
+		//The column is chosen first and then the cell inside the column, reusing each sample for the next level
+		const float prob_x_0 = (sums[0] + sums[2]) / total;
+		int x;
+		if(s_1 < prob_x_0) { x = 0; s_1 /= prob_x_0; }
+		else { x = 1; s_1 = (s_1 - prob_x_0) / (1.f - prob_x_0); }
+		const float column_total = sums[x] + sums[x + 2];
+		const float prob_y_0 = column_total > 0.f ? sums[x] / column_total : 0.5f;
+		int y;
+		if(s_2 < prob_y_0) { y = 0; s_2 /= prob_y_0; }
+		else { y = 1; s_2 = (s_2 - prob_y_0) / (1.f - prob_y_0); }
+		s_1 = std::max(0.f, std::min(s_1, max_square_coordinate_global));
+		s_2 = std::max(0.f, std::min(s_2, max_square_coordinate_global));
+		size *= 0.5f;
+		origin_u += x * size;
+		origin_v += y * size;
+		const uint32_t child_id = node.children_[x + 2 * y];
+		if(child_id == 0) break;
+		node_id = child_id;
+	}
+	return squareToDir(origin_u + s_1 * size, origin_v + s_2 * size);
+}
+
+float DirectionalQuadtree::pdf(const Vec3 &dir) const
+{
+	if(total_ <= 0.f) return 0.f;
+	std::array<float, 2> p = dirToSquare(dir);
+	float density = 1.f;
+	size_t node_id = 0;
+	while(true)
+	{
+		const Node &node = nodes_[node_id];
+		const float total = node.sum();
+		if(total <= 0.f) return 0.f;
+		const int child = childIndex(p);
+		density *= 4.f * node.sums_[child].load(std::memory_order_relaxed) / total;
+		if(node.children_[child] == 0) break;
+		node_id = node.children_[child];
+	}
+	return density * static_cast<float>(0.25 * M_1_PI); //the square maps to the 4 * pi steradians of the sphere with constant area scale
+}
+
+SdTree::SdTree(const Bound &bound, const Parameters &parameters) : bound_(bound), parameters_(parameters)
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float size = bound_.g_[axis] - bound_.a_[axis];
+		inv_size_[axis] = size > 0.f ? 1.f / size : 0.f;
+	}
+	nodes_.resize(1);
+	nodes_[0].leaf_ = 0;
+	leaves_.resize(1);
+}
+
+int SdTree::findLeaf(const Point3 &p, Vec3 *leaf_size) const
+{
+	float position[3];
+	for(int axis = 0; axis < 3; ++axis) position[axis] = std::max(0.f, std::min((p[axis] - bound_.a_[axis]) * inv_size_[axis], 1.f));
+	if(leaf_size) *leaf_size = bound_.g_ - bound_.a_;
+	size_t node_id = 0;
+	while(nodes_[node_id].leaf_ < 0)
+	{
+		const Node &node = nodes_[node_id];
+		const int child = position[node.axis_] >= 0.5f ? 1 : 0;
+		position[node.axis_] = 2.f * position[node.axis_] - child;
+		if(leaf_size) (*leaf_size)[node.axis_] *= 0.5f;
+		node_id = node.children_[child];
+	}
+	return nodes_[node_id].leaf_;
+}
+
+const DirectionalQuadtree *SdTree::getSamplingTree(const Point3 &p) const
+{
+	const DirectionalQuadtree &sampling_tree = leaves_[findLeaf(p)].sampling_;
+	if(sampling_tree.getTotal() <= 0.f) return nullptr;
+	return &sampling_tree;
+}
+
+void SdTree::record(const Point3 &p, const Vec3 &dir, float value, const std::array<float, 3> &jitter)
+{
+	//Stochastic box filter: the record is moved randomly inside a box of the size of its leaf, spreading it to the neighbour leaves
+	Vec3 leaf_size;
+	findLeaf(p, &leaf_size);
+	Point3 filtered_p = p;
+	for(int axis = 0; axis < 3; ++axis) filtered_p[axis] += (jitter[axis] - 0.5f) * leaf_size[axis];
+	DirectionalQuadtree &recording_tree = leaves_[findLeaf(filtered_p)].recording_;
+	recording_tree.addSample();
+	if(value > 0.f && std::isfinite(value)) recording_tree.record(dir, value);
+}
+
+void SdTree::splitLeaf(uint32_t node_id, int depth)
+{
+	const int leaf_id = nodes_[node_id].leaf_;
+	const int num_samples = leaves_[leaf_id].recording_.getNumSamples();
+	if(depth >= parameters_.max_spatial_depth_ || num_samples <= parameters_.spatial_threshold_) return;
+	//Both halves start with a copy of the parent quadtrees, assuming the samples were split evenly between them
+	leaves_[leaf_id].recording_.setNumSamples(num_samples / 2);
+	const Leaf leaf_copy = leaves_[leaf_id];
+	leaves_.push_back(leaf_copy);
+	const int child_axis = (nodes_[node_id].axis_ + 1) % 3;
+	const uint32_t first_child = static_cast<uint32_t>(nodes_.size());
+	nodes_.resize(nodes_.size() + 2);
+	nodes_[first_child].axis_ = child_axis;
+	nodes_[first_child].leaf_ = leaf_id;
+	nodes_[first_child + 1].axis_ = child_axis;
+	nodes_[first_child + 1].leaf_ = static_cast<int>(leaves_.size()) - 1;
+	nodes_[node_id].leaf_ = -1;
+	nodes_[node_id].children_ = {{first_child, first_child + 1}};
+	splitLeaf(first_child, depth + 1);
+	splitLeaf(first_child + 1, depth + 1);
+}
+
+void SdTree::update()
+{
+	for(auto &leaf : leaves_) leaf.recording_.build();
+	struct StackItem
+	{
+		uint32_t node_id_;
+		int depth_;
+	};
+	std::vector<StackItem> stack;
+	stack.push_back({0, 0});
+	while(!stack.empty())
+	{
+		const StackItem item = stack.back();
+		stack.pop_back();
+		const Node &node = nodes_[item.node_id_];
+		if(node.leaf_ >= 0) splitLeaf(item.node_id_, item.depth_);
+		else
+		{
+			stack.push_back({node.children_[0], item.depth_ + 1});
+			stack.push_back({node.children_[1], item.depth_ + 1});
+		}
+	}
+	for(auto &leaf : leaves_)
+	{
+		leaf.sampling_ = leaf.recording_;
+		leaf.recording_.refine(leaf.sampling_, parameters_.directional_threshold_, parameters_.max_directional_depth_);
+	}
+}
+
+int SdTree::getNumDirectionalNodes() const
+{
+	int num_nodes = 0;
+	for(const auto &leaf : leaves_) num_nodes += leaf.sampling_.getNumNodes();
+	return num_nodes;
+}
+
+END_YAFARAY
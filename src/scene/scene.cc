@@ -24,7 +24,12 @@
 #include "common/session.h"
 #include "common/logger.h"
 #include "common/sysinfo.h"
+#include "common/task_pool.h"
 #include "accelerator/accelerator.h"
+#include "common/render_stats.h"
+#include "common/memory_stats.h"
+#include "common/memory.h"
+#include "common/trace.h"
 #include "geometry/object.h"
 #include "common/param.h"
 #include "light/light.h"
@@ -36,9 +41,12 @@
 #include "shader/shader_node.h"
 #include "render/imagefilm.h"
 #include "format/format.h"
+#include "image/tile_cache.h"
 #include "volume/volume.h"
 #include "output/output.h"
 #include "render/render_view.h"
+#include <algorithm>
+#include <chrono>
 
 BEGIN_YAFARAY
 
@@ -66,6 +74,16 @@ std::unique_ptr<Scene> Scene::factory(ParamMap &params)
 	std::unique_ptr<Scene> scene;
 	if(type == "yafaray") scene = YafaRayScene::factory(params);
 	else scene = YafaRayScene::factory(params);
+	if(scene) params.getParam("lazy_creation", scene->lazy_creation_);
+	if(scene) params.getParam("dedup_meshes", scene->dedup_meshes_);
+	if(scene) params.getParam("deferred_geometry_budget", scene->deferred_geometry_budget_);
+	if(scene) params.getParam("asset_cache_dir", scene->asset_cache_dir_);
+	if(scene)
+	{
+		std::string huge_pages = "none";
+		params.getParam("huge_pages", huge_pages);
+		scene->huge_pages_mode_ = HugePages::modeFromName(huge_pages);
+	}
 
 	if(scene) Y_INFO << "Interface: created scene of type '" << type << "'" << YENDL;
 	else Y_ERROR << "Interface: could not create scene of type '" << type << "'" << YENDL;
@@ -82,7 +100,7 @@ Scene::Scene()
 	if(!YAFARAY_BUILD_PLATFORM.empty()) compiler = YAFARAY_BUILD_PLATFORM + "-" + YAFARAY_BUILD_COMPILER;
 
 	Y_INFO << "LibYafaRay (" << YAFARAY_BUILD_VERSION << ")" << " " << YAFARAY_BUILD_OS << " " << YAFARAY_BUILD_ARCHITECTURE << " (" << compiler << ")" << YENDL;
-	session_global.setDifferentialRaysEnabled(false);	//By default, disable ray differential calculations. Only if at least one texture uses them, then enable differentials.
+	session_.setDifferentialRaysEnabled(false);	//By default, disable ray differential calculations. Only if at least one texture uses them, then enable differentials.
 	createDefaultMaterial();
 
 #ifndef HAVE_OPENCV
@@ -101,7 +119,7 @@ void Scene::createDefaultMaterial()
 	std::list<ParamMap> eparams;
 	//Note: keep the std::string or the parameter will be created incorrectly as a bool. This should improve with the new C++17 string literals, but for now with C++11 this should be done.
 	param_map["type"] = std::string("shinydiffusemat");
-	const Material *material = createMaterial("YafaRay_Default_Material", param_map, eparams);
+	const Material *material = instantiateMaterial("YafaRay_Default_Material", param_map, eparams);
 	setCurrentMaterial(material);
 }
 
@@ -151,6 +169,7 @@ void Scene::setNumThreads(int threads)
 	}
 
 	Y_PARAMS << "Using [" << nthreads_ << "] Threads." << YENDL;
+	Y_PARAMS << "CPU SIMD level: " << SysInfo::getSimdLevelName(SysInfo().getSimdLevel()) << YENDL;
 
 	std::stringstream set;
 	set << "CPU threads=" << nthreads_ << std::endl;
@@ -221,14 +240,73 @@ bool Scene::render()
 
 	if(creation_state_.changes_ != CreationState::Flags::CNone)
 	{
-		for(auto &l : getLights()) l.second->init(*this);
-
-		for(auto &output : outputs_)
+		render_times_ = RenderTimes();
+		num_camera_samples_ = 0;
+		MemoryStats::resetPeaks(); //so the peaks are the ones of this render, including the scene data already loaded
+		const Logger::AsyncScope async_logging(logger_global); //so the render threads never wait for the log, for example with the warnings of a broken texture repeated for every sample
+		auto phase_start = std::chrono::steady_clock::now();
+		//Returns the seconds since the previous call, or since the start of the render for the first one
+		auto phase_seconds = [&phase_start]()
 		{
-			output.second->init(image_film_->getWidth(), image_film_->getHeight(), &layers_, &render_views_);
+			const auto phase_end = std::chrono::steady_clock::now();
+			const std::chrono::duration<double> seconds = phase_end - phase_start;
+			phase_start = phase_end;
+			return seconds.count();
+		};
+		//The camera and material updates do not change what the lights are initialized from
+		const bool init_lights = creation_state_.changes_ & ~(CreationState::Flags::CCamera | CreationState::Flags::CMaterial);
+		const bool update_objects = (creation_state_.changes_ & (CreationState::Flags::CGeom | CreationState::Flags::CTransform)) || ((creation_state_.changes_ & CreationState::Flags::CCamera) && hasObjectLods());
+		{
+			//The independent setup phases run concurrently: the accelerator is built while the textures and their mipmaps are loaded,
+			//and the lights not attached to objects (like the background light distributions) are initialized as soon as the textures are loaded.
+			//The lights attached to objects are initialized before the accelerator build, as they can change the objects visibility, and all the lights get the scene bound at the end
+			TraceSpan trace_span("scene", "scene data setup");
+			TaskPool task_pool(getNumThreads());
+			TaskGraph task_graph(task_pool);
+			auto seconds_since = [](const std::chrono::steady_clock::time_point &start) { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+			const size_t textures_task = task_graph.add([&]
+			{
+				const auto start = std::chrono::steady_clock::now();
+				completePendingTextures();
+				render_times_.textures_ = seconds_since(start);
+			});
+			std::vector<size_t> object_light_tasks, light_tasks;
+			if(init_lights)
+			{
+				for(const auto &l : getLights())
+				{
+					Light *light = l.second.get();
+					const size_t light_task = task_graph.add([this, light] { light->init(*this); }, light->initUsesObjects() ? std::vector<size_t>() : std::vector<size_t> {textures_task});
+					if(light->initUsesObjects()) object_light_tasks.push_back(light_task);
+					light_tasks.push_back(light_task);
+				}
+			}
+			//The background precomputations (like the prefiltered environment maps) are done concurrently with the lights, as they only need the textures
+			if(init_lights && background_) task_graph.add([this] { background_->init(*this); }, {textures_task});
+			light_tasks.push_back(task_graph.add([&]
+			{
+				const auto start = std::chrono::steady_clock::now();
+				if(update_objects) updateObjects();
+				render_times_.accelerator_build_ = seconds_since(start);
+			}, object_light_tasks));
+			if(init_lights) task_graph.add([this] { for(auto &l : getLights()) l.second->initSceneBound(getSceneBound()); }, light_tasks);
+			task_graph.add([this]
+			{
+				for(auto &output : outputs_)
+				{
+					output.second->init(image_film_->getWidth(), image_film_->getHeight(), &layers_, &render_views_);
+				}
+			});
+			task_graph.run();
 		}
-
-		if(creation_state_.changes_ & CreationState::Flags::CGeom) updateObjects();
+		if(lazy_creation_ && Y_LOG_HAS_VERBOSE) Y_VERBOSE_SCENE << deferred_materials_.size() << " unused materials and " << pending_textures_.size() << " unused textures were not created nor loaded" << YENDL;
+		phase_seconds();
+		AcceleratorTraversalStats::reset();
+		RenderStats::reset();
+		//The consecutive render views with the same lights and wavelength share the view independent preprocessing of the first one
+		bool previous_view_rendered = false;
+		std::vector<const Light *> previous_view_lights;
+		float previous_view_wavelength = 0.f;
 		for(auto &it : render_views_)
 		{
 			for(auto &o : outputs_) o.second->setRenderView(it.second.get());
@@ -239,26 +317,54 @@ bool Scene::render()
 				Y_WARNING << "Scene: No cameras or lights found at RenderView " << it.second->getName() << "', skipping this RenderView..." << YENDL;
 				continue;
 			}
-			success = (surf_integrator_->preprocess(render_control_, it.second.get(), image_film_.get()) && vol_integrator_->preprocess(render_control_, it.second.get(), image_film_.get()));
+			const std::vector<const Light *> view_lights = it.second->getLightsVisible();
+			const bool share_preprocess = previous_view_rendered && view_lights == previous_view_lights && it.second->getWaveLength() == previous_view_wavelength;
+			if(share_preprocess && Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Scene: RenderView '" << it.second->getName() << "' shares the preprocessing of the previous one" << YENDL;
+			surf_integrator_->shareViewPreprocess(share_preprocess);
+			phase_seconds();
+			{
+				TraceSpan trace_span("preprocess", "preprocess"); //the photon shooting of the photon integrators
+				trace_span.addArg("view", it.second->getName());
+				success = (surf_integrator_->preprocess(render_control_, it.second.get(), image_film_.get()) && vol_integrator_->preprocess(render_control_, it.second.get(), image_film_.get()));
+			}
 			if(!success)
 			{
 				Y_ERROR << "Scene: Preprocessing process failed, exiting..." << YENDL;
+				surf_integrator_->shareViewPreprocess(false);
 				return false;
 			}
+			render_times_.preprocess_ += phase_seconds();
 			render_control_.setStarted();
 			success = surf_integrator_->render(render_control_, it.second.get());
+			render_times_.render_ += phase_seconds();
+			num_camera_samples_ += surf_integrator_->getNumCameraSamples();
 			if(!success)
 			{
 				Y_ERROR << "Scene: Rendering process failed, exiting..." << YENDL;
+				surf_integrator_->shareViewPreprocess(false);
 				return false;
 			}
+			image_film_->measureConvergence(); //the last pass, the previous ones are measured when they finish
 			render_control_.setRenderInfo(surf_integrator_->getRenderInfo());
 			render_control_.setAaNoiseInfo(surf_integrator_->getAaNoiseInfo());
 			surf_integrator_->cleanup();
-			image_film_->flush(it.second.get(), render_control_);
+			{
+				TraceSpan trace_span("output", "output flush");
+				trace_span.addArg("view", it.second->getName());
+				image_film_->flush(it.second.get(), render_control_);
+			}
+			render_times_.output_ += phase_seconds();
 			render_control_.setFinished();
 			image_film_->cleanup();
+			previous_view_rendered = !render_control_.aborted();
+			previous_view_lights = view_lights;
+			previous_view_wavelength = it.second->getWaveLength();
 		}
+		surf_integrator_->shareViewPreprocess(false);
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Scene: Accelerator stats: " << getAcceleratorStats().toJson() << YENDL;
+		Y_INFO << "Scene: Memory: " << MemoryStats::toString() << YENDL;
+		if(RenderStats::enabled() && Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Scene: Render stats: " << RenderStats::renderTotal().toJson() << YENDL;
+		if(Trace::isEnabled()) Trace::save();
 	}
 	else
 	{
@@ -279,8 +385,15 @@ void Scene::clearNonObjects()
 	//Do *NOT* delete or free the outputs, we do not have ownership!
 
 	lights_.clear();
+	retired_lights_.clear();
+	pending_textures_.clear();
+	images_textures_.clear();
+	requested_textures_.clear();
 	textures_.clear();
+	image_buffers_.clear();
 	materials_.clear();
+	retired_materials_.clear();
+	deferred_materials_.clear();
 	cameras_.clear();
 	backgrounds_.clear();
 	integrators_.clear();
@@ -341,11 +454,46 @@ Material *Scene::getMaterial(const std::string &name) const
 	return Scene::findMapItem<Material>(name, materials_);
 }
 
+Material *Scene::getMaterial(const std::string &name)
+{
+	Material *material = Scene::findMapItem<Material>(name, materials_);
+	if(material || deferred_materials_.empty()) return material;
+	auto deferred_material = deferred_materials_.find(name);
+	if(deferred_material == deferred_materials_.end()) return nullptr;
+	//Removed before creating it, so a material using itself does not create it again
+	DeferredMaterial definition = std::move(deferred_material->second);
+	deferred_materials_.erase(deferred_material);
+	return instantiateMaterial(name, definition.params_, definition.eparams_);
+}
+
+void Scene::instantiateReferencedMaterials(const ParamMap &params)
+{
+	if(deferred_materials_.empty()) return;
+	std::string value;
+	for(const auto &param : params)
+	{
+		if(param.second.type() == Parameter::String && param.second.getVal(value) && deferred_materials_.find(value) != deferred_materials_.end()) getMaterial(value);
+	}
+}
+
 Texture *Scene::getTexture(const std::string &name) const
 {
 	return Scene::findMapItem<Texture>(name, textures_);
 }
 
+bool Scene::addImageBuffer(const std::string &name, std::shared_ptr<const HostPixelBuffer> pixel_buffer)
+{
+	if(!pixel_buffer) return false;
+	image_buffers_[name] = std::move(pixel_buffer);
+	return true;
+}
+
+std::shared_ptr<const HostPixelBuffer> Scene::getImageBuffer(const std::string &name) const
+{
+	const auto image_buffer = image_buffers_.find(name);
+	return image_buffer == image_buffers_.end() ? nullptr : image_buffer->second;
+}
+
 Camera *Scene::getCamera(const std::string &name) const
 {
 	return Scene::findMapItem<Camera>(name, cameras_);
@@ -416,6 +564,20 @@ Light *Scene::createLight(const std::string &name, ParamMap &params)
 }
 
 Material *Scene::createMaterial(const std::string &name, ParamMap &params, std::list<ParamMap> &eparams)
+{
+	if(!lazy_creation_) return instantiateMaterial(name, params, eparams);
+	std::string pname = "Material";
+	if(materials_.find(name) != materials_.end() || deferred_materials_.find(name) != deferred_materials_.end())
+	{
+		WARN_EXIST; return nullptr;
+	}
+	params["name"] = name;
+	deferred_materials_[name] = {params, eparams};
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE_SCENE << "Material '" << name << "' will be created when it is used" << YENDL;
+	return nullptr;
+}
+
+Material *Scene::instantiateMaterial(const std::string &name, ParamMap &params, std::list<ParamMap> &eparams)
 {
 	std::string pname = "Material";
 	params["name"] = std::string(name);
@@ -429,6 +591,9 @@ Material *Scene::createMaterial(const std::string &name, ParamMap &params, std::
 		ERR_NO_TYPE; return nullptr;
 	}
 	params["name"] = name;
+	//The textures created until now are decoded together, in parallel, before the first material, shader node, background or volume uses them
+	requestTextures(params, eparams);
+	completePendingTextures();
 	auto material = Material::factory(params, eparams, *this);
 	if(material)
 	{
@@ -578,16 +743,85 @@ ColorOutput *Scene::createOutput(const std::string &name, ParamMap &params, bool
 
 Texture *Scene::createTexture(const std::string &name, ParamMap &params)
 {
-	return createMapItem<Texture>(name, "Texture", params, textures_, this);
+	Texture *texture = createMapItem<Texture>(name, "Texture", params, textures_, this);
+	if(!texture) return nullptr;
+	//The textures loading the same images with the same settings share them, so the images are loaded only once
+	const std::string images_key = texture->getImagesKey();
+	if(!images_key.empty())
+	{
+		const auto images_texture = images_textures_.find(images_key);
+		if(images_texture != images_textures_.end())
+		{
+			texture->shareImages(*images_texture->second);
+			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Scene: Texture '" << name << "' shares the images of a previous texture" << YENDL;
+			return texture;
+		}
+		images_textures_[images_key] = texture;
+	}
+	pending_textures_.push_back(texture);
+	return texture;
+}
+
+void Scene::completePendingTextures()
+{
+	if(pending_textures_.empty()) return;
+	std::vector<Texture *> textures;
+	if(lazy_creation_)
+	{
+		//The textures not used yet stay pending, and are never loaded if nothing uses them
+		auto unused = std::partition(pending_textures_.begin(), pending_textures_.end(), [this](const Texture *texture) { return requested_textures_.find(texture) == requested_textures_.end(); });
+		textures.assign(unused, pending_textures_.end());
+		pending_textures_.erase(unused, pending_textures_.end());
+		if(textures.empty()) return;
+	}
+	else textures.swap(pending_textures_);
+	TraceSpan trace_span("scene", "textures loading");
+	trace_span.addArg("textures", static_cast<int64_t>(textures.size()));
+	//Each texture also uses the task pool threads to generate its mipmaps, so a few big textures do not leave threads idle
+	TaskPool task_pool(std::max(getNumThreads(), SysInfo().getNumSystemThreads()));
+	{
+		TaskPool::Group task_group(task_pool);
+		for(Texture *texture : textures)
+		{
+			task_group.run([texture, &task_pool] { texture->completeLoading(&task_pool); });
+		}
+		task_group.wait();
+	}
+}
+
+void Scene::requestTextures(const ParamMap &params)
+{
+	if(!lazy_creation_) return;
+	std::string value;
+	for(const auto &param : params)
+	{
+		if(param.second.type() != Parameter::String || !param.second.getVal(value)) continue;
+		const Texture *texture = getTexture(value);
+		if(!texture) continue;
+		requested_textures_.insert(texture);
+		//The texture sharing the images of a previous texture needs that one to load them
+		const auto images_texture = images_textures_.find(texture->getImagesKey());
+		if(images_texture != images_textures_.end()) requested_textures_.insert(images_texture->second);
+	}
+}
+
+void Scene::requestTextures(const ParamMap &params, const std::list<ParamMap> &eparams)
+{
+	requestTextures(params);
+	for(const auto &eparam : eparams) requestTextures(eparam);
 }
 
 ShaderNode *Scene::createShaderNode(const std::string &name, ParamMap &params)
 {
+	requestTextures(params);
+	completePendingTextures();
 	return createMapItem<ShaderNode>(name, "ShaderNode", params, shaders_, this);
 }
 
 std::shared_ptr<Background> Scene::createBackground(const std::string &name, ParamMap &params)
 {
+	requestTextures(params);
+	completePendingTextures();
 	return createMapItem<Background>(name, "Background", params, backgrounds_, this);
 }
 
@@ -596,6 +830,62 @@ Camera *Scene::createCamera(const std::string &name, ParamMap &params)
 	return createMapItem<Camera>(name, "Camera", params, cameras_, this);
 }
 
+Camera *Scene::updateCamera(const std::string &name, ParamMap &params)
+{
+	//Only the render views point to the cameras, and they find them again by name when the render starts
+	auto it = cameras_.find(name);
+	if(it == cameras_.end()) return createCamera(name, params);
+	std::unique_ptr<Camera> old_camera = std::move(it->second);
+	cameras_.erase(it);
+	Camera *camera = createCamera(name, params);
+	if(!camera)
+	{
+		cameras_[name] = std::move(old_camera);
+		return nullptr;
+	}
+	creation_state_.changes_ |= CreationState::Flags::CCamera;
+	return camera;
+}
+
+Material *Scene::updateMaterial(const std::string &name, ParamMap &params, std::list<ParamMap> &eparams)
+{
+	//A material not created yet is only redefined
+	deferred_materials_.erase(name);
+	auto it = materials_.find(name);
+	if(it == materials_.end()) return createMaterial(name, params, eparams);
+	std::unique_ptr<Material> old_material = std::move(it->second);
+	materials_.erase(it);
+	Material *material = instantiateMaterial(name, params, eparams);
+	if(!material)
+	{
+		materials_[name] = std::move(old_material);
+		return nullptr;
+	}
+	replaceMaterial(old_material.get(), material);
+	if(creation_state_.current_material_ == old_material.get()) creation_state_.current_material_ = material;
+	//The accelerators keep the ray types seeing each primitive from its material visibility, so they are rebuilt when it changes
+	if(material->getVisibility() != old_material->getVisibility()) creation_state_.changes_ |= CreationState::Flags::CGeom;
+	retired_materials_.push_back(std::move(old_material));
+	creation_state_.changes_ |= CreationState::Flags::CMaterial;
+	return material;
+}
+
+Light *Scene::updateLight(const std::string &name, ParamMap &params)
+{
+	auto it = lights_.find(name);
+	if(it == lights_.end()) return createLight(name, params);
+	std::unique_ptr<Light> old_light = std::move(it->second);
+	lights_.erase(it);
+	Light *light = createLight(name, params);
+	if(!light)
+	{
+		lights_[name] = std::move(old_light);
+		return nullptr;
+	}
+	retired_lights_.push_back(std::move(old_light));
+	return light;
+}
+
 Integrator *Scene::createIntegrator(const std::string &name, ParamMap &params)
 {
 	return createMapItem<Integrator>(name, "Integrator", params, integrators_, this);
@@ -608,6 +898,8 @@ VolumeHandler *Scene::createVolumeHandler(const std::string &name, ParamMap &par
 
 VolumeRegion *Scene::createVolumeRegion(const std::string &name, ParamMap &params)
 {
+	requestTextures(params);
+	completePendingTextures();
 	return createMapItem<VolumeRegion>(name, "VolumeRegion", params, volume_regions_, this);
 }
 
@@ -638,17 +930,27 @@ bool Scene::setupScene(Scene &scene, const ParamMap &params, std::shared_ptr<Pro
 		Y_DEBUG PRTEXT(**Scene::setupScene) PREND;
 		params.printDebug();
 	}
+	std::string trace_file;
+	params.getParam("trace_file", trace_file); //Chrome trace JSON file of the render phases timeline, for chrome://tracing or Perfetto. Disabled if empty
+	Trace::setFile(trace_file);
+	TraceSpan trace_span("scene", "scene setup");
 	std::string name;
 	std::string aa_dark_detection_type_string = "none";
+	std::string aa_sampler_string = "halton";
 	AaNoiseParams aa_noise_params;
 	int nthreads = -1, nthreads_photons = -1;
+	bool threads_pinning = false;
+	bool shading_sort_by_material = false;
+	bool primary_hit_cache = false;
 	bool adv_auto_shadow_bias_enabled = true;
 	float adv_shadow_bias_value = shadow_bias_global;
 	bool adv_auto_min_raydist_enabled = true;
 	float adv_min_raydist_value = min_raydist_global;
 	int adv_base_sampling_offset = 0;
 	int adv_computer_node = 0;
+	int adv_computer_nodes = 1;
 	bool background_resampling = true;  //If false, the background will not be resampled in subsequent adaptative AA passes
+	int texture_cache_size = static_cast<int>(tile_cache_global.getBudget() / (1024 * 1024));
 
 	if(!params.getParam("integrator_name", name))
 	{
@@ -697,27 +999,56 @@ bool Scene::setupScene(Scene &scene, const ParamMap &params, std::shared_ptr<Pro
 	params.getParam("AA_indirect_sample_multiplier_factor", aa_noise_params.indirect_sample_multiplier_factor_);
 	params.getParam("AA_detect_color_noise", aa_noise_params.detect_color_noise_);
 	params.getParam("AA_dark_detection_type", aa_dark_detection_type_string);
+	params.getParam("AA_sampler", aa_sampler_string); //"halton" or "sobol" (Owen scrambled, decorrelated per pixel)
 	params.getParam("AA_dark_threshold_factor", aa_noise_params.dark_threshold_factor_);
 	params.getParam("AA_variance_edge_size", aa_noise_params.variance_edge_size_);
 	params.getParam("AA_variance_pixels", aa_noise_params.variance_pixels_);
+	params.getParam("AA_variance_sampling", aa_noise_params.variance_sampling_);
 	params.getParam("AA_clamp_samples", aa_noise_params.clamp_samples_);
 	params.getParam("AA_clamp_indirect", aa_noise_params.clamp_indirect_);
+	params.getParam("AA_time_budget", aa_noise_params.time_budget_);
+	params.getParam("AA_noise_target", aa_noise_params.noise_target_);
+	params.getParam("AA_preview_levels", aa_noise_params.preview_levels_);
 	params.getParam("threads", nthreads); // number of threads, -1 = auto detection
 	params.getParam("background_resampling", background_resampling);
 
 	nthreads_photons = nthreads;	//if no "threads_photons" parameter exists, make "nthreads_photons" equal to render threads
 
 	params.getParam("threads_photons", nthreads_photons); // number of threads for photon mapping, -1 = auto detection
+	params.getParam("threads_pinning", threads_pinning); // pin each render thread to a CPU, spreading them between the NUMA nodes
+	params.getParam("shading_sort_by_material", shading_sort_by_material); // shade the camera samples of each tile grouped by the material of their first hit
+	params.getParam("primary_hit_cache", primary_hit_cache); // test first the primitive hit by the previous passes in each pixel stratum, only with pinhole cameras
 	params.getParam("adv_auto_shadow_bias_enabled", adv_auto_shadow_bias_enabled);
 	params.getParam("adv_shadow_bias_value", adv_shadow_bias_value);
 	params.getParam("adv_auto_min_raydist_enabled", adv_auto_min_raydist_enabled);
 	params.getParam("adv_min_raydist_value", adv_min_raydist_value);
 	params.getParam("adv_base_sampling_offset", adv_base_sampling_offset); //Base sampling offset, in case of multi-computer rendering each should have a different offset so they don't "repeat" the same samples (user configurable)
 	params.getParam("adv_computer_node", adv_computer_node); //Computer node in multi-computer render environments/render farms
+	params.getParam("adv_computer_nodes", adv_computer_nodes); //If more than 1, the tiles of each frame are distributed between this number of computer nodes instead of each node rendering the whole frame with different samples
 	params.getParam("scene_accelerator", scene_accelerator_); //Computer node in multi-computer render environments/render farms
-
+	params.getParam("scene_accelerator_two_level", scene_accelerator_two_level_);
+	params.getParam("lod_hysteresis", lod_hysteresis_);
+	params.getParam("scene_accelerator_cache_dir", scene_accelerator_cache_dir_);
+	params.getParam("scene_accelerator_spatial_splits", scene_accelerator_spatial_splits_);
+	params.getParam("scene_accelerator_spatial_split_budget", scene_accelerator_spatial_split_budget_);
+	params.getParam("texture_cache_size", texture_cache_size); //memory budget in MB for the tiles of the out of core textures
+	tile_cache_global.setBudget(static_cast<size_t>(std::max(1, texture_cache_size)) * 1024 * 1024);
+
+	scene.setNumThreads(nthreads); //Set before creating the image film, which uses the number of threads to split the areas
+	scene.setNumThreadsPhotons(nthreads_photons);
+	scene.setThreadsPinning(threads_pinning);
+	scene.setShadingSortByMaterial(shading_sort_by_material);
+	scene.setPrimaryHitCache(primary_hit_cache);
 	defineBasicLayers();
 	defineDependentLayers();
+	bool film_denoise = false;
+	params.getParam("film_denoise", film_denoise);
+	if(film_denoise) //the feature layers guiding the film denoiser are rendered as internal layers if they were not defined
+	{
+		if(!layers_.isDefined(Layer::NormalSmooth)) defineLayer(Layer::NormalSmooth, Image::Type::ColorAlpha);
+		if(!layers_.isDefined(Layer::DiffuseColor)) defineLayer(Layer::DiffuseColor, Image::Type::ColorAlpha);
+		if(!layers_.isDefined(Layer::ZDepthAbs)) defineLayer(Layer::ZDepthAbs, Image::Type::GrayAlpha);
+	}
 	image_film_ = ImageFilm::factory(params, this);
 
 	if(pb)
@@ -735,11 +1066,12 @@ bool Scene::setupScene(Scene &scene, const ParamMap &params, std::shared_ptr<Pro
 	else if(aa_dark_detection_type_string == "curve") aa_noise_params.dark_detection_type_ = AaNoiseParams::DarkDetectionType::Curve;
 	else aa_noise_params.dark_detection_type_ = AaNoiseParams::DarkDetectionType::None;
 
+	if(aa_sampler_string == "sobol") aa_noise_params.sampler_type_ = AaNoiseParams::SamplerType::Sobol;
+	else aa_noise_params.sampler_type_ = AaNoiseParams::SamplerType::Halton;
+
 	scene.setSurfIntegrator(static_cast<SurfaceIntegrator *>(integrator));
 	scene.setVolIntegrator(static_cast<VolumeIntegrator *>(volume_integrator));
 	scene.setAntialiasing(aa_noise_params);
-	scene.setNumThreads(nthreads);
-	scene.setNumThreadsPhotons(nthreads_photons);
 	if(background) scene.setBackground(background);
 	scene.shadow_bias_auto_ = adv_auto_shadow_bias_enabled;
 	scene.shadow_bias_ = adv_shadow_bias_value;
@@ -748,6 +1080,8 @@ bool Scene::setupScene(Scene &scene, const ParamMap &params, std::shared_ptr<Pro
 	if(Y_LOG_HAS_DEBUG) Y_DEBUG << "adv_base_sampling_offset=" << adv_base_sampling_offset << YENDL;
 	image_film_->setBaseSamplingOffset(adv_base_sampling_offset);
 	image_film_->setComputerNode(adv_computer_node);
+	image_film_->setNumComputerNodes(std::max(1, adv_computer_nodes));
+	if(adv_computer_nodes > 1) Y_INFO << "Rendering the tiles of computer node " << adv_computer_node << " of " << adv_computer_nodes << " computer nodes" << YENDL;
 	image_film_->setBackgroundResampling(background_resampling);
 	return true;
 }
@@ -31,9 +31,10 @@ std::unique_ptr<Object> CurveObject::factory(ParamMap &params, const Scene &scen
 		params.printDebug();
 	}
 	std::string name, light_name, visibility, base_object_name;
-	bool is_base_object = false, has_uv = false, has_orco = false;
+	bool is_base_object = false, has_uv = false, has_orco = false, strand_ribbons = false;
 	int num_vertices = 0;
 	int object_index = 0;
+	int light_link_mask = -1;
 	float strand_start = 0.01f;
 	float strand_end = 0.01f;
 	float strand_shape = 0.f;
@@ -42,44 +43,81 @@ std::unique_ptr<Object> CurveObject::factory(ParamMap &params, const Scene &scen
 	params.getParam("visibility", visibility);
 	params.getParam("is_base_object", is_base_object);
 	params.getParam("object_index", object_index);
+	params.getParam("light_link_mask", light_link_mask);
 	params.getParam("num_vertices", num_vertices);
 	params.getParam("strand_start", strand_start);
 	params.getParam("strand_end", strand_end);
 	params.getParam("strand_shape", strand_shape);
+	params.getParam("strand_ribbons", strand_ribbons);
 	params.getParam("has_uv", has_uv);
 	params.getParam("has_orco", has_orco);
-	auto object = std::unique_ptr<CurveObject>(new CurveObject(num_vertices, strand_start, strand_end, strand_shape, has_uv, has_orco));
+	auto object = std::unique_ptr<CurveObject>(new CurveObject(num_vertices, strand_start, strand_end, strand_shape, strand_ribbons, has_uv, has_orco, scene.getHugePagesMode()));
 	object->setName(name);
 	object->setLight(scene.getLight(light_name));
 	object->setVisibility(visibilityFromString_global(visibility));
 	object->useAsBaseObject(is_base_object);
 	object->setObjectIndex(object_index);
+	object->setLightLinkMask(static_cast<unsigned int>(light_link_mask));
 	return object;
 }
 
-CurveObject::CurveObject(int num_vertices, float strand_start, float strand_end, float strand_shape, bool has_uv, bool has_orco) : MeshObject(num_vertices, 2 * (num_vertices - 1), has_uv, has_orco), strand_start_(strand_start), strand_end_(strand_end), strand_shape_(strand_shape)
+CurveObject::CurveObject(int num_vertices, float strand_start, float strand_end, float strand_shape, bool ribbons, bool has_uv, bool has_orco, HugePages::Mode huge_pages_mode) : MeshObject(num_vertices, ribbons ? 0 : 2 * (num_vertices - 1), has_uv, has_orco, huge_pages_mode), strand_start_(strand_start), strand_end_(strand_end), strand_shape_(strand_shape), ribbons_(ribbons)
 {
 }
 
+const std::vector<const Primitive *> CurveObject::getPrimitives() const
+{
+	if(!ribbons_) return MeshObject::getPrimitives();
+	std::vector<const Primitive *> primitives;
+	primitives.reserve(segments_.size());
+	for(const auto &segment : segments_) primitives.push_back(&segment);
+	return primitives;
+}
+
+int CurveObject::writePrimitives(const Primitive **primitives) const
+{
+	if(!ribbons_) return MeshObject::writePrimitives(primitives);
+	for(const auto &segment : segments_) *primitives++ = &segment;
+	return static_cast<int>(segments_.size());
+}
+
+float CurveObject::calculateRadius(int index) const
+{
+	const int points_size = points_.size();
+	if(strand_shape_ < 0)
+	{
+		return strand_start_ + math::pow((float)index / (points_size - 1), 1 + strand_shape_) * (strand_end_ - strand_start_);
+	}
+	else
+	{
+		return strand_start_ + (1 - math::pow(((float)(points_size - index - 1)) / (points_size - 1), 1 - strand_shape_)) * (strand_end_ - strand_start_);
+	}
+}
+
 bool CurveObject::calculateObject(const Material *material)
 {
-	const std::vector<Point3> &points = getPoints();
+	const LargeVector<Point3> &points = getPoints();
 	const int points_size = points.size();
+	if(points_size < 2) return false;
+	if(ribbons_)
+	{
+		// one segment primitive between each two points, the strand is not extruded
+		material_ = material;
+		points_.shrink_to_fit();
+		radii_.resize(points_size);
+		for(int i = 0; i < points_size; i++) radii_[i] = calculateRadius(i);
+		segments_.clear();
+		segments_.reserve(points_size - 1);
+		for(int i = 0; i < points_size - 1; i++) segments_.emplace_back(i, *this);
+		return true;
+	}
 	// Vertex extruding
 	Vec3 u{0.f};
 	Vec3 v{0.f};
 	for(int i = 0; i < points_size; i++)
 	{
 		const Point3 o = points[i];
-		float r;	//current radius
-		if(strand_shape_ < 0)
-		{
-			r = strand_start_ + math::pow((float)i / (points_size - 1), 1 + strand_shape_) * (strand_end_ - strand_start_);
-		}
-		else
-		{
-			r = strand_start_ + (1 - math::pow(((float)(points_size - i - 1)) / (points_size - 1), 1 - strand_shape_)) * (strand_end_ - strand_start_);
-		}
+		const float r = calculateRadius(i);	//current radius
 		// Last point keep previous tangent plane
 		if(i < points_size - 1)
 		{
@@ -0,0 +1,154 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "scene/yafaray/object_deferred.h"
+#include "scene/yafaray/object_mesh.h"
+#include "scene/scene.h"
+#include "common/file.h"
+#include "common/logger.h"
+#include "common/param.h"
+#include <cstring>
+#include <mutex>
+
+BEGIN_YAFARAY
+
+//! the object constructor updates the automatic object index shared by all the objects, so the meshes loaded by the render threads are created one at a time
+static std::mutex mesh_creation_mutex_global;
+
+std::unique_ptr<Object> DeferredObject::factory(ParamMap &params, const Scene &scene)
+{
+	if(Y_LOG_HAS_DEBUG)
+	{
+		Y_DEBUG PRTEXT(DeferredObject::factory) PREND;
+		params.printDebug();
+	}
+	std::string name, light_name, visibility, file, material_name;
+	bool compact_attributes = false;
+	int object_index = 0;
+	int light_link_mask = -1;
+	float min[3] = {0.f, 0.f, 0.f}, max[3] = {0.f, 0.f, 0.f};
+	params.getParam("name", name);
+	params.getParam("light_name", light_name);
+	params.getParam("visibility", visibility);
+	params.getParam("object_index", object_index);
+	params.getParam("light_link_mask", light_link_mask);
+	params.getParam("file", file);
+	params.getParam("material", material_name);
+	params.getParam("compact_attributes", compact_attributes);
+	params.getParam("minX", min[0]);
+	params.getParam("minY", min[1]);
+	params.getParam("minZ", min[2]);
+	params.getParam("maxX", max[0]);
+	params.getParam("maxY", max[1]);
+	params.getParam("maxZ", max[2]);
+	if(file.empty())
+	{
+		Y_ERROR << "DeferredObject: no mesh file specified for object '" << name << "'" << YENDL;
+		return nullptr;
+	}
+	const Material *material = material_name.empty() ? nullptr : scene.getMaterial(material_name);
+	if(!material) material = scene.getMaterial("YafaRay_Default_Material");
+	auto object = std::unique_ptr<DeferredObject>(new DeferredObject(file, Bound({min[0], min[1], min[2]}, {max[0], max[1], max[2]}), material, compact_attributes));
+	object->setName(name);
+	object->setLight(scene.getLight(light_name));
+	object->setVisibility(visibilityFromString_global(visibility));
+	object->setObjectIndex(object_index);
+	object->setLightLinkMask(static_cast<unsigned int>(light_link_mask));
+	object->huge_pages_mode_ = scene.getHugePagesMode();
+	return object;
+}
+
+DeferredObject::DeferredObject(const std::string &path, const Bound &bound, const Material *material, bool compact_attributes) : path_(path), bound_(bound), material_(material), compact_attributes_(compact_attributes)
+{
+}
+
+std::unique_ptr<MeshObject> DeferredObject::loadMesh() const
+{
+	MappedFile file(path_);
+	if(!file.isOpen())
+	{
+		Y_ERROR << "DeferredObject: could not open the mesh file '" << path_ << "' of object '" << name_ << "'" << YENDL;
+		return nullptr;
+	}
+	constexpr size_t header_size = 8 + 3 * sizeof(uint32_t);
+	uint32_t header[3];
+	if(file.size() < header_size || std::memcmp(file.data(), "YAFMESH1", 8) != 0)
+	{
+		Y_ERROR << "DeferredObject: '" << path_ << "' is not a YafaRay binary mesh file" << YENDL;
+		return nullptr;
+	}
+	std::memcpy(header, file.data() + 8, sizeof(header));
+	const uint64_t num_vertices = header[0], num_triangles = header[1];
+	const bool has_normals = (header[2] & 1) != 0;
+	const bool has_uv = (header[2] & 2) != 0;
+	const uint64_t points_size = 3 * num_vertices * sizeof(float);
+	const uint64_t indices_size = 3 * num_triangles * sizeof(int32_t);
+	const uint64_t uvs_size = has_uv ? 2 * num_vertices * sizeof(float) : 0;
+	if(file.size() < header_size + points_size * (has_normals ? 2 : 1) + indices_size + uvs_size)
+	{
+		Y_ERROR << "DeferredObject: the mesh file '" << path_ << "' is truncated" << YENDL;
+		return nullptr;
+	}
+	//the buffers are copied as the mapping does not guarantee their alignment
+	const char *data = file.data() + header_size;
+	std::vector<float> points(3 * num_vertices), normals(has_normals ? 3 * num_vertices : 0), uvs(has_uv ? 2 * num_vertices : 0);
+	std::vector<int> indices(3 * num_triangles);
+	std::memcpy(points.data(), data, points_size);
+	data += points_size;
+	if(has_normals)
+	{
+		std::memcpy(normals.data(), data, points_size);
+		data += points_size;
+	}
+	std::memcpy(indices.data(), data, indices_size);
+	data += indices_size;
+	if(has_uv) std::memcpy(uvs.data(), data, uvs_size);
+	for(const int index : indices)
+	{
+		if(index < 0 || static_cast<uint64_t>(index) >= num_vertices)
+		{
+			Y_ERROR << "DeferredObject: the mesh file '" << path_ << "' has vertex indices out of range" << YENDL;
+			return nullptr;
+		}
+	}
+
+	std::unique_ptr<MeshObject> mesh;
+	{
+		std::lock_guard<std::mutex> lock_guard(mesh_creation_mutex_global);
+		mesh = std::unique_ptr<MeshObject>(new MeshObject(static_cast<int>(num_vertices), static_cast<int>(num_triangles), has_uv, false, huge_pages_mode_));
+	}
+	mesh->setName(name_);
+	mesh->setLight(light_);
+	mesh->setVisibility(visibility_);
+	mesh->setObjectIndex(object_index_);
+	mesh->setLightLinkMask(light_link_mask_);
+	mesh->setCompactAttributes(compact_attributes_);
+	mesh->addPoints(points.data(), num_vertices);
+	if(has_normals)
+	{
+		mesh->addNormals(normals.data(), num_vertices);
+		mesh->setSmooth(true);
+	}
+	if(has_uv) mesh->addUvValues(uvs.data(), num_vertices);
+	mesh->addFaces(indices.data(), num_triangles, has_uv ? indices.data() : nullptr, material_);
+	mesh->calculateObject(material_);
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "DeferredObject: loaded " << num_triangles << " triangles of object '" << name_ << "' from '" << path_ << "'" << YENDL;
+	return mesh;
+}
+
+END_YAFARAY
@@ -22,7 +22,11 @@
 #include "scene/scene.h"
 #include "common/logger.h"
 #include "common/param.h"
+#include "common/task_pool.h"
+#include "geometry/matrix4.h"
 #include <array>
+#include <functional>
+#include <algorithm>
 
 BEGIN_YAFARAY
 
@@ -36,30 +40,38 @@ std::unique_ptr<Object> MeshObject::factory(ParamMap &params, const Scene &scene
 	}
 */
 	std::string name, light_name, visibility, base_object_name;
-	bool is_base_object = false, has_uv = false, has_orco = false;
+	bool is_base_object = false, has_uv = false, has_orco = false, compact_attributes = false;
 	int num_faces = 0, num_vertices = 0;
 	int object_index = 0;
+	int light_link_mask = -1;
 	params.getParam("name", name);
 	params.getParam("light_name", light_name);
 	params.getParam("visibility", visibility);
 	params.getParam("is_base_object", is_base_object);
 	params.getParam("object_index", object_index);
+	params.getParam("light_link_mask", light_link_mask);
 	params.getParam("num_faces", num_faces);
 	params.getParam("num_vertices", num_vertices);
 	params.getParam("has_uv", has_uv);
 	params.getParam("has_orco", has_orco);
-	auto object = std::unique_ptr<MeshObject>(new MeshObject(num_vertices, num_faces, has_uv, has_orco));
+	params.getParam("compact_attributes", compact_attributes);
+	auto object = std::unique_ptr<MeshObject>(new MeshObject(num_vertices, num_faces, has_uv, has_orco, scene.getHugePagesMode()));
+	object->setCompactAttributes(compact_attributes);
 	object->setName(name);
 	object->setLight(scene.getLight(light_name));
 	object->setVisibility(visibilityFromString_global(visibility));
 	object->useAsBaseObject(is_base_object);
 	object->setObjectIndex(object_index);
+	object->setLightLinkMask(static_cast<unsigned int>(light_link_mask));
 	return object;
 }
 
-MeshObject::MeshObject(int num_vertices, int num_faces, bool has_uv, bool has_orco)
+MeshObject::MeshObject(int num_vertices, int num_faces, bool has_uv, bool has_orco, HugePages::Mode huge_pages_mode) : points_(LargeBufferAllocator<Point3>(huge_pages_mode)), face_vertices_(LargeBufferAllocator<int>(huge_pages_mode)), face_normals_(LargeBufferAllocator<int>(huge_pages_mode)), face_uvs_(LargeBufferAllocator<int>(huge_pages_mode))
 {
 	faces_.reserve(num_faces);
+	face_vertices_.reserve(3 * num_faces);
+	face_normals_.reserve(3 * num_faces);
+	face_uvs_.reserve(3 * num_faces);
 	points_.reserve(num_vertices);
 	if(has_orco) orco_points_.reserve(num_vertices);
 	if(has_uv) uv_values_.reserve(num_vertices);
@@ -69,37 +81,150 @@ MeshObject::~MeshObject()
 {
 }
 
-void MeshObject::addFace(std::unique_ptr<FacePrimitive> face)
+void MeshObject::replaceMaterial(const Material *old_material, const Material *new_material)
 {
-	if(face)
+	for(auto &face : faces_) if(face.getMaterial() == old_material) face.setMaterial(new_material);
+}
+
+void MeshObject::addFace(const std::vector<int> &vertices, const std::vector<int> &vertices_uv, const Material *mat)
+{
+	if(vertices.size() != 3) return; //Other primitives are not supported
+	const uint32_t first_index = static_cast<uint32_t>(face_vertices_.size());
+	for(size_t vert_num = 0; vert_num < vertices.size(); ++vert_num)
 	{
-		face->setSelfIndex(faces_.size());
-		faces_.emplace_back(std::move(face));
+		face_vertices_.push_back(vertices[vert_num]);
+		face_normals_.push_back(hasNormalsExported() ? vertices[vert_num] : -1);
+		face_uvs_.push_back(vert_num < vertices_uv.size() ? vertices_uv[vert_num] : -1);
 	}
+	faces_.emplace_back(first_index, *this);
+	faces_.back().setSelfIndex(faces_.size() - 1);
+	faces_.back().setMaterial(mat);
 }
 
-void MeshObject::addFace(const std::vector<int> &vertices, const std::vector<int> &vertices_uv, const Material *mat)
+void MeshObject::addFaces(const int *vertices, size_t num_faces, const int *vertices_uv, const Material *mat)
+{
+	const bool has_normals = hasNormalsExported();
+	const size_t num_indices = 3 * num_faces;
+	const uint32_t first_index = static_cast<uint32_t>(face_vertices_.size());
+	face_vertices_.insert(face_vertices_.end(), vertices, vertices + num_indices);
+	if(has_normals) face_normals_.insert(face_normals_.end(), vertices, vertices + num_indices);
+	else face_normals_.resize(face_normals_.size() + num_indices, -1);
+	if(vertices_uv) face_uvs_.insert(face_uvs_.end(), vertices_uv, vertices_uv + num_indices);
+	else face_uvs_.resize(face_uvs_.size() + num_indices, -1);
+	faces_.reserve(faces_.size() + num_faces);
+	for(size_t face_num = 0; face_num < num_faces; ++face_num)
+	{
+		faces_.emplace_back(first_index + 3 * face_num, *this);
+		faces_.back().setSelfIndex(faces_.size() - 1);
+		faces_.back().setMaterial(mat);
+	}
+}
+
+void MeshObject::setFaceNormalsIndices(const FacePrimitive &face, const FacePrimitive::VertexArray<int> &normals_indices)
+{
+	std::copy(normals_indices.begin(), normals_indices.begin() + face.numVertices(), face_normals_.begin() + face.getFirstIndex());
+}
+
+Vec3 MeshObject::getVertexNormal(int index) const
+{
+	if(packed_normals_.empty()) return normals_[index];
+	// octahedral decoding, the lower half of the octahedron is folded over the upper one
+	const uint32_t packed = packed_normals_[index];
+	Vec3 n((packed & 0xFFFF) * (2.f / 65535.f) - 1.f, (packed >> 16) * (2.f / 65535.f) - 1.f, 0.f);
+	n.z_ = 1.f - std::abs(n.x_) - std::abs(n.y_);
+	const float fold = std::max(-n.z_, 0.f);
+	n.x_ += (n.x_ >= 0.f) ? -fold : fold;
+	n.y_ += (n.y_ >= 0.f) ? -fold : fold;
+	return n.normalize();
+}
+
+Uv MeshObject::getUvValue(int index) const
+{
+	if(packed_uv_values_.empty()) return uv_values_[index];
+	const std::array<uint16_t, 2> &packed = packed_uv_values_[index];
+	return { packed_uv_min_.u_ + packed[0] * packed_uv_scale_.u_, packed_uv_min_.v_ + packed[1] * packed_uv_scale_.v_ };
+}
+
+void MeshObject::packNormals()
 {
-	std::unique_ptr<FacePrimitive> face;
-	if(vertices.size() == 3) face = std::unique_ptr<FacePrimitive>(new TrianglePrimitive(vertices, vertices_uv, *this));
-	else return; //Other primitives are not supported
-	face->setMaterial(mat);
-	if(hasNormalsExported()) face->setNormalsIndices(vertices);
-	addFace(std::move(face));
+	if(normals_.empty()) return;
+	packed_normals_.resize(normals_.size());
+	for(size_t idx = 0; idx < normals_.size(); ++idx)
+	{
+		const Vec3 &n = normals_[idx];
+		const float inv_l_1 = 1.f / std::max(1e-20f, std::abs(n.x_) + std::abs(n.y_) + std::abs(n.z_));
+		float x = n.x_ * inv_l_1;
+		float y = n.y_ * inv_l_1;
+		if(n.z_ < 0.f)
+		{
+			const float folded_x = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+			y = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+			x = folded_x;
+		}
+		const uint32_t packed_x = static_cast<uint32_t>(std::round((x * 0.5f + 0.5f) * 65535.f));
+		const uint32_t packed_y = static_cast<uint32_t>(std::round((y * 0.5f + 0.5f) * 65535.f));
+		packed_normals_[idx] = packed_x | (packed_y << 16);
+	}
+	std::vector<Vec3>().swap(normals_);
+}
+
+void MeshObject::unpackNormals()
+{
+	if(packed_normals_.empty()) return;
+	normals_.resize(packed_normals_.size());
+	for(size_t idx = 0; idx < normals_.size(); ++idx) normals_[idx] = getVertexNormal(idx);
+	std::vector<uint32_t>().swap(packed_normals_);
+}
+
+void MeshObject::packUvValues()
+{
+	if(uv_values_.empty()) return;
+	Uv uv_max = uv_values_[0];
+	packed_uv_min_ = uv_values_[0];
+	for(const auto &uv : uv_values_)
+	{
+		packed_uv_min_ = { std::min(packed_uv_min_.u_, uv.u_), std::min(packed_uv_min_.v_, uv.v_) };
+		uv_max = { std::max(uv_max.u_, uv.u_), std::max(uv_max.v_, uv.v_) };
+	}
+	// the uvs are quantized in the range covered by the mesh, the precision only depends on how large that range is
+	packed_uv_scale_ = { (uv_max.u_ - packed_uv_min_.u_) / 65535.f, (uv_max.v_ - packed_uv_min_.v_) / 65535.f };
+	const float inv_scale_u = packed_uv_scale_.u_ > 0.f ? 1.f / packed_uv_scale_.u_ : 0.f;
+	const float inv_scale_v = packed_uv_scale_.v_ > 0.f ? 1.f / packed_uv_scale_.v_ : 0.f;
+	packed_uv_values_.resize(uv_values_.size());
+	for(size_t idx = 0; idx < uv_values_.size(); ++idx)
+	{
+		packed_uv_values_[idx][0] = static_cast<uint16_t>(std::round((uv_values_[idx].u_ - packed_uv_min_.u_) * inv_scale_u));
+		packed_uv_values_[idx][1] = static_cast<uint16_t>(std::round((uv_values_[idx].v_ - packed_uv_min_.v_) * inv_scale_v));
+	}
+	std::vector<Uv>().swap(uv_values_);
 }
 
-void MeshObject::calculateNormals()
+void MeshObject::calculateNormals(TaskPool *task_pool)
 {
-	for(auto &face : faces_) face->calculateGeometricNormal();
+	parallelFor_global(task_pool, faces_.size(), [this](size_t begin, size_t end)
+	{
+		for(size_t face_id = begin; face_id < end; ++face_id) faces_[face_id].calculateGeometricNormal();
+	});
 }
 
 bool MeshObject::calculateObject(const Material *)
 {
 	faces_.shrink_to_fit();
 	points_.shrink_to_fit();
+	face_vertices_.shrink_to_fit();
+	face_normals_.shrink_to_fit();
+	if(hasUv()) face_uvs_.shrink_to_fit();
+	else LargeVector<int>().swap(face_uvs_);
 	if(!orco_points_.empty()) orco_points_.shrink_to_fit();
 	if(!uv_values_.empty()) uv_values_.shrink_to_fit();
 	calculateNormals();
+	if(compact_attributes_)
+	{
+		packNormals();
+		packUvValues();
+	}
+	memory_tracker_.set(vectorMemory_global(faces_) + vectorMemory_global(points_) + vectorMemory_global(orco_points_) + vectorMemory_global(normals_) + vectorMemory_global(uv_values_)
+						+ vectorMemory_global(face_vertices_) + vectorMemory_global(face_normals_) + vectorMemory_global(face_uvs_) + vectorMemory_global(packed_normals_) + vectorMemory_global(packed_uv_values_));
 	return true;
 }
 
@@ -107,10 +232,16 @@ const std::vector<const Primitive *> MeshObject::getPrimitives() const
 {
 	std::vector<const Primitive *> primitives;
 	primitives.reserve(faces_.size());
-	for(const auto &face : faces_) primitives.push_back(face.get());
+	for(const auto &face : faces_) primitives.push_back(&face);
 	return primitives;
 }
 
+int MeshObject::writePrimitives(const Primitive **primitives) const
+{
+	for(const auto &face : faces_) *primitives++ = &face;
+	return static_cast<int>(faces_.size());
+}
+
 void MeshObject::addNormal(const Vec3 &n)
 {
 	const size_t points_size = points_.size();
@@ -118,126 +249,178 @@ void MeshObject::addNormal(const Vec3 &n)
 	normals_.push_back(n);
 }
 
-float getAngleSine_global(const std::array<int, 3> &triangle_indices, const std::vector<Point3> &vertices)
+void MeshObject::addPoints(const float *points, size_t num_points)
+{
+	points_.reserve(points_.size() + num_points);
+	for(size_t i = 0; i < num_points; ++i) points_.push_back({points[3 * i], points[3 * i + 1], points[3 * i + 2]});
+}
+
+void MeshObject::addOrcoPoints(const float *points, size_t num_points)
+{
+	orco_points_.reserve(orco_points_.size() + num_points);
+	for(size_t i = 0; i < num_points; ++i) orco_points_.push_back({points[3 * i], points[3 * i + 1], points[3 * i + 2]});
+}
+
+void MeshObject::addNormals(const float *normals, size_t num_normals)
+{
+	normals_.reserve(normals_.size() + num_normals);
+	for(size_t i = 0; i < num_normals; ++i) normals_.push_back({normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]});
+}
+
+int MeshObject::addUvValues(const float *uvs, size_t num_uvs)
+{
+	const int first_uv = static_cast<int>(uv_values_.size());
+	uv_values_.reserve(uv_values_.size() + num_uvs);
+	for(size_t i = 0; i < num_uvs; ++i) uv_values_.push_back({uvs[2 * i], uvs[2 * i + 1]});
+	return first_uv;
+}
+
+float getAngleSine_global(const std::array<int, 3> &triangle_indices, const LargeVector<Point3> &vertices)
 {
 	const Vec3 edge_1 = vertices[triangle_indices[1]] - vertices[triangle_indices[0]];
 	const Vec3 edge_2 = vertices[triangle_indices[2]] - vertices[triangle_indices[0]];
 	return edge_1.sinFromVectors(edge_2);
 }
 
-bool MeshObject::smoothNormals(float angle)
+bool MeshObject::smoothNormals(float angle, TaskPool *task_pool)
 {
 	const size_t points_size = points_.size();
+	unpackNormals();
 	normals_.resize(points_size, {0, 0, 0});
-
-	if(angle >= 180)
+	if(angle <= 0.1f)
 	{
-		for(auto &face : faces_)
+		if(compact_attributes_) packNormals();
+		setSmooth(true);
+		return true;
+	}
+	// faces around each vertex in compressed rows, so the vertex normals are gathered in parallel without locks: the corners (positions in the face index buffers) of a vertex are vertex_corners[vertex_offsets[vertex]] up to vertex_corners[vertex_offsets[vertex + 1]]
+	const size_t num_corners = face_vertices_.size();
+	std::vector<uint32_t> corner_faces(num_corners);
+	std::vector<uint32_t> vertex_offsets(points_size + 1, 0);
+	for(size_t face_id = 0; face_id < faces_.size(); ++face_id)
+	{
+		const uint32_t first_index = faces_[face_id].getFirstIndex();
+		for(size_t relative_vertex = 0; relative_vertex < faces_[face_id].numVertices(); ++relative_vertex)
 		{
-			const Vec3 n = face->getGeometricNormal();
-			const std::vector<int> vert_indices = face->getVerticesIndices();
-			const size_t num_indices = vert_indices.size();
-			for(size_t relative_vertex = 0; relative_vertex < num_indices; ++relative_vertex)
-			{
-				normals_[vert_indices[relative_vertex]] += n * getAngleSine_global({vert_indices[relative_vertex], vert_indices[(relative_vertex + 1) % num_indices], vert_indices[(relative_vertex + 2) % num_indices]}, points_);
-			}
-			face->setNormalsIndices(vert_indices);
+			corner_faces[first_index + relative_vertex] = static_cast<uint32_t>(face_id);
+			++vertex_offsets[face_vertices_[first_index + relative_vertex] + 1];
 		}
-		for(size_t idx = 0; idx < normals_.size(); ++idx) normals_[idx].normalize();
 	}
-	else if(angle > 0.1f) // angle dependant smoothing
+	for(size_t point_id = 0; point_id < points_size; ++point_id) vertex_offsets[point_id + 1] += vertex_offsets[point_id];
+	std::vector<uint32_t> vertex_corners(num_corners);
 	{
-		const float angle_threshold = math::cos(math::degToRad(angle));
-		// create list of faces that include given vertex
-		std::vector<std::vector<FacePrimitive *>> points_faces(points_size);
-		std::vector<std::vector<float>> points_angles_sines(points_size);
-		for(auto &face : faces_)
+		std::vector<uint32_t> next_corner(vertex_offsets.begin(), vertex_offsets.end() - 1);
+		for(size_t corner = 0; corner < num_corners; ++corner) vertex_corners[next_corner[face_vertices_[corner]]++] = static_cast<uint32_t>(corner);
+	}
+	// weight of each face in the normal of each of its vertices
+	std::vector<float> corner_sines(num_corners);
+	parallelFor_global(task_pool, faces_.size(), [&](size_t begin, size_t end)
+	{
+		for(size_t face_id = begin; face_id < end; ++face_id)
 		{
-			const std::vector<int> vert_indices = face->getVerticesIndices();
-			const size_t num_indices = vert_indices.size();
+			const uint32_t first_index = faces_[face_id].getFirstIndex();
+			const size_t num_indices = faces_[face_id].numVertices();
 			for(size_t relative_vertex = 0; relative_vertex < num_indices; ++relative_vertex)
 			{
-				points_angles_sines[vert_indices[relative_vertex]].push_back(getAngleSine_global({vert_indices[relative_vertex], vert_indices[(relative_vertex + 1) % num_indices], vert_indices[(relative_vertex + 2) % num_indices]}, points_));
-				points_faces[vert_indices[relative_vertex]].push_back(face.get());
+				corner_sines[first_index + relative_vertex] = getAngleSine_global({face_vertices_[first_index + relative_vertex], face_vertices_[first_index + (relative_vertex + 1) % num_indices], face_vertices_[first_index + (relative_vertex + 2) % num_indices]}, points_);
 			}
 		}
-		for(size_t point_id = 0; point_id < points_size; ++point_id)
+	});
+
+	if(angle >= 180)
+	{
+		parallelFor_global(task_pool, points_size, [&](size_t begin, size_t end)
 		{
-			int j = 0;
-			std::vector<Vec3> vertex_normals;
-			std::vector<int> vertex_normals_indices;
-			for(const auto &point_face : points_faces[point_id])
+			for(size_t point_id = begin; point_id < end; ++point_id)
 			{
-				bool smooth = false;
-				// calculate vertex normal for face
-				const Vec3 face_normal = point_face->getGeometricNormal();
-				Vec3 vertex_normal = face_normal * points_angles_sines[point_id][j];
-				int k = 0;
-				for(const auto &point_face_2 : points_faces[point_id])
+				Vec3 normal = normals_[point_id];
+				for(uint32_t i = vertex_offsets[point_id]; i < vertex_offsets[point_id + 1]; ++i)
 				{
-					if(point_face == point_face_2)
-					{
-						k++;
-						continue;
-					}
-					Vec3 face_2_normal = point_face_2->getGeometricNormal();
-					if((face_normal * face_2_normal) > angle_threshold)
-					{
-						smooth = true;
-						vertex_normal += face_2_normal * points_angles_sines[point_id][k];
-					}
-					k++;
+					const uint32_t corner = vertex_corners[i];
+					normal += faces_[corner_faces[corner]].getGeometricNormal() * corner_sines[corner];
 				}
-				int normal_idx = -1;
-				if(smooth)
+				normals_[point_id] = normal.normalize();
+			}
+		});
+		face_normals_ = face_vertices_;
+	}
+	else // angle dependant smoothing
+	{
+		const float angle_threshold = math::cos(math::degToRad(angle));
+		// each vertex gets one smoothed normal for each group of similar faces around it, kept in the vertex row until their final indices are known
+		std::vector<Vec3> cluster_normals(num_corners);
+		std::vector<int> corner_clusters(num_corners, -1);
+		std::vector<uint32_t> vertex_num_clusters(points_size, 0);
+		parallelFor_global(task_pool, points_size, [&](size_t begin, size_t end)
+		{
+			for(size_t point_id = begin; point_id < end; ++point_id)
+			{
+				const uint32_t row_begin = vertex_offsets[point_id];
+				const uint32_t row_end = vertex_offsets[point_id + 1];
+				uint32_t num_clusters = 0;
+				for(uint32_t i = row_begin; i < row_end; ++i)
 				{
-					vertex_normal.normalize();
-					//search for existing normal
-					const size_t num_vertex_normals = vertex_normals.size();
-					for(size_t vertex_normal_id = 0; vertex_normal_id < num_vertex_normals; ++vertex_normal_id)
+					const uint32_t corner = vertex_corners[i];
+					const Vec3 face_normal = faces_[corner_faces[corner]].getGeometricNormal();
+					Vec3 vertex_normal = face_normal * corner_sines[corner];
+					bool smooth = false;
+					for(uint32_t j = row_begin; j < row_end; ++j)
 					{
-						if(vertex_normal * vertex_normals[vertex_normal_id] > 0.999f)
+						if(j == i) continue;
+						const uint32_t corner_2 = vertex_corners[j];
+						const Vec3 face_2_normal = faces_[corner_faces[corner_2]].getGeometricNormal();
+						if((face_normal * face_2_normal) > angle_threshold)
 						{
-							normal_idx = vertex_normals_indices[vertex_normal_id];
-							break;
+							smooth = true;
+							vertex_normal += face_2_normal * corner_sines[corner_2];
 						}
 					}
-					// create new if none found
-					if(normal_idx == -1)
+					if(!smooth) continue; //the face keeps its geometric normal at this vertex
+					vertex_normal.normalize();
+					//search for existing normal, create new if none found
+					int cluster = -1;
+					for(uint32_t k = 0; k < num_clusters; ++k)
 					{
-						normal_idx = normals_.size();
-						vertex_normals.push_back(vertex_normal);
-						vertex_normals_indices.push_back(normal_idx);
-						normals_.push_back(vertex_normal);
+						if(vertex_normal * cluster_normals[row_begin + k] > 0.999f)
+						{
+							cluster = static_cast<int>(k);
+							break;
+						}
 					}
-				}
-				// set vertex normal to idx
-				const std::vector<int> vertices_indices = point_face->getVerticesIndices();
-				std::vector<int> normals_indices = point_face->getNormalsIndices();
-				bool smooth_ok = false;
-				const size_t num_vertices = vertices_indices.size();
-				for(size_t relative_vertex = 0; relative_vertex < num_vertices; ++relative_vertex)
-				{
-					if(vertices_indices[relative_vertex] == static_cast<int>(point_id))
+					if(cluster == -1)
 					{
-						normals_indices[relative_vertex] = normal_idx;
-						smooth_ok = true;
-						break;
+						cluster = static_cast<int>(num_clusters++);
+						cluster_normals[row_begin + cluster] = vertex_normal;
 					}
+					corner_clusters[corner] = cluster;
 				}
-				if(smooth_ok)
-				{
-					point_face->setNormalsIndices(normals_indices);
-					j++;
-				}
-				else
+				vertex_num_clusters[point_id] = num_clusters;
+			}
+		});
+		// the new normals are appended in vertex order, as the vertices were processed serially
+		std::vector<uint32_t> vertex_first_normal(points_size);
+		size_t num_normals = normals_.size();
+		for(size_t point_id = 0; point_id < points_size; ++point_id)
+		{
+			vertex_first_normal[point_id] = static_cast<uint32_t>(num_normals);
+			num_normals += vertex_num_clusters[point_id];
+		}
+		normals_.resize(num_normals);
+		parallelFor_global(task_pool, points_size, [&](size_t begin, size_t end)
+		{
+			for(size_t point_id = begin; point_id < end; ++point_id)
+			{
+				const uint32_t row_begin = vertex_offsets[point_id];
+				for(uint32_t k = 0; k < vertex_num_clusters[point_id]; ++k) normals_[vertex_first_normal[point_id] + k] = cluster_normals[row_begin + k];
+				for(uint32_t i = row_begin; i < vertex_offsets[point_id + 1]; ++i)
 				{
-					Y_ERROR << "Mesh smoothing error!" << YENDL;
-					return false;
+					const uint32_t corner = vertex_corners[i];
+					face_normals_[corner] = corner_clusters[corner] == -1 ? -1 : static_cast<int>(vertex_first_normal[point_id]) + corner_clusters[corner];
 				}
 			}
-		}
+		});
 	}
+	if(compact_attributes_) packNormals();
 	setSmooth(true);
 	return true;
 }
@@ -252,6 +435,101 @@ MeshObject *MeshObject::getMeshFromObject(Object *object)
 	else return static_cast<MeshObject *>(object);
 }
 
+uint64_t MeshObject::contentHash() const
+{
+	uint64_t hash = 14695981039346656037ull;
+	const auto hash_bytes = [&hash](const void *data, size_t size)
+	{
+		const unsigned char *bytes = static_cast<const unsigned char *>(data);
+		for(size_t byte_num = 0; byte_num < size; ++byte_num)
+		{
+			hash ^= bytes[byte_num];
+			hash *= 1099511628211ull;
+		}
+	};
+	const std::array<uint64_t, 6> sizes {{points_.size(), normals_.size(), orco_points_.size(), uv_values_.size(), face_vertices_.size(), faces_.size()}};
+	hash_bytes(sizes.data(), sizes.size() * sizeof(uint64_t));
+	const std::array<bool, 2> settings {{is_smooth_, compact_attributes_}};
+	hash_bytes(settings.data(), settings.size() * sizeof(bool));
+	hash_bytes(face_vertices_.data(), face_vertices_.size() * sizeof(int));
+	hash_bytes(face_normals_.data(), face_normals_.size() * sizeof(int));
+	hash_bytes(face_uvs_.data(), face_uvs_.size() * sizeof(int));
+	for(const auto &uv : uv_values_) hash_bytes(&uv.u_, 2 * sizeof(float));
+	for(const auto &orco_point : orco_points_) hash_bytes(&orco_point.x_, 3 * sizeof(float));
+	for(const auto &face : faces_)
+	{
+		const Material *material = face.getMaterial();
+		hash_bytes(&material, sizeof(material));
+	}
+	return hash;
+}
+
+//! orthonormal frame of the triangle (a, b, c) as the columns of a rotation, false for a degenerate triangle
+static bool triangleFrame_global(const Point3 &a, const Point3 &b, const Point3 &c, std::array<Vec3, 3> &frame)
+{
+	const Vec3 edge_1 = b - a, edge_2 = c - a;
+	const Vec3 normal = edge_1 ^ edge_2;
+	if(edge_1.lengthSqr() <= 0.f || normal.lengthSqr() <= 1e-12f * edge_1.lengthSqr() * edge_2.lengthSqr()) return false;
+	frame[0] = edge_1;
+	frame[0].normalize();
+	frame[2] = normal;
+	frame[2].normalize();
+	frame[1] = frame[2] ^ frame[0];
+	return true;
+}
+
+bool MeshObject::findRigidTransformFrom(const MeshObject &base, Matrix4 &base_to_this) const
+{
+	if(points_.size() != base.points_.size() || normals_.size() != base.normals_.size() || face_vertices_ != base.face_vertices_ || face_normals_ != base.face_normals_ || face_uvs_ != base.face_uvs_) return false;
+	if(is_smooth_ != base.is_smooth_ || compact_attributes_ != base.compact_attributes_ || faces_.size() != base.faces_.size()) return false;
+	for(size_t face_num = 0; face_num < faces_.size(); ++face_num) if(faces_[face_num].getMaterial() != base.faces_[face_num].getMaterial()) return false;
+	for(size_t uv_num = 0; uv_num < uv_values_.size(); ++uv_num) if(uv_values_[uv_num].u_ != base.uv_values_[uv_num].u_ || uv_values_[uv_num].v_ != base.uv_values_[uv_num].v_) return false;
+	if(orco_points_.size() != base.orco_points_.size() || !std::equal(orco_points_.begin(), orco_points_.end(), base.orco_points_.begin(), [](const Point3 &a, const Point3 &b) { return a.x_ == b.x_ && a.y_ == b.y_ && a.z_ == b.z_; })) return false;
+
+	// the rotation maps the frame of the first non degenerate face of the base onto the frame of the same face here
+	std::array<Vec3, 3> base_frame, frame;
+	size_t first_index = face_vertices_.size();
+	for(size_t index = 0; index + 2 < face_vertices_.size(); index += 3)
+	{
+		const int v_0 = face_vertices_[index], v_1 = face_vertices_[index + 1], v_2 = face_vertices_[index + 2];
+		if(triangleFrame_global(base.points_[v_0], base.points_[v_1], base.points_[v_2], base_frame) && triangleFrame_global(points_[v_0], points_[v_1], points_[v_2], frame))
+		{
+			first_index = index;
+			break;
+		}
+	}
+	if(first_index == face_vertices_.size()) return false;
+	float rotation[3][3];
+	for(int row = 0; row < 3; ++row)
+		for(int col = 0; col < 3; ++col)
+			rotation[row][col] = frame[0][row] * base_frame[0][col] + frame[1][row] * base_frame[1][col] + frame[2][row] * base_frame[2][col];
+	const auto rotate = [&rotation](const Vec3 &v) { return Vec3(rotation[0][0] * v.x_ + rotation[0][1] * v.y_ + rotation[0][2] * v.z_, rotation[1][0] * v.x_ + rotation[1][1] * v.y_ + rotation[1][2] * v.z_, rotation[2][0] * v.x_ + rotation[2][1] * v.y_ + rotation[2][2] * v.z_); };
+	const Point3 &base_origin = base.points_[face_vertices_[first_index]];
+	const Point3 &origin = points_[face_vertices_[first_index]];
+
+	// every vertex must land on its copy within a tolerance relative to the size of the mesh
+	Bound bound(base.points_.front(), base.points_.front());
+	for(const auto &point : base.points_) bound.include(point);
+	const float tolerance = 1e-5f * std::max(1e-6f, std::max(bound.longX(), std::max(bound.longY(), bound.longZ())));
+	for(size_t point_num = 0; point_num < points_.size(); ++point_num)
+	{
+		const Vec3 moved = rotate(base.points_[point_num] - base_origin) + (origin - points_[point_num]);
+		if(moved.lengthSqr() > tolerance * tolerance) return false;
+	}
+	for(size_t normal_num = 0; normal_num < normals_.size(); ++normal_num)
+	{
+		if((rotate(base.normals_[normal_num]) - normals_[normal_num]).lengthSqr() > 1e-6f) return false;
+	}
+	const Vec3 translation = Vec3(origin) - rotate(Vec3(base_origin));
+	base_to_this.identity();
+	for(int row = 0; row < 3; ++row)
+	{
+		for(int col = 0; col < 3; ++col) base_to_this.setVal(row, col, rotation[row][col]);
+		base_to_this.setVal(row, 3, translation[row]);
+	}
+	return true;
+}
+
 /*int MeshObject::convertToBezierControlPoints()
 {
 	const int n = points_.size();
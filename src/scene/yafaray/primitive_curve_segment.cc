@@ -0,0 +1,167 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "scene/yafaray/primitive_curve_segment.h"
+#include "scene/yafaray/object_curve.h"
+#include "geometry/bound.h"
+#include "geometry/surface.h"
+#include "geometry/matrix4.h"
+
+BEGIN_YAFARAY
+
+CurveSegmentPrimitive::CurveSegmentPrimitive(int point_index, const CurveObject &curve_object) : Primitive(curve_object), point_index_(point_index)
+{
+}
+
+const CurveObject &CurveSegmentPrimitive::getCurveObject() const
+{
+	return static_cast<const CurveObject &>(base_object_);
+}
+
+Point3 CurveSegmentPrimitive::getPoint(int point_number, const Matrix4 *obj_to_world) const
+{
+	const Point3 point = getCurveObject().getVertex(point_index_ + point_number);
+	if(obj_to_world) return (*obj_to_world) * point;
+	else return point;
+}
+
+float CurveSegmentPrimitive::getRadius(int point_number) const
+{
+	return getCurveObject().getRadius(point_index_ + point_number);
+}
+
+const Material *CurveSegmentPrimitive::getMaterial() const
+{
+	return getCurveObject().getMaterial();
+}
+
+Bound CurveSegmentPrimitive::getBound(const Matrix4 *obj_to_world) const
+{
+	const Point3 p_0 = getPoint(0, obj_to_world);
+	const Point3 p_1 = getPoint(1, obj_to_world);
+	const Vec3 r(std::max(getRadius(0), getRadius(1)));
+	const Point3 a(std::min(p_0.x_, p_1.x_), std::min(p_0.y_, p_1.y_), std::min(p_0.z_, p_1.z_));
+	const Point3 g(std::max(p_0.x_, p_1.x_), std::max(p_0.y_, p_1.y_), std::max(p_0.z_, p_1.z_));
+	return Bound(a - r, g + r);
+}
+
+IntersectData CurveSegmentPrimitive::intersect(const Ray &ray, const Matrix4 *obj_to_world) const
+{
+	const Point3 p_0 = getPoint(0, obj_to_world);
+	const Vec3 edge = getPoint(1, obj_to_world) - p_0;
+	// closest approach between the ray and the segment axis
+	const Vec3 w = ray.from_ - p_0;
+	const float a = ray.dir_ * ray.dir_;
+	const float b = ray.dir_ * edge;
+	const float c = edge * edge;
+	const float d = ray.dir_ * w;
+	const float e = edge * w;
+	const float denom = a * c - b * b;
+	if(denom < 1e-12f * a * c) return {}; //ray parallel to the segment, it can only be hit on the end caps which the neighbour segments cover
+	float s = (a * e - b * d) / denom;
+	float t = (b * e - c * d) / denom;
+	if(s < 0.f || s > 1.f)
+	{
+		// rounded joint: closest point to the end of the segment
+		s = std::max(0.f, std::min(1.f, s));
+		t = ((p_0 + s * edge) - ray.from_) * ray.dir_ / a;
+	}
+	if(t < ray.tmin_) return {};
+	const float radius = (1.f - s) * getRadius(0) + s * getRadius(1);
+	const Vec3 offset = (ray.from_ + t * ray.dir_) - (p_0 + s * edge);
+	const float distance_2 = offset * offset;
+	if(distance_2 > radius * radius) return {};
+
+	// the ribbon is shaded like a cylinder seen from the ray, so the normal depends on the ray direction which getSurface
+	// does not get: it is stored in the intersection data as spherical angles
+	const Vec3 tangent = Vec3(edge).normalize();
+	Vec3 side = ray.dir_ ^ tangent;
+	Vec3 facing = ray.dir_ - (tangent * (ray.dir_ * tangent));
+	side.normalize();
+	facing.normalize();
+	const float side_pos = std::max(-1.f, std::min(1.f, (offset * side) / radius));
+	const Vec3 normal = (side * side_pos - facing * math::sqrt(1.f - side_pos * side_pos)).normalize();
+
+	IntersectData intersect_data;
+	intersect_data.hit_ = true;
+	intersect_data.t_hit_ = t;
+	intersect_data.barycentric_u_ = s;
+	intersect_data.barycentric_v_ = math::acos(normal.z_);
+	intersect_data.barycentric_w_ = std::atan2(normal.y_, normal.x_);
+	intersect_data.time_ = ray.time_;
+	return intersect_data;
+}
+
+SurfacePoint CurveSegmentPrimitive::getSurface(const Point3 &hit, const IntersectData &intersect_data, const Matrix4 *obj_to_world) const
+{
+	const CurveObject &curve_object = getCurveObject();
+	SurfacePoint sp;
+	sp.intersect_data_ = intersect_data;
+	const float sin_theta = math::sin(intersect_data.barycentric_v_);
+	sp.n_ = Vec3(sin_theta * math::cos(intersect_data.barycentric_w_), sin_theta * math::sin(intersect_data.barycentric_w_), math::cos(intersect_data.barycentric_v_));
+	sp.ng_ = sp.n_;
+	// 1D strand uv mapping along the whole curve, as the triangulated curves
+	const float strand_pos = (point_index_ + intersect_data.barycentric_u_) / static_cast<float>(curve_object.numVertices() - 1);
+	sp.u_ = strand_pos;
+	sp.v_ = strand_pos;
+	sp.has_uv_ = false;
+	sp.dp_du_ = getPoint(1, obj_to_world) - getPoint(0, obj_to_world);
+	sp.dp_dv_ = sp.n_ ^ sp.dp_du_;
+	sp.dp_du_abs_ = sp.dp_du_;
+	sp.dp_dv_abs_ = sp.dp_dv_;
+	sp.dp_du_.normalize();
+	sp.dp_dv_.normalize();
+	sp.object_ = &base_object_;
+	sp.light_ = curve_object.getLight();
+	sp.material_ = getMaterial();
+	sp.p_ = hit;
+	Vec3::createCs(sp.n_, sp.nu_, sp.nv_);
+	sp.ds_du_ = { sp.nu_ * sp.dp_du_, sp.nv_ * sp.dp_du_, sp.n_ * sp.dp_du_ };
+	sp.ds_dv_ = { sp.nu_ * sp.dp_dv_, sp.nv_ * sp.dp_dv_, sp.n_ * sp.dp_dv_ };
+	return sp;
+}
+
+float CurveSegmentPrimitive::surfaceArea(const Matrix4 *obj_to_world) const
+{
+	const float length = (getPoint(1, obj_to_world) - getPoint(0, obj_to_world)).length();
+	return M_PI * (getRadius(0) + getRadius(1)) * length;
+}
+
+Vec3 CurveSegmentPrimitive::getGeometricNormal(const Matrix4 *obj_to_world, float u, float v) const
+{
+	Vec3 tangent = getPoint(1, obj_to_world) - getPoint(0, obj_to_world);
+	tangent.normalize();
+	Vec3 normal, bitangent;
+	Vec3::createCs(tangent, normal, bitangent);
+	return normal;
+}
+
+void CurveSegmentPrimitive::sample(float s_1, float s_2, Point3 &p, Vec3 &n, const Matrix4 *obj_to_world) const
+{
+	const Point3 p_0 = getPoint(0, obj_to_world);
+	const Vec3 edge = getPoint(1, obj_to_world) - p_0;
+	Vec3 tangent = edge;
+	tangent.normalize();
+	Vec3 u, v;
+	Vec3::createCs(tangent, u, v);
+	const float phi = 2.f * M_PI * s_2;
+	n = math::cos(phi) * u + math::sin(phi) * v;
+	p = p_0 + s_1 * edge + ((1.f - s_1) * getRadius(0) + s_1 * getRadius(1)) * n;
+}
+
+END_YAFARAY
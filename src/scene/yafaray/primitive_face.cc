@@ -21,31 +21,40 @@
 #include "scene/yafaray/object_mesh.h"
 #include "geometry/bound.h"
 #include "geometry/matrix4.h"
+#include "geometry/surface.h"
 
 BEGIN_YAFARAY
 
-FacePrimitive::FacePrimitive(const std::vector<int> &vertices_indices, const std::vector<int> &vertices_uv_indices, const MeshObject &mesh_object) : Primitive(mesh_object), vertices_(vertices_indices), vertex_normals_(vertices_indices.size(), -1), vertex_uvs_(vertices_uv_indices)
+constexpr size_t FacePrimitive::max_vertices_;
+
+FacePrimitive::FacePrimitive(uint32_t first_index, uint32_t num_vertices, const MeshObject &mesh_object) : Primitive(mesh_object), first_index_(first_index), num_vertices_(num_vertices)
+{
+}
+
+const MeshObject &FacePrimitive::getMeshObject() const
 {
+	return static_cast<const MeshObject &>(base_object_);
 }
 
 Point3 FacePrimitive::getVertex(size_t vertex_number, const Matrix4 *obj_to_world) const
 {
-	const Point3 point = static_cast<const MeshObject &>(base_object_).getVertex(vertices_[vertex_number]);
+	const Point3 point = getMeshObject().getVertex(getMeshObject().getFaceVertexIndex(first_index_ + vertex_number));
 	if(obj_to_world) return (*obj_to_world) * point;
 	else return point;
 }
 
 Point3 FacePrimitive::getOrcoVertex(size_t vertex_number) const
 {
-	if(static_cast<const MeshObject &>(base_object_).hasOrco()) return static_cast<const MeshObject &>(base_object_).getOrcoVertex(vertices_[vertex_number]);
+	if(getMeshObject().hasOrco()) return getMeshObject().getOrcoVertex(getMeshObject().getFaceVertexIndex(first_index_ + vertex_number));
 	else return getVertex(vertex_number, nullptr);
 }
 
 Vec3 FacePrimitive::getVertexNormal(size_t vertex_number, const Vec3 &surface_normal_world, const Matrix4 *obj_to_world) const
 {
-	if(vertex_normals_[vertex_number] >= 0)
+	const int normal_index = getMeshObject().getFaceNormalIndex(first_index_ + vertex_number);
+	if(normal_index >= 0)
 	{
-		const Vec3 vertex_normal = static_cast<const MeshObject &>(base_object_).getVertexNormal(vertex_normals_[vertex_number]);
+		const Vec3 vertex_normal = getMeshObject().getVertexNormal(normal_index);
 		if(obj_to_world) return ((*obj_to_world) * vertex_normal).normalize();
 		else return vertex_normal;
 	}
@@ -54,14 +63,34 @@ Vec3 FacePrimitive::getVertexNormal(size_t vertex_number, const Vec3 &surface_no
 
 Uv FacePrimitive::getVertexUv(size_t vertex_number) const
 {
-	return static_cast<const MeshObject &>(base_object_).getUvValues()[vertex_uvs_[vertex_number]];
+	return getMeshObject().getUvValue(getMeshObject().getFaceUvIndex(first_index_ + vertex_number));
 }
 
-std::vector<Point3> FacePrimitive::getVertices(const Matrix4 *obj_to_world) const
+FacePrimitive::VertexArray<int> FacePrimitive::getVerticesIndices() const
 {
-	const size_t num_vertices = vertices_.size();
-	std::vector<Point3> result(num_vertices);
-	//result.reserve(num_vertices);
+	VertexArray<int> result;
+	for(size_t vert_num = 0; vert_num < num_vertices_; ++vert_num) result[vert_num] = getMeshObject().getFaceVertexIndex(first_index_ + vert_num);
+	return result;
+}
+
+FacePrimitive::VertexArray<int> FacePrimitive::getNormalsIndices() const
+{
+	VertexArray<int> result;
+	for(size_t vert_num = 0; vert_num < num_vertices_; ++vert_num) result[vert_num] = getMeshObject().getFaceNormalIndex(first_index_ + vert_num);
+	return result;
+}
+
+FacePrimitive::VertexArray<int> FacePrimitive::getUvIndices() const
+{
+	VertexArray<int> result;
+	for(size_t vert_num = 0; vert_num < num_vertices_; ++vert_num) result[vert_num] = getMeshObject().getFaceUvIndex(first_index_ + vert_num);
+	return result;
+}
+
+FacePrimitive::VertexArray<Point3> FacePrimitive::getVertices(const Matrix4 *obj_to_world) const
+{
+	const size_t num_vertices = num_vertices_;
+	VertexArray<Point3> result;
 	for(size_t vert_num = 0; vert_num < num_vertices; ++vert_num)
 	{
 		result[vert_num] = getVertex(vert_num, obj_to_world);
@@ -69,11 +98,22 @@ std::vector<Point3> FacePrimitive::getVertices(const Matrix4 *obj_to_world) cons
 	return result;
 }
 
-std::vector<Point3> FacePrimitive::getOrcoVertices() const
+void FacePrimitive::getOrco(const SurfacePoint &sp, Point3 &orco_p, Vec3 &orco_ng) const
+{
+	if(!getMeshObject().hasOrco())
+	{
+		Primitive::getOrco(sp, orco_p, orco_ng);
+		return;
+	}
+	const VertexArray<Point3> orco = getOrcoVertices();
+	orco_p = sp.intersect_data_.barycentric_u_ * orco[0] + sp.intersect_data_.barycentric_v_ * orco[1] + sp.intersect_data_.barycentric_w_ * orco[2];
+	orco_ng = ((orco[1] - orco[0]) ^ (orco[2] - orco[0])).normalize();
+}
+
+FacePrimitive::VertexArray<Point3> FacePrimitive::getOrcoVertices() const
 {
-	const size_t num_vertices = vertices_.size();
-	std::vector<Point3> result(num_vertices);
-	//result.reserve(num_vertices);
+	const size_t num_vertices = num_vertices_;
+	VertexArray<Point3> result;
 	for(size_t vert_num = 0; vert_num < num_vertices; ++vert_num)
 	{
 		result[vert_num] = getOrcoVertex(vert_num);
@@ -81,11 +121,10 @@ std::vector<Point3> FacePrimitive::getOrcoVertices() const
 	return result;
 }
 
-std::vector<Vec3> FacePrimitive::getVerticesNormals(const Vec3 &surface_normal, const Matrix4 *obj_to_world) const
+FacePrimitive::VertexArray<Vec3> FacePrimitive::getVerticesNormals(const Vec3 &surface_normal, const Matrix4 *obj_to_world) const
 {
-	const size_t num_vertices = vertices_.size();
-	std::vector<Vec3> result(num_vertices);
-	//result.reserve(num_vertices);
+	const size_t num_vertices = num_vertices_;
+	VertexArray<Vec3> result;
 	for(size_t vert_num = 0; vert_num < num_vertices; ++vert_num)
 	{
 		result[vert_num] = getVertexNormal(vert_num, surface_normal, obj_to_world);
@@ -93,11 +132,10 @@ std::vector<Vec3> FacePrimitive::getVerticesNormals(const Vec3 &surface_normal,
 	return result;
 }
 
-std::vector<Uv> FacePrimitive::getVerticesUvs() const
+FacePrimitive::VertexArray<Uv> FacePrimitive::getVerticesUvs() const
 {
-	const size_t num_vertices = vertices_.size();
-	std::vector<Uv> result(num_vertices);
-	//result.reserve(num_vertices);
+	const size_t num_vertices = num_vertices_;
+	VertexArray<Uv> result;
 	for(size_t vert_num = 0; vert_num < num_vertices; ++vert_num)
 	{
 		result[vert_num] = getVertexUv(vert_num);
@@ -107,14 +145,13 @@ std::vector<Uv> FacePrimitive::getVerticesUvs() const
 
 Bound FacePrimitive::getBound(const Matrix4 *obj_to_world) const
 {
-	return getBound(getVertices(obj_to_world));
+	return getBound(getVertices(obj_to_world).data(), num_vertices_);
 }
 
-Bound FacePrimitive::getBound(const std::vector<Point3> &vertices)
+Bound FacePrimitive::getBound(const Point3 *vertices, size_t num_vertices)
 {
 	Point3 min_point = vertices[0];
 	Point3 max_point = vertices[0];
-	const size_t num_vertices = vertices.size();
 	for(size_t vert_num = 1; vert_num < num_vertices; ++vert_num)
 	{
 		if(vertices[vert_num].x_ < min_point.x_) min_point.x_ = vertices[vert_num].x_;
@@ -83,13 +83,11 @@ SurfacePoint SpherePrimitive::getSurface(const Point3 &hit, const IntersectData
 	SurfacePoint sp;
 	sp.intersect_data_ = intersect_data;
 	Vec3 normal = hit - center_;
-	sp.orco_p_ = normal;
 	normal.normalize();
 	sp.material_ = material_;
 	sp.n_ = normal;
 	sp.ng_ = normal;
 	//sp.origin = (void*)this;
-	sp.has_orco_ = true;
 	sp.p_ = hit;
 	Vec3::createCs(sp.n_, sp.nu_, sp.nv_);
 	sp.u_ = atan2(normal.y_, normal.x_) * M_1_PI + 1;
@@ -98,6 +96,12 @@ SurfacePoint SpherePrimitive::getSurface(const Point3 &hit, const IntersectData
 	return sp;
 }
 
+void SpherePrimitive::getOrco(const SurfacePoint &sp, Point3 &orco_p, Vec3 &orco_ng) const
+{
+	orco_p = sp.p_ - center_;
+	orco_ng = sp.ng_;
+}
+
 float SpherePrimitive::surfaceArea(const Matrix4 *obj_to_world) const
 {
 	return 0; //FIXME
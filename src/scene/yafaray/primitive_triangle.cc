@@ -31,7 +31,7 @@
 
 BEGIN_YAFARAY
 
-TrianglePrimitive::TrianglePrimitive(const std::vector<int> &vertices_indices, const std::vector<int> &vertices_uv_indices, const MeshObject &mesh_object) : FacePrimitive(vertices_indices, vertices_uv_indices, mesh_object)
+TrianglePrimitive::TrianglePrimitive(uint32_t first_index, const MeshObject &mesh_object) : FacePrimitive(first_index, 3, mesh_object)
 {
 	calculateGeometricNormal();
 }
@@ -41,6 +41,12 @@ IntersectData TrianglePrimitive::intersect(const Ray &ray, const Matrix4 *obj_to
 	return TrianglePrimitive::intersect(ray, { getVertex(0, obj_to_world), getVertex(1, obj_to_world), getVertex(2, obj_to_world) });
 }
 
+bool TrianglePrimitive::getTriangleVertices(std::array<Point3, 3> &vertices, const Matrix4 *obj_to_world) const
+{
+	vertices = {{ getVertex(0, obj_to_world), getVertex(1, obj_to_world), getVertex(2, obj_to_world) }};
+	return true;
+}
+
 IntersectData TrianglePrimitive::intersect(const Ray &ray, const std::array<Point3, 3> &vertices)
 {
 	//Tomas Moller and Ben Trumbore ray intersection scheme
@@ -112,20 +118,6 @@ SurfacePoint TrianglePrimitive::getSurface(const Point3 &hit_point, const Inters
 		sp.n_.normalize();
 	}
 	else sp.n_ = sp.ng_;
-	if(base_mesh_object.hasOrco())
-	{
-		const std::array<Point3, 3> orco_p { getOrcoVertex(0), getOrcoVertex(1), getOrcoVertex(2) };
-
-		sp.orco_p_ = barycentric_u * orco_p[0] + barycentric_v * orco_p[1] + barycentric_w * orco_p[2];
-		sp.orco_ng_ = ((orco_p[1] - orco_p[0]) ^ (orco_p[2] - orco_p[0])).normalize();
-		sp.has_orco_ = true;
-	}
-	else
-	{
-		sp.orco_p_ = hit_point;
-		sp.has_orco_ = false;
-		sp.orco_ng_ = getGeometricNormal();
-	}
 	bool implicit_uv = true;
 	const std::array<Point3, 3> p { getVertex(0, obj_to_world), getVertex(1, obj_to_world), getVertex(2, obj_to_world) };
 	if(base_mesh_object.hasUv())
@@ -166,7 +158,6 @@ SurfacePoint TrianglePrimitive::getSurface(const Point3 &hit_point, const Inters
 	sp.object_ = &base_object_;
 	sp.light_ = base_mesh_object.getLight();
 	sp.has_uv_ = base_mesh_object.hasUv();
-	sp.prim_num_ = getSelfIndex();
 	sp.material_ = getMaterial();
 	sp.p_ = hit_point;
 	Vec3::createCs(sp.n_, sp.nu_, sp.nv_);
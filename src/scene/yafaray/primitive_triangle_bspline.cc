@@ -22,17 +22,18 @@
 #include "geometry/surface.h"
 #include "scene/yafaray/object_mesh.h"
 #include "geometry/uv.h"
+#include "geometry/matrix4.h"
 
 BEGIN_YAFARAY
 
-BsTrianglePrimitive::BsTrianglePrimitive(const std::vector<int> &vertices_indices, const std::vector<int> &vertices_uv_indices, const MeshObject &mesh_object) : FacePrimitive(vertices_indices, vertices_uv_indices, mesh_object)
+BsTrianglePrimitive::BsTrianglePrimitive(uint32_t first_index, const MeshObject &mesh_object) : FacePrimitive(first_index, 3, mesh_object)
 {
 	//calculateGeometricNormal(); //FIXME?
 }
 
 IntersectData BsTrianglePrimitive::intersect(const Ray &ray, const Matrix4 *obj_to_world) const
 {
-	const std::vector<int> vertices_indices = getVerticesIndices();
+	const VertexArray<int> vertices_indices = getVerticesIndices();
 	const Point3 *an = &static_cast<const MeshObject &>(base_object_).getPoints()[vertices_indices[0]];
 	const Point3 *bn = &static_cast<const MeshObject &>(base_object_).getPoints()[vertices_indices[1]];
 	const Point3 *cn = &static_cast<const MeshObject &>(base_object_).getPoints()[vertices_indices[2]];
@@ -66,25 +67,36 @@ IntersectData BsTrianglePrimitive::intersect(const Ray &ray, const Matrix4 *obj_
 
 Bound BsTrianglePrimitive::getBound(const Matrix4 *obj_to_world) const
 {
-	const std::vector<int> vertices_indices = getVerticesIndices();
-	const Point3 *an = &static_cast<const MeshObject &>(base_object_).getPoints()[vertices_indices[0]];
-	const Point3 *bn = &static_cast<const MeshObject &>(base_object_).getPoints()[vertices_indices[1]];
-	const Point3 *cn = &static_cast<const MeshObject &>(base_object_).getPoints()[vertices_indices[2]];
-	const Point3 amin { math::min(an[0].x_, an[1].x_, an[2].x_), math::min(an[0].y_, an[1].y_, an[2].y_), math::min(an[0].z_, an[1].z_, an[2].z_) };
-	const Point3 bmin { math::min(bn[0].x_, bn[1].x_, bn[2].x_), math::min(bn[0].y_, bn[1].y_, bn[2].y_), math::min(bn[0].z_, bn[1].z_, bn[2].z_) };
-	const Point3 cmin { math::min(cn[0].x_, cn[1].x_, cn[2].x_), math::min(cn[0].y_, cn[1].y_, cn[2].y_), math::min(cn[0].z_, cn[1].z_, cn[2].z_) };
-	const Point3 amax { math::max(an[0].x_, an[1].x_, an[2].x_), math::max(an[0].y_, an[1].y_, an[2].y_), math::max(an[0].z_, an[1].z_, an[2].z_) };
-	const Point3 bmax { math::max(bn[0].x_, bn[1].x_, bn[2].x_), math::max(bn[0].y_, bn[1].y_, bn[2].y_), math::max(bn[0].z_, bn[1].z_, bn[2].z_) };
-	const Point3 cmax { math::max(cn[0].x_, cn[1].x_, cn[2].x_), math::max(cn[0].y_, cn[1].y_, cn[2].y_), math::max(cn[0].z_, cn[1].z_, cn[2].z_) };
-	const Point3 l { math::min(amin.x_, bmin.x_, cmin.x_), math::min(amin.y_, bmin.y_, cmin.y_), math::min(amin.z_, bmin.z_, cmin.z_) };
-	const Point3 h { math::max(amax.x_, bmax.x_, cmax.x_), math::max(amax.y_, bmax.y_, cmax.y_), math::max(amax.z_, bmax.z_, cmax.z_) };
-	return Bound(l, h);
+	Bound bound_start, bound_end;
+	getMotionBounds(bound_start, bound_end, obj_to_world);
+	return Bound(bound_start, bound_end);
+}
+
+bool BsTrianglePrimitive::getMotionBounds(Bound &bound_start, Bound &bound_end, const Matrix4 *obj_to_world) const
+{
+	// each point b_1 * p_0 + b_2 * p_1 + b_3 * p_2 of the spline is the interpolation, at the same time, of a point between p_0 and p_1 and a point between p_1 and p_2,
+	// so the bound of the first two control points interpolated towards the bound of the last two contains the triangle at any time
+	const VertexArray<int> vertices_indices = getVerticesIndices();
+	const LargeVector<Point3> &points = static_cast<const MeshObject &>(base_object_).getPoints();
+	bool first = true;
+	for(size_t vert_num = 0; vert_num < 3; ++vert_num)
+	{
+		std::array<Point3, 3> control_points {{ points[vertices_indices[vert_num]], points[vertices_indices[vert_num] + 1], points[vertices_indices[vert_num] + 2] }};
+		if(obj_to_world) for(auto &control_point : control_points) control_point = (*obj_to_world) * control_point;
+		const Bound start_bound(control_points[0], control_points[0]);
+		const Bound end_bound(control_points[2], control_points[2]);
+		const Bound middle_bound(control_points[1], control_points[1]);
+		bound_start = first ? Bound(start_bound, middle_bound) : Bound(bound_start, Bound(start_bound, middle_bound));
+		bound_end = first ? Bound(middle_bound, end_bound) : Bound(bound_end, Bound(middle_bound, end_bound));
+		first = false;
+	}
+	return true;
 }
 
 SurfacePoint BsTrianglePrimitive::getSurface(const Point3 &hit, const IntersectData &intersect_data, const Matrix4 *obj_to_world) const
 {
 	// recalculating the points is not really the nicest solution...
-	const std::vector<int> vertices_indices = getVerticesIndices();
+	const VertexArray<int> vertices_indices = getVerticesIndices();
 	const Point3 *an = &static_cast<const MeshObject &>(base_object_).getPoints()[vertices_indices[0]];
 	const Point3 *bn = &static_cast<const MeshObject &>(base_object_).getPoints()[vertices_indices[1]];
 	const Point3 *cn = &static_cast<const MeshObject &>(base_object_).getPoints()[vertices_indices[2]];
@@ -110,23 +122,10 @@ SurfacePoint BsTrianglePrimitive::getSurface(const Point3 &hit, const IntersectD
 	}
 	else  */sp.n_ = sp.ng_;
 
-	if(static_cast<const MeshObject &>(base_object_).hasOrco())
-	{
-		const std::vector<Point3> orco = getOrcoVertices();
-		sp.orco_p_ = barycentric_u * orco[0] + barycentric_v * orco[1] + barycentric_w * orco[2];
-		sp.orco_ng_ = ((orco[1] - orco[0]) ^ (orco[2] - orco[0])).normalize();
-		sp.has_orco_ = true;
-	}
-	else
-	{
-		sp.orco_p_ = hit;
-		sp.orco_ng_ = sp.ng_;
-		sp.has_orco_ = false;
-	}
 	if(static_cast<const MeshObject &>(base_object_).hasUv())
 	{
-		const int uvi_1 = vertex_uvs_[0], uvi_2 = vertex_uvs_[1], uvi_3 = vertex_uvs_[2];
-		const auto &it = static_cast<const MeshObject &>(base_object_).getUvValues().begin();
+		const Uv it[3] { getVertexUv(0), getVertexUv(1), getVertexUv(2) };
+		const int uvi_1 = 0, uvi_2 = 1, uvi_3 = 2;
 		sp.u_ = barycentric_u * it[uvi_1].u_ + barycentric_v * it[uvi_2].u_ + barycentric_w * it[uvi_3].u_;
 		sp.v_ = barycentric_u * it[uvi_1].v_ + barycentric_v * it[uvi_2].v_ + barycentric_w * it[uvi_3].v_;
 
@@ -137,7 +136,7 @@ SurfacePoint BsTrianglePrimitive::getSurface(const Point3 &hit, const IntersectD
 		const float dv_2 = it[uvi_2].v_ - it[uvi_3].v_;
 		const float det = du_1 * dv_2 - dv_1 * du_2;
 
-		const std::vector<Point3> vert = getVertices();
+		const VertexArray<Point3> vert = getVertices();
 		if(std::abs(det) > 1e-30f)
 		{
 			const float invdet = 1.f / det;
@@ -158,7 +157,7 @@ SurfacePoint BsTrianglePrimitive::getSurface(const Point3 &hit, const IntersectD
 	else
 	{
 		// implicit mapping, p0 = 0/0, p1 = 1/0, p2 = 0/1 => sp.u_ = barycentric_u, sp.v_ = barycentric_v; (arbitrary choice)
-		const std::vector<Point3> vert = getVertices();
+		const VertexArray<Point3> vert = getVertices();
 		sp.dp_du_ = vert[1] - vert[0];
 		sp.dp_dv_ = vert[2] - vert[0];
 		sp.u_ = barycentric_u;
@@ -20,7 +20,11 @@
 #include "scene/yafaray/scene_yafaray.h"
 #include "yafaray_config.h"
 #include "common/logger.h"
+#include "common/render_stats.h"
+#include "common/trace.h"
 #include "accelerator/accelerator.h"
+#include "accelerator/accelerator_two_level.h"
+#include "accelerator/accelerator_embree.h"
 #include "common/param.h"
 #include "light/light.h"
 #include "material/material.h"
@@ -35,8 +39,11 @@
 #include "render/render_data.h"
 #include "scene/yafaray/object_mesh.h"
 #include "geometry/object_instance.h"
+#include "geometry/object_instance_array.h"
 #include "geometry/surface.h"
 #include "geometry/uv.h"
+#include "common/sysinfo.h"
+#include "common/task_pool.h"
 #include "geometry/matrix4.h"
 #include "scene/yafaray/primitive_face.h"
 
@@ -76,6 +83,11 @@ YafaRayScene::~YafaRayScene()
 void YafaRayScene::clearObjects()
 {
 	accelerator_ = nullptr;
+	pending_objects_.clear();
+	instances_.clear();
+	object_lods_.clear();
+	instance_lods_.clear();
+	lod_instances_.clear();
 	objects_.clear();
 }
 
@@ -83,11 +95,107 @@ bool YafaRayScene::endObject()
 {
 	if(Y_LOG_HAS_DEBUG) Y_DEBUG PRTEXT(YafaRayScene::endObject) PREND;
 	if(creation_state_.stack_.front() != CreationState::Object) return false;
-	const bool result = current_object_->calculateObject(creation_state_.current_material_);
+	pending_objects_.push_back({current_object_, creation_state_.current_material_, -1.f});
 	creation_state_.stack_.pop_front();
+	return true;
+}
+
+bool YafaRayScene::endObjects()
+{
+	if(creation_state_.stack_.front() != CreationState::Geometry) return false;
+	const bool result = calculatePendingObjects();
+	return Scene::endObjects() && result;
+}
+
+bool YafaRayScene::calculatePendingObjects()
+{
+	if(pending_objects_.empty()) return true;
+	if(dedup_meshes_) deduplicatePendingMeshes();
+	// the render threads parameter is not known yet while the geometry is being created
+	TaskPool task_pool(std::max(getNumThreads(), SysInfo().getNumSystemThreads()));
+	std::vector<char> results(pending_objects_.size(), true);
+	{
+		TaskPool::Group task_group(task_pool);
+		for(size_t object_id = 0; object_id < pending_objects_.size(); ++object_id)
+		{
+			task_group.run([this, &task_pool, &results, object_id]
+			{
+				const PendingObject &pending_object = pending_objects_[object_id];
+				results[object_id] = pending_object.object_->calculateObject(pending_object.material_);
+				if(results[object_id] && pending_object.smooth_angle_ >= 0.f)
+				{
+					results[object_id] = smoothMesh(static_cast<MeshObject *>(pending_object.object_), pending_object.smooth_angle_, &task_pool);
+				}
+			});
+		}
+		task_group.wait();
+	}
+	bool result = true;
+	for(size_t object_id = 0; object_id < pending_objects_.size(); ++object_id)
+	{
+		if(!results[object_id])
+		{
+			Y_WARNING << "Scene: the object '" << pending_objects_[object_id].object_->getName() << "' could not be calculated" << YENDL;
+			result = false;
+		}
+	}
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Scene: calculated " << pending_objects_.size() << " objects using " << task_pool.getNumThreads() << " threads" << YENDL;
+	pending_objects_.clear();
 	return result;
 }
 
+void YafaRayScene::deduplicatePendingMeshes()
+{
+	std::map<uint64_t, std::vector<size_t>> base_meshes; //!< position in kept_objects of the meshes kept so far, by content hash
+	std::vector<PendingObject> kept_objects;
+	kept_objects.reserve(pending_objects_.size());
+	size_t num_instanced = 0;
+	for(const auto &pending_object : pending_objects_)
+	{
+		Object *object = pending_object.object_;
+		// the lights and the instances reference their objects, which must stay meshes
+		if(!object->isMesh() || object->getBaseObject() || object->isBaseObject() || object->getLight() || object->numPrimitives() == 0)
+		{
+			kept_objects.push_back(pending_object);
+			continue;
+		}
+		const MeshObject *mesh_object = static_cast<const MeshObject *>(object);
+		std::vector<size_t> &candidates = base_meshes[mesh_object->contentHash()];
+		bool instanced = false;
+		for(const size_t candidate : candidates)
+		{
+			const PendingObject &base = kept_objects[candidate];
+			// the instances take these properties from their base object
+			if(base.material_ != pending_object.material_ || base.smooth_angle_ != pending_object.smooth_angle_) continue;
+			if(base.object_->getVisibility() != object->getVisibility() || base.object_->getAbsObjectIndex() != object->getAbsObjectIndex() || base.object_->getLightLinkMask() != object->getLightLinkMask()) continue;
+			Matrix4 base_to_object;
+			if(!mesh_object->findRigidTransformFrom(*static_cast<const MeshObject *>(base.object_), base_to_object)) continue;
+			auto it = objects_.find(object->getName());
+			if(it == objects_.end() || it->second.get() != object) continue;
+			if(current_object_ == object) current_object_ = nullptr;
+			it->second = std::unique_ptr<Object>(new ObjectInstance(*base.object_, base_to_object));
+			instanced = true;
+			++num_instanced;
+			break;
+		}
+		if(instanced) continue;
+		candidates.push_back(kept_objects.size());
+		kept_objects.push_back(pending_object);
+	}
+	pending_objects_ = std::move(kept_objects);
+	if(num_instanced > 0) Y_INFO << "Scene: " << num_instanced << " duplicated meshes replaced by instances of identical meshes" << YENDL;
+}
+
+bool YafaRayScene::smoothMesh(MeshObject *mesh_object, float angle, TaskPool *task_pool)
+{
+	if(mesh_object->hasNormalsExported() && mesh_object->numNormals() == mesh_object->numVertices())
+	{
+		mesh_object->setSmooth(true);
+		return true;
+	}
+	else return mesh_object->smoothNormals(angle, task_pool);
+}
+
 bool YafaRayScene::smoothNormals(const std::string &name, float angle)
 {
 	if(Y_LOG_HAS_DEBUG) Y_DEBUG PRTEXT(YafaRayScene::startObject) PR(name) PR(angle) PREND;
@@ -106,12 +214,17 @@ bool YafaRayScene::smoothNormals(const std::string &name, float angle)
 	}
 	MeshObject *mesh_object = MeshObject::getMeshFromObject(object);
 	if(!mesh_object) return false;
-	else if(mesh_object->hasNormalsExported() && mesh_object->numNormals() == mesh_object->numVertices())
+	// objects not calculated yet are smoothed after their calculation, together with the other pending objects
+	for(auto &pending_object : pending_objects_)
 	{
-		mesh_object->setSmooth(true);
-		return true;
+		if(pending_object.object_ == object)
+		{
+			pending_object.smooth_angle_ = angle;
+			return true;
+		}
 	}
-	else return mesh_object->smoothNormals(angle);
+	TaskPool task_pool(std::max(getNumThreads(), SysInfo().getNumSystemThreads()));
+	return smoothMesh(mesh_object, angle, &task_pool);
 }
 
 int YafaRayScene::addVertex(const Point3 &p)
@@ -173,6 +286,50 @@ int YafaRayScene::addUv(float u, float v)
 	return mesh_object->addUvValue({u, v});
 }
 
+int YafaRayScene::addVertices(const float *vertices, size_t num_vertices, const float *orco)
+{
+	if(creation_state_.stack_.front() != CreationState::Object) return -1;
+	MeshObject *mesh_object = MeshObject::getMeshFromObject(current_object_);
+	if(!mesh_object) return -1;
+	const int first_vertex = mesh_object->numVertices();
+	mesh_object->addPoints(vertices, num_vertices);
+	if(orco) mesh_object->addOrcoPoints(orco, num_vertices);
+	return first_vertex;
+}
+
+bool YafaRayScene::addNormals(const float *normals, size_t num_normals)
+{
+	if(creation_state_.stack_.front() != CreationState::Object) return false;
+	MeshObject *mesh_object = MeshObject::getMeshFromObject(current_object_);
+	if(!mesh_object) return false;
+	mesh_object->addNormals(normals, num_normals);
+	return true;
+}
+
+bool YafaRayScene::addFaces(const int *vert_indices, size_t num_faces, const int *uv_indices)
+{
+	if(creation_state_.stack_.front() != CreationState::Object) return false;
+	MeshObject *mesh_object = MeshObject::getMeshFromObject(current_object_);
+	if(!mesh_object) return false;
+	mesh_object->addFaces(vert_indices, num_faces, uv_indices, creation_state_.current_material_);
+	return true;
+}
+
+int YafaRayScene::addUvs(const float *uvs, size_t num_uvs)
+{
+	if(creation_state_.stack_.front() != CreationState::Object) return -1;
+	MeshObject *mesh_object = MeshObject::getMeshFromObject(current_object_);
+	if(!mesh_object) return -1;
+	return mesh_object->addUvValues(uvs, num_uvs);
+}
+
+void YafaRayScene::replaceMaterial(const Material *old_material, const Material *new_material)
+{
+	//The instances use the primitives of their base objects, so only the objects are changed. The accelerators only point to the primitives and are kept
+	for(auto &object : objects_) object.second->replaceMaterial(old_material, new_material);
+	for(auto &pending_object : pending_objects_) if(pending_object.material_ == old_material) pending_object.material_ = new_material;
+}
+
 Object *YafaRayScene::createObject(const std::string &name, ParamMap &params)
 {
 	std::string pname = "Object";
@@ -187,6 +344,7 @@ Object *YafaRayScene::createObject(const std::string &name, ParamMap &params)
 		ERR_NO_TYPE;
 		return nullptr;
 	}
+	instantiateReferencedMaterials(params); //the object factories only find the materials already created
 	std::unique_ptr<Object> object = Object::factory(params, *this);
 	if(object)
 	{
@@ -209,17 +367,76 @@ Object *YafaRayScene::getObject(const std::string &name) const
 	else return nullptr;
 }
 
+std::vector<const Object *> YafaRayScene::getObjects() const
+{
+	std::vector<const Object *> objects;
+	objects.reserve(objects_.size());
+	for(const auto &object : objects_) objects.push_back(object.second.get());
+	return objects;
+}
+
+AcceleratorStats YafaRayScene::getAcceleratorStats() const
+{
+	AcceleratorStats stats;
+	if(accelerator_) stats = accelerator_->getStats();
+	stats.traversal_ = AcceleratorTraversalStats::total();
+	return stats;
+}
+
 bool YafaRayScene::updateObjects()
 {
-	std::vector<const Primitive *> primitives;
+	TraceSpan trace_span("scene", "accelerator build");
+	calculatePendingObjects();
+	std::vector<const Object *> instances;
+	std::vector<const Object *> primitive_objects;
+	std::vector<size_t> primitive_offsets {0};
 	for(const auto &o : objects_)
 	{
 		if(o.second->getVisibility() == Visibility::Invisible) continue;
 		if(o.second->isBaseObject()) continue;
-		const auto prims = o.second->getPrimitives();
-		primitives.insert(primitives.end(), prims.begin(), prims.end());
+		//the instance arrays have no primitive instances, they always go to the two-level accelerator
+		if((o.second->getBaseObject() && (scene_accelerator_two_level_ || o.second->numPrimitives() == 0)) || o.second->isDeferred())
+		{
+			instances.emplace_back(o.second.get());
+			continue;
+		}
+		primitive_objects.emplace_back(o.second.get());
+		primitive_offsets.emplace_back(primitive_offsets.back() + o.second->numPrimitives());
+	}
+	//A different choice of levels of detail needs a new accelerator even without geometry changes, as only the chosen levels have their own accelerators
+	std::vector<std::unique_ptr<Object>> lod_instances;
+	const bool lods_changed = selectObjectLods(instances, lod_instances);
+	if(!(creation_state_.changes_ & CreationState::Flags::CGeom) && !lods_changed && accelerator_)
+	{
+		if(!(creation_state_.changes_ & CreationState::Flags::CTransform)) return true; //camera update keeping the same levels of detail
+		if(accelerator_->refit())
+		{
+			scene_bound_ = accelerator_->getBound();
+			Y_INFO << "Scene: Accelerator refitted after transform-only changes" << YENDL;
+			return true;
+		}
+	}
+	// the objects write their primitives in parallel directly at their place in the scene primitives, the flattened instances creating their primitive instances meanwhile
+	std::vector<const Primitive *> primitives(primitive_offsets.back());
+	std::vector<int> num_written_primitives(primitive_objects.size());
+	{
+		TaskPool task_pool(primitive_objects.size() > 1 ? getNumThreads() : 1);
+		TaskPool::Group task_group(task_pool);
+		for(size_t object_id = 0; object_id < primitive_objects.size(); ++object_id)
+		{
+			task_group.run([&, object_id] { num_written_primitives[object_id] = primitive_objects[object_id]->writePrimitives(primitives.data() + primitive_offsets[object_id]); });
+		}
+		task_group.wait();
 	}
-	if(primitives.empty())
+	for(size_t object_id = 0; object_id < primitive_objects.size(); ++object_id)
+	{
+		if(num_written_primitives[object_id] != static_cast<int>(primitive_offsets[object_id + 1] - primitive_offsets[object_id]))
+		{
+			Y_ERROR << "Scene: wrong number of primitives in object '" << primitive_objects[object_id]->getName() << "'" << YENDL;
+			return false;
+		}
+	}
+	if(primitives.empty() && instances.empty())
 	{
 		Y_ERROR << "Scene: Scene is empty..." << YENDL;
 		return false;
@@ -232,8 +449,23 @@ bool YafaRayScene::updateObjects()
 	params["cost_ratio"] = 0.8f;
 	params["empty_bonus"] = 0.33f;
 	params["accelerator_threads"] = getNumThreads();
+	if(!scene_accelerator_cache_dir_.empty()) params["accelerator_cache_dir"] = scene_accelerator_cache_dir_;
+	params["bvh_spatial_splits"] = scene_accelerator_spatial_splits_;
+	params["bvh_spatial_split_budget"] = scene_accelerator_spatial_split_budget_;
+	params["deferred_geometry_budget"] = deferred_geometry_budget_;
+	params["huge_pages"] = HugePages::modeName(getHugePagesMode());
 
-	accelerator_ = Accelerator::factory(primitives, params);
+	if(instances.empty()) accelerator_ = Accelerator::factory(primitives, params);
+	else
+	{
+		accelerator_ = nullptr;
+#ifdef HAVE_EMBREE
+		//Embree traverses the instances itself, the two-level accelerator is only used if it could not be created
+		if(scene_accelerator_ == "yafaray-embree") accelerator_ = AcceleratorEmbree::factory(primitives, instances, params);
+#endif
+		if(!accelerator_) accelerator_ = AcceleratorTwoLevel::factory(primitives, instances, params);
+	}
+	lod_instances_ = std::move(lod_instances); //the previous ones were only referenced by the previous accelerator
 	scene_bound_ = accelerator_->getBound();
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Scene: New scene bound is: " << "(" << scene_bound_.a_.x_ << ", " << scene_bound_.a_.y_ << ", " << scene_bound_.a_.z_ << "), (" << scene_bound_.g_.x_ << ", " << scene_bound_.g_.y_ << ", " << scene_bound_.g_.z_ << ")" << YENDL;
 
@@ -244,17 +476,51 @@ bool YafaRayScene::updateObjects()
 	return true;
 }
 
-bool YafaRayScene::intersect(const Ray &ray, SurfacePoint &sp) const
+//! true if the primitive blocks the shadow ray before t_max, with the same conditions as the accelerators shadow tests
+static inline bool occluderHit_global(const Primitive *occluder, const Ray &sray, float t_max)
 {
-	const float t_max = (ray.tmax_ >= 0.f) ? ray.tmax_ : std::numeric_limits<float>::infinity();
+	const IntersectData intersect_data = occluder->intersect(sray);
+	return intersect_data.hit_ && intersect_data.t_hit_ >= sray.tmin_ && intersect_data.t_hit_ < t_max;
+}
+
+//! the primitives hit inside the instances are intersected in the instance object space, so they are not kept as occluders or primary hits
+static inline const Primitive *cachedOccluder_global(const AcceleratorIntersectData &accelerator_intersect_data)
+{
+	return accelerator_intersect_data.obj_to_world_ ? nullptr : accelerator_intersect_data.hit_primitive_;
+}
+
+bool YafaRayScene::intersect(const Ray &ray, SurfacePoint &sp, const Primitive **primary_hit) const
+{
+	RenderStats::add(RenderStats::Rays);
+	++AcceleratorTraversalStats::threadStats().rays_;
+	float t_max = (ray.tmax_ >= 0.f) ? ray.tmax_ : std::numeric_limits<float>::infinity();
 	// intersect with tree:
 	if(!accelerator_) return false;
-	const AcceleratorIntersectData accelerator_intersect_data = accelerator_->intersect(ray, t_max);
+	//the primitive hit before by rays close to this one bounds the traversal, which only has to find closer hits
+	const Primitive *primary_hit_primitive = primary_hit ? *primary_hit : nullptr;
+	IntersectData primary_hit_data;
+	if(primary_hit_primitive)
+	{
+		primary_hit_data = primary_hit_primitive->intersect(ray);
+		if(primary_hit_data.hit_ && primary_hit_data.t_hit_ >= ray.tmin_ && primary_hit_data.t_hit_ < t_max) t_max = primary_hit_data.t_hit_;
+		else primary_hit_primitive = nullptr;
+	}
+	AcceleratorIntersectData accelerator_intersect_data = accelerator_->intersect(ray, t_max);
+	if(primary_hit_primitive && !(accelerator_intersect_data.hit_ && accelerator_intersect_data.hit_primitive_))
+	{
+		accelerator_intersect_data.setIntersectData(primary_hit_data);
+		accelerator_intersect_data.t_max_ = primary_hit_data.t_hit_;
+		accelerator_intersect_data.hit_primitive_ = primary_hit_primitive;
+		accelerator_intersect_data.obj_to_world_ = nullptr;
+		accelerator_intersect_data.hit_geometry_ = nullptr;
+	}
+	if(primary_hit) *primary_hit = accelerator_intersect_data.hit_ ? cachedOccluder_global(accelerator_intersect_data) : nullptr;
 	if(accelerator_intersect_data.hit_ && accelerator_intersect_data.hit_primitive_)
 	{
 		const Point3 hit_point = ray.from_ + accelerator_intersect_data.t_max_ * ray.dir_;
-		sp = accelerator_intersect_data.hit_primitive_->getSurface(hit_point, accelerator_intersect_data);
+		sp = accelerator_intersect_data.hit_primitive_->getSurface(hit_point, accelerator_intersect_data, accelerator_intersect_data.obj_to_world_);
 		sp.hit_primitive_ = accelerator_intersect_data.hit_primitive_;
+		sp.hit_geometry_ = std::move(accelerator_intersect_data.hit_geometry_);
 		sp.ray_ = nullptr;
 		ray.tmax_ = accelerator_intersect_data.t_max_;
 		return true;
@@ -262,41 +528,120 @@ bool YafaRayScene::intersect(const Ray &ray, SurfacePoint &sp) const
 	return false;
 }
 
-bool YafaRayScene::intersect(const DiffRay &ray, SurfacePoint &sp) const
+std::vector<bool> YafaRayScene::intersect(const std::vector<Ray> &rays, std::vector<SurfacePoint> &sp) const
 {
-	if(!intersect(static_cast<const Ray&>(ray), sp)) return false;
+	RenderStats::add(RenderStats::Rays, rays.size());
+	AcceleratorTraversalStats::threadStats().rays_ += rays.size();
+	std::vector<bool> hits(rays.size(), false);
+	sp.resize(rays.size());
+	if(!accelerator_) return hits;
+	std::vector<float> t_max;
+	t_max.reserve(rays.size());
+	for(const auto &ray : rays) t_max.emplace_back((ray.tmax_ >= 0.f) ? ray.tmax_ : std::numeric_limits<float>::infinity());
+	const std::vector<AcceleratorIntersectData> accelerator_intersect_data = accelerator_->intersectStream(rays, t_max);
+	for(size_t ray_num = 0; ray_num < rays.size(); ++ray_num)
+	{
+		const AcceleratorIntersectData &ray_intersect_data = accelerator_intersect_data[ray_num];
+		if(!ray_intersect_data.hit_ || !ray_intersect_data.hit_primitive_) continue;
+		const Ray &ray = rays[ray_num];
+		const Point3 hit_point = ray.from_ + ray_intersect_data.t_max_ * ray.dir_;
+		sp[ray_num] = ray_intersect_data.hit_primitive_->getSurface(hit_point, ray_intersect_data, ray_intersect_data.obj_to_world_);
+		sp[ray_num].hit_primitive_ = ray_intersect_data.hit_primitive_;
+		sp[ray_num].hit_geometry_ = ray_intersect_data.hit_geometry_;
+		sp[ray_num].ray_ = nullptr;
+		ray.tmax_ = ray_intersect_data.t_max_;
+		hits[ray_num] = true;
+	}
+	return hits;
+}
+
+bool YafaRayScene::intersect(const DiffRay &ray, SurfacePoint &sp, const Primitive **primary_hit) const
+{
+	if(!intersect(static_cast<const Ray&>(ray), sp, primary_hit)) return false;
 	sp.ray_ = &ray;
 	return true;
 }
 
-bool YafaRayScene::isShadowed(const RenderData &render_data, const Ray &ray, float &obj_index, float &mat_index) const
+bool YafaRayScene::isShadowed(const RenderData &render_data, const Ray &ray, float &obj_index, float &mat_index, const Primitive **last_occluder) const
 {
+	RenderStats::add(RenderStats::ShadowRays);
+	++AcceleratorTraversalStats::threadStats().shadow_rays_;
 	Ray sray(ray);
 	sray.from_ += sray.dir_ * sray.tmin_;
 	sray.time_ = render_data.time_;
 	const float t_max = (ray.tmax_ >= 0.f) ? sray.tmax_ - 2 * sray.tmin_ : std::numeric_limits<float>::infinity();
 	if(!accelerator_) return false;
-	const AcceleratorIntersectData accelerator_intersect_data = accelerator_->intersectS(sray, t_max, shadow_bias_);
-	if(accelerator_intersect_data.hit_)
+	const Primitive *occluder = nullptr;
+	if(last_occluder && *last_occluder && occluderHit_global(*last_occluder, sray, t_max))
 	{
-		if(accelerator_intersect_data.hit_primitive_)
+		RenderStats::add(RenderStats::ShadowCacheHits);
+		occluder = *last_occluder;
+	}
+	else
+	{
+		const AcceleratorIntersectData accelerator_intersect_data = accelerator_->intersectS(sray, t_max, shadow_bias_);
+		if(!accelerator_intersect_data.hit_) return false;
+		occluder = accelerator_intersect_data.hit_primitive_;
+		if(last_occluder) *last_occluder = cachedOccluder_global(accelerator_intersect_data);
+	}
+	if(occluder)
+	{
+		if(occluder->getObject()) obj_index = occluder->getObject()->getAbsObjectIndex();    //Object index of the object casting the shadow
+		if(occluder->getMaterial()) mat_index = occluder->getMaterial()->getAbsMaterialIndex();    //Material index of the object casting the shadow
+	}
+	return true;
+}
+
+std::vector<bool> YafaRayScene::isShadowed(const RenderData &render_data, const std::vector<Ray> &rays, const Primitive **last_occluder) const
+{
+	RenderStats::add(RenderStats::ShadowRays, rays.size());
+	AcceleratorTraversalStats::threadStats().shadow_rays_ += rays.size();
+	std::vector<bool> shadowed(rays.size(), false);
+	if(!accelerator_) return shadowed;
+	std::vector<Ray> shadow_rays;
+	std::vector<float> t_max;
+	std::vector<size_t> ray_nums; //!< position in rays of each ray in the stream, the rays blocked by the last occluder are not traced
+	shadow_rays.reserve(rays.size());
+	t_max.reserve(rays.size());
+	ray_nums.reserve(rays.size());
+	const Primitive *occluder = last_occluder ? *last_occluder : nullptr;
+	for(size_t ray_num = 0; ray_num < rays.size(); ++ray_num)
+	{
+		const Ray &ray = rays[ray_num];
+		Ray sray(ray);
+		sray.from_ += sray.dir_ * sray.tmin_;
+		sray.time_ = render_data.time_;
+		const float ray_t_max = (ray.tmax_ >= 0.f) ? sray.tmax_ - 2 * sray.tmin_ : std::numeric_limits<float>::infinity();
+		if(occluder && occluderHit_global(occluder, sray, ray_t_max))
 		{
-			if(accelerator_intersect_data.hit_primitive_->getObject()) obj_index = accelerator_intersect_data.hit_primitive_->getObject()->getAbsObjectIndex();    //Object index of the object casting the shadow
-			if(accelerator_intersect_data.hit_primitive_->getMaterial()) mat_index = accelerator_intersect_data.hit_primitive_->getMaterial()->getAbsMaterialIndex();    //Material index of the object casting the shadow
+			RenderStats::add(RenderStats::ShadowCacheHits);
+			shadowed[ray_num] = true;
+			continue;
 		}
-		return true;
+		t_max.emplace_back(ray_t_max);
+		shadow_rays.emplace_back(sray);
+		ray_nums.emplace_back(ray_num);
 	}
-	return false;
+	if(shadow_rays.empty()) return shadowed;
+	const std::vector<AcceleratorIntersectData> accelerator_intersect_data = accelerator_->intersectStreamS(shadow_rays, t_max, shadow_bias_);
+	for(size_t stream_num = 0; stream_num < shadow_rays.size(); ++stream_num)
+	{
+		if(!accelerator_intersect_data[stream_num].hit_) continue;
+		shadowed[ray_nums[stream_num]] = true;
+		if(last_occluder) *last_occluder = cachedOccluder_global(accelerator_intersect_data[stream_num]);
+	}
+	return shadowed;
 }
 
 bool YafaRayScene::isShadowed(RenderData &render_data, const Ray &ray, int max_depth, Rgb &filt, float &obj_index, float &mat_index) const
 {
+	RenderStats::add(RenderStats::ShadowRays);
+	++AcceleratorTraversalStats::threadStats().shadow_rays_;
 	Ray sray(ray);
 	sray.from_ += sray.dir_ * sray.tmin_;
 	const float t_max = (ray.tmax_ >= 0.f) ? sray.tmax_ - 2 * sray.tmin_ : std::numeric_limits<float>::infinity();
-	void *odat = render_data.arena_;
-	alignas (16) unsigned char userdata[Integrator::getUserDataSize()];
-	render_data.arena_ = static_cast<void *>(userdata);
+	void *odat = render_data.material_data_;
+	const MemoryArena::Marker arena_marker = render_data.arena_.getMarker(); //the accelerator allocates the data of the transparent materials hit
 	bool intersect = false;
 	if(accelerator_)
 	{
@@ -312,7 +657,8 @@ bool YafaRayScene::isShadowed(RenderData &render_data, const Ray &ray, int max_d
 			}
 		}
 	}
-	render_data.arena_ = odat;
+	render_data.arena_.rewind(arena_marker);
+	render_data.material_data_ = odat;
 	return intersect;
 }
 
@@ -321,8 +667,8 @@ bool YafaRayScene::addInstance(const std::string &base_object_name, const Matrix
 {
 	//if(Y_LOG_HAS_DEBUG) Y_DEBUG PRTEXT(YafaRayScene::addInstance) PR(base_object_name) PREND;
 	//if(Y_LOG_HAS_DEBUG) Y_DEBUG PRPREC(6) PR(obj_to_world) PREND;
-	const Object *base_object = objects_.find(base_object_name)->second.get();
-	if(objects_.find(base_object_name) == objects_.end())
+	const auto base_object = objects_.find(base_object_name);
+	if(base_object == objects_.end())
 	{
 		Y_ERROR << "Base mesh for instance doesn't exist " << base_object_name << YENDL;
 		return false;
@@ -332,10 +678,198 @@ bool YafaRayScene::addInstance(const std::string &base_object_name, const Matrix
 	{
 		const std::string instance_name = base_object_name + "-" + std::to_string(id);
 		if(Y_LOG_HAS_DEBUG) Y_DEBUG << "  " PRTEXT(Instance:) PR(instance_name) PR(base_object_name) PREND;
-		objects_[instance_name] = std::unique_ptr<Object>(new ObjectInstance(*base_object, obj_to_world));
+		ObjectInstance *instance = new ObjectInstance(*base_object->second, obj_to_world);
+		objects_[instance_name] = std::unique_ptr<Object>(instance);
+		instances_[base_object_name].emplace_back(instance);
+		creation_state_.changes_ |= CreationState::Flags::CGeom;
 		return true;
 	}
 	else return false;
 }
 
+bool YafaRayScene::addInstances(const std::string &base_object_name, const float *obj_to_world, size_t num_instances)
+{
+	const auto base_object = objects_.find(base_object_name);
+	if(base_object == objects_.end())
+	{
+		Y_ERROR << "Base mesh for instances doesn't exist " << base_object_name << YENDL;
+		return false;
+	}
+	if(!obj_to_world || num_instances == 0) return false;
+	int id = getNextFreeId();
+	if(id > 0)
+	{
+		const std::string instance_name = base_object_name + "-" + std::to_string(id);
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Scene: Adding " << num_instances << " instances of '" << base_object_name << "' as '" << instance_name << "'" << YENDL;
+		objects_[instance_name] = std::unique_ptr<Object>(new ObjectInstanceArray(*base_object->second, obj_to_world, num_instances));
+		creation_state_.changes_ |= CreationState::Flags::CGeom;
+		return true;
+	}
+	else return false;
+}
+
+bool YafaRayScene::updateInstance(const std::string &base_object_name, size_t instance_number, const Matrix4 &obj_to_world)
+{
+	const auto instances = instances_.find(base_object_name);
+	if(instances == instances_.end() || instance_number >= instances->second.size())
+	{
+		Y_ERROR << "Scene: Instance " << instance_number << " of base object '" << base_object_name << "' doesn't exist" << YENDL;
+		return false;
+	}
+	instances->second[instance_number]->setObjToWorldMatrix(obj_to_world);
+	creation_state_.changes_ |= CreationState::Flags::CTransform;
+	return true;
+}
+
+size_t YafaRayScene::getNumInstances(const std::string &base_object_name) const
+{
+	const auto instances = instances_.find(base_object_name);
+	return instances == instances_.end() ? 0 : instances->second.size();
+}
+
+bool YafaRayScene::addObjectLod(const std::string &base_object_name, const std::string &lod_object_name, float max_screen_size)
+{
+	const auto base_object = objects_.find(base_object_name);
+	const auto lod_object = objects_.find(lod_object_name);
+	if(base_object == objects_.end() || lod_object == objects_.end() || base_object == lod_object)
+	{
+		Y_ERROR << "Scene: Couldn't add the level of detail '" << lod_object_name << "' of object '" << base_object_name << "', both objects must exist and be different" << YENDL;
+		return false;
+	}
+	lod_object->second->useAsBaseObject(true);
+	ObjectLods &object_lods = object_lods_[base_object->second.get()];
+	//Registering the same level again only changes its max screen size
+	const auto previous_level = std::find(object_lods.objects_.begin(), object_lods.objects_.end(), lod_object->second.get());
+	if(previous_level != object_lods.objects_.end())
+	{
+		object_lods.max_screen_sizes_.erase(object_lods.max_screen_sizes_.begin() + (previous_level - object_lods.objects_.begin()));
+		object_lods.objects_.erase(previous_level);
+	}
+	const auto level = std::upper_bound(object_lods.max_screen_sizes_.begin(), object_lods.max_screen_sizes_.end(), max_screen_size) - object_lods.max_screen_sizes_.begin();
+	object_lods.objects_.insert(object_lods.objects_.begin() + level, lod_object->second.get());
+	object_lods.max_screen_sizes_.insert(object_lods.max_screen_sizes_.begin() + level, max_screen_size);
+	instance_lods_.clear(); //the levels chosen before are not comparable with the new ones
+	creation_state_.changes_ |= CreationState::Flags::CGeom;
+	return true;
+}
+
+//! world space bound of the object bound transformed by the instance matrix
+static Bound instanceBound_global(const Bound &object_bound, const Matrix4 &obj_to_world)
+{
+	const Point3 object_corner = obj_to_world * object_bound.a_;
+	Bound world_bound(object_corner, object_corner);
+	for(int corner = 1; corner < 8; ++corner)
+	{
+		const Point3 p { (corner & 1) ? object_bound.g_.x_ : object_bound.a_.x_, (corner & 2) ? object_bound.g_.y_ : object_bound.a_.y_, (corner & 4) ? object_bound.g_.z_ : object_bound.a_.z_ };
+		world_bound.include(obj_to_world * p);
+	}
+	return world_bound;
+}
+
+/*! diameter in pixels of the bounding sphere of the bound projected by the camera at its center. cam_x and cam_z are the normalized camera axes.
+ *  The bounds around the camera are infinitely big and the ones behind it are not seen, so they get the finest and the coarsest levels */
+static float projectedSize_global(const Camera &camera, const Vec3 &cam_x, const Vec3 &cam_z, const Bound &bound)
+{
+	const Point3 center = bound.center();
+	const float radius = 0.5f * (bound.g_ - bound.a_).length();
+	const float depth = (center - camera.getPosition()) * cam_z;
+	if(depth < -radius) return 0.f;
+	if(depth <= radius) return std::numeric_limits<float>::infinity();
+	//The screen projection goes from -1 to 1 across the image width
+	const float screen_radius = std::abs(camera.screenproject(center + radius * cam_x).x_ - camera.screenproject(center).x_);
+	return screen_radius * static_cast<float>(camera.resX());
+}
+
+/*! level of detail for the projected size, the first one whose max screen size is not exceeded or the base object (max_screen_sizes.size()).
+ *  The previous level is kept while the size stays within the hysteresis margin around its range */
+static uint32_t lodLevel_global(const std::vector<float> &max_screen_sizes, float screen_size, uint32_t previous_level, float hysteresis)
+{
+	const uint32_t num_levels = static_cast<uint32_t>(max_screen_sizes.size());
+	if(previous_level <= num_levels)
+	{
+		const bool above_min = previous_level == 0 || screen_size > max_screen_sizes[previous_level - 1] * (1.f - hysteresis);
+		const bool below_max = previous_level == num_levels || screen_size <= max_screen_sizes[previous_level] * (1.f + hysteresis);
+		if(above_min && below_max) return previous_level;
+	}
+	return static_cast<uint32_t>(std::lower_bound(max_screen_sizes.begin(), max_screen_sizes.end(), screen_size) - max_screen_sizes.begin());
+}
+
+bool YafaRayScene::selectObjectLods(std::vector<const Object *> &instances, std::vector<std::unique_ptr<Object>> &lod_instances)
+{
+	if(object_lods_.empty()) return false;
+	const Camera *camera = nullptr;
+	for(const auto &render_view : getRenderViews())
+	{
+		camera = getCamera(render_view.second->getCameraName());
+		if(camera) break;
+	}
+	if(!camera)
+	{
+		Y_WARNING << "Scene: No camera to choose the levels of detail, using the base objects" << YENDL;
+		const bool changed = !instance_lods_.empty();
+		instance_lods_.clear();
+		return changed;
+	}
+	Vec3 cam_x, cam_y, cam_z;
+	camera->getAxis(cam_x, cam_y, cam_z);
+	cam_x.normalize();
+	cam_z.normalize();
+	std::map<const Object *, Bound> base_object_bounds;
+	std::map<const Object *, std::vector<uint32_t>> instance_lods;
+	std::vector<const Object *> lod_selected_instances;
+	bool changed = false;
+	size_t num_lod_instances[2] = {0, 0}; //instances using a level of detail and the base object
+	for(const Object *instance : instances)
+	{
+		const Object *base_object = instance->isDeferred() ? nullptr : instance->getBaseObject();
+		const auto object_lods = base_object ? object_lods_.find(base_object) : object_lods_.end();
+		if(object_lods == object_lods_.end())
+		{
+			lod_selected_instances.emplace_back(instance);
+			continue;
+		}
+		auto base_object_bound = base_object_bounds.find(base_object);
+		if(base_object_bound == base_object_bounds.end())
+		{
+			const std::vector<const Primitive *> primitives = base_object->getPrimitives();
+			if(primitives.empty())
+			{
+				lod_selected_instances.emplace_back(instance);
+				continue;
+			}
+			Bound bound = primitives.front()->getBound();
+			for(const Primitive *primitive : primitives) bound = Bound(bound, primitive->getBound());
+			base_object_bound = base_object_bounds.insert({base_object, bound}).first;
+		}
+		const std::vector<float> &max_screen_sizes = object_lods->second.max_screen_sizes_;
+		const uint32_t num_levels = static_cast<uint32_t>(max_screen_sizes.size());
+		const auto previous_levels = instance_lods_.find(instance);
+		const bool has_previous_levels = previous_levels != instance_lods_.end() && previous_levels->second.size() == instance->numInstances();
+		std::vector<uint32_t> &levels = instance_lods[instance];
+		levels.resize(instance->numInstances());
+		std::vector<std::vector<const Matrix4 *>> level_matrices(num_levels + 1);
+		for(size_t instance_number = 0; instance_number < instance->numInstances(); ++instance_number)
+		{
+			const Matrix4 *obj_to_world = instance->getInstanceObjToWorldMatrix(instance_number);
+			const float screen_size = projectedSize_global(*camera, cam_x, cam_z, instanceBound_global(base_object_bound->second, *obj_to_world));
+			levels[instance_number] = lodLevel_global(max_screen_sizes, screen_size, has_previous_levels ? previous_levels->second[instance_number] : num_levels + 1, lod_hysteresis_);
+			level_matrices[levels[instance_number]].emplace_back(obj_to_world);
+		}
+		if(!has_previous_levels || previous_levels->second != levels) changed = true;
+		for(uint32_t level = 0; level <= num_levels; ++level)
+		{
+			if(level_matrices[level].empty()) continue;
+			num_lod_instances[level == num_levels] += level_matrices[level].size();
+			const Object &level_object = level < num_levels ? *object_lods->second.objects_[level] : *base_object;
+			lod_instances.emplace_back(new ObjectInstanceLod(level_object, std::move(level_matrices[level])));
+			lod_selected_instances.emplace_back(lod_instances.back().get());
+		}
+	}
+	if(instance_lods.size() != instance_lods_.size()) changed = true;
+	instance_lods_ = std::move(instance_lods);
+	instances = std::move(lod_selected_instances);
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Scene: Levels of detail from camera '" << camera->getCameraName() << "': " << num_lod_instances[0] << " instances use a level of detail, " << num_lod_instances[1] << " the base object" << (changed ? "" : " (unchanged)") << YENDL;
+	return changed;
+}
+
 END_YAFARAY
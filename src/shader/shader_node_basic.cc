@@ -24,6 +24,7 @@
 #include "geometry/surface.h"
 #include "texture/texture_image.h"
 #include "render/render_data.h"
+#include "common/render_stats.h"
 
 BEGIN_YAFARAY
 
@@ -140,15 +141,17 @@ void TextureMapperNode::getCoords(Point3 &texpt, Vec3 &ng, const SurfacePoint &s
 	switch(coords_)
 	{
 		case Uv: texpt = evalUv_global(sp); ng = sp.ng_; break;
-		case Orco: texpt = sp.orco_p_; ng = sp.orco_ng_; break;
+		case Orco: sp.getOrco(texpt, ng); break;
 		case Transformed: texpt = mtx_ * sp.p_; ng = mtx_ * sp.ng_; break;  // apply 4x4 matrix of object for mapping also to true surface normals
 		case Window: texpt = render_data.cam_->screenproject(sp.p_); ng = sp.ng_; break;
 		case Normal:
+		{
 			Vec3 camx, camy, camz;
 			render_data.cam_->getAxis(camx, camy, camz);
 			texpt = Point3(sp.n_ * camx, -sp.n_ * camy, 0);
 			ng = sp.ng_;
 			break;
+		}
 		case Stick: // Not implemented yet use GLOB
 		case Stress: // Not implemented yet use GLOB
 		case Tangent: // Not implemented yet use GLOB
@@ -164,9 +167,10 @@ void TextureMapperNode::eval(NodeStack &stack, const RenderData &render_data, co
 {
 	Point3 texpt(0.f);
 	Vec3 ng(0.f);
-	std::unique_ptr<const MipMapParams> mip_map_params;
+	MipMapParams mipmap_params_differentials(0.f);
+	const MipMapParams *mip_map_params = nullptr;
 
-	if((tex_->getInterpolationType() == InterpolationType::Trilinear || tex_->getInterpolationType() == InterpolationType::Ewa) && sp.ray_ && sp.ray_->has_differentials_)
+	if((tex_->getInterpolationType() == InterpolationType::Trilinear || tex_->getInterpolationType() == InterpolationType::Ewa) && sp.ray_ && (sp.ray_->has_differentials_ || sp.ray_->hasCone()))
 	{
 		const SpDifferentials sp_diff(sp, *(sp.ray_));
 		getCoords(texpt, ng, sp, render_data);
@@ -179,7 +183,8 @@ void TextureMapperNode::eval(NodeStack &stack, const RenderData &render_data, co
 			sp_diff.getUVdifferentials(du_dx, dv_dx, du_dy, dv_dy);
 			const Point3 texpt_diffx = 1.0e+2f * (doMapping(texptorig + 1.0e-2f * Point3(du_dx, dv_dx, 0.f), ng) - texpt);
 			const Point3 texpt_diffy = 1.0e+2f * (doMapping(texptorig + 1.0e-2f * Point3(du_dy, dv_dy, 0.f), ng) - texpt);
-			mip_map_params = std::unique_ptr<const MipMapParams>(new MipMapParams(texpt_diffx.x_, texpt_diffx.y_, texpt_diffy.x_, texpt_diffy.y_));
+			mipmap_params_differentials = MipMapParams(texpt_diffx.x_, texpt_diffx.y_, texpt_diffy.x_, texpt_diffy.y_);
+			mip_map_params = &mipmap_params_differentials;
 		}
 	}
 	else
@@ -188,7 +193,33 @@ void TextureMapperNode::eval(NodeStack &stack, const RenderData &render_data, co
 		texpt = doMapping(texpt, ng);
 	}
 
-	stack[this->getId()] = NodeResult(tex_->getColor(texpt, mip_map_params.get()), (do_scalar_) ? tex_->getFloat(texpt, mip_map_params.get()) : 0.f);
+	NodeResult &result = stack[this->getId()];
+	RenderStats::add(RenderStats::TextureLookups);
+	if(do_scalar_) tex_->getColorAndFloat(texpt, mip_map_params, result.col_, result.f_);
+	else result = NodeResult(tex_->getColor(texpt, mip_map_params), 0.f);
+}
+
+bool TextureMapperNode::evalAlphaMask(const RenderData &render_data, const SurfacePoint &sp, float &value) const
+{
+	if(!do_scalar_) return false;
+	//The mipmap levels used with the ray differentials are not in the alpha mask
+	if((tex_->getInterpolationType() == InterpolationType::Trilinear || tex_->getInterpolationType() == InterpolationType::Ewa) && sp.ray_ && (sp.ray_->has_differentials_ || sp.ray_->hasCone())) return false;
+	Point3 texpt(0.f);
+	Vec3 ng(0.f);
+	getCoords(texpt, ng, sp, render_data);
+	return tex_->getAlphaMaskValue(doMapping(texpt, ng), value);
+}
+
+bool TextureMapperNode::isEquivalent(const ShaderNode &node) const
+{
+	const TextureMapperNode *mapper = dynamic_cast<const TextureMapperNode *>(&node);
+	if(!mapper || mapper->tex_ != tex_ || mapper->coords_ != coords_ || mapper->projection_ != projection_ || mapper->do_scalar_ != do_scalar_) return false;
+	if(mapper->map_x_ != map_x_ || mapper->map_y_ != map_y_ || mapper->map_z_ != map_z_ || !(mapper->scale_ == scale_) || !(mapper->offset_ == offset_)) return false;
+	if(coords_ == Transformed)
+	{
+		for(int row = 0; row < 4; ++row) for(int col = 0; col < 4; ++col) if(mapper->mtx_[row][col] != mtx_[row][col]) return false;
+	}
+	return true;
 }
 
 // Normal perturbation
@@ -210,6 +241,7 @@ void TextureMapperNode::evalDerivative(NodeStack &stack, const RenderData &rende
 		if(tex_->isNormalmap())
 		{
 			// Get color from normal map texture
+			RenderStats::add(RenderStats::TextureLookups);
 			color = tex_->getRawColor(texpt);
 
 			// Assign normal map RGB colors to vector norm
@@ -224,12 +256,25 @@ void TextureMapperNode::evalDerivative(NodeStack &stack, const RenderData &rende
 		}
 		else
 		{
-			const Point3 i_0 = (texpt - p_du_);
-			const Point3 i_1 = (texpt + p_du_);
-			const Point3 j_0 = (texpt - p_dv_);
-			const Point3 j_1 = (texpt + p_dv_);
-			const float dfdu = (tex_->getFloat(i_0) - tex_->getFloat(i_1)) / d_u_;
-			const float dfdv = (tex_->getFloat(j_0) - tex_->getFloat(j_1)) / d_v_;
+			float dfdu = 0.f, dfdv = 0.f;
+			Vec3 gradient(0.f);
+			RenderStats::add(RenderStats::TextureLookups);
+			if(tex_->getFloatGradient(texpt, gradient))
+			{
+				// same sign and scale as the central differences below, which span 2 * p_du_ and 2 * p_dv_
+				dfdu = -2.f * gradient.x_;
+				dfdv = -2.f * gradient.y_;
+			}
+			else
+			{
+				const Point3 i_0 = (texpt - p_du_);
+				const Point3 i_1 = (texpt + p_du_);
+				const Point3 j_0 = (texpt - p_dv_);
+				const Point3 j_1 = (texpt + p_dv_);
+				RenderStats::add(RenderStats::TextureLookups, 3);
+				dfdu = (tex_->getFloat(i_0) - tex_->getFloat(i_1)) / d_u_;
+				dfdv = (tex_->getFloat(j_0) - tex_->getFloat(j_1)) / d_v_;
+			}
 
 			// now we got the derivative in UV-space, but need it in shading space:
 			Vec3 vec_u = sp.ds_du_;
@@ -259,6 +304,7 @@ void TextureMapperNode::evalDerivative(NodeStack &stack, const RenderData &rende
 			Vec3 norm(0.f);
 
 			// Get color from normal map texture
+			RenderStats::add(RenderStats::TextureLookups);
 			color = tex_->getRawColor(texpt);
 
 			// Assign normal map RGB colors to vector norm
@@ -290,6 +336,7 @@ void TextureMapperNode::evalDerivative(NodeStack &stack, const RenderData &rende
 			const Point3 j_0 = doMapping(texpt - d_v_ * sp.nv_, ng);
 			const Point3 j_1 = doMapping(texpt + d_v_ * sp.nv_, ng);
 
+			RenderStats::add(RenderStats::TextureLookups, 4);
 			du = (tex_->getFloat(i_0) - tex_->getFloat(i_1)) / d_u_;
 			dv = (tex_->getFloat(j_0) - tex_->getFloat(j_1)) / d_v_;
 			du *= bump_str_;
@@ -308,7 +355,7 @@ void TextureMapperNode::evalDerivative(NodeStack &stack, const RenderData &rende
 
 std::unique_ptr<ShaderNode> TextureMapperNode::factory(const ParamMap &params, const Scene &scene)
 {
-	const Texture *tex = nullptr;
+	Texture *tex = nullptr;
 	std::string texname, option;
 	Coords tc = Global;
 	Projection projection = Plain;
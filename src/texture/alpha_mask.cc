@@ -0,0 +1,67 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "texture/alpha_mask.h"
+#include "common/task_pool.h"
+#include <algorithm>
+#include <atomic>
+
+BEGIN_YAFARAY
+
+bool AlphaMask::build(int width, int height, const std::function<float(int x, int y)> &texel_value, TaskPool *task_pool)
+{
+	words_.clear();
+	if(width <= 0 || height <= 0) return false;
+	const std::size_t min_rows = std::max(static_cast<std::size_t>(1), static_cast<std::size_t>(8192 / width));
+
+	//The first pass finds whether any texel is exact, and whether all of them are so 1 bit per texel is enough
+	std::atomic<bool> any_exact {false};
+	std::atomic<bool> all_exact {true};
+	parallelFor_global(task_pool, height, [&](std::size_t begin, std::size_t end)
+	{
+		bool chunk_any_exact = false;
+		bool chunk_all_exact = true;
+		for(std::size_t y = begin; y < end; ++y) for(int x = 0; x < width; ++x)
+		{
+			if(classify(texel_value(x, static_cast<int>(y))) == Texel::Partial) chunk_all_exact = false;
+			else chunk_any_exact = true;
+		}
+		if(chunk_any_exact) any_exact = true;
+		if(!chunk_all_exact) all_exact = false;
+	}, min_rows);
+	if(!any_exact) return false;
+
+	width_ = width;
+	height_ = height;
+	bits_per_texel_ = all_exact ? 1 : 2;
+	texel_bits_ = (1u << bits_per_texel_) - 1;
+	row_words_ = (static_cast<std::size_t>(width) * bits_per_texel_ + 31) / 32;
+	words_.assign(row_words_ * height, 0);
+	parallelFor_global(task_pool, height, [&](std::size_t begin, std::size_t end)
+	{
+		for(std::size_t y = begin; y < end; ++y) for(int x = 0; x < width; ++x)
+		{
+			const uint32_t texel = static_cast<uint32_t>(classify(texel_value(x, static_cast<int>(y))));
+			const uint32_t bit = static_cast<uint32_t>(x) * bits_per_texel_;
+			words_[y * row_words_ + (bit >> 5)] |= texel << (bit & 31);
+		}
+	}, min_rows);
+	return true;
+}
+
+END_YAFARAY
@@ -0,0 +1,95 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "texture/noise_cache.h"
+#include "common/param.h"
+#include "common/logger.h"
+#include "common/task_pool.h"
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+constexpr int NoiseCache::max_resolution_;
+
+void NoiseCache::setParams(const ParamMap &params)
+{
+	params.getParam("noise_cache_resolution", resolution_);
+	params.getParam("noise_cache_min", min_);
+	params.getParam("noise_cache_max", max_);
+	if(resolution_ > max_resolution_)
+	{
+		Y_WARNING << "NoiseCache: resolution " << resolution_ << " too big, using " << max_resolution_ << " instead" << YENDL;
+		resolution_ = max_resolution_;
+	}
+	if(!isEnabled()) return;
+	if(max_.x_ <= min_.x_ || max_.y_ <= min_.y_ || max_.z_ <= min_.z_)
+	{
+		Y_WARNING << "NoiseCache: the cached box is empty, the noise cache is disabled" << YENDL;
+		resolution_ = 0;
+		return;
+	}
+	const float num_intervals = static_cast<float>(resolution_ - 1);
+	inv_spacing_ = Vec3(num_intervals / (max_.x_ - min_.x_), num_intervals / (max_.y_ - min_.y_), num_intervals / (max_.z_ - min_.z_));
+}
+
+void NoiseCache::bake(const std::function<float(const Point3 &p)> &function, TaskPool *task_pool)
+{
+	if(!isEnabled()) return;
+	const int res = resolution_;
+	const Vec3 spacing(1.f / inv_spacing_.x_, 1.f / inv_spacing_.y_, 1.f / inv_spacing_.z_);
+	std::vector<float> values(static_cast<size_t>(res) * res * res);
+	//Each chunk fills whole lines of points along z
+	parallelFor_global(task_pool, static_cast<size_t>(res) * res, [&](size_t begin, size_t end)
+	{
+		for(size_t line = begin; line < end; ++line)
+		{
+			const int x = static_cast<int>(line / res);
+			const int y = static_cast<int>(line % res);
+			float *line_values = &values[line * res];
+			for(int z = 0; z < res; ++z) line_values[z] = function(Point3(min_.x_ + x * spacing.x_, min_.y_ + y * spacing.y_, min_.z_ + z * spacing.z_));
+		}
+	}, 16);
+	values_ = std::move(values);
+}
+
+bool NoiseCache::getValue(const Point3 &p, float &value) const
+{
+	if(values_.empty()) return false;
+	const float fx = (p.x_ - min_.x_) * inv_spacing_.x_;
+	const float fy = (p.y_ - min_.y_) * inv_spacing_.y_;
+	const float fz = (p.z_ - min_.z_) * inv_spacing_.z_;
+	const float last = static_cast<float>(resolution_ - 1);
+	if(!(fx >= 0.f && fx <= last && fy >= 0.f && fy <= last && fz >= 0.f && fz <= last)) return false; //also rejects NaN coordinates
+	const int x = std::min(static_cast<int>(fx), resolution_ - 2);
+	const int y = std::min(static_cast<int>(fy), resolution_ - 2);
+	const int z = std::min(static_cast<int>(fz), resolution_ - 2);
+	const float tx = fx - x, ty = fy - y, tz = fz - z;
+	const size_t stride_x = static_cast<size_t>(resolution_) * resolution_;
+	const size_t stride_y = static_cast<size_t>(resolution_);
+	const float *v = &values_[x * stride_x + y * stride_y + z];
+	const float v_00 = v[0] + tz * (v[1] - v[0]);
+	const float v_01 = v[stride_y] + tz * (v[stride_y + 1] - v[stride_y]);
+	const float v_10 = v[stride_x] + tz * (v[stride_x + 1] - v[stride_x]);
+	const float v_11 = v[stride_x + stride_y] + tz * (v[stride_x + stride_y + 1] - v[stride_x + stride_y]);
+	const float v_0 = v_00 + ty * (v_01 - v_00);
+	const float v_1 = v_10 + ty * (v_11 - v_10);
+	value = v_0 + tx * (v_1 - v_0);
+	return true;
+}
+
+END_YAFARAY
@@ -18,6 +18,7 @@
 
 #include "texture/noise_generator.h"
 #include "math/interpolation.h"
+#include <algorithm>
 #include <array>
 
 BEGIN_YAFARAY
@@ -179,6 +180,27 @@ static constexpr float hashvectf_global[768] =
 //------------------------------------------------------------------------------------
 // New Perlin noise
 
+inline float NewPerlinNoiseGenerator::blend(int xi, int yi, int zi, float x, float y, float z, float u, float v, float w) const
+{
+	//Hash coordinates of the 8 cube corners and add blended results from 8 corners of cube
+	const int a = hash_global[xi] + yi;
+	const int aa = hash_global[a] + zi;
+	const int ab = hash_global[a + 1] + zi;
+	const int b = hash_global[xi + 1] + yi;
+	const int ba = hash_global[b] + zi;
+	const int bb = hash_global[b + 1] + zi;
+
+	const float lerp_00 = math::lerp(grad(hash_global[ab + 1], x, y - 1, z - 1), grad(hash_global[bb + 1], x - 1, y - 1, z - 1), u);
+	const float lerp_01 = math::lerp(grad(hash_global[aa + 1], x, y, z - 1), grad(hash_global[ba + 1], x - 1, y, z - 1), u);
+	const float lerp_02 = math::lerp(lerp_01, lerp_00, v);
+	const float lerp_03 = math::lerp(grad(hash_global[ab], x, y - 1, z), grad(hash_global[bb], x - 1, y - 1, z), u);
+	const float lerp_04 = math::lerp(grad(hash_global[aa], x, y, z), grad(hash_global[ba], x - 1, y, z), u);
+	const float lerp_05 = math::lerp(lerp_04, lerp_03, v);
+	const float nv = math::lerp(lerp_05, lerp_02, w);
+
+	return (0.5f + 0.5f * nv);
+}
+
 float NewPerlinNoiseGenerator::operator()(const Point3 &pt) const
 {
 	float x = pt.x_;
@@ -199,23 +221,33 @@ float NewPerlinNoiseGenerator::operator()(const Point3 &pt) const
 	v = fade(y);  // FOR EACH OF X,Y,Z.
 	w = fade(z);
 
-	//Hash coordinates of the 8 cube corners and add blended results from 8 corners of cube
-	const int a = hash_global[xi] + yi;
-	const int aa = hash_global[a] + zi;
-	const int ab = hash_global[a + 1] + zi;
-	const int b = hash_global[xi + 1] + yi;
-	const int ba = hash_global[b] + zi;
-	const int bb = hash_global[b + 1] + zi;
-
-	const float lerp_00 = math::lerp(grad(hash_global[ab + 1], x, y - 1, z - 1), grad(hash_global[bb + 1], x - 1, y - 1, z - 1), u);
-	const float lerp_01 = math::lerp(grad(hash_global[aa + 1], x, y, z - 1), grad(hash_global[ba + 1], x - 1, y, z - 1), u);
-	const float lerp_02 = math::lerp(lerp_01, lerp_00, v);
-	const float lerp_03 = math::lerp(grad(hash_global[ab], x, y - 1, z), grad(hash_global[bb], x - 1, y - 1, z), u);
-	const float lerp_04 = math::lerp(grad(hash_global[aa], x, y, z), grad(hash_global[ba], x - 1, y, z), u);
-	const float lerp_05 = math::lerp(lerp_04, lerp_03, v);
-	const float nv = math::lerp(lerp_05, lerp_02, w);
+	return blend(xi, yi, zi, x, y, z, u, v, w);
+}
 
-	return (0.5f + 0.5f * nv);
+void NewPerlinNoiseGenerator::evaluate(const Point3 *pts, float *values, int num) const
+{
+	static constexpr int num_lanes = 8;
+	int cell[3][num_lanes];
+	float rel[3][num_lanes], fades[3][num_lanes];
+	for(int begin = 0; begin < num; begin += num_lanes)
+	{
+		const int lanes = std::min(num - begin, num_lanes);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			for(int lane = 0; lane < lanes; ++lane)
+			{
+				const float coord = pts[begin + lane][axis];
+				const float floor_coord = std::floor(coord);
+				cell[axis][lane] = static_cast<int>(floor_coord) & 255;
+				rel[axis][lane] = coord - floor_coord;
+				fades[axis][lane] = fade(rel[axis][lane]);
+			}
+		}
+		for(int lane = 0; lane < lanes; ++lane)
+		{
+			values[begin + lane] = blend(cell[0][lane], cell[1][lane], cell[2][lane], rel[0][lane], rel[1][lane], rel[2][lane], fades[0][lane], fades[1][lane], fades[2][lane]);
+		}
+	}
 }
 
 //------------------------------------------------------------------------------------
@@ -642,6 +674,8 @@ float CellNoiseGenerator::operator()(const Point3 &pt) const
 //------------------------------------------------------------------------------------
 // Musgrave
 
+static constexpr int max_octaves_batch_global = 16; //!< octaves of the fractal noises evaluated together
+
 /*
  * The following code is based on Ken Musgrave's explanations and sample
  * source code in the book "Texturing and Modelling: A procedural approach"
@@ -658,11 +692,16 @@ float FBmMusgrave::operator()(const Point3 &pt) const
 {
 	float value = 0, pwr = 1, pw_hl = math::pow(lacunarity_, -h_);
 	Point3 tp(pt);
-	for(int i = 0; i < (int)octaves_; i++)
+	//The octaves are independent, so they are evaluated together in batches
+	std::array<Point3, max_octaves_batch_global> points;
+	std::array<float, max_octaves_batch_global> noises;
+	for(int i = 0; i < (int)octaves_;)
 	{
-		value += getSignedNoise_global(n_gen_, tp) * pwr;
-		pwr *= pw_hl;
-		tp *= lacunarity_;
+		const int num = std::min((int)octaves_ - i, max_octaves_batch_global);
+		for(int j = 0; j < num; ++j, tp *= lacunarity_) points[j] = tp;
+		n_gen_->evaluate(points.data(), noises.data(), num);
+		for(int j = 0; j < num; ++j, pwr *= pw_hl) value += (2.f * noises[j] - 1.f) * pwr;
+		i += num;
 	}
 	float rmd = octaves_ - floor(octaves_);
 	if(rmd != 0.f) value += rmd * getSignedNoise_global(n_gen_, tp) * pwr;
@@ -826,11 +865,21 @@ float turbulence_global(const NoiseGenerator *ngen, const Point3 &pt, int oct, f
 {
 	float val, amp = 1, sum = 0;
 	Point3 tp = ngen->offset(pt) * size;	// only blendernoise adds offset
-	for(int i = 0; i <= oct; i++, amp *= 0.5, tp *= 2.0)
+	//The octaves are independent, so they are evaluated together in batches
+	std::array<Point3, max_octaves_batch_global> points;
+	std::array<float, max_octaves_batch_global> noises;
+	for(int i = 0; i <= oct;)
 	{
-		val = (*ngen)(tp);
-		if(hard) val = std::abs(2.0 * val - 1.0);
-		sum += amp * val;
+		const int num = std::min(oct + 1 - i, max_octaves_batch_global);
+		for(int j = 0; j < num; ++j, tp *= 2.0) points[j] = tp;
+		ngen->evaluate(points.data(), noises.data(), num);
+		for(int j = 0; j < num; ++j, amp *= 0.5)
+		{
+			val = noises[j];
+			if(hard) val = std::abs(2.0 * val - 1.0);
+			sum += amp * val;
+		}
+		i += num;
 	}
 
 	return sum * ((float)(1 << oct) / (float)((1 << (oct + 1)) - 1));
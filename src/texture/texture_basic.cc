@@ -106,9 +106,21 @@ CloudsTexture::CloudsTexture(int dep, float sz, bool hd,
 	n_gen_ = newNoise_global(ntype);
 }
 
+void CloudsTexture::completeLoading(TaskPool *task_pool)
+{
+	noise_cache_.bake([this](const Point3 &p) { return turbulence_global(n_gen_.get(), p, depth_, size_, hard_); }, task_pool);
+}
+
+float CloudsTexture::getTurbulence(const Point3 &p) const
+{
+	float turbulence;
+	if(!noise_cache_.getValue(p, turbulence)) turbulence = turbulence_global(n_gen_.get(), p, depth_, size_, hard_);
+	return turbulence;
+}
+
 float CloudsTexture::getFloat(const Point3 &p, const MipMapParams *mipmap_params) const
 {
-	float v = turbulence_global(n_gen_.get(), p, depth_, size_, hard_);
+	float v = getTurbulence(p);
 	if(bias_ != BiasType::None)
 	{
 		v *= v;
@@ -154,7 +166,8 @@ std::unique_ptr<Texture> CloudsTexture::factory(ParamMap &params,
 
 	params.getParam("use_color_ramp", use_color_ramp);
 
-	auto tex = std::unique_ptr<Texture>(new CloudsTexture(depth, size, hard, color_1, color_2, ntype, btype));
+	auto tex = std::unique_ptr<CloudsTexture>(new CloudsTexture(depth, size, hard, color_1, color_2, ntype, btype));
+	tex->noise_cache_.setParams(params);
 	tex->setAdjustments(intensity, contrast, saturation, hue, clamp, factor_red, factor_green, factor_blue);
 
 	if(use_color_ramp) textureReadColorRamp_global(params, tex.get());
@@ -178,9 +191,21 @@ MarbleTexture::MarbleTexture(int oct, float sz, const Rgb &c_1, const Rgb &c_2,
 	else wshape_ = Shape::Sin;
 }
 
+void MarbleTexture::completeLoading(TaskPool *task_pool)
+{
+	if(turb_ != 0.f) noise_cache_.bake([this](const Point3 &p) { return turbulence_global(n_gen_.get(), p, octaves_, size_, hard_); }, task_pool);
+}
+
+float MarbleTexture::getTurbulence(const Point3 &p) const
+{
+	float turbulence;
+	if(!noise_cache_.getValue(p, turbulence)) turbulence = turbulence_global(n_gen_.get(), p, octaves_, size_, hard_);
+	return turbulence;
+}
+
 float MarbleTexture::getFloat(const Point3 &p, const MipMapParams *mipmap_params) const
 {
-	float w = (p.x_ + p.y_ + p.z_) * 5.f + ((turb_ == 0.f) ? 0.f : turb_ * turbulence_global(n_gen_.get(), p, octaves_, size_, hard_));
+	float w = (p.x_ + p.y_ + p.z_) * 5.f + ((turb_ == 0.f) ? 0.f : turb_ * getTurbulence(p));
 	switch(wshape_)
 	{
 		case Shape::Saw:
@@ -236,7 +261,8 @@ std::unique_ptr<Texture> MarbleTexture::factory(ParamMap &params,
 
 	params.getParam("use_color_ramp", use_color_ramp);
 
-	auto tex = std::unique_ptr<Texture>(new MarbleTexture(oct, sz, col_1, col_2, turb, shp, hrd, ntype, shape));
+	auto tex = std::unique_ptr<MarbleTexture>(new MarbleTexture(oct, sz, col_1, col_2, turb, shp, hrd, ntype, shape));
+	tex->noise_cache_.setParams(params);
 	tex->setAdjustments(intensity, contrast, saturation, hue, clamp, factor_red, factor_green, factor_blue);
 	if(use_color_ramp) textureReadColorRamp_global(params, tex.get());
 
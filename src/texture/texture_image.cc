@@ -20,35 +20,38 @@
  */
 
 #include "texture/texture_image.h"
+#include "texture/texture_udim.h"
 #include "common/session.h"
 #include "common/string.h"
 #include "common/param.h"
 #include "scene/scene.h"
 #include "math/interpolation.h"
 #include "format/format.h"
+#include "image/image_tiled.h"
+#include "image/image_block_compressed.h"
 #include "common/file.h"
-
-#ifdef HAVE_OPENCV
-#include <opencv2/photo/photo.hpp>
-#endif
+#include "common/asset_cache.h"
+#include "image/image_host_buffer.h"
+#include "common/task_pool.h"
+#include "common/sysinfo.h"
+#include "common/trace.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <mutex>
 
 BEGIN_YAFARAY
 
 float *ImageTexture::ewa_weight_lut_ = nullptr;
 
-ImageTexture::ImageTexture(std::unique_ptr<Image> image)
-{
-	images_.emplace_back(std::move(image));
-}
-
 ImageTexture::~ImageTexture()
 {
 }
 
 void ImageTexture::resolution(int &x, int &y, int &z) const
 {
-	x = images_.at(0)->getWidth();
-	y = images_.at(0)->getHeight();
+	x = images_->at(0)->getWidth();
+	y = images_->at(0)->getHeight();
 	z = 0;
 }
 
@@ -101,17 +104,119 @@ Rgba ImageTexture::getRawColor(const Point3 &p, const MipMapParams *mipmap_param
 	return ret;
 }
 
-bool ImageTexture::doMapping(Point3 &texpt) const
+void ImageTexture::getColorAndFloat(const Point3 &p, const MipMapParams *mipmap_params, Rgba &color, float &value) const
+{
+	//The float is calculated from the raw color, as in Texture::getFloat, but without interpolating the image again
+	color = getColor(p, mipmap_params);
+	Rgba raw_color = color;
+	raw_color.colorSpaceFromLinearRgb(original_image_file_color_space_, original_image_file_gamma_);
+	value = applyIntensityContrastAdjustments(raw_color.col2Bri());
+}
+
+bool ImageTexture::getAlphaMaskValue(const Point3 &p, float &value) const
+{
+	if(alpha_mask_.isEmpty()) return false;
+	Point3 p_1 = Point3(p.x_, -p.y_, p.z_);
+	if(doMapping(p_1))
+	{
+		value = applyIntensityContrastAdjustments(0.f); //as getColorAndFloat does with the black color outside the image
+		return true;
+	}
+	//The texels are found as in the interpolation used without mipmaps, and the value is only known when all of them are opaque or all are clear
+	const int resx = alpha_mask_.getWidth();
+	const int resy = alpha_mask_.getHeight();
+	const float texel_offset = interpolation_type_ == InterpolationType::None ? 0.f : 0.5f;
+	const float xf = (static_cast<float>(resx) * (p_1.x_ - floor(p_1.x_))) - texel_offset;
+	const float yf = (static_cast<float>(resy) * (p_1.y_ - floor(p_1.y_))) - texel_offset;
+	int x_0, x_1, x_2, x_3, y_0, y_1, y_2, y_3;
+	float dx, dy;
+	findTextureInterpolationCoordinates(x_0, x_1, x_2, x_3, dx, xf, resx, tex_clip_mode_ == ClipMode::Repeat, mirror_x_);
+	findTextureInterpolationCoordinates(y_0, y_1, y_2, y_3, dy, yf, resy, tex_clip_mode_ == ClipMode::Repeat, mirror_y_);
+	const AlphaMask::Texel texel = alpha_mask_.getTexel(x_1, y_1);
+	if(texel == AlphaMask::Texel::Partial) return false;
+	if(interpolation_type_ != InterpolationType::None)
+	{
+		const bool bicubic = interpolation_type_ == InterpolationType::Bicubic;
+		const std::array<int, 4> xs {{ x_0, x_1, x_2, x_3 }};
+		const std::array<int, 4> ys {{ y_0, y_1, y_2, y_3 }};
+		for(int i = bicubic ? 0 : 1; i <= (bicubic ? 3 : 2); ++i) for(int j = bicubic ? 0 : 1; j <= (bicubic ? 3 : 2); ++j)
+		{
+			if(alpha_mask_.getTexel(xs[i], ys[j]) != texel) return false;
+		}
+	}
+	value = texel == AlphaMask::Texel::Opaque ? 0.f : 1.f;
+	return true;
+}
+
+bool ImageTexture::getFloatGradient(const Point3 &p, Vec3 &gradient) const
+{
+	//Without interpolation the texture is piecewise constant, its finite differences are kept instead
+	if(interpolation_type_ == InterpolationType::None) return false;
+
+	Point3 p_1 = Point3(p.x_, -p.y_, p.z_);
+	Vec3 jacobian(0.f);
+	const bool outside = doMapping(p_1, &jacobian);
+	if(outside)
+	{
+		gradient = Vec3(0.f);
+		return true;
+	}
+	//Bump maps are looked up without mipmaps, so the gradient is taken from the full resolution image with the bicubic or the bilinear kernel, as getFloat does
+	Rgba dcolor_dx(0.f), dcolor_dy(0.f);
+	const Rgba color = (interpolation_type_ == InterpolationType::Bicubic) ? bicubicInterpolation(p_1, 0, &dcolor_dx, &dcolor_dy) : bilinearInterpolation(p_1, 0, &dcolor_dx, &dcolor_dy);
+
+	//The adjustments and the color space conversion of getFloat are applied to the interpolated color, they are differentiated with a small step along the color derivatives without looking up more texels
+	const auto float_from_color = [this](const Rgba &interpolated_color)
+	{
+		Rgba raw_color = applyAdjustments(interpolated_color);
+		raw_color.colorSpaceFromLinearRgb(original_image_file_color_space_, original_image_file_gamma_);
+		return applyIntensityContrastAdjustments(raw_color.col2Bri());
+	};
+	const float value = float_from_color(color);
+	const auto float_derivative = [&float_from_color, &color, value](const Rgba &dcolor)
+	{
+		const float max_dcolor = std::max({std::abs(dcolor.r_), std::abs(dcolor.g_), std::abs(dcolor.b_)});
+		if(max_dcolor <= 0.f) return 0.f;
+		const float step = 1.0e-3f / max_dcolor;
+		return (float_from_color(color + step * dcolor) - value) / step;
+	};
+	const float df_dx = float_derivative(dcolor_dx);
+	const float df_dy = float_derivative(dcolor_dy);
+
+	//Back from the mapped texture coordinates to p, with the y axis flipped as in getColor
+	if(rot_90_) gradient = Vec3(jacobian.y_ * df_dy, -jacobian.x_ * df_dx, 0.f);
+	else gradient = Vec3(jacobian.x_ * df_dx, -jacobian.y_ * df_dy, 0.f);
+	return true;
+}
+
+bool ImageTexture::doMapping(Point3 &texpt, Vec3 *jacobian) const
 {
 	bool outside = false;
 	texpt = 0.5f * texpt + 0.5f;
+	Vec3 scale(0.5f, 0.5f, 0.f);
 	// repeat, only valid for REPEAT clipmode
 	if(tex_clip_mode_ == ClipMode::Repeat)
 	{
-		if(xrepeat_ > 1) texpt.x_ *= static_cast<float>(xrepeat_);
-		if(yrepeat_ > 1) texpt.y_ *= static_cast<float>(yrepeat_);
-		if(mirror_x_ && static_cast<int>(ceilf(texpt.x_)) % 2 == 0) texpt.x_ = -texpt.x_;
-		if(mirror_y_ && static_cast<int>(ceilf(texpt.y_)) % 2 == 0) texpt.y_ = -texpt.y_;
+		if(xrepeat_ > 1)
+		{
+			texpt.x_ *= static_cast<float>(xrepeat_);
+			scale.x_ *= static_cast<float>(xrepeat_);
+		}
+		if(yrepeat_ > 1)
+		{
+			texpt.y_ *= static_cast<float>(yrepeat_);
+			scale.y_ *= static_cast<float>(yrepeat_);
+		}
+		if(mirror_x_ && static_cast<int>(ceilf(texpt.x_)) % 2 == 0)
+		{
+			texpt.x_ = -texpt.x_;
+			scale.x_ = -scale.x_;
+		}
+		if(mirror_y_ && static_cast<int>(ceilf(texpt.y_)) % 2 == 0)
+		{
+			texpt.y_ = -texpt.y_;
+			scale.y_ = -scale.y_;
+		}
 		if(texpt.x_ > 1.f) texpt.x_ -= static_cast<int>(texpt.x_);
 		else if(texpt.x_ < 0.f) texpt.x_ += 1 - static_cast<int>(texpt.x_);
 
@@ -120,11 +225,23 @@ bool ImageTexture::doMapping(Point3 &texpt) const
 	}
 
 	// crop
-	if(cropx_) texpt.x_ = cropminx_ + texpt.x_ * (cropmaxx_ - cropminx_);
-	if(cropy_) texpt.y_ = cropminy_ + texpt.y_ * (cropmaxy_ - cropminy_);
+	if(cropx_)
+	{
+		texpt.x_ = cropminx_ + texpt.x_ * (cropmaxx_ - cropminx_);
+		scale.x_ *= (cropmaxx_ - cropminx_);
+	}
+	if(cropy_)
+	{
+		texpt.y_ = cropminy_ + texpt.y_ * (cropmaxy_ - cropminy_);
+		scale.y_ *= (cropmaxy_ - cropminy_);
+	}
 
 	// rot90
-	if(rot_90_) std::swap(texpt.x_, texpt.y_);
+	if(rot_90_)
+	{
+		std::swap(texpt.x_, texpt.y_);
+		std::swap(scale.x_, scale.y_);
+	}
 
 	// clipping
 	switch(tex_clip_mode_)
@@ -155,6 +272,7 @@ bool ImageTexture::doMapping(Point3 &texpt) const
 			{
 				texpt.x_ = (texpt.x_ - 0.5f) / (1.f - checker_dist_) + 0.5f;
 				texpt.y_ = (texpt.y_ - 0.5f) / (1.f - checker_dist_) + 0.5f;
+				scale *= 1.f / (1.f - checker_dist_);
 			}
 			// continue to TCL_CLIP
 		}
@@ -166,6 +284,8 @@ bool ImageTexture::doMapping(Point3 &texpt) const
 		}
 		case ClipMode::Extend:
 		{
+			if(texpt.x_ > 0.99999f || texpt.x_ < 0) scale.x_ = 0.f;
+			if(texpt.y_ > 0.99999f || texpt.y_ < 0) scale.y_ = 0.f;
 			if(texpt.x_ > 0.99999f) texpt.x_ = 0.99999f; else if(texpt.x_ < 0) texpt.x_ = 0;
 			if(texpt.y_ > 0.99999f) texpt.y_ = 0.99999f; else if(texpt.y_ < 0) texpt.y_ = 0;
 			// no break, fall thru to TEX_REPEAT
@@ -173,6 +293,7 @@ bool ImageTexture::doMapping(Point3 &texpt) const
 		default:
 		case ClipMode::Repeat: outside = false; break;
 	}
+	if(jacobian) *jacobian = scale;
 	return outside;
 }
 
@@ -243,10 +364,20 @@ void ImageTexture::findTextureInterpolationCoordinates(int &coord_0, int &coord_
 	}
 }
 
+//! Colors of the texels of the column x at the rows ys, read with a single call when the rows are consecutive
+template <size_t num>
+static void getColumnColors_global(const Image &image, int x, const std::array<int, num> &ys, std::array<Rgba, num> &colors)
+{
+	bool consecutive = true;
+	for(size_t row = 1; row < num && consecutive; ++row) consecutive = (ys[row] == ys[0] + static_cast<int>(row));
+	if(consecutive) image.getColumnColors(x, ys[0], static_cast<int>(num), colors.data());
+	else for(size_t row = 0; row < num; ++row) colors[row] = image.getColor(x, ys[row]);
+}
+
 Rgba ImageTexture::noInterpolation(const Point3 &p, int mipmap_level) const
 {
-	const int resx = images_.at(mipmap_level)->getWidth();
-	const int resy = images_.at(mipmap_level)->getHeight();
+	const int resx = images_->at(mipmap_level)->getWidth();
+	const int resy = images_->at(mipmap_level)->getHeight();
 
 	const float xf = (static_cast<float>(resx) * (p.x_ - floor(p.x_)));
 	const float yf = (static_cast<float>(resy) * (p.y_ - floor(p.y_)));
@@ -255,13 +386,13 @@ Rgba ImageTexture::noInterpolation(const Point3 &p, int mipmap_level) const
 	float dx, dy;
 	findTextureInterpolationCoordinates(x_0, x_1, x_2, x_3, dx, xf, resx, tex_clip_mode_ == ClipMode::Repeat, mirror_x_);
 	findTextureInterpolationCoordinates(y_0, y_1, y_2, y_3, dy, yf, resy, tex_clip_mode_ == ClipMode::Repeat, mirror_y_);
-	return images_.at(mipmap_level)->getColor(x_1, y_1);
+	return images_->at(mipmap_level)->getColor(x_1, y_1);
 }
 
-Rgba ImageTexture::bilinearInterpolation(const Point3 &p, int mipmap_level) const
+Rgba ImageTexture::bilinearInterpolation(const Point3 &p, int mipmap_level, Rgba *dcolor_dx, Rgba *dcolor_dy) const
 {
-	const int resx = images_.at(mipmap_level)->getWidth();
-	const int resy = images_.at(mipmap_level)->getHeight();
+	const int resx = images_->at(mipmap_level)->getWidth();
+	const int resy = images_->at(mipmap_level)->getHeight();
 
 	const float xf = (static_cast<float>(resx) * (p.x_ - floor(p.x_))) - 0.5f;
 	const float yf = (static_cast<float>(resy) * (p.y_ - floor(p.y_))) - 0.5f;
@@ -271,23 +402,29 @@ Rgba ImageTexture::bilinearInterpolation(const Point3 &p, int mipmap_level) cons
 	findTextureInterpolationCoordinates(x_0, x_1, x_2, x_3, dx, xf, resx, tex_clip_mode_ == ClipMode::Repeat, mirror_x_);
 	findTextureInterpolationCoordinates(y_0, y_1, y_2, y_3, dy, yf, resy, tex_clip_mode_ == ClipMode::Repeat, mirror_y_);
 
-	const Rgba c_11 = images_.at(mipmap_level)->getColor(x_1, y_1);
-	const Rgba c_21 = images_.at(mipmap_level)->getColor(x_2, y_1);
-	const Rgba c_12 = images_.at(mipmap_level)->getColor(x_1, y_2);
-	const Rgba c_22 = images_.at(mipmap_level)->getColor(x_2, y_2);
+	std::array<Rgba, 2> column_1, column_2;
+	getColumnColors_global(*images_->at(mipmap_level), x_1, {{ y_1, y_2 }}, column_1);
+	getColumnColors_global(*images_->at(mipmap_level), x_2, {{ y_1, y_2 }}, column_2);
+	const Rgba &c_11 = column_1[0];
+	const Rgba &c_12 = column_1[1];
+	const Rgba &c_21 = column_2[0];
+	const Rgba &c_22 = column_2[1];
 
 	const float w_11 = (1 - dx) * (1 - dy);
 	const float w_12 = (1 - dx) * dy;
 	const float w_21 = dx * (1 - dy);
 	const float w_22 = dx * dy;
 
+	if(dcolor_dx) *dcolor_dx = static_cast<float>(resx) * (((1 - dy) * (c_21 - c_11)) + (dy * (c_22 - c_12)));
+	if(dcolor_dy) *dcolor_dy = static_cast<float>(resy) * (((1 - dx) * (c_12 - c_11)) + (dx * (c_22 - c_21)));
+
 	return (w_11 * c_11) + (w_12 * c_12) + (w_21 * c_21) + (w_22 * c_22);
 }
 
-Rgba ImageTexture::bicubicInterpolation(const Point3 &p, int mipmap_level) const
+Rgba ImageTexture::bicubicInterpolation(const Point3 &p, int mipmap_level, Rgba *dcolor_dx, Rgba *dcolor_dy) const
 {
-	const int resx = images_.at(mipmap_level)->getWidth();
-	const int resy = images_.at(mipmap_level)->getHeight();
+	const int resx = images_->at(mipmap_level)->getWidth();
+	const int resy = images_->at(mipmap_level)->getHeight();
 
 	const float xf = (static_cast<float>(resx) * (p.x_ - floor(p.x_))) - 0.5f;
 	const float yf = (static_cast<float>(resy) * (p.y_ - floor(p.y_))) - 0.5f;
@@ -297,45 +434,43 @@ Rgba ImageTexture::bicubicInterpolation(const Point3 &p, int mipmap_level) const
 	findTextureInterpolationCoordinates(x_0, x_1, x_2, x_3, dx, xf, resx, tex_clip_mode_ == ClipMode::Repeat, mirror_x_);
 	findTextureInterpolationCoordinates(y_0, y_1, y_2, y_3, dy, yf, resy, tex_clip_mode_ == ClipMode::Repeat, mirror_y_);
 
-	const Rgba c_00 = images_.at(mipmap_level)->getColor(x_0, y_0);
-	const Rgba c_01 = images_.at(mipmap_level)->getColor(x_0, y_1);
-	const Rgba c_02 = images_.at(mipmap_level)->getColor(x_0, y_2);
-	const Rgba c_03 = images_.at(mipmap_level)->getColor(x_0, y_3);
-
-	const Rgba c_10 = images_.at(mipmap_level)->getColor(x_1, y_0);
-	const Rgba c_11 = images_.at(mipmap_level)->getColor(x_1, y_1);
-	const Rgba c_12 = images_.at(mipmap_level)->getColor(x_1, y_2);
-	const Rgba c_13 = images_.at(mipmap_level)->getColor(x_1, y_3);
+	const Image &image = *images_->at(mipmap_level);
+	const std::array<int, 4> ys {{ y_0, y_1, y_2, y_3 }};
+	std::array<Rgba, 4> column_0, column_1, column_2, column_3;
+	getColumnColors_global(image, x_0, ys, column_0);
+	getColumnColors_global(image, x_1, ys, column_1);
+	getColumnColors_global(image, x_2, ys, column_2);
+	getColumnColors_global(image, x_3, ys, column_3);
 
-	const Rgba c_20 = images_.at(mipmap_level)->getColor(x_2, y_0);
-	const Rgba c_21 = images_.at(mipmap_level)->getColor(x_2, y_1);
-	const Rgba c_22 = images_.at(mipmap_level)->getColor(x_2, y_2);
-	const Rgba c_23 = images_.at(mipmap_level)->getColor(x_2, y_3);
+	const Rgba cy_0 = math::cubicInterpolate(column_0[0], column_1[0], column_2[0], column_3[0], dx);
+	const Rgba cy_1 = math::cubicInterpolate(column_0[1], column_1[1], column_2[1], column_3[1], dx);
+	const Rgba cy_2 = math::cubicInterpolate(column_0[2], column_1[2], column_2[2], column_3[2], dx);
+	const Rgba cy_3 = math::cubicInterpolate(column_0[3], column_1[3], column_2[3], column_3[3], dx);
 
-	const Rgba c_30 = images_.at(mipmap_level)->getColor(x_3, y_0);
-	const Rgba c_31 = images_.at(mipmap_level)->getColor(x_3, y_1);
-	const Rgba c_32 = images_.at(mipmap_level)->getColor(x_3, y_2);
-	const Rgba c_33 = images_.at(mipmap_level)->getColor(x_3, y_3);
-
-	const Rgba cy_0 = math::cubicInterpolate(c_00, c_10, c_20, c_30, dx);
-	const Rgba cy_1 = math::cubicInterpolate(c_01, c_11, c_21, c_31, dx);
-	const Rgba cy_2 = math::cubicInterpolate(c_02, c_12, c_22, c_32, dx);
-	const Rgba cy_3 = math::cubicInterpolate(c_03, c_13, c_23, c_33, dx);
+	if(dcolor_dx)
+	{
+		const Rgba dcy_0 = math::cubicInterpolateDerivative(column_0[0], column_1[0], column_2[0], column_3[0], dx);
+		const Rgba dcy_1 = math::cubicInterpolateDerivative(column_0[1], column_1[1], column_2[1], column_3[1], dx);
+		const Rgba dcy_2 = math::cubicInterpolateDerivative(column_0[2], column_1[2], column_2[2], column_3[2], dx);
+		const Rgba dcy_3 = math::cubicInterpolateDerivative(column_0[3], column_1[3], column_2[3], column_3[3], dx);
+		*dcolor_dx = static_cast<float>(resx) * math::cubicInterpolate(dcy_0, dcy_1, dcy_2, dcy_3, dy);
+	}
+	if(dcolor_dy) *dcolor_dy = static_cast<float>(resy) * math::cubicInterpolateDerivative(cy_0, cy_1, cy_2, cy_3, dy);
 
 	return math::cubicInterpolate(cy_0, cy_1, cy_2, cy_3, dy);
 }
 
 Rgba ImageTexture::mipMapsTrilinearInterpolation(const Point3 &p, const MipMapParams *mipmap_params) const
 {
-	const float ds = std::max(std::abs(mipmap_params->ds_dx_), std::abs(mipmap_params->ds_dy_)) * images_.at(0)->getWidth();
-	const float dt = std::max(std::abs(mipmap_params->dt_dx_), std::abs(mipmap_params->dt_dy_)) * images_.at(0)->getHeight();
+	const float ds = std::max(std::abs(mipmap_params->ds_dx_), std::abs(mipmap_params->ds_dy_)) * images_->at(0)->getWidth();
+	const float dt = std::max(std::abs(mipmap_params->dt_dx_), std::abs(mipmap_params->dt_dy_)) * images_->at(0)->getHeight();
 	float mipmap_level = 0.5f * math::log2(ds * ds + dt * dt);
 
-	if(mipmap_params->force_image_level_ > 0.f) mipmap_level = mipmap_params->force_image_level_ * static_cast<float>(images_.size() - 1);
+	if(mipmap_params->force_image_level_ > 0.f) mipmap_level = mipmap_params->force_image_level_ * static_cast<float>(images_->size() - 1);
 
 	mipmap_level += trilinear_level_bias_;
 
-	mipmap_level = std::min(std::max(0.f, mipmap_level), static_cast<float>(images_.size() - 1));
+	mipmap_level = std::min(std::max(0.f, mipmap_level), static_cast<float>(images_->size() - 1));
 
 	const int mipmap_level_a = static_cast<int>(floor(mipmap_level));
 	const int mipmap_level_b = static_cast<int>(ceil(mipmap_level));
@@ -376,8 +511,8 @@ Rgba ImageTexture::mipMapsEwaInterpolation(const Point3 &p, float max_anisotropy
 
 	if(minor_length <= 0.f) return bilinearInterpolation(p);
 
-	float mipmap_level = static_cast<float>(images_.size() - 1) - 1.f + math::log2(minor_length);
-	mipmap_level = std::min(std::max(0.f, mipmap_level), static_cast<float>(images_.size() - 1));
+	float mipmap_level = static_cast<float>(images_->size() - 1) - 1.f + math::log2(minor_length);
+	mipmap_level = std::min(std::max(0.f, mipmap_level), static_cast<float>(images_->size() - 1));
 
 	const int mipmap_level_a = static_cast<int>(floor(mipmap_level));
 	const int mipmap_level_b = static_cast<int>(ceil(mipmap_level));
@@ -393,15 +528,15 @@ Rgba ImageTexture::mipMapsEwaInterpolation(const Point3 &p, float max_anisotropy
 
 Rgba ImageTexture::ewaEllipticCalculation(const Point3 &p, float ds_0, float dt_0, float ds_1, float dt_1, int mipmap_level) const
 {
-	if(mipmap_level >= static_cast<float>(images_.size() - 1))
+	if(mipmap_level >= static_cast<float>(images_->size() - 1))
 	{
-		const int resx = images_.at(0)->getWidth();
-		const int resy = images_.at(0)->getHeight();
-		return images_.at(images_.size() - 1)->getColor(math::mod(static_cast<int>(p.x_), resx), math::mod(static_cast<int>(p.y_), resy));
+		const int resx = images_->at(0)->getWidth();
+		const int resy = images_->at(0)->getHeight();
+		return images_->at(images_->size() - 1)->getColor(math::mod(static_cast<int>(p.x_), resx), math::mod(static_cast<int>(p.y_), resy));
 	}
 
-	const int resx = images_.at(mipmap_level)->getWidth();
-	const int resy = images_.at(mipmap_level)->getHeight();
+	const int resx = images_->at(mipmap_level)->getWidth();
+	const int resy = images_->at(mipmap_level)->getHeight();
 
 	const float xf = (static_cast<float>(resx) * (p.x_ - floor(p.x_))) - 0.5f;
 	const float yf = (static_cast<float>(resy) * (p.y_ - floor(p.y_))) - 0.5f;
@@ -432,21 +567,38 @@ Rgba ImageTexture::ewaEllipticCalculation(const Point3 &p, float ds_0, float dt_
 	Rgba sum_col(0.f);
 
 	float sum_wts = 0.f;
-	for(int it = t_0; it <= t_1; ++it)
+	const Image &image = *images_->at(mipmap_level);
+	//The texels are read by columns, stored contiguously in the images, and only from the rows of each column inside the ellipse, as its bounding box has many more texels when it is elongated and rotated
+	std::array<Rgba, 32> colors;
+	for(int is = s_0; is <= s_1; ++is)
 	{
-		const float tt = it - yf;
-		for(int is = s_0; is <= s_1; ++is)
+		const float ss = is - xf;
+		//The rows inside the ellipse are those with a * ss^2 + b * ss * tt + c * tt^2 < 1
+		const float discriminant = b * b * ss * ss - 4.f * c * (a * ss * ss - 1.f);
+		if(discriminant <= 0.f) continue;
+		const float discriminant_sqrt = sqrtf(discriminant);
+		const int it_begin = std::max(t_0, static_cast<int>(ceilf(yf + (-b * ss - discriminant_sqrt) / (2.f * c))));
+		const int it_end = std::min(t_1, static_cast<int>(floorf(yf + (-b * ss + discriminant_sqrt) / (2.f * c)))) + 1;
+		const int ismod = math::mod(is, resx);
+		int itmod = math::mod(it_begin, resy);
+		for(int it = it_begin; it < it_end;)
 		{
-			const float ss = is - xf;
-			const float r_2 = a * ss * ss + b * ss * tt + c * tt * tt;
-			if(r_2 < 1.f)
+			const int num_texels = std::min({ it_end - it, resy - itmod, static_cast<int>(colors.size()) });
+			image.getColumnColors(ismod, itmod, num_texels, colors.data());
+			for(int texel = 0; texel < num_texels; ++texel)
 			{
-				const float weight = ewa_weight_lut_[std::min(static_cast<int>(floorf(r_2 * ewa_weight_lut_size_)), ewa_weight_lut_size_ - 1)];
-				const int ismod = math::mod(is, resx);
-				const int itmod = math::mod(it, resy);
-				sum_col += images_.at(mipmap_level)->getColor(ismod, itmod) * weight;
-				sum_wts += weight;
+				const float tt = (it + texel) - yf;
+				const float r_2 = a * ss * ss + b * ss * tt + c * tt * tt;
+				if(r_2 < 1.f)
+				{
+					const float weight = ewa_weight_lut_[std::min(static_cast<int>(floorf(r_2 * ewa_weight_lut_size_)), ewa_weight_lut_size_ - 1)];
+					sum_col += colors[texel] * weight;
+					sum_wts += weight;
+				}
 			}
+			it += num_texels;
+			itmod += num_texels;
+			if(itmod >= resy) itmod = 0;
 		}
 	}
 	if(sum_wts > 0.f) sum_col = sum_col / sum_wts;
@@ -469,66 +621,273 @@ void ImageTexture::generateEwaLookupTable()
 	}
 }
 
+//! Source texels and weights of each destination texel when downsampling by area averaging, as done by OpenCV INTER_AREA
+struct AreaWeights
+{
+	int first_ = 0;
+	int num_ = 0;
+	float weights_[3]; //!< the destination texels cover up to 3 source texels, as the mipmaps are never less than half the size of the previous level
+};
+
+static std::vector<AreaWeights> areaWeights_global(int src_size, int dst_size)
+{
+	std::vector<AreaWeights> area_weights(dst_size);
+	const double scale = static_cast<double>(src_size) / dst_size;
+	for(int dst_pos = 0; dst_pos < dst_size; ++dst_pos)
+	{
+		const double start = dst_pos * scale;
+		const double end = std::min(start + scale, static_cast<double>(src_size));
+		AreaWeights &area = area_weights[dst_pos];
+		area.first_ = static_cast<int>(start);
+		for(int src_pos = area.first_; src_pos < end && area.num_ < 3; ++src_pos)
+		{
+			const double overlap = std::min(end, src_pos + 1.0) - std::max(start, static_cast<double>(src_pos));
+			area.weights_[area.num_++] = static_cast<float>(overlap / scale);
+		}
+	}
+	return area_weights;
+}
+
 void ImageTexture::generateMipMaps()
 {
-	if(images_.empty()) return;
+	TaskPool task_pool(SysInfo().getNumSystemThreads());
+	completeLoading(&task_pool);
+	buildMipMaps(&task_pool);
+}
+
+void ImageTexture::buildMipMaps(TaskPool *task_pool)
+{
+	if(images_->size() != 1) return; //no image or mipmaps already generated
+	TraceSpan trace_span("texture", "mipmaps");
 
-#ifdef HAVE_OPENCV
 	int img_index = 0;
-	//bool blur_seamless = true;
-	int w = images_.at(0)->getWidth();
-	int h = images_.at(0)->getHeight();
+	int w = images_->at(0)->getWidth();
+	int h = images_->at(0)->getHeight();
 
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Format: generating mipmaps for texture of resolution [" << w << " x " << h << "]" << YENDL;
 
-	const cv::Mat a(h, w, CV_32FC4);
-	cv::Mat_<cv::Vec4f> a_vec = a;
-
-	for(int j = 0; j < h; ++j)
+	//Mipmap generation using temporary full float buffers to reduce information loss, each level downsampled from the previous one
+	std::vector<Rgba> colors(static_cast<size_t>(w) * h);
+	const size_t min_rows = std::max(static_cast<size_t>(1), static_cast<size_t>(8192 / w));
+	parallelFor_global(task_pool, h, [&](size_t begin, size_t end)
 	{
-		for(int i = 0; i < w; ++i)
-		{
-			Rgba color = images_[img_index]->getColor(i, j);
-			a_vec(j, i)[0] = color.getR();
-			a_vec(j, i)[1] = color.getG();
-			a_vec(j, i)[2] = color.getB();
-			a_vec(j, i)[3] = color.getA();
-		}
-	}
+		for(size_t j = begin; j < end; ++j) for(int i = 0; i < w; ++i) colors[j * w + i] = (*images_)[0]->getColor(i, j);
+	}, min_rows);
 
-	//Mipmap generation using the temporary full float buffer to reduce information loss
+	std::vector<Rgba> colors_rows;
+	std::vector<Rgba> colors_2;
 	while(w > 1 || h > 1)
 	{
-		int w_2 = (w + 1) / 2;
-		int h_2 = (h + 1) / 2;
+		const int w_2 = (w + 1) / 2;
+		const int h_2 = (h + 1) / 2;
 		++img_index;
-		images_.emplace_back(Image::factory(w_2, h_2, images_[img_index - 1]->getType(), images_[img_index - 1]->getOptimization()));
-
-		const cv::Mat b(h_2, w_2, CV_32FC4);
-		const cv::Mat_<cv::Vec4f> b_vec = b;
-		cv::resize(a, b, cv::Size(w_2, h_2), 0, 0, cv::INTER_AREA);
-
-		for(int j = 0; j < h_2; ++j)
+		images_->emplace_back(Image::factory(w_2, h_2, (*images_)[img_index - 1]->getType(), (*images_)[img_index - 1]->getOptimization(), huge_pages_mode_));
+		Image *image = (*images_)[img_index].get();
+
+		//The area average is separable, so the rows are downsampled first and then the columns
+		const std::vector<AreaWeights> weights_x = areaWeights_global(w, w_2);
+		const std::vector<AreaWeights> weights_y = areaWeights_global(h, h_2);
+		colors_rows.assign(static_cast<size_t>(w_2) * h, Rgba(0.f));
+		colors_2.assign(static_cast<size_t>(w_2) * h_2, Rgba(0.f));
+		parallelFor_global(task_pool, h, [&](size_t begin, size_t end)
 		{
-			for(int i = 0; i < w_2; ++i)
+			for(size_t j = begin; j < end; ++j) for(int i = 0; i < w_2; ++i)
 			{
-				Rgba tmp_col(0.f);
-				tmp_col.r_ = b_vec(j, i)[0];
-				tmp_col.g_ = b_vec(j, i)[1];
-				tmp_col.b_ = b_vec(j, i)[2];
-				tmp_col.a_ = b_vec(j, i)[3];
-				images_[img_index]->setColor(i, j, tmp_col);
+				const AreaWeights &area = weights_x[i];
+				Rgba &color = colors_rows[j * w_2 + i];
+				for(int n = 0; n < area.num_; ++n) color += colors[j * w + area.first_ + n] * area.weights_[n];
 			}
-		}
+		}, min_rows);
+		parallelFor_global(task_pool, h_2, [&](size_t begin, size_t end)
+		{
+			for(size_t j = begin; j < end; ++j)
+			{
+				const AreaWeights &area = weights_y[j];
+				for(int i = 0; i < w_2; ++i)
+				{
+					Rgba &color = colors_2[j * w_2 + i];
+					for(int n = 0; n < area.num_; ++n) color += colors_rows[(area.first_ + n) * w_2 + i] * area.weights_[n];
+					image->setColor(i, j, color);
+				}
+			}
+		}, std::max(static_cast<size_t>(1), static_cast<size_t>(8192 / w_2)));
+		colors.swap(colors_2);
 		w = w_2;
 		h = h_2;
 		if(Y_LOG_HAS_DEBUG) Y_DEBUG << "Format: generated mipmap " << img_index << " [" << w_2 << " x " << h_2 << "]" << YENDL;
 	}
 
+	//The mipmaps of a texture already block compressed are generated uncompressed from its decoded texels
+	if((*images_)[0]->getOptimization() == Image::Optimization::BlockCompressed) blockCompress(task_pool, 1);
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "Format: mipmap generation done: " << img_index << " mipmaps generated." << YENDL;
-#else
-	Y_WARNING << "Format: cannot generate mipmaps, YafaRay was not built with OpenCV support which is needed for mipmap processing." << YENDL;
-#endif
+}
+
+//! Hash of the contents of the source image file and the settings it is loaded with, so its tile file is reused until they change, also when moved to another computer
+static uint64_t tileFileSignature_global(const std::string &file_name, const ColorSpace &color_space, float gamma, const Image::Optimization &optimization, bool grayscale)
+{
+	const MappedFile file(file_name);
+	if(!file.isOpen()) return 0;
+	uint64_t hash = 14695981039346656037ull;
+	const auto hash_bytes = [&hash](const void *data, size_t size)
+	{
+		const unsigned char *bytes = static_cast<const unsigned char *>(data);
+		for(size_t byte_num = 0; byte_num < size; ++byte_num)
+		{
+			hash ^= bytes[byte_num];
+			hash *= 1099511628211ull;
+		}
+	};
+	const int32_t color_space_id = static_cast<int32_t>(color_space);
+	const int32_t optimization_id = static_cast<int32_t>(optimization);
+	const uint8_t flags = grayscale ? 1 : 0;
+	//The contents are hashed by 64bit words, as hashing them byte by byte would take longer than loading the image
+	const uint64_t file_size = file.size();
+	const uint64_t num_words = file_size / sizeof(uint64_t);
+	for(uint64_t word_num = 0; word_num < num_words; ++word_num)
+	{
+		uint64_t word;
+		std::memcpy(&word, file.data() + word_num * sizeof(uint64_t), sizeof(uint64_t));
+		hash ^= word;
+		hash *= 1099511628211ull;
+	}
+	hash_bytes(file.data() + num_words * sizeof(uint64_t), file_size % sizeof(uint64_t));
+	hash_bytes(&file_size, sizeof(file_size));
+	hash_bytes(&color_space_id, sizeof(color_space_id));
+	hash_bytes(&gamma, sizeof(gamma));
+	hash_bytes(&optimization_id, sizeof(optimization_id));
+	hash_bytes(&flags, sizeof(flags));
+	return hash;
+}
+
+bool ImageTexture::decodeImage(PendingLoading &pending_loading, TaskPool *task_pool)
+{
+	TraceSpan trace_span("texture", "texture load");
+	trace_span.addArg("file", pending_loading.image_file_);
+	if(pending_loading.pixel_buffer_)
+	{
+		auto image_host_buffer = std::unique_ptr<Image>(new ImageHostBuffer(std::move(pending_loading.pixel_buffer_), pending_loading.color_space_, pending_loading.gamma_));
+		const bool grayscale = pending_loading.grayscale_ && !image_host_buffer->isGrayscale();
+		//Without optimization the texture reads the pixels of the buffer directly, otherwise they are converted once to an image with the chosen optimization
+		if(pending_loading.optimization_ == Image::Optimization::None && !grayscale) images_->emplace_back(std::move(image_host_buffer));
+		else
+		{
+			const int width = image_host_buffer->getWidth();
+			const int height = image_host_buffer->getHeight();
+			std::unique_ptr<Image> image = Image::factory(width, height, Image::getTypeFromSettings(image_host_buffer->hasAlpha(), pending_loading.grayscale_ || image_host_buffer->isGrayscale()), pending_loading.optimization_, huge_pages_mode_);
+			parallelFor_global(task_pool, static_cast<size_t>(width), [&](size_t begin, size_t end)
+			{
+				for(size_t x = begin; x < end; ++x)
+					for(int y = 0; y < height; ++y) image->setColor(static_cast<int>(x), y, image_host_buffer->getColor(static_cast<int>(x), y));
+			}, 64);
+			images_->emplace_back(std::move(image));
+		}
+		return true;
+	}
+	pending_loading.format_->setTaskPool(task_pool);
+	pending_loading.format_->setHugePagesMode(huge_pages_mode_);
+	std::unique_ptr<Image> image = pending_loading.format_->loadFromFile(pending_loading.image_file_, pending_loading.optimization_, pending_loading.color_space_, pending_loading.gamma_);
+	pending_loading.format_.reset();
+	if(image)
+	{
+		images_->emplace_back(std::move(image));
+		return true;
+	}
+	//The texture is already used by the scene, so it is kept with a single black texel instead of dropping it
+	Y_ERROR << "ImageTexture: Couldn't load image file '" << pending_loading.image_file_ << "', using a black texture instead." << YENDL;
+	images_->emplace_back(Image::factory(1, 1, Image::Type::Color, Image::Optimization::None));
+	return false;
+}
+
+void ImageTexture::completeLoading(TaskPool *task_pool)
+{
+	if(!pending_loading_) return;
+	const std::unique_ptr<PendingLoading> pending_loading = std::move(pending_loading_);
+	uint64_t tile_file_signature = 0;
+	if(pending_loading->use_tile_file_)
+	{
+		tile_file_signature = tileFileSignature_global(pending_loading->image_file_, pending_loading->color_space_, pending_loading->gamma_, pending_loading->optimization_, pending_loading->grayscale_);
+		*images_ = pending_loading->tiled_ ? ImageTiled::loadTileFile(pending_loading->tile_file_, tile_file_signature) : ImageTiled::readTileFile(pending_loading->tile_file_, tile_file_signature, pending_loading->mipmaps_, huge_pages_mode_);
+	}
+	if(images_->empty())
+	{
+		if(!decodeImage(*pending_loading, task_pool)) return;
+		//The tile files always include the mipmaps, so they can be used with any interpolation
+		if(pending_loading->mipmaps_ || pending_loading->use_tile_file_) buildMipMaps(task_pool);
+		if(pending_loading->use_tile_file_)
+		{
+			//Several textures can use the same image with the same settings and therefore the same tile file
+			static std::mutex tile_file_mutex;
+			std::lock_guard<std::mutex> lock(tile_file_mutex);
+			if(pending_loading->tiled_)
+			{
+				if(!convertToTiled(pending_loading->tile_file_, tile_file_signature)) Y_WARNING << "ImageTexture: Couldn't save tile file '" << pending_loading->tile_file_ << "', keeping the whole texture in memory." << YENDL;
+			}
+			else if(!ImageTiled::saveTileFile(pending_loading->tile_file_, tile_file_signature, *images_)) Y_WARNING << "ImageTexture: Couldn't regenerate tile file '" << pending_loading->tile_file_ << "'" << YENDL;
+		}
+	}
+	if(!pending_loading->mipmaps_) images_->resize(1);
+	if(pending_loading->block_compress_) blockCompress(task_pool, 0);
+	if(alpha_mask_requested_) buildAlphaMask(task_pool);
+	size_t memory_size = alpha_mask_.getMemorySize();
+	for(const auto &image : *images_) memory_size += image->getMemorySize();
+	memory_tracker_.set(memory_size);
+}
+
+void ImageTexture::requestAlphaMask()
+{
+	if(alpha_mask_requested_) return;
+	alpha_mask_requested_ = true;
+	//The scene loads the textures before creating the materials using them, otherwise the mask is built when the image is loaded
+	if(pending_loading_) return;
+	TaskPool task_pool(SysInfo().getNumSystemThreads());
+	buildAlphaMask(&task_pool);
+	memory_tracker_.set(memory_tracker_.get() + alpha_mask_.getMemorySize());
+}
+
+void ImageTexture::buildAlphaMask(TaskPool *task_pool)
+{
+	if(images_->empty() || normalmap_ || tiled_) return;
+	const Image *image = (*images_)[0].get();
+	//The float values are calculated as in getColorAndFloat
+	const bool built = alpha_mask_.build(image->getWidth(), image->getHeight(), [&](int x, int y)
+	{
+		Rgba raw_color = applyAdjustments(image->getColor(x, y));
+		raw_color.colorSpaceFromLinearRgb(original_image_file_color_space_, original_image_file_gamma_);
+		return applyIntensityContrastAdjustments(raw_color.col2Bri());
+	}, task_pool);
+	if(built && Y_LOG_HAS_VERBOSE) Y_VERBOSE << "ImageTexture: built a " << alpha_mask_.getBitsPerTexel() << " bit alpha mask for the transparent shadows" << YENDL;
+}
+
+void ImageTexture::shareImages(const Texture &texture)
+{
+	//Only the image textures have an images key, so the texture with the same key is an image texture too
+	const ImageTexture &image_texture = static_cast<const ImageTexture &>(texture);
+	images_ = image_texture.images_;
+	pending_loading_.reset();
+}
+
+void ImageTexture::blockCompress(TaskPool *task_pool, size_t first_level)
+{
+	for(size_t level = first_level; level < images_->size(); ++level)
+	{
+		std::unique_ptr<Image> compressed_image = ImageBlockCompressed::compress(*(*images_)[level], task_pool);
+		if(!compressed_image)
+		{
+			Y_WARNING << "ImageTexture: Couldn't block compress texture image of type '" << (*images_)[level]->getTypeName() << "', keeping it uncompressed." << YENDL;
+			return;
+		}
+		(*images_)[level] = std::move(compressed_image);
+	}
+}
+
+/*! Replaces the image and its mipmaps by tiled images loaded on demand from the tile file, saving it first */
+bool ImageTexture::convertToTiled(const std::string &tile_file, uint64_t signature)
+{
+	if(!ImageTiled::saveTileFile(tile_file, signature, *images_)) return false;
+	std::vector<std::unique_ptr<Image>> tiled_images = ImageTiled::loadTileFile(tile_file, signature);
+	if(tiled_images.size() != images_->size()) return false;
+	*images_ = std::move(tiled_images);
+	return true;
 }
 
 ImageTexture::ClipMode string2Cliptype_global(const std::string &clipname)
@@ -553,6 +912,10 @@ std::unique_ptr<Texture> ImageTexture::factory(ParamMap &params, const Scene &sc
 	std::string color_space_str = "Raw_Manual_Gamma";
 	std::string image_optimization_str = "optimized";
 	bool img_grayscale = false;
+	bool tiled = false;
+	std::string tile_file;
+	std::string content_key;
+	std::string image_buffer_name;
 	params.getParam("interpolate", interpolation_type_str);
 	params.getParam("color_space", color_space_str);
 	params.getParam("gamma", gamma);
@@ -561,8 +924,25 @@ std::unique_ptr<Texture> ImageTexture::factory(ParamMap &params, const Scene &sc
 	params.getParam("filename", name);
 	params.getParam("image_optimization", image_optimization_str);
 	params.getParam("img_grayscale", img_grayscale);
-
-	if(name.empty())
+	params.getParam("tiled", tiled); //out of core texture, loading its tiles on demand within the tile cache budget
+	params.getParam("tile_file", tile_file); //tile file of the out of core texture, next to the image file by default
+	params.getParam("content_key", content_key); //content key of the image file in the asset cache, if known the cached copy is used without checking the image file
+	params.getParam("image_buffer", image_buffer_name); //pixels given by the host application with Interface::addImageBuffer, instead of an image file
+	//The texture sets with one image file per UDIM tile, loading each tile when first used
+	if(image_buffer_name.empty() && UdimTexture::isUdimPattern(name)) return UdimTexture::factory(params, scene);
+
+	std::shared_ptr<const HostPixelBuffer> pixel_buffer;
+	if(!image_buffer_name.empty())
+	{
+		pixel_buffer = scene.getImageBuffer(image_buffer_name);
+		if(!pixel_buffer)
+		{
+			Y_ERROR << "ImageTexture: Couldn't find image buffer '" << image_buffer_name << "', dropping texture." << YENDL;
+			return nullptr;
+		}
+		tiled = false; //the tile files are generated from image files
+	}
+	else if(name.empty())
 	{
 		Y_ERROR << "ImageTexture: Required argument filename not found for image texture" << YENDL;
 		return nullptr;
@@ -571,60 +951,82 @@ std::unique_ptr<Texture> ImageTexture::factory(ParamMap &params, const Scene &sc
 	const InterpolationType interpolation_type = Texture::getInterpolationTypeFromName(interpolation_type_str);
 	ColorSpace color_space = Rgb::colorSpaceFromName(color_space_str);
 	Image::Optimization image_optimization = Image::getOptimizationTypeFromName(image_optimization_str);
-	const Path path(name);
 
-	ParamMap format_params;
-	format_params["type"] = toLower_global(path.getExtension());
-	std::unique_ptr<Format> format = std::unique_ptr<Format>(Format::factory(format_params));
-	if(!format)
+	std::unique_ptr<Format> format;
+	if(!pixel_buffer)
 	{
-		Y_ERROR << "ImageTexture: Couldn't create image handler, dropping texture." << YENDL;
-		return nullptr;
+		ParamMap format_params;
+		format_params["type"] = toLower_global(Path(name).getExtension());
+		format = std::unique_ptr<Format>(Format::factory(format_params));
+		if(!format)
+		{
+			Y_ERROR << "ImageTexture: Couldn't create image handler, dropping texture." << YENDL;
+			return nullptr;
+		}
+		format->setGrayScaleSetting(img_grayscale);
 	}
+	const bool hdr = pixel_buffer ? pixel_buffer->isFloat() : format->isHdr();
 
-	if(format->isHdr())
+	if(hdr)
 	{
 		if(color_space != ColorSpace::LinearRgb && Y_LOG_HAS_VERBOSE) Y_VERBOSE << "ImageTexture: The image is a HDR/EXR file: forcing linear RGB and ignoring selected color space '" << color_space_str << "' and the gamma setting." << YENDL;
 		color_space = LinearRgb;
-		if(image_optimization_str != "none" && Y_LOG_HAS_VERBOSE) Y_VERBOSE << "ImageTexture: The image is a HDR/EXR file: forcing texture optimization to 'none' and ignoring selected texture optimization '" << image_optimization_str << "'" << YENDL;
-		image_optimization = Image::Optimization::None;
+		if(image_optimization != Image::Optimization::BlockCompressed && image_optimization != Image::Optimization::HalfFloat) //the block compression and the half floats keep the HDR range
+		{
+			if(image_optimization_str != "none" && Y_LOG_HAS_VERBOSE) Y_VERBOSE << "ImageTexture: The image is a HDR/EXR file: forcing texture optimization to 'none' and ignoring selected texture optimization '" << image_optimization_str << "'" << YENDL;
+			image_optimization = Image::Optimization::None;
+		}
 	}
 
-	format->setGrayScaleSetting(img_grayscale);
-
-	std::unique_ptr<Image> image = format->loadFromFile(name, image_optimization, color_space, gamma);
-	if(!image)
+	//The block compressed textures are loaded uncompressed, and compressed once their mipmaps are generated. The tiled textures are not block compressed, as only their resident tiles use memory
+	const bool block_compress = image_optimization == Image::Optimization::BlockCompressed && !tiled;
+	const Image::Optimization load_optimization = (image_optimization != Image::Optimization::BlockCompressed) ? image_optimization : (hdr ? Image::Optimization::None : Image::Optimization::Optimized);
+	const bool mipmaps = interpolation_type == InterpolationType::Trilinear || interpolation_type == InterpolationType::Ewa;
+	if(tile_file.empty()) tile_file = name + ".tiled";
+	if(!pixel_buffer) name = AssetCache::getLocalPath(scene.getAssetCacheDir(), name, content_key);
+	if(!pixel_buffer && !File::exists(name, true))
 	{
-		Y_ERROR << "ImageTexture: Couldn't load image file, dropping texture." << YENDL;
+		Y_ERROR << "ImageTexture: Couldn't find image file '" << name << "', dropping texture." << YENDL;
 		return nullptr;
 	}
 
-	auto tex = std::unique_ptr<ImageTexture>(new ImageTexture(std::move(image)));
-	if(!tex) //FIXME: this will never be true, replace by exception handling??
-	{
-		Y_ERROR << "ImageTexture: Couldn't create image texture." << YENDL;
-		return nullptr;
-	}
+	//The image is loaded later by the scene with its mipmaps and tile file, in parallel for all the textures
+	auto tex = std::unique_ptr<ImageTexture>(new ImageTexture());
+	tex->pending_loading_ = std::unique_ptr<PendingLoading>(new PendingLoading());
+	PendingLoading &pending_loading = *tex->pending_loading_;
+	pending_loading.format_ = std::move(format);
+	pending_loading.pixel_buffer_ = pixel_buffer;
+	pending_loading.image_file_ = name;
+	pending_loading.optimization_ = load_optimization;
+	pending_loading.color_space_ = color_space;
+	pending_loading.gamma_ = gamma;
+	pending_loading.grayscale_ = img_grayscale;
+	pending_loading.mipmaps_ = mipmaps;
+	pending_loading.tiled_ = tiled;
+	tex->tiled_ = tiled;
+	tex->huge_pages_mode_ = scene.getHugePagesMode();
+	//Tile files generated in advance, for example by yafaray-texture-baker, are also used by the textures kept in memory to avoid generating the mipmaps
+	pending_loading.use_tile_file_ = !pixel_buffer && (tiled || File::exists(tile_file, true));
+	pending_loading.tile_file_ = tile_file;
+	pending_loading.block_compress_ = block_compress;
+
+	//The modification time identifies the image file contents without reading them, so the images are not shared with the textures created before the file changed
+	uint64_t file_size = 0;
+	int64_t modification_time = 0;
+	File::getInfo(name, file_size, modification_time);
+	std::stringstream images_key;
+	//The image buffers are identified by their address, so the images are not shared with the textures created before the buffer was replaced
+	if(pixel_buffer) images_key << "image_buffer|" << image_buffer_name << "|" << pixel_buffer.get() << "|";
+	images_key << name << "|" << static_cast<int>(color_space) << "|" << gamma << "|" << static_cast<int>(load_optimization) << "|" << img_grayscale << "|" << mipmaps << "|" << tiled << "|" << block_compress << "|" << tile_file << "|" << file_size << "|" << modification_time;
+	tex->images_key_ = images_key.str();
 
 	tex->original_image_file_color_space_ = color_space;
 	tex->original_image_file_gamma_ = gamma;
 
-	if(interpolation_type == InterpolationType::Trilinear || interpolation_type == InterpolationType::Ewa)
+	if(mipmaps && !scene.getSession().getDifferentialRaysEnabled())
 	{
-		tex->generateMipMaps();
-		if(!session_global.getDifferentialRaysEnabled())
-		{
-			if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "At least one texture using mipmaps interpolation, enabling ray differentials." << YENDL;
-			session_global.setDifferentialRaysEnabled(true);	//If there is at least one texture using mipmaps, then enable differential rays in the rendering process.
-		}
-
-		/*//FIXME DAVID: TEST SAVING MIPMAPS. CAREFUL: IT COULD CAUSE CRASHES!
-		for(int i=0; i<=format->getHighestImgIndex(); ++i)
-		{
-			std::stringstream ss;
-			ss << "//tmp//saved_mipmap_" << ihname << "_global" << i;
-			format->saveToFile(ss.str(), i);
-		}*/
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "At least one texture using mipmaps interpolation, enabling ray differentials." << YENDL;
+		scene.getSession().setDifferentialRaysEnabled(true);	//If there is at least one texture using mipmaps, then enable differential rays in the rendering process.
 	}
 
 	// setup image
@@ -0,0 +1,147 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "texture/texture_udim.h"
+#include "texture/texture_image.h"
+#include "common/session.h"
+#include "common/file.h"
+#include "common/logger.h"
+#include "scene/scene.h"
+#include <algorithm>
+#include <cmath>
+
+BEGIN_YAFARAY
+
+UdimTexture::UdimTexture(const ParamMap &params, const Scene &scene, const std::string &pattern, bool normalmap, int nominal_resolution) : params_(params), scene_(scene), pattern_(pattern), normalmap_(normalmap), nominal_resolution_(nominal_resolution)
+{
+	tiles_ = std::unique_ptr<Tile[]>(new Tile[tiles_u_ * max_tiles_v_]);
+	//The tiles cover the UV square of their number, so the repeats, crop and clipping of the whole texture do not apply to them
+	params_["clipping"] = std::string("extend");
+	params_["xrepeat"] = 1;
+	params_["yrepeat"] = 1;
+	params_["cropmin_x"] = 0.f;
+	params_["cropmin_y"] = 0.f;
+	params_["cropmax_x"] = 1.f;
+	params_["cropmax_y"] = 1.f;
+	params_["tile_file"] = std::string(""); //each tile has its own tile file next to its image file
+	params_["content_key"] = std::string(""); //the content key identifies a single file
+}
+
+void UdimTexture::loadTile(int tile_index) const
+{
+	std::string file_name = pattern_;
+	file_name.replace(file_name.find(udim_tag_), std::string(udim_tag_).size(), std::to_string(1001 + tile_index));
+	//The texture sets often have gaps, the missing tiles are transparent black
+	if(!File::exists(file_name, true))
+	{
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "UdimTexture: tile file '" << file_name << "' not found, using black for the tile." << YENDL;
+		return;
+	}
+	ParamMap tile_params = params_;
+	tile_params["filename"] = file_name;
+	std::unique_ptr<Texture> texture = ImageTexture::factory(tile_params, scene_);
+	if(!texture) return;
+	//Loaded in the thread of the first look-up, the other threads looking up the same tile meanwhile wait in std::call_once
+	texture->completeLoading(nullptr);
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "UdimTexture: loaded tile file '" << file_name << "'" << YENDL;
+	tiles_[tile_index].texture_ = std::move(texture);
+}
+
+const Texture *UdimTexture::getTile(const Point3 &p, Point3 &tile_p) const
+{
+	const float u = 0.5f * (p.x_ + 1.f);
+	const float v = 0.5f * (p.y_ + 1.f);
+	const float tile_u = std::floor(u);
+	const float tile_v = std::floor(v);
+	if(tile_u < 0.f || tile_u >= tiles_u_ || tile_v < 0.f || tile_v >= max_tiles_v_) return nullptr;
+	const int tile_index = static_cast<int>(tile_u) + tiles_u_ * static_cast<int>(tile_v);
+	Tile &tile = tiles_[tile_index];
+	std::call_once(tile.loaded_, &UdimTexture::loadTile, this, tile_index);
+	tile_p = Point3(2.f * (u - tile_u) - 1.f, 2.f * (v - tile_v) - 1.f, p.z_);
+	return tile.texture_.get();
+}
+
+Rgba UdimTexture::getColor(const Point3 &p, const MipMapParams *mipmap_params) const
+{
+	Point3 tile_p;
+	const Texture *tile = getTile(p, tile_p);
+	return tile ? tile->getColor(tile_p, mipmap_params) : Rgba(0.f);
+}
+
+Rgba UdimTexture::getRawColor(const Point3 &p, const MipMapParams *mipmap_params) const
+{
+	Point3 tile_p;
+	const Texture *tile = getTile(p, tile_p);
+	return tile ? tile->getRawColor(tile_p, mipmap_params) : Rgba(0.f);
+}
+
+float UdimTexture::getFloat(const Point3 &p, const MipMapParams *mipmap_params) const
+{
+	Point3 tile_p;
+	const Texture *tile = getTile(p, tile_p);
+	return tile ? tile->getFloat(tile_p, mipmap_params) : 0.f;
+}
+
+void UdimTexture::getColorAndFloat(const Point3 &p, const MipMapParams *mipmap_params, Rgba &color, float &value) const
+{
+	Point3 tile_p;
+	const Texture *tile = getTile(p, tile_p);
+	if(tile) tile->getColorAndFloat(tile_p, mipmap_params, color, value);
+	else
+	{
+		color = Rgba(0.f);
+		value = 0.f;
+	}
+}
+
+bool UdimTexture::getFloatGradient(const Point3 &p, Vec3 &gradient) const
+{
+	//The tiles have the same size as the whole UV square of the regular textures, so the gradient is the same in both coordinates
+	Point3 tile_p;
+	const Texture *tile = getTile(p, tile_p);
+	return tile && tile->getFloatGradient(tile_p, gradient);
+}
+
+std::unique_ptr<Texture> UdimTexture::factory(ParamMap &params, const Scene &scene)
+{
+	std::string pattern;
+	std::string interpolation_type_str;
+	bool normalmap = false;
+	int nominal_resolution = 4096;
+	params.getParam("filename", pattern);
+	params.getParam("interpolate", interpolation_type_str);
+	params.getParam("normalmap", normalmap);
+	params.getParam("udim_resolution", nominal_resolution); //resolution of the tiles given to the bump mapping, known without loading any tile
+	if(!isUdimPattern(pattern))
+	{
+		Y_ERROR << "UdimTexture: the file name '" << pattern << "' does not contain the tile number tag '" << udim_tag_ << "'" << YENDL;
+		return nullptr;
+	}
+	auto tex = std::unique_ptr<UdimTexture>(new UdimTexture(params, scene, pattern, normalmap, std::max(1, nominal_resolution)));
+	tex->interpolation_type_ = Texture::getInterpolationTypeFromName(interpolation_type_str);
+	//The tiles are loaded while rendering, too late for them to enable the ray differentials
+	if((tex->interpolation_type_ == InterpolationType::Trilinear || tex->interpolation_type_ == InterpolationType::Ewa) && !scene.getSession().getDifferentialRaysEnabled())
+	{
+		if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "At least one texture using mipmaps interpolation, enabling ray differentials." << YENDL;
+		scene.getSession().setDifferentialRaysEnabled(true);
+	}
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "UdimTexture: texture set '" << pattern << "', the tiles are loaded when first used." << YENDL;
+	return tex;
+}
+
+END_YAFARAY
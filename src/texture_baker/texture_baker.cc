@@ -0,0 +1,102 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "yafaray_config.h"
+#include "common/param.h"
+#include "common/console.h"
+#include "common/logger.h"
+#include "scene/scene.h"
+#include <fstream>
+
+using namespace::yafaray4;
+
+/*! Generates the tile file with mipmaps of an image texture in advance, so loading the scenes using it does not need
+ * to decode the image nor generate its mipmaps. The texture settings must be the same as in the scenes, as the tile
+ * file stores a hash of the image file and the settings and it is regenerated when loading a texture with different ones */
+int main(int argc, char *argv[])
+{
+	CliParser parse(argc, argv, 2, 1, "You need to set the image file of the texture.");
+
+	parse.setAppName("YafaRay texture baker",
+					 "[OPTIONS]... <input image file> [<output tile file>]\n<input image file> : image file of the texture\n<output tile file> : tile file to generate, by default the image file name followed by \".tiled\", where the textures look for it when no \"tile_file\" parameter is set");
+
+	parse.setOption("vl", "verbosity-level", false, "Set console verbosity level, options are the same as for yafaray-xml\n");
+	parse.setOption("cs", "color-space", false, "Color space of the image, as in the texture \"color_space\" parameter (default sRGB)\n");
+	parse.setOption("io", "image-optimization", false, "Image optimization, as in the texture \"image_optimization\" parameter: \"none\", \"optimized\" (default), \"compressed\" or \"block_compressed\"\n");
+	parse.setOption("gs", "grayscale", true, "If specified, the image is converted to grayscale, as with the texture \"img_grayscale\" parameter\n");
+	parse.setOption("v", "version", true, "Displays this program's version.");
+	parse.setOption("h", "help", true, "Displays this help text.");
+
+	const bool parse_ok = parse.parseCommandLine();
+
+	if(parse.getFlag("h"))
+	{
+		parse.printUsage();
+		return 0;
+	}
+
+	if(parse.getFlag("v"))
+	{
+		Y_INFO << "YafaRay texture baker" << YENDL << "Built with YafaRay Core version " << YAFARAY_BUILD_VERSION << YENDL;
+		return 0;
+	}
+
+	if(!parse_ok)
+	{
+		parse.printError();
+		parse.printUsage();
+		return 1;
+	}
+
+	const std::string verb_level = parse.getOptionString("vl");
+	logger_global.setConsoleMasterVerbosity(verb_level.empty() ? "info" : verb_level);
+
+	const std::vector<std::string> files = parse.getCleanArgs();
+	if(files.empty()) return 1;
+
+	std::string color_space = parse.getOptionString("cs");
+	if(color_space.empty()) color_space = "sRGB";
+	std::string image_optimization = parse.getOptionString("io");
+	if(image_optimization.empty()) image_optimization = "optimized";
+
+	ParamMap scene_params;
+	scene_params["type"] = std::string("yafaray");
+	std::unique_ptr<Scene> scene = Scene::factory(scene_params);
+	if(!scene) return 1;
+
+	//The tile file is generated by the image texture itself when it does not exist or does not match the image and its settings
+	ParamMap params;
+	params["type"] = std::string("image");
+	params["filename"] = files.at(0);
+	params["color_space"] = color_space;
+	params["image_optimization"] = image_optimization;
+	params["img_grayscale"] = parse.getFlag("gs");
+	params["interpolate"] = std::string("trilinear");
+	params["tiled"] = true;
+	const std::string tile_file = (files.size() > 1) ? files.at(1) : files.at(0) + ".tiled";
+	params["tile_file"] = tile_file;
+	const bool texture_ok = scene->createTexture("texture_baker", params);
+	if(texture_ok) scene->completePendingTextures();
+	if(!texture_ok || !std::ifstream(tile_file).good())
+	{
+		Y_ERROR << "Texture baker: could not generate the tile file '" << tile_file << "' of '" << files.at(0) << "'" << YENDL;
+		return 1;
+	}
+	Y_INFO << "Texture baker: tile file '" << tile_file << "' is up to date" << YENDL;
+	return 0;
+}
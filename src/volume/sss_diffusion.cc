@@ -0,0 +1,166 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "volume/sss_diffusion.h"
+#include <cmath>
+#include <algorithm>
+
+BEGIN_YAFARAY
+
+static constexpr int max_depth_global = 16;
+static constexpr int max_leaf_points_global = 8;
+
+DiffusionProfile::DiffusionProfile(const Rgb &sigma_a, const Rgb &sigma_s_reduced, float ior) : ior_(ior)
+{
+	f_dr_ = -1.44f / (ior * ior) + 0.71f / ior + 0.668f + 0.0636f * ior;
+	const float a = (1.f + f_dr_) / (1.f - f_dr_);
+
+	const std::array<float, 3> sigma_a_channels {{ sigma_a.r_, sigma_a.g_, sigma_a.b_ }};
+	const std::array<float, 3> sigma_s_channels {{ sigma_s_reduced.r_, sigma_s_reduced.g_, sigma_s_reduced.b_ }};
+	std::array<float, 3> alpha, sigma_tr, z_r, z_v;
+	float min_sigma_tr = 1e30f;
+	for(int channel = 0; channel < 3; ++channel)
+	{
+		const float sigma_t = std::max(1e-6f, sigma_a_channels[channel] + sigma_s_channels[channel]);
+		alpha[channel] = sigma_s_channels[channel] / sigma_t;
+		//Media without absorption would diffuse the light infinitely far, their profile is cut as if they absorbed a little
+		sigma_tr[channel] = std::max(1e-3f * sigma_t, std::sqrt(3.f * sigma_a_channels[channel] * sigma_t));
+		z_r[channel] = 1.f / sigma_t;
+		z_v[channel] = z_r[channel] * (1.f + 4.f / 3.f * a);
+		min_sigma_tr = std::min(min_sigma_tr, sigma_tr[channel]);
+	}
+	mean_free_path_ = 1.f / min_sigma_tr;
+	max_radius_ = 10.f * mean_free_path_;
+
+	for(int i = 0; i < table_size_; ++i)
+	{
+		const float t = static_cast<float>(i) / static_cast<float>(table_size_ - 1);
+		const float r = max_radius_ * t * t;
+		std::array<float, 3> rd;
+		for(int channel = 0; channel < 3; ++channel)
+		{
+			const float d_r = std::sqrt(r * r + z_r[channel] * z_r[channel]);
+			const float d_v = std::sqrt(r * r + z_v[channel] * z_v[channel]);
+			const float real_source = z_r[channel] * (sigma_tr[channel] * d_r + 1.f) * std::exp(-sigma_tr[channel] * d_r) / (d_r * d_r * d_r);
+			const float virtual_source = z_v[channel] * (sigma_tr[channel] * d_v + 1.f) * std::exp(-sigma_tr[channel] * d_v) / (d_v * d_v * d_v);
+			rd[channel] = alpha[channel] / (4.f * M_PI) * (real_source + virtual_source);
+		}
+		table_[i] = Rgb(rd[0], rd[1], rd[2]);
+	}
+}
+
+Rgb DiffusionProfile::eval(float r) const
+{
+	if(r >= max_radius_) return Rgb(0.f);
+	const float index = std::sqrt(r / max_radius_) * static_cast<float>(table_size_ - 1);
+	const int i = std::min(static_cast<int>(index), table_size_ - 2);
+	const float t = index - static_cast<float>(i);
+	return table_[i] * (1.f - t) + table_[i + 1] * t;
+}
+
+SssPointCloud::SssPointCloud(std::vector<Point> &&points, float max_error) : points_(std::move(points)), max_error_(max_error)
+{
+	if(points_.empty()) return;
+	Bound bound(points_.front().p_, points_.front().p_);
+	for(const auto &point : points_) bound.include(point.p_);
+	nodes_.reserve(2 * points_.size() / max_leaf_points_global + 1);
+	build(bound, 0, static_cast<int>(points_.size()), 0);
+}
+
+int SssPointCloud::build(const Bound &bound, int first_point, int num_points, int depth)
+{
+	const int node_id = static_cast<int>(nodes_.size());
+	nodes_.push_back({});
+	Node node;
+	node.first_point_ = first_point;
+	node.num_points_ = num_points;
+	node.children_.fill(-1);
+
+	const auto begin = points_.begin() + first_point;
+	const auto end = begin + num_points;
+	Bound points_bound(begin->p_, begin->p_);
+	Vec3 weighted_position(0.f);
+	float area = 0.f;
+	node.power_ = Rgb(0.f);
+	for(auto point = begin; point != end; ++point)
+	{
+		points_bound.include(point->p_);
+		weighted_position += point->area_ * Vec3(point->p_);
+		area += point->area_;
+		node.power_ += point->irradiance_ * point->area_;
+	}
+	node.center_ = (area > 0.f) ? Point3(weighted_position * (1.f / area)) : points_bound.center();
+	node.radius_ = 0.5f * (points_bound.g_ - points_bound.a_).length();
+	node.leaf_ = (num_points <= max_leaf_points_global || depth >= max_depth_global);
+
+	if(!node.leaf_)
+	{
+		const Point3 split = bound.center();
+		const auto octant = [&split](const Point &point)
+		{
+			return (point.p_.x_ > split.x_ ? 1 : 0) | (point.p_.y_ > split.y_ ? 2 : 0) | (point.p_.z_ > split.z_ ? 4 : 0);
+		};
+		std::sort(begin, end, [&octant](const Point &point_1, const Point &point_2) { return octant(point_1) < octant(point_2); });
+		int child_first_point = first_point;
+		for(int child = 0; child < 8; ++child)
+		{
+			int child_num_points = 0;
+			while(child_first_point + child_num_points < first_point + num_points && octant(points_[child_first_point + child_num_points]) == child) ++child_num_points;
+			if(child_num_points == 0) continue;
+			Bound child_bound = bound;
+			if(child & 1) child_bound.a_.x_ = split.x_; else child_bound.g_.x_ = split.x_;
+			if(child & 2) child_bound.a_.y_ = split.y_; else child_bound.g_.y_ = split.y_;
+			if(child & 4) child_bound.a_.z_ = split.z_; else child_bound.g_.z_ = split.z_;
+			node.children_[child] = build(child_bound, child_first_point, child_num_points, depth + 1);
+			child_first_point += child_num_points;
+		}
+	}
+	nodes_[node_id] = node; //assigned at the end, the children may have reallocated the nodes
+	return node_id;
+}
+
+Rgb SssPointCloud::radiantExitance(const Point3 &p, const DiffusionProfile &profile) const
+{
+	Rgb exitance(0.f);
+	if(nodes_.empty()) return exitance;
+	std::array<int, 8 * (max_depth_global + 1)> stack;
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+	while(stack_size > 0)
+	{
+		const Node &node = nodes_[stack[--stack_size]];
+		const float dist = (p - node.center_).length();
+		if(dist - node.radius_ >= profile.getMaxRadius()) continue;
+		if(node.leaf_)
+		{
+			for(int i = node.first_point_; i < node.first_point_ + node.num_points_; ++i)
+			{
+				const Point &point = points_[i];
+				exitance += profile.eval((p - point.p_).length()) * point.irradiance_ * point.area_;
+			}
+		}
+		else if(node.radius_ < max_error_ * dist) exitance += profile.eval(dist) * node.power_;
+		else
+		{
+			for(const int child : node.children_) if(child >= 0) stack[stack_size++] = child;
+		}
+	}
+	return exitance;
+}
+
+END_YAFARAY
@@ -26,6 +26,7 @@
 #include "volume/volumehandler_sss.h"
 #include "common/logger.h"
 #include "common/param.h"
+#include "math/random.h"
 
 BEGIN_YAFARAY
 
@@ -125,6 +126,37 @@ Rgb DensityVolumeRegion::tau(const Ray &ray, float step_size, float offset) cons
 	return tau_val;
 }
 
+float VolumeRegion::ratioTracking(const Ray &ray, Random &prng) const
+{
+	Bound::Cross cross = crossBound(ray);
+	// ray doesn't hit the BB
+	if(!cross.crossed_) return 1.f;
+	if(ray.tmax_ < cross.enter_ && ray.tmax_ >= 0) return 1.f;
+	if(ray.tmax_ < cross.leave_ && ray.tmax_ >= 0) cross.leave_ = ray.tmax_;
+	if(cross.enter_ < 0.f) cross.enter_ = 0.f;
+
+	const float sigma_maj = majorant();
+	if(sigma_maj <= 0.f) return 1.f;
+	const float inv_sigma_maj = 1.f / sigma_maj;
+
+	// tentative collisions are distributed according to the majorant, each one weighs the transmittance by the probability of it being a null collision
+	float tr = 1.f;
+	float pos = cross.enter_;
+	while(true)
+	{
+		pos -= math::log(1.f - prng()) * inv_sigma_maj;
+		if(pos >= cross.leave_) break;
+		tr *= std::max(0.f, 1.f - sigmaT(ray.from_ + (ray.dir_ * pos), ray.dir_).energy() * inv_sigma_maj);
+		// russian roulette once the contribution gets small, keeps the estimate unbiased
+		if(tr < 0.1f)
+		{
+			if(prng() >= tr) return 0.f;
+			tr = 1.f;
+		}
+	}
+	return tr;
+}
+
 inline float min_global(float a, float b) { return (a > b) ? b : a; }
 inline float max_global(float a, float b) { return (a < b) ? b : a; }
 
@@ -141,7 +173,7 @@ float VolumeRegion::attenuation(const Point3 p, const Light *l) const
 		Y_WARNING << "VolumeRegion: Attenuation Map is missing" << YENDL;
 	}
 
-	const float *attenuation_grid = attenuation_grid_map_.at(l);
+	const float *attenuation_grid = attenuation_grid_map_.at(l)->data();
 
 	float x = (p.x_ - b_box_.a_.x_) / b_box_.longX() * att_grid_x_ - 0.5f;
 	float y = (p.y_ - b_box_.a_.y_) / b_box_.longY() * att_grid_y_ - 0.5f;
@@ -32,6 +32,29 @@ float ExpDensityVolumeRegion::density(Point3 p) const
 	return a_ * math::exp(-b_ * height);
 }
 
+Rgb ExpDensityVolumeRegion::tau(const Ray &ray, float step_size, float offset) const
+{
+	Bound::Cross cross = crossBound(ray);
+	if(!cross.crossed_) return Rgb(0.f);
+	if(ray.tmax_ < cross.enter_ && ray.tmax_ >= 0) return Rgb(0.f);
+	if(ray.tmax_ < cross.leave_ && ray.tmax_ >= 0) cross.leave_ = ray.tmax_;
+	if(cross.enter_ < 0.f) cross.enter_ = 0.f;
+	const float dist = cross.leave_ - cross.enter_;
+	if(dist <= 0.f) return Rgb(0.f);
+
+	// the height changes linearly along the ray, so the density integrates to the difference of the exponentials at both ends divided by their exponent rate
+	const float height_enter = ray.from_.z_ + ray.dir_.z_ * cross.enter_ - b_box_.a_.z_;
+	const float height_leave = ray.from_.z_ + ray.dir_.z_ * cross.leave_ - b_box_.a_.z_;
+	const float exponent_change = b_ * (height_leave - height_enter);
+	float density_integral;
+	if(std::abs(exponent_change) > 1e-4f) density_integral = a_ * dist * (math::exp(-b_ * height_enter) - math::exp(-b_ * height_leave)) / exponent_change;
+	else density_integral = a_ * dist * math::exp(-b_ * 0.5f * (height_enter + height_leave)); // nearly horizontal ray, constant density
+	Rgb sigma_t(0.f);
+	if(have_s_a_) sigma_t += s_a_;
+	if(have_s_s_) sigma_t += s_s_;
+	return sigma_t * density_integral;
+}
+
 std::unique_ptr<VolumeRegion> ExpDensityVolumeRegion::factory(const ParamMap &params, const Scene &scene)
 {
 	float ss = .1f;
@@ -66,6 +89,8 @@ ExpDensityVolumeRegion::ExpDensityVolumeRegion(Rgb sa, Rgb ss, Rgb le, float gg,
 {
 	a_ = aa;
 	b_ = bb;
+	// the density is monotonic in height, so its maximum is at one of the z bounds
+	max_density_ = std::max(a_, a_ * math::exp(-b_ * b_box_.longZ()));
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "ExpDensityVolume vol: " << s_a_ << " " << s_s_ << " " << l_e_ << " " << a_ << " " << b_ << YENDL;
 }
 
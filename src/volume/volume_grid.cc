@@ -28,33 +28,57 @@ struct PSample;
 
 float GridVolumeRegion::density(Point3 p) const
 {
-	float x = (p.x_ - b_box_.a_.x_) / b_box_.longX() * size_x_ - .5f;
-	float y = (p.y_ - b_box_.a_.y_) / b_box_.longY() * size_y_ - .5f;
-	float z = (p.z_ - b_box_.a_.z_) / b_box_.longZ() * size_z_ - .5f;
-
-	int x_0 = std::max(0, static_cast<int>(floor(x)));
-	int y_0 = std::max(0, static_cast<int>(floor(y)));
-	int z_0 = std::max(0, static_cast<int>(floor(z)));
-
-	int x_1 = std::min(size_x_ - 1, static_cast<int>(ceil(x)));
-	int y_1 = std::min(size_y_ - 1, static_cast<int>(ceil(y)));
-	int z_1 = std::min(size_z_ - 1, static_cast<int>(ceil(z)));
-
-	float xd = x - x_0;
-	float yd = y - y_0;
-	float zd = z - z_0;
-
-	float i_1 = grid_[x_0][y_0][z_0] * (1 - zd) + grid_[x_0][y_0][z_1] * zd;
-	float i_2 = grid_[x_0][y_1][z_0] * (1 - zd) + grid_[x_0][y_1][z_1] * zd;
-	float j_1 = grid_[x_1][y_0][z_0] * (1 - zd) + grid_[x_1][y_0][z_1] * zd;
-	float j_2 = grid_[x_1][y_1][z_0] * (1 - zd) + grid_[x_1][y_1][z_1] * zd;
+	const float x = (p.x_ - b_box_.a_.x_) / b_box_.longX() * grid_.getSizeX() - .5f;
+	const float y = (p.y_ - b_box_.a_.y_) / b_box_.longY() * grid_.getSizeY() - .5f;
+	const float z = (p.z_ - b_box_.a_.z_) / b_box_.longZ() * grid_.getSizeZ() - .5f;
+	return grid_.interpolate(x, y, z);
+}
 
-	float w_1 = i_1 * (1 - yd) + i_2 * yd;
-	float w_2 = j_1 * (1 - yd) + j_2 * yd;
+Rgb GridVolumeRegion::tau(const Ray &ray, float step_size, float offset) const
+{
+	Bound::Cross cross = crossBound(ray);
+	// ray doesn't hit the BB
+	if(!cross.crossed_) return {0.f};
+	if(ray.tmax_ < cross.enter_ && ray.tmax_ >= 0) return Rgb(0.f);
+	if(ray.tmax_ < cross.leave_ && ray.tmax_ >= 0) cross.leave_ = ray.tmax_;
+	if(cross.enter_ < 0.f) cross.enter_ = 0.f;
+
+	const float voxels_per_unit[3] = { grid_.getSizeX() / b_box_.longX(), grid_.getSizeY() / b_box_.longY(), grid_.getSizeZ() / b_box_.longZ() };
+	const int grid_size[3] = { grid_.getSizeX(), grid_.getSizeY(), grid_.getSizeZ() };
+	float pos = cross.enter_ + offset * step_size;
+	Rgb tau_val(0.f);
+
+	while(pos < cross.leave_)
+	{
+		const Point3 p = ray.from_ + (ray.dir_ * pos);
+		int voxel[3];
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			const float v = (p[axis] - b_box_.a_[axis]) * voxels_per_unit[axis] - .5f;
+			voxel[axis] = std::min(grid_size[axis] - 1, std::max(0, static_cast<int>(std::floor(v))));
+		}
 
-	float dens = w_1 * (1 - xd) + w_2 * xd;
+		if(grid_.blockMax(voxel[0], voxel[1], voxel[2]) > 0.f)
+		{
+			tau_val += sigmaT(p, ray.dir_) * step_size;
+			pos += step_size;
+			continue;
+		}
 
-	return dens;
+		// empty block: jump over it to the first sample position past its exit, keeping the step pattern
+		float t_exit = cross.leave_;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			if(ray.dir_[axis] == 0.f) continue;
+			const int block_start = voxel[axis] & ~SparseGrid::block_mask_;
+			const int block_end = (ray.dir_[axis] > 0.f) ? block_start + SparseGrid::block_size_ : block_start;
+			// voxel centers are offset by half a voxel, the same as in density()
+			const float edge = b_box_.a_[axis] + (block_end + .5f) / voxels_per_unit[axis];
+			t_exit = std::min(t_exit, (edge - ray.from_[axis]) / ray.dir_[axis]);
+		}
+		pos += std::max(1.f, std::ceil((t_exit - pos) / step_size)) * step_size;
+	}
+	return tau_val;
 }
 
 std::unique_ptr<VolumeRegion> GridVolumeRegion::factory(const ParamMap &params, const Scene &scene)
@@ -114,60 +138,25 @@ GridVolumeRegion::GridVolumeRegion(Rgb sa, Rgb ss, Rgb le, float gg, Point3 pmin
 
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "GridVolume: " << dim[0] << " " << dim[1] << " " << dim[2] << " " << file_size << " " << size_per_voxel << YENDL;
 
-	size_x_ = dim[0];
-	size_y_ = dim[1];
-	size_z_ = dim[2];
+	grid_.resize(dim[0], dim[1], dim[2]);
 
-	/*
-	sizeX = 60;
-	sizeY = 60;
-	sizeZ = 60;
-	*/
-
-	grid_ = (float ***)malloc(size_x_ * sizeof(float));
-	for(int x = 0; x < size_x_; ++x)
+	for(int z = 0; z < dim[2]; ++z)
 	{
-		grid_[x] = (float **)malloc(size_y_ * sizeof(float));
-		for(int y = 0; y < size_y_; ++y)
+		for(int y = 0; y < dim[1]; ++y)
 		{
-			grid_[x][y] = (float *)malloc(size_z_ * sizeof(float));
-		}
-	}
-
-	for(int z = 0; z < size_z_; ++z)
-	{
-		for(int y = 0; y < size_y_; ++y)
-		{
-			for(int x = 0; x < size_x_; ++x)
+			for(int x = 0; x < dim[0]; ++x)
 			{
 				int voxel = 0;
 				input_stream.read((char *)&voxel, 1);
-				grid_[x][y][z] = voxel / 255.f;
-				/*
-				float r = sizeX / 2.f;
-				float r2 = r*r;
-				float dist = sqrt((x-r)*(x-r) + (y-r)*(y-r) + (z-r)*(z-r));
-				grid[x][y][z] = (dist < r) ? 1.f-dist/r : 0.0f;
-				*/
+				grid_.setVoxel(x, y, z, voxel / 255.f);
 			}
 		}
 	}
+	grid_.buildMipLevels();
+	max_density_ = grid_.getMax();
 
+	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "GridVolume: " << grid_.getNumAllocatedBlocks() << " of " << grid_.getNumBlocks() << " blocks allocated, " << grid_.getNumMipLevels() << " mip levels" << YENDL;
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "GridVolume: Vol.[" << s_a_ << ", " << s_s_ << ", " << l_e_ << "]" << YENDL;
 }
 
-GridVolumeRegion::~GridVolumeRegion() {
-	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "GridVolume: Freeing grid data" << YENDL;
-
-	for(int x = 0; x < size_x_; ++x)
-	{
-		for(int y = 0; y < size_y_; ++y)
-		{
-			free(grid_[x][y]);
-		}
-		free(grid_[x]);
-	}
-	free(grid_);
-}
-
 END_YAFARAY
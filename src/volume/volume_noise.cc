@@ -21,13 +21,102 @@
 #include "texture/texture.h"
 #include "common/param.h"
 #include "scene/scene.h"
+#include "common/memory_stats.h"
+#include <cmath>
 
 BEGIN_YAFARAY
 
 class RenderData;
 struct PSample;
 
+DensityBrickCache::~DensityBrickCache()
+{
+	for(int brick = 0; brick < num_bricks_; ++brick) delete[] brick_samples_data_[brick].load(std::memory_order_relaxed);
+	MemoryStats::add(MemoryStats::Volumes, -baked_bytes_.load(), 0);
+}
+
+void DensityBrickCache::init(const Bound &bound, int resolution, std::function<float(const Point3 &)> bake_density)
+{
+	if(resolution <= 0) return;
+	bound_ = bound;
+	bake_density_ = std::move(bake_density);
+	const std::array<float, 3> sides {{bound.longX(), bound.longY(), bound.longZ()}};
+	const float largest_side = std::max(sides[0], std::max(sides[1], sides[2]));
+	if(largest_side <= 0.f) return;
+	num_bricks_ = 1;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		// the voxels are close to cubes, with the requested resolution along the largest side
+		voxels_[axis] = std::max(1, static_cast<int>(std::ceil(resolution * sides[axis] / largest_side)));
+		voxel_size_[axis] = sides[axis] / voxels_[axis];
+		bricks_[axis] = (voxels_[axis] + brick_size_ - 1) / brick_size_;
+		num_bricks_ *= bricks_[axis];
+	}
+	brick_samples_data_ = std::unique_ptr<std::atomic<const float *>[]>(new std::atomic<const float *>[num_bricks_]);
+	for(int brick = 0; brick < num_bricks_; ++brick) brick_samples_data_[brick].store(nullptr, std::memory_order_relaxed);
+}
+
+const float *DensityBrickCache::bakeBrick(int brick_x, int brick_y, int brick_z) const
+{
+	float *samples = new float[brick_samples_ * brick_samples_ * brick_samples_];
+	for(int z = 0; z < brick_samples_; ++z)
+	{
+		for(int y = 0; y < brick_samples_; ++y)
+		{
+			for(int x = 0; x < brick_samples_; ++x)
+			{
+				const Point3 p(bound_.a_.x_ + (brick_x * brick_size_ + x) * voxel_size_[0],
+							   bound_.a_.y_ + (brick_y * brick_size_ + y) * voxel_size_[1],
+							   bound_.a_.z_ + (brick_z * brick_size_ + z) * voxel_size_[2]);
+				samples[(z * brick_samples_ + y) * brick_samples_ + x] = bake_density_(p);
+			}
+		}
+	}
+	std::atomic<const float *> &brick = brick_samples_data_[(brick_z * bricks_[1] + brick_y) * bricks_[0] + brick_x];
+	const float *expected = nullptr;
+	if(!brick.compare_exchange_strong(expected, samples, std::memory_order_acq_rel, std::memory_order_acquire))
+	{
+		delete[] samples; // another thread published the brick first
+		return expected;
+	}
+	const int64_t bytes = brick_samples_ * brick_samples_ * brick_samples_ * sizeof(float);
+	baked_bytes_ += bytes;
+	MemoryStats::add(MemoryStats::Volumes, bytes, 0);
+	return samples;
+}
+
+float DensityBrickCache::density(const Point3 &p) const
+{
+	std::array<int, 3> voxel, brick, local;
+	std::array<float, 3> frac;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float u = std::min(std::max((p[axis] - bound_.a_[axis]) / voxel_size_[axis], 0.f), static_cast<float>(voxels_[axis]));
+		voxel[axis] = std::min(static_cast<int>(u), voxels_[axis] - 1);
+		frac[axis] = u - voxel[axis];
+		brick[axis] = voxel[axis] / brick_size_;
+		local[axis] = voxel[axis] - brick[axis] * brick_size_;
+	}
+	const float *samples = brick_samples_data_[(brick[2] * bricks_[1] + brick[1]) * bricks_[0] + brick[0]].load(std::memory_order_acquire);
+	if(!samples) samples = bakeBrick(brick[0], brick[1], brick[2]);
+	const float *s = samples + (local[2] * brick_samples_ + local[1]) * brick_samples_ + local[0];
+	constexpr int dy = brick_samples_, dz = brick_samples_ * brick_samples_;
+	const float d_00 = s[0] + (s[1] - s[0]) * frac[0];
+	const float d_10 = s[dy] + (s[dy + 1] - s[dy]) * frac[0];
+	const float d_01 = s[dz] + (s[dz + 1] - s[dz]) * frac[0];
+	const float d_11 = s[dz + dy] + (s[dz + dy + 1] - s[dz + dy]) * frac[0];
+	const float d_0 = d_00 + (d_10 - d_00) * frac[1];
+	const float d_1 = d_01 + (d_11 - d_01) * frac[1];
+	return d_0 + (d_1 - d_0) * frac[2];
+}
+
 float NoiseVolumeRegion::density(Point3 p) const
+{
+	if(density_cache_.enabled()) return density_cache_.density(p);
+	return noiseDensity(p);
+}
+
+float NoiseVolumeRegion::noiseDensity(const Point3 &p) const
 {
 	float d = tex_dist_noise_->getColor(p * 0.1f).energy();
 
@@ -49,6 +138,7 @@ std::unique_ptr<VolumeRegion> NoiseVolumeRegion::factory(const ParamMap &params,
 	float min[] = {0, 0, 0};
 	float max[] = {0, 0, 0};
 	int att_sc = 1;
+	int cache_resolution = 0;
 	std::string tex_name;
 
 	params.getParam("sigma_s", ss);
@@ -66,6 +156,7 @@ std::unique_ptr<VolumeRegion> NoiseVolumeRegion::factory(const ParamMap &params,
 	params.getParam("maxZ", max[2]);
 	params.getParam("attgridScale", att_sc);
 	params.getParam("texture", tex_name);
+	params.getParam("density_cache_resolution", cache_resolution);
 
 	if(tex_name.empty())
 	{
@@ -81,7 +172,7 @@ std::unique_ptr<VolumeRegion> NoiseVolumeRegion::factory(const ParamMap &params,
 		return nullptr;
 	}
 
-	return std::unique_ptr<VolumeRegion>(new NoiseVolumeRegion(Rgb(sa), Rgb(ss), Rgb(le), g, cov, sharp, dens, Point3(min[0], min[1], min[2]), Point3(max[0], max[1], max[2]), att_sc, noise));
+	return std::unique_ptr<VolumeRegion>(new NoiseVolumeRegion(Rgb(sa), Rgb(ss), Rgb(le), g, cov, sharp, dens, Point3(min[0], min[1], min[2]), Point3(max[0], max[1], max[2]), att_sc, noise, cache_resolution));
 }
 
 END_YAFARAY
@@ -0,0 +1,90 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "volume/volume_region_tree.h"
+#include "volume/volume.h"
+#include <algorithm>
+#include <array>
+
+BEGIN_YAFARAY
+
+void VolumeRegionTree::build(const std::map<std::string, std::unique_ptr<VolumeRegion>> &volume_regions)
+{
+	entries_.clear();
+	nodes_.clear();
+	for(const auto &v : volume_regions) entries_.push_back({v.second.get(), v.second->getBb()});
+	if(entries_.empty()) return;
+	nodes_.reserve(2 * entries_.size());
+	buildNode(0, static_cast<uint32_t>(entries_.size()));
+}
+
+uint32_t VolumeRegionTree::buildNode(uint32_t begin, uint32_t end)
+{
+	const uint32_t node_id = static_cast<uint32_t>(nodes_.size());
+	nodes_.push_back({entries_[begin].bound_, begin, end - begin});
+	Bound centers(entries_[begin].bound_.center(), entries_[begin].bound_.center());
+	for(uint32_t i = begin + 1; i < end; ++i)
+	{
+		nodes_[node_id].bound_ = Bound(nodes_[node_id].bound_, entries_[i].bound_);
+		centers.include(entries_[i].bound_.center());
+	}
+	if(end - begin <= max_leaf_regions_) return node_id;
+
+	//median split along the largest extent of the region centers, which keeps the depth logarithmic
+	const int axis = centers.largestAxis();
+	const uint32_t middle = begin + (end - begin) / 2;
+	std::nth_element(entries_.begin() + begin, entries_.begin() + middle, entries_.begin() + end, [axis](const Entry &a, const Entry &b) { return a.bound_.center()[axis] < b.bound_.center()[axis]; });
+	nodes_[node_id].count_ = 0;
+	buildNode(begin, middle);
+	const uint32_t second_child = buildNode(middle, end);
+	nodes_[node_id].first_ = second_child;
+	return node_id;
+}
+
+void VolumeRegionTree::intersect(const Ray &ray, std::vector<Hit> &hits) const
+{
+	hits.clear();
+	if(nodes_.empty()) return;
+	const float t_max = (ray.tmax_ >= 0.f) ? std::min(ray.tmax_, max_distance_) : max_distance_;
+	std::array<uint32_t, max_depth_> stack;
+	int stack_size = 0;
+	uint32_t node_id = 0;
+	while(true)
+	{
+		const Node &node = nodes_[node_id];
+		if(node.bound_.cross(ray, t_max).crossed_)
+		{
+			if(node.count_ == 0)
+			{
+				stack[stack_size++] = node.first_;
+				++node_id;
+				continue;
+			}
+			for(uint32_t i = node.first_; i < node.first_ + node.count_; ++i)
+			{
+				const Bound::Cross cross = entries_[i].bound_.cross(ray, t_max);
+				if(cross.crossed_) hits.push_back({entries_[i].region_, std::max(cross.enter_, 0.f), std::min(cross.leave_, t_max)});
+			}
+		}
+		if(stack_size == 0) break;
+		node_id = stack[--stack_size];
+	}
+	std::sort(hits.begin(), hits.end(), [](const Hit &a, const Hit &b) { return a.enter_ < b.enter_; });
+}
+
+END_YAFARAY
@@ -72,14 +72,13 @@ float SkyVolumeRegion::p(const Vec3 &w_l, const Vec3 &w_s) const
 float SkyVolumeRegion::phaseRayleigh(const Vec3 &w_l, const Vec3 &w_s) const
 {
 	float costheta = (w_l * w_s);
-	return 3.f / (16.f * M_PI) * (1.f + costheta * costheta) * s_ray_.energy();
+	return rayleigh_factor_ * (1.f + costheta * costheta);
 }
 
 float SkyVolumeRegion::phaseMie(const Vec3 &w_l, const Vec3 &w_s) const
 {
-	float k = 1.55f * g_ - .55f * g_ * g_ * g_;
-	float kcostheta = k * (w_l * w_s);
-	return 1.f / (4.f * M_PI) * (1.f - k * k) / ((1.f - kcostheta) * (1.f - kcostheta)) * s_mie_.energy();
+	float kcostheta = mie_k_ * (w_l * w_s);
+	return mie_factor_ / ((1.f - kcostheta) * (1.f - kcostheta));
 }
 
 
@@ -114,6 +113,10 @@ SkyVolumeRegion::SkyVolumeRegion(Rgb sa, Rgb ss, Rgb le, Point3 pmin, Point3 pma
 	s_s_ = Rgb(0.f);
 	l_e_ = le;
 	g_ = 0.f;
+	//The phase functions only depend on the angle, their constant factors are computed once here instead of in each call
+	rayleigh_factor_ = 3.f / (16.f * M_PI) * s_ray_.energy();
+	mie_k_ = 1.55f * g_ - .55f * g_ * g_ * g_;
+	mie_factor_ = 1.f / (4.f * M_PI) * (1.f - mie_k_ * mie_k_) * s_mie_.energy();
 	if(Y_LOG_HAS_VERBOSE) Y_VERBOSE << "SkyVolume: Vol. [" << s_ray_ << ", " << s_mie_ << ", " << l_e_ << "]" << YENDL;
 }
 
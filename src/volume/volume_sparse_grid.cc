@@ -0,0 +1,154 @@
+/****************************************************************************
+ *      This is part of the libYafaRay package
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation,Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include "volume/volume_sparse_grid.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+BEGIN_YAFARAY
+
+constexpr uint32_t SparseGrid::empty_block_;
+
+void SparseGrid::resize(int size_x, int size_y, int size_z)
+{
+	size_x_ = size_x;
+	size_y_ = size_y;
+	size_z_ = size_z;
+	blocks_x_ = (size_x + block_mask_) >> block_log_2_;
+	blocks_y_ = (size_y + block_mask_) >> block_log_2_;
+	blocks_z_ = (size_z + block_mask_) >> block_log_2_;
+	block_index_.assign(static_cast<size_t>(blocks_x_) * blocks_y_ * blocks_z_, empty_block_);
+	block_data_.clear();
+	mip_levels_.clear();
+}
+
+void SparseGrid::setVoxel(int x, int y, int z, float value)
+{
+	uint32_t &block = block_index_[blockIndex(x, y, z)];
+	if(block == empty_block_)
+	{
+		if(value == 0.f) return; //no need to allocate a block just to store the background value
+		block = static_cast<uint32_t>(block_data_.size() / block_voxels_);
+		block_data_.resize(block_data_.size() + block_voxels_, 0.f);
+	}
+	block_data_[static_cast<size_t>(block) * block_voxels_ + voxelOffset(x, y, z)] = value;
+}
+
+float SparseGrid::interpolate(float x, float y, float z) const
+{
+	const int x_0 = std::max(0, static_cast<int>(std::floor(x)));
+	const int y_0 = std::max(0, static_cast<int>(std::floor(y)));
+	const int z_0 = std::max(0, static_cast<int>(std::floor(z)));
+
+	const int x_1 = std::min(size_x_ - 1, static_cast<int>(std::ceil(x)));
+	const int y_1 = std::min(size_y_ - 1, static_cast<int>(std::ceil(y)));
+	const int z_1 = std::min(size_z_ - 1, static_cast<int>(std::ceil(z)));
+
+	const float xd = x - x_0;
+	const float yd = y - y_0;
+	const float zd = z - z_0;
+
+	const float i_1 = getVoxel(x_0, y_0, z_0) * (1 - zd) + getVoxel(x_0, y_0, z_1) * zd;
+	const float i_2 = getVoxel(x_0, y_1, z_0) * (1 - zd) + getVoxel(x_0, y_1, z_1) * zd;
+	const float j_1 = getVoxel(x_1, y_0, z_0) * (1 - zd) + getVoxel(x_1, y_0, z_1) * zd;
+	const float j_2 = getVoxel(x_1, y_1, z_0) * (1 - zd) + getVoxel(x_1, y_1, z_1) * zd;
+
+	const float w_1 = i_1 * (1 - yd) + i_2 * yd;
+	const float w_2 = j_1 * (1 - yd) + j_2 * yd;
+
+	return w_1 * (1 - xd) + w_2 * xd;
+}
+
+void SparseGrid::buildMipLevels()
+{
+	mip_levels_.clear();
+	if(block_index_.empty()) return;
+	block_data_.shrink_to_fit();
+
+	//level 0: min/max of each block. The interpolation of a voxel also reads its +1 neighbours, so those are included in the range
+	MipLevel level_0;
+	level_0.size_x_ = blocks_x_;
+	level_0.size_y_ = blocks_y_;
+	level_0.size_z_ = blocks_z_;
+	level_0.min_.resize(block_index_.size());
+	level_0.max_.resize(block_index_.size());
+	for(int bz = 0; bz < blocks_z_; ++bz)
+	{
+		for(int by = 0; by < blocks_y_; ++by)
+		{
+			for(int bx = 0; bx < blocks_x_; ++bx)
+			{
+				float min_val = std::numeric_limits<float>::max();
+				float max_val = std::numeric_limits<float>::lowest();
+				const int z_end = std::min(size_z_, (bz + 1) * block_size_ + 1);
+				const int y_end = std::min(size_y_, (by + 1) * block_size_ + 1);
+				const int x_end = std::min(size_x_, (bx + 1) * block_size_ + 1);
+				for(int z = bz * block_size_; z < z_end; ++z)
+				{
+					for(int y = by * block_size_; y < y_end; ++y)
+					{
+						for(int x = bx * block_size_; x < x_end; ++x)
+						{
+							const float value = getVoxel(x, y, z);
+							min_val = std::min(min_val, value);
+							max_val = std::max(max_val, value);
+						}
+					}
+				}
+				const size_t cell = (static_cast<size_t>(bz) * blocks_y_ + by) * blocks_x_ + bx;
+				level_0.min_[cell] = min_val;
+				level_0.max_[cell] = max_val;
+			}
+		}
+	}
+	mip_levels_.push_back(std::move(level_0));
+
+	//coarser levels, each cell covering 2x2x2 cells of the previous level, until a single cell is left
+	while(mip_levels_.back().size_x_ > 1 || mip_levels_.back().size_y_ > 1 || mip_levels_.back().size_z_ > 1)
+	{
+		const MipLevel &prev = mip_levels_.back();
+		MipLevel level;
+		level.size_x_ = (prev.size_x_ + 1) >> 1;
+		level.size_y_ = (prev.size_y_ + 1) >> 1;
+		level.size_z_ = (prev.size_z_ + 1) >> 1;
+		const size_t num_cells = static_cast<size_t>(level.size_x_) * level.size_y_ * level.size_z_;
+		level.min_.assign(num_cells, std::numeric_limits<float>::max());
+		level.max_.assign(num_cells, std::numeric_limits<float>::lowest());
+		for(int z = 0; z < prev.size_z_; ++z)
+		{
+			for(int y = 0; y < prev.size_y_; ++y)
+			{
+				for(int x = 0; x < prev.size_x_; ++x)
+				{
+					const size_t prev_cell = (static_cast<size_t>(z) * prev.size_y_ + y) * prev.size_x_ + x;
+					const size_t cell = (static_cast<size_t>(z >> 1) * level.size_y_ + (y >> 1)) * level.size_x_ + (x >> 1);
+					level.min_[cell] = std::min(level.min_[cell], prev.min_[prev_cell]);
+					level.max_[cell] = std::max(level.max_[cell], prev.max_[prev_cell]);
+				}
+			}
+		}
+		mip_levels_.push_back(std::move(level));
+	}
+	size_t memory_size = vectorMemory_global(block_index_) + vectorMemory_global(block_data_);
+	for(const auto &level : mip_levels_) memory_size += vectorMemory_global(level.min_) + vectorMemory_global(level.max_);
+	memory_tracker_.set(memory_size);
+}
+
+END_YAFARAY
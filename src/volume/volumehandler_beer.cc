@@ -40,8 +40,9 @@ bool BeerVolumeHandler::transmittance(const RenderData &render_data, const Ray &
 		return true;
 	}
 	float dist = ray.tmax_; // maybe substract ray.tmin...
-	Rgb be(-dist * sigma_a_);
-	col = Rgb(math::exp(be.getR()), math::exp(be.getG()), math::exp(be.getB()));
+	float be[4] = { -dist * sigma_a_.r_, -dist * sigma_a_.g_, -dist * sigma_a_.b_, 0.f };
+	math::exp(be, be, 4);
+	col = Rgb(be[0], be[1], be[2]);
 	return true;
 }
 
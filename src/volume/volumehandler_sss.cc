@@ -24,9 +24,18 @@
 
 BEGIN_YAFARAY
 
-SssVolumeHandler::SssVolumeHandler(const Rgb &a_col, const Rgb &s_col, double dist):
+SssVolumeHandler::SssVolumeHandler(const Rgb &a_col, const Rgb &s_col, double dist, Mode mode, float ior):
 		BeerVolumeHandler(a_col, dist), dist_s_(dist), scatter_col_(s_col)
-{}
+{
+	if(mode == Mode::Diffusion)
+	{
+		//The random walk scatters every dist_s_ on average and keeps scatter_col_ of the light in each event, the rest is absorbed
+		const float sigma_s = (dist_s_ > 0.f) ? 1.f / dist_s_ : 1.f;
+		const Rgb sigma_s_reduced = scatter_col_ * sigma_s;
+		const Rgb sigma_a = getSigmaA() + (Rgb(1.f) - scatter_col_) * sigma_s;
+		diffusion_profile_ = std::unique_ptr<const DiffusionProfile>(new DiffusionProfile(sigma_a, sigma_s_reduced, ior));
+	}
+}
 
 bool SssVolumeHandler::scatter(const RenderData &render_data, const Ray &ray, Ray &s_ray, PSample &s) const
 {
@@ -42,10 +51,15 @@ std::unique_ptr<VolumeHandler> SssVolumeHandler::factory(const ParamMap &params,
 {
 	Rgb a_col(0.5f), s_col(0.8f);
 	double dist = 1.f;
+	std::string mode_str = "random_walk";
+	float ior = 1.3f;
 	params.getParam("absorption_col", a_col);
 	params.getParam("absorption_dist", dist);
 	params.getParam("scatter_col", s_col);
-	return std::unique_ptr<VolumeHandler>(new SssVolumeHandler(a_col, s_col, dist));
+	params.getParam("mode", mode_str);
+	params.getParam("ior", ior);
+	const Mode mode = (mode_str == "diffusion") ? Mode::Diffusion : Mode::RandomWalk;
+	return std::unique_ptr<VolumeHandler>(new SssVolumeHandler(a_col, s_col, dist, mode, std::max(1.f, ior)));
 }
 
 END_YAFARAY
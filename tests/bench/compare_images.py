@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Compares the average color of two Radiance HDR renders of the same scene, for instance rendered with and without an
+# integrator option that should not change the result beyond its noise, and fails if they differ more than the tolerance.
+#
+#   python3 compare_images.py [--tolerance 0.05] <reference .hdr> <render .hdr>
+
+import argparse
+import sys
+
+
+def read_hdr(path):
+	with open(path, "rb") as file: data = file.read()
+	pos = 0
+	while True: #header lines, ended by an empty line
+		end = data.index(b"\n", pos)
+		line = data[pos:end]
+		pos = end + 1
+		if not line: break
+	end = data.index(b"\n", pos)
+	resolution = data[pos:end].split()
+	pos = end + 1
+	height, width = int(resolution[1]), int(resolution[3])
+	pixels = []
+	for _ in range(height):
+		if width >= 8 and width < 32768 and data[pos] == 2 and data[pos + 1] == 2 and (data[pos + 2] << 8 | data[pos + 3]) == width:
+			pos += 4
+			channels = []
+			for _ in range(4): #run length encoded scanline, one channel after the other
+				channel = bytearray()
+				while len(channel) < width:
+					count = data[pos]
+					if count > 128:
+						channel += bytes([data[pos + 1]]) * (count - 128)
+						pos += 2
+					else:
+						channel += data[pos + 1:pos + 1 + count]
+						pos += 1 + count
+				channels.append(channel)
+			scanline = zip(*channels)
+		else:
+			scanline = [tuple(data[pos + 4 * x:pos + 4 * x + 4]) for x in range(width)]
+			pos += 4 * width
+		for r, g, b, e in scanline:
+			scale = 2.0 ** (e - 136) if e else 0.0
+			pixels.append((r * scale, g * scale, b * scale))
+	return width, height, pixels
+
+
+def mean_color(pixels):
+	return [sum(pixel[channel] for pixel in pixels) / len(pixels) for channel in range(3)]
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Compares the average color of two Radiance HDR renders")
+	parser.add_argument("reference")
+	parser.add_argument("render")
+	parser.add_argument("--tolerance", type=float, default=0.05, help="largest relative difference of the average of each color channel (default %(default)s)")
+	args = parser.parse_args()
+	reference_width, reference_height, reference = read_hdr(args.reference)
+	width, height, render = read_hdr(args.render)
+	if (width, height) != (reference_width, reference_height):
+		print("%s: %dx%d, but the reference is %dx%d" % (args.render, width, height, reference_width, reference_height))
+		return 1
+	reference_mean, render_mean = mean_color(reference), mean_color(render)
+	differences = [abs(m - r) / r if r > 0.0 else abs(m) for m, r in zip(render_mean, reference_mean)]
+	ok = max(differences) <= args.tolerance
+	print("%s: average %s, reference %s, relative difference %s: %s" % (args.render, ["%.4f" % m for m in render_mean], ["%.4f" % r for r in reference_mean],
+			["%.4f" % d for d in differences], "ok" if ok else "FAILED"))
+	return 0 if ok else 1
+
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,334 @@
+#!/usr/bin/env python3
+# Generates the XML scenes of the YafaRay benchmark suite, rendered with the yafaray-bench tool.
+# The scenes are generated instead of stored, as the high poly and instancing ones would be too big.
+#
+# To run the benchmark, using the terminal do this:
+#   python3 generate_scenes.py <output directory>
+#   yafaray-bench -o results.json <output directory>/scenes.txt
+# or build the "bench" target of the CMake build with the WITH_BENCHMARK option enabled.
+#
+# The --accelerator option sets the scene accelerator of all the scenes, to compare the renders of two accelerators,
+# --image-format the format of the rendered images, for instance "hdr" for the reference images of yafaray-bench,
+# which are saved in linear RGB as yafaray-bench loads them, and --integrator-param name=value sets a parameter of the
+# surface integrator of all the scenes, to compare the renders with and without an integrator option.
+#
+# Each scene stresses a different part of the renderer:
+#   high_poly            accelerator build and traversal of a single dense mesh
+#   instancing           two-level accelerator with many instances of a base object
+#   hdri_exterior        path tracing with an HDRI image based lighting
+#   hdri_courtyard       path tracing with several diffuse bounces in a low walled courtyard under an HDRI sky
+#   photon_interior      photon mapping with final gather in a closed room lit by an area light
+#   sppm_caustics        SPPM caustics of a glass sphere
+#   volumes              single scattering in a uniform volume region
+#   texture_heavy        image texture lookups with mipmaps and EWA filtering
+#   transparent_shadows  shadow rays through several layers of transparent meshes and instances
+
+import argparse
+import math
+import os
+import sys
+
+RES_X = 320
+RES_Y = 240
+ACCELERATOR = "yafaray-bvh"
+IMAGE_FORMAT = "png"
+INTEGRATOR_PARAMS = {}
+TEXTURES_DIR = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "test01"))
+
+
+def texture_path(name):
+	return os.path.join(TEXTURES_DIR, name).replace("\\", "/")
+
+
+class SceneWriter:
+	def __init__(self, path):
+		self.file = open(path, "w")
+		self.file.write('<?xml version="1.0"?>\n<scene>\n\n<scene_parameters>\n\t<type sval="yafaray"/>\n</scene_parameters>\n\n')
+		self.file.write('<layer>\n\t<type sval="combined"/>\n\t<exported_image_name sval="Combined"/>\n\t<exported_image_type sval="ColorAlpha"/>\n</layer>\n\n')
+		self.object_index = 0
+
+	def element(self, tag, name, params, *list_elements):
+		if tag == "integrator" and name == "integrator": params = dict(params, **INTEGRATOR_PARAMS)
+		self.file.write('<%s name="%s">\n' % (tag, name) if name else "<%s>\n" % tag)
+		self.write_params(params, "\t")
+		for list_element in list_elements:
+			self.file.write("\t<list_element>\n")
+			self.write_params(list_element, "\t\t")
+			self.file.write("\t</list_element>\n")
+		self.file.write("</%s>\n\n" % tag)
+
+	def write_params(self, params, indent):
+		for key, value in params.items():
+			if isinstance(value, bool):
+				self.file.write('%s<%s bval="%s"/>\n' % (indent, key, "true" if value else "false"))
+			elif isinstance(value, int):
+				self.file.write('%s<%s ival="%d"/>\n' % (indent, key, value))
+			elif isinstance(value, float):
+				self.file.write('%s<%s fval="%g"/>\n' % (indent, key, value))
+			elif isinstance(value, str):
+				self.file.write('%s<%s sval="%s"/>\n' % (indent, key, value))
+			elif len(value) == 3:
+				self.file.write('%s<%s x="%g" y="%g" z="%g"/>\n' % ((indent, key) + tuple(value)))
+			else:
+				self.file.write('%s<%s r="%g" g="%g" b="%g" a="%g"/>\n' % ((indent, key) + tuple(value)))
+
+	def mesh(self, name, material, vertices, faces, base_object=False, smooth_angle=None):
+		self.file.write('<object>\n\t<object_parameters name="%s">\n' % name)
+		self.write_params({"has_orco": False, "has_uv": False, "is_base_object": base_object, "num_faces": len(faces), "num_vertices": len(vertices), "object_index": self.object_index, "type": "mesh"}, "\t\t")
+		self.file.write("\t</object_parameters>\n")
+		self.file.writelines('\t<p x="%g" y="%g" z="%g"/>\n' % v for v in vertices)
+		self.file.write('\t<set_material sval="%s"/>\n' % material)
+		self.file.writelines('\t<f a="%d" b="%d" c="%d"/>\n' % f for f in faces)
+		self.file.write("</object>\n\n")
+		if smooth_angle is not None: self.file.write('<smooth object_name="%s" angle="%g"/>\n\n' % (name, smooth_angle))
+		self.object_index += 1
+
+	def instance(self, base_object_name, matrix):
+		self.file.write('<instance base_object_name="%s">\n\t<transform' % base_object_name)
+		for i in range(4):
+			for j in range(4): self.file.write(' m%d%d="%g"' % (i, j, matrix[i][j]))
+		self.file.write("/>\n</instance>\n\n")
+
+	def camera(self, eye, target):
+		self.element("camera", "camera", {"type": "perspective", "from": eye, "to": target, "up": (eye[0], eye[1], eye[2] + 1.0), "focal": 1.1, "resx": RES_X, "resy": RES_Y})
+
+	def finish(self, name, render_params, light_names):
+		self.element("output", "output", {"type": "image_output", "image_path": name + "." + IMAGE_FORMAT, "color_space": "LinearRGB" if IMAGE_FORMAT in ("hdr", "exr") else "sRGB", "badge_position": "none", "logging_save_txt": False, "logging_save_html": False})
+		self.element("render_view", "view", {"camera_name": "camera", "light_names": ";".join(light_names)})
+		params = {"AA_passes": 1, "AA_minsamples": 4, "AA_pixelwidth": 1.5, "filter_type": "gauss", "threads": -1, "threads_photons": -1,
+				"tile_size": 32, "tiles_order": "centre", "scene_accelerator": ACCELERATOR, "width": RES_X, "height": RES_Y, "xstart": 0, "ystart": 0}
+		params.update(render_params)
+		self.element("render", None, params)
+		self.file.write("</scene>\n")
+		self.file.close()
+
+
+def diffuse(color):
+	return {"type": "shinydiffusemat", "color": color + (1.0,), "diffuse_reflect": 1.0}
+
+
+def grid_plane(size, z=0.0, divisions=1):
+	vertices = []
+	for i in range(divisions + 1):
+		for j in range(divisions + 1): vertices.append((-size + 2.0 * size * i / divisions, -size + 2.0 * size * j / divisions, z))
+	faces = []
+	for i in range(divisions):
+		for j in range(divisions):
+			v = i * (divisions + 1) + j
+			faces += [(v, v + divisions + 1, v + divisions + 2), (v, v + divisions + 2, v + 1)]
+	return vertices, faces
+
+
+def sphere(center, radius, rings, segments):
+	vertices = [(center[0], center[1], center[2] + radius)]
+	for ring in range(1, rings):
+		theta = math.pi * ring / rings
+		for segment in range(segments):
+			phi = 2.0 * math.pi * segment / segments
+			vertices.append((center[0] + radius * math.sin(theta) * math.cos(phi), center[1] + radius * math.sin(theta) * math.sin(phi), center[2] + radius * math.cos(theta)))
+	vertices.append((center[0], center[1], center[2] - radius))
+	faces = [(0, 1 + s, 1 + (s + 1) % segments) for s in range(segments)]
+	for ring in range(rings - 2):
+		first = 1 + ring * segments
+		for s in range(segments):
+			a, b = first + s, first + (s + 1) % segments
+			faces += [(a, a + segments, b + segments), (a, b + segments, b)]
+	last = len(vertices) - 1
+	first = last - segments
+	faces += [(first + s, last, first + (s + 1) % segments) for s in range(segments)]
+	return vertices, faces
+
+
+def box(corner_min, corner_max, inward=False):
+	(x0, y0, z0), (x1, y1, z1) = corner_min, corner_max
+	vertices = [(x0, y0, z0), (x1, y0, z0), (x1, y1, z0), (x0, y1, z0), (x0, y0, z1), (x1, y0, z1), (x1, y1, z1), (x0, y1, z1)]
+	faces = [(0, 2, 1), (0, 3, 2), (4, 5, 6), (4, 6, 7), (0, 1, 5), (0, 5, 4), (1, 2, 6), (1, 6, 5), (2, 3, 7), (2, 7, 6), (3, 0, 4), (3, 4, 7)]
+	if inward: faces = [(a, c, b) for a, b, c in faces]
+	return vertices, faces
+
+
+def point_light(scene, name, position, power):
+	scene.element("light", name, {"type": "pointlight", "from": position, "color": (1.0, 1.0, 1.0, 1.0), "power": power})
+
+
+def high_poly(scene):
+	scene.element("material", "grey", diffuse((0.8, 0.8, 0.8)))
+	scene.mesh("ground", "grey", *grid_plane(10.0))
+	scene.mesh("sphere", "grey", *sphere((0.0, 0.0, 1.5), 1.5, 500, 1000), smooth_angle=30.0) #about one million triangles
+	point_light(scene, "light", (4.0, -4.0, 6.0), 60.0)
+	scene.element("background", "background", {"type": "constant", "color": (0.2, 0.2, 0.25, 1.0), "power": 1.0})
+	scene.element("integrator", "integrator", {"type": "directlighting", "raydepth": 4, "shadowDepth": 2})
+	scene.element("integrator", "volume_integrator", {"type": "none"})
+	scene.camera((6.0, -6.0, 4.0), (0.0, 0.0, 1.2))
+	return {"background_name": "background", "integrator_name": "integrator", "volintegrator_name": "volume_integrator"}, ["light"]
+
+
+def instancing(scene):
+	scene.element("material", "grey", diffuse((0.8, 0.8, 0.8)))
+	scene.element("material", "red", diffuse((0.8, 0.2, 0.1)))
+	scene.mesh("ground", "grey", *grid_plane(60.0))
+	scene.mesh("rock", "red", *sphere((0.0, 0.0, 0.0), 0.3, 24, 48), base_object=True, smooth_angle=60.0)
+	for i in range(100):
+		for j in range(100): #ten thousand instances
+			scale = 0.6 + 0.4 * ((i * 7 + j * 13) % 10) / 10.0
+			angle = (i * 3 + j * 5) * 0.37
+			x, y = -50.0 + i + 0.3 * math.sin(j), -50.0 + j + 0.3 * math.cos(i)
+			scene.instance("rock", ((scale * math.cos(angle), -scale * math.sin(angle), 0.0, x), (scale * math.sin(angle), scale * math.cos(angle), 0.0, y), (0.0, 0.0, scale, 0.3 * scale), (0.0, 0.0, 0.0, 1.0)))
+	scene.element("light", "sun", {"type": "sunlight", "direction": (1.0, -1.0, 1.5), "color": (1.0, 0.95, 0.9, 1.0), "power": 2.0, "angle": 0.5, "samples": 2})
+	scene.element("background", "background", {"type": "sunsky", "from": (1.0, -1.0, 1.5), "turbidity": 3.0, "background_light": True, "light_samples": 4, "power": 1.0})
+	scene.element("integrator", "integrator", {"type": "directlighting", "raydepth": 4, "shadowDepth": 2})
+	scene.element("integrator", "volume_integrator", {"type": "none"})
+	scene.camera((-52.0, -52.0, 6.0), (0.0, 0.0, 0.0))
+	return {"background_name": "background", "integrator_name": "integrator", "volintegrator_name": "volume_integrator"}, ["sun"]
+
+
+def hdri_exterior(scene):
+	scene.element("texture", "hdri", {"type": "image", "filename": texture_path("test01_tex.hdr"), "color_space": "LinearRGB", "interpolate": "bilinear", "image_optimization": "none"})
+	scene.element("material", "grey", diffuse((0.8, 0.8, 0.8)))
+	scene.element("material", "glossy", {"type": "glossy", "color": (0.8, 0.6, 0.3, 1.0), "diffuse_color": (0.3, 0.2, 0.1, 1.0), "diffuse_reflect": 0.5, "glossy_reflect": 0.6, "exponent": 200.0})
+	scene.mesh("ground", "grey", *grid_plane(20.0))
+	for i in range(5): scene.mesh("sphere%d" % i, "glossy", *sphere((-4.0 + 2.0 * i, 0.0, 0.8), 0.8, 32, 64), smooth_angle=60.0)
+	scene.element("background", "background", {"type": "textureback", "texture": "hdri", "ibl": True, "ibl_samples": 8, "power": 1.0})
+	scene.element("integrator", "integrator", {"type": "pathtracing", "raydepth": 6, "shadowDepth": 2, "path_samples": 8, "bounces": 4, "no_recursive": False})
+	scene.element("integrator", "volume_integrator", {"type": "none"})
+	scene.camera((0.0, -9.0, 2.5), (0.0, 0.0, 0.8))
+	return {"background_name": "background", "integrator_name": "integrator", "volintegrator_name": "volume_integrator"}, []
+
+
+def hdri_courtyard(scene):
+	scene.element("texture", "hdri", {"type": "image", "filename": texture_path("test01_tex.hdr"), "color_space": "LinearRGB", "interpolate": "bilinear", "image_optimization": "none"})
+	scene.element("material", "white", diffuse((0.95, 0.95, 0.95)))
+	scene.mesh("ground", "white", *grid_plane(20.0))
+	vertices, faces = box((-3.0, -3.0, 0.0), (3.0, 3.0, 0.5), inward=True)
+	scene.mesh("walls", "white", vertices, faces[4:]) #without the floor and the roof
+	scene.mesh("block", "white", *box((-1.0, -1.0, 0.0), (1.0, 1.0, 0.5)))
+	scene.element("background", "background", {"type": "textureback", "texture": "hdri", "ibl": True, "ibl_samples": 8, "power": 4.0})
+	scene.element("integrator", "integrator", {"type": "pathtracing", "raydepth": 6, "shadowDepth": 2, "path_samples": 8, "bounces": 6, "no_recursive": False})
+	scene.element("integrator", "volume_integrator", {"type": "none"})
+	scene.camera((4.0, -4.0, 4.0), (0.0, 0.0, 0.3))
+	return {"background_name": "background", "integrator_name": "integrator", "volintegrator_name": "volume_integrator"}, []
+
+
+def photon_interior(scene):
+	scene.element("material", "white", diffuse((0.75, 0.75, 0.75)))
+	scene.element("material", "red", diffuse((0.7, 0.1, 0.1)))
+	scene.element("material", "green", diffuse((0.1, 0.6, 0.1)))
+	scene.mesh("room", "white", *box((-3.0, -3.0, 0.0), (3.0, 3.0, 4.0), inward=True))
+	scene.mesh("wall_red", "red", [(-2.99, -3.0, 0.0), (-2.99, 3.0, 0.0), (-2.99, 3.0, 4.0), (-2.99, -3.0, 4.0)], [(0, 1, 2), (0, 2, 3)])
+	scene.mesh("wall_green", "green", [(2.99, -3.0, 0.0), (2.99, -3.0, 4.0), (2.99, 3.0, 4.0), (2.99, 3.0, 0.0)], [(0, 1, 2), (0, 2, 3)])
+	scene.mesh("block_tall", "white", *box((-1.8, 0.0, 0.0), (-0.4, 1.4, 2.5)))
+	scene.mesh("block_short", "white", *box((0.4, -1.2, 0.0), (1.8, 0.2, 1.2)))
+	scene.element("light", "ceiling", {"type": "arealight", "corner": (-0.75, -0.75, 3.98), "point1": (0.75, -0.75, 3.98), "point2": (-0.75, 0.75, 3.98), "color": (1.0, 0.9, 0.8, 1.0), "power": 8.0, "samples": 8})
+	scene.element("background", "background", {"type": "constant", "color": (0.0, 0.0, 0.0, 1.0), "power": 0.0})
+	scene.element("integrator", "integrator", {"type": "photonmapping", "raydepth": 5, "shadowDepth": 2, "photons": 500000, "cPhotons": 0, "caustics": False, "diffuseRadius": 0.2, "search": 100, "bounces": 5, "finalGather": True, "fg_samples": 16, "fg_bounces": 2})
+	scene.element("integrator", "volume_integrator", {"type": "none"})
+	scene.camera((0.0, -2.95, 2.0), (0.0, 0.0, 1.6))
+	return {"background_name": "background", "integrator_name": "integrator", "volintegrator_name": "volume_integrator"}, ["ceiling"]
+
+
+def sppm_caustics(scene):
+	scene.element("material", "grey", diffuse((0.8, 0.8, 0.8)))
+	scene.element("material", "glass", {"type": "glass", "IOR": 1.5, "filter_color": (1.0, 1.0, 1.0, 1.0), "mirror_color": (1.0, 1.0, 1.0, 1.0)})
+	scene.mesh("ground", "grey", *grid_plane(10.0))
+	scene.mesh("sphere", "glass", *sphere((0.0, 0.0, 1.0), 1.0, 64, 128), smooth_angle=60.0)
+	point_light(scene, "light", (-2.0, 2.0, 5.0), 80.0)
+	scene.element("background", "background", {"type": "constant", "color": (0.05, 0.05, 0.05, 1.0), "power": 1.0})
+	scene.element("integrator", "integrator", {"type": "SPPM", "raydepth": 6, "shadowDepth": 2, "photons": 200000, "passNums": 8, "bounces": 6, "photonRadius": 0.3, "searchNum": 50, "times": 1.0, "pmIRE": False})
+	scene.element("integrator", "volume_integrator", {"type": "none"})
+	scene.camera((0.0, -5.0, 3.5), (0.0, 0.0, 0.6))
+	return {"background_name": "background", "integrator_name": "integrator", "volintegrator_name": "volume_integrator"}, ["light"]
+
+
+def volumes(scene):
+	scene.element("material", "grey", diffuse((0.8, 0.8, 0.8)))
+	scene.mesh("ground", "grey", *grid_plane(10.0))
+	scene.mesh("pillar", "grey", *box((-0.5, -0.5, 0.0), (0.5, 0.5, 3.0)))
+	point_light(scene, "light", (-1.5, 2.5, 4.0), 60.0)
+	scene.element("volumeregion", "fog", {"type": "UniformVolume", "sigma_s": 0.1, "sigma_a": 0.02, "l_e": 0.0, "g": 0.3, "minX": -5.0, "minY": -5.0, "minZ": 0.0, "maxX": 5.0, "maxY": 5.0, "maxZ": 5.0, "attgridScale": 5})
+	scene.element("background", "background", {"type": "constant", "color": (0.0, 0.0, 0.0, 1.0), "power": 0.0})
+	scene.element("integrator", "integrator", {"type": "directlighting", "raydepth": 4, "shadowDepth": 2})
+	scene.element("integrator", "volume_integrator", {"type": "SingleScatterIntegrator", "stepSize": 0.2, "adaptive": True, "optimize": True})
+	scene.camera((0.0, -8.0, 2.5), (0.0, 0.0, 1.5))
+	return {"background_name": "background", "integrator_name": "integrator", "volintegrator_name": "volume_integrator"}, ["light"]
+
+
+def texture_heavy(scene):
+	images = ["test01_tex.png", "test01_tex.jpg", "test01_tex.tga", "test01_tex.tif", "test01_tex.exr", "test01_tex.hdr"]
+	interpolations = ["bilinear", "bicubic", "mipmap_trilinear", "mipmap_ewa"]
+	scene.element("material", "grey", diffuse((0.8, 0.8, 0.8)))
+	scene.mesh("ground", "grey", *grid_plane(10.0))
+	for i in range(len(images) * len(interpolations)):
+		image, interpolation = images[i % len(images)], interpolations[i // len(images)]
+		texture, material = "texture%d" % i, "textured%d" % i
+		scene.element("texture", texture, {"type": "image", "filename": texture_path(image), "color_space": "LinearRGB" if image.endswith(("exr", "hdr")) else "sRGB",
+				"interpolate": interpolation, "ewa_max_anisotropy": 8.0, "clipping": "repeat", "xrepeat": 1 + i % 4, "yrepeat": 1 + i % 4})
+		scene.element("material", material, {"type": "shinydiffusemat", "color": (0.8, 0.8, 0.8, 1.0), "diffuse_reflect": 1.0, "diffuse_shader": "diffuse_layer"},
+				{"element": "shader_node", "type": "layer", "name": "diffuse_layer", "input": "mapper", "blend_mode": "mix", "colfac": 1.0, "color_input": True, "do_color": True,
+				"do_scalar": False, "def_col": (1.0, 0.0, 1.0, 1.0), "upper_color": (0.8, 0.8, 0.8, 1.0), "upper_value": 0.0},
+				{"element": "shader_node", "type": "texture_mapper", "name": "mapper", "texture": texture, "texco": "global", "mapping": "cube", "proj_x": 1, "proj_y": 2, "proj_z": 3,
+				"offset": (0.0, 0.0, 0.0), "scale": (1.0, 1.0, 1.0)})
+		x, y = -5.0 + 2.0 * (i % 6), -3.0 + 2.0 * (i // 6)
+		scene.mesh("cube%d" % i, material, *box((x - 0.7, y - 0.7, 0.0), (x + 0.7, y + 0.7, 1.4)))
+	point_light(scene, "light", (2.0, -6.0, 8.0), 120.0)
+	scene.element("background", "background", {"type": "constant", "color": (0.3, 0.3, 0.3, 1.0), "power": 1.0})
+	scene.element("integrator", "integrator", {"type": "directlighting", "raydepth": 4, "shadowDepth": 2})
+	scene.element("integrator", "volume_integrator", {"type": "none"})
+	scene.camera((0.0, -14.0, 5.0), (0.0, 1.0, 0.0))
+	return {"background_name": "background", "integrator_name": "integrator", "volintegrator_name": "volume_integrator"}, ["light"]
+
+
+def transparent_shadows(scene):
+	scene.element("material", "grey", diffuse((0.8, 0.8, 0.8)))
+	scene.element("material", "tinted", {"type": "shinydiffusemat", "color": (0.9, 0.5, 0.2, 1.0), "diffuse_reflect": 1.0, "transparency": 0.7, "transmit_filter": 1.0})
+	scene.element("material", "glass", {"type": "glass", "IOR": 1.5, "filter_color": (0.6, 0.8, 1.0, 1.0), "mirror_color": (1.0, 1.0, 1.0, 1.0), "transmit_filter": 1.0, "fake_shadows": True})
+	scene.mesh("ground", "grey", *grid_plane(10.0))
+	for i in range(4): scene.mesh("panel%d" % i, "tinted", *box((-3.0, -2.0 + i, 0.5), (3.0, -1.9 + i, 3.0)))
+	scene.mesh("bubble", "glass", *sphere((0.0, 0.0, 0.0), 0.4, 16, 32), base_object=True, smooth_angle=60.0)
+	for i in range(5):
+		for j in range(3): scene.instance("bubble", ((1.0, 0.0, 0.0, -2.0 + i), (0.0, 1.0, 0.0, 2.5 + j), (0.0, 0.0, 1.0, 1.5 + 0.3 * ((i + j) % 3)), (0.0, 0.0, 0.0, 1.0)))
+	point_light(scene, "light", (0.5, 8.0, 7.0), 150.0)
+	scene.element("background", "background", {"type": "constant", "color": (0.2, 0.2, 0.25, 1.0), "power": 1.0})
+	scene.element("integrator", "integrator", {"type": "directlighting", "raydepth": 4, "transpShad": True, "shadowDepth": 8})
+	scene.element("integrator", "volume_integrator", {"type": "none"})
+	scene.camera((7.0, -7.0, 5.0), (0.0, 1.0, 0.5))
+	return {"background_name": "background", "integrator_name": "integrator", "volintegrator_name": "volume_integrator"}, ["light"]
+
+
+SCENES = [high_poly, instancing, hdri_exterior, hdri_courtyard, photon_interior, sppm_caustics, volumes, texture_heavy, transparent_shadows]
+
+
+def parse_value(value):
+	if value in ("true", "false"): return value == "true"
+	for value_type in (int, float):
+		try: return value_type(value)
+		except ValueError: pass
+	return value
+
+
+def main():
+	global ACCELERATOR, IMAGE_FORMAT
+	parser = argparse.ArgumentParser(description="Generates the XML scenes of the YafaRay benchmark suite")
+	parser.add_argument("output_dir", help="directory of the scenes and of the scenes.txt scene list")
+	parser.add_argument("--accelerator", default=ACCELERATOR, help="scene accelerator of all the scenes (default %(default)s)")
+	parser.add_argument("--image-format", default=IMAGE_FORMAT, help="extension of the rendered images (default %(default)s)")
+	parser.add_argument("--integrator-param", action="append", default=[], metavar="NAME=VALUE", help="parameter of the surface integrator of all the scenes, can be repeated")
+	args = parser.parse_args()
+	ACCELERATOR, IMAGE_FORMAT = args.accelerator, args.image_format
+	for integrator_param in args.integrator_param:
+		name, value = integrator_param.split("=", 1)
+		INTEGRATOR_PARAMS[name] = parse_value(value)
+	output_dir = args.output_dir
+	if not os.path.isdir(output_dir): os.makedirs(output_dir)
+	with open(os.path.join(output_dir, "scenes.txt"), "w") as scene_list:
+		for generate in SCENES:
+			name = generate.__name__
+			scene = SceneWriter(os.path.join(output_dir, name + ".xml"))
+			render_params, light_names = generate(scene)
+			scene.finish(name, render_params, light_names)
+			scene_list.write(name + ".xml\n")
+			print("Generated %s" % os.path.join(output_dir, name + ".xml"))
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())